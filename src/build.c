@@ -12,6 +12,10 @@
  * are supposed to be match states, and then hand this info to
  * matassign2hmm().
  * 
+ * With <bld->Mcpu> threads, the column occupancies, the faux traces
+ * and the counts of a big alignment are split over threads; see
+ * split_work().
+ * 
  * 
  * Contents:
  *    1. Exported API: model construction routines.
@@ -24,16 +28,55 @@
 
 #include <string.h>
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_msa.h"
 #include "esl_msafile.h"
+#include "esl_vectorops.h"
 
 #include "hmmer.h"
 
-static int do_modelmask( ESL_MSA *msa);
-static int matassign2hmm(ESL_MSA *msa, int *matassign, P7_HMM **ret_hmm, P7_TRACE ***opt_tr);
-static int annotate_model(P7_HMM *hmm, int *matassign, ESL_MSA *msa);
+/* Splitting one alignment over threads (bld->Mcpu): work is handed
+ * out in blocks of this many columns or sequences; and the counts
+ * are collected in at most p7_BUILD_NCOUNT partial count models, one
+ * per fixed range of sequences, summed in order at the end. The
+ * ranges depend only on the alignment, so the model is the same for
+ * any number of threads. Alignments of fewer than p7_BUILD_MINSEQ
+ * sequences aren't worth splitting.
+ */
+#define p7_BUILD_BLOCK   256
+#define p7_BUILD_NCOUNT  32
+#define p7_BUILD_MINSEQ  2048
+
+enum buildstage_e { p7_BUILD_COLUMNS = 0, p7_BUILD_TRACES = 1, p7_BUILD_COUNTS = 2 };
+
+typedef struct {
+  enum buildstage_e stage;
+  ESL_MSA   *msa;
+  int       *matassign;
+  float      symfrac;	/* for p7_BUILD_COLUMNS                           */
+  P7_TRACE **tr;	/* for p7_BUILD_TRACES, p7_BUILD_COUNTS           */
+  P7_HMM   **part;	/* for p7_BUILD_COUNTS: part[c] counts range c    */
+  int        npart;
+  int        w;		/* this worker does blocks w, w+nw, w+2nw...      */
+  int        nw;
+  int        status;
+#ifdef HMMER_THREADS
+  pthread_t  thread;
+#endif
+} BUILD_WORKER;
+
+static int   do_modelmask( ESL_MSA *msa);
+static int   matassign2hmm(ESL_MSA *msa, int *matassign, int ncpu, P7_HMM **ret_hmm, P7_TRACE ***opt_tr);
+static int   annotate_model(P7_HMM *hmm, int *matassign, ESL_MSA *msa);
+static void  assign_columns(const ESL_MSA *msa, float symfrac, int *matassign, int a1, int a2);
+static int   make_traces   (ESL_MSA *msa, int *matassign, int i1, int i2, P7_TRACE **tr);
+static void *build_worker  (void *arg);
+static int   split_work    (BUILD_WORKER *proto, int ncpu);
 
 /*****************************************************************
  * 1. Exported API: model construction routines.
@@ -94,7 +137,7 @@ p7_Handmodelmaker(ESL_MSA *msa, P7_BUILDER *bld, P7_HMM **ret_hmm, P7_TRACE ***o
     matassign[apos] = (esl_abc_CIsGap(msa->abc, msa->rf[apos-1])? FALSE : TRUE);
 
   /* matassign2hmm leaves ret_hmm, opt_tr in their proper state: */
-  if ((status = matassign2hmm(msa, matassign, ret_hmm, opt_tr)) != eslOK) goto ERROR;
+  if ((status = matassign2hmm(msa, matassign, (bld ? bld->Mcpu : 0), ret_hmm, opt_tr)) != eslOK) goto ERROR;
 
   free(matassign);
   return eslOK;
@@ -154,12 +197,10 @@ p7_Handmodelmaker(ESL_MSA *msa, P7_BUILDER *bld, P7_HMM **ret_hmm, P7_TRACE ***o
 int
 p7_Fastmodelmaker(ESL_MSA *msa, float symfrac, P7_BUILDER *bld, P7_HMM **ret_hmm, P7_TRACE ***opt_tr)
 {
-  int      status;	     /* return status flag                  */
-  int     *matassign = NULL; /* MAT state assignments if 1; 1..alen */
-  int      idx;              /* counter over sequences              */
-  int      apos;             /* counter for aligned columns         */
-  float    r;		         /* weighted residue count              */
-  float    totwgt;	     /* weighted residue+gap count          */
+  int           status;	  /* return status flag                  */
+  int          *matassign = NULL; /* MAT state assignments if 1; 1..alen */
+  int           ncpu      = (bld ? bld->Mcpu : 0);
+  BUILD_WORKER  proto;
 
   if (! (msa->flags & eslMSA_DIGITAL)) ESL_XEXCEPTION(eslEINVAL, "need digital MSA");
 
@@ -169,25 +210,21 @@ p7_Fastmodelmaker(ESL_MSA *msa, float symfrac, P7_BUILDER *bld, P7_HMM **ret_hmm
 
   /* Determine weighted sym freq in each column, set matassign[] accordingly.
    */
-  for (apos = 1; apos <= msa->alen; apos++) 
-    {  
-      r = totwgt = 0.;
-      for (idx = 0; idx < msa->nseq; idx++) 
-      {
-        if       (esl_abc_XIsResidue(msa->abc, msa->ax[idx][apos])) { r += msa->wgt[idx]; totwgt += msa->wgt[idx]; }
-        else if  (esl_abc_XIsGap(msa->abc,     msa->ax[idx][apos])) {                     totwgt += msa->wgt[idx]; }
-        else if  (esl_abc_XIsMissing(msa->abc, msa->ax[idx][apos])) continue;
-      }
-      if (r > 0. && r / totwgt >= symfrac) matassign[apos] = TRUE;
-      else                                 matassign[apos] = FALSE;
+  if (ncpu > 0 && msa->nseq >= p7_BUILD_MINSEQ)
+    {
+      proto.stage     = p7_BUILD_COLUMNS;
+      proto.msa       = msa;
+      proto.matassign = matassign;
+      proto.symfrac   = symfrac;
+      if ((status = split_work(&proto, ncpu)) != eslOK) goto ERROR;
     }
-
+  else assign_columns(msa, symfrac, matassign, 1, msa->alen);
 
   /* Once we have matassign calculated, modelmakers behave
    * the same; matassign2hmm() does this stuff (traceback construction,
    * trace counting) and sets up ret_hmm and opt_tr.
    */
-  if ((status = matassign2hmm(msa, matassign, ret_hmm, opt_tr)) != eslOK) {
+  if ((status = matassign2hmm(msa, matassign, ncpu, ret_hmm, opt_tr)) != eslOK) {
     fprintf (stderr, "hmm construction error during trace counting\n");
     goto ERROR;
   }
@@ -248,6 +285,8 @@ do_modelmask( ESL_MSA *msa)
  *           matassign - 1..alen bit flags for column assignments
  *           ret_hmm   - RETURN: counts-form HMM
  *           opt_tr    - optRETURN: array of tracebacks for aseq's
+ *           ncpu      - if nonzero, and the <msa> is big, split traces and counts
+ *                       over this many threads
  *                         
  * Return:   <eslOK> on success.
  *           <eslENORESULT> if no consensus columns are identified.
@@ -255,15 +294,19 @@ do_modelmask( ESL_MSA *msa)
  *           ret_hmm and opt_tr alloc'ed here.
  */
 static int
-matassign2hmm(ESL_MSA *msa, int *matassign, P7_HMM **ret_hmm, P7_TRACE ***opt_tr)
+matassign2hmm(ESL_MSA *msa, int *matassign, int ncpu, P7_HMM **ret_hmm, P7_TRACE ***opt_tr)
 {
   int        status;		/* return status                       */
   P7_HMM    *hmm = NULL;        /* RETURN: new hmm                     */
   P7_TRACE **tr  = NULL;        /* RETURN: 0..nseq-1 fake traces       */
+  P7_HMM   **part = NULL;       /* partial count models, if split      */
+  int      npart = 0;
   int      M;                   /* length of new model in match states */
   int      idx;                 /* counter over sequences              */
   int      apos;                /* counter for aligned columns         */
-  char errbuf[eslERRBUFSIZE];
+  int      c, k;
+  int      do_split = (ncpu > 0 && msa->nseq >= p7_BUILD_MINSEQ);
+  BUILD_WORKER proto;
 
   /* apply the model mask in the 'GC MM' row */
   do_modelmask(msa);
@@ -275,21 +318,54 @@ matassign2hmm(ESL_MSA *msa, int *matassign, P7_HMM **ret_hmm, P7_TRACE ***opt_tr
 
   /* Make fake tracebacks for each seq */
   ESL_ALLOC(tr, sizeof(P7_TRACE *) * msa->nseq);
-  if ((status = p7_trace_FauxFromMSA(msa, matassign, p7_MSA_COORDS, tr))        != eslOK) goto ERROR;
-  for (idx = 0; idx < msa->nseq; idx++)
+  for (idx = 0; idx < msa->nseq; idx++) tr[idx] = NULL;
+  proto.msa       = msa;
+  proto.matassign = matassign;
+  proto.tr        = tr;
+  if (do_split) 
     {
-      if ((status = p7_trace_Doctor(tr[idx], NULL, NULL))                       != eslOK) goto ERROR;
-      if ((status = p7_trace_Validate(tr[idx], msa->abc, msa->ax[idx], errbuf)) != eslOK) 
-	ESL_XEXCEPTION(eslFAIL, "validation failed: %s", errbuf);
+      proto.stage = p7_BUILD_TRACES;
+      if ((status = split_work(&proto, ncpu)) != eslOK) goto ERROR;
     }
+  else if ((status = make_traces(msa, matassign, 0, msa->nseq, tr)) != eslOK) goto ERROR;
 
   /* Build count model from tracebacks */
   if ((hmm    = p7_hmm_Create(M, msa->abc)) == NULL)  { status = eslEMEM; goto ERROR; }
   if ((status = p7_hmm_Zero(hmm))           != eslOK) goto ERROR;
-  for (idx = 0; idx < msa->nseq; idx++) {
-    if (tr[idx] == NULL) continue; /* skip rare examples of empty sequences */
-    if ((status = p7_trace_Count(hmm, msa->ax[idx], msa->wgt[idx], tr[idx])) != eslOK) goto ERROR;
-  }
+  if (do_split)
+    {
+      npart = ESL_MIN(p7_BUILD_NCOUNT, msa->nseq / p7_BUILD_BLOCK);
+      ESL_ALLOC(part, sizeof(P7_HMM *) * npart);
+      for (c = 0; c < npart; c++) part[c] = NULL;
+      for (c = 0; c < npart; c++)
+	{
+	  if ((part[c] = p7_hmm_Create(M, msa->abc)) == NULL)  { status = eslEMEM; goto ERROR; }
+	  if ((status  = p7_hmm_Zero(part[c]))       != eslOK) goto ERROR;
+	}
+      proto.stage = p7_BUILD_COUNTS;
+      proto.part  = part;
+      proto.npart = npart;
+      if ((status = split_work(&proto, ncpu)) != eslOK) goto ERROR;
+
+      for (c = 0; c < npart; c++)
+	{
+	  for (k = 0; k <= M; k++)
+	    {
+	      esl_vec_FAdd(hmm->t[k],   part[c]->t[k],   p7H_NTRANSITIONS);
+	      esl_vec_FAdd(hmm->mat[k], part[c]->mat[k], msa->abc->K);
+	      esl_vec_FAdd(hmm->ins[k], part[c]->ins[k], msa->abc->K);
+	    }
+	  p7_hmm_Destroy(part[c]);
+	  part[c] = NULL;
+	}
+      free(part);
+      part = NULL;
+    }
+  else
+    for (idx = 0; idx < msa->nseq; idx++) {
+      if (tr[idx] == NULL) continue; /* skip rare examples of empty sequences */
+      if ((status = p7_trace_Count(hmm, msa->ax[idx], msa->wgt[idx], tr[idx])) != eslOK) goto ERROR;
+    }
 
   hmm->nseq     = msa->nseq;
   hmm->eff_nseq = msa->nseq;
@@ -313,12 +389,192 @@ matassign2hmm(ESL_MSA *msa, int *matassign, P7_HMM **ret_hmm, P7_TRACE ***opt_tr
   return eslOK;
 
  ERROR:
+  if (part   != NULL) { for (c = 0; c < npart; c++) p7_hmm_Destroy(part[c]); free(part); }
   if (tr     != NULL) p7_trace_DestroyArray(tr, msa->nseq);
   if (hmm    != NULL) p7_hmm_Destroy(hmm);
   if (opt_tr != NULL) *opt_tr = NULL;
   *ret_hmm = NULL;
   return status;
 }
+
+
+/* assign_columns()
+ * 
+ * Set matassign[a1..a2] for columns <a1..a2> of <msa>: TRUE if the
+ * column's weighted residue occupancy is >= <symfrac>.
+ *
+ * Columns are done p7_BUILD_BLOCK at a time, and within a block
+ * sequence by sequence, so each aligned row is read in order instead
+ * of one residue per row per column; on a deep alignment, walking a
+ * column down thousands of rows misses cache on every step. Residue
+ * and gap codes are counted by multiplying the weight by 0/1 tables,
+ * without branches, so the inner loop over a block's columns is
+ * straight-line code the compiler can vectorize. Adding a 0.0 is
+ * exact, so the sums (and the assignment) are the same as adding up
+ * each column's residues in sequence order.
+ */
+static void
+assign_columns(const ESL_MSA *msa, float symfrac, int *matassign, int a1, int a2)
+{
+  float          isres[256];             /* 1.0 for residue codes, else 0.0         */
+  float          iscnt[256];             /* 1.0 for residue and gap codes, else 0.0 */
+  float          r[p7_BUILD_BLOCK];	 /* weighted residue count, per column      */
+  float          totwgt[p7_BUILD_BLOCK]; /* weighted residue+gap count              */
+  const ESL_DSQ *ax;
+  double         wgt;
+  int            idx;                    /* counter over sequences                  */
+  int            apos;                   /* first column of a block                 */
+  int            n;                      /* number of columns in a block            */
+  int            x, j;
+
+  for (x = 0; x < 256; x++)
+    {
+      isres[x] = (x < msa->abc->Kp &&  esl_abc_XIsResidue(msa->abc, x))                                 ? 1.0 : 0.0;
+      iscnt[x] = (x < msa->abc->Kp && (esl_abc_XIsResidue(msa->abc, x) || esl_abc_XIsGap(msa->abc, x))) ? 1.0 : 0.0;
+    }
+
+  for (apos = a1; apos <= a2; apos += p7_BUILD_BLOCK)
+    {
+      n = ESL_MIN(p7_BUILD_BLOCK, a2 - apos + 1);
+      for (j = 0; j < n; j++) r[j] = totwgt[j] = 0.;
+
+      for (idx = 0; idx < msa->nseq; idx++)
+	{
+	  ax  = msa->ax[idx] + apos;
+	  wgt = msa->wgt[idx];
+	  for (j = 0; j < n; j++)
+	    {
+	      r[j]      += wgt * isres[ax[j]];
+	      totwgt[j] += wgt * iscnt[ax[j]];
+	    }
+	}
+
+      for (j = 0; j < n; j++)
+	matassign[apos+j] = (r[j] > 0. && r[j] / totwgt[j] >= symfrac) ? TRUE : FALSE;
+    }
+}
+
+
+/* make_traces()
+ * 
+ * Make doctored, validated faux traces <tr[i1..i2-1]> for seqs
+ * <i1..i2-1> of <msa>. On error, those traces are left NULL; the
+ * caller frees the others.
+ */
+static int
+make_traces(ESL_MSA *msa, int *matassign, int i1, int i2, P7_TRACE **tr)
+{
+  char errbuf[eslERRBUFSIZE];
+  int  idx;
+  int  status;
+
+  if ((status = p7_trace_FauxFromMSARange(msa, matassign, p7_MSA_COORDS, i1, i2, tr))  != eslOK) return status;
+  for (idx = i1; idx < i2; idx++)
+    {
+      if ((status = p7_trace_Doctor(tr[idx], NULL, NULL))                       != eslOK) goto ERROR;
+      if ((status = p7_trace_Validate(tr[idx], msa->abc, msa->ax[idx], errbuf)) != eslOK) 
+	ESL_XEXCEPTION(eslFAIL, "validation failed: %s", errbuf);
+    }
+  return eslOK;
+
+ ERROR:
+  for (idx = i1; idx < i2; idx++) { p7_trace_Destroy(tr[idx]); tr[idx] = NULL; }
+  return status;
+}
+
+
+/* build_worker()
+ * 
+ * Do worker <wk->w>'s share of one stage of a split construction.
+ * The columns and traces are done in blocks of p7_BUILD_BLOCK, dealt
+ * out in turn; the counts in the <npart> fixed sequence ranges.
+ */
+static void *
+build_worker(void *arg)
+{
+  BUILD_WORKER *wk   = (BUILD_WORKER *) arg;
+  ESL_MSA      *msa  = wk->msa;
+  int           n    = (wk->stage == p7_BUILD_COLUMNS ? msa->alen : msa->nseq);
+  int           b, c, i1, i2, idx;
+
+  wk->status = eslOK;
+  if (wk->stage == p7_BUILD_COLUMNS)
+    {
+      for (b = wk->w * p7_BUILD_BLOCK; b < n; b += wk->nw * p7_BUILD_BLOCK)
+	assign_columns(msa, wk->symfrac, wk->matassign, b+1, ESL_MIN(n, b + p7_BUILD_BLOCK));
+    }
+  else if (wk->stage == p7_BUILD_TRACES)
+    {
+      for (b = wk->w * p7_BUILD_BLOCK; b < n; b += wk->nw * p7_BUILD_BLOCK)
+	if ((wk->status = make_traces(msa, wk->matassign, b, ESL_MIN(n, b + p7_BUILD_BLOCK), wk->tr)) != eslOK) break;
+    }
+  else
+    {
+      for (c = wk->w; c < wk->npart; c += wk->nw)
+	{
+	  i1 = (int) ((int64_t) n *  c    / wk->npart);
+	  i2 = (int) ((int64_t) n * (c+1) / wk->npart);
+	  for (idx = i1; idx < i2; idx++)
+	    {
+	      if (wk->tr[idx] == NULL) continue; /* skip rare examples of empty sequences */
+	      if ((wk->status = p7_trace_Count(wk->part[c], msa->ax[idx], msa->wgt[idx], wk->tr[idx])) != eslOK) break;
+	    }
+	  if (wk->status != eslOK) break;
+	}
+    }
+  return NULL;
+}
+
+
+/* split_work()
+ * 
+ * Run the stage described by <proto> on up to <ncpu> threads, the
+ * caller's included, as p7_Calibrate() does with its simulations.
+ * If a thread can't be started, the caller runs its share afterwards.
+ * Return the first nonzero status of any of them.
+ */
+static int
+split_work(BUILD_WORKER *proto, int ncpu)
+{
+  BUILD_WORKER *wk = NULL;
+  int           nw = 1;
+  int           nthr, w;
+  int           status;
+
+#ifdef HMMER_THREADS
+  nw = ESL_MAX(1, ncpu);
+#endif
+  ESL_ALLOC(wk, sizeof(BUILD_WORKER) * nw);
+  for (w = 0; w < nw; w++)
+    {
+      wk[w]        = *proto;
+      wk[w].w      = w;
+      wk[w].nw     = nw;
+      wk[w].status = eslOK;
+    }
+
+  nthr = 1;
+#ifdef HMMER_THREADS
+  for (nthr = 1; nthr < nw; nthr++)
+    if (pthread_create(&(wk[nthr].thread), NULL, build_worker, &(wk[nthr])) != 0) break;
+#endif
+  build_worker(&(wk[0]));
+  for (w = nthr; w < nw; w++)
+    build_worker(&(wk[w]));
+#ifdef HMMER_THREADS
+  for (w = 1; w < nthr; w++)
+    pthread_join(wk[w].thread, NULL);
+#endif
+
+  status = eslOK;
+  for (w = 0; w < nw; w++)
+    if (wk[w].status != eslOK && status == eslOK) status = wk[w].status;
+  free(wk);
+  return status;
+
+ ERROR:
+  return status;
+}
   
 
 
@@ -399,6 +655,7 @@ annotate_model(P7_HMM *hmm, int *matassign, ESL_MSA *msa)
  * 3. Unit tests.
  *****************************************************************/
 #ifdef p7BUILD_TESTDRIVE
+#include "esl_random.h"
 
 /* utest_basic()
  * An MSA to ex{e,o}rcise past demons.
@@ -521,6 +778,91 @@ utest_fragments(void)
   return;
 }
 
+/* assign_columns_rowwise()
+ * The original one-column-at-a-time assign_columns(), for
+ * utest_assign_columns() to compare to.
+ */
+static void
+assign_columns_rowwise(const ESL_MSA *msa, float symfrac, int *matassign, int a1, int a2)
+{
+  int   idx;             /* counter over sequences      */
+  int   apos;            /* counter for aligned columns */
+  float r;		 /* weighted residue count      */
+  float totwgt;	         /* weighted residue+gap count  */
+
+  for (apos = a1; apos <= a2; apos++) 
+    {  
+      r = totwgt = 0.;
+      for (idx = 0; idx < msa->nseq; idx++) 
+      {
+        if       (esl_abc_XIsResidue(msa->abc, msa->ax[idx][apos])) { r += msa->wgt[idx]; totwgt += msa->wgt[idx]; }
+        else if  (esl_abc_XIsGap(msa->abc,     msa->ax[idx][apos])) {                     totwgt += msa->wgt[idx]; }
+        else if  (esl_abc_XIsMissing(msa->abc, msa->ax[idx][apos])) continue;
+      }
+      if (r > 0. && r / totwgt >= symfrac) matassign[apos] = TRUE;
+      else                                 matassign[apos] = FALSE;
+    }
+}
+
+/* utest_assign_columns()
+ * On random weighted alignments of <nseq> sequences and <alen>
+ * columns, assign_columns(), which counts a block of columns at a time
+ * row by row, assigns the same match columns as the original
+ * column-by-column loop, for several <symfrac> thresholds, for the
+ * whole alignment and for ranges that start and end inside a block.
+ * A fraction <insfrac> of the columns are insert-like, almost all
+ * gaps; the rest are mostly residues. All codes turn up, degenerate
+ * residues, '*' and missing data included.
+ */
+static void
+utest_assign_columns(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int nseq, int alen, double insfrac)
+{
+  char     *failmsg   = "failure in build.c::utest_assign_columns() unit test";
+  ESL_MSA  *msa       = esl_msa_CreateDigital(abc, nseq, alen);
+  int      *ma1       = malloc(sizeof(int) * (alen+2));
+  int      *ma2       = malloc(sizeof(int) * (alen+2));
+  double   *pgap      = malloc(sizeof(double) * (alen+1));
+  float     symfrac[] = { 0.0, 0.1, 0.5, 0.9, 1.0 };
+  int       nsymfrac  = 5;
+  int       a1, a2;
+  int       idx, apos, s, t;
+
+  if (msa == NULL || ma1 == NULL || ma2 == NULL || pgap == NULL) esl_fatal(failmsg);
+  for (apos = 1; apos <= alen; apos++)
+    pgap[apos] = (esl_random(rng) < insfrac) ? 0.9 + 0.1 * esl_random(rng) : 0.3 * esl_random(rng);
+  for (idx = 0; idx < nseq; idx++)
+    {
+      msa->wgt[idx]     = (esl_random(rng) < 0.05) ? 0.0 : 2.0 * esl_random(rng);
+      msa->ax[idx][0]   = eslDSQ_SENTINEL;
+      for (apos = 1; apos <= alen; apos++)
+	{
+	  if      (esl_random(rng) < pgap[apos]) msa->ax[idx][apos] = esl_abc_XGetGap(abc);
+	  else if (esl_random(rng) < 0.05)       msa->ax[idx][apos] = esl_rnd_Roll(rng, abc->Kp);  /* any code: degenerate, '*', missing... */
+	  else                                   msa->ax[idx][apos] = esl_rnd_Roll(rng, abc->K);
+	}
+      msa->ax[idx][alen+1] = eslDSQ_SENTINEL;
+    }
+  msa->flags |= eslMSA_HASWGTS;
+
+  for (s = 0; s < nsymfrac; s++)
+    for (t = 0; t < 4; t++)
+      {
+	a1 = (t == 0 ? 1    : 1 + esl_rnd_Roll(rng, alen));
+	a2 = (t == 0 ? alen : a1 + esl_rnd_Roll(rng, alen - a1 + 1));
+	esl_vec_ISet(ma1, alen+2, -1);
+	esl_vec_ISet(ma2, alen+2, -1);
+	assign_columns        (msa, symfrac[s], ma1, a1, a2);
+	assign_columns_rowwise(msa, symfrac[s], ma2, a1, a2);
+	for (apos = 0; apos <= alen+1; apos++)
+	  if (ma1[apos] != ma2[apos]) esl_fatal(failmsg);
+      }
+
+  free(pgap);
+  free(ma1);
+  free(ma2);
+  esl_msa_Destroy(msa);
+}
+
 #endif /*p7BUILD_TESTDRIVE*/
 /*---------------------- end of unit tests -----------------------*/
 
@@ -535,16 +877,38 @@ utest_fragments(void)
 /* gcc -g -Wall -Dp7BUILD_TESTDRIVE -I. -I../easel -L. -L../easel -o build_utest build.c -lhmmer -leasel -lm
  */
 #include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
 
 #include <p7_config.h>
 #include "hmmer.h"
 
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the build module";
+
 int
 main(int argc, char **argv)
 {  
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc = esl_alphabet_Create(eslAMINO);
+
   utest_basic();
   utest_fragments();
+  utest_assign_columns(rng, abc, 200, 3 * p7_BUILD_BLOCK + 17, 0.1);
+  utest_assign_columns(rng, abc, 200, 3 * p7_BUILD_BLOCK + 17, 0.7);   /* insert-heavy */
+  utest_assign_columns(rng, abc, 1,   p7_BUILD_BLOCK,          0.5);
+  utest_assign_columns(rng, abc, 500, 40,                      0.9);
 
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
   return eslOK;
 }
 
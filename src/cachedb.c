@@ -1,4 +1,15 @@
 /* Sequence and profile caches, used by the hmmpgmd daemon.
+ *
+ * Parsing a large hmmpgmd-format FASTA file into a P7_SEQCACHE can
+ * take many minutes. p7_seqcache_WriteSnapshot() saves a loaded cache
+ * as a binary snapshot, <seqfile>.h3s, laid out so that its residue
+ * and header arenas can be used in place; p7_seqcache_Open() maps a
+ * current snapshot instead of parsing <seqfile>, and workers on one
+ * host share its pages.
+ *
+ * A worker short of memory can also pack a loaded cache's residues
+ * five bits apiece with p7_seqcache_Pack(), and unpack each chunk of
+ * targets with p7_seqcache_Unpack() just before searching it.
  */
 #include <p7_config.h>
 
@@ -6,6 +17,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -19,6 +35,26 @@
 #include "hmmpgmd.h"
 
 
+static uint32_t v1_snapmagic = 0xe8b3f3b1; /* snapshot v1: "h3s1" + 0x80808080 */
+
+#define p7_SNAPALIGN 4096	/* snapshot sections start on page boundaries */
+
+/* One sequence in a snapshot; <list> order, offsets into the arenas */
+typedef struct {
+  uint64_t res_off;		/* dsq  - residue_mem                    */
+  uint64_t hdr_off;		/* name - header_mem                     */
+  int64_t  n;
+  int64_t  idx;
+  uint64_t db_key;
+  int64_t  desc_off;		/* offset in description arena; -1: none */
+} SNAP_SEQ;
+
+static int   seqcache_OpenSnapshot(char *seqfile, char *snapfile, P7_SEQCACHE **ret_cache, char *errbuf);
+static int   snapshot_is_current(char *seqfile, char *snapfile);
+static int   snapshot_pad(FILE *fp);
+static int   snapshot_get(char **p, char *end, void *dst, size_t n);
+static char *snapshot_section(char *base, char **p, char *end, uint64_t n);
+
 /* sort routines */
 static int
 sort_seq(const void *p1, const void *p2)
@@ -31,6 +67,17 @@ sort_seq(const void *p1, const void *p2)
   return cmp;
 }
 
+static int
+sort_length(const void *p1, const void *p2)
+{
+  const HMMER_SEQ *s1 = (const HMMER_SEQ *) p1;
+  const HMMER_SEQ *s2 = (const HMMER_SEQ *) p2;
+
+  if (s1->n   != s2->n)   return (s1->n   < s2->n)   ? -1 : 1;
+  if (s1->idx != s2->idx) return (s1->idx < s2->idx) ? -1 : 1;
+  return 0;
+}
+
 int
 p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
 {
@@ -68,6 +115,17 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
 
   if (errbuf) errbuf[0] = '\0';	/* CURRENTLY UNUSED. FIXME */
 
+  /* A current binary snapshot loads in seconds; a bad one is ignored, and we parse <seqfile> */
+  if (esl_sprintf(&ptr, "%s%s", seqfile, p7_SEQCACHE_SNAPSUFFIX) != eslOK) return eslEMEM;
+  if (snapshot_is_current(seqfile, ptr))
+    {
+      status = seqcache_OpenSnapshot(seqfile, ptr, &cache, errbuf);
+      if (status == eslOK)  { free(ptr); *ret_cache = cache; return eslOK; }
+      if (status == eslEMEM){ free(ptr); return status; }
+      printf("Ignoring snapshot %s: %s\n", ptr, (errbuf ? errbuf : "bad format"));
+    }
+  free(ptr);
+
   /* Open the target sequence database */
   if ((status = esl_sqfile_Open(seqfile, eslSQFILE_FASTA, NULL, &sqfp)) != eslOK) return status;
 
@@ -125,7 +183,7 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
   hdr_size = seq_cnt * 10;
 
   total_mem += res_size + hdr_size;
-  ESL_ALLOC(cache->residue_mem, res_size);
+  if ((cache->residue_mem = p7_hugemem_Alloc(res_size)) == NULL) { status = eslEMEM; goto ERROR; }  /* the big one: in hugepages, if they're on */
   ESL_ALLOC(cache->header_mem, hdr_size);
 
   /* position the sequence file to the start of the first sequence.
@@ -261,7 +319,7 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
   if (abc   != NULL) esl_alphabet_Destroy(abc);
   if (cache != NULL) {
     if (cache->header_mem  != NULL) free(cache->header_mem);
-    if (cache->residue_mem != NULL) free(cache->residue_mem);
+    if (cache->residue_mem != NULL) p7_hugemem_Free(cache->residue_mem);
     if (cache->name        != NULL) free(cache->name);
     if (cache->id          != NULL) free(cache->id);
     free(cache);
@@ -272,6 +330,218 @@ p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf)
   return eslEMEM;
 }
 
+/* Function:  p7_seqcache_MoveResidues()
+ * Synopsis:  Move a sequence cache's residues to a new arena.
+ *
+ * Purpose:   Point the sequences of <cache> into <mem>, a new residue
+ *            arena of <cache->res_size> bytes that the caller has
+ *            filled in with the sequences in <list> order: each one's
+ *            leading sentinel and residues (<n>+1 bytes), then a
+ *            final sentinel. (<p7_seqcache_Open()> lays them out the
+ *            same way, but in file order.) The old arena is freed
+ *            unless it is part of a snapshot; the cache takes over
+ *            <mem>.
+ *
+ *            The hmmpgmd worker fills the new arena with a thread
+ *            pinned to each NUMA node, so that each slice of it is in
+ *            the memory of one node, and each sub-database's targets
+ *            are in slice order.
+ *
+ *            Not for a packed cache, which has no residue arena.
+ */
+void
+p7_seqcache_MoveResidues(P7_SEQCACHE *cache, void *mem)
+{
+  ESL_DSQ  *p = (ESL_DSQ *) mem;
+  uint32_t  i;
+
+  for (i = 0; i < cache->count; ++i) {
+    cache->list[i].dsq = p;
+    p += cache->list[i].n + 1;
+  }
+
+  if (cache->snap_mem == NULL || cache->res_moved) p7_hugemem_Free(cache->residue_mem);
+  cache->residue_mem = mem;
+  cache->res_moved   = (cache->snap_mem != NULL);
+}
+
+/* Function:  p7_seqcache_SortByLength()
+ * Synopsis:  Group a sequence cache's targets by length.
+ *
+ * Purpose:   Sort each run of <window> consecutive sequences of
+ *            <cache->list> by length, shortest first (ties in <idx>
+ *            order), and rebuild the sub-databases' target lists to
+ *            follow. The runs themselves stay in the shuffled order
+ *            <p7_seqcache_Open()> gave them, so any large range of
+ *            the list still has the database's mix of lengths, and
+ *            splitting a search evenly over workers by target count
+ *            still splits it evenly by residues; but the chunks of a
+ *            few hundred targets that a worker's threads claim hold
+ *            targets of much the same length, which keeps the DP
+ *            matrices from regrowing, and suits the batch SSV filter.
+ *
+ *            The order only depends on the cache's contents and
+ *            <window>, so a master and its workers that load the
+ *            same database and sort it with the same <window> agree
+ *            on every target's place in the lists. Sorting again
+ *            with the same <window> changes nothing. A <window> of 0
+ *            or 1 leaves the order alone.
+ *
+ *            Hits carry the targets' <idx>, so search results don't
+ *            depend on the order.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqcache_SortByLength(P7_SEQCACHE *cache, uint32_t window)
+{
+  uint32_t *db_inx = NULL;
+  uint64_t  db_key;
+  uint32_t  i, d;
+  int       status;
+
+  if (window < 2) return eslOK;
+
+  for (i = 0; i < cache->count; i += window)
+    qsort(cache->list + i, ESL_MIN(window, cache->count - i), sizeof(HMMER_SEQ), sort_length);
+
+  ESL_ALLOC(db_inx, sizeof(uint32_t) * ESL_MAX(1, cache->db_cnt));
+  for (d = 0; d < cache->db_cnt; ++d) db_inx[d] = 0;
+  for (i = 0; i < cache->count; ++i)
+    for (db_key = cache->list[i].db_key, d = 0; db_key && d < cache->db_cnt; db_key >>= 1, ++d)
+      if ((db_key & 1) && db_inx[d] < cache->db[d].count)
+	cache->db[d].list[db_inx[d]++] = &cache->list[i];
+
+  cache->lsort = window;
+  free(db_inx);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* Function:  p7_seqcache_Pack()
+ * Synopsis:  Pack a sequence cache's residues into five bits apiece.
+ *
+ * Purpose:   Replace the one-byte-per-residue arena of <cache> by a
+ *            packed one in <cache->pack_mem>: <p7_SEQCACHE_PACKRES>
+ *            (12) residue codes of <p7_SEQCACHE_PACKBITS> (5) bits to
+ *            a 64-bit word, low bits first, each sequence starting on
+ *            a word of its own, and no sentinels. That is 5.3 bits a
+ *            residue instead of 8, a third less memory for the
+ *            residues. Each sequence's <pk> points to its first word,
+ *            and its <dsq> becomes <NULL>; callers unpack the
+ *            residues with <p7_seqcache_Unpack()> when they need them.
+ *
+ *            The old arena is freed unless it is part of a snapshot.
+ *            If the snapshot is mapped, its residue pages are simply
+ *            never touched again, and the kernel can drop them.
+ *
+ *            A packed cache can't be saved with
+ *            <p7_seqcache_WriteSnapshot()>, or moved with
+ *            <p7_seqcache_MoveResidues()>.
+ *
+ * Returns:   <eslOK> on success; also if <cache> is already packed.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <eslEINVAL> if a
+ *            residue code doesn't fit in five bits; in both cases
+ *            <cache> is unchanged.
+ */
+int
+p7_seqcache_Pack(P7_SEQCACHE *cache)
+{
+  uint64_t *pk;
+  uint64_t  nwords = 0;
+  uint64_t  w;
+  int64_t   j;
+  uint32_t  i;
+  int       status;
+
+  if (cache->pack_mem != NULL) return eslOK;
+
+  for (i = 0; i < cache->count; ++i)
+    nwords += (cache->list[i].n + p7_SEQCACHE_PACKRES - 1) / p7_SEQCACHE_PACKRES;
+  if ((cache->pack_mem = p7_hugemem_Alloc(sizeof(uint64_t) * ESL_MAX(1, nwords))) == NULL) ESL_XEXCEPTION(eslEMEM, "allocation of packed residues failed");
+
+  pk = cache->pack_mem;
+  for (i = 0; i < cache->count; ++i) {
+    ESL_DSQ *dsq = cache->list[i].dsq;
+
+    for (j = 0, w = 0; j < cache->list[i].n; ++j) {
+      if (dsq[j+1] >> p7_SEQCACHE_PACKBITS) ESL_XEXCEPTION(eslEINVAL, "residue code %d of sequence %d doesn't fit in %d bits", dsq[j+1], (int) i, p7_SEQCACHE_PACKBITS);
+      w |= (uint64_t) dsq[j+1] << (p7_SEQCACHE_PACKBITS * (j % p7_SEQCACHE_PACKRES));
+      if (j % p7_SEQCACHE_PACKRES == p7_SEQCACHE_PACKRES - 1) { *pk++ = w; w = 0; }
+    }
+    if (j % p7_SEQCACHE_PACKRES) *pk++ = w;
+  }
+  cache->pack_size = sizeof(uint64_t) * nwords;
+
+  /* only now that nothing can fail, switch the sequences over */
+  pk = cache->pack_mem;
+  for (i = 0; i < cache->count; ++i) {
+    cache->list[i].pk  = pk;
+    cache->list[i].dsq = NULL;
+    pk += (cache->list[i].n + p7_SEQCACHE_PACKRES - 1) / p7_SEQCACHE_PACKRES;
+  }
+  if (cache->snap_mem == NULL || cache->res_moved) p7_hugemem_Free(cache->residue_mem);
+  cache->residue_mem = NULL;
+  cache->res_moved   = FALSE;
+  return eslOK;
+
+ ERROR:
+  p7_hugemem_Free(cache->pack_mem);
+  cache->pack_mem = NULL;
+  return status;
+}
+
+/* Function:  p7_seqcache_Unpack()
+ * Synopsis:  Unpack one sequence of a packed cache.
+ *
+ * Purpose:   Unpack the residues of <seq>, a sequence of a cache that
+ *            <p7_seqcache_Pack()> has packed, into the caller's
+ *            digital sequence buffer <dsq>, which has room for at
+ *            least <seq->n>+2 codes: <dsq[1..n]>, with sentinels at
+ *            <dsq[0]> and <dsq[n+1]>.
+ */
+void
+p7_seqcache_Unpack(const HMMER_SEQ *seq, ESL_DSQ *dsq)
+{
+  const uint64_t *pk = seq->pk;
+  uint64_t        w  = 0;
+  int64_t         j;
+
+  dsq[0] = eslDSQ_SENTINEL;
+  for (j = 0; j < seq->n; ++j) {
+    if (j % p7_SEQCACHE_PACKRES == 0) w = *pk++;
+    dsq[j+1] = w & ((1 << p7_SEQCACHE_PACKBITS) - 1);
+    w >>= p7_SEQCACHE_PACKBITS;
+  }
+  dsq[seq->n+1] = eslDSQ_SENTINEL;
+}
+
+/* Function:  p7_seqcache_Sizeof()
+ * Synopsis:  Returns total size of a sequence cache, in bytes.
+ */
+size_t
+p7_seqcache_Sizeof(P7_SEQCACHE *cache)
+{
+  size_t   n = sizeof(P7_SEQCACHE);
+  uint32_t i;
+
+  n += sizeof(HMMER_SEQ) * cache->count;
+  n += sizeof(SEQ_DB)    * cache->db_cnt;
+  for (i = 0; i < cache->db_cnt; i++)
+    n += sizeof(HMMER_SEQ *) * cache->db[i].count;
+
+  if      (cache->snap_mem) n += cache->snap_size + (cache->res_moved ? cache->res_size : 0);
+  else if (cache->pack_mem) n += cache->hdr_size;
+  else                      n += cache->res_size  + cache->hdr_size;
+  n += cache->pack_size;
+  return n;
+}
+
 void
 p7_seqcache_Close(P7_SEQCACHE *cache)
 {
@@ -287,13 +557,324 @@ p7_seqcache_Close(P7_SEQCACHE *cache)
       free(cache->db);
     }
   if (cache->abc)         esl_alphabet_Destroy(cache->abc);
+  if (cache->snap_mem)
+    { /* arenas and descriptions live in the snapshot */
+      if (cache->res_moved) p7_hugemem_Free(cache->residue_mem);
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+      if (cache->snap_mapped) munmap(cache->snap_mem, cache->snap_size);
+      else                    free(cache->snap_mem);
+#else
+      free(cache->snap_mem);
+#endif
+    }
+  else
+    {
+      if (cache->list) 
+	for (i = 0; i < cache->count; ++i)
+	  if (cache->list[i].desc) free(cache->list[i].desc);
+      if (cache->residue_mem) p7_hugemem_Free(cache->residue_mem);
+      if (cache->header_mem)  free(cache->header_mem);
+    }
+  if (cache->pack_mem)    p7_hugemem_Free(cache->pack_mem);
   if (cache->list)        free(cache->list);
-  if (cache->residue_mem) free(cache->residue_mem);
-  if (cache->header_mem)  free(cache->header_mem);
   free(cache);
 }
 
 
+/* Function:  p7_seqcache_WriteSnapshot()
+ * Synopsis:  Save a sequence cache as a binary snapshot.
+ *
+ * Purpose:   Save the loaded sequence cache <cache> to the binary
+ *            snapshot file <snapfile>, which is normally
+ *            <cache->name> with the suffix <p7_SEQCACHE_SNAPSUFFIX>
+ *            (".h3s") so <p7_seqcache_Open()> finds it.
+ *
+ *            The snapshot holds the database header, the sequence
+ *            list in its shuffled order, and the header, residue and
+ *            description arenas, each aligned to a page boundary, 
+ *            so that <p7_seqcache_Open()> can map the file and use
+ *            the arenas in place. Like the pressed HMM files, it is
+ *            in native byte order and only readable on the same
+ *            architecture.
+ *
+ *            The file is written under a temporary name and renamed,
+ *            so concurrent readers never see a partial snapshot.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEWRITE> on any open or write failure, with an
+ *            informative message in <errbuf>, if it's non-<NULL>.
+ *            <eslEINVAL> if <cache> is packed (<p7_seqcache_Pack()>).
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqcache_WriteSnapshot(P7_SEQCACHE *cache, char *snapfile, char *errbuf)
+{
+  FILE     *fp        = NULL;
+  char     *tmpfile   = NULL;
+  SNAP_SEQ *rec       = NULL;
+  uint64_t  desc_size = 0;
+  uint32_t  id_len    = strlen(cache->id);
+  uint32_t  idx;
+  int64_t   i;
+  uint32_t  d;
+  int       status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (cache->pack_mem) ESL_FAIL(eslEINVAL, errbuf, "can't snapshot a packed sequence cache");
+
+  ESL_ALLOC(rec, sizeof(SNAP_SEQ) * (cache->count ? cache->count : 1));
+  for (i = 0; i < cache->count; i++)
+    {
+      rec[i].res_off  = (ESL_DSQ *) cache->list[i].dsq - (ESL_DSQ *) cache->residue_mem;
+      rec[i].hdr_off  = cache->list[i].name - cache->header_mem;
+      rec[i].n        = cache->list[i].n;
+      rec[i].idx      = cache->list[i].idx;
+      rec[i].db_key   = cache->list[i].db_key;
+      rec[i].desc_off = -1;
+      if (cache->list[i].desc) {
+	rec[i].desc_off = desc_size;
+	desc_size      += strlen(cache->list[i].desc) + 1;
+      }
+    }
+
+  if ((status = esl_sprintf(&tmpfile, "%s.tmp", snapfile)) != eslOK) goto ERROR;
+  if ((fp = fopen(tmpfile, "wb")) == NULL) ESL_XFAIL(eslEWRITE, errbuf, "failed to open %s for writing", tmpfile);
+
+  if (fwrite(&v1_snapmagic,     sizeof(uint32_t), 1,         fp) != 1)         ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(&cache->count,     sizeof(uint32_t), 1,         fp) != 1)         ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(&cache->db_cnt,    sizeof(uint32_t), 1,         fp) != 1)         ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(&id_len,           sizeof(uint32_t), 1,         fp) != 1)         ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(&cache->res_size,  sizeof(uint64_t), 1,         fp) != 1)         ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(&cache->hdr_size,  sizeof(uint64_t), 1,         fp) != 1)         ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(&desc_size,        sizeof(uint64_t), 1,         fp) != 1)         ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(cache->id,         sizeof(char),     id_len+1,  fp) != id_len+1)  ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+
+  /* sub-databases: sizes, then their members as indices into <list> */
+  for (d = 0; d < cache->db_cnt; d++)
+    {
+      if (fwrite(&cache->db[d].count, sizeof(uint32_t), 1, fp) != 1)            ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+      if (fwrite(&cache->db[d].K,     sizeof(uint32_t), 1, fp) != 1)            ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+      for (i = 0; i < cache->db[d].count; i++) {
+	idx = cache->db[d].list[i] - cache->list;
+	if (fwrite(&idx,              sizeof(uint32_t), 1, fp) != 1)            ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+      }
+    }
+
+  /* the sequence list and the arenas, each page-aligned */
+  if (snapshot_pad(fp)                                                    != eslOK)           ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(rec,                sizeof(SNAP_SEQ), cache->count,    fp) != cache->count)    ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (snapshot_pad(fp)                                                    != eslOK)           ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(cache->header_mem,  sizeof(char),     cache->hdr_size, fp) != cache->hdr_size) ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (snapshot_pad(fp)                                                    != eslOK)           ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(cache->residue_mem, sizeof(char),     cache->res_size, fp) != cache->res_size) ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (snapshot_pad(fp)                                                    != eslOK)           ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  for (i = 0; i < cache->count; i++)
+    if (cache->list[i].desc && fwrite(cache->list[i].desc, sizeof(char), strlen(cache->list[i].desc)+1, fp) != strlen(cache->list[i].desc)+1)
+      ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed");
+  if (fwrite(&v1_snapmagic,      sizeof(uint32_t), 1,               fp) != 1)               ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed"); /* sentinel */
+
+  if (fclose(fp) != 0)            { fp = NULL; ESL_XFAIL(eslEWRITE, errbuf, "snapshot write failed"); }
+  fp = NULL;
+  if (rename(tmpfile, snapfile) != 0)          ESL_XFAIL(eslEWRITE, errbuf, "failed to rename %s to %s", tmpfile, snapfile);
+
+  free(tmpfile);
+  free(rec);
+  return eslOK;
+
+ ERROR:
+  if (fp)      { fclose(fp); remove(tmpfile); }
+  if (tmpfile) free(tmpfile);
+  if (rec)     free(rec);
+  return status;
+}
+
+
+/* snapshot_is_current()
+ *
+ * Return TRUE if <snapfile> exists and is no older than <seqfile>.
+ */
+static int
+snapshot_is_current(char *seqfile, char *snapfile)
+{
+  struct stat seq_st;
+  struct stat snap_st;
+
+  if (stat(snapfile, &snap_st) != 0) return FALSE;
+  if (stat(seqfile,  &seq_st)  != 0) return TRUE;  /* snapshot alone is fine */
+  return (snap_st.st_mtime >= seq_st.st_mtime) ? TRUE : FALSE;
+}
+
+/* snapshot_pad()
+ *
+ * Write zeros to <fp> up to the next <p7_SNAPALIGN> file offset.
+ */
+static int
+snapshot_pad(FILE *fp)
+{
+  off_t offset;
+
+  if ((offset = ftello(fp)) < 0) return eslEWRITE;
+  for ( ; offset % p7_SNAPALIGN; offset++)
+    if (fputc('\0', fp) == EOF) return eslEWRITE;
+  return eslOK;
+}
+
+/* snapshot_get()
+ *
+ * Copy the next <n> bytes of the snapshot at <*p> to <dst>, and
+ * advance <*p>; fail with <eslEFORMAT> if that runs past <end>.
+ */
+static int
+snapshot_get(char **p, char *end, void *dst, size_t n)
+{
+  if (n > (size_t) (end - *p)) return eslEFORMAT;
+  memcpy(dst, *p, n);
+  *p += n;
+  return eslOK;
+}
+
+/* snapshot_section()
+ *
+ * Return a pointer to the next <n>-byte, page-aligned section of the
+ * snapshot that starts at <base>. Advance <*p> past it. Return NULL
+ * if the section runs past <end>.
+ */
+static char *
+snapshot_section(char *base, char **p, char *end, uint64_t n)
+{
+  uint64_t off = ((*p - base + p7_SNAPALIGN - 1) / p7_SNAPALIGN) * p7_SNAPALIGN;
+  char    *s   = base + off;
+
+  if (off > (uint64_t) (end - base) || n > (uint64_t) (end - s)) return NULL;
+  *p = s + n;
+  return s;
+}
+
+/* seqcache_OpenSnapshot()
+ *
+ * Load the sequence cache for <seqfile> from its binary snapshot
+ * <snapfile>, written by <p7_seqcache_WriteSnapshot()>. Where mmap()
+ * is available, the file is mapped read-only and shared, and the
+ * residue, header and description arenas are used in place; only
+ * the <list> of sequences and the sub-database lists are rebuilt,
+ * which is linear in the number of sequences, not residues.
+ * Otherwise we read the whole file into memory.
+ *
+ * Returns <eslOK> on success; <eslENOTFOUND> if <snapfile> can't be
+ * opened; <eslEFORMAT> if it is truncated or not a snapshot, with a
+ * message in <errbuf> if it's non-<NULL>. Throws <eslEMEM> on
+ * allocation failure.
+ */
+static int
+seqcache_OpenSnapshot(char *seqfile, char *snapfile, P7_SEQCACHE **ret_cache, char *errbuf)
+{
+  P7_SEQCACHE *cache  = NULL;
+  FILE        *fp     = NULL;
+  char        *base   = NULL;
+  char        *end;
+  char        *p;
+  SNAP_SEQ    *rec;
+  char        *desc_mem;
+  struct stat  st;
+  uint32_t     magic;
+  uint32_t     id_len;
+  uint32_t     idx;
+  uint64_t     desc_size;
+  int64_t      i;
+  uint32_t     d;
+  int          status;
+
+  ESL_ALLOC(cache, sizeof(P7_SEQCACHE));
+  memset(cache, 0, sizeof(P7_SEQCACHE));
+
+  if ((fp = fopen(snapfile, "rb")) == NULL)            ESL_XFAIL(eslENOTFOUND, errbuf, "failed to open %s", snapfile);
+  if (fstat(fileno(fp), &st) != 0 || st.st_size == 0)  ESL_XFAIL(eslEFORMAT,   errbuf, "%s is empty", snapfile);
+  cache->snap_size = st.st_size;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  base = mmap(NULL, cache->snap_size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+  if (base == MAP_FAILED) base = NULL;
+  else {
+    cache->snap_mapped = TRUE;
+#ifdef MADV_WILLNEED
+    madvise(base, cache->snap_size, MADV_WILLNEED); /* start paging in residues while we build the lists */
+#endif
+  }
+#endif
+  if (base == NULL)
+    {
+      ESL_ALLOC(base, cache->snap_size);
+      if (fread(base, sizeof(char), cache->snap_size, fp) != cache->snap_size) { free(base); ESL_XFAIL(eslEFORMAT, errbuf, "failed to read %s", snapfile); }
+    }
+  cache->snap_mem = base;
+  fclose(fp); fp = NULL;
+
+  p   = base;
+  end = base + cache->snap_size;
+  if (snapshot_get(&p, end, &magic,            sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (magic != v1_snapmagic)                                               ESL_XFAIL(eslEFORMAT, errbuf, "bad magic; not a sequence cache snapshot");
+  if (snapshot_get(&p, end, &cache->count,     sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (snapshot_get(&p, end, &cache->db_cnt,    sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (snapshot_get(&p, end, &id_len,           sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (snapshot_get(&p, end, &cache->res_size,  sizeof(uint64_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (snapshot_get(&p, end, &cache->hdr_size,  sizeof(uint64_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (snapshot_get(&p, end, &desc_size,        sizeof(uint64_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (cache->db_cnt > 32)                                                  ESL_XFAIL(eslEFORMAT, errbuf, "too many sub-databases");
+
+  ESL_ALLOC(cache->id, id_len+1);
+  if (snapshot_get(&p, end, cache->id,         id_len+1)         != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  cache->id[id_len] = '\0';
+  if (esl_strdup(seqfile, -1, &cache->name) != eslOK)                      { status = eslEMEM; goto ERROR; }
+
+  ESL_ALLOC(cache->list, sizeof(HMMER_SEQ) * (cache->count ? cache->count : 1));
+  ESL_ALLOC(cache->db,   sizeof(SEQ_DB)    * (cache->db_cnt ? cache->db_cnt : 1));
+  for (d = 0; d < cache->db_cnt; d++) cache->db[d].list = NULL;
+  for (d = 0; d < cache->db_cnt; d++)
+    {
+      if (snapshot_get(&p, end, &cache->db[d].count, sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+      if (snapshot_get(&p, end, &cache->db[d].K,     sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+      ESL_ALLOC(cache->db[d].list, sizeof(HMMER_SEQ *) * (cache->db[d].count ? cache->db[d].count : 1));
+      for (i = 0; i < cache->db[d].count; i++) {
+	if (snapshot_get(&p, end, &idx, sizeof(uint32_t)) != eslOK)        ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+	if (idx >= cache->count)                                           ESL_XFAIL(eslEFORMAT, errbuf, "bad sub-database index");
+	cache->db[d].list[i] = cache->list + idx;
+      }
+    }
+
+  if ((rec                = (SNAP_SEQ *) snapshot_section(base, &p, end, sizeof(SNAP_SEQ) * cache->count)) == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if ((cache->header_mem  =              snapshot_section(base, &p, end, cache->hdr_size))                 == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if ((cache->residue_mem =              snapshot_section(base, &p, end, cache->res_size))                 == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if ((desc_mem           =              snapshot_section(base, &p, end, desc_size))                       == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "truncated snapshot");
+  if (snapshot_get(&p, end, &magic, sizeof(uint32_t)) != eslOK || magic != v1_snapmagic)                           ESL_XFAIL(eslEFORMAT, errbuf, "bad sentinel; snapshot corrupted?");
+
+  for (i = 0; i < cache->count; i++)
+    {
+      if (rec[i].res_off + rec[i].n + 1 > cache->res_size || rec[i].hdr_off >= cache->hdr_size) ESL_XFAIL(eslEFORMAT, errbuf, "bad offsets for sequence %d", (int) i);
+      if (rec[i].desc_off >= 0 && (uint64_t) rec[i].desc_off >= desc_size)                      ESL_XFAIL(eslEFORMAT, errbuf, "bad offsets for sequence %d", (int) i);
+      cache->list[i].name   = cache->header_mem + rec[i].hdr_off;
+      cache->list[i].dsq    = (ESL_DSQ *) cache->residue_mem + rec[i].res_off;
+      cache->list[i].n      = rec[i].n;
+      cache->list[i].idx    = rec[i].idx;
+      cache->list[i].db_key = rec[i].db_key;
+      cache->list[i].desc   = (rec[i].desc_off >= 0) ? desc_mem + rec[i].desc_off : NULL;
+      cache->list[i].pk     = NULL;
+    }
+
+  if ((cache->abc = esl_alphabet_Create(eslAMINO)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  printf("\nLoaded sequence db snapshot %s; %" PRIu64 " bytes %s\n", snapfile, cache->snap_size, (cache->snap_mapped ? "mapped" : "read"));
+  *ret_cache = cache;
+  return eslOK;
+
+ ERROR:
+  if (fp)    fclose(fp);
+  if (cache) p7_seqcache_Close(cache);
+  *ret_cache = NULL;
+  return status;
+}
+
+
 
 
 /*****************************************************************
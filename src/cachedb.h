@@ -3,11 +3,12 @@
 
 typedef struct {
   char    *name;                   /* name; ("\0" if no name)               */
-  ESL_DSQ *dsq;                    /* digitized sequence [1..n]             */
+  ESL_DSQ *dsq;                    /* digitized sequence [1..n]; NULL if packed */
   int64_t  n;                      /* length of dsq                         */
   int64_t  idx;	                   /* ctr for this seq                      */
   uint64_t db_key;                 /* flag for included databases           */
   char    *desc;                   /* description                           */
+  uint64_t *pk;                    /* packed residues, or NULL (see p7_seqcache_Pack()) */
 } HMMER_SEQ;
 
 typedef struct {
@@ -31,11 +32,36 @@ typedef struct {
 
   uint64_t            res_size;    /* size of residue memory allocation     */
   uint64_t            hdr_size;    /* size of header memory allocation      */
-} P7_SEQCACHE;
 
+  /* If the cache was loaded from a binary snapshot, <residue_mem>,
+   * <header_mem> and the descriptions all point into <snap_mem>.
+   */
+  void               *snap_mem;    /* the snapshot file, or NULL            */
+  uint64_t            snap_size;   /* size of <snap_mem> in bytes           */
+  int                 snap_mapped; /* TRUE if <snap_mem> is mmap()'ed       */
+  int                 res_moved;   /* TRUE if <residue_mem> was moved out of <snap_mem> */
+
+  /* After p7_seqcache_Pack(), the residues are held in <pack_mem>
+   * instead, p7_SEQCACHE_PACKRES codes of p7_SEQCACHE_PACKBITS bits to
+   * a word, and each sequence's <dsq> is NULL.
+   */
+  uint64_t           *pack_mem;    /* packed residues, or NULL              */
+  uint64_t            pack_size;   /* size of <pack_mem> in bytes           */
+
+  uint32_t            lsort;       /* runs of <list> sorted by length (p7_seqcache_SortByLength()), 0 if none */
+} P7_SEQCACHE;
 
+#define p7_SEQCACHE_SNAPSUFFIX ".h3s"  /* snapshot of <seqfile> is <seqfile>.h3s */
+#define p7_SEQCACHE_PACKBITS   5       /* bits per packed residue: amino codes are all < 32 */
+#define p7_SEQCACHE_PACKRES    12      /* packed residues per 64-bit word       */
 
 extern int    p7_seqcache_Open(char *seqfile, P7_SEQCACHE **ret_cache, char *errbuf);
+extern int    p7_seqcache_WriteSnapshot(P7_SEQCACHE *cache, char *snapfile, char *errbuf);
+extern void   p7_seqcache_MoveResidues(P7_SEQCACHE *cache, void *mem);
+extern int    p7_seqcache_SortByLength(P7_SEQCACHE *cache, uint32_t window);
+extern int    p7_seqcache_Pack(P7_SEQCACHE *cache);
+extern void   p7_seqcache_Unpack(const HMMER_SEQ *seq, ESL_DSQ *dsq);
+extern size_t p7_seqcache_Sizeof(P7_SEQCACHE *cache);
 extern void   p7_seqcache_Close(P7_SEQCACHE *cache);
 
 #endif /*P7_CACHEDB_INCLUDED*/
@@ -3,13 +3,18 @@
  * Contents:
  *   1. p7_Calibrate():  model calibration wrapper 
  *   2. Determination of individual E-value parameters
- *   3. Statistics and specific experiment drivers
- *   4. Benchmark driver
+ *   3. The simulations, optionally split over threads
+ *   4. Statistics and specific experiment drivers
+ *   5. Benchmark driver
  * 
  * SRE, Mon Aug  6 13:00:06 2007
  */
 #include <p7_config.h>
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
 #include "easel.h"
 #include "esl_gumbel.h"
 #include "esl_random.h"
@@ -18,6 +23,24 @@
 
 #include "hmmer.h"
 
+/* A split calibration (see p7_Calibrate()) simulates its random
+ * sequences in chunks of this many, each chunk from its own RNG
+ * stream, so the scores don't depend on how many threads share the
+ * chunks out.
+ */
+#define p7_CALIBRATE_CHUNK 25
+
+/* Random sequences are generated and scored in batches of up to this
+ * many, so that with a short model the MSV scores can come from the
+ * inter-sequence SSV filter, one sequence per vector lane.
+ */
+#define p7_CALIBRATE_BATCH 32
+
+enum calscore_e { p7_CAL_MSV = 0, p7_CAL_VITERBI = 1, p7_CAL_FORWARD = 2 };
+
+static int sim_mu   (enum calscore_e which, ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, int ncpu, double lambda, double *ret_mu);
+static int sim_tau  (ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, int ncpu, double lambda, double tailp, double *ret_tau);
+
 /*****************************************************************
  * 1. p7_Calibrate():  model calibration wrapper 
  *****************************************************************/ 
@@ -29,6 +52,13 @@
  * Purpose:   Calibrate the E-value parameters of a model with 
  *            one calculation ($\lambda$) and two brief simulations
  *            (Viterbi $\mu$, Forward $\tau$).
+ *
+ *            If <cfg_b->Ecpu> is nonzero, each simulation is split:
+ *            its sequences are generated in chunks, each from an RNG
+ *            stream seeded from <*byp_rng>, and scored by up to
+ *            <Ecpu> threads. The result is the same for any nonzero
+ *            <Ecpu>, but not the same as an unsplit calibration's,
+ *            which draws all of its sequences from <*byp_rng> in turn.
  *            
  * Args:      hmm     - HMM to be calibrated
  *            cfg_b   - OPTCFG: ptr to optional build configuration;
@@ -69,6 +99,7 @@ p7_Calibrate(P7_HMM *hmm, P7_BUILDER *cfg_b, ESL_RANDOMNESS **byp_rng, P7_BG **b
   int             EfL    = ((cfg_b != NULL) ? cfg_b->EfL    : 100);
   int             EfN    = ((cfg_b != NULL) ? cfg_b->EfN    : 200);
   double          Eft    = ((cfg_b != NULL) ? cfg_b->Eft    : 0.04);
+  int             ncpu   = ((cfg_b != NULL) ? cfg_b->Ecpu   : 0);
   double          lambda, mmu, vmu, tau;
   int             status;
   
@@ -102,9 +133,9 @@ p7_Calibrate(P7_HMM *hmm, P7_BUILDER *cfg_b, ESL_RANDOMNESS **byp_rng, P7_BG **b
 
   /* The calibration steps themselves */
   if ((status = p7_Lambda(hmm, bg, &lambda))                          != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine lambda");
-  if ((status = p7_MSVMu    (r, om, bg, EmL, EmN, lambda, &mmu))      != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine msv mu");
-  if ((status = p7_ViterbiMu(r, om, bg, EvL, EvN, lambda, &vmu))      != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine vit mu");
-  if ((status = p7_Tau      (r, om, bg, EfL, EfN, lambda, Eft, &tau)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine fwd tau");
+  if ((status = sim_mu(p7_CAL_MSV,     r, om, bg, EmL, EmN, ncpu, lambda, &mmu)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine msv mu");
+  if ((status = sim_mu(p7_CAL_VITERBI, r, om, bg, EvL, EvN, ncpu, lambda, &vmu)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine vit mu");
+  if ((status = sim_tau(               r, om, bg, EfL, EfN, ncpu, lambda, Eft, &tau)) != eslOK) ESL_XFAIL(status,  errbuf, "failed to determine fwd tau");
 
   /* Store results */
   hmm->evparam[p7_MLAMBDA] = om->evparam[p7_MLAMBDA] = lambda;
@@ -237,46 +268,7 @@ p7_Lambda(P7_HMM *hmm, P7_BG *bg, double *ret_lambda)
 int
 p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double *ret_mmu)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, 0); /* DP matrix: 1 row version */
-  ESL_DSQ *dsq     = NULL;
-  double  *xv      = NULL;
-  int      i;
-  float    sc, nullsc;
-  float    maxsc   = (255 - om->base_b) / om->scale_b; /* if score overflows, use this */
-  int      status;
-
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
-  ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
-
-  p7_oprofile_ReconfigLength(om, L);
-  p7_bg_SetLength(bg, L);
-
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-
-      status = p7_MSVFilter(dsq, L, om, ox, &sc); 
-      if (status == eslERANGE) { sc = maxsc; status = eslOK; }
-      if (status != eslOK)     goto ERROR;
-
-      xv[i] = (sc - nullsc) / eslCONST_LOG2;
-    }
-
-  if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_mmu))  != eslOK) goto ERROR;
-  p7_omx_Destroy(ox);
-  free(xv);
-  free(dsq);
-  return eslOK;
-
- ERROR:
-  *ret_mmu = 0.0;
-  if (ox  != NULL) p7_omx_Destroy(ox);
-  if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
-  return status;
-
+  return sim_mu(p7_CAL_MSV, r, om, bg, L, N, 0, lambda, ret_mmu);
 }
 
 /* Function:  p7_ViterbiMu()
@@ -306,46 +298,7 @@ p7_MSVMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lam
 int
 p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double *ret_vmu)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, 0); /* DP matrix: 1 row version */
-  ESL_DSQ *dsq     = NULL;
-  double  *xv      = NULL;
-  int      i;
-  float    sc, nullsc;
-  float    maxsc   = (32767.0 - om->base_w) / om->scale_w; /* if score overflows, use this [J4/139] */
-  int      status;
-
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
-  ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
-
-  p7_oprofile_ReconfigLength(om, L);
-  p7_bg_SetLength(bg, L);
-
-  for (i = 0; i < N; i++)
-    {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-
-      status = p7_ViterbiFilter(dsq, L, om, ox, &sc); 
-      if (status == eslERANGE) { sc = maxsc; status = eslOK; }
-      if (status != eslOK)     goto ERROR;
-
-      xv[i] = (sc - nullsc) / eslCONST_LOG2;
-    }
-
-  if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_vmu))  != eslOK) goto ERROR;
-  p7_omx_Destroy(ox);
-  free(xv);
-  free(dsq);
-  return eslOK;
-
- ERROR:
-  *ret_vmu = 0.0;
-  if (ox  != NULL) p7_omx_Destroy(ox);
-  if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
-  return status;
-
+  return sim_mu(p7_CAL_VITERBI, r, om, bg, L, N, 0, lambda, ret_vmu);
 }
 
 
@@ -411,29 +364,256 @@ p7_ViterbiMu(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double
 int
 p7_Tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambda, double tailp, double *ret_tau)
 {
-  P7_OMX  *ox      = p7_omx_Create(om->M, 0, L);     /* DP matrix: for ForwardParser,  L rows */
-  ESL_DSQ *dsq     = NULL;
-  double  *xv      = NULL;
-  float    fsc, nullsc;		                  
-  double   gmu, glam;
-  int      status;
-  int      i;
-
-  ESL_ALLOC(xv,  sizeof(double)  * N);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
-  if (ox == NULL) { status = eslEMEM; goto ERROR; }
+  return sim_tau(r, om, bg, L, N, 0, lambda, tailp, ret_tau);
+}
+/*-------------- end, determining individual parameters ---------*/
+
+
+/*****************************************************************
+ * 3. The simulations, optionally split over threads
+ *****************************************************************/
+
+/* score_seqs()
+ * 
+ * Generate <N> random sequences of length <L> from <bg> with <r>,
+ * score each with the <which> filter of <om>, and store the bit
+ * scores in <xv[0..N-1]>. <ox> is a DP matrix big enough for that
+ * filter, <dsq> room for <p7_CALIBRATE_BATCH> sequences of <L>
+ * residues each. <om> and <bg> are already configured for length
+ * <L>, and are only read.
+ *
+ * The sequences are drawn a batch at a time, in the same order as
+ * one at a time, so the scores don't depend on the batching. MSV
+ * scores of a short model (<om->M> $\leq$ <p7_SSVMULTI_MAXM>) come
+ * from the inter-sequence SSV filter where the host supports it, as
+ * in <p7_Pipeline_Block()>; the full MSV filter is only run on the
+ * sequences where the J state may have been used. The Viterbi and
+ * Forward filters have no inter-sequence version.
+ */
+static int
+score_seqs(enum calscore_e which, ESL_RANDOMNESS *r, const P7_OPROFILE *om, const P7_BG *bg, int L, int N, P7_OMX *ox, ESL_DSQ *dsq, double *xv)
+{
+  const ESL_DSQ *bdsq[p7_CALIBRATE_BATCH];
+  int            bL[p7_CALIBRATE_BATCH];
+  uint8_t        xE[p7_CALIBRATE_BATCH];
+  float          nullsc[p7_CALIBRATE_BATCH];
+  float          maxsc     = 0.;
+  int            use_multi = FALSE;
+  float          sc;
+  int            i, b, nb;
+  int            status;
+
+  if      (which == p7_CAL_MSV)     maxsc = (255 - om->base_b) / om->scale_b;     /* if score overflows, use this */
+  else if (which == p7_CAL_VITERBI) maxsc = (32767.0 - om->base_w) / om->scale_w; /* if score overflows, use this [J4/139] */
+
+#if defined (eslENABLE_SSE)
+  use_multi = (which == p7_CAL_MSV && om->M <= p7_SSVMULTI_MAXM && impl_HaveAVX2());
+#endif
+
+  for (b = 0; b < p7_CALIBRATE_BATCH; b++) { bdsq[b] = dsq + b * (L+2); bL[b] = L; }
+
+  for (i = 0; i < N; i += nb)
+    {
+      nb = ESL_MIN(p7_CALIBRATE_BATCH, N - i);
+      for (b = 0; b < nb; b++)
+	{
+	  if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq + b * (L+2))) != eslOK) return status;
+	  if ((status = p7_bg_NullOne(bg, bdsq[b], L, &(nullsc[b])))          != eslOK) return status;
+	}
+
+#if defined (eslENABLE_SSE)
+      if (use_multi && (status = p7_SSVFilter_multi(bdsq, bL, nb, om, xE)) != eslOK) return status;
+#endif
+
+      for (b = 0; b < nb; b++)
+	{
+	  status = eslENORESULT;
+#if defined (eslENABLE_SSE)
+	  if (use_multi) status = p7_SSVFilter_Score(xE[b], om, &sc);
+#endif
+	  if (status == eslENORESULT)
+	    switch (which) {
+	    case p7_CAL_MSV:     status = p7_MSVFilter    (bdsq[b], L, om, ox, &sc); break;
+	    case p7_CAL_VITERBI: status = p7_ViterbiFilter(bdsq[b], L, om, ox, &sc); break;
+	    case p7_CAL_FORWARD: status = p7_ForwardParser(bdsq[b], L, om, ox, &sc); break;
+	    }
+	  if (status == eslERANGE && which != p7_CAL_FORWARD) { sc = maxsc; status = eslOK; }
+	  if (status != eslOK) return status;
+
+	  xv[i+b] = (sc - nullsc[b]) / eslCONST_LOG2;
+	}
+    }
+  return eslOK;
+}
+
+typedef struct {
+  enum calscore_e    which;
+  const P7_OPROFILE *om;
+  const P7_BG       *bg;
+  int                L;
+  int                N;
+  const uint32_t    *seed;       /* one RNG seed per chunk                   */
+  int                nchunk;
+  int                w;          /* this worker takes chunks w, w+nw, ...    */
+  int                nw;
+  int                rngtype;    /* eslRND_FAST or not, as the caller's RNG */
+  double            *xv;         /* shared score array; chunks don't overlap */
+  int                status;
+#ifdef HMMER_THREADS
+  pthread_t          thread;
+#endif
+} CAL_WORKER;
+
+static void *
+calibrate_worker(void *arg)
+{
+  CAL_WORKER     *wk  = (CAL_WORKER *) arg;
+  P7_OMX         *ox  = p7_omx_Create(wk->om->M, 0, (wk->which == p7_CAL_FORWARD ? wk->L : 0));
+  ESL_DSQ        *dsq = malloc(sizeof(ESL_DSQ) * (wk->L+2) * p7_CALIBRATE_BATCH);
+  ESL_RANDOMNESS *r   = (wk->rngtype == eslRND_FAST ? esl_randomness_CreateFast(wk->seed[wk->w]) : esl_randomness_Create(wk->seed[wk->w]));
+  int             c, n;
+
+  if (wk->w > 0) impl_Init();	/* a new thread's SIMD state, as the pipeline threads set it */
+
+  wk->status = eslOK;
+  if (ox == NULL || dsq == NULL || r == NULL) { wk->status = eslEMEM; goto DONE; }
+
+  for (c = wk->w; c < wk->nchunk; c += wk->nw)
+    {
+      n = ESL_MIN(p7_CALIBRATE_CHUNK, wk->N - c * p7_CALIBRATE_CHUNK);
+      esl_randomness_Init(r, wk->seed[c]);
+      if ((wk->status = score_seqs(wk->which, r, wk->om, wk->bg, wk->L, n, ox, dsq, wk->xv + c * p7_CALIBRATE_CHUNK)) != eslOK) goto DONE;
+    }
+
+ DONE:
+  if (ox  != NULL) p7_omx_Destroy(ox);
+  if (dsq != NULL) free(dsq);
+  if (r   != NULL) esl_randomness_Destroy(r);
+  return NULL;
+}
+
+/* sample_scores()
+ * 
+ * Configure <om> and <bg> for length <L>, then collect the <which>
+ * bit scores of <N> random sequences in <xv[0..N-1]>. With <ncpu> 0,
+ * all the sequences are drawn from <r> in turn. Otherwise they're
+ * drawn in chunks of <p7_CALIBRATE_CHUNK>, each chunk from its own
+ * stream seeded by <r>, and up to <ncpu> threads (the caller's
+ * included) share the chunks out.
+ */
+static int
+sample_scores(enum calscore_e which, ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, int ncpu, double *xv)
+{
+  CAL_WORKER *wk     = NULL;
+  uint32_t   *seed   = NULL;
+  P7_OMX     *ox     = NULL;
+  ESL_DSQ    *dsq    = NULL;
+  int         nchunk = (N + p7_CALIBRATE_CHUNK - 1) / p7_CALIBRATE_CHUNK;
+  int         nw, nthr;
+  int         c, w;
+  int         status;
 
   p7_oprofile_ReconfigLength(om, L);
   p7_bg_SetLength(bg, L);
 
-  for (i = 0; i < N; i++)
+  if (ncpu == 0 || nchunk == 0)
+    {
+      if ((ox = p7_omx_Create(om->M, 0, (which == p7_CAL_FORWARD ? L : 0))) == NULL) { status = eslEMEM; goto ERROR; }
+      ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2) * p7_CALIBRATE_BATCH);
+      if ((status = score_seqs(which, r, om, bg, L, N, ox, dsq, xv)) != eslOK) goto ERROR;
+      p7_omx_Destroy(ox);
+      free(dsq);
+      return eslOK;
+    }
+
+  ESL_ALLOC(seed, sizeof(uint32_t) * nchunk);
+  for (c = 0; c < nchunk; c++)
+    do { seed[c] = esl_random_uint32(r); } while (seed[c] == 0); /* 0 would mean an arbitrary seed */
+
+#ifdef HMMER_THREADS
+  nw = ESL_MIN(ncpu, nchunk);
+#else
+  nw = 1;
+#endif
+  ESL_ALLOC(wk, sizeof(CAL_WORKER) * nw);
+  for (w = 0; w < nw; w++)
     {
-      if ((status = esl_rsq_xfIID(r, bg->f, om->abc->K, L, dsq)) != eslOK) goto ERROR;
-      if ((status = p7_ForwardParser(dsq, L, om, ox, &fsc))      != eslOK) goto ERROR;
-      if ((status = p7_bg_NullOne(bg, dsq, L, &nullsc))          != eslOK) goto ERROR;   
-      xv[i] = (fsc - nullsc) / eslCONST_LOG2;
+      wk[w].which   = which;
+      wk[w].om      = om;
+      wk[w].bg      = bg;
+      wk[w].L       = L;
+      wk[w].N       = N;
+      wk[w].seed    = seed;
+      wk[w].nchunk  = nchunk;
+      wk[w].w       = w;
+      wk[w].nw      = nw;
+      wk[w].rngtype = r->type;
+      wk[w].xv      = xv;
+      wk[w].status  = eslOK;
     }
-  if ((status = esl_gumbel_FitComplete(xv, N, &gmu, &glam)) != eslOK) goto ERROR;
+
+  /* If a thread can't be started, run its share of chunks ourselves afterwards. */
+  nthr = 1;
+#ifdef HMMER_THREADS
+  for (nthr = 1; nthr < nw; nthr++)
+    if (pthread_create(&(wk[nthr].thread), NULL, calibrate_worker, &(wk[nthr])) != 0) break;
+#endif
+  calibrate_worker(&(wk[0]));
+  for (w = nthr; w < nw; w++)
+    calibrate_worker(&(wk[w]));
+#ifdef HMMER_THREADS
+  for (w = 1; w < nthr; w++)
+    pthread_join(wk[w].thread, NULL);
+#endif
+
+  status = eslOK;
+  for (w = 0; w < nw; w++)
+    if (wk[w].status != eslOK) status = wk[w].status;
+  free(wk);
+  free(seed);
+  return status;
+
+ ERROR:
+  if (ox   != NULL) p7_omx_Destroy(ox);
+  if (dsq  != NULL) free(dsq);
+  if (wk   != NULL) free(wk);
+  if (seed != NULL) free(seed);
+  return status;
+}
+
+/* sim_mu(), sim_tau()
+ * 
+ * The bodies of p7_MSVMu()/p7_ViterbiMu() and p7_Tau(), with the
+ * <ncpu> of sample_scores() for p7_Calibrate() to split them.
+ */
+static int
+sim_mu(enum calscore_e which, ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, int ncpu, double lambda, double *ret_mu)
+{
+  double *xv = NULL;
+  int     status;
+
+  ESL_ALLOC(xv, sizeof(double) * N);
+  if ((status = sample_scores(which, r, om, bg, L, N, ncpu, xv))   != eslOK) goto ERROR;
+  if ((status = esl_gumbel_FitCompleteLoc(xv, N, lambda, ret_mu))  != eslOK) goto ERROR;
+  free(xv);
+  return eslOK;
+
+ ERROR:
+  *ret_mu = 0.0;
+  if (xv != NULL) free(xv);
+  return status;
+}
+
+static int
+sim_tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, int ncpu, double lambda, double tailp, double *ret_tau)
+{
+  double *xv = NULL;
+  double  gmu, glam;
+  int     status;
+
+  ESL_ALLOC(xv, sizeof(double) * N);
+  if ((status = sample_scores(p7_CAL_FORWARD, r, om, bg, L, N, ncpu, xv)) != eslOK) goto ERROR;
+  if ((status = esl_gumbel_FitComplete(xv, N, &gmu, &glam))               != eslOK) goto ERROR;
 
   /* Explanation of the eqn below: first find the x at which the Gumbel tail
    * mass is predicted to be equal to tailp. Then back up from that x
@@ -441,26 +621,21 @@ p7_Tau(ESL_RANDOMNESS *r, P7_OPROFILE *om, P7_BG *bg, int L, int N, double lambd
    * instead of tailp.
    */
   *ret_tau =  esl_gumbel_invcdf(1.0-tailp, gmu, glam) + (log(tailp) / lambda);
-  
   free(xv);
-  free(dsq);
-  p7_omx_Destroy(ox);
   return eslOK;
 
  ERROR:
   *ret_tau = 0.;
-  if (xv  != NULL) free(xv);
-  if (dsq != NULL) free(dsq);
-  if (ox  != NULL) p7_omx_Destroy(ox);
+  if (xv != NULL) free(xv);
   return status;
 }
-/*-------------- end, determining individual parameters ---------*/
+/*------------------ end, split simulations ---------------------*/
 
 
 
 
 /*****************************************************************
- * 3. Statistics and specific experiment drivers
+ * 4. Statistics and specific experiment drivers
  *****************************************************************/
 #ifdef p7EVALUES_STATS
 /* gcc -o evalues_stats -g -O2 -msse2 -I. -L. -I../easel -L../easel -Dp7EVALUES_STATS evalues.c -lhmmer -leasel -lm
@@ -572,7 +747,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 4. Benchmark driver
+ * 5. Benchmark driver
  *****************************************************************/
 
 #ifdef p7EVALUES_BENCHMARK
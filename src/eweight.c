@@ -9,19 +9,55 @@
 
 #include <p7_config.h>
 
+#include <math.h>
+
 #include "easel.h"
 #include "esl_rootfinder.h"
+#include "esl_vectorops.h"
 
 #include "hmmer.h"
 
+/* The target only depends on the match emissions, so each evaluation
+ * estimates just those (p7_MatchParameterEstimation()), from the
+ * original counts times a per-node scale, into <h2->mat>; the rest
+ * of <h2> is never used.
+ */
 struct ew_param_s {
   const P7_HMM    *hmm;		/* ptr to the original count-based HMM, which remains unchanged */
   const P7_BG     *bg;		/* ptr to the null model */
   const P7_PRIOR  *pri;		/* Dirichlet prior used to parameterize from counts */
-  P7_HMM          *h2;		/* our working space: a copy of <hmm> that we can muck with */
+  P7_HMM          *h2;		/* our working space: match emissions are estimated into h2->mat */
+  double          *scale;	/* scale[1..M]: count multiplier for each node, for this evaluation */
   double           etarget;	/* information content target, in bits */
 };
 
+static int
+eweight_init(struct ew_param_s *p, const P7_HMM *hmm, const P7_BG *bg, const P7_PRIOR *pri, double etarget)
+{
+  int status;
+
+  p->hmm     = hmm;
+  p->bg      = bg;
+  p->pri     = pri;
+  p->etarget = etarget;
+  p->scale   = NULL;
+  if ((p->h2 = p7_hmm_Create(hmm->M, hmm->abc)) == NULL) return eslEMEM;
+  ESL_ALLOC(p->scale, sizeof(double) * (hmm->M+1));
+  return eslOK;
+
+ ERROR:
+  p7_hmm_Destroy(p->h2);
+  p->h2 = NULL;
+  return status;
+}
+
+static void
+eweight_destroy(struct ew_param_s *p)
+{
+  if (p->h2    != NULL) p7_hmm_Destroy(p->h2);
+  if (p->scale != NULL) free(p->scale);
+}
+
 /* Evaluate fx = rel entropy - etarget, which we want to be = 0,
  * for effective sequence number <x>.
  */
@@ -29,10 +65,10 @@ static int
 eweight_target_f(double Neff, void *params, double *ret_fx)
 {
   struct ew_param_s *p = (struct ew_param_s *) params;
+  int k;
 
-  p7_hmm_CopyParameters(p->hmm, p->h2);
-  p7_hmm_Scale(p->h2, Neff / (double) p->h2->nseq);
-  p7_ParameterEstimation(p->h2, p->pri);
+  for (k = 1; k <= p->hmm->M; k++) p->scale[k] = Neff / (double) p->hmm->nseq;
+  p7_MatchParameterEstimation(p->hmm, p->pri, p->scale, p->h2->mat);
   *ret_fx = p7_MeanMatchRelativeEntropy(p->h2, p->bg) - p->etarget;
   return eslOK;
 }
@@ -68,11 +104,7 @@ p7_EntropyWeight(const P7_HMM *hmm, const P7_BG *bg, const P7_PRIOR *pri, double
 
   /* Store parameters in the structure we'll pass to the rootfinder
    */
-  p.hmm = hmm;
-  p.bg  = bg;
-  p.pri = pri;
-  if ((p.h2  = p7_hmm_Clone(hmm)) == NULL) return eslEMEM;
-  p.etarget = etarget;
+  if ((status = eweight_init(&p, hmm, bg, pri, etarget)) != eslOK) { *ret_Neff = (double) hmm->nseq; return status; }
 
   Neff = (double) hmm->nseq;
   if ((status = eweight_target_f(Neff, &p, &fx)) != eslOK) goto ERROR;
@@ -85,12 +117,12 @@ p7_EntropyWeight(const P7_HMM *hmm, const P7_BG *bg, const P7_PRIOR *pri, double
       esl_rootfinder_Destroy(R);
     }
 
-  p7_hmm_Destroy(p.h2);
+  eweight_destroy(&p);
   *ret_Neff = Neff;
   return eslOK;
 
  ERROR:
-  if (p.h2 != NULL)   p7_hmm_Destroy(p.h2);
+  eweight_destroy(&p);
   if (R    != NULL)   esl_rootfinder_Destroy(R);
   *ret_Neff = (double) hmm->nseq;
   return status;
@@ -104,10 +136,16 @@ static int
 eweight_target_exp_f(double exp, void *params, double *ret_fx)
 {
   struct ew_param_s *p = (struct ew_param_s *) params;
+  float  count;
+  int    k;
 
-  p7_hmm_CopyParameters(p->hmm, p->h2);
-  p7_hmm_ScaleExponential(p->h2, exp);
-  p7_ParameterEstimation(p->h2, p->pri);
+  /* as p7_hmm_ScaleExponential() */
+  for (k = 1; k <= p->hmm->M; k++)
+    {
+      count       = esl_vec_FSum(p->hmm->mat[k], p->hmm->abc->K);
+      p->scale[k] = (count > 0 ? (float) pow(count, exp) / count : 1.0);
+    }
+  p7_MatchParameterEstimation(p->hmm, p->pri, p->scale, p->h2->mat);
   *ret_fx = p7_MeanMatchRelativeEntropy(p->h2, p->bg) - p->etarget;
   return eslOK;
 }
@@ -150,11 +188,7 @@ p7_EntropyWeight_exp(const P7_HMM *hmm, const P7_BG *bg, const P7_PRIOR *pri, do
 
   /* Store parameters in the structure we'll pass to the rootfinder
    */
-  p.hmm = hmm;
-  p.bg  = bg;
-  p.pri = pri;
-  if ((p.h2  = p7_hmm_Clone(hmm)) == NULL) return eslEMEM;
-  p.etarget = etarget;
+  if ((status = eweight_init(&p, hmm, bg, pri, etarget)) != eslOK) return status;
   
   //Neff = (double) hmm->nseq;
   if ((status = eweight_target_exp_f(1.0, &p, &fx)) != eslOK) goto ERROR;
@@ -168,13 +202,13 @@ p7_EntropyWeight_exp(const P7_HMM *hmm, const P7_BG *bg, const P7_PRIOR *pri, do
   }
   
 
-  p7_hmm_Destroy(p.h2);
+  eweight_destroy(&p);
 
   *ret_exp = exp;
   return eslOK;
 
  ERROR:
-  if (p.h2 != NULL)   p7_hmm_Destroy(p.h2);
+  eweight_destroy(&p);
   if (R    != NULL)   esl_rootfinder_Destroy(R);
 
   return status;
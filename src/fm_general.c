@@ -5,14 +5,29 @@
  *   1. List management
  *   2. Interval / range computation
  *   3. Functions related to the original sequence
- *   4. FM data initialization, configuration, and reading from file
+ *   4. The interleaved rank layout
+ *   5. FM data initialization, configuration, and reading from file
  */
 #include <p7_config.h>
 
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "easel.h"
 #include "esl_getopts.h"
 #include "hmmer.h"
 
+/* An index's big arrays go in hugepages, if they're on (p7_hugemem.c) */
+#define FM_BIGALLOC(p, size) do { if (((p) = p7_hugemem_Alloc(size)) == NULL) ESL_XEXCEPTION(eslEMEM, "FM index allocation failed"); } while (0)
+
 /* Function:  fm_initSeeds()
  *
  * Synopsis:  initialize the object used to store a list of seed diagonals
@@ -197,6 +212,71 @@ fm_updateIntervalReverse( const FM_DATA *fm, const FM_CFG *cfg, char c, FM_INTER
 
 
 
+/* Function:  fm_updateIntervalForwardAll()
+ * Synopsis:  fm_updateIntervalForward() for every character at once.
+ *
+ * Purpose:   For each character c of the alphabet, set <next_bk[c]>
+ *            and <next_f[c]> to what <interval_bk> and <interval_f>
+ *            would become after <fm_updateIntervalForward()> with c.
+ *            This takes two <fm_getOccCountAll()> calls instead of
+ *            two occ counts per character, and leaves <interval_bk>,
+ *            <interval_f> unchanged.
+ *
+ * Returns:   eslOK
+ */
+int
+fm_updateIntervalForwardAll( const FM_DATA *fm, const FM_CFG *cfg, const FM_INTERVAL *interval_bk, const FM_INTERVAL *interval_f,
+                             FM_INTERVAL *next_bk, FM_INTERVAL *next_f) {
+  uint32_t occ_l[FM_MAX_ALPHSIZE], occ_u[FM_MAX_ALPHSIZE];
+  uint32_t occLT_l, occLT_u;
+  int c;
+
+  fm_getOccCountAll (fm, cfg, interval_bk->lower - 1, occ_l);
+  fm_getOccCountAll (fm, cfg, interval_bk->upper,     occ_u);
+
+  occLT_l = (interval_bk->lower - 1 >= fm->term_loc); // '$' is lexicographically lower than 'A'
+  occLT_u = (interval_bk->upper     >= fm->term_loc);
+  for (c=0; c<cfg->meta->alph_size; c++) {
+    next_f[c].lower = interval_f->lower + (occLT_u - occLT_l);
+    next_f[c].upper = next_f[c].lower + (occ_u[c] - occ_l[c]) - 1;
+
+    next_bk[c].lower = abs((int)(fm->C[c])) + occ_l[c];
+    next_bk[c].upper = abs((int)(fm->C[c])) + occ_u[c] - 1;
+
+    occLT_l += occ_l[c];
+    occLT_u += occ_u[c];
+  }
+
+  return eslOK;
+}
+
+
+/* Function:  fm_updateIntervalReverseAll()
+ * Synopsis:  fm_updateIntervalReverse() for every character at once.
+ *
+ * Purpose:   For each character c of the alphabet, set <next[c]> to
+ *            what <interval> would become after <fm_updateIntervalReverse()>
+ *            with c, using two <fm_getOccCountAll()> calls.
+ *
+ * Returns:   eslOK
+ */
+int
+fm_updateIntervalReverseAll( const FM_DATA *fm, const FM_CFG *cfg, const FM_INTERVAL *interval, FM_INTERVAL *next) {
+  uint32_t count1[FM_MAX_ALPHSIZE], count2[FM_MAX_ALPHSIZE];
+  int c;
+
+  fm_getOccCountAll (fm, cfg, interval->lower-1, count1);
+  fm_getOccCountAll (fm, cfg, interval->upper,   count2);
+
+  for (c=0; c<cfg->meta->alph_size; c++) {
+    next[c].lower = abs((int)(fm->C[c])) + count1[c];
+    next[c].upper = abs((int)(fm->C[c])) + count2[c] - 1;
+  }
+
+  return eslOK;
+}
+
+
 /* Function:  getSARangeReverse()
  * Synopsis:  For a given query sequence, find its interval in the FM-index, using backward search
  * Purpose:   Implement Algorithm 3.6 (p17) of Firth paper (A Comparison of BWT Approaches
@@ -270,6 +350,24 @@ fm_getChar(uint8_t alph_type, int j, const uint8_t *B )
   return c;
 }
 
+/* Function:  fm_getBWTChar()
+ * Synopsis:  Find the character c residing at position <j> of the BWT of <fm>.
+ * Purpose:   Same as <fm_getChar()> on <fm->BWT>, but also for an index
+ *            in the interleaved rank layout, which has no <fm->BWT>.
+ */
+uint8_t
+fm_getBWTChar(const FM_DATA *fm, uint8_t alph_type, int j)
+{
+  const uint64_t *line;
+  int             k;
+
+  if (fm->rank == NULL) return fm_getChar(alph_type, j, fm->BWT);
+
+  line = fm->rank + (j / fm_RANK_LINECHARS) * fm_RANK_LINEWORDS;
+  k    = (j % fm_RANK_LINECHARS) / 4;  // the byte of the line that j is in
+  return ((line[1 + k/8] >> (8*(k%8))) >> ( 0x6 - ((j&0x3)*2) )) & 0x3;
+}
+
 
 
 /* Function:  fm_findOverlappingAmbiguityBlock()
@@ -448,7 +546,199 @@ fm_getOriginalPosition (const FM_DATA *fms, const FM_METADATA *meta, int fm_id,
 }
 
 /*********************************************************************
- *# 4. FM data initialization, configuration, and reading from file
+ *# 4. The interleaved rank layout
+ *********************************************************************/
+
+/* With nhmmer --fm_interleave, fm_FM_read() turns a DNA index's BWT and
+ * occ arrays into 64-byte lines (see fm_RANK_LINECHARS in hmmer.h):
+ * word 0 of a line holds the counts of a,c,g,t in BWT[] before the
+ * line, relative to its superblock's counts in <rank_sb>; words 1..7
+ * hold the line's 224 characters, packed four to a byte as in BWT[],
+ * byte k of the line in bits 8*(k%8) of word 1+k/8. An occurrence
+ * count then reads one line, and a superblock count that's likely in
+ * cache, instead of scanning up to half an occ_b interval of BWT[]
+ * from a checkpoint in another array. Memory is about that of BWT[]
+ * and the occ arrays, which are freed.
+ */
+
+/* fm_popcount64()
+ * Number of set bits in <x>. Compilers turn this into a popcnt
+ * instruction where there is one.
+ */
+static inline int
+fm_popcount64(uint64_t x)
+{
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return (int) ((x * 0x0101010101010101ULL) >> 56);
+}
+
+/* fm_rankLineCount()
+ * Number of occurrences of <c> among the first <r> (0..fm_RANK_LINECHARS)
+ * characters of rank line <line>.
+ */
+static inline uint32_t
+fm_rankLineCount(const uint64_t *line, int r, uint8_t c)
+{
+  uint64_t pat  = 0x5555555555555555ULL * c;  // c in every 2-bit field
+  uint64_t mask;
+  uint64_t x;
+  uint32_t cnt  = 0;
+  int      i, rem;
+
+  for (i = 0; i < r/32; i++) {
+    x    = line[1+i] ^ pat;                    // 00 where the character is c ...
+    cnt += fm_popcount64(~(x | (x >> 1)) & 0x5555555555555555ULL);  // ... counted once per field
+  }
+
+  if ((rem = r % 32) > 0) {
+    mask = ((uint64_t) 1 << (8*(rem/4))) - 1;  // the whole bytes; the part-byte's chars are in its high bits
+    if (rem % 4) mask |= (uint64_t) ((0xff << (8 - 2*(rem%4))) & 0xff) << (8*(rem/4));
+    x    = line[1+i] ^ pat;
+    cnt += fm_popcount64(~(x | (x >> 1)) & 0x5555555555555555ULL & mask);
+  }
+  return cnt;
+}
+
+/* fm_interleaveRank()
+ * Build the rank lines of DNA index <fm> from its BWT, then free (or,
+ * if they're in a file mapping, let go of) BWT and the occ arrays.
+ */
+static int
+fm_interleaveRank(FM_DATA *fm)
+{
+  uint64_t  nlines           = fm->N / fm_RANK_LINECHARS + 1;  // +1: a count through BWT[N-1] can start a line
+  uint64_t  nsb              = (nlines - 1) / fm_RANK_SBLINES + 1;
+  uint64_t  compressed_bytes = (fm->N + 3) / 4;
+  uint32_t  tot[4]           = { 0, 0, 0, 0 };
+  uint32_t *sb;
+  uint64_t *line;
+  uint64_t  L, b;
+  int       c, k;
+  int       status;
+
+  FM_BIGALLOC (fm->rank_mem, nlines * fm_RANK_LINEWORDS * sizeof(uint64_t) + 63);  // +63 for manual 64-byte alignment
+  fm->rank = (uint64_t *) (((unsigned long int)fm->rank_mem + 63) & (~0x3f));      // one line per cache line
+  ESL_ALLOC   (fm->rank_sb,  nsb * 4 * sizeof(uint32_t));
+
+  for (L = 0; L < nlines; L++) {
+    line = fm->rank + L * fm_RANK_LINEWORDS;
+    sb   = fm->rank_sb + (L / fm_RANK_SBLINES) * 4;
+    if (L % fm_RANK_SBLINES == 0)
+      for (c = 0; c < 4; c++) sb[c] = tot[c];
+
+    for (k = 0; k < fm_RANK_LINEWORDS; k++) line[k] = 0;
+    for (c = 0; c < 4; c++)
+      line[0] |= (uint64_t) (tot[c] - sb[c]) << (16*c);
+    for (k = 0; k < fm_RANK_LINECHARS/4; k++) {
+      b = L * (fm_RANK_LINECHARS/4) + k;
+      if (b < compressed_bytes) line[1 + k/8] |= (uint64_t) fm->BWT[b] << (8*(k%8));
+    }
+    for (c = 0; c < 4; c++)
+      tot[c] += fm_rankLineCount(line, ESL_MIN(fm->N - L * fm_RANK_LINECHARS, fm_RANK_LINECHARS), c);
+  }
+
+  if (! (fm->mapped & fmMAPPED_BWT))   p7_hugemem_Free (fm->BWT_mem);
+  if (! (fm->mapped & fmMAPPED_OCCB))  p7_hugemem_Free (fm->occCnts_b);
+  if (! (fm->mapped & fmMAPPED_OCCSB)) p7_hugemem_Free (fm->occCnts_sb);
+  fm->BWT_mem    = NULL;
+  fm->BWT        = NULL;
+  fm->occCnts_b  = NULL;
+  fm->occCnts_sb = NULL;
+  fm->mapped    &= ~(fmMAPPED_BWT | fmMAPPED_OCCB | fmMAPPED_OCCSB);
+  return eslOK;
+
+ERROR:
+  return status;
+}
+
+
+/* Function:  fm_getOccCountRank()
+ * Synopsis:  Compute number of occurrences of c in BWT[1..pos], from rank lines
+ *
+ * Purpose:   The version of <fm_getOccCount()> for an index in the
+ *            interleaved rank layout (<fm->rank> non-NULL), which it
+ *            calls instead.
+ */
+int
+fm_getOccCountRank (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
+{
+  uint64_t        n    = pos + 1;
+  uint64_t        L    = n / fm_RANK_LINECHARS;
+  const uint64_t *line = fm->rank + L * fm_RANK_LINEWORDS;
+  int             cnt;
+
+  cnt  = fm->rank_sb[(L / fm_RANK_SBLINES) * 4 + c];
+  cnt += (line[0] >> (16*c)) & 0xffff;
+  cnt += fm_rankLineCount(line, n % fm_RANK_LINECHARS, c);
+
+  if (c==0 && pos >= fm->term_loc) { // I overcounted 'A' by one, because '$' was replaced with an 'A'
+    cnt--;
+  }
+  return cnt;
+}
+
+/* Function:  fm_getOccCountLTRank()
+ * Synopsis:  Compute number of occurrences of characters with value <c in BWT[1..pos], from rank lines
+ *
+ * Purpose:   The version of <fm_getOccCountLT()> for an index in the
+ *            interleaved rank layout, which it calls instead.
+ */
+int
+fm_getOccCountLTRank (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt)
+{
+  uint64_t        n    = pos + 1;
+  uint64_t        L    = n / fm_RANK_LINECHARS;
+  const uint64_t *line = fm->rank + L * fm_RANK_LINEWORDS;
+  const uint32_t *sb   = fm->rank_sb + (L / fm_RANK_SBLINES) * 4;
+  int             i;
+
+  *cntlt = 0;
+  for (i = 0; i <= c; i++) {
+    uint32_t cnt = sb[i] + ((line[0] >> (16*i)) & 0xffff) + fm_rankLineCount(line, n % fm_RANK_LINECHARS, i);
+    if (i < c) *cntlt += cnt;
+    else       *cnteq  = cnt;
+  }
+
+  if ( pos >= fm->term_loc) {
+    if (c == 0) { // deal with the fact that '$' was replaced with an 'A'
+      (*cnteq)--; // I overcounted 'A' by one
+      (*cntlt) = 1; // '$' is lexicographically lower than 'A', but I didn't count it in the method above
+    }
+  }
+  return eslOK;
+}
+
+/* Function:  fm_getOccCountAllRank()
+ * Synopsis:  Compute number of occurrences of every character in BWT[1..pos], from rank lines
+ *
+ * Purpose:   The version of <fm_getOccCountAll()> for an index in the
+ *            interleaved rank layout, which it calls instead. The
+ *            counts of all four characters come from the same line.
+ */
+int
+fm_getOccCountAllRank (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint32_t *cnt)
+{
+  uint64_t        n    = pos + 1;
+  uint64_t        L    = n / fm_RANK_LINECHARS;
+  const uint64_t *line = fm->rank + L * fm_RANK_LINEWORDS;
+  const uint32_t *sb   = fm->rank_sb + (L / fm_RANK_SBLINES) * 4;
+  int             r    = n % fm_RANK_LINECHARS;
+  int             c;
+
+  for (c = 0; c < 3; c++)
+    cnt[c] = sb[c] + ((line[0] >> (16*c)) & 0xffff) + fm_rankLineCount(line, r, c);
+  cnt[3] = n - cnt[0] - cnt[1] - cnt[2];  // the rest
+
+  if (pos >= fm->term_loc) { // I overcounted 'A' by one, because '$' was replaced with an 'A'
+    cnt[0]--;
+  }
+  return eslOK;
+}
+
+/*********************************************************************
+ *# 5. FM data initialization, configuration, and reading from file
  *********************************************************************/
 
 int
@@ -462,51 +752,472 @@ fm_initConfigGeneric( FM_CFG *cfg, ESL_GETOPTS *go ) {
   cfg->drop_lim          = eslCONST_LOG2 * (go ? esl_opt_GetReal(go, "--seed_drop_lim") : -1.0);  // convert from bits to nats
   cfg->score_density_req = eslCONST_LOG2 * (go ? esl_opt_GetReal(go, "--seed_sc_density") : -1.0);// convert from bits to nats
   cfg->scthreshFM        = eslCONST_LOG2 * (go ? esl_opt_GetReal(go, "--seed_sc_thresh") : -1.0); // convert from bits to nats
+  cfg->seed_threads      = 0;  // set by the caller, which knows how many cores are free
+  cfg->kmer_k            = (go ? esl_opt_GetInteger(go, "--seed_kmer") : 0);
+
+  return eslOK;
+}
+
+/* Function:  fm_configSeedThreshold()
+ * Synopsis:  Scale the FM seed score threshold to a query profile.
+ *
+ * Purpose:   Set <cfg->sc_thresh_ratio> for query profile <gm>. The
+ *            best match score at each position, divided by sqrt(M),
+ *            is used as a proxy for the score of the expected longest
+ *            common subsequence. If that score is less than a target
+ *            of 7, the seed score threshold is shifted down by the
+ *            same ratio. The score is not let below 5; under that,
+ *            run time suffers dramatically.
+ *            Xref: ~wheelert/notebook/2014/03-04-FM-time-v-len/00NOTES
+ *
+ *            If <opt_reliable> is non-NULL, it is set TRUE if seeds can
+ *            be expected to find the profile's hits. It is set FALSE
+ *            if the profile is shorter than the seed length, has no
+ *            MAXL, or its expected score would have been raised to the
+ *            floor of 5. Then a caller can search the database without
+ *            the seed prefilter.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+fm_configSeedThreshold(FM_CFG *cfg, const P7_PROFILE *gm, int *opt_reliable)
+{
+  float best_sc_avg = 0.;
+  float max_score;
+  int   i, j;
+
+  for (i = 1; i <= gm->M; i++) {
+    max_score = 0;
+    for (j = 0; j < gm->abc->K; j++)
+      if (p7P_MSC(gm, i, j) > max_score) max_score = p7P_MSC(gm, i, j);
+    best_sc_avg += max_score;
+  }
+  best_sc_avg /= sqrt((double) gm->M);   //that's dividing by M to get score density, then multiplying by sqrt(M) as a proxy for expected LCS
+
+  if (opt_reliable) *opt_reliable = (gm->M >= cfg->max_depth && gm->max_length > 0 && best_sc_avg >= 5.0);
 
+  best_sc_avg = ESL_MAX(5.0,best_sc_avg);
+  cfg->sc_thresh_ratio = ESL_MIN(best_sc_avg/7.0, 1.0);
   return eslOK;
 }
 
+/* fm_kmerNodes()
+ * The number of nodes in a complete trie of strings of length up to
+ * <k> over an alphabet of size <A>, counting the root; or
+ * fm_KMER_MAXNODES+1, if that's more than fm_KMER_MAXNODES.
+ */
+static int
+fm_kmerNodes(int A, int k)
+{
+  int64_t n     = 1;
+  int64_t level = 1;
+
+  for ( ; k > 0; k--) {
+    level *= A;
+    n     += level;
+    if (n > fm_KMER_MAXNODES) return fm_KMER_MAXNODES+1;
+  }
+  return (int) n;
+}
+
 /* Function:  fm_FM_free()
  * Synopsis:  release the memory required to store an individual FM-index
+ * Purpose:   Arrays that point into a file mapping (see <fm_mapFMfile()>)
+ *            are left alone; they go away with the mapping.
  */
 void
 fm_FM_destroy ( FM_DATA *fm, int isMainFM)
 {
 
-  free (fm->BWT_mem);
+  if (! (fm->mapped & fmMAPPED_BWT))   p7_hugemem_Free (fm->BWT_mem);
   free (fm->C);
-  free (fm->occCnts_b);
-  free (fm->occCnts_sb);
+  if (! (fm->mapped & fmMAPPED_OCCB))  p7_hugemem_Free (fm->occCnts_b);
+  if (! (fm->mapped & fmMAPPED_OCCSB)) p7_hugemem_Free (fm->occCnts_sb);
+  p7_hugemem_Free (fm->rank_mem);
+  free (fm->rank_sb);
+  free (fm->kmer_1);
+  free (fm->kmer_2);
+
+  if (isMainFM) {
+     if (! (fm->mapped & fmMAPPED_T))  p7_hugemem_Free (fm->T);
+     if (! (fm->mapped & fmMAPPED_SA)) p7_hugemem_Free (fm->SA);
+  }
+}
 
+/* Function:  fm_FM_Sizeof()
+ * Synopsis:  Returns the memory held by an individual FM-index, in bytes.
+ * Purpose:   Counts the arrays <fm> owns, as <fm_FM_destroy()> would
+ *            free them; arrays in a file mapping aren't counted, and
+ *            T and SA only for the main (forward) index, as the
+ *            reverse one shares them.
+ */
+size_t
+fm_FM_Sizeof(const FM_DATA *fm, const FM_METADATA *meta, int isMainFM)
+{
+  int      chars_per_byte   = 8/meta->charBits;
+  uint64_t compressed_bytes = ((chars_per_byte-1+fm->N)/chars_per_byte);
+  uint64_t num_freq_cnts_b  = 1+ceil((double)fm->N/meta->freq_cnt_b);
+  uint64_t num_freq_cnts_sb = 1+ceil((double)fm->N/meta->freq_cnt_sb);
+  uint64_t num_SA_samples   = 1+floor((double)fm->N/meta->freq_SA);
+  size_t   n                = sizeof(FM_DATA) + (1+meta->alph_size) * sizeof(int64_t);  /* C */
+
+  uint64_t num_rank_lines   = fm->N / fm_RANK_LINECHARS + 1;
+
+  if (fm->BWT        && ! (fm->mapped & fmMAPPED_BWT))   n += compressed_bytes + 47;
+  if (fm->occCnts_b  && ! (fm->mapped & fmMAPPED_OCCB))  n += num_freq_cnts_b  * meta->alph_size * sizeof(uint16_t);
+  if (fm->occCnts_sb && ! (fm->mapped & fmMAPPED_OCCSB)) n += num_freq_cnts_sb * meta->alph_size * sizeof(uint32_t);
+  if (fm->rank)  n += num_rank_lines * fm_RANK_LINEWORDS * sizeof(uint64_t) + 63
+                    + ((num_rank_lines - 1) / fm_RANK_SBLINES + 1) * 4 * sizeof(uint32_t);
+  if (fm->kmer_1) n += fm_kmerNodes(meta->alph_size, fm->kmer_k) * sizeof(FM_INTERVAL);
+  if (fm->kmer_2) n += fm_kmerNodes(meta->alph_size, fm->kmer_k) * sizeof(FM_INTERVAL);
   if (isMainFM) {
-     free (fm->T);
-     free (fm->SA);
+    if (fm->T  && ! (fm->mapped & fmMAPPED_T))  n += compressed_bytes;
+    if (fm->SA && ! (fm->mapped & fmMAPPED_SA)) n += num_SA_samples * sizeof(uint32_t);
+  }
+  return n;
+}
+
+
+/* Function:  fm_FM_buildKmers()
+ * Synopsis:  Tabulate the intervals of all short strings in an index pair.
+ *
+ * Purpose:   For the forward index <fmf> and reverse index <fmb> of one
+ *            block, just read, compute the interval of every string of
+ *            length up to <cfg->kmer_k> as the seed search would find
+ *            it: in <fmf->kmer_1> by backward search on <fmf>, and in
+ *            <fmb->kmer_1>, <fmb->kmer_2> by forward search on <fmb>
+ *            (see <fm_updateIntervalForwardAll()>). The top levels of
+ *            every query's seed search trie are then looked up instead
+ *            of counted, and those are the levels whose occ counts are
+ *            spread over the whole index, a cache miss apiece.
+ *
+ *            As in the seed search, the children of a string that
+ *            doesn't occur get its empty interval. <k> is cut down to
+ *            <cfg->max_depth>, and to as many levels as fit in
+ *            fm_KMER_MAXNODES nodes; a <k> below 2 builds nothing, as
+ *            the first level is read from <C> anyway.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; then neither index has
+ *            a table.
+ */
+int
+fm_FM_buildKmers(FM_DATA *fmf, FM_DATA *fmb, const FM_CFG *cfg)
+{
+  int A = cfg->meta->alph_size;
+  int k = ESL_MIN(cfg->kmer_k, cfg->max_depth);
+  int nnodes;
+  int first, last;  // nodes of the current level
+  int level, n, c;
+  int status;
+
+  fmf->kmer_1 = fmf->kmer_2 = fmb->kmer_1 = fmb->kmer_2 = NULL;
+  fmf->kmer_k = fmb->kmer_k = 0;
+
+  while (k > 1 && fm_kmerNodes(A, k) > fm_KMER_MAXNODES) k--;
+  if (k < 2) return eslOK;
+  nnodes = fm_kmerNodes(A, k);
+
+  ESL_ALLOC(fmf->kmer_1, nnodes * sizeof(FM_INTERVAL));
+  ESL_ALLOC(fmb->kmer_1, nnodes * sizeof(FM_INTERVAL));
+  ESL_ALLOC(fmb->kmer_2, nnodes * sizeof(FM_INTERVAL));
+
+  fmf->kmer_1[0].lower = fmb->kmer_1[0].lower = fmb->kmer_2[0].lower = -1;  // the root is never looked up
+  fmf->kmer_1[0].upper = fmb->kmer_1[0].upper = fmb->kmer_2[0].upper = -1;
+  for (c=0; c<A; c++) {
+    fmf->kmer_1[1+c].lower = fmb->kmer_1[1+c].lower = fmb->kmer_2[1+c].lower = fmf->C[c];
+    fmf->kmer_1[1+c].upper = fmb->kmer_1[1+c].upper = fmb->kmer_2[1+c].upper = abs((int)(fmf->C[c+1]))-1;
+  }
+
+  for (level=1, first=1, last=A; level<k; level++) {
+    for (n=first; n<=last; n++) {
+      if ( fmf->kmer_1[n].lower >= 0 && fmf->kmer_1[n].lower <= fmf->kmer_1[n].upper )
+        fm_updateIntervalReverseAll(fmf, cfg, fmf->kmer_1+n, fmf->kmer_1+n*A+1);
+      else
+        for (c=0; c<A; c++) fmf->kmer_1[n*A+1+c] = fmf->kmer_1[n];
+
+      if ( fmb->kmer_1[n].lower >= 0 && fmb->kmer_1[n].lower <= fmb->kmer_1[n].upper )
+        fm_updateIntervalForwardAll(fmb, cfg, fmb->kmer_1+n, fmb->kmer_2+n, fmb->kmer_1+n*A+1, fmb->kmer_2+n*A+1);
+      else
+        for (c=0; c<A; c++) {
+          fmb->kmer_1[n*A+1+c] = fmb->kmer_1[n];
+          fmb->kmer_2[n*A+1+c] = fmb->kmer_2[n];
+        }
+    }
+    first = first*A+1;
+    last  = last*A+A;
+  }
+
+  fmf->kmer_k = fmb->kmer_k = k;
+  return eslOK;
+
+ ERROR:
+  free(fmf->kmer_1);
+  free(fmb->kmer_1);
+  free(fmb->kmer_2);
+  fmf->kmer_1 = fmb->kmer_1 = fmb->kmer_2 = NULL;
+  return status;
+}
+
+
+/* fm_skipPadding()
+ * In an aligned (makehmmerdb --align) file, each array of an FM-index
+ * starts on an fm_ALIGN-byte file offset; step <fp> over the zero
+ * padding in front of the next one.
+ */
+static int
+fm_skipPadding(FILE *fp)
+{
+  off_t off = ftello(fp);
+
+  if (off < 0) return eslEFORMAT;
+  if (off % fm_ALIGN && fseeko(fp, fm_ALIGN - off % fm_ALIGN, SEEK_CUR) != 0) return eslEFORMAT;
+  return eslOK;
+}
+
+/* fm_computeC()
+ * Compute the first position of each letter in the alphabet in a sorted list
+ * (with an extra value to simplify lookup of the last position for the last letter).
+ * Negative values indicate that there are zero of that character in T, can be
+ * used to establish the end of the prior range
+ */
+static void
+fm_computeC(FM_DATA *fm, const FM_METADATA *meta, int num_freq_cnts_sb)
+{
+  //shortcut variables
+  int64_t  *C          = fm->C;
+  uint32_t *occCnts_sb = fm->occCnts_sb;
+  int64_t   prevC;
+  int       cnt;
+  int       i;
+
+  C[0] = 0;
+  for (i=0; i<meta->alph_size; i++) {
+    prevC = abs((int)(C[i]));
+
+    cnt = FM_OCC_CNT( sb, num_freq_cnts_sb-1, i);
+
+    if (cnt==0) {// none of this character
+      C[i+1] = prevC;
+      C[i] *= -1; // use negative to indicate that there's no character of this type, the number gives the end point of the previous
+    } else {
+      C[i+1] = prevC + cnt;
+    }
+  }
+  C[meta->alph_size] *= -1;
+  C[0] = 1;
+}
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+/* fm_mapLayout()
+ * Given the file offset <off> of an FM-index header and the index's
+ * length <N>, fill <pos> with the file offsets of T, BWT, SA, occCnts_b
+ * and occCnts_sb (T and SA only if <withTSA>), and return the offset of
+ * the first byte past the index.
+ */
+static uint64_t
+fm_mapLayout(const FM_METADATA *meta, uint64_t off, uint64_t N, int withTSA, uint64_t pos[5])
+{
+  int      chars_per_byte   = 8/meta->charBits;
+  uint64_t compressed_bytes = ((chars_per_byte-1+N)/chars_per_byte);
+  uint64_t num_freq_cnts_b  = 1+ceil((double)N/meta->freq_cnt_b);
+  uint64_t num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
+  uint64_t num_SA_samples   = 1+floor((double)N/meta->freq_SA);
+  uint64_t nbytes[5];
+  int      i;
+
+  nbytes[0] = withTSA ? compressed_bytes : 0;
+  nbytes[1] = compressed_bytes;
+  nbytes[2] = withTSA ? num_SA_samples * sizeof(uint32_t) : 0;
+  nbytes[3] = num_freq_cnts_b  * meta->alph_size * sizeof(uint16_t);
+  nbytes[4] = num_freq_cnts_sb * meta->alph_size * sizeof(uint32_t);
+
+  off += fm_HEADERSIZE;
+  for (i = 0; i < 5; i++) {
+    if (! withTSA && (i == 0 || i == 2)) { pos[i] = 0; continue; }
+    if (meta->aligned && off % fm_ALIGN) off += fm_ALIGN - off % fm_ALIGN;
+    pos[i] = off;
+    off   += nbytes[i];
+  }
+  return off;
+}
+
+/* fm_mapPrefetch()
+ * Ask the kernel to start paging in the FM-index whose header is at
+ * file offset <off>, so that it's (at least partly) resident by the time
+ * the search gets to it.
+ */
+static void
+fm_mapPrefetch(const FM_METADATA *meta, uint64_t off, int withTSA)
+{
+#ifdef MADV_WILLNEED
+  uint64_t pos[5];
+  uint64_t N;
+  uint64_t end;
+  uint64_t pagesize = (uint64_t) sysconf(_SC_PAGESIZE);
+
+  if (off + fm_HEADERSIZE > meta->mapsize) return;
+  memcpy(&N, meta->map + off, sizeof(uint64_t));
+  end = ESL_MIN(meta->mapsize, fm_mapLayout(meta, off, N, withTSA, pos));
+  off -= off % pagesize;
+  madvise(meta->map + off, end - off, MADV_WILLNEED);
+#endif
+}
+
+/* fm_FM_mapread()
+ * The mmap()'ed version of <fm_FM_read()>. The index is taken from the
+ * mapping at the current position of <meta->fp>, and <meta->fp> is moved
+ * past it afterwards, so callers can keep using fgetpos()/fsetpos() to
+ * rewind the database as they do with fread(). An array points straight
+ * into the mapping when its file offset suits its alignment (always, in
+ * a file built with makehmmerdb --align); otherwise it is copied.
+ */
+static int
+fm_FM_mapread( FM_DATA *fm, FM_METADATA *meta, int getAll )
+{
+  int      chars_per_byte = 8/meta->charBits;
+  uint64_t compressed_bytes;
+  uint64_t num_freq_cnts_b;
+  uint64_t num_freq_cnts_sb;
+  uint64_t num_SA_samples;
+  uint64_t pos[5];
+  uint64_t off;
+  uint64_t end;
+  char    *hdr;
+  off_t    here;
+  int      status;
+
+  if ((here = ftello(meta->fp)) < 0) { status = eslEFORMAT; goto ERROR; }
+  off = (uint64_t) here;
+  if (off + fm_HEADERSIZE > meta->mapsize) { status = eslEFORMAT; goto ERROR; }
+
+  hdr = meta->map + off;
+  memcpy(&(fm->N),            hdr,      sizeof(uint64_t));
+  memcpy(&(fm->term_loc),     hdr +  8, sizeof(uint32_t));
+  memcpy(&(fm->seq_offset),   hdr + 12, sizeof(uint32_t));
+  memcpy(&(fm->ambig_offset), hdr + 16, sizeof(uint32_t));
+  memcpy(&(fm->overlap),      hdr + 20, sizeof(uint32_t));
+  memcpy(&(fm->seq_cnt),      hdr + 24, sizeof(uint32_t));
+  memcpy(&(fm->ambig_cnt),    hdr + 28, sizeof(uint32_t));
+
+  compressed_bytes = ((chars_per_byte-1+fm->N)/chars_per_byte);
+  num_freq_cnts_b  = 1+ceil((double)fm->N/meta->freq_cnt_b);
+  num_freq_cnts_sb = 1+ceil((double)fm->N/meta->freq_cnt_sb);
+  num_SA_samples   = 1+floor((double)fm->N/meta->freq_SA);
+
+  end = fm_mapLayout(meta, off, fm->N, getAll, pos);
+  if (end > meta->mapsize) { status = eslEFORMAT; goto ERROR; }
+
+  /* the current index, and the one after it: with both strands in the
+   * file, T and SA come with every other index.
+   */
+  fm_mapPrefetch(meta, off, getAll);
+  fm_mapPrefetch(meta, end, meta->fwd_only ? TRUE : !getAll);
+
+  if (getAll) { // T is bytes, so it can always be used in place
+    fm->T       = (uint8_t *) (meta->map + pos[0]);
+    fm->mapped |= fmMAPPED_T;
+  }
+
+  /* fm_sse.c reads BWT with aligned 16-byte loads (fm_avx.c, unaligned
+   * 32-byte ones). Reads past the end of the BWT stay inside the mapping,
+   * since the occ arrays follow it.
+   */
+  if (pos[1] % 16 == 0) {
+    fm->BWT     = (uint8_t *) (meta->map + pos[1]);
+    fm->mapped |= fmMAPPED_BWT;
+  } else {
+    FM_BIGALLOC (fm->BWT_mem,  sizeof(uint8_t) * (compressed_bytes + 47) );
+    fm->BWT =   (uint8_t *) (((unsigned long int)fm->BWT_mem + 15) & (~0xf));
+    memcpy(fm->BWT, meta->map + pos[1], compressed_bytes);
+  }
+
+  if (getAll) {
+    if (pos[2] % sizeof(uint32_t) == 0) {
+      fm->SA      = (uint32_t *) (meta->map + pos[2]);
+      fm->mapped |= fmMAPPED_SA;
+    } else {
+      FM_BIGALLOC (fm->SA, num_SA_samples * sizeof(uint32_t));
+      memcpy(fm->SA, meta->map + pos[2], num_SA_samples * sizeof(uint32_t));
+    }
+  }
+
+  if (pos[3] % sizeof(uint16_t) == 0) {
+    fm->occCnts_b = (uint16_t *) (meta->map + pos[3]);
+    fm->mapped   |= fmMAPPED_OCCB;
+  } else {
+    FM_BIGALLOC (fm->occCnts_b,  num_freq_cnts_b *  (meta->alph_size ) * sizeof(uint16_t));
+    memcpy(fm->occCnts_b, meta->map + pos[3], num_freq_cnts_b *  (meta->alph_size ) * sizeof(uint16_t));
+  }
+
+  if (pos[4] % sizeof(uint32_t) == 0) {
+    fm->occCnts_sb = (uint32_t *) (meta->map + pos[4]);
+    fm->mapped    |= fmMAPPED_OCCSB;
+  } else {
+    FM_BIGALLOC (fm->occCnts_sb,  num_freq_cnts_sb *  (meta->alph_size ) * sizeof(uint32_t));
+    memcpy(fm->occCnts_sb, meta->map + pos[4], num_freq_cnts_sb *  (meta->alph_size ) * sizeof(uint32_t));
   }
+
+  ESL_ALLOC (fm->C, (1+meta->alph_size) * sizeof(int64_t));
+  fm_computeC(fm, meta, num_freq_cnts_sb);
+
+  if (fseeko(meta->fp, (off_t) end, SEEK_SET) != 0) { status = eslEFORMAT; goto ERROR; }
+  return eslOK;
+
+ERROR:
+  fm_FM_destroy(fm, getAll);
+  return status;
 }
+#endif /*HAVE_MMAP && HAVE_SYS_MMAN_H*/
+
 
 /* Function:  fm_FM_read()
  * Synopsis:  Read the FM index off disk
  * Purpose:   Read the FM-index as written by fmbuild.
  *            First read the metadata header, then allocate space for the full index,
  *            then read it in.
+ *
+ *            If <meta->interleave> is set and the index is DNA, its
+ *            BWT and occ arrays are then replaced by the interleaved
+ *            rank layout (see fm_interleaveRank()).
+ *
+ *            If the file has been mapped with <fm_mapFMfile()>, the
+ *            index's arrays point into the mapping instead of being
+ *            read into fresh allocations.
  */
 int
 fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
 {
-  //shortcut variables
-  int64_t *C               = NULL;
-
-  int i;
-  uint32_t *occCnts_sb = NULL;
   int32_t compressed_bytes;
   int num_freq_cnts_b;
   int num_freq_cnts_sb;
   int num_SA_samples;
-  int64_t prevC;
-  int cnt;
   int chars_per_byte = 8/meta->charBits;
   int status;
 
+  fm->T          = NULL;
+  fm->BWT_mem    = NULL;
+  fm->BWT        = NULL;
+  fm->SA         = NULL;
+  fm->C          = NULL;
+  fm->occCnts_sb = NULL;
+  fm->occCnts_b  = NULL;
+  fm->rank_mem   = NULL;
+  fm->rank       = NULL;
+  fm->rank_sb    = NULL;
+  fm->mapped     = 0;
+  fm->kmer_1     = NULL;
+  fm->kmer_2     = NULL;
+  fm->kmer_k     = 0;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (meta->map) {
+    if ((status = fm_FM_mapread(fm, meta, getAll)) != eslOK) return status;
+    if (meta->interleave && meta->alph_type == fm_DNA && (status = fm_interleaveRank(fm)) != eslOK) goto ERROR;
+    return eslOK;
+  }
+#endif
 
   if(fread(&(fm->N), sizeof(uint64_t), 1, meta->fp) !=  1            ||
      fread(&(fm->term_loc), sizeof(uint32_t), 1, meta->fp) !=  1     ||
@@ -524,47 +1235,32 @@ fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
   num_SA_samples   = 1+floor((double)fm->N/meta->freq_SA);
 
   // allocate space, then read the data
-  if (getAll) ESL_ALLOC (fm->T, sizeof(uint8_t) * compressed_bytes );
-  ESL_ALLOC (fm->BWT_mem,  sizeof(uint8_t) * (compressed_bytes + 31) ); // +31 for manual 16-byte alignment  ( typically only need +15, but this allows offset in memory, plus offset in case of <16 bytes of characters at the end)
+  if (getAll) FM_BIGALLOC (fm->T, sizeof(uint8_t) * compressed_bytes );
+  FM_BIGALLOC (fm->BWT_mem,  sizeof(uint8_t) * (compressed_bytes + 47) ); // +47 for manual 16-byte alignment  ( +15 ), plus the 32-byte reads of the AVX2 counts (impl_sse/fm_avx.c) that run past the last byte of characters
      fm->BWT =   (uint8_t *) (((unsigned long int)fm->BWT_mem + 15) & (~0xf));   // align vector memory on 16-byte boundaries
-  if (getAll) ESL_ALLOC (fm->SA, num_SA_samples * sizeof(uint32_t));
+  if (getAll) FM_BIGALLOC (fm->SA, num_SA_samples * sizeof(uint32_t));
   ESL_ALLOC (fm->C, (1+meta->alph_size) * sizeof(int64_t));
-  ESL_ALLOC (fm->occCnts_b,  num_freq_cnts_b *  (meta->alph_size ) * sizeof(uint16_t)); // every freq_cnt positions, store an array of ints
-  ESL_ALLOC (fm->occCnts_sb,  num_freq_cnts_sb *  (meta->alph_size ) * sizeof(uint32_t)); // every freq_cnt positions, store an array of ints
+  FM_BIGALLOC (fm->occCnts_b,  num_freq_cnts_b *  (meta->alph_size ) * sizeof(uint16_t)); // every freq_cnt positions, store an array of ints
+  FM_BIGALLOC (fm->occCnts_sb,  num_freq_cnts_sb *  (meta->alph_size ) * sizeof(uint32_t)); // every freq_cnt positions, store an array of ints
 
 
   if(
+     (getAll && meta->aligned && fm_skipPadding(meta->fp) != eslOK)                                ||
      (getAll && fread(fm->T, sizeof(uint8_t), compressed_bytes, meta->fp) != compressed_bytes) ||
+     (meta->aligned && fm_skipPadding(meta->fp) != eslOK)                                          ||
      (fread(fm->BWT, sizeof(uint8_t), compressed_bytes, meta->fp)  != compressed_bytes) ||
+     (getAll && meta->aligned && fm_skipPadding(meta->fp) != eslOK)                                ||
      (getAll && fread(fm->SA, sizeof(uint32_t), (size_t)num_SA_samples, meta->fp) != (size_t)num_SA_samples)  ||
+     (meta->aligned && fm_skipPadding(meta->fp) != eslOK)                                          ||
      (fread(fm->occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, meta->fp) != (size_t)num_freq_cnts_b)  ||
+     (meta->aligned && fm_skipPadding(meta->fp) != eslOK)                                          ||
      (fread(fm->occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, meta->fp) != (size_t)num_freq_cnts_sb)
     )
     {status=eslEFORMAT; goto ERROR;}
 
-  //shortcut variables
-  C          = fm->C;
-  occCnts_sb = fm->occCnts_sb;
-
-  /*compute the first position of each letter in the alphabet in a sorted list
-  * (with an extra value to simplify lookup of the last position for the last letter).
-  * Negative values indicate that there are zero of that character in T, can be
-  * used to establish the end of the prior range*/
-  C[0] = 0;
-  for (i=0; i<meta->alph_size; i++) {
-    prevC = abs((int)(C[i]));
-
-    cnt = FM_OCC_CNT( sb, num_freq_cnts_sb-1, i);
+  fm_computeC(fm, meta, num_freq_cnts_sb);
 
-    if (cnt==0) {// none of this character
-      C[i+1] = prevC;
-      C[i] *= -1; // use negative to indicate that there's no character of this type, the number gives the end point of the previous
-    } else {
-      C[i+1] = prevC + cnt;
-    }
-  }
-  C[meta->alph_size] *= -1;
-  C[0] = 1;
+  if (meta->interleave && meta->alph_type == fm_DNA && (status = fm_interleaveRank(fm)) != eslOK) goto ERROR;
 
   return eslOK;
 
@@ -586,6 +1282,9 @@ fm_readFMmeta( FM_METADATA *meta)
   int status;
   int i;
 
+  meta->aligned = FALSE;
+  meta->map     = NULL;
+  meta->mapsize = 0;
 
   fm_initAmbiguityList(meta->ambig_list);
 
@@ -603,6 +1302,12 @@ fm_readFMmeta( FM_METADATA *meta)
   )
   {status=eslEFORMAT; goto ERROR;}
 
+  /* the fwd_only byte also carries the layout flags */
+  if (meta->fwd_only & fm_FLAG_ALIGNED) {
+    meta->aligned   = TRUE;
+    meta->fwd_only &= ~fm_FLAG_ALIGNED;
+  }
+
   /* sanity check - are these metadata for a real FM index?
    * TODO: in an upcoming renovation of FM, capture FM validation & version as part of metadata header
    */
@@ -670,6 +1375,66 @@ ERROR:
 }
 
 
+/* Function:  fm_mapFMfile()
+ * Synopsis:  Memory-map the FM-index file for <fm_FM_read()>
+ *
+ * Purpose:   After <fm_readFMmeta()>, map all of <meta->fp> read-only
+ *            and shared, so that subsequent <fm_FM_read()> calls point
+ *            into the mapping instead of reading each index into
+ *            private memory. Concurrent searches of the same database
+ *            then share one copy in the page cache, and a search starts
+ *            without first loading the whole index. Pages of the next
+ *            index are prefetched as each one is read.
+ *
+ *            The file position of <meta->fp> is still used (and kept up)
+ *            to say which index comes next.
+ *
+ *            If mmap() isn't available here, or fails, nothing changes
+ *            and <fm_FM_read()> goes on using fread().
+ *
+ * Returns:   <eslOK> if the file is mapped; <eslFAIL> if not, which is
+ *            not an error.
+ */
+int
+fm_mapFMfile(FM_METADATA *meta)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  struct stat st;
+  void       *p;
+  off_t       here;
+
+  if (meta->map) return eslOK;
+  if (fstat(fileno(meta->fp), &st) != 0 || st.st_size <= 0) return eslFAIL;
+  if ((here = ftello(meta->fp)) < 0)                         return eslFAIL;
+
+  p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(meta->fp), 0);
+  if (p == MAP_FAILED) return eslFAIL;
+
+  meta->map     = (char *) p;
+  meta->mapsize = (uint64_t) st.st_size;
+  fm_mapPrefetch(meta, (uint64_t) here, TRUE);
+  return eslOK;
+#else
+  return eslFAIL;
+#endif
+}
+
+/* Function:  fm_unmapFMfile()
+ * Synopsis:  Release a mapping made by <fm_mapFMfile()>
+ *
+ * Purpose:   Unmap the FM-index file. Any <FM_DATA> read from the
+ *            mapping must be destroyed first.
+ */
+void
+fm_unmapFMfile(FM_METADATA *meta)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (meta && meta->map) munmap(meta->map, meta->mapsize);
+#endif
+  if (meta) { meta->map = NULL; meta->mapsize = 0; }
+}
+
+
 /* Function:  fm_configAlloc()
  * Synopsis:  Allocate a <FM_CFG> model object, and its FM_METADATA
  */
@@ -683,6 +1448,10 @@ fm_configAlloc(FM_CFG **cfg)
 
   ESL_ALLOC(*cfg, sizeof(FM_CFG) );
   ESL_ALLOC((*cfg)->meta, sizeof(FM_METADATA));
+  (*cfg)->meta->map     = NULL;
+  (*cfg)->meta->mapsize = 0;
+  (*cfg)->meta->aligned = FALSE;
+  (*cfg)->meta->interleave = FALSE;
   ESL_ALLOC ((*cfg)->meta->ambig_list, sizeof(FM_AMBIGLIST));
 
   return eslOK;
@@ -724,6 +1493,7 @@ int
 fm_metaDestroy(FM_METADATA *meta ) {
   int i;
   if (meta != NULL) {
+    fm_unmapFMfile(meta);
     for (i=0; i<meta->seq_count; i++) {
       if(meta->seq_data[i].name)   free(meta->seq_data[i].name);
       if(meta->seq_data[i].acc)    free(meta->seq_data[i].acc);
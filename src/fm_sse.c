@@ -56,13 +56,22 @@ fm_print_m128_rev (__m128i in)
 
 
 /* Function:  fm_initConfig()
- * Purpose:   Initialize vector masks used in SSE FMindex implementation
+ * Purpose:   Initialize vector masks used in SSE FMindex implementation,
+ *            and decide whether occurrence counts can use the AVX2
+ *            versions (a DNA index, with occ_b checkpoints spaced in
+ *            multiples of 128 chars, on a host with AVX2).
  */
 int
 fm_configInit( FM_CFG *cfg, ESL_GETOPTS *go )
 {
   fm_initConfigGeneric(cfg, go);
 
+#ifdef HMMER_AVX2
+  cfg->occ_avx2 = (impl_HaveAVX2() && cfg->meta->alph_type == fm_DNA && cfg->meta->freq_cnt_b % 128 == 0);
+#else
+  cfg->occ_avx2 = FALSE;
+#endif
+
 #if defined (eslENABLE_SSE)
   int i,j;
   int trim_chunk_count;
@@ -186,10 +195,19 @@ ERROR:
  *            that _mm_load_si128 calls appropriately meet 16-byte-alignment requirements. That's
  *            a reasonable expectation, as spacings of 256 or more seem to give the best speed,
  *            and certainly better space-utilization.
+ *
+ *            If <cfg->occ_avx2> is set, the count is done by the AVX2 version,
+ *            <fm_getOccCount_avx()>, instead; and for an index in the
+ *            interleaved rank layout, <fm_getOccCountRank()>.
  */
 int
 fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
 {
+  if (fm->rank) return fm_getOccCountRank(fm, cfg, pos, c);
+#ifdef HMMER_AVX2
+  if (cfg->occ_avx2) return fm_getOccCount_avx(fm, cfg, pos, c);
+#endif
+
   FM_METADATA *meta = cfg->meta;
   int cnt = 0;
   const int b_pos          = (pos+1) / meta->freq_cnt_b ; //floor(pos/b_size)   : the b count element preceding pos
@@ -370,10 +388,18 @@ fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
  *            a reasonable expectation, as spacings of 256 or more seem to give the best speed,
  *            and certainly better space-utilization.
  *
+ *            If <cfg->occ_avx2> is set, the counts are done by the AVX2 version,
+ *            <fm_getOccCountLT_avx()>, instead; and for an index in the
+ *            interleaved rank layout, <fm_getOccCountLTRank()>.
  */
 int
 fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt)
 {
+  if (fm->rank) return fm_getOccCountLTRank(fm, cfg, pos, c, cnteq, cntlt);
+#ifdef HMMER_AVX2
+  if (cfg->occ_avx2) return fm_getOccCountLT_avx(fm, cfg, pos, c, cnteq, cntlt);
+#endif
+
   FM_METADATA *meta = cfg->meta;
   int i;
   const uint16_t * occCnts_b  = fm->occCnts_b;
@@ -410,7 +436,7 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
 #if   defined (eslENABLE_SSE)
   int j;
 
-  if ( landmark < fm->N - 1 || landmark == -1 ) {
+  if ( landmark < fm->N || landmark == -1 ) {
 
     const uint8_t * BWT = fm->BWT;
 
@@ -620,3 +646,186 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
 
 }
 
+
+
+/* Function:  fm_getOccCountAll()
+ * Synopsis:  Compute number of occurrences of every character in BWT[1..pos]
+ *
+ * Purpose:   Same as calling <fm_getOccCount()> for each character c of the
+ *            alphabet, returning the counts in <cnt[0..alph_size-1]>, but
+ *            (for DNA) with a single scan from the checkpoint: each 16-byte
+ *            vector is matched against the first three characters, and
+ *            the count of the fourth is what's left. This is what lets
+ *            FM_Recurse() compute the intervals of all the children of a
+ *            trie node at once.
+ *
+ *            If <cfg->occ_avx2> is set, the counts are done by the AVX2 version,
+ *            <fm_getOccCountAll_avx()>, instead; and for an index in the
+ *            interleaved rank layout, <fm_getOccCountAllRank()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+fm_getOccCountAll (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint32_t *cnt)
+{
+  FM_METADATA *meta = cfg->meta;
+  int c;
+
+  if (fm->rank) return fm_getOccCountAllRank(fm, cfg, pos, cnt);
+#ifdef HMMER_AVX2
+  if (cfg->occ_avx2) return fm_getOccCountAll_avx(fm, cfg, pos, cnt);
+#endif
+
+  if (meta->alph_type != fm_DNA) {
+    for (c=0; c<meta->alph_size; c++)
+      cnt[c] = fm_getOccCount(fm, cfg, pos, c);
+    return eslOK;
+  }
+
+  const uint16_t * occCnts_b  = fm->occCnts_b;
+  const uint32_t * occCnts_sb = fm->occCnts_sb;
+  const int b_pos          = (pos+1) / meta->freq_cnt_b ; //floor(pos/b_size)   : the b count element preceding pos
+  const int sb_pos         = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
+  const int cnt_mod_mask_b = meta->freq_cnt_b - 1; //used to compute the mod function
+  const int b_rel_pos      = (pos+1) & cnt_mod_mask_b; // pos % b_size      : how close is pos to the boundary corresponding to b_pos
+  int up_b           = 2*b_rel_pos/meta->freq_cnt_b; //1 if pos is expected to be closer to the boundary of b_pos+1, 0 otherwise
+  int landmark       = ((b_pos+up_b)*meta->freq_cnt_b) - 1 ;
+
+  if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
+    up_b      = 0;
+    landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
+  }
+
+  // get the cnts stored at the nearest checkpoint
+  for (c=0; c<4; c++) {
+    cnt[c] = FM_OCC_CNT(sb, sb_pos, c );
+    if (up_b)
+      cnt[c] += FM_OCC_CNT(b, b_pos + 1, c ) ;
+    else if ( b_pos !=  sb_pos * (meta->freq_cnt_sb / meta->freq_cnt_b) )
+      cnt[c] += FM_OCC_CNT(b, b_pos, c )  ;// b_pos has cumulative counts since the prior sb_pos - if sb_pos references the same count as b_pos, it'll doublecount
+  }
+
+#if defined (eslENABLE_SSE)
+  int i;
+
+  if ( landmark < fm->N || landmark == -1 ) {
+    const uint8_t * BWT = fm->BWT;
+    int      sign  = ( up_b == 1 ?  -1 : 1);
+    int      nscan = ( up_b == 1 ?  landmark - pos : pos - landmark); // number of chars counted from the checkpoint
+    uint32_t scnt[3];
+
+    register __m128i BWT_v;
+    register __m128i tmp_v;
+    register __m128i tmp2_v;
+    register __m128i counts0_v = cfg->fm_neg128_v; // as in fm_getOccCount(): offset -128 in signed bytes
+    register __m128i counts1_v = cfg->fm_neg128_v;
+    register __m128i counts2_v = cfg->fm_neg128_v;
+
+    if (!up_b) { // count forward, adding
+      for (i=1+floor(landmark/4.0) ; i+15<( (pos+1)/4);  i+=16) { // keep running until i begins a run that shouldn't all be counted
+        BWT_v    = *(__m128i*)(BWT+i);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[0], tmp_v, tmp2_v, tmp_v);  FM_COUNT_2BIT(tmp_v, tmp2_v, counts0_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[1], tmp_v, tmp2_v, tmp_v);  FM_COUNT_2BIT(tmp_v, tmp2_v, counts1_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[2], tmp_v, tmp2_v, tmp_v);  FM_COUNT_2BIT(tmp_v, tmp2_v, counts2_v);
+      }
+
+      int remaining_cnt = pos + 1 -  i*4 ;
+      if (remaining_cnt > 0) {
+        BWT_v    = *(__m128i*)(BWT+i);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[0], tmp_v, tmp2_v, tmp_v);
+        tmp_v    = _mm_and_si128(tmp_v, *(cfg->fm_masks_v + remaining_cnt)); // leaves only the remaining_cnt chars in the array
+        FM_COUNT_2BIT(tmp_v, tmp2_v, counts0_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[1], tmp_v, tmp2_v, tmp_v);
+        tmp_v    = _mm_and_si128(tmp_v, *(cfg->fm_masks_v + remaining_cnt));
+        FM_COUNT_2BIT(tmp_v, tmp2_v, counts1_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[2], tmp_v, tmp2_v, tmp_v);
+        tmp_v    = _mm_and_si128(tmp_v, *(cfg->fm_masks_v + remaining_cnt));
+        FM_COUNT_2BIT(tmp_v, tmp2_v, counts2_v);
+      }
+
+    } else { // count backwards, subtracting
+      for (i=(landmark/4)-15 ; i>(pos/4);  i-=16) {
+        BWT_v = *(__m128i*)(BWT+i);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[0], tmp_v, tmp2_v, tmp_v);  FM_COUNT_2BIT(tmp_v, tmp2_v, counts0_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[1], tmp_v, tmp2_v, tmp_v);  FM_COUNT_2BIT(tmp_v, tmp2_v, counts1_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[2], tmp_v, tmp2_v, tmp_v);  FM_COUNT_2BIT(tmp_v, tmp2_v, counts2_v);
+      }
+
+      int remaining_cnt = 64 - (pos + 1 - i*4);
+      if (remaining_cnt > 0) {
+        BWT_v = *(__m128i*)(BWT+i);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[0], tmp_v, tmp2_v, tmp_v);
+        tmp_v    = _mm_and_si128(tmp_v, *(cfg->fm_reverse_masks_v + remaining_cnt)); // leaves only the remaining_cnt chars in the array
+        FM_COUNT_2BIT(tmp_v, tmp2_v, counts0_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[1], tmp_v, tmp2_v, tmp_v);
+        tmp_v    = _mm_and_si128(tmp_v, *(cfg->fm_reverse_masks_v + remaining_cnt));
+        FM_COUNT_2BIT(tmp_v, tmp2_v, counts1_v);
+        FM_MATCH_2BIT(BWT_v, cfg->fm_chars_v[2], tmp_v, tmp2_v, tmp_v);
+        tmp_v    = _mm_and_si128(tmp_v, *(cfg->fm_reverse_masks_v + remaining_cnt));
+        FM_COUNT_2BIT(tmp_v, tmp2_v, counts2_v);
+      }
+    }
+
+    counts0_v = _mm_xor_si128(counts0_v, cfg->fm_neg128_v); //counts are stored in signed bytes, base -128. Move them to unsigned bytes
+    FM_GATHER_8BIT_COUNTS(counts0_v,counts0_v,counts0_v);
+    counts1_v = _mm_xor_si128(counts1_v, cfg->fm_neg128_v);
+    FM_GATHER_8BIT_COUNTS(counts1_v,counts1_v,counts1_v);
+    counts2_v = _mm_xor_si128(counts2_v, cfg->fm_neg128_v);
+    FM_GATHER_8BIT_COUNTS(counts2_v,counts2_v,counts2_v);
+
+    scnt[0] = _mm_extract_epi16(counts0_v, 0);
+    scnt[1] = _mm_extract_epi16(counts1_v, 0);
+    scnt[2] = _mm_extract_epi16(counts2_v, 0);
+    cnt[0] += sign * scnt[0];
+    cnt[1] += sign * scnt[1];
+    cnt[2] += sign * scnt[2];
+    cnt[3] += sign * (nscan - scnt[0] - scnt[1] - scnt[2]);
+  }
+
+  if (pos >= fm->term_loc) { // I overcounted 'A' by one, because '$' was replaced with an 'A'
+    cnt[0]--;
+  }
+
+#endif //#if   defined (eslENABLE_SSE)
+
+  return eslOK;
+}
+
+
+/* Function:  fm_prefetchOcc()
+ * Synopsis:  Prefetch what an occurrence count at <pos> will read.
+ *
+ * Purpose:   Issue software prefetches for the checkpoint counts and
+ *            the BWT bytes that <fm_getOccCount*()> will read to count
+ *            occurrences in BWT[0..pos], so that the cache misses of
+ *            several counts overlap instead of coming one at a time.
+ *            Does nothing for <pos> < 0.
+ */
+void
+fm_prefetchOcc (const FM_DATA *fm, const FM_CFG *cfg, int pos)
+{
+#if defined (eslENABLE_SSE)
+  FM_METADATA *meta = cfg->meta;
+  const uint16_t * occCnts_b  = fm->occCnts_b;
+  const uint32_t * occCnts_sb = fm->occCnts_sb;
+  const int b_pos          = (pos+1) / meta->freq_cnt_b ;
+  const int sb_pos         = (pos+1) / meta->freq_cnt_sb;
+  const int b_rel_pos      = (pos+1) & (meta->freq_cnt_b - 1);
+  int up_b           = 2*b_rel_pos/meta->freq_cnt_b;
+
+  if (pos < 0) return;
+  if (fm->rank) {  // one line, and its superblock's counts
+    _mm_prefetch((const char *) (fm->rank    + ((pos+1) / fm_RANK_LINECHARS) * fm_RANK_LINEWORDS),   _MM_HINT_T0);
+    _mm_prefetch((const char *) (fm->rank_sb + ((pos+1) / fm_RANK_LINECHARS / fm_RANK_SBLINES) * 4), _MM_HINT_T0);
+    return;
+  }
+  if (((b_pos+up_b)*meta->freq_cnt_b) - 1 >= fm->N) up_b = 0;
+
+  _mm_prefetch((const char *) &(FM_OCC_CNT(sb, sb_pos, 0)),     _MM_HINT_T0);
+  _mm_prefetch((const char *) &(FM_OCC_CNT(b, b_pos+up_b, 0)),  _MM_HINT_T0);
+  if (meta->alph_type == fm_DNA)
+    _mm_prefetch((const char *) (fm->BWT + pos/4),              _MM_HINT_T0); // the scan's other end lies in the same or a neighboring line
+  else
+    _mm_prefetch((const char *) (fm->BWT + pos),                _MM_HINT_T0);
+#endif
+}
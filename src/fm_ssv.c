@@ -1,6 +1,9 @@
 #include <p7_config.h>
 
 #include <string.h>
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -122,21 +125,23 @@ FM_mergeSeeds(FM_DIAGLIST *seeds, int N, int ssv_length) {
   * Args:      fmf             - FM index for finding matches to the input sequence
   *            fm_cfg          - FM-index meta data
   *            i               - Single position in the BWT
+  *            nocc            - RETURN: incremented by the number of occ counts done
   *
   * Returns:   <eslOK> on success.
   */
 static uint32_t
-FM_backtrackSeed(const FM_DATA *fmf, const FM_CFG *fm_cfg, int i) {
+FM_backtrackSeed(const FM_DATA *fmf, const FM_CFG *fm_cfg, int i, uint64_t *nocc) {
   int j = i;
   int len = 0;
   int c;
 
   while ( j != fmf->term_loc && (j % fm_cfg->meta->freq_SA)) { //go until we hit a position in the full SA that was sampled during FM index construction
-    c = fm_getChar( fm_cfg->meta->alph_type, j, fmf->BWT);
+    c = fm_getBWTChar( fmf, fm_cfg->meta->alph_type, j);
     j = fm_getOccCount (fmf, fm_cfg, j-1, c);
     j += abs((int)(fmf->C[c]));
     len++;
   }
+  *nocc += len;
 
   return len + (j==fmf->term_loc ? 0 : fmf->SA[ j / fm_cfg->meta->freq_SA ]) ; // len is how many backward steps we had to take to find a sampled SA position
 }
@@ -159,6 +164,7 @@ FM_backtrackSeed(const FM_DATA *fmf, const FM_CFG *fm_cfg, int i) {
  *            complementarity - top or bottom strand
  *            interval        - FM-index interval
  *            seeds           - RETURN: collection of threshold-passing windows
+ *            nocc            - RETURN: incremented by the number of occ counts done
  *
  * Returns:   <eslOK> on success.
  */
@@ -167,7 +173,7 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
             int k, int M, float sc, int depth, int fm_direction,
             int model_direction, int complementarity,
             FM_INTERVAL *interval,
-            FM_DIAGLIST *seeds
+            FM_DIAGLIST *seeds, uint64_t *nocc
             )
 {
   int i;
@@ -181,9 +187,9 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
     seed->length = depth;
 
     if (complementarity == p7_NOCOMPLEMENT )
-      seed->n    =  fmf->N - FM_backtrackSeed(fmf, fm_cfg, i) - depth - 1;
+      seed->n    =  fmf->N - FM_backtrackSeed(fmf, fm_cfg, i, nocc) - depth - 1;
     else
-      seed->n    =  FM_backtrackSeed(fmf, fm_cfg, i) ;
+      seed->n    =  FM_backtrackSeed(fmf, fm_cfg, i, nocc) ;
 
     seed->complementarity = complementarity;
 
@@ -206,6 +212,66 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
   return eslOK;
 }
 
+/* Function:  FM_nextIntervals()
+ *
+ * Synopsis:  Compute the intervals of all the children of a trie node
+ *
+ * Details:   Fill <next_1[c]> (and <next_2[c]>, for fm_backward) with the
+ *            intervals of the strings made by extending the node's string
+ *            with each character c, as fm_updateIntervalReverse() (or
+ *            fm_updateIntervalForward()) would, but with one all-character
+ *            occ count at each end of the node's interval. A child whose
+ *            parent interval is empty gets the parent's interval, unchanged.
+ *
+ *            Then prefetch the checkpoint and BWT lines that the children's
+ *            own lookups will read, so that when FM_Recurse() descends into
+ *            them the cache misses have been overlapping with the scoring
+ *            of this node's diagonals, rather than being taken one at a time.
+ *
+ *            If the children are short enough to be in the index's k-mer
+ *            table (<fm_FM_buildKmers()>), <node> is the node's number in
+ *            it, and the children are copied from the table instead;
+ *            nothing is prefetched unless the grandchildren aren't in the
+ *            table too. Otherwise <node> is -1.
+ */
+static void
+FM_nextIntervals( int depth, int node, int fm_direction,
+                  const FM_DATA *fmf, const FM_DATA *fmb, const FM_CFG *fm_cfg,
+                  const FM_INTERVAL *interval_1, const FM_INTERVAL *interval_2,
+                  FM_INTERVAL *next_1, FM_INTERVAL *next_2, uint64_t *nocc)
+{
+  const FM_DATA *fm = (fm_direction == fm_forward ? fmf : fmb);
+  int A = fm_cfg->meta->alph_size;
+  int c;
+
+  if (node >= 0) {
+    memcpy(next_1, fm->kmer_1 + node*A+1, A * sizeof(FM_INTERVAL));
+    if (fm_direction != fm_forward) memcpy(next_2, fm->kmer_2 + node*A+1, A * sizeof(FM_INTERVAL));
+    if (depth < fm->kmer_k) return;
+  } else if ( interval_1->lower >= 0 && interval_1->lower <= interval_1->upper  ) { //no use extending a non-existent string
+    if (fm_direction == fm_forward)
+      fm_updateIntervalReverseAll( fmf, fm_cfg, interval_1, next_1);
+    else
+      fm_updateIntervalForwardAll( fmb, fm_cfg, interval_1, interval_2, next_1, next_2);
+    *nocc += 2;
+  } else {
+    for (c=0; c<A; c++) {
+      next_1[c] = *interval_1;
+      if (fm_direction != fm_forward) next_2[c] = *interval_2;
+    }
+    return;
+  }
+
+  if (depth < fm_cfg->max_depth) { // children at max_depth are never extended
+    for (c=0; c<A; c++) {
+      if ( next_1[c].lower >= 0 && next_1[c].lower <= next_1[c].upper  ) {
+        fm_prefetchOcc(fm, fm_cfg, next_1[c].lower - 1);
+        fm_prefetchOcc(fm, fm_cfg, next_1[c].upper);
+      }
+    }
+  }
+}
+
 /* Function:  FM_Recurse()
  *
  * Synopsis:  Recursively traverse/prune a string trie, testing all strings vs the model
@@ -218,7 +284,15 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
  *            over either the top or bottom (reverse complemented) strand
  *            of the target sequences.
  *
+ *            The intervals of all of P's children are computed together
+ *            (FM_nextIntervals()) the first time any of them is needed, and
+ *            the lookups they'll need in turn are prefetched then. The trie
+ *            is still walked depth first, so seeds come out in the same
+ *            order as before. Down to the length of the index's k-mer
+ *            table, the intervals are looked up, not counted.
+ *
  * Args:      depth       - how long is the current path
+ *            node        - the path's number in the k-mer table of <fmf>, <fmb>, or -1 below it
  *            Kp          - alphabet size (including ambiguity)
  *            fmf         - FM index for finding matches to the input sequence
  *            fmb         - FM index for finding matches to the reverse of the input sequence
@@ -230,20 +304,22 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
  *            last        - The index of the last entry in dp_pairs for the current column of the DP table
  *            interval_1  - FM-index interval - used for the standard backwards pass along the BWT (fmf)
  *            interval_2  - FM-index interval - used for the forward pass along the BWT (fmb)
+ *            c_only      - if >=0, extend the path only by this character (for splitting the trie among threads); else -1
  *            seeds       - RETURN: collection of threshold-passing windows
+ *            nocc        - RETURN: incremented by the number of occ counts done
  *            seq         - preallocated char* used to capture and print the string for the current path - for debugging only
  *
  * Returns:   <eslOK> on success.
  */
 static int
-FM_Recurse( int depth, int Kp, int fm_direction,
+FM_Recurse( int depth, int node, int Kp, int fm_direction,
             const FM_DATA *fmf, const FM_DATA *fmb,
             const FM_CFG *fm_cfg,
             const P7_SCOREDATA *ssvdata, uint8_t *consensus,
             float sc_threshFM,
             FM_DP_PAIR *dp_pairs, int first, int last,
             FM_INTERVAL *interval_1, FM_INTERVAL *interval_2,
-            FM_DIAGLIST *seeds
+            int c_only, FM_DIAGLIST *seeds, uint64_t *nocc
 //            , char *seq
           )
 {
@@ -252,12 +328,17 @@ FM_Recurse( int depth, int Kp, int fm_direction,
   float sc, next_score;
 
   int c, i, k;
+  int c_first = (c_only >= 0 ? c_only   : 0);
+  int c_end   = (c_only >= 0 ? c_only+1 : fm_cfg->meta->alph_size);
   FM_INTERVAL interval_1_new, interval_2_new;
+  FM_INTERVAL next_1[FM_MAX_ALPHSIZE], next_2[FM_MAX_ALPHSIZE];
+  int have_next = FALSE;
+  int node_new;
   uint8_t positive_run = 0;
   uint8_t consec_consensus = 0;
   uint8_t cons_c = 0;
 
-  for (c=0; c< fm_cfg->meta->alph_size; c++) {//acgt
+  for (c=c_first; c< c_end; c++) {//acgt
     int dppos = last;
     //seq[depth-1] = fm_cfg->meta->alph[c];
     //seq[depth] = '\0';
@@ -285,31 +366,26 @@ FM_Recurse( int depth, int Kp, int fm_direction,
             || (fm_cfg->consensus_match_req > 0 && consec_consensus == fm_cfg->consensus_match_req)
             ) { // this is a seed I want to extend
 
-          interval_1_new.lower = interval_1->lower;
-          interval_1_new.upper = interval_1->upper;
+          if (!have_next) {
+            FM_nextIntervals(depth, node, fm_direction, fmf, fmb, fm_cfg, interval_1, interval_2, next_1, next_2, nocc);
+            have_next = TRUE;
+          }
+          interval_1_new = next_1[c];
 
           if (fm_direction == fm_forward) {
-            if ( interval_1_new.lower >= 0 && interval_1_new.lower <= interval_1_new.upper  )  //no use extending a non-existent string
-            fm_updateIntervalReverse( fmf, fm_cfg, c, &interval_1_new);
-
             if ( interval_1_new.lower >= 0 && interval_1_new.lower <= interval_1_new.upper  ) {  //no use passing a non-existent string
               FM_getPassingDiags(fmf, fm_cfg, k, ssvdata->M, sc, depth, fm_forward,
                                  dp_pairs[i].model_direction, dp_pairs[i].complementarity,
-                                 &interval_1_new, seeds);
+                                 &interval_1_new, seeds, nocc);
             }
           } else { // fm_direction == fm_reverse
             //searching for forward matches on the FM-index
-            interval_2_new.lower = interval_2->lower;
-            interval_2_new.upper = interval_2->upper;
-
-            //searching for reverse matches on the FM-index
-            if ( interval_1_new.lower >= 0 && interval_1_new.lower <= interval_1_new.upper  )  //no use extending a non-existent string
-              fm_updateIntervalForward( fmb, fm_cfg, c, &interval_1_new, &interval_2_new);
+            interval_2_new = next_2[c];
 
             if ( interval_2_new.lower >= 0 && interval_2_new.lower <= interval_2_new.upper  ) { //no use passing a non-existent string
               FM_getPassingDiags(fmf, fm_cfg, k, ssvdata->M, sc, depth, fm_backward,
                                  dp_pairs[i].model_direction, dp_pairs[i].complementarity,
-                                 &interval_2_new, seeds);
+                                 &interval_2_new, seeds, nocc);
             }
           }
 
@@ -362,43 +438,39 @@ FM_Recurse( int depth, int Kp, int fm_direction,
 
     if ( dppos > last ){  // at least one diagonal that might reach threshold score, but hasn't yet, so extend
 
-      interval_1_new.lower = interval_1->lower;
-      interval_1_new.upper = interval_1->upper;
+      if (!have_next) {
+        FM_nextIntervals(depth, node, fm_direction, fmf, fmb, fm_cfg, interval_1, interval_2, next_1, next_2, nocc);
+        have_next = TRUE;
+      }
+      interval_1_new = next_1[c];
+      node_new       = (node >= 0 && depth < fmf->kmer_k ? node*fm_cfg->meta->alph_size+1+c : -1);
 
       if (fm_direction == fm_forward) {
 
-        if ( interval_1_new.lower >= 0 && interval_1_new.lower <= interval_1_new.upper  )  //no use extending a non-existent string
-          fm_updateIntervalReverse( fmf, fm_cfg, c, &interval_1_new);
-
         if (  interval_1_new.lower < 0 || interval_1_new.lower > interval_1_new.upper ) { //that string doesn't exist in fwd index
           continue;
         }
-        FM_Recurse(depth+1, Kp, fm_direction,
+        FM_Recurse(depth+1, node_new, Kp, fm_direction,
                   fmf, fmb, fm_cfg, ssvdata, consensus,
                   sc_threshFM, dp_pairs, last+1, dppos,
                   &interval_1_new, NULL,
-                  seeds
+                  -1, seeds, nocc
                   //, seq
                   );
 
 
       } else { // fm_direction == fm_reverse
 
-        interval_2_new.lower = interval_2->lower;
-        interval_2_new.upper = interval_2->upper;
-
-        if ( interval_1_new.lower >= 0 && interval_1_new.lower <= interval_1_new.upper  )  //no use extending a non-existent string
-          fm_updateIntervalForward( fmb, fm_cfg, c, &interval_1_new, &interval_2_new);
-
+        interval_2_new = next_2[c];
 
         if (  interval_1_new.lower < 0 || interval_1_new.lower > interval_1_new.upper ) { //that string doesn't exist in reverse index
           continue;
         }
-        FM_Recurse(depth+1, Kp, fm_direction,
+        FM_Recurse(depth+1, node_new, Kp, fm_direction,
                   fmf, fmb, fm_cfg, ssvdata, consensus,
                   sc_threshFM, dp_pairs, last+1, dppos,
                   &interval_1_new, &interval_2_new,
-                  seeds
+                  -1, seeds, nocc
                   //, seq
                   );
 
@@ -411,6 +483,277 @@ FM_Recurse( int depth, int Kp, int fm_direction,
   return eslOK;
 }
 
+/* FM_seedColumns()
+ *
+ * Fill in the first DP columns of the seed search, for paths starting
+ * with character <i>: <dp_pairs_fwd> for the forward pass on the FM-index,
+ * <dp_pairs_rev> for the backward pass, with <*ret_fwd_cnt> and
+ * <*ret_rev_cnt> entries. Only positive-scoring entries are kept.
+ */
+static void
+FM_seedColumns(const FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
+               uint8_t *consensus, int Kp, int strands, int i,
+               FM_DP_PAIR *dp_pairs_fwd, int *ret_fwd_cnt,
+               FM_DP_PAIR *dp_pairs_rev, int *ret_rev_cnt)
+{
+  int   fwd_cnt = 0;
+  int   rev_cnt = 0;
+  int   k;
+  float sc;
+
+  // Fill in a DP column for the character c, (compressed so that only positive-scoring entries are kept)
+  // There will be 4 DP columns for each character, (1) fwd-std, (2) fwd-complement, (3) rev-std, (4) rev-complement
+  for (k = 1; k <= ssvdata->M; k++) // there's no need to bother keeping an entry starting at the last position (gm->M)
+  {
+
+    if (strands != p7_STRAND_BOTTOMONLY) {
+      sc = ssvdata->ssv_scores_f[k*Kp + i];
+      if (sc>0) { // we'll extend any positive-scoring diagonal
+        /* fwd on model, fwd on FM (really, reverse on FM, but the FM is on a reversed string, so its fwd*/
+        if (k < ssvdata->M-3) { // don't bother starting a forward diagonal so close to the end of the model
+          //Forward pass on the FM-index
+          dp_pairs_fwd[fwd_cnt].pos =             k;
+          dp_pairs_fwd[fwd_cnt].score =           sc;
+          dp_pairs_fwd[fwd_cnt].max_score =       sc;
+          dp_pairs_fwd[fwd_cnt].score_peak_len =  1;
+          dp_pairs_fwd[fwd_cnt].consec_pos =      1;
+          dp_pairs_fwd[fwd_cnt].max_consec_pos =  1;
+          dp_pairs_fwd[fwd_cnt].consec_consensus = (i==consensus[k] ? 1 : 0);
+          dp_pairs_fwd[fwd_cnt].complementarity = p7_NOCOMPLEMENT;
+          dp_pairs_fwd[fwd_cnt].model_direction = fm_forward;
+          fwd_cnt++;
+        }
+
+        /* rev on model, rev on FM (the FM is on the unreversed string)*/
+        if (k > 4) { // don't bother starting a reverse diagonal so close to the start of the model
+          dp_pairs_rev[rev_cnt].pos =             k;
+          dp_pairs_rev[rev_cnt].score =           sc;
+          dp_pairs_rev[rev_cnt].max_score =       sc;
+          dp_pairs_rev[rev_cnt].score_peak_len =  1;
+          dp_pairs_rev[rev_cnt].consec_pos =      1;
+          dp_pairs_rev[rev_cnt].max_consec_pos =  1;
+          dp_pairs_rev[rev_cnt].consec_consensus = (i==consensus[k] ? 1: 0);
+          dp_pairs_rev[rev_cnt].complementarity = p7_NOCOMPLEMENT;
+          dp_pairs_rev[rev_cnt].model_direction = fm_backward;
+          rev_cnt++;
+        }
+      }
+    }
+
+
+    // Now do the reverse complement
+    if (strands != p7_STRAND_TOPONLY) {
+      sc = ssvdata->ssv_scores_f[k*Kp + fm_cfg->meta->compl_alph[i]];
+      if (sc>0) { // we'll extend any positive-scoring diagonal
+        /* rev on model, fwd on FM (really, reverse on FM, but the FM is on a reversed string, so its fwd*/
+        if (k > 4) { // don't bother starting a reverse diagonal so close to the start of the model
+          dp_pairs_fwd[fwd_cnt].pos =             k;
+          dp_pairs_fwd[fwd_cnt].score =           sc;
+          dp_pairs_fwd[fwd_cnt].max_score =       sc;
+          dp_pairs_fwd[fwd_cnt].score_peak_len =  1;
+          dp_pairs_fwd[fwd_cnt].consec_pos =      1;
+          dp_pairs_fwd[fwd_cnt].max_consec_pos =  1;
+          dp_pairs_fwd[fwd_cnt].consec_consensus = (i==consensus[k] ? 1: 0);
+          dp_pairs_fwd[fwd_cnt].complementarity = p7_COMPLEMENT;
+          dp_pairs_fwd[fwd_cnt].model_direction = fm_backward;
+          fwd_cnt++;
+        }
+
+        /* fwd on model, rev on FM (the FM is on the unreversed string - complemented)*/
+        if (k < ssvdata->M-3) { // don't bother starting a forward diagonal so close to the end of the model
+          dp_pairs_rev[rev_cnt].pos =             k;
+          dp_pairs_rev[rev_cnt].score =           sc;
+          dp_pairs_rev[rev_cnt].max_score =       sc;
+          dp_pairs_rev[rev_cnt].score_peak_len =  1;
+          dp_pairs_rev[rev_cnt].consec_pos =      1;
+          dp_pairs_rev[rev_cnt].max_consec_pos =  1;
+          dp_pairs_rev[rev_cnt].consec_consensus = (i==consensus[k] ? 1: 0);
+          dp_pairs_rev[rev_cnt].complementarity = p7_COMPLEMENT;
+          dp_pairs_rev[rev_cnt].model_direction = fm_forward;
+          rev_cnt++;
+        }
+
+      }
+    }
+  }
+
+  *ret_fwd_cnt = fwd_cnt;
+  *ret_rev_cnt = rev_cnt;
+}
+
+
+#ifdef HMMER_THREADS
+/* The seed search of one FM-index, split among threads.
+ *
+ * The trie of paths is cut after its first two characters, and each
+ * subtree is searched once in each direction along the FM-index, for
+ * (alph_size^2 * 2) tasks. Threads take the next unclaimed task until
+ * none are left, so a thread that drew small subtrees picks up more of
+ * them. Each task collects its own seeds (and occ count tally); they're
+ * concatenated in task order, which is the order the serial search finds
+ * them in, so results are the same for any number of threads.
+ */
+typedef struct {
+  int          c1;           // first character of each path
+  int          c2;           // second character
+  int          fm_direction; // fm_forward or fm_backward
+  FM_DIAGLIST  seeds;
+  uint64_t     nocc;         // occ counts done by this task
+} FM_SEEDTASK;
+
+typedef struct {
+  const FM_DATA      *fmf;
+  const FM_DATA      *fmb;
+  const FM_CFG       *fm_cfg;
+  const P7_SCOREDATA *ssvdata;
+  uint8_t            *consensus;
+  int                 Kp;
+  float               sc_threshFM;
+  int                 strands;
+
+  FM_SEEDTASK        *task;
+  int                 ntasks;
+  int                 next;     // index of the next unclaimed task
+  int                 status;   // eslOK, or the first failure
+  pthread_mutex_t     mutex;
+} FM_SEEDWORK;
+
+static void *
+FM_seedThread(void *arg)
+{
+  FM_SEEDWORK  *work         = (FM_SEEDWORK *) arg;
+  const FM_CFG *fm_cfg       = work->fm_cfg;
+  FM_DP_PAIR   *dp_pairs_fwd = NULL;
+  FM_DP_PAIR   *dp_pairs_rev = NULL;
+  FM_SEEDTASK  *task;
+  FM_INTERVAL   interval_1, interval_2;
+  int           fwd_cnt, rev_cnt;
+  int           t;
+  int           status;
+
+  ESL_ALLOC(dp_pairs_fwd, work->ssvdata->M * fm_cfg->max_depth * sizeof(FM_DP_PAIR));
+  ESL_ALLOC(dp_pairs_rev, work->ssvdata->M * fm_cfg->max_depth * sizeof(FM_DP_PAIR));
+
+  while (1)
+    {
+      pthread_mutex_lock(&work->mutex);
+      t = (work->status == eslOK ? work->next++ : work->ntasks);
+      pthread_mutex_unlock(&work->mutex);
+      if (t >= work->ntasks) break;
+
+      task = work->task + t;
+      interval_1.lower = interval_2.lower = work->fmf->C[task->c1];
+      interval_1.upper = interval_2.upper = abs((int)(work->fmf->C[task->c1+1]))-1;
+      if (interval_1.lower < 0) continue; //none of that character found
+
+      FM_seedColumns(fm_cfg, work->ssvdata, work->consensus, work->Kp, work->strands, task->c1,
+                     dp_pairs_fwd, &fwd_cnt, dp_pairs_rev, &rev_cnt);
+
+      if (task->fm_direction == fm_forward)
+        FM_Recurse ( 2, (work->fmf->kmer_k >= 2 ? 1+task->c1 : -1), work->Kp, fm_forward,
+                     work->fmf, work->fmb, fm_cfg, work->ssvdata, work->consensus,
+                     work->sc_threshFM, dp_pairs_fwd, 0, fwd_cnt-1,
+                     &interval_1, NULL,
+                     task->c2, &(task->seeds), &(task->nocc)
+                );
+      else
+        FM_Recurse ( 2, (work->fmb->kmer_k >= 2 ? 1+task->c1 : -1), work->Kp, fm_backward,
+                     work->fmf, work->fmb, fm_cfg, work->ssvdata, work->consensus,
+                     work->sc_threshFM, dp_pairs_rev, 0, rev_cnt-1,
+                     &interval_1, &interval_2,
+                     task->c2, &(task->seeds), &(task->nocc)
+                );
+    }
+
+  free(dp_pairs_fwd);
+  free(dp_pairs_rev);
+  return NULL;
+
+ ERROR:
+  pthread_mutex_lock(&work->mutex);
+  work->status = status;
+  pthread_mutex_unlock(&work->mutex);
+  free(dp_pairs_fwd);
+  free(dp_pairs_rev);
+  return NULL;
+}
+
+/* FM_getSeedsThreaded()
+ * The threaded version of the search in FM_getSeeds(), using
+ * <fm_cfg->seed_threads> threads; same arguments.
+ */
+static int
+FM_getSeedsThreaded ( const FM_DATA *fmf, const FM_DATA *fmb,
+                      const FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
+                      uint8_t  *consensus, int Kp, float sc_threshFM,
+                      int strands, FM_DIAGLIST *seeds, uint64_t *nocc
+                    )
+{
+  FM_SEEDWORK  work;
+  pthread_t   *tid      = NULL;
+  int          nthreads = 0;
+  int          A        = fm_cfg->meta->alph_size;
+  int          t, j;
+  FM_DIAG     *seed;
+  int          status;
+
+  work.fmf         = fmf;
+  work.fmb         = fmb;
+  work.fm_cfg      = fm_cfg;
+  work.ssvdata     = ssvdata;
+  work.consensus   = consensus;
+  work.Kp          = Kp;
+  work.sc_threshFM = sc_threshFM;
+  work.strands     = strands;
+  work.task        = NULL;
+  work.ntasks      = A * 2 * A;
+  work.next        = 0;
+  work.status      = eslOK;
+  if (pthread_mutex_init(&work.mutex, NULL) != 0) ESL_EXCEPTION(eslESYS, "mutex init failed");
+
+  ESL_ALLOC(work.task, work.ntasks * sizeof(FM_SEEDTASK));
+  for (t = 0; t < work.ntasks; t++) work.task[t].seeds.diags = NULL;
+  for (t = 0; t < work.ntasks; t++) {
+    work.task[t].c1           = t / (2*A);
+    work.task[t].fm_direction = ((t / A) % 2 == 0 ? fm_forward : fm_backward);
+    work.task[t].c2           = t % A;
+    work.task[t].nocc         = 0;
+    if ((status = fm_initSeeds(&(work.task[t].seeds))) != eslOK) goto ERROR;
+  }
+
+  ESL_ALLOC(tid, fm_cfg->seed_threads * sizeof(pthread_t));
+  for (nthreads = 0; nthreads < fm_cfg->seed_threads; nthreads++)
+    if (pthread_create(&tid[nthreads], NULL, FM_seedThread, &work) != 0) break;
+  if (nthreads == 0) FM_seedThread(&work); // couldn't start any; do it here
+  for (t = 0; t < nthreads; t++) pthread_join(tid[t], NULL);
+  if ((status = work.status) != eslOK) goto ERROR;
+
+  for (t = 0; t < work.ntasks; t++) {
+    for (j = 0; j < work.task[t].seeds.count; j++) {
+      if ((seed = fm_newSeed(seeds)) == NULL) { status = eslEMEM; goto ERROR; }
+      *seed = work.task[t].seeds.diags[j];
+    }
+    *nocc += work.task[t].nocc;
+  }
+
+  for (t = 0; t < work.ntasks; t++) free(work.task[t].seeds.diags);
+  free(work.task);
+  free(tid);
+  pthread_mutex_destroy(&work.mutex);
+  return eslOK;
+
+ ERROR:
+  if (work.task) {
+    for (t = 0; t < work.ntasks; t++) free(work.task[t].seeds.diags);
+    free(work.task);
+  }
+  free(tid);
+  pthread_mutex_destroy(&work.mutex);
+  return status;
+}
+#endif /*HMMER_THREADS*/
+
+
 /* Function:  FM_getSeeds()
  *
  * Synopsis:  Find short diagonal seeds with score above a modest threshold.
@@ -429,6 +772,9 @@ FM_Recurse( int depth, int Kp, int fm_direction,
  *            up to some fixed length looking for threshold-passing
  *            diagonals - FM_Recurse() does the hard work.
  *
+ *            If <fm_cfg->seed_threads> is more than 1, the trie is split
+ *            among that many threads (see FM_getSeedsThreaded()).
+ *
  * Args:      fmf         - FM index for finding matches to the input sequence
  *            fmb         - FM index for finding matches to the reverse of the input sequence
  *            fm_cfg      - FM-index meta data
@@ -437,23 +783,31 @@ FM_Recurse( int depth, int Kp, int fm_direction,
  *            sc_threshFM - Score that a short diagonal must pass to warrant extension to a full diagonal
  *            strands     - p7_STRAND_TOPONLY  | p7_STRAND_BOTTOMONLY |  p7_STRAND_BOTH
  *            seeds       - RETURN: collection of threshold-passing windows
+ *            nocc        - RETURN: incremented by the number of occ counts done
  *
  * Returns:   <eslOK> on success.
  */
 static int FM_getSeeds ( const FM_DATA *fmf, const FM_DATA *fmb,
                          const FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
                          uint8_t  *consensus, int Kp, float sc_threshFM,
-                         int strands, FM_DIAGLIST *seeds
+                         int strands, FM_DIAGLIST *seeds, uint64_t *nocc
                  )
 {
   FM_INTERVAL interval_f1, interval_f2, interval_bk;
-  int i, k;
+  int i;
   int status;
-  float sc;
   //char         *seq;
 
-  FM_DP_PAIR *dp_pairs_fwd;
-  FM_DP_PAIR *dp_pairs_rev;
+  FM_DP_PAIR *dp_pairs_fwd = NULL;
+  FM_DP_PAIR *dp_pairs_rev = NULL;
+
+#ifdef HMMER_THREADS
+  if (fm_cfg->seed_threads > 1) {
+    if ((status = FM_getSeedsThreaded(fmf, fmb, fm_cfg, ssvdata, consensus, Kp, sc_threshFM, strands, seeds, nocc)) != eslOK) return status;
+    FM_mergeSeeds(seeds, fmf->N, fm_cfg->ssv_length);
+    return eslOK;
+  }
+#endif
 
   ESL_ALLOC(dp_pairs_fwd, ssvdata->M * fm_cfg->max_depth * sizeof(FM_DP_PAIR)); // guaranteed to be enough to hold all diagonals
   ESL_ALLOC(dp_pairs_rev, ssvdata->M * fm_cfg->max_depth * sizeof(FM_DP_PAIR));
@@ -473,96 +827,22 @@ static int FM_getSeeds ( const FM_DATA *fmf, const FM_DATA *fmb,
     //seq[0] = fm_cfg->meta->alph[i];
     //seq[1] = '\0';
 
-    // Fill in a DP column for the character c, (compressed so that only positive-scoring entries are kept)
-    // There will be 4 DP columns for each character, (1) fwd-std, (2) fwd-complement, (3) rev-std, (4) rev-complement
-    for (k = 1; k <= ssvdata->M; k++) // there's no need to bother keeping an entry starting at the last position (gm->M)
-    {
-
-      if (strands != p7_STRAND_BOTTOMONLY) {
-        sc = ssvdata->ssv_scores_f[k*Kp + i];
-        if (sc>0) { // we'll extend any positive-scoring diagonal
-          /* fwd on model, fwd on FM (really, reverse on FM, but the FM is on a reversed string, so its fwd*/
-          if (k < ssvdata->M-3) { // don't bother starting a forward diagonal so close to the end of the model
-            //Forward pass on the FM-index
-            dp_pairs_fwd[fwd_cnt].pos =             k;
-            dp_pairs_fwd[fwd_cnt].score =           sc;
-            dp_pairs_fwd[fwd_cnt].max_score =       sc;
-            dp_pairs_fwd[fwd_cnt].score_peak_len =  1;
-            dp_pairs_fwd[fwd_cnt].consec_pos =      1;
-            dp_pairs_fwd[fwd_cnt].max_consec_pos =  1;
-            dp_pairs_fwd[fwd_cnt].consec_consensus = (i==consensus[k] ? 1 : 0);
-            dp_pairs_fwd[fwd_cnt].complementarity = p7_NOCOMPLEMENT;
-            dp_pairs_fwd[fwd_cnt].model_direction = fm_forward;
-            fwd_cnt++;
-          }
-
-          /* rev on model, rev on FM (the FM is on the unreversed string)*/
-          if (k > 4) { // don't bother starting a reverse diagonal so close to the start of the model
-            dp_pairs_rev[rev_cnt].pos =             k;
-            dp_pairs_rev[rev_cnt].score =           sc;
-            dp_pairs_rev[rev_cnt].max_score =       sc;
-            dp_pairs_rev[rev_cnt].score_peak_len =  1;
-            dp_pairs_rev[rev_cnt].consec_pos =      1;
-            dp_pairs_rev[rev_cnt].max_consec_pos =  1;
-            dp_pairs_rev[rev_cnt].consec_consensus = (i==consensus[k] ? 1: 0);
-            dp_pairs_rev[rev_cnt].complementarity = p7_NOCOMPLEMENT;
-            dp_pairs_rev[rev_cnt].model_direction = fm_backward;
-            rev_cnt++;
-          }
-        }
-      }
-
+    FM_seedColumns(fm_cfg, ssvdata, consensus, Kp, strands, i,
+                   dp_pairs_fwd, &fwd_cnt, dp_pairs_rev, &rev_cnt);
 
-      // Now do the reverse complement
-      if (strands != p7_STRAND_TOPONLY) {
-        sc = ssvdata->ssv_scores_f[k*Kp + fm_cfg->meta->compl_alph[i]];
-        if (sc>0) { // we'll extend any positive-scoring diagonal
-          /* rev on model, fwd on FM (really, reverse on FM, but the FM is on a reversed string, so its fwd*/
-          if (k > 4) { // don't bother starting a reverse diagonal so close to the start of the model
-            dp_pairs_fwd[fwd_cnt].pos =             k;
-            dp_pairs_fwd[fwd_cnt].score =           sc;
-            dp_pairs_fwd[fwd_cnt].max_score =       sc;
-            dp_pairs_fwd[fwd_cnt].score_peak_len =  1;
-            dp_pairs_fwd[fwd_cnt].consec_pos =      1;
-            dp_pairs_fwd[fwd_cnt].max_consec_pos =  1;
-            dp_pairs_fwd[fwd_cnt].consec_consensus = (i==consensus[k] ? 1: 0);
-            dp_pairs_fwd[fwd_cnt].complementarity = p7_COMPLEMENT;
-            dp_pairs_fwd[fwd_cnt].model_direction = fm_backward;
-            fwd_cnt++;
-          }
-
-          /* fwd on model, rev on FM (the FM is on the unreversed string - complemented)*/
-          if (k < ssvdata->M-3) { // don't bother starting a forward diagonal so close to the end of the model
-            dp_pairs_rev[rev_cnt].pos =             k;
-            dp_pairs_rev[rev_cnt].score =           sc;
-            dp_pairs_rev[rev_cnt].max_score =       sc;
-            dp_pairs_rev[rev_cnt].score_peak_len =  1;
-            dp_pairs_rev[rev_cnt].consec_pos =      1;
-            dp_pairs_rev[rev_cnt].max_consec_pos =  1;
-            dp_pairs_rev[rev_cnt].consec_consensus = (i==consensus[k] ? 1: 0);
-            dp_pairs_rev[rev_cnt].complementarity = p7_COMPLEMENT;
-            dp_pairs_rev[rev_cnt].model_direction = fm_forward;
-            rev_cnt++;
-          }
-
-        }
-      }
-    }
-
-
-    FM_Recurse ( 2, Kp, fm_forward,
+    FM_Recurse ( 2, (fmf->kmer_k >= 2 ? 1+i : -1), Kp, fm_forward,
                  fmf, fmb, fm_cfg, ssvdata, consensus,
                  sc_threshFM, dp_pairs_fwd, 0, fwd_cnt-1,
                  &interval_f1, NULL,
-                 seeds
+                 -1, seeds, nocc
                  //, seq
             );
 
-    FM_Recurse ( 2, Kp, fm_backward,
+    FM_Recurse ( 2, (fmb->kmer_k >= 2 ? 1+i : -1), Kp, fm_backward,
                  fmf, fmb, fm_cfg, ssvdata, consensus,
                  sc_threshFM, dp_pairs_rev, 0, rev_cnt-1,
                  &interval_bk, &interval_f2,
-                 seeds
+                 -1, seeds, nocc
                  //, seq
             );
   }
@@ -577,6 +857,8 @@ static int FM_getSeeds ( const FM_DATA *fmf, const FM_DATA *fmb,
   return eslOK;
 
 ERROR:
+  free (dp_pairs_fwd);
+  free (dp_pairs_rev);
   return eslEMEM;
 }
 
@@ -718,6 +1000,8 @@ FM_extendSeed(FM_DIAG *diag, const FM_DATA *fm, const P7_SCOREDATA *ssvdata, FM_
  *            ssvdata - compact data required for computing SSV scores
  *            strands     - p7_STRAND_TOPONLY  | p7_STRAND_BOTTOMONLY |  p7_STRAND_BOTH
  *            windowlist - RETURN: collection of SSV-passing windows, with meta data required for downstream stages.
+ *            opt_nocc   - optRETURN: if non-NULL, incremented by the number of FM-index
+ *                         occurrence counts done by the seed search
  *
  * Returns:   <eslOK> on success.
  *
@@ -726,7 +1010,7 @@ FM_extendSeed(FM_DIAG *diag, const FM_DATA *fm, const P7_SCOREDATA *ssvdata, FM_
 int
 p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
          const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
-         int strands, ESL_RANDOMNESS *r, P7_HMM_WINDOWLIST *windowlist)
+         int strands, ESL_RANDOMNESS *r, P7_HMM_WINDOWLIST *windowlist, uint64_t *opt_nocc)
 {
   float sc_thresh, sc_threshFM;
   float invP;
@@ -747,6 +1031,7 @@ p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
 
 
   FM_DIAGLIST seeds;
+  uint64_t    nocc = 0;
   int         status;
   status = fm_initSeeds(&seeds);
   if (status != eslOK)
@@ -799,7 +1084,7 @@ p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
   sc_threshFM = fm_cfg->scthreshFM * fm_cfg->sc_thresh_ratio;
 
   //get diagonals that score above sc_threshFM
-  status = FM_getSeeds(fmf, fmb, fm_cfg, ssvdata, consensus, om->abc->Kp, sc_threshFM, strands, &seeds );
+  status = FM_getSeeds(fmf, fmb, fm_cfg, ssvdata, consensus, om->abc->Kp, sc_threshFM, strands, &seeds, &nocc );
   if (status != eslOK)
     ESL_EXCEPTION(eslEMEM, "Error allocating memory for seed computation\n");
 
@@ -817,6 +1102,7 @@ p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
 
   esl_sq_Destroy(tmp_sq);
 
+  if (opt_nocc) *opt_nocc += nocc;
   free(seeds.diags);
   free(consensus);
   return eslEOF;
@@ -825,6 +1111,62 @@ ERROR:
   ESL_EXCEPTION(eslEMEM, "Error allocating memory for SSVFM longtarget\n");
 
 }
+
+/* Function:  p7_SSVFM_Targets()
+ * Synopsis:  Flags the sequences of an FM-index block that have an SSV-passing diagonal
+ *
+ * Details:   The seeding stage of a protein search against an FM-index.
+ *            Runs the seed search and extension of p7_SSVFM_longlarget()
+ *            on the (only) strand of block <fmf>/<fmb>. For every window
+ *            that meets the <F1> threshold, sets <seg_passed[id]> to TRUE,
+ *            where <id> is the index of the window's sequence segment in
+ *            <fm_cfg->meta->seq_data>. Only the flagged sequences need to
+ *            go through the full per-sequence pipeline.
+ *
+ * Args:      om          - optimized profile
+ *            bg          - the background model
+ *            F1          - p-value below which a window is captured as being above threshold
+ *            fmf         - data for forward traversal of the FM-index
+ *            fmb         - data for backward traversal of the FM-index
+ *            fm_cfg      - FM-index meta data
+ *            ssvdata     - compact data required for computing SSV scores
+ *            r           - source of randomness
+ *            seg_passed  - RETURN: one flag per sequence segment of the FM-index
+ *                          (<fm_cfg->meta->seq_count>), allocated and cleared by the caller
+ *            opt_npassed - optRETURN: number of segments newly flagged
+ *            opt_nocc    - optRETURN: if non-NULL, incremented by the number of FM-index
+ *                          occurrence counts done by the seed search
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> if trouble allocating memory for seeds
+ */
+int
+p7_SSVFM_Targets( P7_OPROFILE *om, P7_BG *bg, double F1,
+         const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
+         ESL_RANDOMNESS *r, int *seg_passed, int *opt_npassed, uint64_t *opt_nocc)
+{
+  P7_HMM_WINDOWLIST windowlist;
+  int               npassed = 0;
+  int               i;
+  int               status;
+
+  if ((status = p7_hmmwindow_init(&windowlist)) != eslOK)
+    ESL_EXCEPTION(eslEMEM, "Error allocating memory for window list\n");
+
+  status = p7_SSVFM_longlarget(om, 2.0, bg, F1, fmf, fmb, fm_cfg, ssvdata, p7_STRAND_TOPONLY, r, &windowlist, opt_nocc);
+  if (status != eslEOF) { free(windowlist.windows); return status; }
+
+  for (i = 0; i < windowlist.count; i++)
+    if (! seg_passed[windowlist.windows[i].id]) {
+      seg_passed[windowlist.windows[i].id] = TRUE;
+      npassed++;
+    }
+
+  free(windowlist.windows);
+  if (opt_npassed) *opt_npassed = npassed;
+  return eslOK;
+}
 /*------------------ end, FM_MSV() ------------------------*/
 
 
@@ -1,4 +1,11 @@
 /* Forward/Backward, generic, with bands.
+ *
+ * The DP is only done in the cells of a P7_GBANDS mask: segments of
+ * rows ia..ib, and on each row a band of model positions ka..kb, for
+ * example as marked by posterior decoding in
+ * <p7_GBackwardCheckpointed()>. Cells outside the mask are treated as
+ * impossible, so the banded score is a lower bound on the full one,
+ * and equal to it when the mask covers every cell.
  */
 
 #include <p7_config.h>
@@ -10,6 +17,27 @@
 #include "p7_gbands.h"
 #include "p7_gmxb.h"
 
+/* Function:  p7_GForwardBanded()
+ * Synopsis:  The Forward algorithm, in the cells of a band mask.
+ *
+ * Purpose:   The Forward algorithm, comparing profile <gm> in a
+ *            DP matrix <gxb> to digital sequence <dsq> of length <L>,
+ *            computing only the cells in the band mask <gxb->bnd>,
+ *            in local or glocal mode as <gm> is configured. The
+ *            matrix is $O(\sum_i (kb_i-ka_i+1))$ instead of $O(ML)$,
+ *            and so is the time.
+ *
+ *            Caller must have initialized the log-sum calculation
+ *            with a call to <p7_FLogsumInit()>.
+ *
+ * Args:      dsq    - sequence in digitized form, 1..L
+ *            L      - length of dsq
+ *            gm     - profile
+ *            gxb    - banded DP matrix, sized for its bands by <p7_gmxb_Reinit()>
+ *            opt_sc - optRETURN: banded Forward lod score in nats
+ *
+ * Returns:   <eslOK> on success.
+ */
 int
 p7_GForwardBanded(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMXB *gxb, float *opt_sc)
 {
@@ -31,7 +59,7 @@ p7_GForwardBanded(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMXB *gxb,
   float        dc;				 /* precalculated D(i,k+1) value on current row */
   float        sc;				 /* temporary score calculation M(i,k)          */
   int          g, i, k;				 /* indices running over segments, residues (rows) x_i, model positions (cols) k  */
-  //float        esc  = p7_profile_IsLocal(gm) ? 0 : -eslINFINITY;
+  float        esc  = p7_profile_IsLocal(gm) ? 0 : -eslINFINITY; /* local exits M_k,D_k->E; glocal only from M_M,D_M */
   
   xN      = 0.0f;
   xJ      = -eslINFINITY;
@@ -77,8 +105,7 @@ p7_GForwardBanded(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMXB *gxb,
 	  for (k = kac; k <= kbc2; k++)
 	    {
 	      *dpc++ = sc = MSC(k) + p7_FLogsum( p7_FLogsum(mvp + TSC(p7P_MM, k-1), ivp + TSC(p7P_IM, k-1)),
-						 dvp + TSC(p7P_DM, k-1));
-						 //p7_FLogsum(dvp + TSC(p7P_DM, k-1), xB  + TSC(p7P_BM, k-1)));
+						 p7_FLogsum(dvp + TSC(p7P_DM, k-1), xB  + TSC(p7P_BM, k-1)));
 	      
 
 	      if (k >= kap && k <= kbp) {  mvp = *dpp++;       ivp = *dpp++;        dvp = *dpp++;       } 	      // an if seems unavoidable. alternatively, might unroll 
@@ -87,7 +114,7 @@ p7_GForwardBanded(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMXB *gxb,
 
 	      *dpc++ = ISC(k) + p7_FLogsum( mvp + TSC(p7P_MI, k), ivp + TSC(p7P_II, k));
 
-	      //xE     = p7_FLogsum( p7_FLogsum(sc + esc, dc + esc), xE);/* Mk->E accumulation      */
+	      xE     = p7_FLogsum( p7_FLogsum(sc + esc, dc + esc), xE); /* M_k,D_k->E accumulation */
 
 	      /* next D_k+1 */
 	      *dpc++ = dc;
@@ -105,7 +132,7 @@ p7_GForwardBanded(const ESL_DSQ *dsq, int L, const P7_PROFILE *gm, P7_GMXB *gxb,
 
 	  *xpc++ = xE;
 	  *xpc++ = xN = xN + gm->xsc[p7P_N][p7P_LOOP];
-	  *xpc++ = xJ = p7_FLogsum( xJ + gm->xsc[p7P_J][p7P_LOOP],  xE + gm->xsc[p7P_E][p7P_MOVE]);
+	  *xpc++ = xJ = p7_FLogsum( xJ + gm->xsc[p7P_J][p7P_LOOP],  xE + gm->xsc[p7P_E][p7P_LOOP]);
 	  *xpc++ = xB = p7_FLogsum( xJ + gm->xsc[p7P_J][p7P_MOVE],  xN + gm->xsc[p7P_N][p7P_MOVE]);
 	  *xpc++ = xC = p7_FLogsum( xE + gm->xsc[p7P_E][p7P_MOVE],  xC + gm->xsc[p7P_C][p7P_LOOP]);
 
@@ -180,8 +207,10 @@ main(int argc, char **argv)
   p7_ProfileConfig(hmm, bg, gm, L, p7_GLOCAL);
 
   /* Contrive bands: one length M band of width W */
-  bnd = p7_gbands_Create(L, gm->M);
+  bnd = p7_gbands_Create();
   if (L < gm->M) p7_Fail("for now, L must be >=M, because we make a single band");
+  bnd->L = L;
+  bnd->M = gm->M;
   base = (L-gm->M) / 2;
   for (k = 1; k <= gm->M; k++)
     p7_gbands_Append(bnd, k+base, ESL_MAX(1,k-W), ESL_MIN(gm->M,k+W));
@@ -228,3 +257,206 @@ main(int argc, char **argv)
 }
 #endif /*p7GENERIC_FWDBACK_BANDED_BENCHMARK*/
 /************** end, benchmark driver*****************************/
+
+
+
+/*****************************************************************
+ * x. Unit tests
+ *****************************************************************/
+#ifdef p7GENERIC_FWDBACK_BANDED_TESTDRIVE
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* full_mask()
+ * Make <bnd> a mask of every cell of an <L> by <M> matrix.
+ */
+static void
+full_mask(P7_GBANDS *bnd, int L, int M)
+{
+  int i;
+
+  p7_gbands_Reuse(bnd);
+  bnd->L = L;
+  bnd->M = M;
+  for (i = 1; i <= L; i++)
+    if (p7_gbands_Append(bnd, i, 1, M) != eslOK) esl_fatal("band append failed");
+}
+
+/* diagonal_mask()
+ * Make <bnd> a mask of two segments on a band of halfwidth <W> around
+ * the main diagonal, leaving rows out before, between and after them.
+ */
+static void
+diagonal_mask(P7_GBANDS *bnd, int L, int M, int W)
+{
+  int i, k;
+
+  p7_gbands_Reuse(bnd);
+  bnd->L = L;
+  bnd->M = M;
+  for (i = 2; i <= L-1; i++)
+    {
+      if (i == L/2) continue;
+      k = ESL_MIN(M, ESL_MAX(1, (int) ((double) i * M / L)));
+      if (p7_gbands_Append(bnd, i, ESL_MAX(1, k-W), ESL_MIN(M, k+W)) != eslOK) esl_fatal("band append failed");
+    }
+}
+
+/* compare_one()
+ * Score <dsq> of length <L> with the full Forward and with the banded
+ * Forward in a full mask, which must agree; and in a partial mask,
+ * which can only be lower.
+ */
+static void
+compare_one(const ESL_DSQ *dsq, int L, P7_PROFILE *gm, P7_GMX *gx, P7_GBANDS *bnd, P7_GMXB *gxb, const char *msg, int be_verbose)
+{
+  float fsc, bsc;
+
+  if (p7_gmx_GrowTo(gx, gm->M, L)              != eslOK) esl_fatal("%s: matrix reallocation failed", msg);
+  if (p7_GForward(dsq, L, gm, gx, &fsc)        != eslOK) esl_fatal("%s: forward failed", msg);
+
+  full_mask(bnd, L, gm->M);
+  if (p7_gmxb_Reinit(gxb, bnd)                 != eslOK) esl_fatal("%s: banded matrix reinit failed", msg);
+  if (p7_GForwardBanded(dsq, L, gm, gxb, &bsc) != eslOK) esl_fatal("%s: banded forward failed", msg);
+  p7_gmxb_Reuse(gxb);
+  if (be_verbose) printf("%-12s L=%5d  full: %8.4f  banded: %8.4f\n", msg, L, fsc, bsc);
+  if (fabs(fsc - bsc) > 0.001) esl_fatal("%s: full mask banded Forward %f != Forward %f", msg, bsc, fsc);
+
+  if (L < 3) return;
+  diagonal_mask(bnd, L, gm->M, 3);
+  if (p7_gmxb_Reinit(gxb, bnd)                 != eslOK) esl_fatal("%s: banded matrix reinit failed", msg);
+  if (p7_GForwardBanded(dsq, L, gm, gxb, &bsc) != eslOK) esl_fatal("%s: banded forward failed", msg);
+  p7_gmxb_Reuse(gxb);
+  if (bsc > fsc + 0.001) esl_fatal("%s: partial mask banded Forward %f > Forward %f", msg, bsc, fsc);
+}
+
+/* The "fullmask" test: with a mask of every cell, p7_GForwardBanded()
+ * must give the same score as p7_GForward(), in each of the four
+ * configurations <mode>: local entry and exits, and in glocal the
+ * B->M_1 entry and the M_M/D_M exit only. Targets are i.i.d. random,
+ * emitted by the profile, and (multihit modes) two emitted sequences
+ * end to end, so that scores run through E->J->B.
+ */
+static void
+utest_fullmask(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, P7_HMM *hmm, int mode, int L, int nseq, int be_verbose)
+{
+  char        msg[]    = "fullmask unit test failed";
+  P7_PROFILE *gm       = NULL;
+  P7_GMX     *gx       = NULL;
+  P7_GBANDS  *bnd      = NULL;
+  P7_GMXB    *gxb      = NULL;
+  ESL_SQ     *sq       = esl_sq_CreateDigital(abc);
+  ESL_SQ     *sq2      = esl_sq_CreateDigital(abc);
+  ESL_DSQ    *dsq      = NULL;
+  int         do_multi = (mode == p7_LOCAL || mode == p7_GLOCAL);
+  int         idx, n;
+
+  if ((gm  = p7_profile_Create(hmm->M, abc))       == NULL)  esl_fatal(msg);
+  if (p7_ProfileConfig(hmm, bg, gm, L, mode)       != eslOK) esl_fatal(msg);
+  if ((gx  = p7_gmx_Create(gm->M, L))              == NULL)  esl_fatal(msg);
+  if ((bnd = p7_gbands_Create())                   == NULL)  esl_fatal(msg);
+  full_mask(bnd, L, gm->M);
+  if ((gxb = p7_gmxb_Create(bnd))                  == NULL)  esl_fatal(msg);
+  if ((dsq = malloc(sizeof(ESL_DSQ) * (L+2)))      == NULL)  esl_fatal(msg);
+
+  for (idx = 0; idx < nseq; idx++)
+    {
+      if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq)   != eslOK) esl_fatal(msg);
+      compare_one(dsq, L, gm, gx, bnd, gxb, "iid", be_verbose);
+
+      if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL)  != eslOK) esl_fatal(msg);
+      compare_one(sq->dsq, sq->n, gm, gx, bnd, gxb, "emitted", be_verbose);
+
+      if (do_multi)
+	{
+	  if (p7_ProfileEmit(r, hmm, gm, bg, sq2, NULL) != eslOK) esl_fatal(msg);
+	  n = sq->n + sq2->n;
+	  if ((dsq = realloc(dsq, sizeof(ESL_DSQ) * ESL_MAX(L+2, n+2))) == NULL) esl_fatal(msg);
+	  dsq[0] = eslDSQ_SENTINEL;
+	  memcpy(dsq+1,         sq->dsq+1,  sizeof(ESL_DSQ) * sq->n);
+	  memcpy(dsq+1+sq->n,   sq2->dsq+1, sizeof(ESL_DSQ) * sq2->n);
+	  dsq[n+1] = eslDSQ_SENTINEL;
+	  compare_one(dsq, n, gm, gx, bnd, gxb, "multidomain", be_verbose);
+	}
+    }
+
+  free(dsq);
+  esl_sq_Destroy(sq);
+  esl_sq_Destroy(sq2);
+  p7_gmxb_Destroy(gxb);
+  p7_gbands_Destroy(bnd);
+  p7_gmx_Destroy(gx);
+  p7_profile_Destroy(gm);
+}
+#endif /*p7GENERIC_FWDBACK_BANDED_TESTDRIVE*/
+/*------------------------- end, unit tests ---------------------*/
+
+
+
+/*****************************************************************
+ * x. Test driver
+ *****************************************************************/
+#ifdef p7GENERIC_FWDBACK_BANDED_TESTDRIVE
+/* 
+   gcc -g -Wall -Dp7GENERIC_FWDBACK_BANDED_TESTDRIVE -I. -I../easel -L. -L../easel -o generic_fwdback_banded_utest generic_fwdback_banded.c -lhmmer -leasel -lm
+   ./generic_fwdback_banded_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+#include "p7_gbands.h"
+#include "p7_gmxb.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "100", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                   0 },
+  { "-M",        eslARG_INT,     "50", NULL, "n>0", NULL,  NULL, NULL, "length of sampled profile",                      0 },
+  { "-N",        eslARG_INT,     "10", NULL, "n>0", NULL,  NULL, NULL, "number of target seqs of each kind per mode",    0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for banded generic Forward";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go    = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r     = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc   = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg    = p7_bg_Create(abc);
+  P7_HMM         *hmm   = NULL;
+  int             L     = esl_opt_GetInteger(go, "-L");
+  int             M     = esl_opt_GetInteger(go, "-M");
+  int             N     = esl_opt_GetInteger(go, "-N");
+  int             be_verbose = esl_opt_GetBoolean(go, "-v");
+
+  p7_FLogsumInit();
+  if (p7_hmm_Sample(r, M, abc, &hmm) != eslOK) esl_fatal("failed to sample an HMM");
+
+  utest_fullmask(r, abc, bg, hmm, p7_LOCAL,     L, N, be_verbose);
+  utest_fullmask(r, abc, bg, hmm, p7_GLOCAL,    L, N, be_verbose);
+  utest_fullmask(r, abc, bg, hmm, p7_UNILOCAL,  L, N, be_verbose);
+  utest_fullmask(r, abc, bg, hmm, p7_UNIGLOCAL, L, N, be_verbose);
+
+  p7_hmm_Destroy(hmm);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7GENERIC_FWDBACK_BANDED_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
@@ -14,6 +14,9 @@
 #include "esl_sq.h"
 #include "esl_sqio.h"
 #include "esl_vectorops.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
 
 #include "hmmer.h"
 
@@ -34,6 +37,9 @@ static ESL_OPTIONS options[] = {
   { "--rna",       eslARG_NONE,     FALSE,     NULL, NULL, ALPHOPTS,  NULL,  NULL, "assert <seqfile>, <hmmfile> both RNA: no autodetection",      2 },
   { "--informat",  eslARG_STRING,    NULL,     NULL, NULL,   NULL,    NULL,  NULL, "assert <seqfile> is in format <s>: no autodetection",            2 },
   { "--outformat", eslARG_STRING, "Stockholm", NULL, NULL,   NULL,    NULL,  NULL, "output alignment in format <s>",                                    2 },
+#ifdef HMMER_THREADS
+  { "--cpu",       eslARG_INT,     p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  NULL, "number of parallel CPU workers to use for multithreads",            2 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
@@ -95,6 +101,7 @@ main(int argc, char **argv)
   P7_TRACE    **tr      = NULL;	/* array of tracebacks             */
   ESL_MSA      *msa     = NULL;	/* resulting multiple alignment    */
   int           msaopts = 0;	/* flags to p7_tracealign_Seqs()   */
+  int           ncpus   = 0;	/* # of threads aligning sequences */
   int           idx;		/* counter over seqs, traces       */
   int           status;		/* easel/hmmer return code         */
   char          errbuf[eslERRBUFSIZE];
@@ -102,6 +109,7 @@ main(int argc, char **argv)
   /* Parse the command line
    */
   go = esl_getopts_Create(options);
+  if (esl_opt_ProcessEnvironment(go)         != eslOK) cmdline_failure(argv[0], "Failed to process environment: %s\n", go->errbuf);
   if (esl_opt_ProcessCmdline(go, argc, argv) != eslOK) cmdline_failure(argv[0], "Failed to parse command line: %s\n", go->errbuf);
   if (esl_opt_VerifyConfig(go)               != eslOK) cmdline_failure(argv[0], "Error in configuration: %s\n",       go->errbuf);
   if (esl_opt_GetBoolean(go, "-h") )                   cmdline_help   (argv[0], go);
@@ -116,6 +124,10 @@ main(int argc, char **argv)
   msaopts |= p7_ALL_CONSENSUS_COLS; /* default as of 3.1 */
   if (esl_opt_GetBoolean(go, "--trim"))    msaopts |= p7_TRIM;
 
+#ifdef HMMER_THREADS
+  ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+#endif
+
   /* If caller declared an input format, decode it 
    */
   if (esl_opt_IsOn(go, "--informat")) {
@@ -197,7 +209,8 @@ main(int argc, char **argv)
   for (idx = mapseq; idx < totseq; idx++)
     tr[idx] = p7_trace_CreateWithPP();
 
-  p7_tracealign_computeTraces(hmm, sq, mapseq, totseq - mapseq, tr);
+  status = p7_tracealign_computeTracesThreaded(hmm, sq, mapseq, totseq - mapseq, tr, ncpus);
+  if (status != eslOK) p7_Fail("Failed to align sequences to the model: out of memory?\n");
 
   p7_tracealign_Seqs(sq, tr, totseq, hmm->M, msaopts, hmm, &msa);
 
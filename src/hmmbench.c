@@ -0,0 +1,986 @@
+/* hmmbench: benchmark suite for the acceleration kernels, the
+ * comparison pipeline, domain definition, and file I/O.
+ *
+ * One driver with fixed seeds, so numbers are comparable from release
+ * to release on the same hardware. Targets are either synthetic (iid
+ * sequences from the background and a sampled, calibrated profile) or
+ * read from real files with --hmmfile/--seqfile. A table goes to
+ * stdout; --json <f> also saves the results in a machine-readable form:
+ *
+ *   { "benchmark": "hmmbench", "version": ..., "seed": ..., "isa": ...,
+ *     "model": {...}, "targets": {...},
+ *     "results": [ { "name": "msv", "seconds": ..., "mcells_per_sec": ...,
+ *                    "per_sec": ..., "unit": "targets" }, ... ] }
+ *
+ * <seconds> is user CPU time for the compute benchmarks, and wall clock
+ * for the I/O ones.
+ *
+ * With --perf, on Linux, the compute benchmarks also read hardware
+ * counters through perf_event_open(): cycles, instructions, branch
+ * misses, and L1 data and last level cache read misses. Their results
+ * then carry a "perf" object of the raw counts, and the table a line
+ * of IPC and misses per thousand DP cells, to tell a compute-bound
+ * kernel from a memory-bound one. The counters are multiplexed if the
+ * CPU can't count them all at once, and scaled to the time they ran.
+ * If the kernel won't give us counters (see
+ * /proc/sys/kernel/perf_event_paranoid), the benchmarks run without.
+ *
+ * With --xcheck, it instead qualifies the vector backends: every one
+ * the host can run (on x86, each of the SSE2, AVX2 and AVX-512 kernel
+ * tables compiled in) and the generic code run the MSV, SSV, Viterbi
+ * filter and Forward/Backward parsers on the same seeded sampled
+ * profiles and iid targets. It reports Mcells/s for each, and for
+ * each vector kernel the largest deviation from the generic score
+ * and how many exceed the thresholds --xtol and --xtolfwd; the exit
+ * status is 1 if any do. 'make xcheck' runs it.
+ *
+ * Built by 'make bench', which also runs it; not installed.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default   env  range   toggles   reqs   incomp  help                                                 docgroup*/
+  { "-h",           eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  NULL, "show brief help on version and usage",                    0 },
+  { "-s",           eslARG_INT,     "42", NULL, "n>=0",    NULL,  NULL,  NULL, "set random number seed to <n>",                           0 },
+  { "-L",           eslARG_INT,    "400", NULL, "n>0",     NULL,  NULL,  NULL, "length of synthetic target seqs",                         0 },
+  { "-M",           eslARG_INT,    "400", NULL, "n>0",     NULL,  NULL,  NULL, "length of synthetic query profile",                       0 },
+  { "-N",           eslARG_INT,  "20000", NULL, "n>0",     NULL,  NULL,  NULL, "number of target seqs (max, w/ --seqfile)",               0 },
+  { "-D",           eslARG_INT,    "200", NULL, "n>0",     NULL,  NULL,  NULL, "number of emitted homologs for domain definition",        0 },
+  { "-H",           eslARG_INT,    "100", NULL, "n>0",     NULL,  NULL,  NULL, "number of profiles written/read in synthetic HMM I/O",    0 },
+  { "--hmmfile",    eslARG_INFILE,  NULL, NULL, NULL,      NULL,  NULL,  NULL, "use the first profile in <f> as the query",               0 },
+  { "--seqfile",    eslARG_INFILE,  NULL, NULL, NULL,      NULL,  NULL,  NULL, "use (up to -N) seqs in <f> as targets",                   0 },
+  { "--json",       eslARG_OUTFILE, NULL, NULL, NULL,      NULL,  NULL,  NULL, "save results in JSON format to file <f>",                 0 },
+  { "--perf",       eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  NULL, "also count cycles, instructions, cache/branch misses",    0 },
+  { "--xcheck",     eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,"--hmmfile,--seqfile", "only time and check every vector backend against generic code", 0 },
+  { "--xmodels",    eslARG_INT,     "10", NULL, "n>0",     NULL,"--xcheck",NULL, "--xcheck: number of sampled profiles",                   0 },
+  { "--xseqs",      eslARG_INT,    "200", NULL, "n>0",     NULL,"--xcheck",NULL, "--xcheck: number of iid targets per profile",            0 },
+  { "--xtol",       eslARG_REAL,  "0.001",NULL, "x>=0",    NULL,"--xcheck",NULL, "--xcheck: max filter score deviation (nats)",            0 },
+  { "--xtolfwd",    eslARG_REAL,    NULL, NULL, "x>=0",    NULL,"--xcheck",NULL, "--xcheck: max Forward/Backward deviation (nats) [auto]",  0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark suite for HMMER kernels, pipeline, and I/O";
+
+#define MAX_RESULTS 16
+
+/* hardware counters read with --perf */
+enum bench_perf_e { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_L1D_MISSES, PERF_LLC_MISSES, NPERF };
+static const char *perf_name[NPERF] = { "cycles", "instructions", "branch_misses", "l1d_read_misses", "llc_read_misses" };
+
+typedef struct {
+  const char *name;
+  double      seconds;
+  double      cells;     /* DP cells computed (0 if not a DP benchmark) */
+  double      units;     /* number of things processed                  */
+  const char *unit;      /* what <units> counts                         */
+  int         has_perf;  /* TRUE if <perf> was counted                  */
+  double      perf[NPERF];
+} BENCH_RESULT;
+
+typedef struct {
+  BENCH_RESULT r[MAX_RESULTS];
+  int          n;
+} BENCH_RESULTS;
+
+static void
+add_result(BENCH_RESULTS *res, const char *name, double seconds, double cells, double units, const char *unit)
+{
+  BENCH_RESULT *b;
+
+  if (res->n == MAX_RESULTS) esl_fatal("too many benchmark results");
+  b = &(res->r[res->n++]);
+  b->name    = name;
+  b->seconds = seconds;
+  b->cells   = cells;
+  b->units   = units;
+  b->unit    = unit;
+  b->has_perf = FALSE;
+
+  if (cells > 0.) printf("%-22s %10.3f s  %10.1f Mc/s  %12.1f %s/s\n", name, seconds, cells / seconds * 1e-6, units / seconds, unit);
+  else            printf("%-22s %10.3f s  %10s       %12.1f %s/s\n", name, seconds, "-",                     units / seconds, unit);
+}
+
+
+/* Hardware counters, one perf event each, counting this process's
+ * user time only. perf_fd[] are -1, and the calls below no-ops,
+ * without --perf or when the counters can't be opened.
+ */
+static int perf_fd[NPERF] = { -1, -1, -1, -1, -1 };
+
+static void perf_close(void);
+
+static void
+perf_open(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  static const uint32_t type[NPERF]   = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE };
+  static const uint64_t config[NPERF] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_CACHE_LL  | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+  };
+  struct perf_event_attr attr;
+  int    nopen = 0;
+  int    e;
+
+  for (e = 0; e < NPERF; e++)
+    {
+      memset(&attr, 0, sizeof(attr));
+      attr.size           = sizeof(attr);
+      attr.type           = type[e];
+      attr.config         = config[e];
+      attr.disabled       = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv     = 1;
+      attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      perf_fd[e] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+      if (perf_fd[e] >= 0) nopen++;
+    }
+  if (nopen < NPERF)
+    {
+      printf("# --perf: hardware counters unavailable; running without them\n");
+      perf_close();
+    }
+#else
+  printf("# --perf: hardware counters not supported on this system\n");
+#endif
+}
+
+static void
+perf_close(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  int e;
+  for (e = 0; e < NPERF; e++)
+    if (perf_fd[e] >= 0) { close(perf_fd[e]); perf_fd[e] = -1; }
+#endif
+}
+
+/* perf_reset(): zero the counters, before a benchmark */
+static void
+perf_reset(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  int e;
+  for (e = 0; e < NPERF; e++)
+    if (perf_fd[e] >= 0) ioctl(perf_fd[e], PERF_EVENT_IOC_RESET, 0);
+#endif
+}
+
+/* perf_start(), perf_stop(): count only between them, like the stopwatch */
+static void
+perf_start(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  int e;
+  for (e = 0; e < NPERF; e++)
+    if (perf_fd[e] >= 0) ioctl(perf_fd[e], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static void
+perf_stop(void)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  int e;
+  for (e = 0; e < NPERF; e++)
+    if (perf_fd[e] >= 0) ioctl(perf_fd[e], PERF_EVENT_IOC_DISABLE, 0);
+#endif
+}
+
+/* add_perf()
+ * Attach the counts since the last perf_reset() to the benchmark
+ * just added, and print them per thousand DP cells.
+ */
+static void
+add_perf(BENCH_RESULTS *res)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+  BENCH_RESULT *b = &(res->r[res->n-1]);
+  uint64_t      v[3];   /* value, time enabled, time running */
+  int           e;
+
+  for (e = 0; e < NPERF; e++)
+    {
+      if (perf_fd[e] < 0 || read(perf_fd[e], v, sizeof(v)) != sizeof(v)) return;
+      b->perf[e] = (v[2] > 0) ? (double) v[0] * (double) v[1] / (double) v[2] : 0.;
+    }
+  b->has_perf = TRUE;
+
+  printf("%-22s %10.2f ipc  %8.3f br  %8.3f L1d  %8.3f LLC  misses/kcell\n", "",
+	 b->perf[PERF_CYCLES] > 0. ? b->perf[PERF_INSTRUCTIONS] / b->perf[PERF_CYCLES] : 0.,
+	 b->perf[PERF_BRANCH_MISSES] / b->cells * 1e3,
+	 b->perf[PERF_L1D_MISSES]    / b->cells * 1e3,
+	 b->perf[PERF_LLC_MISSES]    / b->cells * 1e3);
+#endif
+}
+
+static const char *
+isa_name(void)
+{
+#if   defined (eslENABLE_SSE)
+  return p7_impl_Kernels()->isa;
+#elif defined (eslENABLE_NEON)
+  return "neon";
+#elif defined (eslENABLE_VMX)
+  return "vmx";
+#else
+  return "unknown";
+#endif
+}
+
+static void
+json_string(FILE *fp, const char *s)
+{
+  fputc('"', fp);
+  for (; s && *s; s++)
+    {
+      if      (*s == '"' || *s == '\\')  fprintf(fp, "\\%c", *s);
+      else if ((unsigned char) *s < 0x20) fprintf(fp, "\\u%04x", (unsigned char) *s);
+      else    fputc(*s, fp);
+    }
+  fputc('"', fp);
+}
+
+static void
+write_json(FILE *fp, ESL_GETOPTS *go, const P7_OPROFILE *om, int nseq, int64_t nres, BENCH_RESULTS *res)
+{
+  int i;
+
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"benchmark\": \"hmmbench\",\n");
+  fprintf(fp, "  \"version\": ");  json_string(fp, HMMER_VERSION); fprintf(fp, ",\n");
+  fprintf(fp, "  \"seed\": %d,\n", esl_opt_GetInteger(go, "-s"));
+  fprintf(fp, "  \"isa\": \"%s\",\n", isa_name());
+  fprintf(fp, "  \"model\": { \"name\": "); json_string(fp, om->name);
+  fprintf(fp, ", \"M\": %d, \"source\": ", om->M);
+  json_string(fp, esl_opt_IsOn(go, "--hmmfile") ? esl_opt_GetString(go, "--hmmfile") : "synthetic");
+  fprintf(fp, " },\n");
+  fprintf(fp, "  \"targets\": { \"N\": %d, \"residues\": %" PRId64 ", \"source\": ", nseq, nres);
+  json_string(fp, esl_opt_IsOn(go, "--seqfile") ? esl_opt_GetString(go, "--seqfile") : "synthetic");
+  fprintf(fp, " },\n");
+  fprintf(fp, "  \"results\": [\n");
+  for (i = 0; i < res->n; i++)
+    {
+      fprintf(fp, "    { \"name\": \"%s\", \"seconds\": %.6f, \"mcells_per_sec\": ", res->r[i].name, res->r[i].seconds);
+      if (res->r[i].cells > 0.) fprintf(fp, "%.3f", res->r[i].cells / res->r[i].seconds * 1e-6);
+      else                      fprintf(fp, "null");
+      fprintf(fp, ", \"per_sec\": %.3f, \"unit\": \"%s\"", res->r[i].units / res->r[i].seconds, res->r[i].unit);
+      if (res->r[i].has_perf)
+	{
+	  int e;
+	  fprintf(fp, ", \"perf\": {");
+	  for (e = 0; e < NPERF; e++) fprintf(fp, "%s \"%s\": %.0f", e ? "," : "", perf_name[e], res->r[i].perf[e]);
+	  fprintf(fp, " }");
+	}
+      fprintf(fp, " }%s\n", (i < res->n-1) ? "," : "");
+    }
+  fprintf(fp, "  ]\n");
+  fprintf(fp, "}\n");
+}
+
+
+/* Query: first profile in --hmmfile, or a sampled and calibrated one. */
+static P7_HMM *
+get_query(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_ALPHABET **byp_abc, P7_BG **ret_bg)
+{
+  P7_HMMFILE *hfp = NULL;
+  P7_HMM     *hmm = NULL;
+  P7_BG      *bg  = NULL;
+  char        errbuf[eslERRBUFSIZE];
+  int         status;
+
+  if (esl_opt_IsOn(go, "--hmmfile"))
+    {
+      status = p7_hmmfile_Open(esl_opt_GetString(go, "--hmmfile"), NULL, &hfp, errbuf);
+      if      (status == eslENOTFOUND) p7_Fail("File existence/permissions problem in trying to open HMM file %s.\n%s\n", esl_opt_GetString(go, "--hmmfile"), errbuf);
+      else if (status == eslEFORMAT)   p7_Fail("File format problem in trying to open HMM file %s.\n%s\n",                esl_opt_GetString(go, "--hmmfile"), errbuf);
+      else if (status != eslOK)        p7_Fail("Unexpected error %d in opening HMM file %s.\n%s\n",               status, esl_opt_GetString(go, "--hmmfile"), errbuf);
+      if (p7_hmmfile_Read(hfp, byp_abc, &hmm) != eslOK) p7_Fail("Failed to read a profile from %s", esl_opt_GetString(go, "--hmmfile"));
+      p7_hmmfile_Close(hfp);
+      bg = p7_bg_Create(*byp_abc);
+    }
+  else
+    {
+      if (*byp_abc == NULL) *byp_abc = esl_alphabet_Create(eslAMINO);
+      bg = p7_bg_Create(*byp_abc);
+      if (p7_hmm_Sample(r, esl_opt_GetInteger(go, "-M"), *byp_abc, &hmm) != eslOK) p7_Fail("failed to sample an HMM");
+      if (p7_hmm_SetName(hmm, "synthetic")                                != eslOK) p7_Fail("failed to name the HMM");
+      if (p7_Calibrate(hmm, NULL, &r, &bg, NULL, NULL)                    != eslOK) p7_Fail("failed to calibrate the HMM");
+    }
+  *ret_bg = bg;
+  return hmm;
+}
+
+/* Targets: up to -N seqs from --seqfile, or -N iid seqs of length -L. */
+static ESL_SQ **
+get_targets(ESL_GETOPTS *go, ESL_RANDOMNESS *r, const ESL_ALPHABET *abc, const P7_BG *bg, int *ret_nseq, int64_t *ret_nres)
+{
+  ESL_SQ    **sq    = NULL;
+  ESL_SQFILE *sqfp  = NULL;
+  int         N     = esl_opt_GetInteger(go, "-N");
+  int         L     = esl_opt_GetInteger(go, "-L");
+  int64_t     nres  = 0;
+  int         nseq;
+  int         status;
+
+  ESL_ALLOC(sq, sizeof(ESL_SQ *) * N);
+
+  if (esl_opt_IsOn(go, "--seqfile"))
+    {
+      status = esl_sqfile_OpenDigital(abc, esl_opt_GetString(go, "--seqfile"), eslSQFILE_UNKNOWN, NULL, &sqfp);
+      if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          esl_opt_GetString(go, "--seqfile"));
+      else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            esl_opt_GetString(go, "--seqfile"));
+      else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, esl_opt_GetString(go, "--seqfile"));
+
+      for (nseq = 0; nseq < N; nseq++)
+	{
+	  sq[nseq] = esl_sq_CreateDigital(abc);
+	  status   = esl_sqio_Read(sqfp, sq[nseq]);
+	  if (status == eslEOF) { esl_sq_Destroy(sq[nseq]); break; }
+	  if (status != eslOK)  p7_Fail("Failed to read sequence file %s:\n%s\n", esl_opt_GetString(go, "--seqfile"), esl_sqfile_GetErrorBuf(sqfp));
+	  if (sq[nseq]->n > 100000) p7_Fail("Target %s is longer than the pipeline's 100K limit", sq[nseq]->name);
+	  nres += sq[nseq]->n;
+	}
+      esl_sqfile_Close(sqfp);
+      if (nseq == 0) p7_Fail("No sequences in %s", esl_opt_GetString(go, "--seqfile"));
+    }
+  else
+    {
+      for (nseq = 0; nseq < N; nseq++)
+	{
+	  sq[nseq] = esl_sq_CreateDigital(abc);
+	  esl_sq_GrowTo(sq[nseq], L);
+	  esl_rsq_xfIID(r, bg->f, abc->K, L, sq[nseq]->dsq);
+	  sq[nseq]->n = L;
+	  esl_sq_FormatName(sq[nseq], "random%d", nseq+1);
+	  nres += L;
+	}
+    }
+
+  *ret_nseq = nseq;
+  *ret_nres = nres;
+  return sq;
+
+ ERROR:
+  p7_Fail("allocation failure");
+  return NULL;
+}
+
+
+/* One DP kernel over all targets: msv, ssv, vit, fwd */
+enum bench_kernel_e { BENCH_MSV, BENCH_SSV, BENCH_VIT, BENCH_FWD };
+
+static void
+bench_kernel(BENCH_RESULTS *res, const char *name, enum bench_kernel_e which, P7_OPROFILE *om, ESL_SQ **sq, int nseq)
+{
+  ESL_STOPWATCH *w   = esl_stopwatch_Create();
+  P7_OMX        *oxf = p7_omx_Create(om->M, 0, 0);
+  P7_OMX        *oxb = p7_omx_Create(om->M, 0, 0);
+  double         cells = 0.;
+  float          sc;
+  int            i;
+
+  perf_reset();
+  perf_start();
+  esl_stopwatch_Start(w);
+  for (i = 0; i < nseq; i++)
+    {
+      p7_oprofile_ReconfigLength(om, sq[i]->n);
+      switch (which) {
+      case BENCH_MSV: p7_MSVFilter    (sq[i]->dsq, sq[i]->n, om, oxf, &sc); break;
+#if defined (eslENABLE_SSE) || defined (eslENABLE_NEON) || defined (eslENABLE_VMX)
+      case BENCH_SSV: p7_SSVFilter    (sq[i]->dsq, sq[i]->n, om,      &sc); break;
+#endif
+      case BENCH_VIT: p7_ViterbiFilter(sq[i]->dsq, sq[i]->n, om, oxf, &sc); break;
+      case BENCH_FWD:
+	p7_omx_GrowTo(oxf, om->M, 0, sq[i]->n);
+	p7_ForwardParser(sq[i]->dsq, sq[i]->n, om, oxf, &sc);
+	break;
+      default: break;
+      }
+      cells += (double) sq[i]->n * (double) om->M;
+    }
+  esl_stopwatch_Stop(w);
+  perf_stop();
+  add_result(res, name, w->user, cells, nseq, "targets");
+  add_perf(res);
+
+  p7_omx_Destroy(oxf);
+  p7_omx_Destroy(oxb);
+  esl_stopwatch_Destroy(w);
+}
+
+/* Backward parser over all targets. Each needs its Forward matrix
+ * first, so only the Backward calls are timed, one at a time.
+ */
+static void
+bench_backward(BENCH_RESULTS *res, P7_OPROFILE *om, ESL_SQ **sq, int nseq)
+{
+  ESL_STOPWATCH *w   = esl_stopwatch_Create();
+  P7_OMX        *oxf = p7_omx_Create(om->M, 0, 0);
+  P7_OMX        *oxb = p7_omx_Create(om->M, 0, 0);
+  double         secs  = 0.;
+  double         cells = 0.;
+  int            i;
+
+  perf_reset();
+  for (i = 0; i < nseq; i++)
+    {
+      p7_oprofile_ReconfigLength(om, sq[i]->n);
+      p7_omx_GrowTo(oxf, om->M, 0, sq[i]->n);
+      p7_omx_GrowTo(oxb, om->M, 0, sq[i]->n);
+      p7_ForwardParser(sq[i]->dsq, sq[i]->n, om, oxf, NULL);
+
+      perf_start();
+      esl_stopwatch_Start(w);
+      p7_BackwardParser(sq[i]->dsq, sq[i]->n, om, oxf, oxb, NULL);
+      esl_stopwatch_Stop(w);
+      perf_stop();
+      secs  += w->user;
+      cells += (double) sq[i]->n * (double) om->M;
+    }
+  add_result(res, "bck", secs, cells, nseq, "targets");
+  add_perf(res);
+
+  p7_omx_Destroy(oxf);
+  p7_omx_Destroy(oxb);
+  esl_stopwatch_Destroy(w);
+}
+
+/* The full p7_Pipeline() on all targets */
+static void
+bench_pipeline(BENCH_RESULTS *res, P7_OPROFILE *om, P7_BG *bg, ESL_SQ **sq, int nseq)
+{
+  ESL_STOPWATCH *w   = esl_stopwatch_Create();
+  P7_PIPELINE   *pli = p7_pipeline_Create(NULL, om->M, 400, FALSE, p7_SEARCH_SEQS);
+  P7_TOPHITS    *th  = p7_tophits_Create();
+  double         cells = 0.;
+  int            i;
+
+  perf_reset();
+  perf_start();
+  esl_stopwatch_Start(w);
+  p7_pli_NewModel(pli, om, bg);
+  for (i = 0; i < nseq; i++)
+    {
+      p7_pli_NewSeq(pli, sq[i]);
+      p7_bg_SetLength(bg, sq[i]->n);
+      p7_oprofile_ReconfigLength(om, sq[i]->n);
+      p7_Pipeline(pli, om, bg, sq[i], NULL, th);
+      p7_pipeline_Reuse(pli);
+      cells += (double) sq[i]->n * (double) om->M;
+    }
+  esl_stopwatch_Stop(w);
+  perf_stop();
+  add_result(res, "pipeline", w->user, cells, nseq, "targets");
+  add_perf(res);
+
+  p7_tophits_Destroy(th);
+  p7_pipeline_Destroy(pli);
+  esl_stopwatch_Destroy(w);
+}
+
+/* Domain definition on -D homologs emitted from the query; only
+ * p7_domaindef_ByPosteriorHeuristics() is timed.
+ */
+static void
+bench_domaindef(BENCH_RESULTS *res, ESL_GETOPTS *go, ESL_RANDOMNESS *r, P7_HMM *hmm, P7_PROFILE *gm, P7_OPROFILE *om, P7_BG *bg)
+{
+  ESL_STOPWATCH *w    = esl_stopwatch_Create();
+  ESL_SQ        *sq   = esl_sq_CreateDigital(gm->abc);
+  P7_OMX        *oxf  = p7_omx_Create(om->M, 0, 0);
+  P7_OMX        *oxb  = p7_omx_Create(om->M, 0, 0);
+  P7_OMX        *fwd  = p7_omx_Create(om->M, 400, 400);
+  P7_OMX        *bck  = p7_omx_Create(om->M, 400, 400);
+  P7_DOMAINDEF  *ddef = p7_domaindef_Create(r);
+  int            D    = esl_opt_GetInteger(go, "-D");
+  double         secs = 0.;
+  double         cells = 0.;
+  int            ndom = 0;
+  int            i;
+
+  perf_reset();
+  for (i = 0; i < D; i++)
+    {
+      do {
+	esl_sq_Reuse(sq);
+	p7_ProfileEmit(r, hmm, gm, bg, sq, NULL);
+      } while (sq->n > 100000);
+      esl_sq_FormatName(sq, "homolog%d", i+1);
+
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+      p7_omx_GrowTo(oxf, om->M, 0, sq->n);
+      p7_omx_GrowTo(oxb, om->M, 0, sq->n);
+      p7_ForwardParser (sq->dsq, sq->n, om, oxf, NULL);
+      p7_BackwardParser(sq->dsq, sq->n, om, oxf, oxb, NULL);
+
+      perf_start();
+      esl_stopwatch_Start(w);
+      p7_domaindef_ByPosteriorHeuristics(sq, NULL, om, oxf, oxb, fwd, bck, ddef, bg, FALSE, NULL, NULL, NULL);
+      esl_stopwatch_Stop(w);
+      perf_stop();
+      secs  += w->user;
+      cells += (double) sq->n * (double) om->M;
+      ndom  += ddef->ndom;
+      p7_domaindef_Reuse(ddef);
+    }
+  add_result(res, "domaindef", secs, cells, D, "targets");
+  add_perf(res);
+  printf("# domaindef: %d domains in %d emitted homologs\n", ndom, D);
+
+  p7_domaindef_Destroy(ddef);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  p7_omx_Destroy(oxb);
+  p7_omx_Destroy(oxf);
+  esl_sq_Destroy(sq);
+  esl_stopwatch_Destroy(w);
+}
+
+/* Sequence file parsing: --seqfile, or the synthetic targets written as FASTA */
+static void
+bench_seqio(BENCH_RESULTS *res, ESL_GETOPTS *go, const ESL_ALPHABET *abc, ESL_SQ **tsq, int nseq)
+{
+  ESL_STOPWATCH *w        = esl_stopwatch_Create();
+  ESL_SQFILE    *sqfp     = NULL;
+  ESL_SQ        *sq       = esl_sq_CreateDigital(abc);
+  char           tmpfile[32] = "hmmbenchXXXXXX";
+  char          *seqfile;
+  FILE          *fp;
+  int64_t        nres     = 0;
+  int            i;
+
+  if (esl_opt_IsOn(go, "--seqfile")) seqfile = esl_opt_GetString(go, "--seqfile");
+  else
+    {
+      if (esl_tmpfile_named(tmpfile, &fp) != eslOK) p7_Fail("failed to create a tmpfile");
+      for (i = 0; i < nseq; i++)
+	if (esl_sqio_Write(fp, tsq[i], eslSQFILE_FASTA, FALSE) != eslOK) p7_Fail("failed to write tmp seqfile");
+      fclose(fp);
+      seqfile = tmpfile;
+    }
+
+  esl_stopwatch_Start(w);
+  if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_UNKNOWN, NULL, &sqfp) != eslOK) p7_Fail("failed to open %s", seqfile);
+  for (i = 0; esl_sqio_Read(sqfp, sq) == eslOK; i++)
+    {
+      nres += sq->n;
+      esl_sq_Reuse(sq);
+    }
+  esl_sqfile_Close(sqfp);
+  esl_stopwatch_Stop(w);
+  add_result(res, "seqio_read", w->elapsed, 0., (double) nres * 1e-6, "Mres");
+
+  if (! esl_opt_IsOn(go, "--seqfile")) remove(tmpfile);
+  esl_sq_Destroy(sq);
+  esl_stopwatch_Destroy(w);
+}
+
+/* Profile file parsing: --hmmfile, or -H copies of the query written in ASCII */
+static void
+bench_hmmio(BENCH_RESULTS *res, ESL_GETOPTS *go, P7_HMM *qhmm)
+{
+  ESL_STOPWATCH *w        = esl_stopwatch_Create();
+  ESL_ALPHABET  *abc      = NULL;
+  P7_HMMFILE    *hfp      = NULL;
+  P7_HMM        *hmm      = NULL;
+  char           tmpfile[32] = "hmmbenchXXXXXX";
+  char          *hmmfile;
+  FILE          *fp;
+  int64_t        nnodes   = 0;
+  int            nhmm     = 0;
+  int            i;
+
+  if (esl_opt_IsOn(go, "--hmmfile")) hmmfile = esl_opt_GetString(go, "--hmmfile");
+  else
+    {
+      if (esl_tmpfile_named(tmpfile, &fp) != eslOK) p7_Fail("failed to create a tmpfile");
+      for (i = 0; i < esl_opt_GetInteger(go, "-H"); i++)
+	if (p7_hmmfile_WriteASCII(fp, -1, qhmm) != eslOK) p7_Fail("failed to write tmp HMM file");
+      fclose(fp);
+      hmmfile = tmpfile;
+    }
+
+  esl_stopwatch_Start(w);
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("failed to open %s", hmmfile);
+  while (p7_hmmfile_Read(hfp, &abc, &hmm) == eslOK)
+    {
+      nhmm++;
+      nnodes += hmm->M;
+      p7_hmm_Destroy(hmm);
+    }
+  p7_hmmfile_Close(hfp);
+  esl_stopwatch_Stop(w);
+  add_result(res, "hmmio_read", w->elapsed, 0., nhmm, "models");
+  printf("# hmmio_read: %d models, %" PRId64 " nodes\n", nhmm, nnodes);
+
+  if (! esl_opt_IsOn(go, "--hmmfile")) remove(tmpfile);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+}
+
+
+/*****************************************************************
+ * --xcheck: every vector backend against the generic code
+ *****************************************************************/
+
+/* The kernels of one backend. On x86 each P7_KERNELS table the host
+ * can run (SSE2, AVX2, AVX-512) is a backend of its own; on ARM and
+ * POWER there is the one, called through the public entry points.
+ * The generic implementation is the reference, and is timed too.
+ */
+typedef struct {
+  const char *name;
+  int (*msv)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+  int (*ssv)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+  int (*vit)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+  int (*fwd)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *fwd, float *opt_sc);
+  int (*bck)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+} XBACKEND;
+
+#define MAX_XBACKENDS 4
+
+enum xkernel_e { XK_MSV, XK_SSV, XK_VIT, XK_FWD, XK_BCK, NXK };
+static const char *xkernel_name[NXK] = { "msv", "ssv", "vit", "fwd", "bck" };
+
+/* one backend's tally for one kernel, over all profiles and targets */
+typedef struct {
+  double seconds;
+  double cells;
+  int    n;           /* scores compared with the generic ones        */
+  int    noverflow;   /* filter scores that overflowed: not compared  */
+  int    nleft;       /* SSV results left to the full MSV filter      */
+  int    nfail;       /* deviations over the threshold                */
+  double maxdev;      /* largest deviation seen                       */
+} XTALLY;
+
+/* xcheck_backends()
+ * Fill <be> with the vector backends this host can run; return how many.
+ */
+static int
+xcheck_backends(XBACKEND *be)
+{
+  int n = 0;
+#if defined (eslENABLE_SSE)
+  const P7_KERNELS *k;
+  const char       *name;
+
+  for (n = 0; n < MAX_XBACKENDS && (k = p7_impl_KernelTable(n, &name)) != NULL; n++)
+    {
+      be[n].name = name;
+      be[n].msv  = k->msv;
+      be[n].ssv  = k->ssv;
+      be[n].vit  = k->vit;
+      be[n].fwd  = k->fwdparser;
+      be[n].bck  = k->bckparser;
+    }
+#else
+  be[0].name = isa_name();
+  be[0].msv  = p7_MSVFilter;
+  be[0].ssv  = p7_SSVFilter;
+  be[0].vit  = p7_ViterbiFilter;
+  be[0].fwd  = p7_ForwardParser;
+  be[0].bck  = p7_BackwardParser;
+  n = 1;
+#endif
+  return n;
+}
+
+/* xcheck_score()
+ * Tally one vector score <sc>, with return code <status>, against
+ * the reference <ref>.
+ */
+static void
+xcheck_score(XTALLY *t, int status, float sc, float ref, double tol)
+{
+  double dev;
+
+  if      (status == eslERANGE)    { t->noverflow++; return; }
+  else if (status == eslENORESULT) { t->nleft++;     return; }
+  dev = fabs((double) sc - (double) ref);
+  if (dev > t->maxdev) t->maxdev = dev;
+  if (dev > tol) t->nfail++;
+  t->n++;
+}
+
+/* xcheck()
+ * Run every backend's MSV, SSV, Viterbi filter and Forward/Backward
+ * parsers on the same --xmodels sampled profiles (-M nodes) and
+ * --xseqs iid targets each (-L residues), all from seed -s; time
+ * them, and compare their scores with the generic ones. The filters
+ * are checked against generic Viterbi on a profile rounded and
+ * scaled the way each filter's is (p7_profile_SameAsMF(),
+ * p7_profile_SameAsVF()), so they should agree to within --xtol; the
+ * parsers against p7_GForward() and p7_GBackward(), to within
+ * --xtolfwd. Returns the number of failed comparisons.
+ */
+static int
+xcheck(ESL_GETOPTS *go)
+{
+  ESL_RANDOMNESS *r     = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc   = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg    = p7_bg_Create(abc);
+  ESL_STOPWATCH  *w     = esl_stopwatch_Create();
+  int             M     = esl_opt_GetInteger(go, "-M");
+  int             L     = esl_opt_GetInteger(go, "-L");
+  int             nmod  = esl_opt_GetInteger(go, "--xmodels");
+  int             nsq   = esl_opt_GetInteger(go, "--xseqs");
+  double          tol   = esl_opt_GetReal(go, "--xtol");
+  double          ftol;
+  XBACKEND        be[MAX_XBACKENDS];
+  XTALLY          t[MAX_XBACKENDS+1][NXK];   /* [0] is the generic code */
+  int             nbe   = xcheck_backends(be);
+  ESL_DSQ       **dsq   = NULL;
+  float          *ref   = NULL;              /* [NXK*s + k]: reference score of target s for kernel k */
+  P7_HMM         *hmm   = NULL;
+  P7_PROFILE     *gm    = NULL;
+  P7_PROFILE     *gmr   = NULL;
+  P7_OPROFILE    *om    = NULL;
+  P7_GMX         *gx    = p7_gmx_Create(M, L);
+  P7_OMX         *oxf   = p7_omx_Create(M, 0, L);
+  P7_OMX         *oxb   = p7_omx_Create(M, 0, L);
+  FILE           *jfp   = NULL;
+  double          cells = (double) M * (double) L;
+  float           sc;
+  int             nfail = 0;
+  int             b, k, m, s, status;
+
+  /* Forward/Backward: as tight as the generic code's own logsum allows */
+  p7_FLogsumInit();
+  if (esl_opt_IsOn(go, "--xtolfwd")) ftol = esl_opt_GetReal(go, "--xtolfwd");
+  else                               ftol = (p7_FLogsumError(-0.4, -0.5) > 0.0001) ? 1.0 : 0.0001;
+
+  memset(t, 0, sizeof(t));
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ *) * nsq);
+  ESL_ALLOC(ref, sizeof(float) * NXK * nsq);
+  for (s = 0; s < nsq; s++) ESL_ALLOC(dsq[s], sizeof(ESL_DSQ) * (L+2));
+
+  printf("# %s %s; --xcheck; seed %d\n", "hmmbench", HMMER_VERSION, esl_opt_GetInteger(go, "-s"));
+  printf("# %d sampled profiles (M=%d) x %d iid targets (L=%d)\n", nmod, M, nsq, L);
+  printf("# thresholds: filters %g nats, parsers %g nats\n", tol, ftol);
+
+  for (m = 0; m < nmod; m++)
+    {
+      if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) p7_Fail("failed to sample a profile");
+      gmr = p7_profile_Clone(gm);
+      for (s = 0; s < nsq; s++) esl_rsq_xfIID(r, bg->f, abc->K, L, dsq[s]);
+
+      /* generic code: time it on <gm>, and get the references */
+      esl_stopwatch_Start(w);
+      for (s = 0; s < nsq; s++) p7_GMSV(dsq[s], L, gm, gx, 2.0, &sc);
+      esl_stopwatch_Stop(w);
+      t[0][XK_MSV].seconds += w->user; t[0][XK_MSV].cells += cells * nsq;
+
+      esl_stopwatch_Start(w);
+      for (s = 0; s < nsq; s++) p7_GViterbi(dsq[s], L, gm, gx, &sc);
+      esl_stopwatch_Stop(w);
+      t[0][XK_VIT].seconds += w->user; t[0][XK_VIT].cells += cells * nsq;
+
+      esl_stopwatch_Start(w);
+      for (s = 0; s < nsq; s++) p7_GForward(dsq[s], L, gm, gx, &ref[NXK*s + XK_FWD]);
+      esl_stopwatch_Stop(w);
+      t[0][XK_FWD].seconds += w->user; t[0][XK_FWD].cells += cells * nsq;
+
+      esl_stopwatch_Start(w);
+      for (s = 0; s < nsq; s++) p7_GBackward(dsq[s], L, gm, gx, &ref[NXK*s + XK_BCK]);
+      esl_stopwatch_Stop(w);
+      t[0][XK_BCK].seconds += w->user; t[0][XK_BCK].cells += cells * nsq;
+
+      p7_profile_SameAsMF(om, gmr);
+      for (s = 0; s < nsq; s++)
+	{
+	  p7_GViterbi(dsq[s], L, gmr, gx, &sc);
+	  ref[NXK*s + XK_MSV] = ref[NXK*s + XK_SSV] = sc / om->scale_b - 3.0f;
+	}
+      p7_profile_Copy(gm, gmr);
+      p7_profile_SameAsVF(om, gmr);
+      for (s = 0; s < nsq; s++)
+	{
+	  p7_GViterbi(dsq[s], L, gmr, gx, &sc);
+	  ref[NXK*s + XK_VIT] = sc / om->scale_w - 3.0f;
+	}
+
+      /* each backend, on the same profile and targets */
+      for (b = 0; b < nbe; b++)
+	for (k = 0; k < NXK; k++)
+	  {
+	    XTALLY *tb = &(t[b+1][k]);
+
+	    for (s = 0; s < nsq; s++)
+	      {
+		if (k == XK_BCK) be[b].fwd(dsq[s], L, om, oxf, NULL);
+		esl_stopwatch_Start(w);
+		switch (k) {
+		case XK_MSV: status = be[b].msv(dsq[s], L, om, oxf,      &sc); break;
+		case XK_SSV: status = be[b].ssv(dsq[s], L, om,           &sc); break;
+		case XK_VIT: status = be[b].vit(dsq[s], L, om, oxf,      &sc); break;
+		case XK_FWD: status = be[b].fwd(dsq[s], L, om, oxf,      &sc); break;
+		case XK_BCK: status = be[b].bck(dsq[s], L, om, oxf, oxb, &sc); break;
+		default:     status = eslEINCONCEIVABLE; break;
+		}
+		esl_stopwatch_Stop(w);
+		tb->seconds += w->user;
+		tb->cells   += cells;
+		xcheck_score(tb, status, sc, ref[NXK*s + k], (k == XK_FWD || k == XK_BCK) ? ftol : tol);
+	      }
+	  }
+
+      p7_oprofile_Destroy(om);
+      p7_profile_Destroy(gmr);
+      p7_profile_Destroy(gm);
+      p7_hmm_Destroy(hmm);
+    }
+
+  printf("%-14s %-4s %10s %8s %8s %8s %12s %6s\n", "backend", "kern", "Mc/s", "checked", "overflow", "to_msv", "max_dev", "fail");
+  for (b = 0; b <= nbe; b++)
+    for (k = 0; k < NXK; k++)
+      {
+	XTALLY *tb = &(t[b][k]);
+
+	if (tb->cells == 0.) continue;   /* the generic code has no SSV */
+	if (b == 0) printf("%-14s %-4s %10.1f %8s %8s %8s %12s %6s\n", "generic", xkernel_name[k], tb->cells / tb->seconds * 1e-6, "-", "-", "-", "-", "-");
+	else        printf("%-14s %-4s %10.1f %8d %8d %8d %12.6f %6d\n", be[b-1].name, xkernel_name[k], tb->cells / tb->seconds * 1e-6, tb->n, tb->noverflow, tb->nleft, tb->maxdev, tb->nfail);
+	nfail += tb->nfail;
+      }
+  printf("# %s\n", nfail ? "FAILED: scores over threshold" : "ok");
+
+  if (esl_opt_IsOn(go, "--json"))
+    {
+      if ((jfp = fopen(esl_opt_GetString(go, "--json"), "w")) == NULL) p7_Fail("Failed to open JSON output file %s for writing\n", esl_opt_GetString(go, "--json"));
+      fprintf(jfp, "{\n");
+      fprintf(jfp, "  \"benchmark\": \"hmmbench-xcheck\",\n");
+      fprintf(jfp, "  \"version\": ");  json_string(jfp, HMMER_VERSION); fprintf(jfp, ",\n");
+      fprintf(jfp, "  \"seed\": %d,\n", esl_opt_GetInteger(go, "-s"));
+      fprintf(jfp, "  \"models\": %d, \"M\": %d, \"targets\": %d, \"L\": %d,\n", nmod, M, nsq, L);
+      fprintf(jfp, "  \"tol\": %g, \"tol_parsers\": %g,\n", tol, ftol);
+      fprintf(jfp, "  \"pass\": %s,\n", nfail ? "false" : "true");
+      fprintf(jfp, "  \"results\": [\n");
+      for (b = 0; b <= nbe; b++)
+	for (k = 0; k < NXK; k++)
+	  {
+	    XTALLY *tb = &(t[b][k]);
+	    if (tb->cells == 0.) continue;
+	    fprintf(jfp, "%s    { \"backend\": \"%s\", \"kernel\": \"%s\", \"seconds\": %.6f, \"mcells_per_sec\": %.3f",
+		    (b == 0 && k == 0) ? "" : ",\n", (b == 0 ? "generic" : be[b-1].name), xkernel_name[k], tb->seconds, tb->cells / tb->seconds * 1e-6);
+	    if (b > 0) fprintf(jfp, ", \"checked\": %d, \"overflow\": %d, \"to_msv\": %d, \"max_dev\": %.6f, \"fail\": %d", tb->n, tb->noverflow, tb->nleft, tb->maxdev, tb->nfail);
+	    fprintf(jfp, " }");
+	  }
+      fprintf(jfp, "\n  ]\n");
+      fprintf(jfp, "}\n");
+      fclose(jfp);
+    }
+
+  for (s = 0; s < nsq; s++) free(dsq[s]);
+  free(dsq);
+  free(ref);
+  p7_omx_Destroy(oxb);
+  p7_omx_Destroy(oxf);
+  p7_gmx_Destroy(gx);
+  esl_stopwatch_Destroy(w);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  return nfail;
+
+ ERROR:
+  p7_Fail("allocation failure");
+  return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_HMM         *hmm  = NULL;
+  P7_BG          *bg   = NULL;
+  P7_PROFILE     *gm   = NULL;
+  P7_OPROFILE    *om   = NULL;
+  ESL_SQ        **sq   = NULL;
+  BENCH_RESULTS   res;
+  FILE           *jfp  = NULL;
+  int             nseq;
+  int64_t         nres;
+  int             i;
+
+  if (esl_opt_GetBoolean(go, "--xcheck"))
+    {
+      i = xcheck(go);
+      esl_randomness_Destroy(r);
+      esl_getopts_Destroy(go);
+      return (i > 0 ? 1 : 0);
+    }
+
+  res.n = 0;
+  hmm = get_query(go, r, &abc, &bg);
+  sq  = get_targets(go, r, abc, bg, &nseq, &nres);
+
+  gm = p7_profile_Create(hmm->M, abc);
+  om = p7_oprofile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL);
+  p7_oprofile_Convert(gm, om);
+
+  printf("# %s %s; isa %s; seed %d\n", "hmmbench", HMMER_VERSION, isa_name(), esl_opt_GetInteger(go, "-s"));
+  printf("# query  %s (M=%d)\n", hmm->name, hmm->M);
+  printf("# %d targets, %" PRId64 " residues\n", nseq, nres);
+  if (esl_opt_GetBoolean(go, "--perf")) perf_open();
+
+  bench_kernel(&res, "msv",  BENCH_MSV, om, sq, nseq);
+#if defined (eslENABLE_SSE) || defined (eslENABLE_NEON) || defined (eslENABLE_VMX)
+  bench_kernel(&res, "ssv",  BENCH_SSV, om, sq, nseq);
+#endif
+  bench_kernel(&res, "vit",  BENCH_VIT, om, sq, nseq);
+  bench_kernel(&res, "fwd",  BENCH_FWD, om, sq, nseq);
+  bench_backward (&res, om, sq, nseq);
+  bench_pipeline (&res, om, bg, sq, nseq);
+  bench_domaindef(&res, go, r, hmm, gm, om, bg);
+  perf_close();
+  bench_seqio(&res, go, abc, sq, nseq);
+  bench_hmmio(&res, go, hmm);
+
+  if (esl_opt_IsOn(go, "--json"))
+    {
+      if ((jfp = fopen(esl_opt_GetString(go, "--json"), "w")) == NULL) p7_Fail("Failed to open JSON output file %s for writing\n", esl_opt_GetString(go, "--json"));
+      write_json(jfp, go, om, nseq, nres, &res);
+      fclose(jfp);
+    }
+
+  for (i = 0; i < nseq; i++) esl_sq_Destroy(sq[i]);
+  free(sq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
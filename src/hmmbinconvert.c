@@ -0,0 +1,87 @@
+/* hmmbinconvert: convert a binary result file (--binout) to tabular text.
+ *
+ * Reads a binary result file written by hmmsearch or hmmscan --binout
+ * and writes the --tblout, --domtblout, or --pfamtblout text that the
+ * search would have written.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type          default  env  range  toggles  reqs   incomp  help   docgroup*/
+  { "-h",           eslARG_NONE,    FALSE, NULL, NULL,   NULL,   NULL,   NULL, "show brief help on version and usage",                         0 },
+  { "-q",           eslARG_INT,     NULL,  NULL, "n>=0", NULL,   NULL,   NULL, "only convert query number <n> (0..nquery-1)",                  0 },
+  { "--tblout",     eslARG_OUTFILE, NULL,  NULL, NULL,   NULL,   NULL,   NULL, "save parseable table of per-sequence hits to file <f>",        0 },
+  { "--domtblout",  eslARG_OUTFILE, NULL,  NULL, NULL,   NULL,   NULL,   NULL, "save parseable table of per-domain hits to file <f>",          0 },
+  { "--pfamtblout", eslARG_OUTFILE, NULL,  NULL, NULL,   NULL,   NULL,   NULL, "save table of hits and domains to file, in Pfam format <f>",   0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <binfile>";
+static char banner[] = "convert a binary result file to tabular text output";
+
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS   *go        = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char          *binfile   = esl_opt_GetArg(go, 1);
+  P7_BINOUT     *bo        = NULL;
+  P7_TOPHITS    *th        = NULL;
+  FILE          *tblfp     = NULL;
+  FILE          *domtblfp  = NULL;
+  FILE          *pfamtblfp = NULL;
+  int64_t        q, q1, q2;
+  int            status;
+  char           errbuf[eslERRBUFSIZE];
+
+  status = p7_binout_Open(binfile, &bo, errbuf);
+  if      (status == eslENOTFOUND) p7_Fail("File existence/permissions problem in trying to open binary result file %s.\n%s\n", binfile, errbuf);
+  else if (status == eslEFORMAT)   p7_Fail("File format problem in trying to open binary result file %s.\n%s\n",                binfile, errbuf);
+  else if (status != eslOK)        p7_Fail("Unexpected error %d in opening binary result file %s.\n%s\n",                       status, binfile, errbuf);
+
+  if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp     = fopen(esl_opt_GetString(go, "--tblout"),     "w")) == NULL) p7_Fail("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
+  if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp  = fopen(esl_opt_GetString(go, "--domtblout"),  "w")) == NULL) p7_Fail("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
+  if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL) p7_Fail("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (! tblfp && ! domtblfp && ! pfamtblfp) tblfp = stdout; /* default: per-seq table to stdout */
+
+  q1 = 0;
+  q2 = bo->nquery;
+  if (esl_opt_IsOn(go, "-q"))
+    {
+      q1 = esl_opt_GetInteger(go, "-q");
+      if (q1 >= bo->nquery) p7_Fail("No query %" PRId64 " in %s: it has %" PRId64 " queries", q1, binfile, bo->nquery);
+      q2 = q1 + 1;
+    }
+
+  for (q = q1; q < q2; q++)
+    {
+      status = p7_binout_ReadQuery(bo, q, &th);
+      if      (status == eslEFORMAT) p7_Fail("Bad record in binary result file %s:\n%s\n", binfile, bo->errbuf);
+      else if (status != eslOK)      p7_Fail("Unexpected error %d reading query %" PRId64 " from %s", status, q, binfile);
+
+      if (tblfp)     p7_tophits_TabularTargets(tblfp,    bo->qname, bo->qacc, th, &(bo->pli), (q == q1));
+      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, bo->qname, bo->qacc, th, &(bo->pli), (q == q1));
+      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp,   bo->qname, bo->qacc, th, &(bo->pli));
+
+      p7_tophits_Destroy(th);
+    }
+
+  if (tblfp)     p7_tophits_TabularTail(tblfp,     bo->progname, bo->mode, bo->qfile, bo->tfile, go);
+  if (domtblfp)  p7_tophits_TabularTail(domtblfp,  bo->progname, bo->mode, bo->qfile, bo->tfile, go);
+  if (pfamtblfp) p7_tophits_TabularTail(pfamtblfp, bo->progname, bo->mode, bo->qfile, bo->tfile, go);
+
+  if (tblfp && tblfp != stdout) fclose(tblfp);
+  if (domtblfp)                 fclose(domtblfp);
+  if (pfamtblfp)                fclose(pfamtblfp);
+  p7_binout_Close(bo);
+  esl_getopts_Destroy(go);
+  return 0;
+}
@@ -42,6 +42,7 @@ static ESL_OPTIONS searchOpts[] = {
     /* Control of output */
   { "--acc",        eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                2 },
+  { "--compactali", eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL, "--noali",         "have alignments sent in their compact form",                   2 },
   { "--notextw",    eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                         2 },
   { "--textw",      eslARG_INT,         "120", NULL, "n>=120",NULL,  NULL, "--notextw",      "set max width of ASCII text output lines",                     2 },
   /* Control of scoring system */
@@ -69,6 +70,11 @@ static ESL_OPTIONS searchOpts[] = {
   { "--F2",         eslARG_REAL,       "1e-3", NULL, NULL,    NULL,  NULL, "--max",          "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,       "1e-5", NULL, NULL,    NULL,  NULL, "--max",          "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,        NULL,  NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                             7 },
+  { "--dd_threads", eslARG_INT,         "0",   NULL, "n>=0",  NULL,  NULL, NULL,             "define domains of a multidomain target in <n> threads",        7 },
+  { "--dd_ramlimit", eslARG_INT,        "0",   NULL, "n>=0",  NULL,  NULL, NULL,             "cap full envelope DP matrices at <n> MB (0: no cap)",          7 },
+  { "--dd_nbatch",  eslARG_INT,         "0",   NULL, "n>=0",  NULL,  NULL, NULL,             "sample domain traces in batches of <n>, stopping early",       7 },
+  { "--dd_deferali", eslARG_NONE,       FALSE, NULL, NULL,    NULL,  NULL, NULL,             "align domains only of targets that are reported",              7 },
+  { "--dd_bf16",    eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL, NULL,             "keep envelope DP matrices in bfloat16 (half the memory)",      7 },
   /* Control of E-value calibration */
   { "--EmL",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,          "length of sequences for MSV Gumbel mu fit",                   11 },   
   { "--EmN",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,          "number of sequences for MSV Gumbel mu fit",                   11 },   
@@ -79,12 +85,16 @@ static ESL_OPTIONS searchOpts[] = {
   { "--Eft",        eslARG_REAL,       "0.04", NULL,"0<x<1",    NULL,  NULL,  NULL,          "tail mass for Forward exponential tail tau fit",              11 },   
   /* Other options */
   { "--seed",       eslARG_INT,         "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
+  { "--timing",     eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "report time spent in each stage of the pipeline",             12 },
+  { "--memstats",   eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "report memory high-water marks of the pipeline",              12 },
+  { "--membudget",  eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  NULL,            "keep each pipeline under <n> MB of DP memory",                12 },
   { "--nonull2",    eslARG_NONE,        NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",               12 },
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,        FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--hmmdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--seqdb",       "hmm database to search",                                      12 },
   { "--seqdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--hmmdb",       "protein database to search",                                  12 },
   { "--seqdb_ranges",eslARG_STRING,     NULL,  NULL,  NULL,   NULL, "--seqdb", NULL,         "range(s) of sequences within --seqdb that will be searched",  12 },
+  { "--deadline",   eslARG_REAL,        FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "give up on the search <x> seconds after it was submitted",    12 },
 
   /* name           type        default  env  range toggles reqs incomp  help                                          docgroup*/
   { "-c",         eslARG_INT,       "1", NULL, NULL, NULL,  NULL, "--seqdb",  "use alt genetic code of NCBI transl table <n>", 15 },
@@ -401,6 +411,9 @@ int main(int argc, char *argv[])
       //     P7_HMMFILE      *hfp     = NULL;        /* open input HMM file             */
       ESL_SQ          *sq      = NULL;        /* one target sequence (digital)   */
       ESL_ALPHABET    *abc     = NULL;        /* digital alphabet                */
+      char            *s;
+      int              nreplies;                /* queries answered                */
+      int              q;
 
       status = eslOK;
       abc = esl_alphabet_Create(eslAMINO);
@@ -414,135 +427,143 @@ int main(int argc, char *argv[])
           exit(1);
         }
 
-        // Get the status structure back from the server
-        buf = malloc(HMMD_SEARCH_STATUS_SERIAL_SIZE);
-        buf_offset = 0;
-        n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
-        if(buf == NULL){
-          printf("Unable to allocate memory for search status structure\n");
-          exit(1);
-        }
+        /* a scan of several sequences is answered one query at a time */
+        nreplies = 1;
+        if (esl_opt_IsUsed(go, "--hmmdb") && *ptr == '>')
+          for (s = ptr + 1; (s = strstr(s, "\n>")) != NULL; s++) nreplies++;
+
+        for (q = 0; q < nreplies; q++) {
+          // Get the status structure back from the server
+          buf = malloc(HMMD_SEARCH_STATUS_SERIAL_SIZE);
+          buf_offset = 0;
+          n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
+          if(buf == NULL){
+            printf("Unable to allocate memory for search status structure\n");
+            exit(1);
+          }
 
-        if ((size = readn(sock, buf, n)) == -1) {
-          fprintf(stderr, "[%s:%d] read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
-          exit(1);
-        }
+          if ((size = readn(sock, buf, n)) == -1) {
+            fprintf(stderr, "[%s:%d] read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+            exit(1);
+          }
 
-        if(hmmd_search_status_Deserialize(buf, &buf_offset, &sstatus) != eslOK){
-          printf("Unable to deserialize search status object \n");
-          exit(1);
-        }
+          if(hmmd_search_status_Deserialize(buf, &buf_offset, &sstatus) != eslOK){
+            printf("Unable to deserialize search status object \n");
+            exit(1);
+          }
+
+          if (sstatus.status != eslOK) {
+            char *ebuf;
+            n = sstatus.msg_size;
+            ebuf = malloc(n);
+            if ((size = readn(sock, ebuf, n)) == -1) {
+              fprintf(stderr, "[%s:%d] read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+              exit(1);
+            }
+            fprintf(stderr, "ERROR (%d): %s\n", sstatus.status, ebuf);
+            free(ebuf);
+            free(buf);
+            continue;
+          }
 
-        if (sstatus.status != eslOK) {
-          char *ebuf;
+          free(buf); // clear this out 
+          buf_offset = 0; // reset to beginning for next serialized object
           n = sstatus.msg_size;
-          ebuf = malloc(n);
-          if ((size = readn(sock, ebuf, n)) == -1) {
+
+          if ((buf = malloc(n)) == NULL) {
+            fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+            exit(1);
+          }
+          // Grab the serialized search results
+          if ((size = readn(sock, buf, n)) == -1) {
             fprintf(stderr, "[%s:%d] read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
             exit(1);
           }
-          fprintf(stderr, "ERROR (%d): %s\n", sstatus.status, ebuf);
-          free(ebuf);
-          goto COMPLETE;
-        }
 
-        free(buf); // clear this out 
-        buf_offset = 0; // reset to beginning for next serialized object
-        n = sstatus.msg_size;
-
-        if ((buf = malloc(n)) == NULL) {
-          fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
-          exit(1);
-        }
-        // Grab the serialized search results
-        if ((size = readn(sock, buf, n)) == -1) {
-          fprintf(stderr, "[%s:%d] read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
-          exit(1);
-        }
-
-        if ((stats = malloc(sizeof(HMMD_SEARCH_STATS))) == NULL) {
-          fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
-          exit(1);
-        }
-        stats->hit_offsets = NULL; // force allocation of memory for this in _Deserialize
-        if(p7_hmmd_search_stats_Deserialize(buf, &buf_offset, stats) != eslOK){
-          printf("Unable to deserialize search stats object \n");
-          exit(1);
-        }
+          if ((stats = malloc(sizeof(HMMD_SEARCH_STATS))) == NULL) {
+            fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+            exit(1);
+          }
+          stats->hit_offsets = NULL; // force allocation of memory for this in _Deserialize
+          if(p7_hmmd_search_stats_Deserialize(buf, &buf_offset, stats) != eslOK){
+            printf("Unable to deserialize search stats object \n");
+            exit(1);
+          }
 
-        // Create the structures we'll deserialize the hits into
-        pli = p7_pipeline_Create(go, 100, 100, FALSE, (esl_opt_IsUsed(go, "--seqdb")) ? p7_SEARCH_SEQS : p7_SCAN_MODELS);
+          // Create the structures we'll deserialize the hits into
+          pli = p7_pipeline_Create(go, 100, 100, FALSE, (esl_opt_IsUsed(go, "--seqdb")) ? p7_SEARCH_SEQS : p7_SCAN_MODELS);
 
-        /* copy the search stats */
-        w->elapsed       = stats->elapsed;
-        w->user          = stats->user;
-        w->sys           = stats->sys;
+          /* copy the search stats */
+          w->elapsed       = stats->elapsed;
+          w->user          = stats->user;
+          w->sys           = stats->sys;
 
-        pli->nmodels     = stats->nmodels;
-        pli->nseqs       = stats->nseqs;
-        pli->n_past_msv  = stats->n_past_msv;
-        pli->n_past_bias = stats->n_past_bias;
-        pli->n_past_vit  = stats->n_past_vit;
-        pli->n_past_fwd  = stats->n_past_fwd;
+          pli->nmodels     = stats->nmodels;
+          pli->nseqs       = stats->nseqs;
+          pli->n_past_msv  = stats->n_past_msv;
+          pli->n_past_bias = stats->n_past_bias;
+          pli->n_past_vit  = stats->n_past_vit;
+          pli->n_past_fwd  = stats->n_past_fwd;
 
-        pli->Z           = stats->Z;
-        pli->domZ        = stats->domZ;
-        pli->Z_setby     = stats->Z_setby;
-        pli->domZ_setby  = stats->domZ_setby;
+          pli->Z           = stats->Z;
+          pli->domZ        = stats->domZ;
+          pli->Z_setby     = stats->Z_setby;
+          pli->domZ_setby  = stats->domZ_setby;
 
-        th = p7_tophits_Create(); 
+          th = p7_tophits_Create(); 
 
-        free(th->unsrt);
-        free(th->hit);
+          free(th->unsrt);
+          free(th->hit);
 
-        th->N         = stats->nhits;
-        if ((th->unsrt = malloc(stats-> nhits *sizeof(P7_HIT))) == NULL) {
-          fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
-          exit(1);
-        }
-        th->nreported = stats->nreported;
-        th->nincluded = stats->nincluded;
-        th->is_sorted_by_seqidx  = FALSE;
-        th->is_sorted_by_sortkey = TRUE;
+          th->N         = stats->nhits;
+          if ((th->unsrt = malloc(stats-> nhits *sizeof(P7_HIT))) == NULL) {
+            fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+            exit(1);
+          }
+          th->nreported = stats->nreported;
+          th->nincluded = stats->nincluded;
+          th->is_sorted_by_seqidx  = FALSE;
+          th->is_sorted_by_sortkey = TRUE;
 
-        if ((th->hit = malloc(sizeof(void *) * stats->nhits)) == NULL) {
-          fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
-          exit(1);
-        }
-        hits_start = buf_offset;
-        // deserialize the hits
-        for (i = 0; i < stats->nhits; ++i) {
-          // set all internal pointers of the hit to NULL before deserializing into it
-          th->unsrt[i].name = NULL;
-          th->unsrt[i].acc = NULL;
-          th->unsrt[i].desc = NULL;
-          th->unsrt[i].dcl = NULL;
-          if((buf_offset -hits_start) != stats->hit_offsets[i]){
-            printf("Hit offset %d did not match expected.  Found %d, expected %" PRIu64 "\n", i, (buf_offset-hits_start), stats->hit_offsets[i]);
+          if ((th->hit = malloc(sizeof(void *) * stats->nhits)) == NULL) {
+            fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+            exit(1);
           }
-          if(p7_hit_Deserialize(buf, &buf_offset, &(th->unsrt[i])) != eslOK){
-            printf("Unable to deserialize hit %d\n", i);
-            exit(0);
+          hits_start = buf_offset;
+          // deserialize the hits
+          for (i = 0; i < stats->nhits; ++i) {
+            // set all internal pointers of the hit to NULL before deserializing into it
+            th->unsrt[i].name = NULL;
+            th->unsrt[i].acc = NULL;
+            th->unsrt[i].desc = NULL;
+            th->unsrt[i].dcl = NULL;
+            if((buf_offset -hits_start) != stats->hit_offsets[i]){
+              printf("Hit offset %d did not match expected.  Found %d, expected %" PRIu64 "\n", i, (buf_offset-hits_start), stats->hit_offsets[i]);
+            }
+            if(p7_hit_Deserialize(buf, &buf_offset, &(th->unsrt[i])) != eslOK){
+              printf("Unable to deserialize hit %d\n", i);
+              exit(0);
+            }
+            th->hit[i] = &(th->unsrt[i]);  
           }
-          th->hit[i] = &(th->unsrt[i]);  
-        }
 
-        /* adjust the reported and included hits */
-        //th->is_sorted = FALSE;
-        //p7_tophits_Sort(th);
+          /* adjust the reported and included hits */
+          //th->is_sorted = FALSE;
+          //p7_tophits_Sort(th);
 		
-        /* Print the results.  */
-        if (scores) { p7_tophits_Targets(stdout, th, pli, 120); fprintf(stdout, "\n\n"); }
-        if (ali)    { p7_tophits_Domains(stdout, th, pli, 120); fprintf(stdout, "\n\n"); }
-        p7_pli_Statistics(stdout, pli, w);  
+          /* Print the results.  */
+          if (scores) { p7_tophits_Targets(stdout, th, pli, 120); fprintf(stdout, "\n\n"); }
+          if (ali)    { p7_tophits_Domains(stdout, th, pli, 120); fprintf(stdout, "\n\n"); }
+          p7_pli_Statistics(stdout, pli, w);  
 
-        p7_pipeline_Destroy(pli); 
-        p7_tophits_Destroy(th);
-        free(buf);
+          p7_pipeline_Destroy(pli); 
+          p7_tophits_Destroy(th);
+          free(buf);
 
-        fprintf(stdout, "//\n");  fflush(stdout);
+          fprintf(stdout, "//\n");  fflush(stdout);
 
-        fprintf(stdout, "Total bytes received %" PRId64 "\n", sstatus.msg_size);
+          fprintf(stdout, "Total bytes received %" PRId64 "\n", sstatus.msg_size);
+        }
       } else {
         printf("Error parsing input query\n");
       }
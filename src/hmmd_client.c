@@ -0,0 +1,892 @@
+/* HMMD_CLIENT: an asynchronous, pipelined client of the hmmpgmd daemon.
+ *
+ * hmmc2 sends one request and blocks until its whole answer is in.
+ * An HMMD_CLIENT lets a program keep many requests outstanding on one
+ * connection instead: hmmd_client_Send() only queues a request, under
+ * an id of the caller's choosing, and hmmd_client_Process() moves
+ * whatever bytes the socket will take or give without blocking. Each
+ * answer is decoded as it arrives - its status, then its statistics,
+ * then each hit with p7_hit_Deserialize() as soon as all of its bytes
+ * are in - so only one hit's worth of an answer is ever buffered
+ * beyond what has been decoded. A finished answer goes to the
+ * callback set with hmmd_client_SetCallback(), or else waits for
+ * hmmd_client_Next(). hmmd_client_Fd() lets a caller wait on the
+ * connection with its own poll() or event loop.
+ *
+ * The daemon answers the requests of a connection in the order it
+ * got them, and the answers carry no id of their own, so they're
+ * matched to ids in order. That is why each request here must be a
+ * single query: a scan of several sequences is answered once per
+ * sequence, but rejected with a single error, and the two can't be
+ * told apart. Server commands ('!') aren't supported either; a
+ * successful reload has no answer at all. A request the daemon
+ * rejects before queueing it (a malformed request, one past the
+ * client's --quota) is answered at once, possibly ahead of the
+ * client's searches still in flight; callers that pipeline should
+ * keep within their quota.
+ *
+ * Contents:
+ *    1. The HMMD_CLIENT object.
+ *    2. Internal functions.
+ *    3. Unit tests.
+ *    4. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+#include "hmmd_client.h"
+
+#define HMMD_CLIENT_CHUNK (64 * 1024)   /* initial buffer sizes, and bytes read per read() */
+
+/* bytes into a serialized HMMD_SEARCH_STATS of its <nhits>, the first
+ * of the three counts that end its fixed part
+ */
+#define HMMD_SEARCH_STATS_NHITS_OFFSET (HMMD_SEARCH_STATS_SERIAL_BASE - 3 * sizeof(uint64_t))
+
+static int  client_write(HMMD_CLIENT *cl);
+static int  client_read(HMMD_CLIENT *cl, int *ret_more, int *ret_eof);
+static int  client_decode(HMMD_CLIENT *cl);
+static int  client_grow_output(HMMD_CLIENT *cl, size_t n);
+static void client_complete(HMMD_CLIENT *cl);
+
+
+/*****************************************************************
+ *= 1. The HMMD_CLIENT object
+ *****************************************************************/
+
+/* Function:  hmmd_client_Connect()
+ * Synopsis:  Connect to an hmmpgmd master.
+ *
+ * Purpose:   Connect to the hmmpgmd master listening for clients at
+ *            IPv4 address <ip>, port <port> (its --cport), and return
+ *            a new client for the connection in <*ret_cl>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslESYS> if the connection can't be made, with a message
+ *            in <errbuf>, and <*ret_cl> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+hmmd_client_Connect(const char *ip, int port, HMMD_CLIENT **ret_cl, char *errbuf)
+{
+  struct sockaddr_in addr;
+  int                fd = -1;
+  int                status;
+
+  *ret_cl = NULL;
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)                     ESL_XFAIL(eslESYS, errbuf, "socket error %d - %s", errno, strerror(errno));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(port);
+  if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1)                   ESL_XFAIL(eslESYS, errbuf, "%s is not an IPv4 address", ip);
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)         ESL_XFAIL(eslESYS, errbuf, "connect to %s:%d error %d - %s", ip, port, errno, strerror(errno));
+
+  if ((status = hmmd_client_Attach(fd, ret_cl)) != eslOK) goto ERROR;
+  return eslOK;
+
+ ERROR:
+  if (fd >= 0) close(fd);
+  return status;
+}
+
+
+/* Function:  hmmd_client_Attach()
+ * Synopsis:  Make a client of an open connection.
+ *
+ * Purpose:   Create a client for <fd>, a stream socket already
+ *            connected to an hmmpgmd master, and return it in
+ *            <*ret_cl>. The client makes <fd> non-blocking, and takes
+ *            it over: hmmd_client_Close() closes it.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslESYS> if <fd> can't be made non-blocking.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+hmmd_client_Attach(int fd, HMMD_CLIENT **ret_cl)
+{
+  HMMD_CLIENT *cl = NULL;
+  int          flags;
+  int          status;
+
+  *ret_cl = NULL;
+  if ((flags = fcntl(fd, F_GETFL, 0)) < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return eslESYS;
+
+  ESL_ALLOC(cl, sizeof(HMMD_CLIENT));
+  memset(cl, 0, sizeof(HMMD_CLIENT));
+  cl->fd    = fd;
+  cl->state = HMMD_CLIENT_STATUS;
+
+  ESL_ALLOC(cl->obuf, HMMD_CLIENT_CHUNK);
+  cl->oalloc = HMMD_CLIENT_CHUNK;
+  ESL_ALLOC(cl->ibuf, HMMD_CLIENT_CHUNK);
+  cl->ialloc = HMMD_CLIENT_CHUNK;
+  ESL_ALLOC(cl->ids, sizeof(uint32_t) * 16);
+  cl->idalloc = 16;
+
+  *ret_cl = cl;
+  return eslOK;
+
+ ERROR:
+  if (cl != NULL) {
+    cl->fd = -1;                 /* the caller still owns <fd> */
+    hmmd_client_Close(cl);
+  }
+  return status;
+}
+
+
+/* Function:  hmmd_client_SetCallback()
+ * Synopsis:  Have each answer handed to a callback.
+ *
+ * Purpose:   From now on, call <cb(res, arg)> from inside
+ *            hmmd_client_Process() with each answer as it completes,
+ *            instead of queueing it for hmmd_client_Next(). <cb> owns
+ *            <res>, and frees it with hmmd_result_Destroy(). A <NULL>
+ *            <cb> goes back to queueing.
+ */
+void
+hmmd_client_SetCallback(HMMD_CLIENT *cl, hmmd_client_Callback cb, void *arg)
+{
+  cl->cb     = cb;
+  cl->cb_arg = arg;
+}
+
+
+/* Function:  hmmd_client_Send()
+ * Synopsis:  Queue a request.
+ *
+ * Purpose:   Queue a search for <query> - one sequence in FASTA
+ *            format, or one HMM in HMMER3 save file format - with
+ *            search options <opts> (as hmmc2 takes them after '@',
+ *            e.g. "--seqdb 1 -E 0.01"; or <NULL>), to be sent as
+ *            hmmd_client_Process() gets the chance. Its answer will
+ *            carry <id>, which the client doesn't interpret.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if <query> is not a single query: empty, a
+ *            server command, more than one sequence, or with a "//"
+ *            line before its end; or if <opts> has a newline in it.
+ *            Nothing is queued.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+hmmd_client_Send(HMMD_CLIENT *cl, uint32_t id, const char *opts, const char *query)
+{
+  const char *s;
+  size_t      olen = (opts == NULL) ? 0 : strlen(opts);
+  size_t      qlen;
+  int         terminated = FALSE;
+  int         status;
+
+  /* skip leading white space, as the daemon does */
+  while (*query == ' ' || *query == '\t' || *query == '\n' || *query == '\r') ++query;
+  qlen = strlen(query);
+  if (qlen == 0 || *query == '!' || *query == '@')                      return eslEINVAL;
+  if (strncmp(query, "//", 2) == 0)                                     return eslEINVAL;
+  if (opts != NULL && strpbrk(opts, "\r\n") != NULL)                    return eslEINVAL;
+
+  /* a terminating "//" line is optional, but nothing may follow it */
+  for (s = query; s != NULL && *s != '\0'; s = strchr(s, '\n'), s = (s == NULL) ? NULL : s + 1) {
+    if (s[0] == '/' && s[1] == '/') {
+      while (*s != '\0' && *s != '\n') ++s;
+      while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r') ++s;
+      if (*s != '\0') return eslEINVAL;
+      terminated = TRUE;
+      break;
+    }
+    if (s > query && s[0] == '>') return eslEINVAL;   /* a second sequence */
+  }
+
+  if ((status = client_grow_output(cl, (opts == NULL ? 0 : olen + 2) + qlen + 4)) != eslOK) return status;
+
+  if (opts != NULL) {
+    cl->obuf[cl->on++] = '@';
+    memcpy(cl->obuf + cl->on, opts, olen);
+    cl->on += olen;
+    cl->obuf[cl->on++] = '\n';
+  }
+  memcpy(cl->obuf + cl->on, query, qlen);
+  cl->on += qlen;
+  if (! terminated) {
+    if (query[qlen-1] != '\n') cl->obuf[cl->on++] = '\n';
+    memcpy(cl->obuf + cl->on, "//\n", 3);
+    cl->on += 3;
+  }
+
+  /* remember the id, in order */
+  if (cl->nids == cl->idalloc) {
+    uint32_t *p;
+    int       i;
+
+    ESL_ALLOC(p, sizeof(uint32_t) * cl->idalloc * 2);
+    for (i = 0; i < cl->nids; i++) p[i] = cl->ids[(cl->ihead + i) % cl->idalloc];
+    free(cl->ids);
+    cl->ids      = p;
+    cl->ihead    = 0;
+    cl->idalloc *= 2;
+  }
+  cl->ids[(cl->ihead + cl->nids) % cl->idalloc] = id;
+  cl->nids++;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  hmmd_client_Process()
+ * Synopsis:  Move requests and answers along.
+ *
+ * Purpose:   Wait up to <timeout_ms> milliseconds (0: don't wait; -1:
+ *            indefinitely) for the connection to be ready, then write
+ *            as much of the queued requests as it takes, and read and
+ *            decode as much of the answers as has arrived, all without
+ *            blocking. Each answer completed is handed to the callback,
+ *            or queued for hmmd_client_Next().
+ *
+ *            Returns at once, with <eslOK>, if no request is
+ *            outstanding.
+ *
+ * Returns:   <eslOK> on success, including a timeout.
+ *            <eslEOF> if the daemon closed the connection; answers
+ *            completed before it did are still delivered.
+ *            <eslESYS> on a socket error, and <eslEFORMAT> if the
+ *            daemon sent something that can't be decoded. After any of
+ *            these the connection is unusable.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+hmmd_client_Process(HMMD_CLIENT *cl, int timeout_ms)
+{
+  struct pollfd pfd;
+  int           eof = FALSE;
+  int           more;
+  int           n;
+  int           status;
+
+  if (cl->nids == 0 && cl->opos == cl->on) return eslOK;
+
+  pfd.fd      = cl->fd;
+  pfd.events  = POLLIN | (hmmd_client_WantsWrite(cl) ? POLLOUT : 0);
+  pfd.revents = 0;
+  if ((n = poll(&pfd, 1, timeout_ms)) < 0) return (errno == EINTR) ? eslOK : eslESYS;
+  if (n == 0)                              return eslOK;
+
+  if (pfd.revents & POLLNVAL) return eslESYS;
+
+  if ((pfd.revents & POLLOUT) && (status = client_write(cl)) != eslOK) return status;
+
+  /* decode as we read, so undecoded input stays small */
+  if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+    do {
+      if ((status = client_read(cl, &more, &eof)) != eslOK) return status;
+      if ((status = client_decode(cl))            != eslOK) return status;
+    } while (more);
+  }
+  return (eof ? eslEOF : eslOK);
+}
+
+
+/* Function:  hmmd_client_Next()
+ * Synopsis:  Get the next completed answer.
+ *
+ * Purpose:   Take the oldest completed answer off <cl>'s queue, and
+ *            return it in <*ret_res>. The caller frees it with
+ *            hmmd_result_Destroy().
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOD> if no answer is waiting, and <*ret_res> is <NULL>.
+ */
+int
+hmmd_client_Next(HMMD_CLIENT *cl, HMMD_RESULT **ret_res)
+{
+  HMMD_RESULT *res = cl->done;
+
+  *ret_res = res;
+  if (res == NULL) return eslEOD;
+
+  cl->done = res->next;
+  if (cl->done == NULL) cl->done_tail = NULL;
+  res->next = NULL;
+  return eslOK;
+}
+
+
+/* Function:  hmmd_client_Fd()
+ * Synopsis:  The client's socket, for the caller's own poll().
+ */
+int
+hmmd_client_Fd(const HMMD_CLIENT *cl)
+{
+  return cl->fd;
+}
+
+
+/* Function:  hmmd_client_Pending()
+ * Synopsis:  Number of requests still waiting for their answers.
+ */
+int
+hmmd_client_Pending(const HMMD_CLIENT *cl)
+{
+  return cl->nids;
+}
+
+
+/* Function:  hmmd_client_WantsWrite()
+ * Synopsis:  TRUE if requests are waiting to be written.
+ *
+ * Purpose:   For a caller that polls hmmd_client_Fd() itself: wait
+ *            for it to be writable as well as readable while this is
+ *            TRUE.
+ */
+int
+hmmd_client_WantsWrite(const HMMD_CLIENT *cl)
+{
+  return (cl->opos < cl->on);
+}
+
+
+/* Function:  hmmd_client_Close()
+ * Synopsis:  Close the connection, and free the client.
+ *
+ * Purpose:   Close <cl>'s connection, and free it, along with any
+ *            answers nobody has taken yet. Requests still outstanding
+ *            are abandoned; the daemon sees the hangup.
+ */
+void
+hmmd_client_Close(HMMD_CLIENT *cl)
+{
+  HMMD_RESULT *res;
+
+  if (cl == NULL) return;
+  if (cl->fd >= 0) close(cl->fd);
+  while (hmmd_client_Next(cl, &res) == eslOK) hmmd_result_Destroy(res);
+  hmmd_result_Destroy(cl->cur);
+  if (cl->obuf != NULL) free(cl->obuf);
+  if (cl->ibuf != NULL) free(cl->ibuf);
+  if (cl->ids  != NULL) free(cl->ids);
+  free(cl);
+}
+
+
+/* Function:  hmmd_result_Destroy()
+ * Synopsis:  Free an answer.
+ */
+void
+hmmd_result_Destroy(HMMD_RESULT *res)
+{
+  uint64_t i;
+
+  if (res == NULL) return;
+  if (res->errmsg           != NULL) free(res->errmsg);
+  if (res->stats.hit_offsets != NULL) free(res->stats.hit_offsets);
+  if (res->hits != NULL) {
+    for (i = 0; i < res->stats.nhits; i++) p7_hit_Destroy(res->hits[i]);
+    free(res->hits);
+  }
+  free(res);
+}
+/*-------------------- end, HMMD_CLIENT -------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions
+ *****************************************************************/
+
+/* client_grow_output()
+ *
+ * Make room for <n> more bytes of requests in <cl->obuf>, first
+ * dropping the ones already written.
+ */
+static int
+client_grow_output(HMMD_CLIENT *cl, size_t n)
+{
+  int status;
+
+  if (cl->opos > 0) {
+    memmove(cl->obuf, cl->obuf + cl->opos, cl->on - cl->opos);
+    cl->on  -= cl->opos;
+    cl->opos = 0;
+  }
+  if (cl->on + n > cl->oalloc) {
+    while (cl->on + n > cl->oalloc) cl->oalloc *= 2;
+    ESL_REALLOC(cl->obuf, cl->oalloc);
+  }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* client_write()
+ *
+ * Write queued requests until the socket would block. A daemon that
+ * has gone away shows up as an error here rather than as a SIGPIPE,
+ * where the system lets us ask for that.
+ */
+static int
+client_write(HMMD_CLIENT *cl)
+{
+  ssize_t n;
+#ifdef MSG_NOSIGNAL
+  int     flags = MSG_NOSIGNAL;
+#else
+  int     flags = 0;
+#endif
+
+  while (cl->opos < cl->on) {
+    if ((n = send(cl->fd, cl->obuf + cl->opos, cl->on - cl->opos, flags)) < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return eslESYS;
+    }
+    cl->opos += n;
+  }
+  if (cl->opos == cl->on) cl->opos = cl->on = 0;
+  return eslOK;
+}
+
+/* client_read()
+ *
+ * Append one read()'s worth of what has arrived to <cl->ibuf>,
+ * growing it if it's getting full. Sets <*ret_more> if there may be
+ * more to read, and <*ret_eof> if the daemon hung up.
+ */
+static int
+client_read(HMMD_CLIENT *cl, int *ret_more, int *ret_eof)
+{
+  ssize_t n;
+  int     status;
+
+  *ret_more = FALSE;
+  if (cl->ialloc - cl->in < HMMD_CLIENT_CHUNK / 2) {
+    ESL_REALLOC(cl->ibuf, cl->ialloc * 2);
+    cl->ialloc *= 2;
+  }
+
+  do {
+    n = read(cl->fd, cl->ibuf + cl->in, cl->ialloc - cl->in);
+  } while (n < 0 && errno == EINTR);
+
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return eslOK;
+    if (errno == ECONNRESET) { *ret_eof = TRUE; return eslOK; }
+    return eslESYS;
+  }
+  if (n == 0) { *ret_eof = TRUE; return eslOK; }
+  cl->in    += n;
+  *ret_more  = TRUE;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* client_decode()
+ *
+ * Decode as much of the answers in <cl->ibuf> as is complete, and
+ * drop the decoded bytes. A hit is decoded once the offset of the
+ * next one (or the end of the answer) is in; an answer whose stats
+ * carry no hit offsets is decoded once all its hits are in.
+ */
+static int
+client_decode(HMMD_CLIENT *cl)
+{
+  HMMD_SEARCH_STATUS  sstatus;
+  HMMD_RESULT        *res;
+  uint64_t            nhits;
+  uint64_t            first;
+  uint64_t            need;
+  uint64_t            end;
+  uint32_t            pos = 0;
+  uint32_t            p;
+  int                 status;
+
+  for ( ;; ) {
+    size_t avail = cl->in - pos;
+
+    if (cl->state == HMMD_CLIENT_STATUS) {
+      if (avail == 0) break;
+      if (cl->nids == 0) { status = eslEFORMAT; goto ERROR; }    /* an answer nobody asked for */
+      if (avail < HMMD_SEARCH_STATUS_SERIAL_SIZE) break;
+
+      p = pos;
+      if (hmmd_search_status_Deserialize(cl->ibuf, &p, &sstatus) != eslOK) { status = eslEFORMAT; goto ERROR; }
+      pos = p;
+
+      ESL_ALLOC(res, sizeof(HMMD_RESULT));
+      memset(res, 0, sizeof(HMMD_RESULT));
+      res->id     = cl->ids[cl->ihead];
+      res->status = sstatus.status;
+      cl->cur      = res;
+      cl->msg_left = sstatus.msg_size;
+      if (sstatus.status != eslOK)                                   cl->state = HMMD_CLIENT_ERRMSG;
+      else if (sstatus.msg_size < HMMD_SEARCH_STATS_SERIAL_BASE + sizeof(uint64_t)) { status = eslEFORMAT; goto ERROR; }
+      else                                                           cl->state = HMMD_CLIENT_STATS;
+    }
+
+    else if (cl->state == HMMD_CLIENT_ERRMSG) {
+      if (avail < cl->msg_left) break;
+      ESL_ALLOC(cl->cur->errmsg, cl->msg_left + 1);
+      memcpy(cl->cur->errmsg, cl->ibuf + pos, cl->msg_left);
+      cl->cur->errmsg[cl->msg_left] = '\0';
+      pos += cl->msg_left;
+      client_complete(cl);
+    }
+
+    else if (cl->state == HMMD_CLIENT_STATS) {
+      /* the first offset (or -1, for none) says how long the stats are */
+      need = HMMD_SEARCH_STATS_SERIAL_BASE + sizeof(uint64_t);
+      if (avail < need) break;
+      memcpy(&nhits, cl->ibuf + pos + HMMD_SEARCH_STATS_NHITS_OFFSET, sizeof(uint64_t));
+      memcpy(&first, cl->ibuf + pos + HMMD_SEARCH_STATS_SERIAL_BASE,  sizeof(uint64_t));
+      nhits = esl_ntoh64(nhits);
+      first = esl_ntoh64(first);
+      if (first != (uint64_t) -1) {
+        if (nhits == 0 || nhits > cl->msg_left / sizeof(uint64_t)) { status = eslEFORMAT; goto ERROR; }
+        need = HMMD_SEARCH_STATS_SERIAL_BASE + nhits * sizeof(uint64_t);
+      }
+      if (need > cl->msg_left) { status = eslEFORMAT; goto ERROR; }
+      if (avail < need) break;
+
+      p = pos;
+      if (p7_hmmd_search_stats_Deserialize(cl->ibuf, &p, &(cl->cur->stats)) != eslOK || p - pos != need) { status = eslEFORMAT; goto ERROR; }
+      pos = p;
+
+      cl->hits_len  = cl->msg_left - need;
+      cl->hits_done = 0;
+      if (nhits > cl->hits_len) { status = eslEFORMAT; goto ERROR; }  /* every hit takes some bytes */
+      if (nhits > 0) {
+        ESL_ALLOC(cl->cur->hits, sizeof(P7_HIT *) * nhits);
+        memset(cl->cur->hits, 0, sizeof(P7_HIT *) * nhits);
+      }
+      cl->state = HMMD_CLIENT_HITS;
+    }
+
+    else { /* HMMD_CLIENT_HITS */
+      res = cl->cur;
+      if (res->nhits == res->stats.nhits) {
+        if (cl->hits_done != cl->hits_len) { status = eslEFORMAT; goto ERROR; }
+        client_complete(cl);
+        continue;
+      }
+
+      if (res->stats.hit_offsets != NULL) {
+        if (res->stats.hit_offsets[res->nhits] != cl->hits_done) { status = eslEFORMAT; goto ERROR; }
+        end = (res->nhits + 1 < res->stats.nhits) ? res->stats.hit_offsets[res->nhits + 1] : cl->hits_len;
+        if (end <= cl->hits_done || end > cl->hits_len) { status = eslEFORMAT; goto ERROR; }
+      }
+      else end = cl->hits_len;
+      if (avail < end - cl->hits_done) break;
+
+      if ((res->hits[res->nhits] = p7_hit_Create_empty()) == NULL) { status = eslEMEM; goto ERROR; }
+      p = pos;
+      if (p7_hit_Deserialize(cl->ibuf, &p, res->hits[res->nhits]) != eslOK) { status = eslEFORMAT; goto ERROR; }
+      if (p - pos > cl->hits_len - cl->hits_done)                            { status = eslEFORMAT; goto ERROR; }
+      if (res->stats.hit_offsets != NULL && p - pos != end - cl->hits_done)   { status = eslEFORMAT; goto ERROR; }
+      cl->hits_done += p - pos;
+      pos = p;
+      res->nhits++;
+    }
+  }
+
+  /* drop what's been decoded */
+  if (pos > 0) {
+    memmove(cl->ibuf, cl->ibuf + pos, cl->in - pos);
+    cl->in -= pos;
+  }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* client_complete()
+ *
+ * The answer being decoded is whole: retire its request, and deliver
+ * it.
+ */
+static void
+client_complete(HMMD_CLIENT *cl)
+{
+  HMMD_RESULT *res = cl->cur;
+
+  cl->ihead = (cl->ihead + 1) % cl->idalloc;
+  cl->nids--;
+  cl->cur   = NULL;
+  cl->state = HMMD_CLIENT_STATUS;
+
+  if (cl->cb != NULL) {
+    (*cl->cb)(res, cl->cb_arg);
+  } else {
+    if (cl->done_tail == NULL) cl->done            = res;
+    else                       cl->done_tail->next = res;
+    cl->done_tail = res;
+  }
+}
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7HMMD_CLIENT_TESTDRIVE
+
+/* serialize_answer()
+ *
+ * Append the daemon's answer for <nhits> sampled hits, kept in
+ * <hits>, to <*buf>: as the master sends it, with hit offsets.
+ */
+static void
+serialize_answer(ESL_RAND64 *rng, P7_HIT **hits, int nhits, uint8_t **buf, uint32_t *n, uint32_t *nalloc)
+{
+  char               msg[] = "hmmd_client serialize_answer failed";
+  HMMD_SEARCH_STATUS sstatus;
+  HMMD_SEARCH_STATS  stats;
+  uint8_t           *hbuf   = NULL;
+  uint32_t           hn     = 0;
+  uint32_t           halloc = 0;
+  uint8_t           *sbuf   = NULL;
+  uint32_t           sn     = 0;
+  uint32_t           salloc = 0;
+  int                i;
+
+  memset(&stats, 0, sizeof(HMMD_SEARCH_STATS));
+  stats.Z           = 1000.;
+  stats.domZ        = 10.;
+  stats.Z_setby     = p7_ZSETBY_NTARGETS;
+  stats.domZ_setby  = p7_ZSETBY_NTARGETS;
+  stats.nseqs       = 1000;
+  stats.nhits       = nhits;
+  stats.nreported   = nhits;
+  stats.hit_offsets = (nhits > 0) ? malloc(sizeof(uint64_t) * nhits) : NULL;
+
+  for (i = 0; i < nhits; i++) {
+    hits[i] = NULL;
+    if (p7_hit_TestSample(rng, &(hits[i])) != eslOK) esl_fatal(msg);
+    stats.hit_offsets[i] = hn;
+    if (p7_hit_Serialize(hits[i], &hbuf, &hn, &halloc) != eslOK) esl_fatal(msg);
+  }
+  if (p7_hmmd_search_stats_Serialize(&stats, &sbuf, &sn, &salloc) != eslOK) esl_fatal(msg);
+
+  sstatus.status   = eslOK;
+  sstatus.msg_size = sn + hn;
+  if (hmmd_search_status_Serialize(&sstatus, buf, n, nalloc) != eslOK) esl_fatal(msg);
+  if (*n + sn + hn > *nalloc) {
+    *nalloc = *n + sn + hn;
+    if ((*buf = realloc(*buf, *nalloc)) == NULL) esl_fatal(msg);
+  }
+  memcpy(*buf + *n, sbuf, sn);  *n += sn;
+  if (hn > 0) { memcpy(*buf + *n, hbuf, hn);  *n += hn; }
+
+  if (stats.hit_offsets) free(stats.hit_offsets);
+  if (hbuf) free(hbuf);
+  free(sbuf);
+}
+
+/* utest_Pipeline()
+ *
+ * Queue <nreq> requests, and play the daemon on the other end of a
+ * socketpair: check each request arrives "//"-terminated and in order,
+ * then write back answers - hits, an error, and no hits - a few bytes
+ * at a time, and check each decodes to what was sent, under the right
+ * id.
+ */
+static void
+utest_Pipeline(ESL_RAND64 *rng, int nreq)
+{
+  char          msg[]  = "hmmd_client pipeline unit test failed";
+  HMMD_CLIENT  *cl     = NULL;
+  HMMD_RESULT  *res    = NULL;
+  P7_HIT     ***hits   = NULL;
+  int          *nhits  = NULL;
+  uint8_t      *buf    = NULL;
+  uint32_t      n      = 0;
+  uint32_t      nalloc = 0;
+  char          req[4096];
+  char          errmsg[] = "Search cancelled";
+  HMMD_SEARCH_STATUS sstatus;
+  size_t        sent, len;
+  int           nread  = 0;
+  int           sv[2];
+  int           q, i, k;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)       esl_fatal(msg);
+  if (hmmd_client_Attach(sv[0], &cl)          != eslOK)  esl_fatal(msg);
+
+  /* malformed requests are refused */
+  if (hmmd_client_Send(cl, 0, NULL, "")                      != eslEINVAL) esl_fatal(msg);
+  if (hmmd_client_Send(cl, 0, NULL, "!shutdown\n")           != eslEINVAL) esl_fatal(msg);
+  if (hmmd_client_Send(cl, 0, NULL, ">a\nACDE\n>b\nACDE\n")  != eslEINVAL) esl_fatal(msg);
+  if (hmmd_client_Send(cl, 0, NULL, ">a\nACDE\n//\n>b\n")    != eslEINVAL) esl_fatal(msg);
+  if (hmmd_client_Pending(cl) != 0) esl_fatal(msg);
+
+  for (q = 0; q < nreq; q++)
+    if (hmmd_client_Send(cl, 100 + q, (q % 2) ? "--seqdb 1" : NULL, (q % 3) ? ">q\nACDEFGHIK\n" : ">q\nACDEFGHIK\n//\n") != eslOK) esl_fatal(msg);
+  if (hmmd_client_Pending(cl) != nreq) esl_fatal(msg);
+
+  while (hmmd_client_WantsWrite(cl))
+    if (hmmd_client_Process(cl, 1000) != eslOK) esl_fatal(msg);
+
+  /* the requests arrive whole, each once */
+  len = 0;
+  while (nread < nreq) {
+    ssize_t r = read(sv[1], req + len, sizeof(req) - len - 1);
+    char   *s;
+    if (r <= 0) esl_fatal(msg);
+    len += r;
+    req[len] = '\0';
+    while ((s = strstr(req, "\n//\n")) != NULL) {
+      nread++;
+      memmove(req, s + 4, len - (s + 4 - req) + 1);
+      len -= s + 4 - req;
+    }
+  }
+  if (len != 0) esl_fatal(msg);
+
+  /* answers: request 1 gets an error, every third one no hits */
+  if ((hits  = malloc(sizeof(P7_HIT **) * nreq)) == NULL) esl_fatal(msg);
+  if ((nhits = malloc(sizeof(int)       * nreq)) == NULL) esl_fatal(msg);
+  for (q = 0; q < nreq; q++) {
+    nhits[q] = (q == 1 || q % 3 == 2) ? 0 : 1 + q % 7;
+    hits[q]  = malloc(sizeof(P7_HIT *) * (nhits[q] + 1));
+    if (q == 1) {
+      sstatus.status   = eslFAIL;
+      sstatus.msg_size = strlen(errmsg) + 1;
+      if (hmmd_search_status_Serialize(&sstatus, &buf, &n, &nalloc) != eslOK) esl_fatal(msg);
+      if (n + sstatus.msg_size > nalloc) { nalloc = n + sstatus.msg_size; buf = realloc(buf, nalloc); }
+      memcpy(buf + n, errmsg, sstatus.msg_size);
+      n += sstatus.msg_size;
+    }
+    else serialize_answer(rng, hits[q], nhits[q], &buf, &n, &nalloc);
+  }
+
+  /* dribble them out, decoding as they go */
+  for (sent = 0; sent < n; sent += len) {
+    len = ESL_MIN(n - sent, 1 + esl_rand64(rng) % 97);
+    if (write(sv[1], buf + sent, len) != len)  esl_fatal(msg);
+    if (hmmd_client_Process(cl, 1000) != eslOK) esl_fatal(msg);
+    if (cl->in > 2 * HMMD_CLIENT_CHUNK)        esl_fatal(msg);  /* decoded bytes don't pile up */
+  }
+  while (hmmd_client_Pending(cl) > 0)
+    if (hmmd_client_Process(cl, 1000) != eslOK) esl_fatal(msg);
+
+  for (q = 0; q < nreq; q++) {
+    if (hmmd_client_Next(cl, &res) != eslOK) esl_fatal(msg);
+    if (res->id != 100 + q)                  esl_fatal(msg);
+    if (q == 1) {
+      if (res->status != eslFAIL || res->errmsg == NULL || strcmp(res->errmsg, errmsg) != 0) esl_fatal(msg);
+    } else {
+      if (res->status != eslOK || res->errmsg != NULL)                                      esl_fatal(msg);
+      if (res->nhits != nhits[q] || res->stats.nhits != nhits[q])                           esl_fatal(msg);
+      for (k = 0; k < nhits[q]; k++)
+	if (p7_hit_Compare(hits[q][k], res->hits[k], 1e-4, 1e-4) != eslOK)                  esl_fatal(msg);
+    }
+    hmmd_result_Destroy(res);
+    for (i = 0; i < nhits[q]; i++) p7_hit_Destroy(hits[q][i]);
+    free(hits[q]);
+  }
+  if (hmmd_client_Next(cl, &res) != eslEOD) esl_fatal(msg);
+
+  /* with nothing outstanding, there's nothing to do */
+  close(sv[1]);
+  if (hmmd_client_Process(cl, 1000) != eslOK) esl_fatal(msg);
+
+  hmmd_client_Close(cl);
+  free(hits);
+  free(nhits);
+  free(buf);
+}
+
+/* utest_Callback()
+ *
+ * With a callback set, answers go to it, and Next() has none.
+ */
+static void
+callback_count(HMMD_RESULT *res, void *arg)
+{
+  (*(int *) arg)++;
+  hmmd_result_Destroy(res);
+}
+
+static void
+utest_Callback(ESL_RAND64 *rng)
+{
+  char         msg[]  = "hmmd_client callback unit test failed";
+  HMMD_CLIENT *cl     = NULL;
+  HMMD_RESULT *res    = NULL;
+  P7_HIT      *hits[3];
+  uint8_t     *buf    = NULL;
+  uint32_t     n      = 0;
+  uint32_t     nalloc = 0;
+  int          ncalls = 0;
+  int          sv[2];
+  int          i;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0)       esl_fatal(msg);
+  if (hmmd_client_Attach(sv[0], &cl)          != eslOK)  esl_fatal(msg);
+  hmmd_client_SetCallback(cl, callback_count, &ncalls);
+
+  if (hmmd_client_Send(cl, 7, NULL, ">q\nACDE\n") != eslOK) esl_fatal(msg);
+  if (hmmd_client_Send(cl, 8, NULL, ">q\nACDE\n") != eslOK) esl_fatal(msg);
+  serialize_answer(rng, hits, 3, &buf, &n, &nalloc);
+  if (write(sv[1], buf, n) != n) esl_fatal(msg);
+  for (i = 0; i < 3; i++) p7_hit_Destroy(hits[i]);
+
+  while (ncalls < 1)
+    if (hmmd_client_Process(cl, 1000) != eslOK) esl_fatal(msg);
+  if (hmmd_client_Pending(cl) != 1)         esl_fatal(msg);
+  if (hmmd_client_Next(cl, &res) != eslEOD) esl_fatal(msg);
+
+  /* the daemon hangs up on the second */
+  close(sv[1]);
+  if (hmmd_client_Process(cl, 1000) != eslEOF) esl_fatal(msg);
+  if (ncalls != 1)                             esl_fatal(msg);
+
+  hmmd_client_Close(cl);
+  free(buf);
+}
+#endif /*p7HMMD_CLIENT_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7HMMD_CLIENT_TESTDRIVE
+
+int
+main(int argc, char **argv)
+{
+  ESL_RAND64 *rng = esl_rand64_Create(0);
+
+  utest_Pipeline(rng, 20);
+  utest_Callback(rng);
+
+  esl_rand64_Destroy(rng);
+  return eslOK;
+}
+#endif /*p7HMMD_CLIENT_TESTDRIVE*/
@@ -0,0 +1,69 @@
+/* An asynchronous, pipelined client of the hmmpgmd daemon.
+ */
+#ifndef P7_HMMD_CLIENT_INCLUDED
+#define P7_HMMD_CLIENT_INCLUDED
+
+#include <stdint.h>
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+
+/* The answer to one request */
+typedef struct hmmd_result_s {
+  uint32_t              id;        /* caller's id for the request, from hmmd_client_Send() */
+  int                   status;    /* eslOK, or the daemon's error code     */
+  char                 *errmsg;    /* daemon's error message, if status != eslOK; else NULL */
+  HMMD_SEARCH_STATS     stats;     /* search statistics, if status == eslOK */
+  P7_HIT              **hits;      /* hits [0..nhits-1], ranked as the daemon sent them */
+  uint64_t              nhits;     /* number of hits decoded so far          */
+  struct hmmd_result_s *next;      /* link in the client's queue of answers */
+} HMMD_RESULT;
+
+/* Called with each answer as it completes; takes ownership of <res> */
+typedef void (*hmmd_client_Callback)(HMMD_RESULT *res, void *arg);
+
+/* decoder state, for the answer at the head of the pending requests */
+enum hmmd_client_state_e { HMMD_CLIENT_STATUS, HMMD_CLIENT_ERRMSG, HMMD_CLIENT_STATS, HMMD_CLIENT_HITS };
+
+typedef struct {
+  int                   fd;        /* socket connected to the daemon; non-blocking */
+
+  char                 *obuf;      /* requests not yet written [opos..on-1] */
+  size_t                opos;
+  size_t                on;
+  size_t                oalloc;
+
+  uint8_t              *ibuf;      /* answer bytes read, not yet decoded [0..in-1] */
+  size_t                in;
+  size_t                ialloc;
+
+  uint32_t             *ids;       /* ids of pending requests, oldest first: ids[ihead..ihead+nids-1 mod idalloc] */
+  int                   ihead;
+  int                   nids;
+  int                   idalloc;
+
+  enum hmmd_client_state_e state;
+  uint64_t              msg_left;  /* bytes of the current answer's message not yet decoded */
+  uint64_t              hits_len;  /* bytes of serialized hits in the current answer */
+  uint64_t              hits_done; /* ... of which have been decoded         */
+  HMMD_RESULT          *cur;       /* answer being decoded, or NULL         */
+
+  HMMD_RESULT          *done;      /* completed answers, oldest first, for hmmd_client_Next() */
+  HMMD_RESULT          *done_tail;
+  hmmd_client_Callback  cb;        /* or, if non-NULL, the callback that gets them */
+  void                 *cb_arg;
+} HMMD_CLIENT;
+
+extern int  hmmd_client_Connect(const char *ip, int port, HMMD_CLIENT **ret_cl, char *errbuf);
+extern int  hmmd_client_Attach(int fd, HMMD_CLIENT **ret_cl);
+extern void hmmd_client_SetCallback(HMMD_CLIENT *cl, hmmd_client_Callback cb, void *arg);
+extern int  hmmd_client_Send(HMMD_CLIENT *cl, uint32_t id, const char *opts, const char *query);
+extern int  hmmd_client_Process(HMMD_CLIENT *cl, int timeout_ms);
+extern int  hmmd_client_Next(HMMD_CLIENT *cl, HMMD_RESULT **ret_res);
+extern int  hmmd_client_Fd(const HMMD_CLIENT *cl);
+extern int  hmmd_client_Pending(const HMMD_CLIENT *cl);
+extern int  hmmd_client_WantsWrite(const HMMD_CLIENT *cl);
+extern void hmmd_client_Close(HMMD_CLIENT *cl);
+extern void hmmd_result_Destroy(HMMD_RESULT *res);
+
+#endif /*P7_HMMD_CLIENT_INCLUDED*/
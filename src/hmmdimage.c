@@ -0,0 +1,354 @@
+/* hmmpgmd: handing the databases' prepared cache image to starting
+ * workers, from the master or a peer, instead of every worker reading
+ * them from shared storage.
+ *
+ * The master and each worker run with --imgport serve the image of
+ * the databases they hold; see HMMD_CMD_FETCH in hmmpgmd.h for the
+ * protocol, and how the master arranges its workers into a tree.
+ *
+ * Contents:
+ *   1. The image being served.
+ *   2. Serving an image.
+ *   3. Fetching an image.
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+#include "cachedb.h"
+
+#define IMG_BUFSIZE (1024 * 1024)  /* bytes of a file read or written at a time */
+
+static const char *img_suffix[HMMD_IMG_NFILES] = { p7_SEQCACHE_SNAPSUFFIX, "", ".h3m", ".h3i", ".h3f", ".h3p" };
+
+
+/*****************************************************************
+ * 1. The image being served.
+ *****************************************************************/
+
+/* The image a master or worker serves, one per process, like the
+ * --trace output. It is replaced whole when databases are (re)loaded;
+ * until the first load it isn't ready, and fetches wait for it.
+ */
+static pthread_mutex_t img_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  img_cond  = PTHREAD_COND_INITIALIZER;   /* broadcast when the image is set */
+static int             img_ready = FALSE;
+static char            img_sid[MAX_INIT_DESC];
+static uint32_t        img_seq_cnt;
+static uint32_t        img_model_cnt;
+static char           *img_path[HMMD_IMG_NFILES];              /* files served; NULL if not held */
+
+/* Function:  hmmpgmd_ImagePath()
+ * Synopsis:  Name a file of a database's cache image.
+ *
+ * Purpose:   Name file <file> (<HMMD_IMG_*>) of the image of database
+ *            file <dbfile>: next to <dbfile> itself if <dir> is
+ *            <NULL>, else in directory <dir>, where a worker keeps
+ *            the images it fetches. The sequence cache snapshot of
+ *            <dbfile> is <dbfile>.h3s, wherever it is; a profile
+ *            database's files are <dbfile> and its pressed
+ *            <dbfile>.h3m, .h3i, .h3f and .h3p.
+ *
+ * Returns:   <eslOK>, and the file name in <*ret_path>, which the
+ *            caller frees.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+hmmpgmd_ImagePath(const char *dbfile, int file, const char *dir, char **ret_path)
+{
+  const char *base = strrchr(dbfile, '/');
+
+  base = (base == NULL) ? dbfile : base + 1;
+  if (dir == NULL) return esl_sprintf(ret_path, "%s%s",    dbfile,    img_suffix[file]);
+  else             return esl_sprintf(ret_path, "%s/%s%s", dir, base, img_suffix[file]);
+}
+
+/* Function:  hmmpgmd_ImageSet()
+ * Synopsis:  Serve the image of newly loaded databases.
+ *
+ * Purpose:   Start serving the image of the databases just loaded,
+ *            whose sequence database has id <sid> and <seq_cnt>
+ *            sequences (<""> and 0 if none), and whose profile
+ *            database has <model_cnt> models (0 if none). <path>
+ *            names the files of the image, <[0..HMMD_IMG_NFILES-1]>;
+ *            <path[f]> is <NULL> for a file not held. The names are
+ *            copied. Fetches waiting for the first image, or asking
+ *            for these databases, are answered from now on.
+ */
+void
+hmmpgmd_ImageSet(const char *sid, uint32_t seq_cnt, uint32_t model_cnt, char **path)
+{
+  int f;
+  int n;
+
+  if ((n = pthread_mutex_lock(&img_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  strncpy(img_sid, sid, MAX_INIT_DESC);
+  img_sid[MAX_INIT_DESC-1] = '\0';
+  img_seq_cnt   = seq_cnt;
+  img_model_cnt = model_cnt;
+  for (f = 0; f < HMMD_IMG_NFILES; f++)
+    {
+      free(img_path[f]);
+      img_path[f] = NULL;
+      if (path[f] != NULL && esl_strdup(path[f], -1, &img_path[f]) != eslOK) LOG_FATAL_MSG("malloc", errno);
+    }
+  img_ready = TRUE;
+  if ((n = pthread_cond_broadcast(&img_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock(&img_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+}
+
+
+/*****************************************************************
+ * 2. Serving an image.
+ *****************************************************************/
+
+/* image_lookup()
+ * Wait for the image to be ready, then find the file that fetch
+ * <req> asks for. Returns <eslOK> and the file name in <*ret_path>,
+ * which the caller frees; <eslEINCOMPAT> if the image is of other
+ * databases, or still isn't ready after HMMD_IMG_WAIT seconds;
+ * <eslENOTFOUND> if the file isn't held.
+ */
+static int
+image_lookup(HMMD_FETCH_CMD *req, char **ret_path)
+{
+  struct timespec until;
+  int             status;
+  int             n;
+
+  *ret_path = NULL;
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += HMMD_IMG_WAIT;
+
+  if ((n = pthread_mutex_lock(&img_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  while (! img_ready)
+    if (pthread_cond_timedwait(&img_cond, &img_mutex, &until) == ETIMEDOUT) break;
+
+  req->sid[MAX_INIT_DESC-1] = '\0';
+  if      (! img_ready || strcmp(req->sid, img_sid) != 0 || req->seq_cnt != img_seq_cnt || req->model_cnt != img_model_cnt) status = eslEINCOMPAT;
+  else if (req->file >= HMMD_IMG_NFILES || img_path[req->file] == NULL)                                                    status = eslENOTFOUND;
+  else if (esl_strdup(img_path[req->file], -1, ret_path) != eslOK)                                                         status = eslEMEM;
+  else                                                                                                                     status = eslOK;
+
+  if ((n = pthread_mutex_unlock(&img_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  return status;
+}
+
+/* image_thread()
+ * Answer the one fetch on connection <arg>, a malloc()'ed socket
+ * descriptor.
+ */
+static void *
+image_thread(void *arg)
+{
+  int               fd    = *(int *) arg;
+  int               ffd   = -1;
+  char             *path  = NULL;
+  char             *buf   = NULL;
+  HMMD_HEADER       hdr;
+  HMMD_FETCH_CMD    req;
+  HMMD_FETCH_REPLY  reply;
+  struct stat       st;
+  uint64_t          left;
+  ssize_t           n;
+
+  pthread_detach(pthread_self());
+  free(arg);
+
+  memset(&reply, 0, sizeof(HMMD_FETCH_REPLY));
+  if (readn(fd, &hdr, sizeof(HMMD_HEADER)) != sizeof(HMMD_HEADER) || hdr.command != HMMD_CMD_FETCH || hdr.length != sizeof(HMMD_FETCH_CMD)) goto EXIT;
+  if (readn(fd, &req, sizeof(HMMD_FETCH_CMD)) != sizeof(HMMD_FETCH_CMD)) goto EXIT;
+
+  reply.status = image_lookup(&req, &path);
+  if (reply.status == eslOK)
+    {
+      if ((ffd = open(path, O_RDONLY)) < 0 || fstat(ffd, &st) != 0) reply.status = eslENOTFOUND;
+      else reply.size = st.st_size;
+    }
+  if (writen(fd, &reply, sizeof(HMMD_FETCH_REPLY)) != sizeof(HMMD_FETCH_REPLY) || reply.status != eslOK) goto EXIT;
+
+  if ((buf = malloc(IMG_BUFSIZE)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  for (left = reply.size; left > 0; left -= n)
+    {
+      if ((n = read(ffd, buf, ESL_MIN(left, IMG_BUFSIZE))) <= 0) {
+        if (n < 0 && errno == EINTR) { n = 0; continue; }
+        p7_syslog(LOG_ERR,"[%s:%d] - reading image file %s error %d - %s\n", __FILE__, __LINE__, path, errno, strerror(errno));
+        break;			/* the fetch sees a short file */
+      }
+      if (writen(fd, buf, n) != n) break;
+    }
+  if (left == 0) printf("Served image file %s, %" PRIu64 " bytes\n", path, reply.size);
+
+ EXIT:
+  if (ffd >= 0) close(ffd);
+  free(path);
+  free(buf);
+  close(fd);
+  pthread_exit(NULL);
+}
+
+/* image_listener()
+ * Accept fetches on listening socket <arg>, each answered in a
+ * thread of its own.
+ */
+static void *
+image_listener(void *arg)
+{
+  int        sock_fd = *(int *) arg;
+  int       *fd;
+  int        n;
+  pthread_t  thread_id;
+
+  for ( ;; ) {
+    if ((fd = malloc(sizeof(int))) == NULL) LOG_FATAL_MSG("malloc", errno);
+    if ((*fd = accept(sock_fd, NULL, NULL)) < 0) LOG_FATAL_MSG("accept", errno);
+    if ((n = pthread_create(&thread_id, NULL, image_thread, fd)) != 0) LOG_FATAL_MSG("thread create", n);
+  }
+
+  pthread_exit(NULL);
+}
+
+/* Function:  hmmpgmd_ImageServe()
+ * Synopsis:  Serve the image to peers on a port.
+ *
+ * Purpose:   Start a thread answering peers' fetches of this
+ *            process's image (<hmmpgmd_ImageSet()>) on TCP port
+ *            <port>. A fetch that arrives before the image is set
+ *            waits for it.
+ *
+ *            Like the daemon's other ports, failing to open it is
+ *            fatal.
+ */
+void
+hmmpgmd_ImageServe(int port)
+{
+  static int          sock_fd;	/* the listener's, for the life of the process */
+  struct sockaddr_in  addr;
+  pthread_t           thread_id;
+  int                 reuse = 1;
+  int                 n;
+
+  if ((sock_fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) LOG_FATAL_MSG("socket", errno);
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(reuse)) < 0) LOG_FATAL_MSG("setsockopt", errno);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port        = htons(port);
+  if (bind(sock_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) LOG_FATAL_MSG("bind", errno);
+  if (listen(sock_fd, 64) < 0)                                     LOG_FATAL_MSG("listen", errno);
+
+  if ((n = pthread_create(&thread_id, NULL, image_listener, &sock_fd)) != 0) LOG_FATAL_MSG("thread create", n);
+}
+
+
+
+/*****************************************************************
+ * 3. Fetching an image.
+ *****************************************************************/
+
+/* Function:  hmmpgmd_ImageFetch()
+ * Synopsis:  Fetch one file of an image from the master or a peer.
+ *
+ * Purpose:   Fetch file <file> (<HMMD_IMG_*>) of the image of the
+ *            databases named by <init>, an HMMD_CMD_INIT, from the
+ *            server at address <ip>, port <port>, and save it as
+ *            <path>. The file is written to <path>.tmp and renamed,
+ *            so <path> is never a partial file.
+ *
+ * Returns:   <eslOK> on success. <eslEINCOMPAT> if the server holds
+ *            other databases; <eslENOTFOUND> if it doesn't have the
+ *            file; <eslFAIL> if it can't be reached, or the file
+ *            doesn't arrive whole; <eslEWRITE> if <path> can't be
+ *            written. On failure <errbuf> says why, and <path> is
+ *            left as it was.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+hmmpgmd_ImageFetch(const char *ip, int port, const HMMD_INIT_CMD *init, int file, const char *path, char *errbuf)
+{
+  struct sockaddr_in  addr;
+  HMMD_HEADER         hdr;
+  HMMD_FETCH_CMD      req;
+  HMMD_FETCH_REPLY    reply;
+  char               *tmpfile = NULL;
+  char               *buf     = NULL;
+  FILE               *fp      = NULL;
+  uint64_t            left;
+  size_t              n;
+  int                 fd      = -1;
+  int                 status;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(port);
+  if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1)                         ESL_XFAIL(eslFAIL, errbuf, "bad image server address %s", ip);
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)                          ESL_XFAIL(eslFAIL, errbuf, "socket failed: %s", strerror(errno));
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)            ESL_XFAIL(eslFAIL, errbuf, "can't connect to %s:%d: %s", ip, port, strerror(errno));
+
+  memset(&hdr, 0, sizeof(HMMD_HEADER));
+  memset(&req, 0, sizeof(HMMD_FETCH_CMD));
+  hdr.command   = HMMD_CMD_FETCH;
+  hdr.length    = sizeof(HMMD_FETCH_CMD);
+  memcpy(req.sid, init->sid, MAX_INIT_DESC);
+  req.seq_cnt   = (init->db_cnt  != 0) ? init->seq_cnt   : 0;
+  req.model_cnt = (init->hmm_cnt != 0) ? init->model_cnt : 0;
+  req.file      = file;
+  if (writen(fd, &hdr, sizeof(HMMD_HEADER))      != sizeof(HMMD_HEADER))      ESL_XFAIL(eslFAIL, errbuf, "failed to send fetch to %s", ip);
+  if (writen(fd, &req, sizeof(HMMD_FETCH_CMD))   != sizeof(HMMD_FETCH_CMD))   ESL_XFAIL(eslFAIL, errbuf, "failed to send fetch to %s", ip);
+  if (readn (fd, &reply, sizeof(HMMD_FETCH_REPLY)) != sizeof(HMMD_FETCH_REPLY)) ESL_XFAIL(eslFAIL, errbuf, "no answer to fetch from %s", ip);
+  if (reply.status == eslEINCOMPAT)                                        ESL_XFAIL(eslEINCOMPAT, errbuf, "%s holds other databases", ip);
+  if (reply.status != eslOK)                                               ESL_XFAIL(eslENOTFOUND, errbuf, "%s doesn't have %s", ip, path);
+
+  if ((status = esl_sprintf(&tmpfile, "%s.tmp", path)) != eslOK) goto ERROR;
+  ESL_ALLOC(buf, IMG_BUFSIZE);
+  if ((fp = fopen(tmpfile, "wb")) == NULL)                                 ESL_XFAIL(eslEWRITE, errbuf, "failed to open %s for writing", tmpfile);
+  for (left = reply.size; left > 0; left -= n)
+    {
+      n = ESL_MIN(left, IMG_BUFSIZE);
+      if (readn(fd, buf, n) != n)                                          ESL_XFAIL(eslFAIL,   errbuf, "%s from %s cut short", path, ip);
+      if (fwrite(buf, sizeof(char), n, fp) != n)                           ESL_XFAIL(eslEWRITE, errbuf, "failed to write %s", tmpfile);
+    }
+  if (fclose(fp) != 0) { fp = NULL;                                        ESL_XFAIL(eslEWRITE, errbuf, "failed to write %s", tmpfile); }
+  fp = NULL;
+  if (rename(tmpfile, path) != 0)                                          ESL_XFAIL(eslEWRITE, errbuf, "failed to rename %s to %s", tmpfile, path);
+
+  printf("Fetched image file %s from %s, %" PRIu64 " bytes\n", path, ip, reply.size);
+  free(tmpfile);
+  free(buf);
+  close(fd);
+  return eslOK;
+
+ ERROR:
+  if (fp)      fclose(fp);
+  if (tmpfile) { remove(tmpfile); free(tmpfile); }
+  if (buf)     free(buf);
+  if (fd >= 0) close(fd);
+  return status;
+}
+
+#endif /*HMMER_THREADS*/
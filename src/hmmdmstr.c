@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
@@ -14,6 +15,7 @@
 #include <pthread.h>
 #include <setjmp.h>
 #include <sys/socket.h>
+#include <poll.h>
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>     /* On FreeBSD, you need netinet/in.h for struct sockaddr_in            */
 #endif                      /* On OpenBSD, netinet/in.h is required for (must precede) arpa/inet.h */
@@ -21,6 +23,10 @@
 #include <syslog.h>
 #include <assert.h>
 #include <time.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <fcntl.h>
+#include <sys/epoll.h>
+#endif
 
 #ifndef HMMER_THREADS
 #error "Program requires pthreads be enabled."
@@ -31,7 +37,6 @@
 #include "esl_getopts.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
-#include "esl_stack.h"
 #include "esl_stopwatch.h"
 #include "esl_threads.h"
 
@@ -45,33 +50,172 @@
 
 #define CONF_FILE "/etc/hmmpgmd.conf"
 
+/* why a search was given up, in ACTIVE_SEARCH <cancelled> */
+#define CANCEL_CLIENT    1      /* the client hung up                       */
+#define CANCEL_DEADLINE  2      /* its deadline (--deadline) passed         */
+#define CANCEL_MASTER    3      /* aggregator: the master cancelled it      */
+#define CANCEL_POLL      1      /* seconds between checks for either        */
+
 typedef struct {
   HMMD_SEARCH_STATS   stats;
   HMMD_SEARCH_STATUS  status;
-  P7_HIT              **hits; 
+  P7_HITREF           *hits;     /* ranked hits, still serialized in <bufs>, unless decoded */
+  uint8_t            **bufs;     /* the workers' serialized hits [0..nbufs-1]              */
+  int                 nbufs;
   int                 nhits;
   int                 db_inx;
   int                 db_cnt;
   int                 errors;
 } SEARCH_RESULTS;
 
+/* The queue of commands clients want done. Rather than first come,
+ * first served, requests are ordered by start-time fair queuing over
+ * the clients (by ip address): a request is tagged with a virtual
+ * finish time, max(<vtime>, the client's last finish tag) plus its
+ * estimated cost, and the smallest tag is served first. A client with
+ * a batch of big searches queued thus only holds others up by its fair
+ * share, while a short query from an otherwise idle client goes ahead
+ * of it. Requests that have waited <max_wait> seconds are served first
+ * regardless of their tags, so none starve.
+ *
+ * A search of a sequence database that is served takes up to
+ * <coalesce> of the others queued with the same options against the
+ * same database along with it: the workers then go through the
+ * sequence cache once for all of them, rather than streaming all its
+ * residues from memory once per query.
+ */
+typedef struct cmd_entry_s {
+  QUEUE_DATA          *query;
+  double               start;      /* virtual start tag                        */
+  double               finish;     /* virtual finish tag                       */
+  time_t               queued;     /* arrival time                             */
+  struct client_tag_s *client;
+  struct cmd_entry_s  *next;
+} CMD_ENTRY;
+
+typedef struct client_tag_s {
+  char                 ip_addr[64];
+  double               finish;     /* finish tag of the client's last request  */
+  int                  nqueued;    /* requests the client has queued           */
+  struct client_tag_s *next;
+} CLIENT_TAG;
+
+typedef struct {
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;           /* signaled when a request is queued        */
+
+  CMD_ENTRY       *head;           /* queued requests, in arrival order        */
+  CLIENT_TAG      *clients;        /* clients with requests queued or recently served */
+  double           vtime;          /* start tag of the request served last     */
+
+  int              max_wait;       /* seconds until a request is served regardless of its tag (--maxwait) */
+  int              quota;          /* most requests queued per client; 0 for no limit (--cquota) */
+  int              coalesce;       /* most searches served as one (--coalesce), at most HMMD_BATCH_MAX */
+
+  P7_SEQCACHE     *seq_db;         /* for the cost estimates                   */
+  double           hmm_res;        /* match states in the profile database     */
+} CMD_QUEUE;
+
 typedef struct {
   int             sock_fd;
   char            ip_addr[64];
 
-  ESL_STACK      *cmdstack;	/* stack of commands that clients want done */
+  CMD_QUEUE      *cmdqueue;	/* queue of commands that clients want done */
 } CLIENTSIDE_ARGS;
 
+#ifdef HAVE_SYS_EPOLL_H
+#define CLIENT_POOL_THREADS  4    /* threads parsing complete client requests */
+#define CLIENT_MAX_EVENTS    64   /* events handled per epoll_wait() call     */
+
+/* One client connection in the event-driven client layer. Input is
+ * accumulated in <buffer> by the epoll thread until a complete
+ * request has arrived; the request is then handed to the pool. The
+ * socket is registered EPOLLONESHOT, so at most one thread owns a
+ * connection at any time.
+ */
+typedef struct clientside_conn_s {
+  CLIENTSIDE_ARGS           args;
+  char                     *buffer;
+  int                       buf_size;
+  int                       amount;
+  struct clientside_conn_s *next;     /* link in the pool's request queue */
+} CLIENTSIDE_CONN;
+
+typedef struct {
+  int              epoll_fd;
+  int              listen_fd;
+  CMD_QUEUE       *cmdqueue;
+
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;
+  CLIENTSIDE_CONN *head;              /* connections with a complete request */
+  CLIENTSIDE_CONN *tail;
+} CLIENTSIDE_POOL;
+#endif /*HAVE_SYS_EPOLL_H*/
+
+/* Results of recent searches, so that a repeated request is answered
+ * without going to the workers. The key is the query's digital
+ * sequence or model parameters, the options that were set, and the
+ * database searched; the entry holds the serialized status, stats and
+ * hits exactly as forward_results() sent them. Entries are found by
+ * a hash of the key, compared in full, and the least recently used
+ * are evicted to keep the cache under <max_size> bytes.
+ */
+#define RCACHE_NBUCKETS 4096
+
+typedef struct rcache_entry_s {
+  uint64_t               hash;
+  char                  *key;
+  int                    keylen;
+  uint8_t               *data;     /* serialized HMMD_SEARCH_STATUS, HMMD_SEARCH_STATS and hits */
+  uint64_t               datalen;
+  struct rcache_entry_s *hnext;    /* next entry in the same bucket           */
+  struct rcache_entry_s *prev;     /* LRU list: the entry used more recently  */
+  struct rcache_entry_s *next;     /* LRU list: the entry used less recently  */
+} RCACHE_ENTRY;
+
+typedef struct {
+  pthread_mutex_t  mutex;
+  uint64_t         max_size;       /* bytes of entries to keep; 0 turns the cache off (--rcache) */
+  uint64_t         size;           /* bytes of entries kept                   */
+  RCACHE_ENTRY    *bucket[RCACHE_NBUCKETS];
+  RCACHE_ENTRY    *head;           /* most recently used                      */
+  RCACHE_ENTRY    *tail;           /* least recently used                     */
+} RESULT_CACHE;
+
+/* Latency histogram of one command type, for the metrics port. The
+ * bucket counts are per bucket; they are summed into Prometheus's
+ * cumulative "le" buckets when the metrics are written out.
+ */
+#define METRICS_NBUCKETS 10
+
+static const double metrics_le[METRICS_NBUCKETS] = { 0.1, 0.5, 1.0, 2.0, 5.0, 10.0, 30.0, 60.0, 300.0, 1800.0 };
+
+typedef struct {
+  uint64_t         count;          /* requests answered                       */
+  uint64_t         failed;         /* requests answered with an error         */
+  double           sum;            /* seconds, over the <count> requests      */
+  uint64_t         bucket[METRICS_NBUCKETS+1]; /* [METRICS_NBUCKETS] is +Inf  */
+} METRICS_HIST;
+
 typedef struct {
   int              sock_fd;
+  int              sock_fd_metrics;  /* metrics port (--mport), or -1           */
 
   pthread_mutex_t  work_mutex;
-  pthread_cond_t   start_cond;
-  pthread_cond_t   complete_cond;
+  pthread_cond_t   complete_cond;   /* signaled when a worker answers or fails, or a search ends */
 
+  /* A reload swaps in a new version of the databases while searches
+   * go on: each search keeps the version it started with, and the old
+   * one is freed when the last of those has finished.
+   */
   int              db_version;
   P7_SEQCACHE     *seq_db;
   P7_HMMCACHE     *hmm_db;
+  int              reloading;        /* TRUE while a reload is in progress         */
+  QUEUE_DATA      *reload_query;     /* the client's reload request                */
+  int              seqsnap;          /* save a snapshot of a reloaded seqdb (--seqsnap, --imgport) */
+  CMD_QUEUE       *cmdqueue;         /* its cost estimates follow the databases    */
 
   int              ready;
   int              failed;
@@ -84,28 +228,116 @@ typedef struct {
   int              idle_cnt;
   struct worker_s *idling;
 
-  RANGE_LIST       *range_list;  /* (optional) list of ranges searched within the seqdb */
+  uint32_t                next_id;    /* query id given to the next search         */
+  int                     nactive;    /* number of searches in flight              */
+  int                     max_active; /* most searches allowed in flight (--searches) */
+  struct active_search_s *active;     /* the searches in flight                    */
+
+  RESULT_CACHE            rcache;     /* results of recent searches                */
+
+  /* Counters for the metrics port (--mport), under <work_mutex> */
+  time_t           started;          /* when the master started                    */
+  METRICS_HIST     latency[2];       /* [0] HMMD_CMD_SEARCH, [1] HMMD_CMD_SCAN     */
+  uint64_t         ncached;          /* requests answered from <rcache>            */
+  uint64_t         ntargets;         /* targets searched, over all requests        */
+  uint64_t         n_past_msv;       /* # of them past each stage of the pipeline  */
+  uint64_t         n_past_bias;
+  uint64_t         n_past_vit;
+  uint64_t         n_past_fwd;
+  uint64_t         nreported;        /* hits reported                              */
+
+  /* An aggregator (--aggregator) stands in for the master to its own
+   * workers: it has no databases, and starts them on the master's INIT
+   */
+  int              upstream_fd;      /* connection to the master, or -1            */
+  pthread_mutex_t  upstream_mutex;   /* serializes the replies written to it       */
+  HMMD_COMMAND    *init_cmd;         /* the master's INIT for <db_version>, or NULL */
+
+  /* Workers fetch the databases' image (--imgport) over a tree: node 0
+   * is the master, and workers are nodes 1.. in the order they join,
+   * each with <img_fanout> children. Under <work_mutex>.
+   */
+  int              img_port;         /* image port, or 0 if workers read the databases */
+  int              img_fanout;       /* children of each node (--imgfanout)        */
+  int              img_nodes;        /* workers given a node so far                */
+  int              img_nalloc;       /* allocated size of <img_ip>                 */
+  char           (*img_ip)[64];      /* [1..img_nodes] each node's address         */
 
   int              completed;
 } WORKERSIDE_ARGS;
 
+/* One worker's share of a search. The part is queued on the worker's
+ * <outstanding> list when the search is sent out; the worker's reader
+ * thread fills in the results when the reply carrying the search's
+ * query id arrives, or fails the part if the worker goes away first.
+ */
+typedef struct search_part_s {
+  struct active_search_s *search;     /* search this is a share of                 */
+  struct worker_s        *worker;     /* worker it was sent to                     */
+  uint32_t                srch_inx;   /* first target of the share                 */
+  uint32_t                srch_cnt;   /* number of targets in the share            */
+  int                     completed;  /* TRUE once the worker's results are in     */
+  int                     total;      /* bytes received from the worker            */
+
+  uint64_t                span_id;    /* trace span of the share, 0 if not traced  */
+  double                  t_sent;     /* when the share was written to the worker  */
+  double                  t_done;     /* when the worker's answer was all read     */
+  HMMD_REPLY              reply;      /* the answer's header, with the worker's times */
+
+  HMMD_SEARCH_STATS       stats;
+  HMMD_SEARCH_STATUS      status;
+  char                   *err_buf;
+  uint8_t                *hit_buf;    /* the hits, as the worker serialized them    */
+  P7_HITREF              *refs;       /* ... indexed in the worker's rank order     */
+
+  struct search_part_s   *next;       /* next part outstanding on the same worker  */
+} SEARCH_PART;
+
+/* A search in flight. Each search runs in its own thread, which
+ * splits the database among the ready workers, waits for their
+ * replies and forwards the merged results to the client.
+ */
+typedef struct active_search_s {
+  QUEUE_DATA             *query;
+  uint32_t                query_id;   /* id the workers echo back in their replies */
+  uint64_t                trace_id;   /* trace of the search (--trace), or 0       */
+  WORKERSIDE_ARGS        *comm;
+  RANGE_LIST             *range_list; /* (optional) list of ranges searched within the seqdb */
+
+  int                     db_version; /* version of the databases searched         */
+  P7_SEQCACHE            *seq_db;
+  P7_HMMCACHE            *hmm_db;
+
+  SEARCH_PART            *parts;      /* [0..nparts-1] shares of the current try   */
+  int                     nparts;
+  int                     ndone;      /* parts answered or failed                  */
+
+  double                  deadline;   /* when to give up (--deadline), or 0        */
+  int                     cancelled;  /* CANCEL_CLIENT or CANCEL_DEADLINE once given up, else 0 */
+
+  struct active_search_s *next;       /* link in the parent's <active> list        */
+} ACTIVE_SEARCH;
+
 typedef struct worker_s {
   int                   sock_fd;
   char                  ip_addr[64];
   
-  int                   completed;
   int                   terminated;
-  HMMD_COMMAND         *cmd;
-
-  uint32_t              srch_inx;
-  uint32_t              srch_cnt;
-
-  HMMD_SEARCH_STATS     stats;
-  HMMD_SEARCH_STATUS    status;
-  char                 *err_buf;
-  P7_HIT               **hits;
-  uint32_t             allocated_hits;
-  int                   total;
+  int                   sending;      /* searches about to write to <sock_fd>; keeps a terminated worker alive */
+  pthread_mutex_t       send_mutex;   /* serializes the commands written to <sock_fd> */
+  SEARCH_PART          *outstanding;  /* parts sent to the worker and not answered yet */
+
+  int                   db_version;   /* newest database version the worker holds      */
+  int                   db_low;       /* oldest version it still holds                 */
+  int                   reloading;    /* TRUE until it answers the reload's HMMD_CMD_RELOAD */
+  int                   img_node;     /* node in the image tree (--imgport), 0 until given one */
+
+  uint64_t              nparts;       /* parts answered, for the metrics port          */
+  uint64_t              nseqs;        /* sequences searched in them                    */
+  uint64_t              nmodels;      /* models searched in them                       */
+  double                busy;         /* seconds the worker reported spending on them  */
+  uint64_t              mem_peak;     /* biggest pipeline memory peak of any of them   */
+  uint64_t              mem_rss;      /* the worker's peak RSS, as last reported       */
 
   WORKERSIDE_ARGS      *parent;
 
@@ -115,14 +347,21 @@ typedef struct worker_s {
 
 
 static void setup_clientside_comm(ESL_GETOPTS *opts, CLIENTSIDE_ARGS  *args);
+static int  clientside_request(CLIENTSIDE_ARGS *data, char *buffer);
 static void setup_workerside_comm(ESL_GETOPTS *opts, WORKERSIDE_ARGS  *args);
+static void setup_metrics_comm(ESL_GETOPTS *opts, WORKERSIDE_ARGS *args);
+static void metrics_request(WORKERSIDE_ARGS *args, QUEUE_DATA *query, double elapsed, HMMD_SEARCH_STATS *stats);
+static void metrics_cached(WORKERSIDE_ARGS *args);
 
 static void destroy_worker(WORKER_DATA *worker);
 
 static void init_results(SEARCH_RESULTS *results);
-static void clear_results(WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
-static void gather_results(QUEUE_DATA *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
-static void forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results);
+static void clear_results(SEARCH_RESULTS *results);
+static void clear_parts(ACTIVE_SEARCH *search);
+static void gather_results(ACTIVE_SEARCH *search, SEARCH_RESULTS *results);
+static void forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results, RESULT_CACHE *cache, char *key, int keylen);
+static void serialize_hitref(const P7_HITREF *ref, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
+static void set_cmdqueue_db(CMD_QUEUE *q, P7_SEQCACHE *seq_db, P7_HMMCACHE *hmm_db);
 
 static void
 print_client_msg(int fd, int status, char *format, va_list ap)
@@ -180,6 +419,520 @@ client_msg_longjmp(int fd, int status, jmp_buf *env, char *format, ...)
   longjmp(*env, 1);
 }
 
+/* init_cmdqueue()
+ * Set up the empty command queue <q>. The databases are only used to
+ * estimate what each request will cost.
+ */
+static void
+init_cmdqueue(CMD_QUEUE *q, ESL_GETOPTS *go, P7_SEQCACHE *seq_db, P7_HMMCACHE *hmm_db)
+{
+  int n;
+
+  memset(q, 0, sizeof(CMD_QUEUE));
+  if ((n = pthread_mutex_init(&q->mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+  if ((n = pthread_cond_init(&q->cond, NULL))   != 0) LOG_FATAL_MSG("cond init", n);
+
+  q->max_wait = esl_opt_GetInteger(go, "--maxwait");
+  q->quota    = esl_opt_GetInteger(go, "--cquota");
+  q->coalesce = ESL_MIN(esl_opt_GetInteger(go, "--coalesce"), HMMD_BATCH_MAX);
+  set_cmdqueue_db(q, seq_db, hmm_db);
+}
+
+/* set_cmdqueue_db()
+ * Base the cost estimates of queue <q> on databases <seq_db> and
+ * <hmm_db>, after a reload has replaced the ones it had.
+ */
+static void
+set_cmdqueue_db(CMD_QUEUE *q, P7_SEQCACHE *seq_db, P7_HMMCACHE *hmm_db)
+{
+  int i;
+  int n;
+
+  if ((n = pthread_mutex_lock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  q->seq_db  = seq_db;
+  q->hmm_res = 0.0;
+  if (hmm_db != NULL)
+    for (i = 0; i < hmm_db->n; i++) q->hmm_res += hmm_db->list[i]->M;
+  if ((n = pthread_mutex_unlock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* destroy_cmdqueue()
+ * Free the queue <q> and any requests still on it.
+ */
+static void
+destroy_cmdqueue(CMD_QUEUE *q)
+{
+  CMD_ENTRY  *e;
+  CLIENT_TAG *c;
+
+  while ((e = q->head) != NULL) {
+    q->head = e->next;
+    free_QueueData(e->query);
+    free(e);
+  }
+  while ((c = q->clients) != NULL) {
+    q->clients = c->next;
+    free(c);
+  }
+  pthread_mutex_destroy(&q->mutex);
+  pthread_cond_destroy(&q->cond);
+}
+
+/* cmd_cost()
+ * Estimate the work in request <query>: query length times the
+ * residues (or match states) it is compared to; a batch costs the
+ * sum of its queries. Commands other than searches cost nothing, and
+ * are served ahead of them.
+ */
+static double
+cmd_cost(CMD_QUEUE *q, QUEUE_DATA *query)
+{
+  double len;
+  int    i;
+
+  if (query->cmd_type != HMMD_CMD_SEARCH && query->cmd_type != HMMD_CMD_SCAN) return 0.0;
+
+  if (query->nbatch > 0) {
+    for (len = 0.0, i = 0; i < query->nbatch; i++) len += cmd_cost(q, query->batch[i]);
+    return len;
+  }
+
+  if      (query->hmm != NULL) len = query->hmm->M;
+  else if (query->seq != NULL) len = query->seq->n;
+  else                         len = 1.0;
+
+  if (query->cmd_type == HMMD_CMD_SCAN) return len * q->hmm_res;
+
+  /* a sub-database gets its share of the residues */
+  if (q->seq_db == NULL || q->seq_db->count == 0 || query->dbx < 0 || query->dbx >= q->seq_db->db_cnt) return 0.0;
+  return len * (double) q->seq_db->res_size * q->seq_db->db[query->dbx].count / q->seq_db->count;
+}
+
+/* push_cmd()
+ * Queue request <query>, tagged for its client. The queue takes over
+ * <query>. If the client already has its quota of requests queued,
+ * the request is refused and freed.
+ */
+static void
+push_cmd(CMD_QUEUE *q, QUEUE_DATA *query)
+{
+  CMD_ENTRY   *e = NULL;
+  CMD_ENTRY  **tail;
+  CLIENT_TAG  *c;
+  int          n;
+
+  query->t_queued = hmmpgmd_Now();
+
+  if ((n = pthread_mutex_lock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  for (c = q->clients; c != NULL; c = c->next)
+    if (strcmp(c->ip_addr, query->ip_addr) == 0) break;
+  if (c == NULL) {
+    if ((c = malloc(sizeof(CLIENT_TAG))) == NULL) LOG_FATAL_MSG("malloc", errno);
+    strcpy(c->ip_addr, query->ip_addr);
+    c->finish  = 0.0;
+    c->nqueued = 0;
+    c->next    = q->clients;
+    q->clients = c;
+  }
+
+  if (q->quota > 0 && c->nqueued >= q->quota) {
+    if ((n = pthread_mutex_unlock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+    client_msg(query->sock, eslFAIL, "Too many requests queued from %s (limit %d)\n", query->ip_addr, q->quota);
+    free_QueueData(query);
+    return;
+  }
+
+  if ((e = malloc(sizeof(CMD_ENTRY))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  e->query  = query;
+  e->client = c;
+  e->queued = time(NULL);
+  e->start  = ESL_MAX(q->vtime, c->finish);
+  e->finish = e->start + cmd_cost(q, query);
+  e->next   = NULL;
+
+  c->finish = e->finish;
+  c->nqueued++;
+
+  for (tail = &q->head; *tail != NULL; tail = &(*tail)->next) ;
+  *tail = e;
+
+  if ((n = pthread_cond_signal(&q->cond)) != 0) LOG_FATAL_MSG("cond signal", n);
+  if ((n = pthread_mutex_unlock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* coalescable()
+ * TRUE if search request <query> can be run in one pass over the
+ * sequence cache with <first>: both single searches of the same
+ * database, with the same kind of query and the same options. A
+ * search within --seqdb_ranges is run on its own.
+ */
+static int
+coalescable(QUEUE_DATA *first, QUEUE_DATA *query)
+{
+  if (query->cmd_type != HMMD_CMD_SEARCH || query->nbatch > 0 || query->cmd == NULL) return FALSE;
+  if (esl_opt_IsUsed(query->opts, "--seqdb_ranges"))                                 return FALSE;
+  if (first == NULL)                                                                 return TRUE;
+
+  return (query->query_type            == first->query_type &&
+          query->dbx                   == first->dbx        &&
+          query->cmd->srch.opts_length == first->cmd->srch.opts_length &&
+          memcmp(query->cmd->srch.data, first->cmd->srch.data, first->cmd->srch.opts_length) == 0);
+}
+
+/* coalesce_cmds()
+ * Take the searches queued in <q> that can run with search <first>,
+ * which was just taken off it, up to <q->coalesce> in all. Returns
+ * <first> if there are none; else a batch of the searches, <first>
+ * and the others in the order they arrived, each answered on its own
+ * socket. A search is left queued behind an earlier request of its
+ * connection, which must be answered first. Called with the queue
+ * mutex held.
+ */
+static QUEUE_DATA *
+coalesce_cmds(CMD_QUEUE *q, QUEUE_DATA *first)
+{
+  QUEUE_DATA  *group = NULL;
+  QUEUE_DATA  *members[HMMD_BATCH_MAX];
+  CMD_ENTRY   *e;
+  CMD_ENTRY   *x;
+  CMD_ENTRY  **prev;
+  int          n = 1;
+
+  if (q->coalesce < 2 || !coalescable(NULL, first)) return first;
+
+  members[0] = first;
+  prev = &q->head;
+  while ((e = *prev) != NULL && n < q->coalesce) {
+    for (x = q->head; x != e; x = x->next)
+      if (x->query->sock == e->query->sock) break;
+    if (x != e || !coalescable(first, e->query)) { prev = &e->next; continue; }
+
+    members[n++] = e->query;
+    *prev = e->next;
+    q->vtime = ESL_MAX(q->vtime, e->start);
+    e->client->nqueued--;
+    free(e);
+  }
+  if (n == 1) return first;
+
+  if ((group = malloc(sizeof(QUEUE_DATA))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(group, 0, sizeof(QUEUE_DATA));
+  if ((group->batch = malloc(sizeof(QUEUE_DATA *) * n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memcpy(group->batch, members, sizeof(QUEUE_DATA *) * n);
+  group->nbatch     = n;
+  group->cmd_type   = HMMD_CMD_SEARCH;
+  group->query_type = first->query_type;
+  group->dbx        = first->dbx;
+  group->sock       = first->sock;
+  group->t_queued   = first->t_queued;
+  strcpy(group->ip_addr, first->ip_addr);
+  if (process_searchopts(first->sock, first->cmd->srch.data, &group->opts) != eslOK) LOG_FATAL_MSG("esl_getopts_Create", eslEMEM);
+  return group;
+}
+
+/* pop_cmd()
+ * Wait for a request, and take the one to serve next off queue <q>:
+ * the oldest of any that have waited <max_wait> seconds, otherwise
+ * the one with the smallest finish tag; with the searches that can
+ * run with it, as one batch (see coalesce_cmds()).
+ */
+static QUEUE_DATA *
+pop_cmd(CMD_QUEUE *q)
+{
+  QUEUE_DATA  *query;
+  CMD_ENTRY   *e;
+  CMD_ENTRY  **prev;
+  CMD_ENTRY  **best;
+  CLIENT_TAG  *c;
+  CLIENT_TAG **cprev;
+  time_t       now;
+  int          n;
+
+  if ((n = pthread_mutex_lock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  while (q->head == NULL) {
+    if ((n = pthread_cond_wait(&q->cond, &q->mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+
+  /* the queue is in arrival order, so the first overdue request is the oldest */
+  now  = time(NULL);
+  best = NULL;
+  for (prev = &q->head; *prev != NULL; prev = &(*prev)->next) {
+    e = *prev;
+    if (q->max_wait > 0 && now - e->queued >= q->max_wait) { best = prev; break; }
+    if (best == NULL || e->finish < (*best)->finish) best = prev;
+  }
+
+  e     = *best;
+  *best = e->next;
+  query = e->query;
+
+  q->vtime = ESL_MAX(q->vtime, e->start);
+  e->client->nqueued--;
+  free(e);
+
+  query = coalesce_cmds(q, query);
+
+  /* forget the clients that are idle and no longer ahead of virtual time */
+  cprev = &q->clients;
+  while ((c = *cprev) != NULL) {
+    if (c->nqueued == 0 && c->finish <= q->vtime) { *cprev = c->next; free(c); }
+    else                                            cprev  = &c->next;
+  }
+
+  if ((n = pthread_mutex_unlock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  return query;
+}
+
+/* discard_cmds()
+ * Remove all the requests in queue <q> that came from client socket
+ * <fd>, because we're closing that client down.
+ */
+static void
+discard_cmds(CMD_QUEUE *q, int fd)
+{
+  CMD_ENTRY  *e;
+  CMD_ENTRY **prev;
+  int         n;
+
+  if ((n = pthread_mutex_lock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  prev = &q->head;
+  while ((e = *prev) != NULL) {
+    if (e->query->sock == fd) {
+      *prev = e->next;
+      e->client->nqueued--;
+      free_QueueData(e->query);
+      free(e);
+    } else {
+      prev = &e->next;
+    }
+  }
+
+  if ((n = pthread_mutex_unlock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+static void
+init_rcache(RESULT_CACHE *cache, uint64_t max_size)
+{
+  int n;
+
+  memset(cache, 0, sizeof(RESULT_CACHE));
+  if ((n = pthread_mutex_init(&cache->mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+  cache->max_size = max_size;
+}
+
+static void
+destroy_rcache(RESULT_CACHE *cache)
+{
+  RCACHE_ENTRY *e;
+
+  while ((e = cache->head) != NULL) {
+    cache->head = e->next;
+    free(e->key);
+    free(e->data);
+    free(e);
+  }
+  pthread_mutex_destroy(&cache->mutex);
+}
+
+/* rcache_hash()
+ * FNV-1a hash of the <n> bytes of <key>.
+ */
+static uint64_t
+rcache_hash(const char *key, int n)
+{
+  uint64_t h = 14695981039346656037ULL;
+  int      i;
+
+  for (i = 0; i < n; i++) {
+    h ^= (unsigned char) key[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void
+rcache_append(char **key, int *len, int *nalloc, const void *p, int n)
+{
+  while (*len + n > *nalloc) {
+    *nalloc = (*nalloc == 0) ? 1024 : *nalloc * 2;
+    if ((*key = realloc(*key, *nalloc)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  }
+  memcpy(*key + *len, p, n);
+  *len += n;
+}
+
+/* rcache_key()
+ * Build the cache key for <search>'s query: what is searched (command,
+ * database and its version, so a reload retires the old answers), every option the client set, in the order of the options
+ * table so that their order on the command line does not matter, and
+ * the query itself. Returns the key in <*ret_key>, its length in
+ * <*ret_len>; the caller frees it.
+ */
+static void
+rcache_key(ACTIVE_SEARCH *search, char **ret_key, int *ret_len)
+{
+  QUEUE_DATA  *query  = search->query;
+  ESL_GETOPTS *go     = query->opts;
+  char        *key    = NULL;
+  int          len    = 0;
+  int          nalloc = 0;
+  P7_HMM      *hmm    = query->hmm;
+  int          i;
+
+  rcache_append(&key, &len, &nalloc, &query->cmd_type, sizeof(query->cmd_type));
+  rcache_append(&key, &len, &nalloc, &query->dbx,      sizeof(query->dbx));
+  rcache_append(&key, &len, &nalloc, &search->db_version, sizeof(search->db_version));
+  if (query->cmd_type == HMMD_CMD_SEARCH) rcache_append(&key, &len, &nalloc, search->seq_db->id,   strlen(search->seq_db->id)   + 1);
+  else                                    rcache_append(&key, &len, &nalloc, search->hmm_db->name, strlen(search->hmm_db->name) + 1);
+
+  for (i = 0; i < go->nopts; i++) {
+    if (go->setby[i] == eslARG_SETBY_DEFAULT) continue;
+    rcache_append(&key, &len, &nalloc, go->opt[i].name, strlen(go->opt[i].name) + 1);
+    if (go->val[i] != NULL) rcache_append(&key, &len, &nalloc, go->val[i], strlen(go->val[i]) + 1);
+    else                    rcache_append(&key, &len, &nalloc, "", 1);
+  }
+
+  if (query->seq != NULL) {
+    rcache_append(&key, &len, &nalloc, &query->seq->n, sizeof(query->seq->n));
+    rcache_append(&key, &len, &nalloc, query->seq->dsq, query->seq->n + 2);
+  } else {
+    /* everything about the model that the pipeline scores with */
+    rcache_append(&key, &len, &nalloc, &hmm->M,          sizeof(hmm->M));
+    rcache_append(&key, &len, &nalloc, &hmm->flags,      sizeof(hmm->flags));
+    rcache_append(&key, &len, &nalloc, &hmm->max_length, sizeof(hmm->max_length));
+    rcache_append(&key, &len, &nalloc, hmm->evparam,     sizeof(float) * p7_NEVPARAM);
+    rcache_append(&key, &len, &nalloc, hmm->cutoff,      sizeof(float) * p7_NCUTOFFS);
+    if (hmm->flags & p7H_COMPO)
+      rcache_append(&key, &len, &nalloc, hmm->compo,     sizeof(float) * p7_MAXABET);
+    rcache_append(&key, &len, &nalloc, *hmm->t,          sizeof(float) * p7H_NTRANSITIONS * (hmm->M+1));
+    rcache_append(&key, &len, &nalloc, *hmm->mat,        sizeof(float) * hmm->abc->K * (hmm->M+1));
+    rcache_append(&key, &len, &nalloc, *hmm->ins,        sizeof(float) * hmm->abc->K * (hmm->M+1));
+  }
+
+  *ret_key = key;
+  *ret_len = len;
+}
+
+/* rcache_unlink()
+ * Take entry <e> off the LRU list of <cache>.
+ */
+static void
+rcache_unlink(RESULT_CACHE *cache, RCACHE_ENTRY *e)
+{
+  if (e->prev != NULL) e->prev->next = e->next; else cache->head = e->next;
+  if (e->next != NULL) e->next->prev = e->prev; else cache->tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void
+rcache_push(RESULT_CACHE *cache, RCACHE_ENTRY *e)
+{
+  e->prev = NULL;
+  e->next = cache->head;
+  if (cache->head != NULL) cache->head->prev = e; else cache->tail = e;
+  cache->head = e;
+}
+
+static RCACHE_ENTRY *
+rcache_find(RESULT_CACHE *cache, const char *key, int keylen, uint64_t hash)
+{
+  RCACHE_ENTRY *e;
+
+  for (e = cache->bucket[hash % RCACHE_NBUCKETS]; e != NULL; e = e->hnext)
+    if (e->hash == hash && e->keylen == keylen && memcmp(e->key, key, keylen) == 0) return e;
+  return NULL;
+}
+
+/* rcache_lookup()
+ * Look for the results for <key> in <cache>. If they are there,
+ * return TRUE and a copy of them in <*ret_data>, <*ret_len>, which the
+ * caller frees; otherwise return FALSE.
+ */
+static int
+rcache_lookup(RESULT_CACHE *cache, const char *key, int keylen, uint8_t **ret_data, uint64_t *ret_len)
+{
+  RCACHE_ENTRY *e;
+  uint64_t      hash = rcache_hash(key, keylen);
+  int           n;
+
+  *ret_data = NULL;
+  *ret_len  = 0;
+
+  if ((n = pthread_mutex_lock (&cache->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if ((e = rcache_find(cache, key, keylen, hash)) != NULL) {
+    rcache_unlink(cache, e);
+    rcache_push(cache, e);
+    if ((*ret_data = malloc(e->datalen)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(*ret_data, e->data, e->datalen);
+    *ret_len = e->datalen;
+  }
+  if ((n = pthread_mutex_unlock (&cache->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  return (e != NULL);
+}
+
+/* rcache_fits()
+ * Return TRUE if results of <datalen> bytes for a key of <keylen>
+ * bytes are worth keeping in <cache>: not more than a quarter of it.
+ */
+static int
+rcache_fits(RESULT_CACHE *cache, int keylen, uint64_t datalen)
+{
+  return (sizeof(RCACHE_ENTRY) + keylen + datalen <= cache->max_size / 4);
+}
+
+/* rcache_insert()
+ * Keep the <datalen> bytes of serialized results <data> for <key>,
+ * evicting the least recently used entries to make room. The cache
+ * takes over <data>; the caller has checked rcache_fits().
+ */
+static void
+rcache_insert(RESULT_CACHE *cache, const char *key, int keylen, uint8_t *data, uint64_t datalen)
+{
+  RCACHE_ENTRY  *e;
+  RCACHE_ENTRY **pp;
+  uint64_t       hash = rcache_hash(key, keylen);
+  uint64_t       size = sizeof(RCACHE_ENTRY) + keylen + datalen;
+  int            n;
+
+  if ((n = pthread_mutex_lock (&cache->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  /* another search may have answered the same request meanwhile */
+  if (rcache_find(cache, key, keylen, hash) == NULL) {
+    while (cache->size + size > cache->max_size) {
+      e = cache->tail;
+      rcache_unlink(cache, e);
+      for (pp = &cache->bucket[e->hash % RCACHE_NBUCKETS]; *pp != e; pp = &(*pp)->hnext) ;
+      *pp = e->hnext;
+      cache->size -= sizeof(RCACHE_ENTRY) + e->keylen + e->datalen;
+      free(e->key);
+      free(e->data);
+      free(e);
+    }
+
+    if ((e       = malloc(sizeof(RCACHE_ENTRY))) == NULL) LOG_FATAL_MSG("malloc", errno);
+    if ((e->key  = malloc(keylen))               == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(e->key, key, keylen);
+    e->data    = data;
+    e->hash    = hash;
+    e->keylen  = keylen;
+    e->datalen = datalen;
+
+    e->hnext = cache->bucket[hash % RCACHE_NBUCKETS];
+    cache->bucket[hash % RCACHE_NBUCKETS] = e;
+    rcache_push(cache, e);
+    cache->size += size;
+    data = NULL;
+  }
+
+  if ((n = pthread_mutex_unlock (&cache->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (data != NULL) free(data);
+}
+
 static int
 validate_workers(WORKERSIDE_ARGS *args)
 {
@@ -262,11 +1015,13 @@ update_workers(WORKERSIDE_ARGS *args)
     args->ready++;
   }
 
-  /* remove any workers who have failed */
+  /* remove any workers who have failed, once no search is still
+   * writing to them
+   */
   worker = args->head;
   while (args->failed > 0 && worker != NULL) {
     WORKER_DATA *next =  worker->next;
-    if (worker->terminated) {
+    if (worker->terminated && worker->sending == 0) {
       --args->failed;
       --args->ready;
       if (args->head == worker && args->tail == worker) {
@@ -290,374 +1045,2074 @@ update_workers(WORKERSIDE_ARGS *args)
   assert(validate_workers(args));
 }
 
-static void
-process_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+/* init_command()
+ * Build an HMMD_CMD_INIT or HMMD_CMD_RELOAD command naming databases
+ * <seq_db> and <hmm_db> (either may be NULL) as version <version>.
+ * Returns the command, which the caller frees, or NULL if it can't be
+ * allocated.
+ */
+static HMMD_COMMAND *
+init_command(uint32_t command, int version, P7_SEQCACHE *seq_db, P7_HMMCACHE *hmm_db)
 {
-  ESL_STOPWATCH  *w          = NULL;      /* timer used for profiling statistics             */
-  WORKER_DATA    *worker     = NULL;
-  SEARCH_RESULTS  results;
-  int n;
-  int cnt;
-  int inx;
-  int ready_workers;    /* counter variable used to track the number of workers currently available to receive work; short for "remaining", I imagine */
-  int tries;
-  int i;
+  HMMD_COMMAND *cmd = NULL;
+  char         *p;
+  int           n;
 
+  n = sizeof(HMMD_COMMAND);
+  if (seq_db != NULL) n += strlen(seq_db->name) + 1;
+  if (hmm_db != NULL) n += strlen(hmm_db->name) + 1;
 
-  memset(&results, 0, sizeof(SEARCH_RESULTS)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
+  if ((cmd = malloc(n)) == NULL) return NULL;
+  memset(cmd, 0, n);
 
-  /* figure out the size of the database we are searching */
-  if (query->cmd_type == HMMD_CMD_SEARCH) {
-    if((args->seq_db == NULL)||(args->seq_db->db == NULL)|| (query->dbx >= args->seq_db->db_cnt) || (query->dbx < 0)){
-      // Client is attempting to search a database that does not exist, complain and abort search
-      client_msg(query->sock, eslFAIL, "Specified sequence database has not been loaded into the daemon. \n");
-      return;
-    }
-    else{ 
-      cnt = args->seq_db->db[query->dbx].count;
-    }
-  } else {
-    if(args->hmm_db == NULL){
-      // Client is attempting to search a database that does not exist, complain and abort search
-      client_msg(query->sock, eslFAIL, "No HMM database has been loaded into the daemon. \n");
-      return;
-    }
-    else{ 
-     cnt = args->hmm_db->n;
-    }
-  }
-  
-  // start timer after we make sure the relevant database exists to make cleanup easier on error
-  w = esl_stopwatch_Create();
-  esl_stopwatch_Start(w);
-  init_results(&results);
+  cmd->hdr.length      = n - sizeof(HMMD_HEADER);
+  cmd->hdr.command     = command;
+  cmd->init.db_version = version;
 
-  //if range(s) are given, count how many of the seqdb's sequences are within supplied range(s)
-  if (args->range_list) { // can only happen in HMMD_CMD_SEARCH case
-    int range_cnt = 0; // this will now count how many of the seqs in the db are within the range
-    for (i=0; i<cnt; i++) {
-      if ( hmmpgmd_IsWithinRanges(args->seq_db->list[i].idx, args->range_list ) )
-        range_cnt++;
-    }
-    cnt = range_cnt;
-  }
+  p = cmd->init.data;
 
+  if (seq_db != NULL) {
+    cmd->init.db_cnt      = seq_db->db_cnt;
+    cmd->init.seq_cnt     = seq_db->count;
+    cmd->init.seqdb_off   = p - cmd->init.data;
 
-  inx = 0;
-  tries = 0;
-  do {
-    /* process any changes to the available workers */
-    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+    cmd->init.lsort       = seq_db->lsort;
 
-    /* build a list of the currently available workers */
-    update_workers(args);
+    strncpy(cmd->init.sid, seq_db->id, sizeof(cmd->init.sid));
+    cmd->init.sid[sizeof(cmd->init.sid)-1] = 0;
 
-    /* if there are no workers, report an error */
-    if (args->ready > 0) {
-      ready_workers = args->ready;
+    strcpy(p, seq_db->name);
+    p += strlen(seq_db->name) + 1;
+  }
 
-      /* update the workers search information */
-      worker = args->head;
+  if (hmm_db != NULL) {
+    cmd->init.hmm_cnt     = 1;
+    cmd->init.model_cnt   = hmm_db->n;
+    cmd->init.hmmdb_off   = p - cmd->init.data;
 
-      while (worker != NULL) {
-        worker->cmd        = query->cmd;
-        worker->completed  = 0;
-        worker->total      = 0;
+    //strncpy(cmd->init.hid, hmm_db->id, sizeof(cmd->init.hid));
+    //cmd->init.hid[sizeof(cmd->init.hid)-1] = 0;
 
-        /* assign each worker a portion of the database */
-        worker->srch_inx = inx;
-        if (args->range_list) {
-          // if ranges are given, need to split the db list based on which elements in the list are within the given range(s)
-          int goal = cnt / ready_workers; //how many within-range sequences do I want to ask this worker to handle
-          int curr = 0;                   //how many within-range sequences have I seen since the start of this full-db range
-          worker->srch_cnt = 0;
-          while (curr < goal) {
-            if ( hmmpgmd_IsWithinRanges (args->seq_db->list[inx].idx, args->range_list ) )
-                curr++;
-            worker->srch_cnt++;
-            inx++;
-          }
-          cnt -= curr;
-        } else {
-          // default - split evenly among workers
-          worker->srch_cnt = cnt / ready_workers;
-          inx += worker->srch_cnt;
-          cnt -= worker->srch_cnt;
-        }
+    strcpy(p, hmm_db->name);
+    p += strlen(hmm_db->name) + 1;
+  }
 
-        --ready_workers;
-        worker            = worker->next;
-      }
+  return cmd;
+}
 
-      args->completed = 0;
+/* image_source()
+ * Give <worker> a node in the tree the databases' image is fetched
+ * over, if it hasn't one yet, and name the node's parent in its
+ * HMMD_CMD_INIT <cmd>: the master for the first <img_fanout> workers,
+ * then the workers that joined before. The caller holds
+ * <args->work_mutex>.
+ */
+static void
+image_source(WORKERSIDE_ARGS *args, WORKER_DATA *worker, HMMD_COMMAND *cmd)
+{
+  int up;
 
-      /* notify all the worker threads of the new query */
-      if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if (worker->img_node == 0) {
+    if (args->img_nodes + 1 >= args->img_nalloc) {
+      args->img_nalloc = ESL_MAX(64, args->img_nalloc * 2);
+      if ((args->img_ip = realloc(args->img_ip, sizeof(*args->img_ip) * args->img_nalloc)) == NULL) LOG_FATAL_MSG("realloc", errno);
     }
+    worker->img_node = ++args->img_nodes;
+    strcpy(args->img_ip[worker->img_node], worker->ip_addr);
+  }
 
-    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
-
-    if (args->ready > 0) {
-      /* Wait for all the workers to complete */
-      if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  up = (worker->img_node - 1) / args->img_fanout;
+  cmd->init.img_port = args->img_port;
+  if (up > 0) strcpy(cmd->init.img_ip, args->img_ip[up]);
+}
 
-      while (args->completed < args->ready) {
-        if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+/* image_set()
+ * Serve the image of databases <seq_db> and <hmm_db> (either may be
+ * NULL) from the files they were loaded from: the sequence cache's
+ * snapshot, and the profile database and its pressed files.
+ */
+static void
+image_set(P7_SEQCACHE *seq_db, P7_HMMCACHE *hmm_db)
+{
+  char *path[HMMD_IMG_NFILES];
+  int   f;
+
+  for (f = 0; f < HMMD_IMG_NFILES; f++) path[f] = NULL;
+  if (seq_db != NULL && hmmpgmd_ImagePath(seq_db->name, HMMD_IMG_SEQSNAP, NULL, &path[HMMD_IMG_SEQSNAP]) != eslOK) LOG_FATAL_MSG("malloc", errno);
+  for (f = HMMD_IMG_HMM; hmm_db != NULL && f < HMMD_IMG_NFILES; f++)
+    if (hmmpgmd_ImagePath(hmm_db->name, f, NULL, &path[f]) != eslOK) LOG_FATAL_MSG("malloc", errno);
+
+  hmmpgmd_ImageSet(seq_db ? seq_db->id : "", seq_db ? seq_db->count : 0, hmm_db ? hmm_db->n : 0, path);
+  for (f = 0; f < HMMD_IMG_NFILES; f++) free(path[f]);
+}
+
+/* send_command()
+ * Write <cmd> to <worker>, between the searches other threads are
+ * writing to it. A write error is only logged; the worker's reader
+ * thread sees the broken connection.
+ */
+static void
+send_command(WORKER_DATA *worker, HMMD_COMMAND *cmd)
+{
+  int n;
+  int rc;
+
+  if ((rc = pthread_mutex_lock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex lock", rc);
+  n = MSG_SIZE(cmd);
+  if (worker->sock_fd >= 0 && writen(worker->sock_fd, cmd, n) != n) {
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+  }
+  if ((rc = pthread_mutex_unlock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", rc);
+}
+
+/* send_release()
+ * Tell <worker> that no search will name a database version older
+ * than <version>.
+ */
+static void
+send_release(WORKER_DATA *worker, int version)
+{
+  HMMD_COMMAND cmd;
+
+  memset(&cmd, 0, sizeof(HMMD_COMMAND)); /* silence valgrind. if we ever serialize structs properly, remove */
+  cmd.hdr.length      = sizeof(HMMD_INIT_CMD);
+  cmd.hdr.command     = HMMD_CMD_RELEASE;
+  cmd.init.db_version = version;
+
+  send_command(worker, &cmd);
+  if (worker->db_version >= version) worker->db_low = version;
+}
+
+/* worker_serves()
+ * Returns TRUE if <worker> is up and holds the version of the
+ * databases that <search> was started on.
+ */
+static int
+worker_serves(WORKER_DATA *worker, ACTIVE_SEARCH *search)
+{
+  return (!worker->terminated && search->db_version >= worker->db_low && search->db_version <= worker->db_version);
+}
+
+/* send_part()
+ * Write a worker its share of a search, search command <srch> for the
+ * part's range of targets. A write error is only logged: the worker's
+ * reader thread sees the broken connection and fails the part.
+ */
+static void
+send_part(SEARCH_PART *part, HMMD_COMMAND *srch)
+{
+  WORKER_DATA    *worker = part->worker;
+  HMMD_COMMAND    cmd;
+  char           *ptr;
+  int             n;
+  int             rc;
+
+  memset(&cmd, 0, sizeof(HMMD_COMMAND)); /* silence valgrind. if we ever serialize structs properly, remove */
+
+  if ((rc = pthread_mutex_lock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex lock", rc);
+
+  if (worker->sock_fd >= 0) {
+    /* write search message in two parts */
+    n = sizeof(HMMD_HEADER) + sizeof(HMMD_SEARCH_CMD);
+    memcpy(&cmd, srch, n);
+    cmd.srch.inx      = part->srch_inx;
+    cmd.srch.cnt      = part->srch_cnt;
+    cmd.srch.query_id = part->search->query_id;
+    cmd.srch.db_version = part->search->db_version;
+    cmd.srch.trace_id = part->search->trace_id;
+    cmd.srch.span_id  = part->span_id;
+    if (writen(worker->sock_fd, &cmd, n) != n) {
+      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+    } else {
+      /* write remaining data, i.e. sequence, options etc. */
+      ptr = (char *)srch;
+      ptr += n;
+      n = MSG_SIZE(srch) - n;
+      if (writen(worker->sock_fd, ptr, n) != n) {
+        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      }
+    }
+  }
+
+  if ((rc = pthread_mutex_unlock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", rc);
+  part->t_sent = hmmpgmd_Now();
+  p7_PROBE3(hmmpgmd__dispatch, part->search->query_id, part->srch_inx, part->srch_cnt);
+}
+
+/* search_abandoned()
+ * Returns CANCEL_DEADLINE if <search>'s deadline has passed,
+ * CANCEL_CLIENT if its client has hung up, and 0 if neither. The
+ * client may have sent its next request already, so only a hangup
+ * with nothing left to read counts.
+ */
+static int
+search_abandoned(ACTIVE_SEARCH *search)
+{
+  struct pollfd pfd;
+  char          c;
+
+  if (search->deadline > 0. && hmmpgmd_Now() >= search->deadline) return CANCEL_DEADLINE;
+
+  pfd.fd      = search->query->sock;
+  pfd.events  = POLLIN;
+  pfd.revents = 0;
+  if (poll(&pfd, 1, 0) <= 0)                             return 0;
+  if (pfd.revents & (POLLERR | POLLNVAL))                return CANCEL_CLIENT;
+  if (recv(pfd.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0) return CANCEL_CLIENT;
+  return 0;
+}
+
+/* cancel_search()
+ * Give up on <search>: tell the workers of its unanswered parts to
+ * stop. They answer with an error soon after, which completes the
+ * parts as usual. Called with the work mutex held.
+ */
+static void
+cancel_search(ACTIVE_SEARCH *search, int why)
+{
+  HMMD_COMMAND  cmd;
+  SEARCH_PART  *part;
+  int           i;
+
+  search->cancelled = why;
+
+  memset(&cmd, 0, sizeof(HMMD_COMMAND)); /* silence valgrind. if we ever serialize structs properly, remove */
+  cmd.hdr.length    = sizeof(HMMD_SEARCH_CMD);
+  cmd.hdr.command   = HMMD_CMD_CANCEL;
+  cmd.srch.query_id = search->query_id;
+
+  for (i = 0; i < search->nparts; i++) {
+    part = &search->parts[i];
+    if (!part->completed && !part->worker->terminated) send_command(part->worker, &cmd);
+  }
+}
+
+/* wait_parts()
+ * Wait, with the work mutex held, for a worker to answer or fail, but
+ * no longer than CANCEL_POLL seconds. Then see which of the shares of
+ * request <search> have been abandoned: the searches
+ * <subs>[0..nsub-1], which are <search> itself, or the queries of a
+ * batch chunk. The workers run a chunk as one search, so it is only
+ * cancelled once all of them have been; until then, the answers of
+ * those abandoned are dropped.
+ */
+static void
+wait_parts(ACTIVE_SEARCH *search, ACTIVE_SEARCH *subs, int nsub)
+{
+  WORKERSIDE_ARGS *args = search->comm;
+  struct timespec  until;
+  int              why   = 0;
+  int              live  = 0;      /* shares still wanted                   */
+  int              fresh = 0;      /* shares found abandoned on this call   */
+  int              i;
+  int              n;
+
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += CANCEL_POLL;
+  if ((n = pthread_cond_timedwait (&args->complete_cond, &args->work_mutex, &until)) != 0 && n != ETIMEDOUT) LOG_FATAL_MSG("cond wait", n);
+
+  for (i = 0; i < nsub; i++) {
+    if (subs[i].query_id == 0 || subs[i].cancelled) continue;
+    if ((subs[i].cancelled = search_abandoned(&subs[i])) == 0) live++;
+    else { fresh++; why = subs[i].cancelled; }
+  }
+  if (live > 0 || fresh == 0) return;   /* still wanted, or cancelled already */
+
+  if (search->cancelled == 0) search->cancelled = why;
+  for (i = 0; i < nsub; i++)
+    if (subs[i].query_id != 0) cancel_search(&subs[i], subs[i].cancelled);
+}
+
+/* cancelled_msg()
+ * Answer <query> of request <search>, which was given up. A client
+ * that hung up isn't there to tell.
+ */
+static void
+cancelled_msg(ACTIVE_SEARCH *search, QUEUE_DATA *query)
+{
+  if (search->cancelled == CANCEL_DEADLINE)
+    client_msg(query->sock, eslFAIL, "Search cancelled: deadline of %g seconds passed\n", esl_opt_GetReal(query->opts, "--deadline"));
+  else
+    p7_syslog(LOG_ERR,"[%s:%d] - %s (%d) hung up, query %u cancelled\n", __FILE__, __LINE__, query->ip_addr, query->sock, query->query_id);
+}
+
+/* trace_parts()
+ * Write the trace spans of the shares of <search>'s try <tries>: the
+ * wait for each worker, and the search on it, on the worker's clock.
+ */
+static void
+trace_parts(ACTIVE_SEARCH *search, int tries)
+{
+  SEARCH_PART *part;
+  uint64_t     root = HMMD_SPAN(search->query_id, HMMD_SPAN_QUERY, 0);
+  int          i;
+
+  for (i = 0; i < search->nparts; i++) {
+    part = &search->parts[i];
+    hmmpgmd_TraceSpan(search->trace_id, part->span_id, root, "hmmpgmd.worker", part->t_sent, part->t_done, search->query_id, part->worker->ip_addr);
+    if (part->reply.t_done > 0.)
+      hmmpgmd_TraceSpan(search->trace_id, HMMD_SPAN(search->query_id, HMMD_SPAN_SEARCH, tries * 256 + i), part->span_id, "hmmpgmd.worker.search",
+                        part->reply.t_start, part->reply.t_done, search->query_id, part->worker->ip_addr);
+  }
+}
+
+static void process_batch(ACTIVE_SEARCH *search);
+
+static void
+process_search(ACTIVE_SEARCH *search)
+{
+  WORKERSIDE_ARGS *args      = search->comm;
+  QUEUE_DATA      *query     = search->query;
+  ESL_STOPWATCH  *w          = NULL;      /* timer used for profiling statistics             */
+  WORKER_DATA    *worker     = NULL;
+  SEARCH_PART    *part       = NULL;
+  SEARCH_RESULTS  results;
+  char           *key        = NULL;      /* result cache key, or NULL if the cache is off   */
+  int             keylen     = 0;
+  uint8_t        *cached     = NULL;
+  uint64_t        cached_len = 0;
+  int n;
+  int cnt;
+  int inx;
+  int ready_workers;    /* counter variable used to track the number of workers currently available to receive work; short for "remaining", I imagine */
+  int tries;
+  int i;
+  double   t_start = hmmpgmd_Now();   /* for the trace spans */
+  double   t0, t1;
+  uint64_t root;
+
+  /* the deadline counts from when the request arrived; a batch's queries keep the batch's */
+  if (search->deadline == 0. && esl_opt_IsOn(query->opts, "--deadline"))
+    search->deadline = (query->t_queued > 0. ? query->t_queued : t_start) + esl_opt_GetReal(query->opts, "--deadline");
+
+  if (query->nbatch > 0) {
+    process_batch(search);
+    return;
+  }
+
+  /* the trace is named for the master's start and the query id, so it's unique to the request */
+  search->trace_id = hmmpgmd_Tracing() ? ((((uint64_t) args->started) << 32) | search->query_id) : 0;
+  root = HMMD_SPAN(search->query_id, HMMD_SPAN_QUERY, 0);
+  if (query->t_queued > 0.)
+    hmmpgmd_TraceSpan(search->trace_id, HMMD_SPAN(search->query_id, HMMD_SPAN_QUEUE, 0), root, "hmmpgmd.queue", query->t_queued, t_start, search->query_id, NULL);
+  if (query->t_queued == 0.) query->t_queued = t_start;
+
+  memset(&results, 0, sizeof(SEARCH_RESULTS)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
+
+  /* figure out the size of the database we are searching */
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    if((search->seq_db == NULL)||(search->seq_db->db == NULL)|| (query->dbx >= search->seq_db->db_cnt) || (query->dbx < 0)){
+      // Client is attempting to search a database that does not exist, complain and abort search
+      client_msg(query->sock, eslFAIL, "Specified sequence database has not been loaded into the daemon. \n");
+      return;
+    }
+    else{ 
+      cnt = search->seq_db->db[query->dbx].count;
+    }
+  } else {
+    if(search->hmm_db == NULL){
+      // Client is attempting to search a database that does not exist, complain and abort search
+      client_msg(query->sock, eslFAIL, "No HMM database has been loaded into the daemon. \n");
+      return;
+    }
+    else{ 
+     cnt = search->hmm_db->n;
+    }
+  }
+
+  /* a request we answered recently doesn't need the workers */
+  if (args->rcache.max_size > 0) {
+    rcache_key(search, &key, &keylen);
+    if (rcache_lookup(&args->rcache, key, keylen, &cached, &cached_len)) {
+      if (writen(query->sock, cached, cached_len) != cached_len)
+        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+      else
+        printf("Results for %s (%d) sent %" PRIu64 " bytes from cache\n", query->ip_addr, query->sock, cached_len);
+      fflush(stdout);
+      metrics_cached(args);
+      t1 = hmmpgmd_Now();
+      hmmpgmd_TraceSpan(search->trace_id, HMMD_SPAN(search->query_id, HMMD_SPAN_CACHE, 0), root, "hmmpgmd.cache", t_start, t1, search->query_id, NULL);
+      hmmpgmd_TraceSpan(search->trace_id, root, 0, "hmmpgmd.query", query->t_queued, t1, search->query_id, NULL);
+      free(cached);
+      free(key);
+      return;
+    }
+  }
+  
+  /* a request abandoned while it was queued isn't worth starting */
+  if (search->cancelled == 0) search->cancelled = search_abandoned(search);
+  if (search->cancelled) {
+    cancelled_msg(search, query);
+    metrics_request(args, query, 0.0, NULL);
+    if (key != NULL) free(key);
+    return;
+  }
+
+  // start timer after we make sure the relevant database exists to make cleanup easier on error
+  w = esl_stopwatch_Create();
+  esl_stopwatch_Start(w);
+  init_results(&results);
+
+  //if range(s) are given, count how many of the seqdb's sequences are within supplied range(s)
+  if (search->range_list) { // can only happen in HMMD_CMD_SEARCH case
+    int range_cnt = 0; // this will now count how many of the seqs in the db are within the range
+    for (i=0; i<cnt; i++) {
+      if ( hmmpgmd_IsWithinRanges(search->seq_db->list[i].idx, search->range_list ) )
+        range_cnt++;
+    }
+    cnt = range_cnt;
+  }
+
+
+  inx = 0;
+  tries = 0;
+  do {
+    /* process any changes to the available workers */
+    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+    /* build a list of the currently available workers */
+    update_workers(args);
+
+    /* a worker that failed while another search was still writing to
+     * it stays on the list until that search lets go of it; skip it,
+     * and any worker that doesn't hold the search's databases
+     */
+    ready_workers = 0;
+    for (worker = args->head; worker != NULL; worker = worker->next)
+      if (worker_serves(worker, search)) ++ready_workers;
+
+    search->nparts = 0;
+    search->ndone  = 0;
+
+    /* if there are no workers, report an error */
+    if (ready_workers > 0) {
+      if ((search->parts = malloc(sizeof(SEARCH_PART) * ready_workers)) == NULL) LOG_FATAL_MSG("malloc", errno);
+      memset(search->parts, 0, sizeof(SEARCH_PART) * ready_workers);
+
+      for (worker = args->head; worker != NULL; worker = worker->next) {
+        if (!worker_serves(worker, search)) continue;
+
+        part          = &search->parts[search->nparts];
+        part->search  = search;
+        part->worker  = worker;
+        part->span_id = search->trace_id ? HMMD_SPAN(search->query_id, HMMD_SPAN_PART, tries * 256 + search->nparts) : 0;
+        search->nparts++;
+
+        /* assign each worker a portion of the database */
+        part->srch_inx = inx;
+        if (search->range_list) {
+          // if ranges are given, need to split the db list based on which elements in the list are within the given range(s)
+          int goal = cnt / ready_workers; //how many within-range sequences do I want to ask this worker to handle
+          int curr = 0;                   //how many within-range sequences have I seen since the start of this full-db range
+          part->srch_cnt = 0;
+          while (curr < goal) {
+            if ( hmmpgmd_IsWithinRanges (search->seq_db->list[inx].idx, search->range_list ) )
+                curr++;
+            part->srch_cnt++;
+            inx++;
+          }
+          cnt -= curr;
+        } else {
+          // default - split evenly among workers
+          part->srch_cnt = cnt / ready_workers;
+          inx += part->srch_cnt;
+          cnt -= part->srch_cnt;
+        }
+
+        /* queue the part on the worker before it can answer */
+        part->next          = worker->outstanding;
+        worker->outstanding = part;
+        worker->sending++;
+
+        --ready_workers;
+      }
+    }
+
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+
+    /* send out the shares; other searches may be writing to the same
+     * workers, so this happens outside the work mutex
+     */
+    t0 = hmmpgmd_Now();
+    for (i = 0; i < search->nparts; i++) send_part(&search->parts[i], query->cmd);
+    hmmpgmd_TraceSpan(search->trace_id, HMMD_SPAN(search->query_id, HMMD_SPAN_DISPATCH, tries), root, "hmmpgmd.dispatch", t0, hmmpgmd_Now(), search->query_id, NULL);
+
+    /* Wait for all the workers to answer, or fail */
+    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+    for (i = 0; i < search->nparts; i++) search->parts[i].worker->sending--;
+
+    /* checking now and then that the client still wants the answer */
+    while (search->ndone < search->nparts) wait_parts(search, search, 1);
+
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+    if (search->trace_id) trace_parts(search, tries);
+    if (search->cancelled) {
+      clear_parts(search);
+      break;
+    }
+
+    /* gather up the results from all the workers */
+    t0 = hmmpgmd_Now();
+    gather_results(search, &results);
+    hmmpgmd_TraceSpan(search->trace_id, HMMD_SPAN(search->query_id, HMMD_SPAN_GATHER, tries), root, "hmmpgmd.gather", t0, hmmpgmd_Now(), search->query_id, NULL);
+    clear_parts(search);
+
+    /* we can recover from one worker crashing.  get the block that worker ran on
+     * and redistribute its load to all the remaining workers.
+     */
+    inx = results.db_inx;
+    cnt = results.db_cnt;
+    ++tries;
+
+  } while (search->nparts > 0 && results.errors == 1 && tries < 2);
+
+
+  esl_stopwatch_Stop(w);
+
+  /* copy the search stats */
+  results.stats.elapsed = w->elapsed;
+  results.stats.user    = w->user;
+  results.stats.sys     = w->sys;
+  results.stats.hit_offsets = NULL; // set this to make sure we allocate memory later
+  /* TODO: check for errors */
+  if (search->cancelled) {
+    cancelled_msg(search, query);
+    metrics_request(args, query, w->elapsed, NULL);
+    clear_results(&results);
+  } else if (search->nparts == 0) {
+    client_msg(query->sock, eslFAIL, "No compute nodes available\n");
+    metrics_request(args, query, w->elapsed, NULL);
+    clear_results(&results);
+  } else if (results.errors > 0) {
+    client_msg(query->sock, eslFAIL, "Errors running search\n");
+    metrics_request(args, query, w->elapsed, NULL);
+    clear_results(&results);
+  } else {
+    metrics_request(args, query, w->elapsed, &results.stats);
+    t0 = hmmpgmd_Now();
+    forward_results(query, &results, &args->rcache, key, keylen);  
+    hmmpgmd_TraceSpan(search->trace_id, HMMD_SPAN(search->query_id, HMMD_SPAN_FORWARD, 0), root, "hmmpgmd.forward", t0, hmmpgmd_Now(), search->query_id, NULL);
+  }
+  hmmpgmd_TraceSpan(search->trace_id, root, 0, "hmmpgmd.query", query->t_queued, hmmpgmd_Now(), search->query_id, NULL);
+
+  if (key != NULL) free(key);
+  esl_stopwatch_Destroy(w);
+}
+
+/* batch_command()
+ * Build the command that sends the queries of batch chunk
+ * <subs>[0..nsub-1] that have a query id to a worker: one scan of all
+ * their sequences, or one search with all their queries, with the
+ * options they share.
+ */
+static HMMD_COMMAND *
+batch_command(ACTIVE_SEARCH *subs, int nsub)
+{
+  HMMD_COMMAND     *cmd   = NULL;
+  HMMD_COMMAND     *first = NULL;
+  HMMD_BATCH_QUERY  bq;
+  char             *ptr;
+  int               n;
+  int               len;
+  int               i;
+
+  /* each query's command holds the options, then its name, description and sequence */
+  n = sizeof(HMMD_COMMAND);
+  for (i = 0; i < nsub; i++) {
+    if (subs[i].query_id == 0) continue;
+    if (first == NULL) {
+      first = subs[i].query->cmd;
+      n    += first->srch.opts_length;
+    }
+    n += sizeof(HMMD_BATCH_QUERY) + MSG_SIZE(subs[i].query->cmd) - sizeof(HMMD_COMMAND) - subs[i].query->cmd->srch.opts_length;
+  }
+
+  if ((cmd = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(cmd, 0, n);		/* silence valgrind bitching about uninit bytes; remove if we ever serialize structs properly */
+  cmd->hdr.length       = n - sizeof(HMMD_HEADER);
+  cmd->hdr.command      = first->hdr.command;
+  cmd->srch.db_inx      = first->srch.db_inx;
+  cmd->srch.query_type  = first->srch.query_type;
+  cmd->srch.opts_length = first->srch.opts_length;
+
+  ptr = cmd->srch.data;
+  memcpy(ptr, first->srch.data, first->srch.opts_length);
+  ptr += first->srch.opts_length;
+
+  for (i = 0; i < nsub; i++) {
+    if (subs[i].query_id == 0) continue;
+
+    len = MSG_SIZE(subs[i].query->cmd) - sizeof(HMMD_COMMAND) - subs[i].query->cmd->srch.opts_length;
+
+    bq.query_id     = subs[i].query_id;
+    bq.query_length = subs[i].query->cmd->srch.query_length;
+    bq.data_length  = len;
+    memcpy(ptr, &bq, sizeof(HMMD_BATCH_QUERY));
+    ptr += sizeof(HMMD_BATCH_QUERY);
+
+    memcpy(ptr, subs[i].query->cmd->srch.data + subs[i].query->cmd->srch.opts_length, len);
+    ptr += len;
+
+    cmd->srch.nqueries++;
+  }
+
+  return cmd;
+}
+
+/* process_batch()
+ * Run batch <search>, a search per query, and answer each query in
+ * turn: a batch scan, or searches of a sequence database coalesced
+ * from the queue, each answered on its own client's socket. Up to
+ * HMMD_BATCH_MAX queries at a time go to each worker in one command,
+ * so that it goes through its share of the database once for all of
+ * them. Queries answered from the result cache, or abandoned while
+ * they were queued, aren't sent; a query whose share failed is
+ * searched again on its own.
+ */
+static void
+process_batch(ACTIVE_SEARCH *search)
+{
+  WORKERSIDE_ARGS *args       = search->comm;
+  QUEUE_DATA      *query      = search->query;
+  ACTIVE_SEARCH    subs[HMMD_BATCH_MAX];       /* a search per query of the current chunk    */
+  char            *key[HMMD_BATCH_MAX];        /* their result cache keys, or NULL           */
+  int              keylen[HMMD_BATCH_MAX];
+  uint8_t         *cached[HMMD_BATCH_MAX];     /* their answers from the cache, or NULL      */
+  uint64_t         cached_len[HMMD_BATCH_MAX];
+  HMMD_COMMAND    *cmd        = NULL;
+  ESL_STOPWATCH   *w          = NULL;
+  WORKER_DATA     *worker     = NULL;
+  SEARCH_PART     *part       = NULL;
+  SEARCH_PART     *sent       = NULL;          /* the parts of one query sent: one per worker */
+  SEARCH_RESULTS   results;
+  int              nsub;
+  int              nsent;
+  int              nworkers;
+  int              busy;
+  int              inx;
+  int              cnt;
+  int              ntargets;
+  int              b, i, k, n;
+
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    if (search->seq_db == NULL || search->seq_db->db == NULL || query->dbx >= search->seq_db->db_cnt || query->dbx < 0) {
+      for (i = 0; i < query->nbatch; i++)
+        client_msg(query->batch[i]->sock, eslFAIL, "Specified sequence database has not been loaded into the daemon. \n");
+      return;
+    }
+    ntargets = search->seq_db->db[query->dbx].count;
+  } else {
+    if (search->hmm_db == NULL) {
+      for (i = 0; i < query->nbatch; i++)
+        client_msg(query->batch[i]->sock, eslFAIL, "No HMM database has been loaded into the daemon. \n");
+      return;
+    }
+    ntargets = search->hmm_db->n;
+  }
+
+  memset(&results, 0, sizeof(SEARCH_RESULTS)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
+  w = esl_stopwatch_Create();
+
+  for (b = 0; b < query->nbatch; b += nsub) {
+    nsub = ESL_MIN(HMMD_BATCH_MAX, query->nbatch - b);
+    memset(subs, 0, sizeof(ACTIVE_SEARCH) * nsub);
+
+    /* each query is a search of its own, on the databases that the
+     * batch started on; those we answered recently don't need the
+     * workers. A coalesced search's deadline counts from when it
+     * arrived itself.
+     */
+    nsent = 0;
+    for (i = 0; i < nsub; i++) {
+      subs[i].query      = query->batch[b+i];
+      subs[i].comm       = args;
+      subs[i].db_version = search->db_version;
+      subs[i].seq_db     = search->seq_db;
+      subs[i].hmm_db     = search->hmm_db;
+      subs[i].deadline   = search->deadline;
+      subs[i].cancelled  = search->cancelled;
+      if (subs[i].query->t_queued > 0. && esl_opt_IsOn(subs[i].query->opts, "--deadline"))
+        subs[i].deadline = subs[i].query->t_queued + esl_opt_GetReal(subs[i].query->opts, "--deadline");
+
+      key[i]        = NULL;
+      keylen[i]     = 0;
+      cached[i]     = NULL;
+      cached_len[i] = 0;
+      if (args->rcache.max_size > 0) {
+        rcache_key(&subs[i], &key[i], &keylen[i]);
+        if (rcache_lookup(&args->rcache, key[i], keylen[i], &cached[i], &cached_len[i])) continue;
       }
+      if (subs[i].cancelled == 0) subs[i].cancelled = search_abandoned(&subs[i]);
+      if (subs[i].cancelled == 0) nsent++;
+    }
+
+    esl_stopwatch_Start(w);
+
+    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+    /* zero is left for the workers' shutdown acknowledgement */
+    for (i = 0; i < nsub; i++) {
+      if (cached[i] != NULL || subs[i].cancelled) continue;
+      if (++args->next_id == 0) ++args->next_id;
+      subs[i].query_id        = args->next_id;
+      subs[i].query->query_id = args->next_id;
+    }
+
+    /* a single query left to send is searched on its own, below */
+    sent     = NULL;
+    nworkers = 0;
+    if (nsent > 1) {
+      update_workers(args);
+
+      nworkers = 0;
+      for (worker = args->head; worker != NULL; worker = worker->next)
+        if (worker_serves(worker, search)) ++nworkers;
+
+      /* every query gets the same split of the targets over the
+       * workers, and its parts are queued before any can answer
+       */
+      for (i = 0; i < nsub && nworkers > 0; i++) {
+        if (subs[i].query_id == 0) continue;
+
+        if ((subs[i].parts = malloc(sizeof(SEARCH_PART) * nworkers)) == NULL) LOG_FATAL_MSG("malloc", errno);
+        memset(subs[i].parts, 0, sizeof(SEARCH_PART) * nworkers);
+
+        inx = 0;
+        cnt = ntargets;
+        k   = nworkers;
+        for (worker = args->head; worker != NULL; worker = worker->next) {
+          if (!worker_serves(worker, search)) continue;
+
+          part           = &subs[i].parts[subs[i].nparts++];
+          part->search   = &subs[i];
+          part->worker   = worker;
+          part->srch_inx = inx;
+          part->srch_cnt = cnt / k;
+          inx += part->srch_cnt;
+          cnt -= part->srch_cnt;
+          --k;
+
+          part->next          = worker->outstanding;
+          worker->outstanding = part;
+        }
+        if (sent == NULL) sent = subs[i].parts;
+      }
+
+      for (k = 0; sent != NULL && k < nworkers; k++) sent[k].worker->sending++;
+    }
+
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+
+    if (sent != NULL) {
+      /* one command per worker carries all the queries of the chunk */
+      cmd = batch_command(subs, nsub);
+      for (k = 0; k < nworkers; k++) send_part(&sent[k], cmd);
+      free(cmd);
+
+      /* Wait for all the workers to answer all the queries, or fail */
+      if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+      for (k = 0; k < nworkers; k++) sent[k].worker->sending--;
+
+      do {
+        for (busy = 0, i = 0; i < nsub; i++)
+          if (subs[i].ndone < subs[i].nparts) busy = 1;
+        if (busy) wait_parts(search, subs, nsub);
+      } while (busy);
+
+      if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+    }
+
+    esl_stopwatch_Stop(w);
+
+    /* answer the queries in the order the client sent them */
+    for (i = 0; i < nsub; i++) {
+      if (cached[i] != NULL) {
+        if (writen(subs[i].query->sock, cached[i], cached_len[i]) != cached_len[i])
+          p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, subs[i].query->ip_addr, errno, strerror(errno));
+        else
+          printf("Results for %s (%d) sent %" PRIu64 " bytes from cache\n", subs[i].query->ip_addr, subs[i].query->sock, cached_len[i]);
+        fflush(stdout);
+        metrics_cached(args);
+        free(cached[i]);
+      } else if (subs[i].cancelled || search->cancelled) {
+        /* once the whole chunk is given up, the rest of the batch goes with it */
+        clear_parts(&subs[i]);
+        if (subs[i].cancelled == 0) subs[i].cancelled = search->cancelled;
+        cancelled_msg(&subs[i], subs[i].query);
+        metrics_request(args, subs[i].query, w->elapsed, NULL);
+      } else if (subs[i].nparts == 0) {
+        /* not sent in the batch: the last query left, or no workers */
+        process_search(&subs[i]);
+      } else {
+        init_results(&results);
+        gather_results(&subs[i], &results);
+        clear_parts(&subs[i]);
+
+        if (results.errors > 0) {
+          clear_results(&results);
+          process_search(&subs[i]);
+        } else {
+          results.stats.elapsed     = w->elapsed;
+          results.stats.user        = w->user;
+          results.stats.sys         = w->sys;
+          results.stats.hit_offsets = NULL;
+          metrics_request(args, subs[i].query, w->elapsed, &results.stats);
+          forward_results(subs[i].query, &results, &args->rcache, key[i], keylen[i]);
+        }
+      }
+      if (key[i] != NULL) free(key[i]);
+    }
+  }
+
+  esl_stopwatch_Destroy(w);
+}
+
+/* search_thread()
+ * Run one search to completion, then free it and let the master
+ * start another.
+ */
+static void *
+search_thread(void *arg)
+{
+  ACTIVE_SEARCH    *search = (ACTIVE_SEARCH *)arg;
+  WORKERSIDE_ARGS  *args   = search->comm;
+  ACTIVE_SEARCH   **prev;
+  int               n;
+
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self()); 
+
+  process_search(search);
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  for (prev = &args->active; *prev != search; prev = &(*prev)->next) ;
+  *prev = search->next;
+  --args->nactive;
+
+  /* notify the master that a search slot is free */
+  if ((n = pthread_cond_broadcast(&args->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (search->range_list) {
+    if (search->range_list->starts)  free(search->range_list->starts);
+    if (search->range_list->ends)    free(search->range_list->ends);
+    free(search->range_list);
+  }
+  free_QueueData(search->query);
+  free(search);
+
+  pthread_exit(NULL);
+}
+
+/* wait_slot()
+ * Wait until fewer than <max_active> searches are in flight.
+ */
+static void
+wait_slot(WORKERSIDE_ARGS *args)
+{
+  int n;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  while (args->nactive >= args->max_active) {
+    if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* same_client()
+ * TRUE if requests <a> and <b> answer on a socket in common; a batch
+ * of coalesced searches answers on each of theirs.
+ */
+static int
+same_client(QUEUE_DATA *a, QUEUE_DATA *b)
+{
+  int i, j;
+
+  if (a->nbatch > 0) {
+    for (i = 0; i < a->nbatch; i++)
+      if (same_client(a->batch[i], b)) return TRUE;
+    return FALSE;
+  }
+  if (b->nbatch > 0) {
+    for (j = 0; j < b->nbatch; j++)
+      if (a->sock == b->batch[j]->sock) return TRUE;
+    return FALSE;
+  }
+  return (a->sock == b->sock);
+}
+
+/* start_search()
+ * Hand <query> to a search thread of its own. Waits until fewer than
+ * <max_active> searches are in flight, and until the client's
+ * previous search on the same connection has been answered (each
+ * client's, for coalesced searches), so each client still gets its
+ * results back in the order it asked for them. The search thread
+ * takes over <query>.
+ */
+static void
+start_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+{
+  ACTIVE_SEARCH  *search = NULL;
+  ACTIVE_SEARCH  *curr;
+  pthread_t       thread_id;
+  int             busy;
+  int             n;
+  int             status;
+
+  ESL_ALLOC(search, sizeof(ACTIVE_SEARCH));
+  memset(search, 0, sizeof(ACTIVE_SEARCH));
+  search->query = query;
+  search->comm  = args;
+
+  if (query->cmd_type == HMMD_CMD_SEARCH && esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
+    ESL_ALLOC(search->range_list, sizeof(RANGE_LIST));
+    hmmpgmd_GetRanges(search->range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
+  }
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  do {
+    busy = (args->nactive >= args->max_active);
+    for (curr = args->active; !busy && curr != NULL; curr = curr->next)
+      if (same_client(curr->query, query)) busy = 1;
+    if (busy) {
+      if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+    }
+  } while (busy);
+
+  /* zero is left for the workers' shutdown acknowledgement */
+  if (++args->next_id == 0) ++args->next_id;
+  search->query_id = args->next_id;
+  query->query_id  = args->next_id;
+
+  /* the search sticks to the databases it starts on, even if a reload
+   * swaps them out before it is done
+   */
+  search->db_version = args->db_version;
+  search->seq_db     = args->seq_db;
+  search->hmm_db     = args->hmm_db;
+
+  search->next = args->active;
+  args->active = search;
+  ++args->nactive;
+
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if ((n = pthread_create(&thread_id, NULL, search_thread, search)) != 0) LOG_FATAL_MSG("thread create", n);
+  return;
+
+ ERROR:
+  p7_Fail("Memory allocation error. Code: %d\n",    status);
+}
+
+static void
+process_shutdown(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+{
+  int n;
+  int cnt;
+  int rc;
+  struct timespec deadline;
+
+  HMMD_COMMAND cmd;
+
+  WORKER_DATA *worker  = NULL;
+  WORKER_DATA *lists[2];
+  int          l;
+
+  /* process any changes to the available workers */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  /* let the searches and any reload in flight finish first */
+  while (args->nactive > 0 || args->reloading) {
+    if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+
+  /* build a list of the currently available workers */
+  update_workers(args);
+
+  /* reset all the idle and active workers */
+  cnt = 0;
+  args->completed = 0;
+
+  /* build a reset command */
+  memset(&cmd, 0, sizeof(HMMD_COMMAND)); /* silence valgrind. if we ever serialize structs properly, remove */
+  cmd.hdr.length  = 0;
+  cmd.hdr.command = HMMD_CMD_SHUTDOWN;
+
+  /* send the shutdown to the active and the idle workers; each
+   * worker's reader thread exits on the acknowledgement, or on the
+   * closed connection
+   */
+  lists[0] = args->head;
+  lists[1] = args->idling;
+  for (l = 0; l < 2; l++) {
+    for (worker = lists[l]; worker != NULL; worker = worker->next) {
+      if (worker->terminated) continue;
+
+      if ((rc = pthread_mutex_lock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex lock", rc);
+      n = MSG_SIZE(&cmd);
+      if (worker->sock_fd >= 0 && writen(worker->sock_fd, &cmd, n) != n) {
+        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      }
+      if ((rc = pthread_mutex_unlock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", rc);
+      ++cnt;
+    }
+  }
+
+  /* Wait for all the workers to complete, but not for one that
+   * stopped responding
+   */
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += 2;
+  while (args->completed < cnt) {
+    if ((n = pthread_cond_timedwait (&args->complete_cond, &args->work_mutex, &deadline)) != 0) {
+      if (n != ETIMEDOUT) LOG_FATAL_MSG("cond wait", n);
+      p7_syslog(LOG_ERR,"[%s:%d] - shutdown: %d of %d workers are not responding\n", __FILE__, __LINE__, cnt - args->completed, cnt);
+      break;
+    }
+  }
+
+  /* build a list of the currently available workers */
+  update_workers(args);
+
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* reload_thread()
+ * Reload the databases without stopping the service: while searches
+ * go on, load a new copy of the master's databases, have the workers
+ * load theirs, then swap the new version in for the searches that
+ * start from then on. Once the searches still on the old version have
+ * finished, the workers are told to let go of it and the master frees
+ * its copy.
+ */
+static void *
+reload_thread(void *arg)
+{
+  WORKERSIDE_ARGS  *args     = (WORKERSIDE_ARGS *)arg;
+  QUEUE_DATA       *query    = args->reload_query;
+  P7_SEQCACHE      *seq_db   = NULL;
+  P7_HMMCACHE      *hmm_db   = NULL;
+  HMMD_COMMAND     *cmd      = NULL;
+  WORKER_DATA      *worker   = NULL;
+  ACTIVE_SEARCH    *search   = NULL;
+  char              errbuf[eslERRBUFSIZE];
+  int               version;
+  int               old_version;
+  int               waiting;
+  int               loaded;
+  int               sent;
+  int               n;
+  int               status;
+
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self());
+
+  /* only this thread replaces the databases, so they can be read
+   * without the lock
+   */
+  if (args->seq_db != NULL) {
+    char *name = args->seq_db->name;
+    if ((status = p7_seqcache_Open(name, &seq_db, errbuf)) != eslOK) {
+      client_msg(query->sock, eslFAIL, "Failed to reload %s (%d)\n", name, status);
+      goto CLEANUP;
+    }
+    if (args->seqsnap && seq_db->snap_mem == NULL) {
+      char *snapfile = NULL;
+      if (esl_sprintf(&snapfile, "%s%s", name, p7_SEQCACHE_SNAPSUFFIX) != eslOK) LOG_FATAL_MSG("malloc", errno);
+      if ((status = p7_seqcache_WriteSnapshot(seq_db, snapfile, errbuf)) != eslOK)
+        p7_syslog(LOG_ERR,"[%s:%d] - failed to write snapshot %s (%d) - %s\n", __FILE__, __LINE__, snapfile, status, errbuf);
+      free(snapfile);
+    }
+    /* after the snapshot, which keeps file order; workers sort the same way */
+    if (p7_seqcache_SortByLength(seq_db, args->seq_db->lsort) != eslOK) LOG_FATAL_MSG("malloc", errno);
+  }
+
+  if (args->hmm_db != NULL) {
+    char *name = args->hmm_db->name;
+    if ((status = p7_hmmcache_Open(name, &hmm_db, errbuf)) != eslOK) {
+      client_msg(query->sock, eslFAIL, "Failed to reload profile db %s (%d)\n", name, status);
+      goto CLEANUP;
+    }
+    p7_hmmcache_SetNumericNames(hmm_db);
+    printf("Reloaded profile db %s;  models: %d  memory: %" PRId64 "\n",
+           name, hmm_db->n, (uint64_t) p7_hmmcache_Sizeof(hmm_db));
+  }
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  version = args->db_version + 1;
+  if ((cmd = init_command(HMMD_CMD_RELOAD, version, seq_db, hmm_db)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  /* have the workers load the new version in the background */
+  update_workers(args);
+  sent = 0;
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    if (worker->terminated) continue;
+    worker->reloading = 1;
+    send_command(worker, cmd);
+    ++sent;
+  }
+
+  do {
+    waiting = loaded = 0;
+    for (worker = args->head; worker != NULL; worker = worker->next) {
+      if (worker->terminated) continue;
+      if (worker->reloading)                  ++waiting;
+      if (worker->db_version == version)      ++loaded;
+    }
+    if (waiting > 0) {
+      if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+    }
+  } while (waiting > 0);
+
+  /* if no worker could load the new version, keep the old one */
+  if (sent > 0 && loaded == 0) {
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+    client_msg(query->sock, eslFAIL, "No worker could reload the databases\n");
+    goto CLEANUP;
+  }
+
+  /* swap: searches starting from here on use the new version */
+  old_version      = args->db_version;
+  args->db_version = version;
+  ESL_SWAP(args->seq_db, seq_db, P7_SEQCACHE *);
+  ESL_SWAP(args->hmm_db, hmm_db, P7_HMMCACHE *);
+  if (args->img_port != 0) image_set(args->seq_db, args->hmm_db);
+
+  /* workers that joined during the reload still hold the old version;
+   * any that join from now on are started on the new one
+   */
+  update_workers(args);
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    if (worker->terminated || worker->reloading || worker->db_version >= version) continue;
+    worker->reloading = 1;
+    send_command(worker, cmd);
+  }
+
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  set_cmdqueue_db(args->cmdqueue, args->seq_db, args->hmm_db);
+
+  printf("Database version %d is in service\n", version);
+  fflush(stdout);
+
+  /* wait for the searches on the old version to finish */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  do {
+    for (search = args->active; search != NULL; search = search->next)
+      if (search->db_version == old_version) break;
+    if (search != NULL) {
+      if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+    }
+  } while (search != NULL);
+
+  /* a worker still loading is released when it answers */
+  update_workers(args);
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    if (worker->terminated || worker->db_version < version) continue;
+    send_release(worker, version);
+  }
+  args->reloading = 0;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  /* seq_db and hmm_db now hold the old version, which nothing uses */
+ CLEANUP:
+  if (hmm_db != NULL) p7_hmmcache_Close(hmm_db);
+  if (seq_db != NULL) p7_seqcache_Close(seq_db);
+  if (cmd    != NULL) free(cmd);
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  args->reloading    = 0;
+  args->reload_query = NULL;
+  if ((n = pthread_cond_broadcast(&args->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  free_QueueData(query);
+  pthread_exit(NULL);
+}
+
+/* process_reload()
+ * Start a reload of the databases in the background, unless one is
+ * already running. Takes over <query>.
+ */
+static void
+process_reload(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+{
+  pthread_t thread_id;
+  int       n;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (args->reloading) {
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+    client_msg(query->sock, eslFAIL, "A reload is already in progress\n");
+    free_QueueData(query);
+    return;
+  }
+  args->reloading    = 1;
+  args->reload_query = query;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if ((n = pthread_create(&thread_id, NULL, reload_thread, args)) != 0) LOG_FATAL_MSG("thread create", n);
+}
+
+void
+master_process(ESL_GETOPTS *go)
+{
+  P7_SEQCACHE        *seq_db     = NULL;
+  P7_HMMCACHE        *hmm_db     = NULL;
+  CMD_QUEUE           cmdqueue;          /* queue of commands that clients want done */
+  QUEUE_DATA         *query      = NULL;
+  CLIENTSIDE_ARGS     client_comm;
+  WORKERSIDE_ARGS     worker_comm;
+  int                 n;
+  int                 shutdown;
+  char                errbuf[eslERRBUFSIZE]; 
+  int                 status     = eslOK;
+
+  impl_Init();
+  p7_FLogsumInit();     /* we're going to use table-driven Logsum() approximations at times */
+
+  if (esl_opt_IsUsed(go, "--seqdb")) {
+    char *name = esl_opt_GetString(go, "--seqdb");
+    if ((status = p7_seqcache_Open(name, &seq_db, errbuf)) != eslOK) 
+      p7_Fail("Failed to cache %s (%d)", name, status);
+
+    /* save a snapshot that the next start (and workers sharing the filesystem) can map;
+     * it is also the image workers fetch (--imgport)
+     */
+    if ((esl_opt_GetBoolean(go, "--seqsnap") || esl_opt_IsOn(go, "--imgport")) && seq_db->snap_mem == NULL) {
+      char *snapfile = NULL;
+      if (esl_sprintf(&snapfile, "%s%s", name, p7_SEQCACHE_SNAPSUFFIX) != eslOK) p7_Fail("Failed to allocate snapshot file name");
+      if ((status = p7_seqcache_WriteSnapshot(seq_db, snapfile, errbuf)) != eslOK) 
+	p7_Fail("Failed to write sequence cache snapshot %s (%d)\n  %s\n", snapfile, status, errbuf);
+      free(snapfile);
+    }
+
+    /* after the snapshot, which keeps file order; the INIT command
+     * tells the workers to sort theirs the same way
+     */
+    if (p7_seqcache_SortByLength(seq_db, esl_opt_GetInteger(go, "--lsort")) != eslOK)
+      p7_Fail("Failed to sort %s by length", name);
+  }
+
+  if (esl_opt_IsUsed(go, "--hmmdb")) {
+    char *name = esl_opt_GetString(go, "--hmmdb");
+
+    status = p7_hmmcache_Open(name, &hmm_db, errbuf);
+    if      (status == eslENOTFOUND) p7_Fail("Failed to open profile database %s\n  %s\n",    name, errbuf);
+    else if (status == eslEFORMAT)   p7_Fail("Failed to parse profile database %s\n  %s\n",   name, errbuf); 
+    else if (status == eslEINCOMPAT) p7_Fail("Mismatched alphabets in profile db %s\n  %s\n", name, errbuf);
+    else if (status != eslOK)        p7_Fail("Failed to load profile db %s : code %d\n",      name, status);
+
+    p7_hmmcache_SetNumericNames(hmm_db);
+
+    printf("Loaded profile db %s;  models: %d  memory: %" PRId64 "\n", 
+	   name, hmm_db->n, (uint64_t) p7_hmmcache_Sizeof(hmm_db));
+  }
+
+  /* if stdout is redirected at the commandline, it causes printf's to be buffered,
+   * which means status logging isn't printed. This line strongly requests unbuffering,
+   * which should be ok, given the low stdout load of hmmpgmd
+   */
+  setvbuf (stdout, NULL, _IONBF, BUFSIZ);
+  printf("Data loaded into memory. Master is ready.\n");
+  setvbuf (stdout, NULL, _IOFBF, BUFSIZ);
+
+  /* initialize the request queue, shared by the client threads and this one */
+  init_cmdqueue(&cmdqueue, go, seq_db, hmm_db);
+
+  /* start the communications with the web clients */
+  client_comm.cmdqueue = &cmdqueue;
+  setup_clientside_comm(go, &client_comm);
+
+  /* initialize the worker structure */
+  if ((n = pthread_mutex_init(&worker_comm.work_mutex, NULL)) != 0)   LOG_FATAL_MSG("mutex init", n);
+  if ((n = pthread_cond_init(&worker_comm.complete_cond, NULL)) != 0) LOG_FATAL_MSG("cond init", n);
+
+  worker_comm.sock_fd    = -1;
+  worker_comm.sock_fd_metrics = -1;
+  worker_comm.head       = NULL;
+  worker_comm.tail       = NULL;
+  worker_comm.pending    = NULL;
+  worker_comm.idling     = NULL;
+  worker_comm.seq_db     = seq_db;
+  worker_comm.hmm_db     = hmm_db;
+  worker_comm.db_version = 1;
+  worker_comm.reloading  = 0;
+  worker_comm.reload_query = NULL;
+  worker_comm.seqsnap    = esl_opt_GetBoolean(go, "--seqsnap") || esl_opt_IsOn(go, "--imgport");
+  worker_comm.cmdqueue   = &cmdqueue;
+
+  worker_comm.ready      = 0;
+  worker_comm.failed     = 0;
+  worker_comm.pend_cnt   = 0;
+  worker_comm.idle_cnt   = 0;
+
+  worker_comm.next_id    = 0;
+  worker_comm.nactive    = 0;
+  worker_comm.max_active = esl_opt_GetInteger(go, "--searches");
+  worker_comm.active     = NULL;
+  worker_comm.completed  = 0;
+  init_rcache(&worker_comm.rcache, ESL_MBYTES((uint64_t) esl_opt_GetInteger(go, "--rcache")));
+
+  worker_comm.started     = time(NULL);
+  memset(worker_comm.latency, 0, sizeof(worker_comm.latency));
+  worker_comm.ncached     = 0;
+  worker_comm.ntargets    = 0;
+  worker_comm.n_past_msv  = 0;
+  worker_comm.n_past_bias = 0;
+  worker_comm.n_past_vit  = 0;
+  worker_comm.n_past_fwd  = 0;
+  worker_comm.nreported   = 0;
+
+  worker_comm.upstream_fd = -1;
+  worker_comm.init_cmd    = NULL;
+
+  worker_comm.img_port    = esl_opt_IsOn(go, "--imgport") ? esl_opt_GetInteger(go, "--imgport") : 0;
+  worker_comm.img_fanout  = esl_opt_GetInteger(go, "--imgfanout");
+  worker_comm.img_nodes   = 0;
+  worker_comm.img_nalloc  = 0;
+  worker_comm.img_ip      = NULL;
+  if (worker_comm.img_port != 0) {
+    image_set(seq_db, hmm_db);
+    hmmpgmd_ImageServe(worker_comm.img_port);
+  }
+
+  setup_workerside_comm(go, &worker_comm);
+  if (esl_opt_IsOn(go, "--mport")) setup_metrics_comm(go, &worker_comm);
+
+  /* read query hmm/sequence 
+   * the pop_cmd() will wait until a client pushes a command to the queue
+   */
+  shutdown = 0;
+  while (!shutdown) {
+    /* pick the next request only when a search could start on it, so
+     * the choice sees everything that arrived in the meantime
+     */
+    wait_slot(&worker_comm);
+    query = pop_cmd(&cmdqueue);
+
+    printf("Processing command %d from %s\n", query->cmd_type, query->ip_addr);
+    if (query->cmd_type == HMMD_CMD_SEARCH && query->nbatch > 0)
+      printf("... with %d queued searches coalesced into one pass\n", query->nbatch - 1);
+    fflush(stdout);
+
+    switch(query->cmd_type) {
+    case HMMD_CMD_SEARCH:      
+    case HMMD_CMD_SCAN:        
+      /* the search thread frees the query when it is done */
+      start_search(&worker_comm, query); 
+      query = NULL;
+      break;
+    case HMMD_CMD_SHUTDOWN:    
+      process_shutdown(&worker_comm, query);
+      p7_syslog(LOG_ERR,"[%s:%d] - shutting down...\n", __FILE__, __LINE__);
+      shutdown = 1;
+      break;
+    case HMMD_CMD_RELOAD:
+      /* the reload thread frees the query when it is done */
+      process_reload(&worker_comm, query);
+      query = NULL;
+      break;
+    default:
+      p7_syslog(LOG_ERR,"[%s:%d] - unknown command %d from %s\n", __FILE__, __LINE__, query->cmd_type, query->ip_addr);
+      break;
+    }
+
+    if (query != NULL) free_QueueData(query);
+  }
+
+  /* a reload may have replaced the databases loaded at startup */
+  if (worker_comm.hmm_db) p7_hmmcache_Close(worker_comm.hmm_db);
+  if (worker_comm.seq_db) p7_seqcache_Close(worker_comm.seq_db);
+
+  destroy_cmdqueue(&cmdqueue);
+
+  destroy_rcache(&worker_comm.rcache);
+  free(worker_comm.img_ip);
+  pthread_mutex_destroy(&worker_comm.work_mutex);
+  pthread_cond_destroy(&worker_comm.complete_cond);
+
+  return;
+}
+
+
+/*****************************************************************
+ * The aggregator (--aggregator)
+ *****************************************************************/
+
+/* An aggregator stands between the master and a subtree of workers,
+ * so that neither the master's connections nor its merging grow with
+ * the cluster. To the master it is one worker; to its own workers, it
+ * is the master. It holds no databases: it hands the master's INIT on
+ * to its workers, splits each share it is sent over them, merges
+ * their ranked hits, drops the ones the master could neither report
+ * nor include, and answers the master with one reply per query, just
+ * as a worker does.
+ */
+
+/* a share of a search relayed from the master: a search per query of
+ * the command, which a batch scan has several of
+ */
+typedef struct {
+  WORKERSIDE_ARGS  *args;
+  HMMD_COMMAND     *cmd;                  /* the master's command          */
+  int               nq;                   /* number of queries in it       */
+  QUEUE_DATA        qs[HMMD_BATCH_MAX];   /* each query ...                */
+  ACTIVE_SEARCH     subs[HMMD_BATCH_MAX]; /* ... and its search            */
+  double            t_recv;               /* when the command was read     */
+} RELAY;
+
+/* connect_upstream()
+ * Connect to the master at --aggregator, waiting for it to come up
+ * as a worker does.
+ */
+static int
+connect_upstream(ESL_GETOPTS *go)
+{
+  struct sockaddr_in addr;
+  int                fd;
+  int                cnt = 0;
+  int                sec = 1;
+
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) LOG_FATAL_MSG("socket", errno);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(esl_opt_GetInteger(go, "--wport"));
+  if ((inet_pton(AF_INET, esl_opt_GetString(go, "--aggregator"), &addr.sin_addr)) < 0) LOG_FATAL_MSG("inet pton", errno);
+
+  while (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    if (errno != ECONNREFUSED) LOG_FATAL_MSG("connect", errno);
+    sleep(sec);
+    if (++cnt > 10) {
+      cnt = 0;
+      if (sec < 64) sec *= 2;
+    }
+  }
+  return fd;
+}
+
+/* read_upstream()
+ * Read the master's next command into <*ret_cmd>, which the caller
+ * frees. Returns eslOK, or eslEOD once the master has gone away.
+ */
+static int
+read_upstream(int fd, HMMD_COMMAND **ret_cmd)
+{
+  HMMD_HEADER   hdr;
+  HMMD_COMMAND *cmd = NULL;
+  int           n;
+
+  *ret_cmd = NULL;
+  if (readn(fd, &hdr, sizeof(hdr)) == -1) return eslEOD;
+
+  n = MSG_SIZE(&hdr);
+  if ((cmd = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(cmd, 0, n);		/* avoid uninitialized bytes. remove this, if we ever serialize/deserialize structures properly */
+  cmd->hdr = hdr;
+  if (hdr.length > 0 && readn(fd, &cmd->init, hdr.length) == -1) {
+    free(cmd);
+    return eslEOD;
+  }
+
+  *ret_cmd = cmd;
+  return eslOK;
+}
+
+/* write_upstream()
+ * Write <n> bytes of <p> to the master, a whole reply at a time;
+ * several relays may be answering at once.
+ */
+static void
+write_upstream(WORKERSIDE_ARGS *args, const void *p, size_t n)
+{
+  if (writen(args->upstream_fd, p, n) != n) LOG_FATAL_MSG("write", errno);
+}
+
+/* upstream_error()
+ * Answer query <query> of <relay> with an error status and message
+ * <msg> instead of results.
+ */
+static void
+upstream_error(RELAY *relay, QUEUE_DATA *query, char *msg)
+{
+  WORKERSIDE_ARGS    *args   = relay->args;
+  HMMD_REPLY          reply;
+  HMMD_SEARCH_STATUS  status;
+  uint8_t            *buf    = NULL;
+  uint32_t            n      = 0;
+  uint32_t            nalloc = 0;
+  int                 rc;
+
+  memset(&status, 0, sizeof(HMMD_SEARCH_STATUS)); /* silence valgrind errors - zero out entire structure including its padding */
+  status.status   = eslFAIL;
+  status.msg_size = strlen(msg) + 1;
+  if (hmmd_search_status_Serialize(&status, &buf, &n, &nalloc) != eslOK) LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
+
+  memset(&reply, 0, sizeof(HMMD_REPLY));
+  reply.command  = query->cmd_type;
+  reply.query_id = query->query_id;
+
+  if ((rc = pthread_mutex_lock (&args->upstream_mutex)) != 0) LOG_FATAL_MSG("mutex lock", rc);
+  write_upstream(args, &reply, sizeof(HMMD_REPLY));
+  write_upstream(args, buf, n);
+  write_upstream(args, msg, status.msg_size);
+  if ((rc = pthread_mutex_unlock (&args->upstream_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", rc);
+
+  p7_syslog(LOG_ERR,"[%s:%d] - query %u: %s\n", __FILE__, __LINE__, query->query_id, msg);
+  free(buf);
+}
+
+/* upstream_results()
+ * Answer query <i> of <relay> with its merged <results>, in the
+ * chunks a worker sends them in; <t_start>, <t_done> are the
+ * relay's times for the master's trace. The hits stay in <results>.
+ */
+static void
+upstream_results(RELAY *relay, int i, SEARCH_RESULTS *results, double t_start, double t_done)
+{
+  WORKERSIDE_ARGS    *args   = relay->args;
+  QUEUE_DATA         *query  = &relay->qs[i];
+  ACTIVE_SEARCH      *search = &relay->subs[i];
+  HMMD_REPLY          reply;
+  HMMD_SEARCH_STATUS  status;
+  uint8_t            *buf    = NULL;   /* the stats, then each chunk of hits */
+  uint8_t            *buf2   = NULL;   /* the status */
+  uint32_t            n      = 0;
+  uint32_t            nalloc = 0;
+  uint32_t            n2     = 0;
+  uint32_t            nalloc2 = 0;
+  uint32_t            chunk_len;
+  enum p7_aliform_e   form;
+  uint64_t            h;
+  int                 k;
+  int                 rc;
+
+  memset(&status, 0, sizeof(HMMD_SEARCH_STATUS)); /* silence valgrind errors - zero out entire structure including its padding */
+  results->stats.elapsed     = t_done - t_start;
+  results->stats.user        = 0.;
+  results->stats.sys         = 0.;
+  results->stats.hit_offsets = NULL;
+  if (p7_hmmd_search_stats_Serialize(&results->stats, &buf, &n, &nalloc) != eslOK) LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATS failed", errno);
+
+  status.status   = eslOK;
+  status.msg_size = n;
+  if (hmmd_search_status_Serialize(&status, &buf2, &n2, &nalloc2) != eslOK) LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
+
+  memset(&reply, 0, sizeof(HMMD_REPLY));
+  reply.command  = query->cmd_type;
+  reply.query_id = query->query_id;
+  reply.t_recv   = relay->t_recv;
+  reply.t_start  = t_start;
+  reply.t_done   = t_done;
+  for (k = 0; k < search->nparts; k++) {
+    reply.mem_peak = ESL_MAX(reply.mem_peak, search->parts[k].reply.mem_peak);
+    reply.mem_rss  = ESL_MAX(reply.mem_rss,  search->parts[k].reply.mem_rss);
+  }
+
+  if ((rc = pthread_mutex_lock (&args->upstream_mutex)) != 0) LOG_FATAL_MSG("mutex lock", rc);
+  write_upstream(args, &reply, sizeof(HMMD_REPLY));
+  write_upstream(args, buf2,   n2);
+  write_upstream(args, buf,    status.msg_size);
+
+  /* the hits are in rank order already, and serialized as the workers sent them */
+  form = esl_opt_GetBoolean(query->opts, "--noali") ? p7_ALI_NONE : p7_ALI_COMPACT;
+  n    = 0;
+  for (h = 0; h < results->stats.nhits; h++) {
+    serialize_hitref(&results->hits[h], form, &buf, &n, &nalloc);
+    if (n >= HMMD_HIT_CHUNK || h == results->stats.nhits-1) {
+      chunk_len = esl_hton32(n);
+      write_upstream(args, &chunk_len, sizeof(uint32_t));
+      write_upstream(args, buf, n);
+      n = 0;
+    }
+  }
+  if ((rc = pthread_mutex_unlock (&args->upstream_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", rc);
+
+  printf("Relayed query %u: %" PRIu64 " hits from %d workers\n", query->query_id, results->stats.nhits, search->nparts);
+  fflush(stdout);
+  free(buf);
+  free(buf2);
+}
+
+/* relay_trim()
+ * Drop the hits of <results> that the master can neither report nor
+ * include, whatever the other subtrees find: those past the --topk
+ * best, and those outside both per-target thresholds. Those depend
+ * on Z, which is known for the whole database already; but they
+ * can't be applied with per-model cutoffs (--cut_ga etc.), which
+ * leave all the hits.
+ */
+static void
+relay_trim(QUEUE_DATA *query, SEARCH_RESULTS *results)
+{
+  P7_PIPELINE *pli;
+  P7_HITREF   *ref;
+  uint64_t     h;
+  uint64_t     n;
+
+  pli = p7_pipeline_Create(query->opts, 100, 100, FALSE, (query->cmd_type == HMMD_CMD_SEARCH) ? p7_SEARCH_SEQS : p7_SCAN_MODELS);
+  if (pli == NULL) LOG_FATAL_MSG("malloc", ENOMEM);
+  pli->Z = results->stats.Z;
+
+  if (! pli->use_bit_cutoffs) {
+    for (n = 0, h = 0; h < results->stats.nhits; h++) {
+      ref = &results->hits[h];
+      if ((! esl_opt_IsOn(query->opts, "--topk") || n < esl_opt_GetInteger(query->opts, "--topk")) &&
+          (p7_pli_TargetReportable(pli, ref->score, ref->lnP) || p7_pli_TargetIncludable(pli, ref->score, ref->lnP)))
+        results->hits[n++] = *ref;   // the hits dropped stay in their buffers, until clear_results()
+    }
+    results->stats.nhits = n;
+  }
+  p7_pipeline_Destroy(pli);
+}
+
+/* relay_thread()
+ * Run the master's search command of <relay> on our workers: split
+ * its share of the targets over them, wait for their answers, and
+ * answer each query with the merged, trimmed hits, or an error if
+ * any of the workers failed, since the master retries failed shares
+ * elsewhere.
+ */
+static void *
+relay_thread(void *arg)
+{
+  RELAY           *relay = (RELAY *) arg;
+  WORKERSIDE_ARGS *args  = relay->args;
+  HMMD_COMMAND    *cmd   = relay->cmd;
+  ACTIVE_SEARCH   *subs  = relay->subs;
+  ACTIVE_SEARCH  **prev;
+  WORKER_DATA     *worker;
+  SEARCH_PART     *part;
+  SEARCH_RESULTS   results;
+  double           t_start;
+  double           t_done;
+  uint32_t         inx;
+  uint32_t         cnt;
+  int              nworkers;
+  int              busy;
+  int              i, k, n;
+
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self());
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  update_workers(args);
+  nworkers = 0;
+  for (worker = args->head; worker != NULL; worker = worker->next)
+    if (worker_serves(worker, &subs[0])) ++nworkers;
 
-      if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  /* every query gets the same split of the share, so the command
+   * goes out once per worker, as the master sent it
+   */
+  for (i = 0; i < relay->nq && nworkers > 0; i++) {
+    if ((subs[i].parts = malloc(sizeof(SEARCH_PART) * nworkers)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memset(subs[i].parts, 0, sizeof(SEARCH_PART) * nworkers);
+
+    inx = cmd->srch.inx;
+    cnt = cmd->srch.cnt;
+    k   = nworkers;
+    for (worker = args->head; worker != NULL; worker = worker->next) {
+      if (!worker_serves(worker, &subs[i])) continue;
+
+      part           = &subs[i].parts[subs[i].nparts++];
+      part->search   = &subs[i];
+      part->worker   = worker;
+      part->span_id  = cmd->srch.span_id;
+      part->srch_inx = inx;
+      part->srch_cnt = cnt / k;
+      inx += part->srch_cnt;
+      cnt -= part->srch_cnt;
+      --k;
+
+      part->next          = worker->outstanding;
+      worker->outstanding = part;
     }
+  }
+  for (k = 0; k < subs[0].nparts; k++) subs[0].parts[k].worker->sending++;
 
-    /* gather up the results from all the workers */
-    gather_results(query, args, &results);
-
-    /* we can recover from one worker crashing.  get the block that worker ran on
-     * and redistribute its load to all the remaining workers.
-     */
-    inx = results.db_inx;
-    cnt = results.db_cnt;
-    ++tries;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-  } while (args->ready > 0 && results.errors == 1 && tries < 2);
+  t_start = hmmpgmd_Now();
+  for (k = 0; k < subs[0].nparts; k++) send_part(&subs[0].parts[k], cmd);
 
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (k = 0; k < subs[0].nparts; k++) subs[0].parts[k].worker->sending--;
+  do {
+    for (busy = 0, i = 0; i < relay->nq; i++)
+      if (subs[i].ndone < subs[i].nparts) busy = 1;
+    if (busy) wait_parts(&subs[0], subs, relay->nq);
+  } while (busy);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  t_done = hmmpgmd_Now();
+
+  for (i = 0; i < relay->nq; i++) {
+    init_results(&results);
+    if (subs[i].nparts > 0 && !subs[i].cancelled) gather_results(&subs[i], &results);
+
+    if      (subs[i].nparts == 0) upstream_error(relay, &relay->qs[i], "no workers available on aggregator");
+    else if (subs[i].cancelled)   upstream_error(relay, &relay->qs[i], "search cancelled");
+    else if (results.errors > 0)  upstream_error(relay, &relay->qs[i], "a worker of the aggregator failed");
+    else {
+      /* a scan's Z is the whole profile database, which none of our workers searched alone */
+      if (cmd->hdr.command == HMMD_CMD_SCAN && results.stats.Z_setby == p7_ZSETBY_NTARGETS) results.stats.Z = args->init_cmd->init.model_cnt;
+      relay_trim(&relay->qs[i], &results);
+      upstream_results(relay, i, &results, t_start, t_done);
+    }
 
-  esl_stopwatch_Stop(w);
+    clear_parts(&subs[i]);
+    clear_results(&results);
+  }
 
-  /* copy the search stats */
-  results.stats.elapsed = w->elapsed;
-  results.stats.user    = w->user;
-  results.stats.sys     = w->sys;
-  results.stats.hit_offsets = NULL; // set this to make sure we allocate memory later
-  /* TODO: check for errors */
-  if (args->ready == 0) {
-    client_msg(query->sock, eslFAIL, "No compute nodes available\n");
-  } else if (args->failed > 0) {
-    client_msg(query->sock, eslFAIL, "Errors running search\n");
-    clear_results(args, &results);
-  } else {
-    forward_results(query, &results);  
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (i = 0; i < relay->nq; i++) {
+    for (prev = &args->active; *prev != &subs[i]; prev = &(*prev)->next) ;
+    *prev = subs[i].next;
   }
+  --args->nactive;
+  if ((n = pthread_cond_broadcast(&args->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-  esl_stopwatch_Destroy(w);
+  for (i = 0; i < relay->nq; i++) esl_getopts_Destroy(relay->qs[i].opts);
+  free(cmd);
+  free(relay);
+  pthread_exit(NULL);
 }
 
+/* start_relay()
+ * Start a thread to run the master's search command <cmd>, which it
+ * takes over. Its queries are listed with the searches in flight
+ * right away, so that a cancel read next finds them.
+ */
 static void
-process_shutdown(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+start_relay(WORKERSIDE_ARGS *args, HMMD_COMMAND *cmd)
 {
-  int n;
-  int cnt;
+  RELAY            *relay = NULL;
+  HMMD_BATCH_QUERY  bq;
+  QUEUE_DATA       *query;
+  char             *p;
+  pthread_t         thread_id;
+  int               i;
+  int               n;
 
-  HMMD_COMMAND cmd;
+  if ((relay = malloc(sizeof(RELAY))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(relay, 0, sizeof(RELAY));	/* avoid uninitialized bytes. remove this, if we ever serialize/deserialize structures properly */
+  relay->args   = args;
+  relay->cmd    = cmd;
+  relay->nq     = (cmd->srch.nqueries > 0) ? ESL_MIN(cmd->srch.nqueries, HMMD_BATCH_MAX) : 1;
+  relay->t_recv = hmmpgmd_Now();
 
-  WORKER_DATA *worker  = NULL;
+  /* a batch's queries follow the options: each an HMMD_BATCH_QUERY,
+   * then its data, a sequence or an HMM
+   */
+  p = cmd->srch.data + cmd->srch.opts_length;
+  for (i = 0; i < relay->nq; i++) {
+    query = &relay->qs[i];
+    query->cmd_type = cmd->hdr.command;
+    query->dbx      = cmd->srch.db_inx;
+    query->sock     = args->upstream_fd;
+    strcpy(query->ip_addr, "master");
+    if (process_searchopts(args->upstream_fd, cmd->srch.data, &query->opts) != eslOK) LOG_FATAL_MSG("esl_getopts_Create", eslEMEM);
+
+    if (cmd->srch.nqueries > 0) {
+      memcpy(&bq, p, sizeof(HMMD_BATCH_QUERY));
+      p += sizeof(HMMD_BATCH_QUERY) + bq.data_length;
+      query->query_id = bq.query_id;
+    } else
+      query->query_id = cmd->srch.query_id;
+
+    relay->subs[i].query      = query;
+    relay->subs[i].query_id   = query->query_id;
+    relay->subs[i].trace_id   = cmd->srch.trace_id;
+    relay->subs[i].comm       = args;
+    relay->subs[i].db_version = cmd->srch.db_version;
+  }
 
-  /* process any changes to the available workers */
   if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (i = 0; i < relay->nq; i++) {
+    relay->subs[i].next = args->active;
+    args->active        = &relay->subs[i];
+  }
+  ++args->nactive;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-  /* build a list of the currently available workers */
-  update_workers(args);
+  if ((n = pthread_create(&thread_id, NULL, relay_thread, relay)) != 0) LOG_FATAL_MSG("thread create", n);
+}
 
-  /* reset all the idle and active workers */
-  cnt = 0;
+/* relay_reload_thread()
+ * Have our workers load the databases of the master's HMMD_CMD_RELOAD,
+ * or of a later HMMD_CMD_INIT for a newer version, while the searches
+ * go on, as reload_thread() does on the master. The new version is in
+ * service once any of them has it, or right away if we have none.
+ * Answers the master the way a worker does.
+ */
+static void *
+relay_reload_thread(void *arg)
+{
+  RELAY           *relay   = (RELAY *) arg;
+  WORKERSIDE_ARGS *args    = relay->args;
+  HMMD_COMMAND    *cmd     = relay->cmd;
+  uint32_t         command = cmd->hdr.command;
+  WORKER_DATA     *worker;
+  HMMD_REPLY       reply;
+  int              version = cmd->init.db_version;
+  int              waiting;
+  int              loaded;
+  int              sent;
+  int              n;
 
-  /* build a reset command */
-  cmd.hdr.length  = 0;
-  cmd.hdr.command = HMMD_CMD_SHUTDOWN;
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self());
 
-  /* look for the active workers to shutdown */
-  worker = args->head;
-  while (worker != NULL) {
-    worker->cmd        = &cmd;
-    worker->completed  = 0;
-    worker->total      = 0;
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-    worker = worker->next;
-    ++cnt;
+  cmd->hdr.command = HMMD_CMD_RELOAD;
+  update_workers(args);
+  sent = 0;
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    if (worker->terminated) continue;
+    worker->reloading = 1;
+    send_command(worker, cmd);
+    ++sent;
   }
 
-  /* look for the idle workers to shutdown */
-  worker = args->idling;
-  while (worker != NULL) {
-    worker->cmd        = &cmd;
-    worker->completed  = 0;
-    worker->total      = 0;
+  do {
+    waiting = loaded = 0;
+    for (worker = args->head; worker != NULL; worker = worker->next) {
+      if (worker->terminated) continue;
+      if (worker->reloading)             ++waiting;
+      if (worker->db_version == version) ++loaded;
+    }
+    if (waiting > 0) {
+      if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+    }
+  } while (waiting > 0);
 
-    worker = worker->next;
-    ++cnt;
+  /* workers that join from now on are started on the new version */
+  if (sent == 0 || loaded > 0) {
+    cmd->hdr.command = HMMD_CMD_INIT;
+    ESL_SWAP(args->init_cmd, cmd, HMMD_COMMAND *);
+    args->db_version = version;
   }
+  version = args->db_version;
 
-  /* check if there are any workers to shutdown */
-  if (cnt > 0) {
-    args->completed = 0;
+  args->reloading = 0;
+  if ((n = pthread_cond_broadcast(&args->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-    /* notify all the worker threads of the new query */
-    if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
-    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+  /* a reload is answered with the version we hold; an init, by echoing it */
+  if ((n = pthread_mutex_lock (&args->upstream_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (command == HMMD_CMD_RELOAD) {
+    memset(&reply, 0, sizeof(HMMD_REPLY));
+    reply.command  = HMMD_CMD_RELOAD;
+    reply.query_id = version;
+    write_upstream(args, &reply, sizeof(HMMD_REPLY));
+  } else {
+    args->init_cmd->hdr.status = (version == args->init_cmd->init.db_version) ? eslOK : eslFAIL;
+    write_upstream(args, args->init_cmd, MSG_SIZE(args->init_cmd));
+  }
+  if ((n = pthread_mutex_unlock (&args->upstream_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-    /* Wait for all the workers to complete */
-    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  printf("Database version %d is in service\n", version);
+  fflush(stdout);
 
-    while (args->completed < cnt) {
-      if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
-    }
-  }
+  free(cmd);
+  free(relay);
+  pthread_exit(NULL);
+}
 
-  /* build a list of the currently available workers */
-  update_workers(args);
+/* start_relay_reload()
+ * Start relaying reload command <cmd>, which it takes over, unless a
+ * reload is already running; the master only sends one at a time.
+ */
+static void
+start_relay_reload(WORKERSIDE_ARGS *args, HMMD_COMMAND *cmd)
+{
+  RELAY     *relay = NULL;
+  pthread_t  thread_id;
+  int        n;
 
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (args->reloading) {
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+    p7_syslog(LOG_ERR,"[%s:%d] - reload to version %u while another is running\n", __FILE__, __LINE__, cmd->init.db_version);
+    free(cmd);
+    return;
+  }
+  args->reloading = 1;
   if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
-}
 
+  if ((relay = malloc(sizeof(RELAY))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(relay, 0, sizeof(RELAY));
+  relay->args = args;
+  relay->cmd  = cmd;
+  if ((n = pthread_create(&thread_id, NULL, relay_reload_thread, relay)) != 0) LOG_FATAL_MSG("thread create", n);
+}
 
 void
-master_process(ESL_GETOPTS *go)
+aggregator_process(ESL_GETOPTS *go)
 {
-  P7_SEQCACHE        *seq_db     = NULL;
-  P7_HMMCACHE        *hmm_db     = NULL;
-  ESL_STACK          *cmdstack   = NULL; /* stack of commands that clients want done */
-  QUEUE_DATA         *query      = NULL;
-  CLIENTSIDE_ARGS     client_comm;
+  HMMD_COMMAND       *cmd      = NULL;
   WORKERSIDE_ARGS     worker_comm;
-  int                 n;
+  ACTIVE_SEARCH      *search;
+  WORKER_DATA        *worker;
+  HMMD_REPLY          reply;
+  struct timespec     until;
   int                 shutdown;
-  char                errbuf[eslERRBUFSIZE]; 
-  int                 status     = eslOK;
+  int                 n;
 
   impl_Init();
-  p7_FLogsumInit();     /* we're going to use table-driven Logsum() approximations at times */
+  p7_FLogsumInit();     /* relay_trim() sets up pipelines, for their thresholds */
+
+  memset(&worker_comm, 0, sizeof(WORKERSIDE_ARGS));
+  if ((n = pthread_mutex_init(&worker_comm.work_mutex, NULL)) != 0)     LOG_FATAL_MSG("mutex init", n);
+  if ((n = pthread_cond_init(&worker_comm.complete_cond, NULL)) != 0)   LOG_FATAL_MSG("cond init", n);
+  if ((n = pthread_mutex_init(&worker_comm.upstream_mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+  worker_comm.sock_fd         = -1;
+  worker_comm.sock_fd_metrics = -1;
+  worker_comm.max_active      = esl_opt_GetInteger(go, "--searches");
+  worker_comm.started         = time(NULL);
+
+  /* the master starts us on its databases, which our workers load */
+  worker_comm.upstream_fd = connect_upstream(go);
+  if (read_upstream(worker_comm.upstream_fd, &cmd) != eslOK || cmd->hdr.command != HMMD_CMD_INIT)
+    p7_Fail("Failed to read the master's databases at %s\n", esl_opt_GetString(go, "--aggregator"));
+  worker_comm.init_cmd   = cmd;
+  worker_comm.db_version = cmd->init.db_version;
+  cmd = NULL;
 
-  if (esl_opt_IsUsed(go, "--seqdb")) {
-    char *name = esl_opt_GetString(go, "--seqdb");
-    if ((status = p7_seqcache_Open(name, &seq_db, errbuf)) != eslOK) 
-      p7_Fail("Failed to cache %s (%d)", name, status);
+  setup_workerside_comm(go, &worker_comm);
 
+  /* the master counts us in once we can search: when a worker has joined */
+  if ((n = pthread_mutex_lock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  while (worker_comm.pend_cnt == 0 && worker_comm.ready == 0) {
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += 1;
+    if ((n = pthread_cond_timedwait (&worker_comm.complete_cond, &worker_comm.work_mutex, &until)) != 0 && n != ETIMEDOUT) LOG_FATAL_MSG("cond wait", n);
   }
+  if ((n = pthread_mutex_unlock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-  if (esl_opt_IsUsed(go, "--hmmdb")) {
-    char *name = esl_opt_GetString(go, "--hmmdb");
-
-    status = p7_hmmcache_Open(name, &hmm_db, errbuf);
-    if      (status == eslENOTFOUND) p7_Fail("Failed to open profile database %s\n  %s\n",    name, errbuf);
-    else if (status == eslEFORMAT)   p7_Fail("Failed to parse profile database %s\n  %s\n",   name, errbuf); 
-    else if (status == eslEINCOMPAT) p7_Fail("Mismatched alphabets in profile db %s\n  %s\n", name, errbuf);
-    else if (status != eslOK)        p7_Fail("Failed to load profile db %s : code %d\n",      name, status);
-
-    p7_hmmcache_SetNumericNames(hmm_db);
-
-    printf("Loaded profile db %s;  models: %d  memory: %" PRId64 "\n", 
-	   name, hmm_db->n, (uint64_t) p7_hmmcache_Sizeof(hmm_db));
-  }
+  worker_comm.init_cmd->hdr.status = eslOK;
+  write_upstream(&worker_comm, worker_comm.init_cmd, MSG_SIZE(worker_comm.init_cmd));
 
-  /* if stdout is redirected at the commandline, it causes printf's to be buffered,
-   * which means status logging isn't printed. This line strongly requests unbuffering,
-   * which should be ok, given the low stdout load of hmmpgmd
-   */
   setvbuf (stdout, NULL, _IONBF, BUFSIZ);
-  printf("Data loaded into memory. Master is ready.\n");
+  printf("Workers joined. Aggregator is ready.\n");
   setvbuf (stdout, NULL, _IOFBF, BUFSIZ);
 
-  /* initialize the search stack, set it up for interthread communication  */
-  cmdstack = esl_stack_PCreate();
-  esl_stack_UseMutex(cmdstack);
-  esl_stack_UseCond(cmdstack);
-
-  /* start the communications with the web clients */
-  client_comm.cmdstack = cmdstack;
-  setup_clientside_comm(go, &client_comm);
-
-  /* initialize the worker structure */
-  if ((n = pthread_mutex_init(&worker_comm.work_mutex, NULL)) != 0)   LOG_FATAL_MSG("mutex init", n);
-  if ((n = pthread_cond_init(&worker_comm.start_cond, NULL)) != 0)    LOG_FATAL_MSG("cond init", n);
-  if ((n = pthread_cond_init(&worker_comm.complete_cond, NULL)) != 0) LOG_FATAL_MSG("cond init", n);
-
-  worker_comm.sock_fd    = -1;
-  worker_comm.head       = NULL;
-  worker_comm.tail       = NULL;
-  worker_comm.pending    = NULL;
-  worker_comm.idling     = NULL;
-  worker_comm.seq_db     = seq_db;
-  worker_comm.hmm_db     = hmm_db;
-  worker_comm.db_version = 1;
-
-  worker_comm.ready      = 0;
-  worker_comm.failed     = 0;
-  worker_comm.pend_cnt   = 0;
-  worker_comm.idle_cnt   = 0;
-
-  setup_workerside_comm(go, &worker_comm);
-
-  /* read query hmm/sequence 
-   * the PPop() will wait until a client pushes a command to the queue
-   */
+  /* relay the master's commands, as they come, until it shuts us down or goes away */
   shutdown = 0;
-  while (!shutdown &&  esl_stack_PPop(cmdstack, (void **) &query) == eslOK) {
-    printf("Processing command %d from %s\n", query->cmd_type, query->ip_addr);
-    fflush(stdout);
-
-    worker_comm.range_list = NULL;
-
-    switch(query->cmd_type) {
-    case HMMD_CMD_SEARCH:      
-      if (esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
-        ESL_ALLOC(worker_comm.range_list, sizeof(RANGE_LIST));
-        hmmpgmd_GetRanges(worker_comm.range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
-      }
-      process_search(&worker_comm, query); 
+  while (!shutdown && read_upstream(worker_comm.upstream_fd, &cmd) == eslOK) {
+    switch (cmd->hdr.command) {
+    case HMMD_CMD_SEARCH:
+    case HMMD_CMD_SCAN:
+      start_relay(&worker_comm, cmd);
+      cmd = NULL;
       break;
-    case HMMD_CMD_SCAN:        process_search(&worker_comm, query); break;
-    case HMMD_CMD_SHUTDOWN:    
-      process_shutdown(&worker_comm, query);
-      p7_syslog(LOG_ERR,"[%s:%d] - shutting down...\n", __FILE__, __LINE__);
+    case HMMD_CMD_INIT:
+    case HMMD_CMD_RELOAD:
+      start_relay_reload(&worker_comm, cmd);
+      cmd = NULL;
+      break;
+    case HMMD_CMD_RELEASE:
+      if ((n = pthread_mutex_lock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+      update_workers(&worker_comm);
+      for (worker = worker_comm.head; worker != NULL; worker = worker->next)
+        if (!worker->terminated && worker->db_version >= cmd->init.db_version) send_release(worker, cmd->init.db_version);
+      if ((n = pthread_mutex_unlock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+      break;
+    case HMMD_CMD_CANCEL:
+      if ((n = pthread_mutex_lock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+      for (search = worker_comm.active; search != NULL; search = search->next)
+        if (search->query_id == cmd->srch.query_id && !search->cancelled) cancel_search(search, CANCEL_MASTER);
+      if ((n = pthread_mutex_unlock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+      break;
+    case HMMD_CMD_SHUTDOWN:
+      process_shutdown(&worker_comm, NULL);
+      memset(&reply, 0, sizeof(HMMD_REPLY));
+      reply.command = HMMD_CMD_SHUTDOWN;
+      write_upstream(&worker_comm, &reply, sizeof(HMMD_REPLY));
       shutdown = 1;
       break;
     default:
-      p7_syslog(LOG_ERR,"[%s:%d] - unknown command %d from %s\n", __FILE__, __LINE__, query->cmd_type, query->ip_addr);
-      break;
+      p7_syslog(LOG_ERR,"[%s:%d] - unknown command %d (%d)\n", __FILE__, __LINE__, cmd->hdr.command, cmd->hdr.length);
     }
 
-    free_QueueData(query);
+    if (cmd != NULL) free(cmd);
+    cmd = NULL;
   }
 
-  esl_stack_ReleaseCond(cmdstack);
-
-  if (hmm_db) p7_hmmcache_Close(hmm_db);
-  if (seq_db) p7_seqcache_Close(seq_db);
+  if (!shutdown) p7_syslog(LOG_ERR,"[%s:%d] - master went away, shutting down...\n", __FILE__, __LINE__);
+  close(worker_comm.upstream_fd);
+  return;
+}
 
-  esl_stack_Destroy(cmdstack);
 
-  pthread_mutex_destroy(&worker_comm.work_mutex);
-  pthread_cond_destroy(&worker_comm.start_cond);
-  pthread_cond_destroy(&worker_comm.complete_cond);
+// Qsort comparison function to sort an array of scanned hits
+static int
+hitref_sorter(const void *p1, const void *p2)
+{
+  return p7_hitref_Compare((const P7_HITREF *) p1, (const P7_HITREF *) p2);
+}
 
+/* hitref_siftdown()
+ * Restore the heap order of runs <heap[0..nh-1]> below <i>, where a
+ * run is better than another if its next hit <runs[r][pos[r]]> ranks
+ * first, or ties and the run comes first.
+ */
+static void
+hitref_siftdown(int *heap, int nh, int i, P7_HITREF **runs, const uint64_t *pos)
+{
+  int best, c, cmp, tmp;
 
-  if (worker_comm.range_list) {
-    if (worker_comm.range_list->starts)  free(worker_comm.range_list->starts);
-    if (worker_comm.range_list->ends)    free(worker_comm.range_list->ends);
-    free (worker_comm.range_list);
+  for ( ; ; i = best) {
+    best = i;
+    for (c = 2*i+1; c <= 2*i+2 && c < nh; c++) {
+      cmp = p7_hitref_Compare(&runs[heap[c]][pos[heap[c]]], &runs[heap[best]][pos[heap[best]]]);
+      if (cmp < 0 || (cmp == 0 && heap[c] < heap[best])) best = c;
+    }
+    if (best == i) return;
+    tmp = heap[i]; heap[i] = heap[best]; heap[best] = tmp;
   }
-
-  return;
-
-
-ERROR:
-  p7_Fail("Memory allocation error. Code: %d\n",    status);
-
 }
 
-
-// Qsort comparison function to sort a list of pointers to P7_HITs
-static int
-hit_sorter2(const void *p1, const void *p2)
+/* merge_hitrefs()
+ * K-way merge of the <nruns> ranked runs of scanned hits <runs>, of
+ * lengths <nrun>, into <out>, as p7_tophits_MergeHitArrays() does
+ * for P7_HITs.
+ */
+static void
+merge_hitrefs(P7_HITREF **runs, const uint64_t *nrun, int nruns, P7_HITREF *out)
 {
-  int cmp;
-
-  const P7_HIT *h1 = *((P7_HIT **) p1);
-  const P7_HIT *h2 = *((P7_HIT **) p2);
+  int      *heap = NULL;   /* run indices, best next hit on top */
+  uint64_t *pos  = NULL;   /* next unmerged hit in each run     */
+  uint64_t  k    = 0;
+  int       nh   = 0;
+  int       r, i;
+
+  if ((heap = malloc(sizeof(int)      * (nruns+1))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((pos  = malloc(sizeof(uint64_t) * (nruns+1))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  for (r = 0; r < nruns; r++) {
+    pos[r] = 0;
+    if (nrun[r] > 0) heap[nh++] = r;
+  }
+  for (i = nh/2-1; i >= 0; i--) hitref_siftdown(heap, nh, i, runs, pos);
 
-  cmp  = (h1->sortkey < h2->sortkey);
-  cmp -= (h1->sortkey > h2->sortkey);
+  while (nh > 0) {
+    r        = heap[0];
+    out[k++] = runs[r][pos[r]++];
+    if (pos[r] == nrun[r]) heap[0] = heap[--nh];
+    if (nh > 1) hitref_siftdown(heap, nh, 0, runs, pos);
+  }
 
-  return cmp;
+  free(heap);
+  free(pos);
 }
 
 static void
@@ -679,6 +3134,8 @@ init_results(SEARCH_RESULTS *results)
   results->stats.Z           = 0;
 
   results->hits              = NULL;
+  results->bufs              = NULL;
+  results->nbufs             = 0;
   results->stats.hit_offsets = NULL;
   results->nhits             = 0;
   results->db_inx            = 0;
@@ -687,99 +3144,177 @@ init_results(SEARCH_RESULTS *results)
 }
 
 static void
-gather_results(QUEUE_DATA *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results)
+gather_results(ACTIVE_SEARCH *search, SEARCH_RESULTS *results)
 {
+  QUEUE_DATA      *query = search->query;
   int cnt;
-  int n;
-  int i0, i1;
-  WORKER_DATA *worker;
-
-  /* allocate spaces to hold all the hits */
-  cnt = results->nhits + MAX_WORKERS;
-  if ((results->hits = realloc(results->hits, sizeof(P7_HIT *) * cnt)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  int i;
+  int nruns;
+  uint64_t     j;
+  P7_HITREF  **runs   = NULL;   /* sorted runs of hits to merge: results so far, then each worker's */
+  uint64_t    *nrun   = NULL;
+  P7_HITREF   *merged = NULL;
+  SEARCH_PART *part;
+
+  /* the parts are all answered or failed, so the worker threads are
+   * done with them and no locking is needed
+   */
 
-  /* lock the workers until we have merged the results */
-  if ((n = pthread_mutex_lock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  /* one run for the hits we already have, plus one per worker */
+  nruns = 1 + search->nparts;
+  if ((runs = malloc(sizeof(P7_HITREF *) * nruns)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((nrun = malloc(sizeof(uint64_t)    * nruns)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((results->bufs = realloc(results->bufs, sizeof(uint8_t *) * (results->nbufs + search->nparts + 1))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  runs[0] = results->hits;
+  nrun[0] = results->stats.nhits;
+  nruns   = 1;
 
   /* count the number of hits */
   cnt = results->nhits;
-  worker = comm->head;
-  while (worker != NULL) {
-    if (worker->completed) {
+  results->errors = 0;
+  for (i = 0; i < search->nparts; i++) {
+    part = &search->parts[i];
+    if (part->completed && part->status.status == eslOK) {
       uint32_t previous_hits = results->stats.nhits;
 
-      results->stats.nhits        += worker->stats.nhits;
-      results->stats.nreported    += worker->stats.nreported;
-      results->stats.nincluded    += worker->stats.nincluded;
-
-      results->stats.n_past_msv   += worker->stats.n_past_msv;
-      results->stats.n_past_bias  += worker->stats.n_past_bias;
-      results->stats.n_past_vit   += worker->stats.n_past_vit;
-      results->stats.n_past_fwd   += worker->stats.n_past_fwd;
+      results->stats.nhits        += part->stats.nhits;
+      results->stats.nreported    += part->stats.nreported;
+      results->stats.nincluded    += part->stats.nincluded;
 
-      results->stats.Z_setby       = worker->stats.Z_setby;
-      results->stats.domZ_setby    = worker->stats.domZ_setby;
-      results->stats.domZ          = worker->stats.domZ;
-      results->stats.Z             = worker->stats.Z;
+      results->stats.n_past_msv   += part->stats.n_past_msv;
+      results->stats.n_past_bias  += part->stats.n_past_bias;
+      results->stats.n_past_vit   += part->stats.n_past_vit;
+      results->stats.n_past_fwd   += part->stats.n_past_fwd;
 
-      results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
+      results->stats.Z_setby       = part->stats.Z_setby;
+      results->stats.domZ_setby    = part->stats.domZ_setby;
+      results->stats.domZ          = part->stats.domZ;
+      results->stats.Z             = part->stats.Z;
 
       if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
-        // Add enough space to the list of hits for all the hits from this worker
-        results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
-        if(results->hits == NULL){
-          LOG_FATAL_MSG("malloc", n);
-        }
-
-        // copy this worker's hits into the global list
-        for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
-          results->hits[i1] = worker->hits[i0];
-        }
-
-        free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
-        // will be freed by forward_results()
-
-        worker->hits = NULL;  
+        // Workers send their hits in rank order; take this part's index
+        // as one sorted run for the merge below, and its buffer, which
+        // forward_results() frees with the rest
+        runs[nruns] = part->refs;
+        nrun[nruns] = results->stats.nhits - previous_hits;
+        for (j = 1; j < nrun[nruns]; j++)
+          if (p7_hitref_Compare(&runs[nruns][j-1], &runs[nruns][j]) > 0) break;
+        if (j < nrun[nruns]) qsort(runs[nruns], nrun[nruns], sizeof(P7_HITREF), hitref_sorter);
+        nruns++;
+
+        results->bufs[results->nbufs++] = part->hit_buf;
+        part->refs    = NULL;
+        part->hit_buf = NULL;
       }
-      worker->completed   = 0;
       ++cnt;
     } else {
       results->errors++;
-      results->db_inx            = worker->srch_inx;
-      results->db_cnt            = worker->srch_cnt;
+      results->db_inx            = part->srch_inx;
+      results->db_cnt            = part->srch_cnt;
     }
-
-    worker = worker->next;
   }
 
-  if ((n = pthread_mutex_unlock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
-
-  if (query->cmd_type == HMMD_CMD_SEARCH) {
-    results->stats.nmodels = 1;
-    results->stats.nseqs   = comm->seq_db->db[query->dbx].K;
-  } else {
-    results->stats.nseqs   = 1;
-    results->stats.nmodels = comm->hmm_db->n;
+  /* k-way merge of the sorted runs into one ranked list of all the hits */
+  if (nruns > 1) {
+    if ((merged = malloc(sizeof(P7_HITREF) * results->stats.nhits)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    merge_hitrefs(runs, nrun, nruns, merged);
+    for (i = 0; i < nruns; i++) free(runs[i]);  // frees the indices, not the hits' buffers
+    results->hits = merged;
   }
+  free(runs);
+  free(nrun);
+
+  /* an aggregator has no databases, and passes on its workers' counts */
+  if (search->seq_db != NULL || search->hmm_db != NULL) {
+    if (query->cmd_type == HMMD_CMD_SEARCH) {
+      results->stats.nmodels = 1;
+      results->stats.nseqs   = search->seq_db->db[query->dbx].K;
+    } else {
+      results->stats.nseqs   = 1;
+      results->stats.nmodels = search->hmm_db->n;
+    }
     
-  if (results->stats.Z_setby == p7_ZSETBY_NTARGETS) {
-    results->stats.Z = (query->cmd_type == HMMD_CMD_SEARCH) ? results->stats.nseqs : results->stats.nmodels;
+    if (results->stats.Z_setby == p7_ZSETBY_NTARGETS) {
+      results->stats.Z = (query->cmd_type == HMMD_CMD_SEARCH) ? results->stats.nseqs : results->stats.nmodels;
+    }
   }
 
   results->nhits = cnt;
+  p7_PROBE2(hmmpgmd__gather, search->query_id, results->stats.nhits);
+}
+
+/* decode_hitref()
+ * Deserialize the hit <ref> indexes, if it isn't already.
+ */
+static void
+decode_hitref(P7_HITREF *ref)
+{
+  uint32_t pos = 0;
+
+  if (ref->hit != NULL) return;
+  if ((ref->hit = p7_hit_Create_empty()) == NULL)            LOG_FATAL_MSG("malloc", errno);
+  if (p7_hit_Deserialize(ref->ser, &pos, ref->hit) != eslOK) LOG_FATAL_MSG("Couldn't deserialize P7_HIT", errno);
+}
+
+/* serialize_hitref()
+ * Append the hit <ref> indexes to <*buf>, as p7_hit_SerializeAs()
+ * would: re-serialized in form <form> if it was decoded, else copied
+ * as the worker sent it. With <buf> NULL, only add its length to <*n>.
+ */
+static void
+serialize_hitref(const P7_HITREF *ref, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc)
+{
+  uint8_t  *scratch = NULL;
+  uint32_t  len     = 0;
+  uint32_t  salloc  = 0;
+
+  if (ref->hit != NULL) {
+    if (buf == NULL) {
+      if (p7_hit_SerializeAs(ref->hit, form, &scratch, &len, &salloc) != eslOK) LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
+      *n += len;
+      free(scratch);
+    }
+    else if (p7_hit_SerializeAs(ref->hit, form, buf, n, nalloc) != eslOK) LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
+    return;
+  }
+
+  if (buf != NULL) {
+    if (*n + ref->ser_len > *nalloc) {
+      if ((*buf = realloc(*buf, *n + ref->ser_len)) == NULL) LOG_FATAL_MSG("malloc", errno);
+      *nalloc = *n + ref->ser_len;
+    }
+    memcpy(*buf + *n, ref->ser, ref->ser_len);
+  }
+  *n += ref->ser_len;
 }
 
+/* forward_results()
+ * Send the merged <results> of <query> to the client. If <key> is
+ * non-NULL, also keep the serialized results in <cache> under <key>.
+ *
+ * The hits are still as the workers serialized them. Only those that
+ * can be reported or included are deserialized, to be thresholded;
+ * the rest (most of them, in a big search) can't be changed by
+ * p7_tophits_Threshold(), and are sent on byte for byte, unless the
+ * client wants their alignments in another form than the workers'.
+ */
 static void
-forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
+forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results, RESULT_CACHE *cache, char *key, int keylen)
 {
   P7_TOPHITS         th;
   P7_PIPELINE        *pli   = NULL;
-  P7_DOMAIN         **dcl   = NULL;
-  P7_HIT             *hits  = NULL;
+  P7_HIT            **hits  = NULL;  // the decoded hits, in rank order, for p7_tophits_Threshold()
+  P7_HITREF          *ref;
   int fd, n;
   uint8_t **buf, **buf2, **buf3, *buf_ptr, *buf2_ptr, *buf3_ptr;
   uint32_t nalloc, nalloc2, nalloc3, buf_offset, buf_offset2, buf_offset3;
+  uint64_t hits_len = 0;  // bytes of serialized hits
+  uint8_t *cached   = NULL;  // copy of what is sent, for the result cache
+  uint64_t cached_len;
+  uint64_t cached_pos;
   enum p7_pipemodes_e mode;
+  enum p7_aliform_e   form;
+  enum p7_aliform_e   wform;
   int i;
   // Initialize these pointers-to-pointers that we'll use for sending data
   buf_ptr = NULL;
@@ -793,8 +3328,14 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
 
   if (query->cmd_type == HMMD_CMD_SEARCH) mode = p7_SEARCH_SEQS;
   else                                    mode = p7_SCAN_MODELS;
+
+  /* alignments go to the client as strings, unless it asked for them compact or not at all */
+  if      (esl_opt_GetBoolean(query->opts, "--noali"))      form = p7_ALI_NONE;
+  else if (esl_opt_GetBoolean(query->opts, "--compactali")) form = p7_ALI_COMPACT;
+  else                                                      form = p7_ALI_FULL;
+  wform = esl_opt_GetBoolean(query->opts, "--noali") ? p7_ALI_NONE : p7_ALI_COMPACT;  /* as the workers sent them */
     
-  /* sort the hits and apply score and E-value thresholds */
+  /* apply score and E-value thresholds to the hits that can pass them */
   if (results->nhits > 0) {
     if(results->stats.hit_offsets != NULL){
       if ((results->stats.hit_offsets = realloc(results->stats.hit_offsets, results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
@@ -803,17 +3344,17 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
       if ((results->stats.hit_offsets = malloc(results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
 
-    // sort the hits 
-    qsort(results->hits, results->stats.nhits, sizeof(P7_HIT *), hit_sorter2);
+    // the hits are already sorted: gather_results() merged the workers' ranked runs
 
     th.unsrt     = NULL;
-    th.N         = results->stats.nhits;
+    th.N         = 0;
     th.nreported = 0;
     th.nincluded = 0;
     th.is_sorted_by_sortkey = 0;
     th.is_sorted_by_seqidx  = 0;
       
     pli = p7_pipeline_Create(query->opts, 100, 100, FALSE, mode);
+    if (esl_opt_IsOn(query->opts, "--topk")) pli->topk = esl_opt_GetInteger(query->opts, "--topk");   /* only for p7_tophits_Threshold() */
     pli->nmodels     = results->stats.nmodels;
     pli->nseqs       = results->stats.nseqs;
     pli->n_past_msv  = results->stats.n_past_msv;
@@ -827,7 +3368,23 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     pli->domZ_setby  = results->stats.domZ_setby;
 
 
-    th.hit = results->hits;
+    /* A hit the thresholds can't flag, that has no flags yet, comes
+     * out of p7_tophits_Threshold() unchanged, so only the others
+     * have to be deserialized for it. Decoded in rank order, they
+     * get the same --topk cutoff and domZ as the whole list would.
+     */
+    if ((hits = malloc(sizeof(P7_HIT *) * (results->stats.nhits+1))) == NULL) LOG_FATAL_MSG("malloc", errno);  /* +1: nhits may be 0 */
+    for (i = 0; i < results->stats.nhits; i++) {
+      ref = &results->hits[i];
+      if (form != wform ||
+          (ref->flags & (p7_IS_REPORTED | p7_IS_INCLUDED)) || ref->nreported || ref->nincluded || ref->ndomflagged ||
+          (! pli->use_bit_cutoffs && !(ref->flags & p7_IS_DUPLICATE) && p7_pli_TargetReportable(pli, ref->score, ref->lnP)))
+        {
+          decode_hitref(ref);
+          hits[th.N++] = ref->hit;
+        }
+    }
+    th.hit = hits;
 
     p7_tophits_Threshold(&th, pli);
 
@@ -848,13 +3405,15 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
   nalloc = 0;
   buf_offset = 0;
 
-  // First, the buffer of hits
+  // First, the offsets of the hits. Each hit is serialized into a
+  // scratch buffer just to learn its size, so the serialized hits
+  // never all have to be in memory at once
   for(i =0; i< results->stats.nhits; i++){
    
-    results->stats.hit_offsets[i] = buf_offset;
-    if(p7_hit_Serialize(results->hits[i], buf, &buf_offset, &nalloc) != eslOK){
-      LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
-    }
+    results->stats.hit_offsets[i] = hits_len;
+    buf_offset = 0;
+    serialize_hitref(&results->hits[i], form, NULL, &buf_offset, NULL);
+    hits_len += buf_offset;
 
   }
   if(results->stats.nhits == 0){
@@ -869,7 +3428,7 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATS failed", errno);
   }
 
-  results->status.msg_size = buf_offset + buf_offset2; // set size of second message
+  results->status.msg_size = hits_len + buf_offset2; // set size of second message
   
   // Third, the buffer with the HMMD_SEARCH_STATUS object
   buf_offset3 = 0;
@@ -878,6 +3437,15 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
   }
 
+  // keep a copy for the result cache, if the results are small enough to cache
+  cached_len = buf_offset3 + results->status.msg_size;
+  if (key != NULL && rcache_fits(cache, keylen, cached_len)) {
+    if ((cached = malloc(cached_len)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(cached,               buf3_ptr, buf_offset3);
+    memcpy(cached + buf_offset3, buf2_ptr, buf_offset2);
+    cached_pos = buf_offset3 + buf_offset2;
+  }
+
   // Now, send the buffers in the reverse of the order they were built
   /* send back a successful status message */
   n = buf_offset3;
@@ -894,30 +3462,54 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
     goto CLEAR;
   }
-  //printf("%p\n", results->hits[1]);
-  // and finally the hits 
-  n=buf_offset;
 
-  if (writen(fd, buf_ptr, n) != n) {
-    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
-    goto CLEAR;
+  // and finally the hits, a chunk at a time. Each decoded hit is
+  // freed once it is on its way
+  buf_offset = 0;
+  for(i =0; i< results->stats.nhits; i++){
+    ref = &results->hits[i];
+    serialize_hitref(ref, form, buf, &buf_offset, &nalloc);
+    if (ref->hit != NULL) p7_hit_Destroy(ref->hit);
+    ref->hit = NULL;
+
+    if (buf_offset >= HMMD_HIT_CHUNK || i == results->stats.nhits-1) {
+      n = buf_offset;
+      if (writen(fd, buf_ptr, n) != n) {
+        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+        goto CLEAR;
+      }
+      if (cached != NULL) {
+        memcpy(cached + cached_pos, buf_ptr, n);
+        cached_pos += n;
+      }
+      buf_offset = 0;
+    }
   }
   printf("Results for %s (%d) sent %" PRId64 " bytes\n", query->ip_addr, fd, results->status.msg_size);
+  p7_PROBE2(hmmpgmd__send, query->query_id, results->status.msg_size);
+
+  if (cached != NULL) {
+    rcache_insert(cache, key, keylen, cached, cached_len);  /* the cache takes over <cached> */
+    cached = NULL;
+  }
   printf("Hits:%"PRId64 "  reported:%" PRId64 "  included:%"PRId64 "\n", results->stats.nhits, results->stats.nreported, results->stats.nincluded);
   fflush(stdout);
 
  CLEAR:
   /* free all the data */
   for(i = 0; i < results->stats.nhits; i++){
-    p7_hit_Destroy(results->hits[i]);
+    if (results->hits[i].hit != NULL) p7_hit_Destroy(results->hits[i].hit);
   }
+  for(i = 0; i < results->nbufs; i++) free(results->bufs[i]);
+  if (cached != NULL) free(cached);
 
   free(results->hits);
+  free(results->bufs);
   results->hits = NULL;
+  results->bufs = NULL;
 
   if (pli)  p7_pipeline_Destroy(pli);
   if (hits) free(hits);
-  if (dcl)  free(dcl);
   if(buf_ptr != NULL){
     free(buf_ptr);
   }
@@ -937,58 +3529,48 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
 static void
 destroy_worker(WORKER_DATA *worker)
 {
-  int i;
-  if (worker == NULL)
+  if (worker != NULL)
   {
-    if (worker->err_buf  != NULL) free(worker->err_buf);
-    if (worker->hits != NULL){
-      for(i = 0; i < worker->allocated_hits; i++){
-        p7_hit_Destroy(worker->hits[i]);
-      }
-      free(worker->hits);
-    }
+    pthread_mutex_destroy(&worker->send_mutex);
     memset(worker, 0, sizeof(WORKER_DATA));
     free(worker);
   }
 }
 
+/* clear_parts()
+ * Free what is left of the workers' replies once gather_results()
+ * has taken the hits it wanted, and the parts themselves.
+ */
 static void
-clear_results(WORKERSIDE_ARGS *args, SEARCH_RESULTS *results)
+clear_parts(ACTIVE_SEARCH *search)
 {
-  int i;
-  int n;
-  WORKER_DATA *worker;
-
-  /* lock the workers until we have freed the results */
-  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
-  assert(validate_workers(args));
+  SEARCH_PART *part;
+  int i;
 
-  /* free all the results */
-  worker = args->head;
-  while (worker != NULL) {
-    if (worker->err_buf  != NULL) free(worker->err_buf);
-    if(worker->hits != NULL){
-      for(i =0; i < worker->allocated_hits; i++){
-        p7_hit_Destroy(worker->hits[i]);
-      }
-      free(worker->hits);
-      worker->hits = NULL;
-    }
-    worker->err_buf  = NULL;
-      
-    worker->completed = 0;
-    worker = worker->next;
+  for (i = 0; i < search->nparts && search->parts != NULL; i++) {
+    part = &search->parts[i];
+    if (part->err_buf != NULL) free(part->err_buf);
+    if (part->refs    != NULL) free(part->refs);
+    if (part->hit_buf != NULL) free(part->hit_buf);
   }
 
-  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+  if (search->parts != NULL) free(search->parts);
+  search->parts = NULL;
+}
+
+static void
+clear_results(SEARCH_RESULTS *results)
+{
+  int i;
 
-  for (i = 0; i < results->nhits; ++i) {
-    if (results->hits[i]  != NULL) p7_hit_Destroy(results->hits[i]);
-    results->hits[i]  = NULL;
+  for (i = 0; i < results->stats.nhits && results->hits != NULL; ++i) {
+    if (results->hits[i].hit != NULL) p7_hit_Destroy(results->hits[i].hit);
+    results->hits[i].hit = NULL;
   }
+  for (i = 0; i < results->nbufs; ++i) free(results->bufs[i]);
 
   if (results->hits != NULL) free(results->hits);
+  if (results->bufs != NULL) free(results->bufs);
   init_results(results);
 }
 
@@ -998,7 +3580,7 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
   QUEUE_DATA    *parms    = NULL;     /* cmd to queue           */
   HMMD_COMMAND  *cmd      = NULL;     /* parsed cmd to process  */
   int            fd       = data->sock_fd;
-  ESL_STACK     *cmdstack = data->cmdstack;
+  CMD_QUEUE     *cmdqueue = data->cmdqueue;
   char          *s;
   time_t         date;
   char           timestamp[32];
@@ -1021,6 +3603,13 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
       cmd->hdr.length  = 0;
       cmd->hdr.command = HMMD_CMD_SHUTDOWN;
     } 
+  else if (strcmp(s, "reload") == 0)
+    {
+      if ((cmd = malloc(sizeof(HMMD_HEADER))) == NULL) LOG_FATAL_MSG("malloc", errno);
+      memset(cmd, 0, sizeof(HMMD_HEADER)); /* avoid uninit bytes & valgrind bitching. Remove, if we ever serialize structs correctly. */
+      cmd->hdr.length  = 0;
+      cmd->hdr.command = HMMD_CMD_RELOAD;
+    }
   else 
     {
       client_msg(fd, eslEINVAL, "Unknown command %s\n", s);
@@ -1048,68 +3637,105 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
   printf("Queuing command %d from %s (%d)\n", cmd->hdr.command, parms->ip_addr, parms->sock);
   fflush(stdout);
 
-  esl_stack_PPush(cmdstack, parms);
+  p7_PROBE3(hmmpgmd__recv, parms->cmd_type, parms->sock, parms->nbatch);
+  push_cmd(cmdqueue, parms);
 }
 
+/* request_length()
+ * Returns the length of the first complete request in the <amount>
+ * bytes of client input in <buffer>: everything through the first
+ * line that starts with "//", which terminates a request. Returns 0
+ * if no request is complete yet. A client may pipeline requests, so
+ * more input can follow.
+ */
 static int
-clientside_loop(CLIENTSIDE_ARGS *data)
+request_length(char *buffer, int amount)
 {
-  int                status;
+  int i = 0;
+
+  while (i < amount) {
+    if (i + 1 < amount && buffer[i] == '/' && buffer[i+1] == '/') {
+      while (i < amount && buffer[i] != '\n') ++i;
+      return (i < amount) ? i + 1 : amount;
+    }
+    while (i < amount && buffer[i] != '\n') ++i;
+    ++i;
+  }
+  return 0;
+}
+
+/* split_request()
+ * Cut the first complete request, of length <n>, off the <amount>
+ * bytes of input in <buffer> (allocated for <buf_size>), and
+ * '\0'-terminate it. Whatever follows it is moved into a new buffer,
+ * returned in <*ret_rest>, <*ret_size> and <*ret_amount>; or
+ * <*ret_rest> is NULL if nothing does.
+ */
+static void
+split_request(char *buffer, int n, int amount, char **ret_rest, int *ret_size, int *ret_amount)
+{
+  char *rest = NULL;
+  int   size = 0;
+
+  if (n < amount) {
+    size = ESL_MAX(MAX_BUFFER, amount - n + 1);
+    if ((rest = malloc(size)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memcpy(rest, buffer + n, amount - n);
+  }
+  buffer[n] = 0;
+
+  *ret_rest   = rest;
+  *ret_size   = size;
+  *ret_amount = (rest == NULL) ? 0 : amount - n;
+}
 
+#ifndef HAVE_SYS_EPOLL_H
+/* clientside_loop()
+ * Read and handle one request from the client. Input the client has
+ * already sent past the end of that request is carried over to the
+ * next call in <*carry>, <*carry_size> and <*carry_amount>.
+ */
+static int
+clientside_loop(CLIENTSIDE_ARGS *data, char **carry, int *carry_size, int *carry_amount)
+{
   char              *ptr;
   char              *buffer;
-  char               opt_str[MAX_BUFFER];
-
-  int                dbx;
   int                buf_size;
   int                remaining;
   int                amount;
   int                eod;
   int                n;
 
-  P7_HMM            *hmm     = NULL;     /* query HMM                      */
-  ESL_SQ            *seq     = NULL;     /* query sequence                 */
-  ESL_SCOREMATRIX   *sco     = NULL;     /* scoring matrix                 */
-  P7_HMMFILE        *hfp     = NULL;
-  ESL_ALPHABET      *abc     = NULL;     /* digital alphabet               */
-  ESL_GETOPTS       *opts    = NULL;     /* search specific options        */
-  HMMD_COMMAND      *cmd     = NULL;     /* search cmd to send to workers  */
-
-  ESL_STACK         *cmdstack = data->cmdstack;
-  QUEUE_DATA        *parms;
-  jmp_buf            jmp_env;
-  time_t             date;
-  char               timestamp[32];
-
-  buf_size = MAX_BUFFER;
-  if ((buffer  = malloc(buf_size))   == NULL) LOG_FATAL_MSG("malloc", errno);
-  ptr = buffer;
-  remaining = buf_size;
-  amount = 0;
+  if (*carry != NULL) {
+    buffer   = *carry;
+    buf_size = *carry_size;
+    amount   = *carry_amount;
+    *carry   = NULL;
+  } else {
+    buf_size = MAX_BUFFER;
+    if ((buffer  = malloc(buf_size))   == NULL) LOG_FATAL_MSG("malloc", errno);
+    amount = 0;
+  }
+  ptr = buffer + amount;
+  remaining = buf_size - amount;
 
-  eod = 0;
+  eod = request_length(buffer, amount);
   while (!eod) {
-    int   l;
-    char *s;
 
     /* Receive message from client */
     if ((n = read(data->sock_fd, ptr, remaining)) < 0) {
       p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, data->ip_addr, errno, strerror(errno));
+      free(buffer);
       return 1;
     }
 
-    if (n == 0) return 1;
+    if (n == 0) { free(buffer); return 1; }
 
     ptr += n;
     amount += n;
     remaining -= n;
 
-    /* scan backwards till we hit the start of the line */
-    l = amount;
-    s = ptr - 1;
-    while (l-- > 0 && (*s == '\n' || *s == '\r')) --s;
-    while (l-- > 0 && (*s != '\n' && *s != '\r')) --s;
-    eod = (amount > 1 && *(s + 1) == '/' && *(s + 2) == '/' );
+    eod = request_length(buffer, amount);
 
     /* if the buffer is full, make it larger */
     if (!eod && remaining == 0) {
@@ -1120,12 +3746,152 @@ clientside_loop(CLIENTSIDE_ARGS *data)
     }
   }
 
-  /* zero terminate the buffer */
-  if (remaining == 0) {
+  /* make room to zero terminate the request */
+  if (eod == buf_size) {
     if ((buffer = realloc(buffer, buf_size + 1)) == NULL) LOG_FATAL_MSG("realloc", errno);
-    ptr = buffer + buf_size;
   }
-  *ptr = 0;
+  split_request(buffer, eod, amount, carry, carry_size, carry_amount);
+
+  return clientside_request(data, buffer);
+}
+#endif /*HAVE_SYS_EPOLL_H*/
+
+/* clientside_request()
+ * Parse one complete, '\0'-terminated client request in <buffer>,
+ * and queue it on <data->cmdqueue>; or report an error to the client.
+ * Takes ownership of <buffer>, and frees it. Returns 0.
+ */
+/* build_command()
+ * Build the search command that is sent to the workers for query
+ * sequence <seq> or HMM <hmm>, in alphabet <abc>, against database
+ * <dbx> (1..n) with options <opts>, given by string <opt_str>.
+ */
+static HMMD_COMMAND *
+build_command(char *opt_str, int dbx, ESL_GETOPTS *opts, ESL_SQ *seq, P7_HMM *hmm, ESL_ALPHABET *abc)
+{
+  HMMD_COMMAND *cmd = NULL;
+  char         *ptr;
+  int           n;
+
+  n = sizeof(HMMD_COMMAND);
+  n = n + strlen(opt_str) + 1;
+
+  if (seq != NULL) {
+    n = n + strlen(seq->name) + 1;
+    n = n + strlen(seq->desc) + 1;
+    n = n + seq->n + 2;
+  } else {
+    n = n + sizeof(P7_HMM);
+    n = n + sizeof(float) * (hmm->M + 1) * p7H_NTRANSITIONS;
+    n = n + sizeof(float) * (hmm->M + 1) * abc->K;
+    n = n + sizeof(float) * (hmm->M + 1) * abc->K;
+    if (hmm->name   != NULL)    n = n + strlen(hmm->name) + 1;
+    if (hmm->acc    != NULL)    n = n + strlen(hmm->acc)  + 1;
+    if (hmm->desc   != NULL)    n = n + strlen(hmm->desc) + 1;
+    if (hmm->flags & p7H_RF)    n = n + hmm->M + 2;
+    if (hmm->flags & p7H_MMASK) n = n + hmm->M + 2;
+    if (hmm->flags & p7H_CONS)  n = n + hmm->M + 2;
+    if (hmm->flags & p7H_CS)    n = n + hmm->M + 2;
+    if (hmm->flags & p7H_CA)    n = n + hmm->M + 2;
+    if (hmm->flags & p7H_MAP)   n = n + sizeof(int) * (hmm->M + 1);
+  }
+
+  if ((cmd = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(cmd, 0, n);		/* silence valgrind bitching about uninit bytes; remove if we ever serialize structs properly */
+  cmd->hdr.length       = n - sizeof(HMMD_HEADER);
+  cmd->hdr.command      = (esl_opt_IsUsed(opts, "--seqdb")) ? HMMD_CMD_SEARCH : HMMD_CMD_SCAN;
+  cmd->srch.db_inx      = dbx - 1;   /* the program indexes databases 0 .. n-1 */
+  cmd->srch.opts_length = strlen(opt_str) + 1;
+
+  ptr = cmd->srch.data;
+
+  memcpy(ptr, opt_str, cmd->srch.opts_length);
+  ptr += cmd->srch.opts_length;
+  
+  if (seq != NULL) {
+    cmd->srch.query_type   = HMMD_SEQUENCE;
+    cmd->srch.query_length = seq->n + 2;
+
+    n = strlen(seq->name) + 1;
+    memcpy(ptr, seq->name, n);
+    ptr += n;
+
+    n = strlen(seq->desc) + 1;
+    memcpy(ptr, seq->desc, n);
+    ptr += n;
+
+    n = seq->n + 2;
+    memcpy(ptr, seq->dsq, n);
+    ptr += n;
+  } else {
+    cmd->srch.query_type   = HMMD_HMM;
+    cmd->srch.query_length = hmm->M;
+
+    n = sizeof(P7_HMM);
+    memcpy(ptr, hmm, n);
+    ptr += n;
+
+    n = sizeof(float) * (hmm->M + 1) * p7H_NTRANSITIONS;
+    memcpy(ptr, *hmm->t, n);
+    ptr += n;
+
+    n = sizeof(float) * (hmm->M + 1) * abc->K;
+    memcpy(ptr, *hmm->mat, n);
+    ptr += n;
+    memcpy(ptr, *hmm->ins, n);
+    ptr += n;
+
+    if (hmm->name) { n = strlen(hmm->name) + 1;  memcpy(ptr, hmm->name, n);  ptr += n; }
+    if (hmm->acc)  { n = strlen(hmm->acc)  + 1;  memcpy(ptr, hmm->acc, n);   ptr += n; }
+    if (hmm->desc) { n = strlen(hmm->desc) + 1;  memcpy(ptr, hmm->desc, n);  ptr += n; }
+
+    n = hmm->M + 2;
+    if (hmm->flags & p7H_RF)    { memcpy(ptr, hmm->rf,        n); ptr += n; }
+    if (hmm->flags & p7H_MMASK) { memcpy(ptr, hmm->mm,        n); ptr += n; }
+    if (hmm->flags & p7H_CONS)  { memcpy(ptr, hmm->consensus, n); ptr += n; }
+    if (hmm->flags & p7H_CS)    { memcpy(ptr, hmm->cs,        n); ptr += n; }
+    if (hmm->flags & p7H_CA)    { memcpy(ptr, hmm->ca,        n); ptr += n; }
+
+    if (hmm->flags & p7H_MAP) {
+      n = sizeof(int) * (hmm->M + 1);
+      memcpy(ptr, hmm->map, n);
+      ptr += n;
+    }
+  }
+
+  return cmd;
+}
+
+static int
+clientside_request(CLIENTSIDE_ARGS *data, char *buffer)
+{
+  int                status;
+
+  char              *ptr;
+  char               opt_str[MAX_BUFFER];
+
+  int                dbx;
+  int                n;
+
+  P7_HMM            *hmm     = NULL;     /* query HMM                      */
+  ESL_SQ            *seq     = NULL;     /* query sequence                 */
+  ESL_SCOREMATRIX   *sco     = NULL;     /* scoring matrix                 */
+  P7_HMMFILE        *hfp     = NULL;
+  ESL_ALPHABET      *abc     = NULL;     /* digital alphabet               */
+  ESL_GETOPTS       *opts    = NULL;     /* search specific options        */
+  HMMD_COMMAND      *cmd     = NULL;     /* search cmd to send to workers  */
+  ESL_SQ           **batch_sq = NULL;    /* query sequences of a batch scan */
+  int                nbatch   = 0;
+  char              *rec      = NULL;    /* one record of a batch, terminated */
+  char              *end;
+  int                i;
+
+  CMD_QUEUE         *cmdqueue = data->cmdqueue;
+  QUEUE_DATA        *parms;
+  QUEUE_DATA        *member;
+  jmp_buf            jmp_env;
+  time_t             date;
+  char               timestamp[32];
 
   /* skip all leading white spaces */
   ptr = buffer;
@@ -1188,7 +3954,37 @@ clientside_loop(CLIENTSIDE_ARGS *data)
     seq = NULL;
     hmm = NULL;
 
-    if (*ptr == '>') {
+    if (*ptr == '>' && esl_opt_IsUsed(opts, "--hmmdb")) {
+      /* a scan may be of several sequences at once: parse each record,
+       * terminated as the daemon format wants it
+       */
+      for (n = 1, end = ptr + 1; (end = strstr(end, "\n>")) != NULL; end++) n++;
+      if ((batch_sq = malloc(sizeof(ESL_SQ *) * n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+      if ((rec      = malloc(strlen(ptr) + 4))      == NULL) LOG_FATAL_MSG("malloc", errno);
+
+      while (*ptr == '>') {
+        if ((end = strstr(ptr, "\n>")) != NULL) end++;
+        else                                   end = ptr + strlen(ptr);
+        memcpy(rec, ptr, end - ptr);
+        strcpy(rec + (end - ptr), "//\n");
+
+        batch_sq[nbatch] = esl_sq_CreateDigital(abc);
+        status = esl_sqio_Parse(rec, strlen(rec), batch_sq[nbatch++], eslSQFILE_DAEMON);
+        if (status != eslOK) client_msg_longjmp(data->sock_fd, status, &jmp_env, "Error parsing FASTA sequence %d", nbatch);
+        if (batch_sq[nbatch-1]->n < 1) client_msg_longjmp(data->sock_fd, eslEFORMAT, &jmp_env, "Error zero length FASTA sequence %d", nbatch);
+        ptr = end;
+      }
+      free(rec);
+      rec = NULL;
+
+      if (nbatch == 1) {
+        seq = batch_sq[0];
+        free(batch_sq);
+        batch_sq = NULL;
+        nbatch   = 0;
+      }
+
+    } else if (*ptr == '>') {
       /* try to parse the input buffer as a FASTA sequence */
       seq = esl_sq_CreateDigital(abc);
       /* try to parse the input buffer as a FASTA sequence */
@@ -1221,98 +4017,42 @@ clientside_loop(CLIENTSIDE_ARGS *data)
     if (hmm  != NULL) p7_hmm_Destroy(hmm);
     if (seq  != NULL) esl_sq_Destroy(seq);
     if (sco  != NULL) esl_scorematrix_Destroy(sco);
+    for (i = 0; i < nbatch; i++) esl_sq_Destroy(batch_sq[i]);
+    if (batch_sq != NULL) free(batch_sq);
+    if (rec      != NULL) free(rec);
 
     free(buffer);
     return 0;
-  }
-
-  if ((parms = malloc(sizeof(QUEUE_DATA))) == NULL) LOG_FATAL_MSG("malloc", errno);
-
-  /* build the search structure that will be sent to all the workers */
-  n = sizeof(HMMD_COMMAND);
-  n = n + strlen(opt_str) + 1;
-
-  if (seq != NULL) {
-    n = n + strlen(seq->name) + 1;
-    n = n + strlen(seq->desc) + 1;
-    n = n + seq->n + 2;
-  } else {
-    n = n + sizeof(P7_HMM);
-    n = n + sizeof(float) * (hmm->M + 1) * p7H_NTRANSITIONS;
-    n = n + sizeof(float) * (hmm->M + 1) * abc->K;
-    n = n + sizeof(float) * (hmm->M + 1) * abc->K;
-    if (hmm->name   != NULL)    n = n + strlen(hmm->name) + 1;
-    if (hmm->acc    != NULL)    n = n + strlen(hmm->acc)  + 1;
-    if (hmm->desc   != NULL)    n = n + strlen(hmm->desc) + 1;
-    if (hmm->flags & p7H_RF)    n = n + hmm->M + 2;
-    if (hmm->flags & p7H_MMASK) n = n + hmm->M + 2;
-    if (hmm->flags & p7H_CONS)  n = n + hmm->M + 2;
-    if (hmm->flags & p7H_CS)    n = n + hmm->M + 2;
-    if (hmm->flags & p7H_CA)    n = n + hmm->M + 2;
-    if (hmm->flags & p7H_MAP)   n = n + sizeof(int) * (hmm->M + 1);
-  }
-
-  if ((cmd = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
-  memset(cmd, 0, n);		/* silence valgrind bitching about uninit bytes; remove if we ever serialize structs properly */
-  cmd->hdr.length       = n - sizeof(HMMD_HEADER);
-  cmd->hdr.command      = (esl_opt_IsUsed(opts, "--seqdb")) ? HMMD_CMD_SEARCH : HMMD_CMD_SCAN;
-  cmd->srch.db_inx      = dbx - 1;   /* the program indexes databases 0 .. n-1 */
-  cmd->srch.opts_length = strlen(opt_str) + 1;
-
-  ptr = cmd->srch.data;
-
-  memcpy(ptr, opt_str, cmd->srch.opts_length);
-  ptr += cmd->srch.opts_length;
-  
-  if (seq != NULL) {
-    cmd->srch.query_type   = HMMD_SEQUENCE;
-    cmd->srch.query_length = seq->n + 2;
-
-    n = strlen(seq->name) + 1;
-    memcpy(ptr, seq->name, n);
-    ptr += n;
-
-    n = strlen(seq->desc) + 1;
-    memcpy(ptr, seq->desc, n);
-    ptr += n;
-
-    n = seq->n + 2;
-    memcpy(ptr, seq->dsq, n);
-    ptr += n;
-  } else {
-    cmd->srch.query_type   = HMMD_HMM;
-    cmd->srch.query_length = hmm->M;
-
-    n = sizeof(P7_HMM);
-    memcpy(ptr, hmm, n);
-    ptr += n;
-
-    n = sizeof(float) * (hmm->M + 1) * p7H_NTRANSITIONS;
-    memcpy(ptr, *hmm->t, n);
-    ptr += n;
-
-    n = sizeof(float) * (hmm->M + 1) * abc->K;
-    memcpy(ptr, *hmm->mat, n);
-    ptr += n;
-    memcpy(ptr, *hmm->ins, n);
-    ptr += n;
-
-    if (hmm->name) { n = strlen(hmm->name) + 1;  memcpy(ptr, hmm->name, n);  ptr += n; }
-    if (hmm->acc)  { n = strlen(hmm->acc)  + 1;  memcpy(ptr, hmm->acc, n);   ptr += n; }
-    if (hmm->desc) { n = strlen(hmm->desc) + 1;  memcpy(ptr, hmm->desc, n);  ptr += n; }
-
-    n = hmm->M + 2;
-    if (hmm->flags & p7H_RF)    { memcpy(ptr, hmm->rf,        n); ptr += n; }
-    if (hmm->flags & p7H_MMASK) { memcpy(ptr, hmm->mm,        n); ptr += n; }
-    if (hmm->flags & p7H_CONS)  { memcpy(ptr, hmm->consensus, n); ptr += n; }
-    if (hmm->flags & p7H_CS)    { memcpy(ptr, hmm->cs,        n); ptr += n; }
-    if (hmm->flags & p7H_CA)    { memcpy(ptr, hmm->ca,        n); ptr += n; }
+  }
 
-    if (hmm->flags & p7H_MAP) {
-      n = sizeof(int) * (hmm->M + 1);
-      memcpy(ptr, hmm->map, n);
-      ptr += n;
+  if ((parms = malloc(sizeof(QUEUE_DATA))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  parms->batch  = NULL;
+  parms->nbatch = 0;
+
+  if (nbatch > 1) {
+    /* a batch scan: the queries hold one sequence each, and share the alphabet */
+    if ((parms->batch = malloc(sizeof(QUEUE_DATA *) * nbatch)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    for (i = 0; i < nbatch; i++) {
+      if ((member = malloc(sizeof(QUEUE_DATA))) == NULL) LOG_FATAL_MSG("malloc", errno);
+      memset(member, 0, sizeof(QUEUE_DATA));
+      if (process_searchopts(data->sock_fd, opt_str, &member->opts) != eslOK) LOG_FATAL_MSG("esl_getopts_Create", eslEMEM);
+      member->seq        = batch_sq[i];
+      member->abc        = NULL;
+      member->dbx        = dbx - 1;
+      member->cmd        = build_command(opt_str, dbx, member->opts, member->seq, NULL, abc);
+      strcpy(member->ip_addr, data->ip_addr);
+      member->sock       = data->sock_fd;
+      member->cmd_type   = member->cmd->hdr.command;
+      member->query_type = HMMD_SEQUENCE;
+
+      parms->batch[i] = member;
+      batch_sq[i]     = NULL;
     }
+    parms->nbatch = nbatch;
+    seq = NULL;
+    cmd = NULL;
+  } else {
+    cmd = build_command(opt_str, dbx, opts, seq, hmm, abc);
   }
 
   parms->hmm  = hmm;
@@ -1321,56 +4061,277 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   parms->opts = opts;
   parms->dbx  = dbx - 1;
   parms->cmd  = cmd;
+  if (batch_sq != NULL) free(batch_sq);
 
   strcpy(parms->ip_addr, data->ip_addr);
   parms->sock       = data->sock_fd;
-  parms->cmd_type   = cmd->hdr.command;
-  parms->query_type = (seq != NULL) ? HMMD_SEQUENCE : HMMD_HMM;
+  parms->cmd_type   = (esl_opt_IsUsed(opts, "--seqdb")) ? HMMD_CMD_SEARCH : HMMD_CMD_SCAN;
+  parms->query_type = (hmm == NULL) ? HMMD_SEQUENCE : HMMD_HMM;
 
   date = time(NULL);
   ctime_r(&date, timestamp);
   printf("\n%s", timestamp);	/* note ctime_r() leaves \n on end of timestamp */
 
-  if (parms->seq != NULL) {
-    printf("Queuing %s %s from %s (%d)\n", (cmd->hdr.command == HMMD_CMD_SEARCH) ? "search" : "scan", parms->seq->name, parms->ip_addr, parms->sock);
+  if (parms->nbatch > 0) {
+    printf("Queuing scan of %d sequences from %s (%d)\n", parms->nbatch, parms->ip_addr, parms->sock);
+  } else if (parms->seq != NULL) {
+    printf("Queuing %s %s from %s (%d)\n", (parms->cmd_type == HMMD_CMD_SEARCH) ? "search" : "scan", parms->seq->name, parms->ip_addr, parms->sock);
   } else {
     printf("Queuing hmm %s from %s (%d)\n", parms->hmm->name, parms->ip_addr, parms->sock);
   }
   printf("%s", opt_str);	/* note opt_str already has trailing \n */
   fflush(stdout);
 
-  esl_stack_PPush(cmdstack, parms);
+  p7_PROBE3(hmmpgmd__recv, parms->cmd_type, parms->sock, parms->nbatch);
+  push_cmd(cmdqueue, parms);
 
   free(buffer);
   return 0;
 }
 
 
-/* discard_function()
- * function handed to esl_stack_DiscardSelected() to remove
- * all commands in the stack that are associated with a
- * particular client socket, because we're closing that
- * client down. Prototype to this is dictate by the generalized
- * interface to esl_stack_DiscardSelected().
+#ifdef HAVE_SYS_EPOLL_H
+/* close_conn()
+ * Shut down client connection <conn>: drop any of its commands still
+ * waiting on the queue, and release the socket and buffer.
+ */
+static void
+close_conn(CLIENTSIDE_POOL *pool, CLIENTSIDE_CONN *conn)
+{
+  discard_cmds(conn->args.cmdqueue, conn->args.sock_fd);
+
+  printf("Closing %s (%d)\n", conn->args.ip_addr, conn->args.sock_fd);
+  fflush(stdout);
+
+  epoll_ctl(pool->epoll_fd, EPOLL_CTL_DEL, conn->args.sock_fd, NULL);
+  close(conn->args.sock_fd);
+  if (conn->buffer != NULL) free(conn->buffer);
+  free(conn);
+}
+
+/* rearm_conn()
+ * Re-enable input events on <conn> once its current owner is done with it.
+ */
+static void
+rearm_conn(CLIENTSIDE_POOL *pool, CLIENTSIDE_CONN *conn)
+{
+  struct epoll_event ev;
+
+  ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  ev.data.ptr = conn;
+  if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_MOD, conn->args.sock_fd, &ev) < 0) LOG_FATAL_MSG("epoll_ctl", errno);
+}
+
+/* accept_conns()
+ * Accept every pending connection on the non-blocking listen socket
+ * and register each new client with the epoll set.
+ */
+static void
+accept_conns(CLIENTSIDE_POOL *pool)
+{
+  int                  n;
+  int                  fd;
+  int                  addrlen;
+  struct sockaddr_in   addr;
+  struct epoll_event   ev;
+  CLIENTSIDE_CONN     *conn;
+
+  for ( ;; ) {
+    n = sizeof(addr);
+    if ((fd = accept(pool->listen_fd, (struct sockaddr *)&addr, (unsigned int *)&n)) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      LOG_FATAL_MSG("accept", errno);
+    }
+
+    if ((conn = malloc(sizeof(CLIENTSIDE_CONN))) == NULL) LOG_FATAL_MSG("malloc", errno);
+    conn->args.cmdqueue = pool->cmdqueue;
+    conn->args.sock_fd  = fd;
+    conn->buffer        = NULL;
+    conn->buf_size      = 0;
+    conn->amount        = 0;
+    conn->next          = NULL;
+
+    addrlen = sizeof(conn->args.ip_addr);
+    strncpy(conn->args.ip_addr, inet_ntoa(addr.sin_addr), addrlen);
+    conn->args.ip_addr[addrlen-1] = 0;
+
+    ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) LOG_FATAL_MSG("epoll_ctl", errno);
+  }
+}
+
+/* queue_conn()
+ * Hand <conn>, which holds a complete request, to the pool.
+ */
+static void
+queue_conn(CLIENTSIDE_POOL *pool, CLIENTSIDE_CONN *conn)
+{
+  pthread_mutex_lock(&pool->mutex);
+  conn->next = NULL;
+  if (pool->tail == NULL) pool->head       = conn;
+  else                    pool->tail->next = conn;
+  pool->tail = conn;
+  pthread_cond_signal(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+/* read_conn()
+ * Drain whatever input is available on <conn> without blocking.
+ * Returns 1 if the client has gone away, 0 otherwise. When a complete
+ * request has arrived it is queued for the pool (even if the client
+ * has since hung up; the hangup is seen again once the pool re-arms
+ * the connection); otherwise the connection is re-armed to wait for
+ * more input.
+ *
+ * The client sockets themselves stay blocking, since results are
+ * written back to them with writen(); MSG_DONTWAIT keeps just these
+ * reads non-blocking.
  */
 static int
-discard_function(void *elemp, void *args)
+read_conn(CLIENTSIDE_POOL *pool, CLIENTSIDE_CONN *conn)
 {
-  QUEUE_DATA  *elem = (QUEUE_DATA *) elemp;
-  int          fd   = * (int *) args;
+  int n;
+  int eof = 0;
 
-  if (elem->sock == fd) 
-    {
-      free_QueueData(elem);
-      return TRUE;
+  for ( ;; ) {
+    if (conn->buffer == NULL) {
+      conn->buf_size = MAX_BUFFER;
+      conn->amount   = 0;
+      if ((conn->buffer = malloc(conn->buf_size)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    }
+
+    /* always leave room for the terminating '\0' */
+    if (conn->amount + 1 >= conn->buf_size) {
+      if ((conn->buffer = realloc(conn->buffer, conn->buf_size * 2)) == NULL) LOG_FATAL_MSG("realloc", errno);
+      conn->buf_size *= 2;
+    }
+
+    n = recv(conn->args.sock_fd, conn->buffer + conn->amount, conn->buf_size - conn->amount - 1, MSG_DONTWAIT);
+    if (n == 0) { eof = 1; break; }
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, conn->args.ip_addr, errno, strerror(errno));
+      return 1;
+    }
+    conn->amount += n;
+  }
+
+  if (conn->amount > 0 && request_length(conn->buffer, conn->amount) > 0) {
+    queue_conn(pool, conn);
+  } else if (eof) {
+    return 1;
+  } else {
+    rearm_conn(pool, conn);
+  }
+  return 0;
+}
+
+/* clientside_pool_thread()
+ * One of a small, fixed set of threads that parse complete client
+ * requests and push them onto the command queue. A client that
+ * pipelines its requests may have sent more than one; the rest stay
+ * on the connection, which goes straight back to the pool if another
+ * one is already complete.
+ */
+static void *
+clientside_pool_thread(void *arg)
+{
+  CLIENTSIDE_POOL *pool = (CLIENTSIDE_POOL *)arg;
+  CLIENTSIDE_CONN *conn;
+  char            *buffer;
+  int              n;
+
+  pthread_detach(pthread_self());
+
+  for ( ;; ) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->head == NULL) pthread_cond_wait(&pool->cond, &pool->mutex);
+    conn       = pool->head;
+    pool->head = conn->next;
+    if (pool->head == NULL) pool->tail = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+
+    buffer = conn->buffer;
+    n      = request_length(buffer, conn->amount);
+    split_request(buffer, n, conn->amount, &conn->buffer, &conn->buf_size, &conn->amount);
+    clientside_request(&conn->args, buffer);
+
+    if (conn->buffer != NULL && request_length(conn->buffer, conn->amount) > 0) queue_conn(pool, conn);
+    else                                                                            rearm_conn(pool, conn);
+  }
+
+  pthread_exit(NULL);
+}
+
+/* client_comm_thread()
+ * Event-driven client layer: one thread multiplexes the listen socket
+ * and every client socket with epoll, and a fixed pool of
+ * CLIENT_POOL_THREADS threads turns complete requests into QUEUE_DATA
+ * on the command queue.
+ */
+static void *
+client_comm_thread(void *arg)
+{
+  int                  i;
+  int                  n;
+  int                  flags;
+  pthread_t            thread_id;
+  struct epoll_event   ev;
+  struct epoll_event   events[CLIENT_MAX_EVENTS];
+  CLIENTSIDE_CONN     *conn;
+  CLIENTSIDE_POOL     *pool;
+  CLIENTSIDE_ARGS     *data     = (CLIENTSIDE_ARGS *)arg;
+
+  if ((pool = malloc(sizeof(CLIENTSIDE_POOL))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  pool->listen_fd = data->sock_fd;
+  pool->cmdqueue  = data->cmdqueue;
+  pool->head      = NULL;
+  pool->tail      = NULL;
+  if ((n = pthread_mutex_init(&pool->mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+  if ((n = pthread_cond_init(&pool->cond, NULL))   != 0) LOG_FATAL_MSG("cond init", n);
+
+  if ((pool->epoll_fd = epoll_create1(0)) < 0) LOG_FATAL_MSG("epoll_create", errno);
+
+  if ((flags = fcntl(pool->listen_fd, F_GETFL, 0)) < 0)              LOG_FATAL_MSG("fcntl", errno);
+  if (fcntl(pool->listen_fd, F_SETFL, flags | O_NONBLOCK) < 0)       LOG_FATAL_MSG("fcntl", errno);
+
+  ev.events   = EPOLLIN;
+  ev.data.ptr = NULL;             /* NULL marks the listen socket */
+  if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, pool->listen_fd, &ev) < 0) LOG_FATAL_MSG("epoll_ctl", errno);
+
+  for (i = 0; i < CLIENT_POOL_THREADS; ++i)
+    if ((n = pthread_create(&thread_id, NULL, clientside_pool_thread, pool)) != 0) LOG_FATAL_MSG("thread create", n);
+
+  for ( ;; ) {
+    if ((n = epoll_wait(pool->epoll_fd, events, CLIENT_MAX_EVENTS, -1)) < 0) {
+      if (errno == EINTR) continue;
+      LOG_FATAL_MSG("epoll_wait", errno);
+    }
+
+    for (i = 0; i < n; ++i) {
+      conn = (CLIENTSIDE_CONN *) events[i].data.ptr;
+      if (conn == NULL) { accept_conns(pool); continue; }
+
+      /* read first, so a request sent just before hangup is not lost */
+      if (read_conn(pool, conn)) close_conn(pool, conn);
     }
-  return FALSE;
+  }
+
+  pthread_exit(NULL);
 }
 
+#else /* thread-per-client fallback where epoll is unavailable */
+
 static void *
 clientside_thread(void *arg)
 {
   int              eof;
+  char            *carry        = NULL;
+  int              carry_size   = 0;
+  int              carry_amount = 0;
   CLIENTSIDE_ARGS *data = (CLIENTSIDE_ARGS *)arg;
 
   /* Guarantees that thread resources are deallocated upon return */
@@ -1378,11 +4339,12 @@ clientside_thread(void *arg)
 
   eof = 0;
   while (!eof) {
-    eof = clientside_loop(data);
+    eof = clientside_loop(data, &carry, &carry_size, &carry_amount);
   }
+  if (carry != NULL) free(carry);
 
-  /* remove any commands in stack associated with this client's socket */
-  esl_stack_DiscardSelected(data->cmdstack, discard_function, &(data->sock_fd));
+  /* remove any commands in the queue associated with this client's socket */
+  discard_cmds(data->cmdqueue, data->sock_fd);
 
   printf("Closing %s (%d)\n", data->ip_addr, data->sock_fd);
   fflush(stdout);
@@ -1413,7 +4375,7 @@ client_comm_thread(void *arg)
     if ((fd = accept(data->sock_fd, (struct sockaddr *)&addr, (unsigned int *)&n)) < 0) LOG_FATAL_MSG("accept", errno);
 
     if ((targs = malloc(sizeof(CLIENTSIDE_ARGS))) == NULL) LOG_FATAL_MSG("malloc", errno);
-    targs->cmdstack   = data->cmdstack;
+    targs->cmdqueue   = data->cmdqueue;
     targs->sock_fd    = fd;
 
     addrlen = sizeof(targs->ip_addr);
@@ -1425,6 +4387,7 @@ client_comm_thread(void *arg)
   
   pthread_exit(NULL);
 }
+#endif /*HAVE_SYS_EPOLL_H*/
 
 static void 
 setup_clientside_comm(ESL_GETOPTS *opts, CLIENTSIDE_ARGS *args)
@@ -1472,91 +4435,72 @@ setup_clientside_comm(ESL_GETOPTS *opts, CLIENTSIDE_ARGS *args)
 static void
 workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
 {
-  ESL_STOPWATCH      *w     = NULL;
   HMMD_SEARCH_STATS  *stats = NULL;
-  HMMD_COMMAND        cmd;
+  HMMD_REPLY          reply;
+  SEARCH_PART        *part;
+  SEARCH_PART       **prev;
+  double elapsed;
   int    n, i;
   int    size;
   int    total;
-  char  *ptr;
   uint8_t *buf; // Buffer to receive bytes into over sockets
+  uint32_t buf_alloc; // its allocated size
   uint32_t buf_position; //Index into buffer for deserialize
-  memset(&cmd, 0, sizeof(HMMD_COMMAND)); /* silence valgrind. if we ever serialize structs properly, remove */
-  w = esl_stopwatch_Create();
-
+  uint32_t chunk_len; // length of the next chunk of hits
+  uint32_t hit_len;   // bytes of hits read so far
+  uint32_t hit_alloc; // allocated size of the part's hit_buf
+  P7_HITREF ref;
+  memset(&reply, 0, sizeof(HMMD_REPLY)); /* silence valgrind. if we ever serialize structs properly, remove */
+
+  /* the search threads write the commands; this thread only reads
+   * the worker's replies, which come back in the order the worker
+   * finishes the searches
+   */
   for ( ; ; ) {
 
-    /* wait for the next search object */
-    if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
-    /* wait for the master's signal to start the calculations */
-    while (worker->cmd == NULL) {
-      if ((n = pthread_cond_wait(&data->start_cond, &data->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+    /* wait for the next reply */
+    if ((size = readn(worker->sock_fd, &reply, sizeof(HMMD_REPLY))) == -1) {
+      p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      break;
     }
 
-    if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
-
-    if (worker->cmd->hdr.command == HMMD_CMD_SHUTDOWN) {
-      fd_set rset;
-      struct timeval tv;
-      
-      n = MSG_SIZE(worker->cmd);
-      if (writen(worker->sock_fd, worker->cmd, n) != n) {
-        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-        break;
-      }
-
-      FD_ZERO(&rset);
-      FD_SET(worker->sock_fd, &rset);
-
-      tv.tv_sec = 2;
-      tv.tv_usec = 0;
+    if (reply.command == HMMD_CMD_SHUTDOWN) {
+      p7_syslog(LOG_ERR,"[%s:%d] - shutting down %s\n", __FILE__, __LINE__, worker->ip_addr);
+      break;
+    }
 
-      if ((n = select(worker->sock_fd + 1, &rset, NULL, NULL, &tv)) < 0) {
-        p7_syslog(LOG_ERR,"[%s:%d] - select %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+    /* a reload answer carries the newest database version the worker holds */
+    if (reply.command == HMMD_CMD_RELOAD) {
+      if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+      if ((int) reply.query_id > worker->db_version) {
+        worker->db_version = reply.query_id;
+        /* a worker catching up after the reload can drop the old version now */
+        if (!data->reloading && worker->db_version == data->db_version) send_release(worker, data->db_version);
       } else {
-        if (n == 0) {
-          p7_syslog(LOG_ERR,"[%s:%d] - shutdown %s is not responding\n", __FILE__, __LINE__, worker->ip_addr);
-        } else {
-          n = sizeof(HMMD_HEADER);
-          if ((size = readn(worker->sock_fd, &cmd, n)) == -1) {
-            p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-          }
-          if (cmd.hdr.command == HMMD_CMD_SHUTDOWN) {
-            p7_syslog(LOG_ERR,"[%s:%d] - shutting down %s\n", __FILE__, __LINE__, worker->ip_addr);
-          } else {
-            p7_syslog(LOG_ERR,"[%s:%d] - error shutting down %s - received %d\n", __FILE__, __LINE__, worker->ip_addr, cmd.hdr.command);
-          }
-        }
+        p7_syslog(LOG_ERR,"[%s:%d] - %s failed to reload, still at database version %u\n", __FILE__, __LINE__, worker->ip_addr, reply.query_id);
       }
-      break;
-    }
+      worker->reloading = 0;
+      if ((n = pthread_cond_broadcast(&data->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+      if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-    //printf ("Writing %d bytes to %s [MSG = %d/%d]\n", (int)MSG_SIZE(worker->cmd), worker->ip_addr, worker->cmd->hdr.command, worker->cmd->hdr.length);
+      printf ("WORKER %s RELOADED: database version %u\n", worker->ip_addr, reply.query_id);
+      fflush(stdout);
+      continue;
+    }
 
-    esl_stopwatch_Start(w);
+    /* find the search the reply belongs to */
+    if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+    for (part = worker->outstanding; part != NULL; part = part->next)
+      if (part->search->query_id == reply.query_id) break;
+    if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-    /* write search message in two parts */
-    n = sizeof(HMMD_HEADER) + sizeof(HMMD_SEARCH_CMD);
-    memcpy(&cmd, worker->cmd, n);
-    cmd.srch.inx = worker->srch_inx;
-    cmd.srch.cnt = worker->srch_cnt;
-    if (writen(worker->sock_fd, &cmd, n) != n) {
-      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+    if (part == NULL) {
+      p7_syslog(LOG_ERR,"[%s:%d] - unexpected reply %d for query %u from %s\n", __FILE__, __LINE__, reply.command, reply.query_id, worker->ip_addr);
       break;
     }
 
-    /* write remaining data, i.e. sequence, options etc. */
-    ptr = (char *)worker->cmd;
-    ptr += n;
-    n = MSG_SIZE(worker->cmd) - n;
-    if (writen(worker->sock_fd, ptr, n) != n) {
-      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-      break;
-    }
-    
-    total = 0;
-    worker->total = 0;
+    total       = sizeof(HMMD_REPLY);
+    part->reply = reply;
 
     n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
     buf = malloc(n);
@@ -1567,89 +4511,123 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
     total += n;
     if ((size = readn(worker->sock_fd, buf, n)) == -1) {
       p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      free(buf);
       break;
     }
 
     buf_position = 0;
-    if(hmmd_search_status_Deserialize(buf, &buf_position, &(worker->status)) != eslOK){
+    if(hmmd_search_status_Deserialize(buf, &buf_position, &(part->status)) != eslOK){
        LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATUS", errno);
     }
 
-    if (worker->status.status != eslOK) {
-      n = worker->status.msg_size;
+    if (part->status.status != eslOK) {
+      free(buf);
+      n = part->status.msg_size;
       total += n; 
-      if ((worker->err_buf = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
-      worker->err_buf[0] = 0;
-      if ((size = readn(worker->sock_fd, worker->err_buf, n)) == -1) {
+      if ((part->err_buf = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+      part->err_buf[0] = 0;
+      if ((size = readn(worker->sock_fd, part->err_buf, n)) == -1) {
         p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
         break;
       }
     } else {
 
-      // receive the results from the worker
-      buf = realloc(buf, worker->status.msg_size);
+      // receive the stats from the worker
+      buf = realloc(buf, part->status.msg_size);
       if(buf == NULL){
         LOG_FATAL_MSG("malloc", errno);
       }
+      buf_alloc = part->status.msg_size;
 
-      total += worker->status.msg_size;
-      if ((size = readn(worker->sock_fd, buf, worker->status.msg_size)) == -1) {
+      total += part->status.msg_size;
+      if ((size = readn(worker->sock_fd, buf, part->status.msg_size)) == -1) {
         p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+        free(buf);
         break;
       }
 
       buf_position = 0; // start at beginning of new buffer of data
       // Now, serialize the data structures out of it
-      if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(worker->stats)) != eslOK){
+      if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(part->stats)) != eslOK){
         LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATS", errno);
       }
-      stats = &worker->stats;
-      if(stats->nhits > 0){
-        worker->hits = malloc(stats->nhits * sizeof(P7_HIT *));
-        if(worker->hits == NULL){
-          LOG_FATAL_MSG("malloc", errno);
+      stats = &part->stats;
+      free(buf);
+
+      /* read in the hits, a chunk at a time, as the worker serialized
+       * them: the master only deserializes the ones it has to (see
+       * forward_results()). Scanning checks that each chunk holds
+       * whole hits, and counts them.
+       */
+      i         = 0;
+      hit_len   = 0;
+      hit_alloc = 0;
+      while (i < stats->nhits) {
+        if ((size = readn(worker->sock_fd, &chunk_len, sizeof(uint32_t))) == -1) break;
+        chunk_len = esl_ntoh32(chunk_len);
+        if (chunk_len == 0 || chunk_len > UINT32_MAX - hit_len) break;
+        if (hit_len + chunk_len > hit_alloc) {
+          hit_alloc = (hit_alloc > UINT32_MAX / 2) ? UINT32_MAX : ESL_MAX(2 * hit_alloc, hit_len + chunk_len);
+          if ((part->hit_buf = realloc(part->hit_buf, hit_alloc)) == NULL) LOG_FATAL_MSG("malloc", errno);
         }
-        worker->allocated_hits = stats->nhits;  // Need this if we have to destroy the worker because of an error
-        /* read in the hits */
-        for(i = 0; i < stats->nhits; i++){
-          worker->hits[i] = p7_hit_Create_empty();
-          if(worker->hits[i] == NULL){
-            LOG_FATAL_MSG("malloc", errno);
-          }
-          if(p7_hit_Deserialize(buf, &buf_position, worker->hits[i]) != eslOK){
-            LOG_FATAL_MSG("Couldn't deserialize P7_HIT", errno);
-          } 
+        total += sizeof(uint32_t) + chunk_len;
+        if ((size = readn(worker->sock_fd, part->hit_buf + hit_len, chunk_len)) == -1) break;
+
+        buf_position = hit_len;
+        hit_len     += chunk_len;
+        while (buf_position < hit_len && i < stats->nhits) {
+          if (p7_hit_Scan(part->hit_buf, &buf_position, hit_len, &ref) != eslOK) LOG_FATAL_MSG("Couldn't scan P7_HIT", EINVAL);
+          i++;
         }
       }
-      free(buf);
-    }
+      if (i < stats->nhits) {
+        p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+        break;
+      }
 
-    /* We've just allocated an array of pointers to P7_HIT objects and a bunch of P7_HIT 
-      objects that we don't free in this function.  Here's what happens to them.  gather_results() assembles
-      all of the P7_HIT objects from the different workers into one big list, which it passes to forward_results().  
-      gather_results() frees each worker's array of pointers to P7_HIT objects, and forward_results is responsible for 
-      freeing all of the P7_HIT objects when it's done with them */
+      /* index the hits, now that the buffer won't move again */
+      if (stats->nhits > 0) {
+        if ((part->refs = malloc(stats->nhits * sizeof(P7_HITREF))) == NULL) LOG_FATAL_MSG("malloc", errno);
+        for (buf_position = 0, i = 0; i < stats->nhits; i++)
+          p7_hit_Scan(part->hit_buf, &buf_position, hit_len, &part->refs[i]);
+      }
+    }
 
-    esl_stopwatch_Stop(w);
+    /* The part's hit_buf and refs aren't freed here.  gather_results() merges
+      all the parts' refs into one ranked list, and takes over their buffers, which
+      forward_results() (or, on an aggregator, clear_results()) frees when it's done */
 
     if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-    /* set the state of the worker to completed */
-    worker->cmd       = NULL;
-    worker->completed = 1;
-    worker->total     = total;
-    ++data->completed;
+    /* take the part off the worker's list and mark it completed; the
+     * search thread may free it as soon as the lock is released
+     */
+    for (prev = &worker->outstanding; *prev != part; prev = &(*prev)->next) ;
+    *prev = part->next;
+
+    part->completed = 1;
+    part->total     = total;
+    part->t_done    = hmmpgmd_Now();
+    ++part->search->ndone;
+    elapsed         = (part->status.status == eslOK) ? part->stats.elapsed : 0.0;
+
+    if (part->status.status == eslOK) {
+      worker->nparts++;
+      worker->busy += elapsed;
+      worker->mem_peak = ESL_MAX(worker->mem_peak, part->reply.mem_peak);
+      if (part->reply.mem_rss > 0) worker->mem_rss = part->reply.mem_rss;
+      if (part->search->query->cmd_type == HMMD_CMD_SEARCH) worker->nseqs   += part->srch_cnt;
+      else                                                  worker->nmodels += part->srch_cnt;
+    }
 
-    /* notify the master that a worker has completed */
+    /* notify the search that a worker has completed */
     if ((n = pthread_cond_broadcast(&data->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
     if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-    printf ("WORKER %s COMPLETED: %.2f sec received %d bytes\n", worker->ip_addr, w->elapsed, total);
+    printf ("WORKER %s COMPLETED query %u: %.2f sec received %d bytes\n", worker->ip_addr, reply.query_id, elapsed, total);
     fflush(stdout);
   }
 
-  esl_stopwatch_Destroy(w);
-
   return;
 }
 
@@ -1659,68 +4637,47 @@ workerside_thread(void *arg)
   HMMD_COMMAND     *cmd     = NULL;
   WORKER_DATA      *worker  = (WORKER_DATA *)arg;
   WORKERSIDE_ARGS  *parent  = (WORKERSIDE_ARGS *)worker->parent;
+  SEARCH_PART      *part    = NULL;
   HMMD_HEADER       hdr;
+  char              ip_addr[64];
   int               n;
   int               fd = 0;
   int               version;
   int               updated;
   int               status = eslOK;
-  char             *p;
 
   memset(&hdr, 0, sizeof(HMMD_HEADER)); /* silence valgrind; remove if/when we serialize structs properly */
 
   /* Guarantees that thread resources are deallocated upon return */
   pthread_detach(pthread_self()); 
 
+  strcpy(ip_addr, worker->ip_addr);
+
   printf("Handling worker %s (%d)\n", worker->ip_addr, worker->sock_fd);
   fflush(stdout);
 
   updated = 0;
   while (!updated) {
-    /* get the database version to load */
+    /* get the database version to load; a reload may swap the
+     * databases as soon as the lock is released
+     */
     if ((n = pthread_mutex_lock (&parent->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
     version = parent->db_version;
+    if (cmd != NULL) free(cmd);
+    if (parent->init_cmd != NULL) {
+      /* an aggregator passes on its master's databases */
+      if ((cmd = malloc(MSG_SIZE(parent->init_cmd))) != NULL) memcpy(cmd, parent->init_cmd, MSG_SIZE(parent->init_cmd));
+    } else {
+      cmd = init_command(HMMD_CMD_INIT, version, parent->seq_db, parent->hmm_db);
+      if (cmd != NULL && parent->img_port != 0) image_source(parent, worker, cmd);
+    }
     if ((n = pthread_mutex_unlock (&parent->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
 
-    n = sizeof(HMMD_COMMAND);
-    if (parent->seq_db != NULL) n += strlen(parent->seq_db->name) + 1;
-    if (parent->hmm_db != NULL) n += strlen(parent->hmm_db->name) + 1;
-
-    cmd = malloc(n);
     if (cmd == NULL) {
       p7_syslog(LOG_ERR,"[%s:%d] - malloc %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
       goto EXIT;
     }
-    memset(cmd, 0, n);
-
-    cmd->hdr.length  = n - sizeof(HMMD_HEADER);
-    cmd->hdr.command = HMMD_CMD_INIT;
-
-    p = cmd->init.data;
-
-    if (parent->seq_db != NULL) {
-      cmd->init.db_cnt      = parent->seq_db->db_cnt;
-      cmd->init.seq_cnt     = parent->seq_db->count;
-      cmd->init.seqdb_off   = p - cmd->init.data;
-
-      strncpy(cmd->init.sid, parent->seq_db->id, sizeof(cmd->init.sid));
-      cmd->init.sid[sizeof(cmd->init.sid)-1] = 0;
-
-      strcpy(p, parent->seq_db->name);
-      p += strlen(parent->seq_db->name) + 1;
-    }
-
-    if (parent->hmm_db != NULL) {
-      cmd->init.hmm_cnt     = 1;
-      cmd->init.model_cnt   = parent->hmm_db->n;
-      cmd->init.hmmdb_off   = p - cmd->init.data;
-
-      //strncpy(cmd->init.hid, parent->hmm_db->id, sizeof(cmd->init.hid));
-      //cmd->init.hid[sizeof(cmd->init.hid)-1] = 0;
-
-      strcpy(p, parent->hmm_db->name);
-      p += strlen(parent->hmm_db->name) + 1;
-    }
+    n = MSG_SIZE(cmd);
 
     if (writen(worker->sock_fd, cmd, n) != n) {
       p7_syslog(LOG_ERR,"[%s:%d] - writing (%d) error %d - %s\n", __FILE__, __LINE__, worker->sock_fd, errno, strerror(errno));
@@ -1772,10 +4729,13 @@ workerside_thread(void *arg)
      * the version has changed, force the worker to reload and verify.
      */
     if (version == parent->db_version) {
+      worker->db_version = version;
+      worker->db_low     = version;
       if (status == eslOK) {
         worker->next    = parent->pending;
         parent->pending = worker;
         ++parent->pend_cnt;
+        if ((n = pthread_cond_broadcast(&parent->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
       } else {
         worker->next   = parent->idling;
         parent->idling = worker;
@@ -1794,16 +4754,29 @@ workerside_thread(void *arg)
 
   workerside_loop(parent, worker);
 
-  if ((n = pthread_mutex_lock (&parent->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
+  /* stop the search threads writing to the connection */
+  if ((n = pthread_mutex_lock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
   fd = worker->sock_fd;
+  worker->sock_fd = -1;
+  if ((n = pthread_mutex_unlock (&worker->send_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  /* the worker may be destroyed once it is marked terminated */
+  strcpy(ip_addr, worker->ip_addr);
+
+  if ((n = pthread_mutex_lock (&parent->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
   ++parent->failed;
   ++parent->completed;
 
+  /* fail the shares of the searches the worker never answered */
+  while (worker->outstanding != NULL) {
+    part = worker->outstanding;
+    worker->outstanding = part->next;
+    part->completed = 0;
+    ++part->search->ndone;
+  }
+
   worker->terminated = 1;
-  worker->total      = 0;
-  worker->sock_fd    = -1;
 
   assert(validate_workers(parent));
 
@@ -1812,7 +4785,7 @@ workerside_thread(void *arg)
   if ((n = pthread_mutex_unlock (&parent->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
  EXIT:
-  printf("Closing worker %s (%d)\n", worker->ip_addr, fd);
+  printf("Closing worker %s (%d)\n", ip_addr, fd);
   fflush(stdout);
 
   if (cmd != NULL) free(cmd);
@@ -1843,10 +4816,11 @@ worker_comm_thread(void *arg)
     if ((worker = malloc(sizeof(WORKER_DATA))) == NULL) LOG_FATAL_MSG("thread create", errno);
     memset(worker, 0, sizeof(WORKER_DATA));
 
-    worker->parent     = data;
-    worker->sock_fd    = fd;
-    worker->allocated_hits = 0; // These may be redundant because of the memset earlier, but better safe than sorry
-    worker->hits = NULL;
+    worker->parent      = data;
+    worker->sock_fd     = fd;
+    worker->outstanding = NULL; // These may be redundant because of the memset earlier, but better safe than sorry
+    worker->sending     = 0;
+    if ((n = pthread_mutex_init(&worker->send_mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
 
     addrlen = sizeof(worker->ip_addr);
     strncpy(worker->ip_addr, inet_ntoa(addr.sin_addr), addrlen);
@@ -1902,6 +4876,236 @@ setup_workerside_comm(ESL_GETOPTS *opts, WORKERSIDE_ARGS *args)
   if ((n = pthread_create(&thread_id, NULL, worker_comm_thread, (void *)args)) != 0) LOG_FATAL_MSG("thread create", n);
 }
 
+
+/* The metrics port (--mport).
+ *
+ * A scrape is a plain HTTP GET; whatever the request, the answer is
+ * the master's counters in the Prometheus text exposition format:
+ * requests queued and in flight, workers, latency histograms per
+ * command, pipeline pass counts summed over the searches' results,
+ * per-worker targets and busy time (a rate() of one over the other is
+ * the worker's throughput), and the size of the cached databases.
+ * Counters reset when the master restarts, and a worker's when it
+ * reconnects.
+ */
+
+/* metrics_request()
+ * Count a request <query> answered in <elapsed> seconds, with
+ * results <stats>, or NULL if it failed.
+ */
+static void
+metrics_request(WORKERSIDE_ARGS *args, QUEUE_DATA *query, double elapsed, HMMD_SEARCH_STATS *stats)
+{
+  METRICS_HIST *h = &args->latency[query->cmd_type == HMMD_CMD_SEARCH ? 0 : 1];
+  int           b;
+  int           n;
+
+  for (b = 0; b < METRICS_NBUCKETS && elapsed > metrics_le[b]; b++) ;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  h->count++;
+  h->sum += elapsed;
+  h->bucket[b]++;
+  if (stats == NULL) h->failed++;
+  else {
+    args->ntargets    += (query->cmd_type == HMMD_CMD_SEARCH) ? stats->nseqs : stats->nmodels;
+    args->n_past_msv  += stats->n_past_msv;
+    args->n_past_bias += stats->n_past_bias;
+    args->n_past_vit  += stats->n_past_vit;
+    args->n_past_fwd  += stats->n_past_fwd;
+    args->nreported   += stats->nreported;
+  }
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* metrics_cached()
+ * Count a request answered from the result cache.
+ */
+static void
+metrics_cached(WORKERSIDE_ARGS *args)
+{
+  int n;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  args->ncached++;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* metrics_printf()
+ * Append to the growing string <*buf> of length <*len>, allocated
+ * for <*nalloc> bytes.
+ */
+static void
+metrics_printf(char **buf, int *len, int *nalloc, const char *format, ...)
+{
+  va_list ap;
+  int     n;
+
+  for ( ;; ) {
+    va_start(ap, format);
+    n = vsnprintf(*buf + *len, *nalloc - *len, format, ap);
+    va_end(ap);
+    if (n < 0) LOG_FATAL_MSG("vsnprintf", errno);
+    if (*len + n < *nalloc) break;
+    *nalloc = 2 * (*len + n + 1);
+    if ((*buf = realloc(*buf, *nalloc)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  }
+  *len += n;
+}
+
+/* metrics_format()
+ * Write the current metrics into <*buf>, of length <*len>.
+ */
+static void
+metrics_format(WORKERSIDE_ARGS *args, char **buf, int *len, int *nalloc)
+{
+  static const char *commands[2] = { "search", "scan" };
+  CMD_QUEUE   *q       = args->cmdqueue;
+  CMD_ENTRY   *e;
+  WORKER_DATA *worker;
+  uint64_t     cum;
+  int          nqueued = 0;
+  int          nworkers;
+  int          c, b, n;
+
+  /* the request queue has its own lock; take it first, never while holding <work_mutex> */
+  if ((n = pthread_mutex_lock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (e = q->head; e != NULL; e = e->next) nqueued++;
+  if ((n = pthread_mutex_unlock (&q->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  *len = 0;
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_start_time_seconds Time the master started, since the epoch.\n# TYPE hmmpgmd_start_time_seconds gauge\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_start_time_seconds %" PRId64 "\n", (int64_t) args->started);
+
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_queued_requests Requests waiting for a search slot.\n# TYPE hmmpgmd_queued_requests gauge\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_queued_requests %d\n", nqueued);
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_active_searches Searches in flight.\n# TYPE hmmpgmd_active_searches gauge\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_active_searches %d\n", args->nactive);
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_max_active_searches Most searches allowed in flight (--searches).\n# TYPE hmmpgmd_max_active_searches gauge\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_max_active_searches %d\n", args->max_active);
+
+  for (nworkers = 0, worker = args->head; worker != NULL; worker = worker->next)
+    if (!worker->terminated) nworkers++;
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_workers Workers connected, by state.\n# TYPE hmmpgmd_workers gauge\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_workers{state=\"ready\"} %d\n",   nworkers);
+  metrics_printf(buf, len, nalloc, "hmmpgmd_workers{state=\"pending\"} %d\n", args->pend_cnt);
+  metrics_printf(buf, len, nalloc, "hmmpgmd_workers{state=\"idle\"} %d\n",    args->idle_cnt);
+
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_request_duration_seconds Time from the start of a search to its answer.\n# TYPE hmmpgmd_request_duration_seconds histogram\n");
+  for (c = 0; c < 2; c++) {
+    METRICS_HIST *h = &args->latency[c];
+    for (cum = 0, b = 0; b < METRICS_NBUCKETS; b++) {
+      cum += h->bucket[b];
+      metrics_printf(buf, len, nalloc, "hmmpgmd_request_duration_seconds_bucket{command=\"%s\",le=\"%g\"} %" PRIu64 "\n", commands[c], metrics_le[b], cum);
+    }
+    metrics_printf(buf, len, nalloc, "hmmpgmd_request_duration_seconds_bucket{command=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", commands[c], h->count);
+    metrics_printf(buf, len, nalloc, "hmmpgmd_request_duration_seconds_sum{command=\"%s\"} %.6f\n",            commands[c], h->sum);
+    metrics_printf(buf, len, nalloc, "hmmpgmd_request_duration_seconds_count{command=\"%s\"} %" PRIu64 "\n",    commands[c], h->count);
+  }
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_failed_requests_total Requests answered with an error.\n# TYPE hmmpgmd_failed_requests_total counter\n");
+  for (c = 0; c < 2; c++)
+    metrics_printf(buf, len, nalloc, "hmmpgmd_failed_requests_total{command=\"%s\"} %" PRIu64 "\n", commands[c], args->latency[c].failed);
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_cached_requests_total Requests answered from the result cache.\n# TYPE hmmpgmd_cached_requests_total counter\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_cached_requests_total %" PRIu64 "\n", args->ncached);
+
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_pipeline_targets_total Targets past each stage of the pipeline, over all searches.\n# TYPE hmmpgmd_pipeline_targets_total counter\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_pipeline_targets_total{stage=\"searched\"} %" PRIu64 "\n", args->ntargets);
+  metrics_printf(buf, len, nalloc, "hmmpgmd_pipeline_targets_total{stage=\"msv\"} %" PRIu64 "\n",      args->n_past_msv);
+  metrics_printf(buf, len, nalloc, "hmmpgmd_pipeline_targets_total{stage=\"bias\"} %" PRIu64 "\n",     args->n_past_bias);
+  metrics_printf(buf, len, nalloc, "hmmpgmd_pipeline_targets_total{stage=\"vit\"} %" PRIu64 "\n",      args->n_past_vit);
+  metrics_printf(buf, len, nalloc, "hmmpgmd_pipeline_targets_total{stage=\"fwd\"} %" PRIu64 "\n",      args->n_past_fwd);
+  metrics_printf(buf, len, nalloc, "hmmpgmd_pipeline_targets_total{stage=\"reported\"} %" PRIu64 "\n", args->nreported);
+
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_worker_parts_total Shares of searches a worker has answered.\n# TYPE hmmpgmd_worker_parts_total counter\n");
+  for (worker = args->head; worker != NULL; worker = worker->next)
+    metrics_printf(buf, len, nalloc, "hmmpgmd_worker_parts_total{worker=\"%s:%d\"} %" PRIu64 "\n", worker->ip_addr, worker->sock_fd, worker->nparts);
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_worker_targets_total Sequences or models a worker has searched.\n# TYPE hmmpgmd_worker_targets_total counter\n");
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    metrics_printf(buf, len, nalloc, "hmmpgmd_worker_targets_total{worker=\"%s:%d\",type=\"sequences\"} %" PRIu64 "\n", worker->ip_addr, worker->sock_fd, worker->nseqs);
+    metrics_printf(buf, len, nalloc, "hmmpgmd_worker_targets_total{worker=\"%s:%d\",type=\"models\"} %" PRIu64 "\n",    worker->ip_addr, worker->sock_fd, worker->nmodels);
+  }
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_worker_busy_seconds_total Search time a worker has reported.\n# TYPE hmmpgmd_worker_busy_seconds_total counter\n");
+  for (worker = args->head; worker != NULL; worker = worker->next)
+    metrics_printf(buf, len, nalloc, "hmmpgmd_worker_busy_seconds_total{worker=\"%s:%d\"} %.6f\n", worker->ip_addr, worker->sock_fd, worker->busy);
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_worker_memory_peak_bytes A worker's memory high-water marks: the biggest search's pipelines, and the process.\n# TYPE hmmpgmd_worker_memory_peak_bytes gauge\n");
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    metrics_printf(buf, len, nalloc, "hmmpgmd_worker_memory_peak_bytes{worker=\"%s:%d\",kind=\"pipeline\"} %" PRIu64 "\n", worker->ip_addr, worker->sock_fd, worker->mem_peak);
+    metrics_printf(buf, len, nalloc, "hmmpgmd_worker_memory_peak_bytes{worker=\"%s:%d\",kind=\"rss\"} %" PRIu64 "\n",      worker->ip_addr, worker->sock_fd, worker->mem_rss);
+  }
+
+  metrics_printf(buf, len, nalloc, "# HELP hmmpgmd_cache_bytes Memory held by the cached databases.\n# TYPE hmmpgmd_cache_bytes gauge\n");
+  metrics_printf(buf, len, nalloc, "hmmpgmd_cache_bytes{db=\"seq\"} %" PRIu64 "\n", (uint64_t) (args->seq_db ? p7_seqcache_Sizeof(args->seq_db) : 0));
+  metrics_printf(buf, len, nalloc, "hmmpgmd_cache_bytes{db=\"hmm\"} %" PRIu64 "\n", (uint64_t) (args->hmm_db ? p7_hmmcache_Sizeof(args->hmm_db) : 0));
+  metrics_printf(buf, len, nalloc, "hmmpgmd_cache_bytes{db=\"results\"} %" PRIu64 "\n", args->rcache.size);
+
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+static void *
+metrics_comm_thread(void *arg)
+{
+  WORKERSIDE_ARGS     *args   = (WORKERSIDE_ARGS *) arg;
+  char                 req[MAX_BUFFER];
+  char                 hdr[128];
+  char                *body   = NULL;
+  int                  len    = 0;
+  int                  nalloc = 0;
+  int                  fd;
+  int                  hlen;
+  unsigned int         n;
+  struct sockaddr_in   addr;
+
+  for ( ;; ) {
+    n = sizeof(addr);
+    if ((fd = accept(args->sock_fd_metrics, (struct sockaddr *)&addr, &n)) < 0) {
+      p7_syslog(LOG_ERR,"[%s:%d] - metrics accept error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+      continue;
+    }
+
+    /* the request itself doesn't matter; read what has arrived of it */
+    if (read(fd, req, sizeof(req)) < 0)
+      p7_syslog(LOG_ERR,"[%s:%d] - metrics read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+
+    metrics_format(args, &body, &len, &nalloc);
+    hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n", len);
+    if (writen(fd, hdr, hlen) != hlen || writen(fd, body, len) != len)
+      p7_syslog(LOG_ERR,"[%s:%d] - metrics write error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+    close(fd);
+  }
+
+  pthread_exit(NULL);
+}
+
+static void
+setup_metrics_comm(ESL_GETOPTS *opts, WORKERSIDE_ARGS *args)
+{
+  int                  n;
+  int                  reuse;
+  int                  sock_fd;
+  pthread_t            thread_id;
+
+  struct sockaddr_in   addr;
+
+  if ((sock_fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) LOG_FATAL_MSG("socket", errno);
+
+  reuse = 1;
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, (void *)&reuse, sizeof(reuse)) < 0) LOG_FATAL_MSG("setsockopt", errno);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(esl_opt_GetInteger(opts, "--mport"));
+
+  if (bind(sock_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) LOG_FATAL_MSG("bind", errno);
+  if (listen(sock_fd, 4) < 0) LOG_FATAL_MSG("listen", errno);
+
+  args->sock_fd_metrics = sock_fd;
+
+  if ((n = pthread_create(&thread_id, NULL, metrics_comm_thread, (void *)args)) != 0) LOG_FATAL_MSG("thread create", n);
+}
+
 #endif /*HMMER_THREADS*/
 
 
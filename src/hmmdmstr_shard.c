@@ -21,6 +21,7 @@
 #include <syslog.h>
 #include <assert.h>
 #include <time.h>
+#include <math.h>
 
 #ifndef HMMER_THREADS
 #error "Program requires pthreads be enabled."
@@ -48,13 +49,50 @@
 #define INVALID_IP 0xfefefefe // 254.254.254.254 is supposed to be in the "reserved for future use" range of IPs, so we
   // should never see one
 
+#define RATE_DECAY  0.3   /* weight of the newest timing in a worker's rate  */
+#define MIN_PIECE   256   /* targets; a smaller slice isn't worth a round trip */
+
+/* Each worker keeps a histogram of how long its slices take against
+ * what its rate predicted, in LATE_SCALE bins per doubling; bin
+ * LATE_ZERO starts at a ratio of 1. The histogram is halved once it
+ * holds LATE_MAX timings, so it follows a node whose health changes.
+ */
+#define LATE_BINS    64
+#define LATE_SCALE   8
+#define LATE_ZERO    24
+#define LATE_MAX     1024
+#define LATE_WARMUP  16    /* timings needed before the histogram is trusted */
+#define LATE_GUESS   2.0   /* ratio used until then                          */
+#define SPEC_MIN     0.25  /* seconds; never duplicate a slice sooner        */
+#define SPEC_POLL    50    /* msec between checks for late slices            */
+
+/* A slice [inx..inx+cnt-1] of one shard's list, searched as one
+ * command: of the sequence database's shard, or for a scan, of the
+ * hmm database's, which is sharded the same way. A slice sits in one or more workers' queues; the
+ * first answer to arrive is kept, and a copy that finishes later is
+ * thrown away.
+ */
+typedef struct {
+  uint32_t            shard;
+  uint32_t            inx;
+  uint32_t            cnt;
+
+  int                 queued;     /* queues it is waiting in           */
+  int                 running;    /* workers searching it now          */
+  int                 copies;     /* speculative copies issued         */
+  int                 done;       /* answer taken                      */
+  int                 failed;     /* a worker reported an error        */
+  double              deadline;   /* reissue if not done by then; 0 if never */
+
+  HMMD_SEARCH_STATS   stats;      /* the answer                        */
+  P7_HIT            **hits;
+} SHARD_PIECE;
+
 typedef struct {
   HMMD_SEARCH_STATS   stats;
   HMMD_SEARCH_STATUS  status;
   P7_HIT           **hits;
   int                 nhits;
-  int                 db_inx;
-  int                 db_cnt;
   int                 errors;
 } SEARCH_RESULTS;
 
@@ -92,6 +130,14 @@ typedef struct {
   int              completed;
   uint32_t         num_shards;  // new for sharding
   uint32_t         *worker_ips;  // IP addresses of the workers we've connected to
+  uint32_t         replicas;    /* shards each worker holds: its own and the next replicas-1 */
+  double           qscale;      /* cost of the current query per target (its length) */
+
+  SHARD_PIECE     *pieces;      /* the current query's slices */
+  int              npieces;
+  int              pieces_alloc;
+  uint32_t         query_no;    /* counts queries, to know an answer that comes too late */
+  double           spec_q;      /* latency quantile past which a slice is reissued; 0 for never */
 
 } WORKERSIDE_ARGS;
 
@@ -103,14 +149,19 @@ typedef struct worker_s {
   int                   terminated;
   HMMD_COMMAND_SHARD         *cmd;
 
-  uint32_t              srch_inx;
-  uint32_t              srch_cnt;
+  int                  *queue;        /* parent's <pieces> to search, in order */
+  int                   nqueue;
+  int                   queue_alloc;
+  int                   next;         /* next <queue> entry to take */
+  uint32_t              queue_no;     /* <query_no> the queue is for */
+  int                   running;      /* slice being searched, or -1 */
+  uint32_t              running_no;   /* <query_no> of that slice    */
+
+  double                rate[2];      /* smoothed cost searched per second: [0] searches, [1] scans; 0 until timed */
+  double                load;         /* plan_pieces(): predicted seconds of work */
+  uint32_t              late[LATE_BINS]; /* histogram of slice time over predicted time */
+  uint32_t              nlate;
 
-  HMMD_SEARCH_STATS     stats;
-  HMMD_SEARCH_STATUS    status;
-  char                 *err_buf;
-  P7_HIT               **hits;
-  uint32_t              allocated_hits;       
   int                   total;
 
   WORKERSIDE_ARGS      *parent;
@@ -311,17 +362,215 @@ update_workers(WORKERSIDE_ARGS *args)
   assert(validate_workers(args));
 }
 
+static double
+now_seconds(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+}
+
+/* add a slice to the current query's table; returns its index */
+static int
+add_piece(WORKERSIDE_ARGS *args, uint32_t shard, uint32_t inx, uint32_t cnt)
+{
+  SHARD_PIECE *piece;
+
+  if (args->npieces == args->pieces_alloc) {
+    args->pieces_alloc = (args->pieces_alloc > 0) ? args->pieces_alloc * 2 : 64;
+    if ((args->pieces = realloc(args->pieces, sizeof(SHARD_PIECE) * args->pieces_alloc)) == NULL) LOG_FATAL_MSG("realloc", errno);
+  }
+  piece = &args->pieces[args->npieces];
+  memset(piece, 0, sizeof(SHARD_PIECE));
+  piece->shard = shard;
+  piece->inx   = inx;
+  piece->cnt   = cnt;
+
+  return args->npieces++;
+}
+
+static void
+queue_piece(WORKERSIDE_ARGS *args, WORKER_DATA *worker, int i)
+{
+  if (worker->nqueue == worker->queue_alloc) {
+    worker->queue_alloc = (worker->queue_alloc > 0) ? worker->queue_alloc * 2 : 8;
+    if ((worker->queue = realloc(worker->queue, sizeof(int) * worker->queue_alloc)) == NULL) LOG_FATAL_MSG("realloc", errno);
+  }
+  worker->queue[worker->nqueue++] = i;
+  args->pieces[i].queued++;
+}
+
+/* can <worker> search a slice of <shard>? */
+static int
+holds_piece(WORKERSIDE_ARGS *args, WORKER_DATA *worker, uint32_t shard)
+{
+  if (worker->terminated) return FALSE;
+  return (shard + args->num_shards - worker->my_shard) % args->num_shards < args->replicas;
+}
+
+/* a worker that hasn't been timed yet is assumed average */
+static double
+worker_rate(WORKER_DATA *worker, int is_scan, double avg)
+{
+  return (worker->rate[is_scan] > 0.0) ? worker->rate[is_scan] : avg;
+}
+
+/* the <q> quantile of a worker's slice times over their predicted times */
+static double
+late_ratio(WORKER_DATA *worker, double q)
+{
+  uint32_t sum = 0;
+  int      b;
+
+  if (worker->nlate < LATE_WARMUP) return LATE_GUESS;
+  for (b = 0; b < LATE_BINS - 1; b++) {
+    sum += worker->late[b];
+    if (sum >= q * worker->nlate) break;
+  }
+  return pow(2.0, (double) (b + 1 - LATE_ZERO) / LATE_SCALE);
+}
+
+static void
+add_late(WORKER_DATA *worker, double ratio)
+{
+  int b;
+
+  b = (ratio > 0.0) ? (int) floor(LATE_SCALE * log2(ratio)) + LATE_ZERO : 0;
+  b = ESL_MAX(0, ESL_MIN(LATE_BINS - 1, b));
+  worker->late[b]++;
+
+  if (++worker->nlate >= LATE_MAX) {
+    worker->nlate = 0;
+    for (b = 0; b < LATE_BINS; b++) {
+      worker->late[b] /= 2;
+      worker->nlate   += worker->late[b];
+    }
+  }
+}
+
+/* Function:  plan_pieces()
+ * Synopsis:  Split a query's slices over the workers by their speed.
+ *
+ * Purpose:   Cut the <ntodo> slices in <todo> into the current query's
+ *            slice table in <args>, and queue them on the live workers.
+ *            A slice of shard <s> can go to any worker holding <s>, of
+ *            the hmm database for a scan (<is_scan>), whose rates are
+ *            kept apart.
+ *
+ *            Each worker's predicted finish time is the work it has
+ *            been given over its measured <rate>. Every slice starts
+ *            out charged to its shard's own worker. Then, one slice at
+ *            a time, it is taken back and poured over its holders,
+ *            least loaded first, until their finish times are level.
+ *            With equal rates a shard stays whole on its own worker;
+ *            a slow worker sheds part of its shard to the neighbours
+ *            that hold replicas of it, so a search tracks the speed of
+ *            the cluster rather than of its slowest node.
+ *
+ *            Caller holds <work_mutex>.
+ *
+ * Returns:   the number of workers given work, or -1 if a slice has
+ *            no live worker holding it.
+ */
+static int
+plan_pieces(WORKERSIDE_ARGS *args, int is_scan, SHARD_PIECE *todo, int ntodo)
+{
+  WORKER_DATA  *worker;
+  WORKER_DATA **hold   = NULL;
+  double        avg    = 0.0;
+  double        rsum, lsum, level, share;
+  uint32_t      inx, left, cnt;
+  int           nrated = 0;
+  int           nhold;
+  int           used   = 0;
+  int           i, j, k;
+
+  if ((hold = malloc(sizeof(WORKER_DATA *) * args->num_shards)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    worker->load     = 0.0;
+    worker->nqueue   = 0;
+    worker->next     = 0;
+    worker->queue_no = args->query_no;
+    if (!worker->terminated && worker->rate[is_scan] > 0.0) { avg += worker->rate[is_scan]; nrated++; }
+  }
+  avg = (nrated > 0) ? avg / nrated : 1.0;
+
+  for (i = 0; i < ntodo; i++)
+    for (worker = args->head; worker != NULL; worker = worker->next)
+      if (!worker->terminated && worker->my_shard == todo[i].shard) worker->load += todo[i].cnt / worker_rate(worker, is_scan, avg);
+
+  for (i = 0; i < ntodo; i++) {
+    /* the holders of this slice, by increasing load */
+    nhold = 0;
+    for (worker = args->head; worker != NULL; worker = worker->next) {
+      if (!holds_piece(args, worker, todo[i].shard)) continue;
+      if (worker->my_shard == todo[i].shard) worker->load -= todo[i].cnt / worker_rate(worker, is_scan, avg);
+      for (j = nhold; j > 0 && hold[j-1]->load > worker->load; j--) hold[j] = hold[j-1];
+      hold[j] = worker;
+      nhold++;
+    }
+    if (nhold == 0) { free(hold); return -1; }
+
+    /* raise the level over the least loaded holders until it takes the slice */
+    rsum = lsum = level = 0.0;
+    for (k = 0; k < nhold; k++) {
+      rsum += worker_rate(hold[k], is_scan, avg);
+      lsum += worker_rate(hold[k], is_scan, avg) * hold[k]->load;
+      level = (todo[i].cnt + lsum) / rsum;
+      if (k+1 == nhold || level <= hold[k+1]->load) break;
+    }
+
+    /* cut consecutive ranges; rounding and slivers go to the least loaded */
+    inx  = todo[i].inx;
+    left = todo[i].cnt;
+    for (j = k; j >= 0 && left > 0; j--) {
+      share = worker_rate(hold[j], is_scan, avg) * (level - hold[j]->load);
+      cnt   = (share > 0.0) ? (uint32_t) share : 0;
+      if (j == 0)               cnt = left;
+      else if (cnt < MIN_PIECE) continue;
+      else if (cnt > left)      cnt = left;
+
+      if (hold[j]->nqueue == 0) used++;
+      queue_piece(args, hold[j], add_piece(args, todo[i].shard, inx, cnt));
+      hold[j]->load += cnt / worker_rate(hold[j], is_scan, avg);
+      inx  += cnt;
+      left -= cnt;
+    }
+  }
+
+  free(hold);
+  return used;
+}
+
+/* how much a worker already has to do, in slices */
+static int
+worker_backlog(WORKER_DATA *worker)
+{
+  return (worker->nqueue - worker->next) + (worker->running >= 0);
+}
+
 static void
 process_search(WORKERSIDE_ARGS *args, QUEUE_DATA_SHARD *query)
 {
   ESL_STOPWATCH  *w          = NULL;      /* timer used for profiling statistics             */
   WORKER_DATA    *worker     = NULL;
+  WORKER_DATA    *spare      = NULL;      /* worker to hand an orphaned or late slice to     */
+  SHARD_PIECE    *todo       = NULL;      /* the query, one slice per shard                  */
+  SHARD_PIECE    *piece;
   SEARCH_RESULTS  results;
+  struct timespec deadline;
+  double          now;
   int n;
   int cnt;
-  int inx;
-  int ready_workers;    /* counter variable used to track the number of workers currently available to receive work; short for "remaining", I imagine */
-  int tries;
+  int ntodo;
+  int is_scan;
+  int left;
+  int i;
+  int no_nodes;         /* a shard has no live worker holding it */
+  int errors;           /* a worker reported an error            */
+  uint32_t s;
 
   memset(&results, 0, sizeof(SEARCH_RESULTS)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
 
@@ -352,106 +601,101 @@ process_search(WORKERSIDE_ARGS *args, QUEUE_DATA_SHARD *query)
 
   init_results(&results);
 
-  //if range(s) are given, count how many of the seqdb's sequences are within supplied range(s)
- /* if (args->range_list) { // can only happen in HMMD_CMD_SEARCH case
-   int range_cnt = 0; // this will now count how many of the seqs in the db are within the range
-    for (i=0; i<cnt; i++) {
-      if ( hmmpgmd_IsWithinRanges(args->seq_db->list[i].idx, args->range_list ) )
-        range_cnt++;
-    }
-    cnt = range_cnt;
+  /* the whole query, as one slice per shard, of the sequence or the
+   * hmm database
+   */
+  is_scan = (query->cmd_type == HMMD_CMD_SCAN);
+  ntodo   = args->num_shards;
+  if ((todo = malloc(sizeof(SHARD_PIECE) * ntodo)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  for (s = 0; s < ntodo; s++) {
+    todo[s].shard = s;
+    todo[s].inx   = 0;
+    todo[s].cnt   = (cnt + args->num_shards - 1 - s) / args->num_shards; /* shards are dealt out round robin */
   }
-  */
-
-
-  inx = 0;
-  tries = 0;
-  do {
-    /* process any changes to the available workers */
-    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-    /* build a list of the currently available workers */
-    update_workers(args);
-
-    /* if there aren't enough workers ready, report an error */
-    if (args->ready == args->num_shards) {
-      ready_workers = args->ready;
-
-      /* update the workers search information */
-      worker = args->head;
-
-      while (worker != NULL) {
-        worker->cmd        = query->cmd;
-        worker->completed  = 0;
-        worker->total      = 0;
-
-        /* assign each worker a portion of the database */
-        worker->srch_inx = inx;
-        if (args->range_list) {
-      /*  old code for non-sharded database.  For sharded database, each worker should be told to search the entire range of the 
-          search, because a worker only has 1/nth of the database 
-          // if ranges are given, need to split the db list based on which elements in the list are within the given range(s)
-          int goal = cnt / ready_workers; //how many within-range sequences do I want to ask this worker to handle
-          int curr = 0;                   //how many within-range sequences have I seen since the start of this full-db range
-          worker->srch_cnt = 0;
-          while (curr < goal) {
-            if ( hmmpgmd_IsWithinRanges (args->seq_db->list[inx].idx, args->range_list ) )
-                curr++;
-            worker->srch_cnt++;
-            inx++;
-          }
-          cnt -= curr;
-          */ 
-          worker->srch_cnt = cnt;
-        } else {
-          if(query->cmd_type == HMMD_CMD_SEARCH){
-            // This is a sharded hmmsearch, so each worker should be told to search the entire db range, which
-            // will cause them to search their entire shard
-            worker->srch_cnt = cnt;
-          }
-          else{
-            // This is a hmmscan, so the database is not sharded and each worker should be told to search a fraction of it     
-            worker->srch_cnt = cnt / ready_workers;
-            inx += worker->srch_cnt;
-            cnt -= worker->srch_cnt;
-          }
-        }
+  /* process any changes to the available workers */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-        --ready_workers;
-        worker            = worker->next;
-      }
+  /* build a list of the currently available workers */
+  update_workers(args);
 
-      args->completed = 0;
+  args->npieces = 0;
 
-      /* notify all the worker threads of the new query */
-      if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
-    }
+  /* targets cost in proportion to the query's length; this lets a
+   * worker's rate carry over between queries of different sizes.
+   */
+  args->qscale = ESL_MAX(1.0, (query->hmm != NULL) ? (double) query->hmm->M : (double) query->seq->n);
 
-    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+  /* if a shard has no worker left holding it, report an error */
+  no_nodes = (plan_pieces(args, is_scan, todo, ntodo) < 0);
+  errors   = 0;
 
-    if (args->ready > 0) {
-      /* Wait for all the workers to complete */
-      if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  /* every live worker gets the command: one that was given no slices
+   * may still be handed an orphaned or a late one.
+   */
+  if (!no_nodes) {
+    for (worker = args->head; worker != NULL; worker = worker->next) worker->cmd = query->cmd;
+    if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  }
 
-      while (args->completed < args->ready) {
-        if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  /* Wait for every slice to be answered. A slice whose worker died is
+   * queued again on another holder. A slice still running past its
+   * worker's latency quantile gets one copy on an idle holder, and
+   * whichever answer arrives first is kept.
+   */
+  while (!no_nodes && !errors) {
+    left = 0;
+    now  = now_seconds();
+    for (i = 0; i < args->npieces && !no_nodes; i++) {
+      piece = &args->pieces[i];
+      if (piece->done)   continue;
+      if (piece->failed) { errors = 1; break; }
+      left++;
+
+      if (piece->queued > 0) continue;
+      if (piece->running > 0 && (args->spec_q == 0.0 || piece->copies > 0 || piece->deadline == 0.0 || now < piece->deadline)) continue;
+
+      spare = NULL;
+      for (worker = args->head; worker != NULL; worker = worker->next) {
+        if (!holds_piece(args, worker, piece->shard)) continue;
+        if (piece->running > 0 && worker_backlog(worker) > 0)  continue;
+        if (spare == NULL || worker_backlog(worker) < worker_backlog(spare)) spare = worker;
       }
 
-      if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+      if (spare != NULL) {
+        if (piece->running > 0) {
+          piece->copies++;
+          printf("Shard %d [%d - %d] is late, also sending it to %s\n", piece->shard, piece->inx, piece->inx + piece->cnt - 1, spare->ip_addr);
+        }
+        queue_piece(args, spare, i);
+        if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+      } else if (piece->running == 0) {
+        no_nodes = 1;
+      }
     }
+    if (no_nodes || errors || left == 0) break;
 
-    /* gather up the results from all the workers */
-    gather_results(query, args, &results);
+    if (args->spec_q > 0.0) {
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_nsec += SPEC_POLL * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L) { deadline.tv_sec++; deadline.tv_nsec -= 1000000000L; }
+      if ((n = pthread_cond_timedwait (&args->complete_cond, &args->work_mutex, &deadline)) != 0 && n != ETIMEDOUT) LOG_FATAL_MSG("cond timedwait", n);
+    } else {
+      if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+    }
+  }
 
-    /* we can recover from one worker crashing.  get the block that worker ran on
-     * and redistribute its load to all the remaining workers.
-     */
-    inx = results.db_inx;
-    cnt = results.db_cnt;
-    ++tries;
+  /* drop the copies still queued; any answer still out is now too late */
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    worker->cmd  = NULL;
+    worker->next = worker->nqueue;
+  }
+  args->query_no++;
 
-  } while (args->ready > 0 && results.errors == 1 && tries < 2);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
 
+  /* gather up the results from all the slices */
+  if (!no_nodes && !errors) gather_results(query, args, &results);
 
   esl_stopwatch_Stop(w);
 
@@ -460,16 +704,17 @@ process_search(WORKERSIDE_ARGS *args, QUEUE_DATA_SHARD *query)
   results.stats.user    = w->user;
   results.stats.sys     = w->sys;
   results.stats.hit_offsets = NULL; // set this to make sure we allocate memory later
-  /* TODO: check for errors */
-  if (args->ready != args->num_shards) {
-    client_msg(query->sock, eslFAIL, "Not enough compute nodes available for the number of shards specified.  %d nodes available, %d required\n", args->ready, args->num_shards);
-  } else if (args->failed > 0) {
+  if (no_nodes) {
+    client_msg(query->sock, eslFAIL, "Not enough compute nodes available for the number of shards specified.  %d nodes available, %d shards with %d replicas each\n", args->ready, args->num_shards, args->replicas);
+    clear_results(args, &results);
+  } else if (errors) {
     client_msg(query->sock, eslFAIL, "Errors running search\n");
     clear_results(args, &results);
   } else {
     forward_results(query, &results);  
   }
 
+  free(todo);
   esl_stopwatch_Destroy(w);
 }
 
@@ -612,6 +857,15 @@ master_process_shard(ESL_GETOPTS *go)
   worker_comm.hmm_db     = hmm_db;
   worker_comm.db_version = 1;
   worker_comm.num_shards = esl_opt_GetInteger(go, "--num_shards");
+  worker_comm.replicas   = esl_opt_GetInteger(go, "--replicas");
+  if (worker_comm.replicas > worker_comm.num_shards)
+    p7_Fail("--replicas %d is more than the %d shards\n", worker_comm.replicas, worker_comm.num_shards);
+  worker_comm.qscale     = 1.0;
+  worker_comm.pieces     = NULL;
+  worker_comm.npieces    = 0;
+  worker_comm.pieces_alloc = 0;
+  worker_comm.query_no   = 0;
+  worker_comm.spec_q     = esl_opt_GetReal(go, "--speculate");
   ESL_ALLOC(worker_comm.worker_ips, worker_comm.num_shards * sizeof(uint32_t));
   for(i = 0; i < worker_comm.num_shards; i++){
     worker_comm.worker_ips[i] = INVALID_IP;
@@ -674,6 +928,7 @@ master_process_shard(ESL_GETOPTS *go)
     free (worker_comm.range_list);
   }
   free(worker_comm.worker_ips);
+  if (worker_comm.pieces) free(worker_comm.pieces);
   return;
 
 
@@ -718,76 +973,70 @@ init_results(SEARCH_RESULTS *results)
 
   results->hits              = NULL;
   results->nhits             = 0;
-  results->db_inx            = 0;
-  results->db_cnt            = 0;
   results->errors            = 0;
 }
 
 
+/* free the answers still held in the query's slice table */
 static void
-gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results)
+clear_pieces(WORKERSIDE_ARGS *args)
 {
-  int cnt;
-  int n;
-  int i0, i1;
-  WORKER_DATA *worker;
+  int i, j;
 
-  /* allocate spaces to hold all the hits */
-  cnt = results->nhits + MAX_WORKERS;
-  if ((results->hits = realloc(results->hits, sizeof(P7_HIT *) * cnt)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  for (i = 0; i < args->npieces; i++) {
+    if (args->pieces[i].hits == NULL) continue;
+    for (j = 0; j < args->pieces[i].stats.nhits; j++) p7_hit_Destroy(args->pieces[i].hits[j]);
+    free(args->pieces[i].hits);
+    args->pieces[i].hits = NULL;
+  }
+  args->npieces = 0;
+}
+
+static void
+gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results)
+{
+  SHARD_PIECE *piece;
+  uint64_t     nhits;
+  int          cnt;
+  int          n;
+  int          i, j;
 
   /* lock the workers until we have merged the results */
   if ((n = pthread_mutex_lock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
+  /* allocate spaces to hold all the hits */
+  nhits = results->stats.nhits;
+  for (i = 0; i < comm->npieces; i++)
+    if (comm->pieces[i].done) nhits += comm->pieces[i].stats.nhits;
+  if (nhits > 0 && (results->hits = realloc(results->hits, sizeof(P7_HIT *) * nhits)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
   /* count the number of hits */
   cnt = results->nhits;
-  worker = comm->head;
-  while (worker != NULL) {
-    if (worker->completed) {
-      uint32_t previous_hits = results->stats.nhits;
-
-      results->stats.nhits        += worker->stats.nhits;
-      results->stats.nreported    += worker->stats.nreported;
-      results->stats.nincluded    += worker->stats.nincluded;
-
-      results->stats.n_past_msv   += worker->stats.n_past_msv;
-      results->stats.n_past_bias  += worker->stats.n_past_bias;
-      results->stats.n_past_vit   += worker->stats.n_past_vit;
-      results->stats.n_past_fwd   += worker->stats.n_past_fwd;
-
-      results->stats.Z_setby       = worker->stats.Z_setby;
-      results->stats.domZ_setby    = worker->stats.domZ_setby;
-      results->stats.domZ          = worker->stats.domZ;
-      results->stats.Z             = worker->stats.Z;
-
-      results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
-      if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
-        // Add enough space to the list of hits for all the hits from this worker
-       results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
-        if(results->hits == NULL){
-         LOG_FATAL_MSG("malloc", n);
-       }
-
-       // copy this worker's hits into the global list
-        for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
-          results->hits[i1] = worker->hits[i0];
-       }
-
-        free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
-       // will be freed by forward_results()
-
-       worker->hits = NULL;  
-      }
-      worker->completed   = 0;
-      ++cnt;
-    } else {
-      results->errors++;
-      results->db_inx            = worker->srch_inx;
-      results->db_cnt            = worker->srch_cnt;
-    }
-
-    worker = worker->next;
+  for (i = 0; i < comm->npieces; i++) {
+    piece = &comm->pieces[i];
+    if (!piece->done) continue;
+
+    // copy this slice's hits into the global list; forward_results() frees the hits themselves
+    for (j = 0; j < piece->stats.nhits; j++) results->hits[results->stats.nhits + j] = piece->hits[j];
+    if (piece->hits != NULL) free(piece->hits);
+    piece->hits = NULL;
+
+    results->stats.nhits        += piece->stats.nhits;
+    results->stats.nreported    += piece->stats.nreported;
+    results->stats.nincluded    += piece->stats.nincluded;
+
+    results->stats.n_past_msv   += piece->stats.n_past_msv;
+    results->stats.n_past_bias  += piece->stats.n_past_bias;
+    results->stats.n_past_vit   += piece->stats.n_past_vit;
+    results->stats.n_past_fwd   += piece->stats.n_past_fwd;
+
+    results->stats.Z_setby       = piece->stats.Z_setby;
+    results->stats.domZ_setby    = piece->stats.domZ_setby;
+    results->stats.domZ          = piece->stats.domZ;
+    results->stats.Z             = piece->stats.Z;
+    ++cnt;
   }
+  clear_pieces(comm);
 
   if ((n = pthread_mutex_unlock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
@@ -976,16 +1225,9 @@ forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results)
 static void
 destroy_worker(WORKER_DATA *worker)
 {
-  int i;
-  if (worker == NULL)
+  if (worker != NULL)
   {
-    if (worker->err_buf  != NULL) free(worker->err_buf);
-    if (worker->hits != NULL){
-      for(i = 0; i < worker->allocated_hits; i++){
-        p7_hit_Destroy(worker->hits[i]);
-      }
-      free(worker->hits);
-    }
+    if (worker->queue != NULL) free(worker->queue);
     memset(worker, 0, sizeof(WORKER_DATA));
     free(worker);
   }
@@ -996,33 +1238,18 @@ clear_results(WORKERSIDE_ARGS *args, SEARCH_RESULTS *results)
 {
   int i;
   int n;
-  WORKER_DATA *worker;
 
   /* lock the workers until we have freed the results */
   if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
   assert(validate_workers(args));
 
-  /* free all the results */
-  worker = args->head;
-  while (worker != NULL) {
-    if (worker->err_buf  != NULL) free(worker->err_buf);
-    if(worker->hits != NULL){
-      for(i =0; i < worker->allocated_hits; i++){
-        p7_hit_Destroy(worker->hits[i]);
-      }
-      free(worker->hits);
-      worker->hits = NULL;
-    }
-    worker->err_buf  = NULL;
-      
-    worker->completed = 0;
-    worker = worker->next;
-  }
+  /* free the answers of the slices that did come back */
+  clear_pieces(args);
 
   if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
 
-  for (i = 0; i < results->nhits; ++i) {
+  for (i = 0; i < results->stats.nhits; ++i) {
     if (results->hits[i]  != NULL) p7_hit_Destroy(results->hits[i]);
     results->hits[i]  = NULL;
   }
@@ -1511,35 +1738,46 @@ setup_clientside_comm(ESL_GETOPTS *opts, CLIENTSIDE_ARGS *args)
 static void
 workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
 {
-  ESL_STOPWATCH      *w     = NULL;
-  HMMD_SEARCH_STATS  *stats = NULL;
+  HMMD_SEARCH_STATUS  sstatus;
+  HMMD_SEARCH_STATS   stats;
   HMMD_COMMAND_SHARD        cmd;
-  int    n, i;
+  HMMD_COMMAND_SHARD *msg   = NULL; /* our copy of the search command */
+  SHARD_PIECE        *piece;
+  P7_HIT            **hits  = NULL;
+  int    n, i, d, k;
   int    size;
   int    total;
-  char  *ptr;
+  int    nhits;
+  int    ok;
+  int    msg_alloc = 0;
+  uint32_t query_no;
+  uint32_t piece_cnt;
+  double qscale;
+  double expect;
+  double started;
+  double elapsed;
+  double sample;
   uint8_t *buf; // Buffer to receive bytes into over sockets
   uint32_t buf_position; //Index into buffer for deserialize
   memset(&cmd, 0, sizeof(HMMD_COMMAND_SHARD)); /* silence valgrind. if we ever serialize structs properly, remove */
-  w = esl_stopwatch_Create();
 
   for ( ; ; ) {
 
     /* wait for the next search object */
     if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-    /* wait for the master's signal to start the calculations */
-    while (worker->cmd == NULL) {
+    /* wait for the master's signal: a shutdown, or a slice in our queue */
+    while (worker->cmd == NULL || (worker->cmd->hdr.command != HMMD_CMD_SHUTDOWN && worker->next >= worker->nqueue)) {
       if ((n = pthread_cond_wait(&data->start_cond, &data->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
     }
 
-    if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
-
     /* terminate the connection */
     if (worker->cmd->hdr.command == HMMD_CMD_SHUTDOWN) {
       fd_set rset;
       struct timeval tv;
       
+      if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
       n = MSG_SIZE(worker->cmd);
       if (writen(worker->sock_fd, worker->cmd, n) != n) {
         p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
@@ -1572,31 +1810,53 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
       break;
     }
 
-    //printf ("Writing %d bytes to %s [MSG = %d/%d]\n", (int)MSG_SIZE(worker->cmd), worker->ip_addr, worker->cmd->hdr.command, worker->cmd->hdr.length);
-
-    esl_stopwatch_Start(w);
+    /* take the next slice, unless another worker has already answered it */
+    i     = worker->queue[worker->next++];
+    piece = &data->pieces[i];
+    piece->queued--;
+    if (piece->done) {
+      if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+      continue;
+    }
+    piece->running++;
+    worker->running    = i;
+    worker->running_no = query_no = data->query_no;
 
-    /* write search message in two parts */
-    n = sizeof(HMMD_HEADER) + sizeof(HMMD_SEARCH_CMD);
-    memcpy(&cmd, worker->cmd, n);
-    cmd.srch.inx = worker->srch_inx;
-    cmd.srch.cnt = worker->srch_cnt;
-    if (writen(worker->sock_fd, &cmd, n) != n) {
-      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-      break;
+    /* search our own copy of the command: if we lose the race, the
+     * query and its command may be gone before we're done.
+     */
+    n = MSG_SIZE(worker->cmd);
+    if (n > msg_alloc) {
+      if ((msg = realloc(msg, n)) == NULL) LOG_FATAL_MSG("realloc", errno);
+      msg_alloc = n;
     }
+    memcpy(msg, worker->cmd, n);
+    msg->srch.shard = piece->shard;
+    msg->srch.inx   = piece->inx;
+    msg->srch.cnt   = piece->cnt;
+    piece_cnt       = piece->cnt;
+
+    /* when the first copy of a slice starts, set when to give up waiting on it */
+    k       = (msg->hdr.command == HMMD_CMD_SCAN);
+    qscale  = data->qscale;
+    expect  = (worker->rate[k] > 0.0) ? piece_cnt * qscale / worker->rate[k] : 0.0;
+    started = now_seconds();
+    if (piece->copies == 0 && expect > 0.0)
+      piece->deadline = started + ESL_MAX(SPEC_MIN, expect * late_ratio(worker, data->spec_q));
 
-    /* write remaining data, i.e. sequence, options etc. */
-    ptr = (char *)worker->cmd;
-    ptr += n;
-    n = MSG_SIZE(worker->cmd) - n;
-    if (writen(worker->sock_fd, ptr, n) != n) {
+    if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+    //printf ("Writing %d bytes to %s [MSG = %d/%d]\n", (int)MSG_SIZE(msg), worker->ip_addr, msg->hdr.command, msg->hdr.length);
+
+    n = MSG_SIZE(msg);
+    if (writen(worker->sock_fd, msg, n) != n) {
       p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
       break;
     }
-    
+
     total = 0;
-    worker->total = 0;
+    nhits = 0;
+    ok    = 0;
 
     n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
     buf = malloc(n);
@@ -1607,88 +1867,111 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
     total += n;
     if ((size = readn(worker->sock_fd, buf, n)) == -1) {
       p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      free(buf);
       break;
     }
 
     buf_position = 0;
-    if(hmmd_search_status_Deserialize(buf, &buf_position, &(worker->status)) != eslOK){
+    if(hmmd_search_status_Deserialize(buf, &buf_position, &sstatus) != eslOK){
        LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATUS", errno);
     }
 
-    if (worker->status.status != eslOK) {
-      n = worker->status.msg_size;
-      total += n; 
-      if ((worker->err_buf = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
-      worker->err_buf[0] = 0;
-      if ((size = readn(worker->sock_fd, worker->err_buf, n)) == -1) {
-        p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-        break;
-      }
-    } else {
-
-      // receive the results from the worker
-      buf = realloc(buf, worker->status.msg_size);
-      if(buf == NULL){
-        LOG_FATAL_MSG("malloc", errno);
-      }
+    // receive the error message, or the results, from the worker
+    buf = realloc(buf, sstatus.msg_size + 1);
+    if(buf == NULL){
+      LOG_FATAL_MSG("malloc", errno);
+    }
 
-      total += worker->status.msg_size;
-      if ((size = readn(worker->sock_fd, buf, worker->status.msg_size)) == -1) {
-        p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-        break;
-      }
+    total += sstatus.msg_size;
+    if ((size = readn(worker->sock_fd, buf, sstatus.msg_size)) == -1) {
+      p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      free(buf);
+      break;
+    }
 
+    if (sstatus.status != eslOK) {
+      buf[sstatus.msg_size] = 0;
+      p7_syslog(LOG_ERR,"[%s:%d] - %s search error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, sstatus.status, (char *) buf);
+    } else {
       buf_position = 0; // start at beginning of new buffer of data
       // Now, serialize the data structures out of it
-      if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(worker->stats)) != eslOK){
+      if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &stats) != eslOK){
         LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATS", errno);
       }
-      stats = &worker->stats;
-      if(stats->nhits > 0){
-        worker->hits = malloc(stats->nhits * sizeof(P7_HIT *));
-        if(worker->hits == NULL){
+      if(stats.nhits > 0){
+        hits = malloc(stats.nhits * sizeof(P7_HIT *));
+        if(hits == NULL){
           LOG_FATAL_MSG("malloc", errno);
         }
-        worker->allocated_hits = stats->nhits;  // Need this if we have to destroy the worker because of an error
         /* read in the hits */
-        for(i = 0; i < stats->nhits; i++){
-          worker->hits[i] = p7_hit_Create_empty();
-          if(worker->hits[i] == NULL){
+        for(nhits = 0; nhits < stats.nhits; nhits++){
+          hits[nhits] = p7_hit_Create_empty();
+          if(hits[nhits] == NULL){
             LOG_FATAL_MSG("malloc", errno);
           }
-          if(p7_hit_Deserialize(buf, &buf_position, worker->hits[i]) != eslOK){
+          if(p7_hit_Deserialize(buf, &buf_position, hits[nhits]) != eslOK){
             LOG_FATAL_MSG("Couldn't deserialize P7_HIT", errno);
           } 
+          /* the master only holds on to alignments until it forwards them: keep them compact */
+          for(d = 0; d < hits[nhits]->ndom; d++){
+            if(p7_alidisplay_Compress(hits[nhits]->dcl[d].ad) != eslOK){
+              LOG_FATAL_MSG("Couldn't compress P7_ALIDISPLAY", errno);
+            }
+          }
         }
       }
-      free(buf);
+      ok = 1;
     }
+    free(buf);
+    elapsed = now_seconds() - started;
 
-    /* We've just allocated an array of pointers to P7_HIT objects and a bunch of P7_HIT 
-      objects that we don't free in this function.  Here's what happens to them.  gather_results() assembles
-      all of the P7_HIT objects from the different workers into one big list, which it passes to forward_results().  
-      gather_results() frees each worker's array of pointers to P7_HIT objects, and forward_results is responsible for 
-      freeing all of the P7_HIT objects when it's done with them */
-
-    esl_stopwatch_Stop(w);
+    /* The first answer for a slice is kept in the slice table, and its hits are
+      handed on from there: gather_results() collects the P7_HIT objects from all
+      the slices into one big list which it passes to forward_results(), and
+      forward_results is responsible for freeing them when it's done with them.
+      An answer that comes second, or after its query has finished, is freed here */
 
     if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-    /* set the state of the worker to completed */
-    worker->cmd       = NULL;
-    worker->completed = 1;
-    worker->total     = total;
-    ++data->completed;
+    if (query_no == data->query_no) {
+      piece = &data->pieces[i];
+      piece->running--;
+      if (ok && !piece->done) {
+        piece->done  = 1;
+        piece->stats = stats;
+        piece->hits  = hits;
+        hits         = NULL;
+      } else if (!ok && !piece->done) {
+        piece->failed = 1;
+      }
+    }
+    worker->running = -1;
+    worker->total   = total;
+
+    /* time the worker, in query cost per second, for plan_pieces();
+     * and how late it was, for the next slice's deadline
+     */
+    if (ok && elapsed > 0.0) {
+      if (expect > 0.0) add_late(worker, elapsed / expect);
+      sample = piece_cnt * qscale / elapsed;
+      worker->rate[k] = (worker->rate[k] > 0.0) ? (1.0 - RATE_DECAY) * worker->rate[k] + RATE_DECAY * sample : sample;
+    }
 
-    /* notify the master that a worker has completed */
+    /* notify the master that a slice has completed */
     if ((n = pthread_cond_broadcast(&data->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
     if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-    printf ("WORKER %s COMPLETED: %.2f sec received %d bytes\n", worker->ip_addr, w->elapsed, total);
+    if (hits != NULL) {
+      for (d = 0; d < nhits; d++) p7_hit_Destroy(hits[d]);
+      free(hits);
+      hits = NULL;
+    }
+
+    printf ("WORKER %s COMPLETED: %.2f sec received %d bytes\n", worker->ip_addr, elapsed, total);
     fflush(stdout);
   }
 
-  esl_stopwatch_Destroy(w);
+  if (msg != NULL) free(msg);
 
   return;
 }
@@ -1748,10 +2031,13 @@ workerside_thread(void *arg)
 
       strcpy(p, parent->seq_db->name);
       p += strlen(parent->seq_db->name) + 1;
-      cmd->init.num_shards = worker->num_shards;
-      cmd->init.my_shard = worker->my_shard;
     }
 
+    /* both databases are sharded the same way */
+    cmd->init.num_shards = worker->num_shards;
+    cmd->init.my_shard = worker->my_shard;
+    cmd->init.replicas = parent->replicas;
+
     if (parent->hmm_db != NULL) {
       cmd->init.hmm_cnt     = 1;
       cmd->init.model_cnt   = parent->hmm_db->n;
@@ -1843,6 +2129,12 @@ workerside_thread(void *arg)
   ++parent->failed;
   ++parent->completed;
 
+  /* give back the slices we were holding, so the master can hand them on */
+  if (worker->running >= 0 && worker->running_no == parent->query_no) parent->pieces[worker->running].running--;
+  if (worker->queue_no == parent->query_no)
+    while (worker->next < worker->nqueue) parent->pieces[worker->queue[worker->next++]].queued--;
+  worker->running = -1;
+
   worker->terminated = 1;
   worker->total      = 0;
   worker->sock_fd    = -1;
@@ -1885,6 +2177,7 @@ worker_comm_thread(void *arg)
 
     worker->parent     = data;
     worker->sock_fd    = fd;
+    worker->running    = -1;
 
     addrlen = sizeof(worker->ip_addr);
     strncpy(worker->ip_addr, inet_ntoa(addr.sin_addr), addrlen);
@@ -18,6 +18,8 @@
 #include <arpa/inet.h>
 #include <syslog.h>
 #include <assert.h>
+#include <inttypes.h>
+#include <sys/time.h>
 
 #ifndef HMMER_THREADS
 #error "Program requires pthreads be enabled."
@@ -52,6 +54,7 @@ static ESL_OPTIONS searchOpts[] = {
   /* Control of output */
   { "--acc",        eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL, NULL,        "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL, NULL,        "don't output alignments, so output is smaller",                2 },
+  { "--compactali", eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL, "--noali",   "send alignments in their compact form, so output is smaller",  2 },
   /* Control of scoring system */
   { "--popen",      eslARG_REAL,       "0.02", NULL, "0<=x<0.5",NULL,  NULL, NULL,        "gap open probability",                                         3 },
   { "--pextend",    eslARG_REAL,        "0.4", NULL, "0<=x<1",  NULL,  NULL, NULL,        "gap extend probability",                                       3 },
@@ -62,6 +65,7 @@ static ESL_OPTIONS searchOpts[] = {
   { "-T",           eslARG_REAL,      FALSE, NULL, NULL,      NULL,  NULL, REPOPTS,     "report sequences >= this score threshold in output",           4 },
   { "--domE",       eslARG_REAL,     "10.0", NULL, "x>0",     NULL,  NULL, DOMREPOPTS,  "report domains <= this E-value threshold in output",           4 },
   { "--domT",       eslARG_REAL,      FALSE, NULL, NULL,      NULL,  NULL, DOMREPOPTS,  "report domains >= this score cutoff in output",                4 },
+  { "--topk",       eslARG_INT,       FALSE, NULL, "n>0",     NULL,  NULL, NULL,        "report only the <n> best targets; skip work on the rest",      4 },
   /* Control of inclusion (significance) thresholds */
   { "--incE",       eslARG_REAL,     "0.01", NULL, "x>0",     NULL,  NULL, INCOPTS,     "consider sequences <= this E-value threshold as significant",  5 },
   { "--incT",       eslARG_REAL,      FALSE, NULL, NULL,      NULL,  NULL, INCOPTS,     "consider sequences >= this score threshold as significant",    5 },
@@ -77,6 +81,11 @@ static ESL_OPTIONS searchOpts[] = {
   { "--F2",         eslARG_REAL,     "1e-3", NULL, NULL,      NULL,  NULL, "--max",     "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,     "1e-5", NULL, NULL,      NULL,  NULL, "--max",     "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,       NULL, NULL, NULL,      NULL,  NULL, "--max",     "turn off composition bias filter",                             7 },
+  { "--dd_threads", eslARG_INT,        "0",  NULL, "n>=0",    NULL,  NULL, NULL,        "define domains of a multidomain target in <n> threads",        7 },
+  { "--dd_ramlimit", eslARG_INT,       "0",  NULL, "n>=0",    NULL,  NULL, NULL,        "cap full envelope DP matrices at <n> MB (0: no cap)",          7 },
+  { "--dd_nbatch",  eslARG_INT,        "0",  NULL, "n>=0",    NULL,  NULL, NULL,        "sample domain traces in batches of <n>, stopping early",       7 },
+  { "--dd_deferali", eslARG_NONE,      FALSE, NULL, NULL,     NULL,  NULL, NULL,        "align domains only of targets that are reported",              7 },
+  { "--dd_bf16",    eslARG_NONE,       FALSE, NULL, NULL,     NULL,  NULL, NULL,        "keep envelope DP matrices in bfloat16 (half the memory)",      7 },
   /* Control of E-value calibration */
   { "--EmL",        eslARG_INT,       "200", NULL,"n>0",      NULL,  NULL, NULL,        "length of sequences for MSV Gumbel mu fit",                   11 },   
   { "--EmN",        eslARG_INT,       "200", NULL,"n>0",      NULL,  NULL, NULL,        "number of sequences for MSV Gumbel mu fit",                   11 },   
@@ -87,12 +96,16 @@ static ESL_OPTIONS searchOpts[] = {
   { "--Eft",        eslARG_REAL,     "0.04", NULL,"0<x<1",    NULL,  NULL, NULL,        "tail mass for Forward exponential tail tau fit",              11 },   
   /* Other options */
   { "--seed",       eslARG_INT,        "42", NULL, "n>=0",    NULL,  NULL, NULL,        "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
+  { "--timing",     eslARG_NONE,       FALSE, NULL, NULL,     NULL,  NULL, NULL,        "report time spent in each stage of the pipeline",             12 },
+  { "--memstats",   eslARG_NONE,       FALSE, NULL, NULL,     NULL,  NULL, NULL,        "report memory high-water marks of the pipeline",              12 },
+  { "--membudget",  eslARG_INT,        NULL, NULL, "n>0",     NULL,  NULL, NULL,        "keep each pipeline under <n> MB of DP memory",                12 },
   { "--nonull2",    eslARG_NONE,       NULL, NULL, NULL,      NULL,  NULL, NULL,        "turn off biased composition score corrections",               12 },
   { "-Z",           eslARG_REAL,      FALSE, NULL, "x>0",     NULL,  NULL, NULL,        "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,      FALSE, NULL, "x>0",     NULL,  NULL, NULL,        "set # of significant seqs, for domain E-value calculation",   12 },
   { "--hmmdb",      eslARG_INT,       NULL,  NULL, "n>0",   NULL,  NULL,  "--seqdb",       "hmm database to search",                                      12 },
   { "--seqdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--hmmdb",       "protein database to search",                                  12 },
   { "--seqdb_ranges",eslARG_STRING,     NULL,  NULL,  NULL,   NULL, "--seqdb", NULL,         "range(s) of sequences within --seqdb that will be searched",  12 },
+  { "--deadline",   eslARG_REAL,      FALSE, NULL, "x>0",     NULL,  NULL, NULL,        "give up on the search <x> seconds after it was submitted",    12 },
   
 
   /* name           type        default  env  range toggles reqs incomp  help                                          docgroup*/
@@ -207,7 +220,12 @@ process_searchopts(int fd, char *cmdstr, ESL_GETOPTS **ret_opts)
 void
 free_QueueData(QUEUE_DATA *data)
 {
+  int i;
+
   /* free the query data */
+  for (i = 0; i < data->nbatch; i++) free_QueueData(data->batch[i]);
+  if (data->batch != NULL) free(data->batch);
+
   esl_getopts_Destroy(data->opts);
 
   if (data->abc != NULL) esl_alphabet_Destroy(data->abc);
@@ -218,6 +236,153 @@ free_QueueData(QUEUE_DATA *data)
   free(data);
 }
 
+static FILE           *trace_fp    = NULL;   /* --trace output, or NULL if not tracing */
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Function:  hmmpgmd_TraceOpen()
+ * Synopsis:  Start writing trace spans to a file.
+ *
+ * Purpose:   Append the trace spans of this master's or worker's
+ *            searches to file <path>, one JSON object per line.
+ *
+ * Returns:   <eslOK> on success; <eslFAIL> if <path> can't be opened
+ *            for appending.
+ */
+int
+hmmpgmd_TraceOpen(const char *path)
+{
+  if ((trace_fp = fopen(path, "a")) == NULL) return eslFAIL;
+  return eslOK;
+}
+
+/* Function:  hmmpgmd_Tracing()
+ * Synopsis:  Return TRUE if trace spans are being written.
+ */
+int
+hmmpgmd_Tracing(void)
+{
+  return (trace_fp != NULL);
+}
+
+/* Function:  hmmpgmd_Now()
+ * Synopsis:  Wall clock time, in seconds since the epoch.
+ */
+double
+hmmpgmd_Now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (double) tv.tv_sec + (double) tv.tv_usec * 1e-6;
+}
+
+/* Function:  hmmpgmd_TraceSpan()
+ * Synopsis:  Write one trace span.
+ *
+ * Purpose:   Write span <span_id> of trace <trace_id>, a child of
+ *            span <parent_id> (0 for the root), for stage <name> of
+ *            search <query_id> from time <t0> to <t1> (seconds since
+ *            the epoch), and optionally the address of the <worker>
+ *            the stage ran on or waited for. The line has the fields
+ *            of an OpenTelemetry span, so a collector can read the
+ *            file as it is.
+ *
+ *            Does nothing if not tracing, or if <trace_id> is 0.
+ *            Safe to call from any thread.
+ */
+void
+hmmpgmd_TraceSpan(uint64_t trace_id, uint64_t span_id, uint64_t parent_id, const char *name,
+                  double t0, double t1, uint32_t query_id, const char *worker)
+{
+  if (trace_fp == NULL || trace_id == 0) return;
+  if (t1 < t0) t1 = t0;
+
+  if (pthread_mutex_lock(&trace_mutex) != 0) p7_Fail("mutex lock failed");
+  fprintf(trace_fp, "{\"traceId\":\"%032" PRIx64 "\",\"spanId\":\"%016" PRIx64 "\",", trace_id, span_id);
+  if (parent_id) fprintf(trace_fp, "\"parentSpanId\":\"%016" PRIx64 "\",", parent_id);
+  fprintf(trace_fp, "\"name\":\"%s\",\"startTimeUnixNano\":\"%" PRIu64 "\",\"endTimeUnixNano\":\"%" PRIu64 "\",",
+          name, (uint64_t) (t0 * 1e9), (uint64_t) (t1 * 1e9));
+  fprintf(trace_fp, "\"attributes\":[{\"key\":\"hmmpgmd.query_id\",\"value\":{\"intValue\":\"%" PRIu32 "\"}}", query_id);
+  if (worker) fprintf(trace_fp, ",{\"key\":\"hmmpgmd.worker\",\"value\":{\"stringValue\":\"%s\"}}", worker);
+  fprintf(trace_fp, "]}\n");
+  fflush(trace_fp);
+  if (pthread_mutex_unlock(&trace_mutex) != 0) p7_Fail("mutex unlock failed");
+}
+
+#ifndef HMMD_ATOMIC_WORK
+static pthread_mutex_t work_mutex = PTHREAD_MUTEX_INITIALIZER; /* guards all HMMD_WORK w/o atomic builtins */
+#endif
+
+/* Function:  hmmpgmd_InitWork()
+ * Synopsis:  Initialize shared work distribution for worker threads.
+ *
+ * Purpose:   Initialize <work> to hand out the indices <0..total-1>
+ *            to <nthreads> threads, in chunks of at least <min_blk>
+ *            and at most <max_blk>, or <HMMD_WORK_MAXBLK> if
+ *            <max_blk> is 0 or more than that. A caller that can guess
+ *            what a target costs sets <max_blk> so that a chunk
+ *            costs about <p7_BLOCK_CELLS> DP cells.
+ */
+void
+hmmpgmd_InitWork(HMMD_WORK *work, int total, int nthreads, int min_blk, int max_blk)
+{
+  work->next     = 0;
+  work->total    = total;
+  work->nthreads = ESL_MAX(1, nthreads);
+  work->min_blk  = ESL_MAX(1, min_blk);
+  work->max_blk  = (max_blk > 0) ? ESL_MIN(max_blk, HMMD_WORK_MAXBLK) : HMMD_WORK_MAXBLK;
+  work->max_blk  = ESL_MAX(work->min_blk, work->max_blk);
+}
+
+/* guided_blk()
+ * Chunk size when <left> indices remain: about half of an even share
+ * of what is left, clamped to the min/max chunk.
+ */
+static int
+guided_blk(HMMD_WORK *work, int left)
+{
+  int blk = left / (2 * work->nthreads);
+
+  blk = ESL_MIN(blk, work->max_blk);
+  blk = ESL_MAX(blk, work->min_blk);
+  return ESL_MIN(blk, left);
+}
+
+/* Function:  hmmpgmd_NextWork()
+ * Synopsis:  Claim the next chunk of work.
+ *
+ * Purpose:   Claim the next chunk of indices from <work>. The first
+ *            index of the chunk is returned in <*ret_inx>. Safe to
+ *            call concurrently from any number of threads; lock free
+ *            when the compiler provides atomic builtins.
+ *
+ * Returns:   the number of indices in the chunk; 0 when all work has
+ *            been handed out.
+ */
+int
+hmmpgmd_NextWork(HMMD_WORK *work, int *ret_inx)
+{
+  int inx;
+  int blk;
+
+#ifdef HMMD_ATOMIC_WORK
+  inx = __atomic_load_n(&work->next, __ATOMIC_RELAXED);
+  do {
+    if (inx >= work->total) { *ret_inx = work->total; return 0; }
+    blk = guided_blk(work, work->total - inx);
+  } while (! __atomic_compare_exchange_n(&work->next, &inx, inx + blk, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#else
+  if (pthread_mutex_lock(&work_mutex) != 0) p7_Fail("mutex lock failed");
+  inx = work->next;
+  blk = (inx < work->total) ? guided_blk(work, work->total - inx) : 0;
+  work->next += blk;
+  if (pthread_mutex_unlock(&work_mutex) != 0) p7_Fail("mutex unlock failed");
+#endif
+
+  *ret_inx = inx;
+  return blk;
+}
+
 /* Function:  hmmpgmd_IsWithinRanges()
  * Synopsis:  Test if the given id falls within one of a collection of ranges
  *
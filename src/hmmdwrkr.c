@@ -1,5 +1,6 @@
 /* worker side of the hmmer daemon
  */
+#define _GNU_SOURCE             /* sched_setaffinity() and the CPU_* macros, where available */
 #include <p7_config.h>
 
 #ifdef HMMER_THREADS
@@ -19,6 +20,9 @@
 #include <arpa/inet.h>
 #include <syslog.h>
 #include <time.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
 
 #ifndef HMMER_THREADS
 #error "Program requires pthreads be enabled."
@@ -39,6 +43,8 @@
 
 #define MAX_WORKERS  64
 #define MAX_BUFFER   4096
+#define MAX_NODES    64         /* most NUMA nodes placed on            */
+#define NUMA_ALIGN   4096       /* page size: alignment of the residue arena, granularity of its node slices */
 
 #define CONF_FILE "/etc/hmmpgmd.conf"
 
@@ -49,14 +55,20 @@ typedef struct {
 
   P7_OPROFILE     **om_list;     /* list of profiles to process      */
   int               om_cnt;      /* number of profiles               */
+  P7_HMMCACHE      *hcache;      /* their cache, if lazy (--hmmrest); else NULL */
 
-  pthread_mutex_t  *inx_mutex;   /* protect data                     */
-  int              *blk_size;    /* sequences per block              */
-  int              *limit;       /* point to decrease block size     */
-  int              *inx;         /* next index to process            */
+  HMMD_WORK        *work;        /* shared work, [0..nwork-1], one per NUMA node */
+  int               nwork;
+  int               home;        /* work taken from first, until it runs dry */
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t        *cpus;        /* cpus of the home node, or NULL   */
+#endif
 
   P7_HMM           *hmm;         /* query HMM                        */
   ESL_SQ           *seq;         /* query sequence                   */
+  P7_OPROFILE     **oms;         /* search: the queries' profiles, [0..nseqs-1], shared read-only; each thread searches with clones */
+  ESL_SQ          **seqs;        /* scan: query sequences, [0..nseqs-1] */
+  int               nseqs;       /* number of queries, of a scan or a search */
   ESL_ALPHABET     *abc;         /* digital alphabet                 */
   ESL_GETOPTS      *opts;        /* search specific options          */
 
@@ -69,25 +81,121 @@ typedef struct {
    */
   P7_PIPELINE      *pli;         /* work pipeline                    */
   P7_TOPHITS       *th;          /* top hit results                  */
+  P7_PIPELINE     **plis;        /* a pipeline per query, [0..nseqs-1] */
+  P7_TOPHITS      **ths;         /* the hits of each query           */
+
+  P7_MXPOOL        *mxpool;      /* shared DP matrices, or NULL      */
+  struct worker_ctx_s **ctxs;    /* search: the thread's kept pipeline and hit list of each query (<plis>, <ths>) */
+
+  volatile int     *cancel;      /* set if the master cancels the search; stop claiming work */
 } WORKER_INFO;
 
+/* One version of the cached databases. Each search holds a reference
+ * on the version it names; once the master has released a version,
+ * it is freed when the last of its searches lets go.
+ */
+typedef struct worker_db_s {
+  int                  version;   /* master's version of the databases */
+  P7_SEQCACHE         *seq_db;    /* cached sequence database         */
+  P7_HMMCACHE         *hmm_db;    /* cached hmm database              */
+  int                  refs;      /* searches using this version      */
+  int                  released;  /* TRUE once no search will name it */
+  int                  nnodes;    /* NUMA nodes the residues are spread over */
+  ESL_DSQ             *node_res[MAX_NODES]; /* start of each node's slice of the residues */
+  struct worker_db_s  *next;      /* next older version               */
+} WORKER_DB;
+
+/* A search thread's pipeline and hit list, kept between searches, so
+ * a small query isn't mostly spent creating and destroying them. The
+ * pipeline's thresholds come from the search's options, so a context
+ * is only reused by searches with the same options string.
+ */
+typedef struct worker_ctx_s {
+  char                *opts;     /* options the pipeline was created with */
+  P7_PIPELINE         *pli;
+  P7_TOPHITS          *th;
+  struct worker_ctx_s *next;     /* next idle context                */
+} WORKER_CTX;
+
 typedef struct {
   int fd;                        /* socket connection to server      */
   int ncpus;                     /* number of cpus to use            */
 
-  P7_SEQCACHE *seq_db;           /* cached sequence database         */
-  P7_HMMCACHE *hmm_db;           /* cached hmm database              */
+  WORKER_DB   *dbs;              /* versions held, newest first; guarded by <mutex> */
+
+  /* On a NUMA machine, each version's residues are spread over the
+   * nodes in slices, and each search thread is pinned to a node and
+   * searches the sequences of its node's slice before the others'.
+   */
+  int          nnodes;           /* NUMA nodes in use; 1 if none, or --nonuma */
+  int          packed;           /* TRUE to pack the cached residues (--packed) */
+  int          hmmrest;          /* --hmmrest <n>: cache profiles lazily, keeping <n> complete; -1: off */
+  int          imgport;          /* serve the databases' image on this port, 0 if not (--imgport) */
+  char        *imgdir;           /* ... keeping the images fetched in this directory (--imgdir) */
+  char        *master_ip;        /* the master's address (--worker) */
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t    node_cpus[MAX_NODES]; /* our cpus on each node         */
+#endif
+
+  P7_MXPOOL   *mxpool;           /* DP matrices kept between searches, or NULL */
+  WORKER_CTX  *ctxs;             /* idle search contexts, most recently used first; guarded by <mutex> */
+  int          nctxs;            /* ... how many; at most <ncpus> are kept */
+
+  /* The master may send a search while others are running. Each runs
+   * in its own thread, on a share of the cpus, and answers when done.
+   */
+  pthread_mutex_t  mutex;        /* guards <nactive>, <jobs>, <dbs> and <ctxs> */
+  pthread_cond_t   cond;         /* signaled when a search finishes  */
+  int              nactive;      /* number of searches running       */
+  struct search_job_s *jobs;     /* the searches running, for HMMD_CMD_CANCEL */
+  pthread_mutex_t  write_mutex;  /* one reply at a time on <fd>      */
 } WORKER_ENV;
 
+/* a search or reload command, handed to the thread that runs it */
+typedef struct search_job_s {
+  HMMD_COMMAND *cmd;
+  WORKER_ENV   *env;
+  int           ncpus;           /* threads to search with           */
+  double        t_recv;          /* when the command was read        */
+
+  uint32_t      query_id;        /* master's id for the search; a batch's, its first query's */
+  volatile int  cancel;          /* TRUE once the master has cancelled the search */
+  struct search_job_s *next;     /* next search running              */
+} SEARCH_JOB;
+
 static void process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
-static void process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query);
+static void process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, WORKER_DB *db, QUEUE_DATA *query, int ncpus, volatile int *cancel);
+static void process_CancelCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
 static void process_Shutdown(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static void process_ReleaseCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+
+static int   load_Databases(HMMD_COMMAND *cmd, WORKER_ENV *env, WORKER_DB **ret_db);
+static int   fetch_Image(HMMD_COMMAND *cmd, WORKER_ENV *env, char *dbfile, int file, int nfiles, char **ret_local);
+static void  close_Databases(WORKER_DB *db);
+static void  start_ReloadCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static void *reload_job(void *arg);
+static void  free_Released(WORKER_ENV *env);
+
+static void  numa_Init(WORKER_ENV *env, int enabled);
+static void  numa_Place(WORKER_ENV *env, WORKER_DB *db);
+static int   next_Work(WORKER_INFO *info, int *ret_inx);
+static int   query_Profile(ESL_SQ *seq, P7_HMM *hmm, ESL_GETOPTS *opts, P7_BG *bg, P7_OPROFILE **ret_om, char *errbuf);
+
+static WORKER_CTX *get_Context(WORKER_ENV *env, const char *opts, ESL_GETOPTS *go, int M_hint);
+static void        put_Context(WORKER_ENV *env, WORKER_CTX *ctx);
+static void        free_Contexts(WORKER_ENV *env);
+
+static void  start_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static void  wait_Searches(WORKER_ENV *env);
+static void *search_job(void *arg);
 
 static QUEUE_DATA *process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static P7_HMM     *unpack_Hmm(char *p, int M, ESL_ALPHABET *abc);
 
 static int  setup_masterside_comm(ESL_GETOPTS *opts);
 
-static void send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli);
+static void send_results(WORKER_ENV *env, QUEUE_DATA *query, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli);
+static void send_error(WORKER_ENV *env, QUEUE_DATA *query, char *msg);
 
 #define BLOCK_SIZE 1000
 static void search_thread(void *arg);
@@ -135,6 +243,7 @@ read_Command(HMMD_COMMAND **ret_cmd, WORKER_ENV *env)
     }
   }
 
+  p7_PROBE2(hmmpgmd__worker__recv, cmd->hdr.command, cmd->hdr.length);
   *ret_cmd = cmd;
   return eslOK;
 }
@@ -146,38 +255,58 @@ worker_process(ESL_GETOPTS *go)
   int           shutdown = 0;
   WORKER_ENV    env;
   int           status;
-   
-  QUEUE_DATA      *query      = NULL;   
+  int           n;
   
   /* Initializations */
   impl_Init();
   p7_FLogsumInit();      /* we're going to use table-driven Logsum() approximations at times */
 
   env.ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"),  esl_threads_GetCPUCount());
+  numa_Init(&env, ! esl_opt_GetBoolean(go, "--nonuma"));
+  env.packed = esl_opt_GetBoolean(go, "--packed");
+  env.hmmrest = esl_opt_IsOn(go, "--hmmrest") ? esl_opt_GetInteger(go, "--hmmrest") : -1;
+  env.imgport = esl_opt_IsOn(go, "--imgport") ? esl_opt_GetInteger(go, "--imgport") : 0;
+  env.imgdir  = esl_opt_GetString(go, "--imgdir");
+  env.master_ip = esl_opt_GetString(go, "--worker");
 
-  env.hmm_db = NULL;
-  env.seq_db = NULL;
-  env.fd     = setup_masterside_comm(go);
+  /* peers may ask for our image as soon as the master names us their parent; they wait for the load */
+  if (env.imgport != 0) hmmpgmd_ImageServe(env.imgport);
 
+  env.dbs = NULL;
+
+  /* Pipelines borrow their DP matrices from a pool that lives as long
+   * as the worker, so a search doesn't start by allocating them.
+   */
+  env.mxpool = NULL;
+  if (esl_opt_GetInteger(go, "--mxpool") > 0)
+    env.mxpool = p7_mxpool_Create(ESL_MBYTES((size_t) esl_opt_GetInteger(go, "--mxpool")), ESL_MBYTES((size_t) esl_opt_GetInteger(go, "--mxtrim")));
+  env.fd     = setup_masterside_comm(go);
+  env.ctxs   = NULL;
+  env.nctxs  = 0;
+
+  env.nactive = 0;
+  env.jobs    = NULL;
+  if ((n = pthread_mutex_init(&env.mutex, NULL))       != 0) LOG_FATAL_MSG("mutex init", n);
+  if ((n = pthread_cond_init (&env.cond, NULL))        != 0) LOG_FATAL_MSG("cond init", n);
+  if ((n = pthread_mutex_init(&env.write_mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+
+  /* Searches run in the background, so that the next command can be
+   * read while they do; the databases are only replaced by an INIT, or
+   * the worker shut down, once they have all answered. A RELOAD loads
+   * the new databases in the background too, next to the old ones.
+   */
   while (!shutdown) 
     {
       if ((status = read_Command(&cmd, &env)) != eslOK) break;
 
       switch (cmd->hdr.command) {
-      case HMMD_CMD_INIT:      process_InitCmd  (cmd, &env);                break;
-      case HMMD_CMD_SCAN: 
-	  {	  
- 		   query = process_QueryCmd(cmd, &env);
- 		   process_SearchCmd(cmd, &env, query);
- 		   free_QueueData(query);
-	  }
-		 break;
-      case HMMD_CMD_SEARCH:
-		   query = process_QueryCmd(cmd, &env);
-	     process_SearchCmd(cmd, &env, query);
-       free_QueueData(query);
-         break;
-      case HMMD_CMD_SHUTDOWN:  process_Shutdown (cmd, &env);  shutdown = 1; break;
+      case HMMD_CMD_INIT:      wait_Searches(&env); process_InitCmd  (cmd, &env);                break;
+      case HMMD_CMD_SCAN:
+      case HMMD_CMD_SEARCH:    start_SearchCmd(cmd, &env);  cmd = NULL;                          break;
+      case HMMD_CMD_RELOAD:    start_ReloadCmd(cmd, &env);  cmd = NULL;                          break;
+      case HMMD_CMD_RELEASE:   process_ReleaseCmd(cmd, &env);                                    break;
+      case HMMD_CMD_CANCEL:    process_CancelCmd (cmd, &env);                                    break;
+      case HMMD_CMD_SHUTDOWN:  wait_Searches(&env); process_Shutdown (cmd, &env);  shutdown = 1; break;
       default: p7_syslog(LOG_ERR,"[%s:%d] - unknown command %d (%d)\n", __FILE__, __LINE__, cmd->hdr.command, cmd->hdr.length);
       }
 
@@ -185,35 +314,167 @@ worker_process(ESL_GETOPTS *go)
       cmd = NULL;
     }
 
-  if (env.hmm_db) p7_hmmcache_Close(env.hmm_db);
-  if (env.seq_db) p7_seqcache_Close(env.seq_db);
+  wait_Searches(&env);
+  pthread_mutex_destroy(&env.mutex);
+  pthread_cond_destroy(&env.cond);
+  pthread_mutex_destroy(&env.write_mutex);
+
+  close_Databases(env.dbs);
+  free_Contexts(&env);  /* before the pool their pipelines' matrices go back to */
+  if (env.mxpool) p7_mxpool_Destroy(env.mxpool);
   if (env.fd != -1) close(env.fd);
   return;
 }
 
 
+/* start_SearchCmd()
+ * Start a thread to run search command <cmd>, which it takes
+ * ownership of. The new search gets an equal share of the cpus with
+ * the ones already running (at least one); when they overlap, the
+ * scheduler interleaves them.
+ */
+static void
+start_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
+{
+  SEARCH_JOB *job = NULL;
+  pthread_t   thread_id;
+  int         n;
+
+  if ((job = malloc(sizeof(SEARCH_JOB))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  job->cmd    = cmd;
+  job->env    = env;
+  job->t_recv = hmmpgmd_Now();
+  job->query_id = cmd->srch.query_id;
+  job->cancel   = FALSE;
+
+  /* listed before the next command is read, so a cancel can't miss it */
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  env->nactive++;
+  job->ncpus = ESL_MAX(1, env->ncpus / env->nactive);
+  job->next  = env->jobs;
+  env->jobs  = job;
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if ((n = pthread_create(&thread_id, NULL, search_job, job)) != 0) LOG_FATAL_MSG("thread create", n);
+}
+
+/* process_CancelCmd()
+ * The master has given up on search <cmd->srch.query_id>: if it is
+ * still running, its threads stop claiming work, and it answers with
+ * an error instead of results. A search that isn't running anymore
+ * has already answered; the cancel crossed its reply.
+ */
+static void
+process_CancelCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
+{
+  SEARCH_JOB *job;
+  int         n;
+
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (job = env->jobs; job != NULL; job = job->next)
+    if (job->query_id == cmd->srch.query_id) job->cancel = TRUE;
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* wait_Searches()
+ * Wait for all running searches to finish and send their results.
+ */
+static void
+wait_Searches(WORKER_ENV *env)
+{
+  int n;
+
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  while (env->nactive > 0)
+    if ((n = pthread_cond_wait(&env->cond, &env->mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+static void *
+search_job(void *arg)
+{
+  SEARCH_JOB  *job   = (SEARCH_JOB *) arg;
+  WORKER_ENV  *env   = job->env;
+  QUEUE_DATA  *query = NULL;
+  WORKER_DB   *db    = NULL;
+  SEARCH_JOB **prev;
+  int          n;
+
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self());
+
+  query = process_QueryCmd(job->cmd, env);
+  query->t_recv = job->t_recv;
+  for (n = 0; n < query->nbatch; n++) query->batch[n]->t_recv = job->t_recv;
+
+  /* hold on to the version of the databases the master split the search over */
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (db = env->dbs; db != NULL; db = db->next)
+    if (db->version == job->cmd->srch.db_version) break;
+  if (db != NULL) db->refs++;
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (db != NULL)           process_SearchCmd(job->cmd, env, db, query, job->ncpus, &job->cancel);
+  else if (query->nbatch == 0) send_error(env, query, "database version not loaded on worker");
+  else for (n = 0; n < query->nbatch; n++) send_error(env, query->batch[n], "database version not loaded on worker");
+  free_QueueData(query);
+  free(job->cmd);
+
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (prev = &env->jobs; *prev != job; prev = &(*prev)->next) ;
+  *prev = job->next;
+  free(job);
+  if (db != NULL) db->refs--;
+  /* with no other search running, a lazy profile cache can let go of what it's read */
+  if (db != NULL && env->nactive == 1 && db->hmm_db != NULL && p7_hmmcache_Trim(db->hmm_db) != eslOK) LOG_FATAL_MSG("malloc", ENOMEM);
+  free_Released(env);
+  env->nactive--;
+  if ((n = pthread_cond_broadcast(&env->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  pthread_exit(NULL);
+}
+
 static void 
-process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
+process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, WORKER_DB *db, QUEUE_DATA *query, int ncpus, volatile int *cancel)
 { 
   int              i;
-  int              cnt;
-  int              limit;
+  int              k;
+  int              q;
   int              status;
-  int              blk_size;
+  QUEUE_DATA     **qs         = NULL; /* the queries answered: the batch, or just <query> */
+  ESL_SQ         **seqs       = NULL;
+  int              nq;
+  HMMD_WORK        work[MAX_NODES];
+  int              nwork;
+  int              bound[MAX_NODES+1]; /* work[k] is targets bound[k]..bound[k+1]-1 */
+  int              nthreads[MAX_NODES];
+  double           cells;              /* DP cells per target, roughly */
+  int64_t          qlen;               /* nodes, or residues, of the batch's queries */
   WORKER_INFO     *info       = NULL;
+  P7_TOPHITS     **thl        = NULL;
+  P7_BG           *bg         = NULL;
+  P7_OPROFILE    **oms        = NULL;  /* search: the queries' profiles, for all the threads */
   ESL_ALPHABET    *abc;
   ESL_STOPWATCH   *w;
   ESL_THREADS     *threadObj  = NULL;
-  pthread_mutex_t  inx_mutex;
-  int              current_index;
   time_t           date;
   char             timestamp[32];
+  char             errbuf[eslERRBUFSIZE];
 
   w = esl_stopwatch_Create();
   abc = esl_alphabet_Create(eslAMINO);
 
-  if (pthread_mutex_init(&inx_mutex, NULL) != 0) p7_Fail("mutex init failed");
-  ESL_ALLOC(info, sizeof(*info) * env->ncpus);
+  ESL_ALLOC(info, sizeof(*info) * ncpus);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * ncpus);
+
+  nq = (query->nbatch > 0) ? query->nbatch : 1;
+  ESL_ALLOC(qs,   sizeof(QUEUE_DATA *) * nq);
+  ESL_ALLOC(seqs, sizeof(ESL_SQ *)     * nq);
+  for (q = 0; q < nq; q++) {
+    qs[q]   = (query->nbatch > 0) ? query->batch[q] : query;
+    seqs[q] = qs[q]->seq;
+  }
 
   /* Log the current time (at search start) */
   date = time(NULL);
@@ -222,6 +483,40 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
 
   /* initialize thread data */
   esl_stopwatch_Start(w);
+  for (q = 0; q < nq; q++) qs[q]->t_start = hmmpgmd_Now();
+
+  /* A search's threads all search with the same profiles: build them
+   * once, rather than in each of them. A query of a coalesced search
+   * whose profile can't be built is answered with the error, and the
+   * others go on without it.
+   */
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    bg = p7_bg_Create(query->abc);
+    ESL_ALLOC(oms, sizeof(P7_OPROFILE *) * nq);
+    for (k = 0, q = 0; q < nq; q++) {
+      if (query_Profile(seqs[q], qs[q]->hmm, qs[q]->opts, bg, &oms[k], errbuf) != eslOK) {
+        p7_syslog(LOG_ERR,"[%s:%d] - query %u: %s\n", __FILE__, __LINE__, qs[q]->query_id, errbuf);
+        send_error(env, qs[q], errbuf);
+        continue;
+      }
+      qs[k]   = qs[q];
+      seqs[k] = seqs[q];
+      k++;
+    }
+    nq = k;
+
+    if (nq == 0) {
+      p7_bg_Destroy(bg);
+      free(oms);
+      free(info);
+      free(thl);
+      free(qs);
+      free(seqs);
+      esl_stopwatch_Destroy(w);
+      esl_alphabet_Destroy(abc);
+      return;
+    }
+  }
 
   info->range_list = NULL;
   if (esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
@@ -233,7 +528,10 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   if (query->cmd_type == HMMD_CMD_SEARCH) threadObj = esl_threads_Create(&search_thread);
   else                                    threadObj = esl_threads_Create(&scan_thread);
 
-  if (query->query_type == HMMD_SEQUENCE) {
+  if (query->nbatch > 0) {
+    fprintf(stdout, "Search %d %s  [%s ...]", nq, (query->query_type == HMMD_SEQUENCE) ? "seqs" : "hmms",
+            (query->query_type == HMMD_SEQUENCE) ? seqs[0]->name : qs[0]->hmm->name);
+  } else if (query->query_type == HMMD_SEQUENCE) {
     fprintf(stdout, "Search seq %s  [L=%ld]", query->seq->name, (long) query->seq->n);
   } else {
     fprintf(stdout, "Search hmm %s  [M=%d]", query->hmm->name, query->hmm->M);
@@ -247,87 +545,169 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
 
   fprintf(stdout, "\n");
 
+  /* Split a sequence search by the NUMA node holding the residues.
+   * numa_Place() laid the residues out in list order, so each node's
+   * targets are a run of the list.
+   */
+  nwork    = (query->cmd_type == HMMD_CMD_SEARCH) ? db->nnodes : 1;
+  bound[0] = 0;
+  for (k = 1; k < nwork; k++) {
+    HMMER_SEQ **sq_list = &db->seq_db->db[query->dbx].list[query->inx];
+    int         lo      = bound[k-1];
+    int         hi      = query->cnt;
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (sq_list[mid]->dsq < db->node_res[k]) lo = mid + 1;
+      else                                     hi = mid;
+    }
+    bound[k] = lo;
+  }
+  bound[nwork] = query->cnt;
+  for (k = 0; k < nwork; k++) nthreads[k] = 0;
+
   /* Create processing pipeline and hit list */
-  for (i = 0; i < env->ncpus; ++i) {
+  for (i = 0; i < ncpus; ++i) {
     info[i].abc   = query->abc;
     info[i].hmm   = query->hmm;
-    info[i].seq   = query->seq;
+    info[i].seq   = seqs[0];
+    info[i].oms   = oms;
+    info[i].seqs  = seqs;
+    info[i].nseqs = nq;
     info[i].opts  = query->opts;
 
     info[i].range_list  = info[0].range_list;
 
     info[i].th    = NULL;
     info[i].pli   = NULL;
-
-    info[i].inx_mutex = &inx_mutex;
-    info[i].inx       = &current_index;/* this is confusing trickery - to share a single variable across all threads */
-    info[i].blk_size  = &blk_size;     /* ditto */
-    info[i].limit     = &limit;	       /* ditto. TODO: come back and clean this up. */
+    info[i].ths   = NULL;
+    info[i].plis  = NULL;
+
+    info[i].mxpool = env->mxpool;
+    info[i].ctxs   = NULL;
+    info[i].cancel = cancel;
+
+    info[i].work  = work;
+    info[i].nwork = nwork;
+    info[i].home  = i * nwork / ncpus;
+    nthreads[info[i].home]++;
+#ifdef HAVE_SCHED_SETAFFINITY
+    info[i].cpus  = (nwork > 1) ? &env->node_cpus[info[i].home] : NULL;
+#endif
 
     if (query->cmd_type == HMMD_CMD_SEARCH) {
-      HMMER_SEQ **list  = env->seq_db->db[query->dbx].list;
+      HMMER_SEQ **list  = db->seq_db->db[query->dbx].list;
       info[i].sq_list   = &list[query->inx];
       info[i].sq_cnt    = query->cnt;
-      info[i].db_Z      = env->seq_db->db[query->dbx].K;
+      info[i].db_Z      = db->seq_db->db[query->dbx].K;
       info[i].om_list   = NULL;
       info[i].om_cnt    = 0;
+      info[i].hcache    = NULL;
+      ESL_ALLOC(info[i].ctxs, sizeof(WORKER_CTX *)  * nq);
+      ESL_ALLOC(info[i].plis, sizeof(P7_PIPELINE *) * nq);
+      ESL_ALLOC(info[i].ths,  sizeof(P7_TOPHITS *)  * nq);
+      for (q = 0; q < nq; q++) {
+        info[i].ctxs[q] = get_Context(env, cmd->srch.data, qs[q]->opts, oms[q]->M);
+        info[i].plis[q] = info[i].ctxs[q]->pli;
+        info[i].ths[q]  = info[i].ctxs[q]->th;
+      }
     } else {
       info[i].sq_list   = NULL;
       info[i].sq_cnt    = 0;
       info[i].db_Z      = 0;
-      info[i].om_list   = &env->hmm_db->list[query->inx];
+      info[i].om_list   = &db->hmm_db->list[query->inx];
       info[i].om_cnt    = query->cnt;
+      info[i].hcache    = (db->hmm_db->lazy ? db->hmm_db : NULL);
+      ESL_ALLOC(info[i].plis, sizeof(P7_PIPELINE *) * nq);
+      ESL_ALLOC(info[i].ths,  sizeof(P7_TOPHITS *)  * nq);
     }
 
     esl_threads_AddThread(threadObj, &info[i]);
   }
 
-  /* try block size of 5000.  we will need enough sequences for four
-   * blocks per thread or better.
+  /* sequences are cheap enough to hand out in chunks of at least 64;
+   * profiles are scanned in smaller chunks near the end. Chunks are
+   * capped at about p7_BLOCK_CELLS DP cells, from the mean target
+   * size, so a long query doesn't leave one thread with a chunk as
+   * big as a few others' whole share.
    */
-  blk_size = 5000;
-  cnt = query->cnt / env->ncpus / blk_size;
-  limit = query->cnt * 2 / 3;
-  if (cnt < 4) {
-    /* try block size of 1000  */
-    blk_size /= 5;
-    cnt = query->cnt / env->ncpus / blk_size;
-    if (cnt < 4) {
-      /* still not enough.  just divide it up into one block per thread */
-      blk_size = query->cnt / env->ncpus + 1;
-      limit = query->cnt * 2;
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    P7_SEQCACHE *sdb = db->seq_db;
+
+    for (qlen = 0, q = 0; q < nq; q++)
+      qlen += (qs[q]->query_type == HMMD_SEQUENCE) ? qs[q]->seq->n : qs[q]->hmm->M;
+    cells = (sdb->count > 0) ? (double) sdb->res_size / sdb->count * qlen : 1.0;
+    for (k = 0; k < nwork; k++) {
+      hmmpgmd_InitWork(&work[k], bound[k+1], ESL_MAX(1, nthreads[k]), 64, (int) ESL_MIN(HMMD_WORK_MAXBLK, p7_BLOCK_CELLS / ESL_MAX(1.0, cells)));
+      work[k].next = bound[k];
     }
   }
-  current_index = 0;
+  else {
+    for (cells = 0., i = 0; i < info[0].om_cnt; i++) cells += info[0].om_list[i]->M;
+    for (qlen = 0, q = 0; q < nq; q++) qlen += seqs[q]->n;
+    cells = cells / ESL_MAX(1, info[0].om_cnt) * qlen;
+    hmmpgmd_InitWork(&work[0], info[0].om_cnt, ncpus, 4, (int) ESL_MIN(HMMD_WORK_MAXBLK, p7_BLOCK_CELLS / ESL_MAX(1.0, cells)));
+  }
 
   esl_threads_WaitForStart(threadObj);
   esl_threads_WaitForFinish(threadObj);
 
   esl_stopwatch_Stop(w);
+  for (q = 0; q < nq; q++) qs[q]->t_done = hmmpgmd_Now();
 #if 1
-  fprintf (stdout, "   Sequences  Residues                              Elapsed\n");
-  for (i = 0; i < env->ncpus; ++i) {
-    print_timings(i, info[i].elapsed, info[i].pli);
+  if (nq == 1) {
+    fprintf (stdout, "   Sequences  Residues                              Elapsed\n");
+    for (i = 0; i < ncpus; ++i) {
+      print_timings(i, info[i].elapsed, info[i].pli);
+    }
   }
 #endif
-  /* merge the results of the search results */
-  for (i = 1; i < env->ncpus; ++i) {
-    p7_tophits_Merge(info[0].th, info[i].th);
-    p7_pipeline_Merge(info[0].pli, info[i].pli);
-    p7_pipeline_Destroy(info[i].pli);
-    p7_tophits_Destroy(info[i].th);
-  }
+  /* merge the results of each query, and answer it */
+  for (q = 0; q < nq; q++) {
+    for (i = 0; i < ncpus; ++i) {
+      info[i].th  = info[i].ths[q];
+      info[i].pli = info[i].plis[q];
+    }
 
-  print_timings(99, w->elapsed, info[0].pli);
-  send_results(env->fd, w, info[0].th, info[0].pli);
+    for (i = 1; i < ncpus; ++i) thl[i-1] = info[i].th;
+    p7_tophits_MergeMany(info[0].th, thl, ncpus-1);
+    for (i = 1; i < ncpus; ++i) {
+      p7_pipeline_Merge(info[0].pli, info[i].pli);
+      if (info[i].ctxs == NULL) {  /* a search's are kept, in its contexts */
+        p7_pipeline_Destroy(info[i].pli);
+        p7_tophits_Destroy(info[i].th);
+      }
+    }
+    if (query->cmd_type == HMMD_CMD_SEARCH && info[0].pli->Z_setby == p7_ZSETBY_NTARGETS)
+      info[0].pli->Z = info[0].db_Z;   /* _Merge() added the other threads' counts to it */
 
-  /* free the last of the pipeline data */
-  p7_pipeline_Destroy(info->pli);
-  p7_tophits_Destroy(info->th);
+    print_timings(99, w->elapsed, info[0].pli);
+    if (*cancel) send_error(env, qs[q], "search cancelled by the master");
+    else         send_results(env, qs[q], w, info[0].th, info[0].pli);
+
+    /* free the last of the pipeline data */
+    if (info->ctxs == NULL) {
+      p7_pipeline_Destroy(info->pli);
+      p7_tophits_Destroy(info->th);
+    }
+  }
 
   esl_threads_Destroy(threadObj);
 
-  pthread_mutex_destroy(&inx_mutex);
+  /* the search's pipelines and hit lists are reset for the next one */
+  for (i = 0; i < ncpus; ++i)
+    if (info[i].ctxs)
+      for (q = 0; q < nq; q++) put_Context(env, info[i].ctxs[q]);
+  if (oms) {
+    for (q = 0; q < nq; q++) p7_oprofile_Destroy(oms[q]);
+    free(oms);
+  }
+  if (bg) p7_bg_Destroy(bg);
+
+  for (i = 0; i < ncpus; ++i) {
+    if (info[i].ctxs) free(info[i].ctxs);
+    if (info[i].plis) free(info[i].plis);
+    if (info[i].ths)  free(info[i].ths);
+  }
 
   if (info->range_list) {
     if (info->range_list->starts)  free(info->range_list->starts);
@@ -336,6 +716,9 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   }
 
   free(info);
+  free(thl);
+  free(qs);
+  free(seqs);
 
   esl_stopwatch_Destroy(w);
   esl_alphabet_Destroy(abc);
@@ -370,6 +753,9 @@ process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
   query->dbx        = cmd->srch.db_inx;
   query->inx        = cmd->srch.inx;
   query->cnt        = cmd->srch.cnt;
+  query->query_id   = cmd->srch.query_id;
+  query->trace_id   = cmd->srch.trace_id;
+  query->span_id    = cmd->srch.span_id;
   query->sock       = env->fd;
   query->cmd        = NULL;
 
@@ -384,6 +770,50 @@ process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
 
   query->abc = esl_alphabet_Create(eslAMINO);
 
+  /* a batch scan, one query per sequence, or a coalesced search, one
+   * per sequence or HMM; all with the same options. They use the
+   * alphabet of <query>, which holds them
+   */
+  if (cmd->srch.nqueries > 0) {
+    HMMD_BATCH_QUERY  bq;
+    QUEUE_DATA       *member;
+
+    query->nbatch = cmd->srch.nqueries;
+    if ((query->batch = malloc(sizeof(QUEUE_DATA *) * query->nbatch)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+    p += cmd->srch.opts_length;
+    for (i = 0; i < query->nbatch; i++) {
+      if ((member = malloc(sizeof(QUEUE_DATA))) == NULL) LOG_FATAL_MSG("malloc", errno);
+      memset(member, 0, sizeof(QUEUE_DATA));
+
+      memcpy(&bq, p, sizeof(HMMD_BATCH_QUERY));
+      p += sizeof(HMMD_BATCH_QUERY);
+
+      member->cmd_type   = query->cmd_type;
+      member->query_type = query->query_type;
+      member->dbx        = query->dbx;
+      member->inx        = query->inx;
+      member->cnt        = query->cnt;
+      member->query_id   = bq.query_id;
+      member->sock       = env->fd;
+
+      status = process_searchopts(env->fd, cmd->srch.data, &member->opts);
+      if (status != eslOK)  LOG_FATAL_MSG("esl_getopts_Create", status);
+
+      if (query->query_type == HMMD_SEQUENCE) {
+        name = p;
+        desc = name + strlen(name) + 1;
+        dsq  = (ESL_DSQ *) (desc + strlen(desc) + 1);
+        member->seq = esl_sq_CreateDigitalFrom(query->abc, name, dsq, bq.query_length - 2, desc, NULL, NULL);
+      } else
+        member->hmm = unpack_Hmm(p, bq.query_length, query->abc);
+      p += bq.data_length;
+
+      query->batch[i] = member;
+    }
+    return query;
+  }
+
   /* check if we are processing a sequence or hmm */
   if (cmd->srch.query_type == HMMD_SEQUENCE) {
     n    = cmd->srch.query_length - 2;
@@ -392,101 +822,196 @@ process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
     dsq  = (ESL_DSQ *) (desc + strlen(desc) + 1);
     query->seq = esl_sq_CreateDigitalFrom(query->abc, name, dsq, n, desc, NULL, NULL);
   } else {
-    P7_HMM  thmm;
-    P7_HMM *hmm = p7_hmm_CreateShell();
-
-    /* allocate memory for the hmm and initialize */
-    p += cmd->srch.opts_length;
-    memcpy(&thmm, p, sizeof(P7_HMM));
-
-    hmm->flags = thmm.flags;
-    p7_hmm_CreateBody(hmm, cmd->srch.query_length, query->abc);
-    p += sizeof(P7_HMM);
-
-    /* initialize fields */
-    hmm->nseq       = thmm.nseq;
-    hmm->eff_nseq   = thmm.eff_nseq;
-    hmm->max_length = thmm.max_length;
-    hmm->checksum   = thmm.checksum;
-    hmm->ctime      = NULL;
-    hmm->comlog     = NULL;
-
-    for (i = 0; i < p7_NCUTOFFS; i++) hmm->cutoff[i]  = thmm.cutoff[i];
-    for (i = 0; i < p7_NEVPARAM; i++) hmm->evparam[i] = thmm.evparam[i];
-    for (i = 0; i < p7_MAXABET;  i++) hmm->compo[i]   = thmm.compo[i];
-
-    /* fill in the hmm pointers */
-    n = sizeof(float) * (hmm->M + 1) * p7H_NTRANSITIONS;
-    memcpy(*hmm->t, p, n);     p += n;
-
-    n = sizeof(float) * (hmm->M + 1) * query->abc->K;
-    memcpy(*hmm->mat, p, n);   p += n;
-    memcpy(*hmm->ins, p, n);   p += n;
-
-    if (thmm.name) { hmm->name = strdup(p); p += strlen(hmm->name) + 1; }
-    if (thmm.acc)  { hmm->acc  = strdup(p); p += strlen(hmm->acc)  + 1; }
-    if (thmm.desc) { hmm->desc = strdup(p); p += strlen(hmm->desc) + 1; }
-
-    n = hmm->M + 2;
-    if (hmm->flags & p7H_RF)    { memcpy(hmm->rf,        p, n); p += n; }
-    if (hmm->flags & p7H_MMASK) { memcpy(hmm->mm,        p, n); p += n; }
-    if (hmm->flags & p7H_CONS)  { memcpy(hmm->consensus, p, n); p += n; }
-    if (hmm->flags & p7H_CS)    { memcpy(hmm->cs,        p, n); p += n; }
-    if (hmm->flags & p7H_CA)    { memcpy(hmm->ca,        p, n); p += n; }
-
-    n = sizeof(int) * (hmm->M + 1);
-    if (hmm->flags & p7H_MAP) {  memcpy(hmm->map,       p, n); p += n; }
-
-    query->hmm = hmm;
+    query->hmm = unpack_Hmm(p + cmd->srch.opts_length, cmd->srch.query_length, query->abc);
   }
 
   return query;
 }
 
+/* unpack_Hmm()
+ * Create the query HMM of <M> nodes serialized at <p>, as the master's
+ * build_command() wrote it, in alphabet <abc>.
+ */
+static P7_HMM *
+unpack_Hmm(char *p, int M, ESL_ALPHABET *abc)
+{
+  P7_HMM  thmm;
+  P7_HMM *hmm = p7_hmm_CreateShell();
+  int     i;
+  int     n;
+
+  /* allocate memory for the hmm and initialize */
+  memcpy(&thmm, p, sizeof(P7_HMM));
+
+  hmm->flags = thmm.flags;
+  p7_hmm_CreateBody(hmm, M, abc);
+  p += sizeof(P7_HMM);
+
+  /* initialize fields */
+  hmm->nseq       = thmm.nseq;
+  hmm->eff_nseq   = thmm.eff_nseq;
+  hmm->max_length = thmm.max_length;
+  hmm->checksum   = thmm.checksum;
+  hmm->ctime      = NULL;
+  hmm->comlog     = NULL;
+
+  for (i = 0; i < p7_NCUTOFFS; i++) hmm->cutoff[i]  = thmm.cutoff[i];
+  for (i = 0; i < p7_NEVPARAM; i++) hmm->evparam[i] = thmm.evparam[i];
+  for (i = 0; i < p7_MAXABET;  i++) hmm->compo[i]   = thmm.compo[i];
+
+  /* fill in the hmm pointers */
+  n = sizeof(float) * (hmm->M + 1) * p7H_NTRANSITIONS;
+  memcpy(*hmm->t, p, n);     p += n;
+
+  n = sizeof(float) * (hmm->M + 1) * abc->K;
+  memcpy(*hmm->mat, p, n);   p += n;
+  memcpy(*hmm->ins, p, n);   p += n;
+
+  if (thmm.name) { hmm->name = strdup(p); p += strlen(hmm->name) + 1; }
+  if (thmm.acc)  { hmm->acc  = strdup(p); p += strlen(hmm->acc)  + 1; }
+  if (thmm.desc) { hmm->desc = strdup(p); p += strlen(hmm->desc) + 1; }
+
+  n = hmm->M + 2;
+  if (hmm->flags & p7H_RF)    { memcpy(hmm->rf,        p, n); p += n; }
+  if (hmm->flags & p7H_MMASK) { memcpy(hmm->mm,        p, n); p += n; }
+  if (hmm->flags & p7H_CONS)  { memcpy(hmm->consensus, p, n); p += n; }
+  if (hmm->flags & p7H_CS)    { memcpy(hmm->cs,        p, n); p += n; }
+  if (hmm->flags & p7H_CA)    { memcpy(hmm->ca,        p, n); p += n; }
+
+  n = sizeof(int) * (hmm->M + 1);
+  if (hmm->flags & p7H_MAP) {  memcpy(hmm->map,       p, n); p += n; }
+
+  return hmm;
+}
+
 static void
 process_Shutdown(HMMD_COMMAND *cmd, WORKER_ENV  *env)
 {
+  HMMD_REPLY     reply;
   int            n;
 
-  n = MSG_SIZE(cmd);
-  cmd->hdr.status = eslOK;
-  if (writen(env->fd, cmd, n) != n) {
+  memset(&reply, 0, sizeof(HMMD_REPLY));
+  reply.command  = HMMD_CMD_SHUTDOWN;
+  reply.query_id = 0;
+
+  n = sizeof(HMMD_REPLY);
+  if (writen(env->fd, &reply, n) != n) {
     LOG_FATAL_MSG("write error", errno);
   }
 }
 
-static void
-process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
+/* fetch_Image()
+ * Fetch files <file>..<file>+<nfiles>-1 of the image of database
+ * file <dbfile> named by HMMD_CMD_INIT <cmd> into <env->imgdir>: from
+ * the peer <cmd> names, or if it fails, from the master; see
+ * HMMD_CMD_FETCH. Returns eslOK, and in <*ret_local> the name the
+ * database has in <env->imgdir>, which the caller frees and opens
+ * instead of <dbfile>. Otherwise logs why, and returns the error
+ * code; the caller reads <dbfile> itself.
+ */
+static int
+fetch_Image(HMMD_COMMAND *cmd, WORKER_ENV *env, char *dbfile, int file, int nfiles, char **ret_local)
 {
-  char *p;
-  int   n;
-  int   status;
+  char        errbuf[eslERRBUFSIZE];
+  const char *src[2];
+  char       *path   = NULL;
+  int         nsrc   = 0;
+  int         status = eslFAIL;
+  int         s, f;
+
+  *ret_local = NULL;
+  cmd->init.img_ip[sizeof(cmd->init.img_ip)-1] = '\0';
+  if (cmd->init.img_ip[0] != '\0') src[nsrc++] = cmd->init.img_ip;
+  src[nsrc++] = env->master_ip;
+
+  for (s = 0; s < nsrc; s++)
+    {
+      for (f = file; f < file + nfiles; f++)
+        {
+          if ((status = hmmpgmd_ImagePath(dbfile, f, env->imgdir, &path)) != eslOK) return status;
+          status = hmmpgmd_ImageFetch(src[s], cmd->init.img_port, &cmd->init, f, path, errbuf);
+          free(path);
+          path = NULL;
+          if (status != eslOK) break;
+        }
+      /* the profile database's own file has no suffix: its name is the database's local name */
+      if (status == eslOK) return hmmpgmd_ImagePath(dbfile, HMMD_IMG_HMM, env->imgdir, ret_local);
+      if (status == eslEMEM) return status;
+      p7_syslog(LOG_ERR,"[%s:%d] - fetching image of %s from %s: %s\n", __FILE__, __LINE__, dbfile, src[s], errbuf);
+    }
+  return status;
+}
+
+/* load_Databases()
+ * Load the databases named by HMMD_CMD_INIT or HMMD_CMD_RELOAD
+ * command <cmd>, and check them against the master's; pack the
+ * sequence cache's residues if <env->packed>. If the command names
+ * an image source (--imgport), first fetch the databases' image and
+ * load that, falling back to the databases themselves; either way,
+ * serve what was loaded to peers. Returns eslOK and the new version
+ * in <*ret_db>; otherwise logs the error and returns its code, with
+ * <*ret_db> NULL.
+ */
+static int
+load_Databases(HMMD_COMMAND *cmd, WORKER_ENV *env, WORKER_DB **ret_db)
+{
+  WORKER_DB *db    = NULL;
+  char      *local = NULL;
+  char      *path[HMMD_IMG_NFILES];
+  char      *p;
+  int        f;
+  int        status;
 
-  if (env->hmm_db != NULL) p7_hmmcache_Close(env->hmm_db);
-  if (env->seq_db != NULL) p7_seqcache_Close(env->seq_db);
+  for (f = 0; f < HMMD_IMG_NFILES; f++) path[f] = NULL;
 
-  env->hmm_db = NULL;
-  env->seq_db = NULL;
+  if ((db = malloc(sizeof(WORKER_DB))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(db, 0, sizeof(WORKER_DB));
+  db->version = cmd->init.db_version;
+  db->nnodes  = 1;
 
   /* load the sequence database */
   if (cmd->init.db_cnt != 0) {
     P7_SEQCACHE *sdb = NULL;
 
     p  = cmd->init.data + cmd->init.seqdb_off;
-    status = p7_seqcache_Open(p, &sdb, NULL);
+    status = eslFAIL;
+    if (env->imgport != 0 && cmd->init.img_port != 0 && fetch_Image(cmd, env, p, HMMD_IMG_SEQSNAP, 1, &local) == eslOK) {
+      if ((status = p7_seqcache_Open(local, &sdb, NULL)) != eslOK)
+        p7_syslog(LOG_ERR,"[%s:%d] - p7_seqcache_Open %s error %d; reading %s\n", __FILE__, __LINE__, local, status, p);
+    }
+    if (status != eslOK) status = p7_seqcache_Open(p, &sdb, NULL);
+    free(local);
+    local = NULL;
     if (status != eslOK) {
       p7_syslog(LOG_ERR,"[%s:%d] - p7_seqcache_Open %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache seqdb error", status);
+      goto ERROR;
     }
+    db->seq_db = sdb;
 
     /* validate the sequence database */
     cmd->init.sid[MAX_INIT_DESC-1] = 0;
     if (strcmp (cmd->init.sid, sdb->id) != 0 || cmd->init.db_cnt != sdb->db_cnt || cmd->init.seq_cnt != sdb->count) {
       p7_syslog(LOG_ERR,"[%s:%d] - seq db %s: integrity error %s - %s\n", __FILE__, __LINE__, p, cmd->init.sid, sdb->id);
-      LOG_FATAL_MSG("database integrity error", 0);
+      status = eslEINCOMPAT;
+      goto ERROR;
     }
 
-    env->seq_db = sdb;
+    /* the master splits searches by place in the lists: use its order */
+    if ((status = p7_seqcache_SortByLength(sdb, cmd->init.lsort)) != eslOK) {
+      p7_syslog(LOG_ERR,"[%s:%d] - p7_seqcache_SortByLength %s error %d\n", __FILE__, __LINE__, p, status);
+      goto ERROR;
+    }
+
+    /* a cache loaded from a snapshot can hand it on; one parsed from FASTA can't */
+    if (sdb->snap_mem != NULL && (status = hmmpgmd_ImagePath(sdb->name, HMMD_IMG_SEQSNAP, NULL, &path[HMMD_IMG_SEQSNAP])) != eslOK) goto ERROR;
+
+    if (env->packed) {
+      if ((status = p7_seqcache_Pack(sdb)) != eslOK) {
+        p7_syslog(LOG_ERR,"[%s:%d] - p7_seqcache_Pack %s error %d\n", __FILE__, __LINE__, p, status);
+        goto ERROR;
+      }
+      printf("Packed seq db %s residues;  memory: %" PRIu64 "\n", p, (uint64_t) p7_seqcache_Sizeof(sdb));
+    }
   }
 
   /* load the hmm database */
@@ -494,16 +1019,25 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
     P7_HMMCACHE *hcache = NULL;
 
     p  = cmd->init.data + cmd->init.hmmdb_off;
-
-    status = p7_hmmcache_Open(p, &hcache, NULL);
+    if (env->imgport != 0 && cmd->init.img_port != 0 && fetch_Image(cmd, env, p, HMMD_IMG_HMM, HMMD_IMG_NFILES - HMMD_IMG_HMM, &local) == eslOK) p = local;
+
+    if (env->hmmrest >= 0) status = p7_hmmcache_OpenLazy(p, (uint32_t) env->hmmrest, &hcache, NULL);
+    else                   status = p7_hmmcache_Open    (p,                          &hcache, NULL);
+    if (status != eslOK && local != NULL) {
+      p = cmd->init.data + cmd->init.hmmdb_off;
+      p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_Open %s error %d; reading %s\n", __FILE__, __LINE__, local, status, p);
+      if (env->hmmrest >= 0) status = p7_hmmcache_OpenLazy(p, (uint32_t) env->hmmrest, &hcache, NULL);
+      else                   status = p7_hmmcache_Open    (p,                          &hcache, NULL);
+    }
     if (status != eslOK) {
       p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_Open %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache hmmdb error", status);
+      goto ERROR;
     }
+    db->hmm_db = hcache;
 
     if ( (status = p7_hmmcache_SetNumericNames(hcache)) != eslOK){
       p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_SetNumericNames %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache hmmdb error", status);
+      goto ERROR;
     }
 
     /* validate the hmm database */
@@ -511,16 +1045,408 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
     /* TODO: come up with a new pressed format with an id to compare - strcmp (cmd->init.hid, hdb->id) != 0 */
     if (cmd->init.hmm_cnt != 1 || cmd->init.model_cnt != hcache->n) {
       p7_syslog(LOG_ERR,"[%s:%d] - hmm db %s: integrity error\n", __FILE__, __LINE__, p);
-      LOG_FATAL_MSG("database integrity error", 0);
+      status = eslEINCOMPAT;
+      goto ERROR;
     }
 
-    env->hmm_db = hcache;
-
     printf("Loaded profile db %s;  models: %d  memory: %" PRId64 "\n",
-         p, hcache->n, (uint64_t) p7_hmmcache_Sizeof(hcache));
+         hcache->name, hcache->n, (uint64_t) p7_hmmcache_Sizeof(hcache));
 
+    for (f = HMMD_IMG_HMM; f < HMMD_IMG_NFILES; f++)
+      if ((status = hmmpgmd_ImagePath(hcache->name, f, NULL, &path[f])) != eslOK) goto ERROR;
   }
 
+  if (env->imgport != 0)
+    hmmpgmd_ImageSet(db->seq_db ? db->seq_db->id : "", db->seq_db ? db->seq_db->count : 0, db->hmm_db ? db->hmm_db->n : 0, path);
+
+  for (f = 0; f < HMMD_IMG_NFILES; f++) free(path[f]);
+  free(local);
+  *ret_db = db;
+  return eslOK;
+
+ ERROR:
+  for (f = 0; f < HMMD_IMG_NFILES; f++) free(path[f]);
+  free(local);
+  db->next = NULL;
+  close_Databases(db);
+  *ret_db = NULL;
+  return status;
+}
+
+/* close_Databases()
+ * Free the list of database versions starting at <db>.
+ */
+static void
+close_Databases(WORKER_DB *db)
+{
+  WORKER_DB *next;
+
+  for ( ; db != NULL; db = next) {
+    next = db->next;
+    if (db->hmm_db != NULL) p7_hmmcache_Close(db->hmm_db);
+    if (db->seq_db != NULL) p7_seqcache_Close(db->seq_db);
+    free(db);
+  }
+}
+
+/* free_Released()
+ * Free the database versions that have been released and that no
+ * search is using. The caller holds <env->mutex>.
+ */
+static void
+free_Released(WORKER_ENV *env)
+{
+  WORKER_DB **prev;
+  WORKER_DB  *db;
+
+  prev = &env->dbs;
+  while ((db = *prev) != NULL) {
+    if (db->released && db->refs == 0) {
+      *prev    = db->next;
+      db->next = NULL;
+      printf("Freed database version %d\n", db->version);
+      close_Databases(db);
+    } else {
+      prev = &db->next;
+    }
+  }
+}
+
+#ifdef HAVE_SCHED_SETAFFINITY
+/* numa_ReadCpus()
+ * Read the cpus of NUMA node <node> into <cpus>. Returns eslOK, or
+ * eslENOTFOUND if there is no such node.
+ */
+static int
+numa_ReadCpus(int node, cpu_set_t *cpus)
+{
+  char  path[64];
+  char  buf[4096];
+  char *p;
+  FILE *fp;
+  long  lo, hi;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  if ((fp = fopen(path, "r")) == NULL) return eslENOTFOUND;
+  if (fgets(buf, sizeof(buf), fp) == NULL) buf[0] = 0;
+  fclose(fp);
+
+  /* a list of ranges, such as "0-7,16-23" */
+  CPU_ZERO(cpus);
+  for (p = buf; *p >= '0' && *p <= '9'; ) {
+    lo = hi = strtol(p, &p, 10);
+    if (*p == '-') hi = strtol(p+1, &p, 10);
+    for ( ; lo <= hi && lo < CPU_SETSIZE; lo++) CPU_SET(lo, cpus);
+    if (*p == ',') p++;
+  }
+  return eslOK;
+}
+
+/* one node's share of copying the residues: sequences first..last-1 */
+typedef struct {
+  HMMER_SEQ *list;
+  uint32_t   first;
+  uint32_t   last;
+  ESL_DSQ   *dst;              /* where sequence <first> goes      */
+  cpu_set_t *cpus;
+} NUMA_COPY;
+
+static void *
+numa_copy(void *arg)
+{
+  NUMA_COPY *c = (NUMA_COPY *) arg;
+  ESL_DSQ   *p = c->dst;
+  uint32_t   i;
+
+  /* the first write to a page puts it on the writer's node */
+  sched_setaffinity(0, sizeof(cpu_set_t), c->cpus);
+  for (i = c->first; i < c->last; i++) {
+    memcpy(p, c->list[i].dsq, c->list[i].n + 1);
+    p += c->list[i].n + 1;
+  }
+  return NULL;
+}
+#endif /*HAVE_SCHED_SETAFFINITY*/
+
+/* numa_Init()
+ * Find the NUMA nodes we have cpus on. Threads are only placed if
+ * <enabled> and there are at least two.
+ */
+static void
+numa_Init(WORKER_ENV *env, int enabled)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t allowed;
+  cpu_set_t cpus;
+  int       node;
+  int       n = 0;
+#endif
+
+  env->nnodes = 1;
+#ifdef HAVE_SCHED_SETAFFINITY
+  if (!enabled) return;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) return;
+
+  for (node = 0; n < MAX_NODES && numa_ReadCpus(node, &cpus) == eslOK; node++) {
+    /* skip nodes with memory only, or none of our cpus */
+    CPU_AND(&env->node_cpus[n], &cpus, &allowed);
+    if (CPU_COUNT(&env->node_cpus[n]) > 0) n++;
+  }
+  if (n > 1) {
+    env->nnodes = n;
+    printf("Placing search threads and residues on %d NUMA nodes\n", n);
+  }
+#endif
+}
+
+/* numa_Place()
+ * Spread the residues of <db>'s sequence cache over the NUMA nodes:
+ * copy them to a new arena in the order of the sequence list, which
+ * the sub-databases' target lists follow, with each node's slice of
+ * it written by a thread on that node, so the slice is in the node's
+ * memory. Needs twice the memory of the residues while copying; if
+ * that can't be had, the residues stay where they are and searches
+ * aren't split by node. Packed residues (--packed) aren't placed.
+ */
+static void
+numa_Place(WORKER_ENV *env, WORKER_DB *db)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  P7_SEQCACHE *sdb    = db->seq_db;
+  NUMA_COPY    copy[MAX_NODES];
+  pthread_t    tid[MAX_NODES];
+  void        *mem    = NULL;
+  ESL_DSQ     *p;
+  uint64_t     slice;
+  uint64_t     off;
+  uint64_t     align;
+  uint32_t     i;
+  int          k;
+  int          n;
+#endif
+
+  db->nnodes = 1;
+#ifdef HAVE_SCHED_SETAFFINITY
+  /* with hugepages, a node's slice is whole hugepages, so that none is
+   * first touched by, and placed on, the wrong node
+   */
+  align = (p7_hugemem_Mode() != p7_HUGEMEM_OFF) ? p7_HUGEMEM_MIN : NUMA_ALIGN;
+  if (env->nnodes < 2 || sdb == NULL || sdb->pack_mem != NULL || sdb->res_size < (uint64_t) env->nnodes * align) return;
+
+  if (posix_memalign(&mem, align, sdb->res_size) != 0) {
+    p7_syslog(LOG_ERR,"[%s:%d] - no memory to place %" PRIu64 " residues by NUMA node\n", __FILE__, __LINE__, sdb->res_size);
+    return;
+  }
+  p7_hugemem_Advise(mem, sdb->res_size);
+
+  /* a node's slice starts with the first sequence past a page boundary */
+  slice = (sdb->res_size / env->nnodes + align - 1) / align * align;
+  p     = (ESL_DSQ *) mem;
+  off   = 0;
+  i     = 0;
+  for (k = 0; k < env->nnodes; k++) {
+    copy[k].list  = sdb->list;
+    copy[k].first = i;
+    copy[k].dst   = p + off;
+    copy[k].cpus  = &env->node_cpus[k];
+    while (i < sdb->count && (k == env->nnodes-1 || off < (uint64_t) (k+1) * slice)) {
+      off += sdb->list[i].n + 1;
+      i++;
+    }
+    copy[k].last  = i;
+    if ((n = pthread_create(&tid[k], NULL, numa_copy, &copy[k])) != 0) LOG_FATAL_MSG("thread create", n);
+  }
+  for (k = 0; k < env->nnodes; k++)
+    if ((n = pthread_join(tid[k], NULL)) != 0) LOG_FATAL_MSG("thread join", n);
+  p[off] = eslDSQ_SENTINEL;
+
+  p7_seqcache_MoveResidues(sdb, mem);
+  for (k = 0; k < env->nnodes; k++) db->node_res[k] = copy[k].dst;
+  db->nnodes = env->nnodes;
+#endif
+}
+
+/* next_Work()
+ * Claim the next chunk of a search's targets for thread <info>: from
+ * its home node's share while that lasts, then from the others'.
+ * Returns the number of targets, 0 when all are taken, or when the
+ * search has been cancelled.
+ */
+static int
+next_Work(WORKER_INFO *info, int *ret_inx)
+{
+  int k;
+  int n;
+
+  if (*info->cancel) return 0;
+  for (k = 0; k < info->nwork; k++)
+    if ((n = hmmpgmd_NextWork(&info->work[(info->home + k) % info->nwork], ret_inx)) > 0) return n;
+  return 0;
+}
+
+/* query_Profile()
+ * Build the optimized profile a search's threads share: from query
+ * sequence <seq> with the score system <opts> asks for, or else from
+ * query HMM <hmm>. Returns eslOK and the profile in <*ret_om>; or an
+ * error code, with a message in <errbuf>.
+ */
+static int
+query_Profile(ESL_SQ *seq, P7_HMM *hmm, ESL_GETOPTS *opts, P7_BG *bg, P7_OPROFILE **ret_om, char *errbuf)
+{
+  P7_BUILDER  *bld  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  int          seed;
+  int          status;
+
+  if (seq != NULL) {
+    bld = p7_builder_Create(NULL, bg->abc);
+    if ((seed = esl_opt_GetInteger(opts, "--seed")) > 0) {
+      esl_randomness_Init(bld->r, seed);
+      bld->do_reseeding = TRUE;
+    }
+    bld->EmL = esl_opt_GetInteger(opts, "--EmL");
+    bld->EmN = esl_opt_GetInteger(opts, "--EmN");
+    bld->EvL = esl_opt_GetInteger(opts, "--EvL");
+    bld->EvN = esl_opt_GetInteger(opts, "--EvN");
+    bld->EfL = esl_opt_GetInteger(opts, "--EfL");
+    bld->EfN = esl_opt_GetInteger(opts, "--EfN");
+    bld->Eft = esl_opt_GetReal   (opts, "--Eft");
+
+    if (esl_opt_IsOn(opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(opts, "--mxfile"), NULL, esl_opt_GetReal(opts, "--popen"), esl_opt_GetReal(opts, "--pextend"), bg);
+    else                                status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(opts, "--mx"),           esl_opt_GetReal(opts, "--popen"), esl_opt_GetReal(opts, "--pextend"), bg);
+    if (status != eslOK) {
+      snprintf(errbuf, eslERRBUFSIZE, "failed to set single query sequence score system: %s", bld->errbuf);
+      p7_builder_Destroy(bld);
+      return status;
+    }
+    if ((status = p7_SingleBuilder(bld, seq, bg, NULL, NULL, NULL, &om)) != eslOK) { /* bypass HMM - only need model */
+      snprintf(errbuf, eslERRBUFSIZE, "failed to build a profile from the query sequence: %s", bld->errbuf);
+      p7_builder_Destroy(bld);
+      return status;
+    }
+    p7_builder_Destroy(bld);
+  } else {
+    gm = p7_profile_Create (hmm->M, bg->abc);
+    om = p7_oprofile_Create(hmm->M, bg->abc);
+    if (gm == NULL || om == NULL) {
+      snprintf(errbuf, eslERRBUFSIZE, "failed to allocate the query profile");
+      if (gm) p7_profile_Destroy(gm);
+      if (om) p7_oprofile_Destroy(om);
+      return eslEMEM;
+    }
+    p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL);
+    p7_oprofile_Convert(gm, om);
+    p7_profile_Destroy(gm);
+  }
+
+  *ret_om = om;
+  return eslOK;
+}
+
+/* get_Context()
+ * Take an idle search context created for options string <opts>
+ * (parsed, <go>), or create a new one, sized for a query of about
+ * <M_hint> nodes. Fatal on allocation failure, like the rest of a
+ * search's setup.
+ */
+static WORKER_CTX *
+get_Context(WORKER_ENV *env, const char *opts, ESL_GETOPTS *go, int M_hint)
+{
+  WORKER_CTX **pp;
+  WORKER_CTX  *ctx = NULL;
+
+  if (pthread_mutex_lock(&env->mutex) != 0) LOG_FATAL_MSG("mutex lock", errno);
+  for (pp = &env->ctxs; *pp != NULL; pp = &(*pp)->next)
+    if (strcmp((*pp)->opts, opts) == 0) {
+      ctx = *pp;
+      *pp = ctx->next;
+      env->nctxs--;
+      break;
+    }
+  if (pthread_mutex_unlock(&env->mutex) != 0) LOG_FATAL_MSG("mutex unlock", errno);
+  if (ctx != NULL) return ctx;
+
+  if ((ctx = malloc(sizeof(WORKER_CTX))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((ctx->opts = strdup(opts))        == NULL) LOG_FATAL_MSG("strdup", errno);
+  ctx->th   = p7_tophits_Create();
+  ctx->pli  = p7_pipeline_CreateInPool(env->mxpool, go, M_hint, 100, FALSE, p7_SEARCH_SEQS);
+  ctx->next = NULL;
+  if (ctx->th == NULL || ctx->pli == NULL) LOG_FATAL_MSG("malloc", ENOMEM);
+  p7_tophits_BorrowStrings(ctx->th);  /* hits name sequences in the cache, which outlives the search */
+  if (esl_opt_IsOn(go, "--topk") && p7_pipeline_SetTopK(ctx->pli, esl_opt_GetInteger(go, "--topk")) != eslOK) LOG_FATAL_MSG("malloc", ENOMEM);
+  return ctx;
+}
+
+/* put_Context()
+ * Reset search context <ctx> for another query, and make it idle
+ * again. The least recently used contexts beyond <ncpus> of them
+ * (one search's worth) are freed.
+ */
+static void
+put_Context(WORKER_ENV *env, WORKER_CTX *ctx)
+{
+  WORKER_CTX **pp;
+  WORKER_CTX  *old = NULL;
+  int          n;
+
+  p7_tophits_Reuse(ctx->th);
+  p7_pipeline_ReuseQuery(ctx->pli);
+
+  if (pthread_mutex_lock(&env->mutex) != 0) LOG_FATAL_MSG("mutex lock", errno);
+  ctx->next = env->ctxs;
+  env->ctxs = ctx;
+  if (++env->nctxs > env->ncpus) {
+    for (n = 1, pp = &env->ctxs; n < env->ncpus; n++) pp = &(*pp)->next;
+    old = (*pp)->next;
+    (*pp)->next = NULL;
+    env->nctxs  = env->ncpus;
+  }
+  if (pthread_mutex_unlock(&env->mutex) != 0) LOG_FATAL_MSG("mutex unlock", errno);
+
+  while (old != NULL) {
+    ctx = old->next;
+    p7_tophits_Destroy(old->th);
+    p7_pipeline_Destroy(old->pli);
+    free(old->opts);
+    free(old);
+    old = ctx;
+  }
+}
+
+/* free_Contexts()
+ * Free all of the worker's idle search contexts, at shutdown.
+ */
+static void
+free_Contexts(WORKER_ENV *env)
+{
+  WORKER_CTX *ctx;
+
+  while ((ctx = env->ctxs) != NULL) {
+    env->ctxs = ctx->next;
+    p7_tophits_Destroy(ctx->th);
+    p7_pipeline_Destroy(ctx->pli);
+    free(ctx->opts);
+    free(ctx);
+  }
+  env->nctxs = 0;
+}
+
+static void
+process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
+{
+  WORKER_DB *db = NULL;
+  int        n;
+  int        status;
+
+  /* no search is running: drop every version we hold */
+  close_Databases(env->dbs);
+  env->dbs = NULL;
+
+  if ((status = load_Databases(cmd, env, &db)) != eslOK) LOG_FATAL_MSG("cache database error", status);
+  numa_Place(env, db);
+  env->dbs = db;
+
   /* if stdout is redirected at the commandline, it causes printf's to be buffered,
    * which means status logging isn't printed. This line strongly requests unbuffering,
    * which should be ok, given the low stdout load of hmmpgmd
@@ -538,133 +1464,227 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
   }
 }
 
+/* start_ReloadCmd()
+ * Load the databases of reload command <cmd>, which it takes
+ * ownership of, in a thread of its own, so the searches of the
+ * version held now go on meanwhile.
+ */
+static void
+start_ReloadCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
+{
+  SEARCH_JOB *job = NULL;
+  pthread_t   thread_id;
+  int         n;
+
+  if ((job = malloc(sizeof(SEARCH_JOB))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  job->cmd   = cmd;
+  job->env   = env;
+  job->ncpus = 0;
+
+  /* counted as a search, so a shutdown or an init waits for it */
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  env->nactive++;
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if ((n = pthread_create(&thread_id, NULL, reload_job, job)) != 0) LOG_FATAL_MSG("thread create", n);
+}
+
+static void *
+reload_job(void *arg)
+{
+  SEARCH_JOB *job   = (SEARCH_JOB *) arg;
+  WORKER_ENV *env   = job->env;
+  WORKER_DB  *db    = NULL;
+  HMMD_REPLY  reply;
+  int         n;
+
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self());
+
+  printf("Reloading databases, version %u\n", job->cmd->init.db_version);
+  fflush(stdout);
+
+  if (load_Databases(job->cmd, env, &db) == eslOK) numa_Place(env, db);
+
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (db != NULL && (env->dbs == NULL || db->version > env->dbs->version)) {
+    db->next = env->dbs;
+    env->dbs = db;
+  } else if (db != NULL) {
+    close_Databases(db);
+  }
+  memset(&reply, 0, sizeof(HMMD_REPLY));
+  reply.command  = HMMD_CMD_RELOAD;
+  reply.query_id = (env->dbs == NULL) ? 0 : env->dbs->version;
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  /* tell the master which version we hold now */
+  if ((n = pthread_mutex_lock (&env->write_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (writen(env->fd, &reply, sizeof(HMMD_REPLY)) != sizeof(HMMD_REPLY)) LOG_FATAL_MSG("write", errno);
+  if ((n = pthread_mutex_unlock (&env->write_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  printf("Database version %u is loaded\n", reply.query_id);
+  fflush(stdout);
+
+  free(job->cmd);
+  free(job);
+
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  env->nactive--;
+  if ((n = pthread_cond_broadcast(&env->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  pthread_exit(NULL);
+}
+
+/* process_ReleaseCmd()
+ * No search will name a database version older than the one in
+ * <cmd> any more: free those, apart from the newest we hold, as soon
+ * as their searches are done.
+ */
+static void
+process_ReleaseCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
+{
+  WORKER_DB *db;
+  int        n;
+
+  if ((n = pthread_mutex_lock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (env->dbs != NULL)
+    for (db = env->dbs->next; db != NULL; db = db->next)
+      if (db->version < cmd->init.db_version) db->released = TRUE;
+  free_Released(env);
+  if ((n = pthread_mutex_unlock (&env->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
 
 static void 
 search_thread(void *arg)
 {
   int               i;
   int               count;
-  int               seed;
-  int               status;
   int               workeridx;
+  enum p7_zsetby_e  zsetby;
   WORKER_INFO      *info;
   ESL_THREADS      *obj;
-  ESL_SQ            dbsq;
+  ESL_SQ_BLOCK      block;                   /* a chunk of the cached targets, as ESL_SQ shells */
+  ESL_DSQ          *res      = NULL;         /* the chunk's residues, if the cache is packed */
+  int64_t           nres     = 0;            /* allocated size of <res>        */
   ESL_STOPWATCH    *w        = NULL;         /* timing stopwatch               */
-  P7_BUILDER       *bld      = NULL;         /* HMM construction configuration */
-  P7_BG            *bg       = NULL;         /* null model                     */
-  P7_PIPELINE      *pli      = NULL;         /* work pipeline                  */
-  P7_TOPHITS       *th       = NULL;         /* top hit results                */
-  P7_PROFILE       *gm       = NULL;         /* generic model                  */
-  P7_OPROFILE      *om       = NULL;         /* optimized query profile        */
+  P7_BG           **bg       = NULL;         /* null model of each query, with its bias filter */
+  P7_OPROFILE     **om       = NULL;         /* our clones of the query profiles */
+  int               q;
 
   obj = (ESL_THREADS *) arg;
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+#ifdef HAVE_SCHED_SETAFFINITY
+  if (info->cpus != NULL) sched_setaffinity(0, sizeof(cpu_set_t), info->cpus);
+#endif
   w    = esl_stopwatch_Create();
-  bg   = p7_bg_Create(info->abc);
   esl_stopwatch_Start(w);
 
-  /* set up the dummy description and accession fields */
-  dbsq.desc = "";
-  dbsq.acc  = "";
-
-  /* process a query sequence or hmm */
-  if (info->seq != NULL) {
-    bld = p7_builder_Create(NULL, info->abc);
-    if ((seed = esl_opt_GetInteger(info->opts, "--seed")) > 0) {
-      esl_randomness_Init(bld->r, seed);
-      bld->do_reseeding = TRUE;
-    }
-    bld->EmL = esl_opt_GetInteger(info->opts, "--EmL");
-    bld->EmN = esl_opt_GetInteger(info->opts, "--EmN");
-    bld->EvL = esl_opt_GetInteger(info->opts, "--EvL");
-    bld->EvN = esl_opt_GetInteger(info->opts, "--EvN");
-    bld->EfL = esl_opt_GetInteger(info->opts, "--EfL");
-    bld->EfN = esl_opt_GetInteger(info->opts, "--EfN");
-    bld->Eft = esl_opt_GetReal   (info->opts, "--Eft");
-
-    if (esl_opt_IsOn(info->opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(info->opts, "--mxfile"), NULL, esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg);
-    else                                      status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(info->opts, "--mx"),           esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg); 
-    if (status != eslOK) {
-      //client_error(info->sock, status, "hmmgpmd: failed to set single query sequence score system: %s", bld->errbuf);
-      fprintf(stderr, "hmmpgmd: failed to set single query sequence score system: %s", bld->errbuf);
-      pthread_exit(NULL);
-      return;
+  block.list     = NULL;
+  block.listSize = 0;
+  block.complete = TRUE;
+
+  /* the profiles are shared; only their length configuration, which
+   * the pipeline sets for each target, is our clones' own. The
+   * pipelines and hit lists are the contexts', fresh or reset by the
+   * last search to use them.
+   *
+   * Z is the whole database's size from the start, not the running
+   * count of targets that p7_Pipeline_Block()'s p7_pli_NewSeq() calls
+   * would keep; so it's held fixed while we search. The queries share
+   * their options, so it's set the same way for all of them.
+   */
+  if ((om = malloc(sizeof(P7_OPROFILE *) * info->nseqs)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((bg = malloc(sizeof(P7_BG *)       * info->nseqs)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  zsetby = info->plis[0]->Z_setby;
+  for (q = 0; q < info->nseqs; q++) {
+    if ((om[q] = p7_oprofile_Clone(info->oms[q])) == NULL) LOG_FATAL_MSG("malloc", ENOMEM);
+    if ((bg[q] = p7_bg_Create(info->abc))         == NULL) LOG_FATAL_MSG("malloc", ENOMEM);
+    p7_pli_NewModel(info->plis[q], om[q], bg[q]);
+    if (zsetby == p7_ZSETBY_NTARGETS) {
+      info->plis[q]->Z       = info->db_Z;
+      info->plis[q]->Z_setby = p7_ZSETBY_OPTION;
     }
-    p7_SingleBuilder(bld, info->seq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
-    p7_builder_Destroy(bld);
-  } else {
-    gm = p7_profile_Create (info->hmm->M, info->abc);
-    om = p7_oprofile_Create(info->hmm->M, info->abc);
-    p7_ProfileConfig(info->hmm, bg, gm, 100, p7_LOCAL);
-    p7_oprofile_Convert(gm, om);
   }
 
-  /* Create processing pipeline and hit list */
-  th  = p7_tophits_Create(); 
-  pli = p7_pipeline_Create(info->opts, om->M, 100, FALSE, p7_SEARCH_SEQS);
-  p7_pli_NewModel(pli, om, bg);
-
-  if (pli->Z_setby == p7_ZSETBY_NTARGETS) pli->Z = info->db_Z;
-
   /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
+  for ( ;; ) {
     int          inx;
-    int          blksz;
     HMMER_SEQ  **sq;
+    void        *p;
+    int64_t      need;
 
     /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->sq_cnt * 2;
-      } else {
-        *info->limit = inx + (info->sq_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
-
+    if ((count = next_Work(info, &inx)) == 0) break;
     sq = info->sq_list + inx;
 
-    count = info->sq_cnt - inx;
-    if (count > blksz) count = blksz;
-
-    /* Main loop: */
-    for (i = 0; i < count; ++i, ++sq) {
-      if ( !(info->range_list) || hmmpgmd_IsWithinRanges ((*sq)->idx, info->range_list)) {
-        dbsq.name  = (*sq)->name;
-        dbsq.dsq   = (*sq)->dsq;
-        dbsq.n     = (*sq)->n;
-        dbsq.idx   = (*sq)->idx;
-        if((*sq)->desc != NULL) dbsq.desc  = (*sq)->desc;
-
-        p7_bg_SetLength(bg, dbsq.n);
-        p7_oprofile_ReconfigLength(om, dbsq.n);
+    if (count > block.listSize) {
+      if ((p = realloc(block.list, sizeof(ESL_SQ) * count)) == NULL) LOG_FATAL_MSG("realloc", errno);
+      block.list     = p;
+      block.listSize = count;
+    }
 
-        p7_Pipeline(pli, om, bg, &dbsq, NULL, th);
+    /* a packed cache's chunk is unpacked into our own buffer first */
+    for (need = 0, i = 0; i < count; ++i)
+      if (sq[i]->pk != NULL) need += sq[i]->n + 2;
+    if (need > nres) {
+      if ((p = realloc(res, sizeof(ESL_DSQ) * need)) == NULL) LOG_FATAL_MSG("realloc", errno);
+      res  = p;
+      nres = need;
+    }
 
-        p7_pipeline_Reuse(pli);
+    /* Main loop: the chunk goes through the pipeline as one block,
+     * so the batch SSV filter (on AVX2, or a GPU) sees all of it at
+     * once; and through each query's in turn, while its residues are
+     * still in cache. The ESL_SQ shells borrow the cache's names and
+     * residues.
+     */
+    for (block.count = 0, need = 0, i = 0; i < count; ++i, ++sq) {
+      if ( !(info->range_list) || hmmpgmd_IsWithinRanges ((*sq)->idx, info->range_list)) {
+        ESL_SQ *dbsq = block.list + block.count++;
+
+        memset(dbsq, 0, sizeof(ESL_SQ));
+        dbsq->name  = (*sq)->name;
+        dbsq->acc   = "";
+        dbsq->desc  = ((*sq)->desc != NULL) ? (*sq)->desc : "";
+        dbsq->dsq   = (*sq)->dsq;
+        dbsq->n     = (*sq)->n;
+        dbsq->idx   = (*sq)->idx;
+        if ((*sq)->pk != NULL) {
+          dbsq->dsq = res + need;
+          p7_seqcache_Unpack(*sq, dbsq->dsq);
+          need += (*sq)->n + 2;
+        }
       }
     }
+
+    for (q = 0; q < info->nseqs; q++)
+      if (p7_Pipeline_Block(info->plis[q], om[q], bg[q], &block, info->ths[q]) == eslEMEM) LOG_FATAL_MSG("malloc", ENOMEM);
   }
+  free(block.list);
+  if (res != NULL) free(res);
 
-  /* make available the pipeline objects to the main thread */
-  info->th = th;
-  info->pli = pli;
+  /* make available the pipeline objects to the main thread,
+   * with our hits already sorted for its k-way merge
+   */
+  for (q = 0; q < info->nseqs; q++) {
+    info->plis[q]->Z_setby = zsetby;
+    p7_tophits_SortBySortkey(info->ths[q]);
+  }
+  info->th  = info->ths[0];
+  info->pli = info->plis[0];
 
   /* clean up */
-  p7_bg_Destroy(bg);
-  p7_oprofile_Destroy(om);
-
-  if (gm != NULL)  p7_profile_Destroy(gm);
+  for (q = 0; q < info->nseqs; q++) {
+    p7_bg_Destroy(bg[q]);
+    p7_oprofile_Destroy(om[q]);
+  }
+  free(bg);
+  free(om);
 
   esl_stopwatch_Stop(w);
   info->elapsed = w->elapsed;
@@ -690,7 +1710,8 @@ scan_thread(void *arg)
 
   P7_BG            *bg       = NULL;         /* null model                     */
   P7_PIPELINE      *pli      = NULL;         /* work pipeline                  */
-  P7_TOPHITS       *th       = NULL;         /* top hit results                */
+  ESL_SQ           *sq       = NULL;         /* query sequence                 */
+  int               q;
 
   obj = (ESL_THREADS *) arg;
   esl_threads_Started(obj, &workeridx);
@@ -703,53 +1724,48 @@ scan_thread(void *arg)
   /* Convert to an optimized model */
   bg = p7_bg_Create(info->abc);
 
-  /* Create processing pipeline and hit list */
-  th  = p7_tophits_Create(); 
-  pli = p7_pipeline_Create(info->opts, 100, 100, FALSE, p7_SCAN_MODELS);
-
-  p7_pli_NewSeq(pli, info->seq);
+  /* Create a processing pipeline and hit list for each query */
+  for (q = 0; q < info->nseqs; q++) {
+    info->ths[q]  = p7_tophits_Create(); 
+    info->plis[q] = p7_pipeline_CreateInPool(info->mxpool, info->opts, 100, 100, FALSE, p7_SCAN_MODELS);
+    if (esl_opt_IsOn(info->opts, "--topk") && p7_pipeline_SetTopK(info->plis[q], esl_opt_GetInteger(info->opts, "--topk")) != eslOK) LOG_FATAL_MSG("malloc", ENOMEM);
+    info->plis[q]->hcache = info->hcache;
+    p7_pli_NewSeq(info->plis[q], info->seqs[q]);
+  }
 
-  /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
+  /* loop until all profiles have been processed */
+  for ( ;; ) {
     int           inx;
-    int          blksz;
     P7_OPROFILE **om;
 
-    /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx   = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->om_cnt * 2;
-      } else {
-        *info->limit = inx + (info->om_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
-
-    om    = info->om_list + inx;
-    count = info->om_cnt - inx;
-    if (count > blksz) count = blksz;
+    /* grab the next block of profiles */
+    if ((count = next_Work(info, &inx)) == 0) break;
+    om = info->om_list + inx;
 
-    /* Main loop: */
+    /* Main loop: each profile is run against all the queries of a
+     * batch while it is still in cache
+     */
     for (i = 0; i < count; ++i, ++om) {
-      p7_pli_NewModel(pli, *om, bg);
-      p7_bg_SetLength(bg, info->seq->n);
-      p7_oprofile_ReconfigLength(*om, info->seq->n);
+      for (q = 0; q < info->nseqs; q++) {
+        sq  = info->seqs[q];
+        pli = info->plis[q];
+
+        p7_pli_NewModel(pli, *om, bg);
+        p7_bg_SetLength(bg, sq->n);
+        p7_oprofile_ReconfigLength(*om, sq->n);
 	      
-      p7_Pipeline(pli, *om, bg, info->seq, NULL, th);
-      p7_pipeline_Reuse(pli);
+        p7_Pipeline(pli, *om, bg, sq, NULL, info->ths[q]);
+        p7_pipeline_Reuse(pli);
+      }
     }
   }
 
-  /* make available the pipeline objects to the main thread */
-  info->th = th;
-  info->pli = pli;
+  /* make available the pipeline objects to the main thread,
+   * with our hits already sorted for its k-way merge
+   */
+  for (q = 0; q < info->nseqs; q++) p7_tophits_SortBySortkey(info->ths[q]);
+  info->th  = info->ths[0];
+  info->pli = info->plis[0];
 
   /* clean up */
   p7_bg_Destroy(bg);
@@ -767,16 +1783,25 @@ scan_thread(void *arg)
 
 
 static void
-send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
+send_results(WORKER_ENV *env, QUEUE_DATA *query, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
+  HMMD_REPLY          reply;
   HMMD_SEARCH_STATS   stats;
   HMMD_SEARCH_STATUS  status;
-  uint8_t **buf = NULL; // Buffer for the main results message
+  int                 fd = env->fd;
+  int                 rc;
+  uint8_t **buf = NULL; // Buffer for the stats, then for each chunk of hits
   uint8_t **buf2 = NULL; // Buffer for the initial HMMD_SEARCH_STATUS message
   uint8_t *buf_ptr = NULL; 
   uint8_t *buf2_ptr = NULL;
   uint32_t n = 0; // index within buffer of serialized data
   uint32_t nalloc = 0; // Size of serialized buffer
+  uint32_t n2 = 0;
+  uint32_t nalloc2 = 0;
+  uint32_t chunk_len; // length of a chunk of hits, in network byte order
+  uint64_t total;
+  enum p7_aliform_e form;
   int i;
+  double t_send = hmmpgmd_Now(); // start of the send span, for --trace
   // set up handles to buffers
   buf = &buf_ptr;
   buf2 = &buf2_ptr;
@@ -812,33 +1837,96 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
     LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATS failed", errno);
   }
 
-  // and then the hits
-  for(i =0; i< stats.nhits; i++){
-    if(p7_hit_Serialize(&(th->unsrt[i]), buf, &n, &nalloc) != eslOK){
-      LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
-    }
-  }
-
-  status.msg_size = n; // n will have the number of bytes used to serialize the main data block
-  n = 0;
-  nalloc = 0; // reset these to serialize status object
+  status.msg_size = n; // n will have the number of bytes used to serialize the stats; the hits follow in chunks
 
   // Serialize the search_status object
- if(hmmd_search_status_Serialize(&status, buf2, &n, &nalloc) != eslOK){
+ if(hmmd_search_status_Serialize(&status, buf2, &n2, &nalloc2) != eslOK){
     LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
   }
 
+  // Say which search this answers; other searches may be answering on <fd> too,
+  // and when it ran, for the master's trace
+  memset(&reply, 0, sizeof(HMMD_REPLY));
+  reply.command  = query->cmd_type;
+  reply.query_id = query->query_id;
+  reply.t_recv   = query->t_recv;
+  reply.t_start  = query->t_start;
+  reply.t_done   = query->t_done;
+  reply.mem_peak = ESL_MAX(pli->mem_sumpeaks, pli->mem_peaktot);
+  reply.mem_rss  = p7_pli_ProcessPeak();
+  if ((rc = pthread_mutex_lock (&env->write_mutex)) != 0) LOG_FATAL_MSG("mutex lock", rc);
+  if (writen(fd, &reply, sizeof(HMMD_REPLY)) != sizeof(HMMD_REPLY)) LOG_FATAL_MSG("write", errno);
+
   // Send the status object
-  if (writen(fd, buf2_ptr, n) != n) LOG_FATAL_MSG("write", errno);
+  if (writen(fd, buf2_ptr, n2) != n2) LOG_FATAL_MSG("write", errno);
 
-  // And the serialized data
+  // And the serialized stats
   if (writen(fd, buf_ptr, status.msg_size) != status.msg_size) LOG_FATAL_MSG("write", errno);
+  total = sizeof(HMMD_REPLY) + n2 + status.msg_size;
+
+  // and then the hits, in rank order, so the master can merge
+  // the sorted runs from its workers instead of resorting them.
+  // They go out a chunk at a time, reusing the one buffer. The master
+  // keeps alignments compact anyway, so they're sent that way; or not
+  // at all, if the client doesn't want them.
+  form = esl_opt_GetBoolean(query->opts, "--noali") ? p7_ALI_NONE : p7_ALI_COMPACT;
+  p7_tophits_SortBySortkey(th);
+  n = 0;
+  for(i =0; i< stats.nhits; i++){
+    if(p7_hit_SerializeAs(th->hit[i], form, buf, &n, &nalloc) != eslOK){
+      LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
+    }
+    if (n >= HMMD_HIT_CHUNK || i == stats.nhits-1) {
+      chunk_len = esl_hton32(n);
+      if (writen(fd, &chunk_len, sizeof(uint32_t)) != sizeof(uint32_t)) LOG_FATAL_MSG("write", errno);
+      if (writen(fd, buf_ptr, n) != n)                                   LOG_FATAL_MSG("write", errno);
+      total += sizeof(uint32_t) + n;
+      n = 0;
+    }
+  }
+  if ((rc = pthread_mutex_unlock (&env->write_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", rc);
   free(buf_ptr);
   free(buf2_ptr);
-  printf("Bytes: %" PRId64 "  hits: %" PRId64 "  sent on socket %d\n", status.msg_size, stats.nhits, fd);
+  hmmpgmd_TraceSpan(query->trace_id, HMMD_SPAN(query->query_id, HMMD_SPAN_SEND, query->span_id), query->span_id, "hmmpgmd.worker.send",
+                    t_send, hmmpgmd_Now(), query->query_id, NULL);
+  printf("Bytes: %" PRId64 "  hits: %" PRId64 "  sent on socket %d for query %u\n", total, stats.nhits, fd, query->query_id);
+  p7_PROBE2(hmmpgmd__worker__send, query->query_id, stats.nhits);
   fflush(stdout);
 }
 
+/* send_error()
+ * Answer search <query> with an error status and message <msg>
+ * instead of results.
+ */
+static void
+send_error(WORKER_ENV *env, QUEUE_DATA *query, char *msg)
+{
+  HMMD_REPLY          reply;
+  HMMD_SEARCH_STATUS  status;
+  uint8_t            *buf    = NULL;
+  uint32_t            n      = 0;
+  uint32_t            nalloc = 0;
+  int                 rc;
+
+  memset(&status, 0, sizeof(HMMD_SEARCH_STATUS)); /* silence valgrind errors - zero out entire structure including its padding */
+  status.status   = eslFAIL;
+  status.msg_size = strlen(msg) + 1;
+  if (hmmd_search_status_Serialize(&status, &buf, &n, &nalloc) != eslOK) {
+    LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
+  }
+
+  memset(&reply, 0, sizeof(HMMD_REPLY));
+  reply.command  = query->cmd_type;
+  reply.query_id = query->query_id;
+  if ((rc = pthread_mutex_lock (&env->write_mutex)) != 0) LOG_FATAL_MSG("mutex lock", rc);
+  if (writen(env->fd, &reply, sizeof(HMMD_REPLY)) != sizeof(HMMD_REPLY)) LOG_FATAL_MSG("write", errno);
+  if (writen(env->fd, buf, n) != n)                                      LOG_FATAL_MSG("write", errno);
+  if (writen(env->fd, msg, status.msg_size) != status.msg_size)         LOG_FATAL_MSG("write", errno);
+  if ((rc = pthread_mutex_unlock (&env->write_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", rc);
+
+  p7_syslog(LOG_ERR,"[%s:%d] - query %u: %s\n", __FILE__, __LINE__, query->query_id, msg);
+  free(buf);
+}
 
 static int 
 setup_masterside_comm(ESL_GETOPTS *opts)
@@ -52,10 +52,7 @@ typedef struct {
   P7_OPROFILE     **om_list;     /* list of profiles to process      */
   int               om_cnt;      /* number of profiles               */
 
-  pthread_mutex_t  *inx_mutex;   /* protect data                     */
-  int              *blk_size;    /* sequences per block              */
-  int              *limit;       /* point to decrease block size     */
-  int              *inx;         /* next index to process            */
+  HMMD_WORK        *work;        /* shared work distribution         */
 
   P7_HMM           *hmm;         /* query HMM                        */
   ESL_SQ           *seq;         /* query sequence                   */
@@ -71,14 +68,21 @@ typedef struct {
    */
   P7_PIPELINE      *pli;         /* work pipeline                    */
   P7_TOPHITS       *th;          /* top hit results                  */
+
+  P7_MXPOOL        *mxpool;      /* shared DP matrices, or NULL      */
 } WORKER_INFO;
 
 typedef struct {
   int fd;                        /* socket connection to server      */
   int ncpus;                     /* number of cpus to use            */
 
-  P7_SEQCACHE *seq_db;           /* cached sequence database         */
-  P7_HMMCACHE *hmm_db;           /* cached hmm database              */
+  P7_SEQCACHE **seq_db;          /* cached shards; [i] is shard (my_shard + i) % num_shards */
+  P7_HMMCACHE **hmm_db;          /* cached hmm database shards, the same way */
+  uint32_t     my_shard;         /* first shard held                 */
+  uint32_t     num_shards;       /* shards the database is split into */
+  uint32_t     replicas;         /* number of shards held            */
+
+  P7_MXPOOL   *mxpool;           /* DP matrices kept between searches, or NULL */
 } WORKER_ENV;
 
 
@@ -96,6 +100,7 @@ free_QueueData_shard(QUEUE_DATA_SHARD *data)
   free(data);
 }
 
+static void close_shards(WORKER_ENV *env);
 static void process_InitCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env);
 static void process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *query);
 static void process_Shutdown(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env);
@@ -172,8 +177,16 @@ worker_process_shard(ESL_GETOPTS *go)
 
   env.ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"),  esl_threads_GetCPUCount());
 
-  env.hmm_db = NULL;
-  env.seq_db = NULL;
+  env.hmm_db   = NULL;
+  env.seq_db   = NULL;
+  env.replicas = 0;
+
+  /* Pipelines borrow their DP matrices from a pool that lives as long
+   * as the worker, so a search doesn't start by allocating them.
+   */
+  env.mxpool = NULL;
+  if (esl_opt_GetInteger(go, "--mxpool") > 0)
+    env.mxpool = p7_mxpool_Create(ESL_MBYTES((size_t) esl_opt_GetInteger(go, "--mxpool")), ESL_MBYTES((size_t) esl_opt_GetInteger(go, "--mxtrim")));
   env.fd     = setup_masterside_comm(go);
 
   while (!shutdown) 
@@ -203,8 +216,8 @@ worker_process_shard(ESL_GETOPTS *go)
       cmd = NULL;
     }
 
-  if (env.hmm_db) p7_hmmcache_Close(env.hmm_db);
-  if (env.seq_db) p7_seqcache_Close(env.seq_db);
+  close_shards(&env);
+  if (env.mxpool) p7_mxpool_Destroy(env.mxpool);
   if (env.fd != -1) close(env.fd);
   return;
 }
@@ -214,24 +227,23 @@ static void
 process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *query)
 { 
   int              i;
-  int              cnt;
-  int              limit;
   int              status;
-  int              blk_size;
+  HMMD_WORK        work;
   WORKER_INFO     *info       = NULL;
+  P7_TOPHITS     **thl        = NULL;   /* the other threads' hit lists, for p7_tophits_MergeMany() */
   ESL_ALPHABET    *abc;
   ESL_STOPWATCH   *w;
   ESL_THREADS     *threadObj  = NULL;
-  pthread_mutex_t  inx_mutex;
-  int              current_index;
+  SEQ_DB          *db         = NULL;
+  P7_HMMCACHE     *hdb        = NULL;
   time_t           date;
   char             timestamp[32];
 
   w = esl_stopwatch_Create();
   abc = esl_alphabet_Create(eslAMINO);
 
-  if (pthread_mutex_init(&inx_mutex, NULL) != 0) p7_Fail("mutex init failed");
   ESL_ALLOC(info, sizeof(*info) * env->ncpus);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * env->ncpus);
 
   /* Log the current time (at search start) */
   date = time(NULL);
@@ -256,6 +268,28 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
   }  
 
 
+  /* the master only sends a shard we hold; its inx/cnt slice is
+   * counted in that shard's own list, of sequences or of models.
+   */
+  i = (env->num_shards > 0) ? (cmd->srch.shard + env->num_shards - env->my_shard) % env->num_shards : 0;
+  if (i >= env->replicas || (query->cmd_type == HMMD_CMD_SEARCH ? env->seq_db == NULL : env->hmm_db == NULL)) {
+    p7_syslog(LOG_ERR,"[%s:%d] - shard %d not loaded\n", __FILE__, __LINE__, cmd->srch.shard);
+    LOG_FATAL_MSG("search shard", 0);
+  }
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    db = &env->seq_db[i]->db[query->dbx];
+    if (query->inx + query->cnt > db->count) {
+      p7_syslog(LOG_ERR,"[%s:%d] - shard %d range %d..%d past %d\n", __FILE__, __LINE__, cmd->srch.shard, query->inx, query->inx + query->cnt, db->count);
+      LOG_FATAL_MSG("search range", 0);
+    }
+  } else {
+    hdb = env->hmm_db[i];
+    if (query->inx + query->cnt > hdb->n) {
+      p7_syslog(LOG_ERR,"[%s:%d] - shard %d range %d..%d past %d\n", __FILE__, __LINE__, cmd->srch.shard, query->inx, query->inx + query->cnt, hdb->n);
+      LOG_FATAL_MSG("search range", 0);
+    }
+  }
+
   if (query->cmd_type == HMMD_CMD_SEARCH) threadObj = esl_threads_Create(&search_thread);
   else                                    threadObj = esl_threads_Create(&scan_thread);
 
@@ -267,6 +301,7 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
   fprintf(stdout, " vs %s DB %d [%d - %d]",
           (query->cmd_type == HMMD_CMD_SEARCH) ? "SEQ" : "HMM", 
           query->dbx, query->inx, query->inx + query->cnt - 1);
+  fprintf(stdout, " of shard %d", cmd->srch.shard);
 
   if (info->range_list)
     fprintf(stdout, " in range(s) %s", esl_opt_GetString(query->opts, "--seqdb_ranges"));
@@ -285,47 +320,32 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
     info[i].th    = NULL;
     info[i].pli   = NULL;
 
-    info[i].inx_mutex = &inx_mutex;
-    info[i].inx       = &current_index;/* this is confusing trickery - to share a single variable across all threads */
-    info[i].blk_size  = &blk_size;     /* ditto */
-    info[i].limit     = &limit;	       /* ditto. TODO: come back and clean this up. */
+    info[i].mxpool = env->mxpool;
+
+    info[i].work  = &work;
 
     if (query->cmd_type == HMMD_CMD_SEARCH) {
-      HMMER_SEQ **list  = env->seq_db->db[query->dbx].list;
-      info[i].sq_list   = &list[0];  // Always search the whole DB in sharded mode
-      //info[i].sq_cnt    = query->cnt;
-      info[i].sq_cnt = env->seq_db->db[query->dbx].count;
-      info[i].db_Z      = env->seq_db->db[query->dbx].K;
+      info[i].sq_list   = &db->list[query->inx];
+      info[i].sq_cnt    = query->cnt;
+      info[i].db_Z      = db->K;
       info[i].om_list   = NULL;
       info[i].om_cnt    = 0;
     } else {
       info[i].sq_list   = NULL;
       info[i].sq_cnt    = 0;
       info[i].db_Z      = 0;
-      info[i].om_list   = &env->hmm_db->list[query->inx];
+      info[i].om_list   = &hdb->list[query->inx];
       info[i].om_cnt    = query->cnt;
     }
 
     esl_threads_AddThread(threadObj, &info[i]);
   }
 
-  /* try block size of 5000.  we will need enough sequences for four
-   * blocks per thread or better.
+  /* sequences are cheap enough to hand out in chunks of at least 64;
+   * profiles are scanned in smaller chunks near the end.
    */
-  blk_size = 5000;
-  cnt = query->cnt / env->ncpus / blk_size;
-  limit = query->cnt * 2 / 3;
-  if (cnt < 4) {
-    /* try block size of 1000  */
-    blk_size /= 5;
-    cnt = query->cnt / env->ncpus / blk_size;
-    if (cnt < 4) {
-      /* still not enough.  just divide it up into one block per thread */
-      blk_size = query->cnt / env->ncpus + 1;
-      limit = query->cnt * 2;
-    }
-  }
-  current_index = 0;
+  if (query->cmd_type == HMMD_CMD_SEARCH) hmmpgmd_InitWork(&work, info[0].sq_cnt, env->ncpus, 64, 0);
+  else                                    hmmpgmd_InitWork(&work, info[0].om_cnt, env->ncpus, 4, 0);
 
   esl_threads_WaitForStart(threadObj);
   esl_threads_WaitForFinish(threadObj);
@@ -337,9 +357,12 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
     print_timings(i, info[i].elapsed, info[i].pli);
   }
 #endif
-  /* merge the results of the search results */
+  /* merge the results of the search results: the threads sorted
+   * their own hits, so this is one k-way merge instead of a re-sort
+   */
+  for (i = 1; i < env->ncpus; ++i) thl[i-1] = info[i].th;
+  p7_tophits_MergeMany(info[0].th, thl, env->ncpus-1);
   for (i = 1; i < env->ncpus; ++i) {
-    p7_tophits_Merge(info[0].th, info[i].th);
     p7_pipeline_Merge(info[0].pli, info[i].pli);
     p7_pipeline_Destroy(info[i].pli);
     p7_tophits_Destroy(info[i].th);
@@ -354,8 +377,6 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
 
   esl_threads_Destroy(threadObj);
 
-  pthread_mutex_destroy(&inx_mutex);
-
   if (info->range_list) {
     if (info->range_list->starts)  free(info->range_list->starts);
     if (info->range_list->ends)    free(info->range_list->ends);
@@ -363,6 +384,7 @@ process_SearchCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV *env, QUEUE_DATA_SHARD *qu
   }
 
   free(info);
+  free(thl);
 
   esl_stopwatch_Destroy(w);
   esl_alphabet_Destroy(abc);
@@ -482,6 +504,23 @@ process_Shutdown(HMMD_COMMAND_SHARD *cmd, WORKER_ENV  *env)
   }
 }
 
+static void
+close_shards(WORKER_ENV *env)
+{
+  uint32_t i;
+
+  for (i = 0; i < env->replicas; i++) {
+    if (env->seq_db != NULL) p7_seqcache_Close(env->seq_db[i]);
+    if (env->hmm_db != NULL) p7_hmmcache_Close(env->hmm_db[i]);
+  }
+  if (env->seq_db != NULL) free(env->seq_db);
+  if (env->hmm_db != NULL) free(env->hmm_db);
+
+  env->seq_db   = NULL;
+  env->hmm_db   = NULL;
+  env->replicas = 0;
+}
+
 static void
 process_InitCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV  *env)
 {
@@ -489,65 +528,81 @@ process_InitCmd(HMMD_COMMAND_SHARD *cmd, WORKER_ENV  *env)
   int   n;
   int   status;
 
-  if (env->hmm_db != NULL) p7_hmmcache_Close(env->hmm_db);
-  if (env->seq_db != NULL) p7_seqcache_Close(env->seq_db);
+  close_shards(env);
 
-  env->hmm_db = NULL;
-  env->seq_db = NULL;
+  /* load the databases: our own shard, and the next replicas-1 so
+   * the master can move work off a slow neighbour.
+   */
+  env->my_shard   = cmd->init.my_shard;
+  env->num_shards = cmd->init.num_shards;
 
-  /* load the sequence database */
   if (cmd->init.db_cnt != 0) {
     P7_SEQCACHE *sdb = NULL;
+    uint32_t     i;
     //printf("This worker assigned shard %d out of %d\n", cmd->init.my_shard, cmd->init.num_shards);
 
+    if ((env->seq_db = malloc(sizeof(P7_SEQCACHE *) * cmd->init.replicas)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
     p  = cmd->init.data + cmd->init.seqdb_off;
+    for (i = 0; i < cmd->init.replicas; i++) {
 //   printf("Opening database file %s\n", p);
-    status = p7_seqcache_Open_shard(p, &sdb, NULL, cmd->init.my_shard, cmd->init.num_shards);
-    if (status != eslOK) {
-      p7_syslog(LOG_ERR,"[%s:%d] - p7_seqcache_Open %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache seqdb error", status);
-    }
+      status = p7_seqcache_Open_shard(p, &sdb, NULL, (cmd->init.my_shard + i) % cmd->init.num_shards, cmd->init.num_shards);
+      if (status != eslOK) {
+        p7_syslog(LOG_ERR,"[%s:%d] - p7_seqcache_Open %s error %d\n", __FILE__, __LINE__, p, status);
+        LOG_FATAL_MSG("cache seqdb error", status);
+      }
 //    printf("Database opened\n");
-    /* validate the sequence database */
-    cmd->init.sid[MAX_INIT_DESC-1] = 0;
-    if (strcmp (cmd->init.sid, sdb->id) != 0 || cmd->init.db_cnt != sdb->db_cnt /*|| cmd->init.seq_cnt != sdb->count*/) {
-      p7_syslog(LOG_ERR,"[%s:%d] - seq db %s: integrity error %s - %s\n", __FILE__, __LINE__, p, cmd->init.sid, sdb->id);
-      LOG_FATAL_MSG("database integrity error", 0);
-    }
+      /* validate the sequence database */
+      cmd->init.sid[MAX_INIT_DESC-1] = 0;
+      if (strcmp (cmd->init.sid, sdb->id) != 0 || cmd->init.db_cnt != sdb->db_cnt /*|| cmd->init.seq_cnt != sdb->count*/) {
+        p7_syslog(LOG_ERR,"[%s:%d] - seq db %s: integrity error %s - %s\n", __FILE__, __LINE__, p, cmd->init.sid, sdb->id);
+        LOG_FATAL_MSG("database integrity error", 0);
+      }
 //    printf("Database validated\n");
-    env->seq_db = sdb;
+      env->seq_db[i] = sdb;
+      env->replicas  = i + 1;
+    }
   }
 
-  /* load the hmm database */
+  /* load the hmm database shards, the same ones; their models are
+   * named by their place in the whole database
+   */
   if (cmd->init.hmm_cnt != 0) {
     P7_HMMCACHE *hcache = NULL;
+    uint32_t     i, s;
   //  printf("Opening HMM database %s\n", p);
     p  = cmd->init.data + cmd->init.hmmdb_off;
 
-    status = p7_hmmcache_Open(p, &hcache, NULL);
-    if (status != eslOK) {
-      p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_Open %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache hmmdb error", status);
-    }
+    if ((env->hmm_db = malloc(sizeof(P7_HMMCACHE *) * cmd->init.replicas)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    for (i = 0; i < cmd->init.replicas; i++) env->hmm_db[i] = NULL;
 
-    if ( (status = p7_hmmcache_SetNumericNames(hcache)) != eslOK){
-      p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_SetNumericNames %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache hmmdb error", status);
-    }
+    for (i = 0; i < cmd->init.replicas; i++) {
+      s = (cmd->init.my_shard + i) % cmd->init.num_shards;
+      status = p7_hmmcache_OpenShard(p, s, cmd->init.num_shards, &hcache, NULL);
+      if (status != eslOK) {
+        p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_OpenShard %s error %d\n", __FILE__, __LINE__, p, status);
+        LOG_FATAL_MSG("cache hmmdb error", status);
+      }
 
-    /* validate the hmm database */
-    cmd->init.hid[MAX_INIT_DESC-1] = 0;
-    /* TODO: come up with a new pressed format with an id to compare - strcmp (cmd->init.hid, hdb->id) != 0 */
-    if (cmd->init.hmm_cnt != 1 || cmd->init.model_cnt != hcache->n) {
-      p7_syslog(LOG_ERR,"[%s:%d] - hmm db %s: integrity error\n", __FILE__, __LINE__, p);
-      LOG_FATAL_MSG("database integrity error", 0);
-    }
+      if ( (status = p7_hmmcache_SetNumericNames(hcache)) != eslOK){
+        p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_SetNumericNames %s error %d\n", __FILE__, __LINE__, p, status);
+        LOG_FATAL_MSG("cache hmmdb error", status);
+      }
 
-    env->hmm_db = hcache;
+      /* validate the hmm database */
+      cmd->init.hid[MAX_INIT_DESC-1] = 0;
+      /* TODO: come up with a new pressed format with an id to compare - strcmp (cmd->init.hid, hdb->id) != 0 */
+      if (cmd->init.hmm_cnt != 1 || (cmd->init.model_cnt + cmd->init.num_shards - 1 - s) / cmd->init.num_shards != hcache->n) {
+        p7_syslog(LOG_ERR,"[%s:%d] - hmm db %s: integrity error\n", __FILE__, __LINE__, p);
+        LOG_FATAL_MSG("database integrity error", 0);
+      }
 
-    printf("Loaded profile db %s;  models: %d  memory: %" PRId64 "\n",
-         p, hcache->n, (uint64_t) p7_hmmcache_Sizeof(hcache));
+      env->hmm_db[i] = hcache;
+      env->replicas  = ESL_MAX(env->replicas, i + 1);
 
+      printf("Loaded profile db %s shard %u;  models: %d  memory: %" PRId64 "\n",
+             p, s, hcache->n, (uint64_t) p7_hmmcache_Sizeof(hcache));
+    }
   }
 
   /* if stdout is redirected at the commandline, it causes printf's to be buffered,
@@ -633,7 +688,7 @@ search_thread(void *arg)
 
   /* Create processing pipeline and hit list */
   th  = p7_tophits_Create(); 
-  pli = p7_pipeline_Create(info->opts, om->M, 100, FALSE, p7_SEARCH_SEQS);
+  pli = p7_pipeline_CreateInPool(info->mxpool, info->opts, om->M, 100, FALSE, p7_SEARCH_SEQS);
   p7_pli_NewModel(pli, om, bg);
 
   if (pli->Z_setby == p7_ZSETBY_NTARGETS) pli->Z = info->db_Z;
@@ -641,33 +696,14 @@ search_thread(void *arg)
   //  printf("Worker thread starting range-list search\n");
   }
   /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
+  for ( ;; ) {
     int          inx;
-    int          blksz;
     HMMER_SEQ  **sq;
 
     /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->sq_cnt * 2;
-      } else {
-        *info->limit = inx + (info->sq_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
-
+    if ((count = hmmpgmd_NextWork(info->work, &inx)) == 0) break;
     sq = info->sq_list + inx;
 
-    count = info->sq_cnt - inx;
-    if (count > blksz) count = blksz;
-
     /* Main loop: */
     for (i = 0; i < count; ++i, ++sq) {
  /*     if( strtol((*sq)->name, NULL, 10) != (*sq)->idx){
@@ -690,7 +726,10 @@ search_thread(void *arg)
     }
   }
 
-  /* make available the pipeline objects to the main thread */
+  /* make available the pipeline objects to the main thread,
+   * with our hits already sorted for its k-way merge
+   */
+  p7_tophits_SortBySortkey(th);
   info->th = th;
   info->pli = pli;
 
@@ -739,36 +778,18 @@ scan_thread(void *arg)
 
   /* Create processing pipeline and hit list */
   th  = p7_tophits_Create(); 
-  pli = p7_pipeline_Create(info->opts, 100, 100, FALSE, p7_SCAN_MODELS);
+  pli = p7_pipeline_CreateInPool(info->mxpool, info->opts, 100, 100, FALSE, p7_SCAN_MODELS);
 
   p7_pli_NewSeq(pli, info->seq);
 
   /* loop until all sequences have been processed */
-  count = 1;
-  while (count > 0) {
+  for ( ;; ) {
     int           inx;
-    int          blksz;
     P7_OPROFILE **om;
 
-    /* grab the next block of sequences */
-    if (pthread_mutex_lock(info->inx_mutex) != 0) p7_Fail("mutex lock failed");
-    inx   = *info->inx;
-    blksz = *info->blk_size;
-    if (inx > *info->limit) {
-      blksz /= 5;
-      if (blksz < 1000) {
-        *info->limit = info->om_cnt * 2;
-      } else {
-        *info->limit = inx + (info->om_cnt - inx) * 2 / 3; 
-      }
-    }
-    *info->blk_size = blksz;
-    *info->inx += blksz;
-    if (pthread_mutex_unlock(info->inx_mutex) != 0) p7_Fail("mutex unlock failed");
-
-    om    = info->om_list + inx;
-    count = info->om_cnt - inx;
-    if (count > blksz) count = blksz;
+    /* grab the next block of profiles */
+    if ((count = hmmpgmd_NextWork(info->work, &inx)) == 0) break;
+    om = info->om_list + inx;
 
     /* Main loop: */
     for (i = 0; i < count; ++i, ++om) {
@@ -781,7 +802,10 @@ scan_thread(void *arg)
     }
   }
 
-  /* make available the pipeline objects to the main thread */
+  /* make available the pipeline objects to the main thread,
+   * with our hits already sorted for its k-way merge
+   */
+  p7_tophits_SortBySortkey(th);
   info->th = th;
   info->pli = pli;
 
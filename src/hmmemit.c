@@ -6,6 +6,11 @@
 #include <stdlib.h>
 #include <math.h>
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#include "esl_threads.h"
+#endif
+
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_dmatrix.h"
@@ -22,11 +27,15 @@
 #define EMITOPTS "-a,-c,-C,-p"
 #define MODEOPTS "--local,--unilocal,--glocal,--uniglocal"
 
+#define EMIT_BUFSIZE   (1 << 20)  /* stdio buffer for sequence output                    */
+#define EMIT_BLOCKSIZE 1000       /* seqs per block with --cpu; each has its own RNG seed */
+
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
   { "-h",          eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL,  "show brief help on version and usage",                   1 },
   { "-o",          eslARG_OUTFILE,FALSE, NULL, NULL,      NULL,      NULL,    NULL,  "send sequence output to file <f>, not stdout",           1 },
   { "-N",          eslARG_INT,      "1", NULL, "n>0",     NULL,      NULL,  "-c,-C", "number of seqs to sample",                               1 },
+  { "--press",     eslARG_OUTFILE, NULL, NULL, NULL,      NULL,      NULL,"-o,-a,-c,-C","save seqs as pressed database <f>.h3q, not FASTA",    1 },
 /* options controlling what to emit */
   { "-a",          eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL, EMITOPTS, "emit alignment",                                         2 },
   { "-c",          eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL, EMITOPTS, "emit simple majority-rule consensus sequence",           2 },
@@ -43,6 +52,9 @@ static ESL_OPTIONS options[] = {
   { "--minu",      eslARG_REAL,  "0.0",  NULL, "0<=x<=1", NULL,      "-C",    NULL, "show consensus as upper case if >= this fraction",      4 },
 /* other options */
   { "--seed",      eslARG_INT,      "0", NULL, "n>=0",    NULL,      NULL,    NULL, "set RNG seed to <n>",                                    5 },
+#ifdef HMMER_THREADS
+  { "--cpu",       eslARG_INT,      "0", NULL, "n>=0",    NULL,      NULL, "-a,-c,-C", "emit seqs in seeded blocks with <n> threads",          5 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 
@@ -55,7 +67,45 @@ static void cmdline_help(char *argv0, ESL_GETOPTS *go);
 static void emit_consensus(ESL_GETOPTS *go, FILE *ofp, int outfmt,                    P7_HMM *hmm);
 static void emit_fancycons(ESL_GETOPTS *go, FILE *ofp, int outfmt,                    P7_HMM *hmm);
 static void emit_alignment(ESL_GETOPTS *go, FILE *ofp, int outfmt, ESL_RANDOMNESS *r, P7_HMM *hmm);
-static void emit_sequences(ESL_GETOPTS *go, FILE *ofp, int outfmt, ESL_RANDOMNESS *r, P7_HMM *hmm);
+static void emit_sequences(ESL_GETOPTS *go, FILE *ofp, int outfmt, P7_SEQDB_WRITER *sdw, ESL_RANDOMNESS *r, P7_HMM *hmm);
+static void write_sequence(FILE *ofp, int outfmt, P7_SEQDB_WRITER *sdw, ESL_SQ *sq);
+
+#ifdef HMMER_THREADS
+/* EMIT_WORK : emitting -N seqs from one model in blocks, with --cpu.
+ * 
+ * Block <b> is sampled from its own RNG, seeded with <seeds[b]>,
+ * so the output is the same for any number of threads (though not
+ * the same as serial output, which samples every seq from one RNG
+ * stream). Worker threads fill blocks into a ring of <nslots>
+ * slots; block <b> goes in slot b % nslots, once the main thread has
+ * written out the block that was there before. The main thread
+ * writes blocks in order as they're filled.
+ */
+typedef struct {
+  ESL_SQ  **sq;			/* EMIT_BLOCKSIZE seqs                      */
+  int       b;			/* block held in this slot; -1 if free      */
+  int       n;			/* number of seqs in it                     */
+  int       done;		/* TRUE once the block is sampled           */
+} EMIT_SLOT;
+
+typedef struct {
+  const P7_HMM     *hmm;
+  const P7_PROFILE *gm;
+  const P7_BG      *bg;
+  int               do_profile;	/* TRUE to sample from <gm>, not the core model */
+  int               N;
+  int               nblocks;
+  uint32_t         *seeds;	/* seeds[b]: RNG seed for block b          */
+  EMIT_SLOT        *slot;
+  int               nslots;
+  int               next;	/* next block to be taken by a worker      */
+  pthread_mutex_t   mutex;
+  pthread_cond_t    cond;	/* signaled when a slot is filled or freed */
+} EMIT_WORK;
+
+static void  emit_threaded(int ncpus, FILE *ofp, int outfmt, P7_SEQDB_WRITER *sdw, ESL_RANDOMNESS *r, const P7_HMM *hmm, const P7_PROFILE *gm, const P7_BG *bg, int do_profile, int N);
+static void *emit_thread  (void *arg);
+#endif /*HMMER_THREADS*/
 
 
 int
@@ -68,6 +118,7 @@ main(int argc, char **argv)
   P7_HMMFILE      *hfp        = NULL;             /* open hmmfile                            */
   P7_HMM          *hmm        = NULL;             /* HMM to emit from                        */
   FILE            *ofp        = NULL;	          /* output stream                           */
+  P7_SEQDB_WRITER *sdw        = NULL;             /* output pressed database, with --press   */
   int              outfmt     = 0;
   int              nhmms      = 0;
   int              status;	      
@@ -84,6 +135,7 @@ main(int argc, char **argv)
   if ( esl_opt_IsOn(go, "-o") ) {
     if ((ofp = fopen(esl_opt_GetString(go, "-o"), "w")) == NULL) esl_fatal("Failed to open output file %s", esl_opt_GetString(go, "-o"));
   } else ofp = stdout;
+  setvbuf(ofp, NULL, _IOFBF, EMIT_BUFSIZE);  /* large samples: write in big chunks */
 
   if (esl_opt_GetBoolean(go, "-a"))  outfmt = eslMSAFILE_STOCKHOLM;
   else                               outfmt = eslSQFILE_FASTA;
@@ -102,10 +154,19 @@ main(int argc, char **argv)
       else if (status != eslOK)         esl_fatal("Unexpected error in reading HMMs from %s\n",     hfp->fname);
       nhmms++;
 
-      if      (esl_opt_GetBoolean(go, "-c"))  emit_consensus(go, ofp, outfmt,    hmm);
-      else if (esl_opt_GetBoolean(go, "-C"))  emit_fancycons(go, ofp, outfmt,    hmm);
-      else if (esl_opt_GetBoolean(go, "-a"))  emit_alignment(go, ofp, outfmt, r, hmm);
-      else                                    emit_sequences(go, ofp, outfmt, r, hmm);
+      if (esl_opt_IsOn(go, "--press") && sdw == NULL)
+	{
+	  char *dbfile = NULL;
+
+	  if (esl_sprintf(&dbfile, "%s%s", esl_opt_GetString(go, "--press"), p7_SEQDB_SUFFIX) != eslOK) esl_fatal("allocation failed");
+	  if (p7_seqdb_CreateWriter(dbfile, abc->type, &sdw, errbuf) != eslOK) esl_fatal("Failed to open pressed sequence file %s:\n%s\n", dbfile, errbuf);
+	  free(dbfile);
+	}
+
+      if      (esl_opt_GetBoolean(go, "-c"))  emit_consensus(go, ofp, outfmt,         hmm);
+      else if (esl_opt_GetBoolean(go, "-C"))  emit_fancycons(go, ofp, outfmt,         hmm);
+      else if (esl_opt_GetBoolean(go, "-a"))  emit_alignment(go, ofp, outfmt,      r, hmm);
+      else                                    emit_sequences(go, ofp, outfmt, sdw, r, hmm);
 
 
 
@@ -113,6 +174,8 @@ main(int argc, char **argv)
     }
   if (nhmms == 0) esl_fatal("Empty HMM file %s? No HMM data found.\n"); 
 
+  if (sdw && p7_seqdb_CloseWriter(sdw, NULL, NULL, errbuf) != eslOK) esl_fatal("Failed to write pressed sequence file:\n%s\n", errbuf);
+
   if (esl_opt_IsOn(go, "-o")) { fclose(ofp); }
   esl_randomness_Destroy(r);
   esl_alphabet_Destroy(abc);
@@ -219,7 +282,7 @@ emit_alignment(ESL_GETOPTS *go, FILE *ofp, int outfmt, ESL_RANDOMNESS *r, P7_HMM
 }
 
 static void
-emit_sequences(ESL_GETOPTS *go, FILE *ofp, int outfmt, ESL_RANDOMNESS *r, P7_HMM *hmm)
+emit_sequences(ESL_GETOPTS *go, FILE *ofp, int outfmt, P7_SEQDB_WRITER *sdw, ESL_RANDOMNESS *r, P7_HMM *hmm)
 {
   ESL_SQ     *sq           = NULL;
   P7_TRACE   *tr           = NULL;
@@ -247,6 +310,11 @@ emit_sequences(ESL_GETOPTS *go, FILE *ofp, int outfmt, ESL_RANDOMNESS *r, P7_HMM
   if (p7_hmm_Validate    (hmm, NULL, 0.0001)     != eslOK) esl_fatal("whoops, HMM is bad!");
   if (p7_profile_Validate(gm,  NULL, 0.0001)     != eslOK) esl_fatal("whoops, profile is bad!");
 
+#ifdef HMMER_THREADS
+  if (esl_opt_GetInteger(go, "--cpu") > 0)
+    emit_threaded(esl_opt_GetInteger(go, "--cpu"), ofp, outfmt, sdw, r, hmm, gm, bg, do_profile, N);
+  else
+#endif
   for (nseq = 1; nseq <= N; nseq++)
     {
       if (do_profile) status = p7_ProfileEmit(r, hmm, gm, bg, sq, tr);
@@ -256,8 +324,7 @@ emit_sequences(ESL_GETOPTS *go, FILE *ofp, int outfmt, ESL_RANDOMNESS *r, P7_HMM
       status = esl_sq_FormatName(sq, "%s-sample%d", hmm->name, nseq);
       if (status) esl_fatal("Failed to set sequence name\n");
 
-      status = esl_sqio_Write(ofp, sq, outfmt, FALSE);
-      if (status != eslOK) esl_fatal("Failed to write sequence\n");
+      write_sequence(ofp, outfmt, sdw, sq);
 
       p7_trace_Reuse(tr);
       esl_sq_Reuse(sq);
@@ -270,4 +337,157 @@ emit_sequences(ESL_GETOPTS *go, FILE *ofp, int outfmt, ESL_RANDOMNESS *r, P7_HMM
   return;
 }
 
+/* write_sequence()
+ * Write <sq> to the pressed database <sdw> if there is one,
+ * else to <ofp> in format <outfmt>.
+ */
+static void
+write_sequence(FILE *ofp, int outfmt, P7_SEQDB_WRITER *sdw, ESL_SQ *sq)
+{
+  if (sdw) 
+    {
+      if (p7_seqdb_Write(sdw, sq) != eslOK) esl_fatal("Failed to write sequence:\n%s\n", sdw->errbuf);
+    }
+  else if (esl_sqio_Write(ofp, sq, outfmt, FALSE) != eslOK) esl_fatal("Failed to write sequence\n");
+}
+
+
+#ifdef HMMER_THREADS
+/* emit_threaded()
+ * Emit <N> seqs from <hmm> (or, if <do_profile>, from <gm>), in blocks
+ * sampled by <ncpus> worker threads; see EMIT_WORK. The block seeds
+ * are drawn from <r>, so --seed still makes the run reproducible.
+ */
+static void
+emit_threaded(int ncpus, FILE *ofp, int outfmt, P7_SEQDB_WRITER *sdw, ESL_RANDOMNESS *r, const P7_HMM *hmm, const P7_PROFILE *gm, const P7_BG *bg, int do_profile, int N)
+{
+  ESL_THREADS *obj = NULL;
+  EMIT_WORK    wk;
+  EMIT_SLOT   *s;
+  int          b, i;
+
+  wk.hmm        = hmm;
+  wk.gm         = gm;
+  wk.bg         = bg;
+  wk.do_profile = do_profile;
+  wk.N          = N;
+  wk.nblocks    = (N + EMIT_BLOCKSIZE - 1) / EMIT_BLOCKSIZE;
+  wk.nslots     = 2 * ncpus;
+  wk.next       = 0;
+
+  if ((wk.seeds = malloc(sizeof(uint32_t)  * wk.nblocks)) == NULL) esl_fatal("allocation failed");
+  if ((wk.slot  = malloc(sizeof(EMIT_SLOT) * wk.nslots))  == NULL) esl_fatal("allocation failed");
+  for (b = 0; b < wk.nblocks; b++)
+    wk.seeds[b] = 1 + esl_rnd_Roll(r, 2147483646);   /* nonzero: 0 would ask for an arbitrary seed */
+  for (b = 0; b < wk.nslots; b++)
+    {
+      wk.slot[b].b    = -1;
+      wk.slot[b].n    = 0;
+      wk.slot[b].done = FALSE;
+      if ((wk.slot[b].sq = malloc(sizeof(ESL_SQ *) * EMIT_BLOCKSIZE)) == NULL) esl_fatal("allocation failed");
+      for (i = 0; i < EMIT_BLOCKSIZE; i++)
+	if ((wk.slot[b].sq[i] = esl_sq_CreateDigital(hmm->abc)) == NULL) esl_fatal("failed to allocate sequence");
+    }
+  if (pthread_mutex_init(&wk.mutex, NULL) != 0) esl_fatal("mutex init failed");
+  if (pthread_cond_init (&wk.cond,  NULL) != 0) esl_fatal("cond init failed");
+
+  obj = esl_threads_Create(&emit_thread);
+  for (i = 0; i < ncpus; i++)
+    esl_threads_AddThread(obj, &wk);
+  esl_threads_WaitForStart(obj);
+
+  /* Write the blocks out in order, freeing each slot for the block after next */
+  for (b = 0; b < wk.nblocks; b++)
+    {
+      s = &wk.slot[b % wk.nslots];
+      pthread_mutex_lock(&wk.mutex);
+      while (s->b != b || ! s->done) pthread_cond_wait(&wk.cond, &wk.mutex);
+      pthread_mutex_unlock(&wk.mutex);
+
+      for (i = 0; i < s->n; i++)
+	{
+	  write_sequence(ofp, outfmt, sdw, s->sq[i]);
+	  esl_sq_Reuse(s->sq[i]);
+	}
+
+      pthread_mutex_lock(&wk.mutex);
+      s->b    = -1;
+      s->done = FALSE;
+      pthread_cond_broadcast(&wk.cond);
+      pthread_mutex_unlock(&wk.mutex);
+    }
+
+  esl_threads_WaitForFinish(obj);
+  esl_threads_Destroy(obj);
+  pthread_cond_destroy (&wk.cond);
+  pthread_mutex_destroy(&wk.mutex);
+  for (b = 0; b < wk.nslots; b++)
+    {
+      for (i = 0; i < EMIT_BLOCKSIZE; i++) esl_sq_Destroy(wk.slot[b].sq[i]);
+      free(wk.slot[b].sq);
+    }
+  free(wk.slot);
+  free(wk.seeds);
+}
+
+static void *
+emit_thread(void *arg)
+{
+  ESL_THREADS    *obj = (ESL_THREADS *) arg;
+  EMIT_WORK      *wk;
+  EMIT_SLOT      *s   = NULL;
+  ESL_RANDOMNESS *rng = NULL;
+  P7_TRACE       *tr  = NULL;
+  int             workeridx;
+  int             b, i;
+  int             status;
+
+  esl_threads_Started(obj, &workeridx);
+  wk = (EMIT_WORK *) esl_threads_GetData(obj, workeridx);
+
+  if ((rng = esl_randomness_CreateFast(1)) == NULL) esl_fatal("failed to create RNG");
+  if ((tr  = p7_trace_Create())            == NULL) esl_fatal("failed to allocate trace");
+
+  while (1)
+    {
+      /* take the next block, once its slot is free */
+      pthread_mutex_lock(&wk->mutex);
+      while (wk->next < wk->nblocks && wk->slot[wk->next % wk->nslots].b != -1) pthread_cond_wait(&wk->cond, &wk->mutex);
+      b = wk->next;
+      if (b < wk->nblocks) 
+	{
+	  s       = &wk->slot[b % wk->nslots];
+	  s->b    = b;
+	  s->n    = ESL_MIN(EMIT_BLOCKSIZE, wk->N - b * EMIT_BLOCKSIZE);
+	  s->done = FALSE;
+	  wk->next++;
+	}
+      pthread_mutex_unlock(&wk->mutex);
+      if (b >= wk->nblocks) break;
+
+      esl_randomness_Init(rng, wk->seeds[b]);
+      for (i = 0; i < s->n; i++)
+	{
+	  if (wk->do_profile) status = p7_ProfileEmit(rng, wk->hmm, wk->gm, wk->bg, s->sq[i], tr);
+	  else                status = p7_CoreEmit   (rng, wk->hmm, s->sq[i], tr);
+	  if (status) esl_fatal("Failed to emit sequence\n");
+
+	  status = esl_sq_FormatName(s->sq[i], "%s-sample%d", wk->hmm->name, b * EMIT_BLOCKSIZE + i + 1);
+	  if (status) esl_fatal("Failed to set sequence name\n");
+	  p7_trace_Reuse(tr);
+	}
+
+      pthread_mutex_lock(&wk->mutex);
+      s->done = TRUE;
+      pthread_cond_broadcast(&wk->cond);
+      pthread_mutex_unlock(&wk->mutex);
+    }
+
+  p7_trace_Destroy(tr);
+  esl_randomness_Destroy(rng);
+  esl_threads_Finished(obj, workeridx);
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+
 
@@ -51,6 +51,7 @@
 #include "esl_random.h"		/* ESL_RANDOMNESS        */
 #include "esl_rand64.h" /* ESL_RAND64 */
 #include "esl_sq.h"		/* ESL_SQ                */
+#include "esl_sqio.h"		/* ESL_SQFILE            */
 #include "esl_scorematrix.h"    /* ESL_SCOREMATRIX       */
 #include "esl_stopwatch.h"      /* ESL_STOPWATCH         */
 
@@ -89,6 +90,41 @@ enum p7_offsets_e  { p7_MOFFSET = 0, p7_FOFFSET = 1, p7_POFFSET = 2 };
 /* Which strand(s) should be searched */
 enum p7_strands_e {    p7_STRAND_TOPONLY  = 0, p7_STRAND_BOTTOMONLY = 1,  p7_STRAND_BOTH = 2};
 
+/* Static probes (USDT) for tracing running processes with bpftrace,
+ * perf or SystemTap, in provider "hmmer". Where <sys/sdt.h> is
+ * available they're compiled in as a single nop each, plus a note in
+ * the ELF file giving the location of their arguments; a tracer that
+ * attaches turns the nop into a trap. Otherwise they compile to
+ * nothing. Arguments must be integers or pointers, and cheap to
+ * evaluate, since they are evaluated whether or not anyone's looking.
+ *
+ *   msv__start, bias__start, vit__start,  (L, M)        protein pipeline stages,
+ *   fwd__start, dom__start                              in p7_Pipeline() and the
+ *   msv__done, bias__done, vit__done,     (L, M, pass)  block pipelines
+ *   fwd__done
+ *   dom__done                             (L, M, ndom)
+ *   region__start                         (i, j, is_multi)  a region in domain definition
+ *   block__handoff                        (count)           a block of targets to the workers
+ *   hmmpgmd__recv                         (cmd, sock, nqueries)   master: request queued
+ *   hmmpgmd__dispatch                     (query_id, inx, cnt)    master: share sent to a worker
+ *   hmmpgmd__gather                       (query_id, nhits)       master: workers' hits merged
+ *   hmmpgmd__send                         (query_id, nbytes)      master: answer sent to client
+ *   hmmpgmd__worker__recv                 (cmd, length)           worker: command read
+ *   hmmpgmd__worker__send                 (query_id, nhits)       worker: answer sent
+ */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define p7_PROBE(name)                   DTRACE_PROBE(hmmer, name)
+#define p7_PROBE1(name, a)               DTRACE_PROBE1(hmmer, name, a)
+#define p7_PROBE2(name, a, b)            DTRACE_PROBE2(hmmer, name, a, b)
+#define p7_PROBE3(name, a, b, c)         DTRACE_PROBE3(hmmer, name, a, b, c)
+#else
+#define p7_PROBE(name)
+#define p7_PROBE1(name, a)
+#define p7_PROBE2(name, a, b)
+#define p7_PROBE3(name, a, b, c)
+#endif
+
 /*****************************************************************
  * 1. P7_HMM: a core model.
  *****************************************************************/
@@ -279,6 +315,22 @@ typedef struct p7_profile_s {
   const ESL_ALPHABET *abc;	/* copy of pointer to appropriate alphabet                */
 } P7_PROFILE;
 
+/* The target length dependent N,C,J parameters, for mean target
+ * length <L> and <nj> expected uses of the J state; the values that
+ * reconfiguring an optimized profile's length calculates. In a scan,
+ * every model is configured for the same query length, so these are
+ * calculated once (p7_LengthParams()) and then just copied into each
+ * model (p7_oprofile_SetMSVLength(), p7_oprofile_SetRestLength()).
+ */
+typedef struct p7_lenparam_s {
+  int    L;			/* target length these are for, or -1 if unset            */
+  float  nj;			/* expected # of J's: 0 or 1, uni vs. multihit            */
+  float  msvmove;		/* MSV/SSV NCJ move: log 3/(L+3)                          */
+  float  pmove;			/* N,C,J move probability: (2+nj)/(L+2+nj)                */
+  float  ploop;			/* N,C,J loop probability: 1 - pmove                      */
+  float  lpmove;		/* log pmove                                              */
+} P7_LENPARAM;
+
 
 
 /*****************************************************************
@@ -414,7 +466,7 @@ typedef struct p7_hmmfile_s {
   char         *fname;	         /* (fully qualified) name of the HMM file; [STDIN] if - */
   ESL_SSI      *ssi;		 /* open SSI index for model file <f>; NULL if none.     */
 
-  int           do_gzip;	/* TRUE if f is "gzip -dc |" (will pclose(f))           */ 
+  int           do_gzip;	/* TRUE if f is a "gzip -dc |" or "zstd -dc |" pipe (will pclose(f)) */ 
   int           do_stdin;       /* TRUE if f is stdin (won't close f)                   */
   int           newly_opened;	/* TRUE if we just opened the stream (and parsed magic) */
   int           is_pressed;	/* TRUE if a pressed HMM database file (Pfam or equiv)  */
@@ -426,6 +478,10 @@ typedef struct p7_hmmfile_s {
   /* If <is_pressed>, we can read optimized profiles directly, via:  */
   FILE         *ffp;		/* MSV part of the optimized profile */
   FILE         *pfp;		/* rest of the optimized profile     */
+  char         *ffp_map;	/* read-only mmap() of <ffp>, or NULL; score vectors point into it */
+  char         *pfp_map;	/* ditto, for <pfp>                                                */
+  off_t         ffp_mapsize;	/* size of <ffp_map> in bytes                                      */
+  off_t         pfp_mapsize;	/* size of <pfp_map> in bytes                                      */
 
 #ifdef HMMER_THREADS
   int              syncRead;
@@ -604,8 +660,20 @@ typedef struct p7_alidisplay_s {
 
   int   memsize;                /* size of allocated block of memory    */
   char *mem;			/* memory used for the char data above  */
+  int   in_arena;		/* TRUE if <ad> and <mem> belong to a P7_ARENA: never free them */
+
+  char *zdata;			/* compact form of the display lines, in <mem>; or NULL. see p7_alidisplay_Compress() */
+  int   zsize;			/* size of <zdata>, in bytes            */
+  int   zflags;			/* which optional lines <zdata> has: rf, mm, cs, pp */
 } P7_ALIDISPLAY;
 
+/* How the _SerializeAs() functions write alignment displays */
+enum p7_aliform_e {
+  p7_ALI_FULL    = 0,		/* display lines as strings, as _Serialize() does */
+  p7_ALI_COMPACT = 1,		/* display lines in the compact form of p7_alidisplay_Compress() */
+  p7_ALI_NONE    = 2		/* no display lines (N = 0) nor per-position scores; coords and names only */
+};
+
 
 /*****************************************************************
  * 10. P7_DOMAINDEF: reusably managing workflow in defining domains
@@ -654,9 +722,23 @@ typedef struct p7_domaindef_s {
   /* rng and reusable memory for stochastic tracebacks */
   ESL_RANDOMNESS *r;		/* random number generator                                 */
   int             do_reseeding;	/* TRUE to reset the RNG, make results reproducible        */
+  int             nthreads;	/* >1: regions of a long target may be processed in threads */
+  int64_t         ramlimit;	/* >0: envelopes whose full DP matrices exceed this many bytes are checkpointed */
+  int             do_bf16;	/* TRUE: envelopes keep Forward/Backward matrices in bfloat16 (SSE only)        */
+  int             defer_ali;	/* TRUE: domains are scored without alignments, for p7_domaindef_Align() later */
+  struct p7_arena_s  *arena;	/* if non-NULL, alignment displays are allocated here (a hit list's arena) */
+  struct p7_omxchk_s *ock;	/* checkpointed DP matrices for such envelopes, created as needed (SSE only) */
+  struct p7_omxchk_s *ock16;	/* bfloat16 Forward/Backward matrices, if <do_bf16>, created as needed       */
+  uint64_t        nchk;		/* # of envelopes checkpointed because of <ramlimit>; not reset by _Reuse()     */
+  struct p7_omx_s *post_ox;	/* if non-NULL: the posterior decoding of envelope <post_dsq+1..post_Ld>,    */
+  const ESL_DSQ   *post_dsq;	/*   decoded without alignment, is still in this matrix, so that            */
+  int              post_Ld;	/*   p7_domaindef_Align() can skip its Forward/Backward/Decoding             */
   P7_SPENSEMBLE  *sp;		/* an ensemble of sampled segment pairs (domain endpoints) */
   P7_TRACE       *tr;		/* reusable space for a trace of a domain                  */
   P7_TRACE       *gtr;		/* reusable space for a traceback of the entire target seq */
+  struct p7_domaindef_s **wdef;	/* [0..nwdef-1] scratch space of threaded region workers, kept from */
+  struct p7_omx_s       **wox;	/*   target to target; wox[2w], wox[2w+1] are worker w's Fwd/Bck    */
+  int                     nwdef;	/*   matrices (NULL for worker 0, which uses the caller's)          */
 
   /* Heuristic thresholds that control the region definition process */
   /* "rt" = "region threshold", for lack of better term  */
@@ -666,6 +748,7 @@ typedef struct p7_domaindef_s {
   
   /* Heuristic thresholds that control the stochastic traceback/clustering process */
   int    nsamples;	/* collect ensemble of this many stochastic traces */
+  int    nbatch;	/* >0: collect traces in batches of this many, stopping early once clustering is stable         */
   float  min_overlap;	/* 0.8 means >= 80% overlap of (smaller/larger) segment to link, both in seq and hmm            */
   int    of_smaller;	/* see above; TRUE means overlap denom is calc'ed wrt smaller segment; FALSE means larger       */
   int    max_diagdiff;	/* 4 means either start or endpoints of two segments must be within <=4 diagonals of each other */
@@ -699,6 +782,34 @@ typedef struct p7_domaindef_s {
 #define p7_IS_DUPLICATE     (1<<4)
 
 
+/* Structure: P7_ARENA
+ *
+ * Bulk allocation for the many small, same-lifetime objects in a hit
+ * list: target names, accessions, descriptions, alignment displays.
+ * Memory is carved sequentially out of a chain of large blocks, and
+ * is freed only in bulk; objects in an arena are never free()'d
+ * individually. An arena is not thread-safe; each thread's hit list
+ * has its own.
+ */
+struct p7_arenablock_s {
+  struct p7_arenablock_s *next;	/* next (older) block in the chain      */
+  size_t  n;			/* bytes used in <mem>                  */
+  size_t  nalloc;		/* bytes allocated for <mem>            */
+  char   *mem;			/* the memory, following this header    */
+};
+
+typedef struct p7_arena_s {
+  struct p7_arenablock_s *blk;	/* current block; head of the chain, or NULL  */
+  size_t   blocksize;		/* allocation size of a new block             */
+  int      nblocks;		/* number of blocks in the chain              */
+  uint64_t nbytes;		/* total bytes allocated to callers           */
+
+  int      is_marked;		/* TRUE if a mark is set for p7_arena_Rewind() */
+  struct p7_arenablock_s *mark_blk; /* current block when the mark was set   */
+  size_t   mark_n;		/* ... and its <n> at that time               */
+} P7_ARENA;
+
+
 /* Structure: P7_HIT
  * 
  * Info about a high-scoring database hit, kept so we can output a
@@ -740,9 +851,62 @@ typedef struct p7_hit_s {
 
   P7_DOMAIN *dcl;	/* domain coordinate list and alignment display */
   esl_pos_t  offset;	/* used in socket communications, in serialized communication: offset of P7_DOMAIN msg for this P7_HIT */
+  int        in_arena;	/* TRUE if name, acc, desc are in the hit list's arena, or borrowed: don't free them */
 } P7_HIT;
 
 
+/* Structure: P7_HITREF
+ * 
+ * A serialized P7_HIT, left where it is in its buffer, with the few
+ * fields that ranking and thresholding it take read out by
+ * p7_hit_Scan(). Lets a process that only merges and passes on hits
+ * (the hmmpgmd master) avoid deserializing the ones it never reports.
+ */
+typedef struct p7_hitref_s {
+  P7_HIT        *hit;           /* the hit, if it has been deserialized; else NULL      */
+  const uint8_t *ser;           /* the serialized hit, domains and all                  */
+  uint32_t       ser_len;       /* its length in bytes                                  */
+  double         sortkey;
+  float          score;
+  double         lnP;
+  uint32_t       flags;
+  int            ndom;
+  int            nreported;
+  int            nincluded;
+  int            ndomflagged;   /* # of domains already flagged reported or included   */
+  int64_t        iali;          /* dcl[0]'s alignment start, end, for tie-breaking;    */
+  int64_t        jali;          /*   0 if there are no domains                         */
+  const char    *name;          /* points into <ser>                                   */
+} P7_HITREF;
+
+
+/* Structure: P7_HITSPILL
+ * 
+ * The part of a hit list that's been spilled to disk, once its hits
+ * in memory outgrew a budget (see p7_tophits_SetSpill()): sorted
+ * runs of hits serialized by p7_hit_Serialize(), one temporary file
+ * each. The list's sort, threshold and output functions merge the
+ * runs back as they read them, holding one hit per run in memory.
+ */
+#define p7_HITSPILL_MAXRUNS 64  /* more runs than this are merged into one */
+
+typedef struct p7_hitspill_s {
+  uint64_t  maxbytes;     /* spill the hits in memory once they're bigger than this */
+  uint64_t  nbytes;       /* approximate size of hits unsrt[0..nsized-1]            */
+  uint64_t  nsized;       /* how many of the hits in memory are in <nbytes>         */
+  FILE    **fp;           /* sorted runs [0..nruns-1], each a tmpfile()             */
+  uint64_t *nrun;         /* number of hits in each run                             */
+  int       nruns;
+  int       nalloc;       /* allocated size of <fp>, <nrun>                         */
+  uint64_t  nspilled;     /* total number of hits in the runs                       */
+  int       maxnamelen;   /* longest name, accession, and shown name (acc, or name) */
+  int       maxacclen;    /*   of the spilled hits, for output column widths        */
+  int       maxshownlen;
+  uint8_t  *buf;          /* serialization buffer, of <balloc> bytes                */
+  uint32_t  balloc;
+} P7_HITSPILL;
+
+
 /* Structure: P7_TOPHITS
  * merging when we prepare to output results. "hit" list is NULL and
  * unavailable until after we do a sort.  
@@ -756,6 +920,9 @@ typedef struct p7_tophits_s {
   uint64_t nincluded;	/* number of hits that are includable       */
   int      is_sorted_by_sortkey; /* TRUE when hits sorted by sortkey and th->hit valid for all N hits */
   int      is_sorted_by_seqidx; /* TRUE when hits sorted by seq_idx, position, and th->hit valid for all N hits */
+  P7_ARENA *arena;	/* bulk memory for hit strings, alignment displays; or NULL */
+  int      borrow_strings; /* TRUE: hits point at the caller's name, acc, desc; see p7_tophits_BorrowStrings() */
+  P7_HITSPILL *spill;	/* hits spilled to disk past a memory budget; or NULL       */
 } P7_TOPHITS;
 
 
@@ -837,6 +1004,7 @@ typedef struct p7_hmm_window_list_s {
  * 15. The FM-index acceleration to the SSV filter.  Only works for SSE
  *****************************************************************/
 #define FM_MAX_LINE 256
+#define FM_MAX_ALPHSIZE 26  /* largest meta->alph_size: amino (see fm_alphabetCreate()) */
 
 /* Structure the 2D occ array into a single array.  "type" is either b or sb.
  * Note that one extra count value is required by RLE, one 4-byte int for
@@ -903,6 +1071,39 @@ typedef struct fm_seqdata_s {
 } FM_SEQDATA;
 
 
+/* On-disk layout of the FM-index file. Flags share the fwd_only byte of
+ * the metadata header; an aligned file pads each array of each index to
+ * start at an fm_ALIGN-byte file offset, so that it can be used in place
+ * from a memory mapping.
+ */
+#define fm_FLAG_ALIGNED  (1<<1)
+#define fm_ALIGN         64
+#define fm_HEADERSIZE    32    /* N (uint64), then six uint32 fields */
+
+#define fmMAPPED_T       (1<<0)
+#define fmMAPPED_BWT     (1<<1)
+#define fmMAPPED_SA      (1<<2)
+#define fmMAPPED_OCCB    (1<<3)
+#define fmMAPPED_OCCSB   (1<<4)
+
+/* Interleaved rank layout of a DNA BWT (nhmmer --fm_interleave), built
+ * by fm_FM_read() in place of BWT and the occ arrays: each 64-byte line
+ * holds four 16-bit counts, relative to its superblock, followed by the
+ * next fm_RANK_LINECHARS packed characters; superblocks of
+ * fm_RANK_SBLINES lines keep 32-bit counts of their own.
+ */
+#define fm_RANK_LINEWORDS  8      /* uint64_t's per line: one of counts, seven of characters */
+#define fm_RANK_LINECHARS  224
+#define fm_RANK_SBLINES    256    /* 256*224 < 65536, for the 16-bit counts */
+
+/* Table of the intervals of all strings of length 1..kmer_k, built by
+ * fm_FM_buildKmers() after an index pair is read, from which the seed
+ * search takes the top levels of its trie. Strings are numbered as
+ * nodes of a complete trie: the empty string is 0, and the child of
+ * node n by character c is n*alph_size+1+c.
+ */
+#define fm_KMER_MAXNODES   (1<<20)
+
 typedef struct fm_metadata_s {
   uint8_t  fwd_only;
   uint8_t  alph_type;
@@ -917,9 +1118,13 @@ typedef struct fm_metadata_s {
   char     *alph;
   char     *inv_alph;
   int      *compl_alph;
+  uint8_t  aligned;  //each array of each FM-index starts on an fm_ALIGN-byte file offset (makehmmerdb --align)
+  uint8_t  interleave; //set by the caller: fm_FM_read() builds the interleaved rank layout of a DNA index
   FILE         *fp;
   FM_SEQDATA   *seq_data;
   FM_AMBIGLIST *ambig_list;
+  char         *map;     //the whole file, mmap()'ed read-only by fm_mapFMfile(); or NULL
+  uint64_t      mapsize;
 } FM_METADATA;
 
 
@@ -938,6 +1143,13 @@ typedef struct fm_data_s {
   int64_t  *C; //the first position of each letter of the alphabet if all of T is sorted.  (signed, as I use that to keep tract of presence/absence)
   uint32_t *occCnts_sb;
   uint16_t *occCnts_b;
+  uint8_t  *rank_mem;
+  uint64_t *rank;    // interleaved rank lines, 64-byte aligned in rank_mem; or NULL, for BWT and occCnts_*
+  uint32_t *rank_sb; // superblock counts for the rank lines
+  uint8_t   mapped; //fmMAPPED_* bits: arrays that point into meta->map rather than owned memory
+  FM_INTERVAL *kmer_1; // interval of each string of length <= kmer_k in this index; or NULL
+  FM_INTERVAL *kmer_2; // reverse index only: the matching interval in the forward index; or NULL
+  int       kmer_k;
 } FM_DATA;
 
 typedef struct fm_dp_pair_s {
@@ -998,7 +1210,10 @@ typedef struct {
 #endif //#if   defined (eslENABLE_SSE)
 
   /*counter, to compute FM-index speed*/
-  int occCallCnt;
+  uint64_t occCallCnt;
+
+  /*TRUE if fm_getOccCount*() use the AVX2 versions in impl_sse/fm_avx.c; set in fm_configInit()*/
+  int occ_avx2;
 
   /*bounding cutoffs*/
   int max_depth;
@@ -1011,6 +1226,12 @@ typedef struct {
   float scthreshFM;
   float sc_thresh_ratio; //information content deficit,  actual_relent/target_relent
 
+  /*number of threads to split the seed search of one FM-index across; 0 or 1 = none*/
+  int seed_threads;
+
+  /*length of the strings whose intervals fm_FM_buildKmers() tabulates; 0 = none*/
+  int kmer_k;
+
   /*pointer to FM-index metadata*/
   FM_METADATA *meta;
 
@@ -1177,12 +1398,76 @@ enum p7_pipemodes_e { p7_SEARCH_SEQS = 0, p7_SCAN_MODELS = 1 };
 enum p7_zsetby_e    { p7_ZSETBY_NTARGETS = 0, p7_ZSETBY_OPTION = 1, p7_ZSETBY_FILEINFO = 2 };
 enum p7_complementarity_e { p7_NOCOMPLEMENT    = 0, p7_COMPLEMENT   = 1 };
 
+/* In the long target pipeline, merging neighboring SSV or Viterbi
+ * windows stops when the merged window would be longer than this
+ * many times the model's max_length (W).
+ */
+#define p7_WINDOW_MAXLEN_FACTOR 4
+
+/* Subsystems whose memory a pipeline accounts for (see
+ * p7_pli_MemAccount()), and their names in p7_pli_Statistics().
+ */
+enum p7_memsys_e { p7_MEM_OMX = 0, p7_MEM_DOMAINDEF = 1, p7_MEM_TOPHITS = 2, p7_MEM_OPROFILE = 3, p7_MEM_SEQS = 4, p7_MEM_FMDATA = 5 };
+#define p7_NMEMSYS 6
+
+/* P7_MXPOOL: a shared pool of idle DP matrices.
+ *
+ * Pipelines created with p7_pipeline_CreateInPool() borrow their
+ * matrices from a pool and return them when they're destroyed, so a
+ * long-running program (the hmmpgmd worker) doesn't allocate new
+ * matrices for every search. Matrices held idle are bounded in total
+ * by <maxbytes>; a matrix bigger than <maxmx> (grown on some very long
+ * target) is freed when it comes back instead of being kept. Either
+ * limit is off if 0. A pool may be shared by threads.
+ */
+typedef struct p7_mxpool_s {
+  P7_OMX  **ox;			/* idle optimized matrices [0..nox-1]            */
+  size_t   *oxsize;		/* p7_omx_Sizeof() of each                        */
+  int       nox;
+  int       oxalloc;
+  P7_GMX  **gx;			/* idle generic matrices [0..ngx-1]              */
+  size_t   *gxsize;		/* p7_gmx_Sizeof() of each                        */
+  int       ngx;
+  int       gxalloc;
+
+  size_t    nbytes;		/* total size of the idle matrices                */
+  size_t    maxbytes;		/* high-water mark on <nbytes>; 0 = unlimited     */
+  size_t    maxmx;		/* matrices bigger than this aren't kept; 0 = any */
+
+  uint64_t  nget;		/* # of matrices handed out                       */
+  uint64_t  nhit;		/*   ... of which were reused from the pool       */
+  uint64_t  ntrim;		/* # of matrices freed on return instead of kept  */
+
+#ifdef HMMER_THREADS
+  pthread_mutex_t mutex;
+#endif
+} P7_MXPOOL;
+
+/* P7_WORDSEEDS: the k-mer neighbourhood of a single query sequence
+ * under a score matrix, for phmmer's optional word seed prefilter
+ * (see p7_wordseeds.c). seed[w] is TRUE if word code w, in base K
+ * with the first residue most significant, scores >= T against some
+ * query word.
+ */
+#define p7_WORDSEEDS_MAXK 4
+
+typedef struct p7_wordseeds_s {
+  int      k;			/* word length, 1..p7_WORDSEEDS_MAXK         */
+  int      T;			/* neighbourhood score threshold             */
+  int      K;			/* alphabet size (canonical residues)        */
+  int      nwords;		/* K^k: size of <seed>                       */
+  uint8_t *seed;		/* [0..nwords-1] TRUE if word is a seed      */
+  int      nmarked;		/* number of seed words                      */
+} P7_WORDSEEDS;
+
+
 typedef struct p7_pipeline_s {
   /* Dynamic programming matrices                                           */
   P7_OMX     *oxf;		/* one-row Forward matrix, accel pipe       */
   P7_OMX     *oxb;		/* one-row Backward matrix, accel pipe      */
   P7_OMX     *fwd;		/* full Fwd matrix for domain envelopes     */
   P7_OMX     *bck;		/* full Bck matrix for domain envelopes     */
+  P7_MXPOOL  *mxpool;		/* where they came from, or NULL            */
 
   /* Domain postprocessing                                                  */
   ESL_RANDOMNESS *r;		/* random number generator                  */
@@ -1224,6 +1509,30 @@ typedef struct p7_pipeline_s {
   int     do_biasfilter;	/* TRUE to use biased comp HMM filter       */
   int     do_null2;		/* TRUE to use null2 score corrections      */
 
+  /* Top-K mode (see p7_pipeline_SetTopK())                                 */
+  int     topk;			/* report only the best <topk> targets; 0 = all */
+  int     ntopk;		/* # of sort keys in <topk_heap>            */
+  double *topk_heap;		/* min-heap: best <ntopk> hit sortkeys so far */
+  uint64_t n_topk_skipped;	/* # past Fwd filter that couldn't make top K */
+  uint64_t n_max_skipped;	/* --max: # past Fwd filter too far under the reporting threshold */
+
+  /* Adaptive filter thresholds (see p7_pipeline_SetAdaptive())             */
+  int      do_adapt;		/* TRUE to tighten filters that pass too many */
+  int      n_adapt;		/* # of adjustments made                    */
+  int      adapt_bias;		/* TRUE if adaptive mode turned the bias filter on */
+  double   F1_orig;		/* F1 before any adjustment                 */
+  double   F2_orig;		/* F2 before any adjustment                 */
+  uint64_t adapt_nseqs;		/* nseqs at the start of the current window */
+  uint64_t adapt_nbias;		/* n_past_bias at the start of the window   */
+  uint64_t adapt_nvit;		/* n_past_vit at the start of the window    */
+
+  /* Viterbi-path domain definition (see p7_pipeline_SetViterbiDomains())  */
+  int      do_vitdom;		/* TRUE to try p7_domaindef_ByViterbi() first */
+  uint64_t n_vitdom;		/* # of targets whose domain it defined     */
+
+  /* Score-only mode (see p7_pipeline_SetSeqScoreOnly())                   */
+  int      do_seqonly;		/* TRUE to stop after Forward: no domains   */
+
   /* Accounting. (reduceable in threaded/MPI parallel version)              */
   uint64_t      nmodels;        /* # of HMMs searched                       */
   uint64_t      nseqs;	        /* # of sequences searched                  */
@@ -1239,20 +1548,318 @@ typedef struct p7_pipeline_s {
   uint64_t      pos_past_vit;	/* # positions that pass ViterbiFilter()  (used for nhmmer) */
   uint64_t      pos_past_fwd;	/* # positions that pass ForwardFilter()  (used for nhmmer) */
   uint64_t      pos_output;	    /* # positions that make it to the final output (used for nhmmer) */
+  uint64_t      n_fm_occ;       /* # FM-index occurrence counts in the SSV seed search (nhmmer, hmmsearch with an FM-index) */
+  uint64_t      n_past_fm;      /* # targets with an SSV-passing FM-index seed (hmmsearch with an FM-index) */
+  uint64_t      n_past_words;   /* # targets with a query word seed (phmmer --wordk) */
+
+  /* Per-stage timing, in nanoseconds (optional; see p7_pli_Statistics())  */
+  int           do_timing;      /* TRUE to accumulate the ns_* stage times  */
+  uint64_t      ns_msv;         /* MSV (SSV) filter, incl. null model score */
+  uint64_t      ns_bias;        /* biased composition filter                */
+  uint64_t      ns_vit;         /* Viterbi filter                           */
+  uint64_t      ns_fwd;         /* Forward filter                           */
+  uint64_t      ns_dom;         /* Backward + domain definition + scoring   */
+
+  /* Memory accounting, in bytes (see p7_pli_MemAccount())                 */
+  int           do_memstats;    /* TRUE to report memory in p7_pli_Statistics() */
+  size_t        mem_cur[p7_NMEMSYS];  /* current size of each subsystem     */
+  size_t        mem_peak[p7_NMEMSYS]; /* high-water mark of each            */
+  size_t        mem_peaktot;    /* high-water mark of their total           */
+  size_t        mem_sumpeaks;   /* sum of mem_peaktot over merged pipelines (threads) */
+  int64_t       mem_budget;     /* >0: keep the total under this; see p7_pipeline_SetMemBudget() */
+  int64_t       mem_ramlimit;   /* ddef->ramlimit as configured, before the budget tightens it */
 
   enum p7_pipemodes_e mode;    	/* p7_SCAN_MODELS | p7_SEARCH_SEQS          */
   int           long_targets;   /* TRUE if the target sequences are expected to be very long (e.g. dna chromosome search in nhmmer) */
   int           strands;         /*  p7_STRAND_TOPONLY  | p7_STRAND_BOTTOMONLY |  p7_STRAND_BOTH */
   int 		    	W;              /* window length for nhmmer scan - essentially maximum length of model that we expect to find*/
   int           block_length;   /* length of overlapping blocks read in the multi-threaded variant (default MAX_RESIDUE_COUNT) */
+  int           window_maxlen;  /* merged SSV/Viterbi windows don't grow past this length (p7_WINDOW_MAXLEN_FACTOR * W) */
+  P7_HMM_WINDOWLIST fwd_windows; /* long targets: windows of seq <fwd_seqidx> already given to Forward, abs coords */
+  int64_t       fwd_seqidx;     /*   ... -1 if none                          */
+  P7_LENPARAM   lenp;           /* N,C,J length params, reused while target L is the same */
+  int           null_L;         /* null1 score <null_sc> of a length <null_L> target with <null_p1>, */
+  float         null_p1;        /*   reused while both are the same; <null_L> is -1 if unset   */
+  float         null_sc;
+  float         msv_score;      /* MSV bit score of the last target given to p7_Pipeline(), or a bound on it if the MSV filter stopped early; -inf if it wasn't scored */
 
   int           show_accessions;/* TRUE to output accessions not names      */
   int           show_alignments;/* TRUE to output alignments (default)      */
 
   P7_HMMFILE   *hfp;		/* COPY of open HMM database (if scan mode) */
+  struct p7_hmmcache_s *hcache; /* lazy profile cache to complete profiles from (scan mode), or NULL; not owned */
+  const P7_WORDSEEDS *words;    /* optional word seed prefilter, or NULL; not owned */
   char          errbuf[eslERRBUFSIZE];
 } P7_PIPELINE;
 
+/* The threaded search drivers hand their workers blocks of targets
+ * of about p7_BLOCK_CELLS dynamic programming cells (residues times
+ * model nodes), rather than of a fixed number of sequences, so a
+ * block of long targets costs about what a block of short ones does,
+ * and the last blocks of a search don't leave threads idle.
+ * p7_BLOCK_RESIDUES(M) is a block's residue budget for a model of <M>
+ * nodes; short models keep the old limit of p7_BLOCK_MAXRESIDUES.
+ */
+#define p7_BLOCK_CELLS        (64 * 1024 * 1024)
+#define p7_BLOCK_MAXRESIDUES  (1024 * 1024)
+#define p7_BLOCK_RESIDUES(M)  ((int) ESL_MIN(p7_BLOCK_MAXRESIDUES, p7_BLOCK_CELLS / ESL_MAX(1, (M))))
+
+
+/* P7_TABSTREAM: writes --tblout/--domtblout rows while a search
+ * runs, as the pipeline accepts hits, instead of from the final
+ * sorted list. Only valid when Z and domZ are fixed in advance, so
+ * that a hit's E-values and report flags are final when it's found
+ * (see p7_tophits_ThresholdHit()). Workers hand over copies of their
+ * reported hits; with threads, a writer thread does the output, so
+ * workers don't wait on I/O.
+ */
+typedef struct p7_tabstream_s {
+  FILE        *tblfp;		/* per-sequence table, or NULL               */
+  FILE        *domtblfp;	/* per-domain table, or NULL                 */
+  char        *qname;		/* current query name (a copy)               */
+  char        *qacc;		/* current query accession (a copy), or NULL */
+  P7_PIPELINE *pli;		/* current query's pipeline: Z, domZ, mode   */
+
+  P7_HIT     **q;		/* hits waiting to be written, in order found */
+  int          nq;		/* number of hits in <q>                     */
+  int          nqalloc;		/* current allocation size of <q>            */
+  uint64_t     nwritten;	/* number of hits written for this query     */
+  int          status;		/* first write failure, or eslOK             */
+
+#ifdef HMMER_THREADS
+  int             use_thread;	/* TRUE if the writer thread is running      */
+  int             busy;		/* TRUE while the writer has hits in hand    */
+  int             stop;		/* TRUE tells the writer thread to exit      */
+  pthread_t       thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;		/* signals new work, or work finished        */
+#endif
+} P7_TABSTREAM;
+
+
+/* P7_READAHEAD: a thread keeping the next <window> bytes of a target
+ * sequence file, past where its parser has got to, in the page cache,
+ * so the reader thread of a threaded search doesn't wait on every
+ * read of a network filesystem. See p7_readahead.c.
+ */
+typedef struct p7_readahead_s {
+  int       fd;			/* our own descriptor on the file            */
+  off_t     fsize;		/* file size                                 */
+  size_t    window;		/* bytes to keep read ahead of <parsed>      */
+  off_t     parsed;		/* parser's last reported position           */
+  off_t     fetched;		/* read through here                         */
+  char     *buf;		/* scratch buffer for reads                  */
+  int       stop;		/* TRUE tells the thread to exit             */
+#ifdef HMMER_THREADS
+  pthread_t       thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;		/* signals a new position, or stop           */
+#endif
+} P7_READAHEAD;
+
+
+/* Hugepage-backed big buffers (--hugepages); see p7_hugemem.c. */
+enum p7_hugemem_e { p7_HUGEMEM_OFF = 0, p7_HUGEMEM_THP = 1, p7_HUGEMEM_2M = 2, p7_HUGEMEM_1G = 3 };
+#define p7_HUGEMEM_MIN  (2 * 1024 * 1024)   /* smaller buffers are always malloc()'ed */
+
+
+/* Cpus that worker and reader threads are pinned to (--cpubind,
+ * --readercpu); opaque, see p7_cpubind.c.
+ */
+typedef struct p7_cpubind_s P7_CPUBIND;
+
+/* A measured choice of the number of worker threads (--cpu auto);
+ * opaque, see p7_cputune.c. Drivers sample about p7_CPUTUNE_CELLS
+ * DP cells (query length times target residues) of the database for
+ * it, and no more than p7_CPUTUNE_MAXRES residues.
+ */
+typedef struct p7_cputune_s P7_CPUTUNE;
+#define p7_CPUTUNE_CELLS   1e10
+#define p7_CPUTUNE_MAXRES  (64 * 1024 * 1024)
+
+
+/* P7_PROGRESS: periodic progress and throughput reports from a
+ * running search (--progress). See p7_progress.c.
+ */
+typedef struct p7_progress_slot_s {
+  uint64_t  ntargets;		/* this query: comparisons done               */
+  uint64_t  npos;		/* ... and residues (search) or nodes (scan) */
+  uint64_t  n_past_msv, n_past_bias, n_past_vit, n_past_fwd;
+  double    busy;		/* seconds in the pipeline, whole run         */
+  double    wait;		/* seconds waiting for targets, whole run     */
+  double    rbusy, rwait;	/* <busy>, <wait> at the last report          */
+} P7_PROGRESS_SLOT;
+
+typedef struct p7_progress_s {
+  FILE             *fp;		/* where reports go                            */
+  int               close_fp;	/* TRUE to fclose() <fp> at the end            */
+  double            interval;	/* seconds between reports                     */
+  enum p7_pipemodes_e mode;	/* search or scan: which counts are targets    */
+  P7_PROGRESS_SLOT *slot;	/* one per worker [0..nslots-1]                */
+  int               nslots;
+
+  int               nquery;	/* current query, 1..                          */
+  char              qname[64];	/* ... its name, maybe truncated               */
+  uint64_t          run_targets;/* finished queries' comparisons               */
+  uint64_t          run_pos;	/* ... and residues or nodes                   */
+  double            reader_wait;/* seconds the reader waited for empty blocks  */
+  double            r_reader_wait; /* ... at the last report               */
+
+  double            total;	/* work to do, in driver's units; 0 = unknown  */
+  double            done;	/* ... done, if !by_residues                   */
+  int               by_residues;/* TRUE: done = residues since SetTotal()      */
+  uint64_t          pos0;	/* residues at SetTotal()                      */
+  double            t_total;	/* time of SetTotal()                          */
+
+  double            t_start;	/* time of Create()                            */
+  double            t_last;	/* time of the last report                     */
+  uint64_t          last_targets, last_pos; /* counts at the last report   */
+#ifdef HMMER_THREADS
+  pthread_t         thread;
+  pthread_mutex_t   mutex;	/* guards all of the above, once running       */
+  pthread_cond_t    cond;	/* signals <stop>                              */
+  int               stop;
+#endif
+} P7_PROGRESS;
+
+
+/* P7_BINOUT: a compact binary result file (--binout), for bulk runs
+ * that would otherwise write and parse billions of --domtblout rows.
+ * Each query's reported hits are stored with p7_hit_Serialize(),
+ * followed by a table of their file offsets; an index at the end of
+ * the file gives random access to any query or hit. The same object
+ * is used to write a file and to read one. See p7_binout.c for the
+ * file layout.
+ */
+#define p7_BINOUT_MAGIC     "HMMRBIN1" /* 8 bytes, no NUL: starts and ends a file */
+#define p7_BINOUT_VERSION   1
+#define p7_BINOUT_QUERYTAG  0x51525931 /* "QRY1" */
+#define p7_BINOUT_INDEXTAG  0x49445831 /* "IDX1" */
+
+typedef struct p7_binout_s {
+  FILE        *fp;
+  int          is_writer;	/* TRUE if writing; FALSE if reading            */
+  uint64_t     offset;		/* writer: # of bytes written so far            */
+  enum p7_pipemodes_e mode;	/* pipeline mode of the search                  */
+  char        *progname;	/* reader: header fields; any may be NULL       */
+  char        *qfile;
+  char        *tfile;
+
+  /* The query index */
+  int64_t      nquery;		/* number of queries                            */
+  int64_t      nqalloc;		/* current allocation size of the index arrays  */
+  uint64_t    *qoff;		/* file offset of each query's record           */
+  uint64_t    *nhits;		/* number of hits stored for each query         */
+  uint64_t    *hoff;		/* file offset of each query's hit offset table */
+
+  /* Reader: the query last read by p7_binout_ReadQuery() */
+  int64_t      curr;		/* its number, or -1                            */
+  char        *qname;
+  char        *qacc;		/* may be NULL                                  */
+  P7_PIPELINE  pli;		/* only mode, Z, domZ, long_targets, inc_by_E set */
+
+  uint8_t     *buf;		/* serialization buffer                         */
+  uint32_t     nalloc;		/* current allocation size of <buf>             */
+  char         errbuf[eslERRBUFSIZE];
+} P7_BINOUT;
+
+
+/* P7_CHECKPOINT: the saved state of a long search (hmmsearch
+ * --checkpoint), so that a run that gets killed can be restarted
+ * where it left off. Every so often the search stops handing out
+ * targets, waits for the ones under way, and records how many
+ * queries were finished (and how long their output files were
+ * then), how far through the target database the current query got,
+ * its hits so far (with p7_hit_Serialize()) and its pipeline
+ * counters. See p7_checkpoint.c for the file layout.
+ */
+#define p7_CHECKPOINT_MAGIC    "HMMRCKP1" /* 8 bytes, no NUL: starts and ends a file */
+#define p7_CHECKPOINT_VERSION  1
+#define p7_CHECKPOINT_MAXOUT   8	  /* max # of output files it keeps track of    */
+#define p7_CHECKPOINT_NCOUNTS  21	  /* # of pipeline counters saved               */
+
+typedef struct p7_checkpoint_s {
+  char        *filename;
+  char        *qfile;		/* the search's query and target files, which  */
+  char        *tfile;		/*   a checkpoint file must match              */
+  double       interval;	/* seconds between checkpoints                  */
+  double       t_last;		/* p7_progress_Now() at the last one            */
+  int          stop;		/* TRUE when a target loop stopped for one      */
+
+  /* How far the search has come */
+  int64_t      nquery;		/* # of queries finished and output             */
+  int          nout;		/* # of output file slots in use                */
+  FILE        *outfp[p7_CHECKPOINT_MAXOUT];   /* the output files; NULL for none */
+  uint64_t     outsize[p7_CHECKPOINT_MAXOUT]; /* their sizes after <nquery> queries */
+  char        *qname;		/* the query under way, or NULL                 */
+  uint64_t     ntargets;	/* # of its targets done                        */
+  int64_t      last_roff;	/* record offset of the last of them; -1 if none */
+
+  /* Read from a checkpoint file, until p7_checkpoint_StartQuery() uses them */
+  int          resumed;		/* TRUE if the state came from a file           */
+  int          have_saved;	/* TRUE if <qname> has saved counters and hits  */
+  uint64_t     counts[p7_CHECKPOINT_NCOUNTS];
+  P7_TOPHITS  *th;		/* the saved hits, or NULL                      */
+
+  uint8_t     *buf;		/* serialization buffer                         */
+  uint32_t     nalloc;		/* current allocation size of <buf>             */
+} P7_CHECKPOINT;
+
+
+/* P7_SEQDB: a pressed target sequence database (hmmseqpress), the
+ * digitized sequences of <seqfile> saved as <seqfile>.h3q so that
+ * searches can map them instead of parsing <seqfile>. Sequences are
+ * read as views into the mapping: see p7_seqdb.c for the file layout.
+ * p7_seqdb_Load() makes the same thing in memory from a sequence file.
+ */
+#define p7_SEQDB_SUFFIX  ".h3q"
+#define p7_SEQDB_MAGIC   0xe8b3f1b1  /* v1: "h3q1" + 0x80808080 */
+
+typedef struct {
+  uint64_t roff;		/* leading sentinel of the sequence, in the residue section */
+  uint64_t moff;		/* its name, in the metadata section                        */
+  uint32_t aoff;		/* its accession is at moff+aoff                            */
+  uint32_t doff;		/* and its description at moff+doff                         */
+} P7_SEQDB_ENTRY;
+
+typedef struct p7_seqdb_s {
+  char                 *dbfile;	/* name of the pressed file, <seqfile>.h3q; or <seqfile>, if loaded */
+  int                   abctype;	/* alphabet it was pressed in (eslAMINO...)       */
+  uint64_t              nseq;	/* number of sequences                            */
+  uint64_t              nres;	/* total number of residues                       */
+  uint64_t              maxL;	/* length of the longest sequence                 */
+
+  const ESL_DSQ        *res;	/* residue section                                */
+  const P7_SEQDB_ENTRY *ent;	/* index, nseq+1 entries                          */
+  const char           *meta;	/* metadata section                               */
+
+  const ESL_ALPHABET   *abc;	/* alphabet of the views; set by p7_seqdb_SetDigital() */
+  uint64_t              next;	/* next sequence to read                          */
+
+  char                 *mem;	/* the whole file (or, if loaded, the three sections) */
+  uint64_t              size;	/* size of <mem> in bytes                         */
+  int                   mapped;	/* TRUE if <mem> is mmap()'ed; else malloc()'ed   */
+} P7_SEQDB;
+
+/* P7_SEQDB_WRITER: a pressed database being written, one sequence at
+ * a time; p7_seqdb_Press() uses one, and so does hmmemit --press.
+ */
+typedef struct {
+  char     *dbfile;		/* final name of the pressed file                 */
+  char     *tmpname;		/* <dbfile>.tmp, renamed to <dbfile> when closed  */
+  FILE     *fp;			/* open <tmpname>                                 */
+  FILE     *efp;		/* index, spooled                                 */
+  FILE     *mfp;		/* metadata, spooled                              */
+  uint32_t  abctype;
+  uint64_t  nseq;
+  uint64_t  nres;
+  uint64_t  maxL;
+  uint64_t  res_off;		/* offset of the residue section                  */
+  uint64_t  res_size;		/* residues and sentinels written so far          */
+  uint64_t  meta_size;		/* metadata written so far                        */
+  char      errbuf[eslERRBUFSIZE];
+} P7_SEQDB_WRITER;
+
 
 
 /*****************************************************************
@@ -1294,6 +1901,8 @@ typedef struct p7_builder_s {
   int                  EfL;	         /* length of sequences generated for Forward fitting      */
   int                  EfN;	         /* # of sequences generated for Forward fitting           */
   double               Eft;	         /* tail mass used for Forward fitting                     */
+  int                  Ecpu;	         /* split each fit over this many threads; 0 = don't split */
+  int                  Mcpu;	         /* split construction of a big model over this many threads; 0 = don't */
 
   /* Choice of prior                                                                               */
   P7_PRIOR            *prior;	         /* choice of prior when parameterizing from counts        */
@@ -1304,6 +1913,7 @@ typedef struct p7_builder_s {
   ESL_DMATRIX         *Q;	         /* Q->mx[a][b] = P(b|a) residue probabilities             */
   double               popen;         	 /* gap open probability                                   */
   double               pextend;          /* gap extend probability                                 */
+  char                *qcache;           /* directory caching calibrated query models, or NULL     */
 
   double               w_beta;    /*beta value used to compute W (window length)   */
   int                  w_len;     /*W (window length)  explicitly set */
@@ -1399,6 +2009,7 @@ extern int hmmlogo_IndelValues (P7_HMM *hmm, float *insert_P, float *insert_expL
 
 /* hmmpgmd2msa.c */
 extern int hmmpgmd2msa(void *data, P7_HMM *hmm, ESL_SQ *qsq, int *incl, int incl_size, int *excl, int excl_size, int excl_all, ESL_MSA **ret_msa);
+extern int hmmpgmd2msa_threaded(void *data, P7_HMM *hmm, ESL_SQ *qsq, int *incl, int incl_size, int *excl, int excl_size, int excl_all, int ncpu, ESL_MSA **ret_msa);
 
 
 
@@ -1424,6 +2035,7 @@ extern int   p7_ILogsum(int s1, int s2);
 /* modelconfig.c */
 extern int p7_ProfileConfig(const P7_HMM *hmm, const P7_BG *bg, P7_PROFILE *gm, int L, int mode);
 extern int p7_ReconfigLength  (P7_PROFILE *gm, int L);
+extern int p7_LengthParams    (P7_LENPARAM *lp, int L, float nj);
 extern int p7_ReconfigMultihit(P7_PROFILE *gm, int L);
 extern int p7_ReconfigUnihit  (P7_PROFILE *gm, int L);
 
@@ -1453,6 +2065,8 @@ extern int p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, i
 
 extern int p7_tophits_MPISend(P7_TOPHITS *th, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
 extern int p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_TOPHITS **ret_th);
+extern int p7_tophits_MPIReduce(P7_TOPHITS *th, P7_PIPELINE *pli, int my_rank, int nproc, int fanout,
+				int th_tag, int pli_tag, MPI_Comm comm, ESL_GETOPTS *go, char **buf, int *nalloc);
 
 extern int p7_oprofile_MPISend(P7_OPROFILE *om, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
 extern int p7_oprofile_MPIPackSize(P7_OPROFILE *om, MPI_Comm comm, int *ret_n);
@@ -1465,14 +2079,19 @@ extern int p7_oprofile_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, i
 extern int p7_tracealign_Seqs(ESL_SQ **sq,           P7_TRACE **tr, int nseq, int M,  int optflags, P7_HMM *hmm, ESL_MSA **ret_msa);
 extern int p7_tracealign_MSA (const ESL_MSA *premsa, P7_TRACE **tr,           int M,  int optflags, ESL_MSA **ret_postmsa);
 extern int p7_tracealign_computeTraces(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRACE  **tr);
+extern int p7_tracealign_computeTracesThreaded(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRACE  **tr, int ncpu);
 extern int p7_tracealign_getMSAandStats(P7_HMM *hmm, ESL_SQ  **sq, int N, ESL_MSA **ret_msa, float **ret_pp, float **ret_relent, float **ret_scores );
 
 /* p7_alidisplay.c */
 extern P7_ALIDISPLAY *p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq);
+extern P7_ALIDISPLAY *p7_alidisplay_CreateInArena(P7_ARENA *arena, const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq);
 extern P7_ALIDISPLAY *p7_alidisplay_Create_empty();
 extern P7_ALIDISPLAY *p7_alidisplay_Clone(const P7_ALIDISPLAY *ad);
 extern size_t         p7_alidisplay_Sizeof(const P7_ALIDISPLAY *ad);
+extern int            p7_alidisplay_Compress(P7_ALIDISPLAY *ad);
+extern int            p7_alidisplay_Expand(P7_ALIDISPLAY *ad);
 extern int            p7_alidisplay_Serialize(const P7_ALIDISPLAY *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
+extern int            p7_alidisplay_SerializeAs(const P7_ALIDISPLAY *obj, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
 extern int            p7_alidisplay_Deserialize(const uint8_t *buf, uint32_t *n, P7_ALIDISPLAY *ret_obj);
 extern int            p7_alidisplay_Serialize_old(P7_ALIDISPLAY *ad);
 extern int            p7_alidisplay_Deserialize_old(P7_ALIDISPLAY *ad);
@@ -1490,6 +2109,16 @@ extern int            p7_alidisplay_Sample(ESL_RANDOMNESS *rng, int N, P7_ALIDIS
 extern int            p7_alidisplay_Dump(FILE *fp, const P7_ALIDISPLAY *ad);
 extern int            p7_alidisplay_Compare(const P7_ALIDISPLAY *ad1, const P7_ALIDISPLAY *ad2);
 
+/* p7_arena.c */
+extern P7_ARENA *p7_arena_Create(size_t blocksize);
+extern void     *p7_arena_Alloc(P7_ARENA *a, size_t n);
+extern int       p7_arena_Strdup(P7_ARENA *a, const char *s, int64_t n, char **ret_s);
+extern int       p7_arena_SetMark(P7_ARENA *a);
+extern int       p7_arena_Rewind(P7_ARENA *a);
+extern int       p7_arena_Splice(P7_ARENA *dst, P7_ARENA *src);
+extern int       p7_arena_Reuse(P7_ARENA *a);
+extern void      p7_arena_Destroy(P7_ARENA *a);
+
 /* p7_bg.c */
 extern P7_BG *p7_bg_Create(const ESL_ALPHABET *abc);
 extern P7_BG *p7_bg_CreateUniform(const ESL_ALPHABET *abc);
@@ -1505,21 +2134,56 @@ extern int    p7_bg_Write(FILE *fp, P7_BG *bg);
 extern int    p7_bg_SetFilter  (P7_BG *bg, int M, const float *compo);
 extern int    p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc);
 
+/* p7_binout.c */
+extern int  p7_binout_Create    (FILE *fp, const char *progname, enum p7_pipemodes_e mode, const char *qfile, const char *tfile, P7_BINOUT **ret_bo);
+extern int  p7_binout_WriteQuery(P7_BINOUT *bo, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli);
+extern int  p7_binout_WriteIndex(P7_BINOUT *bo);
+extern int  p7_binout_Open      (char *filename, P7_BINOUT **ret_bo, char *errbuf);
+extern int  p7_binout_ReadQuery (P7_BINOUT *bo, int64_t q, P7_TOPHITS **ret_th);
+extern int  p7_binout_ReadHit   (P7_BINOUT *bo, int64_t q, uint64_t h, P7_HIT **ret_hit);
+extern void p7_binout_Close     (P7_BINOUT *bo);
+
+/* p7_checkpoint.c */
+extern int  p7_checkpoint_Create    (const char *filename, double interval, const char *qfile, const char *tfile, P7_CHECKPOINT **ret_ck);
+extern int  p7_checkpoint_Read      (P7_CHECKPOINT *ck, char *errbuf);
+extern int  p7_checkpoint_OpenOutput(P7_CHECKPOINT *ck, int which, const char *fname, FILE **ret_fp);
+extern int  p7_checkpoint_StartQuery(P7_CHECKPOINT *ck, const char *qname, P7_PIPELINE *pli, P7_TOPHITS *th, int64_t *ret_roff);
+extern int  p7_checkpoint_Due       (P7_CHECKPOINT *ck);
+extern void p7_checkpoint_Advance   (P7_CHECKPOINT *ck, uint64_t ntargets, int64_t last_roff);
+extern int  p7_checkpoint_Write     (P7_CHECKPOINT *ck, P7_PIPELINE **pli, P7_TOPHITS **th, int n);
+extern void p7_checkpoint_EndQuery  (P7_CHECKPOINT *ck, int64_t nquery);
+extern void p7_checkpoint_Remove    (P7_CHECKPOINT *ck);
+extern void p7_checkpoint_Destroy   (P7_CHECKPOINT *ck);
+
 /* p7_builder.c */
 extern P7_BUILDER *p7_builder_Create(const ESL_GETOPTS *go, const ESL_ALPHABET *abc);
 extern int         p7_builder_LoadScoreSystem(P7_BUILDER *bld, const char *matrix,                  double popen, double pextend, P7_BG *bg);
 extern int         p7_builder_SetScoreSystem (P7_BUILDER *bld, const char *mxfile, const char *env, double popen, double pextend, P7_BG *bg);
+extern int         p7_builder_SetQueryCache(P7_BUILDER *bld, const char *dir);
 extern void        p7_builder_Destroy(P7_BUILDER *bld);
 
 extern int p7_Builder      (P7_BUILDER *bld, ESL_MSA *msa, P7_BG *bg, P7_HMM **opt_hmm, P7_TRACE ***opt_trarr, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om, ESL_MSA **opt_postmsa);
 extern int p7_SingleBuilder(P7_BUILDER *bld, ESL_SQ *sq,   P7_BG *bg, P7_HMM **opt_hmm, P7_TRACE  **opt_tr,    P7_PROFILE **opt_gm, P7_OPROFILE **opt_om); 
 extern int p7_Builder_MaxLength      (P7_HMM *hmm, double emit_thresh);
 
+/* p7_cpubind.c */
+extern int  p7_cpubind_Create (const char *spec, int reader, P7_CPUBIND **ret_cb, char *errbuf);
+extern void p7_cpubind_Reader (const P7_CPUBIND *cb);
+extern void p7_cpubind_Worker (const P7_CPUBIND *cb, int k);
+extern void p7_cpubind_Destroy(P7_CPUBIND *cb);
+
+/* p7_cputune.c */
+extern int  p7_cputune_Measure (const ESL_GETOPTS *go, const P7_OPROFILE *om, ESL_SQ_BLOCK **blocks, int nblocks, int maxcpus, const P7_CPUBIND *cb, P7_CPUTUNE **ret_tune);
+extern int  p7_cputune_NThreads(const P7_CPUTUNE *tune);
+extern int  p7_cputune_Write   (FILE *ofp, const P7_CPUTUNE *tune);
+extern void p7_cputune_Destroy (P7_CPUTUNE *tune);
+
 /* p7_domain.c */
 extern P7_DOMAIN *p7_domain_Create_empty();
 extern void p7_domain_Destroy(P7_DOMAIN *obj);
 extern int p7_domain_Copy(const P7_DOMAIN *src, P7_DOMAIN *dst);
 extern int p7_domain_Serialize(const P7_DOMAIN *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
+extern int p7_domain_SerializeAs(const P7_DOMAIN *obj, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
 extern int p7_domain_Deserialize(const uint8_t *buf, uint32_t *n, P7_DOMAIN *ret_obj);
 extern int p7_domain_TestSample(ESL_RAND64 *rng, P7_DOMAIN **ret_obj);
 extern int p7_domain_Compare(P7_DOMAIN *first, P7_DOMAIN *second, double atol, double rtol);
@@ -1531,11 +2195,13 @@ extern int           p7_domaindef_GrowTo (P7_DOMAINDEF *ddef, int L);
 extern int           p7_domaindef_Reuse  (P7_DOMAINDEF *ddef);
 extern int           p7_domaindef_DumpPosteriors(FILE *ofp, P7_DOMAINDEF *ddef);
 extern void          p7_domaindef_Destroy(P7_DOMAINDEF *ddef);
+extern size_t        p7_domaindef_Sizeof (const P7_DOMAINDEF *ddef);
 
-extern int p7_domaindef_ByViterbi            (P7_PROFILE *gm, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_GMX *gx1, P7_GMX *gx2, P7_DOMAINDEF *ddef);
+extern int p7_domaindef_ByViterbi            (const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *fwd, P7_OMX *bck, P7_DOMAINDEF *ddef, P7_BG *bg);
 extern int p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *oxf, P7_OMX *oxb, P7_OMX *fwd, P7_OMX *bck,
 				                                  P7_DOMAINDEF *ddef, P7_BG *bg, int long_target,
 				                                  P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+extern int p7_domaindef_Align                (const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *fwd, P7_OMX *bck, P7_DOMAINDEF *ddef);
 
 
 /* p7_gmx.c */
@@ -1548,12 +2214,23 @@ extern int     p7_gmx_Compare(P7_GMX *gx1, P7_GMX *gx2, float tolerance);
 extern int     p7_gmx_Dump(FILE *fp, P7_GMX *gx, int flags);
 extern int     p7_gmx_DumpWindow(FILE *fp, P7_GMX *gx, int istart, int iend, int kstart, int kend, int show_specials);
 
+/* p7_hugemem.c */
+extern int   p7_hugemem_SetMode(const char *s);
+extern int   p7_hugemem_Mode(void);
+extern void *p7_hugemem_Alloc(size_t n);
+extern void *p7_hugemem_Grow(void *p, size_t n);
+extern void  p7_hugemem_Free(void *p);
+extern void  p7_hugemem_Advise(void *mem, size_t n);
+
 /* p7_hit.c */
 extern P7_HIT *p7_hit_Create_empty();
 extern void p7_hit_Destroy(P7_HIT *the_hit);
 extern int p7_hit_Copy(const P7_HIT *src, P7_HIT *dst);
 extern int p7_hit_Serialize(const P7_HIT *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
+extern int p7_hit_SerializeAs(const P7_HIT *obj, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
 extern int p7_hit_Deserialize(const uint8_t *buf, uint32_t *n, P7_HIT *ret_obj);
+extern int p7_hit_Scan(const uint8_t *buf, uint32_t *n, uint32_t len, P7_HITREF *ref);
+extern int p7_hitref_Compare(const P7_HITREF *r1, const P7_HITREF *r2);
 extern int p7_hit_TestSample(ESL_RAND64 *rng, P7_HIT **ret_obj);
 extern int p7_hit_Compare(P7_HIT *first, P7_HIT *second, double atol, double rtol);
 
@@ -1599,6 +2276,7 @@ extern int  p7_hmmfile_Open      (const char *filename, char *env, P7_HMMFILE **
 extern int  p7_hmmfile_OpenNoDB  (const char *filename, char *env, P7_HMMFILE **ret_hfp, char *errbuf);
 extern int  p7_hmmfile_OpenBuffer(const char *buffer, int size, P7_HMMFILE **ret_hfp);
 extern void p7_hmmfile_Close(P7_HMMFILE *hfp);
+extern void p7_hmmfile_Unmap(P7_HMMFILE *hfp);
 #ifdef HMMER_THREADS
 extern int  p7_hmmfile_CreateLock(P7_HMMFILE *hfp);
 #endif
@@ -1608,11 +2286,15 @@ extern int  p7_hmmfile_WriteToString (char **s, int format, P7_HMM *hmm);
 extern int  p7_hmmfile_Read(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc,  P7_HMM **opt_hmm);
 extern int  p7_hmmfile_PositionByKey(P7_HMMFILE *hfp, const char *key);
 extern int  p7_hmmfile_Position(P7_HMMFILE *hfp, const off_t offset);
+extern int  p7_hmmfile_SortKeys(P7_HMMFILE *hfp, char **keys, int nkeys, off_t *offset, int *order);
+extern int  p7_hmmfile_ReadAt(P7_HMMFILE *hfp, off_t offset, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm);
 
 
 /* p7_hmmwindow.c */
 int p7_hmmwindow_init (P7_HMM_WINDOWLIST *list);
 P7_HMM_WINDOW *p7_hmmwindow_new (P7_HMM_WINDOWLIST *list, uint32_t id, uint32_t pos, uint32_t fm_pos, uint16_t k, uint32_t length, float score, uint8_t complementarity, uint32_t target_len);
+int p7_hmmwindow_Covered (const P7_HMM_WINDOWLIST *list, int complementarity, int64_t pos, int64_t length);
+int p7_hmmwindow_Prune (P7_HMM_WINDOWLIST *list, int64_t pos);
 
 
 
@@ -1626,17 +2308,33 @@ extern P7_HMM_WINDOW *p7_hmm_newWindow (P7_HMM_WINDOWLIST *list, uint32_t id, ui
 
 
 
+/* p7_mxpool.c */
+extern P7_MXPOOL *p7_mxpool_Create(size_t maxbytes, size_t maxmx);
+extern P7_OMX    *p7_mxpool_GetOMX(P7_MXPOOL *pool, int M, int L, int XL);
+extern int        p7_mxpool_PutOMX(P7_MXPOOL *pool, P7_OMX *ox);
+extern P7_GMX    *p7_mxpool_GetGMX(P7_MXPOOL *pool, int M, int L);
+extern int        p7_mxpool_PutGMX(P7_MXPOOL *pool, P7_GMX *gx);
+extern size_t     p7_mxpool_Sizeof(const P7_MXPOOL *pool);
+extern void       p7_mxpool_Destroy(P7_MXPOOL *pool);
+
 /* p7_null3.c */
 extern void p7_null3_score(const ESL_ALPHABET *abc, const ESL_DSQ *dsq, P7_TRACE *tr, int start, int stop, P7_BG *bg, float *ret_sc);
 extern void p7_null3_windowed_score(const ESL_ALPHABET *abc, const ESL_DSQ *dsq, int start, int stop, P7_BG *bg, float *ret_sc);
 
 /* p7_pipeline.c */
 extern P7_PIPELINE *p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targets, enum p7_pipemodes_e mode);
+extern P7_PIPELINE *p7_pipeline_CreateInPool(P7_MXPOOL *pool, const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targets, enum p7_pipemodes_e mode);
 extern int          p7_pipeline_Reuse  (P7_PIPELINE *pli);
+extern int          p7_pipeline_ReuseQuery(P7_PIPELINE *pli);
 extern void         p7_pipeline_Destroy(P7_PIPELINE *pli);
 extern int          p7_pipeline_Merge  (P7_PIPELINE *p1, P7_PIPELINE *p2);
+extern int          p7_pipeline_SetTopK(P7_PIPELINE *pli, int topk);
+extern void         p7_pipeline_SetAdaptive(P7_PIPELINE *pli, int do_adapt);
+extern void         p7_pipeline_SetViterbiDomains(P7_PIPELINE *pli, int do_vitdom);
+extern void         p7_pipeline_SetSeqScoreOnly(P7_PIPELINE *pli, int do_seqonly);
+extern void         p7_pipeline_SetMemBudget(P7_PIPELINE *pli, int64_t nbytes);
 
-extern int p7_pli_ExtendAndMergeWindows (P7_OPROFILE *om, const P7_SCOREDATA *msvdata, P7_HMM_WINDOWLIST *windowlist, float pct_overlap);
+extern int p7_pli_ExtendAndMergeWindows (P7_OPROFILE *om, const P7_SCOREDATA *msvdata, P7_HMM_WINDOWLIST *windowlist, float pct_overlap, int max_len);
 extern int p7_pli_TargetReportable  (P7_PIPELINE *pli, float score,     double lnP);
 extern int p7_pli_DomainReportable  (P7_PIPELINE *pli, float dom_score, double lnP);
 
@@ -1646,15 +2344,22 @@ extern int p7_pli_NewModel          (P7_PIPELINE *pli, const P7_OPROFILE *om, P7
 extern int p7_pli_NewModelThresholds(P7_PIPELINE *pli, const P7_OPROFILE *om);
 extern int p7_pli_NewSeq            (P7_PIPELINE *pli, const ESL_SQ *sq);
 extern int p7_Pipeline              (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *th);
+extern int p7_Pipeline_Block        (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ_BLOCK *block, P7_TOPHITS *th);
+extern int p7_Pipeline_ScanBlock    (P7_PIPELINE *pli, P7_OM_BLOCK *block, P7_BG *bg, const ESL_SQ *sq, P7_TOPHITS *th);
 extern int p7_Pipeline_LongTarget   (P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
                                      P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx,
                                      const ESL_SQ *sq, int complementarity,
                                      const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg
                                      );
+extern int p7_Pipeline_LongTargetDual(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
+                                       P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx, const ESL_SQ *sq);
 
 
 
 extern int p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w);
+extern int p7_pli_TabularTimings(FILE *ofp, P7_PIPELINE *pli);
+extern void   p7_pli_MemAccount(P7_PIPELINE *pli, enum p7_memsys_e which, size_t nbytes);
+extern size_t p7_pli_ProcessPeak(void);
 
 
 /* p7_prior.c */
@@ -1664,6 +2369,7 @@ extern P7_PRIOR  *p7_prior_CreateLaplace(const ESL_ALPHABET *abc);
 extern void       p7_prior_Destroy(P7_PRIOR *pri);
 
 extern int        p7_ParameterEstimation(P7_HMM *hmm, const P7_PRIOR *pri);
+extern int        p7_MatchParameterEstimation(const P7_HMM *hmm, const P7_PRIOR *pri, const double *scale, float **mat);
 
 /* p7_profile.c */
 extern P7_PROFILE *p7_profile_Create(int M, const ESL_ALPHABET *abc);
@@ -1680,6 +2386,52 @@ extern int         p7_profile_GetT(const P7_PROFILE *gm, char st1, int k1,
 extern int         p7_profile_Validate(const P7_PROFILE *gm, char *errbuf, float tol);
 extern int         p7_profile_Compare(P7_PROFILE *gm1, P7_PROFILE *gm2, float tol);
 
+/* p7_seqdb.c */
+extern int           p7_seqdb_Press(ESL_SQFILE *sqfp, const char *dbfile, uint64_t *opt_nseq, uint64_t *opt_nres, char *errbuf);
+extern int           p7_seqdb_CreateWriter(const char *dbfile, int abctype, P7_SEQDB_WRITER **ret_w, char *errbuf);
+extern int           p7_seqdb_Write(P7_SEQDB_WRITER *w, const ESL_SQ *sq);
+extern int           p7_seqdb_CloseWriter(P7_SEQDB_WRITER *w, uint64_t *opt_nseq, uint64_t *opt_nres, char *errbuf);
+extern void          p7_seqdb_DestroyWriter(P7_SEQDB_WRITER *w);
+extern int           p7_seqdb_Open(const char *seqfile, P7_SEQDB **ret_db, char *errbuf);
+extern int           p7_seqdb_Load(ESL_SQFILE *sqfp, P7_SEQDB **ret_db, char *errbuf);
+extern int           p7_seqdb_LoadList(ESL_SQFILE *sqfp, const char *listfile, P7_SEQDB **ret_db, char *errbuf);
+extern int           p7_seqdb_LoadRange(ESL_SQFILE *sqfp, off_t roff, uint64_t nseq, P7_SEQDB **ret_db, char *errbuf);
+extern int           p7_seqdb_SetDigital(P7_SEQDB *db, const ESL_ALPHABET *abc);
+extern int           p7_seqdb_Position(P7_SEQDB *db, uint64_t i);
+extern int           p7_seqdb_Read(P7_SEQDB *db, ESL_SQ *sq);
+extern int           p7_seqdb_Get(const P7_SEQDB *db, uint64_t i, ESL_SQ *sq);
+extern int           p7_seqdb_ReadBlock(P7_SEQDB *db, ESL_SQ_BLOCK *block, int max_residues);
+extern ESL_SQ_BLOCK *p7_seqdb_CreateBlock(int count);
+extern void          p7_seqdb_DestroyBlock(ESL_SQ_BLOCK *block);
+extern void          p7_seqdb_Close(P7_SEQDB *db);
+
+/* p7_progress.c */
+extern P7_PROGRESS *p7_progress_Create(FILE *fp, int close_fp, double interval, int nworkers, enum p7_pipemodes_e mode);
+extern void         p7_progress_NewQuery(P7_PROGRESS *prog, int nquery, const char *qname);
+extern void         p7_progress_SetTotal(P7_PROGRESS *prog, double total, int by_residues);
+extern void         p7_progress_SetDone(P7_PROGRESS *prog, double done);
+extern void         p7_progress_Worker(P7_PROGRESS *prog, int idx, const P7_PIPELINE *pli, double busy, double wait);
+extern void         p7_progress_ReaderWait(P7_PROGRESS *prog, double wait);
+extern double       p7_progress_Now(void);
+extern void         p7_progress_Destroy(P7_PROGRESS *prog);
+
+/* p7_readahead.c */
+extern P7_READAHEAD *p7_readahead_Open(const char *filename, size_t window);
+extern void          p7_readahead_Advance(P7_READAHEAD *ra, off_t pos);
+extern void          p7_readahead_Close(P7_READAHEAD *ra);
+
+/* p7_tabstream.c */
+extern P7_TABSTREAM *p7_tabstream_Create(FILE *tblfp, FILE *domtblfp, int use_thread);
+extern int           p7_tabstream_NewQuery(P7_TABSTREAM *ts, char *qname, char *qacc, P7_PIPELINE *pli, int show_header);
+extern int           p7_tabstream_AddHits(P7_TABSTREAM *ts, P7_TOPHITS *th, uint64_t from, P7_PIPELINE *pli);
+extern int           p7_tabstream_EndQuery(P7_TABSTREAM *ts);
+extern void          p7_tabstream_Destroy(P7_TABSTREAM *ts);
+
+/* p7_wordseeds.c */
+extern P7_WORDSEEDS *p7_wordseeds_Create(const ESL_SQ *qsq, const ESL_SCOREMATRIX *S, int k, int T);
+extern int           p7_wordseeds_Hit(const P7_WORDSEEDS *ws, const ESL_DSQ *dsq, int L);
+extern void          p7_wordseeds_Destroy(P7_WORDSEEDS *ws);
+
 /* p7_spensemble.c */
 P7_SPENSEMBLE *p7_spensemble_Create(int init_n, int init_epc, int init_sigc);
 extern int     p7_spensemble_Reuse(P7_SPENSEMBLE *sp);
@@ -1697,6 +2449,8 @@ extern P7_TOPHITS *p7_tophits_Create(void);
 extern int         p7_tophits_Grow(P7_TOPHITS *h);
 extern P7_TOPHITS *p7_tophits_Clone(const P7_TOPHITS *h);
 extern int         p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit);
+extern int         p7_tophits_SetHitStrings(P7_TOPHITS *h, P7_HIT *hit, const char *name, const char *acc, const char *desc);
+extern void        p7_tophits_BorrowStrings(P7_TOPHITS *h);
 extern int         p7_tophits_Add(P7_TOPHITS *h,
 				  char *name, char *acc, char *desc, 
 				  double sortkey, 
@@ -1709,28 +2463,44 @@ extern int         p7_tophits_Add(P7_TOPHITS *h,
 extern int         p7_tophits_SortBySortkey(P7_TOPHITS *h);
 extern int         p7_tophits_SortBySeqidxAndAlipos(P7_TOPHITS *h);
 extern int         p7_tophits_SortByModelnameAndAlipos(P7_TOPHITS *h);
+extern int         p7_tophits_SortTopK(P7_TOPHITS *h, uint64_t K);
 
 extern int         p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2);
+extern int         p7_tophits_MergeHitArrays(P7_HIT ***runs, const uint64_t *nrun, int nruns, P7_HIT **out);
+extern int         p7_tophits_MergeMany(P7_TOPHITS *h1, P7_TOPHITS **hl, int nlist);
+extern int         p7_tophits_MergeManyBySeqidxAndAlipos(P7_TOPHITS *h1, P7_TOPHITS **hl, int nlist);
 extern int         p7_tophits_GetMaxPositionLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxNameLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxAccessionLength(P7_TOPHITS *h);
 extern int         p7_tophits_GetMaxShownLength(P7_TOPHITS *h);
+extern int         p7_tophits_SetSpill(P7_TOPHITS *h, uint64_t maxbytes);
+extern int         p7_tophits_Spill(P7_TOPHITS *h);
+extern uint64_t    p7_tophits_Count(const P7_TOPHITS *h);
 extern void        p7_tophits_Destroy(P7_TOPHITS *h);
+extern int         p7_tophits_Serialize(const P7_TOPHITS *th, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
+extern int         p7_tophits_Deserialize(const uint8_t *buf, uint32_t len, uint32_t *n, P7_TOPHITS *th);
 
 extern int p7_tophits_ComputeNhmmerEvalues(P7_TOPHITS *th, double N, int W);
 extern int p7_tophits_RemoveDuplicates(P7_TOPHITS *th, int using_bit_cutoffs);
 extern int p7_tophits_Threshold(P7_TOPHITS *th, P7_PIPELINE *pli);
+extern int p7_tophits_ThresholdHit(P7_HIT *hit, P7_PIPELINE *pli);
 extern int p7_tophits_CompareRanking(P7_TOPHITS *th, ESL_KEYHASH *kh, int *opt_nnew);
 extern int p7_tophits_Targets(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw);
 extern int p7_tophits_Domains(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw);
+extern int p7_tophits_DomainsThreaded(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw, int ncpu);
 
 
 extern int p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc, 
 				ESL_SQ **inc_sqarr, P7_TRACE **inc_trarr, int inc_n, int optflags,
 				ESL_MSA **ret_msa);
+extern int p7_tophits_AlignmentThreaded(const P7_TOPHITS *th, const ESL_ALPHABET *abc, 
+					ESL_SQ **inc_sqarr, P7_TRACE **inc_trarr, int inc_n, int optflags,
+					int ncpu, ESL_MSA **ret_msa);
 extern int p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli, int show_header);
 extern int p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli, int show_header);
 extern int p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli);
+extern int p7_tophits_TabularHeaders(FILE *tblfp, FILE *domtblfp, char *qname, char *qacc, P7_PIPELINE *pli);
+extern int p7_tophits_TabularHit(FILE *tblfp, FILE *domtblfp, char *qname, char *qacc, P7_HIT *hit, P7_PIPELINE *pli);
 extern int p7_tophits_TabularTail(FILE *ofp, const char *progname, enum p7_pipemodes_e pipemode, 
 				  const char *qfile, const char *tfile, const ESL_GETOPTS *go);
 extern int p7_tophits_AliScores(FILE *ofp, char *qname, P7_TOPHITS *th );
@@ -1764,6 +2534,7 @@ extern int  p7_trace_Reverse(P7_TRACE *tr);
 extern int  p7_trace_Index(P7_TRACE *tr);
 
 extern int  p7_trace_FauxFromMSA(ESL_MSA *msa, int *matassign, int optflags, P7_TRACE **tr);
+extern int  p7_trace_FauxFromMSARange(ESL_MSA *msa, int *matassign, int optflags, int idx0, int idx1, P7_TRACE **tr);
 extern int  p7_trace_Doctor(P7_TRACE *tr, int *opt_ndi, int *opt_nid);
 
 extern int  p7_trace_Count(P7_HMM *hmm, ESL_DSQ *dsq, float wt, P7_TRACE *tr);
@@ -1787,8 +2558,16 @@ extern int fm_getOriginalPosition (const FM_DATA *fms, const FM_METADATA *meta,
                                     uint32_t *segment_id, uint64_t *seg_pos);
 extern int fm_readFMmeta( FM_METADATA *meta);
 extern int fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll );
+extern int fm_mapFMfile(FM_METADATA *meta);
+extern void fm_unmapFMfile(FM_METADATA *meta);
 extern void fm_FM_destroy ( FM_DATA *fm, int isMainFM);
+extern size_t fm_FM_Sizeof(const FM_DATA *fm, const FM_METADATA *meta, int isMainFM);
+extern int fm_FM_buildKmers(FM_DATA *fmf, FM_DATA *fmb, const FM_CFG *cfg);
 extern uint8_t fm_getChar(uint8_t alph_type, int j, const uint8_t *B );
+extern uint8_t fm_getBWTChar(const FM_DATA *fm, uint8_t alph_type, int j);
+extern int fm_getOccCountRank   (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c);
+extern int fm_getOccCountLTRank (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt);
+extern int fm_getOccCountAllRank(const FM_DATA *fm, const FM_CFG *cfg, int pos, uint32_t *cnt);
 extern int fm_getSARangeReverse( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alph, FM_INTERVAL *interval);
 extern int fm_getSARangeForward( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alph, FM_INTERVAL *interval);
 extern int fm_configAlloc(FM_CFG **cfg);
@@ -1796,23 +2575,39 @@ extern int fm_configDestroy(FM_CFG *cfg);
 extern int fm_metaDestroy(FM_METADATA *meta );
 extern int fm_updateIntervalForward( const FM_DATA *fm, const FM_CFG *cfg, char c, FM_INTERVAL *interval_f, FM_INTERVAL *interval_bk);
 extern int fm_updateIntervalReverse( const FM_DATA *fm, const FM_CFG *cfg, char c, FM_INTERVAL *interval);
+extern int fm_updateIntervalForwardAll( const FM_DATA *fm, const FM_CFG *cfg, const FM_INTERVAL *interval_bk, const FM_INTERVAL *interval_f,
+                                        FM_INTERVAL *next_bk, FM_INTERVAL *next_f);
+extern int fm_updateIntervalReverseAll( const FM_DATA *fm, const FM_CFG *cfg, const FM_INTERVAL *interval, FM_INTERVAL *next);
 extern int fm_initSeeds (FM_DIAGLIST *list) ;
 extern FM_DIAG * fm_newSeed (FM_DIAGLIST *list);
 extern int fm_initAmbiguityList (FM_AMBIGLIST *list);
 extern int fm_addAmbiguityRange (FM_AMBIGLIST *list, uint32_t start, uint32_t stop);
 extern int fm_convertRange2DSQ(const FM_DATA *fm, const FM_METADATA *meta, uint64_t first, int length, int complementarity, ESL_SQ *sq, int fix_ambiguities );
 extern int fm_initConfigGeneric( FM_CFG *cfg, ESL_GETOPTS *go);
+extern int fm_configSeedThreshold(FM_CFG *cfg, const P7_PROFILE *gm, int *opt_reliable);
 
 /* fm_ssv.c */
 extern int p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
                       const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
-                      int strands, ESL_RANDOMNESS *r, P7_HMM_WINDOWLIST *windowlist);
+                      int strands, ESL_RANDOMNESS *r, P7_HMM_WINDOWLIST *windowlist, uint64_t *opt_nocc);
+extern int p7_SSVFM_Targets( P7_OPROFILE *om, P7_BG *bg, double F1,
+                      const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
+                      ESL_RANDOMNESS *r, int *seg_passed, int *opt_npassed, uint64_t *opt_nocc);
 
 
 /* fm_sse.c */
 extern int fm_configInit      (FM_CFG *cfg, ESL_GETOPTS *go);
 extern int fm_getOccCount     (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c);
 extern int fm_getOccCountLT   (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt);
+extern int fm_getOccCountAll  (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint32_t *cnt);
+extern void fm_prefetchOcc    (const FM_DATA *fm, const FM_CFG *cfg, int pos);
+
+/* impl_sse/fm_avx.c */
+#ifdef HMMER_AVX2
+extern int fm_getOccCount_avx   (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c);
+extern int fm_getOccCountLT_avx (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt);
+extern int fm_getOccCountAll_avx(const FM_DATA *fm, const FM_CFG *cfg, int pos, uint32_t *cnt);
+#endif
 
 #endif /*P7_HMMERH_INCLUDED*/
 
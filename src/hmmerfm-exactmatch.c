@@ -155,7 +155,7 @@ getFMHits( FM_DATA *fm, FM_CFG *cfg, FM_INTERVAL *interval, int block_id, int hi
     len = 0;
 
     while ( j != fm->term_loc && (j % cfg->meta->freq_SA)) { //go until we hit a position in the full SA that was sampled during FM index construction
-      uint8_t c = fm_getChar( cfg->meta->alph_type, j, fm->BWT);
+      uint8_t c = fm_getBWTChar( fm, cfg->meta->alph_type, j);
       j = fm_getOccCount (fm, cfg, j-1, c);
       j += abs((int)(fm->C[c]));
       len++;
@@ -277,6 +277,7 @@ main(int argc,  char *argv[])
 
 
   fm_readFMmeta( meta);
+  fm_mapFMfile( meta);
 
   if      (meta->alph_type == fm_DNA)   abc     = esl_alphabet_Create(eslDNA);
   else if (meta->alph_type == fm_AMINO) abc     = esl_alphabet_Create(eslAMINO);
@@ -55,11 +55,13 @@ static ESL_OPTIONS options[] = {
   { "-o",       eslARG_OUTFILE,FALSE,NULL, NULL, NULL, NULL,"-O,--index",   "output HMM to file <f> instead of stdout",          0 },
   { "-O",       eslARG_NONE,  FALSE, NULL, NULL, NULL, NULL,"-o,-f,--index","output HMM to file named <key>",                    0 },
   { "--index",  eslARG_NONE,  FALSE, NULL, NULL, NULL, NULL, NULL,          "index the <hmmfile>, creating <hmmfile>.ssi",       0 },
+  { "--keyorder",eslARG_NONE, FALSE, NULL, NULL, NULL, "-f", NULL,          "with -f and SSI: output HMMs in <keyfile> order",   0 },
   { 0,0,0,0,0,0,0,0,0,0 },
 };
 
 static void create_ssi_index(ESL_GETOPTS *go, P7_HMMFILE *hfp);
 static void multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp);
+static int  sortedfetch(ESL_GETOPTS *go, FILE *ofp, char **keys, int nkeys, P7_HMMFILE *hfp);
 static void onefetch(ESL_GETOPTS *go, FILE *ofp, char *key, P7_HMMFILE *hfp);
 
 int
@@ -218,16 +220,16 @@ create_ssi_index(ESL_GETOPTS *go, P7_HMMFILE *hfp)
 
 /* multifetch:
  * given a file containing lines with one name or key per line;
- * parse the file line-by-line;
- * if we have an SSI index available, retrieve the HMMs by key
- * as we see each line;
- * else, without an SSI index, store the keys in a hash, then
- * read the entire HMM file in a single pass, outputting HMMs
- * that are in our keylist. 
+ * parse the file line-by-line, storing the keys in a hash;
+ * if we have an SSI index available, look all the keys up in it
+ * and retrieve the HMMs in the order of their offsets, so the HMM
+ * file is read once front to back rather than seeked all over;
+ * else, without an SSI index, read the entire HMM file in a single
+ * pass, outputting HMMs that are in our keylist. 
  * 
- * Note that with an SSI index, you get the HMMs in the order they
- * appear in the <keyfile>, but without an SSI index, you get HMMs in
- * the order they occur in the HMM file.
+ * Either way you get HMMs in the order they occur in the HMM file,
+ * unless --keyorder (which needs SSI) asks for them in the order they
+ * appear in the <keyfile>.
  */
 static void
 multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp)
@@ -236,6 +238,7 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp)
   ESL_FILEPARSER *efp    = NULL;
   ESL_ALPHABET   *abc    = NULL;
   P7_HMM         *hmm    = NULL;
+  char          **klist  = NULL;
   int             nhmm   = 0;
   char           *key;
   int             keylen;
@@ -252,11 +255,21 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp)
       
       status = esl_keyhash_Store(keys, key, -1, &keyidx);
       if (status == eslEDUP) p7_Fail("HMM key %s occurs more than once in file %s\n", key, keyfile);
-	
-      if (hfp->ssi != NULL) { onefetch(go, ofp, key, hfp);  nhmm++; }
     }
 
-  if (hfp->ssi == NULL) 
+  if (esl_opt_GetBoolean(go, "--keyorder") && hfp->ssi == NULL)
+    p7_Fail("--keyorder needs an SSI index for %s; use hmmfetch --index first\n", hfp->fname);
+
+  if (hfp->ssi != NULL)
+    {
+      klist = (char **) malloc(sizeof(char *) * ESL_MAX(1, esl_keyhash_GetNumber(keys)));
+      if (klist == NULL) p7_Fail("allocation failed");
+      for (keyidx = 0; keyidx < esl_keyhash_GetNumber(keys); keyidx++)
+	klist[keyidx] = esl_keyhash_Get(keys, keyidx);
+      nhmm = sortedfetch(go, ofp, klist, esl_keyhash_GetNumber(keys), hfp);
+      free(klist);
+    }
+  else
     {
       while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) != eslEOF)
 	{
@@ -284,6 +297,78 @@ multifetch(ESL_GETOPTS *go, FILE *ofp, char *keyfile, P7_HMMFILE *hfp)
 }
 
 
+/* sortedfetch():
+ * Retrieve the HMMs for <keys[0..nkeys-1]> from <hfp>, which has an
+ * SSI index, reading them in file offset order; return how many were
+ * written. By default they're written as they're read. With
+ * --keyorder, keys are taken in windows of SORTEDFETCH_WINDOW, each
+ * window's HMMs read in offset order, held, and written in key order:
+ * the file is still read forward within a window, at the cost of
+ * holding a window's worth of HMMs in memory.
+ */
+#define SORTEDFETCH_WINDOW 1000
+
+static int
+sortedfetch(ESL_GETOPTS *go, FILE *ofp, char **keys, int nkeys, P7_HMMFILE *hfp)
+{
+  int            do_keyorder = esl_opt_GetBoolean(go, "--keyorder");
+  int            wsize       = (do_keyorder ? ESL_MIN(nkeys, SORTEDFETCH_WINDOW) : nkeys);
+  ESL_ALPHABET  *abc         = NULL;
+  P7_HMM        *hmm         = NULL;
+  P7_HMM       **hmms        = NULL;
+  off_t         *offset      = NULL;
+  int           *order       = NULL;
+  int            nhmm        = 0;
+  int            w, i, k, n;
+  int            status;
+
+  if (nkeys == 0) return 0;
+  if ((offset = malloc(sizeof(off_t) * wsize)) == NULL) p7_Fail("allocation failed");
+  if ((order  = malloc(sizeof(int)   * wsize)) == NULL) p7_Fail("allocation failed");
+  if (do_keyorder && (hmms = malloc(sizeof(P7_HMM *) * wsize)) == NULL) p7_Fail("allocation failed");
+
+  for (w = 0; w < nkeys; w += wsize)
+    {
+      n      = ESL_MIN(wsize, nkeys - w);
+      status = p7_hmmfile_SortKeys(hfp, keys + w, n, offset, order);
+      if      (status == eslENOTFOUND || status == eslEFORMAT) p7_Fail("%s\n", hfp->errbuf);
+      else if (status != eslOK) p7_Fail("Failed to look up HMMs in SSI index of file %s\n", hfp->fname);
+
+      for (i = 0; i < n; i++)
+	{
+	  k      = order[i];
+	  status = p7_hmmfile_ReadAt(hfp, offset[k], &abc, &hmm);
+	  if      (status == eslEOF)       p7_Fail("HMM %s not found in file %s\n", keys[w+k], hfp->fname);
+	  else if (status == eslEOD)       p7_Fail("read failed, HMM file %s may be truncated?", hfp->fname);
+	  else if (status == eslEFORMAT)   p7_Fail("bad file format in HMM file %s",             hfp->fname);
+	  else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",   hfp->fname);
+	  else if (status != eslOK)        p7_Fail("Unexpected error in reading HMMs from %s",   hfp->fname);
+
+	  if (strcmp(keys[w+k], hmm->name) != 0 && (hmm->acc == NULL || strcmp(keys[w+k], hmm->acc) != 0))
+	    p7_Fail("SSI index for %s is out of date: HMM %s isn't where it says; rerun hmmfetch --index\n", hfp->fname, keys[w+k]);
+
+	  if (do_keyorder) hmms[k] = hmm;
+	  else { p7_hmmfile_WriteASCII(ofp, -1, hmm); p7_hmm_Destroy(hmm); nhmm++; }
+	  hmm = NULL;
+	}
+
+      if (do_keyorder)
+	for (k = 0; k < n; k++)
+	  {
+	    p7_hmmfile_WriteASCII(ofp, -1, hmms[k]);
+	    p7_hmm_Destroy(hmms[k]);
+	    nhmm++;
+	  }
+    }
+
+  free(hmms);
+  free(order);
+  free(offset);
+  esl_alphabet_Destroy(abc);
+  return nhmm;
+}
+
+
 /* onefetch():
  * Given one <key> (an HMM name or accession), retrieve the corresponding HMM.
  * In SSI mode, we can do this quickly by positioning the file, then reading
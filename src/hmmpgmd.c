@@ -24,16 +24,36 @@
 static ESL_OPTIONS cmdlineOpts[] = {
   /* name           type         default      env   range           toggles  reqs   incomp           help                                                     docgroup */
   { "-h",           eslARG_NONE,   FALSE,     NULL, NULL,           NULL,  NULL,  NULL,            "show brief help on version and usage",                         1 },
-  { "--master",     eslARG_NONE,    NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "run program as the master server",                            12 },
-  { "--worker",     eslARG_STRING,  NULL,     NULL, NULL,           NULL,  NULL,  "--master",      "run program as a worker with server at <s>",                  12 },
+  { "--master",     eslARG_NONE,    NULL,     NULL, NULL,           NULL,  NULL,  "--worker,--aggregator", "run program as the master server",                     12 },
+  { "--worker",     eslARG_STRING,  NULL,     NULL, NULL,           NULL,  NULL,  "--master,--aggregator", "run program as a worker with server at <s>",           12 },
+  { "--aggregator", eslARG_STRING,  NULL,     NULL, NULL,           NULL,  NULL,  "--master,--worker",     "relay for workers of their own to the server at <s>",  12 },
   { "--cport",      eslARG_INT,     "51371",  NULL, "49151<n<65536",NULL,  NULL,  "--worker",      "port to use for client/server communication",                 12 },
   { "--wport",      eslARG_INT,     "51372",  NULL, "49151<n<65536",NULL,  NULL,  NULL,            "port to use for server/worker communication",                 12 },
   { "--ccncts",     eslARG_INT,     "16",     NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of client side connections to accept",         12 },
   { "--wcncts",     eslARG_INT,     "32",     NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of worker side connections to accept",         12 },
+  { "--searches",   eslARG_INT,     "4",      NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of searches the master runs at once",          12 },
+  { "--maxwait",    eslARG_INT,     "300",    NULL, "n>=0",         NULL,  NULL,  "--worker",      "serve requests queued <n> seconds first (0: never)",          12 },
+  { "--cquota",     eslARG_INT,     "0",      NULL, "n>=0",         NULL,  NULL,  "--worker",      "refuse requests past <n> queued per client (0: no limit)",    12 },
+  { "--coalesce",   eslARG_INT,     "8",      NULL, "n>0",          NULL,  NULL,  "--worker",      "search up to <n> queued seqdb searches in one pass (1: don't)", 12 },
+  { "--rcache",     eslARG_INT,     "256",    NULL, "n>=0",         NULL,  NULL,  "--worker",      "keep up to <n> MB of recent results for repeated queries",    12 },
+  { "--mport",      eslARG_INT,     FALSE,    NULL, "49151<n<65536",NULL,  NULL,  "--worker",      "serve Prometheus metrics over HTTP on port <n>",              12 },
   { "--pid",        eslARG_OUTFILE, NULL,     NULL, NULL,           NULL,  NULL,  NULL,            "file to write process id to",                                 12 },
+  { "--trace",      eslARG_OUTFILE, NULL,     NULL, NULL,           NULL,  NULL,  NULL,            "append a JSON trace span for each stage of a search to <f>",  12 },
   { "--seqdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "protein database to cache for searches",                      12 },
   { "--hmmdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "hmm database to cache for searches",                          12 },
+  { "--seqsnap",    eslARG_NONE,   FALSE,     NULL, NULL,           NULL,"--seqdb","--worker",      "save a binary snapshot of --seqdb cache, for fast restarts",  12 },
+  { "--imgport",    eslARG_INT,    FALSE,     NULL, "49151<n<65536",NULL,  NULL,  "--aggregator",  "serve and fetch the databases' cache image over port <n>",   12 },
+  { "--imgfanout",  eslARG_INT,     "4",      NULL, "n>0",          NULL,"--imgport","--worker",   "master: workers fetching the image from each node",          12 },
+  { "--imgdir",     eslARG_STRING, "/tmp",    NULL, NULL,           NULL,"--imgport","--master",   "worker: keep fetched images in directory <s>",               12 },
+  { "--lsort",      eslARG_INT,     "0",      NULL, "n>=0",         NULL,"--seqdb","--worker",      "sort --seqdb targets by length in runs of <n>; 0 = don't",    12 },
   { "--cpu",        eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>0",        NULL,  NULL,  "--master",      "number of parallel CPU workers to use for multithreads",      12 },
+  { "--mxpool",     eslARG_INT,     "256",    NULL, "n>=0",         NULL,  NULL,  "--master",      "keep up to <n> MB of DP matrices for reuse across searches",  12 },
+  { "--mxtrim",     eslARG_INT,     "64",     NULL, "n>=0",         NULL,  NULL,  "--master",      "don't keep DP matrices bigger than <n> MB for reuse",         12 },
+  { "--nonuma",     eslARG_NONE,   FALSE,     NULL, NULL,           NULL,  NULL,  "--master",      "don't place search threads and cached residues by NUMA node", 12 },
+  { "--hugepages",  eslARG_STRING, NULL,      NULL, NULL,           NULL,  NULL,  "--master",      "put cached residues and big buffers in hugepages: off|thp|2M|1G", 12 },
+  { "--nogpu",      eslARG_NONE,   FALSE,     NULL, NULL,           NULL,  NULL,  "--master",      "keep batch SSV filtering on the CPU, even with a GPU",        12 },
+  { "--packed",     eslARG_NONE,   FALSE,     NULL, NULL,           NULL,  NULL,  "--master",      "hold cached residues in 5 bits, unpacking them as searched",  12 },
+  { "--hmmrest",    eslARG_INT,    FALSE,     NULL, "n>=0",         NULL,  NULL,  "--master",      "cache profiles' MSV parts; keep <n> complete between searches", 12 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 
   };
@@ -136,6 +156,12 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go)
   if (esl_opt_IsUsed(go, "--master") && !(esl_opt_IsUsed(go, "--seqdb") || esl_opt_IsUsed(go, "--hmmdb"))) 
     { if (puts("At least one --seqdb or --hmmdb must be specified.") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
 
+  if (esl_opt_IsOn(go, "--hugepages") && p7_hugemem_SetMode(esl_opt_GetString(go, "--hugepages")) != eslOK)
+    { if (printf("--hugepages takes off, thp, 2M or 1G, not %s\n", esl_opt_GetString(go, "--hugepages")) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+#if defined (eslENABLE_SSE)
+  if (esl_opt_GetBoolean(go, "--nogpu")) p7_impl_DisableGPU();
+#endif
+
   *ret_go = go;
   return eslOK;
   
@@ -165,10 +191,14 @@ main(int argc, char **argv)
   /* check if we need to write out our pid */
   if (esl_opt_IsOn(go, "--pid")) write_pid(go);
 
+  if (esl_opt_IsOn(go, "--trace") && hmmpgmd_TraceOpen(esl_opt_GetString(go, "--trace")) != eslOK)
+    p7_Fail("Failed to open trace file %s for appending\n", esl_opt_GetString(go, "--trace"));
+
   if      (esl_opt_IsUsed(go, "--master"))  master_process(go);
   else if (esl_opt_IsUsed(go, "--worker"))  worker_process(go);
+  else if (esl_opt_IsUsed(go, "--aggregator"))  aggregator_process(go);
   else
-    { puts("Options --master or --worker must be specified.");  }
+    { puts("Options --master, --worker or --aggregator must be specified.");  }
 
   esl_getopts_Destroy(go);
 
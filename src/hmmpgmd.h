@@ -44,6 +44,10 @@ typedef struct {
 #define HMMD_CMD_SCAN       10002
 #define HMMD_CMD_INIT       10003
 #define HMMD_CMD_SHUTDOWN   10004
+#define HMMD_CMD_RELOAD     10005
+#define HMMD_CMD_RELEASE    10006
+#define HMMD_CMD_CANCEL     10007
+#define HMMD_CMD_FETCH      10008
 
 #define MAX_INIT_DESC 32
 
@@ -53,12 +57,72 @@ typedef struct {
   uint32_t    db_type;              /* database type to search                  */
   uint32_t    inx;                  /* index to begin search                    */
   uint32_t    cnt;                  /* number of sequences to search            */
+  uint32_t    query_id;             /* master's id for the search, echoed in the reply */
+  uint32_t    shard;                /* hmmpgmd_shard: shard that inx/cnt index into */
+  uint32_t    db_version;           /* version of the databases the search was split over */
   uint32_t    query_type;           /* sequence / hmm                           */
   uint32_t    query_length;         /* length of the query data                 */
   uint32_t    opts_length;          /* length of the options string             */
+  uint32_t    nqueries;             /* batch: number of queries, 0 if one      */
+  uint64_t    trace_id;             /* master's trace of the query, 0 if not traced (--trace) */
+  uint64_t    span_id;              /* master's span for this share, parent of the worker's */
   char        data[];              /* search data                              */
 } HMMD_SEARCH_CMD;
 
+/* An HMMD_CMD_SCAN may carry a batch of <nqueries> query sequences,
+ * all searched with the same options, so the worker goes through the
+ * profile cache once for all of them. Likewise an HMMD_CMD_SEARCH may
+ * carry a group of queries, all sequences or all HMMs, that the
+ * master coalesced from the queue (--coalesce): the worker goes
+ * through its share of the sequence cache once, each chunk of it
+ * searched with every query's profile in turn. <data> then holds the
+ * options string followed, for each query, by an HMMD_BATCH_QUERY and
+ * the query's data as in a single search: name, description and
+ * digital sequence, or the serialized HMM. <query_length> is unused;
+ * <query_id> is the first query's, which a cancel names. The worker
+ * answers each query with a reply of its own, under the query's id.
+ */
+typedef struct {
+  uint32_t    query_id;             /* master's id for this query's search     */
+  uint32_t    query_length;         /* length of the digital sequence, n+2; or the HMM's M */
+  uint32_t    data_length;          /* bytes of the query's data that follow   */
+} HMMD_BATCH_QUERY;
+
+/* queries sent to a worker in one batch at most; the worker's threads
+ * each keep a pipeline and hit list per query of the batch
+ */
+#define HMMD_BATCH_MAX 16
+
+/* A worker's answer to HMMD_CMD_SEARCH or HMMD_CMD_SCAN starts with
+ * this, followed by the serialized HMMD_SEARCH_STATUS and results. A
+ * worker may run several searches at once and answers each as it
+ * finishes, so <query_id> says which one this is. HMMD_CMD_SHUTDOWN is
+ * acknowledged with one too, with <query_id> 0. The times are on the
+ * worker's clock, in seconds since the epoch, for the master's trace
+ * of the search (--trace); they are 0 in other replies, as are the
+ * memory peaks, which the master's metrics port reports.
+ */
+typedef struct {
+  uint32_t    command;              /* command answered                         */
+  uint32_t    query_id;             /* <query_id> of the HMMD_SEARCH_CMD        */
+  double      t_recv;               /* worker read the command                  */
+  double      t_start;              /* worker started searching                 */
+  double      t_done;               /* worker finished searching                */
+  uint64_t    mem_peak;             /* search's pipeline memory peak, summed over threads (bytes) */
+  uint64_t    mem_rss;              /* worker process's peak RSS so far (bytes), or 0 */
+} HMMD_REPLY;
+
+/* In a worker's answer, the HMMD_SEARCH_STATUS <msg_size> covers only
+ * the serialized HMMD_SEARCH_STATS. The hits follow in chunks, so that
+ * neither side has to hold all of them serialized at once. Each chunk
+ * is a uint32_t length in network byte order, followed by that many
+ * bytes of whole serialized P7_HITs. The stats' <nhits> says when the
+ * last chunk has been read. A chunk is sent once it holds
+ * HMMD_HIT_CHUNK bytes, so it is at most that plus one hit. The master
+ * streams its answer to the client in pieces of the same size.
+ */
+#define HMMD_HIT_CHUNK (1024 * 1024)
+
 /* HMMD_CMD_INIT */
 typedef struct {
   char        sid[MAX_INIT_DESC];   /* unique id for sequence database          */
@@ -69,9 +133,72 @@ typedef struct {
   uint32_t    seq_cnt;              /* sequences in database                    */
   uint32_t    hmm_cnt;              /* total number hmm databases               */
   uint32_t    model_cnt;            /* models in hmm database                   */
+  uint32_t    db_version;           /* master's version of these databases      */
+  uint32_t    lsort;                /* seq database sorted by length in runs of this many, 0 if not */
+  uint32_t    img_port;             /* image port to fetch the databases from, 0: read them (--imgport) */
+  char        img_ip[64];           /* ... on this peer; "" for the master      */
   char        data[];              /* string data                              */
 } HMMD_INIT_CMD;
 
+/* HMMD_CMD_RELOAD carries an HMMD_INIT_CMD for a new <db_version> of
+ * the databases. The worker loads them in the background, searching
+ * the ones it holds meanwhile, and answers with an HMMD_REPLY whose
+ * <query_id> is the newest version it now holds: the new one, or the
+ * old one if the load failed. Searches name the version they were
+ * split over, so a worker keeps both until HMMD_CMD_RELEASE, again an
+ * HMMD_INIT_CMD with only <db_version> set, says that no search will
+ * name an older version; those are freed once their searches end.
+ */
+
+/* HMMD_CMD_CANCEL carries an HMMD_SEARCH_CMD with only <query_id> set:
+ * the master has given up on that search, because its client hung up
+ * or its deadline (search option --deadline) passed. The worker's
+ * threads stop claiming targets, and the search is answered as usual,
+ * but with an error status instead of results. A cancel for a search
+ * that has already answered is ignored.
+ */
+
+/* Starting workers can fetch the databases' prepared cache image from
+ * the master or a peer (--imgport) instead of all reading them from
+ * shared storage. The master hands each worker that joins a place in
+ * a tree of --imgfanout children a node, and names the worker's parent
+ * in the HMMD_CMD_INIT; the first ones fetch from the master itself.
+ * An image is a set of files: the sequence cache snapshot, and the
+ * profile database with its pressed files. A worker serves the files
+ * it loaded on its own image port as soon as it has them, so the
+ * tree fills a level at a time.
+ *
+ * A fetch is one connection per file: an HMMD_HEADER for an
+ * HMMD_CMD_FETCH, then an HMMD_FETCH_CMD naming the file and the
+ * databases' id and sizes from the HMMD_CMD_INIT. The server waits
+ * until its own databases are loaded, then answers with an
+ * HMMD_FETCH_REPLY: <eslOK> and the file's size, followed by its
+ * bytes; or <eslEINCOMPAT> if it holds other databases, or
+ * <eslENOTFOUND> if it doesn't have the file. A worker that can't
+ * fetch from its parent tries the master, then shared storage.
+ */
+#define HMMD_IMG_SEQSNAP    0       /* <seqdb>.h3s, the sequence cache snapshot */
+#define HMMD_IMG_HMM        1       /* <hmmdb>, the profile database            */
+#define HMMD_IMG_H3M        2       /* ... and its pressed files                */
+#define HMMD_IMG_H3I        3
+#define HMMD_IMG_H3F        4
+#define HMMD_IMG_H3P        5
+#define HMMD_IMG_NFILES     6
+
+#define HMMD_IMG_WAIT       3600    /* seconds a fetch waits for the server's own load */
+
+typedef struct {
+  char        sid[MAX_INIT_DESC];   /* id of the sequence database              */
+  uint32_t    seq_cnt;              /* sequences in it                          */
+  uint32_t    model_cnt;            /* models in the hmm database               */
+  uint32_t    file;                 /* HMMD_IMG_*                               */
+} HMMD_FETCH_CMD;
+
+typedef struct {
+  uint32_t    status;               /* eslOK, or why there's no file            */
+  uint64_t    size;                 /* bytes of the file that follow            */
+} HMMD_FETCH_REPLY;
+
 /* HMMD_CMD_RESET */
 typedef struct {
   char        pad;
@@ -114,10 +241,21 @@ typedef struct queue_data_s {
   int            sock;        /* socket descriptor of client    */
   char           ip_addr[64];
 
+  uint32_t       query_id;    /* master's id for the search     */
+  uint64_t       trace_id;    /* trace of the search, 0 if none */
+  uint64_t       span_id;     /* worker: master's span of its share */
+  double         t_queued;    /* master: when the request was queued */
+  double         t_recv;      /* worker: when the command was read   */
+  double         t_start;     /* worker: when the search started     */
+  double         t_done;      /* worker: when the search finished    */
+
   int            dbx;         /* database index to search       */
   int            inx;         /* sequence index to start search */
   int            cnt;         /* number of sequences to search  */
 
+  struct queue_data_s **batch; /* scan of several sequences, or coalesced searches: one query each, or NULL */
+  int            nbatch;      /* number of queries in <batch>   */
+
 } QUEUE_DATA;
 
 
@@ -127,6 +265,58 @@ typedef struct {
   uint32_t *ends;    /* 0..N-1  start positions */
 } RANGE_LIST;
 
+/* Work distribution over a worker's target list. The search/scan
+ * threads each claim their next chunk of [0..total-1] from <next>
+ * with a compare-and-swap; chunks are guided, shrinking with the work
+ * that remains, so the end of a search balances without tiny blocks
+ * serializing on a lock.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define HMMD_ATOMIC_WORK
+#endif
+
+typedef struct {
+  int   next;      /* next unclaimed index              */
+  int   total;     /* number of targets                 */
+  int   nthreads;  /* number of threads sharing work    */
+  int   min_blk;   /* smallest chunk handed out         */
+  int   max_blk;   /* largest chunk handed out          */
+} HMMD_WORK;
+
+#define HMMD_WORK_MAXBLK 5000
+
+extern void hmmpgmd_InitWork(HMMD_WORK *work, int total, int nthreads, int min_blk, int max_blk);
+extern int  hmmpgmd_NextWork(HMMD_WORK *work, int *ret_inx);
+
+/* Tracing (--trace): each stage of a search is a span, written as a
+ * line of OpenTelemetry-style JSON. A span's id is made from the
+ * search's query id, the stage and a number <n> telling apart the
+ * spans of one stage: the try, or the try and the worker's share.
+ */
+#define HMMD_SPAN_QUERY     1     /* the whole request, from queueing to the answer */
+#define HMMD_SPAN_QUEUE     2     /* waiting in the master's queue                  */
+#define HMMD_SPAN_CACHE     3     /* answered from the result cache                 */
+#define HMMD_SPAN_DISPATCH  4     /* sending the shares to the workers              */
+#define HMMD_SPAN_PART      5     /* one worker's share, as the master sees it      */
+#define HMMD_SPAN_SEARCH    6     /* the share's search, on the worker              */
+#define HMMD_SPAN_SEND      7     /* sending the share's results, on the worker     */
+#define HMMD_SPAN_GATHER    8     /* merging the workers' results                   */
+#define HMMD_SPAN_FORWARD   9     /* sending the results to the client              */
+
+#define HMMD_SPAN(query_id, stage, n) ((((uint64_t) (query_id)) << 24) | (((uint64_t) (stage)) << 16) | ((uint64_t) (n) & 0xffff))
+
+extern int    hmmpgmd_TraceOpen(const char *path);
+extern int    hmmpgmd_Tracing(void);
+extern double hmmpgmd_Now(void);
+extern void   hmmpgmd_TraceSpan(uint64_t trace_id, uint64_t span_id, uint64_t parent_id, const char *name,
+                                double t0, double t1, uint32_t query_id, const char *worker);
+
+/* hmmdimage.c */
+extern int  hmmpgmd_ImagePath (const char *dbfile, int file, const char *dir, char **ret_path);
+extern void hmmpgmd_ImageSet  (const char *sid, uint32_t seq_cnt, uint32_t model_cnt, char **path);
+extern void hmmpgmd_ImageServe(int port);
+extern int  hmmpgmd_ImageFetch(const char *ip, int port, const HMMD_INIT_CMD *init, int file, const char *path, char *errbuf);
+
 extern void free_QueueData(QUEUE_DATA *data);
 extern int  hmmpgmd_IsWithinRanges (int64_t sq_idx, RANGE_LIST *list );
 extern int  hmmpgmd_GetRanges (RANGE_LIST *list, char *rangestr);
@@ -135,6 +325,7 @@ extern int  process_searchopts(int fd, char *cmdstr, ESL_GETOPTS **ret_opts);
 
 extern void worker_process(ESL_GETOPTS *go);
 extern void master_process(ESL_GETOPTS *go);
+extern void aggregator_process(ESL_GETOPTS *go);
 
 extern int p7_hmmd_search_stats_Serialize(const HMMD_SEARCH_STATS *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc);
 extern int p7_hmmd_search_stats_Deserialize(const uint8_t *buf, uint32_t *pos, HMMD_SEARCH_STATS *ret_obj);
@@ -15,6 +15,9 @@
 
 #include "esl_sqio.h"
 
+static int cmp_name(const void *a, const void *b);
+static int has_name(const int *names, int n, long name);
+
 
 /******************************************************************************
  *# 1. The <hmmpgmd2msa> function
@@ -73,16 +76,34 @@
  */
 int
 hmmpgmd2msa(void *data, P7_HMM *hmm, ESL_SQ *qsq, int *incl, int incl_size, int *excl, int excl_size, int excl_all, ESL_MSA **ret_msa)
+{
+  return hmmpgmd2msa_threaded(data, hmm, qsq, incl, incl_size, excl, excl_size, excl_all, 0, ret_msa);
+}
+
+/* Function:  hmmpgmd2msa_threaded()
+ * Synopsis:  <hmmpgmd2msa()>, backconverting the hits on threads.
+ *
+ * Purpose:   As <hmmpgmd2msa()>, with the included domains' alignment
+ *            displays converted back to sequences and traces by
+ *            <ncpu> threads; see <p7_tophits_AlignmentThreaded()>.
+ *            The MSA is the same for any <ncpu>; 0 or 1 does it all
+ *            in the calling thread.
+ *
+ * Returns:   <eslOK> on success, and <*ret_msa> is the new MSA.
+ */
+int
+hmmpgmd2msa_threaded(void *data, P7_HMM *hmm, ESL_SQ *qsq, int *incl, int incl_size, int *excl, int excl_size, int excl_all, int ncpu, ESL_MSA **ret_msa)
 {
   HMMD_SEARCH_STATS *stats       = NULL;         // pointer to a single stats object, at the beginning of data 
   P7_TRACE          *qtr         = NULL;         // trace of the query sequence with N residues onto model with N match states 
   P7_TOPHITS         *th         = NULL;
   ESL_MSA           *msa         = NULL;
   char              *p           = (char*)data;  // pointer used to walk along data, must be char* to allow pointer arithmetic 
+  int               *sincl       = NULL;         // sorted copies of incl, excl, for looking names up by bisection
+  int               *sexcl       = NULL;
   int                extra_sqcnt = 0;
   uint32_t n = 0;
   int      i;
-  int      c;
   int      status;
 
   
@@ -169,32 +190,35 @@ hmmpgmd2msa(void *data, P7_HMM *hmm, ESL_SQ *qsq, int *incl, int incl_size, int
     }
   }
 
+  /* the web's lists can be as long as the hit list, so don't scan them once per hit */
+  if (excl_size > 0) {
+    ESL_ALLOC(sexcl, sizeof(int) * excl_size);
+    memcpy(sexcl, excl, sizeof(int) * excl_size);
+    qsort(sexcl, excl_size, sizeof(int), cmp_name);
+  }
+  if (incl_size > 0) {
+    ESL_ALLOC(sincl, sizeof(int) * incl_size);
+    memcpy(sincl, incl, sizeof(int) * incl_size);
+    qsort(sincl, incl_size, sizeof(int), cmp_name);
+  }
+
   for (i = 0; i < th->N; i++) {
     /* Go through the hits and set to be excluded or included as necessary */
     if(th->hit[i]->flags & p7_IS_INCLUDED){
-      if(excl_size > 0){
-        for( c = 0; c < excl_size; c++){
-          if(excl[c] == (long)(th->hit[i]->name) ){
-            th->hit[i]->flags = p7_IS_DROPPED;
-            th->hit[i]->nincluded = 0;
-            break;
-          }
-        }
+      if(excl_size > 0 && has_name(sexcl, excl_size, (long)(th->hit[i]->name))){
+        th->hit[i]->flags = p7_IS_DROPPED;
+        th->hit[i]->nincluded = 0;
       }
     }else{
-      if(incl_size > 0){
-    	for( c = 0; c < incl_size; c++){
-          if(incl[c] == (long)th->hit[i]->name ){
-            th->hit[i]->flags = p7_IS_INCLUDED;
-          }
-        }
+      if(incl_size > 0 && has_name(sincl, incl_size, (long)(th->hit[i]->name))){
+        th->hit[i]->flags = p7_IS_INCLUDED;
       }
     }
   }
 
 
   /* use the tophits and trace info above to produce an alignment */
-  if ( (status = p7_tophits_Alignment(th, hmm->abc, &qsq, &qtr, extra_sqcnt, p7_ALL_CONSENSUS_COLS, &msa)) != eslOK) goto ERROR;
+  if ( (status = p7_tophits_AlignmentThreaded(th, hmm->abc, &qsq, &qtr, extra_sqcnt, p7_ALL_CONSENSUS_COLS, ncpu, &msa)) != eslOK) goto ERROR;
   esl_msa_SetName     (msa, hmm->name, -1);
   esl_msa_SetAccession(msa, hmm->acc,  -1);
   esl_msa_SetDesc     (msa, hmm->desc, -1);
@@ -203,6 +227,8 @@ hmmpgmd2msa(void *data, P7_HMM *hmm, ESL_SQ *qsq, int *incl, int incl_size, int
   if (qtr != NULL) free(qtr);
   p7_tophits_Destroy(th);
 
+  free(sincl);
+  free(sexcl);
   free(stats);
   *ret_msa = msa;
   return eslOK;
@@ -210,10 +236,40 @@ hmmpgmd2msa(void *data, P7_HMM *hmm, ESL_SQ *qsq, int *incl, int incl_size, int
 ERROR:
   if (qtr != NULL) free(qtr);
   p7_tophits_Destroy(th);
+  if(sincl != NULL) free(sincl);
+  if(sexcl != NULL) free(sexcl);
   if(stats != NULL) free(stats);
   return status;
 }
 
+/* qsort() comparison for the incl, excl name lists. */
+static int
+cmp_name(const void *a, const void *b)
+{
+  int x = *(const int *) a;
+  int y = *(const int *) b;
+  return (x > y) - (x < y);
+}
+
+/* has_name()
+ * TRUE if <name> is in the sorted list <names> of size <n>.
+ */
+static int
+has_name(const int *names, int n, long name)
+{
+  int lo = 0;
+  int hi = n;
+  int mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if      ((long) names[mid] < name) lo = mid + 1;
+    else if ((long) names[mid] > name) hi = mid;
+    else    return TRUE;
+  }
+  return FALSE;
+}
+
 /******************************************************************************
  *# 2. The <hmmpgmd2stats> function
  *****************************************************************************/
@@ -346,6 +402,10 @@ int hmmpgmd2stats_old(void *data, P7_HMM *hmm, float** statsOut)
       ad2 = th.hit[i]->dcl[j].ad;
 
       ad2->memsize = ad->memsize;
+      ad2->in_arena = FALSE;
+      ad2->zdata    = NULL;
+      ad2->zsize    = 0;
+      ad2->zflags   = 0;
       ad2->rfline = ad->rfline;
       ad2->mmline = ad->mmline;
       
@@ -511,6 +571,7 @@ void hmmpgmd2msa_utest(int ntrials, char *hmmfile){
   P7_HMMFILE   *hfp     = NULL;
   P7_BG *bg  = p7_bg_Create(abc);
   ESL_MSA *msa, *deser_msa;
+  ESL_MSA *thr_msa = NULL;
   ESL_SQ * sequences[NUM_TEST_SEQUENCES];
   uint8_t **buf, *buf_data;
   HMMD_SEARCH_STATS stats;
@@ -612,6 +673,16 @@ void hmmpgmd2msa_utest(int ntrials, char *hmmfile){
       p7_Fail(msg);
     }
 
+    // backconverting on threads has to give the same MSA
+    if(hmmpgmd2msa_threaded(buf_data, hmm, NULL, NULL, 0, NULL, 0, 0, 4, &thr_msa) != eslOK){
+      p7_Fail(msg);
+    }
+    if(esl_msa_Compare (msa, thr_msa) != eslOK){
+      p7_Fail(msg);
+    }
+    esl_msa_Destroy(thr_msa);
+    thr_msa = NULL;
+
     // clean up after ourselves 
     p7_tophits_Destroy(hitlist);
     for(k = 0; k < NUM_TEST_SEQUENCES; k++){
@@ -0,0 +1,674 @@
+/* hmmpgmd_load: load generator and throughput benchmark for the hmmpgmd daemon.
+ *
+ * Replays a recorded mix of requests, or a synthetic one, against a
+ * running master at a chosen concurrency and, optionally, a chosen
+ * arrival rate, and reports throughput, latency percentiles per query
+ * type, the error rate, and (from the master's metrics port)
+ * per-worker utilization.
+ *
+ * Requests go out through HMMD_CLIENT connections (hmmd_client.c),
+ * all driven from one poll() loop. In a closed loop (the default)
+ * each of the -c connections keeps --depth requests outstanding; with
+ * --rate, requests arrive at random (a Poisson process) whether or
+ * not the daemon keeps up, and a request waiting for a free
+ * connection is timed from its arrival, so a backlog shows in the
+ * latencies.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#include <arpa/inet.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+#include "hmmd_client.h"
+
+#define LOAD_NTYPES  4		/* query types; see load_type()                      */
+#define LOAD_TICK_MS 100	/* longest poll() wait, so --time is checked often enough */
+
+static const char *load_typename[LOAD_NTYPES] = { "phmmer", "hmmsearch", "hmmscan", "other" };
+
+/* One request of the mix */
+typedef struct {
+  char   *opts;			/* options, as after hmmc2's '@'; or NULL  */
+  char   *query;		/* one sequence (FASTA) or one HMM          */
+} LOAD_REQUEST;
+
+/* One weighted option string of a synthetic mix (--mix) */
+typedef struct {
+  double  w;
+  char   *opts;
+} LOAD_MIXOPT;
+
+/* One request sent, by its id */
+typedef struct {
+  int     r;			/* request of the mix                          */
+  int     m;			/* option string of the --mix, or -1           */
+  int     type;			/* index into load_typename[]                  */
+  double  t_arrive;		/* when it arrived (was due to be sent)        */
+  double  t_sent;		/* when it was handed to a connection          */
+  double  t_done;		/* when its answer was in                      */
+  int     status;		/* eslOK, the daemon's error code, or eslESYS if its connection failed */
+  double  elapsed;		/* search time from the answer's stats payload */
+} LOAD_SENT;
+
+/* One connection to the master */
+typedef struct {
+  HMMD_CLIENT *cl;
+  int          nout;		/* requests outstanding on it */
+  int          dead;		/* TRUE once it has failed    */
+} LOAD_CONN;
+
+/* One worker, as the metrics port reports it */
+typedef struct {
+  char    *name;		/* "ip:fd" */
+  uint64_t parts;
+  double   busy;
+} LOAD_WORKER;
+
+static ESL_OPTIONS options[] = {
+  /* name           type         default   env  range   toggles  reqs   incomp    help                                                     docgroup*/
+  { "-h",        eslARG_NONE,      FALSE,  NULL, NULL,    NULL,  NULL,  NULL,     "show brief help on version and usage",                          1 },
+  { "-i",        eslARG_STRING,"127.0.0.1",NULL, NULL,    NULL,  NULL,  NULL,     "IP address of the hmmpgmd master",                              1 },
+  { "-p",        eslARG_INT,     "51371",  NULL, "n>0",   NULL,  NULL,  NULL,     "port the master listens on for clients (its --cport)",          1 },
+  { "--mport",   eslARG_INT,        NULL,  NULL, "n>0",   NULL,  NULL,  NULL,     "master's metrics port (its --mport), for worker utilization",   1 },
+  { "-c",        eslARG_INT,         "4",  NULL, "n>0",   NULL,  NULL,  NULL,     "number of connections to open",                                 2 },
+  { "--depth",   eslARG_INT,         "1",  NULL, "n>0",   NULL,  NULL,  NULL,     "most requests outstanding on one connection",                   2 },
+  { "--rate",    eslARG_REAL,       NULL,  NULL, "x>0",   NULL,  NULL,  NULL,     "open loop: requests arrive at random, <x> per second",          2 },
+  { "-n",        eslARG_INT,        NULL,  NULL, "n>0",   NULL,  NULL,  NULL,     "send <n> requests [default: each request of the mix once]",     2 },
+  { "--time",    eslARG_REAL,       NULL,  NULL, "x>0",   NULL,  NULL,  NULL,     "stop sending new requests after <x> seconds",                   2 },
+  { "--shuffle", eslARG_NONE,      FALSE,  NULL, NULL,    NULL,  NULL,  NULL,     "draw requests from the mix at random, not in order",            2 },
+  { "--mix",     eslARG_INFILE,     NULL,  NULL, NULL,    NULL,  NULL,  NULL,     "synthetic mix: options drawn by weight from file <f>",          2 },
+  { "--seed",    eslARG_INT,        "42",  NULL, "n>=0",  NULL,  NULL,  NULL,     "set RNG seed to <n> (if 0: one-time arbitrary seed)",           2 },
+  { "--tblout",  eslARG_OUTFILE,    NULL,  NULL, NULL,    NULL,  NULL,  NULL,     "save a table of every request's timings to file <f>",           1 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <queryfile>";
+static char banner[] = "load generator and throughput benchmark for hmmpgmd";
+
+static int  read_requests(const char *file, LOAD_REQUEST **ret_req, int *ret_nreq, int *ret_nskip);
+static int  read_mix(const char *file, LOAD_MIXOPT **ret_mix, int *ret_nmix, double *ret_wtot);
+static int  load_type(const char *opts, const char *query);
+static int  scrape_workers(const char *ip, int port, LOAD_WORKER **ret_wk, int *ret_nwk);
+static void report(FILE *ofp, LOAD_SENT *sent, int nsent, double wall, LOAD_WORKER *wk0, int nwk0, LOAD_WORKER *wk1, int nwk1);
+static int  cmp_double(const void *a, const void *b);
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go       = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *ip       = esl_opt_GetString (go, "-i");
+  int             port     = esl_opt_GetInteger(go, "-p");
+  int             nconn    = esl_opt_GetInteger(go, "-c");
+  int             depth    = esl_opt_GetInteger(go, "--depth");
+  int             openloop = esl_opt_IsOn(go, "--rate");
+  double          rate     = openloop ? esl_opt_GetReal(go, "--rate") : 0.0;
+  double          tmax     = esl_opt_IsOn(go, "--time") ? esl_opt_GetReal(go, "--time") : -1.0;
+  ESL_RANDOMNESS *rng      = esl_randomness_Create(esl_opt_GetInteger(go, "--seed"));
+  LOAD_REQUEST   *req      = NULL;
+  LOAD_MIXOPT    *mix      = NULL;
+  LOAD_SENT      *sent     = NULL;
+  LOAD_CONN      *conn     = NULL;
+  LOAD_WORKER    *wk0      = NULL;	/* workers before the run */
+  LOAD_WORKER    *wk1      = NULL;	/* ... and after          */
+  struct pollfd  *pfd      = NULL;
+  HMMD_RESULT    *res      = NULL;
+  FILE           *tblfp    = NULL;
+  int             nreq, nskip;
+  int             nmix     = 0;
+  double          wtot     = 0.0;
+  int             nwk0     = 0;
+  int             nwk1     = 0;
+  int64_t         nmax;			/* requests to send; -1 = until --time */
+  int64_t         nsched   = 0;		/* requests arrived                    */
+  int64_t         nsent    = 0;		/* ... handed to a connection          */
+  int64_t         ndone    = 0;		/* ... answered, or lost               */
+  int64_t         salloc;
+  int             nlive;
+  int             room;
+  double          t0, now, next_arrival, x;
+  int             timeout;
+  int             c, k, r, j;
+  int             status;
+  char            errbuf[eslERRBUFSIZE];
+
+  if ((status = read_requests(esl_opt_GetArg(go, 1), &req, &nreq, &nskip)) != eslOK)
+    {
+      if (status == eslENOTFOUND) p7_Fail("Failed to open query file %s for reading\n", esl_opt_GetArg(go, 1));
+      else                        p7_Fail("Failed to read query file %s\n", esl_opt_GetArg(go, 1));
+    }
+  if (nreq == 0) p7_Fail("No requests found in query file %s\n", esl_opt_GetArg(go, 1));
+  if (nskip > 0) fprintf(stderr, "Skipped %d server command(s) in %s; only searches are replayed\n", nskip, esl_opt_GetArg(go, 1));
+
+  if (esl_opt_IsOn(go, "--mix"))
+    {
+      status = read_mix(esl_opt_GetString(go, "--mix"), &mix, &nmix, &wtot);
+      if      (status == eslENOTFOUND) p7_Fail("Failed to open mix file %s for reading\n", esl_opt_GetString(go, "--mix"));
+      else if (status == eslEFORMAT)   p7_Fail("Mix file %s has a line that isn't <weight> <options>\n", esl_opt_GetString(go, "--mix"));
+      else if (status != eslOK)        p7_Fail("Failed to read mix file %s\n", esl_opt_GetString(go, "--mix"));
+      if (nmix == 0 || wtot <= 0.0)    p7_Fail("Mix file %s has no option strings of positive weight\n", esl_opt_GetString(go, "--mix"));
+    }
+
+  if      (esl_opt_IsOn(go, "-n"))   nmax = esl_opt_GetInteger(go, "-n");
+  else if (tmax > 0.0)               nmax = -1;
+  else                               nmax = nreq;
+
+  if (esl_opt_IsOn(go, "--tblout") && (tblfp = fopen(esl_opt_GetString(go, "--tblout"), "w")) == NULL)
+    p7_Fail("Failed to open table output file %s for writing\n", esl_opt_GetString(go, "--tblout"));
+
+  if (esl_opt_IsOn(go, "--mport") && scrape_workers(ip, esl_opt_GetInteger(go, "--mport"), &wk0, &nwk0) != eslOK)
+    p7_Fail("Failed to read the metrics port %s:%d\n", ip, esl_opt_GetInteger(go, "--mport"));
+
+  /* Connect */
+  if ((conn = malloc(sizeof(LOAD_CONN)     * nconn)) == NULL) p7_Fail("malloc failed");
+  if ((pfd  = malloc(sizeof(struct pollfd) * nconn)) == NULL) p7_Fail("malloc failed");
+  for (c = 0; c < nconn; c++)
+    {
+      if (hmmd_client_Connect(ip, port, &(conn[c].cl), errbuf) != eslOK) p7_Fail("Failed to connect to %s:%d: %s\n", ip, port, errbuf);
+      conn[c].nout = 0;
+      conn[c].dead = FALSE;
+    }
+  nlive = nconn;
+
+  salloc = (nmax > 0) ? nmax : 4096;
+  if ((sent = malloc(sizeof(LOAD_SENT) * salloc)) == NULL) p7_Fail("malloc failed");
+
+  printf("# hmmpgmd_load :: %s\n", banner);
+  printf("# master:                    %s:%d\n", ip, port);
+  printf("# query file:                %s (%d requests)\n", esl_opt_GetArg(go, 1), nreq);
+  if (nmix) printf("# synthetic mix:             %s (%d option strings)\n", esl_opt_GetString(go, "--mix"), nmix);
+  printf("# connections:               %d, up to %d request(s) outstanding on each\n", nconn, depth);
+  if (openloop) printf("# arrivals:                  open loop, %g per second\n", rate);
+  else          printf("# arrivals:                  closed loop\n");
+  if (nmax > 0)   printf("# requests:                  %" PRId64 "\n", nmax);
+  if (tmax > 0.0) printf("# time limit:                %g seconds\n", tmax);
+  printf("# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n");
+  fflush(stdout);
+
+  t0           = p7_progress_Now();
+  next_arrival = t0;
+  while (nlive > 0)
+    {
+      now = p7_progress_Now();
+
+      /* Arrivals. A closed loop's arrive as there's room for them. */
+      for (room = 0, c = 0; c < nconn; c++) if (! conn[c].dead) room += depth - conn[c].nout;
+      room -= (int) (nsched - nsent);
+      while ((nmax < 0 || nsched < nmax) && (tmax < 0.0 || now - t0 < tmax))
+	{
+	  if (openloop && next_arrival > now) break;
+	  if (! openloop && room-- <= 0)      break;
+	  if (nsched == salloc)
+	    {
+	      salloc *= 2;
+	      if ((sent = realloc(sent, sizeof(LOAD_SENT) * salloc)) == NULL) p7_Fail("realloc failed");
+	    }
+	  /* what it asks for */
+	  sent[nsched].r = (esl_opt_GetBoolean(go, "--shuffle") || nmix) ? esl_rnd_Roll(rng, nreq) : (int) (nsched % nreq);
+	  sent[nsched].m = -1;
+	  if (nmix)
+	    {
+	      x = esl_random(rng) * wtot;
+	      for (j = 0; j < nmix-1 && x >= mix[j].w; j++) x -= mix[j].w;
+	      sent[nsched].m = j;
+	    }
+	  sent[nsched].type     = load_type(nmix ? mix[sent[nsched].m].opts : req[sent[nsched].r].opts, req[sent[nsched].r].query);
+	  sent[nsched].t_arrive = openloop ? next_arrival : now;
+	  sent[nsched].t_sent   = 0.0;
+	  sent[nsched].t_done   = 0.0;
+	  sent[nsched].status   = eslOK;
+	  sent[nsched].elapsed  = 0.0;
+	  nsched++;
+	  if (openloop) next_arrival += -log(esl_rnd_UniformPositive(rng)) / rate;
+	}
+
+      /* Hand arrived requests to the least loaded connections */
+      while (nsent < nsched)
+	{
+	  for (k = -1, c = 0; c < nconn; c++)
+	    if (! conn[c].dead && conn[c].nout < depth && (k == -1 || conn[c].nout < conn[k].nout)) k = c;
+	  if (k == -1) break;
+
+	  r      = sent[nsent].r;
+	  status = hmmd_client_Send(conn[k].cl, (uint32_t) nsent, (sent[nsent].m >= 0 ? mix[sent[nsent].m].opts : req[r].opts), req[r].query);
+	  if (status != eslOK) p7_Fail("Failed to queue request %d of %s\n", r+1, esl_opt_GetArg(go, 1));
+	  sent[nsent].t_sent = p7_progress_Now();
+	  conn[k].nout++;
+	  nsent++;
+	}
+
+      if (ndone == nsched && (nmax >= 0 && nsched >= nmax)) break;
+      if (ndone == nsched && tmax >= 0.0 && now - t0 >= tmax) break;
+
+      /* Wait for the connections, or the next arrival */
+      timeout = LOAD_TICK_MS;
+      if (openloop && (nmax < 0 || nsched < nmax))
+	timeout = ESL_MIN(timeout, (int) ceil(ESL_MAX(0.0, next_arrival - p7_progress_Now()) * 1000.0));
+      for (c = 0; c < nconn; c++)
+	{
+	  pfd[c].fd      = conn[c].dead ? -1 : hmmd_client_Fd(conn[c].cl);
+	  pfd[c].events  = POLLIN | (hmmd_client_WantsWrite(conn[c].cl) ? POLLOUT : 0);
+	  pfd[c].revents = 0;
+	}
+      if (poll(pfd, nconn, timeout) < 0 && errno != EINTR) p7_Fail("poll() failed: %s\n", strerror(errno));
+
+      for (c = 0; c < nconn; c++)
+	{
+	  if (conn[c].dead || (pfd[c].revents == 0 && ! hmmd_client_WantsWrite(conn[c].cl))) continue;
+	  status = hmmd_client_Process(conn[c].cl, 0);
+	  now    = p7_progress_Now();
+
+	  while (hmmd_client_Next(conn[c].cl, &res) == eslOK)
+	    {
+	      sent[res->id].t_done  = now;
+	      sent[res->id].status  = res->status;
+	      sent[res->id].elapsed = (res->status == eslOK) ? res->stats.elapsed : 0.0;
+	      conn[c].nout--;
+	      ndone++;
+	      hmmd_result_Destroy(res);
+	    }
+
+	  if (status != eslOK)
+	    { /* the requests still outstanding on it are lost */
+	      HMMD_CLIENT *cl = conn[c].cl;
+	      for (j = 0; j < cl->nids; j++)
+		{
+		  r = cl->ids[(cl->ihead + j) % cl->idalloc];
+		  sent[r].t_done = now;
+		  sent[r].status = eslESYS;
+		  ndone++;
+		}
+	      fprintf(stderr, "Connection %d failed (%s); %d request(s) on it lost\n", c, (status == eslEOF ? "closed by the daemon" : "socket or protocol error"), cl->nids);
+	      hmmd_client_Close(cl);
+	      conn[c].cl   = NULL;
+	      conn[c].nout = 0;
+	      conn[c].dead = TRUE;
+	      nlive--;
+	    }
+	}
+    }
+  /* requests that arrived but never got a connection count as failed */
+  for ( ; nsent < nsched; nsent++) { sent[nsent].status = eslESYS; sent[nsent].t_done = p7_progress_Now(); }
+  now = p7_progress_Now();
+
+  if (esl_opt_IsOn(go, "--mport") && scrape_workers(ip, esl_opt_GetInteger(go, "--mport"), &wk1, &nwk1) != eslOK)
+    fprintf(stderr, "Failed to read the metrics port %s:%d after the run; no worker utilization\n", ip, esl_opt_GetInteger(go, "--mport"));
+
+  report(stdout, sent, (int) nsched, now - t0, wk0, nwk0, wk1, nwk1);
+
+  if (tblfp)
+    {
+      fprintf(tblfp, "# %-8s %-10s %6s %12s %12s %12s %10s %10s\n", "id", "type", "status", "arrive", "sent", "done", "latency", "search");
+      for (j = 0; j < nsched; j++)
+	fprintf(tblfp, "%-10d %-10s %6d %12.6f %12.6f %12.6f %10.6f %10.6f\n", j, load_typename[sent[j].type], sent[j].status,
+		sent[j].t_arrive - t0, (sent[j].t_sent > 0.0 ? sent[j].t_sent - t0 : 0.0), sent[j].t_done - t0,
+		sent[j].t_done - sent[j].t_arrive, sent[j].elapsed);
+      fclose(tblfp);
+    }
+
+  for (c = 0; c < nconn; c++) if (! conn[c].dead) hmmd_client_Close(conn[c].cl);
+  for (j = 0; j < nreq; j++) { free(req[j].opts); free(req[j].query); }
+  for (j = 0; j < nmix; j++) free(mix[j].opts);
+  for (j = 0; j < nwk0; j++) free(wk0[j].name);
+  for (j = 0; j < nwk1; j++) free(wk1[j].name);
+  free(wk0);
+  free(wk1);
+  free(req);
+  free(mix);
+  free(sent);
+  free(conn);
+  free(pfd);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+
+
+/* read_requests()
+ *
+ * Read the requests of <file> into <*ret_req>, <*ret_nreq> of them.
+ * The format is what hmmc2 takes: each request is an optional '@'
+ * line of options and a query, ended by a "//" line. A plain
+ * sequence file or HMM file works too, as requests without options.
+ * A request with several sequences is split into one per sequence,
+ * each with the request's options, since a pipelined client can only
+ * send single queries (see hmmd_client.c). Server commands ('!')
+ * are skipped, and counted in <*ret_nskip>.
+ *
+ * Returns <eslOK>; <eslENOTFOUND> if <file> can't be opened.
+ * Throws <eslEMEM> on allocation failure.
+ */
+static int
+read_requests(const char *file, LOAD_REQUEST **ret_req, int *ret_nreq, int *ret_nskip)
+{
+  FILE         *fp     = NULL;
+  char         *buf    = NULL;
+  size_t        n      = 0;
+  size_t        nalloc = 0;
+  LOAD_REQUEST *req    = NULL;
+  int           nreq   = 0;
+  int           ralloc = 0;
+  int           nskip  = 0;
+  char         *opts   = NULL;
+  char         *s, *eol, *q, *qend, *next;
+  void         *p;
+  int           status;
+
+  if ((fp = fopen(file, "r")) == NULL) return eslENOTFOUND;
+  do {
+    if (n + 1 >= nalloc) { nalloc = ESL_MAX(65536, nalloc * 2); ESL_RALLOC(buf, p, nalloc); }
+    n += fread(buf + n, 1, nalloc - n - 1, fp);
+  } while (! feof(fp) && ! ferror(fp));
+  if (ferror(fp)) { status = eslFAIL; goto ERROR; }
+  buf[n] = '\0';
+  fclose(fp);
+  fp = NULL;
+
+  for (s = buf; *s != '\0'; s = next)
+    {
+      /* one record, up to and including its "//" line, or the end */
+      for (next = s; *next != '\0'; next = (eol == NULL ? next + strlen(next) : eol + 1))
+	{
+	  eol = strchr(next, '\n');
+	  if (next[0] == '/' && next[1] == '/') { next = (eol == NULL ? next + strlen(next) : eol + 1); break; }
+	}
+
+      while (s < next && (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')) s++;
+      if (s == next || (s[0] == '/' && s[1] == '/')) continue;
+      if (*s == '!') { nskip++; continue; }
+
+      opts = NULL;
+      if (*s == '@')
+	{
+	  for (eol = s; eol < next && *eol != '\n' && *eol != '\r'; eol++) ;
+	  if ((status = esl_memstrdup(s+1, eol - s - 1, &opts)) != eslOK) goto ERROR;
+	  for (s = eol; s < next && (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r'); s++) ;
+	}
+
+      /* one request per sequence; an HMM is one query to the record's end */
+      for (q = s; q < next && !(q[0] == '/' && q[1] == '/'); q = qend)
+	{
+	  qend = next;
+	  if (*q == '>')
+	    for (eol = strchr(q, '\n'); eol != NULL && eol+1 < next; eol = strchr(eol+1, '\n'))
+	      if (eol[1] == '>') { qend = eol+1; break; }
+
+	  if (nreq == ralloc) { ralloc = ESL_MAX(64, ralloc * 2); ESL_RALLOC(req, p, sizeof(LOAD_REQUEST) * ralloc); }
+	  req[nreq].opts  = NULL;
+	  req[nreq].query = NULL;
+	  if (opts && (status = esl_strdup(opts, -1, &(req[nreq].opts))) != eslOK) goto ERROR;
+	  if ((status = esl_memstrdup(q, qend - q, &(req[nreq].query)))  != eslOK) goto ERROR;
+	  nreq++;
+	}
+      free(opts);
+      opts = NULL;
+    }
+
+  free(buf);
+  *ret_req   = req;
+  *ret_nreq  = nreq;
+  *ret_nskip = nskip;
+  return eslOK;
+
+ ERROR:
+  if (fp) fclose(fp);
+  free(opts);
+  free(buf);
+  *ret_req   = NULL;
+  *ret_nreq  = 0;
+  *ret_nskip = 0;
+  return status;
+}
+
+
+/* read_mix()
+ *
+ * Read a synthetic mix from <file>: lines of <weight> <options>, such
+ * as "3 --seqdb 1" and "1 --hmmdb 1 -E 0.01". Blank lines and lines
+ * starting with '#' are ignored. Return the option strings in
+ * <*ret_mix>, <*ret_nmix> of them, and their total weight in
+ * <*ret_wtot>.
+ *
+ * Returns <eslOK>; <eslENOTFOUND> if <file> can't be opened;
+ * <eslEFORMAT> on a line that doesn't start with a weight >= 0.
+ * Throws <eslEMEM> on allocation failure.
+ */
+static int
+read_mix(const char *file, LOAD_MIXOPT **ret_mix, int *ret_nmix, double *ret_wtot)
+{
+  FILE        *fp     = NULL;
+  LOAD_MIXOPT *mix    = NULL;
+  int          nmix   = 0;
+  int          nalloc = 0;
+  double       wtot   = 0.0;
+  char         line[4096];
+  char        *s, *end;
+  void        *p;
+  double       w;
+  int          status;
+
+  if ((fp = fopen(file, "r")) == NULL) return eslENOTFOUND;
+  while (fgets(line, sizeof(line), fp) != NULL)
+    {
+      for (s = line; *s == ' ' || *s == '\t'; s++) ;
+      if (*s == '#' || *s == '\n' || *s == '\r' || *s == '\0') continue;
+
+      w = strtod(s, &end);
+      if (end == s || w < 0.0) { status = eslEFORMAT; goto ERROR; }
+      for (s = end; *s == ' ' || *s == '\t'; s++) ;
+      for (end = s + strlen(s); end > s && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'); end--) ;
+      *end = '\0';
+
+      if (nmix == nalloc) { nalloc = ESL_MAX(16, nalloc * 2); ESL_RALLOC(mix, p, sizeof(LOAD_MIXOPT) * nalloc); }
+      mix[nmix].w = w;
+      if ((status = esl_strdup(s, -1, &(mix[nmix].opts))) != eslOK) goto ERROR;
+      wtot += w;
+      nmix++;
+    }
+  fclose(fp);
+
+  *ret_mix  = mix;
+  *ret_nmix = nmix;
+  *ret_wtot = wtot;
+  return eslOK;
+
+ ERROR:
+  if (fp) fclose(fp);
+  while (nmix--) free(mix[nmix].opts);
+  free(mix);
+  *ret_mix  = NULL;
+  *ret_nmix = 0;
+  *ret_wtot = 0.0;
+  return status;
+}
+
+
+/* load_type()
+ *
+ * Classify a request by its query and database: a sequence against
+ * the sequence database (phmmer), an HMM against it (hmmsearch), a
+ * sequence against the profile database (hmmscan), or anything else.
+ */
+static int
+load_type(const char *opts, const char *query)
+{
+  int scan = (opts != NULL && strstr(opts, "--hmmdb") != NULL);
+
+  while (*query == ' ' || *query == '\t' || *query == '\n' || *query == '\r') query++;
+  if (*query == '>') return scan ? 2 : 0;
+  if (strncmp(query, "HMMER", 5) == 0 && ! scan) return 1;
+  return 3;
+}
+
+
+/* scrape_workers()
+ *
+ * Read the master's metrics port at <ip>:<port>, and return each
+ * worker's shares of searches answered and busy seconds in <*ret_wk>,
+ * <*ret_nwk> of them.
+ *
+ * Returns <eslOK>; <eslESYS> if the port can't be read.
+ * Throws <eslEMEM> on allocation failure.
+ */
+static int
+scrape_workers(const char *ip, int port, LOAD_WORKER **ret_wk, int *ret_nwk)
+{
+  static const char  get[]  = "GET /metrics HTTP/1.0\r\n\r\n";
+  struct sockaddr_in addr;
+  LOAD_WORKER       *wk     = NULL;
+  int                nwk    = 0;
+  int                walloc = 0;
+  char              *buf    = NULL;
+  size_t             n      = 0;
+  size_t             nalloc = 0;
+  ssize_t            nr;
+  int                fd     = -1;
+  int                is_busy;
+  char              *s, *name, *end;
+  void              *p;
+  int                i;
+  int                status;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(port);
+  if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1)                     { status = eslESYS; goto ERROR; }
+  if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)                      { status = eslESYS; goto ERROR; }
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)        { status = eslESYS; goto ERROR; }
+  if (write(fd, get, sizeof(get) - 1) != (ssize_t) (sizeof(get) - 1)) { status = eslESYS; goto ERROR; }
+  for (;;)
+    {
+      if (n + 1 >= nalloc) { nalloc = ESL_MAX(65536, nalloc * 2); ESL_RALLOC(buf, p, nalloc); }
+      if ((nr = read(fd, buf + n, nalloc - n - 1)) < 0) { if (errno == EINTR) continue; status = eslESYS; goto ERROR; }
+      if (nr == 0) break;
+      n += nr;
+    }
+  buf[n] = '\0';
+  close(fd);
+  fd = -1;
+
+  for (s = buf; s != NULL && *s != '\0'; s = ((s = strchr(s, '\n')) == NULL ? NULL : s + 1))
+    {
+      if      (strncmp(s, "hmmpgmd_worker_busy_seconds_total{worker=\"", 42) == 0) { is_busy = TRUE;  name = s + 42; }
+      else if (strncmp(s, "hmmpgmd_worker_parts_total{worker=\"", 35) == 0)        { is_busy = FALSE; name = s + 35; }
+      else continue;
+      if ((end = strchr(name, '"')) == NULL) continue;
+
+      for (i = 0; i < nwk; i++)
+	if (strlen(wk[i].name) == (size_t) (end - name) && strncmp(wk[i].name, name, end - name) == 0) break;
+      if (i == nwk)
+	{
+	  if (nwk == walloc) { walloc = ESL_MAX(16, walloc * 2); ESL_RALLOC(wk, p, sizeof(LOAD_WORKER) * walloc); }
+	  if ((status = esl_memstrdup(name, end - name, &(wk[nwk].name))) != eslOK) goto ERROR;
+	  wk[nwk].parts = 0;
+	  wk[nwk].busy  = 0.0;
+	  nwk++;
+	}
+      if ((end = strchr(end, '}')) == NULL) continue;
+      if (is_busy) wk[i].busy  = strtod(end + 1, NULL);
+      else         wk[i].parts = strtoull(end + 1, NULL, 10);
+    }
+
+  free(buf);
+  *ret_wk  = wk;
+  *ret_nwk = nwk;
+  return eslOK;
+
+ ERROR:
+  if (fd >= 0) close(fd);
+  while (nwk--) free(wk[nwk].name);
+  free(wk);
+  free(buf);
+  *ret_wk  = NULL;
+  *ret_nwk = 0;
+  return status;
+}
+
+
+/* report()
+ *
+ * Write the run's throughput, and per query type its error rate,
+ * latency percentiles and mean search time; then, if the workers were
+ * scraped before (<wk0>) and after (<wk1>) the run, each worker's
+ * shares answered and utilization, its busy seconds per second of
+ * the run. A worker running several searches at once can be busy
+ * for more than one.
+ */
+static void
+report(FILE *ofp, LOAD_SENT *sent, int nsent, double wall, LOAD_WORKER *wk0, int nwk0, LOAD_WORKER *wk1, int nwk1)
+{
+  double  *lat  = NULL;
+  int      nok  = 0;
+  int      nerr = 0;
+  int      n, ne;
+  double   sum, ssum;
+  double   busy;
+  uint64_t parts;
+  int      t, i, j;
+
+  if (nsent > 0 && (lat = malloc(sizeof(double) * nsent)) == NULL) p7_Fail("malloc failed");
+  for (i = 0; i < nsent; i++) { if (sent[i].status == eslOK) nok++; else nerr++; }
+
+  fprintf(ofp, "Elapsed:                     %.2f seconds\n", wall);
+  fprintf(ofp, "Requests:                    %d (%d answered, %d failed: %.2f%%)\n", nsent, nok, nerr, nsent ? 100.0 * nerr / nsent : 0.0);
+  fprintf(ofp, "Throughput:                  %.2f answered requests per second\n", wall > 0.0 ? nok / wall : 0.0);
+  fprintf(ofp, "\n");
+  fprintf(ofp, "Latency (ms), answered requests; search is the daemon's own time:\n");
+  fprintf(ofp, "%-10s %8s %8s %10s %10s %10s %10s %10s %10s\n", "type", "n", "errors", "mean", "p50", "p90", "p99", "max", "search");
+  fprintf(ofp, "%-10s %8s %8s %10s %10s %10s %10s %10s %10s\n", "----------", "--------", "--------", "----------", "----------", "----------", "----------", "----------", "----------");
+  for (t = 0; t < LOAD_NTYPES; t++)
+    {
+      for (n = ne = 0, sum = ssum = 0.0, i = 0; i < nsent; i++)
+	if (sent[i].type == t)
+	  {
+	    if (sent[i].status != eslOK) { ne++; continue; }
+	    lat[n++] = 1000.0 * (sent[i].t_done - sent[i].t_arrive);
+	    sum     += lat[n-1];
+	    ssum    += 1000.0 * sent[i].elapsed;
+	  }
+      if (n + ne == 0) continue;
+      if (n == 0) { fprintf(ofp, "%-10s %8d %8d\n", load_typename[t], ne, ne); continue; }
+      qsort(lat, n, sizeof(double), cmp_double);
+      fprintf(ofp, "%-10s %8d %8d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", load_typename[t], n + ne, ne, sum / n,
+	      lat[(int) ceil(0.50 * n) - 1], lat[(int) ceil(0.90 * n) - 1], lat[(int) ceil(0.99 * n) - 1], lat[n-1], ssum / n);
+    }
+
+  if (nwk1 > 0)
+    {
+      fprintf(ofp, "\n");
+      fprintf(ofp, "Workers, from the metrics port:\n");
+      fprintf(ofp, "%-24s %10s %10s %8s\n", "worker", "parts", "busy (s)", "util");
+      fprintf(ofp, "%-24s %10s %10s %8s\n", "------------------------", "----------", "----------", "--------");
+      for (i = 0; i < nwk1; i++)
+	{
+	  busy  = wk1[i].busy;
+	  parts = wk1[i].parts;
+	  for (j = 0; j < nwk0; j++)	/* a worker that connected during the run counts from 0 */
+	    if (strcmp(wk0[j].name, wk1[i].name) == 0 && wk0[j].busy <= wk1[i].busy) { busy -= wk0[j].busy; parts -= wk0[j].parts; break; }
+	  fprintf(ofp, "%-24s %10" PRIu64 " %10.2f %8.2f\n", wk1[i].name, parts, busy, wall > 0.0 ? busy / wall : 0.0);
+	}
+    }
+  free(lat);
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
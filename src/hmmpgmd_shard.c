@@ -35,7 +35,11 @@ static ESL_OPTIONS cmdlineOpts[] = {
   { "--seqdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "protein database to cache for searches",                      12 },
   { "--hmmdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "hmm database to cache for searches",                          12 },
   { "--cpu",        eslARG_INT,  p7_NCPU,"HMMER_NCPU","n>0",        NULL,  NULL,  "--master",      "number of parallel CPU workers to use for multithreads",      12 },
+  { "--mxpool",     eslARG_INT,     "256",    NULL, "n>=0",         NULL,  NULL,  "--master",      "keep up to <n> MB of DP matrices for reuse across searches",  12 },
+  { "--mxtrim",     eslARG_INT,     "64",     NULL, "n>=0",         NULL,  NULL,  "--master",      "don't keep DP matrices bigger than <n> MB for reuse",         12 },
   { "--num_shards", eslARG_INT,    "1",      NULL, "1<=n<512",      NULL,  NULL,  "--worker",      "number of worker nodes that will connect to the master",      12 },
+  { "--replicas",   eslARG_INT,    "1",      NULL, "1<=n<512",      NULL,  NULL,  "--worker",      "number of shards each worker caches: its own and the next",   12 },
+  { "--speculate",  eslARG_REAL,   "0.95",   NULL, "0<=x<1",        NULL,  NULL,  "--worker",      "copy a slice running past this quantile of its latency, 0 = never", 12 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
   };
 
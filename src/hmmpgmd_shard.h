@@ -16,6 +16,7 @@ typedef struct {
   uint32_t    model_cnt;            /* models in hmm database                   */
   uint32_t    num_shards;			/* Number of shards the DB will be divided into */
   uint32_t	  my_shard;				/* which shard is this thread responsible for? */
+  uint32_t    replicas;             /* shards held: my_shard and the next replicas-1 */
   char        data[];              /* string data                              */
 } HMMD_INIT_CMD_SHARD;
 
@@ -5,10 +5,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
 
 #include "hmmer.h"
 
@@ -16,6 +22,10 @@ static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",          0 },
   { "-f",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "force: overwrite any previous pressed files",   0 },
+  { "--sort",    eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "press models longest first, to balance hmmscan's threads", 0 },
+#ifdef HMMER_THREADS
+  { "--cpu",     eslARG_INT,  p7_NCPU, NULL, "n>=0",    NULL,      NULL,    NULL, "number of parallel CPU workers to use for multithreads", 0 },
+#endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <hmmfile>";
@@ -39,6 +49,45 @@ struct dbfiles {
 static struct dbfiles *open_dbfiles (ESL_GETOPTS *go, char *basename);
 static void            close_dbfiles(struct dbfiles *dbf, int status);
 
+/* Models are pressed in batches. While the worker threads configure
+ * and convert the profiles of one batch, the main thread parses the
+ * next; then it writes the converted batch, in file order.
+ */
+#define PRESS_BATCH 256
+
+struct batch {
+  P7_HMM      *hmm[PRESS_BATCH];
+  P7_OPROFILE *om[PRESS_BATCH];
+  int          n;
+};
+
+struct press_worker {
+  struct batch *b;
+  const P7_BG  *bg;
+  int           w;	/* this worker converts models w, w+nw, ... of the batch */
+  int           nw;
+#ifdef HMMER_THREADS
+  pthread_t     thread;
+#endif
+};
+
+/* With --sort, models are pressed in order of decreasing length
+ * instead of file order. A first pass records where each record
+ * starts; the batches then seek to them in sorted order. hmmscan
+ * reads a pressed database front to back in blocks, so its last
+ * blocks are then made of short models, and its threads finish
+ * together instead of waiting on one big model at the end.
+ */
+struct press_rec {
+  off_t offset;
+  int   M;
+  int   idx;
+};
+
+static int   sort_records(P7_HMMFILE *hfp, ESL_ALPHABET **abc, struct press_rec **ret_rec, int *ret_nrec);
+static int   read_batch(P7_HMMFILE *hfp, ESL_ALPHABET **abc, const struct press_rec *rec, int nrec, int *next, struct batch *b);
+static void *convert_worker(void *arg);
+
 int
 main(int argc, char **argv)
 {
@@ -48,14 +97,31 @@ main(int argc, char **argv)
   P7_HMMFILE     *hfp     = NULL;
   P7_HMM         *hmm     = NULL;
   P7_BG          *bg      = NULL;
-  P7_PROFILE     *gm      = NULL;
   P7_OPROFILE    *om      = NULL;
   struct dbfiles *dbf     = NULL;
+  struct press_rec *rec   = NULL;	/* with --sort: model records in press order; else NULL */
+  int             nrec    = 0;
+  int             next    = 0;
+  struct batch    bat[2];	/* the batch being converted, and the next one being read */
+  struct batch   *cur     = &bat[0];
+  struct batch   *nxt     = &bat[1];
+  struct batch   *tmp;
+  struct press_worker wk[64];
   uint16_t        fh      = 0;
   int             nmodel  = 0;
+  int             ncpus   = 0;
+  int             nw, nthr;
+  int             i, w;
+  int             rstatus;
   int             status;
   char            errbuf[eslERRBUFSIZE];
 
+  bat[0].n = bat[1].n = 0;
+#ifdef HMMER_THREADS
+  ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+#endif
+  nw = ESL_MAX(1, ESL_MIN(ncpus, 64));
+
   if (strcmp(hmmfile, "-") == 0) p7_Fail("Can't use - for <hmmfile> argument: can't index standard input\n");
 
   status = p7_hmmfile_OpenNoDB(hmmfile, NULL, &hfp, errbuf);
@@ -73,38 +139,71 @@ main(int argc, char **argv)
   printf("Working...    "); 
   fflush(stdout);
 
-  while ((status = p7_hmmfile_Read(hfp, &abc, &hmm)) == eslOK)
+  rstatus = eslOK;
+  if (esl_opt_GetBoolean(go, "--sort")) rstatus = sort_records(hfp, &abc, &rec, &nrec);
+  if (rstatus == eslOK) rstatus = read_batch(hfp, &abc, rec, nrec, &next, cur);
+  while (cur->n > 0)
     {
-      if (hmm->name == NULL) ESL_XFAIL(eslEINVAL, errbuf, "Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel+1); 
-
       if (nmodel == 0) { 	/* first time initialization, now that alphabet known */
 	bg = p7_bg_Create(abc);
 	p7_bg_SetLength(bg, 400);
       }
 
-      nmodel++;
-
-      gm = p7_profile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL);
-      om = p7_oprofile_Create(gm->M, abc);
-      p7_oprofile_Convert(gm, om);
-      
-      if ((om->offs[p7_MOFFSET] = ftello(dbf->mfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of HMM db file");
-      if ((om->offs[p7_FOFFSET] = ftello(dbf->ffp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of MSV db file");   
-      if ((om->offs[p7_POFFSET] = ftello(dbf->pfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of profile db file"); 
-
-      if ((status = esl_newssi_AddKey(dbf->nssi, hmm->name, fh, om->offs[p7_MOFFSET], 0, 0)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to add key %s to SSI index", hmm->name); 
-      if (hmm->acc) {
-	if ((status = esl_newssi_AddAlias(dbf->nssi, hmm->acc, hmm->name))                   != eslOK) ESL_XFAIL(status, errbuf, "Failed to add secondary key %s to SSI index", hmm->acc); 
-      }
-
-      p7_hmmfile_WriteBinary(dbf->mfp, -1, hmm);
-      p7_oprofile_Write(dbf->ffp, dbf->pfp, om);
-
-      p7_profile_Destroy(gm);
-      p7_oprofile_Destroy(om);
-      p7_hmm_Destroy(hmm);
+      /* Configure and convert this batch in the workers (the main thread is worker 0, after it reads the next batch) */
+      for (w = 0; w < nw; w++)
+	{
+	  wk[w].b  = cur;
+	  wk[w].bg = bg;
+	  wk[w].w  = w;
+	  wk[w].nw = nw;
+	}
+      nthr = 1;
+#ifdef HMMER_THREADS
+      for (nthr = 1; nthr < nw; nthr++)
+	if (pthread_create(&(wk[nthr].thread), NULL, convert_worker, &(wk[nthr])) != 0) break;
+#endif
+      nxt->n = 0;
+      if (rstatus == eslOK) rstatus = read_batch(hfp, &abc, rec, nrec, &next, nxt);
+      convert_worker(&(wk[0]));
+      for (w = nthr; w < nw; w++) convert_worker(&(wk[w]));  /* shares of any threads that couldn't start */
+#ifdef HMMER_THREADS
+      for (w = 1; w < nthr; w++) pthread_join(wk[w].thread, NULL);
+#endif
+
+      /* Write it, in file order */
+      for (i = 0; i < cur->n; i++)
+	{
+	  hmm = cur->hmm[i];
+	  om  = cur->om[i];
+	  cur->hmm[i] = NULL;
+	  cur->om[i]  = NULL;
+	  nmodel++;
+
+	  if (hmm->name == NULL) ESL_XFAIL(eslEINVAL, errbuf, "Every HMM must have a name to be indexed. Failed to find name of HMM #%d\n", nmodel); 
+	  if (om == NULL)        ESL_XFAIL(eslEMEM,   errbuf, "Failed to convert HMM %s", hmm->name);
+
+	  if ((om->offs[p7_MOFFSET] = ftello(dbf->mfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of HMM db file");
+	  if ((om->offs[p7_FOFFSET] = ftello(dbf->ffp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of MSV db file");   
+	  if ((om->offs[p7_POFFSET] = ftello(dbf->pfp)) == -1) ESL_XFAIL(eslESYS, errbuf, "Failed to ftello() current disk position of profile db file"); 
+
+	  if ((status = esl_newssi_AddKey(dbf->nssi, hmm->name, fh, om->offs[p7_MOFFSET], 0, 0)) != eslOK) ESL_XFAIL(status, errbuf, "Failed to add key %s to SSI index", hmm->name); 
+	  if (hmm->acc) {
+	    if ((status = esl_newssi_AddAlias(dbf->nssi, hmm->acc, hmm->name))                   != eslOK) ESL_XFAIL(status, errbuf, "Failed to add secondary key %s to SSI index", hmm->acc); 
+	  }
+
+	  p7_hmmfile_WriteBinary(dbf->mfp, -1, hmm);
+	  p7_oprofile_Write(dbf->ffp, dbf->pfp, om);
+
+	  p7_oprofile_Destroy(om);
+	  p7_hmm_Destroy(hmm);
+	  om  = NULL;
+	  hmm = NULL;
+	}
+      cur->n = 0;
+
+      tmp = cur; cur = nxt; nxt = tmp;
     }
+  status = rstatus;
   if      (status == eslEFORMAT)   ESL_XFAIL(status, errbuf, "bad file format in HMM file %s",             hmmfile); 
   else if (status == eslEINCOMPAT) ESL_XFAIL(status, errbuf, "HMM file %s contains different alphabets",   hmmfile); 
   else if (status != eslEOF)       ESL_XFAIL(status, errbuf, "Unexpected error in reading HMMs from %s",   hmmfile); 
@@ -126,6 +225,7 @@ main(int argc, char **argv)
   printf("Profiles (remainder) pressed into: %s\n", dbf->pfile);
 
   close_dbfiles(dbf, eslOK);
+  free(rec);
   p7_bg_Destroy(bg);
   p7_hmmfile_Close(hfp);
   esl_alphabet_Destroy(abc);
@@ -135,6 +235,11 @@ main(int argc, char **argv)
  ERROR:
   fprintf(stderr, "%s\n", errbuf);
   close_dbfiles(dbf, status);
+  free(rec);
+  p7_oprofile_Destroy(om);
+  if (hmm) p7_hmm_Destroy(hmm);
+  for (w = 0; w < 2; w++)
+    for (i = 0; i < bat[w].n; i++) { if (bat[w].hmm[i]) p7_hmm_Destroy(bat[w].hmm[i]); p7_oprofile_Destroy(bat[w].om[i]); }
   p7_bg_Destroy(bg);
   p7_hmmfile_Close(hfp);
   esl_alphabet_Destroy(abc);
@@ -143,6 +248,118 @@ main(int argc, char **argv)
 }
 
 
+/* press_rec_compare()
+ * qsort() comparison: longer models first; ties stay in file order.
+ */
+static int
+press_rec_compare(const void *a, const void *b)
+{
+  const struct press_rec *ra = (const struct press_rec *) a;
+  const struct press_rec *rb = (const struct press_rec *) b;
+
+  if (ra->M   != rb->M)   return (ra->M > rb->M ? -1 : 1);
+  return (ra->idx < rb->idx ? -1 : (ra->idx > rb->idx ? 1 : 0));
+}
+
+/* sort_records()
+ * First pass for --sort: read every HMM in <hfp>, recording its
+ * record offset and length, and return the records sorted longest
+ * first in <*ret_rec>, <*ret_nrec>. Returns <eslOK> on success; else
+ * the status of the read that failed.
+ */
+static int
+sort_records(P7_HMMFILE *hfp, ESL_ALPHABET **abc, struct press_rec **ret_rec, int *ret_nrec)
+{
+  struct press_rec *rec    = NULL;
+  P7_HMM           *hmm    = NULL;
+  int               nalloc = 0;
+  int               n      = 0;
+  void             *p;
+  int               status;
+
+  while ((status = p7_hmmfile_Read(hfp, abc, &hmm)) == eslOK)
+    {
+      if (n == nalloc) {
+	nalloc = (nalloc == 0 ? 1024 : nalloc * 2);
+	ESL_RALLOC(rec, p, sizeof(struct press_rec) * nalloc);
+      }
+      rec[n].offset = hmm->offset;
+      rec[n].M      = hmm->M;
+      rec[n].idx    = n;
+      n++;
+      p7_hmm_Destroy(hmm);
+      hmm = NULL;
+    }
+  if (status != eslEOF) goto ERROR;
+
+  if (n > 1) qsort(rec, n, sizeof(struct press_rec), press_rec_compare);
+  *ret_rec  = rec;
+  *ret_nrec = n;
+  return eslOK;
+
+ ERROR:
+  if (hmm) p7_hmm_Destroy(hmm);
+  free(rec);
+  *ret_rec  = NULL;
+  *ret_nrec = 0;
+  return status;
+}
+
+/* read_batch()
+ * Read up to PRESS_BATCH next HMMs from <hfp> into <b>, setting
+ * <b->n>. If <rec> is non-NULL, the HMMs are the records
+ * <rec[*next..nrec-1]>, in that order, and <*next> is advanced past
+ * the ones read; else they're the next ones in the file.  Returns
+ * <eslOK> if the batch is full and there may be more; else the status
+ * of the read that stopped it, normally <eslEOF>.
+ */
+static int
+read_batch(P7_HMMFILE *hfp, ESL_ALPHABET **abc, const struct press_rec *rec, int nrec, int *next, struct batch *b)
+{
+  int status = eslOK;
+
+  b->n = 0;
+  while (b->n < PRESS_BATCH)
+    {
+      if (rec)
+	{
+	  if (*next >= nrec) { status = eslEOF; break; }
+	  if ((status = p7_hmmfile_Position(hfp, rec[(*next)++].offset)) != eslOK) break;
+	}
+      if ((status = p7_hmmfile_Read(hfp, abc, &(b->hmm[b->n]))) != eslOK) break;
+      b->om[b->n] = NULL;
+      b->n++;
+    }
+  return status;
+}
+
+/* convert_worker()
+ * Configure and convert this worker's share of the batch's models, as
+ * hmmsearch and hmmscan will read them: local mode, for length 400.
+ * A model that can't be converted is left with a NULL profile, for
+ * the writer to report.
+ */
+static void *
+convert_worker(void *arg)
+{
+  struct press_worker *wk = (struct press_worker *) arg;
+  struct batch        *b  = wk->b;
+  P7_PROFILE          *gm;
+  int                  i;
+
+  for (i = wk->w; i < b->n; i += wk->nw)
+    {
+      b->om[i] = NULL;
+      if ((gm = p7_profile_Create(b->hmm[i]->M, b->hmm[i]->abc)) == NULL) continue;
+      p7_ProfileConfig(b->hmm[i], wk->bg, gm, 400, p7_LOCAL);
+      if ((b->om[i] = p7_oprofile_Create(gm->M, gm->abc)) != NULL)
+	p7_oprofile_Convert(gm, b->om[i]);
+      p7_profile_Destroy(gm);
+    }
+  return NULL;
+}
+
+
 static struct dbfiles *
 open_dbfiles(ESL_GETOPTS *go, char *basename)
 {
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -30,29 +31,54 @@
 #endif
 
 #include "hmmer.h"
+#include "p7_hmmcache.h"
 
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  P7_CPUBIND       *cpubind;     /* --cpubind, --readercpu; or NULL         */
 #endif
   ESL_SQ           *qsq;
   P7_BG            *bg;	         /* null model                              */
   P7_PIPELINE      *pli;         /* work pipeline                           */
   P7_TOPHITS       *th;          /* top hit results                         */
+  int               cached;      /* TRUE if profiles belong to a P7_HMMCACHE */
+  P7_PROGRESS      *prog;        /* progress reports (--progress), or NULL  */
+  int               idx;         /* this worker's slot in <prog>            */
 } WORKER_INFO;
 
+/* one query's finished search, for output_query(); with --asyncout,
+ * written on a thread of its own while the next query is searched
+ */
+typedef struct {
+  FILE             *ofp, *tblfp, *domtblfp, *pfamtblfp;
+  P7_BINOUT        *bo;
+  int               textw;
+  int               ncpus;
+
+  ESL_SQ           *qsq;         /* the query; the master swaps it with its next one */
+  P7_PIPELINE      *pli;         /* its merged pipeline; output_query() frees it, and <th> */
+  P7_TOPHITS       *th;          /* its merged hit list                      */
+  ESL_STOPWATCH     w;           /* a copy of the query's running stopwatch  */
+  int               nquery;      /* 1.. */
+  int               status;      /* output_query()'s return, for the thread  */
+} QUERY_OUTPUT;
+
+static int   output_query(QUERY_OUTPUT *qo);
+#ifdef HMMER_THREADS
+static void *output_thread(void *arg);
+#endif
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
-#if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
+#ifdef HMMER_MPI
+#define PROGOPTS    "--mpi"
 #else
-#define CPUOPTS     NULL
-#define MPIOPTS     NULL
+#define PROGOPTS    NULL
 #endif
 
 static ESL_OPTIONS options[] = {
@@ -63,6 +89,7 @@ static ESL_OPTIONS options[] = {
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",         2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",           2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",    2 },
+  { "--binout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save hits in compact binary format to file <f>",               2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                        2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                 2 },
   { "--notextw",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                          2 },
@@ -87,18 +114,36 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,  "1e-3", NULL, NULL,    NULL,  NULL, "--max",          "Vit threshold: promote hits w/ P <= F2",                        7 },
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,    NULL,  NULL, "--max",          "Fwd threshold: promote hits w/ P <= F3",                        7 },
   { "--nobias",     eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                              7 },
+  { "--vitdom",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, NULL,             "define one-domain targets by their Viterbi path (faster)",      7 },
+  { "--seqscore_only", eslARG_NONE, FALSE, NULL, NULL,    NULL,  NULL, "--domtblout,--vitdom", "per-model scores only: no Backward, no domains (faster)",   7 },
+  { "--dd_threads", eslARG_INT,     "0",  NULL, "n>=0",  NULL,  NULL, NULL,             "define domains of a multidomain target in <n> threads",         7 },
+  { "--dd_ramlimit", eslARG_INT,    "0",  NULL, "n>=0",  NULL,  NULL, NULL,             "cap full envelope DP matrices at <n> MB (0: no cap)",           7 },
+  { "--dd_nbatch",  eslARG_INT,     "0",  NULL, "n>=0",  NULL,  NULL, NULL,             "sample domain traces in batches of <n>, stopping early",        7 },
+  { "--dd_deferali", eslARG_NONE,   FALSE, NULL, NULL,   NULL,  NULL, NULL,             "align domains only of targets that are reported",               7 },
+  { "--dd_bf16",    eslARG_NONE,    FALSE, NULL, NULL,   NULL,  NULL, NULL,             "keep envelope DP matrices in bfloat16 (half the memory)",       7 },
   /* Other options */
   { "--nonull2",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",                12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",           12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",    12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
+  { "--timing",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "report time spent in each stage of the pipeline",              12 },
+  { "--memstats",   eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "report memory high-water marks of the pipeline",               12 },
+  { "--membudget",  eslARG_INT,    NULL,  NULL, "n>0",   NULL,  NULL,  NULL,            "keep each pipeline under <n> MB of DP memory",                 12 },
+  { "--nommap",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "read pressed <hmmdb> with stdio, not mmap()",                  12 },
+  { "--hugepages",  eslARG_STRING, NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "put big buffers in hugepages: <s> = off|thp|2M|1G",            12 },
   { "--qformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert input <seqfile> is in format <s>: no autodetection",    12 },
+  { "--cache",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "read <hmmdb> into memory once, for all the queries",           12 },
+  { "--progress",   eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  PROGOPTS,        "report search progress and throughput to file <f> ('-': stderr)", 12 },
+  { "--progress_int",eslARG_REAL,  "60", NULL, "x>0",   NULL,"--progress", NULL,       "seconds between --progress reports",                           12 },
 #ifdef HMMER_THREADS
-  { "--cpu",        eslARG_INT,"0","HMMER_NCPU","n>=0",NULL,  NULL, CPUOPTS,            "number of parallel CPU workers to use for multithreads",       12 },  // multithread parallelization off by default. hmmscan is i/o bound on almost all systems.
+  { "--cpu",        eslARG_INT,"0","HMMER_NCPU","n>=0",NULL,  NULL, NULL,               "number of parallel CPU workers to use for multithreads",       12 },  // multithread parallelization off by default. hmmscan is i/o bound on almost all systems.
+  { "--cpubind",    eslARG_STRING, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "pin workers to cpus: 'cores', 'sockets', or a list <s> (0-7,16)", 12 },
+  { "--readercpu",  eslARG_INT,    NULL, NULL, "n>=0",  NULL,  NULL,  NULL,            "reserve cpu <n> for the reader and output threads",           12 },
+  { "--asyncout",   eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "write each query's results while the next query is searched",  12 },
 #endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,"--mpi", NULL,            "arrest after start: for debugging MPI under gdb",              12 },  
-  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  MPIOPTS,         "run as an MPI parallel program",                               12 },
+  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "run as an MPI parallel program",                               12 },
 #endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -122,12 +167,24 @@ static char usage[]  = "[-options] <hmmdb> <seqfile>";
 static char banner[] = "search sequence(s) against a profile database";
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
-static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp);
+static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp, P7_HMMCACHE *hcache);
+
+#define SERIAL_PROGRESS_TICK 1024   /* --progress: the serial loop reports every this many models */
 
 #ifdef HMMER_THREADS
-#define BLOCK_SIZE 1000
+/* The threads get blocks of up to BLOCK_SIZE profiles, but a block
+ * is closed early once the MSV cost of its models, the sum of their
+ * lengths times the query length, reaches BLOCK_CELLS: one block of
+ * a few huge models would otherwise keep its worker busy long after
+ * the others have run out of work on the query. (hmmpress --sort
+ * puts the biggest models first, where they get split across the
+ * first blocks instead of turning up last.)
+ */
+#define BLOCK_SIZE  1000
+#define BLOCK_CELLS 25000000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, P7_HMMCACHE *hcache, int L, P7_PROGRESS *prog);
+static int  fill_block(P7_OM_BLOCK *block, P7_HMMFILE *hfp, ESL_ALPHABET **abc, P7_HMMCACHE *hcache, int *next, int L);
 static void pipeline_thread(void *arg);
 #endif
 
@@ -188,6 +245,9 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_hmmf
   if (strcmp(*ret_hmmfile, "-") == 0) 
     { if (puts("hmmscan cannot read <hmm database> from stdin stream, because it must have hmmpress'ed auxfiles") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");   goto FAILURE;  }
 
+  if (esl_opt_IsOn(go, "--hugepages") && p7_hugemem_SetMode(esl_opt_GetString(go, "--hugepages")) != eslOK)
+    { if (printf("--hugepages takes off, thp, 2M or 1G, not %s\n", esl_opt_GetString(go, "--hugepages")) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+
   *ret_go = go;
   return eslOK;
   
@@ -216,6 +276,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--tblout")    && fprintf(ofp, "# per-seq hits tabular output:     %s\n",            esl_opt_GetString(go, "--tblout"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout") && fprintf(ofp, "# per-dom hits tabular output:     %s\n",            esl_opt_GetString(go, "--domtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout")&& fprintf(ofp, "# pfam-style tabular hit output:   %s\n",            esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--binout")     && fprintf(ofp, "# binary result output:            %s\n",             esl_opt_GetString(go, "--binout"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")       && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")     && fprintf(ofp, "# show alignments in output:       no\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--notextw")   && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -236,6 +297,13 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--F2")        && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",            esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",            esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--vitdom")    && fprintf(ofp, "# Viterbi-path domain definition:  on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seqscore_only") && fprintf(ofp, "# per-model scores only:           on\n")                                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_threads") && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--dd_threads"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_ramlimit") && fprintf(ofp, "# domain definition RAM limit:     %d MB\n", esl_opt_GetInteger(go, "--dd_ramlimit"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_nbatch")  && fprintf(ofp, "# domain trace sample batch size:  %d\n", esl_opt_GetInteger(go, "--dd_nbatch"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_deferali") && fprintf(ofp, "# deferred domain alignment:       on\n")                                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_bf16")    && fprintf(ofp, "# bfloat16 envelope matrices:      on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",          esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",          esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -243,13 +311,23 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
     if (esl_opt_GetInteger(go, "--seed")==0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                                  fprintf(ofp, "# random number seed set to:       %d\n",        esl_opt_GetInteger(go, "--seed"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
+  if (esl_opt_IsUsed(go, "--timing")     && fprintf(ofp, "# pipeline stage timing:           on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--memstats")   && fprintf(ofp, "# pipeline memory statistics:      on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--membudget")  && fprintf(ofp, "# pipeline memory budget:          %d MB\n", esl_opt_GetInteger(go, "--membudget"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--nommap")     && fprintf(ofp, "# memory-mapped pressed database:  off\n")                                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hugepages")  && fprintf(ofp, "# hugepages for big buffers:       %s\n", esl_opt_GetString(go, "--hugepages"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--qformat")   && fprintf(ofp, "# input seqfile format asserted:   %s\n",            esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--progress")  && fprintf(ofp, "# progress reports to:             %s\n",            esl_opt_GetString(go, "--progress"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--progress_int") && fprintf(ofp, "# progress report interval (s):    %g\n",         esl_opt_GetReal(go, "--progress_int")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
                                            
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")) {
     if (esl_opt_GetInteger(go, "--cpu") == 0) { if (fprintf(ofp, "# multithread parallelization:     off\n")                                         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
     else                                      { if (fprintf(ofp, "# multithread parallelization:     %d workers\n", esl_opt_GetInteger(go, "--cpu")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
   }
+  if (esl_opt_IsUsed(go, "--asyncout")   && fprintf(ofp, "# query output overlapped:        yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cpubind")    && fprintf(ofp, "# worker threads pinned to:        %s\n",             esl_opt_GetString(go, "--cpubind"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--readercpu")  && fprintf(ofp, "# reader threads pinned to cpu:    %d\n",             esl_opt_GetInteger(go, "--readercpu")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
 #ifdef HMMER_MPI
   if (esl_opt_IsUsed(go, "--mpi")       && fprintf(ofp, "# MPI:                             on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -325,9 +403,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  FILE            *binfp    = NULL;              /* binary result file (--binout)                   */
+  P7_BINOUT       *bo       = NULL;              /* writer for <binfp>                              */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
   P7_HMMFILE      *hfp      = NULL;		 /* open HMM database file                          */
+  P7_HMMCACHE     *hcache   = NULL;              /* <hmmdb> held in memory (--cache)                */
   ESL_ALPHABET    *abc      = NULL;              /* sequence alphabet                               */
   P7_OPROFILE     *om       = NULL;		 /* target profile                                  */
   ESL_STOPWATCH   *w        = NULL;              /* timing                                          */
@@ -343,11 +424,21 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;     /* the other workers' hit lists, for p7_tophits_MergeMany() */
+  P7_PROGRESS     *prog     = NULL;     /* progress reports (--progress), or NULL                   */
+  FILE            *progfp   = NULL;
+  struct stat      st;
 #ifdef HMMER_THREADS
   P7_OM_BLOCK     *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  P7_CPUBIND      *cpubind  = NULL;
+  pthread_t        outthread;           /* --asyncout: writing the previous query's output */
+  int              outbusy  = FALSE;    /*   ... TRUE while it is                          */
+  int              asyncout = FALSE;
 #endif
+  QUERY_OUTPUT     qo;
+  ESL_SQ          *tmpsq;
   char             errbuf[eslERRBUFSIZE];
 
   w = esl_stopwatch_Create();
@@ -375,6 +466,21 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   p7_oprofile_Destroy(om);
   p7_hmmfile_Close(hfp);
+  hfp = NULL;
+
+  /* With --cache, read the whole database now, and search every
+   * query against the same profiles instead of rereading them for
+   * each one. The pressed files stay mapped, so a second hmmscan on
+   * this host shares their pages rather than loading them again.
+   */
+  if (esl_opt_GetBoolean(go, "--cache"))
+    {
+      status = p7_hmmcache_Open(cfg->hmmfile, &hcache, errbuf);
+      if      (status == eslENOTFOUND) p7_Fail("File existence/permissions problem in trying to open HMM file %s.\n%s\n", cfg->hmmfile, errbuf);
+      else if (status == eslEFORMAT)   p7_Fail("File format problem, trying to read HMM file %s.\n%s\n",                  cfg->hmmfile, errbuf);
+      else if (status == eslEINCOMPAT) p7_Fail("HMM file %s contains different alphabets",                             cfg->hmmfile);
+      else if (status != eslOK)        p7_Fail("Unexpected error %d in reading HMM file %s.\n%s\n",              status, cfg->hmmfile, errbuf);
+    }
 
   /* Open the query sequence database */
   status = esl_sqfile_OpenDigital(abc, cfg->seqfile, seqfmt, NULL, &sqfp);
@@ -389,12 +495,21 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (esl_opt_IsOn(go, "--binout"))    { if ((binfp    = fopen(esl_opt_GetString(go, "--binout"),    "wb")) == NULL) esl_fatal("Failed to open binary result file %s for writing\n", esl_opt_GetString(go, "--binout"));
+                                         if (p7_binout_Create(binfp, "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, &bo) != eslOK)       esl_fatal("Failed to write binary result file header\n"); }
 
   output_header(ofp, go, cfg->hmmfile, cfg->seqfile);
 
 #ifdef HMMER_THREADS
   /* initialize thread data */
   ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (esl_opt_IsOn(go, "--cpubind") || esl_opt_IsOn(go, "--readercpu"))
+    {
+      status = p7_cpubind_Create(esl_opt_GetString(go, "--cpubind"), (esl_opt_IsOn(go, "--readercpu") ? esl_opt_GetInteger(go, "--readercpu") : -1), &cpubind, errbuf);
+      if      (status == eslEUNIMPLEMENTED) fprintf(stderr, "Warning: %s\n", errbuf);
+      else if (status != eslOK)             p7_Fail("%s\n", errbuf);
+      p7_cpubind_Reader(cpubind);   /* before any thread starts: they inherit it */
+    }
   if (ncpus > 0)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
@@ -404,12 +519,40 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
+
+#ifdef HMMER_THREADS
+  asyncout = (ncpus > 0 && esl_opt_GetBoolean(go, "--asyncout"));
+#endif
+
+  /* the queries are the work: done is how far into <seqfile> we've got, if it's a whole file */
+  if (esl_opt_IsOn(go, "--progress"))
+    {
+      if (strcmp(esl_opt_GetString(go, "--progress"), "-") == 0) progfp = stderr;
+      else if ((progfp = fopen(esl_opt_GetString(go, "--progress"), "w")) == NULL) p7_Fail("Failed to open progress report file %s for writing\n", esl_opt_GetString(go, "--progress"));
+      if ((prog = p7_progress_Create(progfp, (progfp != stderr), esl_opt_GetReal(go, "--progress_int"), infocnt, p7_SCAN_MODELS)) == NULL) p7_Fail("Failed to start progress reports");
+      if (esl_sqfile_IsRewindable(sqfp) && stat(cfg->seqfile, &st) == 0) p7_progress_SetTotal(prog, (double) st.st_size, FALSE);
+    }
+
+  qo.ofp       = ofp;
+  qo.tblfp     = tblfp;
+  qo.domtblfp  = domtblfp;
+  qo.pfamtblfp = pfamtblfp;
+  qo.bo        = bo;
+  qo.textw     = textw;
+  qo.ncpus     = ncpus;
+  qo.qsq       = esl_sq_CreateDigital(abc);
+  qo.status    = eslOK;
 
   for (i = 0; i < infocnt; ++i)
     {
-      info[i].bg    = p7_bg_Create(abc);
+      info[i].bg     = p7_bg_Create(abc);
+      info[i].cached = (hcache != NULL);
+      info[i].prog   = prog;
+      info[i].idx    = i;
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].queue  = queue;
+      info[i].cpubind = cpubind;
 #endif
     }
 
@@ -429,30 +572,33 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       nquery++;
       esl_stopwatch_Start(w);	                          
+      p7_progress_NewQuery(prog, nquery, qsq->name);
 
-      /* Open the target profile database */
-      status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
-      if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
+      /* Open the target profile database, unless it's cached */
+      if (hcache == NULL)
+	{
+	  status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
+	  if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
+	  if (esl_opt_GetBoolean(go, "--nommap")) p7_hmmfile_Unmap(hfp);
   
 #ifdef HMMER_THREADS
-      /* if we are threaded, create a lock to prevent multiple readers */
-      if (ncpus > 0)
-	{
-	  status = p7_hmmfile_CreateLock(hfp);
-	  if (status != eslOK) p7_Fail("Unexpected error %d creating lock\n", status);
-	}
+	  /* if we are threaded, create a lock to prevent multiple readers */
+	  if (ncpus > 0)
+	    {
+	      status = p7_hmmfile_CreateLock(hfp);
+	      if (status != eslOK) p7_Fail("Unexpected error %d creating lock\n", status);
+	    }
 #endif
-
-      if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	}
 
       for (i = 0; i < infocnt; ++i)
 	{
 	  /* Create processing pipeline and hit list */
 	  info[i].th  = p7_tophits_Create(); 
 	  info[i].pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
-	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+	  if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(info[i].pli, TRUE);
+	  if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(info[i].pli, TRUE);
+	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp>; NULL for complete, cached profiles */
 
 	  p7_pli_NewSeq(info[i].pli, qsq);
 	  info[i].qsq = qsq;
@@ -463,10 +609,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	}
 
 #ifdef HMMER_THREADS
-      if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp);
-      else	      hstatus = serial_loop(info, hfp);
+      if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp, hcache, qsq->n, prog);
+      else	      hstatus = serial_loop(info, hfp, hcache);
 #else
-      hstatus = serial_loop(info, hfp);
+      hstatus = serial_loop(info, hfp, hcache);
 #endif
       switch(hstatus)
 	{
@@ -475,38 +621,62 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	case eslEOF: 	  /* do nothing */                                                 	  break;
 	default: 	   p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile); 
 	}
+      p7_progress_SetDone(prog, (double) ESL_MAX(qsq->roff, qsq->eoff));
 
       /* merge the results of the search results */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeMany(info[0].th, thl, infocnt-1);
       for (i = 1; i < infocnt; ++i)
 	{
-	  p7_tophits_Merge(info[0].th, info[i].th);
 	  p7_pipeline_Merge(info[0].pli, info[i].pli);
 
 	  p7_pipeline_Destroy(info[i].pli);
 	  p7_tophits_Destroy(info[i].th);
 	}
 
-      /* Print results */
-      p7_tophits_SortBySortkey(info->th);
-      p7_tophits_Threshold(info->th, info->pli);
-
-      p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      if (hfp) p7_hmmfile_Close(hfp);
+      hfp = NULL;
+      info->pli->hfp = NULL;
 
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsq->name, qsq->acc, info->th, info->pli);
-
-      esl_stopwatch_Stop(w);
-      p7_pli_Statistics(ofp, info->pli, w);
-      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      fflush(ofp);
-
-      p7_hmmfile_Close(hfp);
-      p7_pipeline_Destroy(info->pli);
-      p7_tophits_Destroy(info->th);
+      /* Output the results. With --asyncout, the previous query's
+       * output must be finished first, so at most one query's results
+       * wait on the output thread, and queries come out in order. The
+       * query sequence goes with them; we read the next one into the
+       * previous query's.
+       */
+#ifdef HMMER_THREADS
+      if (outbusy)
+	{
+	  pthread_join(outthread, NULL);
+	  outbusy = FALSE;
+	  if (qo.status != eslOK) return qo.status;
+	}
+#endif
+      tmpsq     = qo.qsq;
+      qo.qsq    = qsq;
+      qsq       = tmpsq;
+      qo.pli    = info->pli;
+      qo.th     = info->th;
+      qo.w      = *w;
+      qo.nquery = nquery;
+#ifdef HMMER_THREADS
+      if (asyncout)
+	{
+	  if (pthread_create(&outthread, NULL, output_thread, &qo) != 0) p7_Fail("Failed to start output thread");
+	  outbusy = TRUE;
+	}
+      else
+#endif
+      if ((status = output_query(&qo)) != eslOK) return status;
       esl_sq_Reuse(qsq);
     }
+#ifdef HMMER_THREADS
+  if (outbusy)
+    {
+      pthread_join(outthread, NULL);
+      if (qo.status != eslOK) return qo.status;
+    }
+#endif
   if      (sstatus == eslEFORMAT) esl_fatal("Parse failed (sequence file %s):\n%s\n",
 					    sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
   else if (sstatus != eslEOF)     esl_fatal("Unexpected error %d reading sequence file %s",
@@ -517,6 +687,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)    p7_tophits_TabularTail(tblfp,    "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, go);
   if (domtblfp) p7_tophits_TabularTail(domtblfp, "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, go);
   if (pfamtblfp)p7_tophits_TabularTail(pfamtblfp,"hmmscan", p7_SEARCH_SEQS, cfg->seqfile, cfg->hmmfile, go);
+  if (bo && p7_binout_WriteIndex(bo) != eslOK) p7_Fail("Failed to write binary result index");
   if (ofp)      { if (fprintf(ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
   /* Cleanup - prepare for successful exit
@@ -533,25 +704,89 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
     }
+  p7_cpubind_Destroy(cpubind);
 #endif
 
   free(info);
+  free(thl);
+  p7_progress_Destroy(prog);
 
   esl_sq_Destroy(qsq);
+  esl_sq_Destroy(qo.qsq);
   esl_stopwatch_Destroy(w);
   esl_alphabet_Destroy(abc);
   esl_sqfile_Close(sqfp);
+  if (hcache)        p7_hmmcache_Close(hcache);
 
   if (ofp != stdout) fclose(ofp);
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (bo)            p7_binout_Close(bo);
+  if (binfp)         fclose(binfp);
   return eslOK;
 
  ERROR:
   return status;
 }
 
+/* output_query()
+ * Sort and threshold the hits of a finished query and write all its
+ * outputs, then free its pipeline and hit list. Runs on the master
+ * thread, or with --asyncout on output_thread() while the workers
+ * search the next query; only this writes to the output files while
+ * a query's output is pending.
+ */
+static int
+output_query(QUERY_OUTPUT *qo)
+{
+  ESL_SQ      *qsq = qo->qsq;
+  P7_PIPELINE *pli = qo->pli;
+  P7_TOPHITS  *th  = qo->th;
+  FILE        *ofp = qo->ofp;
+
+  if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  p7_tophits_SortBySortkey(th);
+  p7_tophits_Threshold(th, pli);
+
+  p7_tophits_Targets(ofp, th, pli, qo->textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  p7_tophits_DomainsThreaded(ofp, th, pli, qo->textw, qo->ncpus); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  if (qo->tblfp)     p7_tophits_TabularTargets(qo->tblfp,    qsq->name, qsq->acc, th, pli, (qo->nquery == 1));
+  if (qo->domtblfp)  p7_tophits_TabularDomains(qo->domtblfp, qsq->name, qsq->acc, th, pli, (qo->nquery == 1));
+  if (qo->pfamtblfp) p7_tophits_TabularXfam(qo->pfamtblfp, qsq->name, qsq->acc, th, pli);
+  if (qo->bo && p7_binout_WriteQuery(qo->bo, qsq->name, qsq->acc, th, pli) != eslOK) p7_Fail("Failed to write binary results");
+
+  esl_stopwatch_Stop(&(qo->w));
+  p7_pli_Statistics(ofp, pli, &(qo->w));
+  if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  fflush(ofp);
+
+  p7_pipeline_Destroy(pli);
+  p7_tophits_Destroy(th);
+  qo->pli = NULL;
+  qo->th  = NULL;
+  return eslOK;
+}
+
+#ifdef HMMER_THREADS
+/* output_thread()
+ * --asyncout: output_query() on a thread of its own. The master
+ * joins it before handing over the next query.
+ */
+static void *
+output_thread(void *arg)
+{
+  QUERY_OUTPUT *qo = (QUERY_OUTPUT *) arg;
+
+  qo->status = output_query(qo);
+  return NULL;
+}
+#endif
+
 #ifdef HMMER_MPI
 
 /* Define common tags used by the MPI master/slave processes */
@@ -565,6 +800,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #define HMMER_TERMINATING_TAG    8
 #define HMMER_READY_TAG          9
 
+/* Each worker keeps HMMER_BLOCKS_AHEAD block requests outstanding, so
+ * that its next block has arrived by the time it finishes one. Results
+ * are merged up a tree of ranks, HMMER_MERGE_FANOUT children per rank.
+ */
+#define HMMER_BLOCKS_AHEAD       2
+#define HMMER_MERGE_FANOUT       4
+
 /* mpi_failure()
  * Generate an error message.  If the clients rank is not 0, a
  * message is created with the error message and sent to the
@@ -724,6 +966,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;		 /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;	  	 /* output stream for tabular per-seq (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
+  FILE            *binfp    = NULL;              /* binary result file (--binout)                   */
+  P7_BINOUT       *bo       = NULL;              /* writer for <binfp>                              */
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
   P7_BG           *bg       = NULL;	         /* null model                                      */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
@@ -791,6 +1035,11 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     mpi_failure("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp"));
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
+
+  if (esl_opt_IsOn(go, "--binout") && (binfp = fopen(esl_opt_GetString(go, "--binout"), "wb")) == NULL)
+    mpi_failure("Failed to open binary result file %s for writing\n", esl_opt_GetString(go, "--binout"));
+  if (binfp && p7_binout_Create(binfp, "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, &bo) != eslOK)
+    mpi_failure("Failed to write binary result file header\n");
  
   ESL_ALLOC(list, sizeof(MSV_BLOCK));
   list->complete = 0;
@@ -819,6 +1068,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Open the target profile database */
       status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
       if (status != eslOK) mpi_failure("Unexpected error %d in opening hmm file %s.\n", status, cfg->hmmfile);  
+      if (esl_opt_GetBoolean(go, "--nommap")) p7_hmmfile_Unmap(hfp);
   
       if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
       if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -827,6 +1077,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+      if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(pli, TRUE);
+      if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(pli, TRUE);
       pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
       p7_pli_NewSeq(pli, qsq);
@@ -873,10 +1125,15 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       block.length = 0;
       block.count  = 0;
 
-      /* wait for all workers to finish up their work blocks */
-      for (i = 1; i < cfg->nproc; ++i)
+      /* Answer each worker's HMMER_BLOCKS_AHEAD outstanding requests
+       * with an empty block, which tells it the database is done. Go
+       * one worker at a time: one that has had all its empty blocks may
+       * already be asking for blocks for the next query.
+       */
+      for (dest = 1; dest < cfg->nproc; ++dest)
+	for (i = 0; i < HMMER_BLOCKS_AHEAD; ++i)
 	{
-	  if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
+	  if (MPI_Probe(dest, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
 	    mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
 
 	  MPI_Get_count(&mpistatus, MPI_PACKED, &size);
@@ -886,38 +1143,23 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    mpi_size = size; 
 	  }
 
-	  dest = mpistatus.MPI_SOURCE;
 	  MPI_Recv(mpi_buf, size, MPI_PACKED, dest, mpistatus.MPI_TAG, MPI_COMM_WORLD, &mpistatus);
 
 	  if (mpistatus.MPI_TAG == HMMER_ERROR_TAG)
 	    mpi_failure("MPI client %d raised error:\n%s\n", dest, mpi_buf);
 	  if (mpistatus.MPI_TAG != HMMER_READY_TAG)
 	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
-	}
 
-      /* merge the results of the search results */
-      for (dest = 1; dest < cfg->nproc; ++dest)
-	{
-	  P7_PIPELINE     *mpi_pli   = NULL;
-	  P7_TOPHITS      *mpi_th    = NULL;
-
-	  /* send an empty block to signal the worker they are done */
 	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
-
-	  /* wait for the results */
-	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
-	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
-
-	  if ((status = p7_pipeline_MPIRecv(dest, HMMER_PIPELINE_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, go, &mpi_pli)) != eslOK)
-	    mpi_failure("Unexpected error %d receiving pipeline from %d", status, dest);
-
-	  p7_tophits_Merge(th, mpi_th);
-	  p7_pipeline_Merge(pli, mpi_pli);
-
-	  p7_pipeline_Destroy(mpi_pli);
-	  p7_tophits_Destroy(mpi_th);
 	}
 
+      /* merge the results of the search; the workers merge theirs up
+       * a tree, so we only receive those of our own children.
+       */
+      if ((status = p7_tophits_MPIReduce(th, pli, 0, cfg->nproc, HMMER_MERGE_FANOUT, HMMER_TOPHITS_TAG, HMMER_PIPELINE_TAG,
+					 MPI_COMM_WORLD, go, &mpi_buf, &mpi_size)) != eslOK)
+	mpi_failure("Unexpected error %d merging search results", status);
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(th);
       p7_tophits_Threshold(th, pli);
@@ -927,6 +1169,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, th, pli, (nquery == 1));
       if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, th, pli, (nquery == 1));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp,   qsq->name, qsq->acc, th, pli);
+      if (bo && p7_binout_WriteQuery(bo, qsq->name, qsq->acc, th, pli) != eslOK) p7_Fail("Failed to write binary results");
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, pli, w);
@@ -969,6 +1212,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)    p7_tophits_TabularTail(tblfp,    "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, go);
   if (domtblfp) p7_tophits_TabularTail(domtblfp, "hmmscan", p7_SCAN_MODELS, cfg->seqfile, cfg->hmmfile, go);
   if (pfamtblfp)p7_tophits_TabularTail(pfamtblfp, "hmmscan", p7_SEARCH_SEQS, cfg->seqfile, cfg->hmmfile, go);
+  if (bo && p7_binout_WriteIndex(bo) != eslOK) p7_Fail("Failed to write binary result index");
   if (ofp)      { if (fprintf(ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
   /* Cleanup - prepare for successful exit
@@ -986,6 +1230,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (bo)            p7_binout_Close(bo);
+  if (binfp)         fclose(binfp);
 
   return eslOK;
 
@@ -998,7 +1244,6 @@ static int
 mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 {
   int              seqfmt   = eslSQFILE_UNKNOWN; /* format of seqfile                               */
-  P7_BG           *bg       = NULL;	         /* null model                                      */
   ESL_SQFILE      *sqfp     = NULL;              /* open seqfile                                    */
   P7_HMMFILE      *hfp      = NULL;		 /* open HMM database file                          */
   ESL_ALPHABET    *abc      = NULL;              /* sequence alphabet                               */
@@ -1008,15 +1253,35 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              status   = eslOK;
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
+  int              i;
+  int              ncpus    = 0;
+
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;              /* the other threads' hit lists, for p7_tophits_MergeMany() */
+#ifdef HMMER_THREADS
+  P7_OM_BLOCK     *omblock  = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+  void            *newBlock;
+#endif
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures */
   int              mpi_size = 0;                 /* size of the allocated buffer */
 
+  MSV_BLOCK        ahead[HMMER_BLOCKS_AHEAD];    /* blocks on their way from the master */
+  MPI_Request      req[HMMER_BLOCKS_AHEAD];      /* persistent receives into <ahead>    */
+  int              s;
+  int              nempty;
+
   MPI_Status       mpistatus;
   char             errbuf[eslERRBUFSIZE];
 
   w = esl_stopwatch_Create();
 
+  for (s = 0; s < HMMER_BLOCKS_AHEAD; s++)
+    MPI_Recv_init(&ahead[s], 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &req[s]);
+
   /* Open the target profile database to get the sequence alphabet */
   status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, errbuf);
   if      (status == eslENOTFOUND) mpi_failure("File existence/permissions problem in trying to open HMM file %s.\n%s\n", cfg->hmmfile, errbuf);
@@ -1040,54 +1305,139 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status != eslOK)        mpi_failure("Unexpected error %d opening sequence file %s\n", status, cfg->seqfile);
 
   qsq = esl_sq_CreateDigital(abc);
-  bg = p7_bg_Create(abc);
+
+  /* With --cpu, this rank searches its blocks with a pool of threads,
+   * the same way the threaded version does, rather than alone: then
+   * one rank per node (or socket) will do, instead of one per core.
+   */
+#ifdef HMMER_THREADS
+  if (esl_opt_IsUsed(go, "--cpu")) ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue     = esl_workqueue_Create(ncpus * 2);
+      for (i = 0; i < ncpus * 2; ++i)
+	{
+	  if ((omblock = p7_oprofile_CreateBlock(BLOCK_SIZE)) == NULL) mpi_failure("Failed to allocate profile block");
+	  if (esl_workqueue_Init(queue, omblock) != eslOK)            mpi_failure("Failed to add block to work queue");
+	}
+    }
+#endif
+
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  ESL_ALLOC(info, sizeof(WORKER_INFO)  * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
+  for (i = 0; i < infocnt; ++i)
+    {
+      info[i].bg     = p7_bg_Create(abc);
+      info[i].cached = FALSE;
+#ifdef HMMER_THREADS
+      info[i].queue  = queue;
+      info[i].cpubind = NULL;
+#endif
+    }
 
   /* Outside loop: over each query sequence in <seqfile>. */
   while ((sstatus = esl_sqio_Read(sqfp, qsq)) == eslOK)
     {
-      P7_PIPELINE     *pli     = NULL;		/* processing pipeline                      */
-      P7_TOPHITS      *th      = NULL;        	/* top-scoring sequence hits                */
-
       MSV_BLOCK        block;
 
       esl_stopwatch_Start(w);
 
+      /* ask for our first blocks, one per receive */
       status = 0;
-      MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      for (s = 0; s < HMMER_BLOCKS_AHEAD; s++)
+	{
+	  MPI_Start(&req[s]);
+	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+	}
 
       /* Open the target profile database */
       status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
       if (status != eslOK) mpi_failure("Unexpected error %d in opening hmm file %s.\n", status, cfg->hmmfile);  
+      if (esl_opt_GetBoolean(go, "--nommap")) p7_hmmfile_Unmap(hfp);
+#ifdef HMMER_THREADS
+      /* if we are threaded, create a lock to prevent multiple readers */
+      if (ncpus > 0 && (status = p7_hmmfile_CreateLock(hfp)) != eslOK) mpi_failure("Unexpected error %d creating lock\n", status);
+#endif
   
-      /* Create processing pipeline and hit list */
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
-      pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+      for (i = 0; i < infocnt; ++i)
+	{
+	  /* Create processing pipeline and hit list */
+	  info[i].th  = p7_tophits_Create(); 
+	  info[i].pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
+	  if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(info[i].pli, TRUE);
+	  if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(info[i].pli, TRUE);
+	  info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
 
-      p7_pli_NewSeq(pli, qsq);
+	  p7_pli_NewSeq(info[i].pli, qsq);
+	  info[i].qsq = qsq;
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
+
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{
+	  esl_workqueue_Reset(queue);
+	  esl_threads_WaitForStart(threadObj);
+	  if (esl_workqueue_ReaderUpdate(queue, NULL, &newBlock) != eslOK) mpi_failure("Work queue reader failed");
+	}
+#endif
 
-      /* receive a sequence block from the master */
-      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-      while (block.count > 0)
+      /* Blocks arrive in the order they were asked for. An empty one
+       * answers a request made after the database ran out; when all of
+       * ours have come back empty, we're done.
+       */
+      for (s = 0, nempty = 0; nempty < HMMER_BLOCKS_AHEAD; s = (s+1) % HMMER_BLOCKS_AHEAD)
 	{
 	  uint64_t length = 0;
-	  uint64_t count  = block.count;
+	  uint64_t count;
+
+	  MPI_Wait(&req[s], &mpistatus);
+	  block = ahead[s];
+	  if (block.count == 0) { nempty++; continue; }
+
+	  /* ask for another block now, so it arrives while we search this one */
+	  status = 0;
+	  MPI_Start(&req[s]);
+	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+
+	  count = block.count;
 
 	  hstatus = p7_oprofile_Position(hfp, block.offset);
 	  if (hstatus != eslOK) mpi_failure("Cannot position optimized model to %ld\n", block.offset);
 
+#ifdef HMMER_THREADS
+	  if (ncpus > 0)
+	    { /* hand the block's profiles to the threads, up to BLOCK_SIZE at a time */
+	      while (count > 0)
+		{
+		  omblock = (P7_OM_BLOCK *) newBlock;
+		  for (omblock->count = 0; count > 0 && omblock->count < omblock->listSize; omblock->count++, count--)
+		    {
+		      if ((hstatus = p7_oprofile_ReadMSV(hfp, &abc, &omblock->list[omblock->count])) != eslOK) break;
+		      length = omblock->list[omblock->count]->eoff - block.offset + 1;
+		    }
+		  if (omblock->count > 0 && esl_workqueue_ReaderUpdate(queue, omblock, &newBlock) != eslOK) mpi_failure("Work queue reader failed");
+		  if (hstatus != eslOK) break;
+		}
+	    }
+	  else
+#endif
 	  while (count > 0 && (hstatus = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
 	    {
 	      length = om->eoff - block.offset + 1;
 
-	      p7_pli_NewModel(pli, om, bg);
-	      p7_bg_SetLength(bg, qsq->n);
+	      p7_pli_NewModel(info->pli, om, info->bg);
+	      p7_bg_SetLength(info->bg, qsq->n);
 	      p7_oprofile_ReconfigLength(om, qsq->n);
 	      
-	      p7_Pipeline(pli, om, bg, qsq, NULL, th);
+	      p7_Pipeline(info->pli, om, info->bg, qsq, NULL, info->th);
 	      
 	      p7_oprofile_Destroy(om);
-	      p7_pipeline_Reuse(pli);
+	      p7_pipeline_Reuse(info->pli);
 
 	      --count;
 	    }
@@ -1115,24 +1465,40 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    }
 	  if (block.length != length) 
 	    mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length, block.offset);
+	}
 
-	  /* inform the master we need another block of sequences */
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
-
-	  /* wait for the next block of sequences */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{ /* an empty block for each thread tells it we're done */
+	  for (i = 0; i <= ncpus; ++i)
+	    {
+	      omblock = (P7_OM_BLOCK *) newBlock;
+	      omblock->count = 0;
+	      if (esl_workqueue_ReaderUpdate(queue, omblock, (i < ncpus ? &newBlock : NULL)) != eslOK) mpi_failure("Work queue reader failed");
+	    }
+	  esl_threads_WaitForFinish(threadObj);
+	  esl_workqueue_Complete(queue);
 	}
+#endif
 
       esl_stopwatch_Stop(w);
 
-      /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      /* merge the threads' results */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeMany(info[0].th, thl, infocnt-1);
+      for (i = 1; i < infocnt; ++i) p7_pipeline_Merge(info[0].pli, info[i].pli);
+
+      /* Merge in our children's top hits, and send them all on up the tree. */
+      if ((status = p7_tophits_MPIReduce(info[0].th, info[0].pli, cfg->my_rank, cfg->nproc, HMMER_MERGE_FANOUT, HMMER_TOPHITS_TAG, HMMER_PIPELINE_TAG,
+					 MPI_COMM_WORLD, go, &mpi_buf, &mpi_size)) != eslOK)
+	mpi_failure("Unexpected error %d merging search results", status);
 
       p7_hmmfile_Close(hfp);
-      p7_pipeline_Destroy(pli);
-      p7_tophits_Destroy(th);
+      for (i = 0; i < infocnt; ++i)
+	{
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
+	}
       esl_sq_Reuse(qsq);
     } /* end outer loop over query HMMs */
   if (sstatus == eslEFORMAT) 
@@ -1143,9 +1509,24 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   status = 0;
   MPI_Send(&status, 1, MPI_INT, 0, HMMER_TERMINATING_TAG, MPI_COMM_WORLD);
 
-  if (mpi_buf != NULL) free(mpi_buf);
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &omblock) == eslOK)
+	p7_oprofile_DestroyBlock(omblock);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+  free(info);
+  free(thl);
 
-  p7_bg_Destroy(bg);
+  for (s = 0; s < HMMER_BLOCKS_AHEAD; s++)
+    MPI_Request_free(&req[s]);
+  if (mpi_buf != NULL) free(mpi_buf);
 
   esl_sq_Destroy(qsq);
   esl_stopwatch_Destroy(w);
@@ -1153,16 +1534,50 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   esl_sqfile_Close(sqfp);
 
   return eslOK;
+
+ ERROR:
+  mpi_failure("Allocation failed");
+  return eslEMEM;
 }
 #endif /*HMMER_MPI*/
 
 static int
-serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
+serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp, P7_HMMCACHE *hcache)
 {
   int            status;
+  int            i;
 
   P7_OPROFILE   *om;
   ESL_ALPHABET  *abc = NULL;
+  int            n   = 0;
+  double         t0  = (info->prog ? p7_progress_Now() : 0.);
+  double         t1;
+
+  /* Cached profiles are complete, and stay in the cache for the next query */
+  if (hcache)
+    {
+      for (i = 0; i < hcache->n; i++)
+	{
+	  om = hcache->list[i];
+	  p7_pli_NewModel(info->pli, om, info->bg);
+	  p7_bg_SetLength(info->bg, info->qsq->n);
+	  p7_oprofile_ReconfigLength(om, info->qsq->n);
+
+	  status = p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
+	  if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
+
+	  if (info->prog && ++n % SERIAL_PROGRESS_TICK == 0)
+	    {
+	      t1 = p7_progress_Now();
+	      p7_progress_Worker(info->prog, 0, info->pli, t1 - t0, 0.);
+	      t0 = t1;
+	    }
+	  p7_pipeline_Reuse(info->pli);
+	}
+      if (info->prog) p7_progress_Worker(info->prog, 0, info->pli, p7_progress_Now() - t0, 0.);
+      return eslEOF;
+    }
+
   /* Main loop: */
   while ((status = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
     {
@@ -1173,9 +1588,16 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
       status = p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
       if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
 
+      if (info->prog && ++n % SERIAL_PROGRESS_TICK == 0)
+	{
+	  t1 = p7_progress_Now();
+	  p7_progress_Worker(info->prog, 0, info->pli, t1 - t0, 0.);
+	  t0 = t1;
+	}
       p7_oprofile_Destroy(om);
       p7_pipeline_Reuse(info->pli);
     }
+  if (info->prog) p7_progress_Worker(info->prog, 0, info->pli, p7_progress_Now() - t0, 0.);
 
   esl_alphabet_Destroy(abc);
 
@@ -1184,14 +1606,16 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp, P7_HMMCACHE *hcache, int L, P7_PROGRESS *prog)
 {
   int  status   = eslOK;
   int  sstatus  = eslOK;
   int  eofCount = 0;
+  int  next     = 0;	/* next cached profile to hand out */
   P7_OM_BLOCK   *block;
   ESL_ALPHABET  *abc = NULL;
   void          *newBlock;
+  double         t0;
 
   esl_workqueue_Reset(queue);
   esl_threads_WaitForStart(obj);
@@ -1202,8 +1626,8 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
   /* Main loop: */
   while (sstatus == eslOK)
     {
-      block = (P7_OM_BLOCK *) newBlock;
-      sstatus = p7_oprofile_ReadBlockMSV(hfp, &abc, block);
+      block   = (P7_OM_BLOCK *) newBlock;
+      sstatus = fill_block(block, hfp, &abc, hcache, &next, L);
       if (sstatus == eslEOF)
 	{
 	  if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
@@ -1212,8 +1636,11 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
 	  
       if (sstatus == eslOK)
 	{
+	  p7_PROBE1(block__handoff, block->count);
+	  t0     = (prog ? p7_progress_Now() : 0.);
 	  status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
 	  if (status != eslOK) esl_fatal("Work queue reader failed");
+	  if (prog) p7_progress_ReaderWait(prog, p7_progress_Now() - t0);
 	}
     }
 
@@ -1231,6 +1658,37 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
   return sstatus;
 }
 
+/* fill_block()
+ * Fill <block> with the next profiles for a query of length <L>:
+ * up to its listSize of them, but no more once their MSV cost
+ * reaches BLOCK_CELLS. With a cache <hcache>, lend the threads the
+ * cache's own profiles from <*next> on; else read them from <hfp>.
+ * Returns <eslOK>, or <eslEOF> if there were none left; or the
+ * error from reading the file.
+ */
+static int
+fill_block(P7_OM_BLOCK *block, P7_HMMFILE *hfp, ESL_ALPHABET **abc, P7_HMMCACHE *hcache, int *next, int L)
+{
+  int64_t cells  = 0;
+  int     status = eslOK;
+
+  block->count = 0;
+  while (block->count < block->listSize && cells < BLOCK_CELLS)
+    {
+      if (hcache)
+	{
+	  if (*next >= hcache->n) { status = eslEOF; break; }
+	  block->list[block->count] = hcache->list[(*next)++];
+	}
+      else if ((status = p7_oprofile_ReadMSV(hfp, abc, &block->list[block->count])) != eslOK) break;
+
+      cells += (int64_t) block->list[block->count]->M * ESL_MAX(L, 1);
+      block->count++;
+    }
+  if (status == eslEOF && block->count > 0) status = eslOK;
+  return status;
+}
+
 static void 
 pipeline_thread(void *arg)
 {
@@ -1241,6 +1699,7 @@ pipeline_thread(void *arg)
   ESL_THREADS   *obj;
   P7_OM_BLOCK   *block;
   void          *newBlock;
+  double         tw, tb, te;	/* --progress: when we began waiting for a block, began it, finished it */
   
   impl_Init();
 
@@ -1248,7 +1707,9 @@ pipeline_thread(void *arg)
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+  p7_cpubind_Worker(info->cpubind, workeridx);  /* before its DP matrices grow, so they're on its own NUMA node */
 
+  tw     = (info->prog ? p7_progress_Now() : 0.);
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
@@ -1257,23 +1718,23 @@ pipeline_thread(void *arg)
   while (block->count > 0)
   {
       /* Main loop: */
+    tb     = (info->prog ? p7_progress_Now() : 0.);
+    status = p7_Pipeline_ScanBlock(info->pli, block, info->bg, info->qsq, info->th);
+    if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
+
     for (i = 0; i < block->count; ++i)
     {
-      P7_OPROFILE *om = block->list[i];
-
-      p7_pli_NewModel(info->pli, om, info->bg);
-      p7_bg_SetLength(info->bg, info->qsq->n);
-      p7_oprofile_ReconfigLength(om, info->qsq->n);
-
-      status = p7_Pipeline(info->pli, om, info->bg, info->qsq, NULL, info->th);
-      if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
-
-      p7_oprofile_Destroy(om);
-      p7_pipeline_Reuse(info->pli);
-
+      if (! info->cached) p7_oprofile_Destroy(block->list[i]);
       block->list[i] = NULL;
     }
 
+    if (info->prog)
+    {
+      te = p7_progress_Now();
+      p7_progress_Worker(info->prog, info->idx, info->pli, te - tb, tb - tw);
+      tw = te;
+    }
+
     status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
     if (status != eslOK) esl_fatal("Work queue worker failed");
 
@@ -1283,6 +1744,8 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  /* sort our own hits while other threads may still be working, ready for the k-way merge */
+  p7_tophits_SortBySortkey(info->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
@@ -7,18 +7,22 @@
  */
 #include <p7_config.h>
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
 #include "esl_msa.h"
 #include "esl_msafile.h"
+#include "esl_random.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
 #include "esl_stopwatch.h"
+#include "esl_vectorops.h"
 
 #ifdef HMMER_MPI
 #include "mpi.h"
@@ -36,25 +40,62 @@
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  P7_CPUBIND       *cpubind;     /* --cpubind, --readercpu; or NULL         */
 #endif 
   P7_BG            *bg;	         /* null model                              */
   P7_PIPELINE      *pli;         /* work pipeline                           */
   P7_TOPHITS       *th;          /* top hit results                         */
   P7_OPROFILE      *om;          /* optimized query profile                 */
+  P7_TABSTREAM     *ts;          /* streamed tabular output, or NULL        */
+  int               streamonly;  /* TRUE to drop hits once they're streamed */
+  int               sqviews;     /* TRUE if targets are p7_seqdb views, not to be esl_sq_Reuse()'d */
+  P7_PROGRESS      *prog;        /* progress reports (--progress), or NULL  */
+  int               idx;         /* this worker's slot in <prog>            */
 } WORKER_INFO;
 
+/* one query's finished search, for output_query(); with --asyncout,
+ * written on a thread of its own while the next query is searched
+ */
+typedef struct {
+  ESL_GETOPTS      *go;
+  FILE             *ofp, *afp, *tblfp, *domtblfp, *pfamtblfp;
+  P7_BINOUT        *bo;
+  P7_TABSTREAM     *ts;
+  int               streamonly;
+  int               textw;
+  int               ncpus;
+  ESL_ALPHABET     *abc;
+
+  P7_HMM           *hmm;         /* the query; output_query() frees it, and <pli>, <th> */
+  P7_PIPELINE      *pli;         /* its merged pipeline                      */
+  P7_TOPHITS       *th;          /* its merged hit list                      */
+  ESL_STOPWATCH     w;           /* a copy of the query's running stopwatch  */
+  int               nquery;      /* 1.. */
+  int               status;      /* output_query()'s return, for the thread  */
+} QUERY_OUTPUT;
+
+static int   output_query(QUERY_OUTPUT *qo);
+#ifdef HMMER_THREADS
+static void *output_thread(void *arg);
+#endif
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
+/* --readers only applies to the threaded reader, not to MPI workers */
 #if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
+#define READEROPTS  "--mpi"
+#else
+#define READEROPTS  NULL
+#endif
+
+#ifdef HMMER_MPI
+#define STREAMOPTS  "--mpi"
 #else
-#define CPUOPTS     NULL
-#define MPIOPTS     NULL
+#define STREAMOPTS  NULL
 #endif
 
 static ESL_OPTIONS options[] = {
@@ -66,6 +107,9 @@ static ESL_OPTIONS options[] = {
   { "--tblout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-sequence hits to file <f>",        2 },
   { "--domtblout",  eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save parseable table of per-domain hits to file <f>",          2 },
   { "--pfamtblout", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save table of hits and domains to file, in Pfam format <f>",   2 },
+  { "--binout",     eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "save hits in compact binary format to file <f>",               2 },
+  { "--stream",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,"-Z,--domZ", STREAMOPTS,  "write --tblout/--domtblout rows as hits are found",             2 },
+  { "--streamonly", eslARG_NONE,   FALSE, NULL, NULL,    NULL,"--stream", "-A,--pfamtblout,--binout", "with --stream, don't keep hits for a sorted final report",2 },
   { "--acc",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "don't output alignments, so output is smaller",                2 },
   { "--notextw",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--textw",        "unlimit ASCII text output line width",                         2 },
@@ -75,6 +119,7 @@ static ESL_OPTIONS options[] = {
   { "-T",           eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  REPOPTS,         "report sequences >= this score threshold in output",           4 },
   { "--domE",       eslARG_REAL,  "10.0", NULL, "x>0",   NULL,  NULL,  DOMREPOPTS,      "report domains <= this E-value threshold in output",           4 },
   { "--domT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  DOMREPOPTS,      "report domains >= this score cutoff in output",                4 },
+  { "--topk",       eslARG_INT,    FALSE, NULL, "n>0",   NULL,  NULL,  "--stream",      "report only the <n> best sequences; skip work on the rest",    4 },
   /* Control of inclusion (significance) thresholds */
   { "--incE",       eslARG_REAL,  "0.01", NULL, "x>0",   NULL,  NULL,  INCOPTS,         "consider sequences <= this E-value threshold as significant",  5 },
   { "--incT",       eslARG_REAL,   FALSE, NULL, NULL,    NULL,  NULL,  INCOPTS,         "consider sequences >= this score threshold as significant",    5 },
@@ -90,20 +135,59 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,  "1e-3", NULL, NULL,    NULL,  NULL, "--max",          "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,    NULL,  NULL, "--max",          "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                             7 },
+  { "--adapt",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, "--max",          "tighten filters if far too many targets pass them",            7 },
+  { "--vitdom",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, NULL,             "define one-domain targets by their Viterbi path (faster)",     7 },
+  { "--seqscore_only", eslARG_NONE, FALSE, NULL, NULL,    NULL,  NULL, "-A,--domtblout,--vitdom", "per-sequence scores only: no Backward, no domains (faster)", 7 },
+  { "--dd_threads", eslARG_INT,    "0",   NULL, "n>=0",  NULL,  NULL, NULL,             "define domains of a multidomain target in <n> threads",        7 },
+  { "--dd_ramlimit", eslARG_INT,   "0",   NULL, "n>=0",  NULL,  NULL, NULL,             "cap full envelope DP matrices at <n> MB (0: no cap)",          7 },
+  { "--dd_nbatch",  eslARG_INT,    "0",   NULL, "n>=0",  NULL,  NULL, NULL,             "sample domain traces in batches of <n>, stopping early",       7 },
+  { "--dd_deferali", eslARG_NONE,  FALSE, NULL, NULL,    NULL,  NULL, NULL,             "align domains only of targets that are reported",              7 },
+  { "--dd_bf16",    eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL, NULL,             "keep envelope DP matrices in bfloat16 (half the memory)",      7 },
+
+#if defined (eslENABLE_SSE)
+  /* Control of FM pruning/extension, for an fmindex <seqdb> */
+  { "--seed_max_depth",    eslARG_INT,          "15", NULL, NULL,    NULL,  NULL, NULL,          "seed length at which bit threshold must be met",             9 },
+  { "--seed_sc_thresh",    eslARG_REAL,         "14", NULL, NULL,    NULL,  NULL, NULL,          "Default req. score for FM seed (bits)",                      9 },
+  { "--seed_sc_density",   eslARG_REAL,       "0.75", NULL, NULL,    NULL,  NULL, NULL,          "seed must maintain this bit density from one of two ends",   9 },
+  { "--seed_drop_max_len", eslARG_INT,           "4", NULL, NULL,    NULL,  NULL, NULL,          "maximum run length with score under (max - [fm_drop_lim])",  9 },
+  { "--seed_drop_lim",     eslARG_REAL,        "0.3", NULL, NULL,    NULL,  NULL, NULL,          "in seed, max drop in a run of length [fm_drop_max_len]",     9 },
+  { "--seed_req_pos",      eslARG_INT,           "5", NULL, NULL,    NULL,  NULL, NULL,          "minimum number consecutive positive scores in seed" ,        9 },
+  { "--seed_consens_match", eslARG_INT,         "11", NULL, NULL,    NULL,  NULL, NULL,          "<n> consecutive matches to consensus will override score threshold" , 9 },
+  { "--seed_ssv_length",   eslARG_INT,         "100", NULL, NULL,    NULL,  NULL, NULL,          "length of window around FM seed to get full SSV diagonal",   9 },
+  { "--seed_noprefilter",  eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL, NULL,          "search every sequence of an fmindex <seqdb>; no seed prefilter", 9 },
+  { "--seed_kmer",         eslARG_INT,           "8", NULL, "n>=0",  NULL,  NULL, NULL,          "look up seed intervals of strings up to length <n> in a table",  9 },
+#endif
 
 /* Other options */
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",               12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
+  { "--timing",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "report time spent in each stage of the pipeline",             12 },
+  { "--memstats",   eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "report memory high-water marks of the pipeline",              12 },
+  { "--membudget",  eslARG_INT,    NULL,  NULL, "n>0",   NULL,  NULL,  NULL,            "keep each pipeline under <n> MB of DP memory",                12 },
+  { "--hugepages",  eslARG_STRING, NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "put big buffers in hugepages: <s> = off|thp|2M|1G",           12 },
+  { "--nogpu",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "keep batch SSV filtering on the CPU, even with a GPU",        12 },
   { "--tformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "assert target <seqfile> is in format <s>: no autodetection",  12 },
+  { "--tlist",      eslARG_INFILE,  NULL, NULL, NULL,    NULL,  NULL,  NULL,            "only search the targets named in file <f>, found by SSI index", 12 },
 
 #ifdef HMMER_THREADS 
-  { "--cpu",        eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  CPUOPTS,      "number of parallel CPU workers to use for multithreads",      12 },
+  { "--cpu",        eslARG_STRING, p7_NCPU,"HMMER_NCPU",NULL,NULL,  NULL,  NULL,         "number of parallel CPU workers to use for multithreads, or auto", 12 },
+  { "--cpubind",    eslARG_STRING, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "pin workers to cpus: 'cores', 'sockets', or a list <s> (0-7,16)", 12 },
+  { "--readercpu",  eslARG_INT,    NULL, NULL, "n>=0",  NULL,  NULL,  NULL,            "reserve cpu <n> for the reader and output threads",           12 },
+  { "--nblocks",    eslARG_INT,    "2",  NULL, "n>0",   NULL,  NULL,  NULL,            "number of target blocks queued per worker thread",            12 },
+  { "--readahead",  eslARG_INT,    "0",  NULL, "n>=0",  NULL,  NULL,  NULL,            "keep <n> MB of <seqdb> read ahead of the parser (0: off)",    12 },
+  { "--asyncout",   eslARG_NONE,  FALSE, NULL, NULL,    NULL,  NULL,  "--stream",      "write each query's results while the next query is searched", 12 },
+  { "--readers",    eslARG_INT,    "0",  NULL, "n>=0",  NULL,  NULL,  READEROPTS,      "number of threads parsing a FASTA <seqdb> (0: one per 16 workers)", 12 },
 #endif
+  { "--progress",   eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  STREAMOPTS,      "report search progress and throughput to file <f> ('-': stderr)", 12 },
+  { "--progress_int",eslARG_REAL,  "60", NULL, "x>0",   NULL,"--progress", NULL,       "seconds between --progress reports",                          12 },
+  { "--checkpoint", eslARG_OUTFILE, NULL, NULL, NULL,    NULL,  NULL,  "--stream,--binout,--tlist", "save search state to <f> periodically; resume from it if present", 12 },
+  { "--checkpoint_int",eslARG_REAL,"600", NULL, "x>0",   NULL,"--checkpoint", NULL,     "seconds between --checkpoint saves",                          12 },
+  { "--spill",      eslARG_INT,     NULL, NULL, "n>0",   NULL,  NULL,  "--pfamtblout,--binout,--checkpoint", "spill hit lists past <n> MB of memory to temporary files", 12 },
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,    NULL,"--mpi", NULL,            "arrest after start: for debugging MPI under gdb",             12 },  
-  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  MPIOPTS,         "run as an MPI parallel program",                              12 },
+  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,            "run as an MPI parallel program",                              12 },
 #endif
 
   /* Restrict search to subset of database - hidden because these flags are
@@ -139,13 +223,100 @@ struct cfg_s {
 };
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
-static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  parse_ncpus  (const ESL_GETOPTS *go);
+static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs, P7_CHECKPOINT *ck);
+static int  serial_loop_seqdb(WORKER_INFO *info, P7_SEQDB *sqdb);
+static void ckpt_skip    (ESL_SQFILE *dbfp, int64_t roff);
+
+/* --checkpoint's slots for the output files, in the order they're opened */
+enum { CKPT_OUT = 0, CKPT_ALI = 1, CKPT_TBL = 2, CKPT_DOMTBL = 3, CKPT_PFAMTBL = 4 };
+
+#define SERIAL_PROGRESS_TICK 1024   /* --progress: a serial loop reports every this many targets */
+
+#if defined (eslENABLE_SSE)
+/* FM_TARGETS: a protein FM-index <seqdb> (built by makehmmerdb).
+ * The target sequences are reconstructed from the text of each block.
+ * With <use_seeds>, only the sequences with an SSV-passing seed in their
+ * block are returned; otherwise (seeding judged unreliable for the query)
+ * all of them are, and the search is a full scan.
+ */
+typedef struct {
+  FM_CFG          *fm_cfg;
+  FM_METADATA     *meta;
+  fpos_t           basepos;     /* file position of the first block                        */
+  FM_DATA          fmf;         /* current block, forward traversal (holds text T and SA)  */
+  FM_DATA          fmb;         /* current block, backward traversal                       */
+  int              block;       /* current block, 0..block_count-1; -1 before the first    */
+  uint32_t         seg;         /* next segment of the current block to consider           */
+  int             *seg_passed;  /* [0..meta->seq_count-1]: TRUE if segment has a seed      */
+  int              use_seeds;   /* FALSE: return every sequence                            */
+  int              noprefilter; /* TRUE: never use seeds (--seed_noprefilter)              */
+
+  P7_OPROFILE     *om;          /* query profile, for the seed search only                 */
+  P7_SCOREDATA    *ssvdata;     /* SSV scores of <om>                                      */
+  P7_BG           *bg;          /* null model of the seed search                           */
+  ESL_RANDOMNESS  *r;           /* for consensus ties in the seed search                   */
+  double           F1;          /* SSV threshold a seed's extended diagonal must pass      */
+  uint64_t         nseeded;     /* # of sequences with a seed, this query                  */
+  uint64_t         nocc;        /* # of FM-index occurrence counts, this query             */
+} FM_TARGETS;
+
+static FM_TARGETS *fmtargets_Open     (ESL_GETOPTS *go, char *dbfile, int dbfmt, const ESL_ALPHABET *abc);
+static int         fmtargets_NewQuery (FM_TARGETS *ft, P7_OPROFILE *om, P7_PROFILE *gm);
+static int         fmtargets_Next     (FM_TARGETS *ft, ESL_SQ *sq);
+static void        fmtargets_EndQuery (FM_TARGETS *ft);
+static void        fmtargets_Close    (FM_TARGETS *ft);
+static int         serial_loop_FM     (WORKER_INFO *info, FM_TARGETS *ft);
+#endif
 
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_READAHEAD *ra, int n_targetseqs, int max_residues, P7_PROGRESS *prog, P7_CHECKPOINT *ck);
+static int  thread_loop_seqdb(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_SEQDB *sqdb, int max_residues, P7_PROGRESS *prog);
 static void pipeline_thread(void *arg);
+static int  cpu_auto(ESL_GETOPTS *go, struct cfg_s *cfg, int dbfmt, const P7_CPUBIND *cpubind, P7_CPUTUNE **ret_tune, char *errbuf);
+#if defined (eslENABLE_SSE)
+static int  thread_loop_FM(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, FM_TARGETS *ft);
+#endif
+
+/* PAR_READER: target sequences parsed by several threads at once.
+ * With one reader thread, parsing and digitizing the targets limits
+ * a search on many cores. A plain FASTA <seqdb> is split into byte
+ * ranges that each start at a record, and each range is read into
+ * blocks of its own by a reader thread. thread_loop_par() hands the
+ * blocks to the search threads range by range, so the targets arrive
+ * in the same order as from a single reader.
+ */
+#define PAR_MAXREADERS 8      /* most reader threads                               */
+#define PAR_DEPTH      4      /* blocks a reader may have filled ahead             */
+
+struct par_reader_s;
+
+typedef struct {
+  ESL_SQFILE          *sqfp;            /* the range's own handle on <seqdb>                 */
+  off_t                start;           /* offset of the range's first record               */
+  off_t                end;             /* records at or past this are the next range's     */
+  ESL_SQ_BLOCK        *blk[PAR_DEPTH];  /* ring of blocks; <nfull> filled from <head> on    */
+  int                  head;
+  int                  nfull;
+  int                  done;            /* TRUE once the range is read, or failed           */
+  int                  status;          /* eslOK, or the error that stopped the reader      */
+  pthread_t            thread;
+  struct par_reader_s *pr;
+} PAR_RANGE;
+
+typedef struct par_reader_s {
+  PAR_RANGE           *range;           /* [0..nranges-1], in file order                    */
+  int                  nranges;
+  int                  max_residues;    /* a block stops at this many residues              */
+  pthread_mutex_t      mutex;
+  pthread_cond_t       cond;            /* signaled when a block is filled or emptied       */
+} PAR_READER;
+
+static PAR_READER *par_Open       (ESL_SQFILE *dbfp, const ESL_ALPHABET *abc, int nreaders);
+static int         thread_loop_par(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, PAR_READER *pr, int max_residues, P7_PROGRESS *prog);
+static void        par_Close      (PAR_READER *pr);
 #endif 
 
 #ifdef HMMER_MPI
@@ -187,6 +358,11 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_hmmf
       if (puts("\nOptions controlling acceleration heuristics:")             < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
       esl_opt_DisplayHelp(stdout, go, 7, 2, 80); 
 
+#if defined (eslENABLE_SSE)
+      if (puts("\nOptions controlling the seed prefilter of an fmindex <seqdb>:") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 9, 2, 80);
+#endif
+
       if (puts("\nOther expert options:")                                    < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
       esl_opt_DisplayHelp(stdout, go, 12, 2, 80); 
       exit(0);
@@ -200,6 +376,12 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_hmmf
   if (strcmp(*ret_hmmfile, "-") == 0 && strcmp(*ret_seqfile, "-") == 0) 
     { if (puts("Either <hmmfile> or <seqdb> may be '-' (to read from stdin), but not both.") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
 
+  if (esl_opt_IsOn(go, "--hugepages") && p7_hugemem_SetMode(esl_opt_GetString(go, "--hugepages")) != eslOK)
+    { if (printf("--hugepages takes off, thp, 2M or 1G, not %s\n", esl_opt_GetString(go, "--hugepages")) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+#if defined (eslENABLE_SSE)
+  if (esl_opt_GetBoolean(go, "--nogpu")) p7_impl_DisableGPU();
+#endif
+
   *ret_go = go;
   return eslOK;
   
@@ -217,7 +399,7 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_hmmf
 }
 
 static int
-output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
+output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile, const P7_CPUTUNE *tune)
 {
   p7_banner(ofp, go->argv[0], banner);
   
@@ -228,6 +410,9 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--tblout")     && fprintf(ofp, "# per-seq hits tabular output:     %s\n",             esl_opt_GetString(go, "--tblout"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domtblout")  && fprintf(ofp, "# per-dom hits tabular output:     %s\n",             esl_opt_GetString(go, "--domtblout"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--pfamtblout") && fprintf(ofp, "# pfam-style tabular hit output:   %s\n",             esl_opt_GetString(go, "--pfamtblout")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--binout")     && fprintf(ofp, "# binary result output:            %s\n",             esl_opt_GetString(go, "--binout"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--stream")     && fprintf(ofp, "# stream tabular output:           yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--streamonly") && fprintf(ofp, "# final sorted hit report:         no\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--acc")        && fprintf(ofp, "# prefer accessions over names:    yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--noali")      && fprintf(ofp, "# show alignments in output:       no\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--notextw")    && fprintf(ofp, "# max ASCII text line length:      unlimited\n")                                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -236,6 +421,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "-T")           && fprintf(ofp, "# sequence reporting threshold:    score >= %g\n",    esl_opt_GetReal(go, "-T"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domE")       && fprintf(ofp, "# domain reporting threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--domE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domT")       && fprintf(ofp, "# domain reporting threshold:      score >= %g\n",    esl_opt_GetReal(go, "--domT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--topk")       && fprintf(ofp, "# report only the top:             %d sequences\n",   esl_opt_GetInteger(go, "--topk"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incE")       && fprintf(ofp, "# sequence inclusion threshold:    E-value <= %g\n",  esl_opt_GetReal(go, "--incE"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incT")       && fprintf(ofp, "# sequence inclusion threshold:    score >= %g\n",    esl_opt_GetReal(go, "--incT"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incdomE")    && fprintf(ofp, "# domain inclusion threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--incdomE"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -248,6 +434,26 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--F2")         && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")         && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")     && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--adapt")      && fprintf(ofp, "# adaptive filter thresholds:      on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--vitdom")     && fprintf(ofp, "# Viterbi-path domain definition:  on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seqscore_only") && fprintf(ofp, "# per-sequence scores only:        on\n")                                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_threads") && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--dd_threads"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_ramlimit") && fprintf(ofp, "# domain definition RAM limit:     %d MB\n", esl_opt_GetInteger(go, "--dd_ramlimit"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_nbatch")  && fprintf(ofp, "# domain trace sample batch size:  %d\n", esl_opt_GetInteger(go, "--dd_nbatch"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_deferali") && fprintf(ofp, "# deferred domain alignment:       on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_bf16")    && fprintf(ofp, "# bfloat16 envelope matrices:      on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#if defined (eslENABLE_SSE)
+  if (esl_opt_IsUsed(go, "--seed_max_depth")    && fprintf(ofp, "# FM Seed length:                  %d\n",             esl_opt_GetInteger(go, "--seed_max_depth"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_sc_thresh")    && fprintf(ofp, "# FM score threshold (bits):       %g\n",             esl_opt_GetReal(go, "--seed_sc_thresh"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_sc_density")   && fprintf(ofp, "# FM score density (bits/pos):     %g\n",             esl_opt_GetReal(go, "--seed_sc_density"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_drop_max_len") && fprintf(ofp, "# FM max neg-growth length:        %d\n",             esl_opt_GetInteger(go, "--seed_drop_max_len")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_drop_lim")     && fprintf(ofp, "# FM max run drop:                 %g\n",             esl_opt_GetReal(go, "--seed_drop_lim"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_req_pos")      && fprintf(ofp, "# FM req positive run length:      %d\n",             esl_opt_GetInteger(go, "--seed_req_pos"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_consens_match") && fprintf(ofp, "# FM consec consensus match req:   %d\n",            esl_opt_GetInteger(go, "--seed_consens_match")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_ssv_length")   && fprintf(ofp, "# FM len used for Vit window:      %d\n",             esl_opt_GetInteger(go, "--seed_ssv_length"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_noprefilter")  && fprintf(ofp, "# FM seed prefilter:               off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_kmer")         && fprintf(ofp, "# FM seed k-mer table length:      %d\n",             esl_opt_GetInteger(go, "--seed_kmer"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#endif
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") && fprintf(ofp, "# Restrict db to start at seq key: %s\n",            esl_opt_GetString(go, "--restrictdb_stkey"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_n")     && fprintf(ofp, "# Restrict db to # target seqs:    %d\n",            esl_opt_GetInteger(go, "--restrictdb_n")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--ssifile")          && fprintf(ofp, "# Override ssi file to:            %s\n",            esl_opt_GetString(go, "--ssifile"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -259,10 +465,27 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *hmmfile, char *seqfile)
     if (esl_opt_GetInteger(go, "--seed") == 0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                               fprintf(ofp, "# random number seed set to:       %d\n",             esl_opt_GetInteger(go, "--seed"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
+  if (esl_opt_IsUsed(go, "--timing")     && fprintf(ofp, "# pipeline stage timing:           on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--memstats")   && fprintf(ofp, "# pipeline memory statistics:      on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--membudget")  && fprintf(ofp, "# pipeline memory budget:          %d MB\n", esl_opt_GetInteger(go, "--membudget"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hugepages")  && fprintf(ofp, "# hugepages for big buffers:       %s\n", esl_opt_GetString(go, "--hugepages"))              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--nogpu")      && fprintf(ofp, "# GPU SSV filter:                  off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# targ <seqfile> format asserted:  %s\n",             esl_opt_GetString(go, "--tformat"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--tlist")      && fprintf(ofp, "# targets restricted to list:      %s\n",             esl_opt_GetString(go, "--tlist"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
-  if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
+  if (tune) { if (p7_cputune_Write(ofp, tune) != eslOK) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+  else if (esl_opt_IsUsed(go, "--cpu")   && fprintf(ofp, "# number of worker threads:        %s\n",             esl_opt_GetString(go, "--cpu"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--nblocks")    && fprintf(ofp, "# target blocks queued per thread: %d\n",             esl_opt_GetInteger(go, "--nblocks"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--readahead")  && fprintf(ofp, "# target readahead (MB):           %d\n",             esl_opt_GetInteger(go, "--readahead")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--asyncout")   && fprintf(ofp, "# query output overlapped:        yes\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cpubind")    && fprintf(ofp, "# worker threads pinned to:        %s\n",             esl_opt_GetString(go, "--cpubind"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--readercpu")  && fprintf(ofp, "# reader threads pinned to cpu:    %d\n",             esl_opt_GetInteger(go, "--readercpu")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
+  if (esl_opt_IsUsed(go, "--progress")   && fprintf(ofp, "# progress reports to:             %s\n",             esl_opt_GetString(go, "--progress"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--progress_int") && fprintf(ofp, "# progress report interval (s):    %g\n",           esl_opt_GetReal(go, "--progress_int")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--checkpoint") && fprintf(ofp, "# search state checkpointed to:    %s\n",             esl_opt_GetString(go, "--checkpoint")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--checkpoint_int") && fprintf(ofp, "# checkpoint interval (s):         %g\n",       esl_opt_GetReal(go, "--checkpoint_int")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--spill")          && fprintf(ofp, "# hit list memory budget (MB):     %d\n",       esl_opt_GetInteger(go, "--spill"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_MPI
   if (esl_opt_IsUsed(go, "--mpi")        && fprintf(ofp, "# MPI:                             on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
@@ -302,6 +525,9 @@ main(int argc, char **argv)
   if ( cfg.n_targetseq != -1 && cfg.n_targetseq < 1 )
     p7_Fail("--restrictdb_n must be >= 1\n");
 
+  if (esl_opt_IsOn(go, "--tlist") && (cfg.firstseq_key != NULL || cfg.n_targetseq != -1))
+    p7_Fail("--tlist can't be combined with --restrictdb_stkey or --restrictdb_n\n");
+
 
   /* Figure out who we are, and send control there: 
    * we might be an MPI master, an MPI worker, or a serial program.
@@ -315,6 +541,8 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "--mpi")) 
     {
+      if (esl_opt_IsOn(go, "--tlist"))      p7_Fail("--tlist doesn't work with --mpi\n");
+      if (esl_opt_IsOn(go, "--checkpoint")) p7_Fail("--checkpoint doesn't work with --mpi\n");
       cfg.do_mpi     = TRUE;
       MPI_Init(&argc, &argv);
       MPI_Comm_rank(MPI_COMM_WORLD, &(cfg.my_rank));
@@ -354,8 +582,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam tabular output (--pfamtblout)    */
+  FILE            *binfp    = NULL;              /* binary result file (--binout)                   */
+  P7_BINOUT       *bo       = NULL;              /* writer for <binfp>                              */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
+  P7_SEQDB        *sqdb     = NULL;              /* its pressed form (hmmseqpress), if there is one */
   P7_HMM          *hmm      = NULL;              /* one HMM query                                   */
   ESL_ALPHABET    *abc      = NULL;              /* digital alphabet                                */
   int              dbfmt    = eslSQFILE_UNKNOWN; /* format code for sequence database file          */
@@ -371,11 +602,33 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;     /* the other workers' hit lists, for p7_tophits_MergeMany() */
+  P7_TABSTREAM    *ts       = NULL;     /* streamed --tblout/--domtblout rows (--stream)            */
+  int              streamonly = esl_opt_GetBoolean(go, "--streamonly");
+  P7_PROGRESS     *prog     = NULL;     /* progress reports (--progress), or NULL                   */
+  FILE            *progfp   = NULL;
+  double           dbsize   = 0.;       /* bytes of <dbfp> to read per query, if known; else 0      */
+  struct stat      st;
+  P7_CHECKPOINT   *ck       = NULL;     /* saved/restored search state (--checkpoint), or NULL      */
+  P7_PIPELINE    **pll      = NULL;     /* the workers' pipelines, for p7_checkpoint_Write()        */
+  int64_t          roff     = -1;       /* resuming a query: record offset of the last target done  */
+#if defined (eslENABLE_SSE)
+  FM_TARGETS      *ft       = NULL;     /* open fmindex <seqdb>; NULL for a sequence file           */
+#endif
+  P7_CPUTUNE      *tune     = NULL;     /* the trials of --cpu auto, or NULL                        */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  P7_CPUBIND      *cpubind  = NULL;
+  PAR_READER      *pr       = NULL;     /* parallel readers of <dbfp>, or NULL for one              */
+  P7_READAHEAD    *ra       = NULL;     /* readahead of <dbfp> (--readahead), or NULL               */
+  int              nreaders = 0;
+  pthread_t        outthread;           /* --asyncout: writing the previous query's output          */
+  int              outbusy  = FALSE;    /*   ... TRUE while it is                                   */
+  int              asyncout = FALSE;
 #endif
+  QUERY_OUTPUT     qo;
   char             errbuf[eslERRBUFSIZE];
 
   w = esl_stopwatch_Create();
@@ -388,19 +641,55 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     if (dbfmt == eslSQFILE_UNKNOWN) p7_Fail("%s is not a recognized sequence database file format\n", esl_opt_GetString(go, "--tformat"));
   }
 
-  /* Open the target sequence database */
-  status = esl_sqfile_Open(cfg->dbfile, dbfmt, p7_SEQDBENV, &dbfp);
-  if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          cfg->dbfile);
-  else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            cfg->dbfile);
-  else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
-  else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg->dbfile);  
+  /* Open the target sequence database. A current pressed copy
+   * (<seqdb>.h3q, from hmmseqpress) is mapped instead of parsing it,
+   * unless a format was asserted or the search is restricted to a
+   * range or list of it. If we're autodetecting and it isn't readable
+   * as a sequence file, it may be an fmindex; that's opened below,
+   * once the query alphabet is known.
+   */
+  /* A checkpoint records where it was in a plain sequence file, so
+   * --checkpoint reads the file itself, never a pressed copy of it.
+   * If the checkpoint file exists, the search resumes from it.
+   */
+  if (esl_opt_IsOn(go, "--checkpoint"))
+    {
+      if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n")) p7_Fail("--checkpoint can't be combined with --restrictdb_stkey or --restrictdb_n\n");
+      if (strcmp(cfg->hmmfile, "-") == 0 || strcmp(cfg->dbfile, "-") == 0)                  p7_Fail("--checkpoint can't read <hmmfile> or <seqdb> from stdin\n");
+      if (p7_checkpoint_Create(esl_opt_GetString(go, "--checkpoint"), esl_opt_GetReal(go, "--checkpoint_int"), cfg->hmmfile, cfg->dbfile, &ck) != eslOK) p7_Fail("Failed to create checkpoint");
+      status = p7_checkpoint_Read(ck, errbuf);
+      if      (status == eslEFORMAT) p7_Fail("Can't resume from checkpoint file %s:\n%s\n", esl_opt_GetString(go, "--checkpoint"), errbuf);
+      else if (status != eslOK && status != eslENOTFOUND) p7_Fail("Failed to read checkpoint file %s\n", esl_opt_GetString(go, "--checkpoint"));
+    }
 
+  if (dbfmt == eslSQFILE_UNKNOWN && strcmp(cfg->dbfile, "-") != 0 && cfg->firstseq_key == NULL && cfg->n_targetseq < 0 && ! esl_opt_IsOn(go, "--tlist") && ck == NULL)
+    {
+      status = p7_seqdb_Open(cfg->dbfile, &sqdb, errbuf);
+      if      (status == eslEFORMAT) p7_Fail("Pressed sequence file for %s is unusable; rerun hmmseqpress -f, or delete it:\n%s\n", cfg->dbfile, errbuf);
+      else if (status == eslEMEM)    p7_Fail("Failed to open pressed sequence file %s%s\n", cfg->dbfile, p7_SEQDB_SUFFIX);
+    }
 
-  if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n")) {
+  if (sqdb == NULL && dbfmt != eslSQFILE_FMINDEX)
+    {
+      status = esl_sqfile_Open(cfg->dbfile, dbfmt, p7_SEQDBENV, &dbfp);
+      if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",          cfg->dbfile);
+#if defined (eslENABLE_SSE)
+      else if (status == eslEFORMAT && dbfmt == eslSQFILE_UNKNOWN && strcmp(cfg->dbfile, "-") != 0) { esl_sqfile_Close(dbfp); dbfp = NULL; }
+#endif
+      else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",            cfg->dbfile);
+      else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
+      else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, cfg->dbfile);  
+    }
+#if !defined (eslENABLE_SSE)
+  else p7_Fail("fmindex is a valid sequence database file format only on systems supporting SSE vector instructions\n");
+#endif
+
+  if (dbfp && (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n") || esl_opt_IsOn(go, "--tlist"))) {
     if (esl_opt_IsUsed(go, "--ssifile"))
-      esl_sqfile_OpenSSI(dbfp, esl_opt_GetString(go, "--ssifile"));
+      status = esl_sqfile_OpenSSI(dbfp, esl_opt_GetString(go, "--ssifile"));
     else
-      esl_sqfile_OpenSSI(dbfp, NULL);
+      status = esl_sqfile_OpenSSI(dbfp, NULL);
+    if (status != eslOK && esl_opt_IsOn(go, "--tlist")) p7_Fail("--tlist needs an SSI index of %s; make one with esl-sfetch --index\n", cfg->dbfile);
   }
 
 
@@ -411,54 +700,160 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   p7_Fail("File format problem in trying to open HMM file %s.\n%s\n",                cfg->hmmfile, errbuf);
   else if (status != eslOK)        p7_Fail("Unexpected error %d in opening HMM file %s.\n%s\n",               status, cfg->hmmfile, errbuf);  
 
-  /* Open the results output files */
-  if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"), "w")) == NULL) p7_Fail("Failed to open output file %s for writing\n",    esl_opt_GetString(go, "-o")); }
-  if (esl_opt_IsOn(go, "-A"))          { if ((afp      = fopen(esl_opt_GetString(go, "-A"), "w")) == NULL) p7_Fail("Failed to open alignment file %s for writing\n", esl_opt_GetString(go, "-A")); }
-  if (esl_opt_IsOn(go, "--tblout"))    { if ((tblfp    = fopen(esl_opt_GetString(go, "--tblout"),    "w")) == NULL)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
-  if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
-  if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (ck && dbfp == NULL) p7_Fail("--checkpoint needs a sequence file, not an fmindex\n");
+
+  /* Open the results output files; resuming, they're cut back to where the checkpoint left them */
+  if (esl_opt_IsOn(go, "-o"))          { if (p7_checkpoint_OpenOutput(ck, CKPT_OUT,     esl_opt_GetString(go, "-o"),          &ofp)      != eslOK) p7_Fail("Failed to open output file %s for writing\n",    esl_opt_GetString(go, "-o")); }
+  if (esl_opt_IsOn(go, "-A"))          { if (p7_checkpoint_OpenOutput(ck, CKPT_ALI,     esl_opt_GetString(go, "-A"),          &afp)      != eslOK) p7_Fail("Failed to open alignment file %s for writing\n", esl_opt_GetString(go, "-A")); }
+  if (esl_opt_IsOn(go, "--tblout"))    { if (p7_checkpoint_OpenOutput(ck, CKPT_TBL,     esl_opt_GetString(go, "--tblout"),    &tblfp)    != eslOK)  esl_fatal("Failed to open tabular per-seq output file %s for writing\n", esl_opt_GetString(go, "--tblout")); }
+  if (esl_opt_IsOn(go, "--domtblout")) { if (p7_checkpoint_OpenOutput(ck, CKPT_DOMTBL,  esl_opt_GetString(go, "--domtblout"), &domtblfp) != eslOK)  esl_fatal("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout")); }
+  if (esl_opt_IsOn(go, "--pfamtblout")){ if (p7_checkpoint_OpenOutput(ck, CKPT_PFAMTBL, esl_opt_GetString(go, "--pfamtblout"),&pfamtblfp)!= eslOK)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
+  if (esl_opt_IsOn(go, "--binout"))    { if ((binfp    = fopen(esl_opt_GetString(go, "--binout"),    "wb")) == NULL) esl_fatal("Failed to open binary result file %s for writing\n", esl_opt_GetString(go, "--binout"));
+                                         if (p7_binout_Create(binfp, "hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, &bo) != eslOK)       esl_fatal("Failed to write binary result file header\n"); }
 
 #ifdef HMMER_THREADS
   /* initialize thread data */
-  ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  ncpus = parse_ncpus(go);
+  if (esl_opt_IsOn(go, "--cpubind") || esl_opt_IsOn(go, "--readercpu"))
+    {
+      status = p7_cpubind_Create(esl_opt_GetString(go, "--cpubind"), (esl_opt_IsOn(go, "--readercpu") ? esl_opt_GetInteger(go, "--readercpu") : -1), &cpubind, errbuf);
+      if      (status == eslEUNIMPLEMENTED) fprintf(stderr, "Warning: %s\n", errbuf);
+      else if (status != eslOK)             p7_Fail("%s\n", errbuf);
+      p7_cpubind_Reader(cpubind);   /* before any thread starts: they inherit it */
+    }
+  if (ncpus < 0)   /* --cpu auto; the trial threads are pinned as the workers will be */
+    {
+      status = cpu_auto(go, cfg, dbfmt, cpubind, &tune, errbuf);
+      if      (status == eslOK)     ncpus = p7_cputune_NThreads(tune);
+      else if (status == eslEINVAL) { ncpus = esl_threads_GetCPUCount(); fprintf(stderr, "Warning: %s; using %d worker threads\n", errbuf, ncpus); }
+      else                          p7_Fail("Failed to choose the number of worker threads (--cpu auto)\n");
+    }
+  ncpus = ESL_MIN(ncpus, esl_threads_GetCPUCount());
   if (ncpus > 0)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
-      queue = esl_workqueue_Create(ncpus * 2);
+      queue = esl_workqueue_Create(ncpus * esl_opt_GetInteger(go, "--nblocks"));
     }
 #endif
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
+  ESL_ALLOC(pll,  sizeof(P7_PIPELINE *) * infocnt);
+
+  if (esl_opt_GetBoolean(go, "--stream") && (tblfp || domtblfp))
+    {
+      if ((ts = p7_tabstream_Create(tblfp, domtblfp, (ncpus > 0))) == NULL) p7_Fail("Failed to create tabular output stream");
+    }
+  if (ts == NULL) streamonly = FALSE;
+#ifdef HMMER_THREADS
+  asyncout = (ncpus > 0 && esl_opt_GetBoolean(go, "--asyncout") && ck == NULL); /* a checkpoint needs each query's output written */
+#endif
+
+  if (esl_opt_IsOn(go, "--progress"))
+    {
+      if (strcmp(esl_opt_GetString(go, "--progress"), "-") == 0) progfp = stderr;
+      else if ((progfp = fopen(esl_opt_GetString(go, "--progress"), "w")) == NULL) p7_Fail("Failed to open progress report file %s for writing\n", esl_opt_GetString(go, "--progress"));
+      if ((prog = p7_progress_Create(progfp, (progfp != stderr), esl_opt_GetReal(go, "--progress_int"), infocnt, p7_SEARCH_SEQS)) == NULL) p7_Fail("Failed to start progress reports");
+
+      /* a whole, seekable file is done when its last byte is read */
+      if (dbfp && cfg->firstseq_key == NULL && cfg->n_targetseq < 0 && esl_sqfile_IsRewindable(dbfp) && stat(cfg->dbfile, &st) == 0)
+	dbsize = (double) st.st_size;
+    }
+
+  qo.go         = go;
+  qo.ofp        = ofp;
+  qo.afp        = afp;
+  qo.tblfp      = tblfp;
+  qo.domtblfp   = domtblfp;
+  qo.pfamtblfp  = pfamtblfp;
+  qo.bo         = bo;
+  qo.ts         = ts;
+  qo.streamonly = streamonly;
+  qo.textw      = textw;
+  qo.ncpus      = ncpus;
+  qo.status     = eslOK;
 
   /* <abc> is not known 'til first HMM is read. */
   hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
   if (hstatus == eslOK)
     {
       /* One-time initializations after alphabet <abc> becomes known */
-      output_header(ofp, go, cfg->hmmfile, cfg->dbfile);
-      esl_sqfile_SetDigital(dbfp, abc); //ReadBlock requires knowledge of the alphabet to decide how best to read blocks
+      if (ck == NULL || ! ck->resumed)
+	{
+	  output_header(ofp, go, cfg->hmmfile, cfg->dbfile, tune);
+	  p7_checkpoint_EndQuery(ck, 0);
+	}
+      if (sqdb)
+	{
+	  if (p7_seqdb_SetDigital(sqdb, abc) != eslOK) p7_Fail("Pressed sequence file %s isn't in the alphabet of the query HMMs\n", sqdb->dbfile);
+	}
+      else if (dbfp) esl_sqfile_SetDigital(dbfp, abc); //ReadBlock requires knowledge of the alphabet to decide how best to read blocks
+#if defined (eslENABLE_SSE)
+      else      ft = fmtargets_Open(go, cfg->dbfile, dbfmt, abc);
+#endif
+
+      /* With --tlist, fetch the listed targets once, by their SSI
+       * offsets in file order, and search that in-memory database
+       * as a pressed one, for every query.
+       */
+      if (dbfp && esl_opt_IsOn(go, "--tlist"))
+	{
+	  status = p7_seqdb_LoadList(dbfp, esl_opt_GetString(go, "--tlist"), &sqdb, errbuf);
+	  if (status != eslOK) p7_Fail("Failed to read the targets listed in %s:\n%s\n", esl_opt_GetString(go, "--tlist"), errbuf);
+	  if (p7_seqdb_SetDigital(sqdb, abc) != eslOK) p7_Fail("Targets listed in %s aren't in the alphabet of the query HMMs\n", esl_opt_GetString(go, "--tlist"));
+	  esl_sqfile_Close(dbfp);
+	  dbfp = NULL;
+	}
+      else if (esl_opt_IsOn(go, "--tlist")) p7_Fail("--tlist needs a sequence file, not an fmindex\n");
 
       for (i = 0; i < infocnt; ++i)
 	{
-	  info[i].bg    = p7_bg_Create(abc);
+	  info[i].bg         = p7_bg_Create(abc);
+	  info[i].ts         = ts;
+	  info[i].streamonly = streamonly;
+	  info[i].sqviews    = (sqdb != NULL);
+	  info[i].prog       = prog;
+	  info[i].idx        = i;
 #ifdef HMMER_THREADS
-	  info[i].queue = queue;
+	  info[i].queue      = queue;
+	  info[i].cpubind    = cpubind;
 #endif
 	}
 
 #ifdef HMMER_THREADS
-      for (i = 0; i < ncpus * 2; ++i)
+      for (i = 0; i < ncpus * esl_opt_GetInteger(go, "--nblocks"); ++i)
 	{
-	  block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
+	  if (sqdb) block = p7_seqdb_CreateBlock(BLOCK_SIZE); /* views into <sqdb>; no sequence memory of their own */
+	  else      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
 	  if (block == NULL) 	      esl_fatal("Failed to allocate sequence block");
 
  	  status = esl_workqueue_Init(queue, block);
 	  if (status != eslOK)	      esl_fatal("Failed to add block to work queue");
 	}
+
+      /* on many cores, parse the targets with several threads; but
+       * only a whole, seekable FASTA file can be split
+       */
+      nreaders = esl_opt_GetInteger(go, "--readers");
+      if (nreaders == 0) nreaders = ncpus / 16;
+      nreaders = ESL_MIN(nreaders, PAR_MAXREADERS);
+      if (ncpus > 0 && dbfp && nreaders > 1 && cfg->firstseq_key == NULL && cfg->n_targetseq < 0 && ck == NULL)
+	pr = par_Open(dbfp, abc, nreaders);
+      if (ncpus > 0 && dbfp && pr == NULL)
+	ra = p7_readahead_Open(cfg->dbfile, (size_t) esl_opt_GetInteger(go, "--readahead") * 1024 * 1024);
 #endif
     }
 
+  /* resuming, the queries the checkpoint had finished are passed over */
+  while (hstatus == eslOK && ck && nquery < ck->nquery)
+    {
+      p7_hmm_Destroy(hmm);
+      hmm = NULL;
+      nquery++;
+      hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+    }
+
   /* Outer loop: over each query HMM in <hmmfile>. */
   while (hstatus == eslOK) 
     {
@@ -468,8 +863,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       nquery++;
       esl_stopwatch_Start(w);
 
-      /* seqfile may need to be rewound (multiquery mode) */
-      if (nquery > 1)
+      /* an fmindex, or a part or stream of a file, reports no done/eta */
+      p7_progress_NewQuery(prog, nquery, hmm->name);
+      if (sqdb) p7_progress_SetTotal(prog, (double) sqdb->nres, TRUE);
+      else      p7_progress_SetTotal(prog, dbsize, FALSE);
+
+      /* seqfile may need to be rewound (multiquery mode); an fmindex is rewound in fmtargets_NewQuery() */
+      if (sqdb) p7_seqdb_Position(sqdb, 0);
+      if (nquery > 1 && dbfp)
       {
         if (! esl_sqfile_IsRewindable(dbfp))
           esl_fatal("Target sequence file %s isn't rewindable; can't search it with multiple queries", cfg->dbfile);
@@ -484,10 +885,6 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
           p7_Fail("Failure setting restrictdb_stkey to %d\n", cfg->firstseq_key);
       }
 
-      if (fprintf(ofp, "Query:       %s  [M=%d]\n", hmm->name, hmm->M)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (hmm->acc)  { if (fprintf(ofp, "Accession:   %s\n", hmm->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
-      if (hmm->desc) { if (fprintf(ofp, "Description: %s\n", hmm->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
-
       /* Convert to an optimized model */
       gm = p7_profile_Create (hmm->M, abc);
       om = p7_oprofile_Create(hmm->M, abc);
@@ -498,8 +895,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       {
         /* Create processing pipeline and hit list */
         info[i].th  = p7_tophits_Create();
-        info[i].om  = p7_oprofile_Clone(om);
+        info[i].om  = p7_oprofile_Clone(om);   /* shares <om>'s score vectors; only the per-target length config is the thread's own */
         info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+        if (esl_opt_IsOn(go, "--topk") && p7_pipeline_SetTopK(info[i].pli, esl_opt_GetInteger(go, "--topk")) != eslOK) p7_Fail("Failed to allocate --topk heap");
+        if (esl_opt_IsOn(go, "--spill") && p7_tophits_SetSpill(info[i].th, (uint64_t) esl_opt_GetInteger(go, "--spill") * 1024 * 1024 / infocnt) != eslOK) p7_Fail("Failed to allocate --spill bookkeeping");
+        if (esl_opt_GetBoolean(go, "--adapt")) p7_pipeline_SetAdaptive(info[i].pli, TRUE);
+        if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(info[i].pli, TRUE);
+        if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(info[i].pli, TRUE);
         status = p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
         if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
 
@@ -508,12 +910,60 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
       }
 
+      if (ck)
+	{
+	  status = p7_checkpoint_StartQuery(ck, hmm->name, info[0].pli, info[0].th, &roff);
+	  if      (status == eslEINCOMPAT) p7_Fail("Checkpoint file %s was taken during a different query than %s; was %s changed?\n", ck->filename, hmm->name, cfg->hmmfile);
+	  else if (status != eslOK)        p7_Fail("Failed to restore the checkpointed search of %s\n", hmm->name);
+	  if (roff >= 0) ckpt_skip(dbfp, roff);
+	}
+
+      if (ts && p7_tabstream_NewQuery(ts, hmm->name, hmm->acc, info[0].pli, (nquery == 1)) != eslOK)
+        p7_Fail("Failed to write tabular output header");
+
+      if (sqdb)
+      {
+#ifdef HMMER_THREADS
+        if (ncpus > 0)  sstatus = thread_loop_seqdb(threadObj, queue, sqdb, p7_BLOCK_RESIDUES(om->M), prog);
+        else            sstatus = serial_loop_seqdb(info, sqdb);
+#else
+        sstatus = serial_loop_seqdb(info, sqdb);
+#endif
+      }
+      else
+#if defined (eslENABLE_SSE)
+      if (ft)
+      {
+        fmtargets_NewQuery(ft, om, gm);
 #ifdef HMMER_THREADS
-      if (ncpus > 0)  sstatus = thread_loop(threadObj, queue, dbfp, cfg->n_targetseq);
-      else            sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+        if (ncpus > 0)  sstatus = thread_loop_FM(threadObj, queue, ft);
+        else            sstatus = serial_loop_FM(info, ft);
 #else
-      sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+        sstatus = serial_loop_FM(info, ft);
+#endif
+      }
+      else
+#endif
+      /* with --checkpoint, the search stops when a checkpoint is
+       * due, and once it's written, goes on where it stopped
+       */
+      for (;;)
+      {
+#ifdef HMMER_THREADS
+        if      (pr)        sstatus = thread_loop_par(threadObj, queue, pr, p7_BLOCK_RESIDUES(om->M), prog);
+        else if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp, ra, cfg->n_targetseq, p7_BLOCK_RESIDUES(om->M), prog, ck);
+        else                sstatus = serial_loop(info, dbfp, cfg->n_targetseq, ck);
+#else
+        sstatus = serial_loop(info, dbfp, cfg->n_targetseq, ck);
+#endif
+        if (sstatus != eslEOF || ck == NULL || ! ck->stop) break;
+
+        for (i = 0; i < infocnt; ++i) { pll[i] = info[i].pli; thl[i] = info[i].th; }
+        if (p7_checkpoint_Write(ck, pll, thl, infocnt) != eslOK) p7_Fail("Failed to write checkpoint file %s\n", ck->filename);
+#ifdef HMMER_THREADS
+        for (i = 0; i < ncpus; ++i) esl_threads_AddThread(threadObj, &info[i]);
 #endif
+      }
       switch(sstatus)
       {
       case eslEFORMAT:
@@ -527,10 +977,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         esl_fatal("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
       }
 
+      /* all streamed rows must be out before the pipelines are merged */
+      if (ts && p7_tabstream_EndQuery(ts) != eslOK) p7_Fail("Failed to write streamed tabular output");
+
       /* merge the results of the search results */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeMany(info[0].th, thl, infocnt-1);
       for (i = 1; i < infocnt; ++i)
       {
-        p7_tophits_Merge(info[0].th, info[i].th);
         p7_pipeline_Merge(info[0].pli, info[i].pli);
 
         p7_pipeline_Destroy(info[i].pli);
@@ -538,51 +992,65 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         p7_oprofile_Destroy(info[i].om);
       }
 
-      /* Print the results.  */
-      p7_tophits_SortBySortkey(info->th);
-      p7_tophits_Threshold(info->th, info->pli);
-      p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, info->th, info->pli);
-  
-      esl_stopwatch_Stop(w);
-      p7_pli_Statistics(ofp, info->pli, w);
-      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
-      /* Output the results in an MSA (-A option) */
-      if (afp) {
-	ESL_MSA *msa = NULL;
-
-	if (p7_tophits_Alignment(info->th, abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK)
-	  {
-	    esl_msa_SetName     (msa, hmm->name, -1);
-	    esl_msa_SetAccession(msa, hmm->acc,  -1);
-	    esl_msa_SetDesc     (msa, hmm->desc, -1);
-	    esl_msa_FormatAuthor(msa, "hmmsearch (HMMER %s)", HMMER_VERSION);
-
-	    if (textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
-	    else           esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
-	  
-	    if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-	  } 
-	else { if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
-	  
-	esl_msa_Destroy(msa);
+#if defined (eslENABLE_SSE)
+      if (ft)
+      { /* sequences that the seed search passed over still count toward the search space */
+        info->pli->nseqs     = ft->meta->seq_data[ft->meta->seq_count-1].target_id + 1;
+        info->pli->nres      = ft->meta->char_count;
+        info->pli->n_past_fm = ft->nseeded;
+        info->pli->n_fm_occ += ft->nocc;
+        if (info->pli->Z_setby == p7_ZSETBY_NTARGETS) info->pli->Z = (double) info->pli->nseqs;
+        fmtargets_EndQuery(ft);
       }
+#endif
 
-      p7_pipeline_Destroy(info->pli);
-      p7_tophits_Destroy(info->th);
       p7_oprofile_Destroy(info->om);
       p7_oprofile_Destroy(om);
       p7_profile_Destroy(gm);
-      p7_hmm_Destroy(hmm);
+
+      /* Output the results. With --asyncout, the previous query's
+       * output must be finished first, so at most one query's results
+       * wait on the output thread, and queries come out in order.
+       */
+#ifdef HMMER_THREADS
+      if (outbusy)
+	{
+	  pthread_join(outthread, NULL);
+	  outbusy = FALSE;
+	  if (qo.status != eslOK) return qo.status;
+	}
+#endif
+      qo.abc    = abc;
+      qo.hmm    = hmm;
+      qo.pli    = info->pli;
+      qo.th     = info->th;
+      qo.w      = *w;
+      qo.nquery = nquery;
+      hmm       = NULL;
+#ifdef HMMER_THREADS
+      if (asyncout)
+	{
+	  if (pthread_create(&outthread, NULL, output_thread, &qo) != 0) p7_Fail("Failed to start output thread");
+	  outbusy = TRUE;
+	}
+      else
+#endif
+      if ((status = output_query(&qo)) != eslOK) return status;
+
+      p7_checkpoint_EndQuery(ck, nquery);
+      if (p7_checkpoint_Due(ck) && p7_checkpoint_Write(ck, NULL, NULL, 0) != eslOK) p7_Fail("Failed to write checkpoint file %s\n", ck->filename);
 
       hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
     } /* end outer loop over query HMMs */
 
+#ifdef HMMER_THREADS
+  if (outbusy)
+    {
+      pthread_join(outthread, NULL);
+      if (qo.status != eslOK) return qo.status;
+    }
+#endif
+
   switch(hstatus) {
   case eslEOD:       p7_Fail("read failed, HMM file %s may be truncated?", cfg->hmmfile);      break;
   case eslEFORMAT:   p7_Fail("bad file format in HMM file %s",             cfg->hmmfile);      break;
@@ -597,8 +1065,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)    p7_tophits_TabularTail(tblfp,    "hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, go);
   if (domtblfp) p7_tophits_TabularTail(domtblfp, "hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, go);
   if (pfamtblfp) p7_tophits_TabularTail(pfamtblfp,"hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, go);
+  if (bo && p7_binout_WriteIndex(bo) != eslOK) p7_Fail("Failed to write binary result index");
   if (ofp)      { if (fprintf(ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
+  /* the search is done; there's nothing left to resume */
+  p7_checkpoint_Remove(ck);
+
   /* Cleanup - prepare for exit
    */
   for (i = 0; i < infocnt; ++i)
@@ -609,15 +1081,31 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       esl_workqueue_Reset(queue);
       while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
-	esl_sq_DestroyBlock(block);
+	{
+	  if (sqdb) p7_seqdb_DestroyBlock(block);
+	  else      esl_sq_DestroyBlock(block);
+	}
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
     }
+  p7_cpubind_Destroy(cpubind);
+  par_Close(pr);
+  p7_readahead_Close(ra);
 #endif
+  p7_cputune_Destroy(tune);
 
   free(info);
+  free(thl);
+  free(pll);
+  p7_checkpoint_Destroy(ck);
+  p7_progress_Destroy(prog);
+  p7_tabstream_Destroy(ts);
   p7_hmmfile_Close(hfp);
-  esl_sqfile_Close(dbfp);
+  if (dbfp) esl_sqfile_Close(dbfp);
+  p7_seqdb_Close(sqdb);
+#if defined (eslENABLE_SSE)
+  fmtargets_Close(ft);
+#endif
   esl_alphabet_Destroy(abc);
   esl_stopwatch_Destroy(w);
 
@@ -626,6 +1114,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (bo)            p7_binout_Close(bo);
+  if (binfp)         fclose(binfp);
 
   return eslOK;
 
@@ -633,6 +1123,95 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   return eslFAIL;
 }
 
+/* output_query()
+ * Sort and threshold the hits of a finished query and write all its
+ * outputs, then free its HMM, pipeline and hit list. Runs on the
+ * master thread, or with --asyncout on output_thread() while the
+ * workers search the next query; only this writes to the output
+ * files while a query's output is pending.
+ */
+static int
+output_query(QUERY_OUTPUT *qo)
+{
+  P7_HMM      *hmm = qo->hmm;
+  P7_PIPELINE *pli = qo->pli;
+  P7_TOPHITS  *th  = qo->th;
+  FILE        *ofp = qo->ofp;
+
+  if (fprintf(ofp, "Query:       %s  [M=%d]\n", hmm->name, hmm->M)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (hmm->acc)  { if (fprintf(ofp, "Accession:   %s\n", hmm->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+  if (hmm->desc) { if (fprintf(ofp, "Description: %s\n", hmm->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+
+  p7_tophits_SortBySortkey(th);
+  p7_tophits_Threshold(th, pli);
+  if (! qo->streamonly)
+    {
+      p7_tophits_Targets(ofp, th, pli, qo->textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      p7_tophits_DomainsThreaded(ofp, th, pli, qo->textw, qo->ncpus); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+    }
+
+  if (qo->ts)
+    {  /* rows were streamed already; just add the query's timings */
+      if (qo->tblfp)    p7_pli_TabularTimings(qo->tblfp,    pli);
+      if (qo->domtblfp) p7_pli_TabularTimings(qo->domtblfp, pli);
+    }
+  else
+    {
+      if (qo->tblfp)    p7_tophits_TabularTargets(qo->tblfp,    hmm->name, hmm->acc, th, pli, (qo->nquery == 1));
+      if (qo->domtblfp) p7_tophits_TabularDomains(qo->domtblfp, hmm->name, hmm->acc, th, pli, (qo->nquery == 1));
+    }
+  if (qo->pfamtblfp) p7_tophits_TabularXfam(qo->pfamtblfp, hmm->name, hmm->acc, th, pli);
+  if (qo->bo && p7_binout_WriteQuery(qo->bo, hmm->name, hmm->acc, th, pli) != eslOK) p7_Fail("Failed to write binary results");
+
+  esl_stopwatch_Stop(&(qo->w));
+  p7_pli_Statistics(ofp, pli, &(qo->w));
+  if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+
+  /* Output the results in an MSA (-A option) */
+  if (qo->afp) {
+    ESL_MSA *msa = NULL;
+
+    if (p7_tophits_Alignment(th, qo->abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK)
+      {
+	esl_msa_SetName     (msa, hmm->name, -1);
+	esl_msa_SetAccession(msa, hmm->acc,  -1);
+	esl_msa_SetDesc     (msa, hmm->desc, -1);
+	esl_msa_FormatAuthor(msa, "hmmsearch (HMMER %s)", HMMER_VERSION);
+
+	if (qo->textw > 0) esl_msafile_Write(qo->afp, msa, eslMSAFILE_STOCKHOLM);
+	else               esl_msafile_Write(qo->afp, msa, eslMSAFILE_PFAM);
+
+	if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(qo->go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      }
+    else { if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
+
+    esl_msa_Destroy(msa);
+  }
+
+  p7_pipeline_Destroy(pli);
+  p7_tophits_Destroy(th);
+  p7_hmm_Destroy(hmm);
+  qo->hmm = NULL;
+  qo->pli = NULL;
+  qo->th  = NULL;
+  return eslOK;
+}
+
+#ifdef HMMER_THREADS
+/* output_thread()
+ * --asyncout: output_query() on a thread of its own. The master
+ * joins it before handing over the next query.
+ */
+static void *
+output_thread(void *arg)
+{
+  QUERY_OUTPUT *qo = (QUERY_OUTPUT *) arg;
+
+  qo->status = output_query(qo);
+  return NULL;
+}
+#endif
+
 #ifdef HMMER_MPI
 
 /* Define common tags used by the MPI master/slave processes */
@@ -646,6 +1225,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #define HMMER_TERMINATING_TAG    8
 #define HMMER_READY_TAG          9
 
+/* Each worker keeps HMMER_BLOCKS_AHEAD block requests outstanding, so
+ * that its next block has arrived by the time it finishes one. Results
+ * are merged up a tree of ranks, HMMER_MERGE_FANOUT children per rank.
+ */
+#define HMMER_BLOCKS_AHEAD       2
+#define HMMER_MERGE_FANOUT       4
+
 /* mpi_failure()
  * Generate an error message.  If the clients rank is not 0, a
  * message is created with the error message and sent to the
@@ -808,6 +1394,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   FILE            *tblfp    = NULL;              /* output stream for tabular per-seq (--tblout)    */
   FILE            *domtblfp = NULL;              /* output stream for tabular per-dom (--domtblout) */
   FILE            *pfamtblfp= NULL;              /* output stream for pfam-style tabular output  (--pfamtblout) */
+  FILE            *binfp    = NULL;              /* binary result file (--binout)                   */
+  P7_BINOUT       *bo       = NULL;              /* writer for <binfp>                              */
   P7_BG           *bg       = NULL;	         /* null model                                      */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
@@ -882,6 +1470,11 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--pfamtblout") && (pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)
     mpi_failure("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout"));
 
+  if (esl_opt_IsOn(go, "--binout") && (binfp = fopen(esl_opt_GetString(go, "--binout"), "wb")) == NULL)
+    mpi_failure("Failed to open binary result file %s for writing\n", esl_opt_GetString(go, "--binout"));
+  if (binfp && p7_binout_Create(binfp, "hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, &bo) != eslOK)
+    mpi_failure("Failed to write binary result file header\n");
+
   ESL_ALLOC(list, sizeof(BLOCK_LIST));
   list->complete = 0;
   list->size     = 0;
@@ -894,7 +1487,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (hstatus == eslOK)
     {
       /* One-time initializations after alphabet <abc> becomes known */
-      output_header(ofp, go, cfg->hmmfile, cfg->dbfile);
+      output_header(ofp, go, cfg->hmmfile, cfg->dbfile, NULL);
       dbsq = esl_sq_CreateDigital(abc);
       bg = p7_bg_Create(abc);
     }
@@ -935,6 +1528,10 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, hmm->M, 100, FALSE, p7_SEARCH_SEQS);
+      if (esl_opt_IsOn(go, "--topk") && p7_pipeline_SetTopK(pli, esl_opt_GetInteger(go, "--topk")) != eslOK) mpi_failure("Failed to allocate --topk heap");
+      if (esl_opt_GetBoolean(go, "--adapt")) p7_pipeline_SetAdaptive(pli, TRUE);
+      if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(pli, TRUE);
+      if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(pli, TRUE);
       p7_pli_NewModel(pli, om, bg);
 
       /* Main loop: */
@@ -981,10 +1578,15 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       block.length = 0;
       block.count  = 0;
 
-      /* wait for all workers to finish up their work blocks */
-      for (i = 1; i < cfg->nproc; ++i)
+      /* Answer each worker's HMMER_BLOCKS_AHEAD outstanding requests
+       * with an empty block, which tells it the database is done. Go
+       * one worker at a time: one that has had all its empty blocks may
+       * already be asking for blocks for the next query.
+       */
+      for (dest = 1; dest < cfg->nproc; ++dest)
+	for (i = 0; i < HMMER_BLOCKS_AHEAD; ++i)
 	{
-	  if (MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
+	  if (MPI_Probe(dest, MPI_ANY_TAG, MPI_COMM_WORLD, &mpistatus) != 0) 
 	    mpi_failure("MPI error %d receiving message from %d\n", mpistatus.MPI_SOURCE);
 
 	  MPI_Get_count(&mpistatus, MPI_PACKED, &size);
@@ -994,38 +1596,23 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    mpi_size = size; 
 	  }
 
-	  dest = mpistatus.MPI_SOURCE;
 	  MPI_Recv(mpi_buf, size, MPI_PACKED, dest, mpistatus.MPI_TAG, MPI_COMM_WORLD, &mpistatus);
 
 	  if (mpistatus.MPI_TAG == HMMER_ERROR_TAG)
 	    mpi_failure("MPI client %d raised error:\n%s\n", dest, mpi_buf);
 	  if (mpistatus.MPI_TAG != HMMER_READY_TAG)
 	    mpi_failure("Unexpected tag %d from %d\n", mpistatus.MPI_TAG, dest);
-	}
-
-      /* merge the results of the search results */
-      for (dest = 1; dest < cfg->nproc; ++dest)
-	{
-	  P7_PIPELINE     *mpi_pli   = NULL;
-	  P7_TOPHITS      *mpi_th    = NULL;
 
-	  /* send an empty block to signal the worker they are done */
 	  MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
-
-	  /* wait for the results */
-	  if ((status = p7_tophits_MPIRecv(dest, HMMER_TOPHITS_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, &mpi_th)) != eslOK)
-	    mpi_failure("Unexpected error %d receiving tophits from %d", status, dest);
-
-	  if ((status = p7_pipeline_MPIRecv(dest, HMMER_PIPELINE_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size, go, &mpi_pli)) != eslOK)
-	    mpi_failure("Unexpected error %d receiving pipeline from %d", status, dest);
-
-	  p7_tophits_Merge(th, mpi_th);
-	  p7_pipeline_Merge(pli, mpi_pli);
-
-	  p7_pipeline_Destroy(mpi_pli);
-	  p7_tophits_Destroy(mpi_th);
 	}
 
+      /* merge the results of the search; the workers merge theirs up
+       * a tree, so we only receive those of our own children.
+       */
+      if ((status = p7_tophits_MPIReduce(th, pli, 0, cfg->nproc, HMMER_MERGE_FANOUT, HMMER_TOPHITS_TAG, HMMER_PIPELINE_TAG,
+					 MPI_COMM_WORLD, go, &mpi_buf, &mpi_size)) != eslOK)
+	mpi_failure("Unexpected error %d merging search results", status);
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(th);
       p7_tophits_Threshold(th, pli);
@@ -1035,6 +1622,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (tblfp)    p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, th, pli, (nquery == 1));
       if (domtblfp) p7_tophits_TabularDomains(domtblfp, hmm->name, hmm->acc, th, pli, (nquery == 1));
       if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, hmm->name, hmm->acc, th, pli);
+      if (bo && p7_binout_WriteQuery(bo, hmm->name, hmm->acc, th, pli) != eslOK) p7_Fail("Failed to write binary results");
 
       esl_stopwatch_Stop(w);
       p7_pli_Statistics(ofp, pli, w);
@@ -1103,6 +1691,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)    p7_tophits_TabularTail(tblfp,     "hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, go);
   if (domtblfp) p7_tophits_TabularTail(domtblfp,  "hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, go);
   if (pfamtblfp)p7_tophits_TabularTail(pfamtblfp, "hmmsearch", p7_SEARCH_SEQS, cfg->hmmfile, cfg->dbfile, go);
+  if (bo && p7_binout_WriteIndex(bo) != eslOK) p7_Fail("Failed to write binary result index");
   if (ofp)     { if (fprintf(ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
   /* Cleanup - prepare for exit
@@ -1122,6 +1711,8 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (tblfp)         fclose(tblfp);
   if (domtblfp)      fclose(domtblfp);
   if (pfamtblfp)     fclose(pfamtblfp);
+  if (bo)            p7_binout_Close(bo);
+  if (binfp)         fclose(binfp);
 
   return eslOK;
 
@@ -1136,7 +1727,6 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   P7_HMM          *hmm      = NULL;              /* one HMM query                                   */
   ESL_SQ          *dbsq     = NULL;              /* one target sequence (digital)                   */
   ESL_ALPHABET    *abc      = NULL;              /* digital alphabet                                */
-  P7_BG           *bg       = NULL;	         /* null model                                      */
   P7_HMMFILE      *hfp      = NULL;              /* open input HMM file                             */
   ESL_SQFILE      *dbfp     = NULL;              /* open input sequence file                        */
   int              dbfmt    = eslSQFILE_UNKNOWN; /* format code for sequence database file          */
@@ -1144,15 +1734,35 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              status   = eslOK;
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
+  int              i;
+  int              ncpus    = 0;
+
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;              /* the other threads' hit lists, for p7_tophits_MergeMany() */
+#ifdef HMMER_THREADS
+  ESL_SQ_BLOCK    *sqblock  = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+  void            *newBlock;
+#endif
 
   char            *mpi_buf  = NULL;              /* buffer used to pack/unpack structures           */
   int              mpi_size = 0;                 /* size of the allocated buffer                    */
 
+  SEQ_BLOCK        ahead[HMMER_BLOCKS_AHEAD];    /* blocks on their way from the master             */
+  MPI_Request      req[HMMER_BLOCKS_AHEAD];      /* persistent receives into <ahead>                */
+  int              s;
+  int              nempty;
+
   MPI_Status       mpistatus;
   char             errbuf[eslERRBUFSIZE];
 
   w = esl_stopwatch_Create();
 
+  for (s = 0; s < HMMER_BLOCKS_AHEAD; s++)
+    MPI_Recv_init(&ahead[s], 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &req[s]);
+
   /* Open the target sequence database */
   status = esl_sqfile_Open(cfg->dbfile, dbfmt, p7_SEQDBENV, &dbfp);
   if      (status == eslENOTFOUND) mpi_failure("Failed to open sequence file %s for reading\n",          cfg->dbfile);
@@ -1166,14 +1776,53 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   mpi_failure("File format problem in trying to open HMM file %s.\n%s\n",                cfg->hmmfile, errbuf);
   else if (status != eslOK)        mpi_failure("Unexpected error %d in opening HMM file %s.\n%s\n",               status, cfg->hmmfile, errbuf);  
 
+  /* With --cpu, this rank searches its blocks with a pool of threads,
+   * the same way the threaded version does, rather than alone: then
+   * one rank per node (or socket) will do, instead of one per core.
+   */
+#ifdef HMMER_THREADS
+  if (esl_opt_IsUsed(go, "--cpu")) {
+    ncpus = parse_ncpus(go);
+    if (ncpus < 0) ncpus = esl_threads_GetCPUCount();  /* --cpu auto isn't measured per rank: all of them */
+    ncpus = ESL_MIN(ncpus, esl_threads_GetCPUCount());
+  }
+#endif
+
   /* <abc> is not known 'til first HMM is read. */
   hstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
   if (hstatus == eslOK)
     {
       /* One-time initializations after alphabet <abc> becomes known */
       dbsq = esl_sq_CreateDigital(abc);
-      bg = p7_bg_Create(abc);
       esl_sqfile_SetDigital(dbfp, abc);
+
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{
+	  threadObj = esl_threads_Create(&pipeline_thread);
+	  queue     = esl_workqueue_Create(ncpus * 2);
+	  for (i = 0; i < ncpus * 2; ++i)
+	    {
+	      if ((sqblock = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc)) == NULL) mpi_failure("Failed to allocate sequence block");
+	      if (esl_workqueue_Init(queue, sqblock) != eslOK)                   mpi_failure("Failed to add block to work queue");
+	    }
+	}
+#endif
+
+      infocnt = (ncpus == 0) ? 1 : ncpus;
+      ESL_ALLOC(info, sizeof(WORKER_INFO)  * infocnt);
+      ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
+      for (i = 0; i < infocnt; ++i)
+	{
+	  info[i].bg         = p7_bg_Create(abc);
+	  info[i].ts         = NULL;
+	  info[i].streamonly = FALSE;
+	  info[i].sqviews    = FALSE;
+#ifdef HMMER_THREADS
+	  info[i].queue      = queue;
+	  info[i].cpubind    = NULL;
+#endif
+	}
     }
   
   /* Outer loop: over each query HMM in <hmmfile>. */
@@ -1181,48 +1830,99 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       P7_PROFILE      *gm      = NULL;
       P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
-      P7_PIPELINE     *pli     = NULL;
-      P7_TOPHITS      *th      = NULL;
 
       SEQ_BLOCK        block;
 
       esl_stopwatch_Start(w);
 
+      /* ask for our first blocks, one per receive */
       status = 0;
-      MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+      for (s = 0; s < HMMER_BLOCKS_AHEAD; s++)
+	{
+	  MPI_Start(&req[s]);
+	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+	}
 
       /* Convert to an optimized model */
       gm = p7_profile_Create (hmm->M, abc);
       om = p7_oprofile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL);
+      p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL);
       p7_oprofile_Convert(gm, om);
 
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-      p7_pli_NewModel(pli, om, bg);
+      for (i = 0; i < infocnt; ++i)
+	{
+	  info[i].th  = p7_tophits_Create(); 
+	  info[i].om  = p7_oprofile_Clone(om);
+	  info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	  if (esl_opt_IsOn(go, "--topk") && p7_pipeline_SetTopK(info[i].pli, esl_opt_GetInteger(go, "--topk")) != eslOK) mpi_failure("Failed to allocate --topk heap");
+	  if (esl_opt_GetBoolean(go, "--adapt")) p7_pipeline_SetAdaptive(info[i].pli, TRUE);
+	  if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(info[i].pli, TRUE);
+	  if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(info[i].pli, TRUE);
+	  p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
+
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{
+	  esl_workqueue_Reset(queue);
+	  esl_threads_WaitForStart(threadObj);
+	  if (esl_workqueue_ReaderUpdate(queue, NULL, &newBlock) != eslOK) mpi_failure("Work queue reader failed");
+	}
+#endif
 
-      /* receive a sequence block from the master */
-      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-      while (block.count > 0)
+      /* Blocks arrive in the order they were asked for. An empty one
+       * answers a request made after the database ran out; when all of
+       * ours have come back empty, we're done.
+       */
+      for (s = 0, nempty = 0; nempty < HMMER_BLOCKS_AHEAD; s = (s+1) % HMMER_BLOCKS_AHEAD)
 	{
 	  uint64_t length = 0;
-	  uint64_t count  = block.count;
+	  uint64_t count;
+
+	  MPI_Wait(&req[s], &mpistatus);
+	  block = ahead[s];
+	  if (block.count == 0) { nempty++; continue; }
+
+	  /* ask for another block now, so it arrives while we search this one */
+	  status = 0;
+	  MPI_Start(&req[s]);
+	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
+
+	  count = block.count;
 
 	  status = esl_sqfile_Position(dbfp, block.offset);
 	  if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
 
+#ifdef HMMER_THREADS
+	  if (ncpus > 0)
+	    { /* hand the block's sequences to the threads, up to BLOCK_SIZE at a time */
+	      while (count > 0)
+		{
+		  sqblock = (ESL_SQ_BLOCK *) newBlock;
+		  if ((sstatus = esl_sqio_ReadBlock(dbfp, sqblock, p7_BLOCK_RESIDUES(info->om->M), (int) count, /*max_init_window=*/FALSE, FALSE)) != eslOK) break;
+		  length = sqblock->list[sqblock->count-1].eoff - block.offset + 1;
+		  count -= sqblock->count;
+
+		  if (esl_workqueue_ReaderUpdate(queue, sqblock, &newBlock) != eslOK) mpi_failure("Work queue reader failed");
+		}
+	    }
+	  else
+#endif
 	  while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
 	    {
 	      length = dbsq->eoff - block.offset + 1;
 
-	      p7_pli_NewSeq(pli, dbsq);
-	      p7_bg_SetLength(bg, dbsq->n);
-	      p7_oprofile_ReconfigLength(om, dbsq->n);
+	      p7_pli_NewSeq(info->pli, dbsq);
+	      p7_bg_SetLength(info->bg, dbsq->n);
+	      p7_oprofile_ReconfigLength(info->om, dbsq->n);
       
-	      p7_Pipeline(pli, om, bg, dbsq, NULL, th);
+	      p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
 
 	      esl_sq_Reuse(dbsq);
-	      p7_pipeline_Reuse(pli);
+	      p7_pipeline_Reuse(info->pli);
 
 	      --count;
 	    }
@@ -1230,23 +1930,40 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  /* lets do a little bit of sanity checking here to make sure the blocks are the same */
 	  if (count > 0)              mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block.count,  block.count - count, block.offset);
 	  if (block.length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length,              block.offset);
+	}
 
-	  /* inform the master we need another block of sequences */
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
-
-	  /* wait for the next block of sequences */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{ /* an empty block for each thread tells it we're done */
+	  for (i = 0; i <= ncpus; ++i)
+	    {
+	      sqblock = (ESL_SQ_BLOCK *) newBlock;
+	      sqblock->count = 0;
+	      if (esl_workqueue_ReaderUpdate(queue, sqblock, (i < ncpus ? &newBlock : NULL)) != eslOK) mpi_failure("Work queue reader failed");
+	    }
+	  esl_threads_WaitForFinish(threadObj);
+	  esl_workqueue_Complete(queue);
 	}
+#endif
 
       esl_stopwatch_Stop(w);
 
-      /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      /* merge the threads' results */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeMany(info[0].th, thl, infocnt-1);
+      for (i = 1; i < infocnt; ++i) p7_pipeline_Merge(info[0].pli, info[i].pli);
 
-      p7_pipeline_Destroy(pli);
-      p7_tophits_Destroy(th);
+      /* Merge in our children's top hits, and send them all on up the tree. */
+      if ((status = p7_tophits_MPIReduce(info[0].th, info[0].pli, cfg->my_rank, cfg->nproc, HMMER_MERGE_FANOUT, HMMER_TOPHITS_TAG, HMMER_PIPELINE_TAG,
+					 MPI_COMM_WORLD, go, &mpi_buf, &mpi_size)) != eslOK)
+	mpi_failure("Unexpected error %d merging search results", status);
+
+      for (i = 0; i < infocnt; ++i)
+	{
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
+	  p7_oprofile_Destroy(info[i].om);
+	}
       p7_oprofile_Destroy(om);
       p7_profile_Destroy(gm);
       p7_hmm_Destroy(hmm);
@@ -1272,59 +1989,386 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   status = 0;
   MPI_Send(&status, 1, MPI_INT, 0, HMMER_TERMINATING_TAG, MPI_COMM_WORLD);
 
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &sqblock) == eslOK)
+	esl_sq_DestroyBlock(sqblock);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+  free(info);
+  free(thl);
+
+  for (s = 0; s < HMMER_BLOCKS_AHEAD; s++)
+    MPI_Request_free(&req[s]);
   if (mpi_buf != NULL) free(mpi_buf);
 
   p7_hmmfile_Close(hfp);
   esl_sqfile_Close(dbfp);
 
-  p7_bg_Destroy(bg);
   esl_sq_Destroy(dbsq);
   esl_stopwatch_Destroy(w);
 
   return eslOK;
+
+ ERROR:
+  mpi_failure("Allocation failed");
+  return eslEMEM;
 }
 #endif /*HMMER_MPI*/
 
 static int
-serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
+serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs, P7_CHECKPOINT *ck)
 {
   int      sstatus;
   ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
+  uint64_t  n0;                /* # of hits before this target  */
   int seq_cnt = 0;
+  double    t0  = (info->prog ? p7_progress_Now() : 0.);
+  double    t1;
 
   dbsq = esl_sq_CreateDigital(info->om->abc);
 
   /* Main loop: */
-  while ( (n_targetseqs==-1 || seq_cnt<n_targetseqs) &&  (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+  while ( ! p7_checkpoint_Due(ck) && (n_targetseqs==-1 || seq_cnt<n_targetseqs) &&  (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
   {
+      p7_checkpoint_Advance(ck, 1, dbsq->roff);
       p7_pli_NewSeq(info->pli, dbsq);
       p7_bg_SetLength(info->bg, dbsq->n);
       p7_oprofile_ReconfigLength(info->om, dbsq->n);
       
+      n0 = info->th->N;
       p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+      if (info->ts)
+	{
+	  if (p7_tabstream_AddHits(info->ts, info->th, n0, info->pli) != eslOK) esl_fatal("Failed to stream tabular output");
+	  if (info->streamonly) p7_tophits_Reuse(info->th);
+	}
+      if (p7_tophits_Spill(info->th) != eslOK) esl_fatal("Failed to spill hits to a temporary file");
 
       seq_cnt++;
+      if (info->prog && seq_cnt % SERIAL_PROGRESS_TICK == 0)
+	{
+	  t1 = p7_progress_Now();
+	  p7_progress_Worker(info->prog, 0, info->pli, t1 - t0, 0.);
+	  p7_progress_SetDone(info->prog, (double) ESL_MAX(dbsq->roff, dbsq->eoff));
+	  t0 = t1;
+	}
       esl_sq_Reuse(dbsq);
       p7_pipeline_Reuse(info->pli);
   }
+  if (info->prog) p7_progress_Worker(info->prog, 0, info->pli, p7_progress_Now() - t0, 0.);
 
   if (n_targetseqs!=-1 && seq_cnt==n_targetseqs)
     sstatus = eslEOF;
+  if (ck && ck->stop) sstatus = eslEOF;  /* stopped for a checkpoint; caller goes on after it */
 
   esl_sq_Destroy(dbsq);
 
   return sstatus;
 }
 
+
+/* ckpt_skip()
+ * Resuming a --checkpoint search: position <dbfp> just past the
+ * target at record offset <roff>, the last one the checkpoint had
+ * done.
+ */
+static void
+ckpt_skip(ESL_SQFILE *dbfp, int64_t roff)
+{
+  ESL_SQ *sq = esl_sq_CreateDigital(dbfp->abc);
+
+  if (sq == NULL)                                       esl_fatal("Failed to allocate sequence");
+  if (esl_sqfile_Position(dbfp, (off_t) roff) != eslOK) esl_fatal("Failed to position sequence file %s at checkpointed target", dbfp->filename);
+  if (esl_sqio_ReadInfo(dbfp, sq) != eslOK)             esl_fatal("Failed to read checkpointed target in sequence file %s; was it changed?", dbfp->filename);
+  if (sq->roff != roff)                                 esl_fatal("Sequence file %s doesn't match the checkpoint; was it changed?", dbfp->filename);
+  esl_sq_Destroy(sq);
+}
+
+/* parse_ncpus()
+ * The number of worker threads asked for with --cpu, or -1 for
+ * --cpu auto. Fatal if it's neither a number >= 0 nor "auto".
+ */
+static int
+parse_ncpus(const ESL_GETOPTS *go)
+{
+  char *s = esl_opt_GetString(go, "--cpu");
+  char *end;
+  long  n;
+
+  if (strcmp(s, "auto") == 0) return -1;
+  n = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || n < 0 || n > INT_MAX) p7_Fail("--cpu takes a number of worker threads, or auto; not %s\n", s);
+  return (int) n;
+}
+
+/* serial_loop_seqdb()
+ * As serial_loop(), with the targets coming from pressed sequence
+ * database <sqdb> as views: nothing to parse, copy or reuse.
+ */
+static int
+serial_loop_seqdb(WORKER_INFO *info, P7_SEQDB *sqdb)
+{
+  ESL_SQ    dbsq;              /* view of one target sequence    */
+  uint64_t  n0;                /* # of hits before this target  */
+  uint64_t  nseq = 0;
+  double    t0   = (info->prog ? p7_progress_Now() : 0.);
+  double    t1;
+
+  memset(&dbsq, 0, sizeof(ESL_SQ));
+
+  /* Main loop: */
+  while (p7_seqdb_Read(sqdb, &dbsq) == eslOK)
+  {
+      p7_pli_NewSeq(info->pli, &dbsq);
+      p7_bg_SetLength(info->bg, dbsq.n);
+      p7_oprofile_ReconfigLength(info->om, dbsq.n);
+
+      n0 = info->th->N;
+      p7_Pipeline(info->pli, info->om, info->bg, &dbsq, NULL, info->th);
+      if (info->ts)
+	{
+	  if (p7_tabstream_AddHits(info->ts, info->th, n0, info->pli) != eslOK) esl_fatal("Failed to stream tabular output");
+	  if (info->streamonly) p7_tophits_Reuse(info->th);
+	}
+      if (p7_tophits_Spill(info->th) != eslOK) esl_fatal("Failed to spill hits to a temporary file");
+
+      if (info->prog && ++nseq % SERIAL_PROGRESS_TICK == 0)
+	{
+	  t1 = p7_progress_Now();
+	  p7_progress_Worker(info->prog, 0, info->pli, t1 - t0, 0.);
+	  t0 = t1;
+	}
+      p7_pipeline_Reuse(info->pli);
+  }
+  if (info->prog) p7_progress_Worker(info->prog, 0, info->pli, p7_progress_Now() - t0, 0.);
+  return eslEOF;
+}
+
+#if defined (eslENABLE_SSE)
+/* fmtargets_Open()
+ * Open <dbfile> as a protein fmindex, for queries in alphabet <abc>.
+ * <dbfmt> is eslSQFILE_FMINDEX if the format was asserted, or
+ * eslSQFILE_UNKNOWN if we fell through to it while autodetecting.
+ * All errors are fatal.
+ */
+static FM_TARGETS *
+fmtargets_Open(ESL_GETOPTS *go, char *dbfile, int dbfmt, const ESL_ALPHABET *abc)
+{
+  FM_TARGETS *ft = NULL;
+  uint32_t    i;
+  int         status;
+
+  if (strcmp(dbfile, "-") == 0)
+    p7_Fail("Must specify target file type (fmindex, or a sequence file format) to read <seqdb> from stdin ('-')");
+  if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n"))
+    p7_Fail("--restrictdb_stkey and --restrictdb_n flags are incompatible with the fmindex target type\n");
+
+  ESL_ALLOC(ft, sizeof(FM_TARGETS));
+  ft->fm_cfg     = NULL;
+  ft->seg_passed = NULL;
+  ft->block      = -1;
+  ft->seg        = 0;
+  ft->use_seeds  = FALSE;
+  ft->om         = NULL;
+  ft->ssvdata    = NULL;
+  ft->bg         = NULL;
+  ft->r          = NULL;
+
+  if (fm_configAlloc(&(ft->fm_cfg)) != eslOK) p7_Fail("unable to allocate memory to store FM meta data\n");
+  ft->meta = ft->fm_cfg->meta;
+
+  if ((ft->meta->fp = fopen(dbfile, "rb")) == NULL)
+    p7_Fail("Failed to open target sequence database %s for reading\n", dbfile);
+  if (fm_readFMmeta(ft->meta) != eslOK) {
+    if (dbfmt == eslSQFILE_FMINDEX) p7_Fail("Failed to read FM meta data from target sequence database %s\n", dbfile);
+    else                            p7_Fail("Sequence file %s is empty or misformatted\n",                  dbfile);
+  }
+
+  /* Sanity checks. The seed search needs the index of the reversed text as well;
+   * and one target must be one segment, since p7_Pipeline() scores whole sequences.
+   */
+  if (ft->meta->alph_type != fm_AMINO || abc->type != eslAMINO)
+    p7_Fail("fmindex %s isn't protein; use nhmmer to search a DNA fmindex\n", dbfile);
+  if (ft->meta->fwd_only)
+    p7_Fail("fmindex %s was built with --fwd_only; hmmsearch needs the reverse index too\n", dbfile);
+  for (i = 0; i < ft->meta->seq_count; i++)
+    if (ft->meta->seq_data[i].target_start != 1 || (i > 0 && ft->meta->seq_data[i].target_id == ft->meta->seq_data[i-1].target_id))
+      p7_Fail("Sequence %s in fmindex %s is split across blocks; rebuild it with a larger makehmmerdb --block_size\n", ft->meta->seq_data[i].name, dbfile);
+
+  if (fm_configInit(ft->fm_cfg, go) != eslOK)  p7_Fail("Failed to initialize FM configuration for target sequence database %s\n", dbfile);
+  if (fm_alphabetCreate(ft->meta, NULL) != eslOK) p7_Fail("Failed to create FM alphabet for target sequence database %s\n",    dbfile);
+
+  fgetpos(ft->meta->fp, &(ft->basepos));
+  fm_mapFMfile(ft->meta);  /* read the blocks in place from a shared read-only mapping when we can */
+
+  ESL_ALLOC(ft->seg_passed, sizeof(int) * ft->meta->seq_count);
+  ft->noprefilter = (esl_opt_GetBoolean(go, "--seed_noprefilter") || esl_opt_GetBoolean(go, "--max"));
+  ft->F1          = esl_opt_GetReal(go, "--F1");
+  ft->bg          = p7_bg_Create(abc);
+  ft->r           = esl_randomness_CreateFast(esl_opt_GetInteger(go, "--seed"));
+  return ft;
+
+ ERROR:
+  p7_Fail("Failed to allocate fmindex target database");
+  return NULL;
+}
+
+/* fmtargets_NewQuery()
+ * Prepare to search fmindex <ft> with query <om> (and its profile <gm>):
+ * rewind to the first block, and decide whether the seed search can be
+ * trusted with this query (see fm_configSeedThreshold()). If it can't,
+ * every sequence will be searched. <om> must stay valid until
+ * fmtargets_EndQuery().
+ */
+static int
+fmtargets_NewQuery(FM_TARGETS *ft, P7_OPROFILE *om, P7_PROFILE *gm)
+{
+  fm_configSeedThreshold(ft->fm_cfg, gm, &(ft->use_seeds));
+  if (ft->noprefilter) ft->use_seeds = FALSE;
+
+  if (fsetpos(ft->meta->fp, &(ft->basepos)) != 0) p7_Fail("rewind of fmindex via fsetpos() failed");
+  ft->block   = -1;
+  ft->seg     = 0;
+  ft->nseeded = 0;
+  ft->nocc    = 0;
+  ft->om      = om;
+  ft->ssvdata = (ft->use_seeds ? p7_hmm_ScoreDataCreate(om, gm) : NULL);
+  esl_vec_ISet(ft->seg_passed, ft->meta->seq_count, FALSE);
+  return eslOK;
+}
+
+/* fmtargets_Next()
+ * Reconstruct the next target sequence of fmindex <ft> into <sq>, reading
+ * (and, with seeds, seed-searching) the next block when the current one is
+ * used up. Returns <eslOK>, or <eslEOF> when there are no more sequences;
+ * once at <eslEOF>, stays there. Read errors are fatal.
+ */
+static int
+fmtargets_Next(FM_TARGETS *ft, ESL_SQ *sq)
+{
+  FM_SEQDATA *seqdata;
+  int         npassed;
+
+  if (ft->block >= ft->meta->block_count) return eslEOF;
+
+  while (1)
+    {
+      if (ft->block >= 0) {
+        for ( ; ft->seg < ft->fmf.seq_offset + ft->fmf.seq_cnt; ft->seg++)
+          if (! ft->use_seeds || ft->seg_passed[ft->seg]) break;
+        if (ft->seg < ft->fmf.seq_offset + ft->fmf.seq_cnt) break;
+
+        fm_FM_destroy(&(ft->fmf), 1);
+        fm_FM_destroy(&(ft->fmb), 0);
+      }
+      if (ft->block == ft->meta->block_count - 1) { ft->block = ft->meta->block_count; return eslEOF; }
+
+      ft->block++;
+      if (fm_FM_read(&(ft->fmf), ft->meta, TRUE)  != eslOK) p7_Fail("Failed to read FM-index block %d", ft->block);
+      if (fm_FM_read(&(ft->fmb), ft->meta, FALSE) != eslOK) p7_Fail("Failed to read FM-index block %d", ft->block);
+      ft->fmb.SA = ft->fmf.SA;
+      ft->fmb.T  = ft->fmf.T;
+      if (ft->use_seeds && fm_FM_buildKmers(&(ft->fmf), &(ft->fmb), ft->fm_cfg) != eslOK) p7_Fail("Failed to build the k-mer table of FM-index block %d", ft->block);
+      ft->seg    = ft->fmf.seq_offset;
+
+      if (ft->use_seeds) {
+        if (p7_SSVFM_Targets(ft->om, ft->bg, ft->F1, &(ft->fmf), &(ft->fmb), ft->fm_cfg, ft->ssvdata, ft->r,
+                             ft->seg_passed, &npassed, &(ft->nocc)) != eslOK)
+          p7_Fail("FM-index seed search failed");
+        ft->nseeded += npassed;
+      }
+    }
+
+  seqdata = ft->meta->seq_data + ft->seg;
+  fm_convertRange2DSQ(&(ft->fmf), ft->meta, seqdata->fm_start, seqdata->length, p7_NOCOMPLEMENT, sq, FALSE);
+  esl_sq_SetName(sq, seqdata->name);
+  if (seqdata->acc  && seqdata->acc[0]  != '\0') esl_sq_SetAccession(sq, seqdata->acc);
+  if (seqdata->desc && seqdata->desc[0] != '\0') esl_sq_SetDesc     (sq, seqdata->desc);
+  sq->start = 1;
+  sq->end   = sq->n;
+  sq->L     = sq->n;
+  ft->seg++;
+  return eslOK;
+}
+
+/* fmtargets_EndQuery()
+ * Release what fmtargets_NewQuery() set up for the query.
+ */
+static void
+fmtargets_EndQuery(FM_TARGETS *ft)
+{
+  if (ft->block >= 0 && ft->block < ft->meta->block_count) {
+    fm_FM_destroy(&(ft->fmf), 1);
+    fm_FM_destroy(&(ft->fmb), 0);
+  }
+  ft->block = -1;
+  p7_hmm_ScoreDataDestroy(ft->ssvdata);
+  ft->ssvdata = NULL;
+  ft->om      = NULL;
+}
+
+static void
+fmtargets_Close(FM_TARGETS *ft)
+{
+  if (! ft) return;
+  if (ft->meta && ft->meta->fp) fclose(ft->meta->fp);
+  fm_configDestroy(ft->fm_cfg); // will cascade to destroy meta and alphabet, too
+  p7_bg_Destroy(ft->bg);
+  esl_randomness_Destroy(ft->r);
+  free(ft->seg_passed);
+  free(ft);
+}
+
+static int
+serial_loop_FM(WORKER_INFO *info, FM_TARGETS *ft)
+{
+  ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
+  uint64_t  n0;                /* # of hits before this target  */
+
+  dbsq = esl_sq_CreateDigital(info->om->abc);
+
+  /* Main loop: */
+  while (fmtargets_Next(ft, dbsq) == eslOK)
+  {
+      p7_pli_NewSeq(info->pli, dbsq);
+      p7_bg_SetLength(info->bg, dbsq->n);
+      p7_oprofile_ReconfigLength(info->om, dbsq->n);
+      
+      n0 = info->th->N;
+      p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+      if (info->ts)
+	{
+	  if (p7_tabstream_AddHits(info->ts, info->th, n0, info->pli) != eslOK) esl_fatal("Failed to stream tabular output");
+	  if (info->streamonly) p7_tophits_Reuse(info->th);
+	}
+      if (p7_tophits_Spill(info->th) != eslOK) esl_fatal("Failed to spill hits to a temporary file");
+
+      esl_sq_Reuse(dbsq);
+      p7_pipeline_Reuse(info->pli);
+  }
+
+  esl_sq_Destroy(dbsq);
+  return eslEOF;
+}
+#endif /* eslENABLE_SSE */
+
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_READAHEAD *ra, int n_targetseqs, int max_residues, P7_PROGRESS *prog, P7_CHECKPOINT *ck)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
   int  eofCount = 0;
   ESL_SQ_BLOCK *block;
   void         *newBlock;
+  double        t0;
 
   esl_workqueue_Reset(queue);
   esl_threads_WaitForStart(obj);
@@ -1337,15 +2381,135 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
     {
       block = (ESL_SQ_BLOCK *) newBlock;
 
-      if (n_targetseqs == 0)
+      if (n_targetseqs == 0 || p7_checkpoint_Due(ck))  /* a due checkpoint ends the search here, as EOF does */
       {
         block->count = 0;
         sstatus = eslEOF;
       } else {
-        sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
+        sstatus = esl_sqio_ReadBlock(dbfp, block, max_residues, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
         n_targetseqs -= block->count;
+        if (block->count > 0) {
+          p7_checkpoint_Advance(ck, block->count, block->list[block->count-1].roff);
+          p7_readahead_Advance(ra, ESL_MAX(block->list[block->count-1].roff, block->list[block->count-1].eoff));
+          p7_progress_SetDone(prog, (double) ESL_MAX(block->list[block->count-1].roff, block->list[block->count-1].eoff));
+        }
+      }
+
+      if (sstatus == eslEOF)
+      {
+        if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
+        ++eofCount;
+      }
+
+      if (sstatus == eslOK)
+      {
+        p7_PROBE1(block__handoff, block->count);
+        t0     = (prog ? p7_progress_Now() : 0.);
+        status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+        if (status != eslOK) esl_fatal("Work queue reader failed");
+        if (prog) p7_progress_ReaderWait(prog, p7_progress_Now() - t0);
+      }
+    }
+
+  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  if (sstatus == eslEOF)
+    {
+      /* wait for all the threads to complete */
+      esl_threads_WaitForFinish(obj);
+      esl_workqueue_Complete(queue);  
+    }
+
+  return sstatus;
+}
+
+/* thread_loop_seqdb()
+ * As thread_loop(), with target sequences coming from pressed
+ * database <sqdb>. The queue's blocks are p7_seqdb views, so filling
+ * one only sets pointers; the workers don't esl_sq_Reuse() them.
+ * Blocks stop at <max_residues>, as esl_sqio_ReadBlock()'s do.
+ */
+static int
+thread_loop_seqdb(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_SEQDB *sqdb, int max_residues, P7_PROGRESS *prog)
+{
+  int  status  = eslOK;
+  int  sstatus = eslOK;
+  int  eofCount = 0;
+  ESL_SQ_BLOCK *block;
+  void         *newBlock;
+  double        t0;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* Main loop: */
+  while (sstatus == eslOK )
+    {
+      block = (ESL_SQ_BLOCK *) newBlock;
+
+      sstatus = p7_seqdb_ReadBlock(sqdb, block, max_residues);
+
+      if (sstatus == eslEOF)
+      {
+        if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
+        ++eofCount;
       }
 
+      if (sstatus == eslOK)
+      {
+        t0     = (prog ? p7_progress_Now() : 0.);
+        status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+        if (status != eslOK) esl_fatal("Work queue reader failed");
+        if (prog) p7_progress_ReaderWait(prog, p7_progress_Now() - t0);
+      }
+    }
+
+  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  if (sstatus == eslEOF)
+    {
+      /* wait for all the threads to complete */
+      esl_threads_WaitForFinish(obj);
+      esl_workqueue_Complete(queue);  
+    }
+
+  return sstatus;
+}
+
+#if defined (eslENABLE_SSE)
+/* thread_loop_FM()
+ * As thread_loop(), with target sequences coming from fmindex <ft>.
+ */
+static int
+thread_loop_FM(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, FM_TARGETS *ft)
+{
+  int  status  = eslOK;
+  int  sstatus = eslOK;
+  int  eofCount = 0;
+  ESL_SQ_BLOCK *block;
+  void         *newBlock;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+      
+  /* Main loop: */
+  while (sstatus == eslOK )
+    {
+      block = (ESL_SQ_BLOCK *) newBlock;
+
+      block->count = 0;
+      while (block->count < block->listSize && (sstatus = fmtargets_Next(ft, block->list + block->count)) == eslOK)
+        block->count++;
+      if (block->count > 0) sstatus = eslOK;  /* like esl_sqio_ReadBlock(): EOF comes with the first empty block */
+
       if (sstatus == eslEOF)
       {
         if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
@@ -1371,6 +2535,236 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
 
   return sstatus;
 }
+#endif /* eslENABLE_SSE */
+
+/* par_Open()
+ * Set up <nreaders> threads to read the targets of <dbfp> in
+ * parallel, in alphabet <abc>. Returns NULL if <dbfp> can't be split:
+ * if it isn't a FASTA file, is compressed or standard input, or is
+ * too small for more than one range.
+ */
+static PAR_READER *
+par_Open(ESL_SQFILE *dbfp, const ESL_ALPHABET *abc, int nreaders)
+{
+  PAR_READER  *pr  = NULL;
+  FILE        *fp  = NULL;
+  struct stat  st;
+  off_t        bound[PAR_MAXREADERS+1];
+  off_t        pos;
+  int          nranges;
+  int          c, prev;
+  int          k, j;
+  int          status;
+
+  if (dbfp->format != eslSQFILE_FASTA || ! esl_sqfile_IsRewindable(dbfp)) return NULL;
+  if (stat(dbfp->filename, &st) != 0 || (fp = fopen(dbfp->filename, "rb")) == NULL) return NULL;
+
+  /* each range starts at the first record past an even share of the
+   * bytes: a '>' at the start of a line
+   */
+  bound[0] = 0;
+  nranges  = 1;
+  for (k = 1; k < nreaders; k++)
+    {
+      pos = (off_t) ((double) st.st_size * k / nreaders);
+      if (pos <= bound[nranges-1] || fseeko(fp, pos-1, SEEK_SET) != 0) continue;
+      for (prev = getc(fp); (c = getc(fp)) != EOF; prev = c, pos++)
+	if (c == '>' && prev == '\n') break;
+      if (c == EOF) break;
+      if (pos > bound[nranges-1]) bound[nranges++] = pos;
+    }
+  bound[nranges] = st.st_size + 1;
+  fclose(fp);
+  if (nranges < 2) return NULL;
+
+  ESL_ALLOC(pr, sizeof(PAR_READER));
+  ESL_ALLOC(pr->range, sizeof(PAR_RANGE) * nranges);
+  pr->nranges = nranges;
+  for (k = 0; k < nranges; k++)
+    {
+      PAR_RANGE *r = &pr->range[k];
+
+      if (esl_sqfile_OpenDigital(abc, dbfp->filename, eslSQFILE_FASTA, NULL, &r->sqfp) != eslOK)
+	esl_fatal("Failed to open sequence file %s for reading\n", dbfp->filename);
+      r->start = bound[k];
+      r->end   = bound[k+1];
+      for (j = 0; j < PAR_DEPTH; j++)
+	if ((r->blk[j] = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc)) == NULL) esl_fatal("Failed to allocate sequence block");
+      r->pr = pr;
+    }
+  if (pthread_mutex_init(&pr->mutex, NULL) != 0) esl_fatal("mutex init failed");
+  if (pthread_cond_init (&pr->cond,  NULL) != 0) esl_fatal("cond init failed");
+  return pr;
+
+ ERROR:
+  esl_fatal("Failed to allocate parallel sequence readers");
+  return NULL;
+}
+
+/* par_range_thread()
+ * Read the records of one range into the free blocks of its ring,
+ * until the range is done.
+ */
+static void *
+par_range_thread(void *arg)
+{
+  PAR_RANGE    *r      = (PAR_RANGE *) arg;
+  PAR_READER   *pr     = r->pr;
+  ESL_SQ_BLOCK *block;
+  ESL_SQ       *sq;
+  int64_t       nres;
+  int           status;
+
+  status = esl_sqfile_Position(r->sqfp, r->start);
+  while (status == eslOK)
+    {
+      pthread_mutex_lock(&pr->mutex);
+      while (r->nfull == PAR_DEPTH) pthread_cond_wait(&pr->cond, &pr->mutex);
+      block = r->blk[(r->head + r->nfull) % PAR_DEPTH];
+      pthread_mutex_unlock(&pr->mutex);
+
+      block->count = 0;
+      nres         = 0;
+      while (block->count < block->listSize && nres < pr->max_residues)
+	{
+	  sq = block->list + block->count;
+	  if ((status = esl_sqio_Read(r->sqfp, sq)) != eslOK) break;
+	  if (sq->roff >= r->end) { esl_sq_Reuse(sq); status = eslEOF; break; }
+	  nres += sq->n;
+	  block->count++;
+	}
+
+      pthread_mutex_lock(&pr->mutex);
+      if (block->count > 0) r->nfull++;
+      pthread_cond_broadcast(&pr->cond);
+      pthread_mutex_unlock(&pr->mutex);
+    }
+
+  pthread_mutex_lock(&pr->mutex);
+  r->done   = TRUE;
+  r->status = (status == eslEOF) ? eslOK : status;
+  pthread_cond_broadcast(&pr->cond);
+  pthread_mutex_unlock(&pr->mutex);
+  return NULL;
+}
+
+/* thread_loop_par()
+ * As thread_loop(), with the targets of <dbfp> read by the threads of
+ * <pr>. Each filled block is swapped into the work queue's next free
+ * block, taking the ranges in file order. The readers stop a block
+ * at <max_residues>.
+ */
+static int
+thread_loop_par(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, PAR_READER *pr, int max_residues, P7_PROGRESS *prog)
+{
+  int           status   = eslOK;
+  int           sstatus  = eslOK;
+  int           eofCount = 0;
+  int64_t       nseq     = 0;
+  PAR_RANGE    *r;
+  ESL_SQ_BLOCK *block;
+  void         *newBlock;
+  double        t0;
+  int           k;
+
+  pr->max_residues = max_residues;
+  for (k = 0; k < pr->nranges; k++)
+    {
+      r = &pr->range[k];
+      r->head   = 0;
+      r->nfull  = 0;
+      r->done   = FALSE;
+      r->status = eslOK;
+      if (pthread_create(&r->thread, NULL, par_range_thread, r) != 0) esl_fatal("Failed to start sequence reader");
+    }
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  /* Main loop: */
+  k = 0;
+  while (sstatus == eslOK )
+    {
+      block = (ESL_SQ_BLOCK *) newBlock;
+      block->count = 0;
+
+      /* the next filled block, from the first range not done with */
+      pthread_mutex_lock(&pr->mutex);
+      while (k < pr->nranges)
+	{
+	  r = &pr->range[k];
+	  if (r->nfull > 0)
+	    {
+	      ESL_SWAP(*block, *r->blk[r->head], ESL_SQ_BLOCK);
+	      r->head = (r->head + 1) % PAR_DEPTH;
+	      r->nfull--;
+	      pthread_cond_broadcast(&pr->cond);
+	      break;
+	    }
+	  if (r->done && r->status != eslOK) { sstatus = r->status; break; }
+	  if (r->done) k++;
+	  else         pthread_cond_wait(&pr->cond, &pr->mutex);
+	}
+      pthread_mutex_unlock(&pr->mutex);
+
+      if (sstatus != eslOK)
+	esl_fatal("Parse failed (sequence file %s):\n%s\n", r->sqfp->filename, esl_sqfile_GetErrorBuf(r->sqfp));
+
+      block->first_seqidx = nseq;
+      nseq += block->count;
+      if (k == pr->nranges) sstatus = eslEOF;
+
+      /* ranges are handed out in file order, so all before this block's end is read */
+      if (block->count > 0) p7_progress_SetDone(prog, (double) ESL_MAX(block->list[block->count-1].roff, block->list[block->count-1].eoff));
+
+      if (sstatus == eslEOF)
+      {
+        if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
+        ++eofCount;
+      }
+
+      if (sstatus == eslOK)
+      {
+        t0     = (prog ? p7_progress_Now() : 0.);
+        status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+        if (status != eslOK) esl_fatal("Work queue reader failed");
+        if (prog) p7_progress_ReaderWait(prog, p7_progress_Now() - t0);
+      }
+    }
+
+  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
+  if (status != eslOK) esl_fatal("Work queue reader failed");
+
+  for (k = 0; k < pr->nranges; k++) pthread_join(pr->range[k].thread, NULL);
+
+  /* wait for all the threads to complete */
+  esl_threads_WaitForFinish(obj);
+  esl_workqueue_Complete(queue);  
+  return sstatus;
+}
+
+/* par_Close()
+ * Free parallel readers <pr>, if any.
+ */
+static void
+par_Close(PAR_READER *pr)
+{
+  int k, j;
+
+  if (pr == NULL) return;
+  for (k = 0; k < pr->nranges; k++)
+    {
+      for (j = 0; j < PAR_DEPTH; j++) esl_sq_DestroyBlock(pr->range[k].blk[j]);
+      esl_sqfile_Close(pr->range[k].sqfp);
+    }
+  pthread_mutex_destroy(&pr->mutex);
+  pthread_cond_destroy(&pr->cond);
+  free(pr->range);
+  free(pr);
+}
 
 static void 
 pipeline_thread(void *arg)
@@ -1383,6 +2777,8 @@ pipeline_thread(void *arg)
 
   ESL_SQ_BLOCK  *block = NULL;
   void          *newBlock;
+  uint64_t       n0;		/* # of hits before this block */
+  double         tw, tb, te;	/* --progress: when we began waiting for a block, began it, finished it */
   
   impl_Init();
 
@@ -1390,7 +2786,9 @@ pipeline_thread(void *arg)
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+  p7_cpubind_Worker(info->cpubind, workeridx);  /* before its DP matrices grow, so they're on its own NUMA node */
 
+  tw     = (info->prog ? p7_progress_Now() : 0.);
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
@@ -1399,18 +2797,24 @@ pipeline_thread(void *arg)
   while (block->count > 0)
     {
       /* Main loop: */
-      for (i = 0; i < block->count; ++i)
+      tb = (info->prog ? p7_progress_Now() : 0.);
+      n0 = info->th->N;
+      p7_Pipeline_Block(info->pli, info->om, info->bg, block, info->th);
+      if (info->ts)
 	{
-	  ESL_SQ *dbsq = block->list + i;
+	  if (p7_tabstream_AddHits(info->ts, info->th, n0, info->pli) != eslOK) esl_fatal("Failed to stream tabular output");
+	  if (info->streamonly) p7_tophits_Reuse(info->th);
+	}
+      if (p7_tophits_Spill(info->th) != eslOK) esl_fatal("Failed to spill hits to a temporary file");
+      if (! info->sqviews)
+	for (i = 0; i < block->count; ++i)
+	  esl_sq_Reuse(block->list + i);
 
-	  p7_pli_NewSeq(info->pli, dbsq);
-	  p7_bg_SetLength(info->bg, dbsq->n);
-	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
-	  
-	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-	  
-	  esl_sq_Reuse(dbsq);
-	  p7_pipeline_Reuse(info->pli);
+      if (info->prog)
+	{
+	  te = p7_progress_Now();
+	  p7_progress_Worker(info->prog, info->idx, info->pli, te - tb, tb - tw);
+	  tw = te;
 	}
 
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
@@ -1422,9 +2826,90 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  /* sort our own hits while other threads may still be working, ready for the k-way merge */
+  p7_tophits_SortBySortkey(info->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
+
+/* cpu_auto()
+ * --cpu auto: choose the number of worker threads by searching the
+ * first query against the first blocks of <seqdb>, with
+ * p7_cputune_Measure(). Both files are opened afresh for it, and
+ * closed again, so the search proper starts at the beginning of each.
+ * The sample is about p7_CPUTUNE_CELLS cells of the first query, in
+ * blocks as the search reads them; a smaller database is sampled
+ * whole.
+ *
+ * Returns eslOK, with the trials in <*ret_tune>. Returns eslEINVAL,
+ * with the reason in <errbuf>, if the query or targets can't be
+ * sampled: read from stdin, an fmindex, or the trial pipeline can't
+ * be configured. Throws eslEMEM and eslESYS as p7_cputune_Measure().
+ */
+static int
+cpu_auto(ESL_GETOPTS *go, struct cfg_s *cfg, int dbfmt, const P7_CPUBIND *cpubind, P7_CPUTUNE **ret_tune, char *errbuf)
+{
+  P7_HMMFILE    *hfp     = NULL;
+  ESL_SQFILE    *dbfp    = NULL;
+  ESL_ALPHABET  *abc     = NULL;
+  P7_HMM        *hmm     = NULL;
+  P7_BG         *bg      = NULL;
+  P7_PROFILE    *gm      = NULL;
+  P7_OPROFILE   *om      = NULL;
+  ESL_SQ_BLOCK **blocks  = NULL;
+  int            nblocks = 0;
+  int            nalloc  = 0;
+  uint64_t       nres    = 0;
+  double         maxres;
+  int            i;
+  int            status  = eslOK;
+
+  *ret_tune = NULL;
+  if (strcmp(cfg->hmmfile, "-") == 0 || strcmp(cfg->dbfile, "-") == 0) ESL_XFAIL(eslEINVAL, errbuf, "--cpu auto can't sample a query or target file read from stdin");
+  if (p7_hmmfile_Open(cfg->hmmfile, NULL, &hfp, errbuf) != eslOK || p7_hmmfile_Read(hfp, &abc, &hmm) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "--cpu auto can't read the first query of %s", cfg->hmmfile);
+  if (dbfmt != eslSQFILE_FMINDEX) status = esl_sqfile_Open(cfg->dbfile, dbfmt, p7_SEQDBENV, &dbfp);
+  if (dbfmt == eslSQFILE_FMINDEX || status != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "--cpu auto can only sample a sequence file, not %s", cfg->dbfile);
+  esl_sqfile_SetDigital(dbfp, abc);
+
+  bg = p7_bg_Create(abc);
+  gm = p7_profile_Create (hmm->M, abc);
+  om = p7_oprofile_Create(hmm->M, abc);
+  if (bg == NULL || gm == NULL || om == NULL) ESL_XEXCEPTION(eslEMEM, "allocation failed");
+  p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL);
+  p7_oprofile_Convert(gm, om);
+
+  maxres = ESL_MIN((double) p7_CPUTUNE_MAXRES, p7_CPUTUNE_CELLS / ESL_MAX(1, om->M));
+  while ((double) nres < maxres)
+    {
+      if (nblocks == nalloc) {
+	nalloc = ESL_MAX(16, 2 * nalloc);
+	ESL_REALLOC(blocks, sizeof(ESL_SQ_BLOCK *) * nalloc);
+      }
+      if ((blocks[nblocks] = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc)) == NULL) ESL_XEXCEPTION(eslEMEM, "allocation failed");
+      status = esl_sqio_ReadBlock(dbfp, blocks[nblocks], p7_BLOCK_RESIDUES(om->M), -1, /*max_init_window=*/FALSE, FALSE);
+      if (blocks[nblocks]->count == 0) { esl_sq_DestroyBlock(blocks[nblocks]); break; }
+      for (i = 0; i < blocks[nblocks]->count; i++) nres += blocks[nblocks]->list[i].n;
+      nblocks++;
+      if      (status == eslEOF) break;
+      else if (status != eslOK)  ESL_XFAIL(eslEINVAL, errbuf, "--cpu auto failed to parse the targets it sampled from %s", cfg->dbfile);
+    }
+  if (nblocks == 0) ESL_XFAIL(eslEINVAL, errbuf, "--cpu auto found no targets in %s to sample", cfg->dbfile);
+
+  status = p7_cputune_Measure(go, om, blocks, nblocks, esl_threads_GetCPUCount(), cpubind, ret_tune);
+  if (status == eslEINVAL) ESL_XFAIL(eslEINVAL, errbuf, "--cpu auto can't configure a pipeline for the first query");
+
+ ERROR:
+  for (i = 0; i < nblocks; i++) esl_sq_DestroyBlock(blocks[i]);
+  free(blocks);
+  if (om)   p7_oprofile_Destroy(om);
+  if (gm)   p7_profile_Destroy(gm);
+  if (bg)   p7_bg_Destroy(bg);
+  if (hmm)  p7_hmm_Destroy(hmm);
+  if (abc)  esl_alphabet_Destroy(abc);
+  if (dbfp) esl_sqfile_Close(dbfp);
+  if (hfp)  p7_hmmfile_Close(hfp);
+  return status;
+}
 #endif   /* HMMER_THREADS */
  
 
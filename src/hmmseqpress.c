@@ -0,0 +1,94 @@
+/* hmmseqpress: prepare a sequence database for faster hmmsearch, phmmer and jackhmmer searches.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+
+#define ALPHOPTS "--amino,--dna,--rna"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range     toggles      reqs   incomp  help   docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "show brief help on version and usage",                  0 },
+  { "-f",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,      NULL,    NULL, "force: overwrite any previous pressed file",            0 },
+  { "--informat",eslARG_STRING,  NULL, NULL, NULL,      NULL,      NULL,    NULL, "assert <seqfile> is in format <s>: no autodetection",   0 },
+  { "--amino",   eslARG_NONE,   FALSE, NULL, NULL,  ALPHOPTS,      NULL,    NULL, "<seqfile> contains protein sequences",                  0 },
+  { "--dna",     eslARG_NONE,   FALSE, NULL, NULL,  ALPHOPTS,      NULL,    NULL, "<seqfile> contains DNA sequences",                      0 },
+  { "--rna",     eslARG_NONE,   FALSE, NULL, NULL,  ALPHOPTS,      NULL,    NULL, "<seqfile> contains RNA sequences",                      0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <seqfile>";
+static char banner[] = "prepare a sequence database for faster hmmsearch, phmmer and jackhmmer searches";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  ESL_ALPHABET   *abc     = NULL;
+  char           *seqfile = esl_opt_GetArg(go, 1);
+  char           *dbfile  = NULL;
+  ESL_SQFILE     *sqfp    = NULL;
+  int             infmt   = eslSQFILE_UNKNOWN;
+  int             alphatype;
+  uint64_t        nseq, nres;
+  int             status;
+  char            errbuf[eslERRBUFSIZE];
+
+  if (strcmp(seqfile, "-") == 0) p7_Fail("Can't use - for <seqfile> argument: the pressed database is named after it\n");
+
+  if (esl_opt_IsOn(go, "--informat")) {
+    infmt = esl_sqio_EncodeFormat(esl_opt_GetString(go, "--informat"));
+    if (infmt == eslSQFILE_UNKNOWN)  p7_Fail("%s is not a recognized sequence file format\n", esl_opt_GetString(go, "--informat"));
+    if (infmt == eslSQFILE_FMINDEX)  p7_Fail("an fmindex is already a binary database; it can't be pressed\n");
+  }
+
+  status = esl_sqfile_Open(seqfile, infmt, NULL, &sqfp);
+  if      (status == eslENOTFOUND) p7_Fail("Failed to open sequence file %s for reading\n",  seqfile);
+  else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",    seqfile);
+  else if (status != eslOK)        p7_Fail("Unexpected error %d opening sequence file %s\n", status, seqfile);
+
+  if      (esl_opt_GetBoolean(go, "--amino")) alphatype = eslAMINO;
+  else if (esl_opt_GetBoolean(go, "--dna"))   alphatype = eslDNA;
+  else if (esl_opt_GetBoolean(go, "--rna"))   alphatype = eslRNA;
+  else {
+    status = esl_sqfile_GuessAlphabet(sqfp, &alphatype);
+    if      (status == eslENOALPHABET) p7_Fail("Couldn't guess alphabet of sequence file %s; use --amino, --dna or --rna\n", seqfile);
+    else if (status == eslEFORMAT)     p7_Fail("Parse failed (sequence file %s):\n%s\n", seqfile, esl_sqfile_GetErrorBuf(sqfp));
+    else if (status == eslENODATA)     p7_Fail("Sequence file %s contains no data?\n", seqfile);
+    else if (status != eslOK)          p7_Fail("Failed to guess alphabet of sequence file %s\n", seqfile);
+  }
+  abc = esl_alphabet_Create(alphatype);
+  esl_sqfile_SetDigital(sqfp, abc);
+
+  if ((status = esl_sprintf(&dbfile, "%s%s", seqfile, p7_SEQDB_SUFFIX)) != eslOK) p7_Fail("esl_sprintf() failed");
+  if (! esl_opt_GetBoolean(go, "-f") && esl_FileExists(dbfile))
+    p7_Fail("Pressed sequence file %s already exists;\nDelete it first, or use -f to overwrite it\n", dbfile);
+
+  printf("Working...    ");
+  fflush(stdout);
+
+  if ((status = p7_seqdb_Press(sqfp, dbfile, &nseq, &nres, errbuf)) != eslOK)
+    {
+      printf("\n");
+      p7_Fail("%s\n", errbuf);
+    }
+
+  printf("done.\n");
+  printf("Pressed %" PRIu64 " %s sequences (%" PRIu64 " residues).\n", nseq, esl_abc_DecodeType(alphatype), nres);
+  printf("Sequences pressed into binary file: %s\n", dbfile);
+
+  free(dbfile);
+  esl_sqfile_Close(sqfp);
+  esl_alphabet_Destroy(abc);
+  esl_getopts_Destroy(go);
+  exit(0);
+}
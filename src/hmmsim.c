@@ -14,6 +14,11 @@
 #include "mpi.h"
 #endif 
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#include "esl_threads.h"
+#endif
+
 #include "easel.h"
 #include "esl_alphabet.h"
 #include "esl_stats.h"
@@ -34,6 +39,8 @@
 #define ALGORITHMS "--fwd,--vit,--hyb,--msv"           /* Exclusive choice for scoring algorithms */
 #define STYLES     "--fs,--sw,--ls,--s"	               /* Exclusive choice for alignment mode     */
 
+#define SIM_BLOCKSIZE 256   /* random seqs per work block; each block has its own RNG seed */
+
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range     toggles   reqs   incomp  help   docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "show brief help on version and usage",              1 },
@@ -41,6 +48,9 @@ static ESL_OPTIONS options[] = {
   { "-v",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "verbose: print scores",                             1 },
   { "-L",        eslARG_INT,    "100", NULL, "n>0",     NULL,  NULL, NULL, "length of random target seqs",                      1 },
   { "-N",        eslARG_INT,   "1000", NULL, "n>0",     NULL,  NULL, NULL, "number of random target seqs",                      1 },
+#ifdef HMMER_THREADS
+  { "--cpu",     eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL, NULL, NULL, "number of parallel CPU workers to use",              1 },
+#endif
 #ifdef HMMER_MPI
   { "--mpi",     eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL, "run as an MPI parallel program",                    1 },
 #endif
@@ -108,6 +118,7 @@ struct cfg_s {
   int             do_stall;	/* TRUE to stall for MPI debugging */
   int             N;		/* number of simulated seqs per HMM */
   int             L;		/* length of simulated seqs */
+  int             ncpus;	/* number of worker threads; 0 = score in this thread */
 
   /* Masters only (i/o streams) */
   P7_HMMFILE     *hfp;		/* open input HMM file stream */
@@ -134,6 +145,39 @@ static int output_filter_power(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf,
 
 static int elide_length_model(P7_PROFILE *gm, P7_BG *bg);
 
+
+/* SIM_WORK : one work unit's random sequences, divided into blocks for threads.
+ *
+ * The N sequences are scored in blocks of SIM_BLOCKSIZE. Block <b>
+ * is generated from its own RNG, seeded with <seeds[b]>, and puts
+ * its scores in scores[b*SIM_BLOCKSIZE..]. So which thread scores
+ * which block doesn't matter: the scores, and the histograms made of
+ * them, depend only on --seed, not on --cpu.
+ *
+ * The profiles and the null model are only read while scoring, and
+ * are shared. Each thread has its own DP matrices.
+ */
+typedef struct {
+  ESL_GETOPTS     *go;
+  struct cfg_s    *cfg;
+  P7_PROFILE      *gm;
+  P7_OPROFILE     *om;
+  double          *scores;	/* results: N scores           */
+  int             *alilens;	/* optional: N alignment lengths */
+  uint32_t        *seeds;	/* seeds[b]: RNG seed for block b */
+  int              nblocks;
+  int              next;	/* next block to hand out      */
+  int              threaded;	/* TRUE if worker threads share <next> */
+#ifdef HMMER_THREADS
+  pthread_mutex_t  mutex;	/* protects <next>             */
+#endif
+} SIM_WORK;
+
+static int score_blocks(SIM_WORK *wk);
+#ifdef HMMER_THREADS
+static void *sim_thread(void *arg);
+#endif
+
 int
 main(int argc, char **argv)
 {
@@ -199,6 +243,10 @@ main(int argc, char **argv)
   cfg.do_stall = esl_opt_GetBoolean(go, "--stall");
   cfg.N        = esl_opt_GetInteger(go, "-N");
   cfg.L        = esl_opt_GetInteger(go, "-L");
+  cfg.ncpus    = 0;
+#ifdef HMMER_THREADS
+  cfg.ncpus    = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+#endif
   cfg.hfp      = NULL;
   cfg.ofp      = NULL;
   cfg.survfp   = NULL;
@@ -611,15 +659,9 @@ process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm,
   int             L   = esl_opt_GetInteger(go, "-L");
   P7_PROFILE     *gm  = NULL;
   P7_OPROFILE    *om  = NULL;
-  P7_GMX         *gx  = NULL;
-  P7_OMX         *ox  = NULL;
-  P7_TRACE       *tr  = NULL;
-  ESL_DSQ        *dsq = NULL;
-  int             i;
+  SIM_WORK        wk;
+  int             b;
   int             status;
-  int    scounts[p7T_NSTATETYPES]; /* state usage counts from a trace */
-  float  sc;
-  float  nullsc;
   double mu, lambda;
   int    EmL          = esl_opt_GetInteger(go, "--EmL");
   int    EmN          = esl_opt_GetInteger(go, "--EmN");
@@ -628,7 +670,11 @@ process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm,
   int    EfL          = esl_opt_GetInteger(go, "--EfL");
   int    EfN          = esl_opt_GetInteger(go, "--EfN");
   double Eft          = esl_opt_GetReal   (go, "--Eft");
-  float  nu           = esl_opt_GetReal   (go, "--nu");
+#ifdef HMMER_THREADS
+  ESL_THREADS    *obj = NULL;
+#endif
+
+  wk.seeds = NULL;
 
 
   // reseed the RNG to its initial value, to allow reproduction of results
@@ -669,68 +715,201 @@ process_workunit(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm,
   p7_oprofile_Convert(gm, om);
   p7_bg_SetLength    (cfg->bg, L);
 
-  /* Remaining allocations */
-  gx = p7_gmx_Create(gm->M, L);
-  ox = p7_omx_Create(gm->M, 0, L);
-  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
-  tr = p7_trace_Create();
+  /* Collect scores from N random sequences of length L, in blocks.
+   * The block seeds come from <cfg->r> after calibration, so they're
+   * as reproducible as the rest of the run.
+   */
+  wk.go      = go;
+  wk.cfg     = cfg;
+  wk.gm      = gm;
+  wk.om      = om;
+  wk.scores  = scores;
+  wk.alilens = alilens;
+  wk.nblocks = (cfg->N + SIM_BLOCKSIZE - 1) / SIM_BLOCKSIZE;
+  wk.next    = 0;
+  wk.threaded = FALSE;
+  ESL_ALLOC(wk.seeds, sizeof(uint32_t) * wk.nblocks);
+  for (b = 0; b < wk.nblocks; b++)
+    wk.seeds[b] = 1 + esl_rnd_Roll(cfg->r, 2147483646);   /* nonzero: 0 would ask for an arbitrary seed */
+
+#ifdef HMMER_THREADS
+  if (cfg->ncpus > 0 && wk.nblocks > 1)
+    {
+      if (pthread_mutex_init(&wk.mutex, NULL) != 0) ESL_XFAIL(eslESYS, errbuf, "mutex init failed");
+      wk.threaded = TRUE;
+      obj = esl_threads_Create(&sim_thread);
+      for (b = 0; b < ESL_MIN(cfg->ncpus, wk.nblocks); b++)
+	esl_threads_AddThread(obj, &wk);
+      esl_threads_WaitForStart(obj);
+      esl_threads_WaitForFinish(obj);
+      esl_threads_Destroy(obj);
+      pthread_mutex_destroy(&wk.mutex);
+    }
+  else
+#endif
+    if ((status = score_blocks(&wk)) != eslOK) goto ERROR;
 
-  /* Collect scores from N random sequences of length L  */
-  for (i = 0; i < cfg->N; i++)
+  *ret_mu     = mu;
+  *ret_lambda = lambda;
+  status      = eslOK;
+
+ ERROR:
+  if (wk.seeds != NULL) free(wk.seeds);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  if (status == eslEMEM) snprintf(errbuf, eslERRBUFSIZE, "allocation failure");
+  return status;
+}
+
+
+/* score_blocks()
+ *
+ * Score blocks of <wk> until there are none left; called by each
+ * worker thread, or once in serial mode. For each block, generate its
+ * random sequences from the block's own seed, then score them.
+ *
+ * The generic DP algorithms, and the Viterbi and Forward filters,
+ * take one sequence at a time. For --msv --fast, the SSV part of the
+ * MSV filter is done for the whole block at once by
+ * p7_SSVFilter_multi(), as p7_Pipeline_Block() does; the full MSV
+ * filter only runs on sequences where the SSV score isn't exact
+ * (p7_SSVFilter_Score() returns eslENORESULT). Either way the score
+ * is the one p7_MSVFilter() would give.
+ */
+static int
+score_blocks(SIM_WORK *wk)
+{
+  ESL_GETOPTS    *go  = wk->go;
+  struct cfg_s   *cfg = wk->cfg;
+  int             L   = cfg->L;
+  int             do_fast = esl_opt_GetBoolean(go, "--fast");
+  float           nu  = esl_opt_GetReal(go, "--nu");
+  ESL_RANDOMNESS *r   = NULL;
+  P7_GMX         *gx  = NULL;
+  P7_OMX         *ox  = NULL;
+  P7_TRACE       *tr  = NULL;
+  ESL_DSQ        *buf = NULL;	/* SIM_BLOCKSIZE sequences of length L, each with sentinels */
+  ESL_DSQ       **dsq = NULL;	/* dsq[j]: sequence j of the block, in <buf> */
+  int            *len = NULL;
+  uint8_t        *xE  = NULL;	/* batched SSV maxima, for --msv --fast */
+  int    scounts[p7T_NSTATETYPES]; /* state usage counts from a trace */
+  float  sc;
+  float  nullsc;
+  int    b, i, j, n;
+  int    status;
+
+  r  = esl_randomness_Create(1);
+  gx = p7_gmx_Create(wk->gm->M, L);
+  ox = p7_omx_Create(wk->gm->M, 0, L);
+  tr = p7_trace_Create();
+  if (r == NULL || gx == NULL || ox == NULL || tr == NULL) { status = eslEMEM; goto ERROR; }
+  ESL_ALLOC(buf, sizeof(ESL_DSQ)   * (L+2) * SIM_BLOCKSIZE);
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ *) * SIM_BLOCKSIZE);
+  ESL_ALLOC(len, sizeof(int)       * SIM_BLOCKSIZE);
+  ESL_ALLOC(xE,  sizeof(uint8_t)   * SIM_BLOCKSIZE);
+  for (j = 0; j < SIM_BLOCKSIZE; j++) { dsq[j] = buf + (L+2) * j; len[j] = L; }
+
+  while (1)
     {
-      esl_rsq_xfIID(cfg->r, cfg->bg->f, cfg->abc->K, L, dsq);
+#ifdef HMMER_THREADS
+      if (wk->threaded) pthread_mutex_lock(&wk->mutex);
+#endif
+      b = wk->next++;
+#ifdef HMMER_THREADS
+      if (wk->threaded) pthread_mutex_unlock(&wk->mutex);
+#endif
+      if (b >= wk->nblocks) break;
 
-      if (esl_opt_GetBoolean(go, "--fast")) 
-	{
-	  if      (esl_opt_GetBoolean(go, "--vit")) p7_ViterbiFilter(dsq, L, om, ox, &sc);
-	  else if (esl_opt_GetBoolean(go, "--fwd")) p7_ForwardParser(dsq, L, om, ox, &sc);
-	  else if (esl_opt_GetBoolean(go, "--msv")) p7_MSVFilter    (dsq, L, om, ox, &sc);
-	} 
+      n = ESL_MIN(SIM_BLOCKSIZE, cfg->N - b * SIM_BLOCKSIZE);
+      esl_randomness_Init(r, wk->seeds[b]);
+      for (j = 0; j < n; j++)
+	esl_rsq_xfIID(r, cfg->bg->f, cfg->abc->K, L, dsq[j]);
 
-      if (! esl_opt_GetBoolean(go, "--fast") || sc == eslINFINITY) /* note, if a filter overflows, failover to slow versions */
-	{
-	  if      (esl_opt_GetBoolean(go, "--vit")) p7_GViterbi(dsq, L, gm, gx,       &sc);
-	  else if (esl_opt_GetBoolean(go, "--fwd")) p7_GForward(dsq, L, gm, gx,       &sc);
-	  else if (esl_opt_GetBoolean(go, "--hyb")) p7_GHybrid (dsq, L, gm, gx, NULL, &sc);
-	  else if (esl_opt_GetBoolean(go, "--msv")) p7_GMSV    (dsq, L, gm, gx, nu,   &sc);
-	}
+#if defined (eslENABLE_SSE)
+      if (do_fast && esl_opt_GetBoolean(go, "--msv"))
+	if ((status = p7_SSVFilter_multi((const ESL_DSQ **) dsq, len, n, wk->om, xE)) != eslOK) goto ERROR;
+#endif
 
-      /* Optional: get Viterbi alignment length too. */
-      if (esl_opt_GetBoolean(go, "-a"))  /* -a only works with Viterbi; getopts has checked this already */
+      for (j = 0; j < n; j++)
 	{
-	  p7_GTrace(dsq, L, gm, gx, tr);
-	  p7_trace_GetStateUseCounts(tr, scounts);
+	  i = b * SIM_BLOCKSIZE + j;
 
-	  /* there's various ways we could counts "alignment length". 
-	   * Here we'll use the total length of model used, in nodes: M+D states.
-           * score vs al would gives us relative entropy / model position.
-	   */
-	  /* alilens[i] = scounts[p7T_D] + scounts[p7T_I]; SRE: temporarily testing this instead */
-	  alilens[i] = scounts[p7T_M] + scounts[p7T_D] + scounts[p7T_I];
+	  if (do_fast) 
+	    {
+	      if      (esl_opt_GetBoolean(go, "--vit")) p7_ViterbiFilter(dsq[j], L, wk->om, ox, &sc);
+	      else if (esl_opt_GetBoolean(go, "--fwd")) p7_ForwardParser(dsq[j], L, wk->om, ox, &sc);
+	      else if (esl_opt_GetBoolean(go, "--msv"))
+		{
+#if defined (eslENABLE_SSE)
+		  if (p7_SSVFilter_Score(xE[j], wk->om, &sc) == eslENORESULT)
+#endif
+		    p7_MSVFilter(dsq[j], L, wk->om, ox, &sc);
+		}
+	    } 
 
-	  p7_trace_Reuse(tr);
-	}
+	  if (! do_fast || sc == eslINFINITY) /* note, if a filter overflows, failover to slow versions */
+	    {
+	      if      (esl_opt_GetBoolean(go, "--vit")) p7_GViterbi(dsq[j], L, wk->gm, gx,       &sc);
+	      else if (esl_opt_GetBoolean(go, "--fwd")) p7_GForward(dsq[j], L, wk->gm, gx,       &sc);
+	      else if (esl_opt_GetBoolean(go, "--hyb")) p7_GHybrid (dsq[j], L, wk->gm, gx, NULL, &sc);
+	      else if (esl_opt_GetBoolean(go, "--msv")) p7_GMSV    (dsq[j], L, wk->gm, gx, nu,   &sc);
+	    }
 
-      p7_bg_NullOne(cfg->bg, dsq, L, &nullsc);
-      scores[i] = (sc - nullsc) / eslCONST_LOG2;
-    }
+	  /* Optional: get Viterbi alignment length too. */
+	  if (esl_opt_GetBoolean(go, "-a"))  /* -a only works with Viterbi; getopts has checked this already */
+	    {
+	      p7_GTrace(dsq[j], L, wk->gm, gx, tr);
+	      p7_trace_GetStateUseCounts(tr, scounts);
 
-  *ret_mu     = mu;
-  *ret_lambda = lambda;
-  status      = eslOK;
+	      /* there's various ways we could counts "alignment length". 
+	       * Here we'll use the total length of model used, in nodes: M+D states.
+	       * score vs al would gives us relative entropy / model position.
+	       */
+	      /* alilens[i] = scounts[p7T_D] + scounts[p7T_I]; SRE: temporarily testing this instead */
+	      wk->alilens[i] = scounts[p7T_M] + scounts[p7T_D] + scounts[p7T_I];
+
+	      p7_trace_Reuse(tr);
+	    }
+
+	  p7_bg_NullOne(cfg->bg, dsq[j], L, &nullsc);
+	  wk->scores[i] = (sc - nullsc) / eslCONST_LOG2;
+	}
+    }
+  status = eslOK;
 
  ERROR:
-  if (dsq != NULL) free(dsq);
+  if (buf) free(buf);
+  if (dsq) free(dsq);
+  if (len) free(len);
+  if (xE)  free(xE);
+  esl_randomness_Destroy(r);
   p7_omx_Destroy(ox);
-  p7_oprofile_Destroy(om);
-  p7_profile_Destroy(gm);
   p7_gmx_Destroy(gx);
   p7_trace_Destroy(tr);
-  if (status == eslEMEM) snprintf(errbuf, eslERRBUFSIZE, "allocation failure");
   return status;
 }
 
 
+#ifdef HMMER_THREADS
+static void *
+sim_thread(void *arg)
+{
+  ESL_THREADS *obj = (ESL_THREADS *) arg;
+  SIM_WORK    *wk;
+  int          workeridx;
+
+  impl_Init();
+  esl_threads_Started(obj, &workeridx);
+  wk = (SIM_WORK *) esl_threads_GetData(obj, workeridx);
+
+  if (score_blocks(wk) != eslOK) esl_fatal("hmmsim worker thread failed: allocation failure");
+
+  esl_threads_Finished(obj, workeridx);
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+
+
 static int 
 output_result(ESL_GETOPTS *go, struct cfg_s *cfg, char *errbuf, P7_HMM *hmm, double *scores, int *alilens, double pmu, double plambda)
 {
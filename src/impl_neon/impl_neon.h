@@ -13,6 +13,9 @@
 #include "esl_random.h"
 
 #include <arm_neon.h>   /* NEON */
+#ifdef HMMER_SVE
+#include <sys/auxv.h>    /* getauxval() in impl_HaveSVE(); SVE code itself is only built in *_sve.c */
+#endif
 #include "hmmer.h"
 
 /* In calculating Q, the number of vectors we need in a row, we have
@@ -24,6 +27,10 @@
 
 #define p7O_EXTRA_SB 17    /* see ssvfilter.c for explanation */
 
+#ifdef HMMER_SVE
+#define p7O_NQB_SVE(M,W) ( ESL_MAX(2, ((((M)-1) / (W)) + 1)))  /* W uchars; W = runtime SVE vector length, bytes */
+#endif
+
 
 /*****************************************************************
  * 1. P7_OPROFILE: an optimized score profile
@@ -102,6 +109,16 @@ typedef struct p7_oprofile_s {
   float32x4_t *tfv_mem;
   float32x4_t *rfv_mem;
 
+#ifdef HMMER_SVE
+  /* SVE MSV filter: the same scores striped W ways, W = the host's SVE vector
+   * length in bytes, known only at runtime. [x][q][z] with Q = p7O_NQB_SVE(M,W),
+   * contiguous; NULL if not built (non-SVE host). See p7_oprofile_ConvertSVE().     */
+  uint8_t     *rbv_sve;
+  int          sve_w;           /* W: # of uchar cells per vector it was striped for */
+  int          sve_q;           /* Q: # of vectors per residue row                   */
+  int64_t      allocSVE;        /* allocated size of <rbv_sve>, in bytes             */
+#endif
+
   /* Disk offset information for hmmpfam's fast model retrieval                      */
   off_t  offs[p7_NOFFSETS];     /* p7_{MFP}OFFSET, or -1                             */
 
@@ -256,6 +273,7 @@ extern P7_OMX      *p7_omx_Create(int allocM, int allocL, int allocXL);
 extern int          p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL);
 extern int          p7_omx_FDeconvert(P7_OMX *ox, P7_GMX *gx);
 extern int          p7_omx_Reuse  (P7_OMX *ox);
+extern size_t       p7_omx_Sizeof (const P7_OMX *ox);
 extern void         p7_omx_Destroy(P7_OMX *ox);
 
 extern int          p7_omx_SetDumpMode(FILE *fp, P7_OMX *ox, int truefalse);
@@ -281,6 +299,8 @@ extern int          p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om);
 extern int          p7_oprofile_ReconfigLength    (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigMSVLength (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigRestLength(P7_OPROFILE *om, int L);
+extern int          p7_oprofile_SetMSVLength      (P7_OPROFILE *om, const P7_LENPARAM *lp);
+extern int          p7_oprofile_SetRestLength     (P7_OPROFILE *om, const P7_LENPARAM *lp);
 extern int          p7_oprofile_ReconfigMultihit  (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigUnihit    (P7_OPROFILE *om, int L);
 
@@ -295,6 +315,9 @@ extern int          p7_oprofile_GetFwdTransitionArray(const P7_OPROFILE *om, int
 extern int          p7_oprofile_GetSSVEmissionScoreArray(const P7_OPROFILE *om, uint8_t *arr );
 extern int          p7_oprofile_GetFwdEmissionScoreArray(const P7_OPROFILE *om, float *arr );
 extern int          p7_oprofile_GetFwdEmissionArray(const P7_OPROFILE *om, P7_BG *bg, float *arr );
+#ifdef HMMER_SVE
+extern int          p7_oprofile_ConvertSVE(P7_OPROFILE *om);
+#endif
 
 /* decoding.c */
 extern int p7_Decoding      (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp);
@@ -322,8 +345,15 @@ extern int p7_SSVFilter    (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, fl
 
 /* msvfilter.c */
 extern int p7_MSVFilter           (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_MSVFilter_neon      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 extern int p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist);
 
+/* msvfilter_sve.c */
+#ifdef HMMER_SVE
+extern int p7_sve_VectorBytes(void);
+extern int p7_MSVFilter_sve  (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+#endif
+
 
 /* null2.c */
 extern int p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
@@ -370,4 +400,27 @@ impl_Init(void)
   _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 #endif
 }
+
+/* impl_HaveSVE()
+ * TRUE if the SVE MSV filter was compiled in and the running
+ * processor (and kernel) supports SVE. p7_MSVFilter() and the
+ * profile conversion use this to dispatch at runtime, so a single
+ * aarch64 binary runs on both NEON-only and SVE hosts. To compare
+ * the two, call p7_MSVFilter_neon() directly.
+ */
+static inline int
+impl_HaveSVE(void)
+{
+#ifdef HMMER_SVE
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+  static int have_sve = -1;   /* -1 = not yet determined. Benign race: all threads compute the same answer. */
+  if (have_sve == -1)
+    have_sve = (getauxval(AT_HWCAP) & HWCAP_SVE) ? 1 : 0;
+  return have_sve;
+#else
+  return 0;
+#endif
+}
 #endif /* P7_IMPL_NEON_INCLUDED */
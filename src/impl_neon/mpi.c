@@ -375,6 +375,9 @@ p7_oprofile_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, ESL_ALPHABET **
   if (MPI_Unpack(buf, n, pos, &om->bias_b,       1,                     MPI_CHAR, comm) != 0) ESL_EXCEPTION(eslESYS, "mpi unpack failed");
   for (x = 0; x < K; x++)
     if (MPI_Unpack(buf, n, pos,  om->rbv[x],     vsz*Q16,               MPI_CHAR, comm) != 0) ESL_EXCEPTION(eslESYS, "mpi unpack failed");
+#ifdef HMMER_SVE
+  if (impl_HaveSVE() && p7_oprofile_ConvertSVE(om) != eslOK) ESL_EXCEPTION(eslEMEM, "SVE restripe failed");
+#endif
 
   /* Viterbi Filter information */
   if (MPI_Unpack(buf, n, pos, &om->scale_w,      1,                    MPI_FLOAT, comm) != 0) ESL_EXCEPTION(eslESYS, "mpi unpack failed");
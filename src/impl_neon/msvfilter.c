@@ -34,6 +34,27 @@
  *****************************************************************/
 
 /* Function:  p7_MSVFilter()
+ * Synopsis:  Calculates MSV score, dispatching to SVE where possible.
+ *
+ * Purpose:   Same as <p7_MSVFilter_neon()>. If the SVE filter was
+ *            compiled in and the host supports it (<impl_HaveSVE()>),
+ *            call the identical-result <p7_MSVFilter_sve()> instead,
+ *            unless it passes on the model (<eslENORESULT>; see its
+ *            notes).
+ */
+int
+p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+#ifdef HMMER_SVE
+  int status;
+
+  if (impl_HaveSVE() && (status = p7_MSVFilter_sve(dsq, L, om, ox, ret_sc)) != eslENORESULT) return status;
+#endif
+  return p7_MSVFilter_neon(dsq, L, om, ox, ret_sc);
+}
+
+
+/* Function:  p7_MSVFilter_neon()
  * Synopsis:  Calculates MSV score, vewy vewy fast, in limited precision.
  * Incept:    SRE, Wed Dec 26 15:12:25 2007 [Janelia]
  *
@@ -50,6 +71,9 @@
  *            assumes a multihit local mode, and uses its own special
  *            state transition scores, not the scores in the profile.
  *
+ *            This is the NEON version, which <p7_MSVFilter()> calls
+ *            when the SVE filter isn't available.
+ *
  * Args:      dsq     - digital target sequence, 1..L
  *            L       - length of dsq in residues
  *            om      - optimized profile
@@ -70,7 +94,7 @@
  * Throws:    <eslEINVAL> if <ox> allocation is too small.
  */
 int
-p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+p7_MSVFilter_neon(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
 {
   register uint8x16_t mpv;         /* previous row values                                       */
   register uint8x16_t xEv;		     /* E state: keeps max for Mk->E as we go                     */
@@ -78,21 +102,14 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
   register uint8x16_t sv;		       /* temp storage of 1 curr row value in progress              */
   register uint8x16_t biasv;	     /* emission bias in a vector                                 */
   register uint8x16_t zerov;       /* zero vector                                               */
-  uint8_t  xJ;                     /* special states' scores                                    */
+  uint8_t  xE, xB, xJ;             /* special states' scores                                    */
+  uint8_t  tjbm;                   /* cost of moving from either J or N through B to an M state */
   int i;			   /* counter over sequence positions 1..L                      */
   int q;			   /* counter over vectors 0..nq-1                              */
   int Q        = p7O_NQB(om->M);   /* segment length: # of vectors                              */
   uint8x16_t *dp  = ox->dpb[0];	   /* we're going to use dp[0][0..q..Q-1], not {MDI}MX(q) macros*/
   uint8x16_t *rsc;			   /* will point at om->rbv[x] for residue x[i]                 */
 
-  uint8x16_t xJv;                     /* vector for states score                                   */
-  uint8x16_t tjbmv;                   /* vector for cost of moving from either J or N through B to an M state */
-  uint8x16_t tecv;                    /* vector for E->C  cost                                     */
-  uint8x16_t basev;                   /* offset for scores                                         */
-  uint8x16_t ceilingv;                /* saturateed simd value used to test for overflow           */
-  uint8x16_t tempv;                   /* work vector                                               */
-
-  int cmp;
   int status = eslOK;
 
   /* Keep a null vector in a register to emulate _mm_slli_si128 efficiently */
@@ -112,24 +129,12 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
   for (q = 0; q < Q; q++) dp[q] = vmovq_n_u8(0);
   xJ   = 0;
 
-  /* saturate simd register for overflow test */
-  ceilingv = vceqq_u8(biasv, biasv);
-  basev = vmovq_n_u8(om->base_b);
-
-  tjbmv = vmovq_n_u8(om->tjb_b + om->tbm_b);
-  tecv = vmovq_n_u8(om->tec_b);
-
-  xJv = vqsubq_u8(biasv, biasv);
-  xBv = vqsubq_u8(basev, tjbmv);
+  tjbm = om->tjb_b + om->tbm_b;
+  xB   = (om->base_b > tjbm ? om->base_b - tjbm : 0);
+  xBv  = vmovq_n_u8(xB);
 
 #if eslDEBUGLEVEL > 0
-  if (ox->debugging)
-  {
-      uint8_t xB;
-      xB = (uint8_t)vgetq_lane_s16(vreinterpretq_s16_u8(xBv), 0);
-      xJ = (uint8_t)vgetq_lane_s16(vreinterpretq_s16_u8(xJv), 0);
-      p7_omx_DumpMFRow(ox, 0, 0, 0, xJ, xB, xJ);
-  }
+  if (ox->debugging) p7_omx_DumpMFRow(ox, 0, 0, 0, xJ, xB, xJ);
 #endif
 
   for (i = 1; i <= L; i++)
@@ -154,46 +159,32 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
         dp[q] = sv;       	  /* Do delayed store of M(i,q) now that memory is usable */
       }
 
-      /* test for the overflow condition */
-      tempv = vqaddq_u8(xEv, biasv);
-      tempv = vceqq_u8(tempv, ceilingv);
-      cmp = esl_neon_hmax_u8((esl_neon_128i_t) tempv);
-
-      /* Now the "special" states, which start from Mk->E (->C, ->J->B)
-       * Use shuffles instead of shifts so when the last max has completed,
-       * the last four elements of the simd register will contain the
-       * max value.  Then the last shuffle will broadcast the max value
-       * to all simd elements.
+      /* One horizontal max serves both for xE and for the overflow
+       * test: some lane of xEv+bias saturates exactly when the
+       * largest one does. (The SSE version tests a movemask of the
+       * saturated lanes, which is cheaper there than on NEON, where a
+       * reduction is the only way to get at the lanes.) The special
+       * states are then done in scalar, and only xB goes back into a
+       * vector, for the next row.
        */
-      xEv = vmovq_n_u8(esl_neon_hmax_u8((esl_neon_128i_t) xEv));
-
-      /* immediately detect overflow */
-      if (cmp != 0)
+      xE = esl_neon_hmax_u8((esl_neon_128i_t) xEv);
+      if (xE >= 255 - om->bias_b)
       {
         *ret_sc = eslINFINITY;
         return eslERANGE;
       }
 
-      xEv = vqsubq_u8(xEv, tecv);
-      xJv = vmaxq_u8(xJv,xEv);
-
-      xBv = vmaxq_u8(basev, xJv);
-      xBv = vqsubq_u8(xBv, tjbmv);
+      xE  = (xE > om->tec_b ? xE - om->tec_b : 0);
+      xJ  = ESL_MAX(xJ, xE);
+      xB  = ESL_MAX(om->base_b, xJ);
+      xB  = (xB > tjbm ? xB - tjbm : 0);
+      xBv = vmovq_n_u8(xB);
 
 #if eslDEBUGLEVEL > 0
-      if (ox->debugging)
-      {
-        uint8_t xB, xE;
-        xB = (uint8_t)vgetq_lane_s16(vreinterpretq_s16_u8(xBv), 0);
-        xE = (uint8_t)vgetq_lane_s16(vreinterpretq_s16_u8(xEv), 0);
-        xJ = (uint8_t)vgetq_lane_s16(vreinterpretq_s16_u8(xJv), 0);
-        p7_omx_DumpMFRow(ox, i, xE, 0, xJ, xB, xJ);
-      }
+      if (ox->debugging) p7_omx_DumpMFRow(ox, i, xE, 0, xJ, xB, xJ);
 #endif
   } /* end loop over sequence residues 1..L */
 
-  xJ = (uint8_t) vgetq_lane_s16(vreinterpretq_s16_u8(xJv), 0);
-
   /* finally C->T, and add our missing precision on the NN,CC,JJ back */
   *ret_sc = ((float) (xJ - om->tjb_b) - (float) om->base_b);
   *ret_sc /= om->scale_b;
@@ -264,10 +255,7 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
   uint8x16_t *rsc;			         /* will point at om->rbv[x] for residue x[i]                 */
   uint8x16_t tjbmv;              /* vector for J->B move cost + B->M move costs               */
   uint8x16_t basev;              /* offset for scores                                         */
-  uint8x16_t ceilingv;           /* saturated simd value used to test for overflow           */
-  uint8x16_t tempv;              /* work vector                                               */
   uint8x16_t zerov;              /* zero vector */
-  int cmp;
   int k;
   int n;
   int end;
@@ -305,7 +293,6 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
    *  1 bit for each doubling of the length model, so they offset.
    */
   float nullsc;
-  uint8x16_t sc_threshv;
   uint8_t sc_thresh;
   float invP = esl_gumbel_invsurv(P, om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
 
@@ -320,12 +307,10 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
   p7_bg_NullOne  (bg, dsq, om->max_length, &nullsc);
 
   sc_thresh = (int) ceil( ( ( nullsc  + (invP * eslCONST_LOG2) + 3.0 )  * om->scale_b ) + om->base_b +  om->tec_b  + om->tjb_b );
-  sc_threshv = vmovq_n_u8(255 - sc_thresh);
 
   /* Initialization. In offset unsigned  arithmetic, -infinity is 0, and 0 is om->base.
    */
   biasv = vmovq_n_u8(om->bias_b);
-  ceilingv = vceqq_u8(biasv, biasv);
   for (q = 0; q < Q; q++) dp[q] = vmovq_n_u8(0);
 
   basev = vmovq_n_u8(om->base_b);
@@ -354,13 +339,9 @@ p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox,
         dp[q] = sv;       	  /* Do delayed store of M(i,q) now that memory is usable */
       }
 
-      /* test if the pthresh significance threshold has been reached;
-       * note: don't use _mm_cmpgt_epi8, because it's a signed comparison, which won't work on uint8s */
-      tempv = vqaddq_u8(xEv, sc_threshv);
-      tempv = vceqq_u8(tempv, ceilingv);
-      cmp = esl_neon_hmax_u8((esl_neon_128i_t) tempv);
-
-      if (cmp != 0) {  //hit pthresh, so add position to list and reset values
+      /* test if the pthresh significance threshold has been reached: 
+       * the largest lane of xEv is >= sc_thresh. A single reduction does it */
+      if (esl_neon_hmax_u8((esl_neon_128i_t) xEv) >= sc_thresh) {  //hit pthresh, so add position to list and reset values
         //figure out which model state hit threshold
         end = -1;
         rem_sc = -1;
@@ -0,0 +1,303 @@
+/* SVE version of the MSV filter.
+ *
+ * This is the same algorithm as p7_MSVFilter() (msvfilter.c), but
+ * written against the ARM Scalable Vector Extension, whose vector
+ * length is a property of the processor rather than of the code: 128
+ * bits on some cores, 256 on Graviton3, 512 on A64FX, up to 2048 in
+ * principle. Nothing here assumes a width. The striping of the match
+ * scores, W = svcntb() uchar cells per vector and Q = p7O_NQB_SVE(M,W)
+ * vectors per row, is only known at runtime; p7_oprofile_ConvertSVE()
+ * builds <om->rbv_sve> in that layout from the 16-way <om->rbv>.
+ *
+ * Only this file is compiled with SVE instructions enabled
+ * (SVE_CFLAGS). The rest of HMMER stays NEON-only, and p7_MSVFilter()
+ * dispatches here at runtime when impl_HaveSVE() says the host
+ * supports it, so one aarch64 binary runs on SVE and non-SVE hosts.
+ *
+ * Contents:
+ *   1. p7_MSVFilter_sve() implementation
+ *   2. Unit tests
+ *   3. Test driver
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_SVE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <arm_sve.h>		/* SVE  */
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_neon.h"
+
+
+/*****************************************************************
+ * 1. p7_MSVFilter_sve() implementation
+ *****************************************************************/
+
+/* Function:  p7_sve_VectorBytes()
+ * Synopsis:  Return the host's SVE vector length, in bytes.
+ *
+ * Purpose:   Return the number of uchar cells in an SVE vector on the
+ *            running processor. This is the striping width
+ *            <p7_oprofile_ConvertSVE()> uses. It is here, rather than
+ *            in p7_oprofile.c, because it is an SVE instruction: the
+ *            caller must have checked <impl_HaveSVE()>.
+ */
+int
+p7_sve_VectorBytes(void)
+{
+  return (int) svcntb();
+}
+
+
+/* Function:  p7_MSVFilter_sve()
+ * Synopsis:  SVE version of p7_MSVFilter().
+ *
+ * Purpose:   Same as <p7_MSVFilter()>: calculates an approximation of
+ *            the MSV score for sequence <dsq> of length <L> residues,
+ *            using optimized profile <om> and a preallocated one-row
+ *            DP matrix <ox>, and returns it in <ret_sc>. Results are
+ *            identical to the NEON implementation.
+ *
+ *            Unlike the NEON version this doesn't try the SSV filter
+ *            first; it always runs the full MSV recursion, which
+ *            gives the same score.
+ *
+ *            Caller must have checked that the host supports SVE
+ *            (<impl_HaveSVE()>), and <om> must have been restriped
+ *            for it (<p7_oprofile_ConvertSVE()>).
+ *
+ * Note:      As in <p7_MSVFilter()> we misuse <ox>, using its DP
+ *            memory as one row of <Q> vectors of <W> bytes. On a
+ *            wide SVE host and a very small model that row can be
+ *            bigger than <ox> is; then we return <eslENORESULT>, and
+ *            the caller uses the NEON filter instead.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if the score overflows the limited range; in
+ *            this case, this is a high-scoring hit.
+ *            <eslENORESULT> if <om> isn't striped for this host's
+ *            vector length, or the row doesn't fit in <ox>.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ */
+int
+p7_MSVFilter_sve(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  svbool_t    pg    = svptrue_b8(); /* all lanes active: rows are padded to whole vectors        */
+  svuint8_t   mpv;                 /* previous row values                                       */
+  svuint8_t   xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  svuint8_t   xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  svuint8_t   sv;		   /* temp storage of 1 curr row value in progress              */
+  svuint8_t   biasv;	           /* emission bias in a vector                                 */
+  uint8_t     xE, xJ, xB;          /* special states' scores                                    */
+  uint8_t     tjbm = om->tjb_b + om->tbm_b; /* cost of moving from J or N through B to an M state */
+  int         W    = (int) svcntb(); /* # of uchar cells per vector on this host                */
+  int         Q    = p7O_NQB_SVE(om->M, W); /* segment length: # of vectors                     */
+  int         i;		   /* counter over sequence positions 1..L                      */
+  int         q;		   /* counter over vectors 0..nq-1                              */
+  uint8_t    *dp;                  /* we're going to use dp[0..q*W..(Q-1)*W], one row           */
+  const uint8_t *rsc;		   /* will point at om->rbv_sve for residue x[i]                */
+
+  /* Check that the DP matrix is ok for us. */
+  if (p7O_NQB(om->M) > ox->allocQ16)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (om->rbv_sve == NULL || om->sve_w != W || om->sve_q != Q) return eslENORESULT;
+  if ((int64_t) Q * W > (int64_t) ox->allocR * ox->allocQ4 * p7X_NSCELLS * sizeof(float32x4_t)) return eslENORESULT;
+  ox->M   = om->M;
+  dp      = (uint8_t *) ox->dpb[0];
+
+  /* Initialization. In offset unsigned arithmetic, -infinity is 0, and 0 is om->base.
+   */
+  biasv = svdup_n_u8(om->bias_b);
+  for (q = 0; q < Q; q++) svst1_u8(pg, dp + q*W, svdup_n_u8(0));
+  xJ    = 0;
+  xB    = (om->base_b > tjbm ? om->base_b - tjbm : 0);
+  xBv   = svdup_n_u8(xB);
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc = om->rbv_sve + (size_t) dsq[i] * Q * W;
+      xEv = svdup_n_u8(0);
+
+      /* Right shift by one lane: INSR moves every element up one
+       * and puts the scalar in lane 0. The zero shifted on is our
+       * -infinity.
+       */
+      mpv = svinsr_n_u8(svld1_u8(pg, dp + (Q-1)*W), 0);
+      for (q = 0; q < Q; q++)
+	{
+	  /* Calculate new MMXo(i,q); don't store it yet, hold it in sv. */
+	  sv   = svmax_u8_x(pg, mpv, xBv);
+	  sv   = svqadd_u8(sv, biasv);
+	  sv   = svqsub_u8(sv, svld1_u8(pg, rsc + q*W));
+	  xEv  = svmax_u8_x(pg, xEv, sv);
+
+	  mpv  = svld1_u8(pg, dp + q*W);  /* Load {MDI}(i-1,q) into mpv */
+	  svst1_u8(pg, dp + q*W, sv);     /* Do delayed store of M(i,q) now that memory is usable */
+	}
+
+      /* Now the "special" states, in scalar, as in the NEON version. */
+      xE = svmaxv_u8(pg, xEv);
+
+      /* immediately detect overflow */
+      if (xE >= 255 - om->bias_b) { *ret_sc = eslINFINITY; return eslERANGE; }
+
+      xE  = (xE > om->tec_b ? xE - om->tec_b : 0);
+      xJ  = ESL_MAX(xJ, xE);
+      xB  = ESL_MAX(om->base_b, xJ);
+      xB  = (xB > tjbm ? xB - tjbm : 0);
+      xBv = svdup_n_u8(xB);
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T, and add our missing precision on the NN,CC,JJ back */
+  *ret_sc = ((float) (xJ - om->tjb_b) - (float) om->base_b);
+  *ret_sc /= om->scale_b;
+  *ret_sc -= 3.0; /* that's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ */
+
+  return eslOK;
+}
+/*------------------ end, p7_MSVFilter_sve() --------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#ifdef p7MSVFILTER_SVE_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* The SVE filter must give exactly the same scores and return codes
+ * as the NEON one, for a random model of length <M> and <N> random
+ * test sequences of length <L>. main() only runs this on SVE hosts,
+ * where p7_oprofile_Convert() has already restriped the profiles.
+ */
+static void
+utest_msv_sve(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "msvfilter_sve unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  P7_OPROFILE *om2 = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *ox  = p7_omx_Create(ESL_MAX(M, 2*p7_sve_VectorBytes()), 0, 0);  /* big enough for a row on any width */
+  float        sc1, sc2;
+  int          st1, st2;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  if ((om2 = p7_oprofile_Copy(om))    == NULL)  esl_fatal(msg);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      st1 = p7_MSVFilter_neon(dsq, L, om,  ox, &sc1);
+      st2 = p7_MSVFilter_sve (dsq, L, om2, ox, &sc2);    /* also checks that _Copy() carries the SVE scores */
+      if (st1 != st2)                    esl_fatal("%s: MSV status differs (%d, %d)", msg, st1, st2);
+      if (st1 == eslOK && sc1 != sc2)    esl_fatal("%s: MSV scores differ (%.2f, %.2f)", msg, sc1, sc2);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  p7_oprofile_Destroy(om2);
+}
+#endif /*p7MSVFILTER_SVE_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7MSVFILTER_SVE_TESTDRIVE
+/*
+   gcc -g -Wall -march=armv8-a+sve -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o msvfilter_sve_utest -Dp7MSVFILTER_SVE_TESTDRIVE msvfilter_sve.c -lhmmer -leasel -lm
+   ./msvfilter_sve_utest
+ */
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_neon.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the SVE MSV filter implementation";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  if (! impl_HaveSVE())
+    {
+      if (esl_opt_GetBoolean(go, "-v")) printf("host has no SVE; test skipped\n");
+      esl_getopts_Destroy(go);
+      esl_randomness_Destroy(r);
+      return eslOK;
+    }
+  if (esl_opt_GetBoolean(go, "-v")) printf("SVE vector length: %d bytes\n", p7_sve_VectorBytes());
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("MSVFilter_sve() tests, DNA\n");
+  utest_msv_sve(r, abc, bg, M,   L, N);   /* normal sized models */
+  utest_msv_sve(r, abc, bg, 1,   L, 10);  /* size 1 models       */
+  utest_msv_sve(r, abc, bg, M,   1, 10);  /* size 1 sequences    */
+  utest_msv_sve(r, abc, bg, 17,  L, 10);  /* just over one 16-way segment */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("MSVFilter_sve() tests, protein\n");
+  utest_msv_sve(r, abc, bg, M,   L, N);
+  utest_msv_sve(r, abc, bg, 1,   L, 10);
+  utest_msv_sve(r, abc, bg, M,   1, 10);
+  utest_msv_sve(r, abc, bg, 1000,L, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7MSVFILTER_SVE_TESTDRIVE*/
+
+
+#else /* ! HMMER_SVE */
+
+/* Provide a dummy symbol so this compilation unit isn't empty.  */
+void p7_msvfilter_sve_silence_hack(void) { return; }
+
+#endif /* HMMER_SVE or not */
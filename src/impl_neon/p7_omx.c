@@ -77,7 +77,7 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ox->allocQ16 = p7O_NQB(allocM);
   ox->ncells   = (int64_t) ox->allocR * (int64_t) ox->allocQ4 * 4;      /* # of DP cells allocated, where 1 cell contains MDI */
 
-  ESL_ALLOC(ox->dp_mem, sizeof(uint8x16_t) * (int64_t) ox->allocR * (int64_t) ox->allocQ4 * p7X_NSCELLS + 15);  /* floats always dominate; +15 for alignment */
+  if ((ox->dp_mem = p7_hugemem_Alloc(sizeof(uint8x16_t) * (int64_t) ox->allocR * (int64_t) ox->allocQ4 * p7X_NSCELLS + 15)) == NULL) ESL_XEXCEPTION(eslEMEM, "DP matrix allocation failed");  /* floats always dominate; +15 for alignment */
   ESL_ALLOC(ox->dpb,    sizeof(uint8x16_t  *) * ox->allocR);
   ESL_ALLOC(ox->dpw,    sizeof(int16x8_t   *) * ox->allocR);
   ESL_ALLOC(ox->dpf,    sizeof(float32x4_t *) * ox->allocR);
@@ -147,10 +147,11 @@ p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL)
 
   /* If the main matrix is too small in cells, reallocate it; 
    * and we'll need to realign/reset the row pointers later.
+   * Its contents aren't kept (p7_hugemem_Grow()); it's refilled anyway.
    */
   if (ncells > ox->ncells)
     {
-      ESL_RALLOC(ox->dp_mem, p, sizeof(uint8x16_t) * (int64_t) (allocL+1) * (int64_t) nqf * p7X_NSCELLS + 15);
+      if ((ox->dp_mem = p7_hugemem_Grow(ox->dp_mem, sizeof(uint8x16_t) * (int64_t) (allocL+1) * (int64_t) nqf * p7X_NSCELLS + 15)) == NULL) ESL_XEXCEPTION(eslEMEM, "DP matrix allocation failed");
       ox->ncells = ncells;
       reset_row_pointers = TRUE;
     }
@@ -278,6 +279,25 @@ p7_omx_Reuse(P7_OMX *ox)
 
 
 
+/* Function:  p7_omx_Sizeof()
+ * Synopsis:  Returns the allocated size of an optimized DP matrix, in bytes.
+ *
+ * Purpose:   Returns the number of bytes currently allocated for
+ *            optimized DP matrix <ox>: the size it has grown to, not
+ *            the size of the last comparison it held.
+ */
+size_t
+p7_omx_Sizeof(const P7_OMX *ox)
+{
+  size_t n = sizeof(P7_OMX);
+
+  n += sizeof(float) * (size_t) ox->ncells * p7X_NSCELLS + 15;   /* main cells: one cell holds M,D,I */
+  n += sizeof(void *) * (size_t) ox->allocR * 3;                 /* row ptrs   */
+  n += sizeof(float) * (size_t) ox->allocXR * p7X_NXCELLS + 15;  /* specials   */
+  return n;
+}
+
+
 /* Function:  p7_omx_Destroy()
  * Synopsis:  Frees an optimized DP matrix.
  * Incept:    SRE, Tue Nov 27 09:11:42 2007 [Janelia]
@@ -291,7 +311,7 @@ p7_omx_Destroy(P7_OMX *ox)
 {
   if (ox == NULL) return;
   if (ox->x_mem   != NULL) free(ox->x_mem);
-  if (ox->dp_mem  != NULL) free(ox->dp_mem);
+  if (ox->dp_mem  != NULL) p7_hugemem_Free(ox->dp_mem);
   if (ox->dpf     != NULL) free(ox->dpf);
   if (ox->dpw     != NULL) free(ox->dpw);
   if (ox->dpb     != NULL) free(ox->dpb);
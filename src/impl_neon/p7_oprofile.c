@@ -69,6 +69,12 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   om->twv     = NULL;
   om->rfv     = NULL;
   om->tfv     = NULL;
+#ifdef HMMER_SVE
+  om->rbv_sve  = NULL;   /* allocated on demand, by p7_oprofile_ConvertSVE() */
+  om->sve_w    = 0;
+  om->sve_q    = 0;
+  om->allocSVE = 0;
+#endif
   om->clone   = 0;
 
   /* level 1 */
@@ -185,6 +191,9 @@ p7_oprofile_Destroy(P7_OPROFILE *om)
       if (om->sbv       != NULL) free(om->sbv);
       if (om->rwv       != NULL) free(om->rwv);
       if (om->rfv       != NULL) free(om->rfv);
+#ifdef HMMER_SVE
+      if (om->rbv_sve   != NULL) free(om->rbv_sve);
+#endif
       if (om->name      != NULL) free(om->name);
       if (om->acc       != NULL) free(om->acc);
       if (om->desc      != NULL) free(om->desc);
@@ -231,6 +240,9 @@ p7_oprofile_Sizeof(P7_OPROFILE *om)
   n  += sizeof(uint8x16_t  *) * om->abc->Kp;          /* om->sbv       */
   n  += sizeof(int16x8_t   *) * om->abc->Kp;          /* om->rwv       */
   n  += sizeof(float32x4_t *) * om->abc->Kp;          /* om->rfv       */
+#ifdef HMMER_SVE
+  n  += om->allocSVE;                                 /* om->rbv_sve   */
+#endif
 
   n  += sizeof(char) * (om->allocM+2);            /* om->rf        */
   n  += sizeof(char) * (om->allocM+2);            /* om->mm        */
@@ -282,6 +294,12 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->twv     = NULL;
   om2->rfv     = NULL;
   om2->tfv     = NULL;
+#ifdef HMMER_SVE
+  om2->rbv_sve  = NULL;
+  om2->sve_w    = om1->sve_w;
+  om2->sve_q    = om1->sve_q;
+  om2->allocSVE = om1->allocSVE;
+#endif
 
   /* level 1 */
   ESL_ALLOC(om2->rbv_mem, sizeof(uint8x16_t)  * nqb  * abc->Kp    +15);	/* +15 is for manual 16-byte alignment */
@@ -309,6 +327,12 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   memcpy(om2->sbv[0], om1->sbv[0], sizeof(uint8x16_t)  * nqs  * abc->Kp);
   memcpy(om2->rwv[0], om1->rwv[0], sizeof(int16x8_t)   * nqw  * abc->Kp);
   memcpy(om2->rfv[0], om1->rfv[0], sizeof(float32x4_t) * nqf  * abc->Kp);
+#ifdef HMMER_SVE
+  if (om1->rbv_sve != NULL) {
+    ESL_ALLOC(om2->rbv_sve, om1->allocSVE);
+    memcpy(om2->rbv_sve, om1->rbv_sve, om1->allocSVE);
+  }
+#endif
 
   /* set the rest of the row pointers for match emissions */
   for (x = 1; x < abc->Kp; x++) {
@@ -756,6 +780,9 @@ sf_conversion(P7_OPROFILE *om)
       for (q = nq; q < nq + p7O_EXTRA_SB; q++) om->sbv[x][q] = om->sbv[x][q % nq];
     }
 
+#ifdef HMMER_SVE
+  if (impl_HaveSVE()) p7_oprofile_ConvertSVE(om);
+#endif
   return eslOK;
 }
 
@@ -1142,6 +1169,47 @@ p7_oprofile_ReconfigRestLength(P7_OPROFILE *om, int L)
 }
 
 
+/* Function:  p7_oprofile_SetMSVLength()
+ * Synopsis:  Set the MSV part's target length from precalculated parameters.
+ *
+ * Purpose:   Same as <p7_oprofile_ReconfigMSVLength(om, lp->L)>, using
+ *            the log that <p7_LengthParams()> already calculated in
+ *            <lp>. A scan configures every model for the same query
+ *            length, so this takes the log out of the per-model work.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_SetMSVLength(P7_OPROFILE *om, const P7_LENPARAM *lp)
+{
+  om->tjb_b = unbiased_byteify(om, lp->msvmove);
+  return eslOK;
+}
+
+/* Function:  p7_oprofile_SetRestLength()
+ * Synopsis:  Set the main profile's target length from precalculated parameters.
+ *
+ * Purpose:   Same as <p7_oprofile_ReconfigRestLength(om, lp->L)>, using
+ *            the parameters that <p7_LengthParams()> already
+ *            calculated in <lp>. If <lp> was calculated for a
+ *            different uni/multihit mode than <om>'s, this falls back
+ *            to <p7_oprofile_ReconfigRestLength()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_SetRestLength(P7_OPROFILE *om, const P7_LENPARAM *lp)
+{
+  if (lp->nj != om->nj) return p7_oprofile_ReconfigRestLength(om, lp->L);
+
+  om->xf[p7O_N][p7O_LOOP] =  om->xf[p7O_C][p7O_LOOP] = om->xf[p7O_J][p7O_LOOP] = lp->ploop;
+  om->xf[p7O_N][p7O_MOVE] =  om->xf[p7O_C][p7O_MOVE] = om->xf[p7O_J][p7O_MOVE] = lp->pmove;
+  om->xw[p7O_N][p7O_MOVE] =  om->xw[p7O_C][p7O_MOVE] = om->xw[p7O_J][p7O_MOVE] = wordify(om, lp->lpmove);
+  om->L = lp->L;
+  return eslOK;
+}
+
+
 /* Function:  p7_oprofile_ReconfigMultihit()
  * Synopsis:  Quickly reconfig model into multihit mode for target length <L>.
  * Incept:    SRE, Thu Aug 21 10:04:07 2008 [Janelia]
@@ -1199,6 +1267,73 @@ p7_oprofile_ReconfigUnihit(P7_OPROFILE *om, int L)
 
   return p7_oprofile_ReconfigLength(om, L);
 }
+
+#ifdef HMMER_SVE
+/* Function:  p7_oprofile_ConvertSVE()
+ * Synopsis:  Restripe MSV scores for the SVE filter.
+ *
+ * Purpose:   Fill <om->rbv_sve> from the 16-way striped <om->rbv>,
+ *            using W-way striping with Q = p7O_NQB_SVE(M,W) vectors,
+ *            where W is the host's SVE vector length in bytes. Model
+ *            position k (0..M-1) goes to vector k % Q, lane k / Q, the
+ *            same rule as the 16-way layout. Padding cells beyond M
+ *            get the prohibited cost 255 (unsigned). <om->rbv_sve> is
+ *            (re)allocated here as needed, since its size isn't known
+ *            until runtime.
+ *
+ *            The restriping is plain C, but asking for W is an SVE
+ *            instruction, so the caller must have checked
+ *            <impl_HaveSVE()>. It is called from <sf_conversion()>
+ *            (so <p7_oprofile_Convert()> and
+ *            <p7_oprofile_UpdateMSVEmissionScores()> keep the SVE
+ *            scores in sync), and after the MSV part of a profile is
+ *            read from a pressed file or an MPI message.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_oprofile_ConvertSVE(P7_OPROFILE *om)
+{
+  int      M   = om->M;
+  int      nq  = p7O_NQB(M);           /* 16-way segment length  */
+  int      W   = p7_sve_VectorBytes(); /* SVE vector width       */
+  int      nqs = p7O_NQB_SVE(M, W);    /* W-way segment length   */
+  int64_t  n   = (int64_t) om->abc->Kp * nqs * W;
+  uint8_t *rb;
+  uint8_t *rs;
+  int      x, k, q, z;
+  int      status;
+
+  if (n > om->allocSVE) {
+    if (om->rbv_sve != NULL) free(om->rbv_sve);
+    om->allocSVE = 0;
+    ESL_ALLOC(om->rbv_sve, n);
+    om->allocSVE = n;
+  }
+  om->sve_w = W;
+  om->sve_q = nqs;
+
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      rb = (uint8_t *) om->rbv[x];
+      rs = om->rbv_sve + (int64_t) x * nqs * W;
+
+      for (q = 0; q < nqs; q++)
+	for (z = 0; z < W; z++)
+	  {
+	    k = q + z*nqs;     /* k is 0..; node k+1 */
+	    rs[q*W+z] = (k < M) ? rb[(k % nq) * 16 + (k / nq)] : 255;
+	  }
+    }
+  return eslOK;
+
+ ERROR:
+  om->sve_w = om->sve_q = 0;
+  return status;
+}
+#endif /*HMMER_SVE*/
 /*------------ end, conversions to P7_OPROFILE ------------------*/
 
 /*******************************************************************
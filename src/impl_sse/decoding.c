@@ -189,6 +189,126 @@ p7_DomainDecoding(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P
   if (isinf(scaleproduct)) return eslERANGE;
   else                     return eslOK;
 }
+
+
+/* Function:  p7_DecodingCheckpointed()
+ * Synopsis:  Posterior decoding of residue assignment, checkpointed version.
+ *
+ * Purpose:   Same as <p7_Decoding()>, for a checkpointed matrix set
+ *            <ock> in which <p7_ForwardCheckpointed()> and
+ *            <p7_BackwardCheckpointed()> have filled the Forward and
+ *            Backward matrices. This pass only decodes the special
+ *            states, for all rows, and records the scaling factor at
+ *            the start of each segment. The main states are decoded
+ *            one segment at a time, on demand, by
+ *            <p7_DecodingSegment()>. Values are identical to those of
+ *            <p7_Decoding()> on full matrices.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslERANGE> on numeric overflow. See commentary in
+ *            <p7_Decoding()>.
+ *
+ * Throws:    (no abnormal error conditions)
+ */
+int
+p7_DecodingCheckpointed(const P7_OPROFILE *om, P7_OMXCHK *ock)
+{
+  const P7_OMX *oxf = ock->fwd;
+  const P7_OMX *oxb = ock->bck;
+  P7_OMX       *pp  = ock->pp;
+  int    L  = ock->L;
+  int    K  = ock->K;
+  int    i;
+  float  scaleproduct = 1.0 / oxb->xmx[p7X_N];
+
+  pp->M = om->M;
+  pp->L = L;
+  ock->pp_seg = ock->oa_seg = -1;
+
+  pp->xmx[p7X_E] = 0.0;
+  pp->xmx[p7X_N] = 0.0;
+  pp->xmx[p7X_J] = 0.0;
+  pp->xmx[p7X_C] = 0.0;
+  pp->xmx[p7X_B] = 0.0;
+
+  for (i = 1; i <= L; i++)
+    {
+      if ((i-1) % K == 0) ock->segscale[(i-1)/K] = scaleproduct;
+
+      pp->xmx[i*p7X_NXCELLS+p7X_E] = 0.0;
+      pp->xmx[i*p7X_NXCELLS+p7X_N] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_N] * oxb->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_J] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_J] * oxb->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_C] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_C] * oxb->xmx[i*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_B] = 0.0;
+
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+
+  if (isinf(scaleproduct)) return eslERANGE;
+  else                     return eslOK;
+}
+
+
+/* Function:  p7_DecodingSegment()
+ * Synopsis:  Posterior decoding of one segment of a checkpointed matrix.
+ *
+ * Purpose:   Decodes the main states of rows <s*K+1..(s+1)*K> (segment
+ *            <s>) into <ock->pp>, recalculating that segment of the
+ *            Forward and Backward matrices first if need be.
+ *            <p7_DecodingCheckpointed()> must have been called.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_DecodingSegment(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int s)
+{
+  const P7_OMX *oxf = ock->fwd;
+  const P7_OMX *oxb = ock->bck;
+  P7_OMX       *pp  = ock->pp;
+  __m128 *ppv;
+  __m128 *fv;
+  __m128 *bv;
+  __m128  totrv;
+  int    Q  = p7O_NQF(om->M);
+  int    ia = s*ock->K+1;
+  int    ib = ESL_MIN(ock->L, (s+1)*ock->K);
+  int    i,q;
+  float  scaleproduct = ock->segscale[s];
+
+  if (ock->pp_seg == s) return eslOK;
+  p7_ForwardSegment (dsq, om, ock, s);
+  p7_BackwardSegment(dsq, om, ock, s);
+
+  for (i = ia; i <= ib; i++)
+    {
+      ppv   =  pp->dpf[i];
+      fv    = oxf->dpf[i];
+      bv    = oxb->dpf[i];
+      totrv = _mm_set1_ps(scaleproduct * oxf->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+
+      for (q = 0; q < Q; q++)
+	{
+	  /* M */
+	  *ppv = _mm_mul_ps(*fv,  *bv);
+	  *ppv = _mm_mul_ps(*ppv,  totrv);
+	  ppv++;  fv++;  bv++;
+
+	  /* D */
+	  *ppv = _mm_setzero_ps();
+	  ppv++;  fv++;  bv++;
+
+	  /* I */
+	  *ppv = _mm_mul_ps(*fv,  *bv);
+	  *ppv = _mm_mul_ps(*ppv,  totrv);
+	  ppv++;  fv++;  bv++;
+	}
+
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+  ock->pp_seg = s;
+  return eslOK;
+}
 /*------------------ end, posterior decoding --------------------*/
 
 /*****************************************************************
@@ -356,6 +476,74 @@ utest_decoding(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, in
   p7_profile_Destroy(gm);
   p7_hmm_Destroy(hmm);
 }
+
+/* utest_decoding_bf16()
+ * 
+ * Accuracy of a bfloat16 matrix set, against full float matrices:
+ * Forward and Backward scores must be the same, and each posterior
+ * probability within a relative error of <rtol> (the rounding of one
+ * Forward and one Backward value, each <= 2^-9, bounds it at about
+ * 0.004). Prints the largest error seen, if <be_verbose>.
+ */
+static void
+utest_decoding_bf16(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N, float rtol, int be_verbose)
+{
+  char        *msg  = "bfloat16 decoding unit test failed";
+  P7_HMM      *hmm  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  ESL_DSQ     *dsq  = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *fwd  = p7_omx_Create(M, L, L);
+  P7_OMX      *bck  = p7_omx_Create(M, L, L);
+  P7_OMX      *pp   = p7_omx_Create(M, L, L);
+  P7_OMXCHK   *ock  = p7_omxchk_CreateBF16(M, L);
+  float        fsc1, fsc2;
+  float        bsc1, bsc2;
+  float        a, b;
+  float        maxerr = 0.0;
+  int          s, i, k, st;
+
+  if (ock == NULL) esl_fatal(msg);
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
+  while (N--)
+    {
+      if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq)              != eslOK) esl_fatal(msg);
+      if (p7_Forward (dsq, L, om, fwd,      &fsc1)             != eslOK) esl_fatal(msg);
+      if (p7_Backward(dsq, L, om, fwd, bck, &bsc1)             != eslOK) esl_fatal(msg);
+      if (p7_Decoding(om, fwd, bck, pp)                        != eslOK) esl_fatal(msg);
+
+      if (p7_omxchk_GrowTo(ock, M, L)                          != eslOK) esl_fatal(msg);
+      if (p7_ForwardCheckpointed (dsq, L, om, ock, &fsc2)      != eslOK) esl_fatal(msg);
+      if (p7_BackwardCheckpointed(dsq, L, om, ock, &bsc2)      != eslOK) esl_fatal(msg);
+      if (p7_DecodingCheckpointed(om, ock)                     != eslOK) esl_fatal(msg);
+
+      if (fsc1 != fsc2 || bsc1 != bsc2) esl_fatal(msg);
+
+      for (s = 0; s < ock->nseg; s++)
+	{
+	  if (p7_DecodingSegment(dsq, om, ock, s) != eslOK) esl_fatal(msg);
+	  for (i = s*ock->K+1; i <= ESL_MIN(L, (s+1)*ock->K); i++)
+	    for (k = 1; k <= M; k++)
+	      for (st = 0; st < p7X_NSCELLS; st++)
+		{
+		  a = p7_omx_FGetMDI(pp,      st, i, k);
+		  b = p7_omx_FGetMDI(ock->pp, st, i, k);
+		  if (a > 0. && fabs(a-b) / a > maxerr) maxerr = fabs(a-b) / a;
+		  if (fabs(a-b) > rtol * a + 1e-7)  esl_fatal(msg);
+		}
+	}
+    }
+  if (be_verbose) printf("bfloat16 decoding, M=%d L=%d: max relative error %g\n", M, L, maxerr);
+
+  p7_omxchk_Destroy(ock);
+  p7_omx_Destroy(fwd);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(pp);
+  free(dsq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
 #endif /*p7DECODING_TESTDRIVE*/
 /*--------------------- end, unit tests -------------------------*/
 
@@ -392,6 +580,7 @@ static ESL_OPTIONS options[] = {
   { "-L",  eslARG_INT,     "40",  NULL, NULL, NULL, NULL, NULL, "length of sampled sequences",          0 },
   { "-M",  eslARG_INT,     "40",  NULL, NULL, NULL, NULL, NULL, "length of sampled test profile",       0 },
   { "-N",  eslARG_INT,     "10",  NULL, NULL, NULL, NULL, NULL, "number of sampled test sequences",     0 },
+  { "-v",  eslARG_NONE,   FALSE,  NULL, NULL, NULL, NULL, NULL, "be verbose",                           0 },
   { 0,0,0,0,0,0,0,0,0,0},
 };
 static char usage[]  = "[-options]";
@@ -412,6 +601,9 @@ main(int argc, char **argv)
   p7_FLogsumInit();
 
   utest_decoding(r, abc, bg, M, L, N, tol);
+  utest_decoding_bf16(r, abc, bg, M,   L,   N,  0.005, esl_opt_GetBoolean(go, "-v"));
+  utest_decoding_bf16(r, abc, bg, 200, 400, 2,  0.005, esl_opt_GetBoolean(go, "-v"));   /* several segments, and rescaling */
+  utest_decoding_bf16(r, abc, bg, M,   1,   2,  0.005, esl_opt_GetBoolean(go, "-v"));
   
   esl_getopts_Destroy(go);
   esl_randomness_Destroy(r);
@@ -0,0 +1,582 @@
+/* AVX2 versions of the FM-index occurrence counts.
+ *
+ * These are the same counts as fm_getOccCount(), fm_getOccCountLT()
+ * and fm_getOccCountAll() (fm_sse.c), scanning the 2-bit packed DNA BWT
+ * 32 bytes (128 characters) at a time instead of 16. Each count
+ * starts from the nearest occ_b checkpoint, exactly as in the SSE
+ * version, so only the scan between checkpoint and position is
+ * different.
+ *
+ * Only this file is compiled with AVX2 instructions enabled
+ * (AVX2_CFLAGS). The fm_getOccCount*() functions dispatch here at
+ * runtime when fm_configInit() found that the host supports AVX2
+ * (<impl_HaveAVX2()>) and the index allows it (<cfg->occ_avx2>):
+ * a DNA index, with occ_b checkpoints every 128 or more characters.
+ * Amino acid indexes stay on the SSE path.
+ *
+ * Loads are unaligned, and a scan may read up to 32 bytes past the
+ * last byte of the BWT; fm_FM_read() allocates BWT with that much
+ * slack.
+ *
+ * Contents:
+ *   1. fm_getOccCount_avx(), fm_getOccCountLT_avx(), fm_getOccCountAll_avx()
+ *   2. Unit tests
+ *   3. Test driver
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_AVX2
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <xmmintrin.h>		/* SSE  */
+#include <emmintrin.h>		/* SSE2 */
+#include <immintrin.h>		/* AVX2 */
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+
+/* For each character of a 32-byte vector of packed 2-bit characters,
+ * 01 if it matches the character in every 2-bit field of <c_v>, 00
+ * if not. Same method as FM_MATCH_2BIT().
+ */
+static inline __m256i
+fm_match_avx(__m256i BWT_v, __m256i c_v)
+{
+  __m256i m01_v = _mm256_set1_epi8(0x55);
+  __m256i a_v   = _mm256_xor_si256(BWT_v, c_v);
+
+  a_v = _mm256_or_si256(a_v, _mm256_srli_epi16(a_v, 1));
+  return _mm256_andnot_si256(a_v, m01_v);
+}
+
+/* Sum the 01 fields of <match_v> that are under <mask_v> into the
+ * four 64-bit lanes of <cnt_v>:  bytewise popcount, then _mm256_sad_epu8().
+ */
+static inline __m256i
+fm_count_avx(__m256i match_v, __m256i mask_v, __m256i cnt_v)
+{
+  __m256i m33_v = _mm256_set1_epi8(0x33);
+  __m256i m0f_v = _mm256_set1_epi8(0x0f);
+  __m256i a_v   = _mm256_and_si256(match_v, mask_v);
+
+  a_v = _mm256_add_epi8(_mm256_and_si256(a_v, m33_v), _mm256_and_si256(_mm256_srli_epi16(a_v, 2), m33_v));
+  a_v = _mm256_and_si256(_mm256_add_epi8(a_v, _mm256_srli_epi16(a_v, 4)), m0f_v);
+  return _mm256_add_epi64(cnt_v, _mm256_sad_epu8(a_v, _mm256_setzero_si256()));
+}
+
+/* Mask that keeps the first <n> (1..127) characters of a 32-byte
+ * vector; the 256-bit version of <cfg->fm_masks_v[n]>. The first
+ * character of each byte is in its high bits, as in fm_getChar().
+ * It's an unaligned load from row n%4 of <fm_headmask_tbl>: 32 bytes
+ * of all 1s, then the byte holding the first n%4 characters of a
+ * byte, then 0s.
+ */
+#define FM_FF8   0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+#define FM_FF32  FM_FF8, FM_FF8, FM_FF8, FM_FF8
+static const uint8_t fm_headmask_tbl[4][64] = {
+  { FM_FF32, 0x00 },
+  { FM_FF32, 0xc0 },  //11 00 00 00
+  { FM_FF32, 0xf0 },  //11 11 00 00
+  { FM_FF32, 0xfc },  //11 11 11 00
+};
+
+static inline __m256i
+fm_headmask_avx(int n)
+{
+  return _mm256_loadu_si256((const __m256i *) (fm_headmask_tbl[n%4] + 32 - n/4));
+}
+
+static inline uint64_t
+fm_hsum_avx(__m256i cnt_v)
+{
+  __m128i s_v = _mm_add_epi64(_mm256_castsi256_si128(cnt_v), _mm256_extracti128_si256(cnt_v, 1));
+  s_v = _mm_add_epi64(s_v, _mm_unpackhi_epi64(s_v, s_v));
+  return (uint64_t) _mm_cvtsi128_si64(s_v);
+}
+
+/* fm_scan_avx()
+ * Count the characters c, and (if <do_lt>) those with value <c,
+ * between the checkpoint at <landmark> and <pos>: BWT[landmark+1..pos]
+ * if <up_b> is 0, BWT[pos+1..landmark] if it's 1. Returns the counts
+ * in <*ret_eq>, <*ret_lt>.
+ */
+static void
+fm_scan_avx(const uint8_t *BWT, int landmark, int pos, int up_b, uint8_t c, int do_lt,
+            uint64_t *ret_eq, uint64_t *ret_lt)
+{
+  __m256i ones_v = _mm256_set1_epi8((int8_t) 0xff);
+  __m256i eq_v   = _mm256_setzero_si256();
+  __m256i lt_v   = _mm256_setzero_si256();
+  __m256i BWT_v;
+  __m256i mask_v;
+  int     i, j;
+  int     remaining_cnt;
+
+  if (!up_b) { // count forward, adding
+    for (i=(landmark+1)/4 ; i+31<( (pos+1)/4);  i+=32) { // keep running until i begins a run that shouldn't all be counted
+      BWT_v = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      for (j=0; do_lt && j<c; j++)
+        lt_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (j*0x55))), ones_v, lt_v);
+      eq_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (c*0x55))), ones_v, eq_v);
+    }
+
+    remaining_cnt = pos + 1 - i*4;
+    if (remaining_cnt > 0) {
+      BWT_v  = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      mask_v = fm_headmask_avx(remaining_cnt);  // leaves only the remaining_cnt chars in the array
+      for (j=0; do_lt && j<c; j++)
+        lt_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (j*0x55))), mask_v, lt_v);
+      eq_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (c*0x55))), mask_v, eq_v);
+    }
+
+  } else { // count backwards, subtracting
+    for (i=(landmark/4)-31 ; i>(pos/4);  i-=32) {
+      BWT_v = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      for (j=0; do_lt && j<c; j++)
+        lt_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (j*0x55))), ones_v, lt_v);
+      eq_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (c*0x55))), ones_v, eq_v);
+    }
+
+    remaining_cnt = 128 - (pos + 1 - i*4);
+    if (remaining_cnt > 0) {
+      BWT_v  = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      mask_v = _mm256_andnot_si256(fm_headmask_avx(pos + 1 - i*4), ones_v); // leaves only the last remaining_cnt chars
+      for (j=0; do_lt && j<c; j++)
+        lt_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (j*0x55))), mask_v, lt_v);
+      eq_v = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) (c*0x55))), mask_v, eq_v);
+    }
+  }
+
+  *ret_eq = fm_hsum_avx(eq_v);
+  *ret_lt = (do_lt ? fm_hsum_avx(lt_v) : 0);
+}
+
+/* fm_scanall_avx()
+ * Like fm_scan_avx(), but count each of the characters 0,1,2 in
+ * <cnt[0..2]>; the count of 3 is what's left of the scanned length.
+ */
+static void
+fm_scanall_avx(const uint8_t *BWT, int landmark, int pos, int up_b, uint64_t *cnt)
+{
+  __m256i ones_v = _mm256_set1_epi8((int8_t) 0xff);
+  __m256i c0_v   = _mm256_setzero_si256();
+  __m256i c1_v   = _mm256_setzero_si256();
+  __m256i c2_v   = _mm256_setzero_si256();
+  __m256i BWT_v;
+  __m256i mask_v;
+  int     i;
+  int     remaining_cnt;
+
+  if (!up_b) { // count forward, adding
+    for (i=(landmark+1)/4 ; i+31<( (pos+1)/4);  i+=32) {
+      BWT_v = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      c0_v  = fm_count_avx(fm_match_avx(BWT_v, _mm256_setzero_si256()),             ones_v, c0_v);
+      c1_v  = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0x55)),    ones_v, c1_v);
+      c2_v  = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0xaa)),    ones_v, c2_v);
+    }
+    remaining_cnt = pos + 1 - i*4;
+    if (remaining_cnt > 0) {
+      BWT_v  = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      mask_v = fm_headmask_avx(remaining_cnt);
+      c0_v   = fm_count_avx(fm_match_avx(BWT_v, _mm256_setzero_si256()),            mask_v, c0_v);
+      c1_v   = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0x55)),   mask_v, c1_v);
+      c2_v   = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0xaa)),   mask_v, c2_v);
+    }
+
+  } else { // count backwards, subtracting
+    for (i=(landmark/4)-31 ; i>(pos/4);  i-=32) {
+      BWT_v = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      c0_v  = fm_count_avx(fm_match_avx(BWT_v, _mm256_setzero_si256()),             ones_v, c0_v);
+      c1_v  = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0x55)),    ones_v, c1_v);
+      c2_v  = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0xaa)),    ones_v, c2_v);
+    }
+    remaining_cnt = 128 - (pos + 1 - i*4);
+    if (remaining_cnt > 0) {
+      BWT_v  = _mm256_loadu_si256((const __m256i *) (BWT+i));
+      mask_v = _mm256_andnot_si256(fm_headmask_avx(pos + 1 - i*4), ones_v);
+      c0_v   = fm_count_avx(fm_match_avx(BWT_v, _mm256_setzero_si256()),            mask_v, c0_v);
+      c1_v   = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0x55)),   mask_v, c1_v);
+      c2_v   = fm_count_avx(fm_match_avx(BWT_v, _mm256_set1_epi8((int8_t) 0xaa)),   mask_v, c2_v);
+    }
+  }
+
+  cnt[0] = fm_hsum_avx(c0_v);
+  cnt[1] = fm_hsum_avx(c1_v);
+  cnt[2] = fm_hsum_avx(c2_v);
+  cnt[3] = (up_b ? landmark - pos : pos - landmark) - cnt[0] - cnt[1] - cnt[2];
+}
+
+
+/*****************************************************************
+ * 1. fm_getOccCount_avx(), fm_getOccCountLT_avx()
+ *****************************************************************/
+
+/* Function:  fm_getOccCount_avx()
+ * Synopsis:  AVX2 version of fm_getOccCount().
+ *
+ * Purpose:   Same as <fm_getOccCount()>: compute the number of
+ *            occurrences of c in BWT[0..pos] of DNA index <fm>,
+ *            scanning 32 bytes at a time from the nearest checkpoint.
+ *
+ *            Caller must have checked that the host supports AVX2,
+ *            and that <cfg->meta> is a DNA index with occ_b checkpoints
+ *            at least every 128 characters (<cfg->occ_avx2>).
+ *
+ * Returns:   The count.
+ */
+int
+fm_getOccCount_avx(const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
+{
+  FM_METADATA *meta = cfg->meta;
+  int cnt = 0;
+  const uint16_t * occCnts_b  = fm->occCnts_b;
+  const uint32_t * occCnts_sb = fm->occCnts_sb;
+  const int b_pos          = (pos+1) / meta->freq_cnt_b ; //floor(pos/b_size)   : the b count element preceding pos
+  const int sb_pos         = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
+  const int cnt_mod_mask_b = meta->freq_cnt_b - 1; //used to compute the mod function
+  const int b_rel_pos      = (pos+1) & cnt_mod_mask_b; // pos % b_size      : how close is pos to the boundary corresponding to b_pos
+  int up_b           = 2*b_rel_pos/meta->freq_cnt_b; //1 if pos is expected to be closer to the boundary of b_pos+1, 0 otherwise
+  int landmark       = ((b_pos+up_b)*meta->freq_cnt_b) - 1 ;
+  uint64_t eq, lt;
+
+  if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
+    up_b      = 0;
+    landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
+  }
+
+  // get the cnt stored at the nearest checkpoint
+  cnt =  FM_OCC_CNT(sb, sb_pos, c );
+
+  if (up_b)
+    cnt += FM_OCC_CNT(b, b_pos + 1, c ) ;
+  else if ( b_pos !=  sb_pos * (meta->freq_cnt_sb / meta->freq_cnt_b) )
+    cnt += FM_OCC_CNT(b, b_pos, c )  ;// b_pos has cumulative counts since the prior sb_pos - if sb_pos references the same count as b_pos, it'll doublecount
+
+  if ( landmark < fm->N || landmark == -1 ) {
+    fm_scan_avx(fm->BWT, landmark, pos, up_b, c, FALSE, &eq, &lt);
+    cnt += ( up_b == 1 ?  -1 : 1) * (int) eq;
+  }
+
+  if (c==0 && pos >= fm->term_loc) { // I overcounted 'A' by one, because '$' was replaced with an 'A'
+    cnt--;
+  }
+
+  return cnt;
+}
+
+
+/* Function:  fm_getOccCountLT_avx()
+ * Synopsis:  AVX2 version of fm_getOccCountLT().
+ *
+ * Purpose:   Same as <fm_getOccCountLT()>: compute the number of
+ *            occurrences of c in BWT[0..pos], and of characters with
+ *            value <c, of DNA index <fm>, and return them in <*cnteq>
+ *            and <*cntlt>. Each 32-byte vector is loaded once for all
+ *            the characters it's compared to.
+ *
+ *            Same requirements as <fm_getOccCount_avx()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+fm_getOccCountLT_avx(const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt)
+{
+  FM_METADATA *meta = cfg->meta;
+  int i;
+  const uint16_t * occCnts_b  = fm->occCnts_b;
+  const uint32_t * occCnts_sb = fm->occCnts_sb;
+  const int b_pos          = (pos+1) / meta->freq_cnt_b; //floor(pos/b_size)   : the b count element preceding pos
+  const int sb_pos         = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
+  const int b_rel_pos      = (pos+1) % meta->freq_cnt_b; //  how close is pos to the boundary corresponding to b_pos
+  int up_b                 = 2*b_rel_pos/meta->freq_cnt_b; //1 if pos is expected to be closer to the boundary of b_pos+1, 0 otherwise
+  int landmark             = ((b_pos+up_b)*(meta->freq_cnt_b)) - 1 ;
+  uint64_t eq, lt;
+
+  if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
+    up_b      = 0;
+    landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
+  }
+
+  // get the cnt stored at the nearest checkpoint
+  *cntlt = 0;
+  *cnteq = FM_OCC_CNT(sb, sb_pos, c );
+  for (i=0; i<c; i++)
+    *cntlt += FM_OCC_CNT(sb, sb_pos, i );
+
+  if (up_b) {
+    *cnteq += FM_OCC_CNT(b, b_pos + 1, c ) ;
+    for (i=0; i<c; i++)
+      *cntlt += FM_OCC_CNT(b, b_pos + 1, i ) ;
+  } else if ( b_pos !=  sb_pos * (meta->freq_cnt_sb / meta->freq_cnt_b))  {
+    *cnteq += FM_OCC_CNT(b, b_pos, c )  ;// b_pos has cumulative counts since the prior sb_pos - if sb_pos references the same count as b_pos, it'll doublecount
+    for (i=0; i<c; i++)
+      *cntlt += FM_OCC_CNT(b, b_pos, i ) ;
+  }
+
+  if ( landmark < fm->N || landmark == -1 ) {
+    fm_scan_avx(fm->BWT, landmark, pos, up_b, c, (c > 0), &eq, &lt);
+    (*cntlt)  +=   ( up_b == 1 ?  -1 : 1) * (int) lt;
+    (*cnteq)  +=   ( up_b == 1 ?  -1 : 1) * (int) eq;
+  }
+
+  if ( pos >= fm->term_loc) {
+    if (c == 0) { // deal with the fact that '$' was replaced with an 'A'
+      (*cnteq)--; // I overcounted 'A' by one
+      (*cntlt) = 1; // '$' is lexicographically lower than 'A', but I didn't count it in the method above
+    }
+  }
+
+  return eslOK;
+}
+
+
+/* Function:  fm_getOccCountAll_avx()
+ * Synopsis:  AVX2 version of fm_getOccCountAll().
+ *
+ * Purpose:   Same as <fm_getOccCountAll()>: compute the number of
+ *            occurrences of each of the four characters in BWT[0..pos]
+ *            of DNA index <fm>, and return them in <cnt[0..3]>, in one
+ *            scan from the nearest checkpoint.
+ *
+ *            Same requirements as <fm_getOccCount_avx()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+fm_getOccCountAll_avx(const FM_DATA *fm, const FM_CFG *cfg, int pos, uint32_t *cnt)
+{
+  FM_METADATA *meta = cfg->meta;
+  const uint16_t * occCnts_b  = fm->occCnts_b;
+  const uint32_t * occCnts_sb = fm->occCnts_sb;
+  const int b_pos          = (pos+1) / meta->freq_cnt_b ; //floor(pos/b_size)   : the b count element preceding pos
+  const int sb_pos         = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
+  const int cnt_mod_mask_b = meta->freq_cnt_b - 1; //used to compute the mod function
+  const int b_rel_pos      = (pos+1) & cnt_mod_mask_b; // pos % b_size      : how close is pos to the boundary corresponding to b_pos
+  int up_b           = 2*b_rel_pos/meta->freq_cnt_b; //1 if pos is expected to be closer to the boundary of b_pos+1, 0 otherwise
+  int landmark       = ((b_pos+up_b)*meta->freq_cnt_b) - 1 ;
+  uint64_t scnt[4];
+  int c;
+
+  if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
+    up_b      = 0;
+    landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
+  }
+
+  // get the cnts stored at the nearest checkpoint
+  for (c=0; c<4; c++) {
+    cnt[c] = FM_OCC_CNT(sb, sb_pos, c );
+    if (up_b)
+      cnt[c] += FM_OCC_CNT(b, b_pos + 1, c ) ;
+    else if ( b_pos !=  sb_pos * (meta->freq_cnt_sb / meta->freq_cnt_b) )
+      cnt[c] += FM_OCC_CNT(b, b_pos, c )  ;// b_pos has cumulative counts since the prior sb_pos - if sb_pos references the same count as b_pos, it'll doublecount
+  }
+
+  if ( landmark < fm->N || landmark == -1 ) {
+    fm_scanall_avx(fm->BWT, landmark, pos, up_b, scnt);
+    for (c=0; c<4; c++)
+      cnt[c] += ( up_b == 1 ?  -1 : 1) * (int) scnt[c];
+  }
+
+  if (pos >= fm->term_loc) { // I overcounted 'A' by one, because '$' was replaced with an 'A'
+    cnt[0]--;
+  }
+
+  return eslOK;
+}
+/*------------------ end, AVX2 occ counts -----------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#ifdef p7FM_AVX_TESTDRIVE
+#include <math.h>
+
+#include "esl_random.h"
+
+/* Build a random DNA FM_DATA of <N> characters the way makehmmerdb
+ * does, minus the suffix sorting: a random "BWT" with '$' (stored as
+ * 'A') at term_loc, and its occ_b/occ_sb checkpoints. Only the fields
+ * the occ counts look at are set.
+ */
+static void
+utest_build(ESL_RANDOMNESS *r, FM_METADATA *meta, int N, FM_DATA *fm, uint8_t **ret_txt)
+{
+  int       num_freq_cnts_b  = 1+ceil((double)N/meta->freq_cnt_b);
+  int       num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
+  uint8_t  *txt              = malloc(N);
+  uint16_t *occCnts_b        = calloc(num_freq_cnts_b  * meta->alph_size, sizeof(uint16_t));
+  uint32_t *occCnts_sb       = calloc(num_freq_cnts_sb * meta->alph_size, sizeof(uint32_t));
+  uint32_t  cnts_b[4]        = { 0, 0, 0, 0 };
+  uint32_t  cnts_sb[4]       = { 0, 0, 0, 0 };
+  int       compressed_bytes = (N+3)/4;
+  int       j, c;
+
+  fm->N        = N;
+  fm->term_loc = esl_rnd_Roll(r, N);
+  fm->BWT_mem  = calloc(compressed_bytes + 47, 1);
+  fm->BWT      = (uint8_t *) (((unsigned long int)fm->BWT_mem + 15) & (~0xf));
+
+  for (j = 0; j < N; j++) {
+    txt[j] = (j == fm->term_loc ? 0 : esl_rnd_Roll(r, 4));
+    fm->BWT[j/4] |= txt[j] << (6 - 2*(j%4));
+
+    cnts_sb[txt[j]]++;
+    cnts_b[txt[j]]++;
+    if ((j+1) % meta->freq_cnt_b == 0) {
+      for (c = 0; c < meta->alph_size; c++)
+        FM_OCC_CNT(b, (j+1)/meta->freq_cnt_b, c) = cnts_b[c];
+      if ((j+1) % meta->freq_cnt_sb == 0)
+        for (c = 0; c < meta->alph_size; c++) {
+          FM_OCC_CNT(sb, (j+1)/meta->freq_cnt_sb, c) = cnts_sb[c];
+          cnts_b[c] = 0;
+        }
+    }
+  }
+  for (c = 0; c < meta->alph_size; c++) {
+    FM_OCC_CNT(b,  num_freq_cnts_b-1,  c) = cnts_b[c];
+    FM_OCC_CNT(sb, num_freq_cnts_sb-1, c) = cnts_sb[c];
+  }
+
+  fm->occCnts_b  = occCnts_b;
+  fm->occCnts_sb = occCnts_sb;
+  *ret_txt = txt;
+}
+
+/* The AVX2 counts must be the same as the SSE ones (and, for
+ * fm_getOccCount(), as a naive count of the text) at every position
+ * of a random index of length <N>, with checkpoints every <freq_b>
+ * characters.
+ */
+static void
+utest_occ_avx(ESL_RANDOMNESS *r, FM_CFG *cfg, int N, int freq_b)
+{
+  char         msg[] = "fm_avx unit test failed";
+  FM_METADATA *meta  = cfg->meta;
+  FM_DATA      fm;
+  uint8_t     *txt   = NULL;
+  int          naive[4] = { 0, 0, 0, 0 };
+  uint32_t     eq1, lt1, eq2, lt2;
+  uint32_t     all1[4], all2[4];
+  int          pos, c, j;
+
+  meta->freq_cnt_b  = freq_b;
+  meta->freq_cnt_sb = 65536;
+  utest_build(r, meta, N, &fm, &txt);
+
+  for (pos = 0; pos < N; pos++)
+    {
+      if (pos != fm.term_loc) naive[txt[pos]]++;
+      for (c = 0; c < meta->alph_size; c++)
+        {
+          cfg->occ_avx2 = FALSE;
+          if (fm_getOccCount(&fm, cfg, pos, c) != naive[c])                       esl_fatal("%s: SSE count differs from naive count", msg);
+          if (fm_getOccCount_avx(&fm, cfg, pos, c) != naive[c])                   esl_fatal("%s: count of %d at %d is %d, not %d", msg, c, pos, fm_getOccCount_avx(&fm, cfg, pos, c), naive[c]);
+
+          fm_getOccCountLT    (&fm, cfg, pos, c, &eq1, &lt1);
+          fm_getOccCountLT_avx(&fm, cfg, pos, c, &eq2, &lt2);
+          if (eq1 != eq2 || lt1 != lt2)                                             esl_fatal("%s: LT counts of %d at %d differ", msg, c, pos);
+          if (eq1 != naive[c])                                                      esl_fatal("%s: LT count of %d at %d differs from naive count", msg, c, pos);
+          for (lt2 = (pos >= fm.term_loc), j = 0; j < c; j++) lt2 += naive[j];   /* '$' sorts before everything */
+          if (lt1 != lt2)                                                           esl_fatal("%s: LT count below %d at %d is %d, not %d", msg, c, pos, lt1, lt2);
+
+          cfg->occ_avx2 = TRUE;   /* and through the dispatch */
+          if (fm_getOccCount(&fm, cfg, pos, c) != naive[c])                       esl_fatal("%s: dispatched count differs", msg);
+        }
+
+      cfg->occ_avx2 = FALSE;
+      fm_getOccCountAll    (&fm, cfg, pos, all1);
+      fm_getOccCountAll_avx(&fm, cfg, pos, all2);
+      for (c = 0; c < meta->alph_size; c++)
+        if (all1[c] != naive[c] || all2[c] != naive[c])                           esl_fatal("%s: all-character count of %d at %d differs", msg, c, pos);
+    }
+
+  free(txt);
+  free(fm.BWT_mem);
+  free(fm.occCnts_b);
+  free(fm.occCnts_sb);
+}
+#endif /*p7FM_AVX_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7FM_AVX_TESTDRIVE
+/*
+   gcc -g -Wall -msse2 -mavx2 -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o fm_avx_utest -Dp7FM_AVX_TESTDRIVE fm_avx.c -lhmmer -leasel -lm
+   ./fm_avx_utest
+ */
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-N",        eslARG_INT,  "10000", NULL, "n>0", NULL,  NULL, NULL, "length of random index to sample",               0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the AVX2 FM-index occurrence counts";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  int             N    = esl_opt_GetInteger(go, "-N");
+  FM_METADATA     meta;
+  FM_CFG          cfg;
+
+  if (! __builtin_cpu_supports("avx2"))
+    {
+      if (esl_opt_GetBoolean(go, "-v")) printf("host has no AVX2; test skipped\n");
+      esl_getopts_Destroy(go);
+      esl_randomness_Destroy(r);
+      return eslOK;
+    }
+
+  meta.alph_type = fm_DNA;
+  meta.alph_size = 4;
+  meta.freq_cnt_b  = 256;
+  meta.freq_cnt_sb = 65536;
+  cfg.meta = &meta;
+  fm_configInit(&cfg, NULL);
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("fm_getOccCount*_avx() tests\n");
+  utest_occ_avx(r, &cfg, N,    256);   /* the makehmmerdb default      */
+  utest_occ_avx(r, &cfg, N,    128);   /* smallest spacing we dispatch */
+  utest_occ_avx(r, &cfg, N,    1024);  /* several vectors per count    */
+  utest_occ_avx(r, &cfg, 100,  256);   /* index shorter than one block */
+  utest_occ_avx(r, &cfg, 1024, 256);   /* ends exactly on a checkpoint */
+
+  free(cfg.fm_chars_mem);          /* not fm_configDestroy(): <cfg>, <meta> are on the stack */
+  free(cfg.fm_masks_mem);
+  free(cfg.fm_reverse_masks_mem);
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7FM_AVX_TESTDRIVE*/
+
+
+#else /* ! HMMER_AVX2 */
+
+/* Provide a dummy symbol so this compilation unit isn't empty.  */
+void p7_fm_avx_silence_hack(void) { return; }
+
+#endif /* HMMER_AVX2 or not */
@@ -43,8 +43,23 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
-static int forward_engine (int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
-static int backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+static int  forward_engine (int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, uint16_t *h, float *opt_sc);
+static int  backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, uint16_t *h, float *opt_sc);
+static void forward_rows   (int do_full, const ESL_DSQ *dsq, int ia, int ib, const P7_OPROFILE *om, P7_OMX *ox);
+static void backward_init  (int do_full, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck);
+static void backward_rows  (int do_full, const ESL_DSQ *dsq, int ib, int ia, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, int redo);
+static void bf16_pack      (const __m128 *dp, uint16_t *h, int nv);
+static void bf16_unpack    (const uint16_t *h, __m128 *dp, int nv);
+
+/* dd_done()
+ * TRUE when all four lanes of an extended D->D path <dcv> have
+ * underflowed to 0.0. The path only gets multiplied by more DD
+ * transitions from there on, so the rest of the serial DD passes
+ * would add exact zeros to every DMO(q) and can be skipped. On a
+ * large model that saves streaming the tail of the D row (and the DD
+ * transitions) through the cache up to three more times per residue.
+ */
+static inline int dd_done(__m128 dcv) { return (_mm_movemask_ps(_mm_cmpneq_ps(dcv, _mm_setzero_ps())) == 0); }
 
 
 /*****************************************************************
@@ -96,10 +111,10 @@ p7_Forward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *
   if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
-  return forward_engine(TRUE, dsq, L, om, ox, opt_sc);
+  return forward_engine(TRUE, dsq, L, om, ox, NULL, opt_sc);
 }
 
-/* Function:  p7_ForwardParser()
+/* Function:  p7_ForwardParser_sse()
  * Synopsis:  The Forward algorithm, linear memory parsing version.
  * Incept:    SRE, Fri Aug 15 19:05:26 2008 [Casa de Gatos]
  *
@@ -113,6 +128,10 @@ p7_Forward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *
  *            The caller must provide a suitably allocated "parsing"
  *            <ox> by calling <ox = p7_omx_Create(M, 0, L)> or
  *            <p7_omx_GrowTo(ox, M, 0, L)>.
+ *
+ *            This is the SSE2 version. <p7_ForwardParser()> calls it, or
+ *            <p7_ForwardParser_avx512()> on AVX-512 hosts, through the
+ *            kernel table (see kernels.c).
  *            
  * Args:      dsq     - digital target sequence, 1..L
  *            L       - length of dsq in residues          
@@ -129,7 +148,7 @@ p7_Forward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *
  *            In either case, <*opt_sc> is undefined.
  */
 int
-p7_ForwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+p7_ForwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
 {
 #if eslDEBUGLEVEL > 0		
   if (om->M >  ox->allocQ4*4)    ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
@@ -138,7 +157,7 @@ p7_ForwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, f
   if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
-  return forward_engine(FALSE, dsq, L, om, ox, opt_sc);
+  return forward_engine(FALSE, dsq, L, om, ox, NULL, opt_sc);
 }
 
 
@@ -197,12 +216,12 @@ p7_Backward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd,
   if (! p7_oprofile_IsLocal(om))  ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
- return backward_engine(TRUE, dsq, L, om, fwd, bck, opt_sc);
+ return backward_engine(TRUE, dsq, L, om, fwd, bck, NULL, opt_sc);
 }
 
 
 
-/* Function:  p7_BackwardParser()
+/* Function:  p7_BackwardParser_sse()
  * Synopsis:  The Backward algorithm, linear memory parsing version.
  * Incept:    SRE, Sat Aug 16 08:34:13 2008 [Janelia]
  *
@@ -217,6 +236,10 @@ p7_Backward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd,
  *            <bck> by calling <bck = p7_omx_Create(M, 0, L)> or
  *            <p7_omx_GrowTo(bck, M, 0, L)>.
  *
+ *            This is the SSE2 version. <p7_BackwardParser()> calls it, or
+ *            <p7_BackwardParser_avx512()> on AVX-512 hosts, through the
+ *            kernel table (see kernels.c).
+ *
  * Args:      dsq     - digital target sequence, 1..L
  *            L       - length of dsq in residues          
  *            om      - optimized profile
@@ -233,7 +256,7 @@ p7_Backward(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd,
  *            In either case, <*opt_sc> is undefined.
  */
 int 
-p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+p7_BackwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
 {
 #if eslDEBUGLEVEL > 0		
   if (om->M >  bck->allocQ4*4)    ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
@@ -243,7 +266,163 @@ p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX
   if (! p7_oprofile_IsLocal(om))  ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
-  return backward_engine(FALSE, dsq, L, om, fwd, bck, opt_sc);
+  return backward_engine(FALSE, dsq, L, om, fwd, bck, NULL, opt_sc);
+}
+
+
+
+/* Function:  p7_ForwardCheckpointed()
+ * Synopsis:  The Forward algorithm, checkpointed memory version.
+ *
+ * Purpose:   Same as <p7_Forward()>, but fills the Forward matrix of a
+ *            checkpointed matrix set <ock>, which the caller has laid
+ *            out for a target of length <L> with
+ *            <p7_omxchk_Create(M, L)> or <p7_omxchk_GrowTo(ock, M, L)>.
+ *            Requires $O(M \sqrt{L})$ memory; the time is the same as
+ *            <p7_Forward()>. Only the checkpointed rows and the last
+ *            segment of rows are retained; <p7_ForwardSegment()>
+ *            recalculates others on demand.
+ *
+ *            This also invalidates any previous Backward, decoding,
+ *            or OA results in <ock>.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            ock     - RETURN: Forward matrix is filled in <ock->fwd>
+ *            opt_sc  - optRETURN: Forward score (in nats)          
+ *
+ * Returns:   <eslOK> on success. 
+ *
+ * Throws:    <eslEINVAL> if <ock> isn't laid out for length <L>.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int
+p7_ForwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *ock, float *opt_sc)
+{
+  int status;
+
+  if (L != ock->L || om->M > ock->fwd->allocQ4*4) ESL_EXCEPTION(eslEINVAL, "checkpointed matrix not laid out for this problem");
+#if eslDEBUGLEVEL > 0		
+  if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
+#endif
+
+  ock->bck_seg = ock->pp_seg = ock->oa_seg = -1;
+  status       = forward_engine(TRUE, dsq, L, om, ock->fwd, (ock->do_bf16 ? ock->fh : NULL), opt_sc);
+  ock->fwd_seg = ock->nseg-1;	/* the last segment's rows are the ones still in the buffer */
+  return status;
+}
+
+
+/* Function:  p7_BackwardCheckpointed()
+ * Synopsis:  The Backward algorithm, checkpointed memory version.
+ *
+ * Purpose:   Same as <p7_Backward()>, using the checkpointed matrix
+ *            set <ock>, in which <p7_ForwardCheckpointed()> has just
+ *            filled the Forward matrix. Leaves the first segment of
+ *            rows in the buffer. 
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            ock     - checkpointed Forward matrix; RETURN: Backward in <ock->bck>
+ *            opt_sc  - optRETURN: Backward score (in nats)          
+ *
+ * Returns:   <eslOK> on success. 
+ *
+ * Throws:    <eslEINVAL> if <ock> isn't laid out for length <L>.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int
+p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *ock, float *opt_sc)
+{
+  int status;
+
+  if (L != ock->L || L != ock->fwd->L) ESL_EXCEPTION(eslEINVAL, "checkpointed matrix not laid out for this problem");
+
+  ock->pp_seg  = ock->oa_seg = -1;
+  status       = backward_engine(TRUE, dsq, L, om, ock->fwd, ock->bck, (ock->do_bf16 ? ock->bh : NULL), opt_sc);
+  ock->bck_seg = (L > 0 ? 0 : -1);
+  return status;
+}
+
+
+/* Function:  p7_ForwardSegment()
+ * Synopsis:  Recalculate one segment of a checkpointed Forward matrix.
+ *
+ * Purpose:   Makes rows <s*K+1..(s+1)*K> (segment <s>) of the
+ *            checkpointed Forward matrix in <ock> available, by
+ *            recalculating them from the checkpoint at row <s*K>.
+ *            The recalculated values are identical to those of the
+ *            original pass. Does nothing if segment <s> is already
+ *            there. In a bfloat16 set (<p7_omxchk_CreateBF16()>), the
+ *            rows are widened from their stored bfloat16 values
+ *            instead.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_ForwardSegment(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int s)
+{
+  float   totscale = ock->fwd->totscale;
+  int     nv       = p7O_NQF(om->M) * p7X_NSCELLS;
+  int     i;
+
+  if (ock->fwd_seg == s) return eslOK;
+  if (ock->do_bf16)
+    {
+      for (i = s*ock->K+1; i <= ESL_MIN(ock->L, (s+1)*ock->K); i++)
+	bf16_unpack(ock->fh + (int64_t) i * nv * 4, ock->fwd->dpf[i], nv);
+      ock->fwd_seg = s;
+      return eslOK;
+    }
+  forward_rows(TRUE, dsq, s*ock->K+1, ESL_MIN(ock->L, (s+1)*ock->K), om, ock->fwd);
+  ock->fwd->totscale = totscale;
+  ock->fwd_seg       = s;
+  return eslOK;
+}
+
+
+/* Function:  p7_BackwardSegment()
+ * Synopsis:  Recalculate one segment of a checkpointed Backward matrix.
+ *
+ * Purpose:   Same as <p7_ForwardSegment()>, for the Backward matrix:
+ *            recalculates the rows of segment <s> from the checkpoint
+ *            at the first row of segment <s+1> (or from the
+ *            initialization at row <L>, for the last segment),
+ *            reusing the scale factors of the original pass; or, in
+ *            a bfloat16 set, widens the stored rows.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_BackwardSegment(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int s)
+{
+  float totscale       = ock->bck->totscale;
+  int   has_own_scales = ock->bck->has_own_scales;
+  int   ia             = s*ock->K+1;
+  int   ib             = ESL_MIN(ock->L, (s+1)*ock->K);
+  int   nv             = p7O_NQF(om->M) * p7X_NSCELLS;
+  int   i;
+
+  if (ock->bck_seg == s) return eslOK;
+  if (ock->do_bf16)
+    {
+      for (i = ia; i <= ib; i++)
+	bf16_unpack(ock->bh + (int64_t) i * nv * 4, ock->bck->dpf[i], nv);
+      ock->bck_seg = s;
+      return eslOK;
+    }
+  if (ib == ock->L) { backward_init(TRUE, ock->L, om, ock->fwd, ock->bck); ib--; }
+  backward_rows(TRUE, dsq, ib, ia, om, ock->fwd, ock->bck, TRUE);
+  ock->bck->totscale       = totscale;
+  ock->bck->has_own_scales = has_own_scales;
+  ock->bck_seg             = s;
+  return eslOK;
 }
 
 
@@ -252,8 +431,95 @@ p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX
  * 2. Forward/Backward engine implementations (called thru API)
  *****************************************************************/
 
+/* forward_engine()
+ *
+ * Forward, in a full (<do_full> TRUE) or parsing matrix. If <h> is
+ * non-NULL, each row of a full matrix is also saved in <h> in
+ * bfloat16 as soon as it's calculated, at <h + i*Q*p7X_NSCELLS*4>;
+ * that's how a bfloat16 checkpointed set keeps rows that its
+ * working buffer can't.
+ */
 static int
-forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, uint16_t *h, float *opt_sc)
+{
+  __m128   zerov = _mm_setzero_ps(); /* splatted 0.0's in a vector                              */
+  float    xC;			     /* C state score at i=L                                     */
+  int      i;			     /* counter over rows, when saving them to <h>               */
+  int      q;			     /* counter over quads 0..nq-1                               */
+  int      Q   = p7O_NQF(om->M);     /* segment length: # of vectors                             */
+  __m128  *dpc = ox->dpf[0];         /* row 0, for use in {MDI}MO(dpc,q) access macro            */
+
+  /* Initialization. */
+  ox->M  = om->M;
+  ox->L  = L;
+  ox->has_own_scales = TRUE; 	/* all forward matrices control their own scalefactors */
+  for (q = 0; q < Q; q++)
+    MMO(dpc,q) = IMO(dpc,q) = DMO(dpc,q) = zerov;
+  ox->xmx[p7X_E] = 0.;
+  ox->xmx[p7X_N] = 1.;
+  ox->xmx[p7X_J] = 0.;
+  ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
+  ox->xmx[p7X_C] = 0.;
+
+  ox->xmx[p7X_SCALE] = 1.0;
+  ox->totscale       = 0.0;
+
+#if eslDEBUGLEVEL > 0
+  if (ox->debugging) p7_omx_DumpFBRow(ox, TRUE, 0, 9, 5, ox->xmx[p7X_E], ox->xmx[p7X_N], ox->xmx[p7X_J], ox->xmx[p7X_B], ox->xmx[p7X_C]);	/* logify=TRUE, <rowi>=0, width=8, precision=5*/
+#endif
+
+  if (h == NULL) 
+    forward_rows(do_full, dsq, 1, L, om, ox);
+  else
+    for (i = 1; i <= L; i++)
+      {
+	forward_rows(do_full, dsq, i, i, om, ox);
+	bf16_pack(ox->dpf[i], h + (int64_t) i * Q * p7X_NSCELLS * 4, Q * p7X_NSCELLS);
+      }
+  xC = ox->xmx[L*p7X_NXCELLS+p7X_C];
+
+  /* finally C->T, and flip total score back to log space (nats) */
+  /* On overflow, xC is inf or nan (nan arises because inf*0 = nan). */
+  /* On an underflow (which shouldn't happen), we counterintuitively return infinity:
+   * the effect of this is to force the caller to rescore us with full range.
+   */
+  if       (isnan(xC))        ESL_EXCEPTION(eslERANGE, "forward score is NaN");
+  else if  (L>0 && xC == 0.0) ESL_EXCEPTION(eslERANGE, "forward score underflow (is 0.0)");     /* if L==0, xC *should* be 0.0; J5/118 */
+  else if  (isinf(xC) == 1)   ESL_EXCEPTION(eslERANGE, "forward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = ox->totscale + log(xC * om->xf[p7O_C][p7O_MOVE]);
+  return eslOK;
+}
+
+
+/* The row recursions, forward_rows_kernel() and
+ * backward_rows_kernel(), take the matrix type <do_full> and the
+ * <multihit> setting as arguments that forward_rows() and
+ * backward_rows() only ever pass as constants, and they're forced
+ * inline there, so each of the four combinations is compiled as its
+ * own specialized copy: in a parsing matrix the row indexing folds
+ * away, and in unihit mode (E->J = 0) the J state, which can't be
+ * reached, is skipped. The mode is taken from that E->J cost, not
+ * from <om->mode>, because p7_oprofile_ReconfigUnihit(), which domain
+ * definition uses to rescore each domain, leaves <om->mode> alone.
+ * The profile must be local, as for all of this file.
+ */
+#if defined(__GNUC__)
+#define P7_ROWS_INLINE static inline __attribute__((always_inline))
+#else
+#define P7_ROWS_INLINE static inline
+#endif
+
+/* forward_rows_kernel()
+ *
+ * The Forward recursion for rows <ia>..<ib>, starting from the
+ * specials and (in a full matrix) the main states already stored for
+ * row <ia>-1. In a parsing matrix (<do_full> FALSE) the one main row
+ * must still hold row <ia>-1. Rescaling events add to <ox->totscale>.
+ * With <multihit> FALSE, <om> must be in unihit mode; J(i) stays 0.
+ */
+P7_ROWS_INLINE void
+forward_rows_kernel(const int do_full, const int multihit, const ESL_DSQ *dsq, int ia, int ib, const P7_OPROFILE *om, P7_OMX *ox)
 {
   register __m128 mpv, dpv, ipv;   /* previous row values                                       */
   register __m128 sv;		   /* temp storage of 1 curr row value in progress              */
@@ -266,32 +532,18 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
   int q;			   /* counter over quads 0..nq-1                                */
   int j;			   /* counter over DD iterations (4 is full serialization)      */
   int Q       = p7O_NQF(om->M);	   /* segment length: # of vectors                              */
-  __m128 *dpc = ox->dpf[0];        /* current row, for use in {MDI}MO(dpp,q) access macro       */
+  __m128 *dpc = ox->dpf[do_full * (ia-1)]; /* current row, for use in {MDI}MO(dpp,q) access macro */
   __m128 *dpp;                     /* previous row, for use in {MDI}MO(dpp,q) access macro      */
   __m128 *rp;			   /* will point at om->rfv[x] for residue x[i]                 */
   __m128 *tp;			   /* will point into (and step thru) om->tfv                   */
 
-  /* Initialization. */
-  ox->M  = om->M;
-  ox->L  = L;
-  ox->has_own_scales = TRUE; 	/* all forward matrices control their own scalefactors */
-  zerov  = _mm_setzero_ps();
-  for (q = 0; q < Q; q++)
-    MMO(dpc,q) = IMO(dpc,q) = DMO(dpc,q) = zerov;
-  xE    = ox->xmx[p7X_E] = 0.;
-  xN    = ox->xmx[p7X_N] = 1.;
-  xJ    = ox->xmx[p7X_J] = 0.;
-  xB    = ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
-  xC    = ox->xmx[p7X_C] = 0.;
-
-  ox->xmx[p7X_SCALE] = 1.0;
-  ox->totscale       = 0.0;
-
-#if eslDEBUGLEVEL > 0
-  if (ox->debugging) p7_omx_DumpFBRow(ox, TRUE, 0, 9, 5, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=0, width=8, precision=5*/
-#endif
+  zerov = _mm_setzero_ps();
+  xN    = ox->xmx[(ia-1)*p7X_NXCELLS+p7X_N];
+  xJ    = ox->xmx[(ia-1)*p7X_NXCELLS+p7X_J];
+  xB    = ox->xmx[(ia-1)*p7X_NXCELLS+p7X_B];
+  xC    = ox->xmx[(ia-1)*p7X_NXCELLS+p7X_C];
 
-  for (i = 1; i <= L; i++)
+  for (i = ia; i <= ib; i++)
     {
       dpp   = dpc;                      
       dpc   = ox->dpf[do_full * i];     /* avoid conditional, use do_full as kronecker delta */
@@ -391,8 +643,9 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 		  cv         = _mm_or_ps(cv, _mm_cmpgt_ps(sv, DMO(dpc,q))); 
 		  DMO(dpc,q) = sv;	                                    /* store new DMO(q) */
 		  dcv        = _mm_mul_ps(dcv, *tp);   tp++;            /* note, extend dcv, not DMO(q) */
+		  if (dd_done(dcv)) break;                              /* rest of the row gets +0.0 */
 		}	    
-	      if (! _mm_movemask_ps(cv)) break; /* DD's didn't change any DMO(q)? Then done, break out. */
+	      if (! _mm_movemask_ps(cv) || dd_done(dcv)) break; /* DD's didn't change any DMO(q), or can't any more? Then done, break out. */
 	    }
 	}
 
@@ -410,8 +663,11 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 
       xN =  xN * om->xf[p7O_N][p7O_LOOP];
       xC = (xC * om->xf[p7O_C][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_MOVE]);
-      xJ = (xJ * om->xf[p7O_J][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_LOOP]);
-      xB = (xJ * om->xf[p7O_J][p7O_MOVE]) +  (xN * om->xf[p7O_N][p7O_MOVE]);
+      if (multihit) {
+	xJ = (xJ * om->xf[p7O_J][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_LOOP]);
+	xB = (xJ * om->xf[p7O_J][p7O_MOVE]) +  (xN * om->xf[p7O_N][p7O_MOVE]);
+      } else
+	xB =                                   (xN * om->xf[p7O_N][p7O_MOVE]);
       /* and now xB will carry over into next i, and xC carries over after i=L */
 
       /* Sparse rescaling. xE above threshold? trigger a rescaling event.            */
@@ -419,7 +675,7 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 	{
 	  xN  = xN / xE;
 	  xC  = xC / xE;
-	  xJ  = xJ / xE;
+	  if (multihit) xJ = xJ / xE;
 	  xB  = xB / xE;
 	  xEv = _mm_set1_ps(1.0 / xE);
 	  for (q = 0; q < Q; q++)
@@ -447,40 +703,123 @@ forward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7
 #if eslDEBUGLEVEL > 0
       if (ox->debugging) p7_omx_DumpFBRow(ox, TRUE, i, 9, 5, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=i, width=9, precision=5*/
 #endif
-    } /* end loop over sequence residues 1..L */
-
-  /* finally C->T, and flip total score back to log space (nats) */
-  /* On overflow, xC is inf or nan (nan arises because inf*0 = nan). */
-  /* On an underflow (which shouldn't happen), we counterintuitively return infinity:
-   * the effect of this is to force the caller to rescore us with full range.
-   */
-  if       (isnan(xC))        ESL_EXCEPTION(eslERANGE, "forward score is NaN");
-  else if  (L>0 && xC == 0.0) ESL_EXCEPTION(eslERANGE, "forward score underflow (is 0.0)");     /* if L==0, xC *should* be 0.0; J5/118 */
-  else if  (isinf(xC) == 1)   ESL_EXCEPTION(eslERANGE, "forward score overflow (is infinity)");
+    } /* end loop over sequence residues ia..ib */
+}
 
-  if (opt_sc != NULL) *opt_sc = ox->totscale + log(xC * om->xf[p7O_C][p7O_MOVE]);
-  return eslOK;
+/* forward_rows()
+ *
+ * forward_rows_kernel() for rows <ia>..<ib>, specialized for the
+ * matrix type and for <om>'s multihit/unihit mode.
+ */
+static void
+forward_rows(int do_full, const ESL_DSQ *dsq, int ia, int ib, const P7_OPROFILE *om, P7_OMX *ox)
+{
+  if (om->xf[p7O_E][p7O_LOOP] > 0.0f) {
+    if (do_full) forward_rows_kernel(TRUE,  TRUE,  dsq, ia, ib, om, ox);
+    else         forward_rows_kernel(FALSE, TRUE,  dsq, ia, ib, om, ox);
+  } else {
+    if (do_full) forward_rows_kernel(TRUE,  FALSE, dsq, ia, ib, om, ox);
+    else         forward_rows_kernel(FALSE, FALSE, dsq, ia, ib, om, ox);
+  }
 }
 
 
 
+/* backward_engine()
+ *
+ * Backward, in a full or parsing matrix; with <h> non-NULL, each row
+ * of a full matrix is saved in bfloat16, as in <forward_engine()>.
+ */
 static int 
-backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, uint16_t *h, float *opt_sc)
 {
-  register __m128 mpv, ipv, dpv;      /* previous row values                                       */
-  register __m128 mcv, dcv;           /* current row values                                        */
-  register __m128 tmmv, timv, tdmv;   /* tmp vars for accessing rotated transition scores          */
-  register __m128 xBv;		      /* collects B->Mk components of B(i)                         */
-  register __m128 xEv;	              /* splatted E(i)                                             */
+  register __m128 mpv;                /* M(1,k) * e(M_k, x_1) * t(B->M_k)                          */
+  register __m128 xBv;		      /* collects B->Mk components of B(0)                         */
+  __m128   zerov   = _mm_setzero_ps();/* splatted 0.0's in a vector                                */
+  float    xN, xB;		      /* special states' scores                                    */
+  int      i;			      /* counter over rows, when saving them to <h>                */
+  int      q;			      /* counter over quads 0..Q-1                                 */
+  int      Q       = p7O_NQF(om->M);  /* segment length: # of vectors                              */
+  __m128  *dpp;			      /* row 1                                                     */
+  __m128  *rp;			      /* will point into om->rfv[x] for residue x[1]               */
+  __m128  *tp;		              /* will point into (and step thru) om->tfv transition scores */
+#if eslDEBUGLEVEL > 0
+  __m128  *dpc;
+#endif
+
+  backward_init(do_full, L, om, fwd, bck);
+  if (h == NULL)
+    backward_rows(do_full, dsq, L-1, 1, om, fwd, bck, FALSE);
+  else
+    {
+      if (L > 0) bf16_pack(bck->dpf[L], h + (int64_t) L * Q * p7X_NSCELLS * 4, Q * p7X_NSCELLS);
+      for (i = L-1; i >= 1; i--)
+	{
+	  backward_rows(do_full, dsq, i, i, om, fwd, bck, FALSE);
+	  bf16_pack(bck->dpf[i], h + (int64_t) i * Q * p7X_NSCELLS * 4, Q * p7X_NSCELLS);
+	}
+    }
+  xN = bck->xmx[ESL_MIN(L,1)*p7X_NXCELLS+p7X_N]; /* N(1); or N(L) from the initialization, if L=0 */
+
+  /* Termination at i=0, where we can only reach N,B states. */
+  dpp = bck->dpf[1 * do_full];
+  tp  = om->tfv;          /* <*tp> is now the [1 5 9 13] TBMk transition quad  */
+  rp  = om->rfv[dsq[1]];  /* <*rp> is now the [1 5 9 13] match emission quad   */
+  xBv = zerov;
+  for (q = 0; q < Q; q++)
+    {
+      mpv = _mm_mul_ps(MMO(dpp,q), *rp);  rp++;
+      mpv = _mm_mul_ps(mpv,        *tp);  tp += 7;
+      xBv = _mm_add_ps(xBv,        mpv);
+    }
+  /* horizontal sum of xBv */
+  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(0, 3, 2, 1)));
+  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(1, 0, 3, 2)));
+  _mm_store_ss(&xB, xBv);
+ 
+  xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]);  
+
+  bck->xmx[p7X_B]     = xB;
+  bck->xmx[p7X_C]     = 0.0;
+  bck->xmx[p7X_J]     = 0.0;
+  bck->xmx[p7X_N]     = xN;
+  bck->xmx[p7X_E]     = 0.0;
+  bck->xmx[p7X_SCALE] = 1.0;
+
+#if eslDEBUGLEVEL > 0
+  dpc = bck->dpf[0];
+  for (q = 0; q < Q; q++) /* Not strictly necessary, but if someone's looking at DP matrices, this is nice to do: */
+    MMO(dpc,q) = DMO(dpc,q) = IMO(dpc,q) = zerov;
+  if (bck->debugging) p7_omx_DumpFBRow(bck, TRUE, 0, 9, 4, bck->xmx[p7X_E], bck->xmx[p7X_N],  bck->xmx[p7X_J], bck->xmx[p7X_B],  bck->xmx[p7X_C]);	/* logify=TRUE, <rowi>=0, width=9, precision=4*/
+#endif
+
+  if       (isnan(xN))        ESL_EXCEPTION(eslERANGE, "backward score is NaN");
+  else if  (L>0 && xN == 0.0) ESL_EXCEPTION(eslERANGE, "backward score underflow (is 0.0)");    /* if L==0, xN *should* be 0.0 [J5/118]*/
+  else if  (isinf(xN) == 1)   ESL_EXCEPTION(eslERANGE, "backward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = bck->totscale + log(xN);
+  return eslOK;
+}
+
+
+/* backward_init()
+ *
+ * Initialize row <L> of the Backward matrix, using the scale factor
+ * that <fwd> used for that row. Resets <bck->totscale> and
+ * <bck->has_own_scales>.
+ */
+static void
+backward_init(int do_full, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck)
+{
+  register __m128 dpv;                /* previous D value                                          */
+  register __m128 dcv;                /* current D value                                           */
+  register __m128 xEv;	              /* splatted E(L)                                             */
   __m128   zerov;		      /* splatted 0.0's in a vector                                */
   float    xN, xE, xB, xC, xJ;	      /* special states' scores                                    */
-  int      i;			      /* counter over sequence positions 0,1..L                    */
   int      q;			      /* counter over quads 0..Q-1                                 */
   int      Q       = p7O_NQF(om->M);  /* segment length: # of vectors                              */
   int      j;			      /* DD segment iteration counter (4 = full serialization)     */
-  __m128  *dpc;                       /* current DP row                                            */
-  __m128  *dpp;			      /* next ("previous") DP row                                  */
-  __m128  *rp;			      /* will point into om->rfv[x] for residue x[i+1]             */
+  __m128  *dpc;                       /* row L                                                     */
   __m128  *tp;		              /* will point into (and step thru) om->tfv transition scores */
 
   /* initialize the L row. */
@@ -510,7 +849,7 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
       dpv        = DMO(dpc,q);
     }
   /* 2) three more passes, only extending DD component (dcv only; no xE contrib from DMO(q)) */
-  for (j = 1; j < 4; j++)
+  for (j = 1; j < 4 && ! dd_done(dcv); j++)
     {
       tp  = om->tfv + 8*Q - 1;	                            /* <*tp> now the [4 8 12 x] TDD quad         */
       dcv = _mm_move_ss(dcv, zerov);                        /* start leftshift: [1 5 9 13] -> [x 5 9 13] */
@@ -519,6 +858,7 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 	{
 	  dcv        = _mm_mul_ps(dcv, *tp); tp--;
 	  DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
+	  if (dd_done(dcv)) break;
 	}
     }
   /* now MD init */
@@ -559,9 +899,47 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 #if eslDEBUGLEVEL > 0
   if (bck->debugging) p7_omx_DumpFBRow(bck, TRUE, L, 9, 4, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=L, width=9, precision=4*/
 #endif
+}
+
+
+/* backward_rows_kernel()
+ *
+ * The Backward recursion for rows <ib> down to <ia>, starting from
+ * the specials and main states already stored for row <ib>+1. Unless
+ * <redo> is TRUE, the scale factor for each row is chosen and stored
+ * as it's calculated, adding to <bck->totscale>. With <redo>, the
+ * rows are being recalculated (in a checkpointed matrix), and the
+ * scale factors already stored in <bck> are reused as is. With
+ * <multihit> FALSE, <om> must be in unihit mode: J(i) is still
+ * calculated and stored, since B is reachable from it, but E(i)
+ * doesn't collect from it.
+ */
+P7_ROWS_INLINE void
+backward_rows_kernel(const int do_full, const int multihit, const ESL_DSQ *dsq, int ib, int ia, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, int redo)
+{
+  register __m128 mpv, ipv, dpv;      /* previous row values                                       */
+  register __m128 mcv, dcv;           /* current row values                                        */
+  register __m128 tmmv, timv, tdmv;   /* tmp vars for accessing rotated transition scores          */
+  register __m128 xBv;		      /* collects B->Mk components of B(i)                         */
+  register __m128 xEv;	              /* splatted E(i)                                             */
+  __m128   zerov;		      /* splatted 0.0's in a vector                                */
+  float    xN, xE, xB, xC, xJ;	      /* special states' scores                                    */
+  int      i;			      /* counter over sequence positions ia..ib                    */
+  int      q;			      /* counter over quads 0..Q-1                                 */
+  int      Q       = p7O_NQF(om->M);  /* segment length: # of vectors                              */
+  int      j;			      /* DD segment iteration counter (4 = full serialization)     */
+  __m128  *dpc;                       /* current DP row                                            */
+  __m128  *dpp;			      /* next ("previous") DP row                                  */
+  __m128  *rp;			      /* will point into om->rfv[x] for residue x[i+1]             */
+  __m128  *tp;		              /* will point into (and step thru) om->tfv transition scores */
+
+  zerov = _mm_setzero_ps();
+  xN    = bck->xmx[(ib+1)*p7X_NXCELLS+p7X_N];
+  xJ    = bck->xmx[(ib+1)*p7X_NXCELLS+p7X_J];
+  xC    = bck->xmx[(ib+1)*p7X_NXCELLS+p7X_C];
 
   /* main recursion */
-  for (i = L-1; i >= 1; i--)	/* backwards stride */
+  for (i = ib; i >= ia; i--)	/* backwards stride */
     {
       /* phase 1. B(i) collected. Old row destroyed, new row contains
        *    complete I(i,k), partial {MD}(i,k) w/ no {MD}->{DE} paths yet.
@@ -607,7 +985,8 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
       xC =  xC * om->xf[p7O_C][p7O_LOOP];
       xJ = (xB * om->xf[p7O_J][p7O_MOVE]) + (xJ * om->xf[p7O_J][p7O_LOOP]); /* must come after xB */
       xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]); /* must come after xB */
-      xE = (xC * om->xf[p7O_E][p7O_MOVE]) + (xJ * om->xf[p7O_E][p7O_LOOP]); /* must come after xJ, xC */
+      if (multihit) xE = (xC * om->xf[p7O_E][p7O_MOVE]) + (xJ * om->xf[p7O_E][p7O_LOOP]); /* must come after xJ, xC */
+      else          xE = (xC * om->xf[p7O_E][p7O_MOVE]);
       xEv = _mm_set1_ps(xE);	/* splat */
 
 
@@ -625,8 +1004,8 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 	}
       
       /* phase 4: finish extending the DD paths */
-      /* fully serialized for now */
-      for (j = 1; j < 4; j++)	/* three passes: we've already done 1 segment, we need 4 total */
+      /* fully serialized, but stopping once the paths underflow (dd_done()) */
+      for (j = 1; j < 4 && ! dd_done(dcv); j++)	/* three passes: we've already done 1 segment, we need 4 total */
 	{
 	  dcv = _mm_move_ss(dcv, zerov);
 	  dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1));
@@ -635,6 +1014,7 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 	    {
 	      dcv        = _mm_mul_ps(dcv, *tp); tp--;
 	      DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
+	      if (dd_done(dcv)) break;
 	    }
 	}
 
@@ -656,10 +1036,13 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
        * from those in <fwd>. This will complicate subsequent
        * posterior decoding routines.
        */
-      if (xB > 1.0e16) bck->has_own_scales = TRUE;
+      if (! redo)
+	{
+	  if (xB > 1.0e16) bck->has_own_scales = TRUE;
 
-      if      (bck->has_own_scales)  bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = (xB > 1.0e4) ? xB : 1.0;
-      else                           bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  if      (bck->has_own_scales)  bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = (xB > 1.0e4) ? xB : 1.0;
+	  else                           bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	}
 
       if (bck->xmx[i*p7X_NXCELLS+p7X_SCALE] > 1.0)
 	{
@@ -674,7 +1057,7 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
 	    DMO(dpc,q) = _mm_mul_ps(DMO(dpc,q), xBv);
 	    IMO(dpc,q) = _mm_mul_ps(IMO(dpc,q), xBv);
 	  }
-	  bck->totscale += log(bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	  if (! redo) bck->totscale += log(bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
 	}
 
       /* Stores are separate only for pedagogical reasons: easy to
@@ -691,46 +1074,79 @@ backward_engine(int do_full, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, c
       if (bck->debugging) p7_omx_DumpFBRow(bck, TRUE, i, 9, 4, xE, xN, xJ, xB, xC);	/* logify=TRUE, <rowi>=i, width=9, precision=4*/
 #endif
     } /* thus ends the loop over sequence positions i */
+}
 
-  /* Termination at i=0, where we can only reach N,B states. */
-  dpp = bck->dpf[1 * do_full];
-  tp  = om->tfv;          /* <*tp> is now the [1 5 9 13] TBMk transition quad  */
-  rp  = om->rfv[dsq[1]];  /* <*rp> is now the [1 5 9 13] match emission quad   */
-  xBv = zerov;
-  for (q = 0; q < Q; q++)
-    {
-      mpv = _mm_mul_ps(MMO(dpp,q), *rp);  rp++;
-      mpv = _mm_mul_ps(mpv,        *tp);  tp += 7;
-      xBv = _mm_add_ps(xBv,        mpv);
-    }
-  /* horizontal sum of xBv */
-  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(0, 3, 2, 1)));
-  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(1, 0, 3, 2)));
-  _mm_store_ss(&xB, xBv);
- 
-  xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]);  
+/* backward_rows()
+ *
+ * backward_rows_kernel() for rows <ib> down to <ia>, specialized for
+ * the matrix type and for <om>'s multihit/unihit mode.
+ */
+static void
+backward_rows(int do_full, const ESL_DSQ *dsq, int ib, int ia, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, int redo)
+{
+  if (om->xf[p7O_E][p7O_LOOP] > 0.0f) {
+    if (do_full) backward_rows_kernel(TRUE,  TRUE,  dsq, ib, ia, om, fwd, bck, redo);
+    else         backward_rows_kernel(FALSE, TRUE,  dsq, ib, ia, om, fwd, bck, redo);
+  } else {
+    if (do_full) backward_rows_kernel(TRUE,  FALSE, dsq, ib, ia, om, fwd, bck, redo);
+    else         backward_rows_kernel(FALSE, FALSE, dsq, ib, ia, om, fwd, bck, redo);
+  }
+}
 
-  bck->xmx[p7X_B]     = xB;
-  bck->xmx[p7X_C]     = 0.0;
-  bck->xmx[p7X_J]     = 0.0;
-  bck->xmx[p7X_N]     = xN;
-  bck->xmx[p7X_E]     = 0.0;
-  bck->xmx[p7X_SCALE] = 1.0;
 
-#if eslDEBUGLEVEL > 0
-  dpc = bck->dpf[0];
-  for (q = 0; q < Q; q++) /* Not strictly necessary, but if someone's looking at DP matrices, this is nice to do: */
-    MMO(dpc,q) = DMO(dpc,q) = IMO(dpc,q) = zerov;
-  if (bck->debugging) p7_omx_DumpFBRow(bck, TRUE, 0, 9, 4, bck->xmx[p7X_E], bck->xmx[p7X_N],  bck->xmx[p7X_J], bck->xmx[p7X_B],  bck->xmx[p7X_C]);	/* logify=TRUE, <rowi>=0, width=9, precision=4*/
-#endif
+/* bf16_pack()
+ *
+ * Round the <nv> vectors of DP row <dp> to bfloat16 (round to nearest
+ * even) and store them in <h>, 4*<nv> values in the same order.
+ * DP values are never negative, so the 16-bit results are all
+ * <= 0x7f80, and a signed pack saturates none of them.
+ */
+static void
+bf16_pack(const __m128 *dp, uint16_t *h, int nv)
+{
+  __m128i one  = _mm_set1_epi32(1);
+  __m128i bias = _mm_set1_epi32(0x7fff);
+  __m128i a, b;
+  int     v;
 
-  if       (isnan(xN))        ESL_EXCEPTION(eslERANGE, "backward score is NaN");
-  else if  (L>0 && xN == 0.0) ESL_EXCEPTION(eslERANGE, "backward score underflow (is 0.0)");    /* if L==0, xN *should* be 0.0 [J5/118]*/
-  else if  (isinf(xN) == 1)   ESL_EXCEPTION(eslERANGE, "backward score overflow (is infinity)");
+  for (v = 0; v < nv; v += 2)
+    {
+      a = _mm_castps_si128(dp[v]);
+      a = _mm_srli_epi32(_mm_add_epi32(a, _mm_add_epi32(bias, _mm_and_si128(_mm_srli_epi32(a, 16), one))), 16);
+      if (v+1 < nv) {
+	b = _mm_castps_si128(dp[v+1]);
+	b = _mm_srli_epi32(_mm_add_epi32(b, _mm_add_epi32(bias, _mm_and_si128(_mm_srli_epi32(b, 16), one))), 16);
+	_mm_storeu_si128((__m128i *) (h + 4*v), _mm_packs_epi32(a, b));
+      } else
+	_mm_storel_epi64((__m128i *) (h + 4*v), _mm_packs_epi32(a, a));
+    }
+}
 
-  if (opt_sc != NULL) *opt_sc = bck->totscale + log(xN);
-  return eslOK;
+/* bf16_unpack()
+ *
+ * Widen <4*nv> bfloat16 values in <h> back to the <nv> vectors of DP
+ * row <dp>.
+ */
+static void
+bf16_unpack(const uint16_t *h, __m128 *dp, int nv)
+{
+  __m128i zerov = _mm_setzero_si128();
+  __m128i hv;
+  int     v;
+
+  for (v = 0; v < nv; v += 2)
+    {
+      if (v+1 < nv) {
+	hv      = _mm_loadu_si128((const __m128i *) (h + 4*v));
+	dp[v]   = _mm_castsi128_ps(_mm_unpacklo_epi16(zerov, hv));
+	dp[v+1] = _mm_castsi128_ps(_mm_unpackhi_epi16(zerov, hv));
+      } else {
+	hv      = _mm_loadl_epi64((const __m128i *) (h + 4*v));
+	dp[v]   = _mm_castsi128_ps(_mm_unpacklo_epi16(zerov, hv));
+      }
+    }
 }
+
 /*-------------- end, forward/backward engines  -----------------*/
 
 
@@ -888,10 +1304,11 @@ main(int argc, char **argv)
 #include "esl_randomseq.h"
 
 /* 
- * compare to GForward() scores.
+ * compare to GForward() scores; in multihit mode, or (<multihit>
+ * FALSE) in unihit mode, as domain definition uses it.
  */
 static void
-utest_fwdback(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+utest_fwdback(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N, int multihit)
 {
   char        *msg = "forward/backward unit test failed";
   P7_HMM      *hmm = NULL;
@@ -913,6 +1330,11 @@ utest_fwdback(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int
   else tolerance = 0.0001;   /* stronger test: FLogsum() is in slow exact mode. */
 
   p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  if (! multihit)
+    {
+      p7_ReconfigUnihit          (gm, L);
+      p7_oprofile_ReconfigUnihit (om, L);
+    }
   while (N--)
     {
       esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
@@ -995,9 +1417,11 @@ main(int argc, char **argv)
   if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
   if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
 
-  utest_fwdback(r, abc, bg, M, L, N);   /* normal sized models */
-  utest_fwdback(r, abc, bg, 1, L, 10);  /* size 1 models       */
-  utest_fwdback(r, abc, bg, M, 1, 10);  /* size 1 sequences    */
+  utest_fwdback(r, abc, bg, M, L, N,  TRUE);   /* normal sized models */
+  utest_fwdback(r, abc, bg, 1, L, 10, TRUE);   /* size 1 models       */
+  utest_fwdback(r, abc, bg, M, 1, 10, TRUE);   /* size 1 sequences    */
+  utest_fwdback(r, abc, bg, 2000, L, 3, TRUE); /* large models, where DD paths underflow (dd_done()) long before the end of a row */
+  utest_fwdback(r, abc, bg, M, L, N,  FALSE);  /* unihit mode         */
 
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
@@ -1006,9 +1430,10 @@ main(int argc, char **argv)
   if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
   if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
 
-  utest_fwdback(r, abc, bg, M, L, N);   
-  utest_fwdback(r, abc, bg, 1, L, 10);  
-  utest_fwdback(r, abc, bg, M, 1, 10);  
+  utest_fwdback(r, abc, bg, M, L, N,  TRUE);
+  utest_fwdback(r, abc, bg, 1, L, 10, TRUE);
+  utest_fwdback(r, abc, bg, M, 1, 10, TRUE);
+  utest_fwdback(r, abc, bg, M, L, N,  FALSE);
 
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
@@ -0,0 +1,649 @@
+/* AVX-512 versions of the Forward and Backward parsers.
+ *
+ * These are the same algorithms as the linear memory "parsing" modes
+ * of p7_ForwardParser() and p7_BackwardParser() (fwdback.c), with 16
+ * float cells per vector instead of 4. They use their own 16-way
+ * striped copies of the scores, <om->rfv_512> and <om->tfv_512>,
+ * which p7_oprofile_Convert512() derives from the SSE <om->rfv> and
+ * <om->tfv>, and the one-row <ox->dp512> for the MDI cells. The
+ * special states and scale factors go into <ox->xmx> exactly as in
+ * the SSE parsers, so posterior decoding of the specials and domain
+ * definition don't care which version filled them.
+ *
+ * With 16 cells per vector, the D->D paths may need up to 16
+ * sequential passes to cross all segment boundaries. Both parsers
+ * stop as soon as a pass no longer changes any D cell, as SSE
+ * Forward already does for large models.
+ *
+ * Only this file and vitfilter_avx512.c are compiled with AVX-512
+ * (F+BW) instructions enabled (AVX512BW_CFLAGS); the SSE parsers
+ * dispatch here at runtime when impl_HaveAVX512() says the host
+ * supports it.
+ *
+ * Contents:
+ *   1. Forward/Backward parser implementations
+ *   2. Unit tests
+ *   3. Test driver
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_AVX512
+
+#include <stdio.h>
+#include <math.h>
+
+#include <xmmintrin.h>		/* SSE  */
+#include <emmintrin.h>		/* SSE2 */
+#include <immintrin.h>		/* AVX-512 */
+
+#include "easel.h"
+#include "esl_sse.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+
+/* Shift 16 floats right by one element (x,1,2..14), shifting on a
+ * zero; the equivalent of esl_sse_rightshiftz_float().
+ */
+static inline __m512
+rightshiftz_ps_512(__m512 v)
+{
+  return _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_castps_si512(v), _mm512_setzero_si512(), 15));
+}
+
+/* Shift 16 floats left by one element (1,2..15,x), shifting on a
+ * zero; the equivalent of the _mm_move_ss()/_mm_shuffle_ps() leftshift
+ * in the SSE Backward.
+ */
+static inline __m512
+leftshiftz_ps_512(__m512 v)
+{
+  return _mm512_castsi512_ps(_mm512_alignr_epi32(_mm512_setzero_si512(), _mm512_castps_si512(v), 1));
+}
+
+/* TRUE when every lane of an extended D->D path has underflowed to
+ * 0.0, so the rest of the DD passes would only add zeros; see
+ * dd_done() in fwdback.c.
+ */
+static inline int
+dd_done_512(__m512 dcv)
+{
+  return (_mm512_cmp_ps_mask(dcv, _mm512_setzero_ps(), _CMP_NEQ_UQ) == 0);
+}
+
+
+/*****************************************************************
+ * 1. Forward/Backward parser implementations
+ *****************************************************************/
+
+/* Function:  p7_ForwardParser_avx512()
+ * Synopsis:  AVX-512 version of p7_ForwardParser().
+ *
+ * Purpose:   Same as <p7_ForwardParser()>: the Forward algorithm in
+ *            linear memory, for sequence <dsq> of length <L> and
+ *            profile <om>, storing the special states and sparse
+ *            scale factors in parsing matrix <ox>, and optionally
+ *            returning the Forward score in nats in <opt_sc>. Scores
+ *            agree with the SSE implementation to within float
+ *            roundoff.
+ *
+ *            Caller must have checked that the host supports AVX-512
+ *            (<impl_HaveAVX512()>).
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ */
+int
+p7_ForwardParser_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+  register __m512 mpv, dpv, ipv;   /* previous row values                                       */
+  register __m512 sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m512 dcv;		   /* delayed storage of D(i,q+1)                               */
+  register __m512 xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m512 xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  __m512   zerov;		   /* splatted 0.0's in a vector                                */
+  __mmask16 cv;			   /* keeps track of whether any DD's change DMO(q)             */
+  float    xN, xE, xB, xC, xJ;	   /* special states' scores                                    */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int j;			   /* counter over DD iterations (16 is full serialization)     */
+  int Q       = p7O_NQF_512(om->M);/* segment length: # of vectors                              */
+  __m512 *dpc = ox->dp512;         /* the one row; dpc == dpp in parsing mode                   */
+  __m512 *dpp = ox->dp512;
+  __m512 *rp;			   /* will point at om->rfv_512[x] for residue x[i]             */
+  __m512 *tp;			   /* will point into (and step thru) om->tfv_512               */
+
+  if (Q > ox->allocQ512) ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+
+  /* Initialization. */
+  ox->M  = om->M;
+  ox->L  = L;
+  ox->has_own_scales = TRUE; 	/* all forward matrices control their own scalefactors */
+  zerov  = _mm512_setzero_ps();
+  for (q = 0; q < Q; q++)
+    MMO(dpc,q) = IMO(dpc,q) = DMO(dpc,q) = zerov;
+  xE    = ox->xmx[p7X_E] = 0.;
+  xN    = ox->xmx[p7X_N] = 1.;
+  xJ    = ox->xmx[p7X_J] = 0.;
+  xB    = ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
+  xC    = ox->xmx[p7X_C] = 0.;
+
+  ox->xmx[p7X_SCALE] = 1.0;
+  ox->totscale       = 0.0;
+
+  for (i = 1; i <= L; i++)
+    {
+      rp    = om->rfv_512[dsq[i]];
+      tp    = om->tfv_512;
+      dcv   = zerov;
+      xEv   = zerov;
+      xBv   = _mm512_set1_ps(xB);
+
+      mpv   = rightshiftz_ps_512(MMO(dpp,Q-1));
+      dpv   = rightshiftz_ps_512(DMO(dpp,Q-1));
+      ipv   = rightshiftz_ps_512(IMO(dpp,Q-1));
+
+      for (q = 0; q < Q; q++)
+	{
+	  /* Calculate new MMO(i,q); don't store it yet, hold it in sv. */
+	  sv   =                   _mm512_mul_ps(xBv, *tp);  tp++;
+	  sv   = _mm512_add_ps(sv, _mm512_mul_ps(mpv, *tp)); tp++;
+	  sv   = _mm512_add_ps(sv, _mm512_mul_ps(ipv, *tp)); tp++;
+	  sv   = _mm512_add_ps(sv, _mm512_mul_ps(dpv, *tp)); tp++;
+	  sv   = _mm512_mul_ps(sv, *rp);                     rp++;
+	  xEv  = _mm512_add_ps(xEv, sv);
+
+	  /* Load {MDI}(i-1,q) into mpv, dpv, ipv */
+	  mpv = MMO(dpp,q);
+	  dpv = DMO(dpp,q);
+	  ipv = IMO(dpp,q);
+
+	  /* Do the delayed stores of {MD}(i,q) now that memory is usable */
+	  MMO(dpc,q) = sv;
+	  DMO(dpc,q) = dcv;
+
+	  /* Calculate the next D(i,q+1) partially: M->D only */
+	  dcv   = _mm512_mul_ps(sv, *tp); tp++;
+
+	  /* Calculate and store I(i,q); assumes odds ratio for emission is 1.0 */
+	  sv         =                   _mm512_mul_ps(mpv, *tp);  tp++;
+	  IMO(dpc,q) = _mm512_add_ps(sv, _mm512_mul_ps(ipv, *tp)); tp++;
+	}
+
+      /* The DD paths: one complete pass, including M->D ... */
+      dcv        = rightshiftz_ps_512(dcv);
+      DMO(dpc,0) = zerov;
+      tp         = om->tfv_512 + 7*Q;	/* set tp to start of the DD's */
+      for (q = 0; q < Q; q++)
+	{
+	  DMO(dpc,q) = _mm512_add_ps(dcv, DMO(dpc,q));
+	  dcv        = _mm512_mul_ps(DMO(dpc,q), *tp); tp++;
+	}
+
+      /* ... then extend the DD paths until they no longer change any DMO(q) */
+      for (j = 1; j < 16; j++)
+	{
+	  dcv = rightshiftz_ps_512(dcv);
+	  tp  = om->tfv_512 + 7*Q;
+	  cv  = 0;
+	  for (q = 0; q < Q; q++)
+	    {
+	      sv         = _mm512_add_ps(dcv, DMO(dpc,q));
+	      cv        |= _mm512_cmp_ps_mask(sv, DMO(dpc,q), _CMP_GT_OQ);
+	      DMO(dpc,q) = sv;
+	      dcv        = _mm512_mul_ps(dcv, *tp);   tp++;
+	      if (dd_done_512(dcv)) break;
+	    }
+	  if (! cv || dd_done_512(dcv)) break;
+	}
+
+      /* Add D's to xEv */
+      for (q = 0; q < Q; q++) xEv = _mm512_add_ps(DMO(dpc,q), xEv);
+
+      /* Finally the "special" states, which start from Mk->E (->C, ->J->B) */
+      xE = _mm512_reduce_add_ps(xEv);
+
+      xN =  xN * om->xf[p7O_N][p7O_LOOP];
+      xC = (xC * om->xf[p7O_C][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_MOVE]);
+      xJ = (xJ * om->xf[p7O_J][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_LOOP]);
+      xB = (xJ * om->xf[p7O_J][p7O_MOVE]) +  (xN * om->xf[p7O_N][p7O_MOVE]);
+
+      /* Sparse rescaling, same trigger as the SSE version */
+      if (xE > 1.0e4)
+	{
+	  xN  = xN / xE;
+	  xC  = xC / xE;
+	  xJ  = xJ / xE;
+	  xB  = xB / xE;
+	  xEv = _mm512_set1_ps(1.0 / xE);
+	  for (q = 0; q < Q; q++)
+	    {
+	      MMO(dpc,q) = _mm512_mul_ps(MMO(dpc,q), xEv);
+	      DMO(dpc,q) = _mm512_mul_ps(DMO(dpc,q), xEv);
+	      IMO(dpc,q) = _mm512_mul_ps(IMO(dpc,q), xEv);
+	    }
+	  ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = xE;
+	  ox->totscale += log(xE);
+	  xE = 1.0;
+	}
+      else ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = 1.0;
+
+      ox->xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      ox->xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      ox->xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      ox->xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      ox->xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T, and flip total score back to log space (nats) */
+  if       (isnan(xC))        ESL_EXCEPTION(eslERANGE, "forward score is NaN");
+  else if  (L>0 && xC == 0.0) ESL_EXCEPTION(eslERANGE, "forward score underflow (is 0.0)");
+  else if  (isinf(xC) == 1)   ESL_EXCEPTION(eslERANGE, "forward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = ox->totscale + log(xC * om->xf[p7O_C][p7O_MOVE]);
+  return eslOK;
+}
+
+
+/* Function:  p7_BackwardParser_avx512()
+ * Synopsis:  AVX-512 version of p7_BackwardParser().
+ *
+ * Purpose:   Same as <p7_BackwardParser()>: the Backward algorithm in
+ *            linear memory, for sequence <dsq> of length <L> and
+ *            profile <om>, using the sparse scale factors of the
+ *            Forward matrix <fwd> (parsing or full, either SSE or
+ *            AVX-512), storing the special states in <bck>, and
+ *            optionally returning the Backward score in nats in
+ *            <opt_sc>.
+ *
+ *            Caller must have checked that the host supports AVX-512
+ *            (<impl_HaveAVX512()>).
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <bck> allocation is too small.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ */
+int
+p7_BackwardParser_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
+  register __m512 mpv, ipv, dpv;      /* previous row values                                       */
+  register __m512 mcv, dcv;           /* current row values                                        */
+  register __m512 tmmv, timv, tdmv;   /* tmp vars for accessing rotated transition scores          */
+  register __m512 xBv;		      /* collects B->Mk components of B(i)                         */
+  register __m512 xEv;	              /* splatted E(i)                                             */
+  register __m512 sv;		      /* temp storage of a new DMO(q)                              */
+  __m512   zerov;		      /* splatted 0.0's in a vector                                */
+  __mmask16 cv;			      /* keeps track of whether any DD's change DMO(q)             */
+  float    xN, xE, xB, xC, xJ;	      /* special states' scores                                    */
+  int      i;			      /* counter over sequence positions 0,1..L                    */
+  int      q;			      /* counter over vectors 0..Q-1                               */
+  int      Q       = p7O_NQF_512(om->M); /* segment length: # of vectors                           */
+  int      j;			      /* DD segment iteration counter (16 = full serialization)    */
+  __m512  *dpc = bck->dp512;          /* the one row; dpc == dpp in parsing mode                   */
+  __m512  *dpp = bck->dp512;
+  __m512  *rp;			      /* will point into om->rfv_512[x] for residue x[i+1]         */
+  __m512  *tp;		              /* will point into (and step thru) om->tfv_512               */
+
+  if (Q > bck->allocQ512) ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+
+  /* initialize the L row. */
+  bck->M = om->M;
+  bck->L = L;
+  bck->has_own_scales = FALSE;	/* backwards scale factors are *usually* given by <fwd> */
+  xJ     = 0.0;
+  xB     = 0.0;
+  xN     = 0.0;
+  xC     = om->xf[p7O_C][p7O_MOVE];      /* C<-T */
+  xE     = xC * om->xf[p7O_E][p7O_MOVE]; /* E<-C, no tail */
+  xEv    = _mm512_set1_ps(xE);
+  zerov  = _mm512_setzero_ps();
+  dcv    = zerov;
+  for (q = 0; q < Q; q++) MMO(dpc,q) = DMO(dpc,q) = xEv;
+  for (q = 0; q < Q; q++) IMO(dpc,q) = zerov;
+
+  /* init row L's DD paths, 1) first segment includes xE, from DMO(q) */
+  tp  = om->tfv_512 + 8*Q - 1;	      /* <*tp> now the last TDD vector */
+  dpv = leftshiftz_ps_512(DMO(dpc,0));
+  for (q = Q-1; q >= 0; q--)
+    {
+      dcv        = _mm512_mul_ps(dpv, *tp);      tp--;
+      DMO(dpc,q) = _mm512_add_ps(DMO(dpc,q), dcv);
+      dpv        = DMO(dpc,q);
+    }
+  /* 2) more passes, only extending DD component, until no DMO(q) changes */
+  for (j = 1; j < 16; j++)
+    {
+      tp  = om->tfv_512 + 8*Q - 1;
+      dcv = leftshiftz_ps_512(dcv);
+      cv  = 0;
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv        = _mm512_mul_ps(dcv, *tp); tp--;
+	  sv         = _mm512_add_ps(DMO(dpc,q), dcv);
+	  cv        |= _mm512_cmp_ps_mask(sv, DMO(dpc,q), _CMP_GT_OQ);
+	  DMO(dpc,q) = sv;
+	  if (dd_done_512(dcv)) break;
+	}
+      if (! cv || dd_done_512(dcv)) break;
+    }
+  /* now MD init */
+  tp  = om->tfv_512 + 7*Q - 3;	      /* <*tp> now the last Mk->Dk+1 vector */
+  dcv = leftshiftz_ps_512(DMO(dpc,0));
+  for (q = Q-1; q >= 0; q--)
+    {
+      MMO(dpc,q) = _mm512_add_ps(MMO(dpc,q), _mm512_mul_ps(dcv, *tp)); tp -= 7;
+      dcv        = DMO(dpc,q);
+    }
+
+  /* Sparse rescaling: same scale factors as fwd matrix */
+  if (fwd->xmx[L*p7X_NXCELLS+p7X_SCALE] > 1.0)
+    {
+      xE  = xE / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xN  = xN / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xC  = xC / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xJ  = xJ / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xB  = xB / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xEv = _mm512_set1_ps(1.0 / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+      for (q = 0; q < Q; q++) {
+	MMO(dpc,q) = _mm512_mul_ps(MMO(dpc,q), xEv);
+	DMO(dpc,q) = _mm512_mul_ps(DMO(dpc,q), xEv);
+	IMO(dpc,q) = _mm512_mul_ps(IMO(dpc,q), xEv);
+      }
+    }
+  bck->xmx[L*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+  bck->totscale                     = log(bck->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+
+  bck->xmx[L*p7X_NXCELLS+p7X_E] = xE;
+  bck->xmx[L*p7X_NXCELLS+p7X_N] = xN;
+  bck->xmx[L*p7X_NXCELLS+p7X_J] = xJ;
+  bck->xmx[L*p7X_NXCELLS+p7X_B] = xB;
+  bck->xmx[L*p7X_NXCELLS+p7X_C] = xC;
+
+  /* main recursion */
+  for (i = L-1; i >= 1; i--)	/* backwards stride */
+    {
+      /* phase 1. B(i) collected. Old row destroyed, new row contains
+       *    complete I(i,k), partial {MD}(i,k) w/ no {MD}->{DE} paths yet.
+       */
+      rp  = om->rfv_512[dsq[i+1]] + Q-1; /* <*rp> is now the last match emission vector */
+      tp  = om->tfv_512 + 7*Q - 1;	 /* <*tp> is now the last TII transition vector  */
+
+      /* leftshift the first transition vectors */
+      tmmv = leftshiftz_ps_512(om->tfv_512[1]);
+      timv = leftshiftz_ps_512(om->tfv_512[2]);
+      tdmv = leftshiftz_ps_512(om->tfv_512[3]);
+
+      mpv = leftshiftz_ps_512(_mm512_mul_ps(MMO(dpp,0), om->rfv_512[dsq[i+1]][0])); /* precalc M(i+1,k+1) * e(M_k+1, x_{i+1}) */
+
+      xBv = zerov;
+      for (q = Q-1; q >= 0; q--)     /* backwards stride */
+	{
+	  ipv = IMO(dpp,q); /* assumes emission odds ratio of 1.0; i+1's IMO(q) now free */
+	  IMO(dpc,q) = _mm512_add_ps(_mm512_mul_ps(ipv, *tp), _mm512_mul_ps(mpv, timv));   tp--;
+	  DMO(dpc,q) =                                        _mm512_mul_ps(mpv, tdmv);
+	  mcv        = _mm512_add_ps(_mm512_mul_ps(ipv, *tp), _mm512_mul_ps(mpv, tmmv));   tp-= 2;
+
+	  mpv        = _mm512_mul_ps(MMO(dpp,q), *rp);  rp--;  /* obtain mpv for next q. i+1's MMO(q) is freed  */
+	  MMO(dpc,q) = mcv;
+
+	  tdmv = *tp;   tp--;
+	  timv = *tp;   tp--;
+	  tmmv = *tp;   tp--;
+
+	  xBv = _mm512_add_ps(xBv, _mm512_mul_ps(mpv, *tp)); tp--;
+	}
+
+      /* phase 2: now that we have accumulated the B->Mk transitions in xBv, we can do the specials */
+      xB = _mm512_reduce_add_ps(xBv);
+
+      xC =  xC * om->xf[p7O_C][p7O_LOOP];
+      xJ = (xB * om->xf[p7O_J][p7O_MOVE]) + (xJ * om->xf[p7O_J][p7O_LOOP]); /* must come after xB */
+      xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]); /* must come after xB */
+      xE = (xC * om->xf[p7O_E][p7O_MOVE]) + (xJ * om->xf[p7O_E][p7O_LOOP]); /* must come after xJ, xC */
+      xEv = _mm512_set1_ps(xE);	/* splat */
+
+      /* phase 3: {MD}->E paths and one step of the D->D paths */
+      tp  = om->tfv_512 + 8*Q - 1;	/* <*tp> now the last TDD vector */
+      dpv = leftshiftz_ps_512(_mm512_add_ps(DMO(dpc,0), xEv));
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv        = _mm512_mul_ps(dpv, *tp); tp--;
+	  DMO(dpc,q) = _mm512_add_ps(DMO(dpc,q), _mm512_add_ps(dcv, xEv));
+	  dpv        = DMO(dpc,q);
+	  MMO(dpc,q) = _mm512_add_ps(MMO(dpc,q), xEv);
+	}
+
+      /* phase 4: finish extending the DD paths, until they no longer change any DMO(q) */
+      for (j = 1; j < 16; j++)
+	{
+	  dcv = leftshiftz_ps_512(dcv);
+	  tp  = om->tfv_512 + 8*Q - 1;
+	  cv  = 0;
+	  for (q = Q-1; q >= 0; q--)
+	    {
+	      dcv        = _mm512_mul_ps(dcv, *tp); tp--;
+	      sv         = _mm512_add_ps(DMO(dpc,q), dcv);
+	      cv        |= _mm512_cmp_ps_mask(sv, DMO(dpc,q), _CMP_GT_OQ);
+	      DMO(dpc,q) = sv;
+	      if (dd_done_512(dcv)) break;
+	    }
+	  if (! cv || dd_done_512(dcv)) break;
+	}
+
+      /* phase 5: add M->D paths */
+      dcv = leftshiftz_ps_512(DMO(dpc,0));
+      tp  = om->tfv_512 + 7*Q - 3;	/* <*tp> is now the last Mk->Dk+1 vector */
+      for (q = Q-1; q >= 0; q--)
+	{
+	  MMO(dpc,q) = _mm512_add_ps(MMO(dpc,q), _mm512_mul_ps(dcv, *tp)); tp -= 7;
+	  dcv        = DMO(dpc,q);
+	}
+
+      /* Sparse rescaling; switch to own scale factors on the fly if <fwd>'s
+       * are insufficient [J3/119], as the SSE version does.
+       */
+      if (xB > 1.0e16) bck->has_own_scales = TRUE;
+
+      if      (bck->has_own_scales)  bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = (xB > 1.0e4) ? xB : 1.0;
+      else                           bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+
+      if (bck->xmx[i*p7X_NXCELLS+p7X_SCALE] > 1.0)
+	{
+	  xE /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xN /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xJ /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xB /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xC /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xBv = _mm512_set1_ps(1.0 / bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	  for (q = 0; q < Q; q++) {
+	    MMO(dpc,q) = _mm512_mul_ps(MMO(dpc,q), xBv);
+	    DMO(dpc,q) = _mm512_mul_ps(DMO(dpc,q), xBv);
+	    IMO(dpc,q) = _mm512_mul_ps(IMO(dpc,q), xBv);
+	  }
+	  bck->totscale += log(bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	}
+
+      bck->xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      bck->xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      bck->xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      bck->xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      bck->xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    } /* thus ends the loop over sequence positions i */
+
+  /* Termination at i=0, where we can only reach N,B states. */
+  tp  = om->tfv_512;          /* <*tp> is now the first TBMk transition vector */
+  rp  = om->rfv_512[dsq[1]];  /* <*rp> is now the first match emission vector  */
+  xBv = zerov;
+  for (q = 0; q < Q; q++)
+    {
+      mpv = _mm512_mul_ps(MMO(dpp,q), *rp);  rp++;
+      mpv = _mm512_mul_ps(mpv,        *tp);  tp += 7;
+      xBv = _mm512_add_ps(xBv,        mpv);
+    }
+  xB = _mm512_reduce_add_ps(xBv);
+
+  xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]);
+
+  bck->xmx[p7X_B]     = xB;
+  bck->xmx[p7X_C]     = 0.0;
+  bck->xmx[p7X_J]     = 0.0;
+  bck->xmx[p7X_N]     = xN;
+  bck->xmx[p7X_E]     = 0.0;
+  bck->xmx[p7X_SCALE] = 1.0;
+
+  if       (isnan(xN))        ESL_EXCEPTION(eslERANGE, "backward score is NaN");
+  else if  (L>0 && xN == 0.0) ESL_EXCEPTION(eslERANGE, "backward score underflow (is 0.0)");
+  else if  (isinf(xN) == 1)   ESL_EXCEPTION(eslERANGE, "backward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = bck->totscale + log(xN);
+  return eslOK;
+}
+/*------------- end, Forward/Backward parsers -------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#ifdef p7FWDBACK_AVX512_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* Compare AVX-512 parser scores to the SSE ones, for a random model
+ * of length <M> and <N> random sequences of length <L>. Forward and
+ * Backward must also agree with each other.
+ */
+static void
+utest_fwdback_avx512(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "fwdback_avx512 unit test failed";
+  P7_HMM      *hmm  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  ESL_DSQ     *dsq  = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *fwd1 = p7_omx_Create(M, 0, L);
+  P7_OMX      *bck1 = p7_omx_Create(M, 0, L);
+  P7_OMX      *fwd2 = p7_omx_Create(M, 0, L);
+  P7_OMX      *bck2 = p7_omx_Create(M, 0, L);
+  float        fsc1, fsc2;
+  float        bsc1, bsc2;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      p7_ForwardParser_sse     (dsq, L, om, fwd1,       &fsc1);
+      p7_BackwardParser_sse    (dsq, L, om, fwd1, bck1, &bsc1);
+      p7_ForwardParser_avx512  (dsq, L, om, fwd2,       &fsc2);
+      p7_BackwardParser_avx512 (dsq, L, om, fwd2, bck2, &bsc2);
+
+      if (fabs(fsc1-fsc2) > 0.0001) esl_fatal("%s: forward scores differ (%f, %f)",  msg, fsc1, fsc2);
+      if (fabs(bsc1-bsc2) > 0.0001) esl_fatal("%s: backward scores differ (%f, %f)", msg, bsc1, bsc2);
+      if (fabs(fsc2-bsc2) > 0.0001) esl_fatal("%s: fwd/bck scores differ (%f, %f)",  msg, fsc2, bsc2);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(fwd1);
+  p7_omx_Destroy(bck1);
+  p7_omx_Destroy(fwd2);
+  p7_omx_Destroy(bck2);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7FWDBACK_AVX512_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7FWDBACK_AVX512_TESTDRIVE
+/*
+   gcc -g -Wall -msse2 -mavx512f -mavx512bw -std=gnu99 -o fwdback_avx512_utest -I.. -L.. -I../../easel -L../../easel -Dp7FWDBACK_AVX512_TESTDRIVE fwdback_avx512.c -lhmmer -leasel -lm
+   ./fwdback_avx512_utest
+ */
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the AVX-512 Forward/Backward parser implementations";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  if (! __builtin_cpu_supports("avx512f") || ! __builtin_cpu_supports("avx512bw"))
+    {
+      if (esl_opt_GetBoolean(go, "-v")) printf("host has no AVX-512BW; test skipped\n");
+      esl_getopts_Destroy(go);
+      esl_randomness_Destroy(r);
+      return eslOK;
+    }
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("{Forward,Backward}Parser_avx512() tests, DNA\n");
+  utest_fwdback_avx512(r, abc, bg, M,  L, N);   /* normal sized models */
+  utest_fwdback_avx512(r, abc, bg, 1,  L, 10);  /* size 1 models       */
+  utest_fwdback_avx512(r, abc, bg, M,  1, 10);  /* size 1 sequences    */
+  utest_fwdback_avx512(r, abc, bg, 17, L, 10);  /* just over one 16-way segment */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("{Forward,Backward}Parser_avx512() tests, protein\n");
+  utest_fwdback_avx512(r, abc, bg, M,  L, N);
+  utest_fwdback_avx512(r, abc, bg, 1,  L, 10);
+  utest_fwdback_avx512(r, abc, bg, M,  1, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7FWDBACK_AVX512_TESTDRIVE*/
+
+
+#else /* ! HMMER_AVX512 */
+
+/* Provide a dummy symbol so this compilation unit isn't empty.  */
+void p7_fwdback_avx512_silence_hack(void) { return; }
+
+#endif /* HMMER_AVX512 or not */
@@ -16,6 +16,9 @@
 #ifdef __SSE3__
 #include <pmmintrin.h>   /* DENORMAL_MODE */
 #endif
+#if defined(HMMER_AVX2) || defined(HMMER_AVX512)
+#include <immintrin.h>   /* AVX2/AVX-512 types; their code is only built in *_avx.c, *_avx512.c */
+#endif
 #include "hmmer.h"
 
 /* In calculating Q, the number of vectors we need in a row, we have
@@ -27,6 +30,28 @@
 
 #define p7O_EXTRA_SB 17    /* see ssvfilter.c for explanation */
 
+#ifdef HMMER_AVX2
+#define p7O_NQB_AVX(M) ( ESL_MAX(2, ((((M)-1) / 32) + 1)))   /* 32 uchars, AVX2 MSV/SSV */
+#endif
+
+/* Models up to this length get the inter-sequence SSV filter (one
+ * target per lane, p7_SSVFilter_multi()) in p7_Pipeline_Block(). Past
+ * it, the striped filters are faster: the per-lane score lookups cost
+ * more per cell than the striped inner loop, which only loses on
+ * models so short that most of its vectors are padding.
+ */
+#define p7_SSVMULTI_MAXM 20
+
+/* Blocks of at least this many targets go to the GPU batch SSV
+ * filter, when there is one (p7_impl_HaveGPU()), whatever the model
+ * length. Smaller blocks don't pay for the copies to the device.
+ */
+#define p7_GPU_MINBATCH 256
+#ifdef HMMER_AVX512
+#define p7O_NQW_512(M) ( ESL_MAX(2, ((((M)-1) / 32) + 1)))   /* 32 words,  AVX-512 Viterbi      */
+#define p7O_NQF_512(M) ( ESL_MAX(2, ((((M)-1) / 16) + 1)))   /* 16 floats, AVX-512 Fwd/Bck      */
+#endif
+
 
 /*****************************************************************
  * 1. P7_OPROFILE: an optimized score profile
@@ -104,6 +129,29 @@ typedef struct p7_oprofile_s {
   __m128i  *twv_mem;
   __m128   *tfv_mem;
   __m128   *rfv_mem;
+
+#ifdef HMMER_AVX2
+  /* MSV,SSV scores restriped for 32x unsigned byte AVX2 vectors, derived from rbv     */
+  __m256i **rbv_avx;     /* match scores [x][q], Q = p7O_NQB_AVX(M)           */
+  __m256i **sbv_avx;     /* match scores for ssvfilter, +p7O_EXTRA_SB         */
+  __m256i  *rbv_avx_mem;
+  __m256i  *sbv_avx_mem;
+  int       allocQ32;    /* p7O_NQB_AVX(allocM): alloc size for rbv_avx       */
+#endif
+
+#ifdef HMMER_AVX512
+  /* ViterbiFilter, Fwd/Bck parser scores restriped for AVX-512, derived from rwv..tfv  */
+  __m512i **rwv_512;     /* [x][q]  32x int16, Q = p7O_NQW_512(M)             */
+  __m512i  *twv_512;     /* transition blocks [8*Q], same order as twv        */
+  __m512  **rfv_512;     /* [x][q]  16x float, Q = p7O_NQF_512(M)             */
+  __m512   *tfv_512;     /* transition blocks [8*Q], same order as tfv        */
+  __m512i  *rwv_512_mem;
+  __m512i  *twv_512_mem;
+  __m512   *rfv_512_mem;
+  __m512   *tfv_512_mem;
+  int       allocQ32w;   /* p7O_NQW_512(allocM): alloc size for rwv_512, twv_512 */
+  int       allocQ16f;   /* p7O_NQF_512(allocM): alloc size for rfv_512, tfv_512 */
+#endif
   
   /* Disk offset information for hmmpfam's fast model retrieval                      */
   off_t  offs[p7_NOFFSETS];     /* p7_{MFP}OFFSET, or -1                             */
@@ -203,6 +251,13 @@ typedef struct p7_omx_s {
   float     totscale;    /* log of the product of all scale factors (0.0 if unscaled)   */
   int       has_own_scales;  /* TRUE to use own scale factors; FALSE if scales provided     */
 
+#ifdef HMMER_AVX512
+  /* One row for the AVX-512 ViterbiFilter() and {Forward,Backward}Parser()                    */
+  __m512   *dp512;            /* row [0..Q-1][MDI], Q = p7O_NQF_512(M); 64-byte aligned      */
+  void     *dp512_mem;        /* memory for <dp512>, before alignment                        */
+  int       allocQ512;        /* current row width in <dp512> 16-mers: allocQ512*16 >= M     */
+#endif
+
   /* Parsers,scorers only hold a row at a time, so to get them to dump full matrix, it
    * must be done during a DP calculation, after each row is calculated 
    */
@@ -250,8 +305,97 @@ p7_omx_FSetMDI(const P7_OMX *ox, int s, int i, int k, float val)
 
 
 
+/* P7_OMXCHK: checkpointed matrices for domain postprocessing.
+ *
+ * Posterior decoding and optimal accuracy alignment of a long domain
+ * envelope need full O(ML) Forward and Backward matrices. P7_OMXCHK
+ * does the same calculations in O(M sqrt(L)) memory, at the cost of
+ * recomputing rows. Rows 1..L are divided into segments of <K> rows;
+ * segment s holds rows s*K+1..min(L,(s+1)*K). Each of the four
+ * matrices keeps checkpointed rows plus one segment's worth of
+ * working rows, and its <dpf[0..L]> row pointers map logical rows
+ * onto those physical rows, so the usual DP routines run on it
+ * unchanged:
+ *
+ *    fwd:  rows s*K       kept; segment materialized by recomputing forward from row s*K
+ *    bck:  rows s*K+1     kept; segment materialized by recomputing backward from row (s+1)*K+1
+ *    pp:   nothing kept;  segment decoded from fwd,bck segments
+ *    oa:   rows s*K       kept; segment recomputed from row s*K and the pp segment
+ *
+ * Special states (xmx) are kept for all rows, as in a full P7_OMX.
+ * K is about sqrt(3L/4), which minimizes the total rows.
+ *
+ * A set made by p7_omxchk_CreateBF16() trades memory for time the
+ * other way: instead of recomputing Forward and Backward segments, it
+ * keeps every row of both, in bfloat16 (the top 16 bits of each
+ * float), and materializes a segment by widening its rows back to
+ * float. Forward and Backward are still calculated in float, with the
+ * usual sparse rescaling, so scores are unchanged; only the values
+ * that posterior decoding reads are rounded, to a relative error of
+ * at most 2^-9. This stores the two matrices in half the memory of
+ * full float ones, without the recomputation.
+ *
+ * The row pointer maps are only valid for the <L> the layout was set
+ * for, so these matrices must not be passed to p7_omx_GrowTo().
+ */
+typedef struct p7_omxchk_s {
+  int      M;		/* current model dimension                                          */
+  int      L;		/* current sequence dimension                                       */
+  int      K;		/* segment width, in rows (>= 2)                                    */
+  int      nseg;	/* number of segments covering 1..L                                 */
+
+  P7_OMX  *fwd;		/* checkpointed Forward                                             */
+  P7_OMX  *bck;		/* checkpointed Backward                                            */
+  P7_OMX  *pp;		/* one segment of posterior probabilities; row 0 for null2 counts   */
+  P7_OMX  *oa;		/* checkpointed optimal accuracy scores                             */
+
+  int      fwd_seg;	/* which segment's rows are currently materialized, or -1           */
+  int      bck_seg;
+  int      pp_seg;
+  int      oa_seg;
+
+  float   *segscale;	/* decoding scale factor at the first row of each segment [0..nseg-1] */
+  int      allocM;	/* current allocation, in model positions                            */
+  int      allocL;	/* current allocation, in residues                                   */
+  int      allocS;	/* current allocation of <segscale>                                  */
+
+  int      do_bf16;	/* TRUE: fwd, bck rows are all kept in <fh>, <bh> (bfloat16), not recomputed */
+  uint16_t *fh;		/* bfloat16 Forward rows 0..L, each p7X_NSCELLS*4*Q values in <dpf> order  */
+  uint16_t *bh;		/* bfloat16 Backward rows 0..L, same layout                                */
+  int64_t  allocH;	/* current allocation of <fh>, <bh>, in values each                         */
+} P7_OMXCHK;
+
+
+
 /*****************************************************************
- * 3. Declarations of the external API.
+ * 3. P7_KERNELS: the filters chosen at runtime
+ *****************************************************************/
+
+/* The filter and parser kernels that have more than one vector
+ * implementation (SSE2, and optionally AVX2 and AVX-512 kernels
+ * compiled alongside it) are called through a table of function
+ * pointers. p7_impl_Kernels() picks the table once, from what the
+ * running host supports, so a single x86 binary uses the widest
+ * kernels available wherever it runs. p7_MSVFilter() and the other
+ * public names are thin calls through it (kernels.c). Each wider
+ * kernel keeps its own restriped scores inside P7_OPROFILE
+ * (<rbv_avx> etc.), so the profile needs no other layout parameter.
+ */
+typedef struct p7_kernels_s {
+  const char *isa;   /* widest instruction set in use: "sse", "avx2", "avx512" */
+  int (*msv)      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+  int (*ssv)      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+  int (*ssv_multi)(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE);
+  int (*vit)      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+  int (*fwdparser)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+  int (*bckparser)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+  int (*msv_bounded)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc); /* or NULL: use <msv> */
+  int (*vit_bounded)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc); /* or NULL: use <vit> */
+} P7_KERNELS;
+
+
+/*****************************************************************
+ * 4. Declarations of the external API.
  *****************************************************************/
 
 /* p7_omx.c */
@@ -259,6 +403,7 @@ extern P7_OMX      *p7_omx_Create(int allocM, int allocL, int allocXL);
 extern int          p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL);
 extern int          p7_omx_FDeconvert(P7_OMX *ox, P7_GMX *gx);
 extern int          p7_omx_Reuse  (P7_OMX *ox);
+extern size_t       p7_omx_Sizeof (const P7_OMX *ox);
 extern void         p7_omx_Destroy(P7_OMX *ox);
 
 extern int          p7_omx_SetDumpMode(FILE *fp, P7_OMX *ox, int truefalse);
@@ -266,6 +411,13 @@ extern int          p7_omx_DumpMFRow(P7_OMX *ox, int rowi, uint8_t xE, uint8_t x
 extern int          p7_omx_DumpVFRow(P7_OMX *ox, int rowi, int16_t xE, int16_t xN, int16_t xJ, int16_t xB, int16_t xC);
 extern int          p7_omx_DumpFBRow(P7_OMX *ox, int logify, int rowi, int width, int precision, float xE, float xN, float xJ, float xB, float xC);
 
+extern P7_OMXCHK   *p7_omxchk_Create (int M, int L);
+extern P7_OMXCHK   *p7_omxchk_CreateBF16(int M, int L);
+extern int          p7_omxchk_GrowTo (P7_OMXCHK *ock, int M, int L);
+extern size_t       p7_omxchk_Sizeof (const P7_OMXCHK *ock);
+extern size_t       p7_omx_SizeofFull(int M, int L);
+extern void         p7_omxchk_Destroy(P7_OMXCHK *ock);
+
 
 
 /* p7_oprofile.c */
@@ -273,17 +425,27 @@ extern P7_OPROFILE *p7_oprofile_Create(int M, const ESL_ALPHABET *abc);
 extern int          p7_oprofile_IsLocal(const P7_OPROFILE *om);
 extern void         p7_oprofile_Destroy(P7_OPROFILE *om);
 extern size_t       p7_oprofile_Sizeof(P7_OPROFILE *om);
+extern void         p7_oprofile_FreeRest(P7_OPROFILE *om);
+extern int          p7_oprofile_AllocRest(P7_OPROFILE *om);
 extern P7_OPROFILE *p7_oprofile_Copy(P7_OPROFILE *om);
 extern P7_OPROFILE *p7_oprofile_Clone(const P7_OPROFILE *om);
 extern int          p7_oprofile_UpdateFwdEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emissions, float *sc_arr);
 extern int          p7_oprofile_UpdateVitEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emissions, float *sc_arr);
 extern int          p7_oprofile_UpdateMSVEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emissions, float *sc_arr);
+#ifdef HMMER_AVX2
+extern int          p7_oprofile_ConvertAVX(P7_OPROFILE *om);
+#endif
+#ifdef HMMER_AVX512
+extern int          p7_oprofile_Convert512(P7_OPROFILE *om);
+#endif
 
 
 extern int          p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om);
 extern int          p7_oprofile_ReconfigLength    (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigMSVLength (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigRestLength(P7_OPROFILE *om, int L);
+extern int          p7_oprofile_SetMSVLength      (P7_OPROFILE *om, const P7_LENPARAM *lp);
+extern int          p7_oprofile_SetRestLength     (P7_OPROFILE *om, const P7_LENPARAM *lp);
 extern int          p7_oprofile_ReconfigMultihit  (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigUnihit    (P7_OPROFILE *om, int L);
 
@@ -302,12 +464,24 @@ extern int          p7_oprofile_GetFwdEmissionArray(const P7_OPROFILE *om, P7_BG
 /* decoding.c */
 extern int p7_Decoding      (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp);
 extern int p7_DomainDecoding(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_DOMAINDEF *ddef);
+extern int p7_DecodingCheckpointed(const P7_OPROFILE *om, P7_OMXCHK *ock);
+extern int p7_DecodingSegment     (const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int s);
+
+/* fwdback_avx512.c */
+#ifdef HMMER_AVX512
+extern int p7_ForwardParser_avx512 (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_BackwardParser_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+#endif
 
 /* fwdback.c */
 extern int p7_Forward       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
-extern int p7_ForwardParser (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_ForwardParser_sse (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
 extern int p7_Backward      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
-extern int p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_BackwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_ForwardCheckpointed (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *ock, float *opt_sc);
+extern int p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *ock, float *opt_sc);
+extern int p7_ForwardSegment      (const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int s);
+extern int p7_BackwardSegment     (const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int s);
 
 /* io.c */
 extern int p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om);
@@ -320,37 +494,82 @@ extern int p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset);
 extern P7_OM_BLOCK *p7_oprofile_CreateBlock(int size);
 extern void p7_oprofile_DestroyBlock(P7_OM_BLOCK *block);
 
+/* kernels.c */
+extern const P7_KERNELS *p7_impl_Kernels(void);
+extern const P7_KERNELS *p7_impl_KernelTable(int i, const char **opt_name);
+extern int p7_MSVFilter      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_SSVFilter      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_multi(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE);
+extern int p7_ViterbiFilter  (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_MSVFilter_bounded    (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc);
+extern int p7_ViterbiFilter_bounded(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc);
+extern int p7_ForwardParser  (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_BackwardParser (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+
 /* ssvfilter.c */
-extern int p7_SSVFilter    (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_sse  (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_Score(uint8_t xE, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_multi_sse(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE);
 
 /* msvfilter.c */
-extern int p7_MSVFilter           (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_MSVFilter_sse       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_MSVFilter_bounded_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc);
 extern int p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist);
+extern int p7_SSVFilter_longtarget_dual(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P,
+                                        P7_HMM_WINDOWLIST *windowlist, P7_HMM_WINDOWLIST *rc_windowlist);
+
+/* msvfilter_avx.c */
+#ifdef HMMER_AVX2
+extern int p7_MSVFilter_avx(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_SSVFilter_avx(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_multi_avx(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE);
+extern int p7_SSVFilter_dnascan_avx(const ESL_DSQ *p, int step, int M, const __m128i *tab, uint8_t xB, uint8_t bias, uint8_t sc_thresh);
+#endif
+
+/* ssvfilter_gpu.c */
+extern int  p7_impl_HaveGPU(void);
+extern void p7_impl_DisableGPU(void);
+#ifdef HMMER_CUDA
+extern int p7_SSVFilter_multi_gpu(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE);
+#endif
 
 
 /* null2.c */
 extern int p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
+extern int p7_Null2_ByExpectationCheckpointed(const P7_OPROFILE *om, P7_OMXCHK *ock, float *null2);
 extern int p7_Null2_ByTrace      (const P7_OPROFILE *om, const P7_TRACE *tr, int zstart, int zend, P7_OMX *wrk, float *null2);
 
 /* optacc.c */
 extern int p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp,       P7_OMX *ox, float *ret_e);
 extern int p7_OATrace        (const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *tr);
+extern int p7_OptimalAccuracyCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, float *ret_e);
+extern int p7_OATraceCheckpointed        (const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, P7_TRACE *tr);
 
 /* stotrace.c */
 extern int p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox, P7_TRACE *tr);
 
+/* vittrace.c */
+extern int p7_ViterbiFull(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc);
+extern int p7_VTrace     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox, P7_TRACE *tr);
+
 /* vitfilter.c */
-extern int p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ViterbiFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ViterbiFilter_bounded_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc);
 extern int p7_ViterbiFilter_longtarget(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
                                         float filtersc, double P, P7_HMM_WINDOWLIST *windowlist);
 
 
+/* vitfilter_avx512.c */
+#ifdef HMMER_AVX512
+extern int p7_ViterbiFilter_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+#endif
+
 /* vitscore.c */
 extern int p7_ViterbiScore (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 
 
 /*****************************************************************
- * 4. Implementation specific initialization
+ * 5. Implementation specific initialization
  *****************************************************************/
 static inline void
 impl_Init(void)
@@ -373,6 +592,44 @@ impl_Init(void)
   _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
 #endif
 }
+
+/* impl_HaveAVX2()
+ * TRUE if the AVX2 MSV/SSV filters were compiled in and the running
+ * processor (and OS) supports them. The kernel selection in kernels.c,
+ * and the FM-index occurrence counts (fm_sse.c), use
+ * this to dispatch at runtime, so a single binary
+ * runs on both SSE-only and AVX2 hosts. To compare the two, call the
+ * *_sse() and *_avx() kernels directly.
+ */
+static inline int
+impl_HaveAVX2(void)
+{
+#ifdef HMMER_AVX2
+  static int have_avx2 = -1;   /* -1 = not yet determined. Benign race: all threads compute the same answer. */
+  if (have_avx2 == -1)
+    have_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  return have_avx2;
+#else
+  return 0;
+#endif
+}
+
+/* impl_HaveAVX512()
+ * Same, for the AVX-512 (F+BW) Viterbi filter and Forward/Backward
+ * parsers.
+ */
+static inline int
+impl_HaveAVX512(void)
+{
+#ifdef HMMER_AVX512
+  static int have_avx512 = -1;
+  if (have_avx512 == -1)
+    have_avx512 = (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) ? 1 : 0;
+  return have_avx512;
+#else
+  return 0;
+#endif
+}
 #endif /* P7_IMPL_SSE_INCLUDED */
 
 
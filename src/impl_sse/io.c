@@ -9,6 +9,14 @@
  * By convention, hmmpress calls the two files <hmmfile>.h3f and
  * <hmmfile>.h3p, which nominally stand for "H3 filter" and "H3
  * profile".
+ *
+ * Since format 3/g, every block of score vectors in both files starts
+ * at a file offset that's a multiple of p7O_FILEALIGN, with zero
+ * padding in front of it. When p7_hmmfile_Open() has been able to
+ * mmap() the two files, the readers point the profile's score vectors
+ * directly into the mapping instead of copying them, so loading a
+ * database costs little more than the page faults, and concurrent
+ * processes share the same physical pages.
  * 
  * Contents:
  *    1. Writing optimized profiles to two files.
@@ -24,6 +32,11 @@
  *    - Write() could save a tag (model #) instead of name for verifying
  *      that MSV and Rest parts match, saving a malloc for var-lengthed name
  *      in ReadRest().
+ *    - The pressed files hold only the P7_OPROFILE. Nothing that loads
+ *      them configures a P7_PROFILE; nhmmscan's P7_SCOREDATA is a
+ *      restriping of <rbv> plus, for models that pass SSV, arrays
+ *      derived from <tfv>/<rfv>. Saving those too would need a 3/h
+ *      format and matching NEON/VMX readers, for little CPU saved.
  */
 #include <p7_config.h>
 
@@ -43,6 +56,9 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
+static uint32_t  v3g_fmagic = 0xb3e7e6f3; /* 3/g binary MSV file, SSE:     "3gfs" = 0x 33 67 66 73  + 0x80808080 */
+static uint32_t  v3g_pmagic = 0xb3e7f0f3; /* 3/g binary profile file, SSE: "3gps" = 0x 33 67 70 73  + 0x80808080 */
+
 static uint32_t  v3f_fmagic = 0xb3e6e6f3; /* 3/f binary MSV file, SSE:     "3ffs" = 0x 33 66 66 73  + 0x80808080 */
 static uint32_t  v3f_pmagic = 0xb3e6f0f3; /* 3/f binary profile file, SSE: "3fps" = 0x 33 66 70 73  + 0x80808080 */
 
@@ -61,6 +77,28 @@ static uint32_t  v3b_pmagic = 0xb3e2f0f3; /* 3/b binary profile file, SSE: "3bps
 static uint32_t  v3a_fmagic = 0xe8b3e6f3; /* 3/a binary MSV file, SSE:     "h3fs" = 0x 68 33 66 73  + 0x80808080 */
 static uint32_t  v3a_pmagic = 0xe8b3f0f3; /* 3/a binary profile file, SSE: "h3ps" = 0x 68 33 70 73  + 0x80808080 */
 
+#define p7O_FILEALIGN 64	/* score vector blocks start at multiples of this file offset (3/g) */
+
+static int   write_padding(FILE *fp);
+static int   skip_padding(FILE *fp);
+static off_t padded_offset(off_t offset);
+static void *map_vectors(FILE *fp, char *map, off_t mapsize, size_t nbytes);
+
+/* RR_CURSOR: where p7_oprofile_ReadRest() is in the <.h3p> file:
+ * either the stdio stream itself, or its own offset into the file's
+ * mapping, so that threads share no read state.
+ */
+typedef struct {
+  FILE  *fp;       /* stream to read, or NULL to read the mapping      */
+  char  *map;      /* mapped .h3p file                                  */
+  off_t  mapsize;  /* size of <map>, bytes                              */
+  off_t  pos;      /* current offset in <map> (when <fp> is NULL)       */
+} RR_CURSOR;
+
+static size_t rr_read(RR_CURSOR *rd, void *dst, size_t size, size_t n);
+static int    rr_skip_padding(RR_CURSOR *rd);
+static void  *rr_map_vectors(RR_CURSOR *rd, size_t nbytes);
+
 
 /*****************************************************************
  *# 1. Writing optimized profiles to two files.
@@ -94,7 +132,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   int x;
 
   /* <ffp> is the part of the oprofile that MSVFilter() needs */
-  if (fwrite((char *) &(v3f_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (fwrite((char *) &(v3g_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->M),         sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->abc->type), sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &n,               sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -106,6 +144,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->scale_b),   sizeof(float),    1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
   if (fwrite((char *) &(om->base_b),    sizeof(uint8_t),  1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
   if (fwrite((char *) &(om->bias_b),    sizeof(uint8_t),  1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
+  if (write_padding(ffp)                                                      != eslOK)       ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
 
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->sbv[x],    sizeof(__m128i),  Q16x,        ffp) != Q16x)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -116,10 +155,10 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) om->evparam,      sizeof(float),    p7_NEVPARAM, ffp) != p7_NEVPARAM) ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->offs,         sizeof(off_t),    p7_NOFFSETS, ffp) != p7_NOFFSETS) ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->compo,        sizeof(float),    p7_MAXABET,  ffp) != p7_MAXABET)  ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
-  if (fwrite((char *) &(v3f_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
+  if (fwrite((char *) &(v3g_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
 
   /* <pfp> gets the rest of the oprofile */
-  if (fwrite((char *) &(v3f_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (fwrite((char *) &(v3g_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->M),         sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->abc->type), sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &n,               sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -149,6 +188,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) om->consensus,    sizeof(char),     om->M+2,     pfp) != om->M+2)     ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
 
   /* ViterbiFilter part */
+  if (write_padding(pfp)                                                         != eslOK)       ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->twv,             sizeof(__m128i),  8*Q8,        pfp) != 8*Q8)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->rwv[x],       sizeof(__m128i),  Q8,          pfp) != Q8)          ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -160,6 +200,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->ncj_roundoff), sizeof(float),    1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
 
   /* Forward/Backward part */
+  if (write_padding(pfp)                                                      != eslOK)       ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->tfv,          sizeof(__m128),   8*Q4,        pfp) != 8*Q4)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->rfv[x],    sizeof(__m128),   Q4,          pfp) != Q4)          ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -170,7 +211,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->nj),        sizeof(float),    1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->mode),      sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->L)   ,      sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
-  if (fwrite((char *) &(v3f_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
+  if (fwrite((char *) &(v3g_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
   return eslOK;
 }
 /*---------------- end, writing oprofile ------------------------*/
@@ -203,6 +244,11 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
  *            when the HMM file was opened with <p7_hmmfile_Open()>.
  *            
  *            When no more HMMs remain in the file, return <eslEOF>.
+ *            
+ *            If <p7_hmmfile_Open()> mapped the <.h3f> file in memory,
+ *            the MSV and SSV scores of <*ret_om> point into that
+ *            mapping rather than being copied, and <*ret_om> must be
+ *            destroyed before <hfp> is closed.
  *
  * Args:      hfp     - open HMM file, with associated .h3p file
  *            byp_abc - BYPASS: <*byp_abc == ESL_ALPHABET *> if known; 
@@ -232,6 +278,7 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
 {
   P7_OPROFILE  *om = NULL;
   ESL_ALPHABET *abc = NULL;
+  __m128i      *vp;
   uint32_t      magic;
   off_t         roff;
   int           M, Q16, Q16x;
@@ -252,7 +299,8 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if (magic == v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/f); please hmmpress your HMM file again");
+  if (magic != v3g_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
@@ -284,17 +332,34 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (! fread((char *) &(om->scale_b),   sizeof(float),   1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale");
   if (! fread((char *) &(om->base_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base");
   if (! fread((char *) &(om->bias_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read bias");
-  for (x = 0; x < abc->Kp; x++)
-    if (! fread((char *) om->sbv[x],     sizeof(__m128i), Q16x,        hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ssv scores at %d [residue %c]", x, abc->sym[x]); 
-  for (x = 0; x < abc->Kp; x++)
-    if (! fread((char *) om->rbv[x],     sizeof(__m128i), Q16,         hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read msv scores at %d [residue %c]", x, abc->sym[x]); 
+  if (skip_padding(hfp->ffp) != eslOK)                                            ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alignment padding");
+
+  if ((vp = map_vectors(hfp->ffp, hfp->ffp_map, hfp->ffp_mapsize, sizeof(__m128i) * abc->Kp * (Q16x + Q16))) != NULL)
+    { /* zero-copy: ssv and msv scores stay in the mapped .h3f */
+      free(om->sbv_mem);  om->sbv_mem = NULL;
+      free(om->rbv_mem);  om->rbv_mem = NULL;
+      for (x = 0; x < abc->Kp; x++) {
+	om->sbv[x] = vp + (x * Q16x);
+	om->rbv[x] = vp + (abc->Kp * Q16x) + (x * Q16);
+      }
+    }
+  else
+    {
+      for (x = 0; x < abc->Kp; x++)
+	if (! fread((char *) om->sbv[x], sizeof(__m128i), Q16x,        hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ssv scores at %d [residue %c]", x, abc->sym[x]); 
+      for (x = 0; x < abc->Kp; x++)
+	if (! fread((char *) om->rbv[x], sizeof(__m128i), Q16,         hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read msv scores at %d [residue %c]", x, abc->sym[x]); 
+    }
+#ifdef HMMER_AVX2
+  if (p7_oprofile_ConvertAVX(om) != eslOK)                                        ESL_XFAIL(eslEINVAL, hfp->errbuf, "failed to restripe msv scores for AVX2");
+#endif
   if (! fread((char *) om->evparam,      sizeof(float),   p7_NEVPARAM, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read stat params");
   if (! fread((char *) om->offs,         sizeof(off_t),   p7_NOFFSETS, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read hmmpfam offsets");
   if (! fread((char *) om->compo,        sizeof(float),   p7_MAXABET,  hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model composition");
 
   /* record ends with magic sentinel, for detecting binary file corruption */
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->ffp))  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3f file corrupted?");
-  if (magic != v3f_fmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
+  if (magic != v3g_fmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
 
   /* keep track of the ending offset of the MSV model */
   om->eoff = ftello(hfp->ffp) - 1;
@@ -373,7 +438,8 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
   if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
   if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if (magic == v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/f); please hmmpress your HMM file again");
+  if (magic != v3g_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
@@ -400,6 +466,7 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   roff += (sizeof(int) * 5);                      /* magic, model size, alphabet type, max length, name length */
   roff += (sizeof(char) * (n + 1));               /* name string and terminator '\0'                           */
   roff += (sizeof(float) + sizeof(uint8_t) * 5);  /* transition  costs, bias, scale and base                   */
+  roff  = padded_offset(roff);                    /* alignment padding                                         */
   roff += (sizeof(__m128i) * abc->Kp * Q16x);     /* ssv scores                                                */
   roff += (sizeof(__m128i) * abc->Kp * Q16);      /* msv scores                                                */
   roff += (sizeof(float) * p7_NEVPARAM);          /* stat params                                               */
@@ -470,11 +537,19 @@ p7_oprofile_ReadBlockMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OM_BLOCK *h
  *
  *            In thread-parallel hmmscan, the master is calling
  *            ReadMSV() and multiple workers are calling ReadRest().
- *            ReadRest() must be mutex-protected, and we must make
- *            sure that ReadMSV and ReadRest never touch the same
- *            data. ReadMSV only touches ffp (the MSV input data
- *            stream) and errbuf. We can't use the same errbuf
+ *            We must make sure that ReadMSV and ReadRest never touch
+ *            the same data. ReadMSV only touches ffp (the MSV input
+ *            data stream) and errbuf. We can't use the same errbuf
  *            in ReadRest; we work around by using hfp->rr_errbuf.
+ *
+ *            As in ReadMSV(), if the <.h3p> file is mapped in memory,
+ *            the Viterbi and Forward scores point into the mapping,
+ *            so <om> must be destroyed before <hfp> is closed. The
+ *            rest of the profile is then copied out of the mapping
+ *            at a private offset, so workers read concurrently. Only
+ *            when the <.h3p> has to be read through the stdio stream
+ *            <hfp->pfp> is ReadRest() serialized on <hfp->readMutex>
+ *            (if <p7_hmmfile_CreateLock()> was called).
  
  *
  * Args:      hfp - open HMM file, from which we've previously
@@ -498,107 +573,152 @@ int
 p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
 {
   uint32_t      magic;
+  void         *vp;
   int           M, Q4, Q8;
   int           x,n;
   char         *name = NULL;
   int           alphatype;
+  RR_CURSOR     rd;
+#ifdef HMMER_THREADS
+  int           locked = FALSE;	/* TRUE while we hold <hfp->readMutex> */
+#endif
+  char          errbuf[eslERRBUFSIZE];
   int           status;
 
-#ifdef HMMER_THREADS
-  /* lock the mutex to prevent other threads from reading from the optimized
-   * profile at the same time.
+  errbuf[0] = '\0';
+  rd.fp      = NULL;
+  rd.map     = hfp->pfp_map;
+  rd.mapsize = hfp->pfp_mapsize;
+  rd.pos     = om->offs[p7_POFFSET];
+  if (hfp->pfp == NULL) ESL_XFAIL(eslEFORMAT, errbuf, "no MSV profile file; hmmpress probably wasn't run");
+
+  /* A mapped .h3p is read through our own cursor <rd>, so threads
+   * can read different profiles at once. Otherwise, lock the mutex
+   * to prevent other threads from reading from the stream at the
+   * same time, and position it using the offset stored in <om>.
    */
-  if (hfp->syncRead)
+  if (rd.map == NULL)
     {
-      if (pthread_mutex_lock (&hfp->readMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
-    }
+#ifdef HMMER_THREADS
+      if (hfp->syncRead)
+	{
+	  if (pthread_mutex_lock (&hfp->readMutex) != 0) ESL_XEXCEPTION(eslESYS, "mutex lock failed");
+	  locked = TRUE;
+	}
 #endif
-
-  hfp->rr_errbuf[0] = '\0';
-  if (hfp->pfp == NULL) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "no MSV profile file; hmmpress probably wasn't run");
- 
-  /* Position the <hfp->pfp> using offset stored in <om> */
-  if (fseeko(hfp->pfp, om->offs[p7_POFFSET], SEEK_SET) != 0)                       ESL_EXCEPTION(eslESYS, "fseeko() failed");
+      rd.fp = hfp->pfp;
+      if (fseeko(rd.fp, om->offs[p7_POFFSET], SEEK_SET) != 0)                          ESL_XEXCEPTION(eslESYS, "fseeko() failed");
+    }
+  else if (rd.pos < 0 || rd.pos >= rd.mapsize)                                       ESL_XFAIL(eslEFORMAT, errbuf, "bad profile offset; .h3p file truncated?");
    
-  if (! fread( (char *) &magic,          sizeof(uint32_t), 1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read magic");
-  if (magic == v3a_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/a); please hmmpress your HMM file again");
-  if (magic == v3b_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/b); please hmmpress your HMM file again");
-  if (magic == v3c_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
-  if (magic == v3d_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
-  if (magic == v3e_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
-
-  if (! fread( (char *) &M,              sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read model size M");
-  if (! fread( (char *) &alphatype,      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read alphabet type");  
-  if (! fread( (char *) &n,              sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read name length");  
-  if (M         != om->M)                                                          ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f model length mismatch");
-  if (alphatype != om->abc->type)                                                  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f alphabet type mismatch");
+  if (! rr_read(&rd, (char *) &magic,          sizeof(uint32_t), 1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read magic");
+  if (magic == v3a_pmagic) ESL_XFAIL(eslEFORMAT, errbuf, "binary auxfiles are in an outdated HMMER format (3/a); please hmmpress your HMM file again");
+  if (magic == v3b_pmagic) ESL_XFAIL(eslEFORMAT, errbuf, "binary auxfiles are in an outdated HMMER format (3/b); please hmmpress your HMM file again");
+  if (magic == v3c_pmagic) ESL_XFAIL(eslEFORMAT, errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
+  if (magic == v3d_pmagic) ESL_XFAIL(eslEFORMAT, errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
+  if (magic == v3e_pmagic) ESL_XFAIL(eslEFORMAT, errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
+  if (magic == v3f_pmagic) ESL_XFAIL(eslEFORMAT, errbuf, "binary auxfiles are in an outdated HMMER format (3/f); please hmmpress your HMM file again");
+  if (magic != v3g_pmagic) ESL_XFAIL(eslEFORMAT, errbuf, "bad magic; not an HMM database file?");
+
+  if (! rr_read(&rd, (char *) &M,              sizeof(int),      1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read model size M");
+  if (! rr_read(&rd, (char *) &alphatype,      sizeof(int),      1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read alphabet type");  
+  if (! rr_read(&rd, (char *) &n,              sizeof(int),      1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read name length");  
+  if (M         != om->M)                                                          ESL_XFAIL(eslEFORMAT, errbuf, "p/f model length mismatch");
+  if (alphatype != om->abc->type)                                                  ESL_XFAIL(eslEFORMAT, errbuf, "p/f alphabet type mismatch");
 
   ESL_ALLOC(name, sizeof(char) * (n+1));
-  if (! fread( (char *) name,            sizeof(char),     n+1,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read name");  
-  if (strcmp(name, om->name) != 0)                                                 ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f name mismatch");  
+  if (! rr_read(&rd, (char *) name,            sizeof(char),     n+1))          ESL_XFAIL(eslEFORMAT, errbuf, "failed to read name");  
+  if (strcmp(name, om->name) != 0)                                                 ESL_XFAIL(eslEFORMAT, errbuf, "p/f name mismatch");  
   
-  if (! fread((char *) &n,               sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read accession length");
+  if (! rr_read(&rd, (char *) &n,               sizeof(int),      1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read accession length");
   if (n > 0) {
     ESL_ALLOC(om->acc, sizeof(char) * (n+1));
-    if (! fread( (char *) om->acc,       sizeof(char),     n+1,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read accession");      
+    if (! rr_read(&rd, (char *) om->acc,       sizeof(char),     n+1))          ESL_XFAIL(eslEFORMAT, errbuf, "failed to read accession");      
   }
-  if (! fread((char *) &n,               sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read description length");
+  if (! rr_read(&rd, (char *) &n,               sizeof(int),      1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read description length");
   if (n > 0) {
     ESL_ALLOC(om->desc, sizeof(char) * (n+1));
-    if (! fread( (char *) om->desc,      sizeof(char),     n+1,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read description");      
+    if (! rr_read(&rd, (char *) om->desc,      sizeof(char),     n+1))          ESL_XFAIL(eslEFORMAT, errbuf, "failed to read description");      
   }
 
-  if (! fread((char *) om->rf,           sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read rf annotation");
-  if (! fread((char *) om->mm,           sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read mm annotation");
-  if (! fread((char *) om->cs,           sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read cs annotation");
-  if (! fread((char *) om->consensus,    sizeof(char),     M+2,         hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read consensus annotation");
+  if (! rr_read(&rd, (char *) om->rf,           sizeof(char),     M+2))          ESL_XFAIL(eslEFORMAT, errbuf, "failed to read rf annotation");
+  if (! rr_read(&rd, (char *) om->mm,           sizeof(char),     M+2))          ESL_XFAIL(eslEFORMAT, errbuf, "failed to read mm annotation");
+  if (! rr_read(&rd, (char *) om->cs,           sizeof(char),     M+2))          ESL_XFAIL(eslEFORMAT, errbuf, "failed to read cs annotation");
+  if (! rr_read(&rd, (char *) om->consensus,    sizeof(char),     M+2))          ESL_XFAIL(eslEFORMAT, errbuf, "failed to read consensus annotation");
 
   Q4  = p7O_NQF(om->M);
   Q8  = p7O_NQW(om->M);
 
-  if (! fread((char *) om->twv,             sizeof(__m128i),  8*Q8,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tu>, vitfilter transitions");
-  for (x = 0; x < om->abc->Kp; x++)
-    if (! fread( (char *) om->rwv[x],       sizeof(__m128i),  Q8,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <ru>[%d], vitfilter emissions for sym %c", x, om->abc->sym[x]);
+  if (rr_skip_padding(&rd) != eslOK)                                                 ESL_XFAIL(eslEFORMAT, errbuf, "failed to read alignment padding");
+  if ((vp = rr_map_vectors(&rd, sizeof(__m128i) * Q8 * (8 + om->abc->Kp))) != NULL)
+    { /* zero-copy: vitfilter scores stay in the mapped .h3p */
+      free(om->twv_mem);  om->twv_mem = NULL;
+      free(om->rwv_mem);  om->rwv_mem = NULL;
+      om->twv = (__m128i *) vp;
+      for (x = 0; x < om->abc->Kp; x++)
+	om->rwv[x] = om->twv + (8 * Q8) + (x * Q8);
+    }
+  else
+    {
+      if (om->twv == NULL && p7_oprofile_AllocRest(om) != eslOK)                  ESL_XFAIL(eslEMEM, errbuf, "allocation failed: vitfilter scores");
+      if (! rr_read(&rd, (char *) om->twv,         sizeof(__m128i),  8*Q8))         ESL_XFAIL(eslEFORMAT, errbuf, "failed to read <tu>, vitfilter transitions");
+      for (x = 0; x < om->abc->Kp; x++)
+	if (! rr_read(&rd, (char *) om->rwv[x],   sizeof(__m128i),  Q8))           ESL_XFAIL(eslEFORMAT, errbuf, "failed to read <ru>[%d], vitfilter emissions for sym %c", x, om->abc->sym[x]);
+    }
   for (x = 0; x < p7O_NXSTATES; x++)
-    if (! fread( (char *) om->xw[x],        sizeof(int16_t),  p7O_NXTRANS, hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <xu>[%d], vitfilter special transitions", x);
-  if (! fread((char *) &(om->scale_w),      sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read scale_w");
-  if (! fread((char *) &(om->base_w),       sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read base_w");
-  if (! fread((char *) &(om->ddbound_w),    sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
-  if (! fread((char *) &(om->ncj_roundoff), sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
-
-  if (! fread((char *) om->tfv,          sizeof(__m128),   8*Q4,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tf> transitions");
-  for (x = 0; x < om->abc->Kp; x++)
-    if (! fread( (char *) om->rfv[x],    sizeof(__m128),   Q4,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <rf>[%d] emissions for sym %c", x, om->abc->sym[x]);
+    if (! rr_read(&rd, (char *) om->xw[x],        sizeof(int16_t),  p7O_NXTRANS)) ESL_XFAIL(eslEFORMAT, errbuf, "failed to read <xu>[%d], vitfilter special transitions", x);
+  if (! rr_read(&rd, (char *) &(om->scale_w),      sizeof(float),    1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read scale_w");
+  if (! rr_read(&rd, (char *) &(om->base_w),       sizeof(int16_t),  1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read base_w");
+  if (! rr_read(&rd, (char *) &(om->ddbound_w),    sizeof(int16_t),  1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read ddbound_w");
+  if (! rr_read(&rd, (char *) &(om->ncj_roundoff), sizeof(float),    1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read ddbound_w");
+
+  if (rr_skip_padding(&rd) != eslOK)                                              ESL_XFAIL(eslEFORMAT, errbuf, "failed to read alignment padding");
+  if ((vp = rr_map_vectors(&rd, sizeof(__m128) * Q4 * (8 + om->abc->Kp))) != NULL)
+    { /* zero-copy: fwd/bck scores stay in the mapped .h3p */
+      free(om->tfv_mem);  om->tfv_mem = NULL;
+      free(om->rfv_mem);  om->rfv_mem = NULL;
+      om->tfv = (__m128 *) vp;
+      for (x = 0; x < om->abc->Kp; x++)
+	om->rfv[x] = om->tfv + (8 * Q4) + (x * Q4);
+    }
+  else
+    {
+      if (om->tfv == NULL && p7_oprofile_AllocRest(om) != eslOK)                  ESL_XFAIL(eslEMEM, errbuf, "allocation failed: fwd/bck scores");
+      if (! rr_read(&rd, (char *) om->tfv,      sizeof(__m128),   8*Q4))         ESL_XFAIL(eslEFORMAT, errbuf, "failed to read <tf> transitions");
+      for (x = 0; x < om->abc->Kp; x++)
+	if (! rr_read(&rd, (char *) om->rfv[x], sizeof(__m128),   Q4))           ESL_XFAIL(eslEFORMAT, errbuf, "failed to read <rf>[%d] emissions for sym %c", x, om->abc->sym[x]);
+    }
   for (x = 0; x < p7O_NXSTATES; x++)
-    if (! fread( (char *) om->xf[x],     sizeof(float),    p7O_NXTRANS, hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <xf>[%d] special transitions", x);
+    if (! rr_read(&rd, (char *) om->xf[x],     sizeof(float),    p7O_NXTRANS)) ESL_XFAIL(eslEFORMAT, errbuf, "failed to read <xf>[%d] special transitions", x);
+#ifdef HMMER_AVX512
+  if (om->twv_512 == NULL && p7_oprofile_AllocRest(om) != eslOK)                  ESL_XFAIL(eslEMEM, errbuf, "allocation failed: AVX-512 scores");
+  if (p7_oprofile_Convert512(om) != eslOK)                                          ESL_XFAIL(eslEINVAL, errbuf, "failed to restripe vit/fwd scores for AVX-512");
+#endif
 
-  if (! fread((char *)   om->cutoff,     sizeof(float),    p7_NCUTOFFS, hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read Pfam score cutoffs");
-  if (! fread((char *) &(om->nj),        sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read nj");
-  if (! fread((char *) &(om->mode),      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read mode");
-  if (! fread((char *) &(om->L)   ,      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read L");
+  if (! rr_read(&rd, (char *)   om->cutoff,     sizeof(float),    p7_NCUTOFFS)) ESL_XFAIL(eslEFORMAT, errbuf, "failed to read Pfam score cutoffs");
+  if (! rr_read(&rd, (char *) &(om->nj),        sizeof(float),    1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read nj");
+  if (! rr_read(&rd, (char *) &(om->mode),      sizeof(int),      1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read mode");
+  if (! rr_read(&rd, (char *) &(om->L)   ,      sizeof(int),      1))            ESL_XFAIL(eslEFORMAT, errbuf, "failed to read L");
 
   /* record ends with magic sentinel, for detecting binary file corruption */
-  if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->pfp))  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "no sentinel magic: .h3p file corrupted?");
-  if (magic != v3f_pmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
+  if (! rr_read(&rd, (char *) &magic,     sizeof(uint32_t), 1))  ESL_XFAIL(eslEFORMAT, errbuf, "no sentinel magic: .h3p file corrupted?");
+  if (magic != v3g_pmagic)                                           ESL_XFAIL(eslEFORMAT, errbuf, "bad sentinel magic; .h3p file corrupted?");
 
 #ifdef HMMER_THREADS
-  if (hfp->syncRead)
-    {
-      if (pthread_mutex_unlock (&hfp->readMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
-    }
+  if (locked && pthread_mutex_unlock (&hfp->readMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
 #endif
 
   free(name);
   return eslOK;
 
  ERROR:
-
+  /* only now does a reader of a mapped file need the mutex, to leave its message in <hfp> */
 #ifdef HMMER_THREADS
-  if (hfp->syncRead)
-    {
-      if (pthread_mutex_unlock (&hfp->readMutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
-    }
+  if (! locked && hfp->syncRead && pthread_mutex_lock (&hfp->readMutex) == 0) locked = TRUE;
+#endif
+  strcpy(hfp->rr_errbuf, errbuf);
+#ifdef HMMER_THREADS
+  if (locked) pthread_mutex_unlock (&hfp->readMutex);
 #endif
 
   if (name != NULL) free(name);
@@ -706,6 +826,133 @@ p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset)
   return eslOK;
 }
 
+
+/* write_padding()
+ * 
+ * Write zero bytes to binary output stream <fp> until its offset is
+ * a multiple of p7O_FILEALIGN, so the score vectors that follow can be
+ * used in place from a mapping of the file. Returns <eslOK> on
+ * success, <eslEWRITE> if the stream isn't positionable or the write
+ * fails.
+ */
+static int
+write_padding(FILE *fp)
+{
+  static char zeros[p7O_FILEALIGN] = { 0 };
+  off_t       offset;
+  size_t      n;
+
+  if ((offset = ftello(fp)) < 0) return eslEWRITE;
+  n = padded_offset(offset) - offset;
+  if (n > 0 && fwrite(zeros, sizeof(char), n, fp) != n) return eslEWRITE;
+  return eslOK;
+}
+
+/* skip_padding()
+ * 
+ * The reading counterpart of <write_padding()>: consume the zero
+ * padding in input stream <fp>. We fread() the padding rather than
+ * fseeko() past it, to keep the stdio buffer. Returns <eslOK> on
+ * success, <eslEFORMAT> on a short read.
+ */
+static int
+skip_padding(FILE *fp)
+{
+  char   pad[p7O_FILEALIGN];
+  off_t  offset;
+  size_t n;
+
+  if ((offset = ftello(fp)) < 0) return eslEFORMAT;
+  n = padded_offset(offset) - offset;
+  if (n > 0 && fread(pad, sizeof(char), n, fp) != n) return eslEFORMAT;
+  return eslOK;
+}
+
+/* padded_offset()
+ * 
+ * Return <offset>, rounded up to the next multiple of p7O_FILEALIGN.
+ */
+static off_t
+padded_offset(off_t offset)
+{
+  return ((offset + p7O_FILEALIGN - 1) / p7O_FILEALIGN) * p7O_FILEALIGN;
+}
+
+/* map_vectors()
+ * 
+ * If the open binary stream <fp> is mapped in memory at <map> (of
+ * <mapsize> bytes), return a pointer to the <nbytes> of score vectors
+ * at its current offset, and reposition <fp> just past them, as if
+ * they'd been read. Since the offset is aligned (see
+ * <write_padding()>) and mmap() returns page-aligned memory, the
+ * pointer is vector-aligned.
+ * 
+ * Return <NULL> if <fp> isn't mapped, or if the vectors would run
+ * past the end of the file (a truncated file); the caller then reads
+ * with stdio, which will report the error.
+ */
+static void *
+map_vectors(FILE *fp, char *map, off_t mapsize, size_t nbytes)
+{
+  off_t offset;
+
+  if (map == NULL)                             return NULL;
+  if ((offset = ftello(fp)) < 0)               return NULL;
+  if (offset % p7O_FILEALIGN != 0)             return NULL;
+  if (offset + (off_t) nbytes > mapsize)       return NULL;
+  if (fseeko(fp, offset + nbytes, SEEK_SET) != 0) return NULL;
+  return (void *) (map + offset);
+}
+
+/* rr_read()
+ * 
+ * Read <n> items of <size> bytes from <rd> into <dst>, like fread().
+ * Returns the number of items read: <n>, or 0 if a mapped file is too
+ * short to hold them.
+ */
+static size_t
+rr_read(RR_CURSOR *rd, void *dst, size_t size, size_t n)
+{
+  size_t nbytes = size * n;
+
+  if (rd->fp) return fread(dst, size, n, rd->fp);
+  if (rd->pos + (off_t) nbytes > rd->mapsize) return 0;
+  memcpy(dst, rd->map + rd->pos, nbytes);
+  rd->pos += nbytes;
+  return n;
+}
+
+/* rr_skip_padding()
+ * 
+ * <skip_padding()> for a <RR_CURSOR>.
+ */
+static int
+rr_skip_padding(RR_CURSOR *rd)
+{
+  if (rd->fp) return skip_padding(rd->fp);
+  rd->pos = padded_offset(rd->pos);
+  return (rd->pos <= rd->mapsize ? eslOK : eslEFORMAT);
+}
+
+/* rr_map_vectors()
+ * 
+ * <map_vectors()> for a <RR_CURSOR>: return a pointer to the <nbytes>
+ * of score vectors at the cursor in the mapped file and step past
+ * them, or <NULL> if the file isn't mapped or is truncated.
+ */
+static void *
+rr_map_vectors(RR_CURSOR *rd, size_t nbytes)
+{
+  void *vp;
+
+  if (rd->fp || rd->map == NULL)              return NULL;
+  if (rd->pos % p7O_FILEALIGN != 0)           return NULL;
+  if (rd->pos + (off_t) nbytes > rd->mapsize) return NULL;
+  vp       = (void *) (rd->map + rd->pos);
+  rd->pos += nbytes;
+  return vp;
+}
+
 /*-------------------- end, utility routines ---------------------*/
 
 
@@ -805,6 +1052,7 @@ utest_ReadWrite(P7_HMM *hmm, P7_OPROFILE *om)
   P7_HMMFILE  *hfp         = NULL;
   uint16_t     fh          = 0;
   float        tolerance   = 0.001;
+  int          do_stdio;
   char         errbuf[eslERRBUFSIZE];
 
 
@@ -843,17 +1091,30 @@ utest_ReadWrite(P7_HMM *hmm, P7_OPROFILE *om)
   fclose(pfp);
   esl_newssi_Close(nssi);
 
-  /* 2. read the optimized profile back in */
-  if ( p7_hmmfile_Open(tmpfile, NULL, &hfp, NULL)  != eslOK) esl_fatal(msg);
-  if ( p7_oprofile_ReadMSV(hfp, &abc, &om2)        != eslOK) esl_fatal(msg);
-  if ( p7_oprofile_ReadRest(hfp, om2)              != eslOK) esl_fatal(msg);
-
-  /* 3. it should be identical to the original  */
-  if ( p7_oprofile_Compare(om, om2, tolerance, errbuf) != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+  /* 2. read the optimized profile back in; both with the .h3f/.h3p mapped (if we can), and with stdio */
+  for (do_stdio = FALSE; do_stdio <= TRUE; do_stdio++)
+    {
+      if ( p7_hmmfile_Open(tmpfile, NULL, &hfp, NULL)  != eslOK) esl_fatal(msg);
+      if (do_stdio) p7_hmmfile_Unmap(hfp);
+      if ( p7_oprofile_ReadMSV(hfp, &abc, &om2)        != eslOK) esl_fatal(msg);
+      if ( p7_oprofile_ReadRest(hfp, om2)              != eslOK) esl_fatal(msg);
+      if ( do_stdio && (hfp->ffp_map || hfp->pfp_map))           esl_fatal(msg);
+
+      /* mapped score vectors are used in place, so they must be aligned in the file */
+      if (hfp->ffp_map && ((char *) om2->sbv[0] <  hfp->ffp_map || (char *) om2->rbv[0] >= hfp->ffp_map + hfp->ffp_mapsize)) esl_fatal(msg);
+      if (hfp->pfp_map && ((char *) om2->twv    <  hfp->pfp_map || (char *) om2->tfv    >= hfp->pfp_map + hfp->pfp_mapsize)) esl_fatal(msg);
+      if ((uintptr_t) om2->sbv[0] % 16 || (uintptr_t) om2->rbv[0] % 16)  esl_fatal(msg);
+      if ((uintptr_t) om2->twv    % 16 || (uintptr_t) om2->tfv    % 16)  esl_fatal(msg);
+
+      /* 3. it should be identical to the original  */
+      if ( p7_oprofile_Compare(om, om2, tolerance, errbuf) != eslOK) esl_fatal("%s\n%s", msg, errbuf);
        
-  p7_oprofile_Destroy(om2);
-  p7_hmmfile_Close(hfp);
-  esl_alphabet_Destroy(abc);
+      p7_oprofile_Destroy(om2);
+      p7_hmmfile_Close(hfp);
+      esl_alphabet_Destroy(abc);
+      abc = NULL;
+    }
+
   remove(ssifile);
   remove(ffile);
   remove(pfile);
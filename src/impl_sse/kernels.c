@@ -0,0 +1,279 @@
+/* Runtime selection of the vector filter kernels; SSE version.
+ *
+ * The MSV, SSV, Viterbi filter and Forward/Backward parser each have
+ * an SSE2 kernel, and may also have AVX2 or AVX-512 kernels compiled
+ * in alongside (--enable-avx2, --enable-avx512). Which ones run is
+ * decided once per process, from the host's CPU, and recorded in a
+ * P7_KERNELS table of function pointers. The public entry points
+ * here just call through it.
+ *
+ * The tables are static constants. p7_impl_Kernels() only has to
+ * choose one and remember a pointer to it, so there is nothing for
+ * threads racing through the first call to disagree about.
+ *
+ * Contents:
+ *   1. Kernel tables and selection
+ *   2. Public entry points
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+
+/*****************************************************************
+ * 1. Kernel tables and selection
+ *****************************************************************/
+
+static const P7_KERNELS kernels_sse = {
+  "sse",
+  p7_MSVFilter_sse, p7_SSVFilter_sse, p7_SSVFilter_multi_sse,
+  p7_ViterbiFilter_sse,
+  p7_ForwardParser_sse, p7_BackwardParser_sse,
+  p7_MSVFilter_bounded_sse, p7_ViterbiFilter_bounded_sse,
+};
+
+#ifdef HMMER_AVX2
+static const P7_KERNELS kernels_avx2 = {
+  "avx2",
+  p7_MSVFilter_avx, p7_SSVFilter_avx, p7_SSVFilter_multi_avx,
+  p7_ViterbiFilter_sse,
+  p7_ForwardParser_sse, p7_BackwardParser_sse,
+  NULL, p7_ViterbiFilter_bounded_sse,
+};
+#endif
+
+#ifdef HMMER_AVX512
+/* AVX-512 for the 16-bit and float kernels, SSE2 for the byte ones:
+ * a build without AVX2.
+ */
+static const P7_KERNELS kernels_avx512 = {
+  "avx512",
+  p7_MSVFilter_sse, p7_SSVFilter_sse, p7_SSVFilter_multi_sse,
+  p7_ViterbiFilter_avx512,
+  p7_ForwardParser_avx512, p7_BackwardParser_avx512,
+  p7_MSVFilter_bounded_sse, NULL,
+};
+#endif
+
+#if defined(HMMER_AVX2) && defined(HMMER_AVX512)
+static const P7_KERNELS kernels_avx2_avx512 = {
+  "avx512",
+  p7_MSVFilter_avx, p7_SSVFilter_avx, p7_SSVFilter_multi_avx,
+  p7_ViterbiFilter_avx512,
+  p7_ForwardParser_avx512, p7_BackwardParser_avx512,
+  NULL, NULL,
+};
+#endif
+
+/* Function:  p7_impl_Kernels()
+ * Synopsis:  Return the table of filter kernels for this host.
+ *
+ * Purpose:   Return a pointer to the <P7_KERNELS> table of the best
+ *            filter and parser kernels the running host supports,
+ *            out of those compiled in. The choice is made on the
+ *            first call, from <impl_HaveAVX2()> and
+ *            <impl_HaveAVX512()>; after that it doesn't change. To
+ *            run narrower kernels, for testing or benchmarking, take
+ *            them from <p7_impl_KernelTable()> or call them directly.
+ *
+ *            <p7_impl_Kernels()->isa> names the widest instruction
+ *            set in use, for reporting.
+ */
+const P7_KERNELS *
+p7_impl_Kernels(void)
+{
+  static const P7_KERNELS *kernels = NULL;   /* benign race: all threads pick the same table */
+
+  if (kernels == NULL)
+    {
+      int avx2   = impl_HaveAVX2();
+      int avx512 = impl_HaveAVX512();
+
+      if      (avx2 && avx512) {
+#if defined(HMMER_AVX2) && defined(HMMER_AVX512)
+	kernels = &kernels_avx2_avx512;
+#endif
+      }
+      else if (avx512) {
+#ifdef HMMER_AVX512
+	kernels = &kernels_avx512;
+#endif
+      }
+      else if (avx2) {
+#ifdef HMMER_AVX2
+	kernels = &kernels_avx2;
+#endif
+      }
+      if (kernels == NULL) kernels = &kernels_sse;
+    }
+  return kernels;
+}
+
+/* Function:  p7_impl_KernelTable()
+ * Synopsis:  Return the <i>'th kernel table this host can run.
+ *
+ * Purpose:   Go through all the <P7_KERNELS> tables compiled in that
+ *            the running host supports, for <i> = 0,1..: SSE2 first,
+ *            then AVX2, AVX-512, and AVX2 with AVX-512, as compiled
+ *            and available. Return NULL once <i> is past the last.
+ *            If <opt_name> is non-NULL, set <*opt_name> to a name
+ *            that tells the table apart from the others (two of them
+ *            have the <isa> "avx512").
+ *
+ *            This is for benchmarks and tests that compare the
+ *            kernels with each other; searches use <p7_impl_Kernels()>.
+ */
+const P7_KERNELS *
+p7_impl_KernelTable(int i, const char **opt_name)
+{
+  const P7_KERNELS *tab[4];
+  const char       *name[4];
+  int               n = 0;
+#if defined(HMMER_AVX2) || defined(HMMER_AVX512)
+  int               avx2   = impl_HaveAVX2();
+  int               avx512 = impl_HaveAVX512();
+#endif
+
+  tab[n] = &kernels_sse;         name[n++] = "sse";
+#ifdef HMMER_AVX2
+  if (avx2)           { tab[n] = &kernels_avx2;        name[n++] = "avx2";        }
+#endif
+#ifdef HMMER_AVX512
+  if (avx512)         { tab[n] = &kernels_avx512;      name[n++] = "avx512";      }
+#endif
+#if defined(HMMER_AVX2) && defined(HMMER_AVX512)
+  if (avx2 && avx512) { tab[n] = &kernels_avx2_avx512; name[n++] = "avx2+avx512"; }
+#endif
+
+  if (i < 0 || i >= n) return NULL;
+  if (opt_name) *opt_name = name[i];
+  return tab[i];
+}
+
+
+
+/*****************************************************************
+ * 2. Public entry points
+ *****************************************************************/
+
+/* Function:  p7_MSVFilter()
+ * Synopsis:  Calculates MSV score, vewy vewy fast, in limited precision.
+ *
+ * Purpose:   Calls the host's MSV filter kernel; see
+ *            <p7_MSVFilter_sse()> for arguments and returns. All the
+ *            kernels give identical results.
+ */
+int
+p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  return p7_impl_Kernels()->msv(dsq, L, om, ox, ret_sc);
+}
+
+/* Function:  p7_SSVFilter()
+ * Synopsis:  J-state-free MSV filter.
+ *
+ * Purpose:   Calls the host's SSV filter kernel; see
+ *            <p7_SSVFilter_sse()>.
+ */
+int
+p7_SSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
+{
+  return p7_impl_Kernels()->ssv(dsq, L, om, ret_sc);
+}
+
+/* Function:  p7_SSVFilter_multi()
+ * Synopsis:  Raw SSV maxima for a batch of target sequences.
+ *
+ * Purpose:   Calls the host's batch SSV kernel; see
+ *            <p7_SSVFilter_multi_sse()>. Batches of at least
+ *            <p7_GPU_MINBATCH> targets go to the GPU instead, if
+ *            there is one (<p7_impl_HaveGPU()>), and come back to the
+ *            CPU kernel if it fails.
+ */
+int
+p7_SSVFilter_multi(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE)
+{
+#ifdef HMMER_CUDA
+  if (nseq >= p7_GPU_MINBATCH && p7_impl_HaveGPU())
+    {
+      int status = p7_SSVFilter_multi_gpu(dsq, L, nseq, om, xE);
+      if (status != eslFAIL) return status;
+    }
+#endif
+  return p7_impl_Kernels()->ssv_multi(dsq, L, nseq, om, xE);
+}
+
+/* Function:  p7_ViterbiFilter()
+ * Synopsis:  Calculates Viterbi score, vewy vewy fast, in limited precision.
+ *
+ * Purpose:   Calls the host's Viterbi filter kernel; see
+ *            <p7_ViterbiFilter_sse()>. All the kernels give identical
+ *            results.
+ */
+int
+p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  return p7_impl_Kernels()->vit(dsq, L, om, ox, ret_sc);
+}
+
+/* Function:  p7_MSVFilter_bounded()
+ * Synopsis:  MSV filter that stops once the pass/fail outcome is certain.
+ *
+ * Purpose:   Calls the host's bounded MSV kernel; see
+ *            <p7_MSVFilter_bounded_sse()> for arguments and returns.
+ *            A host whose MSV kernel has no bounded version (AVX2)
+ *            runs <p7_MSVFilter()> to the end: its exact score meets
+ *            the same contract.
+ */
+int
+p7_MSVFilter_bounded(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc)
+{
+  const P7_KERNELS *k = p7_impl_Kernels();
+
+  if (k->msv_bounded) return k->msv_bounded(dsq, L, om, ox, reject_sc, accept_sc, ret_sc);
+  else                return k->msv(dsq, L, om, ox, ret_sc);
+}
+
+/* Function:  p7_ViterbiFilter_bounded()
+ * Synopsis:  Viterbi filter that stops once the pass/fail outcome is certain.
+ *
+ * Purpose:   Calls the host's bounded Viterbi filter kernel; see
+ *            <p7_ViterbiFilter_bounded_sse()>. A host whose kernel
+ *            has no bounded version (AVX-512) runs
+ *            <p7_ViterbiFilter()> to the end instead.
+ */
+int
+p7_ViterbiFilter_bounded(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc)
+{
+  const P7_KERNELS *k = p7_impl_Kernels();
+
+  if (k->vit_bounded) return k->vit_bounded(dsq, L, om, ox, reject_sc, accept_sc, ret_sc);
+  else                return k->vit(dsq, L, om, ox, ret_sc);
+}
+
+/* Function:  p7_ForwardParser()
+ * Synopsis:  The Forward algorithm, linear memory parsing version.
+ *
+ * Purpose:   Calls the host's Forward parser kernel; see
+ *            <p7_ForwardParser_sse()>.
+ */
+int
+p7_ForwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+  return p7_impl_Kernels()->fwdparser(dsq, L, om, ox, opt_sc);
+}
+
+/* Function:  p7_BackwardParser()
+ * Synopsis:  The Backward algorithm, linear memory parsing version.
+ *
+ * Purpose:   Calls the host's Backward parser kernel; see
+ *            <p7_BackwardParser_sse()>.
+ */
+int
+p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
+  return p7_impl_Kernels()->bckparser(dsq, L, om, fwd, bck, opt_sc);
+}
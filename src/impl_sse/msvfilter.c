@@ -7,7 +7,7 @@
  * to obtain the score by another (probably slower) method.
  * 
  * Contents:
- *   1. p7_MSVFilter() implementation
+ *   1. p7_MSVFilter() implementation, and the longtarget SSV filters
  *   2. Benchmark driver
  *   3. Unit tests
  *   4. Test driver
@@ -33,8 +33,103 @@
 /*****************************************************************
  * 1. The p7_MSVFilter() DP implementation.
  *****************************************************************/
- 
-/* Function:  p7_MSVFilter()
+
+/* The MSV recursion only runs when the SSV filter can't settle the
+ * score, but then it runs over the whole target, and its inner loop
+ * over Q vectors reloads its bound and walks dp[] in memory on every
+ * row. For small models we instead compile one kernel per segment
+ * count Q, MSV_QKERNEL(Q), with the row in a local array of
+ * constant size: the compiler unrolls the q loop and keeps the row
+ * in registers (on x86-64 that's all of it up to about Q=10; past
+ * that some of it spills to the stack, but the loop overhead is
+ * still gone). p7_MSVFilter_sse() picks one from msv_qkernels[] by Q.
+ *
+ * The specialized kernels don't touch <ox> and don't do the debugging
+ * dumps, so they're skipped when <ox->debugging> is set.
+ */
+#define MSV_QMAX 12
+
+#define MSV_QKERNEL(nq)                                                 \
+static int                                                              \
+msv_q##nq(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc) \
+{                                                                       \
+  __m128i  dp[nq];                                                      \
+  __m128i  mpv, xEv, xBv, sv, biasv, xJv, tjbmv, tecv, basev, ceilingv, tempv; \
+  __m128i *rsc;                                                         \
+  uint8_t  xJ;                                                          \
+  int      i, q;                                                        \
+                                                                        \
+  biasv    = _mm_set1_epi8((int8_t) om->bias_b);                        \
+  for (q = 0; q < nq; q++) dp[q] = _mm_setzero_si128();                 \
+  ceilingv = _mm_cmpeq_epi8(biasv, biasv);                              \
+  basev    = _mm_set1_epi8((int8_t) om->base_b);                        \
+  tjbmv    = _mm_set1_epi8((int8_t) om->tjb_b + (int8_t) om->tbm_b);    \
+  tecv     = _mm_set1_epi8((int8_t) om->tec_b);                         \
+  xJv      = _mm_subs_epu8(biasv, biasv);                               \
+  xBv      = _mm_subs_epu8(basev, tjbmv);                               \
+                                                                        \
+  for (i = 1; i <= L; i++)                                              \
+    {                                                                   \
+      rsc = om->rbv[dsq[i]];                                            \
+      xEv = _mm_setzero_si128();                                        \
+      mpv = _mm_slli_si128(dp[nq-1], 1);                                \
+      for (q = 0; q < nq; q++)                                          \
+	{                                                               \
+	  sv    = _mm_max_epu8(mpv, xBv);                               \
+	  sv    = _mm_adds_epu8(sv, biasv);                             \
+	  sv    = _mm_subs_epu8(sv, rsc[q]);                            \
+	  xEv   = _mm_max_epu8(xEv, sv);                                \
+	  mpv   = dp[q];                                                \
+	  dp[q] = sv;                                                   \
+	}                                                               \
+                                                                        \
+      tempv = _mm_adds_epu8(xEv, biasv);                                \
+      tempv = _mm_cmpeq_epi8(tempv, ceilingv);                          \
+      if (_mm_movemask_epi8(tempv) != 0x0000)                           \
+	{ *ret_sc = eslINFINITY; return eslERANGE; }                    \
+                                                                        \
+      tempv = _mm_shuffle_epi32(xEv, _MM_SHUFFLE(2, 3, 0, 1));          \
+      xEv   = _mm_max_epu8(xEv, tempv);                                 \
+      tempv = _mm_shuffle_epi32(xEv, _MM_SHUFFLE(0, 1, 2, 3));          \
+      xEv   = _mm_max_epu8(xEv, tempv);                                 \
+      tempv = _mm_shufflelo_epi16(xEv, _MM_SHUFFLE(2, 3, 0, 1));        \
+      xEv   = _mm_max_epu8(xEv, tempv);                                 \
+      tempv = _mm_srli_si128(xEv, 1);                                   \
+      xEv   = _mm_max_epu8(xEv, tempv);                                 \
+      xEv   = _mm_shuffle_epi32(xEv, _MM_SHUFFLE(0, 0, 0, 0));          \
+                                                                        \
+      xEv = _mm_subs_epu8(xEv, tecv);                                   \
+      xJv = _mm_max_epu8(xJv, xEv);                                     \
+      xBv = _mm_max_epu8(basev, xJv);                                   \
+      xBv = _mm_subs_epu8(xBv, tjbmv);                                  \
+    }                                                                   \
+                                                                        \
+  xJ = (uint8_t) _mm_extract_epi16(xJv, 0);                             \
+  *ret_sc  = ((float) (xJ - om->tjb_b) - (float) om->base_b);           \
+  *ret_sc /= om->scale_b;                                               \
+  *ret_sc -= 3.0;                                                       \
+  return eslOK;                                                         \
+}
+
+MSV_QKERNEL(2)
+MSV_QKERNEL(3)
+MSV_QKERNEL(4)
+MSV_QKERNEL(5)
+MSV_QKERNEL(6)
+MSV_QKERNEL(7)
+MSV_QKERNEL(8)
+MSV_QKERNEL(9)
+MSV_QKERNEL(10)
+MSV_QKERNEL(11)
+MSV_QKERNEL(12)
+
+/* p7O_NQB() is never less than 2, so [0] and [1] are unused. */
+static int (* const msv_qkernels[MSV_QMAX+1])(const ESL_DSQ *, int, const P7_OPROFILE *, float *) = {
+  NULL,   NULL,   msv_q2,  msv_q3,  msv_q4,  msv_q5,  msv_q6,
+  msv_q7, msv_q8, msv_q9,  msv_q10, msv_q11, msv_q12,
+};
+
+/* Function:  p7_MSVFilter_sse()
  * Synopsis:  Calculates MSV score, vewy vewy fast, in limited precision.
  * Incept:    SRE, Wed Dec 26 15:12:25 2007 [Janelia]
  *
@@ -51,6 +146,12 @@
  *            assumes a multihit local mode, and uses its own special
  *            state transition scores, not the scores in the profile.
  *
+ *            This is the SSE2 version. <p7_MSVFilter()> calls it, or
+ *            the identical-result <p7_MSVFilter_avx()> on AVX2 hosts,
+ *            through the kernel table (see kernels.c). Models of up
+ *            to <16*MSV_QMAX> nodes go to a kernel compiled for
+ *            their segment count.
+ *
  * Args:      dsq     - digital target sequence, 1..L
  *            L       - length of dsq in residues          
  *            om      - optimized profile
@@ -71,7 +172,7 @@
  * Throws:    <eslEINVAL> if <ox> allocation is too small.
  */
 int
-p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+p7_MSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
 {
   register __m128i mpv;            /* previous row values                                       */
   register __m128i xEv;		   /* E state: keeps max for Mk->E as we go                     */
@@ -100,9 +201,15 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
   ox->M   = om->M;
 
   /* Try highly optimized ssv filter first */
-  status = p7_SSVFilter(dsq, L, om, ret_sc);
+  status = p7_SSVFilter_sse(dsq, L, om, ret_sc);
   if (status != eslENORESULT) return status;
 
+  /* Small models: the row fits in registers */
+#if eslDEBUGLEVEL > 0
+  if (! ox->debugging)
+#endif
+  if (Q <= MSV_QMAX) return (*msv_qkernels[Q])(dsq, L, om, ret_sc);
+
   /* Initialization. In offset unsigned arithmetic, -infinity is 0, and 0 is om->base.
    */
   biasv = _mm_set1_epi8((int8_t) om->bias_b); /* yes, you can set1() an unsigned char vector this way */
@@ -206,8 +313,511 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
 
   return eslOK;
 }
-/*------------------ end, p7_MSVFilter() ------------------------*/
+/*---------------- end, p7_MSVFilter_sse() ----------------------*/
+
+
+/* The bounded MSV filter stops as soon as its caller's pass/fail
+ * decision is certain. xJ never decreases, so the xJ reached on a
+ * row is a lower bound on the final score. And no M cell on row
+ * i+1 can beat max(M(i), xB(i)) by more than the best match
+ * emission of residue i+1 (its bias less its cheapest cost), so
+ * the maximum of row i plus the sum of those best emissions over
+ * the rest of the target bounds every cell to come, and so the
+ * final score; it has to stay clear of the overflow test too, or
+ * the full filter could yet return eslERANGE. Both bounds only get
+ * tighter, so checking them every MSV_BOUNDSTRIDE rows, rather than
+ * paying for the extracts on every row, just stops a little later.
+ */
+#define MSV_BOUNDSTRIDE 16
+
+/* msv_xj_threshold()
+ * The smallest xJ, in offset bytes, whose MSV score is at least
+ * <sc> nats: 256 if no byte reaches it, 0 if every one does.
+ */
+static int
+msv_xj_threshold(const P7_OPROFILE *om, float sc)
+{
+  float t = (sc + 3.0) * om->scale_b + (float) om->tjb_b + (float) om->base_b;
+
+  if (t > 255.) return 256;
+  if (t <= 0.)  return 0;
+  return (int) ceilf(t);
+}
+
+/* Function:  p7_MSVFilter_bounded_sse()
+ * Synopsis:  MSV filter that stops once the outcome is certain.
+ *
+ * Purpose:   As <p7_MSVFilter_sse()>, for a caller that only needs
+ *            to know whether the MSV score of <dsq> is below
+ *            <reject_sc>, at or above <accept_sc>, or in between
+ *            (all in nats, <reject_sc> $\leq$ <accept_sc>). The DP
+ *            stops early once the running lower bound on the score
+ *            reaches <accept_sc>, or the upper bound falls below
+ *            <reject_sc>, and returns that bound in <*ret_sc>: so a
+ *            <*ret_sc> >= <accept_sc> is a lower bound, a <*ret_sc>
+ *            < <reject_sc> is an upper bound, and anything in
+ *            between is the score <p7_MSVFilter_sse()> returns.
+ *            Either threshold may be infinite, to turn its early
+ *            exit off.
+ *
+ *            Only the full striped recursion stops early. A score
+ *            the SSV filter settles, and small models that go to an
+ *            <msv_qkernels[]> kernel, come back exact.
+ *
+ * Args:      dsq       - digital target sequence, 1..L
+ *            L         - length of dsq in residues
+ *            om        - optimized profile
+ *            ox        - DP matrix
+ *            reject_sc - stop once the score must be below this (nats)
+ *            accept_sc - stop once the score must be at least this (nats)
+ *            ret_sc    - RETURN: MSV score, or a bound on it (nats)
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if the score overflows the limited range; in
+ *            this case, this is a high-scoring hit.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ */
+int
+p7_MSVFilter_bounded_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc)
+{
+  register __m128i mpv;            /* previous row values                                       */
+  register __m128i xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m128i xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register __m128i sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m128i biasv;	   /* emission bias in a vector                                 */
+  __m128i  xJv;                    /* vector for states score                                   */
+  __m128i  tjbmv;                  /* vector for cost of moving from either J or N through B to an M state */
+  __m128i  tecv;                   /* vector for E->C  cost                                     */
+  __m128i  basev;                  /* offset for scores                                         */
+  __m128i  ceilingv;               /* saturated simd value used to test for overflow            */
+  __m128i  tempv;                  /* work vector                                               */
+  int      gain[p7_MAXCODE];       /* best match emission of each residue, in biased bytes      */
+  int      rest;                   /* sum of gain[] over residues i+1..L                        */
+  int      rejectJ, acceptJ;       /* the thresholds as xJ values                               */
+  int      xJ, xE, xB;
+  int      top;                    /* upper bound on any M cell from here to row L              */
+  int      cmp;
+  int      i;			   /* counter over sequence positions 1..L                      */
+  int      q;			   /* counter over vectors 0..nq-1                              */
+  int      x;                      /* counter over residues 0..Kp-1                             */
+  int      Q   = p7O_NQB(om->M);   /* segment length: # of vectors                              */
+  __m128i *dp  = ox->dpb[0];	   /* we're going to use dp[0][0..q..Q-1], not {MDI}MX(q) macros*/
+  __m128i *rsc;			   /* will point at om->rbv[x] for residue x[i]                 */
+  int      status;
+
+  /* Check that the DP matrix is ok for us. */
+  if (Q > ox->allocQ16)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  ox->M   = om->M;
+
+  status = p7_SSVFilter_sse(dsq, L, om, ret_sc);
+  if (status != eslENORESULT) return status;
+  if (Q <= MSV_QMAX) return (*msv_qkernels[Q])(dsq, L, om, ret_sc);
+
+  biasv = _mm_set1_epi8((int8_t) om->bias_b);
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      rsc = om->rbv[x];
+      xEv = _mm_setzero_si128();
+      for (q = 0; q < Q; q++) xEv = _mm_max_epu8(xEv, _mm_subs_epu8(biasv, rsc[q]));
+      gain[x] = esl_sse_hmax_epu8(xEv);
+    }
+  for (rest = 0, i = 1; i <= L; i++) rest += gain[dsq[i]];
+  rejectJ = msv_xj_threshold(om, reject_sc);
+  acceptJ = msv_xj_threshold(om, accept_sc);
+
+  for (q = 0; q < Q; q++) dp[q] = _mm_setzero_si128();
+  ceilingv = _mm_cmpeq_epi8(biasv, biasv);
+  basev    = _mm_set1_epi8((int8_t) om->base_b);
+  tjbmv    = _mm_set1_epi8((int8_t) om->tjb_b + (int8_t) om->tbm_b);
+  tecv     = _mm_set1_epi8((int8_t) om->tec_b);
+  xJv      = _mm_subs_epu8(biasv, biasv);
+  xBv      = _mm_subs_epu8(basev, tjbmv);
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc = om->rbv[dsq[i]];
+      xEv = _mm_setzero_si128();      
+      mpv = _mm_slli_si128(dp[Q-1], 1);   
+      for (q = 0; q < Q; q++)
+	{
+	  sv    = _mm_max_epu8(mpv, xBv);
+	  sv    = _mm_adds_epu8(sv, biasv);
+	  sv    = _mm_subs_epu8(sv, *rsc);   rsc++;
+	  xEv   = _mm_max_epu8(xEv, sv);
+	  mpv   = dp[q];
+	  dp[q] = sv;
+	}
+
+      tempv = _mm_adds_epu8(xEv, biasv);
+      tempv = _mm_cmpeq_epi8(tempv, ceilingv);
+      cmp   = _mm_movemask_epi8(tempv);
+
+      tempv = _mm_shuffle_epi32(xEv, _MM_SHUFFLE(2, 3, 0, 1));
+      xEv   = _mm_max_epu8(xEv, tempv);
+      tempv = _mm_shuffle_epi32(xEv, _MM_SHUFFLE(0, 1, 2, 3));
+      xEv   = _mm_max_epu8(xEv, tempv);
+      tempv = _mm_shufflelo_epi16(xEv, _MM_SHUFFLE(2, 3, 0, 1));
+      xEv   = _mm_max_epu8(xEv, tempv);
+      tempv = _mm_srli_si128(xEv, 1);
+      xEv   = _mm_max_epu8(xEv, tempv);
+      xEv   = _mm_shuffle_epi32(xEv, _MM_SHUFFLE(0, 0, 0, 0));
+
+      if (cmp != 0x0000) { *ret_sc = eslINFINITY; return eslERANGE; }
+
+      xEv = _mm_subs_epu8(xEv, tecv);
+      xJv = _mm_max_epu8(xJv,xEv);
+      xBv = _mm_max_epu8(basev, xJv);
+      xBv = _mm_subs_epu8(xBv, tjbmv);
+
+      rest -= gain[dsq[i]];
+      if (i % MSV_BOUNDSTRIDE == 0 && i < L)
+	{
+	  xJ = _mm_extract_epi16(xJv, 0) & 0xff;
+	  if (xJ >= acceptJ) break;
+	  xE  = (_mm_extract_epi16(xEv, 0) & 0xff) + om->tec_b;  /* >= max M(i) */
+	  xB  = _mm_extract_epi16(xBv, 0) & 0xff;
+	  top = ESL_MAX(xE, xB) + rest;
+	  if (top + om->bias_b < 255 && ESL_MAX(xJ, top - om->tec_b) < rejectJ) /* (and it can't overflow either) */
+	    { xJ = ESL_MAX(xJ, top - om->tec_b); break; }
+	}
+    } /* end loop over sequence residues 1..L */
+
+  if (i > L) xJ = _mm_extract_epi16(xJv, 0) & 0xff;
+
+  *ret_sc = ((float) (xJ - om->tjb_b) - (float) om->base_b);
+  *ret_sc /= om->scale_b;
+  *ret_sc -= 3.0; /* that's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ */
+  return eslOK;
+}
+/*---------------- end, p7_MSVFilter_bounded_sse() --------------*/
+
+
+
+/* ssv_longtarget_threshold()
+ * The byte score an SSV diagonal must reach in p7_SSVFilter_longtarget()
+ * to meet p-value threshold <P>.
+ *
+ * In original code, converting from a scaled int MSV
+ * score S (the score getting to state E) to a probability goes like this:
+ *  usc =  S - om->tec_b - om->tjb_b - om->base_b;
+ *  usc /= om->scale_b;
+ *  usc -= 3.0;
+ *  P = f ( (usc - nullsc) / eslCONST_LOG2 , mu, lambda)
+ * and we're computing the threshold usc, so reverse it:
+ *  (usc - nullsc) /  eslCONST_LOG2 = inv_f( P, mu, lambda)
+ *  usc = nullsc + eslCONST_LOG2 * inv_f( P, mu, lambda)
+ *  usc += 3
+ *  usc *= om->scale_b
+ *  S = usc + om->tec_b + om->tjb_b + om->base_b
+ *
+ *  Here, I compute threshold with length model based on max_length.  Doesn't
+ *  matter much - in any case, both the bg and om models will change with roughly
+ *  1 bit for each doubling of the length model, so they offset.
+ */
+static uint8_t
+ssv_longtarget_threshold(const ESL_DSQ *dsq, P7_OPROFILE *om, P7_BG *bg, double P)
+{
+  float nullsc;
+  float invP = esl_gumbel_invsurv(P, om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+
+  p7_bg_SetLength(bg, om->max_length);
+  p7_oprofile_ReconfigMSVLength(om, om->max_length);
+  p7_bg_NullOne  (bg, dsq, om->max_length, &nullsc);
+
+  return (int) ceil( ( ( nullsc  + (invP * eslCONST_LOG2) + 3.0 )  * om->scale_b ) + om->base_b +  om->tec_b  + om->tjb_b );
+}
+
+/* ssv_longtarget_row()
+ * One row of the SSV recursion in p7_SSVFilter_longtarget(): update
+ * <dp[0..Q-1]> for a residue with match scores <rsc>, and return the
+ * row's max in <xEv>.
+ */
+static inline __m128i
+ssv_longtarget_row(__m128i *dp, int Q, const __m128i *rsc, __m128i xBv, __m128i biasv)
+{
+  register __m128i mpv;            /* previous row values                                       */
+  register __m128i xEv;		   /* E state: keeps max for Mk->E for a single iteration       */
+  register __m128i sv;		   /* temp storage of 1 curr row value in progress              */
+  int q;
+
+  xEv = _mm_setzero_si128();
+
+  /* Right shifts by 1 byte. 4,8,12,x becomes x,4,8,12.
+   * Because ia32 is littlendian, this means a left bit shift.
+   * Zeros shift on automatically, which is our -infinity.
+   */
+  mpv = _mm_slli_si128(dp[Q-1], 1);
+  for (q = 0; q < Q; q++) {
+    /* Calculate new MMXo(i,q); don't store it yet, hold it in sv. */
+    sv   = _mm_max_epu8(mpv, xBv);
+    sv   = _mm_adds_epu8(sv, biasv);
+    sv   = _mm_subs_epu8(sv, *rsc);   rsc++;
+    xEv  = _mm_max_epu8(xEv, sv);
+
+    mpv   = dp[q];   	  /* Load {MDI}(i-1,q) into mpv */
+    dp[q] = sv;       	  /* Do delayed store of M(i,q) now that memory is usable */
+  }
+  return xEv;
+}
+
+/* ssv_longtarget_residue()
+ * Residue <n> (1..L) of the strand being scanned: dsq[n], or if
+ * <compl> is non-NULL, residue <n> of the reverse complement of <dsq>.
+ */
+static inline ESL_DSQ
+ssv_longtarget_residue(const ESL_DSQ *dsq, const ESL_DSQ *compl, int L, int n)
+{
+  return (compl ? compl[dsq[L+1-n]] : dsq[n]);
+}
+
+/* ssv_longtarget_hit()
+ * Row <i> of <dp> has reached <sc_thresh>: find the diagonal that did
+ * it, extend it, add its window to <windowlist>, and reset <dp>.
+ * Positions are those of the strand being scanned (see
+ * ssv_longtarget_residue()). Returns the target position the
+ * diagonal was extended to; the scan resumes after it.
+ */
+static int
+ssv_longtarget_hit(const ESL_DSQ *dsq, const ESL_DSQ *compl, int L, int i, P7_OPROFILE *om, __m128i *dp, int Q,
+                   const P7_SCOREDATA *ssvdata, uint8_t sc_thresh, P7_HMM_WINDOWLIST *windowlist)
+{
+  int q;
+  int k;
+  int n;
+  int end;
+  int rem_sc;
+  int start;
+  int target_end;
+  int target_start;
+  int max_end;
+  int max_sc;
+  int sc;
+  int pos_since_max;
+  float ret_sc;
+
+  union { __m128i v; uint8_t b[16]; } u;
+
+  //figure out which model state hit threshold
+  end = -1;
+  rem_sc = -1;
+  for (q = 0; q < Q; q++) {  /// Unpack and unstripe, so we can find the state that exceeded pthresh
+    u.v = dp[q];
+    for (k = 0; k < 16; k++) { // unstripe
+      //(q+Q*k+1) is the model position k at which the xE score is found
+      if (u.b[k] >= sc_thresh && u.b[k] > rem_sc && (q+Q*k+1) <= om->M) {
+        end = (q+Q*k+1);
+        rem_sc = u.b[k];
+      }
+    }
+    dp[q] = _mm_set1_epi8(0); // while we're here ... this will cause values to get reset to xB in next dp iteration
+  }
+
+  //recover the diagonal that hit threshold
+  start = end;                    // model position
+  target_end = target_start = i;  // target position
+  sc = rem_sc;
+  while (rem_sc > om->base_b - om->tjb_b - om->tbm_b) {
+    rem_sc -= om->bias_b -  ssvdata->ssv_scores[start*om->abc->Kp + ssv_longtarget_residue(dsq, compl, L, target_start)];
+    --start;
+    --target_start;
+  }
+  start++;
+  target_start++;
+
+
+  //extend diagonal further with single diagonal extension
+  k = end+1;
+  n = target_end+1;
+  max_end = target_end;
+  max_sc = sc;
+  pos_since_max = 0;
+  while (k<om->M && n<=L) {
+    sc += om->bias_b -  ssvdata->ssv_scores[k*om->abc->Kp + ssv_longtarget_residue(dsq, compl, L, n)];
+
+    if (sc >= max_sc) {
+      max_sc = sc;
+      max_end = n;
+      pos_since_max=0;
+    } else {
+      pos_since_max++;
+      if (pos_since_max == 5)
+        break;
+    }
+    k++;
+    n++;
+  }
+
+  end  +=  (max_end - target_end);
+  //k    +=  (max_end - target_end);
+  target_end = max_end;
+
+  ret_sc = ((float) (max_sc - om->tjb_b) - (float) om->base_b);
+  ret_sc /= om->scale_b;
+  ret_sc -= 3.0; // that's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ
+
+  p7_hmmwindow_new(  windowlist,
+                     0,                  // sequence_id; used in the FM-based filter, but not here
+                     target_start,       // position in the target at which the diagonal starts
+                     0,                  // position in the target fm_index at which diagonal starts;  not used here, just in FM-based filter
+                     end,                // position in the model at which the diagonal ends
+                     end-start+1 ,       // length of diagonal
+                     ret_sc,             // score of diagonal
+                     p7_NOCOMPLEMENT,    // always p7_NOCOMPLEMENT here;  varies in FM-based filter
+                     L
+                     );
+
+  return target_end;
+}
+
+/* ssv_longtarget_run()
+ * Rows <from+1..to> of one strand (see ssv_longtarget_residue()), with
+ * <dp> holding row <from> on entry: the SSV recursion, checking each
+ * row against <sc_thresh> and capturing windows by
+ * ssv_longtarget_hit(), which resets <dp> and skips the rest of the
+ * window. Returns the last row done, which is <to> unless a window
+ * ran past it; <dp> holds that row on return.
+ */
+static int
+ssv_longtarget_run(const ESL_DSQ *dsq, const ESL_DSQ *compl, int L, int from, int to, P7_OPROFILE *om, __m128i *dp, int Q,
+                   const P7_SCOREDATA *ssvdata, uint8_t sc_thresh, P7_HMM_WINDOWLIST *windowlist)
+{
+  __m128i biasv      = _mm_set1_epi8((int8_t) om->bias_b);
+  __m128i ceilingv   = _mm_cmpeq_epi8(biasv, biasv);
+  __m128i sc_threshv = _mm_set1_epi8((int8_t) 255 - sc_thresh);
+  __m128i basev      = _mm_set1_epi8((int8_t) om->base_b);
+  __m128i tjbmv      = _mm_set1_epi8((int8_t) om->tjb_b + (int8_t) om->tbm_b);
+  __m128i xBv        = _mm_subs_epu8(basev, tjbmv);
+  __m128i xEv;
+  __m128i tempv;
+  int     i;
+
+  for (i = from+1; i <= to; i++)
+    {
+      xEv = ssv_longtarget_row(dp, Q, om->rbv[ssv_longtarget_residue(dsq, compl, L, i)], xBv, biasv);
+
+      /* test if the pthresh significance threshold has been reached;
+       * note: don't use _mm_cmpgt_epi8, because it's a signed comparison, which won't work on uint8s */
+      tempv = _mm_adds_epu8(xEv, sc_threshv);
+      tempv = _mm_cmpeq_epi8(tempv, ceilingv);
+
+      if (_mm_movemask_epi8(tempv) != 0)  //hit pthresh, so add position to list and reset values
+        i = ssv_longtarget_hit(dsq, compl, L, i, om, dp, Q, ssvdata, sc_thresh, windowlist); // skip forward
+    }
+  return i-1;
+}
+
+
+/* The DNA scan.
+ *
+ * With no J state, SSV is a set of independent ungapped diagonals,
+ * and for DNA the 16 residue codes (the four bases, gap and the
+ * degeneracies) fit one pshufb table per model position. So on AVX2
+ * hosts a DNA strand is first scanned 32 diagonals at a time,
+ * p7_SSVFilter_dnascan_avx() running model positions k=1..M down all
+ * of them at once; the residues for one step are a single unaligned
+ * load from the target, and their scores one shuffle of the table
+ * for k. There's no DP row to load and store, and no striping.
+ *
+ * The scan only says whether a block of diagonals could reach the
+ * threshold. It ignores the resets after a window (so can only
+ * overestimate), and only blocks that it flags are then done by
+ * ssv_longtarget_run() over the rows they cover. Rows in between that
+ * it clears can't contain a window, so skipping them changes nothing
+ * except <dp>: that is rebuilt by starting the striped rows up to M
+ * rows early from a zeroed row, since an SSV cell depends only on
+ * the last M residues. The windows are exactly the striped ones;
+ * on typical genomic sequence most blocks clear, and the striped
+ * code only sees the neighbourhood of hits.
+ */
+#ifdef HMMER_AVX2
+#define p7_SSVDNA_BLOCK 32    /* diagonals per p7_SSVFilter_dnascan_avx() call: one __m256i of bytes */
+
+/* ssv_dna_tables()
+ * Can this strand pair be scanned (see above), and if so the tables:
+ * <tab[k]>, k=1..M, byte x = match cost of residue x at node k, and
+ * <rctab[k]>, the same indexed by complement, for the bottom strand.
+ * Both in one allocation, <*ret_mem>, for the caller to free. Returns
+ * <eslOK>, or <eslENORESULT> if the scan can't be used: no AVX2, not a
+ * nucleic alphabet, a residue code over 15 (which pshufb can't index)
+ * in <dsq>, or a target too short for one block.
+ */
+static int
+ssv_dna_tables(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, void **ret_mem, __m128i **ret_tab, __m128i **ret_rctab)
+{
+  const ESL_DSQ *compl = om->abc->complement;
+  int      M   = om->M;
+  int      Q   = p7O_NQB(M);
+  void    *mem = NULL;
+  __m128i *tab, *rctab;
+  uint8_t *t;
+  int      i, k, x;
+  int      status;
+
+  *ret_mem = NULL;
+  if (! impl_HaveAVX2())                                           return eslENORESULT;
+  if (om->abc->type != eslDNA && om->abc->type != eslRNA)          return eslENORESULT;
+  if (compl == NULL || L < M + p7_SSVDNA_BLOCK)                    return eslENORESULT;
+  for (x = 0; x < 16; x++) if (compl[x] > 15)                      return eslENORESULT;
+  for (i = 1; i <= L; i++) if (dsq[i] > 15)                        return eslENORESULT;
+
+  ESL_ALLOC(mem, sizeof(__m128i) * 2 * (M+1) + 15);
+  tab   = (__m128i *) (((unsigned long int) mem + 15) & (~0xf));
+  rctab = tab + M + 1;
+
+  for (k = 1; k <= M; k++)
+    {
+      t = (uint8_t *) (tab + k);
+      for (x = 0; x < 16; x++) t[x] = ((uint8_t *) (om->rbv[x] + (k-1) % Q))[(k-1) / Q];
+      for (x = 0; x < 16; x++) ((uint8_t *) (rctab + k))[x] = t[compl[x]];
+    }
+
+  *ret_mem   = mem;
+  *ret_tab   = tab;
+  *ret_rctab = rctab;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* ssv_longtarget_dna()
+ * All of one strand, as ssv_longtarget_run(dsq, compl, L, 0, L, ...)
+ * from a zeroed <dp>, but skipping the blocks of diagonals that
+ * p7_SSVFilter_dnascan_avx() clears. <tab> is the strand's table from
+ * ssv_dna_tables().
+ */
+static void
+ssv_longtarget_dna(const ESL_DSQ *dsq, const ESL_DSQ *compl, int L, P7_OPROFILE *om, __m128i *dp, int Q,
+                   const P7_SCOREDATA *ssvdata, uint8_t sc_thresh, const __m128i *tab, P7_HMM_WINDOWLIST *windowlist)
+{
+  __m128i xBv  = _mm_subs_epu8(_mm_set1_epi8((int8_t) om->base_b), _mm_set1_epi8((int8_t) om->tjb_b + (int8_t) om->tbm_b));
+  uint8_t xB   = (uint8_t) _mm_extract_epi16(xBv, 0);
+  int     M    = om->M;
+  int     done;			/* rows 1..done are done, and <dp> is row <done> */
+  int     d;			/* first diagonal (i-k) of the block             */
+  int     q;
+  const ESL_DSQ *p;
+
+  for (q = 0; q < Q; q++) dp[q] = _mm_setzero_si128();
+
+  /* Rows 1..M-1 hold the diagonals that start past k=1; they go straight to the striped code. */
+  done = ssv_longtarget_run(dsq, compl, L, 0, M-1, om, dp, Q, ssvdata, sc_thresh, windowlist);
 
+  for (d = 0; d + p7_SSVDNA_BLOCK-1 + M <= L; d += p7_SSVDNA_BLOCK)
+    {
+      /* lane j is diagonal d+j on the top strand; on the bottom one, diagonal d+31-j of the revcomp */
+      p = (compl ? dsq + L+2 - d - p7_SSVDNA_BLOCK : dsq + d);
+      if (! p7_SSVFilter_dnascan_avx(p, (compl ? -1 : 1), M, tab, xB, om->bias_b, sc_thresh)) continue;
+
+      if (done < d - M) { for (q = 0; q < Q; q++) dp[q] = _mm_setzero_si128(); done = d - M; }
+      done = ssv_longtarget_run(dsq, compl, L, done, d + p7_SSVDNA_BLOCK-1 + M, om, dp, Q, ssvdata, sc_thresh, windowlist);
+    }
+
+  if (done < d - M) { for (q = 0; q < Q; q++) dp[q] = _mm_setzero_si128(); done = d - M; }
+  ssv_longtarget_run(dsq, compl, L, done, L, om, dp, Q, ssvdata, sc_thresh, windowlist);
+}
+#endif /*HMMER_AVX2*/
 
 
 /* Function:  p7_SSVFilter_longtarget()
@@ -248,191 +858,163 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
  *            enough for normal DP calculations, it must be big enough
  *            to hold the MSVFilter calculation.
  *
+ *            On AVX2 hosts, DNA targets are first scanned for the
+ *            diagonals that could reach the threshold (see the DNA
+ *            scan, above); the windows are the same.
+ *
  * Returns:   <eslOK> on success.
  *
  * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ *            <eslEMEM> on allocation failure.
  */
 int
 p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *ssvdata,
                         P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist)
 {
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7O_NQB(om->M);   /* segment length: # of vectors                              */
+  __m128i *dp  = ox->dpb[0];	   /* we're going to use dp[0][0..q..Q-1], not {MDI}MX(q) macros*/
+  uint8_t sc_thresh;
+#ifdef HMMER_AVX2
+  void    *mem = NULL;
+  __m128i *tab, *rctab;
+  int      status;
+#endif
 
-  register __m128i mpv;            /* previous row values                                       */
+  /* Check that the DP matrix is ok for us. */
+  if (Q > ox->allocQ16)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  ox->M   = om->M;
+
+  /* Computing the score required to let P meet the F1 prob threshold */
+  sc_thresh  = ssv_longtarget_threshold(dsq, om, bg, P);
+
+#ifdef HMMER_AVX2
+  /* DNA on an AVX2 host: the diagonal scan (see above) */
+  if ((status = ssv_dna_tables(dsq, L, om, &mem, &tab, &rctab)) == eslOK)
+    {
+      ssv_longtarget_dna(dsq, NULL, L, om, dp, Q, ssvdata, sc_thresh, tab, windowlist);
+      free(mem);
+      return eslOK;
+    }
+  else if (status != eslENORESULT) return status;
+#endif
+
+  /* Initialization. In offset unsigned  arithmetic, -infinity is 0, and 0 is om->base.
+   */
+  for (q = 0; q < Q; q++) dp[q] = _mm_setzero_si128();
+
+  ssv_longtarget_run(dsq, NULL, L, 0, L, om, dp, Q, ssvdata, sc_thresh, windowlist);
+  return eslOK;
+}
+
+
+/* Function:  p7_SSVFilter_longtarget_dual()
+ * Synopsis:  p7_SSVFilter_longtarget() on both strands in one pass.
+ *
+ * Purpose:   Same as calling <p7_SSVFilter_longtarget()> on the DNA
+ *            sequence <dsq> and then on its reverse complement, with
+ *            the same windows as a result, but without making the
+ *            reverse complement: windows on <dsq> are added to
+ *            <windowlist>, and windows on its reverse complement
+ *            (in the coordinates of the reverse complement) to
+ *            <rc_windowlist>.
+ *
+ *            Both strands are scanned in the same loop over
+ *            <i=1..L>, each with its own DP row, and share the profile
+ *            scores <om->rbv>; row <i> of the bottom strand uses the
+ *            complement of <dsq[L+1-i]>, so each strand's recursion
+ *            (and window capture) is exactly the one-strand version's.
+ *            Where the DNA scan can be used (see above), each strand
+ *            is instead scanned on its own, from its own table.
+ *
+ * Args:      as <p7_SSVFilter_longtarget()>, plus
+ *            rc_windowlist - preallocated container for the hits on the
+ *                            reverse complement
+ *
+ * Note:      Uses the first two thirds of the first dp row of <ox>:
+ *            <dp[0..Q-1]> for the top strand, <dp[Q..2Q-1]> for the
+ *            bottom one.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, or <om>'s
+ *            alphabet has no complement.
+ *            <eslEMEM> on allocation failure.
+ */
+int
+p7_SSVFilter_longtarget_dual(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *ssvdata,
+                             P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist, P7_HMM_WINDOWLIST *rc_windowlist)
+{
   register __m128i xEv;		   /* E state: keeps max for Mk->E for a single iteration       */
   register __m128i xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
-  register __m128i sv;		   /* temp storage of 1 curr row value in progress              */
   register __m128i biasv;	   /* emission bias in a vector                                 */
   int i;			   /* counter over sequence positions 1..L                      */
   int q;			   /* counter over vectors 0..nq-1                              */
   int Q        = p7O_NQB(om->M);   /* segment length: # of vectors                              */
-  __m128i *dp  = ox->dpb[0];	   /* we're going to use dp[0][0..q..Q-1], not {MDI}MX(q) macros*/
-  __m128i *rsc;			   /* will point at om->rbv[x] for residue x[i]                 */
+  __m128i *dp  = ox->dpb[0];	   /* top strand row: dp[0..Q-1]                                */
+  __m128i *rc_dp = ox->dpb[0] + Q; /* bottom strand row: dp[Q..2Q-1]                            */
+  const ESL_DSQ *compl = om->abc->complement;
   __m128i tjbmv;                   /* vector for J->B move cost + B->M move costs               */
   __m128i basev;                   /* offset for scores                                         */
   __m128i ceilingv;                /* saturated simd value used to test for overflow           */
   __m128i tempv;                   /* work vector                                               */
-  int cmp;
-  int k;
-  int n;
-  int end;
-  int rem_sc;
-  int start;
-  int target_end;
-  int target_start;
-  int max_end;
-  int max_sc;
-  int sc;
-  int pos_since_max;
-  float ret_sc;
+  int skip    = 0;                 /* top strand rows up to <skip> are skipped, after a hit     */
+  int rc_skip = 0;                 /*  ... and bottom strand rows up to <rc_skip>               */
 
-  union { __m128i v; uint8_t b[16]; } u;
-
-  /*
-   * Computing the score required to let P meet the F1 prob threshold
-   * In original code, converting from a scaled int MSV
-   * score S (the score getting to state E) to a probability goes like this:
-   *  usc =  S - om->tec_b - om->tjb_b - om->base_b;
-   *  usc /= om->scale_b;
-   *  usc -= 3.0;
-   *  P = f ( (usc - nullsc) / eslCONST_LOG2 , mu, lambda)
-   * and we're computing the threshold usc, so reverse it:
-   *  (usc - nullsc) /  eslCONST_LOG2 = inv_f( P, mu, lambda)
-   *  usc = nullsc + eslCONST_LOG2 * inv_f( P, mu, lambda)
-   *  usc += 3
-   *  usc *= om->scale_b
-   *  S = usc + om->tec_b + om->tjb_b + om->base_b
-   *
-   *  Here, I compute threshold with length model based on max_length.  Doesn't
-   *  matter much - in any case, both the bg and om models will change with roughly
-   *  1 bit for each doubling of the length model, so they offset.
-   */
-  float nullsc;
   __m128i sc_threshv;
   uint8_t sc_thresh;
-  float invP = esl_gumbel_invsurv(P, om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+#ifdef HMMER_AVX2
+  void    *mem = NULL;
+  __m128i *tab, *rctab;
+  int      status;
+#endif
 
 
   /* Check that the DP matrix is ok for us. */
-  if (Q > ox->allocQ16)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (Q > ox->allocQ16 || 2*Q > ox->allocQ4 * p7X_NSCELLS)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (compl == NULL)                                          ESL_EXCEPTION(eslEINVAL, "alphabet has no complement");
   ox->M   = om->M;
 
+  sc_thresh  = ssv_longtarget_threshold(dsq, om, bg, P);
 
-  p7_bg_SetLength(bg, om->max_length);
-  p7_oprofile_ReconfigMSVLength(om, om->max_length);
-  p7_bg_NullOne  (bg, dsq, om->max_length, &nullsc);
+#ifdef HMMER_AVX2
+  if ((status = ssv_dna_tables(dsq, L, om, &mem, &tab, &rctab)) == eslOK)
+    {
+      ssv_longtarget_dna(dsq, NULL,  L, om, dp,    Q, ssvdata, sc_thresh, tab,   windowlist);
+      ssv_longtarget_dna(dsq, compl, L, om, rc_dp, Q, ssvdata, sc_thresh, rctab, rc_windowlist);
+      free(mem);
+      return eslOK;
+    }
+  else if (status != eslENORESULT) return status;
+#endif
 
-  sc_thresh = (int) ceil( ( ( nullsc  + (invP * eslCONST_LOG2) + 3.0 )  * om->scale_b ) + om->base_b +  om->tec_b  + om->tjb_b );
   sc_threshv = _mm_set1_epi8((int8_t) 255 - sc_thresh);
 
-  /* Initialization. In offset unsigned  arithmetic, -infinity is 0, and 0 is om->base.
-   */
-  biasv = _mm_set1_epi8((int8_t) om->bias_b); /* yes, you can set1() an unsigned char vector this way */
+  biasv = _mm_set1_epi8((int8_t) om->bias_b);
   ceilingv = _mm_cmpeq_epi8(biasv, biasv);
-  for (q = 0; q < Q; q++) dp[q] = _mm_setzero_si128();
+  for (q = 0; q < Q; q++) dp[q] = rc_dp[q] = _mm_setzero_si128();
 
   basev = _mm_set1_epi8((int8_t) om->base_b);
   tjbmv = _mm_set1_epi8((int8_t) om->tjb_b + (int8_t) om->tbm_b);
 
   xBv = _mm_subs_epu8(basev, tjbmv);
 
-  for (i = 1; i <= L; i++) 
+  for (i = 1; i <= L; i++)
     {
-      rsc = om->rbv[dsq[i]];
-      xEv = _mm_setzero_si128();
-
-      /* Right shifts by 1 byte. 4,8,12,x becomes x,4,8,12.
-       * Because ia32 is littlendian, this means a left bit shift.
-       * Zeros shift on automatically, which is our -infinity.
-       */
-      mpv = _mm_slli_si128(dp[Q-1], 1);
-      for (q = 0; q < Q; q++) {
-        /* Calculate new MMXo(i,q); don't store it yet, hold it in sv. */
-        sv   = _mm_max_epu8(mpv, xBv);
-        sv   = _mm_adds_epu8(sv, biasv);
-        sv   = _mm_subs_epu8(sv, *rsc);   rsc++;
-        xEv  = _mm_max_epu8(xEv, sv);
-        
-        mpv   = dp[q];   	  /* Load {MDI}(i-1,q) into mpv */
-        dp[q] = sv;       	  /* Do delayed store of M(i,q) now that memory is usable */
+      if (i > skip) { // top strand, residue dsq[i]
+        xEv   = ssv_longtarget_row(dp, Q, om->rbv[dsq[i]], xBv, biasv);
+        tempv = _mm_adds_epu8(xEv, sc_threshv);
+        tempv = _mm_cmpeq_epi8(tempv, ceilingv);
+        if (_mm_movemask_epi8(tempv) != 0)
+          skip = ssv_longtarget_hit(dsq, NULL, L, i, om, dp, Q, ssvdata, sc_thresh, windowlist);
       }
 
-      /* test if the pthresh significance threshold has been reached;
-       * note: don't use _mm_cmpgt_epi8, because it's a signed comparison, which won't work on uint8s */
-      tempv = _mm_adds_epu8(xEv, sc_threshv);
-      tempv = _mm_cmpeq_epi8(tempv, ceilingv);
-      cmp = _mm_movemask_epi8(tempv);
-
-      if (cmp != 0) {  //hit pthresh, so add position to list and reset values
-        //figure out which model state hit threshold
-        end = -1;
-        rem_sc = -1;
-        for (q = 0; q < Q; q++) {  /// Unpack and unstripe, so we can find the state that exceeded pthresh
-          u.v = dp[q];
-          for (k = 0; k < 16; k++) { // unstripe
-            //(q+Q*k+1) is the model position k at which the xE score is found
-            if (u.b[k] >= sc_thresh && u.b[k] > rem_sc && (q+Q*k+1) <= om->M) {
-              end = (q+Q*k+1);
-              rem_sc = u.b[k];
-            }
-          }
-          dp[q] = _mm_set1_epi8(0); // while we're here ... this will cause values to get reset to xB in next dp iteration
-        }
-
-        //recover the diagonal that hit threshold
-        start = end;                    // model position
-        target_end = target_start = i;  // target position
-        sc = rem_sc;
-        while (rem_sc > om->base_b - om->tjb_b - om->tbm_b) {
-          rem_sc -= om->bias_b -  ssvdata->ssv_scores[start*om->abc->Kp + dsq[target_start]];
-          --start;
-          --target_start;
-        }
-        start++;
-        target_start++;
-
-
-        //extend diagonal further with single diagonal extension
-        k = end+1;
-        n = target_end+1;
-        max_end = target_end;
-        max_sc = sc;
-        pos_since_max = 0;
-        while (k<om->M && n<=L) {
-          sc += om->bias_b -  ssvdata->ssv_scores[k*om->abc->Kp + dsq[n]];
-          
-          if (sc >= max_sc) {
-            max_sc = sc;
-            max_end = n;
-            pos_since_max=0;
-          } else {
-            pos_since_max++;
-            if (pos_since_max == 5)
-              break;
-          }
-          k++;
-          n++;
-        }
-
-        end  +=  (max_end - target_end);
-        //k    +=  (max_end - target_end);
-        target_end = max_end;
-
-        ret_sc = ((float) (max_sc - om->tjb_b) - (float) om->base_b);
-        ret_sc /= om->scale_b;
-        ret_sc -= 3.0; // that's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ
-
-        p7_hmmwindow_new(  windowlist,
-                           0,                  // sequence_id; used in the FM-based filter, but not here
-                           target_start,       // position in the target at which the diagonal starts
-                           0,                  // position in the target fm_index at which diagonal starts;  not used here, just in FM-based filter
-                           end,                // position in the model at which the diagonal ends
-                           end-start+1 ,       // length of diagonal
-                           ret_sc,             // score of diagonal
-                           p7_NOCOMPLEMENT,    // always p7_NOCOMPLEMENT here;  varies in FM-based filter
-                           L
-                           );
-
-        i = target_end; // skip forward
+      if (i > rc_skip) { // bottom strand: residue i of the revcomp is the complement of dsq[L+1-i]
+        xEv   = ssv_longtarget_row(rc_dp, Q, om->rbv[compl[dsq[L+1-i]]], xBv, biasv);
+        tempv = _mm_adds_epu8(xEv, sc_threshv);
+        tempv = _mm_cmpeq_epi8(tempv, ceilingv);
+        if (_mm_movemask_epi8(tempv) != 0)
+          rc_skip = ssv_longtarget_hit(dsq, compl, L, i, om, rc_dp, Q, ssvdata, sc_thresh, rc_windowlist);
       }
     } /* end loop over sequence residues 1..L */
   return eslOK;
@@ -601,6 +1183,7 @@ main(int argc, char **argv)
 #ifdef p7MSVFILTER_TESTDRIVE
 #include "esl_random.h"
 #include "esl_randomseq.h"
+#include "esl_sq.h"
 
 /* 
  * We can check that scores are identical (within machine error) to
@@ -649,6 +1232,207 @@ utest_msv_filter(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L,
   p7_profile_Destroy(gm);
   p7_oprofile_Destroy(om);
 }
+
+/* utest_msv_bounded()
+ *
+ * p7_MSVFilter_bounded_sse() must make the same decisions as the
+ * full MSV score against reject and accept thresholds set around
+ * it, and a score it returns outside them must bound the full one
+ * from the right side. Random sequences mostly get settled by the
+ * SSV filter; emitted ones with most of their residues resampled
+ * score high enough to need the full recursion, but mostly not so
+ * high that they overflow. <M> should be past the small-model
+ * kernels (16*MSV_QMAX).
+ */
+static void
+utest_msv_bounded(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM      *hmm  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  ESL_SQ      *sq   = esl_sq_CreateDigital(abc);
+  P7_OMX      *ox   = p7_omx_Create(M, 0, 0);
+  float        d[5][2] = { { -1., 1. }, { 0.5, eslINFINITY }, { -eslINFINITY, -0.5 }, { 2., 4. }, { -4., -2. } };
+  float        sc, bsc, lo, hi;
+  int          n, i, j;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+
+  for (n = 0; n < N; n++)
+    {
+      if (n % 2)
+	{
+	  if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL) != eslOK) esl_fatal("bounded msv filter unit test failed: emission");
+	  for (i = 1; i <= sq->n; i++)
+	    if (esl_random(r) < 0.6 + 0.1 * (n % 4)) sq->dsq[i] = esl_rnd_FChoose(r, bg->f, abc->K);
+	}
+      else
+	{
+	  esl_sq_GrowTo(sq, L);
+	  esl_rsq_xfIID(r, bg->f, abc->K, L, sq->dsq);
+	  sq->n = L;
+	}
+      if (sq->n == 0 || p7_MSVFilter_sse(sq->dsq, sq->n, om, ox, &sc) == eslERANGE) { esl_sq_Reuse(sq); continue; }
+
+      for (j = 0; j < 5; j++)
+	{
+	  lo = sc + d[j][0];
+	  hi = sc + d[j][1];
+	  p7_MSVFilter_bounded_sse(sq->dsq, sq->n, om, ox, lo, hi, &bsc);
+	  if ((bsc < lo) != (sc < lo) || (bsc >= hi) != (sc >= hi))
+	    esl_fatal("bounded msv filter unit test failed: decisions differ (%.2f, %.2f; %.2f..%.2f)", sc, bsc, lo, hi);
+	  if      (bsc >= hi) { if (sc < bsc - 0.001) esl_fatal("bounded msv filter unit test failed: %.2f isn't a lower bound on %.2f", bsc, sc); }
+	  else if (bsc <  lo) { if (sc > bsc + 0.001) esl_fatal("bounded msv filter unit test failed: %.2f isn't an upper bound on %.2f", bsc, sc); }
+	  else if (fabs(sc-bsc) > 0.001) esl_fatal("bounded msv filter unit test failed: scores differ (%.2f, %.2f)", sc, bsc);
+	}
+      esl_sq_Reuse(sq);
+    }
+
+  esl_sq_Destroy(sq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+
+/* utest_ssv_longtarget_dual()
+ * 
+ * p7_SSVFilter_longtarget_dual() on a random DNA sequence must find the
+ * same windows as p7_SSVFilter_longtarget() on the sequence and on its
+ * reverse complement. A permissive <P> makes sure there are plenty of
+ * windows on both strands.
+ */
+static void
+utest_ssv_longtarget_dual(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM       *hmm  = NULL;
+  P7_PROFILE   *gm   = NULL;
+  P7_OPROFILE  *om   = NULL;
+  P7_SCOREDATA *data = NULL;
+  ESL_DSQ      *dsq  = malloc(sizeof(ESL_DSQ) * (L+2));
+  ESL_DSQ      *rc   = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX       *ox   = p7_omx_Create(M, 0, 0);
+  P7_HMM_WINDOWLIST w1, w2, rc1, rc2;
+  double        P    = 0.5;
+  int           i, which;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  om->max_length          = 4*M;
+  om->evparam[p7_MMU]     = -8.0;
+  om->evparam[p7_MLAMBDA] = 0.693;
+  data = p7_hmm_ScoreDataCreate(om, NULL);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      rc[0] = rc[L+1] = eslDSQ_SENTINEL;
+      for (i = 1; i <= L; i++) rc[i] = abc->complement[dsq[L+1-i]];
+
+      p7_hmmwindow_init(&w1);  p7_hmmwindow_init(&rc1);
+      p7_hmmwindow_init(&w2);  p7_hmmwindow_init(&rc2);
+
+      p7_SSVFilter_longtarget(dsq, L, om, ox, data, bg, P, &w1);
+      p7_SSVFilter_longtarget(rc,  L, om, ox, data, bg, P, &rc1);
+      if (p7_SSVFilter_longtarget_dual(dsq, L, om, ox, data, bg, P, &w2, &rc2) != eslOK) esl_fatal("dual ssv unit test failed: bad status");
+
+      for (which = 0; which < 2; which++)
+        {
+          P7_HMM_WINDOWLIST *a = (which == 0 ? &w1 : &rc1);
+          P7_HMM_WINDOWLIST *b = (which == 0 ? &w2 : &rc2);
+
+          if (a->count != b->count) esl_fatal("dual ssv unit test failed: %d windows vs. %d on strand %d", a->count, b->count, which);
+          for (i = 0; i < a->count; i++)
+            if (a->windows[i].n      != b->windows[i].n      ||
+                a->windows[i].k      != b->windows[i].k      ||
+                a->windows[i].length != b->windows[i].length ||
+                a->windows[i].score  != b->windows[i].score)
+              esl_fatal("dual ssv unit test failed: window %d differs on strand %d", i, which);
+        }
+
+      free(w1.windows);  free(rc1.windows);
+      free(w2.windows);  free(rc2.windows);
+    }
+
+  free(dsq);
+  free(rc);
+  p7_hmm_ScoreDataDestroy(data);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+
+/* utest_ssv_longtarget_dna()
+ *
+ * The DNA scan on AVX2 hosts must not change any windows: compare
+ * p7_SSVFilter_longtarget() and p7_SSVFilter_longtarget_dual() to the
+ * plain striped rows, ssv_longtarget_run(), on each strand of random
+ * DNA sequences, at a permissive <P> that gives many windows and a
+ * strict one that gives few. (Without AVX2 this is a trivial test.)
+ */
+static void
+utest_ssv_longtarget_dna(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM       *hmm  = NULL;
+  P7_PROFILE   *gm   = NULL;
+  P7_OPROFILE  *om   = NULL;
+  P7_SCOREDATA *data = NULL;
+  ESL_DSQ      *dsq  = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX       *ox   = p7_omx_Create(M, 0, 0);
+  P7_HMM_WINDOWLIST w[2], ref[2], dual[2];
+  double        P[2] = { 0.5, 0.02 };
+  uint8_t       sc_thresh;
+  int           Q    = p7O_NQB(M);
+  int           i, t, which;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  om->max_length          = 4*M;
+  om->evparam[p7_MMU]     = -8.0;
+  om->evparam[p7_MLAMBDA] = 0.693;
+  data = p7_hmm_ScoreDataCreate(om, NULL);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      for (t = 0; t < 2; t++)
+        {
+          for (which = 0; which < 2; which++) { p7_hmmwindow_init(&w[which]); p7_hmmwindow_init(&ref[which]); p7_hmmwindow_init(&dual[which]); }
+
+          sc_thresh = ssv_longtarget_threshold(dsq, om, bg, P[t]);
+          for (which = 0; which < 2; which++)
+            {
+              for (i = 0; i < Q; i++) ox->dpb[0][i] = _mm_setzero_si128();
+              ssv_longtarget_run(dsq, (which == 0 ? NULL : abc->complement), L, 0, L, om, ox->dpb[0], Q, data, sc_thresh, &ref[which]);
+            }
+          if (p7_SSVFilter_longtarget     (dsq, L, om, ox, data, bg, P[t], &w[0])              != eslOK) esl_fatal("dna ssv unit test failed: bad status");
+          if (p7_SSVFilter_longtarget_dual(dsq, L, om, ox, data, bg, P[t], &dual[0], &dual[1]) != eslOK) esl_fatal("dna ssv unit test failed: bad dual status");
+
+          for (which = 0; which < 3; which++)
+            {
+              P7_HMM_WINDOWLIST *a = (which == 2 ? &ref[1] : &ref[0]);
+              P7_HMM_WINDOWLIST *b = (which == 0 ? &w[0] : &dual[which-1]);
+
+              if (a->count != b->count) esl_fatal("dna ssv unit test failed: %d windows vs. %d (%d)", a->count, b->count, which);
+              for (i = 0; i < a->count; i++)
+                if (a->windows[i].n      != b->windows[i].n      ||
+                    a->windows[i].k      != b->windows[i].k      ||
+                    a->windows[i].length != b->windows[i].length ||
+                    a->windows[i].score  != b->windows[i].score)
+                  esl_fatal("dna ssv unit test failed: window %d differs (%d)", i, which);
+            }
+
+          for (which = 0; which < 2; which++) { free(w[which].windows); free(ref[which].windows); free(dual[which].windows); }
+        }
+    }
+
+  free(dsq);
+  p7_hmm_ScoreDataDestroy(data);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
 #endif /*p7MSVFILTER_TESTDRIVE*/
 /*-------------------- end, unit tests --------------------------*/
 
@@ -702,8 +1486,18 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "-v")) printf("MSVFilter() tests, DNA\n");
   utest_msv_filter(r, abc, bg, M, L, N);   /* normal sized models */
+  utest_msv_filter(r, abc, bg, 100, L, 10);/* Q-specialized kernel */
   utest_msv_filter(r, abc, bg, 1, L, 10);  /* size 1 models       */
   utest_msv_filter(r, abc, bg, M, 1, 10);  /* size 1 sequences    */
+  utest_msv_bounded(r, abc, bg, 400, L, N);/* bounded, full loop   */
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("SSVFilter_longtarget_dual() tests, DNA\n");
+  utest_ssv_longtarget_dual(r, abc, bg, M, 10*L, 10);
+  utest_ssv_longtarget_dual(r, abc, bg, 1,    L, 10);
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("SSVFilter_longtarget() DNA scan tests\n");
+  utest_ssv_longtarget_dna(r, abc, bg, M, 10*L, 10);
+  utest_ssv_longtarget_dna(r, abc, bg, 1,    L, 10);
 
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
@@ -713,8 +1507,10 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "-v")) printf("MSVFilter() tests, protein\n");
   utest_msv_filter(r, abc, bg, M, L, N);   
+  utest_msv_filter(r, abc, bg, 100, L, 10);
   utest_msv_filter(r, abc, bg, 1, L, 10);  
   utest_msv_filter(r, abc, bg, M, 1, 10);  
+  utest_msv_bounded(r, abc, bg, 400, L, N);
 
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
@@ -0,0 +1,974 @@
+/* AVX2 versions of the MSV and SSV filters.
+ *
+ * These are the same algorithms as p7_MSVFilter() (msvfilter.c) and
+ * p7_SSVFilter() (ssvfilter.c), with 32 uchar cells per vector
+ * instead of 16. They use their own 32-way striped copies of the
+ * match scores, <om->rbv_avx> and <om->sbv_avx>, which
+ * p7_oprofile_ConvertAVX() derives from the 16-way <om->rbv>.
+ *
+ * Only this file is compiled with AVX2 instructions enabled
+ * (AVX2_CFLAGS). The rest of HMMER stays SSE2-only, and
+ * p7_MSVFilter()/p7_SSVFilter() dispatch here at runtime when
+ * impl_HaveAVX2() says the host supports it. That way one binary
+ * runs on every x86 host and still gets the wider vectors where they
+ * are available.
+ *
+ * Contents:
+ *   1. p7_MSVFilter_avx() implementation
+ *   2. p7_SSVFilter_avx() implementation
+ *   3. p7_SSVFilter_multi_avx(): one target sequence per lane
+ *   4. p7_SSVFilter_dnascan_avx(): 32 DNA diagonals per vector
+ *   5. Unit tests
+ *   6. Test driver
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_AVX2
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <xmmintrin.h>		/* SSE  */
+#include <emmintrin.h>		/* SSE2 */
+#include <immintrin.h>		/* AVX2 */
+
+#include "easel.h"
+#include "esl_sse.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+
+/* Shift a 256-bit vector left by one byte, across the two 128-bit
+ * lanes, shifting a zero into byte 0. This is the AVX2 equivalent of
+ * _mm_slli_si128(v, 1); _mm256_slli_si256() only shifts within each
+ * 128-bit lane.
+ */
+#define AVX_LSHIFT1(v)  _mm256_alignr_epi8((v), _mm256_permute2x128_si256((v), (v), 0x08), 15)
+
+/* Horizontal max of 32 unsigned bytes. */
+static inline uint8_t
+hmax_epu8_avx(__m256i v)
+{
+  return esl_sse_hmax_epu8(_mm_max_epu8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+
+/*****************************************************************
+ * 1. p7_MSVFilter_avx() implementation
+ *****************************************************************/
+
+/* Function:  p7_MSVFilter_avx()
+ * Synopsis:  AVX2 version of p7_MSVFilter().
+ *
+ * Purpose:   Same as <p7_MSVFilter()>: calculates an approximation of
+ *            the MSV score for sequence <dsq> of length <L> residues,
+ *            using optimized profile <om> and a preallocated one-row
+ *            DP matrix <ox>, and returns it in <ret_sc>. Results are
+ *            identical to the SSE implementation.
+ *
+ *            Caller must have checked that the host supports AVX2
+ *            (<impl_HaveAVX2()>).
+ *
+ * Note:      As in <p7_MSVFilter()> we misuse <ox>, here using the
+ *            first dp row as <dp[0..Q-1]> of 32-byte vectors. The
+ *            float part of that row (3*allocQ4 16-byte vectors)
+ *            always dominates what we need, including 32-byte
+ *            realignment.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if the score overflows the limited range; in
+ *            this case, this is a high-scoring hit.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ */
+int
+p7_MSVFilter_avx(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  register __m256i mpv;            /* previous row values                                       */
+  register __m256i xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m256i xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register __m256i sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m256i biasv;	   /* emission bias in a vector                                 */
+  uint8_t  xE, xJ, xB;             /* special states' scores                                    */
+  uint8_t  tjbm = om->tjb_b + om->tbm_b; /* cost of moving from J or N through B to an M state  */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7O_NQB_AVX(om->M); /* segment length: # of vectors                            */
+  __m256i *dp;        	           /* we're going to use dp[0..q..Q-1], not {MDI}MX(q) macros   */
+  __m256i *rsc;			   /* will point at om->rbv_avx[x] for residue x[i]             */
+  int status;
+
+  /* Check that the DP matrix is ok for us. */
+  if (p7O_NQB(om->M) > ox->allocQ16)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  ox->M   = om->M;
+  dp      = (__m256i *) (((unsigned long int) ox->dp_mem + 31) & (~0x1f));
+
+  /* Try highly optimized ssv filter first */
+  status = p7_SSVFilter_avx(dsq, L, om, ret_sc);
+  if (status != eslENORESULT) return status;
+
+  /* Initialization. In offset unsigned arithmetic, -infinity is 0, and 0 is om->base.
+   */
+  biasv = _mm256_set1_epi8((int8_t) om->bias_b);
+  for (q = 0; q < Q; q++) dp[q] = _mm256_setzero_si256();
+  xJ    = 0;
+  xB    = (om->base_b > tjbm ? om->base_b - tjbm : 0);
+  xBv   = _mm256_set1_epi8((int8_t) xB);
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc = om->rbv_avx[dsq[i]];
+      xEv = _mm256_setzero_si256();
+
+      /* Right shifts by 1 byte across the whole 256-bit vector.
+       * Zeros shift on automatically, which is our -infinity.
+       */
+      mpv = AVX_LSHIFT1(dp[Q-1]);
+      for (q = 0; q < Q; q++)
+	{
+	  /* Calculate new MMXo(i,q); don't store it yet, hold it in sv. */
+	  sv   = _mm256_max_epu8(mpv, xBv);
+	  sv   = _mm256_adds_epu8(sv, biasv);
+	  sv   = _mm256_subs_epu8(sv, *rsc);   rsc++;
+	  xEv  = _mm256_max_epu8(xEv, sv);
+
+	  mpv   = dp[q];   	  /* Load {MDI}(i-1,q) into mpv */
+	  dp[q] = sv;       	  /* Do delayed store of M(i,q) now that memory is usable */
+	}
+
+      /* Now the "special" states, which start from Mk->E (->C, ->J->B).
+       * Same saturated uchar arithmetic as the SSE vector version,
+       * but done on scalars once xE has been reduced.
+       */
+      xE = hmax_epu8_avx(xEv);
+
+      /* immediately detect overflow */
+      if (xE >= 255 - om->bias_b) { *ret_sc = eslINFINITY; return eslERANGE; }
+
+      xE  = (xE > om->tec_b ? xE - om->tec_b : 0);
+      xJ  = ESL_MAX(xJ, xE);
+      xB  = ESL_MAX(om->base_b, xJ);
+      xB  = (xB > tjbm ? xB - tjbm : 0);
+      xBv = _mm256_set1_epi8((int8_t) xB);
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T, and add our missing precision on the NN,CC,JJ back */
+  *ret_sc = ((float) (xJ - om->tjb_b) - (float) om->base_b);
+  *ret_sc /= om->scale_b;
+  *ret_sc -= 3.0; /* that's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ */
+
+  return eslOK;
+}
+/*------------------ end, p7_MSVFilter_avx() --------------------*/
+
+
+
+/*****************************************************************
+ * 2. p7_SSVFilter_avx() implementation
+ *****************************************************************/
+
+/* This is a direct translation of the register-banded SSV kernel in
+ * ssvfilter.c to 32-byte vectors; see the long introduction there
+ * for how it works. The only real difference is the one-byte shift
+ * of a diagonal vector, which needs a lane permute under AVX2
+ * (AVX_LSHIFT1). AVX2 has the same 16 vector registers on x86-64 as
+ * SSE, so we keep the same maximum band count.
+ */
+#ifdef __x86_64__ /* 64 bit version */
+#define  MAX_BANDS 14
+#else
+#define  MAX_BANDS 6
+#endif
+
+#define STEP_SINGLE(sv)                         \
+  sv   = _mm256_subs_epi8(sv, *rsc); rsc++;     \
+  xEv  = _mm256_max_epu8(xEv, sv);
+
+#define LENGTH_CHECK(label)                     \
+  if (i >= L) goto label;
+
+#define NO_CHECK(label)
+
+#define STEP_BANDS_1()                          \
+  STEP_SINGLE(sv00)
+
+#define STEP_BANDS_2()                          \
+  STEP_BANDS_1()                                \
+  STEP_SINGLE(sv01)
+
+#define STEP_BANDS_3()                          \
+  STEP_BANDS_2()                                \
+  STEP_SINGLE(sv02)
+
+#define STEP_BANDS_4()                          \
+  STEP_BANDS_3()                                \
+  STEP_SINGLE(sv03)
+
+#define STEP_BANDS_5()                          \
+  STEP_BANDS_4()                                \
+  STEP_SINGLE(sv04)
+
+#define STEP_BANDS_6()                          \
+  STEP_BANDS_5()                                \
+  STEP_SINGLE(sv05)
+
+#define STEP_BANDS_7()                          \
+  STEP_BANDS_6()                                \
+  STEP_SINGLE(sv06)
+
+#define STEP_BANDS_8()                          \
+  STEP_BANDS_7()                                \
+  STEP_SINGLE(sv07)
+
+#define STEP_BANDS_9()                          \
+  STEP_BANDS_8()                                \
+  STEP_SINGLE(sv08)
+
+#define STEP_BANDS_10()                         \
+  STEP_BANDS_9()                                \
+  STEP_SINGLE(sv09)
+
+#define STEP_BANDS_11()                         \
+  STEP_BANDS_10()                               \
+  STEP_SINGLE(sv10)
+
+#define STEP_BANDS_12()                         \
+  STEP_BANDS_11()                               \
+  STEP_SINGLE(sv11)
+
+#define STEP_BANDS_13()                         \
+  STEP_BANDS_12()                               \
+  STEP_SINGLE(sv12)
+
+#define STEP_BANDS_14()                         \
+  STEP_BANDS_13()                               \
+  STEP_SINGLE(sv13)
+
+
+#define CONVERT_STEP(step, length_check, label, sv, pos)        \
+  length_check(label)                                           \
+  rsc = om->sbv_avx[dsq[i]] + pos;                              \
+  step()                                                        \
+  sv = AVX_LSHIFT1(sv);                                         \
+  sv = _mm256_or_si256(sv, beginv);                             \
+  i++;
+
+#define CONVERT_1(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv00, Q - 1)
+
+#define CONVERT_2(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv01, Q - 2)  \
+  CONVERT_1(step, LENGTH_CHECK, label)
+
+#define CONVERT_3(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv02, Q - 3)  \
+  CONVERT_2(step, LENGTH_CHECK, label)
+
+#define CONVERT_4(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv03, Q - 4)  \
+  CONVERT_3(step, LENGTH_CHECK, label)
+
+#define CONVERT_5(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv04, Q - 5)  \
+  CONVERT_4(step, LENGTH_CHECK, label)
+
+#define CONVERT_6(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv05, Q - 6)  \
+  CONVERT_5(step, LENGTH_CHECK, label)
+
+#define CONVERT_7(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv06, Q - 7)  \
+  CONVERT_6(step, LENGTH_CHECK, label)
+
+#define CONVERT_8(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv07, Q - 8)  \
+  CONVERT_7(step, LENGTH_CHECK, label)
+
+#define CONVERT_9(step, LENGTH_CHECK, label)            \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv08, Q - 9)  \
+  CONVERT_8(step, LENGTH_CHECK, label)
+
+#define CONVERT_10(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv09, Q - 10) \
+  CONVERT_9(step, LENGTH_CHECK, label)
+
+#define CONVERT_11(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv10, Q - 11) \
+  CONVERT_10(step, LENGTH_CHECK, label)
+
+#define CONVERT_12(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv11, Q - 12) \
+  CONVERT_11(step, LENGTH_CHECK, label)
+
+#define CONVERT_13(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv12, Q - 13) \
+  CONVERT_12(step, LENGTH_CHECK, label)
+
+#define CONVERT_14(step, LENGTH_CHECK, label)           \
+  CONVERT_STEP(step, LENGTH_CHECK, label, sv13, Q - 14) \
+  CONVERT_13(step, LENGTH_CHECK, label)
+
+
+#define RESET_1()                               \
+  register __m256i sv00 = beginv;
+
+#define RESET_2()                               \
+  RESET_1()                                     \
+  register __m256i sv01 = beginv;
+
+#define RESET_3()                               \
+  RESET_2()                                     \
+  register __m256i sv02 = beginv;
+
+#define RESET_4()                               \
+  RESET_3()                                     \
+  register __m256i sv03 = beginv;
+
+#define RESET_5()                               \
+  RESET_4()                                     \
+  register __m256i sv04 = beginv;
+
+#define RESET_6()                               \
+  RESET_5()                                     \
+  register __m256i sv05 = beginv;
+
+#define RESET_7()                               \
+  RESET_6()                                     \
+  register __m256i sv06 = beginv;
+
+#define RESET_8()                               \
+  RESET_7()                                     \
+  register __m256i sv07 = beginv;
+
+#define RESET_9()                               \
+  RESET_8()                                     \
+  register __m256i sv08 = beginv;
+
+#define RESET_10()                              \
+  RESET_9()                                     \
+  register __m256i sv09 = beginv;
+
+#define RESET_11()                              \
+  RESET_10()                                    \
+  register __m256i sv10 = beginv;
+
+#define RESET_12()                              \
+  RESET_11()                                    \
+  register __m256i sv11 = beginv;
+
+#define RESET_13()                              \
+  RESET_12()                                    \
+  register __m256i sv12 = beginv;
+
+#define RESET_14()                              \
+  RESET_13()                                    \
+  register __m256i sv13 = beginv;
+
+
+#define CALC(reset, step, convert, width)       \
+  int i;                                        \
+  int i2;                                       \
+  int Q        = p7O_NQB_AVX(om->M);            \
+  __m256i *rsc;                                 \
+                                                \
+  int w = width;                                \
+                                                \
+  dsq++;                                        \
+                                                \
+  reset()                                       \
+                                                \
+  for (i = 0; i < L && i < Q - q - w; i++)      \
+    {                                           \
+      rsc = om->sbv_avx[dsq[i]] + i + q;        \
+      step()                                    \
+    }                                           \
+                                                \
+  i = Q - q - w;                                \
+  convert(step, LENGTH_CHECK, done1)            \
+done1:                                          \
+                                                \
+ for (i2 = Q - q; i2 < L - Q; i2 += Q)          \
+   {                                            \
+     for (i = 0; i < Q - w; i++)                \
+       {                                        \
+         rsc = om->sbv_avx[dsq[i2 + i]] + i;    \
+         step()                                 \
+       }                                        \
+                                                \
+     i += i2;                                   \
+     convert(step, NO_CHECK, )                  \
+   }                                            \
+                                                \
+ for (i = 0; i2 + i < L && i < Q - w; i++)      \
+   {                                            \
+     rsc = om->sbv_avx[dsq[i2 + i]] + i;        \
+     step()                                     \
+   }                                            \
+                                                \
+ i+=i2;                                         \
+ convert(step, LENGTH_CHECK, done2)             \
+done2:                                          \
+                                                \
+ return xEv;
+
+
+static __m256i
+calc_band_avx_1(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_1, STEP_BANDS_1, CONVERT_1, 1)
+}
+
+static __m256i
+calc_band_avx_2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_2, STEP_BANDS_2, CONVERT_2, 2)
+}
+
+static __m256i
+calc_band_avx_3(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_3, STEP_BANDS_3, CONVERT_3, 3)
+}
+
+static __m256i
+calc_band_avx_4(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_4, STEP_BANDS_4, CONVERT_4, 4)
+}
+
+static __m256i
+calc_band_avx_5(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_5, STEP_BANDS_5, CONVERT_5, 5)
+}
+
+static __m256i
+calc_band_avx_6(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_6, STEP_BANDS_6, CONVERT_6, 6)
+}
+
+#if MAX_BANDS > 6 /* Only include needed functions to limit object file size */
+static __m256i
+calc_band_avx_7(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_7, STEP_BANDS_7, CONVERT_7, 7)
+}
+
+static __m256i
+calc_band_avx_8(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_8, STEP_BANDS_8, CONVERT_8, 8)
+}
+
+static __m256i
+calc_band_avx_9(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_9, STEP_BANDS_9, CONVERT_9, 9)
+}
+
+static __m256i
+calc_band_avx_10(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_10, STEP_BANDS_10, CONVERT_10, 10)
+}
+
+static __m256i
+calc_band_avx_11(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_11, STEP_BANDS_11, CONVERT_11, 11)
+}
+
+static __m256i
+calc_band_avx_12(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_12, STEP_BANDS_12, CONVERT_12, 12)
+}
+
+static __m256i
+calc_band_avx_13(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_13, STEP_BANDS_13, CONVERT_13, 13)
+}
+
+static __m256i
+calc_band_avx_14(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, __m256i beginv, register __m256i xEv)
+{
+  CALC(RESET_14, STEP_BANDS_14, CONVERT_14, 14)
+}
+#endif /* MAX_BANDS > 6 */
+
+
+static uint8_t
+get_xE_avx(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om)
+{
+  __m256i xEv;		           /* E state: keeps max for Mk->E as we go                     */
+  __m256i beginv;                  /* begin scores                                              */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7O_NQB_AVX(om->M); /* segment length: # of vectors                            */
+  int bands;                       /* the number of bands (rounds) to use                       */
+  int last_q = 0;                  /* for saving the last q value to find band width            */
+  int i;                           /* counter for bands                                         */
+
+  /* function pointers for the various number of vectors to use */
+  __m256i (*fs[MAX_BANDS + 1]) (const ESL_DSQ *, int, const P7_OPROFILE *, int, register __m256i, __m256i)
+    = {NULL
+       , calc_band_avx_1,  calc_band_avx_2,  calc_band_avx_3,  calc_band_avx_4,  calc_band_avx_5,  calc_band_avx_6
+#if MAX_BANDS > 6
+       , calc_band_avx_7,  calc_band_avx_8,  calc_band_avx_9,  calc_band_avx_10, calc_band_avx_11, calc_band_avx_12, calc_band_avx_13, calc_band_avx_14
+#endif
+  };
+
+  beginv =  _mm256_set1_epi8(-128);
+  xEv    =  beginv;
+
+  /* Use the highest number of bands but no more than MAX_BANDS */
+  bands = (Q + MAX_BANDS - 1) / MAX_BANDS;
+
+  for (i = 0; i < bands; i++) {
+    q = (Q * (i + 1)) / bands;
+    xEv = fs[q-last_q](dsq, L, om, last_q, beginv, xEv);
+    last_q = q;
+  }
+
+  return hmax_epu8_avx(xEv);
+}
+
+
+/* Function:  p7_SSVFilter_avx()
+ * Synopsis:  AVX2 version of p7_SSVFilter().
+ *
+ * Purpose:   Same as <p7_SSVFilter()>, using 32-byte vectors and the
+ *            <om->sbv_avx> scores. Return codes and their meanings
+ *            are identical, including <eslENORESULT> when the caller
+ *            must fall back to the full MSV filter.
+ *
+ *            Caller must have checked that the host supports AVX2
+ *            (<impl_HaveAVX2()>).
+ */
+int
+p7_SSVFilter_avx(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
+{
+  if (om->tjb_b + om->tbm_b + om->tec_b + om->bias_b >= 127)
+    return eslENORESULT;  /* the optimizations are not guaranteed to work under these conditions (see ssvfilter.c) */
+
+  return p7_SSVFilter_Score(get_xE_avx(dsq, L, om), om, ret_sc);
+}
+/*------------------ end, p7_SSVFilter_avx() --------------------*/
+
+
+
+/*****************************************************************
+ * 3. p7_SSVFilter_multi_avx(): one target sequence per lane
+ *****************************************************************/
+
+/* The striped filters above put one model in a vector and walk one
+ * target sequence through it. For a short model that wastes most of
+ * each vector on padding: Q is at least 2, so an M=20 model fills 20
+ * of 64 cells. Here we turn it around, in the style of inter-sequence
+ * Smith/Waterman implementations: each of the 32 byte lanes runs the
+ * same SSV recurrence for a different target sequence, and we walk
+ * the model node by node. Every cell is useful work no matter what M
+ * is.
+ *
+ * The price is that the match score now depends on the lane, because
+ * each lane sees a different residue. We look the scores up with
+ * _mm256_shuffle_epi8() from a per-node table of the signed <sbv>
+ * scores for residues 0..31, held as two 16-byte tables (the shuffle
+ * only indexes within 128-bit lanes, so each table is duplicated in
+ * both halves). Residue codes are turned into the two shuffle index
+ * vectors once per row: codes 0..15 pick from the low table, 16..31
+ * from the high one, and a set high bit zeroes the other half.
+ *
+ * Targets in a batch don't have the same length. We sort the targets
+ * by length so that each batch of 32 has similar lengths, and pad the
+ * shorter ones out with a dummy residue code (p7O_MULTI_PADX) that
+ * scores +127 everywhere. Subtracting that takes any cell back to the
+ * -128 baseline, so padding never raises a lane's maximum (except in
+ * a lane that has already wrapped around, which has already reached
+ * the overflow threshold anyway).
+ *
+ * Only the length-independent diagonal maximum xE is calculated; the
+ * caller finishes each target with p7_SSVFilter_Score().
+ */
+#define p7O_MULTI_PADX 31
+
+/* qsort() comparison for (length, index) pairs: decreasing length. */
+static int
+multi_length_sorter(const void *vp1, const void *vp2)
+{
+  int L1 = *((const int *) vp1);
+  int L2 = *((const int *) vp2);
+  return (L1 > L2 ? -1 : (L1 < L2 ? 1 : 0));
+}
+
+/* Function:  p7_SSVFilter_multi_avx()
+ * Synopsis:  AVX2 inter-sequence version of p7_SSVFilter_multi().
+ *
+ * Purpose:   Same as <p7_SSVFilter_multi()>: calculate the raw SSV
+ *            diagonal maximum <xE[s]> of each of the <nseq> targets
+ *            <dsq[s]>, <L[s]> against <om>, running 32 targets at a
+ *            time, one per byte lane. The <xE[s]> give exactly the
+ *            same <p7_SSVFilter_Score()> results as the striped
+ *            filters.
+ *
+ *            Caller must have checked that the host supports AVX2
+ *            (<impl_HaveAVX2()>).
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_SSVFilter_multi_avx(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE)
+{
+  int       M       = om->M;
+  int       Q       = p7O_NQB(M);     /* 16-way segment length of om->sbv, for unstriping */
+  void     *mem     = NULL;
+  __m256i  *tbl;                      /* tbl[2k], tbl[2k+1]: node k+1 scores for residues 0..15, 16..31 */
+  __m256i  *dp;                       /* dp[k]: diagonal score in node k+1, one target per lane         */
+  uint8_t  *res     = NULL;           /* res[32*i + z]: residue i+1 of the target in lane z             */
+  int      *ord     = NULL;           /* targets sorted by decreasing length (2*nseq for the sort)      */
+  uint8_t  *t8;
+  __m256i   beginv  = _mm256_set1_epi8(-128);
+  __m256i   loffv   = _mm256_set1_epi8(0x70);
+  __m256i   hoffv   = _mm256_set1_epi8(16);
+  __m256i   idxv, lov, hiv;
+  __m256i   sv, mpv, xEv;
+  uint8_t   lanes[32];
+  int       Lmax;
+  const ESL_DSQ *bdsq[32];            /* the batch's target sequences, offset to start at residue 1 */
+  int       b, nb;                    /* start and size of the current batch */
+  int       nz;                       /* number of lanes still in their target sequence on row i */
+  int       i, k, s, x, z;
+  int       status;
+
+  /* More than 32 residue codes won't fit the two 16-byte shuffle tables. */
+  if (om->abc->Kp > p7O_MULTI_PADX)
+    {
+      for (s = 0; s < nseq; s++) xE[s] = get_xE_avx(dsq[s], L[s], om);
+      return eslOK;
+    }
+  if (nseq == 0) return eslOK;
+
+  ESL_ALLOC(ord, sizeof(int) * 2 * nseq);
+  for (s = 0; s < nseq; s++) { ord[2*s] = L[s]; ord[2*s+1] = s; }
+  qsort(ord, nseq, sizeof(int) * 2, multi_length_sorter);
+  for (s = 0; s < nseq; s++) ord[s] = ord[2*s+1];
+  Lmax = L[ord[0]];
+
+  ESL_ALLOC(mem, sizeof(__m256i) * 3 * M + 31);
+  tbl = (__m256i *) (((unsigned long int) mem + 31) & (~0x1f));
+  dp  = tbl + 2 * M;
+  ESL_ALLOC(res, sizeof(uint8_t) * 32 * ESL_MAX(1, Lmax));
+
+  /* Unstripe the signed SSV scores into per-node shuffle tables. Node
+   * k+1 is at vector k%Q, element k/Q, of om->sbv[x].
+   */
+  for (k = 0; k < M; k++)
+    {
+      t8 = (uint8_t *) (tbl + 2*k);
+      for (x = 0; x < 32; x++)
+	{
+	  uint8_t sc = (x < om->abc->Kp) ? ((uint8_t *) om->sbv[x])[(k%Q)*16 + k/Q] : 127;
+	  t8[(x/16)*32 + x%16] = t8[(x/16)*32 + x%16 + 16] = sc;
+	}
+    }
+
+  for (b = 0; b < nseq; b += 32)
+    {
+      nb   = ESL_MIN(32, nseq - b);
+      Lmax = L[ord[b]];
+
+      /* Interleave the batch's residues, row by row. Lanes are in
+       * decreasing length order, so lanes nz..31 are padding on row i.
+       */
+      for (z = 0; z < 32; z++) bdsq[z] = (z < nb) ? dsq[ord[b+z]] + 1 : NULL;
+      for (nz = nb, i = 0; i < Lmax; i++)
+	{
+	  while (nz > 0 && L[ord[b+nz-1]] <= i) nz--;
+	  for (z = 0;  z < nz; z++) res[32*i + z] = bdsq[z][i];
+	  for (     ;  z < 32; z++) res[32*i + z] = p7O_MULTI_PADX;
+	}
+
+      for (k = 0; k < M; k++) dp[k] = beginv;
+      xEv = beginv;
+
+      for (i = 0; i < Lmax; i++)
+	{
+	  idxv = _mm256_loadu_si256((__m256i *) (res + 32*i));
+	  lov  = _mm256_adds_epu8(idxv, loffv); /* 0..15 -> 0x70..0x7f; 16..31 get the high bit, zeroing them */
+	  hiv  = _mm256_sub_epi8 (idxv, hoffv); /* 16..31 -> 0..15;     0..15 go negative, zeroing them      */
+
+	  mpv = beginv;
+	  for (k = 0; k < M; k++)
+	    {
+	      sv    = _mm256_or_si256(_mm256_shuffle_epi8(tbl[2*k], lov), _mm256_shuffle_epi8(tbl[2*k+1], hiv));
+	      sv    = _mm256_subs_epi8(mpv, sv);
+	      xEv   = _mm256_max_epu8(xEv, sv);
+	      mpv   = dp[k];
+	      dp[k] = sv;
+	    }
+	}
+
+      _mm256_storeu_si256((__m256i *) lanes, xEv);
+      for (z = 0; z < nb; z++) xE[ord[b+z]] = lanes[z];
+    }
+
+  free(res);
+  free(mem);
+  free(ord);
+  return eslOK;
+
+ ERROR:
+  if (res) free(res);
+  if (mem) free(mem);
+  if (ord) free(ord);
+  return status;
+}
+/*------------------ end, p7_SSVFilter_multi_avx() ---------------*/
+
+
+
+/*****************************************************************
+ * 4. p7_SSVFilter_dnascan_avx(): 32 DNA diagonals per vector
+ *****************************************************************/
+
+/* Function:  p7_SSVFilter_dnascan_avx()
+ * Synopsis:  Could any of 32 DNA diagonals reach an SSV threshold?
+ *
+ * Purpose:   Run the SSV recursion for model nodes <k=1..M> down 32
+ *            diagonals of a DNA target at once, one per byte lane,
+ *            and return whether any cell reached byte score
+ *            <sc_thresh>. Lane <j> at node <k> takes residue
+ *            <p[step*k + j]>, so with <step=1> the lanes are
+ *            consecutive diagonals of <p>, and with <step=-1>
+ *            consecutive diagonals (in reverse lane order) of its
+ *            reverse complement. There are no resets after windows;
+ *            see the DNA scan in msvfilter.c, which calls this.
+ *
+ *            <tab[k]> is a pshufb table for node <k>: byte <x> is the
+ *            match cost of residue <x> (<om->rbv> units), so every
+ *            residue code must be 0..15. <xB> and <bias> are the
+ *            profile's B->Mk score and emission bias, as the
+ *            striped SSV rows use them.
+ *
+ * Returns:   TRUE if some cell reached <sc_thresh>, FALSE if not.
+ */
+int
+p7_SSVFilter_dnascan_avx(const ESL_DSQ *p, int step, int M, const __m128i *tab, uint8_t xB, uint8_t bias, uint8_t sc_thresh)
+{
+  __m256i xBv   = _mm256_set1_epi8((int8_t) xB);
+  __m256i biasv = _mm256_set1_epi8((int8_t) bias);
+  __m256i sv    = _mm256_setzero_si256();   /* the 32 diagonals' cells at node k */
+  __m256i maxv  = _mm256_setzero_si256();   /* max over all cells so far         */
+  __m256i xv;                               /* residues at node k                */
+  int     k;
+
+  for (k = 1; k <= M; k++)
+    {
+      xv   = _mm256_loadu_si256((const __m256i *) (p + step * k));
+      xv   = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(tab[k]), xv);
+      sv   = _mm256_max_epu8(sv, xBv);
+      sv   = _mm256_adds_epu8(sv, biasv);
+      sv   = _mm256_subs_epu8(sv, xv);
+      maxv = _mm256_max_epu8(maxv, sv);
+    }
+  return (hmax_epu8_avx(maxv) >= sc_thresh ? TRUE : FALSE);
+}
+/*------------------ end, p7_SSVFilter_dnascan_avx() -------------*/
+
+
+
+/*****************************************************************
+ * 5. Unit tests
+ *****************************************************************/
+#ifdef p7MSVFILTER_AVX_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* The AVX2 filters must give exactly the same scores and return
+ * codes as the SSE ones, for a random model of length <M> and <N>
+ * random test sequences of length <L>.
+ */
+static void
+utest_msv_avx(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "msvfilter_avx unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  P7_OPROFILE *om2 = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *ox  = p7_omx_Create(M, 0, 0);
+  float        sc1, sc2;
+  int          st1, st2;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  if ((om2 = p7_oprofile_Copy(om)) == NULL) esl_fatal(msg);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      st1 = p7_SSVFilter_sse(dsq, L, om, &sc1);
+      st2 = p7_SSVFilter_avx(dsq, L, om, &sc2);
+      if (st1 != st2)                    esl_fatal("%s: SSV status differs (%d, %d)", msg, st1, st2);
+      if (st1 == eslOK && sc1 != sc2)    esl_fatal("%s: SSV scores differ (%.2f, %.2f)", msg, sc1, sc2);
+
+      st1 = p7_MSVFilter_sse(dsq, L, om,  ox, &sc1);
+      st2 = p7_MSVFilter_avx(dsq, L, om2, ox, &sc2);     /* also checks that _Copy() carries the AVX2 scores */
+      if (st1 != st2)                    esl_fatal("%s: MSV status differs (%d, %d)", msg, st1, st2);
+      if (st1 == eslOK && sc1 != sc2)    esl_fatal("%s: MSV scores differ (%.2f, %.2f)", msg, sc1, sc2);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  p7_oprofile_Destroy(om2);
+}
+
+/* The inter-sequence SSV filter must give the same results as the
+ * striped one, for a batch of <N> random sequences of random lengths
+ * 0..<L> (so batches are ragged, and some sequences are empty).
+ */
+static void
+utest_ssv_multi(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "msvfilter_avx multi-target unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ    **dsq = malloc(sizeof(ESL_DSQ *) * N);
+  int         *len = malloc(sizeof(int)       * N);
+  uint8_t     *xE  = malloc(sizeof(uint8_t)   * N);
+  float        sc1, sc2;
+  int          st1, st2;
+  int          s;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  for (s = 0; s < N; s++)
+    {
+      len[s] = esl_rnd_Roll(r, L+1);
+      dsq[s] = malloc(sizeof(ESL_DSQ) * (len[s]+2));
+      esl_rsq_xfIID(r, bg->f, abc->K, len[s], dsq[s]);
+    }
+
+  if (p7_SSVFilter_multi_avx((const ESL_DSQ **) dsq, len, N, om, xE) != eslOK) esl_fatal(msg);
+
+  for (s = 0; s < N; s++)
+    {
+      p7_oprofile_ReconfigLength(om, len[s]);
+      st1 = p7_SSVFilter_sse  (dsq[s], len[s], om, &sc1);
+      st2 = p7_SSVFilter_Score(xE[s],          om, &sc2);
+      if (st1 != st2)                    esl_fatal("%s: status differs (%d, %d)", msg, st1, st2);
+      if (st1 == eslOK && sc1 != sc2)    esl_fatal("%s: scores differ (%.2f, %.2f)", msg, sc1, sc2);
+    }
+
+  for (s = 0; s < N; s++) free(dsq[s]);
+  free(dsq);
+  free(len);
+  free(xE);
+  p7_hmm_Destroy(hmm);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7MSVFILTER_AVX_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+/*****************************************************************
+ * 6. Test driver
+ *****************************************************************/
+#ifdef p7MSVFILTER_AVX_TESTDRIVE
+/*
+   gcc -g -Wall -msse2 -mavx2 -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o msvfilter_avx_utest -Dp7MSVFILTER_AVX_TESTDRIVE msvfilter_avx.c -lhmmer -leasel -lm
+   ./msvfilter_avx_utest
+ */
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the AVX2 MSV/SSV filter implementation";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  if (! __builtin_cpu_supports("avx2"))
+    {
+      if (esl_opt_GetBoolean(go, "-v")) printf("host has no AVX2; test skipped\n");
+      esl_getopts_Destroy(go);
+      esl_randomness_Destroy(r);
+      return eslOK;
+    }
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("MSVFilter_avx() tests, DNA\n");
+  utest_msv_avx(r, abc, bg, M,   L, N);   /* normal sized models */
+  utest_msv_avx(r, abc, bg, 1,   L, 10);  /* size 1 models       */
+  utest_msv_avx(r, abc, bg, M,   1, 10);  /* size 1 sequences    */
+  utest_msv_avx(r, abc, bg, 33,  L, 10);  /* just over one 32-way segment */
+  utest_ssv_multi(r, abc, bg, 20,  L, N);  /* a few ragged batches of 32 */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("MSVFilter_avx() tests, protein\n");
+  utest_msv_avx(r, abc, bg, M,   L, N);
+  utest_msv_avx(r, abc, bg, 1,   L, 10);
+  utest_msv_avx(r, abc, bg, M,   1, 10);
+  utest_msv_avx(r, abc, bg, 1000,L, 10);  /* more than MAX_BANDS vectors: multiple sweeps */
+  utest_ssv_multi(r, abc, bg, 20,  L, N);
+  utest_ssv_multi(r, abc, bg, 1,   L, 10);
+  utest_ssv_multi(r, abc, bg, M,   L, 33);  /* one full batch plus one target */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7MSVFILTER_AVX_TESTDRIVE*/
+
+
+#else /* ! HMMER_AVX2 */
+
+/* Provide a dummy symbol so this compilation unit isn't empty.  */
+void p7_msvfilter_avx_silence_hack(void) { return; }
+
+#endif /* HMMER_AVX2 or not */
@@ -23,6 +23,8 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
+static int null2_from_counts(const P7_OPROFILE *om, const P7_OMX *pp, int Ld, float *null2);
+
 /*****************************************************************
  * 1. Null2 estimation algorithms.
  *****************************************************************/
@@ -47,32 +49,81 @@ p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
   int      Ld   = pp->L;
   int      Q    = p7O_NQF(M);
   float   *xmx  = pp->xmx;	/* enables use of XMXo(i,s) macro */
-  float    norm;
-  __m128  *rp;
-  __m128   sv;
-  float    xfactor;
-  int      i,q,x;
+  __m128  *cnt  = pp->dpf[0];	/* row 0 accumulates the counts */
+  __m128  *row;
+  float    xN, xC, xJ;
+  int      i,q;
   
   /* Calculate expected # of times that each emitting state was used
    * in generating the Ld residues in this domain.
-   * The 0 row in <wrk> is used to hold these numbers.
+   * The 0 row in <wrk> is used to hold these numbers. Row pointers
+   * and the special state sums are kept in locals, so the compiler
+   * doesn't have to reload them through <pp> after every store; the
+   * summation order is unchanged, which
+   * p7_OptimalAccuracyCheckpointed() relies on.
    */
-  memcpy(pp->dpf[0], pp->dpf[1], sizeof(__m128) * 3 * Q);
-  XMXo(0,p7X_N) = XMXo(1,p7X_N);
-  XMXo(0,p7X_C) = XMXo(1,p7X_C); /* 0.0 */
-  XMXo(0,p7X_J) = XMXo(1,p7X_J); /* 0.0 */
+  memcpy(cnt, pp->dpf[1], sizeof(__m128) * 3 * Q);
+  xN = XMXo(1,p7X_N);
+  xC = XMXo(1,p7X_C); /* 0.0 */
+  xJ = XMXo(1,p7X_J); /* 0.0 */
 
   for (i = 2; i <= Ld; i++)
     {
+      row = pp->dpf[i];
       for (q = 0; q < Q; q++)
 	{
-	  pp->dpf[0][q*3 + p7X_M] = _mm_add_ps(pp->dpf[i][q*3 + p7X_M], pp->dpf[0][q*3 + p7X_M]);
-	  pp->dpf[0][q*3 + p7X_I] = _mm_add_ps(pp->dpf[i][q*3 + p7X_I], pp->dpf[0][q*3 + p7X_I]);
+	  cnt[q*3 + p7X_M] = _mm_add_ps(row[q*3 + p7X_M], cnt[q*3 + p7X_M]);
+	  cnt[q*3 + p7X_I] = _mm_add_ps(row[q*3 + p7X_I], cnt[q*3 + p7X_I]);
 	}
-      XMXo(0,p7X_N) += XMXo(i,p7X_N);
-      XMXo(0,p7X_C) += XMXo(i,p7X_C); 
-      XMXo(0,p7X_J) += XMXo(i,p7X_J); 
+      xN += XMXo(i,p7X_N);
+      xC += XMXo(i,p7X_C); 
+      xJ += XMXo(i,p7X_J); 
     }
+  XMXo(0,p7X_N) = xN;
+  XMXo(0,p7X_C) = xC;
+  XMXo(0,p7X_J) = xJ;
+
+  return null2_from_counts(om, pp, Ld, null2);
+}
+
+
+/* Function:  p7_Null2_ByExpectationCheckpointed()
+ * Synopsis:  Calculate null2 model from checkpointed posterior probabilities.
+ *
+ * Purpose:   Same as <p7_Null2_ByExpectation()>, for a checkpointed
+ *            matrix set <ock>, using the expected state usage counts
+ *            that <p7_OptimalAccuracyCheckpointed()> summed in row 0
+ *            of <ock->pp> as it decoded each segment. The counts are
+ *            converted in place, so this can only be called once per
+ *            <p7_OptimalAccuracyCheckpointed()>.
+ *
+ * Args:      om    - profile, in any mode, target length model set to <L>
+ *            ock   - checkpointed matrices, for <om> against domain envelope <dsq+i-1> (offset)
+ *            null2 - RETURN: null2 log odds scores per residue; <0..Kp-1>; caller allocated space
+ */
+int
+p7_Null2_ByExpectationCheckpointed(const P7_OPROFILE *om, P7_OMXCHK *ock, float *null2)
+{
+  return null2_from_counts(om, ock->pp, ock->L, null2);
+}
+
+
+/* null2_from_counts()
+ *
+ * Given expected numbers of uses of each emitting state in row 0 of
+ * <pp>, for a domain of length <Ld>, convert them in place to
+ * frequencies, and calculate the null2 odds ratios in <null2>.
+ */
+static int
+null2_from_counts(const P7_OPROFILE *om, const P7_OMX *pp, int Ld, float *null2)
+{
+  int      Q    = p7O_NQF(om->M);
+  float   *xmx  = pp->xmx;	/* enables use of XMXo(i,s) macro */
+  float    norm;
+  __m128  *rp;
+  __m128   sv;
+  float    xfactor;
+  int      q,x;
 
   /* Convert those expected #'s to frequencies, to use as posterior weights. */
   norm = 1.0 / (float) Ld;
@@ -118,6 +169,7 @@ p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2)
 }
 
 
+
 /* Function:  p7_Null2_ByTrace()
  * Synopsis:  Assign null2 scores to an envelope by the sampling method.
  * Incept:    SRE, Mon Aug 18 10:22:49 2008 [Janelia]
@@ -13,6 +13,7 @@
 #include <p7_config.h>
 
 #include <float.h>
+#include <string.h>
 
 #include <xmmintrin.h>
 #include <emmintrin.h>
@@ -23,6 +24,8 @@
 
 #include "hmmer.h"
 
+static void oa_rows(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, int ia, int ib);
+
 
 /*****************************************************************
  * 1. Optimal accuracy alignment, DP fill
@@ -56,6 +59,121 @@
  */
 int
 p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *ret_e)
+{
+  __m128 *dpc   = ox->dpf[0];
+  __m128  infv  = _mm_set1_ps(-eslINFINITY);
+  float  *xmx   = ox->xmx;
+  int     Q     = p7O_NQF(om->M);
+  int     q;
+
+  ox->M = om->M;
+  ox->L = pp->L;
+  for (q = 0; q < Q; q++) MMO(dpc, q) = IMO(dpc,q) = DMO(dpc,q) = infv;
+  XMXo(0, p7X_E)    = -eslINFINITY;
+  XMXo(0, p7X_N)    = 0.;
+  XMXo(0, p7X_J)    = -eslINFINITY;
+  XMXo(0, p7X_B)    = 0.;
+  XMXo(0, p7X_C)    = -eslINFINITY;
+
+  oa_rows(om, pp, ox, 1, pp->L);
+
+  *ret_e = ox->xmx[pp->L*p7X_NXCELLS+p7X_C];
+  return eslOK;
+}
+
+
+/* Function:  p7_OptimalAccuracyCheckpointed()
+ * Synopsis:  DP fill of an optimal accuracy alignment, checkpointed version.
+ *
+ * Purpose:   Same as <p7_OptimalAccuracy()>, for a checkpointed matrix
+ *            set <ock> on which <p7_ForwardCheckpointed()>,
+ *            <p7_BackwardCheckpointed()>, and
+ *            <p7_DecodingCheckpointed()> have been called. Each
+ *            segment is decoded in turn with <p7_DecodingSegment()>
+ *            and its OA rows filled in <ock->oa>. The digital target
+ *            sequence <dsq> is needed to recalculate Forward and
+ *            Backward segments.
+ *
+ *            As the segments are decoded, the expected number of
+ *            times each emitting state is used is summed in row 0
+ *            of <ock->pp>, for a subsequent call to
+ *            <p7_Null2_ByExpectationCheckpointed()>.
+ *
+ *            Results are identical to <p7_OptimalAccuracy()> on full
+ *            matrices.
+ *
+ * Returns:   <eslOK> on success, and <*ret_e> contains the final OA
+ *            score.
+ *
+ * Throws:    (no abnormal error conditions)
+ */
+int
+p7_OptimalAccuracyCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, float *ret_e)
+{
+  P7_OMX *pp    = ock->pp;
+  P7_OMX *ox    = ock->oa;
+  __m128 *dpc   = ox->dpf[0];
+  __m128 *cnt   = pp->dpf[0];
+  __m128  infv  = _mm_set1_ps(-eslINFINITY);
+  float  *xmx   = ox->xmx;
+  int     Q     = p7O_NQF(om->M);
+  int     L     = ock->L;
+  int     s, i, q;
+  int     ia, ib;
+
+  ox->M = om->M;
+  ox->L = L;
+  for (q = 0; q < Q; q++) MMO(dpc, q) = IMO(dpc,q) = DMO(dpc,q) = infv;
+  XMXo(0, p7X_E)    = -eslINFINITY;
+  XMXo(0, p7X_N)    = 0.;
+  XMXo(0, p7X_J)    = -eslINFINITY;
+  XMXo(0, p7X_B)    = 0.;
+  XMXo(0, p7X_C)    = -eslINFINITY;
+
+  for (s = 0; s < ock->nseg; s++)
+    {
+      ia = s*ock->K+1;
+      ib = ESL_MIN(L, (s+1)*ock->K);
+      p7_DecodingSegment(dsq, om, ock, s);
+
+      /* Null2 counts, summed in the same order as p7_Null2_ByExpectation() does */
+      for (i = ia; i <= ib; i++)
+	{
+	  if (i == 1)
+	    {
+	      memcpy(cnt, pp->dpf[1], sizeof(__m128) * 3 * Q);
+	      pp->xmx[p7X_N] = pp->xmx[p7X_NXCELLS+p7X_N];
+	      pp->xmx[p7X_C] = pp->xmx[p7X_NXCELLS+p7X_C];
+	      pp->xmx[p7X_J] = pp->xmx[p7X_NXCELLS+p7X_J];
+	      continue;
+	    }
+	  for (q = 0; q < Q; q++)
+	    {
+	      cnt[q*3 + p7X_M] = _mm_add_ps(pp->dpf[i][q*3 + p7X_M], cnt[q*3 + p7X_M]);
+	      cnt[q*3 + p7X_I] = _mm_add_ps(pp->dpf[i][q*3 + p7X_I], cnt[q*3 + p7X_I]);
+	    }
+	  pp->xmx[p7X_N] += pp->xmx[i*p7X_NXCELLS+p7X_N];
+	  pp->xmx[p7X_C] += pp->xmx[i*p7X_NXCELLS+p7X_C];
+	  pp->xmx[p7X_J] += pp->xmx[i*p7X_NXCELLS+p7X_J];
+	}
+
+      oa_rows(om, pp, ox, ia, ib);
+      ock->oa_seg = s;
+    }
+
+  *ret_e = ox->xmx[L*p7X_NXCELLS+p7X_C];
+  return eslOK;
+}
+
+
+/* oa_rows()
+ *
+ * The OA fill for rows <ia>..<ib> of <ox>, from posterior
+ * probability rows <ia>..<ib> of <pp>, starting from row <ia>-1 of
+ * <ox>.
+ */
+static void
+oa_rows(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, int ia, int ib)
 {
   register __m128 mpv, dpv, ipv;   /* previous row values                                       */
   register __m128 sv;		   /* temp storage of 1 curr row value in progress              */
@@ -63,7 +181,7 @@ p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *r
   register __m128 xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
   register __m128 dcv;
   float  *xmx = ox->xmx;
-  __m128 *dpc = ox->dpf[0];        /* current row, for use in {MDI}MO(dpp,q) access macro       */
+  __m128 *dpc = ox->dpf[ia-1];     /* current row, for use in {MDI}MO(dpp,q) access macro       */
   __m128 *dpp;                     /* previous row, for use in {MDI}MO(dpp,q) access macro      */
   __m128 *ppp;			   /* quads in the <pp> posterior probability matrix            */
   __m128 *tp;			   /* quads in the <om->tfv> transition scores                  */
@@ -76,16 +194,7 @@ p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *r
   int i;
   float t1, t2;
 
-  ox->M = om->M;
-  ox->L = pp->L;
-  for (q = 0; q < Q; q++) MMO(dpc, q) = IMO(dpc,q) = DMO(dpc,q) = infv;
-  XMXo(0, p7X_E)    = -eslINFINITY;
-  XMXo(0, p7X_N)    = 0.;
-  XMXo(0, p7X_J)    = -eslINFINITY;
-  XMXo(0, p7X_B)    = 0.;
-  XMXo(0, p7X_C)    = -eslINFINITY;
-
-  for (i = 1; i <= pp->L; i++)
+  for (i = ia; i <= ib; i++)
     {
       dpp = dpc;		/* previous DP row in OA matrix */
       dpc = ox->dpf[i];   	/* current DP row in OA matrix  */
@@ -164,9 +273,6 @@ p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *r
       t2 = ( (om->xf[p7O_J][p7O_MOVE] == 0.0) ? 0.0 : ox->xmx[i*p7X_NXCELLS+p7X_J]);
       ox->xmx[i*p7X_NXCELLS+p7X_B] = ESL_MAX(t1, t2);
     }
-
-  *ret_e = ox->xmx[pp->L*p7X_NXCELLS+p7X_C];
-  return eslOK;
 }
 /*------------------- end, OA DP fill ---------------------------*/
 
@@ -178,6 +284,8 @@ p7_OptimalAccuracy(const P7_OPROFILE *om, const P7_OMX *pp, P7_OMX *ox, float *r
  * 2. OA traceback
  *****************************************************************/
 
+static int          oa_trace  (const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *tr);
+static inline void  oa_segment(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int i);
 static inline float get_postprob(const P7_OMX *pp, int scur, int sprv, int k, int i);
 
 static inline int select_m(const P7_OPROFILE *om,                   const P7_OMX *ox, int i, int k);
@@ -223,6 +331,43 @@ static inline int select_b(const P7_OPROFILE *om,                   const P7_OMX
  */
 int
 p7_OATrace(const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *tr)
+{
+  return oa_trace(NULL, om, NULL, pp, ox, tr);
+}
+
+
+/* Function:  p7_OATraceCheckpointed()
+ * Synopsis:  Optimal accuracy decoding: traceback, checkpointed version.
+ *
+ * Purpose:   Same as <p7_OATrace()>, for a checkpointed matrix set
+ *            <ock> that <p7_OptimalAccuracyCheckpointed()> has just
+ *            filled. As the traceback moves up into each earlier
+ *            segment, that segment's posterior probabilities and OA
+ *            scores are recalculated, which is why the digital target
+ *            sequence <dsq> is needed. The trace is identical to that
+ *            of <p7_OATrace()> on full matrices.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINVAL> if the trace <tr> isn't empty (needs to be Reuse()'d).
+ */
+int
+p7_OATraceCheckpointed(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, P7_TRACE *tr)
+{
+  return oa_trace(dsq, om, ock, ock->pp, ock->oa, tr);
+}
+
+
+/* oa_trace()
+ *
+ * The traceback engine for both <p7_OATrace()> (<ock> is NULL) and
+ * <p7_OATraceCheckpointed()>. In the checkpointed case, before the
+ * traceback uses row <i>, the segment containing <i> is made current.
+ * Row <i-1> is then either in the same segment or a checkpoint.
+ */
+static int
+oa_trace(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *tr)
 {
   int   i   = ox->L;		/* position in sequence 1..L */
   int   k   = 0;		/* position in model 1..M */
@@ -238,6 +383,8 @@ p7_OATrace(const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *
   s0 = tr->st[tr->N-1];
   while (s0 != p7T_S)
     {
+      if (ock) oa_segment(dsq, om, ock, i);
+
       switch (s0) {
       case p7T_M: s1 = select_m(om,     ox, i, k);  k--; i--; break;
       case p7T_D: s1 = select_d(om,     ox, i, k);  k--;      break;
@@ -251,6 +398,7 @@ p7_OATrace(const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *
       }
       if (s1 == -1) ESL_EXCEPTION(eslEINVAL, "OA traceback choice failed");
 
+      if (ock) oa_segment(dsq, om, ock, i);
       postprob = get_postprob(pp, s1, s0, k, i);
       if ((status = p7_trace_AppendWithPP(tr, s1, k, i, postprob)) != eslOK) return status;
 
@@ -262,6 +410,23 @@ p7_OATrace(const P7_OPROFILE *om, const P7_OMX *pp, const P7_OMX *ox, P7_TRACE *
   return p7_trace_Reverse(tr);
 }
 
+/* oa_segment()
+ *
+ * In a checkpointed OA traceback, make the posterior probabilities
+ * and OA scores of the segment containing row <i> current, if they
+ * aren't already. Row 0 is always there.
+ */
+static inline void
+oa_segment(const ESL_DSQ *dsq, const P7_OPROFILE *om, P7_OMXCHK *ock, int i)
+{
+  int s = (i-1) / ock->K;
+
+  if (i < 1 || s == ock->oa_seg) return;
+  p7_DecodingSegment(dsq, om, ock, s);
+  oa_rows(om, ock->pp, ock->oa, s*ock->K+1, ESL_MIN(ock->L, (s+1)*ock->K));
+  ock->oa_seg = s;
+}
+
 static inline float
 get_postprob(const P7_OMX *pp, int scur, int sprv, int k, int i)
 {
@@ -575,6 +740,7 @@ main(int argc, char **argv)
 #include "esl_alphabet.h"
 #include "esl_getopts.h"
 #include "esl_random.h"
+#include "esl_randomseq.h"
 /* 
  * 1. Compare accscore to GOptimalAccuracy().
  * 2. Compare trace to GOATrace().
@@ -726,6 +892,98 @@ utest_optacc(ESL_GETOPTS *go, ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, i
   p7_hmm_Destroy(hmm);
 }
 
+/* utest_checkpointed()
+ * 
+ * The checkpointed path through envelope rescoring, as domain
+ * definition runs it, against the full-matrix path: Forward and
+ * Backward scores, every posterior probability (segment by segment),
+ * the OA score and trace, and null2 must all be identical. Half the
+ * sequences are emitted by the model, half are i.i.d.
+ */
+static void
+utest_checkpointed(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char        *msg = "checkpointed optimal accuracy unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_SQ      *sq  = esl_sq_CreateDigital(abc);
+  P7_OMX      *ox1 = p7_omx_Create(M, L, L);
+  P7_OMX      *ox2 = p7_omx_Create(M, L, L);
+  P7_OMXCHK   *ock = p7_omxchk_Create(M, L);
+  P7_TRACE    *tr1 = p7_trace_CreateWithPP();
+  P7_TRACE    *tr2 = p7_trace_CreateWithPP();
+  float       *n2a = malloc(sizeof(float) * abc->Kp);
+  float       *n2b = malloc(sizeof(float) * abc->Kp);
+  float        fsc1, bsc1, oasc1;
+  float        fsc2, bsc2, oasc2;
+  int          s, i, k, st, x;
+
+  if (ock == NULL || n2a == NULL || n2b == NULL)                     esl_fatal(msg);
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
+  while (N--)
+    {
+      if (N % 2) { if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL)          != eslOK) esl_fatal(msg); }
+      else       { if (esl_sq_GrowTo(sq, L)                              != eslOK) esl_fatal(msg);
+	           if (esl_rsq_xfIID(r, bg->f, abc->K, L, sq->dsq)       != eslOK) esl_fatal(msg);
+		   sq->n = L; }
+
+      /* the full-matrix path */
+      if (p7_omx_GrowTo(ox1, M, sq->n, sq->n)                 != eslOK) esl_fatal(msg);
+      if (p7_omx_GrowTo(ox2, M, sq->n, sq->n)                 != eslOK) esl_fatal(msg);
+      if (p7_Forward (sq->dsq, sq->n, om, ox1,      &fsc1)     != eslOK) esl_fatal(msg);
+      if (p7_Backward(sq->dsq, sq->n, om, ox1, ox2, &bsc1)     != eslOK) esl_fatal(msg);
+      if (p7_Decoding(om, ox1, ox2, ox2)                      != eslOK) esl_fatal(msg);
+
+      /* the checkpointed one */
+      if (p7_omxchk_GrowTo(ock, M, sq->n)                     != eslOK) esl_fatal(msg);
+      if (p7_ForwardCheckpointed (sq->dsq, sq->n, om, ock, &fsc2) != eslOK) esl_fatal(msg);
+      if (p7_BackwardCheckpointed(sq->dsq, sq->n, om, ock, &bsc2) != eslOK) esl_fatal(msg);
+      if (p7_DecodingCheckpointed(om, ock)                    != eslOK) esl_fatal(msg);
+      if (fsc1 != fsc2 || bsc1 != bsc2)                                 esl_fatal(msg);
+
+      for (i = 1; i <= sq->n; i++)
+	for (x = 0; x < p7X_NXCELLS; x++)
+	  if (ox2->xmx[i*p7X_NXCELLS+x] != ock->pp->xmx[i*p7X_NXCELLS+x]) esl_fatal(msg);
+      for (s = 0; s < ock->nseg; s++)
+	{
+	  if (p7_DecodingSegment(sq->dsq, om, ock, s) != eslOK) esl_fatal(msg);
+	  for (i = s*ock->K+1; i <= ESL_MIN(sq->n, (s+1)*ock->K); i++)
+	    for (k = 1; k <= M; k++)
+	      for (st = 0; st < p7X_NSCELLS; st++)
+		if (p7_omx_FGetMDI(ox2, st, i, k) != p7_omx_FGetMDI(ock->pp, st, i, k)) esl_fatal(msg);
+	}
+
+      if (p7_OptimalAccuracy(om, ox2, ox1, &oasc1)                 != eslOK) esl_fatal(msg);
+      if (p7_OATrace(om, ox2, ox1, tr1)                            != eslOK) esl_fatal(msg);
+      if (p7_Null2_ByExpectation(om, ox2, n2a)                     != eslOK) esl_fatal(msg);
+      if (p7_OptimalAccuracyCheckpointed(sq->dsq, om, ock, &oasc2) != eslOK) esl_fatal(msg);
+      if (p7_OATraceCheckpointed(sq->dsq, om, ock, tr2)            != eslOK) esl_fatal(msg);
+      if (p7_Null2_ByExpectationCheckpointed(om, ock, n2b)         != eslOK) esl_fatal(msg);
+
+      if (oasc1 != oasc2)                   esl_fatal(msg);
+      if (p7_trace_Compare(tr1, tr2, 0.0) != eslOK) esl_fatal(msg);
+      for (x = 0; x < abc->Kp; x++)
+	if (n2a[x] != n2b[x])               esl_fatal(msg);
+
+      esl_sq_Reuse(sq);
+      p7_trace_Reuse(tr1);
+      p7_trace_Reuse(tr2);
+    }
+
+  free(n2a);
+  free(n2b);
+  p7_trace_Destroy(tr1);
+  p7_trace_Destroy(tr2);
+  p7_omxchk_Destroy(ock);
+  p7_omx_Destroy(ox2);
+  p7_omx_Destroy(ox1);
+  esl_sq_Destroy(sq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
+
 #endif /*p7OPTACC_TESTDRIVE*/
 /*------------------- end, unit tests ---------------------------*/
 
@@ -809,6 +1067,10 @@ main(int argc, char **argv)
   utest_optacc(go, r, abc, bg, 1, L, 10);  
   utest_optacc(go, r, abc, bg, M, 1, 10);  
 
+  utest_checkpointed(r, abc, bg, M,   L,   N);
+  utest_checkpointed(r, abc, bg, 200, 400, 4);   /* many segments, and rescaling */
+  utest_checkpointed(r, abc, bg, M,   1,   4);
+
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
 
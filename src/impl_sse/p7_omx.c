@@ -2,7 +2,8 @@
  * 
  * Contents:
  *   1. The P7_OMX structure: a dynamic programming matrix
- *   2. Debugging dumps of P7_OMX structures
+ *   2. The P7_OMXCHK structure: checkpointed DP matrices
+ *   3. Debugging dumps of P7_OMX structures
  * 
  * See also:
  *   p7_omx.ai - figure illustrating the layout of a P7_OMX.
@@ -72,6 +73,10 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ox->dpf    = NULL;
   ox->xmx    = NULL;
   ox->x_mem  = NULL;
+#ifdef HMMER_AVX512
+  ox->dp512     = NULL;
+  ox->dp512_mem = NULL;
+#endif
 
   /* DP matrix will be allocated for allocL+1 rows 0,1..L; allocQ4*p7X_NSCELLS columns */
   ox->allocR   = allocL+1;
@@ -81,7 +86,7 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ox->allocQ16 = p7O_NQB(allocM);
   ox->ncells   = (int64_t) ox->allocR * (int64_t) ox->allocQ4 * 4;      /* # of DP cells allocated, where 1 cell contains MDI */
 
-  ESL_ALLOC(ox->dp_mem, sizeof(__m128) * (int64_t) ox->allocR * (int64_t) ox->allocQ4 * p7X_NSCELLS + 15);  /* floats always dominate; +15 for alignment */
+  if ((ox->dp_mem = p7_hugemem_Alloc(sizeof(__m128) * (int64_t) ox->allocR * (int64_t) ox->allocQ4 * p7X_NSCELLS + 15)) == NULL) ESL_XEXCEPTION(eslEMEM, "DP matrix allocation failed");  /* floats always dominate; +15 for alignment */
   ESL_ALLOC(ox->dpb,    sizeof(__m128i *) * ox->allocR);
   ESL_ALLOC(ox->dpw,    sizeof(__m128i *) * ox->allocR);
   ESL_ALLOC(ox->dpf,    sizeof(__m128  *) * ox->allocR);
@@ -100,6 +105,13 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ESL_ALLOC(ox->x_mem,  sizeof(float) * ox->allocXR * p7X_NXCELLS + 15); 
   ox->xmx = (float *) ( ( (unsigned long int) ((char *) ox->x_mem  + 15) & (~0xf)));
 
+#ifdef HMMER_AVX512
+  /* one row for the AVX-512 filter/parsers; floats dominate here too; +63 for 64-byte alignment */
+  ox->allocQ512 = p7O_NQF_512(allocM);
+  ESL_ALLOC(ox->dp512_mem, sizeof(__m512) * ox->allocQ512 * p7X_NSCELLS + 63);
+  ox->dp512 = (__m512 *) ( ( (unsigned long int) ((char *) ox->dp512_mem + 63) & (~0x3f)));
+#endif
+
   ox->M              = 0;
   ox->L              = 0;
   ox->totscale       = 0.0;
@@ -151,10 +163,11 @@ p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL)
 
   /* If the main matrix is too small in cells, reallocate it; 
    * and we'll need to realign/reset the row pointers later.
+   * Its contents aren't kept (p7_hugemem_Grow()); it's refilled anyway.
    */
   if (ncells > ox->ncells)
     {
-      ESL_RALLOC(ox->dp_mem, p, sizeof(__m128) * (int64_t) (allocL+1) * (int64_t) nqf * p7X_NSCELLS + 15);
+      if ((ox->dp_mem = p7_hugemem_Grow(ox->dp_mem, sizeof(__m128) * (int64_t) (allocL+1) * (int64_t) nqf * p7X_NSCELLS + 15)) == NULL) ESL_XEXCEPTION(eslEMEM, "DP matrix allocation failed");
       ox->ncells = ncells;
       reset_row_pointers = TRUE;
     }
@@ -206,6 +219,15 @@ p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL)
       ox->allocQ8  = nqw;
       ox->allocQ16 = nqb;
     }
+
+#ifdef HMMER_AVX512
+  if (p7O_NQF_512(allocM) > ox->allocQ512)
+    {
+      ESL_RALLOC(ox->dp512_mem, p, sizeof(__m512) * p7O_NQF_512(allocM) * p7X_NSCELLS + 63);
+      ox->allocQ512 = p7O_NQF_512(allocM);
+      ox->dp512     = (__m512 *) ( ( (unsigned long int) ((char *) ox->dp512_mem + 63) & (~0x3f)));
+    }
+#endif
   
   ox->M = 0;
   ox->L = 0;
@@ -282,6 +304,28 @@ p7_omx_Reuse(P7_OMX *ox)
 
 
 
+/* Function:  p7_omx_Sizeof()
+ * Synopsis:  Returns the allocated size of an optimized DP matrix, in bytes.
+ *
+ * Purpose:   Returns the number of bytes currently allocated for
+ *            optimized DP matrix <ox>: the size it has grown to, not
+ *            the size of the last comparison it held.
+ */
+size_t
+p7_omx_Sizeof(const P7_OMX *ox)
+{
+  size_t n = sizeof(P7_OMX);
+
+  n += sizeof(float) * (size_t) ox->ncells * p7X_NSCELLS + 15;   /* main cells: one cell holds M,D,I */
+  n += sizeof(void *) * (size_t) ox->allocR * 3;                 /* row ptrs   */
+  n += sizeof(float) * (size_t) ox->allocXR * p7X_NXCELLS + 15;  /* specials   */
+#ifdef HMMER_AVX512
+  n += sizeof(__m512) * ox->allocQ512 * p7X_NSCELLS + 63;
+#endif
+  return n;
+}
+
+
 /* Function:  p7_omx_Destroy()
  * Synopsis:  Frees an optimized DP matrix.
  * Incept:    SRE, Tue Nov 27 09:11:42 2007 [Janelia]
@@ -295,10 +339,13 @@ p7_omx_Destroy(P7_OMX *ox)
 {
   if (ox == NULL) return;
   if (ox->x_mem   != NULL) free(ox->x_mem);
-  if (ox->dp_mem  != NULL) free(ox->dp_mem);
+  if (ox->dp_mem  != NULL) p7_hugemem_Free(ox->dp_mem);
   if (ox->dpf     != NULL) free(ox->dpf);
   if (ox->dpw     != NULL) free(ox->dpw);
   if (ox->dpb     != NULL) free(ox->dpb);
+#ifdef HMMER_AVX512
+  if (ox->dp512_mem != NULL) free(ox->dp512_mem);
+#endif
   free(ox);
   return;
 }
@@ -307,7 +354,277 @@ p7_omx_Destroy(P7_OMX *ox)
 
 
 /*****************************************************************
- * 2. Debugging dumps of P7_OMX structures
+ * 2. The P7_OMXCHK structure: checkpointed DP matrices
+ *****************************************************************/
+
+static P7_OMXCHK *omxchk_create(int M, int L, int do_bf16);
+static int        omxchk_layout(P7_OMX *ox, int M, int L, int K, int phase);
+
+/* Function:  p7_omxchk_Create()
+ * Synopsis:  Create a checkpointed set of DP matrices.
+ *
+ * Purpose:   Allocates a reusable, resizeable <P7_OMXCHK> for a
+ *            comparison of a model of length <M> to a target sequence
+ *            (domain envelope) of length <L>, and lays out its
+ *            checkpointed rows for that <L>. Memory is $O(M \sqrt{L})$
+ *            for the main states, and $O(L)$ for the special states.
+ *
+ * Returns:   a pointer to the new <P7_OMXCHK>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_OMXCHK *
+p7_omxchk_Create(int M, int L)
+{
+  return omxchk_create(M, L, FALSE);
+}
+
+
+/* Function:  p7_omxchk_CreateBF16()
+ * Synopsis:  Create a DP matrix set that keeps Forward/Backward in bfloat16.
+ *
+ * Purpose:   Same as <p7_omxchk_Create()>, but the set keeps all rows
+ *            of the Forward and Backward matrices, rounded to
+ *            bfloat16, instead of checkpoints; segments are widened
+ *            back to float on demand rather than recomputed. Memory
+ *            is about half that of the two full float matrices,
+ *            $O(ML)$. The same checkpointed API
+ *            (<p7_ForwardCheckpointed()> and so on) runs on it.
+ *            Scores are identical to the full-matrix ones; posterior
+ *            probabilities are within a relative error of about
+ *            $2^{-8}$.
+ *
+ * Returns:   a pointer to the new <P7_OMXCHK>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_OMXCHK *
+p7_omxchk_CreateBF16(int M, int L)
+{
+  return omxchk_create(M, L, TRUE);
+}
+
+static P7_OMXCHK *
+omxchk_create(int M, int L, int do_bf16)
+{
+  P7_OMXCHK *ock = NULL;
+  int        status;
+
+  ESL_ALLOC(ock, sizeof(P7_OMXCHK));
+  ock->fwd      = NULL;
+  ock->bck      = NULL;
+  ock->pp       = NULL;
+  ock->oa       = NULL;
+  ock->segscale = NULL;
+  ock->allocM   = 0;
+  ock->allocL   = 0;
+  ock->allocS   = 0;
+  ock->do_bf16  = do_bf16;
+  ock->fh       = NULL;
+  ock->bh       = NULL;
+  ock->allocH   = 0;
+
+  if ((ock->fwd = p7_omx_Create(M, 0, L)) == NULL) goto ERROR;
+  if ((ock->bck = p7_omx_Create(M, 0, L)) == NULL) goto ERROR;
+  if ((ock->pp  = p7_omx_Create(M, 0, L)) == NULL) goto ERROR;
+  if ((ock->oa  = p7_omx_Create(M, 0, L)) == NULL) goto ERROR;
+
+  if (p7_omxchk_GrowTo(ock, M, L) != eslOK) goto ERROR;
+  return ock;
+
+ ERROR:
+  p7_omxchk_Destroy(ock);
+  return NULL;
+}
+
+
+/* Function:  p7_omxchk_GrowTo()
+ * Synopsis:  Lay out a checkpointed DP matrix set for a new problem.
+ *
+ * Purpose:   Assures that <ock> is allocated for a model of length up
+ *            to <M> and a target of length <L>, reallocating if
+ *            needed, and lays out checkpointed rows for a target of
+ *            exactly length <L>. Must be called before each new
+ *            comparison of a different length, because the layout
+ *            depends on <L>.
+ *
+ * Returns:   <eslOK> on success. Any data that was in <ock> is
+ *            invalidated.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_omxchk_GrowTo(P7_OMXCHK *ock, int M, int L)
+{
+  int     K    = ESL_MAX(2, (int) ceil(sqrt(0.75 * (double) L)));
+  int     nseg = (L + K - 1) / K;
+  int64_t nh   = (int64_t) (L+1) * (int64_t) p7O_NQF(M) * p7X_NSCELLS * 4;
+  void   *p;
+  int     status;
+
+  /* With bfloat16 storage, fwd and bck need no checkpoints: any segment can be widened from <fh>,<bh> */
+  if ((status = omxchk_layout(ock->fwd, M, L, K, ock->do_bf16 ? -1 : 0)) != eslOK) return status;
+  if ((status = omxchk_layout(ock->bck, M, L, K, ock->do_bf16 ? -1 : 1)) != eslOK) return status;
+  if ((status = omxchk_layout(ock->pp,  M, L, K, -1))                    != eslOK) return status;
+  if ((status = omxchk_layout(ock->oa,  M, L, K, 0))                     != eslOK) return status;
+
+  if (nseg > ock->allocS)
+    {
+      ESL_RALLOC(ock->segscale, p, sizeof(float) * nseg);
+      ock->allocS = nseg;
+    }
+  if (ock->do_bf16 && nh > ock->allocH)
+    {
+      ESL_RALLOC(ock->fh, p, sizeof(uint16_t) * nh);
+      ESL_RALLOC(ock->bh, p, sizeof(uint16_t) * nh);
+      ock->allocH = nh;
+    }
+
+  ock->M       = M;
+  ock->L       = L;
+  ock->K       = K;
+  ock->nseg    = nseg;
+  ock->fwd_seg = ock->bck_seg = ock->pp_seg = ock->oa_seg = -1;
+  ock->allocM  = ESL_MAX(ock->allocM, M);
+  ock->allocL  = ESL_MAX(ock->allocL, L);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_omxchk_Sizeof()
+ * Synopsis:  Returns the allocation size of a checkpointed DP matrix set, in bytes.
+ */
+size_t
+p7_omxchk_Sizeof(const P7_OMXCHK *ock)
+{
+  P7_OMX *oxv[4] = { ock->fwd, ock->bck, ock->pp, ock->oa };
+  size_t  n      = sizeof(P7_OMXCHK);
+  int     m;
+
+  for (m = 0; m < 4; m++)
+    {
+      n += sizeof(P7_OMX);
+      n += oxv[m]->ncells  / 4 * sizeof(__m128) * p7X_NSCELLS;  /* main cells: dp_mem      */
+      n += oxv[m]->allocR  * sizeof(__m128 *);                 /* row ptrs:   dpf[]       */
+      n += oxv[m]->allocXR * sizeof(float) * p7X_NXCELLS;      /* specials:   xmx         */
+    }
+  n += ock->allocS * sizeof(float);			       /* segscale[]              */
+  n += ock->allocH * sizeof(uint16_t) * 2;		       /* fh[], bh[]              */
+  return n;
+}
+
+
+/* Function:  p7_omx_SizeofFull()
+ * Synopsis:  Predict the size of a full optimized DP matrix, in bytes.
+ *
+ * Purpose:   Returns the approximate allocation size of a full
+ *            <P7_OMX> for an <M> by <L> comparison, as created by
+ *            <p7_omx_Create(M, L, L)>. Used to decide when it's worth
+ *            switching to checkpointed matrices.
+ */
+size_t
+p7_omx_SizeofFull(int M, int L)
+{
+  size_t n = sizeof(P7_OMX);
+
+  n += (size_t) (L+1) * (size_t) p7O_NQF(M) * p7X_NSCELLS * sizeof(__m128);  /* main cells   */
+  n += (size_t) (L+1) * 3 * sizeof(void *);                                  /* row ptrs     */
+  n += (size_t) (L+1) * p7X_NXCELLS * sizeof(float);                         /* specials     */
+  return n;
+}
+
+
+/* Function:  p7_omxchk_Destroy()
+ * Synopsis:  Frees a checkpointed DP matrix set.
+ *
+ * Returns:   (void)
+ */
+void
+p7_omxchk_Destroy(P7_OMXCHK *ock)
+{
+  if (ock == NULL) return;
+  p7_omx_Destroy(ock->fwd);
+  p7_omx_Destroy(ock->bck);
+  p7_omx_Destroy(ock->pp);
+  p7_omx_Destroy(ock->oa);
+  if (ock->segscale != NULL) free(ock->segscale);
+  if (ock->fh       != NULL) free(ock->fh);
+  if (ock->bh       != NULL) free(ock->bh);
+  free(ock);
+  return;
+}
+
+
+/* omxchk_layout()
+ *
+ * Lay out one of the matrices of a <P7_OMXCHK> for an <M> by <L>
+ * problem with segment width <K>. Logical row 0 is always physical
+ * row 0. Logical rows i with i%K == <phase> are checkpoints, each
+ * with its own physical row; <phase> -1 means none. All other
+ * logical rows 1..L share a buffer of <K> physical rows, slot
+ * (i-1)%K, which holds one segment at a time.
+ *
+ * Only <dpf> is laid out; <dpb> and <dpw> are left as the one row
+ * that <p7_omx_Create()> made, since no 8- or 16-bit filter runs on
+ * these matrices. <allocR> and <validR> count logical rows.
+ */
+static int
+omxchk_layout(P7_OMX *ox, int M, int L, int K, int phase)
+{
+  int     Q     = p7O_NQF(M);
+  int     nchk  = 0;
+  int64_t nrows;
+  int64_t ncells;
+  void   *p;
+  int     i, c;
+  int     status;
+
+  for (i = 1; i <= L; i++) if (i % K == phase) nchk++;
+  nrows  = 1 + nchk + K;
+  ncells = nrows * (int64_t) Q * 4;
+
+  if (ncells > ox->ncells)
+    {
+      if ((ox->dp_mem = p7_hugemem_Grow(ox->dp_mem, sizeof(__m128) * nrows * (int64_t) Q * p7X_NSCELLS + 15)) == NULL) ESL_XEXCEPTION(eslEMEM, "DP matrix allocation failed");
+      ox->ncells = ncells;
+    }
+  if (L+1 > ox->allocR)
+    {
+      ESL_RALLOC(ox->dpf, p, sizeof(__m128 *) * (L+1));
+      ox->allocR = L+1;
+    }
+  if (L+1 > ox->allocXR)
+    {
+      ESL_RALLOC(ox->x_mem, p, sizeof(float) * (L+1) * p7X_NXCELLS + 15);
+      ox->allocXR = L+1;
+      ox->xmx     = (float *) ( ( (unsigned long int) ((char *) ox->x_mem + 15) & (~0xf)));
+    }
+
+  ox->dpf[0] = (__m128 *) ( ( (unsigned long int) ((char *) ox->dp_mem + 15) & (~0xf)));
+  for (c = 0, i = 1; i <= L; i++)
+    {
+      if (i % K == phase) ox->dpf[i] = ox->dpf[0] + (int64_t) (1 + c++)              * (int64_t) Q * p7X_NSCELLS;
+      else                ox->dpf[i] = ox->dpf[0] + (int64_t) (1 + nchk + (i-1) % K) * (int64_t) Q * p7X_NSCELLS;
+    }
+
+  ox->allocQ4 = Q;
+  ox->validR  = L+1;
+  ox->M       = 0;
+  ox->L       = 0;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+/*----------------- end, P7_OMXCHK structure --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Debugging dumps of P7_OMX structures
  *****************************************************************/
 /* Because the P7_OMX may be a one-row DP matrix, we can't just run a
  * DP calculation and then dump a whole matrix; we have to dump each
@@ -54,6 +54,13 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   int          nqw = p7O_NQW(allocM); /* # of sword vectors needed for query */
   int          nqf = p7O_NQF(allocM); /* # of float vectors needed for query */
   int          nqs = nqb + p7O_EXTRA_SB;
+#ifdef HMMER_AVX2
+  int          nqa = p7O_NQB_AVX(allocM); /* # of 32-uchar AVX2 vectors needed */
+#endif
+#ifdef HMMER_AVX512
+  int          nqw5 = p7O_NQW_512(allocM); /* # of 32-sword AVX-512 vectors needed */
+  int          nqf5 = p7O_NQF_512(allocM); /* # of 16-float AVX-512 vectors needed */
+#endif
   int          x;
 
   /* level 0 */
@@ -70,6 +77,22 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   om->twv     = NULL;
   om->rfv     = NULL;
   om->tfv     = NULL;
+#ifdef HMMER_AVX2
+  om->rbv_avx_mem = NULL;
+  om->sbv_avx_mem = NULL;
+  om->rbv_avx     = NULL;
+  om->sbv_avx     = NULL;
+#endif
+#ifdef HMMER_AVX512
+  om->rwv_512_mem = NULL;
+  om->twv_512_mem = NULL;
+  om->rfv_512_mem = NULL;
+  om->tfv_512_mem = NULL;
+  om->rwv_512     = NULL;
+  om->twv_512     = NULL;
+  om->rfv_512     = NULL;
+  om->tfv_512     = NULL;
+#endif
   om->clone   = 0;
 
   /* level 1 */
@@ -104,6 +127,41 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   om->allocQ8   = nqw;
   om->allocQ4   = nqf;
 
+#ifdef HMMER_AVX2
+  /* AVX2 copies of the MSV/SSV scores, aligned on 32-byte boundaries */
+  ESL_ALLOC(om->rbv_avx_mem, sizeof(__m256i) * nqa                  * abc->Kp +31);
+  ESL_ALLOC(om->sbv_avx_mem, sizeof(__m256i) * (nqa + p7O_EXTRA_SB) * abc->Kp +31);
+  ESL_ALLOC(om->rbv_avx,     sizeof(__m256i *) * abc->Kp);
+  ESL_ALLOC(om->sbv_avx,     sizeof(__m256i *) * abc->Kp);
+  om->rbv_avx[0] = (__m256i *) (((unsigned long int) om->rbv_avx_mem + 31) & (~0x1f));
+  om->sbv_avx[0] = (__m256i *) (((unsigned long int) om->sbv_avx_mem + 31) & (~0x1f));
+  for (x = 1; x < abc->Kp; x++) {
+    om->rbv_avx[x] = om->rbv_avx[0] + (x * nqa);
+    om->sbv_avx[x] = om->sbv_avx[0] + (x * (nqa + p7O_EXTRA_SB));
+  }
+  om->allocQ32  = nqa;
+#endif
+
+#ifdef HMMER_AVX512
+  /* AVX-512 copies of the Viterbi and Fwd/Bck scores, aligned on 64-byte boundaries */
+  ESL_ALLOC(om->rwv_512_mem, sizeof(__m512i) * nqw5 * abc->Kp    +63);
+  ESL_ALLOC(om->twv_512_mem, sizeof(__m512i) * nqw5 * p7O_NTRANS +63);
+  ESL_ALLOC(om->rfv_512_mem, sizeof(__m512)  * nqf5 * abc->Kp    +63);
+  ESL_ALLOC(om->tfv_512_mem, sizeof(__m512)  * nqf5 * p7O_NTRANS +63);
+  ESL_ALLOC(om->rwv_512,     sizeof(__m512i *) * abc->Kp);
+  ESL_ALLOC(om->rfv_512,     sizeof(__m512  *) * abc->Kp);
+  om->rwv_512[0] = (__m512i *) (((unsigned long int) om->rwv_512_mem + 63) & (~0x3f));
+  om->twv_512    = (__m512i *) (((unsigned long int) om->twv_512_mem + 63) & (~0x3f));
+  om->rfv_512[0] = (__m512  *) (((unsigned long int) om->rfv_512_mem + 63) & (~0x3f));
+  om->tfv_512    = (__m512  *) (((unsigned long int) om->tfv_512_mem + 63) & (~0x3f));
+  for (x = 1; x < abc->Kp; x++) {
+    om->rwv_512[x] = om->rwv_512[0] + (x * nqw5);
+    om->rfv_512[x] = om->rfv_512[0] + (x * nqf5);
+  }
+  om->allocQ32w = nqw5;
+  om->allocQ16f = nqf5;
+#endif
+
   /* Remaining initializations */
   om->tbm_b     = 0;
   om->tec_b     = 0;
@@ -188,6 +246,20 @@ p7_oprofile_Destroy(P7_OPROFILE *om)
       if (om->sbv       != NULL) free(om->sbv);
       if (om->rwv       != NULL) free(om->rwv);
       if (om->rfv       != NULL) free(om->rfv);
+#ifdef HMMER_AVX2
+      if (om->rbv_avx_mem != NULL) free(om->rbv_avx_mem);
+      if (om->sbv_avx_mem != NULL) free(om->sbv_avx_mem);
+      if (om->rbv_avx     != NULL) free(om->rbv_avx);
+      if (om->sbv_avx     != NULL) free(om->sbv_avx);
+#endif
+#ifdef HMMER_AVX512
+      if (om->rwv_512_mem != NULL) free(om->rwv_512_mem);
+      if (om->twv_512_mem != NULL) free(om->twv_512_mem);
+      if (om->rfv_512_mem != NULL) free(om->rfv_512_mem);
+      if (om->tfv_512_mem != NULL) free(om->tfv_512_mem);
+      if (om->rwv_512     != NULL) free(om->rwv_512);
+      if (om->rfv_512     != NULL) free(om->rfv_512);
+#endif
       if (om->name      != NULL) free(om->name);
       if (om->acc       != NULL) free(om->acc);
       if (om->desc      != NULL) free(om->desc);
@@ -220,20 +292,37 @@ p7_oprofile_Sizeof(P7_OPROFILE *om)
    * p7_oprofile_Create(); so even though we could
    * write this more compactly, leave it like this
    * w/ one:one correspondence to _Create(), for
-   * maintainability and clarity.
+   * maintainability and clarity. Score vectors that
+   * point into a mapped file instead, or that
+   * p7_oprofile_FreeRest() freed, aren't counted.
    */
   n  += sizeof(P7_OPROFILE);
-  n  += sizeof(__m128i) * nqb  * om->abc->Kp +15; /* om->rbv_mem   */
-  n  += sizeof(__m128i) * nqs  * om->abc->Kp +15; /* om->sbv_mem   */
-  n  += sizeof(__m128i) * nqw  * om->abc->Kp +15; /* om->rwv_mem   */
-  n  += sizeof(__m128i) * nqw  * p7O_NTRANS  +15; /* om->twv_mem   */
-  n  += sizeof(__m128)  * nqf  * om->abc->Kp +15; /* om->rfv_mem   */
-  n  += sizeof(__m128)  * nqf  * p7O_NTRANS  +15; /* om->tfv_mem   */
+  if (om->rbv_mem) n  += sizeof(__m128i) * nqb  * om->abc->Kp +15; /* om->rbv_mem   */
+  if (om->sbv_mem) n  += sizeof(__m128i) * nqs  * om->abc->Kp +15; /* om->sbv_mem   */
+  if (om->rwv_mem) n  += sizeof(__m128i) * nqw  * om->abc->Kp +15; /* om->rwv_mem   */
+  if (om->twv_mem) n  += sizeof(__m128i) * nqw  * p7O_NTRANS  +15; /* om->twv_mem   */
+  if (om->rfv_mem) n  += sizeof(__m128)  * nqf  * om->abc->Kp +15; /* om->rfv_mem   */
+  if (om->tfv_mem) n  += sizeof(__m128)  * nqf  * p7O_NTRANS  +15; /* om->tfv_mem   */
   
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->rbv       */
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->sbv       */
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->rwv       */
   n  += sizeof(__m128  *) * om->abc->Kp;          /* om->rfv       */
+
+#ifdef HMMER_AVX2
+  n  += sizeof(__m256i) * om->allocQ32                  * om->abc->Kp +31; /* om->rbv_avx_mem */
+  n  += sizeof(__m256i) * (om->allocQ32 + p7O_EXTRA_SB) * om->abc->Kp +31; /* om->sbv_avx_mem */
+  n  += sizeof(__m256i *) * om->abc->Kp;                                     /* om->rbv_avx     */
+  n  += sizeof(__m256i *) * om->abc->Kp;                                     /* om->sbv_avx     */
+#endif
+#ifdef HMMER_AVX512
+  if (om->rwv_512_mem) n  += sizeof(__m512i) * om->allocQ32w * om->abc->Kp +63; /* om->rwv_512_mem */
+  if (om->twv_512_mem) n  += sizeof(__m512i) * om->allocQ32w * p7O_NTRANS  +63; /* om->twv_512_mem */
+  if (om->rfv_512_mem) n  += sizeof(__m512)  * om->allocQ16f * om->abc->Kp +63; /* om->rfv_512_mem */
+  if (om->tfv_512_mem) n  += sizeof(__m512)  * om->allocQ16f * p7O_NTRANS  +63; /* om->tfv_512_mem */
+  n  += sizeof(__m512i *) * om->abc->Kp;                   /* om->rwv_512     */
+  n  += sizeof(__m512  *) * om->abc->Kp;                   /* om->rfv_512     */
+#endif
   
   n  += sizeof(char) * (om->allocM+2);            /* om->rf        */
   n  += sizeof(char) * (om->allocM+2);            /* om->mm        */
@@ -244,6 +333,112 @@ p7_oprofile_Sizeof(P7_OPROFILE *om)
 }
 
 
+/* Function:  p7_oprofile_FreeRest()
+ * Synopsis:  Free all but the MSV filter part of a profile.
+ *
+ * Purpose:   Free the Viterbi filter and Forward/Backward score
+ *            vectors of <om>, and its accession and description,
+ *            leaving only what <p7_oprofile_ReadMSV()> read. Score
+ *            vectors that point into a mapped <.h3p> file are let go
+ *            of, not freed. A later <p7_oprofile_ReadRest()> makes
+ *            <om> complete again.
+ *
+ *            Used by a lazy profile cache (<p7_hmmcache_OpenLazy()>)
+ *            to hold only the MSV part of profiles that are seldom
+ *            needed past the MSV filter.
+ */
+void
+p7_oprofile_FreeRest(P7_OPROFILE *om)
+{
+  int x;
+
+  if (om->clone) return;
+  if (om->rwv_mem) free(om->rwv_mem);
+  if (om->twv_mem) free(om->twv_mem);
+  if (om->rfv_mem) free(om->rfv_mem);
+  if (om->tfv_mem) free(om->tfv_mem);
+  om->rwv_mem = om->twv_mem = NULL;
+  om->rfv_mem = om->tfv_mem = NULL;
+  om->twv     = NULL;
+  om->tfv     = NULL;
+  for (x = 0; x < om->abc->Kp; x++) { om->rwv[x] = NULL; om->rfv[x] = NULL; }
+#ifdef HMMER_AVX512
+  if (om->rwv_512_mem) free(om->rwv_512_mem);
+  if (om->twv_512_mem) free(om->twv_512_mem);
+  if (om->rfv_512_mem) free(om->rfv_512_mem);
+  if (om->tfv_512_mem) free(om->tfv_512_mem);
+  om->rwv_512_mem = om->twv_512_mem = NULL;
+  om->rfv_512_mem = om->tfv_512_mem = NULL;
+  om->twv_512     = NULL;
+  om->tfv_512     = NULL;
+  for (x = 0; x < om->abc->Kp; x++) { om->rwv_512[x] = NULL; om->rfv_512[x] = NULL; }
+#endif
+  if (om->acc)  { free(om->acc);  om->acc  = NULL; }
+  if (om->desc) { free(om->desc); om->desc = NULL; }
+}
+
+
+/* Function:  p7_oprofile_AllocRest()
+ * Synopsis:  Reallocate what p7_oprofile_FreeRest() freed.
+ *
+ * Purpose:   Allocate the Viterbi filter and Forward/Backward score
+ *            vectors of <om> again, where <p7_oprofile_FreeRest()>
+ *            left none, for <p7_oprofile_ReadRest()> to read into.
+ *            Vectors that are allocated, or that point into a mapped
+ *            file, are left alone.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_oprofile_AllocRest(P7_OPROFILE *om)
+{
+  int nqw = om->allocQ8;
+  int nqf = om->allocQ4;
+  int x;
+  int status;
+
+  if (om->twv == NULL)
+    {
+      ESL_ALLOC(om->rwv_mem, sizeof(__m128i) * nqw  * om->abc->Kp      +15);
+      ESL_ALLOC(om->twv_mem, sizeof(__m128i) * nqw  * p7O_NTRANS       +15);
+      om->rwv[0] = (__m128i *) (((unsigned long int) om->rwv_mem + 15) & (~0xf));
+      om->twv    = (__m128i *) (((unsigned long int) om->twv_mem + 15) & (~0xf));
+      for (x = 1; x < om->abc->Kp; x++) om->rwv[x] = om->rwv[0] + (x * nqw);
+    }
+  if (om->tfv == NULL)
+    {
+      ESL_ALLOC(om->rfv_mem, sizeof(__m128)  * nqf  * om->abc->Kp      +15);
+      ESL_ALLOC(om->tfv_mem, sizeof(__m128)  * nqf  * p7O_NTRANS       +15);
+      om->rfv[0] = (__m128  *) (((unsigned long int) om->rfv_mem + 15) & (~0xf));
+      om->tfv    = (__m128  *) (((unsigned long int) om->tfv_mem + 15) & (~0xf));
+      for (x = 1; x < om->abc->Kp; x++) om->rfv[x] = om->rfv[0] + (x * nqf);
+    }
+#ifdef HMMER_AVX512
+  if (om->twv_512 == NULL)
+    {
+      ESL_ALLOC(om->rwv_512_mem, sizeof(__m512i) * om->allocQ32w * om->abc->Kp    +63);
+      ESL_ALLOC(om->twv_512_mem, sizeof(__m512i) * om->allocQ32w * p7O_NTRANS     +63);
+      ESL_ALLOC(om->rfv_512_mem, sizeof(__m512)  * om->allocQ16f * om->abc->Kp    +63);
+      ESL_ALLOC(om->tfv_512_mem, sizeof(__m512)  * om->allocQ16f * p7O_NTRANS     +63);
+      om->rwv_512[0] = (__m512i *) (((unsigned long int) om->rwv_512_mem + 63) & (~0x3f));
+      om->twv_512    = (__m512i *) (((unsigned long int) om->twv_512_mem + 63) & (~0x3f));
+      om->rfv_512[0] = (__m512  *) (((unsigned long int) om->rfv_512_mem + 63) & (~0x3f));
+      om->tfv_512    = (__m512  *) (((unsigned long int) om->tfv_512_mem + 63) & (~0x3f));
+      for (x = 1; x < om->abc->Kp; x++) {
+	om->rwv_512[x] = om->rwv_512[0] + (x * om->allocQ32w);
+	om->rfv_512[x] = om->rfv_512[0] + (x * om->allocQ16f);
+      }
+    }
+#endif
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
 /* TODO: this is not following the _Copy interface guidelines; it's a _Clone */
 /* TODO: its documentation header is a cut/paste of _Create; FIXME */
 /* Function:  p7_oprofile_Copy()
@@ -264,6 +459,13 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   int           nqw  = p7O_NQW(om1->allocM); /* # of sword vectors needed for query */
   int           nqf  = p7O_NQF(om1->allocM); /* # of float vectors needed for query */
   int           nqs  = nqb + p7O_EXTRA_SB;
+#ifdef HMMER_AVX2
+  int           nqa  = p7O_NQB_AVX(om1->allocM); /* # of 32-uchar AVX2 vectors needed */
+#endif
+#ifdef HMMER_AVX512
+  int           nqw5 = p7O_NQW_512(om1->allocM); /* # of 32-sword AVX-512 vectors needed */
+  int           nqf5 = p7O_NQF_512(om1->allocM); /* # of 16-float AVX-512 vectors needed */
+#endif
 
   size_t        size = sizeof(char) * (om1->allocM+2);
 
@@ -285,6 +487,22 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->twv     = NULL;
   om2->rfv     = NULL;
   om2->tfv     = NULL;
+#ifdef HMMER_AVX2
+  om2->rbv_avx_mem = NULL;
+  om2->sbv_avx_mem = NULL;
+  om2->rbv_avx     = NULL;
+  om2->sbv_avx     = NULL;
+#endif
+#ifdef HMMER_AVX512
+  om2->rwv_512_mem = NULL;
+  om2->twv_512_mem = NULL;
+  om2->rfv_512_mem = NULL;
+  om2->tfv_512_mem = NULL;
+  om2->rwv_512     = NULL;
+  om2->twv_512     = NULL;
+  om2->rfv_512     = NULL;
+  om2->tfv_512     = NULL;
+#endif
 
   /* level 1 */
   ESL_ALLOC(om2->rbv_mem, sizeof(__m128i) * nqb  * abc->Kp    +15);	/* +15 is for manual 16-byte alignment */
@@ -324,6 +542,45 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->allocQ8   = nqw;
   om2->allocQ4   = nqf;
 
+#ifdef HMMER_AVX2
+  ESL_ALLOC(om2->rbv_avx_mem, sizeof(__m256i) * nqa                  * abc->Kp +31);
+  ESL_ALLOC(om2->sbv_avx_mem, sizeof(__m256i) * (nqa + p7O_EXTRA_SB) * abc->Kp +31);
+  ESL_ALLOC(om2->rbv_avx,     sizeof(__m256i *) * abc->Kp);
+  ESL_ALLOC(om2->sbv_avx,     sizeof(__m256i *) * abc->Kp);
+  om2->rbv_avx[0] = (__m256i *) (((unsigned long int) om2->rbv_avx_mem + 31) & (~0x1f));
+  om2->sbv_avx[0] = (__m256i *) (((unsigned long int) om2->sbv_avx_mem + 31) & (~0x1f));
+  memcpy(om2->rbv_avx[0], om1->rbv_avx[0], sizeof(__m256i) * nqa                  * abc->Kp);
+  memcpy(om2->sbv_avx[0], om1->sbv_avx[0], sizeof(__m256i) * (nqa + p7O_EXTRA_SB) * abc->Kp);
+  for (x = 1; x < abc->Kp; x++) {
+    om2->rbv_avx[x] = om2->rbv_avx[0] + (x * nqa);
+    om2->sbv_avx[x] = om2->sbv_avx[0] + (x * (nqa + p7O_EXTRA_SB));
+  }
+  om2->allocQ32  = nqa;
+#endif
+
+#ifdef HMMER_AVX512
+  ESL_ALLOC(om2->rwv_512_mem, sizeof(__m512i) * nqw5 * abc->Kp    +63);
+  ESL_ALLOC(om2->twv_512_mem, sizeof(__m512i) * nqw5 * p7O_NTRANS +63);
+  ESL_ALLOC(om2->rfv_512_mem, sizeof(__m512)  * nqf5 * abc->Kp    +63);
+  ESL_ALLOC(om2->tfv_512_mem, sizeof(__m512)  * nqf5 * p7O_NTRANS +63);
+  ESL_ALLOC(om2->rwv_512,     sizeof(__m512i *) * abc->Kp);
+  ESL_ALLOC(om2->rfv_512,     sizeof(__m512  *) * abc->Kp);
+  om2->rwv_512[0] = (__m512i *) (((unsigned long int) om2->rwv_512_mem + 63) & (~0x3f));
+  om2->twv_512    = (__m512i *) (((unsigned long int) om2->twv_512_mem + 63) & (~0x3f));
+  om2->rfv_512[0] = (__m512  *) (((unsigned long int) om2->rfv_512_mem + 63) & (~0x3f));
+  om2->tfv_512    = (__m512  *) (((unsigned long int) om2->tfv_512_mem + 63) & (~0x3f));
+  memcpy(om2->rwv_512[0], om1->rwv_512[0], sizeof(__m512i) * nqw5 * abc->Kp);
+  memcpy(om2->twv_512,    om1->twv_512,    sizeof(__m512i) * nqw5 * p7O_NTRANS);
+  memcpy(om2->rfv_512[0], om1->rfv_512[0], sizeof(__m512)  * nqf5 * abc->Kp);
+  memcpy(om2->tfv_512,    om1->tfv_512,    sizeof(__m512)  * nqf5 * p7O_NTRANS);
+  for (x = 1; x < abc->Kp; x++) {
+    om2->rwv_512[x] = om2->rwv_512[0] + (x * nqw5);
+    om2->rfv_512[x] = om2->rfv_512[0] + (x * nqf5);
+  }
+  om2->allocQ32w = nqw5;
+  om2->allocQ16f = nqf5;
+#endif
+
   /* Remaining initializations */
   om2->tbm_b     = om1->tbm_b;
   om2->tec_b     = om1->tec_b;
@@ -396,6 +653,15 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
  *
  * Purpose:   Quick copy of an optimized profile used in mutiple threads.
  *
+ *            Only the <P7_OPROFILE> structure itself is copied. The
+ *            score vectors and annotation stay shared with <om1>,
+ *            and must be treated as read-only while any clone is in
+ *            use; <om1> must outlive its clones. What each clone owns
+ *            is the length-dependent configuration that
+ *            <p7_oprofile_ReconfigLength()> sets for every target
+ *            (<L>, <tjb_b>, <xw>, <xf>), so each search thread can
+ *            reconfigure its own clone without copying the model.
+ *
  * Throws:    <NULL> on allocation error.
  */
 P7_OPROFILE *
@@ -481,7 +747,11 @@ p7_oprofile_UpdateFwdEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
     }
   }
 
+#ifdef HMMER_AVX512
+  return p7_oprofile_Convert512(om);
+#else
   return eslOK;
+#endif
 }
 
 
@@ -550,7 +820,11 @@ p7_oprofile_UpdateVitEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
     }
   }
 
+#ifdef HMMER_AVX512
+  return p7_oprofile_Convert512(om);
+#else
   return eslOK;
+#endif
 }
 
 
@@ -757,6 +1031,9 @@ sf_conversion(P7_OPROFILE *om)
       for (q = nq; q < nq + p7O_EXTRA_SB; q++) om->sbv[x][q] = om->sbv[x][q % nq];
     }
 
+#ifdef HMMER_AVX2
+  p7_oprofile_ConvertAVX(om);
+#endif
   return eslOK;
 }
 
@@ -1028,6 +1305,9 @@ p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om)
   if ((status =  mf_conversion(gm, om)) != eslOK) return status;   /* MSVFilter()'s information     */
   if ((status =  vf_conversion(gm, om)) != eslOK) return status;   /* ViterbiFilter()'s information */
   if ((status =  fb_conversion(gm, om)) != eslOK) return status;   /* ForwardFilter()'s information */
+#ifdef HMMER_AVX512
+  if ((status = p7_oprofile_Convert512(om)) != eslOK) return status; /* AVX-512 copies of VF, FB scores */
+#endif
 
   if (om->name != NULL) free(om->name);
   if (om->acc  != NULL) free(om->acc);
@@ -1049,6 +1329,146 @@ p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om)
   return status;
 }
 
+#ifdef HMMER_AVX2
+/* Function:  p7_oprofile_ConvertAVX()
+ * Synopsis:  Restripe MSV/SSV scores for the AVX2 filters.
+ *
+ * Purpose:   Fill <om->rbv_avx> and <om->sbv_avx> from the 16-way
+ *            striped <om->rbv>, using 32-way striping with
+ *            Q = p7O_NQB_AVX(M) vectors. Padding cells beyond M get
+ *            the prohibited cost 255 (unsigned), and the SSV scores
+ *            get the same signed <rbv - bias> transformation as
+ *            <sf_conversion()>, plus the <p7O_EXTRA_SB> wraparound
+ *            vectors the register-banded SSV kernel needs.
+ *
+ *            This is plain C and needs no AVX2 instructions, so it
+ *            is safe to call on any host. It is called from
+ *            <sf_conversion()> (so <p7_oprofile_Convert()> and
+ *            <p7_oprofile_UpdateMSVEmissionScores()> keep the AVX2
+ *            scores in sync), and after the MSV part of a profile
+ *            is read from a pressed file or an MPI message.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <om> hasn't been allocated large enough.
+ */
+int
+p7_oprofile_ConvertAVX(P7_OPROFILE *om)
+{
+  int      M   = om->M;
+  int      nq  = p7O_NQB(M);      /* 16-way segment length  */
+  int      nqa = p7O_NQB_AVX(M);  /* 32-way segment length  */
+  uint8_t  bias127 = om->bias_b + 127;
+  uint8_t *rb;
+  uint8_t *ra;
+  uint8_t *sa;
+  int      x, k, q, z;
+  int      b;
+
+  if (nqa > om->allocQ32) ESL_EXCEPTION(eslEINVAL, "optimized profile is too small to hold AVX2 conversion");
+
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      rb = (uint8_t *) om->rbv[x];
+      ra = (uint8_t *) om->rbv_avx[x];
+      sa = (uint8_t *) om->sbv_avx[x];
+
+      for (q = 0; q < nqa; q++)
+	for (z = 0; z < 32; z++)
+	  {
+	    k = q + z*nqa;     /* k is 0..; node k+1 */
+	    ra[q*32+z] = (k < M) ? rb[(k % nq) * 16 + (k / nq)] : 255;
+
+	    /* ((127 + bias) -(sat) rbv) ^ 127, as in sf_conversion() */
+	    b = (int) bias127 - (int) ra[q*32+z];
+	    sa[q*32+z] = (uint8_t) (ESL_MAX(b, 0) ^ 127);
+	  }
+      for (q = nqa; q < nqa + p7O_EXTRA_SB; q++) memcpy(sa + q*32, sa + (q % nqa)*32, 32);
+    }
+  return eslOK;
+}
+#endif /*HMMER_AVX2*/
+
+#ifdef HMMER_AVX512
+/* restripe()
+ * Copy one striped score vector set of logical length <M> from <W1>-wide
+ * vectors (segment length <Q1>) to <W2>-wide ones (<Q2>). Element z of
+ * vector q holds logical index q + z*Q in both layouts; vector q starts
+ * at byte offset q*<step> from its base, so interleaved transitions can
+ * be restriped one type at a time. Cells with logical index >= <M> get
+ * the <esz>-byte value <pad>.
+ */
+static void
+restripe(const void *src, size_t step1, int Q1, int W1,
+	 void       *dst, size_t step2, int Q2, int W2,
+	 int M, size_t esz, const void *pad)
+{
+  const char *s = (const char *) src;
+  char       *d = (char *) dst;
+  int         q, z, i;
+
+  for (q = 0; q < Q2; q++)
+    for (z = 0; z < W2; z++)
+      {
+	i = q + z*Q2;
+	if (i < M) memcpy(d + q*step2 + z*esz, s + (i % Q1)*step1 + (i / Q1)*esz, esz);
+	else       memcpy(d + q*step2 + z*esz, pad,                               esz);
+      }
+}
+
+/* Function:  p7_oprofile_Convert512()
+ * Synopsis:  Restripe Viterbi and Fwd/Bck scores for AVX-512.
+ *
+ * Purpose:   Fill <om->rwv_512>, <om->twv_512>, <om->rfv_512> and
+ *            <om->tfv_512> from the SSE-striped <om->rwv>, <om->twv>,
+ *            <om->rfv> and <om->tfv>, using 32-way (words) and 16-way
+ *            (floats) striping with Q = p7O_NQW_512(M) and
+ *            p7O_NQF_512(M). Transition vectors keep the same
+ *            interleaved order: 7 per q, then the Q DD's. Padding 
+ *            cells get -32768 (words) or 0.0 (odds ratios).
+ *
+ *            Like <p7_oprofile_ConvertAVX()> this is plain C, safe on
+ *            any host. It is called at the end of
+ *            <p7_oprofile_Convert()>, of the Fwd and Vit emission
+ *            updates, and after the rest of a profile is read from a
+ *            pressed file or an MPI message.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <om> hasn't been allocated large enough.
+ */
+int
+p7_oprofile_Convert512(P7_OPROFILE *om)
+{
+  int     M     = om->M;
+  int     nqw   = p7O_NQW(M);
+  int     nqf   = p7O_NQF(M);
+  int     nqw5  = p7O_NQW_512(M);
+  int     nqf5  = p7O_NQF_512(M);
+  int16_t wpad  = -32768;
+  float   fpad  = 0.0;
+  int     x, t;
+
+  if (nqw5 > om->allocQ32w || nqf5 > om->allocQ16f) ESL_EXCEPTION(eslEINVAL, "optimized profile is too small to hold AVX-512 conversion");
+
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      restripe(om->rwv[x], sizeof(__m128i), nqw,  8, om->rwv_512[x], sizeof(__m512i), nqw5, 32, M, sizeof(int16_t), &wpad);
+      restripe(om->rfv[x], sizeof(__m128),  nqf,  4, om->rfv_512[x], sizeof(__m512),  nqf5, 16, M, sizeof(float),   &fpad);
+    }
+
+  for (t = p7O_BM; t <= p7O_II; t++)
+    {
+      restripe(om->twv + t, 7*sizeof(__m128i), nqw, 8, om->twv_512 + t, 7*sizeof(__m512i), nqw5, 32, M, sizeof(int16_t), &wpad);
+      restripe(om->tfv + t, 7*sizeof(__m128),  nqf, 4, om->tfv_512 + t, 7*sizeof(__m512),  nqf5, 16, M, sizeof(float),   &fpad);
+    }
+  restripe(om->twv + 7*nqw, sizeof(__m128i), nqw, 8, om->twv_512 + 7*nqw5, sizeof(__m512i), nqw5, 32, M, sizeof(int16_t), &wpad);
+  restripe(om->tfv + 7*nqf, sizeof(__m128),  nqf, 4, om->tfv_512 + 7*nqf5, sizeof(__m512),  nqf5, 16, M, sizeof(float),   &fpad);
+  return eslOK;
+}
+#endif /*HMMER_AVX512*/
+
+
 /* Function:  p7_oprofile_ReconfigLength()
  * Synopsis:  Set the target sequence length of a model.
  * Incept:    SRE, Thu Dec 20 09:56:40 2007 [Janelia]
@@ -1136,6 +1556,47 @@ p7_oprofile_ReconfigRestLength(P7_OPROFILE *om, int L)
 }
 
 
+/* Function:  p7_oprofile_SetMSVLength()
+ * Synopsis:  Set the MSV part's target length from precalculated parameters.
+ *
+ * Purpose:   Same as <p7_oprofile_ReconfigMSVLength(om, lp->L)>, using
+ *            the log that <p7_LengthParams()> already calculated in
+ *            <lp>. A scan configures every model for the same query
+ *            length, so this takes the log out of the per-model work.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_SetMSVLength(P7_OPROFILE *om, const P7_LENPARAM *lp)
+{
+  om->tjb_b = unbiased_byteify(om, lp->msvmove);
+  return eslOK;
+}
+
+/* Function:  p7_oprofile_SetRestLength()
+ * Synopsis:  Set the main profile's target length from precalculated parameters.
+ *
+ * Purpose:   Same as <p7_oprofile_ReconfigRestLength(om, lp->L)>, using
+ *            the parameters that <p7_LengthParams()> already
+ *            calculated in <lp>. If <lp> was calculated for a
+ *            different uni/multihit mode than <om>'s, this falls back
+ *            to <p7_oprofile_ReconfigRestLength()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_SetRestLength(P7_OPROFILE *om, const P7_LENPARAM *lp)
+{
+  if (lp->nj != om->nj) return p7_oprofile_ReconfigRestLength(om, lp->L);
+
+  om->xf[p7O_N][p7O_LOOP] =  om->xf[p7O_C][p7O_LOOP] = om->xf[p7O_J][p7O_LOOP] = lp->ploop;
+  om->xf[p7O_N][p7O_MOVE] =  om->xf[p7O_C][p7O_MOVE] = om->xf[p7O_J][p7O_MOVE] = lp->pmove;
+  om->xw[p7O_N][p7O_MOVE] =  om->xw[p7O_C][p7O_MOVE] = om->xw[p7O_J][p7O_MOVE] = wordify(om, lp->lpmove);
+  om->L = lp->L;
+  return eslOK;
+}
+
+
 /* Function:  p7_oprofile_ReconfigMultihit()
  * Synopsis:  Quickly reconfig model into multihit mode for target length <L>.
  * Incept:    SRE, Thu Aug 21 10:04:07 2008 [Janelia]
@@ -401,6 +401,24 @@
  *
  * Ignore the warnings and go look for the calc_band_2 function.
  *
+ *
+ * WHY NOT NARROWER CELLS
+ * ======================
+ *
+ * A coarser prefilter in front of this one, with 4-bit scores packed
+ * two cells to a byte, looks like it ought to run at twice the cell
+ * rate. It doesn't: there are no 4-bit lanes in SSE2 or AVX2, so a
+ * saturating subtract on packed nibbles has to be done on the two
+ * halves of each byte separately (two masks, two _mm_subs_epu8(),
+ * an OR), and the max into xEv the same way. That is about six
+ * instructions per 32 cells where the loop above spends two per 16,
+ * before the precision lost from the scores makes the threshold
+ * looser still. The per-cell cost here is already the floor for a
+ * striped filter; on AVX2 hosts p7_SSVFilter_avx() gets the factor
+ * of two from 32 byte lanes instead, and for DNA targets the
+ * longtarget filters have a cheaper first pass (the diagonal scan in
+ * msvfilter.c).
+ *
  */
 
 #include <p7_config.h>
@@ -872,20 +890,59 @@ get_xE(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om)
 }
 
 
+/* Function:  p7_SSVFilter_sse()
+ * Synopsis:  J-state-free MSV filter; tried first by <p7_MSVFilter_sse()>.
+ *
+ * Purpose:   Calculates the MSV score of digital sequence <dsq> of
+ *            length <L> against <om>, ignoring the J state (see
+ *            comments at start of file). Returns <eslOK> and the score
+ *            in <*ret_sc>; <eslERANGE> if the score overflows, with
+ *            <*ret_sc> set to <eslINFINITY>; or <eslENORESULT> if the
+ *            J state might have been used, in which case the caller
+ *            must run the full MSV filter.
+ *
+ *            This is the SSE2 version. <p7_SSVFilter()> calls it, or
+ *            the identical-result <p7_SSVFilter_avx()> on AVX2 hosts,
+ *            through the kernel table (see kernels.c).
+ */
 int
-p7_SSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
+p7_SSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
 {
-  /* Use 16 bit values to avoid overflow due to moved baseline */
-  uint16_t  xE;
-  uint16_t  xJ;
-
   if (om->tjb_b + om->tbm_b + om->tec_b + om->bias_b >= 127) {
     /* the optimizations are not guaranteed to work under these
        conditions (see comments at start of file) */
     return eslENORESULT;
   }
 
-  xE = get_xE(dsq, L, om);
+  return p7_SSVFilter_Score(get_xE(dsq, L, om), om, ret_sc);
+}
+
+
+/* Function:  p7_SSVFilter_Score()
+ * Synopsis:  Convert a raw SSV diagonal maximum to an MSV score.
+ *
+ * Purpose:   Given <xE>, the maximum over all diagonals of one target
+ *            sequence in the shifted byte arithmetic of the SSV filter
+ *            (starting from the signed -128 baseline), finish the
+ *            calculation of <p7_SSVFilter()> for <om> in its current
+ *            length configuration. Return codes and <*ret_sc> are as
+ *            for <p7_SSVFilter()>.
+ *
+ *            <xE> itself does not depend on the target length; only
+ *            this last step does. That's what lets
+ *            <p7_SSVFilter_multi()> score a batch of targets of
+ *            different lengths in one pass, leaving the caller to
+ *            finish each one after <p7_oprofile_ReconfigLength()>.
+ */
+int
+p7_SSVFilter_Score(uint8_t xE_b, const P7_OPROFILE *om, float *ret_sc)
+{
+  /* Use 16 bit values to avoid overflow due to moved baseline */
+  uint16_t  xE = xE_b;
+  uint16_t  xJ;
+
+  if (om->tjb_b + om->tbm_b + om->tec_b + om->bias_b >= 127)
+    return eslENORESULT;
 
   if (xE >= 255 - om->bias_b)
     {
@@ -924,3 +981,35 @@ p7_SSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
 }
 
 
+/* Function:  p7_SSVFilter_multi_sse()
+ * Synopsis:  Raw SSV maxima for a batch of target sequences.
+ *
+ * Purpose:   For each of the <nseq> digital target sequences <dsq[s]>
+ *            of lengths <L[s]>, calculate the length-independent SSV
+ *            diagonal maximum against <om> and store it in <xE[s]>.
+ *            The caller finishes each target with
+ *            <p7_SSVFilter_Score()> after configuring <om> for that
+ *            target's length, which gives exactly the result of
+ *            <p7_SSVFilter()>.
+ *
+ *            This is the SSE2 version, which scores the targets one
+ *            at a time with the striped filter. On AVX2 hosts
+ *            <p7_SSVFilter_multi()> calls <p7_SSVFilter_multi_avx()>
+ *            instead (see kernels.c), which puts one target
+ *            sequence in each byte lane instead of striping the
+ *            model. That uses the vector lanes much better when the
+ *            model is short (see <p7_SSVMULTI_MAXM>).
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_SSVFilter_multi_sse(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE)
+{
+  int s;
+
+  for (s = 0; s < nseq; s++)
+    xE[s] = get_xE(dsq[s], L[s], om);
+  return eslOK;
+}
@@ -0,0 +1,283 @@
+/* Batch SSV filter offloaded to a CUDA GPU.
+ *
+ * p7_SSVFilter_multi() scores a whole block of target sequences
+ * against one profile, so it is the one filter call that already
+ * hands over enough work at once to be worth a trip to a GPU. With
+ * --enable-cuda, and a CUDA device present at runtime, it sends
+ * blocks of at least p7_GPU_MINBATCH targets to
+ * p7_SSVFilter_multi_gpu() here, which packs them into flat arrays
+ * for the kernel in ssvfilter_gpu_kernel.cu. The GPU returns the same
+ * raw xE per target as the CPU kernels, so p7_Pipeline_Block() and
+ * everything downstream of the SSV stage, MSV, Viterbi, Forward,
+ * domain definition, are unchanged and stay on the CPU.
+ *
+ * Any CUDA failure (no device, out of device memory, a driver
+ * error) falls back to the CPU kernel for that block, so the GPU
+ * only ever changes speed, never results. A driver's --nogpu turns the
+ * offload off, with p7_impl_DisableGPU().
+ *
+ * Contents:
+ *   1. p7_SSVFilter_multi_gpu(), p7_impl_HaveGPU(), p7_impl_DisableGPU()
+ *   2. Unit tests
+ *   3. Test driver
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+#ifdef HMMER_CUDA
+/* ssvfilter_gpu_kernel.cu */
+extern int p7_gpu_Available(void);
+extern int p7_gpu_SSVBatch(const int8_t *tbl, int M, int Kp, const uint8_t *res, int64_t nres, const int64_t *off, const int *L, int nseq, uint8_t *xE);
+
+static int have_gpu = -1;   /* -1 = not yet determined. Benign race: all threads compute the same answer. */
+#endif
+
+
+/*****************************************************************
+ * 1. p7_SSVFilter_multi_gpu(), p7_impl_HaveGPU(), p7_impl_DisableGPU()
+ *****************************************************************/
+
+/* Function:  p7_impl_HaveGPU()
+ * Synopsis:  TRUE if batch SSV filtering can be offloaded to a GPU.
+ *
+ * Purpose:   Return TRUE if the CUDA engine was compiled in
+ *            (--enable-cuda), the host has a usable CUDA device, and
+ *            <p7_impl_DisableGPU()> hasn't been called. Decided on the
+ *            first call; like <impl_HaveAVX2()>, after that it doesn't
+ *            change.
+ */
+int
+p7_impl_HaveGPU(void)
+{
+#ifdef HMMER_CUDA
+  if (have_gpu == -1)
+    have_gpu = p7_gpu_Available() ? 1 : 0;
+  return have_gpu;
+#else
+  return 0;
+#endif
+}
+
+/* Function:  p7_impl_DisableGPU()
+ * Synopsis:  Keep batch SSV filtering on the CPU.
+ *
+ * Purpose:   Make <p7_impl_HaveGPU()> return FALSE from now on, for a
+ *            driver's <--nogpu>. Call it before any threads start.
+ *            Results don't change, only speed.
+ */
+void
+p7_impl_DisableGPU(void)
+{
+#ifdef HMMER_CUDA
+  have_gpu = 0;
+#endif
+}
+
+
+#ifdef HMMER_CUDA
+/* Function:  p7_SSVFilter_multi_gpu()
+ * Synopsis:  Raw SSV maxima for a batch of target sequences, on a GPU.
+ *
+ * Purpose:   Same as <p7_SSVFilter_multi_sse()>: for each of the
+ *            <nseq> digital target sequences <dsq[s]> of lengths
+ *            <L[s]>, store the length-independent SSV diagonal maximum
+ *            against <om> in <xE[s]>, for the caller to finish with
+ *            <p7_SSVFilter_Score()>.
+ *
+ *            The striped <om->sbv> scores are unstriped into one row
+ *            of <Kp> signed bytes per node, and the residues of the
+ *            batch packed end to end; both are copied to the device
+ *            for each call.
+ *
+ *            Caller must have checked <p7_impl_HaveGPU()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslFAIL> if the GPU couldn't score the batch; <xE> is
+ *            then undefined, and the caller should use a CPU kernel.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_SSVFilter_multi_gpu(const ESL_DSQ **dsq, const int *L, int nseq, const P7_OPROFILE *om, uint8_t *xE)
+{
+  int      M    = om->M;
+  int      Kp   = om->abc->Kp;
+  int      Q    = p7O_NQB(M);        /* 16-way segment length of om->sbv, for unstriping */
+  int8_t  *tbl  = NULL;              /* tbl[k*Kp + x]: signed score of residue x in node k+1 */
+  uint8_t *res  = NULL;              /* residues of all targets, end to end                  */
+  int64_t *off  = NULL;              /* off[s]: where target s starts in <res>               */
+  int64_t  nres = 0;
+  int      k, s, x;
+  int      status;
+
+  if (nseq == 0) return eslOK;
+
+  ESL_ALLOC(off, sizeof(int64_t) * nseq);
+  for (s = 0; s < nseq; s++) { off[s] = nres; nres += L[s]; }
+
+  ESL_ALLOC(tbl, sizeof(int8_t)  * M * Kp);
+  ESL_ALLOC(res, sizeof(uint8_t) * ESL_MAX(1, nres));
+
+  /* Node k+1 is at vector k%Q, element k/Q, of om->sbv[x]. */
+  for (k = 0; k < M; k++)
+    for (x = 0; x < Kp; x++)
+      tbl[k*Kp + x] = (int8_t) ((uint8_t *) om->sbv[x])[(k%Q)*16 + k/Q];
+
+  for (s = 0; s < nseq; s++)
+    memcpy(res + off[s], dsq[s] + 1, L[s]);
+
+  status = (p7_gpu_SSVBatch(tbl, M, Kp, res, nres, off, L, nseq, xE) == 0 ? eslOK : eslFAIL);
+
+  free(tbl);
+  free(res);
+  free(off);
+  return status;
+
+ ERROR:
+  if (tbl) free(tbl);
+  if (res) free(res);
+  if (off) free(off);
+  return status;
+}
+#endif /*HMMER_CUDA*/
+/*------------------ end, p7_SSVFilter_multi_gpu() ---------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#if defined(p7SSVFILTER_GPU_TESTDRIVE) && defined(HMMER_CUDA)
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* The GPU must give exactly the xE of the SSE batch kernel, for a
+ * random model of length <M> and <N> random target sequences of
+ * random lengths 0..<L>.
+ */
+static void
+utest_ssv_gpu(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "ssvfilter_gpu unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ    **dsq = malloc(sizeof(ESL_DSQ *) * N);
+  int         *len = malloc(sizeof(int)       * N);
+  uint8_t     *xE1 = malloc(sizeof(uint8_t)   * N);
+  uint8_t     *xE2 = malloc(sizeof(uint8_t)   * N);
+  int          s;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  for (s = 0; s < N; s++)
+    {
+      len[s] = esl_rnd_Roll(r, L+1);
+      dsq[s] = malloc(sizeof(ESL_DSQ) * (len[s]+2));
+      esl_rsq_xfIID(r, bg->f, abc->K, len[s], dsq[s]);
+    }
+
+  if (p7_SSVFilter_multi_sse((const ESL_DSQ **) dsq, len, N, om, xE1) != eslOK) esl_fatal(msg);
+  if (p7_SSVFilter_multi_gpu((const ESL_DSQ **) dsq, len, N, om, xE2) != eslOK) esl_fatal("%s: GPU call failed", msg);
+
+  for (s = 0; s < N; s++)
+    if (xE1[s] != xE2[s]) esl_fatal("%s: xE differs for target %d (%d, %d)", msg, s, xE1[s], xE2[s]);
+
+  for (s = 0; s < N; s++) free(dsq[s]);
+  free(dsq);
+  free(len);
+  free(xE1);
+  free(xE2);
+  p7_hmm_Destroy(hmm);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7SSVFILTER_GPU_TESTDRIVE && HMMER_CUDA*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7SSVFILTER_GPU_TESTDRIVE
+/*
+   gcc -g -Wall -msse2 -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o ssvfilter_gpu_utest -Dp7SSVFILTER_GPU_TESTDRIVE ssvfilter_gpu.c -lhmmer -leasel -lcudart -lm
+   ./ssvfilter_gpu_utest
+ */
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "400", NULL, NULL,  NULL,  NULL, NULL, "maximum size of random sequences to sample",     0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,   "1000", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the GPU batch SSV filter";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+
+#ifdef HMMER_CUDA
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  if (! p7_impl_HaveGPU())
+    {
+      if (esl_opt_GetBoolean(go, "-v")) printf("no CUDA device; test skipped\n");
+      esl_randomness_Destroy(r);
+      esl_getopts_Destroy(go);
+      return eslOK;
+    }
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("SSVFilter_multi_gpu() tests, protein\n");
+  utest_ssv_gpu(r, abc, bg, M,    L, N);
+  utest_ssv_gpu(r, abc, bg, 1,    L, 10);   /* size 1 models                 */
+  utest_ssv_gpu(r, abc, bg, M,    1, 10);   /* sequences of length 0 and 1   */
+  utest_ssv_gpu(r, abc, bg, 2000, L, 10);   /* more diagonals than threads   */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("SSVFilter_multi_gpu() tests, DNA\n");
+  utest_ssv_gpu(r, abc, bg, M,    L, N);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+  esl_randomness_Destroy(r);
+#endif /*HMMER_CUDA*/
+
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7SSVFILTER_GPU_TESTDRIVE*/
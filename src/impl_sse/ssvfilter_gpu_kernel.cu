@@ -0,0 +1,130 @@
+/* CUDA kernel for the batch SSV filter.
+ *
+ * Device side of p7_SSVFilter_multi_gpu() (see ssvfilter_gpu.c).
+ * This file is compiled by nvcc, and deliberately knows nothing of
+ * Easel or HMMER structures: the host side hands it flat arrays,
+ * an unstriped table of the signed SSV match scores and the batch's
+ * residues packed end to end, and gets back one raw diagonal maximum
+ * xE per target, the same number p7_SSVFilter_multi() gives.
+ *
+ * The SSV recurrence has no transitions between diagonals. Each
+ * diagonal starts at the -128 baseline, wherever it enters the DP
+ * matrix (row 1 or node 1), and only ever subtracts match scores
+ * with signed saturation. So the diagonals of a target are
+ * independent: each CUDA block takes one target sequence, each of
+ * its threads walks a strided subset of that target's diagonals,
+ * and the block ends with a max reduction. The byte arithmetic is
+ * that of _mm256_subs_epi8() and _mm256_max_epu8() in
+ * p7_SSVFilter_multi_avx(), so every xE is bit-identical.
+ *
+ * Contents:
+ *   1. Kernel
+ *   2. Host entry points (C linkage)
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <cuda_runtime.h>
+
+#define p7_GPU_THREADS 128   /* threads per block; one block per target sequence */
+
+
+/*****************************************************************
+ * 1. Kernel
+ *****************************************************************/
+
+__global__ static void
+ssv_batch_kernel(const int8_t *tbl, int M, int Kp, const uint8_t *res, const int64_t *off, const int *L, uint8_t *xE)
+{
+  __shared__ uint8_t mx[p7_GPU_THREADS];
+  const uint8_t *dsq = res + off[blockIdx.x];   /* residues 1..L of this target, at dsq[0..L-1] */
+  int            Lt  = L[blockIdx.x];
+  uint8_t        m   = 128;                     /* -128 baseline, compared unsigned */
+  int            d, i, k, v;
+
+  /* diagonal d = k - i runs from -(Lt-1) (starts in node 1) to M-1 (starts in row 1) */
+  for (d = (int) threadIdx.x - (Lt-1); d < M; d += blockDim.x)
+    {
+      i = (d < 0 ? -d : 0);
+      k = (d < 0 ? 0  : d);
+      for (v = -128; i < Lt && k < M; i++, k++)
+	{
+	  v -= tbl[k * Kp + dsq[i]];
+	  v  = (v < -128 ? -128 : (v > 127 ? 127 : v));
+	  if ((uint8_t) v > m) m = (uint8_t) v;
+	}
+    }
+
+  mx[threadIdx.x] = m;
+  __syncthreads();
+  for (k = blockDim.x / 2; k > 0; k /= 2)
+    {
+      if (threadIdx.x < k && mx[threadIdx.x + k] > mx[threadIdx.x]) mx[threadIdx.x] = mx[threadIdx.x + k];
+      __syncthreads();
+    }
+  if (threadIdx.x == 0) xE[blockIdx.x] = mx[0];
+}
+
+
+/*****************************************************************
+ * 2. Host entry points (C linkage)
+ *****************************************************************/
+
+/* Function:  p7_gpu_Available()
+ * Synopsis:  Return TRUE if a CUDA device can be used.
+ */
+extern "C" int
+p7_gpu_Available(void)
+{
+  int n = 0;
+  return (cudaGetDeviceCount(&n) == cudaSuccess && n > 0);
+}
+
+/* Function:  p7_gpu_SSVBatch()
+ * Synopsis:  Raw SSV diagonal maxima for a batch of targets, on the GPU.
+ *
+ * Purpose:   <tbl[k*Kp + x]> is the signed SSV match score of residue
+ *            <x> in node <k+1>, for <k=0..M-1>. Target <s> of the
+ *            <nseq> is <L[s]> residue codes at <res + off[s]>; all of
+ *            them take <nres> bytes. Store each target's raw xE in
+ *            <xE[s]>.
+ *
+ * Returns:   0 on success; nonzero on any CUDA error, after which the
+ *            caller should score the batch on the CPU.
+ */
+extern "C" int
+p7_gpu_SSVBatch(const int8_t *tbl, int M, int Kp, const uint8_t *res, int64_t nres, const int64_t *off, const int *L, int nseq, uint8_t *xE)
+{
+  int8_t   *d_tbl = NULL;
+  uint8_t  *d_res = NULL;
+  int64_t  *d_off = NULL;
+  int      *d_L   = NULL;
+  uint8_t  *d_xE  = NULL;
+  int       ok    = 0;
+
+  if (nseq == 0) return 0;
+
+  if (cudaMalloc((void **) &d_tbl, (size_t) M * Kp)             != cudaSuccess) goto DONE;
+  if (cudaMalloc((void **) &d_res, (size_t) nres)               != cudaSuccess) goto DONE;
+  if (cudaMalloc((void **) &d_off, sizeof(int64_t) * nseq)      != cudaSuccess) goto DONE;
+  if (cudaMalloc((void **) &d_L,   sizeof(int)     * nseq)      != cudaSuccess) goto DONE;
+  if (cudaMalloc((void **) &d_xE,  sizeof(uint8_t) * nseq)      != cudaSuccess) goto DONE;
+
+  if (cudaMemcpy(d_tbl, tbl, (size_t) M * Kp,        cudaMemcpyHostToDevice) != cudaSuccess) goto DONE;
+  if (cudaMemcpy(d_res, res, (size_t) nres,          cudaMemcpyHostToDevice) != cudaSuccess) goto DONE;
+  if (cudaMemcpy(d_off, off, sizeof(int64_t) * nseq, cudaMemcpyHostToDevice) != cudaSuccess) goto DONE;
+  if (cudaMemcpy(d_L,   L,   sizeof(int)     * nseq, cudaMemcpyHostToDevice) != cudaSuccess) goto DONE;
+
+  ssv_batch_kernel<<<nseq, p7_GPU_THREADS>>>(d_tbl, M, Kp, d_res, d_off, d_L, d_xE);
+  if (cudaGetLastError() != cudaSuccess) goto DONE;
+
+  if (cudaMemcpy(xE, d_xE, sizeof(uint8_t) * nseq, cudaMemcpyDeviceToHost) != cudaSuccess) goto DONE;
+  ok = 1;
+
+ DONE:
+  cudaFree(d_tbl);
+  cudaFree(d_res);
+  cudaFree(d_off);
+  cudaFree(d_L);
+  cudaFree(d_xE);
+  return (ok ? 0 : 1);
+}
@@ -36,7 +36,123 @@
  * 1. Viterbi filter implementation.
  *****************************************************************/
 
-/* Function:  p7_ViterbiFilter()
+/* As in msvfilter.c, small models get a kernel compiled for their
+ * segment count Q, VIT_QKERNEL(Q), with the M, D and I row in a
+ * local array the compiler can unroll over and keep in registers.
+ * Three vectors per segment run out of registers sooner than MSV's
+ * one, so we stop at Q=8 (M <= 64). The kernels don't touch <ox> and
+ * don't do the debugging dumps, so they're skipped when
+ * <ox->debugging> is set.
+ */
+#define VIT_QMAX 8
+
+#define VIT_QKERNEL(nq)                                                 \
+static int                                                              \
+vit_q##nq(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc) \
+{                                                                       \
+  __m128i  dp[nq * p7X_NSCELLS];                                        \
+  __m128i  mpv, dpv, ipv, sv, dcv, xEv, xBv, Dmaxv, negInfv;            \
+  __m128i *rsc, *tsc;                                                   \
+  int16_t  xE, xB, xC, xJ, xN, Dmax;                                    \
+  int      i, q;                                                        \
+                                                                        \
+  negInfv = _mm_set1_epi16(-32768);                                     \
+  negInfv = _mm_srli_si128(negInfv, 14);                                \
+  for (q = 0; q < nq; q++)                                              \
+    MMXo(q) = IMXo(q) = DMXo(q) = _mm_set1_epi16(-32768);               \
+  xN = om->base_w;                                                      \
+  xB = xN + om->xw[p7O_N][p7O_MOVE];                                    \
+  xJ = -32768;                                                          \
+  xC = -32768;                                                          \
+                                                                        \
+  for (i = 1; i <= L; i++)                                              \
+    {                                                                   \
+      rsc   = om->rwv[dsq[i]];                                          \
+      tsc   = om->twv;                                                  \
+      dcv   = _mm_set1_epi16(-32768);                                   \
+      xEv   = _mm_set1_epi16(-32768);                                   \
+      Dmaxv = _mm_set1_epi16(-32768);                                   \
+      xBv   = _mm_set1_epi16(xB);                                       \
+                                                                        \
+      mpv = _mm_or_si128(_mm_slli_si128(MMXo(nq-1), 2), negInfv);       \
+      dpv = _mm_or_si128(_mm_slli_si128(DMXo(nq-1), 2), negInfv);       \
+      ipv = _mm_or_si128(_mm_slli_si128(IMXo(nq-1), 2), negInfv);       \
+                                                                        \
+      for (q = 0; q < nq; q++)                                          \
+	{                                                               \
+	  sv    =                    _mm_adds_epi16(xBv, tsc[7*q]);     \
+	  sv    = _mm_max_epi16 (sv, _mm_adds_epi16(mpv, tsc[7*q+1]));  \
+	  sv    = _mm_max_epi16 (sv, _mm_adds_epi16(ipv, tsc[7*q+2]));  \
+	  sv    = _mm_max_epi16 (sv, _mm_adds_epi16(dpv, tsc[7*q+3]));  \
+	  sv    = _mm_adds_epi16(sv, rsc[q]);                           \
+	  xEv   = _mm_max_epi16(xEv, sv);                               \
+	  mpv   = MMXo(q);                                              \
+	  dpv   = DMXo(q);                                              \
+	  ipv   = IMXo(q);                                              \
+	  MMXo(q) = sv;                                                 \
+	  DMXo(q) = dcv;                                                \
+	  dcv   = _mm_adds_epi16(sv, tsc[7*q+4]);                       \
+	  Dmaxv = _mm_max_epi16(dcv, Dmaxv);                            \
+	  sv      =                    _mm_adds_epi16(mpv, tsc[7*q+5]); \
+	  IMXo(q) = _mm_max_epi16 (sv, _mm_adds_epi16(ipv, tsc[7*q+6])); \
+	}                                                               \
+                                                                        \
+      xE = esl_sse_hmax_epi16(xEv);                                     \
+      if (xE >= 32767) { *ret_sc = eslINFINITY; return eslERANGE; }     \
+      xN = xN + om->xw[p7O_N][p7O_LOOP];                                \
+      xC = ESL_MAX(xC + om->xw[p7O_C][p7O_LOOP], xE + om->xw[p7O_E][p7O_MOVE]); \
+      xJ = ESL_MAX(xJ + om->xw[p7O_J][p7O_LOOP], xE + om->xw[p7O_E][p7O_LOOP]); \
+      xB = ESL_MAX(xJ + om->xw[p7O_J][p7O_MOVE], xN + om->xw[p7O_N][p7O_MOVE]); \
+                                                                        \
+      Dmax = esl_sse_hmax_epi16(Dmaxv);                                 \
+      if (Dmax + om->ddbound_w > xB)                                    \
+	{                                                               \
+	  tsc = om->twv + 7*nq;                                         \
+	  dcv = _mm_or_si128(_mm_slli_si128(dcv, 2), negInfv);          \
+	  for (q = 0; q < nq; q++)                                      \
+	    {                                                           \
+	      DMXo(q) = _mm_max_epi16(dcv, DMXo(q));                    \
+	      dcv     = _mm_adds_epi16(DMXo(q), tsc[q]);                \
+	    }                                                           \
+	  do {                                                          \
+	    dcv = _mm_or_si128(_mm_slli_si128(dcv, 2), negInfv);        \
+	    for (q = 0; q < nq; q++)                                    \
+	      {                                                         \
+		if (! esl_sse_any_gt_epi16(dcv, DMXo(q))) break;        \
+		DMXo(q) = _mm_max_epi16(dcv, DMXo(q));                  \
+		dcv     = _mm_adds_epi16(DMXo(q), tsc[q]);              \
+	      }                                                         \
+	  } while (q == nq);                                            \
+	}                                                               \
+      else                                                              \
+	DMXo(0) = _mm_or_si128(_mm_slli_si128(dcv, 2), negInfv);        \
+    }                                                                   \
+                                                                        \
+  if (xC > -32768)                                                      \
+    {                                                                   \
+      *ret_sc  = (float) xC + (float) om->xw[p7O_C][p7O_MOVE] - (float) om->base_w; \
+      *ret_sc /= om->scale_w;                                           \
+      *ret_sc -= 3.0;                                                   \
+    }                                                                   \
+  else *ret_sc = -eslINFINITY;                                          \
+  return eslOK;                                                         \
+}
+
+VIT_QKERNEL(2)
+VIT_QKERNEL(3)
+VIT_QKERNEL(4)
+VIT_QKERNEL(5)
+VIT_QKERNEL(6)
+VIT_QKERNEL(7)
+VIT_QKERNEL(8)
+
+/* p7O_NQW() is never less than 2, so [0] and [1] are unused. */
+static int (* const vit_qkernels[VIT_QMAX+1])(const ESL_DSQ *, int, const P7_OPROFILE *, float *) = {
+  NULL,   NULL,   vit_q2,  vit_q3,  vit_q4,  vit_q5,  vit_q6,
+  vit_q7, vit_q8,
+};
+
+/* Function:  p7_ViterbiFilter_sse()
  * Synopsis:  Calculates Viterbi score, vewy vewy fast, in limited precision.
  * Incept:    SRE, Tue Nov 27 09:15:24 2007 [Janelia]
  *
@@ -55,6 +171,12 @@
  *            SSE/SSE2 integer intrinsics \citep{Farrar07}, in reduced
  *            precision (signed words, 16 bits).
  *
+ *            This is the SSE2 version. <p7_ViterbiFilter()> calls it,
+ *            or the identical-result <p7_ViterbiFilter_avx512()> on
+ *            AVX-512 hosts, through the kernel table (see kernels.c).
+ *            Models of up to <8*VIT_QMAX> nodes go to a kernel
+ *            compiled for their segment count.
+ *
  * Args:      dsq     - digital target sequence, 1..L
  *            L       - length of dsq in residues          
  *            om      - optimized profile
@@ -80,7 +202,7 @@
  *            J4/138-140 for reimplementation in 16-bit precision
  */
 int
-p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+p7_ViterbiFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
 {
   register __m128i mpv, dpv, ipv;  /* previous row values                                       */
   register __m128i sv;		   /* temp storage of 1 curr row value in progress              */
@@ -104,6 +226,12 @@ p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, f
   if (om->mode != p7_LOCAL && om->mode != p7_UNILOCAL) ESL_EXCEPTION(eslEINVAL, "Fast filter only works for local alignment");
   ox->M   = om->M;
 
+  /* Small models: the row fits in registers */
+#if eslDEBUGLEVEL > 0
+  if (! ox->debugging)
+#endif
+  if (Q <= VIT_QMAX) return (*vit_qkernels[Q])(dsq, L, om, ret_sc);
+
   /* -infinity is -32768 */
   negInfv = _mm_set1_epi16(-32768);
   negInfv = _mm_srli_si128(negInfv, 14);  /* negInfv = 16-byte vector, 14 0 bytes + 2-byte value=-32768, for an OR operation. */
@@ -246,7 +374,220 @@ p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, f
   else  *ret_sc = -eslINFINITY;
   return eslOK;
 }
-/*---------------- end, p7_ViterbiFilter() ----------------------*/
+/*-------------- end, p7_ViterbiFilter_sse() --------------------*/
+
+
+/* The bounded Viterbi filter stops as soon as its caller's pass/fail
+ * decision is certain. C can loop to the end, so xC(i) plus (L-i)
+ * C->C loops is a lower bound on the final xC. For the upper bound,
+ * all transitions are <= 0 and an I state emits nothing, so no cell
+ * of row i+1 can beat the best cell or xB of any row so far by more
+ * than the best match emission of residue i+1; D cells never beat
+ * the M cells of their own row, so the running max of xE and xB
+ * will do for "the best cell so far". Adding the best emissions of
+ * the rest of the target bounds every cell to come, and so the
+ * final score. Unlike MSV, everything we need is already a scalar
+ * on every row, so we check every row.
+ */
+
+/* vit_xc_threshold()
+ * The smallest xC, in offset words, whose Viterbi filter score is
+ * at least <sc> nats; clamped to +/-1e9 for infinite <sc>.
+ */
+static int
+vit_xc_threshold(const P7_OPROFILE *om, float sc)
+{
+  float t = (sc + 3.0) * om->scale_w + (float) om->base_w - (float) om->xw[p7O_C][p7O_MOVE];
+
+  if (t >  1e9) return  1000000000;
+  if (t < -1e9) return -1000000000;
+  return (int) ceilf(t);
+}
+
+/* Function:  p7_ViterbiFilter_bounded_sse()
+ * Synopsis:  Viterbi filter that stops once the outcome is certain.
+ *
+ * Purpose:   As <p7_ViterbiFilter_sse()>, for a caller that only
+ *            needs to know whether the Viterbi filter score of <dsq>
+ *            is below <reject_sc>, at or above <accept_sc>, or in
+ *            between (all in nats, <reject_sc> $\leq$ <accept_sc>).
+ *            The DP stops early once the running lower bound on the
+ *            score reaches <accept_sc>, or the upper bound falls
+ *            below <reject_sc>, and returns that bound in
+ *            <*ret_sc>: so a <*ret_sc> >= <accept_sc> is a lower
+ *            bound, a <*ret_sc> < <reject_sc> is an upper bound, and
+ *            anything in between is the score
+ *            <p7_ViterbiFilter_sse()> returns. Either threshold may
+ *            be infinite, to turn its early exit off.
+ *
+ *            Small models that go to a <vit_qkernels[]> kernel come
+ *            back exact.
+ *
+ * Args:      dsq       - digital target sequence, 1..L
+ *            L         - length of dsq in residues
+ *            om        - optimized profile
+ *            ox        - DP matrix
+ *            reject_sc - stop once the score must be below this (nats)
+ *            accept_sc - stop once the score must be at least this (nats)
+ *            ret_sc    - RETURN: Viterbi score, or a bound on it (nats)
+ *
+ * Returns:   <eslOK> on success;
+ *            <eslERANGE> if the score overflows; in this case
+ *            <*ret_sc> is <eslINFINITY>, and the sequence can 
+ *            be treated as a high-scoring hit.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, or if
+ *            profile isn't in a local alignment mode.
+ */
+int
+p7_ViterbiFilter_bounded_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float reject_sc, float accept_sc, float *ret_sc)
+{
+  register __m128i mpv, dpv, ipv;  /* previous row values                                       */
+  register __m128i sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m128i dcv;		   /* delayed storage of D(i,q+1)                               */
+  register __m128i xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m128i xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register __m128i Dmaxv;          /* keeps track of maximum D cell on row                      */
+  int16_t  xE, xB, xC, xJ, xN;	   /* special states' scores                                    */
+  int16_t  Dmax;		   /* maximum D cell score on row                               */
+  int      gain[p7_MAXCODE];       /* best match emission of each residue (>= 0), in words      */
+  int64_t  rest;                   /* sum of gain[] over residues i+1..L                        */
+  int64_t  top;                    /* best cell or xB on any row so far                         */
+  int64_t  bnd;                    /* a bound on the final xC                                   */
+  int      rejectC, acceptC;       /* the thresholds as xC values                               */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int x;			   /* counter over residues 0..Kp-1                             */
+  int Q        = p7O_NQW(om->M);   /* segment length: # of vectors                              */
+  __m128i *dp  = ox->dpw[0];	   /* using {MDI}MX(q) macro requires initialization of <dp>    */
+  __m128i *rsc;			   /* will point at om->ru[x] for residue x[i]                  */
+  __m128i *tsc;			   /* will point into (and step thru) om->tu                    */
+  __m128i negInfv;
+
+  /* Check that the DP matrix is ok for us. */
+  if (Q > ox->allocQ8)                                 ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (om->mode != p7_LOCAL && om->mode != p7_UNILOCAL) ESL_EXCEPTION(eslEINVAL, "Fast filter only works for local alignment");
+  ox->M   = om->M;
+
+  if (Q <= VIT_QMAX) return (*vit_qkernels[Q])(dsq, L, om, ret_sc);
+
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      rsc = om->rwv[x];
+      xEv = _mm_set1_epi16(-32768);
+      for (q = 0; q < Q; q++) xEv = _mm_max_epi16(xEv, rsc[q]);
+      gain[x] = ESL_MAX(0, esl_sse_hmax_epi16(xEv));
+    }
+  for (rest = 0, i = 1; i <= L; i++) rest += gain[dsq[i]];
+  rejectC = vit_xc_threshold(om, reject_sc);
+  acceptC = vit_xc_threshold(om, accept_sc);
+
+  negInfv = _mm_set1_epi16(-32768);
+  negInfv = _mm_srli_si128(negInfv, 14);
+  for (q = 0; q < Q; q++)
+    MMXo(q) = IMXo(q) = DMXo(q) = _mm_set1_epi16(-32768);
+  xN   = om->base_w;
+  xB   = xN + om->xw[p7O_N][p7O_MOVE];
+  xJ   = -32768;
+  xC   = -32768;
+  top  = xB;
+  bnd  = -32768;
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc   = om->rwv[dsq[i]];
+      tsc   = om->twv;
+      dcv   = _mm_set1_epi16(-32768);
+      xEv   = _mm_set1_epi16(-32768);     
+      Dmaxv = _mm_set1_epi16(-32768);     
+      xBv   = _mm_set1_epi16(xB);
+
+      mpv = MMXo(Q-1);  mpv = _mm_slli_si128(mpv, 2);  mpv = _mm_or_si128(mpv, negInfv);
+      dpv = DMXo(Q-1);  dpv = _mm_slli_si128(dpv, 2);  dpv = _mm_or_si128(dpv, negInfv);
+      ipv = IMXo(Q-1);  ipv = _mm_slli_si128(ipv, 2);  ipv = _mm_or_si128(ipv, negInfv);
+
+      for (q = 0; q < Q; q++)
+	{
+	  sv   =                    _mm_adds_epi16(xBv, *tsc);  tsc++;
+	  sv   = _mm_max_epi16 (sv, _mm_adds_epi16(mpv, *tsc)); tsc++;
+	  sv   = _mm_max_epi16 (sv, _mm_adds_epi16(ipv, *tsc)); tsc++;
+	  sv   = _mm_max_epi16 (sv, _mm_adds_epi16(dpv, *tsc)); tsc++;
+	  sv   = _mm_adds_epi16(sv, *rsc);                      rsc++;
+	  xEv  = _mm_max_epi16(xEv, sv);
+
+	  mpv = MMXo(q);
+	  dpv = DMXo(q);
+	  ipv = IMXo(q);
+
+	  MMXo(q) = sv;
+	  DMXo(q) = dcv;
+
+	  dcv   = _mm_adds_epi16(sv, *tsc);  tsc++;
+	  Dmaxv = _mm_max_epi16(dcv, Dmaxv);
+
+	  sv     =                    _mm_adds_epi16(mpv, *tsc);  tsc++;
+	  IMXo(q)= _mm_max_epi16 (sv, _mm_adds_epi16(ipv, *tsc)); tsc++;
+	}
+
+      xE = esl_sse_hmax_epi16(xEv);
+      if (xE >= 32767) { *ret_sc = eslINFINITY; return eslERANGE; }
+      xN = xN + om->xw[p7O_N][p7O_LOOP];
+      xC = ESL_MAX(xC + om->xw[p7O_C][p7O_LOOP], xE + om->xw[p7O_E][p7O_MOVE]);
+      xJ = ESL_MAX(xJ + om->xw[p7O_J][p7O_LOOP], xE + om->xw[p7O_E][p7O_LOOP]);
+      xB = ESL_MAX(xJ + om->xw[p7O_J][p7O_MOVE], xN + om->xw[p7O_N][p7O_MOVE]);
+
+      /* Early accept and reject; see comment above */
+      rest -= gain[dsq[i]];
+      top   = ESL_MAX(top, ESL_MAX(xE, xB));
+      if (i < L)
+	{
+	  bnd = (int64_t) xC + (int64_t) (L-i) * om->xw[p7O_C][p7O_LOOP];
+	  if (xC > -32768 && bnd >= acceptC) break;
+	  bnd = ESL_MAX(xC, top + rest + om->xw[p7O_E][p7O_MOVE]);
+	  if (top + rest < 32767 && bnd < rejectC) break;
+	}
+
+      Dmax = esl_sse_hmax_epi16(Dmaxv);
+      if (Dmax + om->ddbound_w > xB) 
+	{
+	  dcv = _mm_slli_si128(dcv, 2); 
+	  dcv = _mm_or_si128(dcv, negInfv);
+	  tsc = om->twv + 7*Q;
+	  for (q = 0; q < Q; q++) 
+	    {
+	      DMXo(q) = _mm_max_epi16(dcv, DMXo(q));	
+	      dcv     = _mm_adds_epi16(DMXo(q), *tsc); tsc++;
+	    }
+	  do {
+	    dcv = _mm_slli_si128(dcv, 2);
+	    dcv = _mm_or_si128(dcv, negInfv);
+	    tsc = om->twv + 7*Q;
+	    for (q = 0; q < Q; q++) 
+	      {
+		if (! esl_sse_any_gt_epi16(dcv, DMXo(q))) break;
+		DMXo(q) = _mm_max_epi16(dcv, DMXo(q));	
+		dcv     = _mm_adds_epi16(DMXo(q), *tsc);   tsc++;
+	      }	    
+	  } while (q == Q);
+	}
+      else
+	{
+	  dcv = _mm_slli_si128(dcv, 2);
+	  DMXo(0) = _mm_or_si128(dcv, negInfv);
+	}
+    } /* end loop over sequence residues 1..L */
+
+  if (i > L)
+    {
+      if (xC == -32768) { *ret_sc = -eslINFINITY; return eslOK; }
+      bnd = xC;
+    }
+  *ret_sc  = (float) bnd + (float) om->xw[p7O_C][p7O_MOVE] - (float) om->base_w;
+  *ret_sc /= om->scale_w;
+  *ret_sc -= 3.0;
+  return eslOK;
+}
+/*-------------- end, p7_ViterbiFilter_bounded_sse() ------------*/
 
 
 
@@ -638,6 +979,7 @@ main(int argc, char **argv)
 #ifdef p7VITFILTER_TESTDRIVE
 #include "esl_random.h"
 #include "esl_randomseq.h"
+#include "esl_sq.h"
 
 /* ViterbiFilter() unit test
  * 
@@ -692,6 +1034,67 @@ utest_viterbi_filter(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int
   p7_profile_Destroy(gm);
   p7_oprofile_Destroy(om);
 }
+
+/* utest_viterbi_bounded()
+ *
+ * p7_ViterbiFilter_bounded_sse() must make the same decisions as
+ * the full Viterbi filter score against reject and accept
+ * thresholds set around it, and a score it returns outside them
+ * must bound the full one from the right side. Half the targets are
+ * emitted ones with most of their residues resampled, for scores
+ * well above the random ones that still don't overflow. <M> should
+ * be past the small-model kernels (8*VIT_QMAX).
+ */
+static void
+utest_viterbi_bounded(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM      *hmm  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  ESL_SQ      *sq   = esl_sq_CreateDigital(abc);
+  P7_OMX      *ox   = p7_omx_Create(M, 0, 0);
+  float        d[5][2] = { { -1., 1. }, { 0.5, eslINFINITY }, { -eslINFINITY, -0.5 }, { 2., 4. }, { -4., -2. } };
+  float        sc, bsc, lo, hi;
+  int          n, i, j;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+
+  for (n = 0; n < N; n++)
+    {
+      if (n % 2)
+	{
+	  if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL) != eslOK) esl_fatal("bounded viterbi filter unit test failed: emission");
+	  for (i = 1; i <= sq->n; i++)
+	    if (esl_random(r) < 0.6 + 0.1 * (n % 4)) sq->dsq[i] = esl_rnd_FChoose(r, bg->f, abc->K);
+	}
+      else
+	{
+	  esl_sq_GrowTo(sq, L);
+	  esl_rsq_xfIID(r, bg->f, abc->K, L, sq->dsq);
+	  sq->n = L;
+	}
+      if (sq->n == 0 || p7_ViterbiFilter_sse(sq->dsq, sq->n, om, ox, &sc) == eslERANGE) { esl_sq_Reuse(sq); continue; }
+
+      for (j = 0; j < 5; j++)
+	{
+	  lo = sc + d[j][0];
+	  hi = sc + d[j][1];
+	  p7_ViterbiFilter_bounded_sse(sq->dsq, sq->n, om, ox, lo, hi, &bsc);
+	  if ((bsc < lo) != (sc < lo) || (bsc >= hi) != (sc >= hi))
+	    esl_fatal("bounded viterbi filter unit test failed: decisions differ (%.2f, %.2f; %.2f..%.2f)", sc, bsc, lo, hi);
+	  if      (bsc >= hi) { if (sc < bsc - 0.001) esl_fatal("bounded viterbi filter unit test failed: %.2f isn't a lower bound on %.2f", bsc, sc); }
+	  else if (bsc <  lo) { if (sc > bsc + 0.001) esl_fatal("bounded viterbi filter unit test failed: %.2f isn't an upper bound on %.2f", bsc, sc); }
+	  else if (fabs(sc-bsc) > 0.001) esl_fatal("bounded viterbi filter unit test failed: scores differ (%.2f, %.2f)", sc, bsc);
+	}
+      esl_sq_Reuse(sq);
+    }
+
+  esl_sq_Destroy(sq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
 #endif /*p7VITFILTER_TESTDRIVE*/
 
 
@@ -744,8 +1147,10 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "-v")) printf("ViterbiFilter() tests, DNA\n");
   utest_viterbi_filter(r, abc, bg, M, L, N);   
+  utest_viterbi_filter(r, abc, bg, 50, L, 10);  /* Q-specialized kernel */
   utest_viterbi_filter(r, abc, bg, 1, L, 10);  
   utest_viterbi_filter(r, abc, bg, M, 1, 10);  
+  utest_viterbi_bounded(r, abc, bg, M, L, N);
 
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
@@ -756,8 +1161,10 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "-v")) printf("ViterbiFilter() tests, protein\n");
   utest_viterbi_filter(r, abc, bg, M, L, N); 
+  utest_viterbi_filter(r, abc, bg, 50, L, 10);
   utest_viterbi_filter(r, abc, bg, 1, L, 10);
   utest_viterbi_filter(r, abc, bg, M, 1, 10);
+  utest_viterbi_bounded(r, abc, bg, M, L, N);
 
   esl_alphabet_Destroy(abc);
   p7_bg_Destroy(bg);
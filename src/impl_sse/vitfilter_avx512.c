@@ -0,0 +1,343 @@
+/* AVX-512 version of the Viterbi filter.
+ *
+ * This is the same algorithm as p7_ViterbiFilter() (vitfilter.c),
+ * with 32 signed word cells per vector instead of 8. It uses its own
+ * 32-way striped copies of the scores, <om->rwv_512> and
+ * <om->twv_512>, which p7_oprofile_Convert512() derives from the SSE
+ * <om->rwv> and <om->twv>.
+ *
+ * Only this file and fwdback_avx512.c are compiled with AVX-512
+ * (F+BW) instructions enabled (AVX512BW_CFLAGS); p7_ViterbiFilter()
+ * dispatches here at runtime when impl_HaveAVX512() says the host
+ * supports it.
+ *
+ * Contents:
+ *   1. p7_ViterbiFilter_avx512() implementation
+ *   2. Unit tests
+ *   3. Test driver
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_AVX512
+
+#include <stdio.h>
+#include <math.h>
+
+#include <xmmintrin.h>		/* SSE  */
+#include <emmintrin.h>		/* SSE2 */
+#include <immintrin.h>		/* AVX-512 */
+
+#include "easel.h"
+#include "esl_sse.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+
+/* Shift a 512-bit vector of words right by one element (to higher
+ * index, a left bit shift), across the four 128-bit lanes, shifting
+ * in element 7 of <fillv>. This is the AVX-512 equivalent of
+ * _mm_slli_si128(v, 2) followed by OR'ing in -32768.
+ */
+static inline __m512i
+rightshift_epi16_512(__m512i v, __m512i fillv)
+{
+  __m512i t = _mm512_alignr_epi64(v, fillv, 6);   /* [fill lane, v lane 0, v lane 1, v lane 2] */
+  return _mm512_alignr_epi8(v, t, 14);
+}
+
+/* Horizontal max of 32 signed words. */
+static inline int16_t
+hmax_epi16_512(__m512i v)
+{
+  __m256i a = _mm256_max_epi16(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+  return esl_sse_hmax_epi16(_mm_max_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+}
+
+
+/*****************************************************************
+ * 1. p7_ViterbiFilter_avx512() implementation
+ *****************************************************************/
+
+/* Function:  p7_ViterbiFilter_avx512()
+ * Synopsis:  AVX-512 version of p7_ViterbiFilter().
+ *
+ * Purpose:   Same as <p7_ViterbiFilter()>: calculates an approximation
+ *            of the Viterbi score for sequence <dsq> of length <L>
+ *            residues, using optimized profile <om> and a
+ *            preallocated one-row DP matrix <ox>, and returns it in
+ *            <ret_sc>. Results are identical to the SSE
+ *            implementation.
+ *
+ *            Caller must have checked that the host supports AVX-512
+ *            (<impl_HaveAVX512()>).
+ *
+ * Note:      Uses the <ox->dp512> row, not <ox->dpw[0]>, so debugging
+ *            row dumps aren't available.
+ *
+ * Returns:   <eslOK> on success;
+ *            <eslERANGE> if the score overflows; in this case
+ *            <*ret_sc> is <eslINFINITY>, and the sequence can
+ *            be treated as a high-scoring hit.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, or if
+ *            profile isn't in a local alignment mode.
+ */
+int
+p7_ViterbiFilter_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  register __m512i mpv, dpv, ipv;  /* previous row values                                       */
+  register __m512i sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m512i dcv;		   /* delayed storage of D(i,q+1)                               */
+  register __m512i xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m512i xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register __m512i Dmaxv;          /* keeps track of maximum D cell on row                      */
+  int16_t  xE, xB, xC, xJ, xN;	   /* special states' scores                                    */
+  int16_t  Dmax;		   /* maximum D cell score on row                               */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7O_NQW_512(om->M); /* segment length: # of vectors                            */
+  __m512i *dp  = (__m512i *) ox->dp512; /* using {MDI}MX(q) macro requires initialization of <dp> */
+  __m512i *rsc;			   /* will point at om->rwv_512[x] for residue x[i]             */
+  __m512i *tsc;			   /* will point into (and step thru) om->twv_512               */
+  __m512i  negInfv = _mm512_set1_epi16(-32768);
+
+  /* Check that the DP matrix is ok for us. */
+  if (Q > ox->allocQ512)                               ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (om->mode != p7_LOCAL && om->mode != p7_UNILOCAL) ESL_EXCEPTION(eslEINVAL, "Fast filter only works for local alignment");
+  ox->M   = om->M;
+
+  /* Initialization. In unsigned arithmetic, -infinity is -32768 */
+  for (q = 0; q < Q; q++)
+    MMXo(q) = IMXo(q) = DMXo(q) = negInfv;
+  xN   = om->base_w;
+  xB   = xN + om->xw[p7O_N][p7O_MOVE];
+  xJ   = -32768;
+  xC   = -32768;
+  xE   = -32768;
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc   = om->rwv_512[dsq[i]];
+      tsc   = om->twv_512;
+      dcv   = negInfv;
+      xEv   = negInfv;
+      Dmaxv = negInfv;
+      xBv   = _mm512_set1_epi16(xB);
+
+      mpv = rightshift_epi16_512(MMXo(Q-1), negInfv);
+      dpv = rightshift_epi16_512(DMXo(Q-1), negInfv);
+      ipv = rightshift_epi16_512(IMXo(Q-1), negInfv);
+
+      for (q = 0; q < Q; q++)
+      {
+        /* Calculate new MMXo(i,q); don't store it yet, hold it in sv. */
+        sv   =                       _mm512_adds_epi16(xBv, *tsc);  tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(mpv, *tsc)); tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(ipv, *tsc)); tsc++;
+        sv   = _mm512_max_epi16 (sv, _mm512_adds_epi16(dpv, *tsc)); tsc++;
+        sv   = _mm512_adds_epi16(sv, *rsc);                         rsc++;
+        xEv  = _mm512_max_epi16(xEv, sv);
+
+        /* Load {MDI}(i-1,q) into mpv, dpv, ipv */
+        mpv = MMXo(q);
+        dpv = DMXo(q);
+        ipv = IMXo(q);
+
+        /* Do the delayed stores of {MD}(i,q) now that memory is usable */
+        MMXo(q) = sv;
+        DMXo(q) = dcv;
+
+        /* Calculate the next D(i,q+1) partially: M->D only */
+        dcv   = _mm512_adds_epi16(sv, *tsc);  tsc++;
+        Dmaxv = _mm512_max_epi16(dcv, Dmaxv);
+
+        /* Calculate and store I(i,q) */
+        sv     =                       _mm512_adds_epi16(mpv, *tsc);  tsc++;
+        IMXo(q)= _mm512_max_epi16 (sv, _mm512_adds_epi16(ipv, *tsc)); tsc++;
+      }
+
+      /* Now the "special" states, which start from Mk->E (->C, ->J->B) */
+      xE = hmax_epi16_512(xEv);
+      if (xE >= 32767) { *ret_sc = eslINFINITY; return eslERANGE; }	/* immediately detect overflow */
+      xN = xN + om->xw[p7O_N][p7O_LOOP];
+      xC = ESL_MAX(xC + om->xw[p7O_C][p7O_LOOP], xE + om->xw[p7O_E][p7O_MOVE]);
+      xJ = ESL_MAX(xJ + om->xw[p7O_J][p7O_LOOP], xE + om->xw[p7O_E][p7O_LOOP]);
+      xB = ESL_MAX(xJ + om->xw[p7O_J][p7O_MOVE], xN + om->xw[p7O_N][p7O_MOVE]);
+
+      /* The "lazy F" loop; see p7_ViterbiFilter() for the test condition. */
+      Dmax = hmax_epi16_512(Dmaxv);
+      if (Dmax + om->ddbound_w > xB)
+	{
+	  /* At least one complete DD path. dcv has carried through from end of q loop above */
+	  dcv = rightshift_epi16_512(dcv, negInfv);
+	  tsc = om->twv_512 + 7*Q;	/* set tsc to start of the DD's */
+	  for (q = 0; q < Q; q++)
+	    {
+	      DMXo(q) = _mm512_max_epi16(dcv, DMXo(q));
+	      dcv     = _mm512_adds_epi16(DMXo(q), *tsc); tsc++;
+	    }
+
+	  /* Up to 31 more passes, while crossing a segment boundary improves a score. */
+	  do {
+	    dcv = rightshift_epi16_512(dcv, negInfv);
+	    tsc = om->twv_512 + 7*Q;	/* set tsc to start of the DD's */
+	    for (q = 0; q < Q; q++)
+	      {
+		if (! _mm512_cmpgt_epi16_mask(dcv, DMXo(q))) break;
+		DMXo(q) = _mm512_max_epi16(dcv, DMXo(q));
+		dcv     = _mm512_adds_epi16(DMXo(q), *tsc);   tsc++;
+	      }
+	  } while (q == Q);
+	}
+      else  /* not calculating DD? then just store the last M->D vector calc'ed.*/
+	DMXo(0) = rightshift_epi16_512(dcv, negInfv);
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T */
+  if (xC > -32768)
+    {
+      *ret_sc = (float) xC + (float) om->xw[p7O_C][p7O_MOVE] - (float) om->base_w;
+      *ret_sc /= om->scale_w;
+      *ret_sc -= 3.0; /* the NN/CC/JJ=0,-3nat approximation: see J5/36 */
+    }
+  else  *ret_sc = -eslINFINITY;
+  return eslOK;
+}
+/*-------------- end, p7_ViterbiFilter_avx512() -----------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests
+ *****************************************************************/
+#ifdef p7VITFILTER_AVX512_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* The AVX-512 filter must give exactly the same scores and return
+ * codes as the SSE one, for a random model of length <M> and <N>
+ * random test sequences of length <L>.
+ */
+static void
+utest_viterbi_avx512(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "vitfilter_avx512 unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  P7_OPROFILE *om2 = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *ox  = p7_omx_Create(M, 0, 0);
+  float        sc1, sc2;
+  int          st1, st2;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  if ((om2 = p7_oprofile_Copy(om)) == NULL) esl_fatal(msg);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      st1 = p7_ViterbiFilter_sse   (dsq, L, om,  ox, &sc1);
+      st2 = p7_ViterbiFilter_avx512(dsq, L, om2, ox, &sc2);   /* also checks that _Copy() carries the AVX-512 scores */
+      if (st1 != st2)                  esl_fatal("%s: status differs (%d, %d)", msg, st1, st2);
+      if (st1 == eslOK && sc1 != sc2)  esl_fatal("%s: scores differ (%.2f, %.2f)", msg, sc1, sc2);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  p7_oprofile_Destroy(om2);
+}
+#endif /*p7VITFILTER_AVX512_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+/*****************************************************************
+ * 3. Test driver
+ *****************************************************************/
+#ifdef p7VITFILTER_AVX512_TESTDRIVE
+/*
+   gcc -g -Wall -msse2 -mavx512f -mavx512bw -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o vitfilter_avx512_utest -Dp7VITFILTER_AVX512_TESTDRIVE vitfilter_avx512.c -lhmmer -leasel -lm
+   ./vitfilter_avx512_utest
+ */
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the AVX-512 Viterbi filter implementation";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  if (! __builtin_cpu_supports("avx512f") || ! __builtin_cpu_supports("avx512bw"))
+    {
+      if (esl_opt_GetBoolean(go, "-v")) printf("host has no AVX-512BW; test skipped\n");
+      esl_getopts_Destroy(go);
+      esl_randomness_Destroy(r);
+      return eslOK;
+    }
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("ViterbiFilter_avx512() tests, DNA\n");
+  utest_viterbi_avx512(r, abc, bg, M,  L, N);   /* normal sized models */
+  utest_viterbi_avx512(r, abc, bg, 1,  L, 10);  /* size 1 models       */
+  utest_viterbi_avx512(r, abc, bg, M,  1, 10);  /* size 1 sequences    */
+  utest_viterbi_avx512(r, abc, bg, 33, L, 10);  /* just over one 32-way segment */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf("ViterbiFilter_avx512() tests, protein\n");
+  utest_viterbi_avx512(r, abc, bg, M,  L, N);
+  utest_viterbi_avx512(r, abc, bg, 1,  L, 10);
+  utest_viterbi_avx512(r, abc, bg, M,  1, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7VITFILTER_AVX512_TESTDRIVE*/
+
+
+#else /* ! HMMER_AVX512 */
+
+/* Provide a dummy symbol so this compilation unit isn't empty.  */
+void p7_vitfilter_avx512_silence_hack(void) { return; }
+
+#endif /* HMMER_AVX512 or not */
@@ -0,0 +1,652 @@
+/* Viterbi alignment with traceback; SSE version.
+ * (Compare generic versions, p7_GViterbi() and p7_GTrace().)
+ *
+ * A striped Viterbi fill of a full matrix, and its traceback, for
+ * the pipeline's fast Viterbi-path domain definition
+ * (p7_domaindef_ByViterbi()). Unlike p7_ViterbiScore(), it works on
+ * the profile as it is, in probability space: the recursion is the
+ * Forward recursion of fwdback.c with max in place of sum, and the
+ * same sparse rescaling, which scales all the paths into a row by
+ * the same factor, so it doesn't change which one is best.
+ *
+ * Contents:
+ *    1. Viterbi fill and traceback.
+ *    2. Selection of steps in the traceback.
+ *    3. Benchmark driver.
+ *    4. Unit tests.
+ *    5. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <math.h>
+
+#include <xmmintrin.h>		/* SSE  */
+#include <emmintrin.h>		/* SSE2 */
+
+#include "easel.h"
+#include "esl_sse.h"
+#include "esl_vectorops.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static inline int select_m(const P7_OPROFILE *om, const P7_OMX *ox, int i, int k);
+static inline int select_d(const P7_OPROFILE *om, const P7_OMX *ox, int i, int k);
+static inline int select_i(const P7_OPROFILE *om, const P7_OMX *ox, int i, int k);
+static inline int select_n(int i);
+static inline int select_c(const P7_OPROFILE *om, const P7_OMX *ox, int i);
+static inline int select_j(const P7_OPROFILE *om, const P7_OMX *ox, int i);
+static inline int select_e(const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k);
+static inline int select_b(const P7_OPROFILE *om, const P7_OMX *ox, int i);
+
+
+/*****************************************************************
+ * 1. Viterbi fill and traceback.
+ *****************************************************************/
+
+/* Function:  p7_ViterbiFull()
+ * Synopsis:  Viterbi fill of a full matrix, for a traceback.
+ *
+ * Purpose:   Calculate the Viterbi (maximum likelihood) alignment of
+ *            profile <om> to digital sequence <dsq> of length <L>,
+ *            in the full DP matrix <ox>, which caller has allocated
+ *            for at least <om->M> by <L>; then <p7_VTrace()> can
+ *            recover the alignment. The score of that alignment (in
+ *            nats) is optionally returned in <opt_sc>.
+ *
+ *            <om> is used in its usual probability space
+ *            configuration, so unlike <p7_ViterbiScore()> this can be
+ *            called on the pipeline's profile, between Forward and
+ *            Backward. Like the rest of the SSE implementation, the
+ *            profile must be local; it may be multihit or unihit.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslERANGE> if the score overflows or underflows, which
+ *            shouldn't happen for a local profile.
+ */
+int
+p7_ViterbiFull(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+  register __m128 mpv, dpv, ipv;   /* previous row values                                       */
+  register __m128 sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m128 dcv;		   /* delayed storage of D(i,q+1)                               */
+  register __m128 xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m128 xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register __m128 cv;		   /* keeps track of whether any DD's change DMO(q)             */
+  __m128   zerov = _mm_setzero_ps();
+  float    xN, xE, xB, xC, xJ;	   /* special states' scores                                    */
+  int      multihit = (om->xf[p7O_E][p7O_LOOP] > 0.0f);
+  int      i;			   /* counter over sequence positions 1..L                      */
+  int      q;			   /* counter over quads 0..nq-1                                */
+  int      j;			   /* counter over DD iterations (4 is full serialization)      */
+  int      Q   = p7O_NQF(om->M);   /* segment length: # of vectors                              */
+  __m128  *dpc = ox->dpf[0];       /* current row, for use in {MDI}MO(dpc,q) access macro       */
+  __m128  *dpp;                    /* previous row                                              */
+  __m128  *rp;			   /* will point at om->rfv[x] for residue x[i]                 */
+  __m128  *tp;			   /* will point into (and step thru) om->tfv                   */
+
+  /* Initialization, as for Forward. */
+  ox->M  = om->M;
+  ox->L  = L;
+  ox->has_own_scales = TRUE;
+  for (q = 0; q < Q; q++)
+    MMO(dpc,q) = IMO(dpc,q) = DMO(dpc,q) = zerov;
+  xE = ox->xmx[p7X_E] = 0.;
+  xN = ox->xmx[p7X_N] = 1.;
+  xJ = ox->xmx[p7X_J] = 0.;
+  xB = ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
+  xC = ox->xmx[p7X_C] = 0.;
+  ox->xmx[p7X_SCALE] = 1.0;
+  ox->totscale       = 0.0;
+
+  for (i = 1; i <= L; i++)
+    {
+      dpp   = dpc;
+      dpc   = ox->dpf[i];
+      rp    = om->rfv[dsq[i]];
+      tp    = om->tfv;
+      dcv   = zerov;
+      xEv   = zerov;
+      xBv   = _mm_set1_ps(xB);
+
+      mpv   = esl_sse_rightshiftz_float(MMO(dpp,Q-1));
+      dpv   = esl_sse_rightshiftz_float(DMO(dpp,Q-1));
+      ipv   = esl_sse_rightshiftz_float(IMO(dpp,Q-1));
+
+      for (q = 0; q < Q; q++)
+	{
+	  sv   =                _mm_mul_ps(xBv, *tp);  tp++;
+	  sv   = _mm_max_ps(sv, _mm_mul_ps(mpv, *tp)); tp++;
+	  sv   = _mm_max_ps(sv, _mm_mul_ps(ipv, *tp)); tp++;
+	  sv   = _mm_max_ps(sv, _mm_mul_ps(dpv, *tp)); tp++;
+	  sv   = _mm_mul_ps(sv, *rp);                  rp++;
+	  xEv  = _mm_max_ps(xEv, sv);
+
+	  mpv = MMO(dpp,q);
+	  dpv = DMO(dpp,q);
+	  ipv = IMO(dpp,q);
+
+	  MMO(dpc,q) = sv;
+	  DMO(dpc,q) = dcv;
+
+	  dcv   = _mm_mul_ps(sv, *tp); tp++;
+
+	  sv         =                _mm_mul_ps(mpv, *tp);  tp++;
+	  IMO(dpc,q) = _mm_max_ps(sv, _mm_mul_ps(ipv, *tp)); tp++;
+	}
+
+      /* The DD paths: one pass adding M->D and D->D to DMO(q), then
+       * up to three more, until no D changes, to carry D->D paths
+       * across the segments.
+       */
+      dcv        = esl_sse_rightshiftz_float(dcv);
+      DMO(dpc,0) = zerov;
+      tp         = om->tfv + 7*Q;
+      for (q = 0; q < Q; q++)
+	{
+	  DMO(dpc,q) = _mm_max_ps(dcv, DMO(dpc,q));
+	  dcv        = _mm_mul_ps(DMO(dpc,q), *tp); tp++;
+	}
+      for (j = 1; j < 4; j++)
+	{
+	  dcv = esl_sse_rightshiftz_float(dcv);
+	  tp  = om->tfv + 7*Q;
+	  cv  = zerov;
+	  for (q = 0; q < Q; q++)
+	    {
+	      cv         = _mm_or_ps(cv, _mm_cmpgt_ps(dcv, DMO(dpc,q)));
+	      DMO(dpc,q) = _mm_max_ps(dcv, DMO(dpc,q));
+	      dcv        = _mm_mul_ps(DMO(dpc,q), *tp); tp++;
+	    }
+	  if (! _mm_movemask_ps(cv)) break;
+	}
+
+      /* A Dk->E path is never better than the Mj->E it came from, so
+       * E is the max over the M's, as in the Viterbi filter.
+       */
+      esl_sse_hmax_ps(xEv, &xE);
+
+      xN =  xN * om->xf[p7O_N][p7O_LOOP];
+      xC = ESL_MAX(xC * om->xf[p7O_C][p7O_LOOP],  xE * om->xf[p7O_E][p7O_MOVE]);
+      if (multihit) {
+	xJ = ESL_MAX(xJ * om->xf[p7O_J][p7O_LOOP],  xE * om->xf[p7O_E][p7O_LOOP]);
+	xB = ESL_MAX(xJ * om->xf[p7O_J][p7O_MOVE],  xN * om->xf[p7O_N][p7O_MOVE]);
+      } else
+	xB = xN * om->xf[p7O_N][p7O_MOVE];
+
+      /* Sparse rescaling, as in Forward */
+      if (xE > 1.0e4)
+	{
+	  xN  = xN / xE;
+	  xC  = xC / xE;
+	  xJ  = xJ / xE;
+	  xB  = xB / xE;
+	  xEv = _mm_set1_ps(1.0 / xE);
+	  for (q = 0; q < Q; q++)
+	    {
+	      MMO(dpc,q) = _mm_mul_ps(MMO(dpc,q), xEv);
+	      DMO(dpc,q) = _mm_mul_ps(DMO(dpc,q), xEv);
+	      IMO(dpc,q) = _mm_mul_ps(IMO(dpc,q), xEv);
+	    }
+	  ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = xE;
+	  ox->totscale += log(xE);
+	  xE = 1.0;
+	}
+      else ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = 1.0;
+
+      ox->xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      ox->xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      ox->xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      ox->xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      ox->xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    }
+
+  if      (isnan(xC))        ESL_EXCEPTION(eslERANGE, "viterbi score is NaN");
+  else if (L>0 && xC == 0.0) ESL_EXCEPTION(eslERANGE, "viterbi score underflow (is 0.0)");
+  else if (isinf(xC) == 1)   ESL_EXCEPTION(eslERANGE, "viterbi score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = ox->totscale + log(xC * om->xf[p7O_C][p7O_MOVE]);
+  return eslOK;
+}
+
+
+/* Function:  p7_VTrace()
+ * Synopsis:  Traceback of a Viterbi matrix.
+ *
+ * Purpose:   Trace back the Viterbi alignment of profile <om> to
+ *            digital sequence <dsq> of length <L> from the matrix
+ *            <ox> that <p7_ViterbiFull()> filled, and store it in
+ *            <tr>, which the caller provides empty (new or
+ *            Reuse()'d) and which is grown here as needed. Ties
+ *            between paths are broken the same way each time, so
+ *            the trace is reproducible, but not necessarily the
+ *            same as <p7_GTrace()>'s when two paths score the same.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ *            <eslEINVAL> if the trace <tr> isn't empty, or the
+ *            traceback fails.
+ */
+int
+p7_VTrace(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *ox, P7_TRACE *tr)
+{
+  int   i = L;			/* position in sequence 1..L */
+  int   k = 0;			/* position in model 1..M */
+  int   s0, s1;			/* choice of a state */
+  int   status;
+
+  if (tr->N != 0) ESL_EXCEPTION(eslEINVAL, "trace not empty; needs to be Reuse()'d?");
+
+  if ((status = p7_trace_Append(tr, p7T_T, k, i)) != eslOK) return status;
+  if ((status = p7_trace_Append(tr, p7T_C, k, i)) != eslOK) return status;
+  s0 = tr->st[tr->N-1];
+  while (s0 != p7T_S)
+    {
+      switch (s0) {
+      case p7T_M: s1 = select_m(om, ox, i, k);  k--; i--; break;
+      case p7T_D: s1 = select_d(om, ox, i, k);  k--;      break;
+      case p7T_I: s1 = select_i(om, ox, i, k);       i--; break;
+      case p7T_N: s1 = select_n(i);                       break;
+      case p7T_C: s1 = select_c(om, ox, i);               break;
+      case p7T_J: s1 = select_j(om, ox, i);               break;
+      case p7T_E: s1 = select_e(om, ox, i, &k);           break;
+      case p7T_B: s1 = select_b(om, ox, i);               break;
+      default: ESL_EXCEPTION(eslEINVAL, "bogus state in traceback");
+      }
+      if (s1 == -1) ESL_EXCEPTION(eslEINVAL, "Viterbi traceback choice failed");
+
+      if ((status = p7_trace_Append(tr, s1, k, i)) != eslOK) return status;
+
+      if ( (s1 == p7T_N || s1 == p7T_J || s1 == p7T_C) && s1 == s0) i--;
+      s0 = s1;
+    }
+
+  tr->M = om->M;
+  tr->L = L;
+  return p7_trace_Reverse(tr);
+}
+/*---------------- end, fill and traceback ----------------------*/
+
+
+/*****************************************************************
+ * 2. Selection of steps in the traceback
+ *****************************************************************/
+/* As in stotrace.c, but each select_?() takes the best of the
+ * paths into the current cell, instead of sampling one. All the
+ * paths compared are in the same row's scaling.
+ */
+
+/* M(i,k) is reached from B(i-1), M(i-1,k-1), D(i-1,k-1), or I(i-1,k-1). */
+static inline int
+select_m(const P7_OPROFILE *om, const P7_OMX *ox, int i, int k)
+{
+  int     Q     = p7O_NQF(ox->M);
+  int     q     = (k-1) % Q;
+  int     r     = (k-1) / Q;
+  __m128 *tp    = om->tfv + 7*q;
+  __m128  xBv   = _mm_set1_ps(ox->xmx[(i-1)*p7X_NXCELLS+p7X_B]);
+  __m128  mpv, dpv, ipv;
+  union { __m128 v; float p[4]; } u;
+  float   path[4];
+  int     state[4] = { p7T_B, p7T_M, p7T_I, p7T_D };
+
+  if (q > 0) {
+    mpv = ox->dpf[i-1][(q-1)*3 + p7X_M];
+    dpv = ox->dpf[i-1][(q-1)*3 + p7X_D];
+    ipv = ox->dpf[i-1][(q-1)*3 + p7X_I];
+  } else {
+    mpv = esl_sse_rightshiftz_float(ox->dpf[i-1][(Q-1)*3 + p7X_M]);
+    dpv = esl_sse_rightshiftz_float(ox->dpf[i-1][(Q-1)*3 + p7X_D]);
+    ipv = esl_sse_rightshiftz_float(ox->dpf[i-1][(Q-1)*3 + p7X_I]);
+  }
+
+  u.v = _mm_mul_ps(xBv, *tp); tp++;  path[0] = u.p[r];
+  u.v = _mm_mul_ps(mpv, *tp); tp++;  path[1] = u.p[r];
+  u.v = _mm_mul_ps(ipv, *tp); tp++;  path[2] = u.p[r];
+  u.v = _mm_mul_ps(dpv, *tp);        path[3] = u.p[r];
+  return state[esl_vec_FArgMax(path, 4)];
+}
+
+/* D(i,k) is reached from M(i, k-1) or D(i,k-1). */
+static inline int
+select_d(const P7_OPROFILE *om, const P7_OMX *ox, int i, int k)
+{
+  int     Q     = p7O_NQF(ox->M);
+  int     q     = (k-1) % Q;
+  int     r     = (k-1) / Q;
+  __m128  mpv, dpv;
+  __m128  tmdv, tddv;
+  union { __m128 v; float p[4]; } u;
+  float   path[2];
+  int     state[2] = { p7T_M, p7T_D };
+
+  if (q > 0) {
+    mpv  = ox->dpf[i][(q-1)*3 + p7X_M];
+    dpv  = ox->dpf[i][(q-1)*3 + p7X_D];
+    tmdv = om->tfv[7*(q-1) + p7O_MD];
+    tddv = om->tfv[7*Q + (q-1)];
+  } else {
+    mpv  = esl_sse_rightshiftz_float(ox->dpf[i][(Q-1)*3 + p7X_M]);
+    dpv  = esl_sse_rightshiftz_float(ox->dpf[i][(Q-1)*3 + p7X_D]);
+    tmdv = esl_sse_rightshiftz_float(om->tfv[7*(Q-1) + p7O_MD]);
+    tddv = esl_sse_rightshiftz_float(om->tfv[8*Q-1]);
+  }
+
+  u.v = _mm_mul_ps(mpv, tmdv); path[0] = u.p[r];
+  u.v = _mm_mul_ps(dpv, tddv); path[1] = u.p[r];
+  return state[esl_vec_FArgMax(path, 2)];
+}
+
+/* I(i,k) is reached from M(i-1, k) or I(i-1,k). */
+static inline int
+select_i(const P7_OPROFILE *om, const P7_OMX *ox, int i, int k)
+{
+  int     Q    = p7O_NQF(ox->M);
+  int     q    = (k-1) % Q;
+  int     r    = (k-1) / Q;
+  __m128  mpv  = ox->dpf[i-1][q*3 + p7X_M];
+  __m128  ipv  = ox->dpf[i-1][q*3 + p7X_I];
+  __m128 *tp   = om->tfv + 7*q + p7O_MI;
+  union { __m128 v; float p[4]; } u;
+  float   path[2];
+  int     state[2] = { p7T_M, p7T_I };
+
+  u.v = _mm_mul_ps(mpv, *tp); tp++;  path[0] = u.p[r];
+  u.v = _mm_mul_ps(ipv, *tp);        path[1] = u.p[r];
+  return state[esl_vec_FArgMax(path, 2)];
+}
+
+/* N(i) must come from N(i-1) for i>0; else it comes from S */
+static inline int
+select_n(int i)
+{
+  if (i == 0) return p7T_S;
+  else        return p7T_N;
+}
+
+/* C(i) is reached from E(i) or C(i-1). */
+static inline int
+select_c(const P7_OPROFILE *om, const P7_OMX *ox, int i)
+{
+  float path[2];
+  int   state[2] = { p7T_C, p7T_E };
+
+  path[0] = ox->xmx[(i-1)*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP];
+  path[1] = ox->xmx[    i*p7X_NXCELLS+p7X_E] * om->xf[p7O_E][p7O_MOVE] * ox->xmx[i*p7X_NXCELLS+p7X_SCALE];
+  return state[esl_vec_FArgMax(path, 2)];
+}
+
+/* J(i) is reached from E(i) or J(i-1). */
+static inline int
+select_j(const P7_OPROFILE *om, const P7_OMX *ox, int i)
+{
+  float path[2];
+  int   state[2] = { p7T_J, p7T_E };
+
+  path[0] = ox->xmx[(i-1)*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP];
+  path[1] = ox->xmx[    i*p7X_NXCELLS+p7X_E] * om->xf[p7O_E][p7O_LOOP] * ox->xmx[i*p7X_NXCELLS+p7X_SCALE];
+  return state[esl_vec_FArgMax(path, 2)];
+}
+
+/* E(i) is reached from the best M(i,k), k=1..M; see p7_ViterbiFull()
+ * on why not from a D. Padding cells past M are 0.0, so never chosen.
+ */
+static inline int
+select_e(const P7_OPROFILE *om, const P7_OMX *ox, int i, int *ret_k)
+{
+  int    Q     = p7O_NQF(ox->M);
+  float  best  = -1.0;
+  union { __m128 v; float p[4]; } u;
+  int    q,r;
+
+  *ret_k = -1;
+  for (q = 0; q < Q; q++)
+    {
+      u.v = ox->dpf[i][q*3 + p7X_M];
+      for (r = 0; r < 4; r++)
+	if (u.p[r] > best || (u.p[r] == best && r*Q + q + 1 < *ret_k)) { best = u.p[r]; *ret_k = r*Q + q + 1; }
+    }
+  return (best > 0.0 ? p7T_M : -1);
+}
+
+/* B(i) is reached from N(i) or J(i). */
+static inline int
+select_b(const P7_OPROFILE *om, const P7_OMX *ox, int i)
+{
+  float path[2];
+  int   state[2] = { p7T_N, p7T_J };
+
+  path[0] = ox->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_MOVE];
+  path[1] = ox->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_MOVE];
+  return state[esl_vec_FArgMax(path, 2)];
+}
+/*---------------------- end, step selection --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Benchmark
+ *****************************************************************/
+#ifdef p7VITTRACE_BENCHMARK
+/*
+   gcc -g -O2 -std=gnu99 -msse2 -o vittrace_benchmark -I.. -L.. -I../../easel -L../../easel -Dp7VITTRACE_BENCHMARK vittrace.c -lhmmer -leasel -lm
+   ./vittrace_benchmark <hmmfile>
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                   0 },
+  { "-N",        eslARG_INT,   "2000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                   0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for Viterbi fill and traceback, SSE version";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *ox      = NULL;
+  P7_TRACE       *tr      = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           sc;
+
+  if (p7_hmmfile_OpenE(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)            != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+
+  ox = p7_omx_Create(gm->M, L, L);
+  tr = p7_trace_Create();
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      p7_ViterbiFull(dsq, L, om, ox, &sc);
+      p7_VTrace(dsq, L, om, ox, tr);
+      p7_trace_Reuse(tr);
+    }
+  esl_stopwatch_Stop(w);
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n", gm->M);
+
+  free(dsq);
+  p7_trace_Destroy(tr);
+  p7_omx_Destroy(ox);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7VITTRACE_BENCHMARK*/
+/*----------------- end, benchmark ------------------------------*/
+
+
+/*****************************************************************
+ * 4. Unit tests
+ *****************************************************************/
+#ifdef p7VITTRACE_TESTDRIVE
+
+/* tests:
+ *   1. the Viterbi score agrees with p7_GViterbi()'s;
+ *   2. the trace validates, and scores what p7_ViterbiFull() said.
+ */
+static void
+utest_vittrace(ESL_ALPHABET *abc, P7_PROFILE *gm, P7_OPROFILE *om, ESL_DSQ *dsq, int L)
+{
+  char      msg[] = "viterbi trace unit test failed";
+  P7_GMX   *gx    = NULL;
+  P7_OMX   *ox    = NULL;
+  P7_TRACE *tr    = NULL;
+  char      errbuf[eslERRBUFSIZE];
+  float     gsc, vsc, trsc;
+
+  if ((gx = p7_gmx_Create(gm->M, L))              == NULL)  esl_fatal(msg);
+  if ((ox = p7_omx_Create(gm->M, L, L))           == NULL)  esl_fatal(msg);
+  if ((tr = p7_trace_Create())                    == NULL)  esl_fatal(msg);
+
+  if (p7_GViterbi   (dsq, L, gm, gx, &gsc)        != eslOK) esl_fatal(msg);
+  if (p7_ViterbiFull(dsq, L, om, ox, &vsc)        != eslOK) esl_fatal(msg);
+  if (p7_VTrace     (dsq, L, om, ox, tr)          != eslOK) esl_fatal(msg);
+  if (p7_trace_Validate(tr, abc, dsq, errbuf)     != eslOK) esl_fatal("trace invalid:\n%s", errbuf);
+  if (p7_trace_Score(tr, dsq, gm, &trsc)          != eslOK) esl_fatal(msg);
+
+  /* pspace floats vs. the generic profile's log scores: be tolerant */
+  if (esl_FCompare_old(gsc,  vsc, 0.001) != eslOK) esl_fatal("%s: viterbi score %f, generic %f", msg, vsc, gsc);
+  if (esl_FCompare_old(trsc, vsc, 0.001) != eslOK) esl_fatal("%s: trace scores %f, viterbi %f",  msg, trsc, vsc);
+
+  p7_trace_Destroy(tr);
+  p7_omx_Destroy(ox);
+  p7_gmx_Destroy(gx);
+}
+#endif /*p7VITTRACE_TESTDRIVE*/
+/*----------------- end, unit tests -----------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Test driver
+ *****************************************************************/
+#ifdef p7VITTRACE_TESTDRIVE
+/* gcc -std=gnu99 -msse2 -g -Wall -o vittrace_utest -Dp7VITTRACE_TESTDRIVE -I.. -L.. -I../../easel -L../../easel vittrace.c -lhmmer -leasel -lm
+ */
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_randomseq.h"
+
+#include <p7_config.h>
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "200", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                   0 },
+  { "-M",        eslARG_INT,    "145", NULL, "n>0", NULL,  NULL, NULL, "length of sampled test HMM",                     0 },
+  { "-N",        eslARG_INT,     "10", NULL, "n>0", NULL,  NULL, NULL, "number of target seqs of each kind",             0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for Viterbi fill and traceback (optimized version)";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go     = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r      = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc    = NULL;
+  P7_HMM         *hmm    = NULL;
+  P7_PROFILE     *gm     = NULL;
+  P7_OPROFILE    *om     = NULL;
+  P7_BG          *bg     = NULL;
+  ESL_DSQ        *dsq    = NULL;
+  ESL_SQ         *sq     = NULL;
+  int             M      = esl_opt_GetInteger(go, "-M");
+  int             L      = esl_opt_GetInteger(go, "-L");
+  int             N      = esl_opt_GetInteger(go, "-N");
+  int             mode, idx;
+
+  if ((abc = esl_alphabet_Create(eslAMINO))         == NULL)  esl_fatal("failed to create alphabet");
+  if (p7_hmm_Sample(r, M, abc, &hmm)                != eslOK) esl_fatal("failed to sample an HMM");
+  if ((bg = p7_bg_Create(abc))                      == NULL)  esl_fatal("failed to create null model");
+  if ((gm = p7_profile_Create(hmm->M, abc))         == NULL)  esl_fatal("failed to create profile");
+  if ((om = p7_oprofile_Create(hmm->M, abc))        == NULL)  esl_fatal("failed to create optimized profile");
+  if ((sq = esl_sq_CreateDigital(abc))              == NULL)  esl_fatal("sequence allocation failed");
+  if ((dsq = malloc(sizeof(ESL_DSQ) *(L+2)))        == NULL)  esl_fatal("malloc failed");
+
+  /* multihit and unihit local; iid and homologous targets */
+  for (mode = 0; mode < 2; mode++)
+    {
+      if (p7_ProfileConfig(hmm, bg, gm, L, (mode == 0 ? p7_LOCAL : p7_UNILOCAL)) != eslOK) esl_fatal("failed to config profile");
+      if (p7_oprofile_Convert(gm, om)   != eslOK) esl_fatal("failed to convert profile");
+
+      for (idx = 0; idx < N; idx++)
+	{
+	  if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq) != eslOK) esl_fatal("seq generation failed");
+	  utest_vittrace(abc, gm, om, dsq, L);
+
+	  if (p7_ProfileEmit(r, hmm, gm, bg, sq, NULL)  != eslOK) esl_fatal("profile emission failed");
+	  p7_ReconfigLength(gm, sq->n);
+	  p7_oprofile_ReconfigLength(om, sq->n);
+	  utest_vittrace(abc, gm, om, sq->dsq, sq->n);
+	  p7_ReconfigLength(gm, L);
+	  p7_oprofile_ReconfigLength(om, L);
+	  esl_sq_Reuse(sq);
+	}
+    }
+
+  fprintf(stderr, "#  status = ok\n");
+
+  esl_sq_Destroy(sq);
+  free(dsq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7VITTRACE_TESTDRIVE*/
+/*---------------- end, test driver -----------------------------*/
@@ -92,11 +92,17 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
   vector unsigned char basev;      /* offset for scores                                         */
   vector unsigned char ceilingv;   /* saturateed simd value used to test for overflow           */
   vector unsigned char tempv;
+  int status;
 
   /* Check that the DP matrix is ok for us. */
   if (Q > ox->allocQ16)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
   ox->M   = om->M;
 
+  /* Try the J-state-free SSV filter first; it passes (eslENORESULT)
+   * when the J state might have mattered, and we do the full calculation.
+   */
+  if ((status = p7_SSVFilter(dsq, L, om, ret_sc)) != eslENORESULT) return status;
+
   /* Initialization. In offset unsigned arithmetic, -infinity is 0, and 0 is om->base.
    */
   dp  = ox->dpb[0];
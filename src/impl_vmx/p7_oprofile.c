@@ -53,6 +53,7 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   int          status;
   P7_OPROFILE *om  = NULL;
   int          nqb = p7O_NQB(allocM); /* # of uchar vectors needed for query */
+  int          nqs = nqb + p7O_EXTRA_SB; /* # of sbv vectors, with SSV wraparound */
   int          nqw = p7O_NQW(allocM); /* # of sword vectors needed for query */
   int          nqf = p7O_NQF(allocM); /* # of float vectors needed for query */
   int          x;
@@ -60,11 +61,13 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   /* level 0 */
   ESL_ALLOC(om, sizeof(P7_OPROFILE));
   om->rbv_mem = NULL;
+  om->sbv_mem = NULL;
   om->rwv_mem = NULL;
   om->twv_mem = NULL;
   om->rfv_mem = NULL;
   om->tfv_mem = NULL;
   om->rbv     = NULL;
+  om->sbv     = NULL;
   om->rwv     = NULL;
   om->twv     = NULL;
   om->rfv     = NULL;
@@ -75,17 +78,20 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
 
   /* +15 is for manual 16-byte alignment */
   ESL_ALLOC(om->rbv_mem, sizeof(vector unsigned char) * nqb  * abc->Kp          +15);
+  ESL_ALLOC(om->sbv_mem, sizeof(vector signed char)   * nqs  * abc->Kp          +15);
   ESL_ALLOC(om->rwv_mem, sizeof(vector signed short)  * nqw  * abc->Kp          +15);
   ESL_ALLOC(om->twv_mem, sizeof(vector signed short)  * nqw  * p7O_NTRANS       +15);
   ESL_ALLOC(om->rfv_mem, sizeof(vector float)         * nqf  * abc->Kp          +15);
   ESL_ALLOC(om->tfv_mem, sizeof(vector float)         * nqf  * p7O_NTRANS       +15);
 
   ESL_ALLOC(om->rbv, sizeof(vector unsigned char *) * abc->Kp);
+  ESL_ALLOC(om->sbv, sizeof(vector signed char *)   * abc->Kp);
   ESL_ALLOC(om->rwv, sizeof(vector signed short *)  * abc->Kp);
   ESL_ALLOC(om->rfv, sizeof(vector float *)         * abc->Kp);
 
   /* align vector memory on 16-byte boundaries */
   om->rbv[0] = (vector unsigned char *) (((unsigned long int) om->rbv_mem + 15) & (~0xf));
+  om->sbv[0] = (vector signed char *)   (((unsigned long int) om->sbv_mem + 15) & (~0xf));
   om->rwv[0] = (vector signed short *)  (((unsigned long int) om->rwv_mem + 15) & (~0xf));
   om->twv    = (vector signed short *)  (((unsigned long int) om->twv_mem + 15) & (~0xf));
   om->rfv[0] = (vector float *)         (((unsigned long int) om->rfv_mem + 15) & (~0xf));
@@ -95,6 +101,7 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   /* set the rest of the row pointers for match emissions */
   for (x = 1; x < abc->Kp; x++) {
     om->rbv[x] = om->rbv[0] + (x * nqb);
+    om->sbv[x] = om->sbv[0] + (x * nqs);
     om->rwv[x] = om->rwv[0] + (x * nqw);
     om->rfv[x] = om->rfv[0] + (x * nqf);
   }
@@ -177,11 +184,13 @@ p7_oprofile_Destroy(P7_OPROFILE *om)
   if (om->clone == 0)
     {
       if (om->rbv_mem    != NULL) free(om->rbv_mem);
+      if (om->sbv_mem    != NULL) free(om->sbv_mem);
       if (om->rwv_mem    != NULL) free(om->rwv_mem);
       if (om->twv_mem    != NULL) free(om->twv_mem);
       if (om->rfv_mem    != NULL) free(om->rfv_mem);
       if (om->tfv_mem    != NULL) free(om->tfv_mem);
       if (om->rbv        != NULL) free(om->rbv);
+      if (om->sbv        != NULL) free(om->sbv);
       if (om->rwv        != NULL) free(om->rwv);
       if (om->rfv        != NULL) free(om->rfv);
       if (om->name       != NULL) free(om->name);
@@ -208,17 +217,20 @@ p7_oprofile_Sizeof(P7_OPROFILE *om)
 {
   size_t n = 0;
   int    nqb = om->allocQ16; /* # of uchar vectors needed for query */
+  int    nqs = nqb + p7O_EXTRA_SB;
   int    nqw = om->allocQ8;  /* # of sword vectors needed for query */
   int    nqf = om->allocQ4;  /* # of float vectors needed for query */
 
   n += sizeof(P7_OPROFILE);
   n += sizeof(vector unsigned char) * nqb  * om->abc->Kp +15; /* om->rbv_mem */
+  n += sizeof(vector signed char)   * nqs  * om->abc->Kp +15; /* om->sbv_mem */
   n += sizeof(vector signed short)  * nqw  * om->abc->Kp +15; /* om->rwv_mem */
   n += sizeof(vector signed short)  * nqw  * p7O_NTRANS  +15; /* om->twv_mem */
   n += sizeof(vector float)         * nqf  * om->abc->Kp +15; /* om->rfv_mem */
   n += sizeof(vector float)         * nqf  * p7O_NTRANS  +15; /* om->tfv_mem */
 
   n += sizeof(vector unsigned char *) * om->abc->Kp; /* om->rbv */
+  n += sizeof(vector signed char *)   * om->abc->Kp; /* om->sbv */
   n += sizeof(vector signed short *)  * om->abc->Kp; /* om->rwv */
   n += sizeof(vector float *)         * om->abc->Kp; /* om->rfv */
 
@@ -245,6 +257,7 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   int           status;
 
   int           nqb  = p7O_NQB(om1->allocM); /* # of uchar vectors needed for query */
+  int           nqs  = nqb + p7O_EXTRA_SB;
   int           nqw  = p7O_NQW(om1->allocM); /* # of sword vectors needed for query */
   int           nqf  = p7O_NQF(om1->allocM); /* # of float vectors needed for query */
 
@@ -257,11 +270,13 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   /* level 0 */
   ESL_ALLOC(om2, sizeof(P7_OPROFILE));
   om2->rbv_mem = NULL;
+  om2->sbv_mem = NULL;
   om2->rwv_mem = NULL;
   om2->twv_mem = NULL;
   om2->rfv_mem = NULL;
   om2->tfv_mem = NULL;
   om2->rbv     = NULL;
+  om2->sbv     = NULL;
   om2->rwv     = NULL;
   om2->twv     = NULL;
   om2->rfv     = NULL;
@@ -271,17 +286,20 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
 
   /* +15 is for manual 16-byte alignment */
   ESL_ALLOC(om2->rbv_mem, sizeof(vector unsigned char) * nqb  * abc->Kp    +15);	
+  ESL_ALLOC(om2->sbv_mem, sizeof(vector signed char)   * nqs  * abc->Kp    +15);
   ESL_ALLOC(om2->rwv_mem, sizeof(vector signed short)  * nqw  * abc->Kp    +15);
   ESL_ALLOC(om2->twv_mem, sizeof(vector signed short)  * nqw  * p7O_NTRANS +15);
   ESL_ALLOC(om2->rfv_mem, sizeof(vector float)         * nqf  * abc->Kp    +15);
   ESL_ALLOC(om2->tfv_mem, sizeof(vector float)         * nqf  * p7O_NTRANS +15);
 
   ESL_ALLOC(om2->rbv, sizeof(vector unsigned char *) * abc->Kp);
+  ESL_ALLOC(om2->sbv, sizeof(vector signed char *)   * abc->Kp);
   ESL_ALLOC(om2->rwv, sizeof(vector signed short *)  * abc->Kp);
   ESL_ALLOC(om2->rfv, sizeof(vector float *)         * abc->Kp);
 
   /* align vector memory on 16-byte boundaries */
   om2->rbv[0] = (vector unsigned char *) (((unsigned long int) om2->rbv_mem + 15) & (~0xf));
+  om2->sbv[0] = (vector signed char *)   (((unsigned long int) om2->sbv_mem + 15) & (~0xf));
   om2->rwv[0] = (vector signed short *)  (((unsigned long int) om2->rwv_mem + 15) & (~0xf));
   om2->twv    = (vector signed short *)  (((unsigned long int) om2->twv_mem + 15) & (~0xf));
   om2->rfv[0] = (vector float *)         (((unsigned long int) om2->rfv_mem + 15) & (~0xf));
@@ -289,12 +307,14 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
 
   /* copy the vector data */
   memcpy(om2->rbv[0], om1->rbv[0], sizeof(vector unsigned char) * nqb  * abc->Kp);
+  memcpy(om2->sbv[0], om1->sbv[0], sizeof(vector signed char)   * nqs  * abc->Kp);
   memcpy(om2->rwv[0], om1->rwv[0], sizeof(vector signed short)  * nqw  * abc->Kp);
   memcpy(om2->rfv[0], om1->rfv[0], sizeof(vector float)         * nqf  * abc->Kp);
 
   /* set the rest of the row pointers for match emissions */
   for (x = 1; x < abc->Kp; x++) {
     om2->rbv[x] = om2->rbv[0] + (x * nqb);
+    om2->sbv[x] = om2->sbv[0] + (x * nqs);
     om2->rwv[x] = om2->rwv[0] + (x * nqw);
     om2->rfv[x] = om2->rfv[0] + (x * nqf);
   }
@@ -606,7 +626,7 @@ p7_oprofile_UpdateMSVEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
     }
   }
 
-  return eslOK;
+  return p7_oprofile_ConvertSSV(om);
 }
 
 
@@ -728,7 +748,7 @@ mf_conversion(const P7_PROFILE *gm, P7_OPROFILE *om)
   om->tec_b = unbiased_byteify(om, logf(0.5f));                                       /* constant multihit E->C = E->J */
   om->tjb_b = unbiased_byteify(om, logf(3.0f / (float) (gm->L+3))); /* this adopts the L setting of the parent profile */
 
-  return eslOK;
+  return p7_oprofile_ConvertSSV(om);
 }
 
 
@@ -970,6 +990,47 @@ p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om)
   return status;
 }
 
+/* Function:  p7_oprofile_ConvertSSV()
+ * Synopsis:  Fill the SSV filter's signed match scores from the MSV ones.
+ *
+ * Purpose:   Set <om->sbv> from <om->rbv> and <om->bias_b>: each
+ *            signed score is <rbv - bias>, as <p7_SSVFilter()> wants
+ *            them, and the first <p7O_EXTRA_SB> vectors of each
+ *            residue's row are repeated past its end, so the banded
+ *            SSV kernels can run off the end of the striped profile.
+ *
+ *            <p7_oprofile_Convert()> and
+ *            <p7_oprofile_UpdateMSVEmissionScores()> call this
+ *            themselves. The SSV scores aren't saved in <.h3f> files
+ *            or MPI messages, so a caller that fills <om->rbv> any
+ *            other way must call it afterwards.
+ *
+ *            The <rbv> values are unsigned and use the whole range,
+ *            so the conversion is done as <((127 + bias) - rbv) ^
+ *            127>, with an unsigned saturated subtraction; read as
+ *            signed, that is <-((127 + bias) - rbv) + 127 = rbv -
+ *            bias>. It's fast, which matters for hmmscan, where it
+ *            runs for every model read.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_ConvertSSV(P7_OPROFILE *om)
+{
+  int     nq  = p7O_NQB(om->M);     /* segment length; total # of striped vectors needed            */
+  int     x;			    /* counter over residues                                        */
+  int     q;			    /* q counts over total # of striped vectors, 0..nq-1            */
+  vector unsigned char tmp  = esl_vmx_set_u8((unsigned char) (om->bias_b + 127));
+  vector unsigned char tmp2 = esl_vmx_set_u8((unsigned char) 127);
+
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      for (q = 0;  q < nq;                q++) om->sbv[x][q] = (vector signed char) vec_xor(vec_subs(tmp, om->rbv[x][q]), tmp2);
+      for (q = nq; q < nq + p7O_EXTRA_SB; q++) om->sbv[x][q] = om->sbv[x][q % nq];
+    }
+  return eslOK;
+}
+
 /* Function:  p7_oprofile_ReconfigLength()
  * Synopsis:  Set the target sequence length of a model.
  * Incept:    SRE, Thu Dec 20 09:56:40 2007 [Janelia]
@@ -1057,6 +1118,47 @@ p7_oprofile_ReconfigRestLength(P7_OPROFILE *om, int L)
 }
 
 
+/* Function:  p7_oprofile_SetMSVLength()
+ * Synopsis:  Set the MSV part's target length from precalculated parameters.
+ *
+ * Purpose:   Same as <p7_oprofile_ReconfigMSVLength(om, lp->L)>, using
+ *            the log that <p7_LengthParams()> already calculated in
+ *            <lp>. A scan configures every model for the same query
+ *            length, so this takes the log out of the per-model work.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_SetMSVLength(P7_OPROFILE *om, const P7_LENPARAM *lp)
+{
+  om->tjb_b = unbiased_byteify(om, lp->msvmove);
+  return eslOK;
+}
+
+/* Function:  p7_oprofile_SetRestLength()
+ * Synopsis:  Set the main profile's target length from precalculated parameters.
+ *
+ * Purpose:   Same as <p7_oprofile_ReconfigRestLength(om, lp->L)>, using
+ *            the parameters that <p7_LengthParams()> already
+ *            calculated in <lp>. If <lp> was calculated for a
+ *            different uni/multihit mode than <om>'s, this falls back
+ *            to <p7_oprofile_ReconfigRestLength()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_SetRestLength(P7_OPROFILE *om, const P7_LENPARAM *lp)
+{
+  if (lp->nj != om->nj) return p7_oprofile_ReconfigRestLength(om, lp->L);
+
+  om->xf[p7O_N][p7O_LOOP] =  om->xf[p7O_C][p7O_LOOP] = om->xf[p7O_J][p7O_LOOP] = lp->ploop;
+  om->xf[p7O_N][p7O_MOVE] =  om->xf[p7O_C][p7O_MOVE] = om->xf[p7O_J][p7O_MOVE] = lp->pmove;
+  om->xw[p7O_N][p7O_MOVE] =  om->xw[p7O_C][p7O_MOVE] = om->xw[p7O_J][p7O_MOVE] = wordify(om, lp->lpmove);
+  om->L = lp->L;
+  return eslOK;
+}
+
+
 /* Function:  p7_oprofile_ReconfigMultihit()
  * Synopsis:  Quickly reconfig model into multihit mode for target length <L>.
  * Incept:    SRE, Thu Aug 21 10:04:07 2008 [Janelia]
@@ -0,0 +1,696 @@
+/* The SSV filter implementation; VMX/VSX version.
+ *
+ * This is the J-state-free, register-banded MSV of
+ * impl_sse/ssvfilter.c, ported to PowerPC vector instructions. See the
+ * introduction there for why the J state can be dropped, how the
+ * begin score is shifted to signed -128 so that a single saturated
+ * signed subtraction replaces the bias add/match subtract pair, and
+ * the two checks (overflow, possible J state use) that decide when
+ * we have to pass the comparison back to p7_MSVFilter() with
+ * <eslENORESULT>.
+ *
+ * The kernels keep w adjacent striped diagonals of the DP in
+ * registers and sweep the whole sequence once per band of w
+ * vectors, so the inner loop touches memory only to fetch the
+ * signed match scores <om->sbv>. <om->sbv> carries <p7O_EXTRA_SB>
+ * extra vectors, copies of the first ones, so a band can run off
+ * the end of the striped profile without wrapping the pointer.
+ * AltiVec has 32 vector registers (VSX on POWER7 and later has 64),
+ * so up to MAX_BANDS diagonals are held at a time without spilling.
+ *
+ * Contents:
+ *   1. p7_SSVFilter() implementation
+ *   2. Benchmark driver
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <math.h>
+
+#ifndef __APPLE_ALTIVEC__
+#include <altivec.h>
+#endif
+
+#include "easel.h"
+#include "esl_vmx.h"
+
+#include "hmmer.h"
+#include "impl_vmx.h"
+
+/*****************************************************************
+ * 1. The p7_SSVFilter() implementation.
+ *****************************************************************/
+
+#define  MAX_BANDS 18
+
+/* One cell: saturated signed subtraction of the match score, then an
+ * unsigned max into one of the six E state accumulators (several, so
+ * that consecutive steps don't wait on the same register).
+ */
+#define STEP_SINGLE(sv, xEv)                             \
+  sv  = vec_subs(sv, *rsc);                              \
+  rsc++;                                                 \
+  xEv = vec_max(xEv, (vector unsigned char) sv);
+
+#define LENGTH_CHECK(label)                              \
+  if (i >= L) goto label;
+
+#define NO_CHECK(label)
+
+#define STEP_BANDS_1()                            \
+  STEP_SINGLE(sv00, xEv0)
+
+#define STEP_BANDS_2()                            \
+  STEP_BANDS_1()                                  \
+  STEP_SINGLE(sv01, xEv1)
+
+#define STEP_BANDS_3()                            \
+  STEP_BANDS_2()                                  \
+  STEP_SINGLE(sv02, xEv2)
+
+#define STEP_BANDS_4()                            \
+  STEP_BANDS_3()                                  \
+  STEP_SINGLE(sv03, xEv3)
+
+#define STEP_BANDS_5()                            \
+  STEP_BANDS_4()                                  \
+  STEP_SINGLE(sv04, xEv4)
+
+#define STEP_BANDS_6()                            \
+  STEP_BANDS_5()                                  \
+  STEP_SINGLE(sv05, xEv5)
+
+#define STEP_BANDS_7()                            \
+  STEP_BANDS_6()                                  \
+  STEP_SINGLE(sv06, xEv0)
+
+#define STEP_BANDS_8()                            \
+  STEP_BANDS_7()                                  \
+  STEP_SINGLE(sv07, xEv1)
+
+#define STEP_BANDS_9()                            \
+  STEP_BANDS_8()                                  \
+  STEP_SINGLE(sv08, xEv2)
+
+#define STEP_BANDS_10()                           \
+  STEP_BANDS_9()                                  \
+  STEP_SINGLE(sv09, xEv3)
+
+#define STEP_BANDS_11()                           \
+  STEP_BANDS_10()                                 \
+  STEP_SINGLE(sv10, xEv4)
+
+#define STEP_BANDS_12()                           \
+  STEP_BANDS_11()                                 \
+  STEP_SINGLE(sv11, xEv5)
+
+#define STEP_BANDS_13()                           \
+  STEP_BANDS_12()                                 \
+  STEP_SINGLE(sv12, xEv0)
+
+#define STEP_BANDS_14()                           \
+  STEP_BANDS_13()                                 \
+  STEP_SINGLE(sv13, xEv1)
+
+#define STEP_BANDS_15()                           \
+  STEP_BANDS_14()                                 \
+  STEP_SINGLE(sv14, xEv2)
+
+#define STEP_BANDS_16()                           \
+  STEP_BANDS_15()                                 \
+  STEP_SINGLE(sv15, xEv3)
+
+#define STEP_BANDS_17()                           \
+  STEP_BANDS_16()                                 \
+  STEP_SINGLE(sv16, xEv4)
+
+#define STEP_BANDS_18()                           \
+  STEP_BANDS_17()                                 \
+  STEP_SINGLE(sv17, xEv5)
+
+#define CONVERT_STEP(step, length_check, label, sv, pos)  \
+  length_check(label)                                     \
+  rsc = om->sbv[dsq[i]] + pos;                            \
+  step()                                                  \
+  sv = vec_sld(beginv, sv, 15);                           \
+  i++;
+
+#define CONVERT_1(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv00, Q - 1)
+
+#define CONVERT_2(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv01, Q - 2)  \
+  CONVERT_1(step, length_check, label)
+
+#define CONVERT_3(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv02, Q - 3)  \
+  CONVERT_2(step, length_check, label)
+
+#define CONVERT_4(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv03, Q - 4)  \
+  CONVERT_3(step, length_check, label)
+
+#define CONVERT_5(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv04, Q - 5)  \
+  CONVERT_4(step, length_check, label)
+
+#define CONVERT_6(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv05, Q - 6)  \
+  CONVERT_5(step, length_check, label)
+
+#define CONVERT_7(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv06, Q - 7)  \
+  CONVERT_6(step, length_check, label)
+
+#define CONVERT_8(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv07, Q - 8)  \
+  CONVERT_7(step, length_check, label)
+
+#define CONVERT_9(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv08, Q - 9)  \
+  CONVERT_8(step, length_check, label)
+
+#define CONVERT_10(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv09, Q - 10)  \
+  CONVERT_9(step, length_check, label)
+
+#define CONVERT_11(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv10, Q - 11)  \
+  CONVERT_10(step, length_check, label)
+
+#define CONVERT_12(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv11, Q - 12)  \
+  CONVERT_11(step, length_check, label)
+
+#define CONVERT_13(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv12, Q - 13)  \
+  CONVERT_12(step, length_check, label)
+
+#define CONVERT_14(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv13, Q - 14)  \
+  CONVERT_13(step, length_check, label)
+
+#define CONVERT_15(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv14, Q - 15)  \
+  CONVERT_14(step, length_check, label)
+
+#define CONVERT_16(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv15, Q - 16)  \
+  CONVERT_15(step, length_check, label)
+
+#define CONVERT_17(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv16, Q - 17)  \
+  CONVERT_16(step, length_check, label)
+
+#define CONVERT_18(step, length_check, label)            \
+  CONVERT_STEP(step, length_check, label, sv17, Q - 18)  \
+  CONVERT_17(step, length_check, label)
+
+#define RESET_1()                                 \
+  register vector signed char sv00 = beginv;
+
+#define RESET_2()                                 \
+  RESET_1()                                       \
+  register vector signed char sv01 = beginv;
+
+#define RESET_3()                                 \
+  RESET_2()                                       \
+  register vector signed char sv02 = beginv;
+
+#define RESET_4()                                 \
+  RESET_3()                                       \
+  register vector signed char sv03 = beginv;
+
+#define RESET_5()                                 \
+  RESET_4()                                       \
+  register vector signed char sv04 = beginv;
+
+#define RESET_6()                                 \
+  RESET_5()                                       \
+  register vector signed char sv05 = beginv;
+
+#define RESET_7()                                 \
+  RESET_6()                                       \
+  register vector signed char sv06 = beginv;
+
+#define RESET_8()                                 \
+  RESET_7()                                       \
+  register vector signed char sv07 = beginv;
+
+#define RESET_9()                                 \
+  RESET_8()                                       \
+  register vector signed char sv08 = beginv;
+
+#define RESET_10()                                \
+  RESET_9()                                       \
+  register vector signed char sv09 = beginv;
+
+#define RESET_11()                                \
+  RESET_10()                                      \
+  register vector signed char sv10 = beginv;
+
+#define RESET_12()                                \
+  RESET_11()                                      \
+  register vector signed char sv11 = beginv;
+
+#define RESET_13()                                \
+  RESET_12()                                      \
+  register vector signed char sv12 = beginv;
+
+#define RESET_14()                                \
+  RESET_13()                                      \
+  register vector signed char sv13 = beginv;
+
+#define RESET_15()                                \
+  RESET_14()                                      \
+  register vector signed char sv14 = beginv;
+
+#define RESET_16()                                \
+  RESET_15()                                      \
+  register vector signed char sv15 = beginv;
+
+#define RESET_17()                                \
+  RESET_16()                                      \
+  register vector signed char sv16 = beginv;
+
+#define RESET_18()                                \
+  RESET_17()                                      \
+  register vector signed char sv17 = beginv;
+
+#define CALC(reset, step, convert, width)         \
+  int i2;                                         \
+  int i;                                          \
+  int Q = p7O_NQB(om->M);                         \
+  vector signed char *rsc;                        \
+  int w = width;                                  \
+                                                  \
+  dsq++;                                          \
+                                                  \
+  reset()                                         \
+                                                  \
+  for (i = 0; i < L && i < Q - q - w; i++)        \
+    {                                             \
+      rsc = om->sbv[dsq[i]] + i + q;              \
+      step()                                      \
+    }                                             \
+                                                  \
+  i = Q - q - w;                                  \
+  convert(step, LENGTH_CHECK, done1)              \
+ done1:                                           \
+                                                  \
+  for (i2 = Q - q; i2 < L - Q; i2 += Q)           \
+    {                                             \
+      for (i = 0; i < Q - w; i++)                 \
+        {                                         \
+          rsc = om->sbv[dsq[i2 + i]] + i;         \
+          step()                                  \
+        }                                         \
+                                                  \
+      i += i2;                                    \
+      convert(step, NO_CHECK, )                   \
+    }                                             \
+                                                  \
+  for (i = 0; i2 + i < L && i < Q - w; i++)       \
+    {                                             \
+      rsc = om->sbv[dsq[i2 + i]] + i;             \
+      step()                                      \
+    }                                             \
+                                                  \
+  i += i2;                                        \
+  convert(step, LENGTH_CHECK, done2)              \
+ done2:                                           \
+                                                  \
+  xEv0 = vec_max(xEv0, xEv1);                     \
+  xEv2 = vec_max(xEv2, xEv3);                     \
+  xEv4 = vec_max(xEv4, xEv5);                     \
+  xEv0 = vec_max(xEv0, xEv2);                     \
+  xEv0 = vec_max(xEv0, xEv4);                     \
+  return xEv0;
+
+/* calc_band_<w>()
+ * Sweeps <dsq> once for the <w> striped diagonals that start at
+ * vector <q>, and returns the running E state maximum folded
+ * together with <xEv0..xEv5>.
+ */
+static vector unsigned char
+calc_band_1(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_1, STEP_BANDS_1, CONVERT_1, 1)
+}
+
+static vector unsigned char
+calc_band_2(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_2, STEP_BANDS_2, CONVERT_2, 2)
+}
+
+static vector unsigned char
+calc_band_3(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_3, STEP_BANDS_3, CONVERT_3, 3)
+}
+
+static vector unsigned char
+calc_band_4(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_4, STEP_BANDS_4, CONVERT_4, 4)
+}
+
+static vector unsigned char
+calc_band_5(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_5, STEP_BANDS_5, CONVERT_5, 5)
+}
+
+static vector unsigned char
+calc_band_6(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_6, STEP_BANDS_6, CONVERT_6, 6)
+}
+
+#if MAX_BANDS > 6 /* only include the kernels we need, to limit object file size */
+static vector unsigned char
+calc_band_7(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_7, STEP_BANDS_7, CONVERT_7, 7)
+}
+
+static vector unsigned char
+calc_band_8(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_8, STEP_BANDS_8, CONVERT_8, 8)
+}
+
+static vector unsigned char
+calc_band_9(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_9, STEP_BANDS_9, CONVERT_9, 9)
+}
+
+static vector unsigned char
+calc_band_10(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_10, STEP_BANDS_10, CONVERT_10, 10)
+}
+
+static vector unsigned char
+calc_band_11(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_11, STEP_BANDS_11, CONVERT_11, 11)
+}
+
+static vector unsigned char
+calc_band_12(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_12, STEP_BANDS_12, CONVERT_12, 12)
+}
+
+static vector unsigned char
+calc_band_13(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_13, STEP_BANDS_13, CONVERT_13, 13)
+}
+
+static vector unsigned char
+calc_band_14(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_14, STEP_BANDS_14, CONVERT_14, 14)
+}
+
+#endif /* MAX_BANDS > 6 */
+#if MAX_BANDS > 14
+static vector unsigned char
+calc_band_15(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_15, STEP_BANDS_15, CONVERT_15, 15)
+}
+
+static vector unsigned char
+calc_band_16(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_16, STEP_BANDS_16, CONVERT_16, 16)
+}
+
+static vector unsigned char
+calc_band_17(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_17, STEP_BANDS_17, CONVERT_17, 17)
+}
+
+static vector unsigned char
+calc_band_18(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, int q, register vector signed char beginv,
+         register vector unsigned char xEv0, register vector unsigned char xEv1, register vector unsigned char xEv2,
+         register vector unsigned char xEv3, register vector unsigned char xEv4, register vector unsigned char xEv5)
+{
+  CALC(RESET_18, STEP_BANDS_18, CONVERT_18, 18)
+}
+
+#endif /* MAX_BANDS > 14 */
+
+/* get_xE()
+ * Runs the banded kernels over all Q striped vectors of <om>, using
+ * as few passes over <dsq> as MAX_BANDS allows, and returns the
+ * maximum E state value (in the shifted, -128 based scale).
+ */
+static uint8_t
+get_xE(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om)
+{
+  vector unsigned char xEv, tempv;  /* E state: keeps max for Mk->E as we go    */
+  vector signed char   beginv;       /* begin scores: signed -128                */
+  int     Q      = p7O_NQB(om->M);   /* segment length: # of vectors             */
+  int     bands;                     /* number of sweeps over the sequence       */
+  int     last_q = 0;                /* first vector of the current band         */
+  int     q;                         /* first vector of the next band            */
+  int     b;                         /* counter over bands                       */
+  uint8_t xE;
+
+  vector unsigned char (*fs[MAX_BANDS + 1]) (const ESL_DSQ *, int, const P7_OPROFILE *, int, register vector signed char,
+                                             register vector unsigned char, register vector unsigned char, register vector unsigned char,
+                                             register vector unsigned char, register vector unsigned char, register vector unsigned char)
+    = { NULL,
+        calc_band_1,  calc_band_2,  calc_band_3,  calc_band_4,  calc_band_5,  calc_band_6
+#if MAX_BANDS > 6
+      , calc_band_7,  calc_band_8,  calc_band_9,  calc_band_10, calc_band_11, calc_band_12, calc_band_13, calc_band_14
+#endif
+#if MAX_BANDS > 14
+      , calc_band_15, calc_band_16, calc_band_17, calc_band_18
+#endif
+  };
+
+  beginv = (vector signed char) esl_vmx_set_u8((unsigned char) 128);
+  xEv    = (vector unsigned char) beginv;
+
+  /* Use as few bands (sweeps) as possible, but no more than MAX_BANDS vectors in each */
+  bands = (Q + MAX_BANDS - 1) / MAX_BANDS;
+  for (b = 0; b < bands; b++)
+    {
+      q      = (Q * (b + 1)) / bands;
+      xEv    = fs[q - last_q](dsq, L, om, last_q, beginv, xEv, xEv, xEv, xEv, xEv, xEv);
+      last_q = q;
+    }
+
+  /* horizontal max, by rotates, as in p7_MSVFilter() */
+  tempv = vec_sld(xEv, xEv, 1);  xEv = vec_max(xEv, tempv);
+  tempv = vec_sld(xEv, xEv, 2);  xEv = vec_max(xEv, tempv);
+  tempv = vec_sld(xEv, xEv, 4);  xEv = vec_max(xEv, tempv);
+  tempv = vec_sld(xEv, xEv, 8);  xEv = vec_max(xEv, tempv);
+  vec_ste(xEv, 0, &xE);
+  return xE;
+}
+
+
+/* Function:  p7_SSVFilter()
+ * Synopsis:  Calculates the MSV score without the J state, faster.
+ *
+ * Purpose:   Calculates an approximation of the MSV score for sequence
+ *            <dsq> of length <L> residues, using optimized profile
+ *            <om>, as <p7_MSVFilter()> does, but ignoring the J state,
+ *            which lets it keep the DP in registers. Return the
+ *            estimated MSV score (in nats) in <ret_sc>.
+ *
+ *            Needs no DP matrix. <p7_MSVFilter()> calls it first, and
+ *            only does its own calculation when this one returns
+ *            <eslENORESULT>.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues
+ *            om      - optimized profile
+ *            ret_sc  - RETURN: MSV score (in nats)
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if the score overflows the limited range; in
+ *            this case, this is a high-scoring hit.
+ *            <eslENORESULT> if the J state could have been used, or
+ *            the overflow can't be told from a real score, or <om>
+ *            has transition costs too large for the shifted scale;
+ *            <*ret_sc> is then undefined, and the caller must use
+ *            <p7_MSVFilter()>'s full calculation.
+ */
+int
+p7_SSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
+{
+  uint16_t xE;			/* 16 bits, to avoid overflow with the moved baseline */
+  uint16_t xJ;
+
+  /* the shifted scale isn't guaranteed to work for these; see impl_sse/ssvfilter.c */
+  if (om->tjb_b + om->tbm_b + om->tec_b + om->bias_b >= 127) return eslENORESULT;
+
+  xE = get_xE(dsq, L, om);
+
+  if (xE >= 255 - om->bias_b)
+    {
+      *ret_sc = eslINFINITY;
+      /* the original MSV filter may not overflow, so we're not sure of our result */
+      if (om->base_b - om->tjb_b - om->tbm_b < 128) return eslENORESULT;
+      return eslERANGE;
+    }
+
+  xE += om->base_b - om->tjb_b - om->tbm_b;
+  xE -= 128;
+
+  if (xE >= 255 - om->bias_b)
+    {
+      /* we know the result will overflow in the original MSV filter */
+      *ret_sc = eslINFINITY;
+      return eslERANGE;
+    }
+
+  xJ = xE - om->tec_b;
+  if (xJ > om->base_b) return eslENORESULT; /* the J state could have been used, so doubt about score */
+
+  /* finally C->T, and add our missing precision on the NN,CC,JJ back */
+  *ret_sc  = ((float) (xJ - om->tjb_b) - (float) om->base_b);
+  *ret_sc /= om->scale_b;
+  *ret_sc -= 3.0; /* that's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ */
+  return eslOK;
+}
+/*------------------ end, p7_SSVFilter() ------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Benchmark driver.
+ *****************************************************************/
+#ifdef p7SSVFILTER_BENCHMARK
+/* gcc -o ssvfilter_benchmark -std=gnu99 -g -Wall -maltivec -I.. -L.. -I../../easel -L../../easel -Dp7SSVFILTER_BENCHMARK ssvfilter.c -lhmmer -leasel -lm
+ * ./ssvfilter_benchmark <hmmfile>
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_vmx.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-b",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "baseline timing: p7_MSVFilter() without SSV",      0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-N",        eslARG_INT,  "50000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for SSVFilter() implementation";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *ox      = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           sc;
+  double          Mcs;
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+  ox = p7_omx_Create(gm->M, 0, 0);
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      if (esl_opt_GetBoolean(go, "-b")) p7_MSVFilter(dsq, L, om, ox, &sc);
+      else                              p7_SSVFilter(dsq, L, om, &sc);
+    }
+  esl_stopwatch_Stop(w);
+  Mcs = (double) N * (double) L * (double) gm->M * 1e-6 / (double) w->user;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n", gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+
+  free(dsq);
+  p7_omx_Destroy(ox);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7SSVFILTER_BENCHMARK*/
+/*------------------ end, benchmark driver ----------------------*/
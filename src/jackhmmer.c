@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -31,6 +32,31 @@
 
 #include "hmmer.h"
 
+/* INCR_CACHE: the iteration cache (--incr).
+ * For each target, how far (in bits) its MSV score fell below the
+ * MSV filter threshold when it was last scored, less the model
+ * changes since. A target that fell further below than the safety
+ * margin plus this round's model change isn't rescanned. The master
+ * updates it between rounds; during a round the workers only read it.
+ */
+typedef struct {
+  float            *deficit;     /* [0..n-1] bits below MSV threshold; -inf: rescan next round */
+  int64_t           n;           /* # of targets: 0 until the first round is done             */
+  float             margin;      /* safety margin, bits (--incr)                              */
+  float             dmodel;      /* how much target MSV scores may have moved this round, bits */
+  float             msvT;        /* this round's MSV threshold, bits                          */
+} INCR_CACHE;
+
+/* INCR_LOG: one worker's targets found more than <margin> bits below
+ * the MSV threshold this round, for the master to put in the cache.
+ */
+typedef struct {
+  int64_t          *idx;         /* target ordinals in the database */
+  float            *deficit;     /* bits below MSV threshold        */
+  int64_t           n;
+  int64_t           nalloc;
+} INCR_LOG;
+
 typedef struct {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
@@ -39,6 +65,10 @@ typedef struct {
   P7_PIPELINE      *pli;
   P7_TOPHITS       *th;
   P7_OPROFILE      *om;
+  int               sqviews;     /* TRUE if targets are p7_seqdb views, not to be esl_sq_Reuse()'d */
+  const INCR_CACHE *ic;          /* iteration cache (--incr), or NULL to scan every target        */
+  INCR_LOG          log;         /* this worker's new cache entries (--incr)                      */
+  int64_t           nskipped;    /* # of targets not rescanned this round (--incr)                */
 } WORKER_INFO;
 
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
@@ -58,6 +88,20 @@ typedef struct {
 #define MPIOPTS     NULL
 #endif
 
+#ifdef HMMER_MPI
+#define INCROPTS    "--max,--mpi"
+#else
+#define INCROPTS    "--max"
+#endif
+
+#ifdef HMMER_MPI
+#define DBCACHEOPTS "--mpi"
+#else
+#define DBCACHEOPTS NULL
+#endif
+
+#define INCR_WINDOW 20   /* --incr: model change is measured over ungapped matches of this many positions */
+
 static ESL_OPTIONS options[] = {
   /* name           type              default   env  range   toggles     reqs   incomp                             help                                                  docgroup*/
   { "-h",           eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  NULL,            "show brief help on version and usage",                         1 },
@@ -98,6 +142,12 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,       "1e-3", NULL, NULL,      NULL,    NULL, "--max",          "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,       "1e-5", NULL, NULL,      NULL,    NULL, "--max",          "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,         NULL, NULL, NULL,      NULL,    NULL, "--max",          "turn off composition bias filter",                             7 },
+  { "--incr",       eslARG_REAL,         NULL, NULL, "x>=0",    NULL,    NULL, INCROPTS,         "rounds 2+: skip targets > <x> bits under last MSV threshold",   7 },
+  { "--dd_threads", eslARG_INT,          "0",  NULL, "n>=0",    NULL,    NULL, NULL,             "define domains of a multidomain target in <n> threads",        7 },
+  { "--dd_ramlimit", eslARG_INT,         "0",  NULL, "n>=0",    NULL,    NULL, NULL,             "cap full envelope DP matrices at <n> MB (0: no cap)",          7 },
+  { "--dd_nbatch",  eslARG_INT,          "0",  NULL, "n>=0",    NULL,    NULL, NULL,             "sample domain traces in batches of <n>, stopping early",       7 },
+  { "--dd_deferali", eslARG_NONE,        FALSE, NULL, NULL,     NULL,    NULL, NULL,             "align domains only of targets that are reported",              7 },
+  { "--dd_bf16",    eslARG_NONE,         FALSE, NULL, NULL,     NULL,    NULL, NULL,             "keep envelope DP matrices in bfloat16 (half the memory)",      7 },
 /* Alternative model construction strategies */
   { "--fast",       eslARG_NONE,        FALSE, NULL, NULL,    CONOPTS,   NULL,  NULL,            "assign cols w/ >= symfrac residues as consensus",              99 }, // unused/prohibited in jackhmmer. Models must be --hand.
   { "--hand",       eslARG_NONE,    "default", NULL, NULL,    CONOPTS,   NULL,  NULL,            "manual construction (requires reference annotation)",          99 },
@@ -135,8 +185,14 @@ static ESL_OPTIONS options[] = {
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,          "42", NULL, "n>=0",    NULL,    NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
+  { "--timing",     eslARG_NONE,         FALSE, NULL, NULL,     NULL,    NULL,  NULL,            "report time spent in each stage of the pipeline",             12 },
+  { "--memstats",   eslARG_NONE,         FALSE, NULL, NULL,     NULL,    NULL,  NULL,            "report memory high-water marks of the pipeline",              12 },
+  { "--membudget",  eslARG_INT,          NULL, NULL, "n>0",     NULL,    NULL,  NULL,            "keep each pipeline under <n> MB of DP memory",                12 },
+  { "--hugepages",  eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "put big buffers in hugepages: <s> = off|thp|2M|1G",           12 },
   { "--qformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert query <seqfile> is in format <s>: no autodetection",   12 },
   { "--tformat",    eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "assert target <seqdb> is in format <s>>: no autodetection",   12 },
+  { "--dbcache",    eslARG_NONE,        FALSE, NULL, NULL,      NULL,    NULL,  DBCACHEOPTS,     "read <seqdb> into memory once, for all rounds and queries",   12 },
+  { "--qcache",     eslARG_STRING,       NULL, NULL, NULL,      NULL,    NULL,  NULL,            "keep calibrated query models in directory <d>, and reuse them", 12 },
 
 #ifdef HMMER_THREADS
   { "--cpu",        eslARG_INT,      p7_NCPU,"HMMER_NCPU","n>=0", NULL,    NULL,  CPUOPTS,       "number of parallel CPU workers to use for multithreads",      12 },
@@ -169,10 +225,12 @@ struct cfg_s {
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp);
+static int  serial_loop_seqdb(WORKER_INFO *info, P7_SEQDB *sqdb);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int max_residues);
+static int  thread_loop_seqdb(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_SEQDB *sqdb, int max_residues);
 static void pipeline_thread(void *arg);
 #endif 
 
@@ -184,6 +242,10 @@ static int  mpi_worker   (ESL_GETOPTS *go, struct cfg_s *cfg);
 static void checkpoint_hmm(int nquery, P7_HMM *hmm,  char *basename, int iteration);
 static void checkpoint_msa(int nquery, ESL_MSA *msa, char *basename, int iteration);
 
+static void  search_target(WORKER_INFO *info, ESL_SQ *dbsq, int64_t t);
+static float incr_model_change(const P7_PROFILE *gm0, const P7_PROFILE *gm1);
+static int   incr_update(INCR_CACHE *ic, WORKER_INFO *info, int infocnt, int64_t nseqs);
+
 /* process_commandline()
  * Take argc, argv, and options; parse the command line;
  * display help/usage info.
@@ -264,6 +326,9 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_qfil
   if (strcmp(*ret_dbfile, "-") == 0) 
     { if (puts("jackhmmer cannot read <seqdb> from stdin stream") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
 
+  if (esl_opt_IsOn(go, "--hugepages") && p7_hugemem_SetMode(esl_opt_GetString(go, "--hugepages")) != eslOK)
+    { if (printf("--hugepages takes off, thp, 2M or 1G, not %s\n", esl_opt_GetString(go, "--hugepages")) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+
   *ret_go = go;
   return eslOK;
   
@@ -318,6 +383,12 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--F2")         && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")         && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")     && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--incr")       && fprintf(ofp, "# skip targets under MSV thresh:   by > %g bits, rounds 2+\n", esl_opt_GetReal(go, "--incr"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_threads") && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--dd_threads"))              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_ramlimit") && fprintf(ofp, "# domain definition RAM limit:     %d MB\n", esl_opt_GetInteger(go, "--dd_ramlimit"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_nbatch")  && fprintf(ofp, "# domain trace sample batch size:  %d\n", esl_opt_GetInteger(go, "--dd_nbatch"))               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_deferali") && fprintf(ofp, "# deferred domain alignment:       on\n")                                                     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_bf16")    && fprintf(ofp, "# bfloat16 envelope matrices:      on\n")                                                      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--fast")       && fprintf(ofp, "# model architecture construction: fast/heuristic\n")                                       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--hand")       && fprintf(ofp, "# model architecture construction: hand-specified by RF annotation\n")                      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--symfrac")    && fprintf(ofp, "# sym frac for model structure:    %.3f\n",           esl_opt_GetReal(go, "--symfrac"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -351,8 +422,14 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
       if (esl_opt_GetInteger(go, "--seed") == 0  && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
       else if                                      (fprintf(ofp, "# random number seed set to:       %d\n",       esl_opt_GetInteger(go, "--seed"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     }
+  if (esl_opt_IsUsed(go, "--timing")     && fprintf(ofp, "# pipeline stage timing:           on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--memstats")   && fprintf(ofp, "# pipeline memory statistics:      on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--membudget")  && fprintf(ofp, "# pipeline memory budget:          %d MB\n", esl_opt_GetInteger(go, "--membudget"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hugepages")  && fprintf(ofp, "# hugepages for big buffers:       %s\n", esl_opt_GetString(go, "--hugepages"))             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--qformat")    && fprintf(ofp, "# query <seqfile> format asserted: %s\n",             esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# target <seqdb> format asserted:  %s\n",             esl_opt_GetString(go, "--tformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dbcache")    && fprintf(ofp, "# target <seqdb> held in memory:   yes\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--qcache")     && fprintf(ofp, "# query model cache:               %s\n",             esl_opt_GetString(go, "--qcache"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
@@ -435,12 +512,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                      */
   ESL_SQFILE      *dbfp     = NULL;               /* open dbfile                                     */
+  P7_SEQDB        *sqdb     = NULL;               /* its pressed form (hmmseqpress), if there is one */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                               */
   P7_BG           *bg       = NULL;		  /* null model                                      */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                  */
   ESL_SQ          *qsq      = NULL;               /* query sequence                                  */
   ESL_KEYHASH     *kh       = NULL;		  /* hash of previous top hits' ranks                */
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                      */
+  INCR_CACHE      *ic       = NULL;               /* iteration cache (--incr), or NULL               */
+  INCR_CACHE       icbuf;
+  int64_t          nskipped;
   int              nquery   = 0;
   int              textw;
   int              iteration;
@@ -456,11 +537,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   int              infocnt  = 0;
   WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;     /* the other workers' hit lists, for p7_tophits_MergeMany() */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
 #endif
+  char             errbuf[eslERRBUFSIZE];
 
   /* Initializations */
   abc           = esl_alphabet_Create(eslAMINO);
@@ -469,6 +552,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   maxiterations = esl_opt_GetInteger(go, "-N");
   textw         = (esl_opt_GetBoolean(go, "--notextw") ? 0 : esl_opt_GetInteger(go, "--textw"));
 
+  if (esl_opt_IsOn(go, "--incr"))
+    {
+      ic            = &icbuf;
+      ic->deficit   = NULL;
+      ic->n         = 0;
+      ic->margin    = esl_opt_GetReal(go, "--incr");
+      ic->dmodel    = eslINFINITY;
+      ic->msvT      = eslINFINITY;
+    }
+
   esl_stopwatch_Start(w);
 
   /* If caller declared input formats, decode them */
@@ -494,6 +587,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) p7_Fail("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (esl_opt_IsOn(go, "--qcache") && p7_builder_SetQueryCache(bld, esl_opt_GetString(go, "--qcache")) != eslOK) p7_Fail("Failed to set query model cache");
 
   /* Open results output files */
   if (esl_opt_IsOn(go, "-o")          && (ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  
@@ -505,15 +599,42 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--domtblout") && (domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  
     p7_Fail("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblout"));
 
-  /* Open the target sequence database for sequential access. */
-  status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
-  if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
-  else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
-  else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
-  else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
+  /* Open the target sequence database for sequential access: a
+   * current pressed copy (<seqdb>.h3q, from hmmseqpress) is mapped
+   * instead of parsing it, unless a format was asserted.
+   */
+  if (dbformat == eslSQFILE_UNKNOWN && strcmp(cfg->dbfile, "-") != 0)
+    {
+      status = p7_seqdb_Open(cfg->dbfile, &sqdb, errbuf);
+      if      (status == eslEFORMAT) p7_Fail("Pressed sequence file for %s is unusable; rerun hmmseqpress -f, or delete it:\n%s\n", cfg->dbfile, errbuf);
+      else if (status == eslEMEM)    p7_Fail("Failed to open pressed sequence file %s%s\n", cfg->dbfile, p7_SEQDB_SUFFIX);
+      if (sqdb && p7_seqdb_SetDigital(sqdb, abc) != eslOK) p7_Fail("Pressed sequence file %s isn't protein\n", sqdb->dbfile);
+    }
+
+  if (sqdb == NULL)
+    {
+      status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
+      if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
+      else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
+      else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
+      else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
   
-  if (! esl_sqfile_IsRewindable(dbfp)) 
-    p7_Fail("Target sequence file %s isn't rewindable; jackhmmer requires that it is", cfg->dbfile);
+      if (! esl_sqfile_IsRewindable(dbfp)) 
+	p7_Fail("Target sequence file %s isn't rewindable; jackhmmer requires that it is", cfg->dbfile);
+
+      /* --dbcache: parse and digitize the targets once, and search
+       * that in-memory copy in every round, as a pressed one would be.
+       */
+      if (esl_opt_GetBoolean(go, "--dbcache"))
+	{
+	  status = p7_seqdb_Load(dbfp, &sqdb, errbuf);
+	  if      (status == eslEMEM) p7_Fail("Not enough memory to hold target sequence database %s\n", cfg->dbfile);
+	  else if (status != eslOK)   p7_Fail("Failed to read target sequence database %s into memory:\n%s\n", cfg->dbfile, errbuf);
+	  p7_seqdb_SetDigital(sqdb, abc);
+	  esl_sqfile_Close(dbfp);
+	  dbfp = NULL;
+	}
+    }
 
   /* Open the query sequence file  */
   status = esl_sqfile_OpenDigital(abc, cfg->qfile, qformat, NULL, &qfp);
@@ -535,6 +656,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   infocnt = (ncpus == 0) ? 1 : ncpus;
   ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
 
   /* Ready to begin */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
@@ -545,6 +667,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].th    = NULL;
       info[i].om    = NULL;
       info[i].bg    = p7_bg_Clone(bg);
+      info[i].sqviews = (sqdb != NULL);
+      info[i].ic    = ic;
+      info[i].log.idx     = NULL;
+      info[i].log.deficit = NULL;
+      info[i].log.n       = 0;
+      info[i].log.nalloc  = 0;
 #ifdef HMMER_THREADS
       info[i].queue = queue;
 #endif
@@ -553,7 +681,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   for (i = 0; i < ncpus * 2; ++i)
     {
-      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
+      if (sqdb) block = p7_seqdb_CreateBlock(BLOCK_SIZE); /* views into <sqdb>; no sequence memory of their own */
+      else      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
       if (block == NULL) 
 	{
 	  p7_Fail("Failed to allocate sequence block");
@@ -573,6 +702,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       P7_HMM          *hmm     = NULL;	     /* HMM - only needed if checkpointed        */
       P7_HMM         **ret_hmm = NULL;	     /* HMM - only needed if checkpointed        */
       P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
+      P7_PROFILE      *gm      = NULL;       /* its generic profile (--incr only)        */
+      P7_PROFILE      *prvgm   = NULL;       /* ... and the last round's                 */
       P7_TRACE        *qtr     = NULL;       /* faux trace for query sequence            */
       ESL_MSA         *msa     = NULL;       /* multiple alignment of included hits      */
       
@@ -591,6 +722,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  esl_stopwatch_Start(w);
 
 	  if (om        != NULL) p7_oprofile_Destroy(om);
+	  if (prvgm     != NULL) p7_profile_Destroy(prvgm);
+	  prvgm = gm;
+	  gm    = NULL;
 	  if (info->pli != NULL) p7_pipeline_Destroy(info->pli);
 	  if (info->th  != NULL) p7_tophits_Destroy(info->th);
 	  if (info->om  != NULL) p7_oprofile_Destroy(info->om);
@@ -598,13 +732,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
  	  /* Create the search model: from query alone (round 1) or from MSA (round 2+) */
 	  if (msa == NULL)	/* round 1 */
 	    {
-	      p7_SingleBuilder(bld, qsq, info[0].bg, ret_hmm, &qtr, NULL, &om); /* bypass HMM - only need model */
+	      p7_SingleBuilder(bld, qsq, info[0].bg, ret_hmm, &qtr, (ic ? &gm : NULL), &om); /* bypass HMM - only need model */
 	      prv_msa_nseq = 1;
 	    }
 	  else
 	    {
 	      /* Throw away old model. Build new one. */
-	      status = p7_Builder(bld, msa, info[0].bg, ret_hmm, NULL, NULL, &om, NULL);
+	      status = p7_Builder(bld, msa, info[0].bg, ret_hmm, NULL, (ic ? &gm : NULL), &om, NULL);
 	      if      (status == eslENORESULT) p7_Fail("Failed to construct new model from iteration %d results:\n%s", iteration, bld->errbuf);
 	      else if (status == eslEFORMAT)   p7_Fail("Failed to construct new model from iteration %d results:\n%s", iteration, bld->errbuf);
 	      else if (status != eslOK)        p7_Fail("Unexpected error constructing new model at iteration %d:",     iteration);
@@ -634,17 +768,31 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	      info[i].om  = p7_oprofile_Clone(om);
 	      info[i].pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
 	      p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+	      info[i].nskipped = 0;
 
 #ifdef HMMER_THREADS
 	      if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
 #endif
 	    }
 
+	  /* With --incr, rounds 2+ skip targets that were far enough
+	   * under the MSV threshold, allowing for how much the model
+	   * has changed since.
+	   */
+	  if (ic)
+	    {
+	      ic->dmodel = incr_model_change(prvgm, gm);
+	      ic->msvT   = esl_gumbel_invsurv(info[0].pli->F1, om->evparam[p7_MMU], om->evparam[p7_MLAMBDA]);
+	    }
+
 #ifdef HMMER_THREADS
-	  if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp);
-	  else           sstatus = serial_loop(info, dbfp);
+	  if      (sqdb && ncpus > 0) sstatus = thread_loop_seqdb(threadObj, queue, sqdb, p7_BLOCK_RESIDUES(om->M));
+	  else if (sqdb)              sstatus = serial_loop_seqdb(info, sqdb);
+	  else if (ncpus > 0)         sstatus = thread_loop(threadObj, queue, dbfp, p7_BLOCK_RESIDUES(om->M));
+	  else                        sstatus = serial_loop(info, dbfp);
 #else
-	  sstatus = serial_loop(info, dbfp);
+	  if (sqdb) sstatus = serial_loop_seqdb(info, sqdb);
+	  else      sstatus = serial_loop(info, dbfp);
 #endif
 	  switch(sstatus)
 	    {
@@ -661,22 +809,26 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    }
 
 	  /* merge the results of the search results */
+	  for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+	  p7_tophits_MergeMany(info[0].th, thl, infocnt-1);
+	  nskipped = info[0].nskipped;
 	  for (i = 1; i < infocnt; ++i)
 	    {
-	      p7_tophits_Merge(info[0].th, info[i].th);
 	      p7_pipeline_Merge(info[0].pli, info[i].pli);
+	      nskipped += info[i].nskipped;
 
 	      p7_pipeline_Destroy(info[i].pli);
 	      p7_tophits_Destroy(info[i].th);
 	      p7_oprofile_Destroy(info[i].om);
 	    }
+	  if (ic && incr_update(ic, info, infocnt, info[0].pli->nseqs) != eslOK) p7_Fail("Failed to allocate iteration cache");
 
 	  /* Print the results. */
 	  p7_tophits_SortBySortkey(info->th);
 	  p7_tophits_Threshold(info->th, info->pli);
 	  p7_tophits_CompareRanking(info->th, kh, &nnew_targets);
 	  p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-	  p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	  p7_tophits_DomainsThreaded(ofp, info->th, info->pli, textw, ncpus); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
 	  /* Create alignment of the top hits */
 	  /* <&qsq, &qtr, 1> included in p7_tophits_Alignment args here => initial query is added to the msa at each round. */
@@ -699,6 +851,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  if (fprintf(ofp, "@@ New targets included:   %d\n", nnew_targets)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 	  if (fprintf(ofp, "@@ New alignment includes: %d subseqs (was %d), including original query\n",
 		  msa->nseq, prv_msa_nseq)                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+	  if (ic && iteration > 1 &&
+	      fprintf(ofp, "@@ Targets not rescanned:  %" PRId64 " of %" PRIu64 " (--incr)\n",
+		      nskipped, info->pli->nseqs)                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 	  if (nnew_targets == 0 && msa->nseq <= prv_msa_nseq)
 	    {
 	      if (fprintf(ofp, "@@\n")                                       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -709,7 +864,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  else if (iteration < maxiterations)
 	    { if (fprintf(ofp, "@@ Continuing to next round.\n\n")           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
 
-	  esl_sqfile_Position(dbfp, 0);
+	  if (sqdb) p7_seqdb_Position(sqdb, 0);
+	  else      esl_sqfile_Position(dbfp, 0);
 	} /* end iteration loop */
 
       /* Because we destroy/create the hitlist, om, pipeline, and msa above, rather than create/destroy,
@@ -737,10 +893,19 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
       esl_msa_Destroy(msa);
       p7_oprofile_Destroy(om);
+      p7_profile_Destroy(gm);
+      p7_profile_Destroy(prvgm);
       p7_trace_Destroy(qtr);
+      if (ic)
+	{
+	  free(ic->deficit);
+	  ic->deficit = NULL;
+	  ic->n       = 0;
+	}
       esl_sq_Reuse(qsq);
       esl_keyhash_Reuse(kh);
-      esl_sqfile_Position(dbfp, 0);
+      if (sqdb) p7_seqdb_Position(sqdb, 0);
+      else      esl_sqfile_Position(dbfp, 0);
     }
   if      (qstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n",
 					    qfp->filename, esl_sqfile_GetErrorBuf(qfp));
@@ -756,24 +921,33 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* Cleanup - prepare for successful exit
    */
   for (i = 0; i < infocnt; ++i)
-    p7_bg_Destroy(info[i].bg);
+    {
+      p7_bg_Destroy(info[i].bg);
+      free(info[i].log.idx);
+      free(info[i].log.deficit);
+    }
 
 #ifdef HMMER_THREADS
   if (ncpus > 0)
     {
       esl_workqueue_Reset(queue);
       while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
-	esl_sq_DestroyBlock(block);
+	{
+	  if (sqdb) p7_seqdb_DestroyBlock(block);
+	  else      esl_sq_DestroyBlock(block);
+	}
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
     }
 #endif
 
   free(info);
+  free(thl);
 
   esl_keyhash_Destroy(kh);
   esl_sqfile_Close(qfp);
-  esl_sqfile_Close(dbfp);
+  if (dbfp) esl_sqfile_Close(dbfp);
+  p7_seqdb_Close(sqdb);
   esl_sq_Destroy(qsq);  
   esl_stopwatch_Destroy(w);
   p7_builder_Destroy(bld);
@@ -883,9 +1057,9 @@ typedef struct {
 
 /* this routine parses the database keeping track of the blocks
  * offset within the file, number of sequences and the length
- * of the block.  These blocks are passed as work units to the
- * MPI workers.  If multiple hmm's are in the query file, the
- * blocks are reused without parsing the database a second time.
+ * of the block.  partition_db() divides these blocks among the
+ * MPI workers.  If the list is complete, it is replayed without
+ * parsing the database a second time.
  */
 int next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block)
 {
@@ -960,9 +1134,55 @@ int next_block(ESL_SQFILE *sqfp, ESL_SQ *sq, BLOCK_LIST *list, SEQ_BLOCK *block)
   return eslEMEM;
 }
 
+/* partition_db()
+ * Index the target database <dbfp> into blocks with next_block(),
+ * and divide them into <npart> runs of consecutive blocks, one for
+ * each worker, in <part[0..npart-1]>: a run's <offset> is the record
+ * offset of its first sequence, <count> its number of sequences, and
+ * <length> the bytes it spans. Blocks are about the same size, so the
+ * runs are too. A worker left without any gets a <count> of 0.
+ * Returns <eslOK>, or the error from parsing <dbfp>.
+ */
+static int
+partition_db(ESL_SQFILE *dbfp, ESL_SQ *dbsq, int npart, SEQ_BLOCK *part)
+{
+  BLOCK_LIST list;
+  SEQ_BLOCK  block;
+  int        lo, hi;
+  int        b, w;
+  int        status;
+
+  list.complete = 0;
+  list.size     = 0;
+  list.current  = 0;
+  list.last     = 0;
+  list.blocks   = NULL;
+
+  while ((status = next_block(dbfp, dbsq, &list, &block)) == eslOK) ;
+  if (status != eslEOF) { free(list.blocks); return status; }
+
+  for (w = 0; w < npart; w++)
+    {
+      lo = (int) ((int64_t) list.last * w     / npart);
+      hi = (int) ((int64_t) list.last * (w+1) / npart);
+      part[w].offset = part[w].length = part[w].count = 0;
+      if (lo == hi) continue;
+
+      part[w].offset = list.blocks[lo].offset;
+      part[w].length = list.blocks[hi-1].offset + list.blocks[hi-1].length - part[w].offset;
+      for (b = lo; b < hi; b++) part[w].count += list.blocks[b].count;
+    }
+  free(list.blocks);
+  return eslOK;
+}
+
 /* mpi_master()
  * The MPI version of hmmbuild.
- * Follows standard pattern for a master/worker load-balanced MPI program (J1/78-79).
+ * Follows standard pattern for a master/worker load-balanced MPI program (J1/78-79),
+ * except that the targets are not handed out as work units: at startup,
+ * each worker is given a run of the target database with partition_db(),
+ * which it loads into memory and keeps for every round of every query.
+ * A round only sends each worker the new model, and gathers its hits.
  * 
  * A master can only return if it's successful. 
  * Errors in an MPI master come in two classes: recoverable and nonrecoverable.
@@ -1010,8 +1230,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   char            *mpi_buf  = NULL;               /* buffer used to pack/unpack structures            */
   int              mpi_size = 0;                  /* size of the allocated buffer                     */
-  BLOCK_LIST      *list     = NULL;
-  SEQ_BLOCK        block;
+  SEQ_BLOCK       *part     = NULL;               /* each worker's run of the targets, [0..nproc-2]  */
 
   int              i;
   int              size;
@@ -1075,12 +1294,13 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status != eslOK)        mpi_failure ("Unexpected error %d opening sequence file %s\n", status, cfg->qfile);
   qsq = esl_sq_CreateDigital(abc);
 
-  ESL_ALLOC(list, sizeof(SEQ_BLOCK));
-  list->complete = 0;
-  list->size     = 0;
-  list->current  = 0;
-  list->last     = 0;
-  list->blocks   = NULL;
+  /* Give each worker its share of the targets, once, for all rounds and queries */
+  ESL_ALLOC(part, sizeof(SEQ_BLOCK) * (cfg->nproc - 1));
+  sstatus = partition_db(dbfp, dbsq, cfg->nproc - 1, part);
+  if      (sstatus == eslEFORMAT) mpi_failure("Parse failed (sequence file %s):\n%s\n", dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
+  else if (sstatus != eslOK)      mpi_failure("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
+  for (dest = 1; dest < cfg->nproc; ++dest)
+    MPI_Send(&part[dest-1], 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
 
   /* Ready to begin */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
@@ -1110,8 +1330,6 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	{       /* We enter each iteration with an optimized profile. */
 	  esl_stopwatch_Start(w);
 
-	  list->current = 0;
-
 	  if (pli != NULL) p7_pipeline_Destroy(pli);
 	  if (th  != NULL) p7_tophits_Destroy(th);
 	  if (om  != NULL) p7_oprofile_Destroy(om);
@@ -1203,22 +1421,6 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 		    status = p7_oprofile_MPISend(om, dest, HMMER_OPROFILE_TAG, MPI_COMM_WORLD, &mpi_buf, &mpi_size);
 		    if (status != eslOK) mpi_failure("Failed to send optimized model to %d\n", dest);
 		    break;
-		  case HMMER_READY_TAG:
-		    sstatus = next_block(dbfp, dbsq, list, &block);
-		    if (sstatus == eslOK || sstatus == eslEOF)
-		      {
-			MPI_Send(&block, 3, MPI_LONG_LONG_INT, dest, HMMER_BLOCK_TAG, MPI_COMM_WORLD);
-		      }
-		    else if (sstatus == eslEFORMAT)
-		      {
-			mpi_failure("Parse failed (sequence file %s):\n%s\n",
-				    dbfp->filename, esl_sqfile_GetErrorBuf(dbfp));
-		      }
-		    else
-		      {
-			mpi_failure("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
-		      }
-		    break;
 		  default:
 		    mpi_failure("Unexpected tag %d from %d\n", tag, dest);
 		    break;
@@ -1302,7 +1504,6 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_trace_Destroy(qtr);
       esl_sq_Reuse(qsq);
       esl_keyhash_Reuse(kh);
-      esl_sqfile_Position(dbfp, 0);
     }
   if      (qstatus == eslEFORMAT) mpi_failure("Parse failed (sequence file %s):\n%s\n",
 					    qfp->filename, esl_sqfile_GetErrorBuf(qfp));
@@ -1339,7 +1540,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (ofp &&    fprintf(ofp, "[ok]\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   /* Cleanup - prepare for successful exit  */
-  free(list);
+  free(part);
   if (mpi_buf != NULL) free(mpi_buf);
 
   p7_bg_Destroy(bg);
@@ -1375,14 +1576,16 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   P7_BG           *bg       = NULL;               /* null model                                      */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                  */
   ESL_SQ          *qsq      = NULL;               /* query sequence                                  */
-  ESL_SQ          *dbsq     = NULL;               /* target sequence                                 */
+  P7_SEQDB        *sqdb     = NULL;               /* our run of the targets, in memory; NULL if none */
+  ESL_SQ           dbsq;                          /* view of one target sequence                     */
   ESL_KEYHASH     *kh       = NULL;		  /* hash of previous top hits' ranks                */
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                      */
+  SEQ_BLOCK        part;                          /* our run of the targets, from the master         */
   int              iteration;
   int              maxiterations;
   int              status   = eslOK;
   int              qstatus  = eslOK;
-  int              sstatus  = eslOK;
+  char             errbuf[eslERRBUFSIZE];
 
   char            *mpi_buf  = NULL;               /* buffer used to pack/unpack structures            */
   int              mpi_size = 0;                  /* size of the allocated buffer                     */
@@ -1421,11 +1624,23 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   mpi_failure("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
   else if (status == eslEINVAL)    mpi_failure("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        mpi_failure("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
-  dbsq = esl_sq_CreateDigital(abc);
   
   if (! esl_sqfile_IsRewindable(dbfp)) 
     mpi_failure("Target sequence file %s isn't rewindable; jackhmmer requires that it is", cfg->dbfile);
 
+  /* Load our run of the targets, once; the file isn't read again */
+  MPI_Recv(&part, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+  if (part.count > 0)
+    {
+      status = p7_seqdb_LoadRange(dbfp, (off_t) part.offset, part.count, &sqdb, errbuf);
+      if      (status == eslEMEM) mpi_failure("Failed to allocate memory for %ld target sequences\n", (long) part.count);
+      else if (status != eslOK)   mpi_failure("Failed to load target sequences at offset %ld of %s:\n%s\n", (long) part.offset, cfg->dbfile, errbuf);
+      p7_seqdb_SetDigital(sqdb, abc);
+    }
+  esl_sqfile_Close(dbfp);
+  dbfp = NULL;
+  memset(&dbsq, 0, sizeof(ESL_SQ));
+
   /* Open the query sequence file  */
   status = esl_sqfile_OpenDigital(abc, cfg->qfile, qformat, NULL, &qfp);
   if      (status == eslENOTFOUND) mpi_failure("Failed to open sequence file %s for reading\n",      cfg->qfile);
@@ -1441,8 +1656,6 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       P7_TOPHITS      *th      = NULL;       /* top-scoring sequence hits                */
       P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
       P7_TRACE        *qtr     = NULL;       /* faux trace for query sequence            */
-      
-      SEQ_BLOCK        block;
 
       if (qsq->n == 0) continue; /* skip zero length queries as if they aren't even present. */
 
@@ -1461,50 +1674,21 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  if (status != eslOK)  mpi_failure("Error %d receiving optimized model on iteration %d\n", status, iteration);
 	  if (iteration > maxiterations) mpi_failure("Iteration %d exceeds max iterations of %d\n", iteration, maxiterations);
 
-	  status = 0;
-	  MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
-
 	  /* Create new processing pipeline and top hits list; destroy old. (TODO: reuse rather than recreate) */
 	  th  = p7_tophits_Create();
 	  pli = p7_pipeline_Create(go, om->M, 400, FALSE, p7_SEARCH_SEQS); /* 400 is a dummy length for now */
 	  p7_pli_NewModel(pli, om, bg);
 
-	  /* receive a sequence block from the master */
-	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
-	  while (block.count > 0)
+	  /* search our run of the targets, in memory */
+	  if (sqdb) p7_seqdb_Position(sqdb, 0);
+	  while (sqdb && p7_seqdb_Read(sqdb, &dbsq) == eslOK)
 	    {
-	      uint64_t length = 0;
-	      uint64_t count  = block.count;
+	      p7_pli_NewSeq(pli, &dbsq);
+	      p7_bg_SetLength(bg, dbsq.n);
+	      p7_oprofile_ReconfigLength(om, dbsq.n);
 
-	      status = esl_sqfile_Position(dbfp, block.offset);
-	      if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
-
-	      while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
-		{
-		  length = dbsq->eoff - block.offset + 1;
-
-		  p7_pli_NewSeq(pli, dbsq);
-		  p7_bg_SetLength(bg, dbsq->n);
-		  p7_oprofile_ReconfigLength(om, dbsq->n);
-      
-		  p7_Pipeline(pli, om, bg, dbsq, NULL, th);
-
-		  esl_sq_Reuse(dbsq);
-		  p7_pipeline_Reuse(pli);
-
-		  --count;
-		}
-
-	      /* lets do a little bit of sanity checking here to make sure the blocks are the same */
-	      if (count > 0)              mpi_failure("Block count mismatch - expected %ld found %ld at offset %ld\n",  block.count,  block.count - count, block.offset);
-	      if (block.length != length) mpi_failure("Block length mismatch - expected %ld found %ld at offset %ld\n", block.length, length,              block.offset);
-
-	      /* inform the master we need another block of sequences */
-	      status = 0;
-	      MPI_Send(&status, 1, MPI_INT, 0, HMMER_READY_TAG, MPI_COMM_WORLD);
-
-	      /* wait for the next block of sequences */
-	      MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
+	      p7_Pipeline(pli, om, bg, &dbsq, NULL, th);
+	      p7_pipeline_Reuse(pli);
 	    }
 
 	  esl_stopwatch_Stop(w);
@@ -1525,7 +1709,6 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_trace_Destroy(qtr);
       esl_sq_Reuse(qsq);
       esl_keyhash_Reuse(kh);
-      esl_sqfile_Position(dbfp, 0);
     }
   if      (qstatus == eslEFORMAT) mpi_failure("Parse failed (sequence file %s):\n%s\n",
 					      qfp->filename, esl_sqfile_GetErrorBuf(qfp));
@@ -1540,8 +1723,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   p7_bg_Destroy(bg);
   esl_keyhash_Destroy(kh);
   esl_sqfile_Close(qfp);
-  esl_sqfile_Close(dbfp);
-  esl_sq_Destroy(dbsq);
+  p7_seqdb_Close(sqdb);
   esl_sq_Destroy(qsq);  
   esl_stopwatch_Destroy(w);
   p7_builder_Destroy(bld);
@@ -1597,25 +1779,130 @@ checkpoint_msa(int nquery, ESL_MSA *msa, char *basename, int iteration)
 
 }
 
+/* search_target()
+ * Search target <dbsq>, number <t> in the database, with the
+ * pipeline in <info>. With an iteration cache (--incr), a target
+ * that was far enough under the MSV threshold in earlier rounds is
+ * only counted (so Z and E-values are unchanged), not rescanned;
+ * and a target that's now far under it is logged for the next round.
+ */
+static void
+search_target(WORKER_INFO *info, ESL_SQ *dbsq, int64_t t)
+{
+  const INCR_CACHE *ic = info->ic;
+
+  p7_pli_NewSeq(info->pli, dbsq);
+  if (ic && t < ic->n && ic->deficit[t] - ic->dmodel > ic->margin) { info->nskipped++; return; }
+
+  p7_bg_SetLength(info->bg, dbsq->n);
+  p7_oprofile_ReconfigLength(info->om, dbsq->n);
+
+  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+
+  if (ic && ic->msvT - info->pli->msv_score > ic->margin)
+    {
+      if (info->log.n == info->log.nalloc)
+	{
+	  info->log.nalloc = ESL_MAX(1024, info->log.nalloc * 2);
+	  if ((info->log.idx     = realloc(info->log.idx,     sizeof(int64_t) * info->log.nalloc)) == NULL ||
+	      (info->log.deficit = realloc(info->log.deficit, sizeof(float)   * info->log.nalloc)) == NULL)
+	    p7_Fail("Failed to grow iteration cache log");
+	}
+      info->log.idx[info->log.n]     = t;
+      info->log.deficit[info->log.n] = ic->msvT - info->pli->msv_score;
+      info->log.n++;
+    }
+  p7_pipeline_Reuse(info->pli);
+}
+
+/* incr_model_change()
+ * How far any target's MSV score may have moved between profiles
+ * <gm0> and <gm1>: the largest change, in bits, that the match
+ * emission scores can make to an ungapped match of INCR_WINDOW (or
+ * fewer) consecutive positions. Returns eslINFINITY, so that every
+ * target is rescanned, if there's no <gm0> or the models differ in
+ * length.
+ */
+static float
+incr_model_change(const P7_PROFILE *gm0, const P7_PROFILE *gm1)
+{
+  float dk[INCR_WINDOW];	/* ring buffer of per-position changes */
+  float sum  = 0.;
+  float best = 0.;
+  float d;
+  int   k, x;
+
+  if (gm0 == NULL || gm0->M != gm1->M) return eslINFINITY;
+
+  for (k = 1; k <= gm1->M; k++)
+    {
+      d = 0.;
+      for (x = 0; x < gm1->abc->K; x++)
+	d = ESL_MAX(d, fabsf(p7P_MSC(gm1, k, x) - p7P_MSC(gm0, k, x)));
+
+      sum += d;
+      if (k > INCR_WINDOW) sum -= dk[k % INCR_WINDOW];
+      dk[k % INCR_WINDOW] = d;
+      best = ESL_MAX(best, sum);
+    }
+  return best / eslCONST_LOG2;
+}
+
+/* incr_update()
+ * After a round, bring iteration cache <ic> up to date: entries of
+ * targets that were skipped are aged by the round's model change,
+ * those of targets that were rescanned are cleared, and then the new
+ * entries logged by the <infocnt> workers in <info> are taken (and
+ * their logs emptied). After the first round, the cache is allocated
+ * for the <nseqs> targets that round saw.
+ *
+ * Returns eslOK on success; <eslEMEM> on allocation failure.
+ */
+static int
+incr_update(INCR_CACHE *ic, WORKER_INFO *info, int infocnt, int64_t nseqs)
+{
+  int64_t t, j;
+  int     i;
+  int     status;
+
+  if (ic->deficit == NULL)
+    {
+      ESL_ALLOC(ic->deficit, sizeof(float) * ESL_MAX(1, nseqs));
+      ic->n = nseqs;
+      for (t = 0; t < ic->n; t++) ic->deficit[t] = -eslINFINITY;
+    }
+  else
+    {
+      for (t = 0; t < ic->n; t++)
+	ic->deficit[t] = (ic->deficit[t] - ic->dmodel > ic->margin) ? ic->deficit[t] - ic->dmodel : -eslINFINITY;
+    }
+
+  for (i = 0; i < infocnt; i++)
+    {
+      for (j = 0; j < info[i].log.n; j++)
+	if (info[i].log.idx[j] < ic->n) ic->deficit[info[i].log.idx[j]] = info[i].log.deficit[j];
+      info[i].log.n = 0;
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
 static int
 serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
 {
   int      sstatus;
   ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
+  int64_t   t        = 0;      /* its ordinal in the database    */
 
   dbsq = esl_sq_CreateDigital(info->om->abc);
 
   /* Main loop: */
   while ((sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
     {
-      p7_pli_NewSeq(info->pli, dbsq);
-      p7_bg_SetLength(info->bg, dbsq->n);
-      p7_oprofile_ReconfigLength(info->om, dbsq->n);
-      
-      p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-
+      search_target(info, dbsq, t++);
       esl_sq_Reuse(dbsq);
-      p7_pipeline_Reuse(info->pli);
     }
 
   esl_sq_Destroy(dbsq);
@@ -1623,9 +1910,80 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
   return sstatus;
 }
 
+/* serial_loop_seqdb()
+ * As serial_loop(), with the targets coming from pressed sequence
+ * database <sqdb> as views: nothing to parse, copy or reuse.
+ */
+static int
+serial_loop_seqdb(WORKER_INFO *info, P7_SEQDB *sqdb)
+{
+  ESL_SQ   dbsq;               /* view of one target sequence    */
+
+  memset(&dbsq, 0, sizeof(ESL_SQ));
+
+  /* Main loop: */
+  while (p7_seqdb_Read(sqdb, &dbsq) == eslOK)
+    search_target(info, &dbsq, dbsq.idx);
+  return eslEOF;
+}
+
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int max_residues)
+{
+  int  status  = eslOK;
+  int  sstatus = eslOK;
+  int  eofCount = 0;
+  int64_t       nseq = 0;      /* # of targets read so far: ordinal of the next block's first */
+  ESL_SQ_BLOCK *block;
+  void         *newBlock;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) p7_Fail("Work queue reader failed");
+      
+  /* Main loop: */
+  while (sstatus == eslOK)
+    {
+      block = (ESL_SQ_BLOCK *) newBlock;
+      sstatus = esl_sqio_ReadBlock(dbfp, block, max_residues, -1, /*max_init_window=*/FALSE, FALSE);
+      block->first_seqidx = nseq;
+      nseq += block->count;
+      if (sstatus == eslEOF)
+	{
+	  if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
+	  ++eofCount;
+	}
+
+      if (sstatus == eslOK)
+	{
+	  status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+	  if (status != eslOK) p7_Fail("Work queue reader failed");
+	}
+    }
+
+  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
+  if (status != eslOK) p7_Fail("Work queue reader failed");
+
+  if (sstatus == eslEOF)
+    {
+      /* wait for all the threads to complete */
+      esl_threads_WaitForFinish(obj);
+      esl_workqueue_Complete(queue);  
+    }
+
+  return sstatus;
+}
+
+/* thread_loop_seqdb()
+ * As thread_loop(), with target sequences coming from pressed
+ * database <sqdb>. The queue's blocks are p7_seqdb views, so filling
+ * one only sets pointers; the workers don't esl_sq_Reuse() them.
+ */
+static int
+thread_loop_seqdb(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_SEQDB *sqdb, int max_residues)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
@@ -1643,7 +2001,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
   while (sstatus == eslOK)
     {
       block = (ESL_SQ_BLOCK *) newBlock;
-      sstatus = esl_sqio_ReadBlock(dbfp, block, -1, -1, /*max_init_window=*/FALSE, FALSE);
+      sstatus = p7_seqdb_ReadBlock(sqdb, block, max_residues);
       if (sstatus == eslEOF)
 	{
 	  if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
@@ -1702,14 +2060,8 @@ pipeline_thread(void *arg)
 	{
 	  ESL_SQ *dbsq = block->list + i;
 
-	  p7_pli_NewSeq(info->pli, dbsq);
-	  p7_bg_SetLength(info->bg, dbsq->n);
-	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
-
-	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-
-	  esl_sq_Reuse(dbsq);
-	  p7_pipeline_Reuse(info->pli);
+	  search_target(info, dbsq, block->first_seqidx + i);
+	  if (! info->sqviews) esl_sq_Reuse(dbsq);
 	}
 
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
@@ -1721,6 +2073,8 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
+  /* sort our own hits while other threads may still be working, ready for the k-way merge */
+  p7_tophits_SortBySortkey(info->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
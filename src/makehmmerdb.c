@@ -7,6 +7,11 @@
 
 #include <string.h>
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#include "esl_threads.h"
+#endif
+
 #include "hmmer.h"
 #include "divsufsort.h"
 
@@ -21,7 +26,6 @@ static ESL_OPTIONS options[] = {
   { "-h",           eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL,  NULL,       "show brief help on version and usage",                      1 },
 
   /* Selecting the alphabet rather than autoguessing it */
-  //TODO: when I make the FM method work for amino acids, re-enable this selection
   { "--amino",   eslARG_NONE,   FALSE, NULL, NULL,   ALPHOPTS,    NULL,     NULL,       "input is protein sequence",                                 2 },
   { "--dna",     eslARG_NONE,   FALSE, NULL, NULL,   ALPHOPTS,    NULL,     NULL,       "input is DNA sequence",                                     2 },
   { "--rna",     eslARG_NONE,   FALSE, NULL, NULL,   ALPHOPTS,    NULL,     NULL,       "input is RNA sequence",                                     2 },
@@ -31,6 +35,11 @@ static ESL_OPTIONS options[] = {
   { "--bin_length", eslARG_INT,        "256", NULL, NULL,    NULL,  NULL,  NULL,        "bin length (power of 2;  32<=b<=4096)",                     3 },
   { "--sa_freq",    eslARG_INT,        "8",   NULL, NULL,    NULL,  NULL,  NULL,        "suffix array sample rate (power of 2)",                     3 },
   { "--block_size", eslARG_INT,        "50",  NULL, NULL,    NULL,  NULL,  NULL,        "input sequence broken into blocks this size (Mbases)",      3 },
+  { "--align",      eslARG_NONE,       FALSE, NULL, NULL,    NULL,  NULL,  NULL,        "align index arrays on disk, for memory-mapped searches",     3 },
+  { "--sa_mem",     eslARG_INT,        NULL,  NULL, "n>0",   NULL,  NULL,  NULL,        "sort suffixes in <n> MB per thread, for large --block_size", 3 },
+#ifdef HMMER_THREADS
+  { "--cpu",        eslARG_INT,     p7_NCPU,"HMMER_NCPU","n>=0",NULL, NULL,  NULL,        "number of parallel CPU workers to use for multithreads",    3 },
+#endif
 
   /* hidden*/
   { "--fwd_only",   eslARG_NONE,       FALSE, NULL, NULL,    NULL,  NULL,  NULL,        "build FM-index only for forward search (not for HMMER)",    9 },
@@ -105,6 +114,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *seqfile, char *fmfile)
   if (fprintf(ofp, "# output binary-formatted HMMER database:  %s\n", fmfile)                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (fprintf(ofp, "# bin_length:                              %d\n", esl_opt_GetInteger(go, "--bin_length")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (fprintf(ofp, "# suffix array sample rate:                %d\n", esl_opt_GetInteger(go, "--sa_freq"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--sa_mem")     && fprintf(ofp, "# suffix sorting memory per thread (MB):   %d\n", esl_opt_GetInteger(go, "--sa_mem")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--amino")      && fprintf(ofp, "# input is asserted to be:                 protein\n")                                        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--dna")        && fprintf(ofp, "# input is asserted to be:                 DNA\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--rna")        && fprintf(ofp, "# input is asserted to be:                 RNA\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -158,50 +168,398 @@ ERROR:
 }
 
 
-/* Function:  buildAndWriteFMIndex()
- * Synopsis:  Take text as input, along with several pre-allocated variables,
- *            and produce BWT and corresponding FM-index, then write it all
- *            to the output file.
+/* FM_BUILDSLOT
+ * One block's share of FM-index construction: the block's text and
+ * everything built from it that gets written out. A slot is filled
+ * by the reader, built by a worker, and written by the writer, in
+ * that order. A threaded build has a fixed number of slots in
+ * flight, which is what bounds its memory. The suffix array is
+ * scratch space that isn't written out, so it belongs to the worker
+ * (see FM_WORKSPACE) rather than the slot.
+ */
+enum fm_slotstate_e { fmSLOT_FREE = 0, fmSLOT_FILLING = 1, fmSLOT_FILLED = 2, fmSLOT_BUILDING = 3, fmSLOT_BUILT = 4 };
+
+typedef struct {
+  enum fm_slotstate_e state;
+  int       blockidx;		/* which block, in input order                                 */
+
+  uint64_t  N;			/* length of T, including the terminal '$'                     */
+  uint32_t  seq_offset;
+  uint32_t  ambig_offset;
+  uint32_t  seq_cnt;
+  uint32_t  ambig_cnt;
+  uint32_t  overlap;
+
+  uint8_t  *T;			/* text in the fm alphabet 1..k; T[N-1] is '$' (0)              */
+  uint8_t  *Tcompressed;	/* packed T, written with the first index                       */
+  uint32_t *SAsamp;		/* sampled suffix array, written with the first index           */
+  uint8_t  *BWT[2];		/* [0]: index of the reversed text; [1]: of the text itself     */
+  uint32_t *occCnts_sb[2];
+  uint16_t *occCnts_b[2];
+  uint32_t  term_loc[2];
+} FM_BUILDSLOT;
+
+/* FM_WORKSPACE
+ * Scratch space for building a block's indexes; one per worker.
  *
- *            if SAsamp == NULL, don't store/write T or SAsamp
+ * With --sa_mem, <SA> may be too small for a whole block's suffix
+ * array. Then the block's suffixes are sorted a range of buckets at
+ * a time instead (fm_blockwiseSuffixes()), bucketed by their first
+ * <k> letters: <bcnt> and <bstart> are each bucket's size and first
+ * rank, <bnext> its next free rank as it's filled.
+ */
+typedef struct {
+  int      *SA;			/* int, because libdivsufsort requires it */
+  uint64_t  sa_max;		/* SA has room for this many suffixes     */
+  uint32_t *cnts_sb;
+  uint16_t *cnts_b;
+
+  int       k;			/* blockwise sorting only; else 0 and NULLs */
+  uint32_t  nbuckets;
+  uint32_t *bcnt;
+  uint32_t *bstart;
+  uint32_t *bnext;
+} FM_WORKSPACE;
+
+#define fm_SUFBUCKETS_MAX (1<<20)  /* at most this many buckets of suffixes in a blockwise sort */
+
+#ifdef HMMER_THREADS
+/* FM_BUILDER
+ * A threaded build: the main thread reads blocks into free slots,
+ * <nworkers> threads build them, and a writer thread writes the
+ * built ones to <fp> in input order, freeing their slots for reuse.
  */
-int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig_offset,
-                        uint32_t seq_cnt, uint32_t ambig_cnt, uint32_t overlap,
-                        FM_DATA *fm_data, uint32_t *SAsamp,
-                        uint32_t *cnts_sb, uint16_t *cnts_b,
-                        uint64_t N, uint8_t **Tcompressed, FILE *fp
-    ) {
+typedef struct {
+  FM_METADATA    *meta;
+  FM_BUILDSLOT  **slot;
+  int             nslots;
+  int             nfilled;	/* # of blocks handed to the workers so far          */
+  int             nwritten;	/* # of blocks written so far; the next one to write */
+  int             eof;		/* TRUE once the reader is done                       */
+  FILE           *fp;
+  uint32_t        max_block_size;
+  uint64_t        sa_max;	/* suffixes a worker sorts at once; see FM_WORKSPACE */
+
+  pthread_t      *worker;
+  int             nworkers;
+  pthread_t       writer;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;		/* signals any change in any slot's state          */
+} FM_BUILDER;
+#endif /*HMMER_THREADS*/
+
+static void fm_slotDestroy(FM_BUILDSLOT *slot);
+static void fm_workspaceDestroy(FM_WORKSPACE *ws);
+#ifdef HMMER_THREADS
+static void *fmbuild_worker(void *arg);
+static void *fmbuild_writer(void *arg);
+#endif
 
 
-  int status;
-  uint64_t i,j,c,joffset;
-  int chars_per_byte = 8/meta->charBits;
-  uint32_t compressed_bytes =   ((chars_per_byte-1+N)/chars_per_byte);
-  uint32_t term_loc;
+/* Function:  fm_slotCreate()
+ * Synopsis:  Allocate a slot for blocks of up to <max_block_size> letters.
+ */
+static FM_BUILDSLOT *
+fm_slotCreate(FM_METADATA *meta, uint32_t max_block_size)
+{
+  FM_BUILDSLOT *slot = NULL;
+  int           pass;
+  int           status;
+
+  ESL_ALLOC(slot, sizeof(FM_BUILDSLOT));
+  slot->state       = fmSLOT_FREE;
+  slot->blockidx    = -1;
+  slot->T           = NULL;
+  slot->Tcompressed = NULL;
+  slot->SAsamp      = NULL;
+  for (pass = 0; pass < 2; pass++) {
+    slot->BWT[pass]        = NULL;
+    slot->occCnts_sb[pass] = NULL;
+    slot->occCnts_b[pass]  = NULL;
+  }
+
+  ESL_ALLOC (slot->T,           max_block_size * sizeof(uint8_t));
+  ESL_ALLOC (slot->Tcompressed, max_block_size * sizeof(uint8_t));
+  ESL_ALLOC (slot->SAsamp,      (1 + floor((double)max_block_size/meta->freq_SA) ) * sizeof(uint32_t));
+  for (pass = 0; pass < (meta->fwd_only ? 1 : 2); pass++) {
+    ESL_ALLOC (slot->BWT[pass],        max_block_size * sizeof(uint8_t));
+    ESL_ALLOC (slot->occCnts_sb[pass], (1+ceil((double)max_block_size/meta->freq_cnt_sb)) *  meta->alph_size * sizeof(uint32_t)); // every freq_cnt_sb positions, store an array of ints
+    ESL_ALLOC (slot->occCnts_b[pass],  ( 1+ceil((double)max_block_size/meta->freq_cnt_b)) *  meta->alph_size * sizeof(uint16_t)); // every freq_cnt_b positions, store an array of 8-byte ints
+  }
+  return slot;
+
+ ERROR:
+  fm_slotDestroy(slot);
+  return NULL;
+}
+
+static void
+fm_slotDestroy(FM_BUILDSLOT *slot)
+{
+  int pass;
+
+  if (slot == NULL) return;
+  free(slot->T);
+  free(slot->Tcompressed);
+  free(slot->SAsamp);
+  for (pass = 0; pass < 2; pass++) {
+    free(slot->BWT[pass]);
+    free(slot->occCnts_sb[pass]);
+    free(slot->occCnts_b[pass]);
+  }
+  free(slot);
+}
+
+/* Function:  fm_workspaceCreate()
+ * Synopsis:  Allocate a worker's scratch space, sorting up to <sa_max>
+ *            suffixes at once in blocks of up to <max_block_size>.
+ */
+static FM_WORKSPACE *
+fm_workspaceCreate(FM_METADATA *meta, uint32_t max_block_size, uint64_t sa_max)
+{
+  FM_WORKSPACE *ws = NULL;
+  uint32_t      sigma = meta->alph_size + 1;  /* letters and '$' */
+  int           status;
+
+  ESL_ALLOC(ws, sizeof(FM_WORKSPACE));
+  ws->SA       = NULL;
+  ws->sa_max   = ESL_MIN(sa_max, (uint64_t) max_block_size);
+  ws->cnts_sb  = NULL;
+  ws->cnts_b   = NULL;
+  ws->k        = 0;
+  ws->nbuckets = 1;
+  ws->bcnt     = NULL;
+  ws->bstart   = NULL;
+  ws->bnext    = NULL;
+  ESL_ALLOC (ws->SA,      ws->sa_max * sizeof(int));
+  ESL_ALLOC (ws->cnts_sb, meta->alph_size * sizeof(uint32_t));
+  ESL_ALLOC (ws->cnts_b,  meta->alph_size * sizeof(uint16_t));
+
+  if (ws->sa_max < max_block_size)
+    {
+      while (ws->nbuckets * sigma <= fm_SUFBUCKETS_MAX) { ws->nbuckets *= sigma; ws->k++; }
+      ESL_ALLOC (ws->bcnt,   ws->nbuckets * sizeof(uint32_t));
+      ESL_ALLOC (ws->bstart, ws->nbuckets * sizeof(uint32_t));
+      ESL_ALLOC (ws->bnext,  ws->nbuckets * sizeof(uint32_t));
+    }
+  return ws;
+
+ ERROR:
+  fm_workspaceDestroy(ws);
+  return NULL;
+}
+
+static void
+fm_workspaceDestroy(FM_WORKSPACE *ws)
+{
+  if (ws == NULL) return;
+  free(ws->SA);
+  free(ws->cnts_sb);
+  free(ws->cnts_b);
+  free(ws->bcnt);
+  free(ws->bstart);
+  free(ws->bnext);
+  free(ws);
+}
+
+/* fm_addSuffix()
+ * Add the suffix T[s..N-1], of rank <j> in the suffix array, to the
+ * BWT, sampled SA and occurrence counts being built in <slot>; the
+ * suffixes come in rank order. <T> is still in the 1..k alphabet,
+ * with '$' (0) at T[N-1].
+ */
+static void
+fm_addSuffix(FM_METADATA *meta, FM_BUILDSLOT *slot, int pass, FM_WORKSPACE *ws, uint64_t j, uint64_t s, uint32_t *term_loc)
+{
+  uint8_t  *BWT        = slot->BWT[pass];
+  uint32_t *occCnts_sb = slot->occCnts_sb[pass];
+  uint16_t *occCnts_b  = slot->occCnts_b[pass];
+  uint64_t  joffset    = j+1;
+  int       c;
+
+  if (s == 0) { //'$'
+    *term_loc = j;
+    BWT[j] =  0; //store 'a' in place of '$'
+  } else {
+    BWT[j] =  slot->T[s-1] - 1;  //move values down so 'a'=0...'t'=3
+  }
+
+  //sample the SA
+  if (pass == 0 && j > 0 && !(j % meta->freq_SA))
+    slot->SAsamp[ j/meta->freq_SA ] = ( s == slot->N - 1 ? -1 : s ) ; // handle the wrap-around '$'
+
+  ws->cnts_sb[BWT[j]]++;
+  ws->cnts_b[BWT[j]]++;
+
+  if ( !(  joffset % meta->freq_cnt_b) ) {  // (j+1)%freq_cnt_b==0  , i.e. every freq_cnt_bth position, noting that it's a zero-based count
+
+    for (c=0; c<meta->alph_size; c++)
+      FM_OCC_CNT(b, (joffset/meta->freq_cnt_b), c ) = ws->cnts_b[c];
+
+    if ( !(joffset % meta->freq_cnt_sb) ) {  // j%freq_cnt_sb==0
+      for (c=0; c<meta->alph_size; c++) {
+        FM_OCC_CNT(sb, (joffset/meta->freq_cnt_sb), c ) = ws->cnts_sb[c];
+        ws->cnts_b[c] = 0;
+      }
+    }
+  }
+}
+
+
+/* fm_suffixCmp()
+ * Compare suffixes T[p..] and T[q..], known to agree in their first
+ * <d> letters. They can't be equal: '$' is unique.
+ */
+static int
+fm_suffixCmp(const uint8_t *T, uint64_t p, uint64_t q, uint64_t d)
+{
+  while (T[p+d] == T[q+d]) d++;
+  return (T[p+d] < T[q+d] ? -1 : 1);
+}
+
+/* fm_sortSuffixes()
+ * Multikey quicksort (Bentley and Sedgewick) of the <n> suffixes of <T>
+ * starting at the positions in <a>, which agree in their first <d>
+ * letters. Runs of repeats cost time in proportion to their length,
+ * which is why divsufsort() is used whenever a block fits in memory.
+ */
+static void
+fm_sortSuffixes(const uint8_t *T, int *a, uint64_t n, uint64_t d)
+{
+  uint64_t lt, gt, i, m;
+  uint8_t  v, x, y, z;
+  int      tmp;
+
+  while (n > 1)
+    {
+      if (n < 16)
+	{
+	  for (i = 1; i < n; i++)
+	    for (m = i; m > 0 && fm_suffixCmp(T, a[m-1], a[m], d) > 0; m--)
+	      { tmp = a[m]; a[m] = a[m-1]; a[m-1] = tmp; }
+	  return;
+	}
+
+      x = T[a[0]+d];  y = T[a[n/2]+d];  z = T[a[n-1]+d];  // median of three for the pivot letter
+      v = (x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y)));
+
+      for (lt = 0, i = 0, gt = n; i < gt; )
+	{
+	  if      (T[a[i]+d] < v) { tmp = a[lt]; a[lt] = a[i]; a[i] = tmp; lt++; i++; }
+	  else if (T[a[i]+d] > v) { gt--; tmp = a[gt]; a[gt] = a[i]; a[i] = tmp; }
+	  else                      i++;
+	}
+
+      fm_sortSuffixes(T, a,      lt,     d);
+      fm_sortSuffixes(T, a + gt, n - gt, d);
+      if (v == 0) return;  // the '$' suffix, alone
+      a += lt;
+      n  = gt - lt;
+      d++;
+    }
+}
+
+/* fm_blockwiseSuffixes()
+ * Add all the suffixes of the block in <slot> to its index in rank
+ * order, as fm_addSuffix() calls, without room in <ws->SA> for the
+ * whole suffix array: suffixes are bucketed by their first <ws->k>
+ * letters (counting '$' and anything past it as 0), and each pass
+ * over T collects and sorts a run of buckets that fits, so memory is
+ * bounded by <ws->sa_max> suffixes. A single bucket bigger than that
+ * gets a pass of its own, for which <ws->SA> is enlarged.
+ */
+static void
+fm_blockwiseSuffixes(FM_METADATA *meta, FM_BUILDSLOT *slot, int pass, FM_WORKSPACE *ws, uint32_t *term_loc)
+{
+  uint8_t  *T     = slot->T;
+  uint64_t  N     = slot->N;
+  uint32_t  sigma = meta->alph_size + 1;
+  uint32_t  top   = ws->nbuckets / sigma;  // weight of a bucket code's first letter
+  uint32_t  code, lo, hi, b;
+  uint64_t  base, n, p, r;
+  void     *tmp;
+  int       status;
+
+  // bucket sizes, and each bucket's first rank
+  for (b = 0; b < ws->nbuckets; b++) ws->bcnt[b] = 0;
+  for (code = 0, p = 0; p < (uint64_t) ws->k; p++) code = code * sigma + (p < N ? T[p] : 0);
+  for (p = 0; p < N; p++)
+    {
+      ws->bcnt[code]++;
+      code = (code - T[p] * top) * sigma + (p + ws->k < N ? T[p + ws->k] : 0);
+    }
+  for (base = 0, b = 0; b < ws->nbuckets; b++) { ws->bstart[b] = ws->bnext[b] = base; base += ws->bcnt[b]; }
+
+  for (lo = 0; lo < ws->nbuckets; lo = hi)
+    {
+      // the run of buckets lo..hi-1 for this pass: at least one
+      for (n = ws->bcnt[lo], hi = lo+1; hi < ws->nbuckets && n + ws->bcnt[hi] <= ws->sa_max; hi++) n += ws->bcnt[hi];
+      if (n == 0) continue;
+      if (n > ws->sa_max) {
+        ESL_RALLOC(ws->SA, tmp, n * sizeof(int));
+        ws->sa_max = n;
+      }
+
+      // collect them from T, by bucket, then sort each bucket past the letters its suffixes share
+      base = ws->bstart[lo];
+      for (code = 0, p = 0; p < (uint64_t) ws->k; p++) code = code * sigma + (p < N ? T[p] : 0);
+      for (p = 0; p < N; p++)
+	{
+	  if (code >= lo && code < hi) ws->SA[ws->bnext[code]++ - base] = p;
+	  code = (code - T[p] * top) * sigma + (p + ws->k < N ? T[p + ws->k] : 0);
+	}
+      for (b = lo; b < hi; b++)
+	fm_sortSuffixes(T, ws->SA + (ws->bstart[b] - base), ws->bcnt[b], ws->k);
+
+      for (r = 0; r < n; r++)
+	fm_addSuffix(meta, slot, pass, ws, base + r, ws->SA[r], term_loc);
+    }
+  return;
+
+ ERROR:
+  esl_fatal("unable to allocate memory for FM-index construction\n");
+}
 
-  uint8_t *T             = fm_data->T;
-  uint8_t *BWT           = fm_data->BWT;
-  int *SA                = (int*) fm_data->SA; //cast this way because libdivsufsort requires an int.
-  uint32_t *occCnts_sb   = fm_data->occCnts_sb;
-  uint16_t *occCnts_b    = fm_data->occCnts_b;
 
+/* Function:  buildFMIndex()
+ * Synopsis:  Take the text in <slot> as input, and produce BWT and
+ *            corresponding FM-index, using the scratch space in <ws>.
+ *
+ *            <pass> 0 builds the index of the reversed text, and also
+ *            the sampled SA and packed text that are stored with it;
+ *            <pass> 1 builds the index of the text itself.
+ *
+ *            The suffix array is built by divsufsort() if it fits in
+ *            <ws>, else blockwise (see fm_blockwiseSuffixes()); the
+ *            index is the same either way.
+ */
+static int
+buildFMIndex (FM_METADATA *meta, FM_BUILDSLOT *slot, int pass, FM_WORKSPACE *ws)
+{
+  int status;
+  uint64_t i,j,c;
+  uint64_t N             = slot->N;
+  uint32_t term_loc      = 0;
+
+  uint8_t *T             = slot->T;
+  uint8_t *BWT           = slot->BWT[pass];
+  int *SA                = ws->SA;
+  uint32_t *occCnts_sb   = slot->occCnts_sb[pass];
+  uint16_t *occCnts_b    = slot->occCnts_b[pass];
+  uint32_t *SAsamp       = (pass == 0 ? slot->SAsamp : NULL);
+  uint8_t  *Tcompressed  = slot->Tcompressed;
+  uint32_t *cnts_sb      = ws->cnts_sb;
+  uint16_t *cnts_b       = ws->cnts_b;
 
   int num_freq_cnts_b  = 1+ceil((double)N/(meta->freq_cnt_b));
   int num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
   int num_SA_samples   = 1+floor((double)N/meta->freq_SA);
 
   if (SAsamp != NULL) {
-    ESL_REALLOC ((*Tcompressed), compressed_bytes * sizeof(uint8_t));
-
     // Reverse the text T, so the BWT will be on reversed T.  Only used for the 1st pass
     fm_reverseString ((char*)T, N-1);
   }
 
-  // Construct the Suffix Array on text T
-  status = divsufsort(fm_data->T, SA, N);
-  if ( status < 0 )
-    esl_fatal("buildAndWriteFMIndex: Error building BWT.\n");
-
   // Construct the BWT, SA landmarks, and FM-index
   for (c=0; c<meta->alph_size; c++) {
     cnts_sb[c] = 0;
@@ -210,55 +568,26 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
     FM_OCC_CNT(b, 0, c ) = 0;
   }
 
-
-  for(j=0; j < N-1; ++j) {
-    T[j]--;  //move values down so 'a'=0...'t'=3; store 'a' in place of '$'
-  }
-  T[N-1]=0;
-
-  BWT[0] =  SA[0]==0 ? 0 /* '$' */ : T[ SA[0]-1] ;
-
-  cnts_sb[BWT[0]]++;
-  cnts_b[BWT[0]]++;
-
   if (SAsamp != NULL) {
     SAsamp[0] = 0; // not used, since indexing is base-1. Set for the sake of consistency of output.
     SAsamp[num_SA_samples-1] = 0; //this may sometimes not be filled below; set to avoid valgrind error in fwrite
   }
 
-  //Scan through SA to build the BWT and FM index structures
-  for(j=1; j < N; ++j) {
-    if (SA[j]==0) { //'$'
-      term_loc = j;
-      BWT[j] =  0; //store 'a' in place of '$'
-    } else {
-      BWT[j] =  T[ SA[j]-1] ;
-    }
-
-
-    //sample the SA
-    if (SAsamp != NULL) {
-      if ( !(j % meta->freq_SA) )
-        SAsamp[ j/meta->freq_SA ] = ( SA[j] == N - 1 ? -1 : SA[j] ) ; // handle the wrap-around '$'
-    }
-
-    cnts_sb[BWT[j]]++;
-    cnts_b[BWT[j]]++;
-
-    joffset = j+1;
-    if ( !(  joffset % meta->freq_cnt_b) ) {  // (j+1)%freq_cnt_b==0  , i.e. every freq_cnt_bth position, noting that it's a zero-based count
-
-      for (c=0; c<meta->alph_size; c++)
-        FM_OCC_CNT(b, (joffset/meta->freq_cnt_b), c ) = cnts_b[c];
+  if (N <= ws->sa_max) {
+    // Construct the Suffix Array on text T, then scan through it
+    status = divsufsort(T, SA, N);
+    if ( status < 0 )
+      esl_fatal("buildFMIndex: Error building BWT.\n");
+    for (j=0; j < N; ++j)
+      fm_addSuffix(meta, slot, pass, ws, j, SA[j], &term_loc);
+  } else {
+    fm_blockwiseSuffixes(meta, slot, pass, ws, &term_loc);
+  }
 
-      if ( !(joffset % meta->freq_cnt_sb) ) {  // j%freq_cnt_sb==0
-        for (c=0; c<meta->alph_size; c++) {
-          FM_OCC_CNT(sb, (joffset/meta->freq_cnt_sb), c ) = cnts_sb[c];
-          cnts_b[c] = 0;
-        }
-      }
-    }
+  for(j=0; j < N-1; ++j) {
+    T[j]--;  //move values down so 'a'=0...'t'=3; store 'a' in place of '$'
   }
+  T[N-1]=0;
 
   //wrap up the counting;
   for (c=0; c<meta->alph_size; c++) {
@@ -290,17 +619,17 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
     if (meta->alph_type == fm_DNA ) {
        //4 chars per byte.  Counting will be done based on quadruples 0..3; 4..7; 8..11; etc.
       for(i=0; i < N-3; i+=4)
-        (*Tcompressed)[i/4] =  T[i]<<6 |   T[i+1]<<4 |   T[i+2]<<2 | T[i+3];
+        Tcompressed[i/4] =  T[i]<<6 |   T[i+1]<<4 |   T[i+2]<<2 | T[i+3];
 
       if (i <= N-1)
-        (*Tcompressed)[i/4] =   T[i]<<6;
+        Tcompressed[i/4] =   T[i]<<6;
       if (i+1 <= N-1)
-        (*Tcompressed)[i/4] |=   T[i+1]<<4;
+        Tcompressed[i/4] |=   T[i+1]<<4;
       if (i+2 <= N-1)
-        (*Tcompressed)[i/4] |=   T[i+2]<<2;
+        Tcompressed[i/4] |=   T[i+2]<<2;
     } else {
       for(i=0; i <= N-1; i++)
-        (*Tcompressed)[i] =    T[i];
+        Tcompressed[i] =    T[i];
     }
   }
 
@@ -310,44 +639,280 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
   }
   T[N-1] = 0;
 
-
-  // Write the FM-index meta data
-  if(fwrite(&N, sizeof(uint64_t), 1, fp) !=  1)
-    esl_fatal( "buildAndWriteFMIndex: Error writing block_length in FM index.\n");
-  if(fwrite(&term_loc, sizeof(uint32_t), 1, fp) !=  1)
-    esl_fatal( "buildAndWriteFMIndex: Error writing terminal location in FM index.\n");
-  if(fwrite(&seq_offset, sizeof(uint32_t), 1, fp) !=  1)
-    esl_fatal( "buildAndWriteFMIndex: Error writing seq_offset in FM index.\n");
-  if(fwrite(&ambig_offset, sizeof(uint32_t), 1, fp) !=  1)
-    esl_fatal( "buildAndWriteFMIndex: Error writing ambig_offset in FM index.\n");
-  if(fwrite(&overlap, sizeof(uint32_t), 1, fp) !=  1)
-    esl_fatal( "buildAndWriteFMIndex: Error writing overlap in FM index.\n");
-  if(fwrite(&seq_cnt, sizeof(uint32_t), 1, fp) !=  1)
-    esl_fatal( "buildAndWriteFMIndex: Error writing seq_cnt in FM index.\n");
-  if(fwrite(&ambig_cnt, sizeof(uint32_t), 1, fp) !=  1)
-    esl_fatal( "buildAndWriteFMIndex: Error writing ambig_cnt in FM index.\n");
-
-  // don't write Tcompressed or SAsamp if SAsamp == NULL
-  if( SAsamp != NULL  && fwrite(*Tcompressed, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
-    esl_fatal( "buildAndWriteFMIndex: Error writing T in FM index.\n");
-  if(fwrite(BWT, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
-    esl_fatal( "buildAndWriteFMIndex: Error writing BWT in FM index.\n");
-  if(SAsamp != NULL && fwrite(SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
-    esl_fatal( "buildAndWriteFMIndex: Error writing SA in FM index.\n");
-  if(fwrite(occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fp) != (size_t)num_freq_cnts_b)
-    esl_fatal( "buildAndWriteFMIndex: Error writing occCnts_b in FM index.\n");
-  if(fwrite(occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
-    esl_fatal( "buildAndWriteFMIndex: Error writing occCnts_sb in FM index.\n");
+  slot->term_loc[pass] = term_loc;
+  return eslOK;
+}
 
 
+/* Function:  writeFMIndex()
+ * Synopsis:  Write the FM-index(es) built in <slot> to the output file.
+ *
+ *            Only the first (reversed text) index is written with its
+ *            T and SAsamp.
+ */
+static int
+writeFMIndex (FM_METADATA *meta, FM_BUILDSLOT *slot, FILE *fp)
+{
+  int      chars_per_byte   = 8/meta->charBits;
+  uint64_t N                = slot->N;
+  uint32_t compressed_bytes = ((chars_per_byte-1+N)/chars_per_byte);
+  int      num_freq_cnts_b  = 1+ceil((double)N/(meta->freq_cnt_b));
+  int      num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
+  int      num_SA_samples   = 1+floor((double)N/meta->freq_SA);
+  uint32_t overlap;
+  int      pass;
+
+  for (pass = 0; pass < (meta->fwd_only ? 1 : 2); pass++) {
+    overlap = (pass == 0 ? slot->overlap : 0);
+
+    // Write the FM-index meta data
+    if(fwrite(&N, sizeof(uint64_t), 1, fp) !=  1)
+      esl_fatal( "writeFMIndex: Error writing block_length in FM index.\n");
+    if(fwrite(&(slot->term_loc[pass]), sizeof(uint32_t), 1, fp) !=  1)
+      esl_fatal( "writeFMIndex: Error writing terminal location in FM index.\n");
+    if(fwrite(&(slot->seq_offset), sizeof(uint32_t), 1, fp) !=  1)
+      esl_fatal( "writeFMIndex: Error writing seq_offset in FM index.\n");
+    if(fwrite(&(slot->ambig_offset), sizeof(uint32_t), 1, fp) !=  1)
+      esl_fatal( "writeFMIndex: Error writing ambig_offset in FM index.\n");
+    if(fwrite(&overlap, sizeof(uint32_t), 1, fp) !=  1)
+      esl_fatal( "writeFMIndex: Error writing overlap in FM index.\n");
+    if(fwrite(&(slot->seq_cnt), sizeof(uint32_t), 1, fp) !=  1)
+      esl_fatal( "writeFMIndex: Error writing seq_cnt in FM index.\n");
+    if(fwrite(&(slot->ambig_cnt), sizeof(uint32_t), 1, fp) !=  1)
+      esl_fatal( "writeFMIndex: Error writing ambig_cnt in FM index.\n");
+
+    // write Tcompressed and SAsamp only with the first index
+    if( pass == 0 && fwrite(slot->Tcompressed, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
+      esl_fatal( "writeFMIndex: Error writing T in FM index.\n");
+    if(fwrite(slot->BWT[pass], sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
+      esl_fatal( "writeFMIndex: Error writing BWT in FM index.\n");
+    if( pass == 0 && fwrite(slot->SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
+      esl_fatal( "writeFMIndex: Error writing SA in FM index.\n");
+    if(fwrite(slot->occCnts_b[pass], sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fp) != (size_t)num_freq_cnts_b)
+      esl_fatal( "writeFMIndex: Error writing occCnts_b in FM index.\n");
+    if(fwrite(slot->occCnts_sb[pass], sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
+      esl_fatal( "writeFMIndex: Error writing occCnts_sb in FM index.\n");
+  }
   return eslOK;
+}
 
-ERROR:
-  /* Deallocate memory. */
-  return eslFAIL;
 
+#ifdef HMMER_THREADS
+/* Function:  fmbuild_Create()
+ * Synopsis:  Start a threaded build, with <nworkers> worker threads.
+ *
+ *            There are <nworkers>+2 slots, so the reader and the
+ *            writer can each be busy with one while every worker
+ *            builds another. Memory use is about 4 bytes per letter
+ *            of <max_block_size> (or per suffix of <sa_max>, if that's
+ *            fewer) for each worker's suffix array, plus about 4 (or,
+ *            with fwd_only, 3) per letter for each slot.
+ */
+static FM_BUILDER *
+fmbuild_Create(FM_METADATA *meta, int nworkers, uint32_t max_block_size, uint64_t sa_max, FILE *fp)
+{
+  FM_BUILDER *bld = NULL;
+  int         s;
+  int         status;
+
+  ESL_ALLOC(bld, sizeof(FM_BUILDER));
+  bld->meta     = meta;
+  bld->nslots   = nworkers + 2;
+  bld->nfilled  = 0;
+  bld->nwritten = 0;
+  bld->eof      = FALSE;
+  bld->fp       = fp;
+  bld->max_block_size = max_block_size;
+  bld->sa_max   = sa_max;
+  bld->nworkers = 0;
+  bld->worker   = NULL;
+
+  ESL_ALLOC(bld->slot,   sizeof(FM_BUILDSLOT *) * bld->nslots);
+  ESL_ALLOC(bld->worker, sizeof(pthread_t)      * nworkers);
+  for (s = 0; s < bld->nslots; s++)
+    if ((bld->slot[s] = fm_slotCreate(meta, max_block_size)) == NULL) goto ERROR;
+
+  if (pthread_mutex_init(&bld->mutex, NULL) != 0) esl_fatal("unable to initialize mutex for FM-index construction\n");
+  if (pthread_cond_init (&bld->cond,  NULL) != 0) esl_fatal("unable to initialize condition for FM-index construction\n");
+
+  if (pthread_create(&bld->writer, NULL, fmbuild_writer, bld) != 0) esl_fatal("unable to start FM-index writer thread\n");
+  for (bld->nworkers = 0; bld->nworkers < nworkers; bld->nworkers++)
+    if (pthread_create(&(bld->worker[bld->nworkers]), NULL, fmbuild_worker, bld) != 0) break;
+  if (bld->nworkers == 0) esl_fatal("unable to start FM-index worker threads\n");
+  return bld;
+
+ ERROR:
+  esl_fatal("unable to allocate memory for FM-index construction\n");
+  return NULL;
 }
 
+/* Function:  fmbuild_GetSlot()
+ * Synopsis:  Wait for a free slot, for the reader to fill.
+ */
+static FM_BUILDSLOT *
+fmbuild_GetSlot(FM_BUILDER *bld)
+{
+  FM_BUILDSLOT *slot = NULL;
+  int           s;
+
+  pthread_mutex_lock(&bld->mutex);
+  while (slot == NULL)
+    {
+      for (s = 0; s < bld->nslots; s++)
+	if (bld->slot[s]->state == fmSLOT_FREE) { slot = bld->slot[s]; break; }
+      if (slot == NULL) pthread_cond_wait(&bld->cond, &bld->mutex);
+    }
+  slot->state = fmSLOT_FILLING;
+  pthread_mutex_unlock(&bld->mutex);
+  return slot;
+}
+
+/* Function:  fmbuild_Submit()
+ * Synopsis:  Hand a filled slot to the workers, as the next block.
+ */
+static void
+fmbuild_Submit(FM_BUILDER *bld, FM_BUILDSLOT *slot)
+{
+  pthread_mutex_lock(&bld->mutex);
+  slot->blockidx = bld->nfilled++;
+  slot->state    = fmSLOT_FILLED;
+  pthread_cond_broadcast(&bld->cond);
+  pthread_mutex_unlock(&bld->mutex);
+}
+
+/* Function:  fmbuild_Finish()
+ * Synopsis:  Tell the threads there are no more blocks, and wait
+ *            until every block has been built and written.
+ */
+static void
+fmbuild_Finish(FM_BUILDER *bld)
+{
+  int w;
+
+  pthread_mutex_lock(&bld->mutex);
+  bld->eof = TRUE;
+  pthread_cond_broadcast(&bld->cond);
+  pthread_mutex_unlock(&bld->mutex);
+
+  for (w = 0; w < bld->nworkers; w++)
+    pthread_join(bld->worker[w], NULL);
+  pthread_join(bld->writer, NULL);
+}
+
+static void
+fmbuild_Destroy(FM_BUILDER *bld)
+{
+  int s;
+
+  if (bld == NULL) return;
+  for (s = 0; s < bld->nslots; s++) fm_slotDestroy(bld->slot[s]);
+  pthread_mutex_destroy(&bld->mutex);
+  pthread_cond_destroy(&bld->cond);
+  free(bld->slot);
+  free(bld->worker);
+  free(bld);
+}
+
+/* fmbuild_worker()
+ * Worker thread: build filled slots, oldest block first so the
+ * writer is kept busy, until the reader is done and nothing is left.
+ */
+static void *
+fmbuild_worker(void *arg)
+{
+  FM_BUILDER   *bld = (FM_BUILDER *) arg;
+  FM_BUILDSLOT *slot;
+  FM_WORKSPACE *ws;
+  int           s;
+
+  if ((ws = fm_workspaceCreate(bld->meta, bld->max_block_size, bld->sa_max)) == NULL)
+    esl_fatal("unable to allocate memory for FM-index construction\n");
+
+  for (;;)
+    {
+      pthread_mutex_lock(&bld->mutex);
+      for (;;)
+	{
+	  slot = NULL;
+	  for (s = 0; s < bld->nslots; s++)
+	    if (bld->slot[s]->state == fmSLOT_FILLED && (slot == NULL || bld->slot[s]->blockidx < slot->blockidx))
+	      slot = bld->slot[s];
+	  if (slot != NULL || bld->eof) break;
+	  pthread_cond_wait(&bld->cond, &bld->mutex);
+	}
+      if (slot == NULL) { pthread_mutex_unlock(&bld->mutex); break; }
+      slot->state = fmSLOT_BUILDING;
+      pthread_mutex_unlock(&bld->mutex);
+
+      buildFMIndex(bld->meta, slot, 0, ws);
+      if ( ! bld->meta->fwd_only )
+	buildFMIndex(bld->meta, slot, 1, ws);
+
+      pthread_mutex_lock(&bld->mutex);
+      slot->state = fmSLOT_BUILT;
+      pthread_cond_broadcast(&bld->cond);
+      pthread_mutex_unlock(&bld->mutex);
+    }
+
+  fm_workspaceDestroy(ws);
+  return NULL;
+}
+
+/* fmbuild_writer()
+ * Writer thread: write built slots in block order, and free them
+ * for the reader, until every block submitted has been written.
+ */
+static void *
+fmbuild_writer(void *arg)
+{
+  FM_BUILDER   *bld = (FM_BUILDER *) arg;
+  FM_BUILDSLOT *slot;
+  int           s;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&bld->mutex);
+      for (;;)
+	{
+	  slot = NULL;
+	  for (s = 0; s < bld->nslots; s++)
+	    if (bld->slot[s]->state == fmSLOT_BUILT && bld->slot[s]->blockidx == bld->nwritten)
+	      slot = bld->slot[s];
+	  if (slot != NULL || (bld->eof && bld->nwritten == bld->nfilled)) break;
+	  pthread_cond_wait(&bld->cond, &bld->mutex);
+	}
+      pthread_mutex_unlock(&bld->mutex);
+      if (slot == NULL) break;
+
+      writeFMIndex(bld->meta, slot, bld->fp);
+
+      pthread_mutex_lock(&bld->mutex);
+      slot->state = fmSLOT_FREE;
+      bld->nwritten++;
+      pthread_cond_broadcast(&bld->cond);
+      pthread_mutex_unlock(&bld->mutex);
+    }
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+
+
+
+/* write_padding()
+ * With --align, zero-fill <fp> up to the next fm_ALIGN-byte file
+ * offset, so that each array of an FM-index can be used in place from a
+ * memory mapping of the file (see fm_mapFMfile()).
+ */
+static int
+write_padding(FILE *fp)
+{
+  static const char zeros[fm_ALIGN] = { 0 };
+  off_t             off             = ftello(fp);
+
+  if (off < 0) return eslEWRITE;
+  if (off % fm_ALIGN && fwrite(zeros, 1, fm_ALIGN - off % fm_ALIGN, fp) != fm_ALIGN - off % fm_ALIGN) return eslEWRITE;
+  return eslOK;
+}
 
 
 /* Function:  main()
@@ -368,11 +933,12 @@ main(int argc, char **argv)
 
   // these will be allocated once, and reused for each built block
   FM_METADATA *meta    = NULL;
-  FM_DATA *fm_data     = NULL;
-  uint32_t *SAsamp     = NULL;
-  uint32_t *cnts_sb    = NULL;
-  uint16_t *cnts_b     = NULL;
-  uint8_t *Tcompressed = NULL;
+  FM_BUILDSLOT *slot   = NULL;   // the slot being filled; in a threaded build, one of bld's
+  FM_WORKSPACE *ws     = NULL;   // unthreaded build only
+#ifdef HMMER_THREADS
+  FM_BUILDER   *bld    = NULL;
+#endif
+  int           ncpus  = 0;
 
 
 
@@ -402,8 +968,10 @@ main(int argc, char **argv)
   int use_tmpsq = 0;
   uint64_t block_length;
   uint64_t total_char_count = 0;
+  uint8_t  flags;                 // fwd_only byte as written: fwd_only, plus layout flags
 
   uint32_t max_block_size;
+  uint64_t sa_max;                // suffixes sorted at once by each worker
 
   int numblocks = 0;
   uint32_t numseqs = 0;
@@ -433,7 +1001,11 @@ main(int argc, char **argv)
   ESL_ALLOC (meta, sizeof(FM_METADATA));
   if (meta == NULL)
     esl_fatal("unable to allocate memory to store FM meta data\n");
-  meta->alph = NULL;
+  meta->alph    = NULL;
+  meta->aligned = FALSE;
+  meta->interleave = FALSE;
+  meta->map     = NULL;
+  meta->mapsize = 0;
 
 
   ESL_ALLOC (meta->ambig_list, sizeof(FM_AMBIGLIST));
@@ -492,7 +1064,6 @@ main(int argc, char **argv)
   if ( esl_opt_IsUsed(go, "--amino")  ) {
     meta->alph_type = fm_AMINO;
     alphatype = eslAMINO;
-    meta->fwd_only = 1;
   } else if (esl_opt_IsUsed(go, "--dna") || esl_opt_IsUsed(go, "--rna") ){
 
     //meta->alph = "dna"; //esl_opt_IsUsed(go, "--dna") ? "dna" || "rna";
@@ -508,7 +1079,6 @@ main(int argc, char **argv)
     } else if (alphaguess == eslAMINO) {
       meta->alph_type = fm_AMINO;
       alphatype = eslAMINO;
-      meta->fwd_only = 1;
     } else {
       esl_fatal("Unable to guess alphabet. Try '--dna' or '--amino'\n%s", ""); //'dna_full'
     }
@@ -518,6 +1088,9 @@ main(int argc, char **argv)
   if (esl_opt_IsOn(go, "--fwd_only") )
     meta->fwd_only = 1;
 
+  if (esl_opt_GetBoolean(go, "--align"))
+    meta->aligned = TRUE;
+
   //getInverseAlphabet
   fm_alphabetCreate(meta, &(meta->charBits));
   chars_per_byte = 8/meta->charBits;
@@ -536,30 +1109,27 @@ main(int argc, char **argv)
   block = esl_sq_CreateDigitalBlock(FM_BLOCK_COUNT, abc);
   block->complete = FALSE;
   max_block_size = FM_BLOCK_OVERLAP+block_size+1  + ceil(block_size*.05); // first +1 for the '$',  +5% of block size because that's the slop allowed by readwindow
+  sa_max         = (esl_opt_IsOn(go, "--sa_mem") ? (uint64_t) esl_opt_GetInteger(go, "--sa_mem") * 1024 * 1024 / sizeof(int) : max_block_size);
 
   /* Allocate BWT, Text, SA, and FM-index data structures, allowing storage of maximally large sequence*/
-  ESL_ALLOC(fm_data, sizeof(FM_DATA) );
-  fm_data->T          = NULL;
-  fm_data->BWT_mem    = NULL;
-  fm_data->BWT        = NULL;
-  fm_data->SA         = NULL;
-  fm_data->C          = NULL;
-  fm_data->occCnts_sb = NULL;
-  fm_data->occCnts_b  = NULL;
-
-  ESL_ALLOC (fm_data->T, max_block_size * sizeof(uint8_t));
-  ESL_ALLOC (fm_data->BWT_mem, max_block_size * sizeof(uint8_t));
-  fm_data->BWT = fm_data->BWT_mem;  // in SSE code, used to align memory. Here, doesn't matter
-  ESL_ALLOC (fm_data->SA, max_block_size * sizeof(int));
-  ESL_ALLOC (SAsamp,     (1 + floor((double)max_block_size/meta->freq_SA) ) * sizeof(uint32_t));
-  ESL_ALLOC (fm_data->occCnts_sb, (1+ceil((double)max_block_size/meta->freq_cnt_sb)) *  meta->alph_size * sizeof(uint32_t)); // every freq_cnt_sb positions, store an array of ints
-  ESL_ALLOC (fm_data->occCnts_b,  ( 1+ceil((double)max_block_size/meta->freq_cnt_b)) *  meta->alph_size * sizeof(uint16_t)); // every freq_cnt_b positions, store an array of 8-byte ints
-  ESL_ALLOC (cnts_sb,    meta->alph_size * sizeof(uint32_t));
-  ESL_ALLOC (cnts_b,     meta->alph_size * sizeof(uint16_t));
-
   // Open a temporary file, to which FM-index data will be written
   if (esl_tmpfile(tmp_filename, &fptmp) != eslOK) esl_fatal("unable to open fm-index tmpfile");
 
+  /* Allocate the text, BWT, SA, and FM-index data structures, allowing storage of a maximally large block.
+   * Blocks are independent, so a threaded build reads one while others are built and
+   * another is written; see fmbuild_Create() for its memory use.
+   */
+#ifdef HMMER_THREADS
+  ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
+    bld = fmbuild_Create(meta, ncpus, max_block_size, sa_max, fptmp);
+#endif
+  if (ncpus == 0)
+    {
+      if ((slot = fm_slotCreate(meta, max_block_size))      == NULL) { status = eslEMEM; goto ERROR; }
+      if ((ws   = fm_workspaceCreate(meta, max_block_size, sa_max)) == NULL) { status = eslEMEM; goto ERROR; }
+    }
+
   /* Main loop: */
   while (status == eslOK ) {
     //reset block as an empty vessel
@@ -632,6 +1202,9 @@ main(int argc, char **argv)
     *      (these will later be shifted to 0-based alphabet, once SA has been built)
     *
     */
+#ifdef HMMER_THREADS
+    if (bld) slot = fmbuild_GetSlot(bld);
+#endif
     block_length = 0;
     for (i=0; i<block->count; i++) {
 
@@ -673,7 +1246,7 @@ main(int argc, char **argv)
           esl_fatal("requested alphabet doesn't match input text\n");
         }
 
-        fm_data->T[block_length] = meta->inv_alph[c];
+        slot->T[block_length] = meta->inv_alph[c];
 
         block_length++;
         if (j>block->list[i].C) total_char_count++; // add to total count, only if it's not redundant with earlier read
@@ -683,26 +1256,39 @@ main(int argc, char **argv)
       in_ambig_run = 0;
     }
 
-    fm_data->T[block_length] = 0; // last character 0 is effectively '$' for suffix array
+    slot->T[block_length] = 0; // last character 0 is effectively '$' for suffix array
     block_length++;
 
-    seq_cnt = numseqs-seq_offset;
-    ambig_cnt = meta->ambig_list->count - ambig_offset;
+    slot->N            = block_length;
+    slot->seq_offset   = seq_offset;
+    slot->ambig_offset = ambig_offset;
+    slot->seq_cnt      = numseqs-seq_offset;
+    slot->ambig_cnt    = meta->ambig_list->count - ambig_offset;
+    slot->overlap      = (uint32_t)block->list[0].C;
 
+#ifdef HMMER_THREADS
+    if (bld) fmbuild_Submit(bld, slot);
+#endif
+    if (ncpus == 0) {
+      //build FM-index for T.  This will be a BWT on the reverse of the sequence, required for reverse-traversal of the BWT
+      buildFMIndex(meta, slot, 0, ws);
 
-    //build and write FM-index for T.  This will be a BWT on the reverse of the sequence, required for reverse-traversal of the BWT
-    buildAndWriteFMIndex(meta, seq_offset, ambig_offset, seq_cnt, ambig_cnt, (uint32_t)block->list[0].C, fm_data,
-                         SAsamp, cnts_sb, cnts_b, block_length, &Tcompressed, fptmp);
-
+      //build FM-index for un-reversed T  (used to find reverse hits using forward traversal of the BWT
+      if ( ! meta->fwd_only )
+        buildFMIndex(meta, slot, 1, ws);
 
-    if ( ! meta->fwd_only ) {
-      //build and write FM-index for un-reversed T  (used to find reverse hits using forward traversal of the BWT
-      buildAndWriteFMIndex(meta, seq_offset, ambig_offset, seq_cnt, ambig_cnt, 0, fm_data,
-                         NULL, cnts_sb, cnts_b, block_length, &Tcompressed, fptmp);
+      writeFMIndex(meta, slot, fptmp);
     }
     numblocks++;
   }
 
+#ifdef HMMER_THREADS
+  if (bld) {
+    fmbuild_Finish(bld);
+    slot = bld->slot[0];  // reused below, to copy the blocks into the output file
+  }
+#endif
+
 
   esl_sqfile_Close(sqfp);
   esl_alphabet_Destroy(abc);
@@ -723,7 +1309,8 @@ main(int argc, char **argv)
 
 
     //write out meta data
-  if( fwrite(&(meta->fwd_only),     sizeof(meta->fwd_only),     1, fp) != 1 ||
+  flags = meta->fwd_only | (meta->aligned ? fm_FLAG_ALIGNED : 0);
+  if( fwrite(&flags,                sizeof(flags),              1, fp) != 1 ||
       fwrite(&(meta->alph_type),    sizeof(meta->alph_type),    1, fp) != 1 ||
       fwrite(&(meta->alph_size),    sizeof(meta->alph_size),    1, fp) != 1 ||
       fwrite(&(meta->charBits),     sizeof(meta->charBits),     1, fp) != 1 ||
@@ -792,15 +1379,15 @@ main(int argc, char **argv)
 
 
     //j==0 test cause T and SA to be written only for forward sequence
-    if(j==0 && fread(fm_data->T, sizeof(uint8_t), compressed_bytes, fptmp) != compressed_bytes)
+    if(j==0 && fread(slot->T, sizeof(uint8_t), compressed_bytes, fptmp) != compressed_bytes)
       esl_fatal( "%s: Error reading T in FM index.\n", argv[0]);
-    if(fread(fm_data->BWT, sizeof(uint8_t), compressed_bytes, fptmp) != compressed_bytes)
+    if(fread(slot->BWT[0], sizeof(uint8_t), compressed_bytes, fptmp) != compressed_bytes)
       esl_fatal( "%s: Error reading BWT in FM index.\n", argv[0]);
-    if(j==0 && fread(SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fptmp) != (size_t)num_SA_samples)
+    if(j==0 && fread(slot->SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fptmp) != (size_t)num_SA_samples)
       esl_fatal( "%s: Error reading SA in FM index.\n", argv[0]);
-    if(fread(fm_data->occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fptmp) != (size_t)num_freq_cnts_b)
+    if(fread(slot->occCnts_b[0], sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fptmp) != (size_t)num_freq_cnts_b)
       esl_fatal( "%s: Error reading occCnts_b in FM index.\n", argv[0]);
-    if(fread(fm_data->occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fptmp) != (size_t)num_freq_cnts_sb)
+    if(fread(slot->occCnts_sb[0], sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fptmp) != (size_t)num_freq_cnts_sb)
       esl_fatal( "%s: Error reading occCnts_sb in FM index.\n", argv[0]);
 
 
@@ -822,15 +1409,25 @@ main(int argc, char **argv)
       esl_fatal( "%s: Error writing ambig_cnt in FM index.\n", argv[0]);
 
 
-    if(j==0 && fwrite(fm_data->T, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
+    if(j==0 && meta->aligned && write_padding(fp) != eslOK)
+      esl_fatal( "%s: Error writing padding in FM index.\n", argv[0]);
+    if(j==0 && fwrite(slot->T, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
       esl_fatal( "%s: Error writing T in FM index.\n", argv[0]);
-    if(fwrite(fm_data->BWT, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
+    if(meta->aligned && write_padding(fp) != eslOK)
+      esl_fatal( "%s: Error writing padding in FM index.\n", argv[0]);
+    if(fwrite(slot->BWT[0], sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
       esl_fatal( "%s: Error writing BWT in FM index.\n", argv[0]);
-    if(j==0 && fwrite(SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
+    if(j==0 && meta->aligned && write_padding(fp) != eslOK)
+      esl_fatal( "%s: Error writing padding in FM index.\n", argv[0]);
+    if(j==0 && fwrite(slot->SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
       esl_fatal( "%s: Error writing SA in FM index.\n", argv[0]);
-    if(fwrite(fm_data->occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fp) != (size_t)num_freq_cnts_b)
+    if(meta->aligned && write_padding(fp) != eslOK)
+      esl_fatal( "%s: Error writing padding in FM index.\n", argv[0]);
+    if(fwrite(slot->occCnts_b[0], sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fp) != (size_t)num_freq_cnts_b)
       esl_fatal( "%s: Error writing occCnts_b in FM index.\n", argv[0]);
-    if(fwrite(fm_data->occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
+    if(meta->aligned && write_padding(fp) != eslOK)
+      esl_fatal( "%s: Error writing padding in FM index.\n", argv[0]);
+    if(fwrite(slot->occCnts_sb[0], sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
       esl_fatal( "%s: Error writing occCnts_sb in FM index.\n", argv[0]);
 
     }
@@ -839,16 +1436,11 @@ main(int argc, char **argv)
   fclose(fp);
   fclose(fptmp);
 
-
-  if (fm_data != NULL)
-    fm_FM_destroy(fm_data, TRUE);
-  free(fm_data);
-  free(SAsamp);
-
-  free(cnts_b);
-  free(cnts_sb);
-
-  free(Tcompressed);
+#ifdef HMMER_THREADS
+  if (bld) { fmbuild_Destroy(bld); slot = NULL; }
+#endif
+  fm_slotDestroy(slot);
+  fm_workspaceDestroy(ws);
 
   fm_metaDestroy(meta);
   esl_getopts_Destroy(go);
@@ -870,12 +1462,11 @@ main(int argc, char **argv)
 ERROR:
   /* Deallocate memory. */
   if (fp)         fclose(fp);
-  if (fm_data)    fm_FM_destroy(fm_data, TRUE);
-  free(fm_data);
-
-  free(SAsamp);
-  free(cnts_b);
-  free(cnts_sb);
+#ifdef HMMER_THREADS
+  if (bld) { fmbuild_Destroy(bld); slot = NULL; }
+#endif
+  fm_slotDestroy(slot);
+  fm_workspaceDestroy(ws);
 
   fm_metaDestroy(meta);
   esl_getopts_Destroy(go);
@@ -233,6 +233,34 @@ p7_ReconfigLength(P7_PROFILE *gm, int L)
   return eslOK;
 }
 
+/* Function:  p7_LengthParams()
+ * Synopsis:  Precalculate target length parameters for optimized profiles.
+ *
+ * Purpose:   Calculate in <lp> the length-dependent N,C,J parameters
+ *            for a mean target length of <L>, for profiles that
+ *            expect to use the J state <nj> times (1 for multihit, 0
+ *            for unihit). These are the values that
+ *            <p7_oprofile_ReconfigLength()> calculates; with them,
+ *            <p7_oprofile_SetMSVLength()> and
+ *            <p7_oprofile_SetRestLength()> configure any number of
+ *            optimized profiles for <L> without recalculating the
+ *            logs. The arithmetic is the same, so the profiles come
+ *            out identical.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_LengthParams(P7_LENPARAM *lp, int L, float nj)
+{
+  lp->L       = L;
+  lp->nj      = nj;
+  lp->msvmove = logf(3.0f / (float) (L+3));
+  lp->pmove   = (2.0f + nj) / ((float) L + 2.0f + nj); /* 2/(L+2) for sw; 3/(L+3) for fs */
+  lp->ploop   = 1.0f - lp->pmove;
+  lp->lpmove  = logf(lp->pmove);
+  return eslOK;
+}
+
 /* Function:  p7_ReconfigMultihit()
  * Synopsis:  Quickly reconfig model into multihit mode for target length <L>.
  *
@@ -12,6 +12,7 @@
 #include <p7_config.h>		
 
 #ifdef HMMER_MPI
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -24,18 +25,6 @@
 
 #include "hmmer.h"
 
-static int p7_hit_MPISend(P7_HIT *hit, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
-static int p7_hit_MPIPackSize(P7_HIT *hit, MPI_Comm comm, int *ret_n);
-static int p7_hit_MPIPack(P7_HIT *hit, char *buf, int n, int *pos, MPI_Comm comm);
-static int p7_hit_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_HIT *hit);
-static int p7_hit_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_HIT *hit);
-
-static int p7_dcl_MPISend(P7_DOMAIN *dcl, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc);
-static int p7_dcl_MPIPackSize(P7_DOMAIN *dcl, MPI_Comm comm, int *ret_n);
-static int p7_dcl_MPIPack(P7_DOMAIN *dcl, char *buf, int n, int *pos, MPI_Comm comm);
-static int p7_dcl_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_DOMAIN *dcl);
-static int p7_dcl_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_DOMAIN *dcl);
-
 /*****************************************************************
  * 1. Communicating P7_HMM, a core model.
  *****************************************************************/
@@ -697,6 +686,7 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;
   if (MPI_Pack_size(1, MPI_UINT64_T, comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;
   if (MPI_Pack_size(1, MPI_DOUBLE,   comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;
+  if (MPI_Pack_size(5, MPI_UINT64_T, comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz; /* ns_msv..ns_dom */
   
   /* Make sure the buffer is allocated appropriately */
   if (*buf == NULL || n > *nalloc) {
@@ -719,6 +709,11 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
       bogus.n_past_vit  = 0;
       bogus.n_past_fwd  = 0;
       bogus.Z           = 0.0;
+      bogus.ns_msv      = 0;
+      bogus.ns_bias     = 0;
+      bogus.ns_vit      = 0;
+      bogus.ns_fwd      = 0;
+      bogus.ns_dom      = 0;
       pli = &bogus;
    } 
 
@@ -735,6 +730,11 @@ p7_pipeline_MPISend(P7_PIPELINE *pli, int dest, int tag, MPI_Comm comm, char **b
   if (MPI_Pack(&pli->n_past_vit,  1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->n_past_fwd,  1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
   if (MPI_Pack(&pli->Z,           1, MPI_DOUBLE,        *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->ns_msv,      1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->ns_bias,     1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->ns_vit,      1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->ns_fwd,      1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+  if (MPI_Pack(&pli->ns_dom,      1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
 
   /* Send the packed pipeline to destination  */
   MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm);
@@ -805,6 +805,11 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_vit),  1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->n_past_fwd),  1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
   if (MPI_Unpack(*buf, n, &pos, &(pli->Z),           1, MPI_DOUBLE,        comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->ns_msv),      1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->ns_bias),     1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->ns_vit),      1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->ns_fwd),      1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
+  if (MPI_Unpack(*buf, n, &pos, &(pli->ns_dom),      1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed"); 
 
   *ret_pli = pli;
   return eslOK;
@@ -830,8 +835,12 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
  *            with MPI tag <tag>, for MPI communicator <comm>, as 
  *            the sole workunit or result. 
  *            
- *            After the TOPHITS <th> information has been sent, send
- *            the each hit as an indepentant message.
+ *            The whole list, hits, domains and alignment displays
+ *            included, goes as one message of raw bytes in the
+ *            <p7_tophits_Serialize()> format that hmmpgmd uses, so
+ *            it's packed with a few <memcpy()>'s rather than an
+ *            <MPI_Pack()> call per field, and byte order is only
+ *            dealt with by the serializers.
  *            
  * Returns:   <eslOK> on success; <*buf> may have been reallocated and
  *            <*nalloc> may have been increased.
@@ -843,103 +852,53 @@ p7_pipeline_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
 int
 p7_tophits_MPISend(P7_TOPHITS *th, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
 {
-  int   status;
-  int   sz, n, pos;
-  int   i, j, inx;
-
-  P7_DOMAIN *dcl = NULL;
-  P7_HIT    *hit = NULL;
-
-  n  = 0;
-  sz = 0;
-
-  /* calculate the buffer size needed to hold the largest hit */
-  hit = th->unsrt;
-  for (i = 0; i < th->N; ++i) {
-    for (j = 0; j < th->unsrt[i].ndom; ++j) {
-      if (sz <= hit->dcl[j].ad->memsize) {
-	sz = hit->dcl[j].ad->memsize;
-	dcl = &hit->dcl[j];
-      }
-    }
-    ++hit;
-  }
-
-  if (th->N > 0) {
-    if ((status = p7_hit_MPIPackSize(th->unsrt, comm, &n)) != eslOK) goto ERROR;
-    if (dcl != NULL) {
-      if ((status = p7_dcl_MPIPackSize(dcl, comm, &sz))    != eslOK) goto ERROR;
-      n = (n > sz) ? n : sz;
-    }
-  }
-
-  if (MPI_Pack_size(3, MPI_UINT64_T, comm, &sz) != 0) ESL_XEXCEPTION(eslESYS, "pack size failed");
-  n = (n > sz) ? n : sz;
-
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n);
-    *nalloc = n; 
-  }
-
-  pos = 0;
-  if (MPI_Pack(&th->N,         1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&th->nreported, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&th->nincluded, 1, MPI_UINT64_T, *buf, n, &pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-
-  /* Send the packed tophits information */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi send failed");
-  if (th->N == 0) return eslOK;
-
-  /* loop through the hit list sending to dest */
-  hit = th->unsrt;
-  for (inx = 0; inx < th->N; ++inx) {
-    if ((status = p7_hit_MPISend(hit, dest, tag, comm, buf, nalloc)) != eslOK) goto ERROR;
-    ++hit;
-  }
-
+  uint8_t *ubuf   = (uint8_t *) *buf;
+  uint32_t n      = 0;
+  uint32_t ualloc = (*buf == NULL) ? 0 : *nalloc;
+  int      status;
+
+  status  = p7_tophits_Serialize(th, &ubuf, &n, &ualloc);
+  *buf    = (char *) ubuf;
+  *nalloc = ualloc;
+  if (status != eslOK) return status;
+  if (n > INT_MAX) ESL_EXCEPTION(eslEMEM, "hit list too big for one MPI message");
+
+  if (MPI_Send(*buf, (int) n, MPI_BYTE, dest, tag, comm) != 0) ESL_EXCEPTION(eslESYS, "mpi send failed");
   return eslOK;
-
- ERROR:
-  return status;
 }
 
 /* Function:  p7_tophits_MPIRecv()
  * Synopsis:  Receives an TOPHITS as a work unit from an MPI sender.
  *
- * Purpose:   Sends the TOPHITS <th> as a work unit to MPI process
- *            <dest> (where <dest> ranges from 0..<nproc-1>), tagged
- *            with MPI tag <tag>, for MPI communicator <comm>, as 
- *            the sole workunit or result. 
+ * Purpose:   Receive a TOPHITS sent by <p7_tophits_MPISend()> from
+ *            MPI process <source> (or <MPI_ANY_SOURCE>), tagged <tag>,
+ *            for MPI communicator <comm>, and return it in a newly
+ *            allocated <*ret_th>.
  *            
- *            After the TOPHITS <th> information has been sent, send
- *            the each hit as an indepentant message.
+ *            <*buf>, <*nalloc> are a working buffer, as for
+ *            <p7_tophits_MPISend()>.
  *            
  * Returns:   <eslOK> on success; <*buf> may have been reallocated and
  *            <*nalloc> may have been increased.
  * 
  * Throws:    <eslESYS> if an MPI call fails; <eslEMEM> if a malloc/realloc
- *            fails. In either case, <*buf> and <*nalloc> remain valid and useful
- *            memory (though the contents of <*buf> are undefined). 
+ *            fails; <eslFAIL> if the message isn't the one expected, or
+ *            doesn't hold a hit list. In any case, <*ret_th> is <NULL>,
+ *            and <*buf> and <*nalloc> remain valid. 
  */
 int
 p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_TOPHITS **ret_th)
 {
   int         n;
   int         status;
-  int         pos;
+  uint32_t    pos   = 0;
   P7_TOPHITS *th    = NULL;
-  P7_HIT     *hit   = NULL;
   MPI_Status  mpistatus;
 
-  uint64_t    nhits;
-  uint64_t    inx;
-
   /* Probe first, because we need to know if our buffer is big enough.
    */
   MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
+  MPI_Get_count(&mpistatus, MPI_BYTE, &n);
 
   /* make sure we are getting the tag we expect and from whom we expect if from */
   if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
@@ -962,21 +921,15 @@ p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
     *nalloc = n; 
   }
 
-  /* Receive the packed top hits */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
+  /* Receive the serialized top hits */
+  MPI_Recv(*buf, n, MPI_BYTE, source, tag, comm, &mpistatus);
 
-  /* Unpack it - watching out for the EOD signal of M = -1. */
-  pos = 0;
   if ((th = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
-  if (MPI_Unpack(*buf, n, &pos, &nhits,         1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
-  if (MPI_Unpack(*buf, n, &pos, &th->nreported, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
-  if (MPI_Unpack(*buf, n, &pos, &th->nincluded, 1, MPI_UINT64_T, comm) != 0) ESL_XEXCEPTION(eslESYS, "unpack failed");
-
-  /* loop through all of the hits sent */
-  for (inx = 0; inx < nhits; ++inx) {
-      if ((status = p7_tophits_CreateNextHit(th, &hit))                  != eslOK) goto ERROR;
-      if ((status = p7_hit_MPIRecv(source, tag, comm, buf, nalloc, hit)) != eslOK) goto ERROR;
-    }
+  status = p7_tophits_Deserialize((uint8_t *) *buf, (uint32_t) n, &pos, th);
+  if      (status == eslEFORMAT)           ESL_XEXCEPTION(eslFAIL, "bad hit list message");
+  else if (status != eslOK)                goto ERROR;
+  if (pos != (uint32_t) n)                 ESL_XEXCEPTION(eslFAIL, "bad hit list message");
+
   *ret_th = th;
   return eslOK;
 
@@ -986,505 +939,73 @@ p7_tophits_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc,
   return status;
 }
 
-
-/* Function:  p7_hit_MPISend()
- */
-int
-p7_hit_MPISend(P7_HIT *hit, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
-{
-  int   inx;
-  int   status;
-  int   pos;
-  int   n = *nalloc;
-
-  /* Pack the HIT into the buffer */
-  pos  = 0;
-  if ((status = p7_hit_MPIPack(hit, *buf, n, &pos, comm)) != eslOK) goto ERROR;
-
-  /* Send the packed HIT to the destination. */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0)  ESL_EXCEPTION(eslESYS, "mpi send failed");
-
-  /* loop through all of the domains */
-  for (inx = 0; inx < hit->ndom; ++inx) {
-    if ((status = p7_dcl_MPISend(hit->dcl + inx, dest, tag, comm, buf, nalloc)) != eslOK) goto ERROR;
-  }
-
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-/* Function:  p7_hit_MPIRecv()
- */
-int
-p7_hit_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_HIT *hit)
-{
-  int         n;
-  int         status;
-  int         pos;
-  int         inx;
-  MPI_Status  mpistatus;
-
-  /* Probe first, because we need to know if our buffer is big enough.
-   */
-  MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
-
-  /* make sure we are getting the tag we expect and from whom we expect if from */
-  if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-  if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-
-  /* set the source and tag */
-  tag = mpistatus.MPI_TAG;
-  source = mpistatus.MPI_SOURCE;
-
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
-    *nalloc = n; 
-  }
-
-  /* Receive the packed top hits */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
-
-  /* Unpack it - watching out for the EOD signal of M = -1. */
-  pos = 0;
-  if ((status = p7_hit_MPIUnpack(*buf, n, &pos, comm, hit)) != eslOK) goto ERROR;
-  ESL_ALLOC(hit->dcl, sizeof(P7_DOMAIN) * hit->ndom);
-
-  /* loop through all of the hits sent */
-  for (inx = 0; inx < hit->ndom; ++inx) {
-     if ((status = p7_dcl_MPIRecv(source, tag, comm, buf, nalloc, hit->dcl + inx)) != eslOK) goto ERROR;
-  }
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-/* Function:  p7_hit_MPIPackSize()
- * Synopsis:  Calculates size needed to pack a HIT.
+/* Function:  p7_tophits_MPIReduce()
+ * Synopsis:  Merge the search results of all ranks, up a tree.
  *
- * Purpose:   Calculate an upper bound on the number of bytes
- *            that <p7_hit_MPIPack()> will need to pack an P7_HIT
- *            <hit> in a packed MPI message for MPI communicator
- *            <comm>; return that number of bytes in <*ret_n>.
+ * Purpose:   Collectively merge each rank's hit list <th> and
+ *            pipeline statistics <pli> toward rank 0, for MPI
+ *            communicator <comm> of <nproc> processes. Every rank
+ *            calls this, with its own <my_rank>.
  *
- * Returns:   <eslOK> on success, and <*ret_n> contains the answer.
+ *            The ranks form a tree with <fanout> children per rank:
+ *            the children of rank <r> are <r*fanout+1>..<r*fanout+fanout>.
+ *            Each rank takes its children's results in whatever order
+ *            they finish, merges them into <th> and <pli>, then (unless
+ *            it's rank 0) sends the merged results to its parent, as
+ *            <p7_tophits_MPISend()> and <p7_pipeline_MPISend()>
+ *            messages tagged <th_tag> and <pli_tag>. Rank 0 ends up
+ *            holding the results of all ranks, having merged only
+ *            <fanout> lists rather than <nproc-1>.
  *
- * Throws:    <eslESYS> if an MPI call fails, and <*ret_n> is 0.
- */
-int
-p7_hit_MPIPackSize(P7_HIT *hit, MPI_Comm comm, int *ret_n)
-{
-  int   status;
-  int   n = 0;
-  int   sz;
-
-  /* P7_HIT data */
-  if (MPI_Pack_size(1,            MPI_INT,      comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // window_length
-  if (MPI_Pack_size(1,            MPI_DOUBLE,   comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // sortkey
-  if (MPI_Pack_size(3,            MPI_FLOAT,    comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // scores
-  if (MPI_Pack_size(3,            MPI_DOUBLE,   comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // lnP
-  if (MPI_Pack_size(1,            MPI_FLOAT,    comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // expected
-  if (MPI_Pack_size(5,            MPI_INT,      comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // region, envelopes, ndom
-  if (MPI_Pack_size(3,            MPI_INT,      comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // report info
-  if (MPI_Pack_size(1,            MPI_UINT32_T, comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // flags
-  if (MPI_Pack_size(2,            MPI_INT64_T,  comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // seqidx, subseq_start
-  if ((status = esl_mpi_PackOptSize(hit->name, -1, MPI_CHAR, comm, &sz)) != eslOK) goto ERROR; else n += sz;
-  if ((status = esl_mpi_PackOptSize(hit->acc,  -1, MPI_CHAR, comm, &sz)) != eslOK) goto ERROR; else n += sz; 
-  if ((status = esl_mpi_PackOptSize(hit->desc, -1, MPI_CHAR, comm, &sz)) != eslOK) goto ERROR; else n += sz; 
-
-  *ret_n = n;
-  return eslOK;
-
- ERROR:
-  *ret_n = 0;
-  return status;
-
-}
-
-/* Function:  p7_hit_MPIPack()
- * Synopsis:  Packs the HIT into MPI buffer.
+ *            <go> is the application configuration, needed to create
+ *            the received pipelines. <*buf>, <*nalloc> are a buffer
+ *            as for the other send/receive functions.
  *
- * Purpose:   Packs HIT <hit> into an MPI packed message buffer <buf>
- *            of length <n> bytes, starting at byte position <*position>,
- *            for MPI communicator <comm>.
- *            
- *            The caller must know that <buf>'s allocation of <n>
- *            bytes is large enough to append the packed HIT at
- *            position <*pos>. This typically requires a call to
- *            <p7_hit_MPIPackSize()> first, and reallocation if
- *            needed.
- *            
- * Returns:   <eslOK> on success; <buf> now contains the
- *            packed <hit>, and <*position> is set to the byte
- *            immediately following the last byte of the HIT
- *            in <buf>. 
- *
- * Throws:    <eslESYS> if an MPI call fails; or <eslEMEM> if the
- *            buffer's length <n> was overflowed in trying to pack
- *            <msa> into <buf>. In either case, the state of
- *            <buf> and <*position> is undefined, and both should
- *            be considered to be corrupted.
- */
-int
-p7_hit_MPIPack(P7_HIT *hit, char *buf, int n, int *pos, MPI_Comm comm)
-{
-  int             status;
-  if (MPI_Pack(&hit->window_length,       1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->sortkey,        1, MPI_DOUBLE,   buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->score,          1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->pre_score,      1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->sum_score,      1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->lnP,            1, MPI_DOUBLE,   buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->pre_lnP,        1, MPI_DOUBLE,   buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->sum_lnP,        1, MPI_DOUBLE,   buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->nexpected,      1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&hit->nregions,       1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->nclustered,     1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->noverlaps,      1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->nenvelopes,     1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->ndom,           1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->flags,          1, MPI_UINT32_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->nreported,      1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->nincluded,      1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->best_domain,    1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->seqidx,      1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&hit->subseq_start,    1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-
-  if ((status = esl_mpi_PackOpt(hit->name,        -1,      MPI_CHAR,  buf, n, pos, comm)) != eslOK) return status;
-  if ((status = esl_mpi_PackOpt(hit->acc,         -1,      MPI_CHAR,  buf, n, pos, comm)) != eslOK) return status; 
-  if ((status = esl_mpi_PackOpt(hit->desc,        -1,      MPI_CHAR,  buf, n, pos, comm)) != eslOK) return status; 
-
-  if (*pos > n) ESL_EXCEPTION(eslEMEM, "buffer overflow");
-  return eslOK;
-  
- ERROR:
-  return status;
-}
-
-/* Function:  p7_hit_MPIUnpack()
- * Synopsis:  Unpacks an HIT from an MPI buffer.
+ * Returns:   <eslOK> on success; <*buf> may have been reallocated and
+ *            <*nalloc> may have been increased.
  *
- * Purpose:   Unpack a newly allocated HIT from MPI packed buffer
- *            <buf>, starting from position <*pos>, where the total length
- *            of the buffer in bytes is <n>. 
- *            
- * Returns:   <eslOK> on success. <*pos> is updated to the position of
- *            the next element in <buf> to unpack (if any). <*ret_hit>
- *            contains a newly allocated HIT, which the caller is
- *            responsible for free'ing.
- *            
- * Throws:    <eslESYS> on an MPI call failure. <eslEMEM> on allocation failure.
- *            In either case, <*ret_hit> is <NULL>, and the state of <buf>
- *            and <*pos> is undefined and should be considered to be corrupted.
- */
-int
-p7_hit_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_HIT *hit)
-{
-  int  status;
-
-  if (MPI_Unpack(buf, n, pos, &hit->window_length,   1, MPI_INT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->sortkey,     1, MPI_DOUBLE, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->score,       1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->pre_score,   1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->sum_score,   1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->lnP,         1, MPI_DOUBLE, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->pre_lnP,     1, MPI_DOUBLE, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->sum_lnP,     1, MPI_DOUBLE, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->nexpected,   1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-  if (MPI_Unpack(buf, n, pos, &hit->nregions,    1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->nclustered,  1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->noverlaps,   1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->nenvelopes,  1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->ndom,        1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->flags,       1, MPI_UINT32_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->nreported,   1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->nincluded,   1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->best_domain, 1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->seqidx,   1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hit->subseq_start, 1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  hit->offset = 0; // This field is only used when packing search results for transmission over sockets (not MPI)
-  // and its value isn't guaranteed to be the same on different machines, so just set it to 0
-
-  if ((status = esl_mpi_UnpackOpt(buf, n, pos,   (void**)&(hit->name),        NULL, MPI_CHAR,  comm)) != eslOK) goto ERROR;
-  if ((status = esl_mpi_UnpackOpt(buf, n, pos,   (void**)&(hit->acc),         NULL, MPI_CHAR,  comm)) != eslOK) goto ERROR;
-  if ((status = esl_mpi_UnpackOpt(buf, n, pos,   (void**)&(hit->desc),        NULL, MPI_CHAR,  comm)) != eslOK) goto ERROR;
-
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-/* Function:  p7_dcl_MPISend()
- */
-int
-p7_dcl_MPISend(P7_DOMAIN *dcl, int dest, int tag, MPI_Comm comm, char **buf, int *nalloc)
-{
-  int   status;
-  int   pos;
-  int   n = *nalloc;
-
-  /* Pack the DOMAIN into the buffer */
-  pos  = 0;
-  if ((status = p7_dcl_MPIPack(dcl, *buf, n, &pos, comm)) != eslOK) goto ERROR;
-
-  /* Send the packed HIT to the destination. */
-  if (MPI_Send(*buf, n, MPI_PACKED, dest, tag, comm) != 0)  ESL_EXCEPTION(eslESYS, "mpi send failed");
-
-  return eslOK;
-
- ERROR:
-  return status;
-}
-
-
-/* Function:  p7_dcl_MPIPackSize()
+ * Throws:    <eslESYS> if an MPI call fails; <eslEMEM> if a malloc/realloc
+ *            fails; <eslFAIL> on an unexpected message.
  */
 int
-p7_dcl_MPIPackSize(P7_DOMAIN *dcl, MPI_Comm comm, int *ret_n)
+p7_tophits_MPIReduce(P7_TOPHITS *th, P7_PIPELINE *pli, int my_rank, int nproc, int fanout,
+		     int th_tag, int pli_tag, MPI_Comm comm, ESL_GETOPTS *go, char **buf, int *nalloc)
 {
-  int   status;
-  int   n = 0;
-  int   sz;
-
-  P7_ALIDISPLAY *ad = dcl->ad;
-
-  /* P7_DOMAIN data */
-  if (MPI_Pack_size(6,            MPI_INT64_T, comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // alignment info
-  if (MPI_Pack_size(5,            MPI_FLOAT,   comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // score info
-  if (MPI_Pack_size(1,            MPI_DOUBLE,  comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // lnP
-  if (MPI_Pack_size(2,            MPI_INT,     comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // thresholds
-  if(dcl->scores_per_pos != NULL){p7_Fail("Non-NULL scores_per_pos field found int p7_dcl_MPIPackSize.  Sending the scores_per_pos field via MPI has not been implemented\n");}
-
-  /* P7_ALIDISPLAY data */
-  if (MPI_Pack_size(18,          MPI_INT,     comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // offset info
-  if (MPI_Pack_size(3,           MPI_INT64_T, comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // sequence info
-  if (MPI_Pack_size(1,           MPI_INT,     comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // string pool size
-  if (MPI_Pack_size(ad->memsize, MPI_CHAR,    comm, &sz) != 0) { ESL_XEXCEPTION(eslESYS, "pack size failed"); } n += sz;  // string pool  
-
-  *ret_n = n;
-  return eslOK;
-
- ERROR:
-  *ret_n = 0;
-  return status;
+  P7_TOPHITS  *kid_th  = NULL;
+  P7_PIPELINE *kid_pli = NULL;
+  int          first   = my_rank * fanout + 1;
+  int          nkids   = ESL_MAX(0, ESL_MIN(fanout, nproc - first));
+  int          source;
+  int          i;
+  int          status;
+  MPI_Status   mpistatus;
 
-}
+  for (i = 0; i < nkids; i++)
+    {
+      /* only our children send us <th_tag> messages; take the first one done */
+      if (MPI_Probe(MPI_ANY_SOURCE, th_tag, comm, &mpistatus) != 0) ESL_XEXCEPTION(eslESYS, "mpi probe failed");
+      source = mpistatus.MPI_SOURCE;
 
-/* Function:  p7_dcl_MPIPack()
- */
-int
-p7_dcl_MPIPack(P7_DOMAIN *dcl, char *buf, int n, int *pos, MPI_Comm comm)
-{
-  int             status;
-  int             offset;
+      if ((status = p7_tophits_MPIRecv (source, th_tag,  comm, buf, nalloc,     &kid_th))  != eslOK) goto ERROR;
+      if ((status = p7_pipeline_MPIRecv(source, pli_tag, comm, buf, nalloc, go, &kid_pli)) != eslOK) goto ERROR;
 
-  P7_ALIDISPLAY  *ad       = dcl->ad;
-  
-  if (MPI_Pack(&dcl->ienv,           1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->jenv,           1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->iali,           1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->jali,           1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->iorf,           1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->jorf,           1, MPI_INT64_T,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
-  if (MPI_Pack(&dcl->envsc,          1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->domcorrection,  1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->dombias,        1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->oasc,           1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->bitscore,       1, MPI_FLOAT,    buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->lnP,            1, MPI_DOUBLE,   buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->is_reported,    1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&dcl->is_included,    1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if(dcl->scores_per_pos != NULL){p7_Fail("Non-NULL scores_per_pos field found int p7_dcl_MPIPack.  Sending the scores_per_pos field via MPI has not been implemented\n");}
-
-  offset = (ad->rfline  == NULL)  ? -1 : ad->rfline - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->mmline  == NULL)  ? -1 : ad->mmline - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->csline  == NULL)  ? -1 : ad->csline - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->model   == NULL)  ? -1 : ad->model - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->mline   == NULL)  ? -1 : ad->mline - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->aseq    == NULL)     ? -1 : ad->aseq - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->ntseq    == NULL)     ? -1 : ad->ntseq - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->ppline  == NULL)  ? -1 : ad->ppline - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->N,               1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->hmmname == NULL)  ? -1 : ad->hmmname - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->hmmacc  == NULL)  ? -1 : ad->hmmacc - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->hmmdesc == NULL)  ? -1 : ad->hmmdesc - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->hmmfrom,         1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->hmmto,           1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->M,               1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->sqname  == NULL)  ? -1 : ad->sqname - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->sqacc   == NULL)  ? -1 : ad->sqacc - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  offset = (ad->sqdesc  == NULL)  ? -1 : ad->sqdesc - ad->mem;
-  if (MPI_Pack(&offset,              1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->sqfrom,          1, MPI_INT64_T,     buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->sqto,            1, MPI_INT64_T,     buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->L,               1, MPI_INT64_T,     buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack(&ad->memsize,         1, MPI_INT,      buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed");
-  if (MPI_Pack( ad->mem,   ad->memsize, MPI_CHAR,     buf, n, pos, comm) != 0) ESL_XEXCEPTION(eslESYS, "pack failed"); 
+      if ((status = p7_tophits_Merge(th, kid_th)) != eslOK) goto ERROR;
+      p7_pipeline_Merge(pli, kid_pli);
 
-  if (*pos > n) ESL_EXCEPTION(eslEMEM, "buffer overflow");
-  return eslOK;
-  
- ERROR:
-  return status;
-}
-
-/* Function:  p7_dcl_MPIUnpack()
- */
-int
-p7_dcl_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, P7_DOMAIN *dcl)
-{
-  int  status;
-  int  rfline, mmline, csline, model, mline, aseq, ntseq, ppline;
-  int  hmmname, hmmacc, hmmdesc;
-  int  sqname, sqacc, sqdesc;
-
-  P7_ALIDISPLAY *ad; 
-
-  ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
-
-  if (MPI_Unpack(buf, n, pos, &dcl->ienv,          1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->jenv,          1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->iali,          1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->jali,          1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->iorf,          1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->jorf,          1, MPI_INT64_T,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->envsc,         1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->domcorrection, 1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->dombias,       1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->oasc,          1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->bitscore,      1, MPI_FLOAT,  comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->lnP,           1, MPI_DOUBLE, comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->is_reported,   1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &dcl->is_included,   1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  dcl->scores_per_pos =NULL;  // we don't support sending this field over MPI, so init to NULL to avoid problems from stale memory
-
-  if (MPI_Unpack(buf, n, pos, &rfline,             1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &mmline,             1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &csline,             1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &model,              1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &mline,              1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &aseq,               1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ntseq,               1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ppline,             1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->N,              1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hmmname,            1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hmmacc,             1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &hmmdesc,            1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->hmmfrom,        1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->hmmto,          1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->M,              1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &sqname,             1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &sqacc,              1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &sqdesc,             1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->sqfrom,         1, MPI_INT64_T,   comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->sqto,           1, MPI_INT64_T,   comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->L,              1, MPI_INT64_T,   comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-  if (MPI_Unpack(buf, n, pos, &ad->memsize,        1, MPI_INT,    comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed");
-
-  dcl->scores_per_pos = NULL;  /*this field is used for nhmmer, which currently doesn't have MPI support */
-
-  /* allocate the string pools for the alignments */
-  ESL_ALLOC(ad->mem, ad->memsize);
-  if (MPI_Unpack(buf, n, pos,  ad->mem,  ad->memsize, MPI_CHAR,   comm) != 0) ESL_XEXCEPTION(eslESYS, "mpi unpack failed"); 
-
-  ad->rfline  = (rfline == -1)  ? NULL : ad->mem + rfline;
-  ad->mmline  = (mmline == -1)  ? NULL : ad->mem + mmline;
-  ad->csline  = (csline == -1)  ? NULL : ad->mem + csline;
-  ad->model   = (model == -1)   ? NULL : ad->mem + model;
-  ad->mline   = (mline == -1)   ? NULL : ad->mem + mline;
-  ad->aseq    = (aseq == -1)    ? NULL : ad->mem + aseq;  
-  ad->ntseq    = (ntseq == -1)    ? NULL : ad->mem + ntseq;
-  ad->ppline  = (ppline == -1)  ? NULL : ad->mem + ppline;
-
-  ad->hmmname = (hmmname == -1) ? NULL : ad->mem + hmmname;
-  ad->hmmacc  = (hmmacc == -1)  ? NULL : ad->mem + hmmacc;
-  ad->hmmdesc = (hmmdesc == -1) ? NULL : ad->mem + hmmdesc;
-
-  ad->sqname  = (sqname == -1)  ? NULL : ad->mem + sqname;
-  ad->sqacc   = (sqacc == -1)   ? NULL : ad->mem + sqacc;
-  ad->sqdesc  = (sqdesc == -1)  ? NULL : ad->mem + sqdesc;
-
-  dcl->ad = ad;
+      p7_tophits_Destroy(kid_th);   kid_th  = NULL;
+      p7_pipeline_Destroy(kid_pli); kid_pli = NULL;
+    }
 
+  if (my_rank > 0)
+    {
+      if ((status = p7_tophits_MPISend (th,  (my_rank-1) / fanout, th_tag,  comm, buf, nalloc)) != eslOK) goto ERROR;
+      if ((status = p7_pipeline_MPISend(pli, (my_rank-1) / fanout, pli_tag, comm, buf, nalloc)) != eslOK) goto ERROR;
+    }
   return eslOK;
 
  ERROR:
-  if (ad  != NULL) {
-    if (ad->mem != NULL) free(ad->mem);
-    free(ad);
-  }
-  return status;
-}
-
-/* Function:  p7_dcl_MPIRecv()
- */
-int
-p7_dcl_MPIRecv(int source, int tag, MPI_Comm comm, char **buf, int *nalloc, P7_DOMAIN *dcl)
-{
-  int         status;
-  int         n;
-  int         pos;
-  MPI_Status  mpistatus;
-
-  /* Probe first, because we need to know if our buffer is big enough.
-   */
-  MPI_Probe(source, tag, comm, &mpistatus);
-  MPI_Get_count(&mpistatus, MPI_PACKED, &n);
-
-  /* make sure we are getting the tag we expect and from whom we expect if from */
-  if (tag    != MPI_ANY_TAG    && mpistatus.MPI_TAG    != tag) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-  if (source != MPI_ANY_SOURCE && mpistatus.MPI_SOURCE != source) {
-    status = eslFAIL;
-    goto ERROR;
-  }
-
-  /* set the source and tag */
-  tag = mpistatus.MPI_TAG;
-  source = mpistatus.MPI_SOURCE;
-
-  /* Make sure the buffer is allocated appropriately */
-  if (*buf == NULL || n > *nalloc) {
-    void *tmp;
-    ESL_RALLOC(*buf, tmp, sizeof(char) * n); 
-    *nalloc = n; 
-  }
-
-  /* Receive the packed dcl */
-  MPI_Recv(*buf, n, MPI_PACKED, source, tag, comm, &mpistatus);
-
-  /* Unpack it, looking at the status code prefix for EOD/EOK  */
-  pos = 0;
-  return p7_dcl_MPIUnpack(*buf, *nalloc, &pos, comm, dcl);
-
- ERROR:
+  if (kid_th)  p7_tophits_Destroy(kid_th);
+  if (kid_pli) p7_pipeline_Destroy(kid_pli);
   return status;
 }
 
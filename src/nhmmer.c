@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -21,6 +22,7 @@
 
 #ifdef HMMER_THREADS
 #include <unistd.h>
+#include <pthread.h>
 #include "esl_threads.h"
 #include "esl_workqueue.h"
 #endif /*HMMER_THREADS*/
@@ -30,9 +32,34 @@
 /* set the max residue count to 1/4 meg when reading a block */
 #define NHMMER_MAX_RESIDUE_COUNT (1024 * 256)  /* 1/4 Mb */
 
+#ifdef HMMER_THREADS
+/* Without --block_length, the threaded reader adapts the block length
+ * as it goes (see blocktune_Next()); by the file size and window
+ * overlap alone, so it's reproducible, and with --block_tune also by
+ * the workers' measured speed.
+ */
+#define NHMMER_BLOCK_MIN          50000               /* as --block_length allows                       */
+#define NHMMER_BLOCK_MAX          (1024 * 1024 * 16)
+#define NHMMER_BLOCKS_PER_THREAD  16                  /* aim: this many blocks per worker of what's left */
+#define NHMMER_BLOCK_MINSECS      0.05                /* ... but no block quicker than this to search,  */
+#define NHMMER_BLOCK_MAXSECS      2.0                 /*     or slower than this                        */
+#define NHMMER_OVERLAP_MAX        0.05                /* and window overlap no more than this fraction  */
+
 typedef struct {
+  pthread_mutex_t  mutex;        /* guards <rate>, which the workers update */
+  int              nworkers;
+  int              do_timing;    /* TRUE with --block_tune: also keep blocks within MINSECS..MAXSECS of measured speed */
+  double           total;        /* size of the target file in bytes; 0 if unknown (stdin, gzip, --restrictdb*) */
+  double           rate;         /* smoothed residues searched per second by one worker; 0 until measured */
+  double           overlap;      /* smoothed fraction of the residues read that are window overlap; -1 until measured */
+} BLOCK_TUNER;
+#endif /*HMMER_THREADS*/
+
+typedef struct worker_s {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  P7_CPUBIND       *cpubind;     /* --cpubind, --readercpu; or NULL         */
+  BLOCK_TUNER      *tune;        /* adapts the reader's block length; NULL with --block_length, or an FM-index */
 #endif /*HMMER_THREADS*/
   P7_BG            *bg;          /* null model                              */
   P7_PIPELINE      *pli;         /* work pipeline                           */
@@ -40,6 +67,7 @@ typedef struct {
   P7_OPROFILE      *om;          /* optimized query profile                 */
   FM_CFG           *fm_cfg;      /* global data for FM-index for fast SSV */
   P7_SCOREDATA     *scoredata;   /* hmm-specific data used by nhmmer */
+  struct worker_s  *qnext;       /* same worker, next query of an FM-index batch (--qbatch); NULL if none */
 } WORKER_INFO;
 
 typedef struct {
@@ -48,6 +76,15 @@ typedef struct {
   int      active;  //TRUE is worker is supposed to work on the contents, FALSE otherwise
 } FM_THREAD_INFO;
 
+/* one query of a batch (--qbatch), held from its setup until its results are output */
+typedef struct {
+  P7_HMM           *hmm;
+  P7_PROFILE       *gm;
+  P7_OPROFILE      *om;
+  P7_SCOREDATA     *scoredata;
+  FM_CFG            fm_cfg;      /* copy of the FM-index config, with this query's seed threshold */
+} QUERY_INFO;
+
 
 typedef struct {
   int    id;         /* internal sequence ID  */
@@ -113,6 +150,9 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,       "3e-3",      NULL, NULL,    NULL,  NULL, "--max",          "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,       "3e-5",      NULL, NULL,    NULL,  NULL, "--max",          "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,         NULL,      NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                             7 },
+  { "--dd_ramlimit", eslARG_INT,         "0",       NULL, "n>=0",  NULL,  NULL, NULL,             "cap full envelope DP matrices at <n> MB (0: no cap)",          7 },
+  { "--dd_nbatch",  eslARG_INT,          "0",       NULL, "n>=0",  NULL,  NULL, NULL,             "sample domain traces in batches of <n>, stopping early",       7 },
+  { "--dd_bf16",    eslARG_NONE,         FALSE,     NULL, NULL,    NULL,  NULL, NULL,             "keep envelope DP matrices in bfloat16 (half the memory)",      7 },
 
   /* Selecting the alphabet rather than autoguessing it */
   { "--dna",        eslARG_NONE,        FALSE, NULL, NULL,   NULL,  NULL,  "--rna",       "input alignment is DNA sequence data",                         8 },
@@ -128,6 +168,9 @@ static ESL_OPTIONS options[] = {
   { "--seed_req_pos",      eslARG_INT,           "5", NULL, NULL,    NULL,  NULL, NULL,          "minimum number consecutive positive scores in seed" ,        9 },
   { "--seed_consens_match", eslARG_INT,         "11", NULL, NULL,    NULL,  NULL, NULL,          "<n> consecutive matches to consensus will override score threshold" , 9 },
   { "--seed_ssv_length",   eslARG_INT,         "100", NULL, NULL,    NULL,  NULL, NULL,          "length of window around FM seed to get full SSV diagonal",   9 },
+  { "--qbatch",            eslARG_INT,           "1", NULL, "n>0",   NULL,  NULL, NULL,          "search <n> queries per pass over the FM-index blocks",       9 },
+  { "--fm_interleave",     eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL, NULL,          "hold FM-index blocks in an interleaved, cache-friendlier layout", 9 },
+  { "--seed_kmer",         eslARG_INT,           "8", NULL, "n>=0",  NULL,  NULL, NULL,          "look up seed intervals of strings up to length <n> in a table",  9 },
 #endif
 
 /* Other options */
@@ -137,9 +180,14 @@ static ESL_OPTIONS options[] = {
   { "--nonull2",    eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,           NULL,     "turn off biased composition score corrections",                 12 },
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",   NULL,  NULL,           NULL,     "set database size (Megabases) to <x> for E-value calculations", 12 },
   { "--seed",       eslARG_INT,          "42", NULL, "n>=0",  NULL,  NULL,           NULL,     "set RNG seed to <n> (if 0: one-time arbitrary seed)",           12 },
+  { "--timing",     eslARG_NONE,         FALSE, NULL, NULL,   NULL,  NULL,           NULL,     "report time spent in each stage of the pipeline",               12 },
+  { "--memstats",   eslARG_NONE,         FALSE, NULL, NULL,   NULL,  NULL,           NULL,     "report memory high-water marks of the pipeline",                12 },
+  { "--membudget",  eslARG_INT,          NULL, NULL, "n>0",   NULL,  NULL,           NULL,     "keep each pipeline under <n> MB of DP memory",                  12 },
+  { "--hugepages",  eslARG_STRING,       NULL, NULL, NULL,    NULL,  NULL,           NULL,     "put big buffers in hugepages: <s> = off|thp|2M|1G",             12 },
   { "--w_beta",     eslARG_REAL,         NULL, NULL, NULL,    NULL,  NULL,           NULL,     "tail mass at which window length is determined",                12 },
   { "--w_length",   eslARG_INT,          NULL, NULL, NULL,    NULL,  NULL,           NULL,     "window length - essentially max expected hit length" ,          12 },
-  { "--block_length", eslARG_INT,        NULL, NULL, "n>=50000", NULL, NULL,         NULL,     "length of blocks read from target database (threaded) ",        12 },
+  { "--block_length", eslARG_INT,        NULL, NULL, "n>=50000", NULL, NULL,         NULL,     "length of blocks read from target database (threaded; default: adapted)", 12 },
+  { "--block_tune", eslARG_NONE,         FALSE, NULL, NULL,   NULL,  NULL, "--block_length", "also adapt block length to measured search speed (threaded)",   12 },
   { "--watson",     eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,       "--crick",    "only search the top strand",                                    12 },
   { "--crick",      eslARG_NONE,         NULL, NULL, NULL,    NULL,  NULL,       "--watson",   "only search the bottom strand",                                 12 },
 
@@ -176,6 +224,11 @@ static ESL_OPTIONS options[] = {
 
 #ifdef HMMER_THREADS 
   { "--cpu",        eslARG_INT, p7_NCPU,"HMMER_NCPU","n>=0",NULL,  NULL,  CPUOPTS,         "number of parallel CPU workers to use for multithreads",      12 },
+  { "--cpubind",    eslARG_STRING, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "pin workers to cpus: 'cores', 'sockets', or a list <s> (0-7,16)", 12 },
+  { "--readercpu",  eslARG_INT,    NULL, NULL, "n>=0",  NULL,  NULL,  NULL,            "reserve cpu <n> for the reader and output threads",           12 },
+  { "--seed_cpu",   eslARG_INT,    NULL, NULL,      "n>=0",NULL,  NULL,  NULL,            "threads per FM-index block in the seed search [default: spare --cpu]", 12 },
+  { "--nblocks",    eslARG_INT,     "2", NULL,      "n>0", NULL,  NULL,  NULL,            "number of target blocks queued per worker thread",            12 },
+  { "--readahead",  eslARG_INT,     "0", NULL,      "n>=0",NULL,  NULL,  NULL,            "keep <n> MB of <seqdb> read ahead of the parser (0: off)",    12 },
 #endif
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -212,8 +265,13 @@ static int  serial_loop    (WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, E
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, char *firstseq_key, int n_targetseqs);
+static int  thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_READAHEAD *ra, char *firstseq_key, int n_targetseqs);
 static void pipeline_thread(void *arg);
+static BLOCK_TUNER *blocktune_Create(int nworkers, double total, int do_timing);
+static int          blocktune_Start(BLOCK_TUNER *t);
+static void         blocktune_Report(BLOCK_TUNER *t, const ESL_SQ_BLOCK *block, double secs);
+static int          blocktune_Next(BLOCK_TUNER *t, const ESL_SQ_BLOCK *block, int blen, double done);
+static void         blocktune_Destroy(BLOCK_TUNER *t);
 #if defined (eslENABLE_SSE)
 static int  thread_loop_FM(WORKER_INFO *info, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp);
 static void pipeline_thread_FM(void *arg);
@@ -281,6 +339,9 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_quer
   if (strcmp(*ret_queryfile, "-") == 0 && strcmp(*ret_seqfile, "-") == 0)
     { if (puts("Either <query hmmfile|alignfile> or <seqdb> may be '-' (to read from stdin), but not both.") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
 
+  if (esl_opt_IsOn(go, "--hugepages") && p7_hugemem_SetMode(esl_opt_GetString(go, "--hugepages")) != eslOK)
+    { if (printf("--hugepages takes off, thp, 2M or 1G, not %s\n", esl_opt_GetString(go, "--hugepages")) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+
   *ret_go = go;
   return eslOK;
   
@@ -332,6 +393,9 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *queryfile, char *seqfile,
   if (esl_opt_IsUsed(go, "--F2")         && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")         && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")     && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_ramlimit") && fprintf(ofp, "# domain definition RAM limit:     %d MB\n", esl_opt_GetInteger(go, "--dd_ramlimit"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_nbatch")  && fprintf(ofp, "# domain trace sample batch size:  %d\n", esl_opt_GetInteger(go, "--dd_nbatch"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_bf16")    && fprintf(ofp, "# bfloat16 envelope matrices:      on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--B1")         && fprintf(ofp, "# biased comp SSV window len:      %d\n",             esl_opt_GetInteger(go, "--B1"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--B2")         && fprintf(ofp, "# biased comp Viterbi window len:  %d\n",             esl_opt_GetInteger(go, "--B2"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -350,6 +414,9 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *queryfile, char *seqfile,
   if (esl_opt_IsUsed(go, "--seed_req_pos")      && fprintf(ofp, "# FM req positive run length:      %d\n",             esl_opt_GetInteger(go, "--seed_req_pos"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed_consens_match") && fprintf(ofp, "# FM consec consensus match req:   %d\n",             esl_opt_GetInteger(go, "--seed_consens_match"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed_ssv_length")   && fprintf(ofp, "# FM len used for Vit window:      %d\n",             esl_opt_GetInteger(go, "--seed_ssv_length"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--qbatch")            && fprintf(ofp, "# FM queries per block pass:       %d\n",             esl_opt_GetInteger(go, "--qbatch"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--fm_interleave")     && fprintf(ofp, "# FM block layout:                 interleaved\n")                                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_kmer")         && fprintf(ofp, "# FM seed k-mer table length:      %d\n",             esl_opt_GetInteger(go, "--seed_kmer"))         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") && fprintf(ofp, "# Restrict db to start at seq key: %s\n",            esl_opt_GetString(go, "--restrictdb_stkey"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_n")     && fprintf(ofp, "# Restrict db to # target seqs:    %d\n",            esl_opt_GetInteger(go, "--restrictdb_n")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -365,15 +432,22 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *queryfile, char *seqfile,
     if (esl_opt_GetInteger(go, "--seed") == 0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if                              (  fprintf(ofp, "# random number seed set to:       %d\n",             esl_opt_GetInteger(go, "--seed"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
+  if (esl_opt_IsUsed(go, "--timing")     && fprintf(ofp, "# pipeline stage timing:           on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--memstats")   && fprintf(ofp, "# pipeline memory statistics:      on\n")                                                    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--membudget")  && fprintf(ofp, "# pipeline memory budget:          %d MB\n", esl_opt_GetInteger(go, "--membudget"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hugepages")  && fprintf(ofp, "# hugepages for big buffers:       %s\n", esl_opt_GetString(go, "--hugepages"))              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--qformat")    && fprintf(ofp, "# query format asserted:           %s\n",              esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--qsingle_seqs")&& fprintf(ofp,"# query contains individual seqs:  on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tformat")    && fprintf(ofp, "# target format asserted:          %s\n",            esl_opt_GetString(go, "--tformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--w_beta")     && fprintf(ofp, "# window length beta value:        %g\n",             esl_opt_GetReal(go, "--w_beta"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--w_length")   && fprintf(ofp, "# window length :                  %d\n",             esl_opt_GetInteger(go, "--w_length")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--block_length")&&fprintf(ofp, "# block length :                   %d\n",             esl_opt_GetInteger(go, "--block_length")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--block_tune") && fprintf(ofp, "# block length by search speed:    on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   //if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:        %d\n",             esl_opt_GetInteger(go, "--cpu"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (fprintf(ofp, "# number of worker threads:        %d\n",             ncpus)      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cpubind")    && fprintf(ofp, "# worker threads pinned to:        %s\n",             esl_opt_GetString(go, "--cpubind"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--readercpu")  && fprintf(ofp, "# reader threads pinned to cpu:    %d\n",             esl_opt_GetInteger(go, "--readercpu")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
   if (fprintf(ofp, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   return eslOK;
@@ -545,7 +619,12 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              ncpus    = 0;
 
   int              infocnt  = 0;
-  WORKER_INFO     *info     = NULL;
+  WORKER_INFO     *infoset  = NULL;            /* [0..qbatch*infocnt-1]: row <q> holds the workers of query <q> in a batch */
+  WORKER_INFO     *info     = NULL;            /* current row of <infoset>    */
+  P7_TOPHITS     **thl      = NULL;            /* [0..infocnt-2]: hit lists of workers 1.., for merging */
+  QUERY_INFO      *batch    = NULL;            /* [0..qbatch-1]: the queries of a batch */
+  int              qbatch   = 1;               /* max # of queries per batch; >1 only for an FM-index */
+  int              nb, q;
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
 #ifdef eslENABLE_SSE
@@ -553,6 +632,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif // eslENABLE_SSE
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  P7_CPUBIND      *cpubind  = NULL;
+  P7_READAHEAD    *ra       = NULL;    /* readahead of <dbfp> (--readahead), or NULL */
+  BLOCK_TUNER     *tune     = NULL;    /* adaptive block length, unless --block_length */
+  struct stat      st;
 #endif // HMMER_THREADS
   char   errbuf[eslERRBUFSIZE];
   double window_beta = -1.0 ;
@@ -772,12 +855,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
     if ( (status = fm_configInit(fm_cfg, go)) != eslOK)
       p7_Fail("Failed to initialize FM configuration for target sequence database %s\n",      cfg->dbfile);
+    fm_meta->interleave = esl_opt_GetBoolean(go, "--fm_interleave");
 
     if ( (status = fm_alphabetCreate(fm_meta, NULL)) != eslOK)
       p7_Fail("Failed to create FM alphabet for target sequence database %s\n",      cfg->dbfile);
 
     fgetpos( fm_meta->fp, &fm_basepos);
 
+    /* search the blocks in place from a shared read-only mapping when we can; fread() otherwise */
+    fm_mapFMfile(fm_meta);
+
     dbformat = eslSQFILE_FMINDEX;
   }
 
@@ -801,6 +888,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   /* initialize thread data */
   ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (esl_opt_IsOn(go, "--cpubind") || esl_opt_IsOn(go, "--readercpu"))
+    {
+      status = p7_cpubind_Create(esl_opt_GetString(go, "--cpubind"), (esl_opt_IsOn(go, "--readercpu") ? esl_opt_GetInteger(go, "--readercpu") : -1), &cpubind, errbuf);
+      if      (status == eslEUNIMPLEMENTED) fprintf(stderr, "Warning: %s\n", errbuf);
+      else if (status != eslOK)             p7_Fail("%s\n", errbuf);
+      p7_cpubind_Reader(cpubind);   /* before any thread starts: they inherit it */
+    }
 
   if (ncpus > 0) {
 #if defined (eslENABLE_SSE)
@@ -810,7 +904,26 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
         threadObj = esl_threads_Create(&pipeline_thread);
 
-      queue = esl_workqueue_Create(ncpus * 2);
+      queue = esl_workqueue_Create(ncpus * esl_opt_GetInteger(go, "--nblocks"));
+      if (dbformat != eslSQFILE_FMINDEX)
+        ra = p7_readahead_Open(cfg->dbfile, (size_t) esl_opt_GetInteger(go, "--readahead") * 1024 * 1024);
+
+      /* the file size estimates the residues left, when the whole file is searched */
+      if (dbformat != eslSQFILE_FMINDEX && ! esl_opt_IsUsed(go, "--block_length")) {
+        if (cfg->firstseq_key == NULL && cfg->n_targetseq == -1 && esl_sqfile_IsRewindable(dbfp) && stat(cfg->dbfile, &st) == 0)
+          tune = blocktune_Create(ncpus, (double) st.st_size, esl_opt_GetBoolean(go, "--block_tune"));
+        else
+          tune = blocktune_Create(ncpus, 0.,                  esl_opt_GetBoolean(go, "--block_tune"));
+        if (tune == NULL) esl_fatal("Failed to allocate block length tuner");
+      }
+  }
+
+  /* Workers search one FM-index block each; with fewer blocks than
+   * workers, use the spare ones to split each block's seed search.
+   */
+  if (dbformat == eslSQFILE_FMINDEX) {
+    if      (esl_opt_IsOn(go, "--seed_cpu"))  fm_cfg->seed_threads = esl_opt_GetInteger(go, "--seed_cpu");
+    else if (ncpus > fm_meta->block_count)    fm_cfg->seed_threads = ncpus / fm_meta->block_count;
   }
 #endif
 
@@ -820,8 +933,15 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     if (status != eslOK) p7_Fail("Trouble reading bgfile: %s\n", errbuf);
   }
 
+#if defined (eslENABLE_SSE)
+  if (dbformat == eslSQFILE_FMINDEX) qbatch = esl_opt_GetInteger(go, "--qbatch");
+#endif
+
   infocnt = (ncpus == 0) ? 1 : ncpus;
-  ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt);
+  ESL_ALLOC(infoset, (ptrdiff_t) sizeof(*infoset) * infocnt * qbatch);
+  ESL_ALLOC(batch,   (ptrdiff_t) sizeof(*batch)   * qbatch);
+  ESL_ALLOC(thl,     (ptrdiff_t) sizeof(*thl)     * infocnt);
+  info = infoset;
 
   if (status == eslOK) {
       /* One-time initializations after alphabet <abc> becomes known */
@@ -830,22 +950,25 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (dbformat != eslSQFILE_FMINDEX)
         dbfp->abc = abc;
 
-      for (i = 0; i < infocnt; ++i)    {
-          info[i].pli    = NULL;
-          info[i].th     = NULL;
-          info[i].om     = NULL;
+      for (i = 0; i < infocnt * qbatch; ++i)    {
+          infoset[i].pli    = NULL;
+          infoset[i].th     = NULL;
+          infoset[i].om     = NULL;
+          infoset[i].qnext  = NULL;
           if (bg_manual != NULL)
-            info[i].bg = p7_bg_Clone(bg_manual);
+            infoset[i].bg = p7_bg_Clone(bg_manual);
           else
-            info[i].bg = p7_bg_Create(abc);
+            infoset[i].bg = p7_bg_Create(abc);
 
 #ifdef HMMER_THREADS
-          info[i].queue = queue;
+          infoset[i].queue   = queue;
+          infoset[i].cpubind = cpubind;
+          infoset[i].tune    = tune;
 #endif
       }
 
 #ifdef HMMER_THREADS
-      for (i = 0; i < ncpus * 2; ++i) {
+      for (i = 0; i < ncpus * esl_opt_GetInteger(go, "--nblocks"); ++i) {
 #if defined (eslENABLE_SSE)
         if (dbformat == eslSQFILE_FMINDEX) {
           ESL_ALLOC(fminfo, sizeof(FM_THREAD_INFO));
@@ -895,62 +1018,153 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   }
 
 
-  /* Outer loop: over each query HMM or alignment in <query file>. */
+  /* Outer loop: over each query HMM or alignment in <query file>, in
+   * batches of <qbatch>. Only an FM-index search has batches of more than
+   * one query (--qbatch): each block of the index is then read once per
+   * batch, and the batch's queries all search it before the next block.
+   */
   while (qhstatus == eslOK) {
       P7_PROFILE      *gm      = NULL;
       P7_OPROFILE     *om      = NULL;       /* optimized query profile                  */
 
-      if ( qfp_sq != NULL) {//  FASTA format, each query is a single sequence, they all have names
-        //Turn sequence into an HMM
-        if ((qhstatus = p7_SingleBuilder(builder, qsq, info->bg, &hmm, NULL, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", builder->errbuf);
+      /* Read the batch's queries, and set up a pipeline for each, in row <nb> of <infoset> */
+      for (nb = 0; nb < qbatch && qhstatus == eslOK; nb++) {
+        info = infoset + nb * infocnt;
+
+        if ( qfp_sq != NULL) {//  FASTA format, each query is a single sequence, they all have names
+          //Turn sequence into an HMM
+          if ((qhstatus = p7_SingleBuilder(builder, qsq, info->bg, &hmm, NULL, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", builder->errbuf);
+
+        } else if ( qfp_msa != NULL ) {
+          //deal with recently read MSA
+          //if name isn't assigned, give it one (can only do this if there's a single unnamed alignment, so pick its filename)
+          if (msa->name == NULL) {
+            char *name = NULL;
+            if (msas_named>0) p7_Fail("Name annotation is required for each alignment in a multi MSA file; failed on #%d", nquery+1);
+
+            if (cfg->queryfile != NULL) {
+              if ((status = esl_FileTail(cfg->queryfile, TRUE, &name)) != eslOK) return status; /* TRUE=nosuffix */
+            } else {
+              name = "Query";
+            }
 
-      } else if ( qfp_msa != NULL ) {
-        //deal with recently read MSA
-        //if name isn't assigned, give it one (can only do this if there's a single unnamed alignment, so pick its filename)
-        if (msa->name == NULL) {
-          char *name = NULL;
-          if (msas_named>0) p7_Fail("Name annotation is required for each alignment in a multi MSA file; failed on #%d", nquery+1);
+            if ((status = esl_msa_SetName(msa, name, -1)) != eslOK) p7_Fail("Error assigning name to alignment");
+            msas_named++;
 
-          if (cfg->queryfile != NULL) {
-            if ((status = esl_FileTail(cfg->queryfile, TRUE, &name)) != eslOK) return status; /* TRUE=nosuffix */
+            free(name);
+          }
+
+          //Turn sequence alignment into an HMM
+          if (msa->nseq == 1 && force_single) {
+            if (qsq!=NULL) esl_sq_Destroy(qsq);
+            qsq = esl_sq_CreateDigitalFrom(msa->abc, (msa->sqname?msa->sqname[0]:"Query"), msa->ax[0], msa->alen, (msa->sqdesc?msa->sqdesc[0]:NULL), (msa->sqacc?msa->sqacc[0]:NULL), NULL);
+            esl_abc_XDealign(qsq->abc, qsq->dsq,  qsq->dsq, &(qsq->n));
+            if ((qhstatus = p7_SingleBuilder(builder, qsq, info->bg, &hmm, NULL, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", builder->errbuf);
           } else {
-            name = "Query";
+            if ((qhstatus = p7_Builder(builder, msa, info->bg, &hmm, NULL, NULL, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", builder->errbuf);
           }
+        }
+
 
-          if ((status = esl_msa_SetName(msa, name, -1)) != eslOK) p7_Fail("Error assigning name to alignment");
-          msas_named++;
+        // Assign HMM max_length
+        if      (window_length > 0)     hmm->max_length = window_length;
+        else if (window_beta   > 0)     p7_Builder_MaxLength(hmm, window_beta);
+        else if (hmm->max_length == -1 ) p7_Builder_MaxLength(hmm, p7_DEFAULT_WINDOW_BETA);
 
-          free(name);
+
+        if (hmmoutfp != NULL) {
+          if ((status = p7_hmmfile_WriteASCII(hmmoutfp, -1, hmm)) != eslOK) ESL_FAIL(status, errbuf, "HMM save failed");
         }
 
-        //Turn sequence alignment into an HMM
-        if (msa->nseq == 1 && force_single) {
-          if (qsq!=NULL) esl_sq_Destroy(qsq);
-          qsq = esl_sq_CreateDigitalFrom(msa->abc, (msa->sqname?msa->sqname[0]:"Query"), msa->ax[0], msa->alen, (msa->sqdesc?msa->sqdesc[0]:NULL), (msa->sqacc?msa->sqacc[0]:NULL), NULL);
-          esl_abc_XDealign(qsq->abc, qsq->dsq,  qsq->dsq, &(qsq->n));
-          if ((qhstatus = p7_SingleBuilder(builder, qsq, info->bg, &hmm, NULL, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", builder->errbuf);
-        } else {
-          if ((qhstatus = p7_Builder(builder, msa, info->bg, &hmm, NULL, NULL, NULL, NULL)) != eslOK) p7_Fail("build failed: %s", builder->errbuf);
+        nquery++;
+
+        /* Convert to an optimized model */
+        gm = p7_profile_Create (hmm->M, abc);
+        om = p7_oprofile_Create(hmm->M, abc);
+        p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
+        p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
+
+#if defined (eslENABLE_SSE)
+        if (dbformat == eslSQFILE_FMINDEX) {
+          batch[nb].fm_cfg = *fm_cfg;   /* the seed threshold is the query's own; the rest is shared */
+          fm_configSeedThreshold(&(batch[nb].fm_cfg), gm, NULL);
+          scoredata = p7_hmm_ScoreDataCreate(om, gm);
         }
-      }
+        else
+#endif
+          scoredata = p7_hmm_ScoreDataCreate(om, NULL);
+
+        /* Fill in the window prefix/suffix lengths now, once, instead of
+         * each worker doing it lazily to its own copy: finished, the
+         * score data is only read, and all the workers share it.
+         */
+        if (scoredata == NULL || p7_hmm_ScoreDataComputeRest(om, scoredata) != eslOK)
+          p7_Fail("Failed to allocate score data for query %s\n", hmm->name);
+
+        for (i = 0; i < infocnt; ++i) {
+            /* Create processing pipeline and hit list */
+            info[i].th  = p7_tophits_Create();
+            info[i].om  = p7_oprofile_Copy(om);
+            info[i].pli = p7_pipeline_Create(go, om->M, 100, TRUE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+
+            //set method specific --F1, if it wasn't set at command line
+            if (!esl_opt_IsOn(go, "--F1") ) {
+#if defined (eslENABLE_SSE)
+              if (dbformat == eslSQFILE_FMINDEX)
+                info[i].pli->F1 = 0.03;
+              else
+#endif
+                info[i].pli->F1 = 0.02;
+            }
 
+#if defined (eslENABLE_SSE)
+            info[i].fm_cfg = (dbformat == eslSQFILE_FMINDEX ? &(batch[nb].fm_cfg) : fm_cfg);
+#endif
+            status = p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+            if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
+
+            info[i].pli->do_alignment_score_calc = esl_opt_IsOn(go, "--aliscoresout") ;
 
-      // Assign HMM max_length
-      if      (window_length > 0)     hmm->max_length = window_length;
-      else if (window_beta   > 0)     p7_Builder_MaxLength(hmm, window_beta);
-      else if (hmm->max_length == -1 ) p7_Builder_MaxLength(hmm, p7_DEFAULT_WINDOW_BETA);
+            if      ( esl_opt_IsUsed(go, "--watson")) info[i].pli->strands = p7_STRAND_TOPONLY;
+            else if ( esl_opt_IsUsed(go, "--crick"))  info[i].pli->strands = p7_STRAND_BOTTOMONLY;
+            else                                      info[i].pli->strands = p7_STRAND_BOTH;
 
+            if (dbformat != eslSQFILE_FMINDEX) {
+              if (  esl_opt_IsUsed(go, "--block_length") )
+                info[i].pli->block_length = esl_opt_GetInteger(go, "--block_length");
+              else
+                info[i].pli->block_length = NHMMER_MAX_RESIDUE_COUNT;
+            }
+
+            info[i].scoredata = scoredata;   /* shared, read-only */
 
-      if (hmmoutfp != NULL) {
-        if ((status = p7_hmmfile_WriteASCII(hmmoutfp, -1, hmm)) != eslOK) ESL_FAIL(status, errbuf, "HMM save failed");
+            /* worker <i> searches each block with all the batch's queries, following <qnext> */
+            info[i].qnext = NULL;
+            if (nb > 0) infoset[(nb-1) * infocnt + i].qnext = &(info[i]);
+        }
+
+        batch[nb].hmm       = hmm;
+        batch[nb].gm        = gm;
+        batch[nb].om        = om;
+        batch[nb].scoredata = scoredata;
+
+        if (qsq != NULL) esl_sq_Reuse(qsq);
+
+        if (hfp != NULL) {
+          qhstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
+        } else if (qfp_msa != NULL){
+          esl_msa_Destroy(msa);
+          qhstatus = esl_msafile_Read(qfp_msa, &msa);
+        } else { // qfp_sq
+          qhstatus = esl_sqio_Read(qfp_sq, qsq);
+        }
+        if (qhstatus != eslOK && qhstatus != eslEOF) p7_Fail("reading from query file %s (%d)\n", cfg->queryfile, qhstatus);
       }
 
-      nquery++;
-      resCnt = 0;
       esl_stopwatch_Start(w);
 
       /* seqfile may need to be rewound (multiquery mode) */
-      if (nquery > 1) {
+      if (nquery > nb) {
 #if defined (eslENABLE_SSE)
         if (dbformat == eslSQFILE_FMINDEX) { //rewind
           if (fsetpos(fm_meta->fp, &fm_basepos) != 0)  ESL_EXCEPTION(eslESYS, "rewind via fsetpos() failed");
@@ -974,85 +1188,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         }
       }
 
-      if (fprintf(ofp, "Query:       %s  [M=%d]\n", hmm->name, hmm->M) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (hmm->acc  && fprintf(ofp, "Accession:   %s\n", hmm->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (hmm->desc && fprintf(ofp, "Description: %s\n", hmm->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
-
-      /* Convert to an optimized model */
-      gm = p7_profile_Create (hmm->M, abc);
-      om = p7_oprofile_Create(hmm->M, abc);
-      p7_ProfileConfig(hmm, info->bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
-      p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
-
-#if defined (eslENABLE_SSE)
-      if (dbformat == eslSQFILE_FMINDEX) {
-        //capture a measure of score density multiplied by something I conjecture to be related to
-        //the expected longest common subsequence (sqrt(M)).  If less than a default target
-        //(7 bits of expected LCS), then the requested score threshold will be shifted down
-        // according to this ratio.
-        // Xref: ~wheelert/notebook/2014/03-04-FM-time-v-len/00NOTES -- Thu Mar  6 14:40:48 EST 2014
-        float best_sc_avg = 0;
-        int j;
-        for (i = 1; i <= om->M; i++) {
-          float max_score = 0;
-          for (j=0; j<hmm->abc->K; j++) {
-            if ( esl_abc_XIsResidue(om->abc,j) &&  gm->rsc[j][(i) * p7P_NR     + p7P_MSC]   > max_score)   max_score   = gm->rsc[j][(i) * p7P_NR     + p7P_MSC];
-          }
-          best_sc_avg += max_score;
-        }
-        best_sc_avg /= sqrt((double) hmm->M);   //that's dividing by M to get score density, then multiplying by sqrt(M) as a proxy for expected LCS
-        best_sc_avg = ESL_MAX(5.0,best_sc_avg); // don't let it get too low, or run time will dramatically suffer
-
-        fm_cfg->sc_thresh_ratio = ESL_MIN(best_sc_avg/7.0, 1.0);
-        scoredata = p7_hmm_ScoreDataCreate(om, gm);
-      }
-      else
-#endif
-        scoredata = p7_hmm_ScoreDataCreate(om, NULL);
-
-      for (i = 0; i < infocnt; ++i) {
-          /* Create processing pipeline and hit list */
-          info[i].th  = p7_tophits_Create();
-          info[i].om  = p7_oprofile_Copy(om);
-          info[i].pli = p7_pipeline_Create(go, om->M, 100, TRUE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-
-          //set method specific --F1, if it wasn't set at command line
-          if (!esl_opt_IsOn(go, "--F1") ) {
-#if defined (eslENABLE_SSE)
-            if (dbformat == eslSQFILE_FMINDEX)
-              info[i].pli->F1 = 0.03;
-            else
-#endif
-              info[i].pli->F1 = 0.02;
-          }
-
-#if defined (eslENABLE_SSE)
-          info[i].fm_cfg = fm_cfg;
-#endif
-          status = p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
-          if (status == eslEINVAL) p7_Fail(info->pli->errbuf);
-
-          info[i].pli->do_alignment_score_calc = esl_opt_IsOn(go, "--aliscoresout") ;
-
-          if      ( esl_opt_IsUsed(go, "--watson")) info[i].pli->strands = p7_STRAND_TOPONLY;
-          else if ( esl_opt_IsUsed(go, "--crick"))  info[i].pli->strands = p7_STRAND_BOTTOMONLY;
-          else                                      info[i].pli->strands = p7_STRAND_BOTH;
-
-          if (dbformat != eslSQFILE_FMINDEX) {
-            if (  esl_opt_IsUsed(go, "--block_length") )
-              info[i].pli->block_length = esl_opt_GetInteger(go, "--block_length");
-            else
-              info[i].pli->block_length = NHMMER_MAX_RESIDUE_COUNT;
-          }
-
-          info[i].scoredata = p7_hmm_ScoreDataClone(scoredata, om->abc->Kp);
-
+      /* Search the database with the batch; workers get row 0, and follow <qnext> to the rest */
+      info = infoset;
 #ifdef HMMER_THREADS
-          if (ncpus > 0)
-            esl_threads_AddThread(threadObj, &info[i]);
+      if (ncpus > 0)
+        for (i = 0; i < infocnt; ++i)
+          esl_threads_AddThread(threadObj, &info[i]);
 #endif
-      }
 
       /* establish the id_lengths data structutre */
       id_length_list = init_id_length(1000);
@@ -1069,7 +1211,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       else
 #endif //defined (eslENABLE_SSE)
       {
-        if (ncpus > 0)  sstatus = thread_loop    (info, id_length_list, threadObj, queue, dbfp, cfg->firstseq_key, cfg->n_targetseq);
+        if (ncpus > 0)  sstatus = thread_loop    (info, id_length_list, threadObj, queue, dbfp, ra, cfg->firstseq_key, cfg->n_targetseq);
         else            sstatus = serial_loop    (info, id_length_list, dbfp, cfg->firstseq_key, cfg->n_targetseq);
       }
 
@@ -1096,125 +1238,126 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
           esl_fatal("Unexpected error %d reading sequence file %s", sstatus, dbfp->filename);
       }
 
-      //need to re-compute e-values before merging (when list will be sorted)
-      if (esl_opt_IsUsed(go, "-Z")) {
-    	  resCnt = 1000000*esl_opt_GetReal(go, "-Z");
+      /* Output each query of the batch, in order */
+      for (q = 0; q < nb; q++) {
+        info      = infoset + q * infocnt;
+        hmm       = batch[q].hmm;
+        gm        = batch[q].gm;
+        om        = batch[q].om;
+        scoredata = batch[q].scoredata;
+        resCnt    = 0;
 
-    	  if ( info[0].pli->strands == p7_STRAND_BOTH)
-    	    resCnt *= 2;
+        if (fprintf(ofp, "Query:       %s  [M=%d]\n", hmm->name, hmm->M) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        if (hmm->acc  && fprintf(ofp, "Accession:   %s\n", hmm->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        if (hmm->desc && fprintf(ofp, "Description: %s\n", hmm->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
-      } else {
+        //need to re-compute e-values before merging (when list will be sorted)
+        if (esl_opt_IsUsed(go, "-Z")) {
+      	  resCnt = 1000000*esl_opt_GetReal(go, "-Z");
+
+      	  if ( info[0].pli->strands == p7_STRAND_BOTH)
+      	    resCnt *= 2;
+
+        } else {
 #if defined (eslENABLE_SSE)
-        if (dbformat == eslSQFILE_FMINDEX) {
-          resCnt = 2 * fm_meta->char_count;
-        }
-        else
+          if (dbformat == eslSQFILE_FMINDEX) {
+            resCnt = 2 * fm_meta->char_count;
+          }
+          else
 #endif
-        {
-          for (i = 0; i < infocnt; ++i)
-            resCnt += info[i].pli->nres;
+          {
+            for (i = 0; i < infocnt; ++i)
+              resCnt += info[i].pli->nres;
+          }
         }
-      }
 
-      for (i = 0; i < infocnt; ++i)
-          p7_tophits_ComputeNhmmerEvalues(info[i].th, resCnt, info[i].om->max_length);
-
-      /* merge the results of the search results */
-      for (i = 1; i < infocnt; ++i) {
-          p7_tophits_Merge(info[0].th, info[i].th);
-          p7_pipeline_Merge(info[0].pli, info[i].pli);
-
-          p7_pipeline_Destroy(info[i].pli);
-          p7_tophits_Destroy(info[i].th);
-          p7_oprofile_Destroy(info[i].om);
-      }
+        for (i = 0; i < infocnt; ++i)
+            p7_tophits_ComputeNhmmerEvalues(info[i].th, resCnt, info[i].om->max_length);
+
+        /* merge the results of the search results: the workers have
+         * each sorted their own hits by target and position, so one
+         * k-way merge leaves them ready for duplicate removal
+         */
+        for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+        p7_tophits_MergeManyBySeqidxAndAlipos(info[0].th, thl, infocnt-1);
+        for (i = 1; i < infocnt; ++i) {
+            p7_pipeline_Merge(info[0].pli, info[i].pli);
+
+            p7_pipeline_Destroy(info[i].pli);
+            p7_tophits_Destroy(info[i].th);
+            p7_oprofile_Destroy(info[i].om);
+        }
 
 #if defined (eslENABLE_SSE)
-      if (dbformat == eslSQFILE_FMINDEX) {
-        info[0].pli->nseqs = fm_meta->seq_data[fm_meta->seq_count-1].target_id + 1;
-        info[0].pli->nres  = resCnt;
-      }
+        if (dbformat == eslSQFILE_FMINDEX) {
+          info[0].pli->nseqs = fm_meta->seq_data[fm_meta->seq_count-1].target_id + 1;
+          info[0].pli->nres  = resCnt;
+        }
 #endif
 
-      /* Print the results.  */
-      p7_tophits_SortBySeqidxAndAlipos(info->th);
-      assign_Lengths(info->th, id_length_list);
-      p7_tophits_RemoveDuplicates(info->th, info->pli->use_bit_cutoffs);
+        /* Print the results.  */
+        p7_tophits_SortBySeqidxAndAlipos(info->th);   /* no-op after the merge */
+        assign_Lengths(info->th, id_length_list);
+        p7_tophits_RemoveDuplicates(info->th, info->pli->use_bit_cutoffs);
 
-      p7_tophits_SortBySortkey(info->th);
-      p7_tophits_Threshold(info->th, info->pli);
+        p7_tophits_SortBySortkey(info->th);
+        p7_tophits_Threshold(info->th, info->pli);
 
 
-      //tally up total number of hits and target coverage
-      info->pli->n_output = info->pli->pos_output = 0;
-      for (i = 0; i < info->th->N; i++) {
-          if ( (info->th->hit[i]->flags & p7_IS_REPORTED) || info->th->hit[i]->flags & p7_IS_INCLUDED) {
-              info->pli->n_output++;
-              info->pli->pos_output += 1 + (info->th->hit[i]->dcl[0].jali > info->th->hit[i]->dcl[0].iali ? info->th->hit[i]->dcl[0].jali - info->th->hit[i]->dcl[0].iali : info->th->hit[i]->dcl[0].iali - info->th->hit[i]->dcl[0].jali) ;
-          }
-      }
-
-      p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        //tally up total number of hits and target coverage
+        info->pli->n_output = info->pli->pos_output = 0;
+        for (i = 0; i < info->th->N; i++) {
+            if ( (info->th->hit[i]->flags & p7_IS_REPORTED) || info->th->hit[i]->flags & p7_IS_INCLUDED) {
+                info->pli->n_output++;
+                info->pli->pos_output += 1 + (info->th->hit[i]->dcl[0].jali > info->th->hit[i]->dcl[0].iali ? info->th->hit[i]->dcl[0].jali - info->th->hit[i]->dcl[0].iali : info->th->hit[i]->dcl[0].iali - info->th->hit[i]->dcl[0].jali) ;
+            }
+        }
 
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, info->th, info->pli, (nquery == 1));
-      if (dfamtblfp) p7_tophits_TabularXfam(dfamtblfp,   hmm->name, hmm->acc, info->th, info->pli);
-      if (aliscoresfp) p7_tophits_AliScores(aliscoresfp, hmm->name, info->th );
+        p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        p7_tophits_DomainsThreaded(ofp, info->th, info->pli, textw, ncpus); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
-      esl_stopwatch_Stop(w);
+        if (tblfp)     p7_tophits_TabularTargets(tblfp,    hmm->name, hmm->acc, info->th, info->pli, (nquery - nb + q == 0));
+        if (dfamtblfp) p7_tophits_TabularXfam(dfamtblfp,   hmm->name, hmm->acc, info->th, info->pli);
+        if (aliscoresfp) p7_tophits_AliScores(aliscoresfp, hmm->name, info->th );
 
-      p7_pli_Statistics(ofp, info->pli, w);
+        esl_stopwatch_Stop(w);
 
-      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        p7_pli_Statistics(ofp, info->pli, w);
 
-      /* Output the results in an MSA (-A option) */
-      if (afp) {
-          ESL_MSA *msa = NULL;
+        if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
-          if (p7_tophits_Alignment(info->th, abc, NULL, NULL, 0, p7_DEFAULT, &msa) == eslOK) 
-	    {
-	      esl_msa_SetName     (msa, hmm->name, -1);
-	      esl_msa_SetAccession(msa, hmm->acc,  -1);
-	      esl_msa_SetDesc     (msa, hmm->desc, -1);
-	      esl_msa_FormatAuthor(msa, "nhmmer (HMMER %s)", HMMER_VERSION);
+        /* Output the results in an MSA (-A option) */
+        if (afp) {
+            ESL_MSA *msa = NULL;
 
-	      if (textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
-	      else           esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
+            if (p7_tophits_Alignment(info->th, abc, NULL, NULL, 0, p7_DEFAULT, &msa) == eslOK) 
+  	    {
+  	      esl_msa_SetName     (msa, hmm->name, -1);
+  	      esl_msa_SetAccession(msa, hmm->acc,  -1);
+  	      esl_msa_SetDesc     (msa, hmm->desc, -1);
+  	      esl_msa_FormatAuthor(msa, "nhmmer (HMMER %s)", HMMER_VERSION);
 
-	      if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-	    }  
-	  else 
-	    {
-	      if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-	    }
-          esl_msa_Destroy(msa);
-      }
+  	      if (textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
+  	      else           esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
 
-      for (i = 0; i < infocnt; ++i)
-        p7_hmm_ScoreDataDestroy(info[i].scoredata);
+  	      if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  	    }  
+  	  else 
+  	    {
+  	      if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  	    }
+            esl_msa_Destroy(msa);
+        }
 
-      p7_hmm_ScoreDataDestroy(scoredata);
-      p7_pipeline_Destroy(info->pli);
-      p7_tophits_Destroy(info->th);
-      p7_oprofile_Destroy(info->om);
-      p7_oprofile_Destroy(om);
-      p7_profile_Destroy(gm);
-      p7_hmm_Destroy(hmm);
-      destroy_id_length(id_length_list);
-      if (qsq != NULL) esl_sq_Reuse(qsq);
-
-      if (hfp != NULL) {
-        qhstatus = p7_hmmfile_Read(hfp, &abc, &hmm);
-      } else if (qfp_msa != NULL){
-        esl_msa_Destroy(msa);
-        qhstatus = esl_msafile_Read(qfp_msa, &msa);
-      } else { // qfp_sq
-        qhstatus = esl_sqio_Read(qfp_sq, qsq);
+        p7_hmm_ScoreDataDestroy(scoredata);
+        p7_pipeline_Destroy(info->pli);
+        p7_tophits_Destroy(info->th);
+        p7_oprofile_Destroy(info->om);
+        p7_oprofile_Destroy(om);
+        p7_profile_Destroy(gm);
+        p7_hmm_Destroy(hmm);
       }
-      if (qhstatus != eslOK && qhstatus != eslEOF) p7_Fail("reading from query file %s (%d)\n", cfg->queryfile, qhstatus);
-
-
-
+      destroy_id_length(id_length_list);
 
   } /* end outer loop over queries */
 
@@ -1245,8 +1388,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   /* Cleanup - prepare for successful exit
    */
-  for (i = 0; i < infocnt; ++i)
-    p7_bg_Destroy(info[i].bg);
+  for (i = 0; i < infocnt * qbatch; ++i)
+    p7_bg_Destroy(infoset[i].bg);
 
 #ifdef HMMER_THREADS
   if (ncpus > 0) {
@@ -1271,9 +1414,14 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
   }
+  p7_cpubind_Destroy(cpubind);
+  p7_readahead_Close(ra);
+  blocktune_Destroy(tune);
 #endif
 
-  free(info);
+  free(infoset);
+  free(batch);
+  free(thl);
 
   if (hfp)     p7_hmmfile_Close(hfp);
   if (qfp_msa) esl_msafile_Close(qfp_msa);
@@ -1321,6 +1469,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
 
    if (hmmfile != NULL) free (hmmfile);
+   if (thl)             free (thl);
 
    return eslFAIL;
 }
@@ -1343,26 +1492,37 @@ serial_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_SQFILE *dbfp,
       dbsq->idx = seq_id;
       p7_pli_NewSeq(info->pli, dbsq);
 
-      if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
-
+      if (info->pli->strands == p7_STRAND_BOTH && dbsq->abc->complement != NULL) {
+        // both strands in one pass, without a reverse complemented copy
         info->pli->nres -= dbsq->C; // to account for overlapping region of windows
-        p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq, p7_NOCOMPLEMENT, NULL, NULL, NULL);
+        p7_Pipeline_LongTargetDual(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq);
         p7_pipeline_Reuse(info->pli); // prepare for next search
 
+        info->pli->nres += dbsq->W;
+
       } else {
-        info->pli->nres -= dbsq->n;
-      }
 
-      //reverse complement
-      if (info->pli->strands != p7_STRAND_TOPONLY && dbsq->abc->complement != NULL )
-      {
-          esl_sq_Copy(dbsq,dbsq_revcmp);
-          esl_sq_ReverseComplement(dbsq_revcmp);
-          p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq_revcmp, p7_COMPLEMENT, NULL, NULL, NULL);
+        if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
+
+          info->pli->nres -= dbsq->C; // to account for overlapping region of windows
+          p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq, p7_NOCOMPLEMENT, NULL, NULL, NULL);
           p7_pipeline_Reuse(info->pli); // prepare for next search
 
-          info->pli->nres += dbsq_revcmp->W;
+        } else {
+          info->pli->nres -= dbsq->n;
+        }
+
+        //reverse complement
+        if (info->pli->strands != p7_STRAND_TOPONLY && dbsq->abc->complement != NULL )
+        {
+            esl_sq_Copy(dbsq,dbsq_revcmp);
+            esl_sq_ReverseComplement(dbsq_revcmp);
+            p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, info->pli->nseqs, dbsq_revcmp, p7_COMPLEMENT, NULL, NULL, NULL);
+            p7_pipeline_Reuse(info->pli); // prepare for next search
 
+            info->pli->nres += dbsq_revcmp->W;
+
+        }
       }
 
       wstatus = esl_sqio_ReadWindow(dbfp, info->om->max_length, info->pli->block_length, dbsq);
@@ -1397,6 +1557,7 @@ serial_loop_FM(WORKER_INFO *info, ESL_SQFILE *dbfp)
 
   FM_DATA  fmf;
   FM_DATA  fmb;
+  WORKER_INFO *qinfo;
 
   FM_METADATA *meta = info->fm_cfg->meta;
 
@@ -1410,11 +1571,16 @@ serial_loop_FM(WORKER_INFO *info, ESL_SQFILE *dbfp)
 
     fmb.SA = fmf.SA;
     fmb.T  = fmf.T;
-
-    wstatus = p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg,
-        info->th, -1, NULL, -1,  &fmf, &fmb, info->fm_cfg);
+    wstatus = fm_FM_buildKmers(&fmf, &fmb, info->fm_cfg);
     if (wstatus != eslOK) return wstatus;
 
+    /* every query of the batch searches the block while it's in memory */
+    for (qinfo = info; qinfo; qinfo = qinfo->qnext) {
+      wstatus = p7_Pipeline_LongTarget(qinfo->pli, qinfo->om, qinfo->scoredata, qinfo->bg,
+          qinfo->th, -1, NULL, -1,  &fmf, &fmb, qinfo->fm_cfg);
+      if (wstatus != eslOK) return wstatus;
+    }
+
     fm_FM_destroy(&fmf, 1);
     fm_FM_destroy(&fmb, 0);
   }
@@ -1426,7 +1592,7 @@ serial_loop_FM(WORKER_INFO *info, ESL_SQFILE *dbfp)
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, char *firstseq_key, int n_targetseqs)
+thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_READAHEAD *ra, char *firstseq_key, int n_targetseqs)
 {
 
   int          i;
@@ -1439,6 +1605,8 @@ thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj,
 
   ESL_SQ      *tmpsq = esl_sq_CreateDigital(info->om->abc);
   int          abort = FALSE; // in the case n_targetseqs != -1, a block may get abbreviated
+  int          blen  = (info->tune ? blocktune_Start(info->tune) : info->pli->block_length);
+  double       done;
 
 
   esl_workqueue_Reset(queue);
@@ -1456,7 +1624,13 @@ thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj,
         block->count = 0;
         sstatus = eslEOF;
       } else {
-        sstatus = esl_sqio_ReadBlock(dbfp, block, info->pli->block_length, n_targetseqs, /*max_init_window=*/FALSE, TRUE);
+        sstatus = esl_sqio_ReadBlock(dbfp, block, blen, n_targetseqs, /*max_init_window=*/FALSE, TRUE);
+      }
+      /* a window of a long target: its data offset plus residues read is near enough */
+      if (block->count > 0) {
+        done = (double) ESL_MAX(block->list[block->count-1].roff, block->list[block->count-1].doff + block->list[block->count-1].end);
+        p7_readahead_Advance(ra, (off_t) done);
+        if (info->tune) blen = blocktune_Next(info->tune, block, blen, done);
       }
 
       block->first_seqidx = info->pli->nseqs;
@@ -1525,7 +1699,7 @@ thread_loop(WORKER_INFO *info, ID_LENGTH_LIST *id_length_list, ESL_THREADS *obj,
             }
           }
 
-          if(block_space > 20* info->pli->block_length){  
+          if(block_space > 20 * (uint64_t) ESL_MAX(blen, info->pli->block_length)){  
             if(esl_sq_BlockReallocSequences(((ESL_SQ_BLOCK *)newBlock)) != eslOK){
               esl_fatal( "Error reallocating sequence data in block.\n");
             }  
@@ -1575,6 +1749,7 @@ pipeline_thread(void *arg)
   ESL_THREADS   *obj;
   ESL_SQ_BLOCK  *block = NULL;
   void          *newBlock;
+  double         t0;
   
   impl_Init();
 
@@ -1582,6 +1757,7 @@ pipeline_thread(void *arg)
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+  p7_cpubind_Worker(info->cpubind, workeridx);  /* before its DP matrices grow, so they're on its own NUMA node */
 
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) esl_fatal("Work queue worker failed");
@@ -1592,6 +1768,8 @@ pipeline_thread(void *arg)
 
   while (block->count > 0)
   {
+      t0 = (info->tune ? p7_progress_Now() : 0.);
+
       /* Main loop: */
       for (i = 0; i < block->count; ++i)
     {
@@ -1599,26 +1777,38 @@ pipeline_thread(void *arg)
 
       p7_pli_NewSeq(info->pli, dbsq);
 
-      if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
+      if (info->pli->strands == p7_STRAND_BOTH && dbsq->abc->complement != NULL) {
+        // both strands in one pass, without a reverse complemented copy
         info->pli->nres -= dbsq->C; // to account for overlapping region of windows
-
-        p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, block->first_seqidx + i, dbsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
+        p7_Pipeline_LongTargetDual(info->pli, info->om, info->scoredata, info->bg, info->th, block->first_seqidx + i, dbsq);
         p7_pipeline_Reuse(info->pli); // prepare for next search
 
+        info->pli->nres += dbsq->W;
+
       } else {
-        info->pli->nres -= dbsq->n;
-      }
 
-      //reverse complement
-      if (info->pli->strands != p7_STRAND_TOPONLY && dbsq->abc->complement != NULL)
-      {
-          esl_sq_ReverseComplement(dbsq);
-          p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, block->first_seqidx + i, dbsq, p7_COMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
+        if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
+          info->pli->nres -= dbsq->C; // to account for overlapping region of windows
+
+          p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, block->first_seqidx + i, dbsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
           p7_pipeline_Reuse(info->pli); // prepare for next search
 
-          info->pli->nres += dbsq->W;
+        } else {
+          info->pli->nres -= dbsq->n;
+        }
+
+        //reverse complement
+        if (info->pli->strands != p7_STRAND_TOPONLY && dbsq->abc->complement != NULL)
+        {
+            esl_sq_ReverseComplement(dbsq);
+            p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg, info->th, block->first_seqidx + i, dbsq, p7_COMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
+            p7_pipeline_Reuse(info->pli); // prepare for next search
+
+            info->pli->nres += dbsq->W;
+        }
       }
     }
+      if (info->tune) blocktune_Report(info->tune, block, p7_progress_Now() - t0);
  
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
       if (status != eslOK) esl_fatal("Work queue worker failed");
@@ -1628,6 +1818,9 @@ pipeline_thread(void *arg)
   }
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
+
+  /* sort while we're still in parallel; the master merges these */
+  p7_tophits_SortBySeqidxAndAlipos(info->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
@@ -1662,6 +1855,8 @@ thread_loop_FM(WORKER_INFO *info, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_S
 
     fminfo->fmb->SA = fminfo->fmf->SA;
     fminfo->fmb->T  = fminfo->fmf->T;
+    status = fm_FM_buildKmers(fminfo->fmf, fminfo->fmb, info->fm_cfg);
+    if (status != eslOK) return status;
     fminfo->active  = TRUE;
 
     status = esl_workqueue_ReaderUpdate(queue, fminfo, &newFMinfo);
@@ -1698,6 +1893,7 @@ pipeline_thread_FM(void *arg)
   int status;
   int workeridx;
   WORKER_INFO    *info;
+  WORKER_INFO    *qinfo;
   ESL_THREADS    *obj;
   FM_THREAD_INFO *fminfo    = NULL;
   void           *newFMinfo = NULL;
@@ -1709,6 +1905,7 @@ pipeline_thread_FM(void *arg)
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+  p7_cpubind_Worker(info->cpubind, workeridx);  /* before its DP matrices grow, so they're on its own NUMA node */
 
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newFMinfo);
   if (status != eslOK) esl_fatal("Work queue worker failed");
@@ -1718,9 +1915,11 @@ pipeline_thread_FM(void *arg)
 
   while (fminfo->active)
   {
-      status = p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg,
-          info->th, -1, NULL, -1,  fminfo->fmf, fminfo->fmb, info->fm_cfg/*, NULL, NULL, NULL */);
-      if (status != eslOK) esl_fatal ("Work queue worker failed");
+      for (qinfo = info; qinfo; qinfo = qinfo->qnext) {
+        status = p7_Pipeline_LongTarget(qinfo->pli, qinfo->om, qinfo->scoredata, qinfo->bg,
+            qinfo->th, -1, NULL, -1,  fminfo->fmf, fminfo->fmb, qinfo->fm_cfg/*, NULL, NULL, NULL */);
+        if (status != eslOK) esl_fatal ("Work queue worker failed");
+      }
 
       fm_FM_destroy(fminfo->fmf, 1);
       fm_FM_destroy(fminfo->fmb, 0);
@@ -1734,12 +1933,124 @@ pipeline_thread_FM(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, fminfo, NULL);
   if (status != eslOK) esl_fatal("Work queue worker failed");
 
+  /* sort while we're still in parallel; the master merges these */
+  for (qinfo = info; qinfo; qinfo = qinfo->qnext)
+    p7_tophits_SortBySeqidxAndAlipos(qinfo->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
 #endif //#if defined (eslENABLE_SSE)
 
 
+/* helper functions for adapting the threaded reader's block length.
+ *
+ * Each window of a long target after the first re-reads the last
+ * om->max_length residues of the one before, so small blocks waste
+ * work on overlap, and the workers' time on the queue; large ones
+ * leave workers idle while the last few blocks finish. The reader
+ * aims to hand each worker NHMMER_BLOCKS_PER_THREAD more blocks of
+ * what's left of the file, so blocks shrink toward the end, unless the
+ * measured overlap is more than NHMMER_OVERLAP_MAX of what is read.
+ * Both depend only on the query and the targets, so the blocks (and
+ * the windows searched) are the same from run to run. With
+ * --block_tune (<do_timing>), the workers' measured speed also keeps
+ * a block to NHMMER_BLOCK_MINSECS to NHMMER_BLOCK_MAXSECS of search
+ * time, the only guide when the file size isn't known; that's
+ * quicker, but depends on the machine and its load. The length
+ * changes by no more than a factor of two from one block to the next.
+ */
+static BLOCK_TUNER *
+blocktune_Create(int nworkers, double total, int do_timing)
+{
+  BLOCK_TUNER *t = NULL;
+  int          status;
+
+  ESL_ALLOC(t, sizeof(BLOCK_TUNER));
+  if (pthread_mutex_init(&t->mutex, NULL) != 0) { free(t); return NULL; }
+  t->nworkers  = ESL_MAX(1, nworkers);
+  t->do_timing = do_timing;
+  t->total     = total;
+  t->rate      = 0.;
+  t->overlap   = -1.;
+  return t;
+
+ ERROR:
+  return NULL;
+}
+
+/* blocktune_Start()
+ * Forget what was measured for the last query (the model sets the
+ * speed and the overlap), and return the first block length.
+ */
+static int
+blocktune_Start(BLOCK_TUNER *t)
+{
+  pthread_mutex_lock(&t->mutex);
+  t->rate    = 0.;
+  t->overlap = -1.;
+  pthread_mutex_unlock(&t->mutex);
+  return NHMMER_MAX_RESIDUE_COUNT;
+}
+
+/* blocktune_Report()
+ * A worker took <secs> to search <block>. Only used with <do_timing>.
+ */
+static void
+blocktune_Report(BLOCK_TUNER *t, const ESL_SQ_BLOCK *block, double secs)
+{
+  int64_t nres = 0;
+  double  rate;
+  int     i;
+
+  if (! t->do_timing) return;
+  for (i = 0; i < block->count; i++) nres += block->list[i].n;
+  if (nres == 0 || secs <= 0.) return;
+  rate = (double) nres / secs;
+
+  pthread_mutex_lock(&t->mutex);
+  t->rate = (t->rate == 0.) ? rate : 0.8 * t->rate + 0.2 * rate;
+  pthread_mutex_unlock(&t->mutex);
+}
+
+/* blocktune_Next()
+ * The reader has just read <block> with block length <blen>, and is
+ * <done> bytes into the file; return the length for the next block.
+ */
+static int
+blocktune_Next(BLOCK_TUNER *t, const ESL_SQ_BLOCK *block, int blen, double done)
+{
+  int64_t nres  = 0;
+  int64_t nover = 0;
+  double  rate;
+  double  want  = (double) blen;
+  int     i;
+
+  /* only the reader touches <overlap> */
+  for (i = 0; i < block->count; i++) { nres += block->list[i].n; nover += block->list[i].C; }
+  if (nres > 0)
+    t->overlap = (t->overlap < 0.) ? (double) nover / (double) nres : 0.8 * t->overlap + 0.2 * (double) nover / (double) nres;
+
+  pthread_mutex_lock(&t->mutex);
+  rate = t->rate;
+  pthread_mutex_unlock(&t->mutex);
+
+  if (t->total > done)                 want = (t->total - done) / (double) (t->nworkers * NHMMER_BLOCKS_PER_THREAD);
+  if (t->overlap > NHMMER_OVERLAP_MAX) want = ESL_MAX(want, (double) blen * t->overlap / NHMMER_OVERLAP_MAX);
+  if (rate > 0.)                       want = ESL_MIN(ESL_MAX(want, rate * NHMMER_BLOCK_MINSECS), rate * NHMMER_BLOCK_MAXSECS);
+
+  want = ESL_MIN(ESL_MAX(want, (double) blen / 2.), (double) blen * 2.);
+  want = ESL_MIN(ESL_MAX(want, (double) NHMMER_BLOCK_MIN), (double) NHMMER_BLOCK_MAX);
+  return (int) want;
+}
+
+static void
+blocktune_Destroy(BLOCK_TUNER *t)
+{
+  if (t == NULL) return;
+  pthread_mutex_destroy(&t->mutex);
+  free(t);
+}
+
 #endif   /* HMMER_THREADS */
 
 
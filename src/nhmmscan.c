@@ -34,8 +34,11 @@ typedef struct {
   P7_TOPHITS       *th;          /* top hit results                         */
   float            *scores;
   float            *fwd_emissions; /* to hold residue emission probabilities in serial order (gathered from the optimized striped <om> with p7_oprofile_GetFwdEmissionArray() ). */
+  int               max_length;  /* largest model max_length seen; sets the overlap of query windows */
 } WORKER_INFO;
 
+#define NHMMSCAN_MAX_RESIDUE_COUNT (1024 * 1024 * 10)  /* 10 Mb */
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
@@ -73,14 +76,23 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,  "3e-3", NULL, NULL,    NULL,  NULL, "--max",          "Vit threshold: promote hits w/ P <= F2",                        7 },
   { "--F3",         eslARG_REAL,  "3e-5", NULL, NULL,    NULL,  NULL, "--max",          "Fwd threshold: promote hits w/ P <= F3",                        7 },
   { "--nobias",     eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                              7 },
+  { "--dd_ramlimit", eslARG_INT,    "0",  NULL, "n>=0",  NULL,  NULL, NULL,             "cap full envelope DP matrices at <n> MB (0: no cap)",           7 },
+  { "--dd_nbatch",  eslARG_INT,     "0",  NULL, "n>=0",  NULL,  NULL, NULL,             "sample domain traces in batches of <n>, stopping early",        7 },
+  { "--dd_bf16",    eslARG_NONE,    FALSE, NULL, NULL,   NULL,  NULL, NULL,             "keep envelope DP matrices in bfloat16 (half the memory)",       7 },
 
   /* Other options */
   { "--qformat",    eslARG_STRING,  NULL, NULL, NULL,    NULL,  NULL,  NULL,             "assert input <seqfile> is in format <s>",                      12 },
   { "--nonull2",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,             "turn off biased composition score corrections",                12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,             "set # of comparisons done, for E-value calculation",           12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,             "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
+  { "--timing",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,             "report time spent in each stage of the pipeline",              12 },
+  { "--memstats",   eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,             "report memory high-water marks of the pipeline",               12 },
+  { "--membudget",  eslARG_INT,    NULL,  NULL, "n>0",   NULL,  NULL,  NULL,             "keep each pipeline under <n> MB of DP memory",                 12 },
+  { "--nommap",     eslARG_NONE,   FALSE, NULL, NULL,    NULL,  NULL,  NULL,             "read pressed <hmmdb> with stdio, not mmap()",                  12 },
+  { "--hugepages",  eslARG_STRING, NULL,  NULL, NULL,    NULL,  NULL,  NULL,             "put big buffers in hugepages: <s> = off|thp|2M|1G",            12 },
   { "--w_beta",     eslARG_REAL,    NULL, NULL, NULL,    NULL,  NULL,  NULL,             "tail mass at which window length is determined",               12 },
   { "--w_length",   eslARG_INT,     NULL, NULL, NULL,    NULL,  NULL,  NULL,             "window length - essentially max expected hit length ",         12 },
+  { "--block_length", eslARG_INT,   NULL, NULL, "n>=50000", NULL, NULL,  NULL,             "length of blocks of the query sequence searched at a time",    12 },
   { "--watson",     eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,"--crick",          "only search the top strand",                                   12 },
   { "--crick",      eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,"--watson",         "only search the bottom strand",                                12 },
 #ifdef HMMER_THREADS
@@ -186,6 +198,9 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_hmmf
   if (strcmp(*ret_hmmfile, "-") == 0) 
     { if (puts("nhmmscan cannot read <hmm database> from stdin stream, because it must have hmmpress'ed auxfiles") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");   goto FAILURE;  }
 
+  if (esl_opt_IsOn(go, "--hugepages") && p7_hugemem_SetMode(esl_opt_GetString(go, "--hugepages")) != eslOK)
+    { if (printf("--hugepages takes off, thp, 2M or 1G, not %s\n", esl_opt_GetString(go, "--hugepages")) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+
   *ret_go = go;
   return eslOK;
   
@@ -231,6 +246,9 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--F2")        && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",            esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",            esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_ramlimit") && fprintf(ofp, "# domain definition RAM limit:     %d MB\n", esl_opt_GetInteger(go, "--dd_ramlimit"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_nbatch")  && fprintf(ofp, "# domain trace sample batch size:  %d\n", esl_opt_GetInteger(go, "--dd_nbatch"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_bf16")    && fprintf(ofp, "# bfloat16 envelope matrices:      on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--B1")         && fprintf(ofp, "# biased comp MSV window len:      %d\n",             esl_opt_GetInteger(go, "--B1"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--B2")         && fprintf(ofp, "# biased comp Viterbi window len:  %d\n",             esl_opt_GetInteger(go, "--B2"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -247,9 +265,15 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
     if (esl_opt_GetInteger(go, "--seed")==0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                              < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                                  fprintf(ofp, "# random number seed set to:       %d\n",        esl_opt_GetInteger(go, "--seed"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
+  if (esl_opt_IsUsed(go, "--timing")     && fprintf(ofp, "# pipeline stage timing:           on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--memstats")   && fprintf(ofp, "# pipeline memory statistics:      on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--membudget")  && fprintf(ofp, "# pipeline memory budget:          %d MB\n", esl_opt_GetInteger(go, "--membudget"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--nommap")     && fprintf(ofp, "# memory-mapped pressed database:  off\n")                                                < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hugepages")  && fprintf(ofp, "# hugepages for big buffers:       %s\n", esl_opt_GetString(go, "--hugepages"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--qformat")   && fprintf(ofp, "# input seqfile format asserted:   %s\n",            esl_opt_GetString(go, "--qformat"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--w_beta")     && fprintf(ofp, "# window length beta value:        %g\n",             esl_opt_GetReal(go, "--w_beta"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--w_length")   && fprintf(ofp, "# window length :                  %d\n",             esl_opt_GetInteger(go, "--w_length")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--block_length")&&fprintf(ofp, "# block length :                   %d\n",             esl_opt_GetInteger(go, "--block_length")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
  if (esl_opt_IsUsed(go, "--cpu")) {
     if (esl_opt_GetInteger(go, "--cpu") == 0) { if (fprintf(ofp, "# multithread parallelization:     off\n")                                         < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed"); }
@@ -316,6 +340,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              hstatus  = eslOK;
   int              sstatus  = eslOK;
   int              i;
+  int              block_length;                 /* residues read per window of the query           */
+  int              overlap_len;                  /* overlap of consecutive windows of the query     */
+  int64_t          seq_len;                      /* residues searched, summed over strands          */
 
   int              ncpus    = 0;
 
@@ -425,42 +452,23 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     }
 #endif
 
-  /* Outside loop: over each query sequence in <seqfile>. */
-  while ((sstatus = esl_sqio_Read(sqfp, qsq)) == eslOK)
+  /* Outside loop: over each query sequence in <seqfile>.
+   * A query is read and searched in windows of at most <block_length>
+   * residues (plus the overlap with the preceding window), so a query
+   * the size of a chromosome doesn't have to fit in memory at once.
+   */
+  block_length = (esl_opt_IsUsed(go, "--block_length") ? esl_opt_GetInteger(go, "--block_length") : NHMMSCAN_MAX_RESIDUE_COUNT);
+  sstatus = esl_sqio_ReadWindow(sqfp, 0, block_length, qsq);
+  while (sstatus == eslOK)
   {
-      if (sstatus == eslEMEM)                 p7_Fail("Memory allocation error reading sequence file\n", status);
-      if (sstatus == eslEINCONCEIVABLE)       p7_Fail("Unexpected error %d reading sequence file\n", status);
-     // if (qsq->L > NHMMER_MAX_RESIDUE_COUNT)  p7_Fail("Input sequence %s in file %s exceeds maximum length of %d bases.\n",  qsq->name, cfg->seqfile, NHMMER_MAX_RESIDUE_COUNT);
-
       nquery++;
       esl_stopwatch_Start(w);	                          
 
-      /* Open the target profile database */
-      status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
-      if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
-  
-#ifdef HMMER_THREADS
-      /* if we are threaded, create a lock to prevent multiple readers */
-      if (ncpus > 0)
-      {
-        status = p7_hmmfile_CreateLock(hfp);
-        if (status != eslOK) p7_Fail("Unexpected error %d creating lock\n", status);
-      }
-#endif
-
-      if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-
       for (i = 0; i < infocnt; ++i)
       {
         /* Create processing pipeline and hit list */
         info[i].th  = p7_tophits_Create();
         info[i].pli = p7_pipeline_Create(go, 100, 100, TRUE, p7_SCAN_MODELS); /* M_hint = 100, L_hint = 100 are just dummies for now */
-        info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
-
-        p7_pli_NewSeq(info[i].pli, qsq);
-        info[i].qsq = qsq;
 
         if (  esl_opt_IsUsed(go, "--watson") )
           info[i].pli->strands = p7_STRAND_TOPONLY;
@@ -470,29 +478,65 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
           info[i].pli->strands = p7_STRAND_BOTH;
 
         info[i].fwd_emissions = NULL;
+        info[i].max_length    = 0;
+      }
+
+      /* Inside loop: over the windows of the query; each one is searched against every model */
+      while (sstatus == eslOK)
+      {
+        /* Open the target profile database */
+        status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
+        if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
+        if (esl_opt_GetBoolean(go, "--nommap")) p7_hmmfile_Unmap(hfp);
+  
+#ifdef HMMER_THREADS
+        /* if we are threaded, create a lock to prevent multiple readers */
+        if (ncpus > 0)
+        {
+          status = p7_hmmfile_CreateLock(hfp);
+          if (status != eslOK) p7_Fail("Unexpected error %d creating lock\n", status);
+        }
+#endif
+
+        for (i = 0; i < infocnt; ++i)
+        {
+          info[i].pli->hfp = hfp;  /* for two-stage input, pipeline needs <hfp> */
+          p7_pli_NewSeq(info[i].pli, qsq);
+          info[i].pli->nres -= qsq->C; // to account for overlapping region of windows
+          info[i].qsq = qsq;
 
 #ifdef HMMER_THREADS
           if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
 #endif
-      }
+        }
 
 #ifdef HMMER_THREADS
-      if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp);
-      else	      hstatus = serial_loop(info, hfp);
+        if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp);
+        else	      hstatus = serial_loop(info, hfp);
 #else
-      hstatus = serial_loop(info, hfp);
+        hstatus = serial_loop(info, hfp);
 #endif
-      switch(hstatus)
-      {
-        case eslEFORMAT:   p7_Fail("bad file format in HMM file %s",             cfg->hmmfile);	  break;
-        case eslEINCOMPAT: p7_Fail("HMM file %s contains different alphabets",   cfg->hmmfile);	  break;
-        case eslEOF:
-        case eslOK:   /* do nothing */
-          break;
-        default: 	   p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile);
-      }
+        switch(hstatus)
+        {
+          case eslEFORMAT:   p7_Fail("bad file format in HMM file %s",             cfg->hmmfile);	  break;
+          case eslEINCOMPAT: p7_Fail("HMM file %s contains different alphabets",   cfg->hmmfile);	  break;
+          case eslEOF:
+          case eslOK:   /* do nothing */
+            break;
+          default: 	   p7_Fail("Unexpected error in reading HMMs from %s",   cfg->hmmfile);
+        }
+        p7_hmmfile_Close(hfp);
 
+        /* the next window overlaps this one by the longest model's max_length */
+        overlap_len = 0;
+        for (i = 0; i < infocnt; ++i) overlap_len = ESL_MAX(overlap_len, info[i].max_length);
+        sstatus = esl_sqio_ReadWindow(sqfp, overlap_len, block_length, qsq);
+      }
+      if (sstatus != eslEOD) break;  // a read error; reported below
 
+      if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->L) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      if (qsq->acc[0]  != 0 && fprintf(ofp, "Accession:   %s\n", qsq->acc)     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      if (qsq->desc[0] != 0 && fprintf(ofp, "Description: %s\n", qsq->desc)    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
       /* merge the results of the search results */
       for (i = 1; i < infocnt; ++i)
@@ -505,16 +549,20 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       }
 
 
-      /* modify e-value to account for number of models */
+      /* modify e-value to account for the length of the query (on each strand searched), and for number of models */
+      seq_len = 0;
+      if (info->pli->strands != p7_STRAND_TOPONLY && abc->complement != NULL) seq_len += qsq->L;
+      if (info->pli->strands != p7_STRAND_BOTTOMONLY)                         seq_len += qsq->L;
       for (i = 0; i < info->th->N ; i++)
       {
+        info->th->unsrt[i].lnP         += log((float)seq_len / (float)info->th->unsrt[i].window_length);
         info->th->unsrt[i].lnP         += log((float)info->pli->nmodels);
         info->th->unsrt[i].dcl[0].lnP   = info->th->unsrt[i].lnP;
         info->th->unsrt[i].sortkey      = -1.0 * info->th->unsrt[i].lnP;
       }
 
 
-      /* it's possible to have duplicates based on how viterbi ranges can overlap */
+      /* it's possible to have duplicates based on how viterbi ranges can overlap, and where query windows overlap */
       p7_tophits_SortByModelnameAndAlipos(info->th);
       p7_tophits_RemoveDuplicates(info->th, info->pli->use_bit_cutoffs);
 
@@ -535,7 +583,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 
       p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+      p7_tophits_DomainsThreaded(ofp, info->th, info->pli, textw, ncpus); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
       if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
       if (dfamtblfp) p7_tophits_TabularXfam(dfamtblfp,   qsq->name, NULL, info->th, info->pli);
@@ -546,10 +594,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
       fflush(ofp);
 
-      p7_hmmfile_Close(hfp);
       p7_pipeline_Destroy(info->pli);
       p7_tophits_Destroy(info->th);
       esl_sq_Reuse(qsq);
+
+      sstatus = esl_sqio_ReadWindow(sqfp, 0, block_length, qsq);
   }
 
 
@@ -603,8 +652,7 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
 {
   int            status;
   int i;
-  int seq_len = 0;
-  int prev_hit_cnt = 0;
+  int prev_hit_cnt = info->th->N;  /* hits from earlier windows of the query are already finished */
   P7_OPROFILE   *om        = NULL;
   P7_SCOREDATA  *scoredata = NULL;   /* hmm-specific data used by nhmmer */
   ESL_ALPHABET  *abc = NULL;
@@ -615,15 +663,14 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
     esl_sq_Copy(info->qsq,sq_revcmp);
     esl_sq_ReverseComplement(sq_revcmp);
 
-    info->pli->nres += info->qsq->n;
+    info->pli->nres += info->qsq->W;  // residues of this window not already counted in the previous one
   }
 
   /* Main loop: */
   while ((status = p7_oprofile_ReadMSV(hfp, &abc, &om)) == eslOK)
   {
-      seq_len = 0;
-
       p7_pli_NewModel(info->pli, om, info->bg);
+      info->max_length = ESL_MAX(info->max_length, om->max_length);
       p7_bg_SetLength(info->bg, info->qsq->n);
       p7_oprofile_ReconfigLength(om, info->qsq->n);
 
@@ -651,7 +698,6 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
         if (status != eslOK) p7_Fail(info->pli->errbuf);
 
         p7_pipeline_Reuse(info->pli); // prepare for next search
-        seq_len = info->qsq->n;
       }
 
       if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
@@ -659,14 +705,11 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
         if (status != eslOK) p7_Fail(info->pli->errbuf);
 
         p7_pipeline_Reuse(info->pli);
-        seq_len += info->qsq->n;
       }
 
+      /* the query-length correction of the E-values waits until the whole query has been read; see serial_master() */
       for (i = prev_hit_cnt; i < info->th->N ; i++)
       {
-        info->th->unsrt[i].lnP         += log((float)seq_len / (float)om->max_length);
-        info->th->unsrt[i].dcl[0].lnP   = info->th->unsrt[i].lnP;
-        info->th->unsrt[i].sortkey      = -1.0 * info->th->unsrt[i].lnP;
         info->th->unsrt[i].dcl[0].ad->L =  om->M;
       }
 
@@ -747,8 +790,7 @@ pipeline_thread(void *arg)
   P7_OPROFILE   *om        = NULL;
   P7_SCOREDATA  *scoredata = NULL;   /* hmm-specific data used by nhmmer */
 
-  int seq_len = 0;
-  int prev_hit_cnt = 0;
+  int prev_hit_cnt;
   ESL_SQ        *sq_revcmp = NULL;
 
   impl_Init();
@@ -757,6 +799,7 @@ pipeline_thread(void *arg)
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+  prev_hit_cnt = info->th->N;
 
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) esl_fatal("Work queue worker failed");
@@ -766,7 +809,7 @@ pipeline_thread(void *arg)
     sq_revcmp =  esl_sq_CreateDigital(info->qsq->abc);
     esl_sq_Copy(info->qsq,sq_revcmp);
     esl_sq_ReverseComplement(sq_revcmp);
-    info->pli->nres += info->qsq->n;
+    info->pli->nres += info->qsq->W;
   }
 
   /* loop until all blocks have been processed */
@@ -777,9 +820,8 @@ pipeline_thread(void *arg)
       for (i = 0; i < block->count; ++i)
       {
         om = block->list[i];
-        seq_len = 0;
-
         p7_pli_NewModel(info->pli, om, info->bg);
+        info->max_length = ESL_MAX(info->max_length, om->max_length);
         p7_bg_SetLength(info->bg, info->qsq->n);
         p7_oprofile_ReconfigLength(om, info->qsq->n);
 
@@ -807,22 +849,18 @@ pipeline_thread(void *arg)
           if (status != eslOK) p7_Fail(info->pli->errbuf);
 
           p7_pipeline_Reuse(info->pli); // prepare for next search
-          seq_len = info->qsq->n;
-        }
+          }
 
         if (info->pli->strands != p7_STRAND_BOTTOMONLY) {
           status = p7_Pipeline_LongTarget(info->pli, om, scoredata, info->bg, info->th, 0, info->qsq, p7_NOCOMPLEMENT, NULL, NULL, NULL/*, NULL, NULL, NULL*/);
           if (status != eslOK) p7_Fail(info->pli->errbuf);
 
           p7_pipeline_Reuse(info->pli);
-          seq_len += info->qsq->n;
-        }
+          }
 
+        /* the query-length correction of the E-values waits until the whole query has been read; see serial_master() */
         for (j = prev_hit_cnt; j < info->th->N ; j++)
         {
-          info->th->unsrt[j].lnP         += log((float)seq_len / (float)om->max_length);
-          info->th->unsrt[j].dcl[0].lnP   = info->th->unsrt[j].lnP;
-          info->th->unsrt[j].sortkey      = -1.0 * info->th->unsrt[j].lnP;
           info->th->unsrt[j].dcl[0].ad->L = om->M;
         }
 
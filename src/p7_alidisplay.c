@@ -28,6 +28,7 @@
 #define PPLINE_PRESENT (1 << 3)
 #define ASEQ_PRESENT (1 << 4)
 #define NTSEQ_PRESENT (1 << 5)
+#define ZDATA_PRESENT (1 << 6)  // display lines are in the compact form; rf/mm/cs/pp bits then say which it has
 
 /*****************************************************************
  * 1. The P7_ALIDISPLAY object
@@ -90,6 +91,30 @@
  */
 P7_ALIDISPLAY *
 p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq)
+{
+  return p7_alidisplay_CreateInArena(NULL, tr, which, om, sq, ntsq);
+}
+
+/* Function:  p7_alidisplay_CreateInArena()
+ * Synopsis:  Create an alignment display in a hit list's arena.
+ *
+ * Purpose:   Same as <p7_alidisplay_Create()>, but if <arena> is
+ *            non-<NULL>, the display and its strings are allocated as
+ *            one piece of <arena> memory instead of with two
+ *            <malloc()>'s. The display is then owned by the arena:
+ *            <p7_alidisplay_Destroy()> on it is a no-op, and it is
+ *            freed in bulk with the arena (normally that of the
+ *            <P7_TOPHITS> list it's going to end up in).
+ *
+ *            If <arena> is <NULL>, this is <p7_alidisplay_Create()>.
+ *
+ * Returns:   ptr to the new display.
+ *
+ * Throws:    <NULL> on allocation failure, or if something's internally corrupt 
+ *            in the data.
+ */
+P7_ALIDISPLAY *
+p7_alidisplay_CreateInArena(P7_ARENA *arena, const P7_TRACE *tr, int which, const P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq)
 {
   P7_ALIDISPLAY *ad       = NULL;
   char          *Alphabet = om->abc->sym;
@@ -144,12 +169,26 @@ p7_alidisplay_Create(const P7_TRACE *tr, int which, const P7_OPROFILE *om, const
   sq_acclen   = strlen(sq->acc);                            n += sq_acclen   + 1; /* sq->acc is "\0" when unset */
   sq_desclen  = strlen(sq->desc);                           n += sq_desclen  + 1; /* same for desc              */
  
-  ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
-  ad->mem = NULL;
+  if (arena)
+    { /* display and its strings, in one piece of arena memory */
+      if ((ad = p7_arena_Alloc(arena, sizeof(P7_ALIDISPLAY) + sizeof(char) * n)) == NULL) { status = eslEMEM; goto ERROR; }
+      ad->mem      = (char *) ad + sizeof(P7_ALIDISPLAY);
+      ad->memsize  = sizeof(char) * n;
+      ad->in_arena = TRUE;
+    }
+  else
+    {
+      ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
+      ad->mem      = NULL;
+      ad->in_arena = FALSE;
+      ad->memsize  = sizeof(char) * n;
+      ESL_ALLOC(ad->mem, ad->memsize);
+    }
+  ad->zdata  = NULL;
+  ad->zsize  = 0;
+  ad->zflags = 0;
 
   pos = 0; 
-  ad->memsize = sizeof(char) * n;
-  ESL_ALLOC(ad->mem, ad->memsize);
   if (om->rf[0]  != 0) { ad->rfline = ad->mem + pos; pos += z2-z1+2; } else { ad->rfline = NULL; }
   //if (om->mm[0]  != 0) { ad->mmline = ad->mem + pos; pos += z2-z1+2; } else { ad->mmline = NULL; }
   ad->mmline = NULL;
@@ -303,6 +342,10 @@ extern P7_ALIDISPLAY *p7_alidisplay_Create_empty()
 
   new_obj->memsize = 0;
   new_obj->mem = NULL;
+  new_obj->in_arena = FALSE;
+  new_obj->zdata = NULL;
+  new_obj->zsize = 0;
+  new_obj->zflags = 0;
 
   return new_obj;
 
@@ -332,8 +375,12 @@ p7_alidisplay_Clone(const P7_ALIDISPLAY *ad)
   ad2->sqname  = ad2->sqacc  = ad2->sqdesc  = NULL;
   ad2->mem     = NULL;
   ad2->memsize = 0;
+  ad2->in_arena = FALSE;
+  ad2->zdata   = NULL;
+  ad2->zsize   = ad->zsize;
+  ad2->zflags  = ad->zflags;
 
-  if (ad->memsize) 		/* serialized */
+  if (ad->memsize) 		/* serialized, or compact */
     {
       ESL_ALLOC(ad2->mem, sizeof(char) * ad->memsize);
       ad2->memsize = ad->memsize;
@@ -342,9 +389,10 @@ p7_alidisplay_Clone(const P7_ALIDISPLAY *ad)
       ad2->rfline = (ad->rfline ? ad2->mem + (ad->rfline - ad->mem) : NULL );
       ad2->mmline = (ad->mmline ? ad2->mem + (ad->mmline - ad->mem) : NULL );
       ad2->csline = (ad->csline ? ad2->mem + (ad->csline - ad->mem) : NULL );
-      ad2->model  = ad2->mem + (ad->model  - ad->mem);
-      ad2->mline  = ad2->mem + (ad->mline  - ad->mem);
-      ad2->aseq   = ad2->mem + (ad->aseq   - ad->mem);
+      ad2->model  = (ad->model  ? ad2->mem + (ad->model  - ad->mem) : NULL );
+      ad2->mline  = (ad->mline  ? ad2->mem + (ad->mline  - ad->mem) : NULL );
+      ad2->aseq   = (ad->aseq   ? ad2->mem + (ad->aseq   - ad->mem) : NULL );
+      ad2->zdata  = (ad->zdata  ? ad2->mem + (ad->zdata  - ad->mem) : NULL );
       ad2->ntseq  = (ad->ntseq  ? ad2->mem + (ad->ntseq  - ad->mem) : NULL );
       ad2->ppline = (ad->ppline ? ad2->mem + (ad->ppline - ad->mem) : NULL );
       ad2->N      = ad->N;
@@ -416,6 +464,8 @@ p7_alidisplay_Sizeof(const P7_ALIDISPLAY *ad)
 {
   size_t n = sizeof(P7_ALIDISPLAY);
 
+  if (ad->zdata) return n + ad->memsize; /* compact form: everything is in <mem> */
+
   if (ad->rfline) n += ad->N+1; /* +1 for \0 */
   if (ad->mmline) n += ad->N+1;
   if (ad->csline) n += ad->N+1; 
@@ -433,9 +483,474 @@ p7_alidisplay_Sizeof(const P7_ALIDISPLAY *ad)
 }
 
 
+/* The compact form of an alidisplay.
+ *
+ * Held in memory for a long time, as in hmmpgmd's master, most of an
+ * alidisplay's size is its display lines, which are mostly
+ * redundant with each other: the state of each column is implied by
+ * model ('.' for I) and aseq ('-' for D), an I column has no
+ * model/RF/CS characters, a D column has no residue or posterior
+ * probability, and the mline is one of three things. The compact
+ * form stores only the information, in one block <zdata>:
+ *
+ *    runs       one byte per run of M/I/D columns: state in the top 2
+ *               bits, run length-1 (up to p7_ALIDISPLAY_ZRUNMAX) below
+ *    residues   aseq characters of the M and I columns
+ *    model      model characters of the M and D columns
+ *    mline      2-bit codes for M columns (' ', '+', or the model
+ *               character), four per byte
+ *    rf, mm, cs the M and D columns of each line that's present
+ *    pp         the M and I columns of the ppline, as 4-bit codes
+ *               (0-9 for '0'..'9', 10 for '*'), two per byte
+ *
+ * <zdata> lives in <mem>, with the name/accession/description strings
+ * and the ntseq (if any), which stay as they are. The display line
+ * pointers are NULL while an alidisplay is compact.
+ */
+#define p7_ALIDISPLAY_ZRUNMAX 64
+enum alidisplay_zstate_e { ZST_M = 0, ZST_I = 1, ZST_D = 2 };
+
+/* a compact block's section pointers, given its counts */
+struct alidisplay_zlayout_s {
+  int      nrun, nm, ni, nd;
+  uint8_t *run;
+  char    *res;
+  char    *mod;
+  uint8_t *mlc;
+  char    *rf, *mm, *cs;
+  uint8_t *pp;
+  int      zsize;
+};
+
+static int
+alidisplay_zstate(const P7_ALIDISPLAY *ad, int z)
+{
+  if (ad->model[z] == '.') return ZST_I;
+  if (ad->aseq[z]  == '-') return ZST_D;
+  return ZST_M;
+}
+
+static int
+alidisplay_zcode_pp(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c == '*')             return 10;
+  return -1;
+}
+
+/* alidisplay_zlayout()
+ *
+ * Given the counts in <zl> and the optional lines <zflags> present,
+ * set <zl>'s section pointers into <zdata> (which may be NULL, for
+ * just computing <zl->zsize>).
+ */
+static void
+alidisplay_zlayout(struct alidisplay_zlayout_s *zl, int zflags, char *zdata)
+{
+  int nmd = zl->nm + zl->nd;
+  int nmi = zl->nm + zl->ni;
+  int pos = 0;
+
+  zl->run = (uint8_t *) zdata + pos;  pos += zl->nrun;
+  zl->res = zdata + pos;              pos += nmi;
+  zl->mod = zdata + pos;              pos += nmd;
+  zl->mlc = (uint8_t *) zdata + pos;  pos += (zl->nm + 3) / 4;
+  zl->rf  = zdata + pos;              pos += (zflags & RFLINE_PRESENT ? nmd : 0);
+  zl->mm  = zdata + pos;              pos += (zflags & MMLINE_PRESENT ? nmd : 0);
+  zl->cs  = zdata + pos;              pos += (zflags & CSLINE_PRESENT ? nmd : 0);
+  zl->pp  = (uint8_t *) zdata + pos;  pos += (zflags & PPLINE_PRESENT ? (nmi + 1) / 2 : 0);
+  zl->zsize = pos;
+}
+
+/* alidisplay_zcount()
+ *
+ * Decode the runs at the start of the compact block <zdata> of an
+ * alidisplay of <N> columns, setting the counts in <zl>. At most
+ * <zmax> bytes of <zdata> are read. Returns <eslOK>; or <eslFAIL> if
+ * the runs don't describe exactly <N> columns within <zmax> bytes.
+ */
+static int
+alidisplay_zcount(struct alidisplay_zlayout_s *zl, const char *zdata, int N, int zmax)
+{
+  int z, s, len;
+
+  zl->nrun = zl->nm = zl->ni = zl->nd = 0;
+  for (z = 0; z < N; z += len, zl->nrun++)
+    {
+      if (zl->nrun >= zmax) return eslFAIL;
+      s   = ((uint8_t) zdata[zl->nrun]) >> 6;
+      len = (((uint8_t) zdata[zl->nrun]) & 0x3f) + 1;
+      if      (s == ZST_M) zl->nm += len;
+      else if (s == ZST_I) zl->ni += len;
+      else if (s == ZST_D) zl->nd += len;
+      else return eslFAIL;
+    }
+  return (z == N ? eslOK : eslFAIL);
+}
+
+/* alidisplay_zcheck()
+ *
+ * Check that the display lines of <ad> can be represented exactly in
+ * the compact form, and if so, count its runs and columns in <zl>.
+ * Returns <eslOK> if they can; <eslFAIL> if not.
+ */
+static int
+alidisplay_zcheck(const P7_ALIDISPLAY *ad, struct alidisplay_zlayout_s *zl)
+{
+  int z, s;
+  int prv = -1;
+  int len = 0;
+
+  if (ad->model == NULL || ad->mline == NULL || ad->aseq == NULL) return eslFAIL;
+  zl->nrun = zl->nm = zl->ni = zl->nd = 0;
+  for (z = 0; z < ad->N; z++)
+    {
+      s = alidisplay_zstate(ad, z);
+      if (s == ZST_M && ad->mline[z] != ' ' && ad->mline[z] != '+' && ad->mline[z] != ad->model[z]) return eslFAIL;
+      if (s != ZST_M && ad->mline[z] != ' ')                                                          return eslFAIL;
+      if (s == ZST_I && ((ad->rfline && ad->rfline[z] != '.') ||
+			 (ad->mmline && ad->mmline[z] != '.') ||
+			 (ad->csline && ad->csline[z] != '.')))                                         return eslFAIL;
+      if (ad->ppline && (s == ZST_D ? ad->ppline[z] != '.' : alidisplay_zcode_pp(ad->ppline[z]) < 0)) return eslFAIL;
+
+      if      (s == ZST_M) zl->nm++;
+      else if (s == ZST_I) zl->ni++;
+      else                 zl->nd++;
+      if (s != prv || len == p7_ALIDISPLAY_ZRUNMAX) { zl->nrun++; prv = s; len = 0; }
+      len++;
+    }
+  return eslOK;
+}
+
+/* alidisplay_zencode()
+ *
+ * Encode the display lines of <ad> in <zdata>, laid out by <zl>
+ * (after <alidisplay_zcheck()> and <alidisplay_zlayout()>).
+ */
+static void
+alidisplay_zencode(const P7_ALIDISPLAY *ad, struct alidisplay_zlayout_s *zl, char *zdata)
+{
+  int z, s;
+  int nr = 0, nmi = 0, nmd = 0, nm = 0;
+  int prv = -1;
+  int len = 0;
+  int code;
+
+  memset(zdata, 0, zl->zsize);	/* mline and pp codes are OR'ed in */
+  for (z = 0; z < ad->N; z++)
+    {
+      s = alidisplay_zstate(ad, z);
+      if (s != prv || len == p7_ALIDISPLAY_ZRUNMAX)
+	{
+	  if (prv != -1) zl->run[nr++] = (uint8_t) ((prv << 6) | (len-1));
+	  prv = s;
+	  len = 0;
+	}
+      len++;
+
+      if (s != ZST_D)
+	{
+	  zl->res[nmi] = ad->aseq[z];
+	  if (ad->ppline) zl->pp[nmi/2] |= (uint8_t) (alidisplay_zcode_pp(ad->ppline[z]) << (4 * (nmi%2)));
+	  nmi++;
+	}
+      if (s != ZST_I)
+	{
+	  zl->mod[nmd] = ad->model[z];
+	  if (ad->rfline) zl->rf[nmd] = ad->rfline[z];
+	  if (ad->mmline) zl->mm[nmd] = ad->mmline[z];
+	  if (ad->csline) zl->cs[nmd] = ad->csline[z];
+	  nmd++;
+	}
+      if (s == ZST_M)
+	{
+	  code = (ad->mline[z] == ad->model[z] ? 2 : (ad->mline[z] == '+' ? 1 : 0));
+	  zl->mlc[nm/4] |= (uint8_t) (code << (2 * (nm%4)));
+	  nm++;
+	}
+    }
+  if (prv != -1) zl->run[nr++] = (uint8_t) ((prv << 6) | (len-1));
+}
+
+/* alidisplay_expanded_copy()
+ *
+ * Return a new, normal (serialized-form) copy of compact alidisplay
+ * <ad>, with its display lines decoded; or <NULL> on allocation
+ * failure.
+ */
+static P7_ALIDISPLAY *
+alidisplay_expanded_copy(const P7_ALIDISPLAY *ad)
+{
+  P7_ALIDISPLAY *ad2 = NULL;
+  struct alidisplay_zlayout_s zl;
+  int            nlines = 3;
+  int            z, r, s, len;
+  int            nmi = 0, nmd = 0, nm = 0;
+  int            code;
+  int            pos, n;
+  int            status;
+
+  /* decode the runs, to get the counts and find the other sections */
+  if (alidisplay_zcount(&zl, ad->zdata, ad->N, ad->zsize) != eslOK) goto ERROR;
+  alidisplay_zlayout(&zl, ad->zflags, ad->zdata);
+
+  if (ad->zflags & RFLINE_PRESENT) nlines++;
+  if (ad->zflags & MMLINE_PRESENT) nlines++;
+  if (ad->zflags & CSLINE_PRESENT) nlines++;
+  if (ad->zflags & PPLINE_PRESENT) nlines++;
+
+  ESL_ALLOC(ad2, sizeof(P7_ALIDISPLAY));
+  *ad2 = *ad;
+  ad2->mem      = NULL;
+  ad2->zdata    = NULL;
+  ad2->zsize    = 0;
+  ad2->zflags   = 0;
+  ad2->in_arena = FALSE;
+  ad2->memsize  = ad->memsize - ad->zsize + nlines * (ad->N+1);
+  ESL_ALLOC(ad2->mem, ad2->memsize);
+
+  /* same layout as p7_alidisplay_Serialize_old() */
+  pos = 0;
+  if (ad->zflags & RFLINE_PRESENT) { ad2->rfline = ad2->mem + pos; pos += ad->N+1; } else ad2->rfline = NULL;
+  if (ad->zflags & MMLINE_PRESENT) { ad2->mmline = ad2->mem + pos; pos += ad->N+1; } else ad2->mmline = NULL;
+  if (ad->zflags & CSLINE_PRESENT) { ad2->csline = ad2->mem + pos; pos += ad->N+1; } else ad2->csline = NULL;
+  ad2->model = ad2->mem + pos; pos += ad->N+1;
+  ad2->mline = ad2->mem + pos; pos += ad->N+1;
+  ad2->aseq  = ad2->mem + pos; pos += ad->N+1;
+  if (ad->ntseq) { memcpy(ad2->mem + pos, ad->ntseq, 3*ad->N+1); ad2->ntseq = ad2->mem + pos; pos += 3*ad->N+1; }
+  if (ad->zflags & PPLINE_PRESENT) { ad2->ppline = ad2->mem + pos; pos += ad->N+1; } else ad2->ppline = NULL;
+  n = 1 + strlen(ad->hmmname);  memcpy(ad2->mem + pos, ad->hmmname, n); ad2->hmmname = ad2->mem + pos; pos += n;
+  n = 1 + strlen(ad->hmmacc);   memcpy(ad2->mem + pos, ad->hmmacc,  n); ad2->hmmacc  = ad2->mem + pos; pos += n;
+  n = 1 + strlen(ad->hmmdesc);  memcpy(ad2->mem + pos, ad->hmmdesc, n); ad2->hmmdesc = ad2->mem + pos; pos += n;
+  n = 1 + strlen(ad->sqname);   memcpy(ad2->mem + pos, ad->sqname,  n); ad2->sqname  = ad2->mem + pos; pos += n;
+  n = 1 + strlen(ad->sqacc);    memcpy(ad2->mem + pos, ad->sqacc,   n); ad2->sqacc   = ad2->mem + pos; pos += n;
+  n = 1 + strlen(ad->sqdesc);   memcpy(ad2->mem + pos, ad->sqdesc,  n); ad2->sqdesc  = ad2->mem + pos; pos += n;
+
+  for (z = 0, r = 0; r < zl.nrun; r++)
+    {
+      s   = zl.run[r] >> 6;
+      len = (zl.run[r] & 0x3f) + 1;
+      for ( ; len > 0; len--, z++)
+	{
+	  if (s != ZST_D)
+	    {
+	      ad2->aseq[z] = zl.res[nmi];
+	      if (ad2->ppline) {
+		code = (zl.pp[nmi/2] >> (4 * (nmi%2))) & 0xf;
+		ad2->ppline[z] = (code == 10 ? '*' : '0' + code);
+	      }
+	      nmi++;
+	    }
+	  else
+	    {
+	      ad2->aseq[z] = '-';
+	      if (ad2->ppline) ad2->ppline[z] = '.';
+	    }
+
+	  if (s != ZST_I)
+	    {
+	      ad2->model[z] = zl.mod[nmd];
+	      if (ad2->rfline) ad2->rfline[z] = zl.rf[nmd];
+	      if (ad2->mmline) ad2->mmline[z] = zl.mm[nmd];
+	      if (ad2->csline) ad2->csline[z] = zl.cs[nmd];
+	      nmd++;
+	    }
+	  else
+	    {
+	      ad2->model[z] = '.';
+	      if (ad2->rfline) ad2->rfline[z] = '.';
+	      if (ad2->mmline) ad2->mmline[z] = '.';
+	      if (ad2->csline) ad2->csline[z] = '.';
+	    }
+
+	  if (s == ZST_M)
+	    {
+	      code = (zl.mlc[nm/4] >> (2 * (nm%4))) & 0x3;
+	      ad2->mline[z] = (code == 2 ? ad2->model[z] : (code == 1 ? '+' : ' '));
+	      nm++;
+	    }
+	  else ad2->mline[z] = ' ';
+	}
+    }
+  ad2->model[ad->N] = ad2->mline[ad->N] = ad2->aseq[ad->N] = '\0';
+  if (ad2->rfline) ad2->rfline[ad->N] = '\0';
+  if (ad2->mmline) ad2->mmline[ad->N] = '\0';
+  if (ad2->csline) ad2->csline[ad->N] = '\0';
+  if (ad2->ppline) ad2->ppline[ad->N] = '\0';
+  return ad2;
+
+ ERROR:
+  if (ad2) { if (ad2->mem) free(ad2->mem); free(ad2); }
+  return NULL;
+}
+
+
+/* Function:  p7_alidisplay_Compress()
+ * Synopsis:  Convert an alidisplay to its compact form.
+ *
+ * Purpose:   Convert alignment display <ad> to a compact form that
+ *            stores its state path as runs, plus the target residues
+ *            and model characters once each, instead of full-length
+ *            display lines. This is for alidisplays that are held in
+ *            memory a long time without being shown, like the
+ *            results in hmmpgmd's master.
+ *
+ *            A compact alidisplay has <NULL> display line pointers
+ *            (<model>, <mline>, <aseq> and the optional lines). The
+ *            P7_ALIDISPLAY API works on it and expands it as needed:
+ *            <p7_alidisplay_Print()>, <_Serialize()>, <_Backconvert()>
+ *            and the debugging functions decode a temporary copy.
+ *            Code that reads the display lines directly must call
+ *            <p7_alidisplay_Expand()> first. <p7_alidisplay_Sizeof()>
+ *            reports the compact size.
+ *
+ *            Does nothing if <ad> is already compact; if it's in an
+ *            arena or in the old deserialized form; or if its lines
+ *            have something the compact form can't reproduce exactly
+ *            (they always can for an alidisplay made by
+ *            <p7_alidisplay_Create()>).
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <ad> is unchanged.
+ */
+int
+p7_alidisplay_Compress(P7_ALIDISPLAY *ad)
+{
+  struct alidisplay_zlayout_s zl;
+  char *mem = NULL;
+  int   zflags = 0;
+  int   memsize;
+  int   pos, n;
+  int   status;
+
+  if (ad->zdata || ad->in_arena || ad->mem == NULL) return eslOK;
+  if (alidisplay_zcheck(ad, &zl) != eslOK)            return eslOK;
+
+  if (ad->rfline) zflags |= RFLINE_PRESENT;
+  if (ad->mmline) zflags |= MMLINE_PRESENT;
+  if (ad->csline) zflags |= CSLINE_PRESENT;
+  if (ad->ppline) zflags |= PPLINE_PRESENT;
+  alidisplay_zlayout(&zl, zflags, NULL);
+
+  memsize = zl.zsize + (ad->ntseq ? 3*ad->N+1 : 0) +
+    strlen(ad->hmmname) + strlen(ad->hmmacc) + strlen(ad->hmmdesc) +
+    strlen(ad->sqname)  + strlen(ad->sqacc)  + strlen(ad->sqdesc)  + 6;
+  ESL_ALLOC(mem, memsize);
+
+  alidisplay_zlayout(&zl, zflags, mem);
+  alidisplay_zencode(ad, &zl, mem);
+  pos = zl.zsize;
+  if (ad->ntseq) { memcpy(mem + pos, ad->ntseq, 3*ad->N+1); ad->ntseq = mem + pos; pos += 3*ad->N+1; }
+  n = 1 + strlen(ad->hmmname);  memcpy(mem + pos, ad->hmmname, n); ad->hmmname = mem + pos; pos += n;
+  n = 1 + strlen(ad->hmmacc);   memcpy(mem + pos, ad->hmmacc,  n); ad->hmmacc  = mem + pos; pos += n;
+  n = 1 + strlen(ad->hmmdesc);  memcpy(mem + pos, ad->hmmdesc, n); ad->hmmdesc = mem + pos; pos += n;
+  n = 1 + strlen(ad->sqname);   memcpy(mem + pos, ad->sqname,  n); ad->sqname  = mem + pos; pos += n;
+  n = 1 + strlen(ad->sqacc);    memcpy(mem + pos, ad->sqacc,   n); ad->sqacc   = mem + pos; pos += n;
+  n = 1 + strlen(ad->sqdesc);   memcpy(mem + pos, ad->sqdesc,  n); ad->sqdesc  = mem + pos; pos += n;
+
+  free(ad->mem);
+  ad->mem     = mem;
+  ad->memsize = memsize;
+  ad->zdata   = mem;
+  ad->zsize   = zl.zsize;
+  ad->zflags  = zflags;
+  ad->rfline  = ad->mmline = ad->csline = ad->model = ad->mline = ad->aseq = ad->ppline = NULL;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_alidisplay_Expand()
+ * Synopsis:  Convert a compact alidisplay back to its normal form.
+ *
+ * Purpose:   If <ad> is compact (see <p7_alidisplay_Compress()>),
+ *            decode its display lines and convert it back to the
+ *            normal form. Otherwise, do nothing.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <ad> is unchanged.
+ */
+int
+p7_alidisplay_Expand(P7_ALIDISPLAY *ad)
+{
+  P7_ALIDISPLAY *ad2;
+
+  if (ad->zdata == NULL) return eslOK;
+  if ((ad2 = alidisplay_expanded_copy(ad)) == NULL) ESL_EXCEPTION(eslEMEM, "allocation failed expanding alidisplay");
+
+  free(ad->mem);
+  *ad = *ad2;
+  free(ad2);
+  return eslOK;
+}
+
+
 #define SER_BASE_SIZE ((5 * sizeof(int)) + (3 * sizeof(int64_t)) +1) // Total size of the fixed-length fields in a 
 // serialized P7_ALIDISPLAY 
 
+/* alidisplay_serialize_fixed()
+ *
+ * Write the fixed-length fields of serialized <obj>, of total size
+ * <ser_size> and with presence flags <presence_flags>, at <ptr>.
+ * Return the position just after them.
+ */
+static uint8_t *
+alidisplay_serialize_fixed(const P7_ALIDISPLAY *obj, uint32_t ser_size, uint8_t presence_flags, uint8_t *ptr)
+{
+  uint32_t network_32bit; // hold 32-bit fields after conversion to network order
+  uint64_t network_64bit; // hold 64-bit fields after conversion to network order
+
+  // Field 1: size of the serialized object
+  network_32bit = esl_hton32(ser_size);
+  memcpy(ptr, &network_32bit, sizeof(uint32_t)); // Write size of the serialized object into the buffer
+  ptr += sizeof(uint32_t);
+
+  // Field 2: N
+  network_32bit = esl_hton32(obj->N);
+  memcpy(ptr, &network_32bit, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+ 
+  // Field 3: Hmmfrom field
+  network_32bit = esl_hton32(obj->hmmfrom);
+  memcpy(ptr, &network_32bit, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+
+  // Field 4: Hmmto field
+  network_32bit = esl_hton32(obj->hmmto);
+  memcpy(ptr, &network_32bit, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+
+  // Field 5: M field
+  network_32bit = esl_hton32(obj->M);
+  memcpy(ptr, &network_32bit, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+
+  // Field 6: Sqfrom
+  network_64bit = esl_hton64(obj->sqfrom);
+  memcpy(ptr, &network_64bit, sizeof(int64_t));
+  ptr += sizeof(int64_t);
+
+  // Field 7: Sqto
+  network_64bit = esl_hton64(obj->sqto);
+  memcpy(ptr, &network_64bit, sizeof(int64_t));
+  ptr += sizeof(int64_t);
+
+  // Field 8: L
+  network_64bit = esl_hton64(obj->L);
+  memcpy(ptr, &network_64bit, sizeof(int64_t));
+  ptr += sizeof(int64_t);
+
+  // Field 9: presence_flags
+  memcpy(ptr, &presence_flags, sizeof(uint8_t));
+  ptr += sizeof(uint8_t);
+
+  return ptr;
+}
+
 /* Function:  p7_alidisplay_Serialize
  * Synopsis:  Serializes a HMMD_SEARCH_STATS object into a stream of bytes
  *.           that can be reliably transmitted over internet sockets
@@ -466,8 +981,6 @@ int p7_alidisplay_Serialize(const P7_ALIDISPLAY *obj, uint8_t **buf, uint32_t *n
   int status; // error variable used by ESL_ALLOC
   uint32_t ser_size; // size of the structure when serialized
   uint8_t *ptr; // current position within the buffer
-  uint32_t network_32bit; // hold 32-bit fields after conversion to network order
-  uint64_t network_64bit; // hold 64-bit fields after conversion to network order
   uint8_t presence_flags = 0; // Bit-vector that records presence or absence of optional strings
   uint32_t hmmname_length, hmmacc_length, hmmdesc_length, sqname_length, sqacc_length, sqdesc_length;
 
@@ -476,6 +989,15 @@ int p7_alidisplay_Serialize(const P7_ALIDISPLAY *obj, uint8_t **buf, uint32_t *n
     return(eslEINVAL);
   }
 
+  // A compact alidisplay is serialized in the normal form, from a temporary expanded copy
+  if(obj->zdata != NULL){
+    P7_ALIDISPLAY *expanded;
+    if((expanded = alidisplay_expanded_copy(obj)) == NULL) ESL_EXCEPTION(eslEMEM, "allocation failed expanding alidisplay");
+    status = p7_alidisplay_Serialize(expanded, buf, n, nalloc);
+    p7_alidisplay_Destroy(expanded);
+    return status;
+  }
+
   // Pass 1: Compute size of the serialized data structure
   /* 11 ints: 4 int fields in P7_ALIDISPLAY + lengths of 6 variable-length strings + total length of serialized structure
      3 int64_t fields in P7_ALIDISPLAY
@@ -554,48 +1076,7 @@ int p7_alidisplay_Serialize(const P7_ALIDISPLAY *obj, uint8_t **buf, uint32_t *n
   //First, the fixed-length field
   ptr = *buf + *n; // point to the start of empty space in the buffer
 
-  network_32bit = esl_hton32(ser_size); // first field in the serialized object is its size
-  memcpy(ptr, &network_32bit, sizeof(uint32_t)); // Write size of the serialized object into the buffer
-  ptr += sizeof(uint32_t);
-
-  // Field 2: N
-  network_32bit = esl_hton32(obj->N);
-  memcpy(ptr, &network_32bit, sizeof(uint32_t));
-  ptr += sizeof(uint32_t);
- 
-  // Field 3: Hmmfrom field
-  network_32bit = esl_hton32(obj->hmmfrom);
-  memcpy(ptr, &network_32bit, sizeof(uint32_t));
-  ptr += sizeof(uint32_t);
-
-  // Field 4: Hmmto field
-  network_32bit = esl_hton32(obj->hmmto);
-  memcpy(ptr, &network_32bit, sizeof(uint32_t));
-  ptr += sizeof(uint32_t);
-
-  // Field 5: M field
-  network_32bit = esl_hton32(obj->M);
-  memcpy(ptr, &network_32bit, sizeof(uint32_t));
-  ptr += sizeof(uint32_t);
-
-  // Field 6: Sqfrom
-  network_64bit = esl_hton64(obj->sqfrom);
-  memcpy(ptr, &network_64bit, sizeof(int64_t));
-  ptr += sizeof(int64_t);
-
-  // Field 7: Sqto
-  network_64bit = esl_hton64(obj->sqto);
-  memcpy(ptr, &network_64bit, sizeof(int64_t));
-  ptr += sizeof(int64_t);
-
-  // Field 8: L
-  network_64bit = esl_hton64(obj->L);
-  memcpy(ptr, &network_64bit, sizeof(int64_t));
-  ptr += sizeof(int64_t);
-
-  // Field 9: presence_flags
-  memcpy(ptr, &presence_flags, sizeof(uint8_t));
-  ptr += sizeof(uint8_t);
+  ptr = alidisplay_serialize_fixed(obj, ser_size, presence_flags, ptr);
 
   //Now, the strings, some of which are optional
   // Note that many of these strings are fixed-length if they are present
@@ -680,6 +1161,120 @@ int p7_alidisplay_Serialize(const P7_ALIDISPLAY *obj, uint8_t **buf, uint32_t *n
     return eslEMEM;
 }
 
+/* Function:  p7_alidisplay_SerializeAs()
+ * Synopsis:  Serialize a P7_ALIDISPLAY, choosing the form of its display lines.
+ *
+ * Purpose:   As <p7_alidisplay_Serialize()>, but write the display lines
+ *            of <obj> in form <form>:
+ *
+ *            <p7_ALI_FULL>:    as strings, exactly as <_Serialize()> does.
+ *
+ *            <p7_ALI_COMPACT>: in the compact form of
+ *                              <p7_alidisplay_Compress()>, flagged in the
+ *                              presence bits; usually several times
+ *                              smaller. If <obj> isn't compact it is
+ *                              encoded on the fly; if its lines can't be
+ *                              represented compactly, it's written
+ *                              <p7_ALI_FULL>.
+ *
+ *            <p7_ALI_NONE>:    as empty strings, with <N> 0; only the
+ *                              coordinates, lengths and names are kept.
+ *                              This is still the <p7_ALI_FULL> format, so
+ *                              any reader of it can read this.
+ *
+ *            <p7_alidisplay_Deserialize()> reads all three. A compact
+ *            one deserializes to a compact alidisplay.
+ *
+ * Returns:   <eslOK> on success, as <p7_alidisplay_Serialize()>.
+ *
+ * Throws:    As <p7_alidisplay_Serialize()>.
+ */
+int
+p7_alidisplay_SerializeAs(const P7_ALIDISPLAY *obj, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc)
+{
+  struct alidisplay_zlayout_s zl;
+  P7_ALIDISPLAY bare;
+  uint32_t      ser_size;
+  uint8_t      *ptr;
+  uint8_t       presence_flags;
+  int           zflags = 0;
+  int           zsize;
+  int           len;
+  int           status;
+
+  if (obj == NULL || buf == NULL || n == NULL) return eslEINVAL;
+
+  if (form == p7_ALI_FULL) return p7_alidisplay_Serialize(obj, buf, n, nalloc);
+  if (form == p7_ALI_NONE)
+    {
+      bare        = *obj;
+      bare.N      = 0;
+      bare.rfline = bare.mmline = bare.csline = bare.ppline = bare.ntseq = NULL;
+      bare.model  = bare.mline  = bare.aseq   = (char *) "";
+      bare.zdata  = NULL;
+      return p7_alidisplay_Serialize(&bare, buf, n, nalloc);
+    }
+
+  // p7_ALI_COMPACT: use <obj>'s own compact block, or lay one out to encode into the buffer
+  if (obj->zdata)
+    {
+      zflags = obj->zflags;
+      zsize  = obj->zsize;
+    }
+  else
+    {
+      if (alidisplay_zcheck(obj, &zl) != eslOK) return p7_alidisplay_Serialize(obj, buf, n, nalloc);
+      if (obj->rfline) zflags |= RFLINE_PRESENT;
+      if (obj->mmline) zflags |= MMLINE_PRESENT;
+      if (obj->csline) zflags |= CSLINE_PRESENT;
+      if (obj->ppline) zflags |= PPLINE_PRESENT;
+      alidisplay_zlayout(&zl, zflags, NULL);
+      zsize = zl.zsize;
+    }
+  presence_flags = zflags | ZDATA_PRESENT | (obj->ntseq ? NTSEQ_PRESENT : 0);
+
+  ser_size = SER_BASE_SIZE + zsize + (obj->ntseq ? 3*obj->N+1 : 0) +
+    strlen(obj->hmmname) + strlen(obj->hmmacc) + strlen(obj->hmmdesc) +
+    strlen(obj->sqname)  + strlen(obj->sqacc)  + strlen(obj->sqdesc)  + 6;
+
+  if (*buf == NULL)
+    {
+      ESL_ALLOC(*buf, ser_size);
+      *nalloc = ser_size;
+    }
+  if (*n + ser_size > *nalloc)
+    {
+      ESL_REALLOC(*buf, (*n + ser_size));
+      *nalloc = *n + ser_size;
+    }
+
+  ptr = alidisplay_serialize_fixed(obj, ser_size, presence_flags, *buf + *n);
+
+  if (obj->zdata) memcpy(ptr, obj->zdata, zsize);
+  else {
+    alidisplay_zlayout(&zl, zflags, (char *) ptr);
+    alidisplay_zencode(obj, &zl, (char *) ptr);
+  }
+  ptr += zsize;
+
+  if (obj->ntseq) { memcpy(ptr, obj->ntseq, 3*obj->N+1); ptr += 3*obj->N+1; }
+  len = strlen(obj->hmmname) + 1;  memcpy(ptr, obj->hmmname, len);  ptr += len;
+  len = strlen(obj->hmmacc)  + 1;  memcpy(ptr, obj->hmmacc,  len);  ptr += len;
+  len = strlen(obj->hmmdesc) + 1;  memcpy(ptr, obj->hmmdesc, len);  ptr += len;
+  len = strlen(obj->sqname)  + 1;  memcpy(ptr, obj->sqname,  len);  ptr += len;
+  len = strlen(obj->sqacc)   + 1;  memcpy(ptr, obj->sqacc,   len);  ptr += len;
+  len = strlen(obj->sqdesc)  + 1;  memcpy(ptr, obj->sqdesc,  len);  ptr += len;
+
+  if (ptr != *buf + *n + ser_size)
+    ESL_EXCEPTION(eslFAIL, "Serialized object length did not match computed length in p7_alidisplay_SerializeAs");
+
+  *n = ptr - *buf;
+  return eslOK;
+
+ ERROR:
+  return eslEMEM;
+}
+
 /* Function:  p7_alidisplay_Deserialize
  * Synopsis:  Derializes a P7_ALIDISPLAY object from a stream of bytes in network order into
  *            a valid data structure
@@ -731,6 +1326,9 @@ extern int p7_alidisplay_Deserialize(const uint8_t *buf, uint32_t *n, P7_ALIDISP
     }
     ret_obj->memsize = obj_size - SER_BASE_SIZE;
   }
+  ret_obj->zdata  = NULL; // deserialized object is in the normal form, even if <ret_obj> was compact
+  ret_obj->zsize  = 0;
+  ret_obj->zflags = 0;
 
   // Second field: N
   memcpy(&network_32bit, ptr, sizeof(uint32_t)); // Grab the bytes out of the buffer
@@ -775,80 +1373,106 @@ extern int p7_alidisplay_Deserialize(const uint8_t *buf, uint32_t *n, P7_ALIDISP
   memcpy(ret_obj->mem, ptr, (obj_size - SER_BASE_SIZE)); 
   mem_ptr = ret_obj->mem;
   ptr += (obj_size - SER_BASE_SIZE);
-  // Tenth field: rfline, if present
 
   if(ptr != buf + *n + obj_size){
     ESL_EXCEPTION(eslFAIL, "In p7_alidisplay_Deserialize, found object (ptr) to be of size %ld, expected %u.\n", (long int) (ptr - (buf + *n)), obj_size);
   }
 
-  if(presence_flags & RFLINE_PRESENT){
-    ret_obj->rfline = mem_ptr;
-    string_length = strlen(ret_obj->rfline);
-    mem_ptr+= string_length +1; // + 1 to account for end-of-string character
-  }
-  else{ // not present
-    ret_obj->rfline = NULL; 
-  }
-
-  // Eleventh field: mmline, if present
-  if(presence_flags & MMLINE_PRESENT){
-    ret_obj->mmline = mem_ptr;
-    string_length = strlen(ret_obj->mmline);
-    mem_ptr+= string_length + 1;
-  }
-  else{ // not present
-    ret_obj->mmline = NULL; 
-  }
+  if(presence_flags & ZDATA_PRESENT){ // display lines in the compact form (p7_alidisplay_SerializeAs()); keep it that way
+    struct alidisplay_zlayout_s zl;
 
-  // Twelfth field: csline, if present
-  if(presence_flags & CSLINE_PRESENT){
-    ret_obj->csline = mem_ptr;
-    string_length = strlen(ret_obj->csline);
-    mem_ptr+= string_length + 1;
-  }
-  else{ // not present
-    ret_obj->csline = NULL; 
+    if(alidisplay_zcount(&zl, ret_obj->mem, ret_obj->N, obj_size - SER_BASE_SIZE) != eslOK){
+      ESL_EXCEPTION(eslFAIL, "In p7_alidisplay_Deserialize, compact display lines don't match N = %d\n", ret_obj->N);
+    }
+    ret_obj->zflags = presence_flags & (RFLINE_PRESENT | MMLINE_PRESENT | CSLINE_PRESENT | PPLINE_PRESENT);
+    alidisplay_zlayout(&zl, ret_obj->zflags, NULL);
+    if((uint32_t) zl.zsize > obj_size - SER_BASE_SIZE){
+      ESL_EXCEPTION(eslFAIL, "In p7_alidisplay_Deserialize, compact display lines overrun the object\n");
+    }
+    ret_obj->zdata = ret_obj->mem;
+    ret_obj->zsize = zl.zsize;
+    ret_obj->rfline = ret_obj->mmline = ret_obj->csline = ret_obj->model = ret_obj->mline = ret_obj->aseq = ret_obj->ppline = NULL;
+    mem_ptr += zl.zsize;
+
+    if(presence_flags & NTSEQ_PRESENT){
+      ret_obj->ntseq = mem_ptr;
+      mem_ptr += 3 * ret_obj->N + 1;
+    }
+    else{
+      ret_obj->ntseq = NULL;
+    }
   }
+  else{
+    // Tenth field: rfline, if present
+    if(presence_flags & RFLINE_PRESENT){
+      ret_obj->rfline = mem_ptr;
+      string_length = strlen(ret_obj->rfline);
+      mem_ptr+= string_length +1; // + 1 to account for end-of-string character
+    }
+    else{ // not present
+      ret_obj->rfline = NULL; 
+    }
 
+    // Eleventh field: mmline, if present
+    if(presence_flags & MMLINE_PRESENT){
+      ret_obj->mmline = mem_ptr;
+      string_length = strlen(ret_obj->mmline);
+      mem_ptr+= string_length + 1;
+    }
+    else{ // not present
+      ret_obj->mmline = NULL; 
+    }
 
-  // Thirteenth field: model
-  ret_obj->model = mem_ptr;
-  string_length = strlen(ret_obj->model);
-  mem_ptr+= string_length + 1;
+    // Twelfth field: csline, if present
+    if(presence_flags & CSLINE_PRESENT){
+      ret_obj->csline = mem_ptr;
+      string_length = strlen(ret_obj->csline);
+      mem_ptr+= string_length + 1;
+    }
+    else{ // not present
+      ret_obj->csline = NULL; 
+    }
 
- // Thirteenth field: mline
-  ret_obj->mline = mem_ptr;
-  string_length = strlen(ret_obj->mline);
-  mem_ptr+= string_length + 1;
 
-  // Fourteenth field: aseq, if present
-  if(presence_flags & ASEQ_PRESENT){
-    ret_obj->aseq = mem_ptr;
-    string_length = strlen(ret_obj->aseq);
+    // Thirteenth field: model
+    ret_obj->model = mem_ptr;
+    string_length = strlen(ret_obj->model);
     mem_ptr+= string_length + 1;
-  }
-  else{ // not present
-    ret_obj->aseq = NULL; 
-  }
 
-  // Fifteenth field: ntseq, if present
-  if(presence_flags & NTSEQ_PRESENT){
-    ret_obj->ntseq = mem_ptr;
-    string_length = strlen(ret_obj->ntseq);
+   // Thirteenth field: mline
+    ret_obj->mline = mem_ptr;
+    string_length = strlen(ret_obj->mline);
     mem_ptr+= string_length + 1;
-  }
-  else{ // not present
-    ret_obj->ntseq = NULL; 
-  }
 
-  // Sixteenth field: ppline, if present
-  if(presence_flags & PPLINE_PRESENT){
-    ret_obj->ppline = mem_ptr;
-    string_length = strlen(ret_obj->ppline);
-    mem_ptr+= string_length + 1;
-  }
-  else{ // not present
-    ret_obj->ppline = NULL; 
+    // Fourteenth field: aseq, if present
+    if(presence_flags & ASEQ_PRESENT){
+      ret_obj->aseq = mem_ptr;
+      string_length = strlen(ret_obj->aseq);
+      mem_ptr+= string_length + 1;
+    }
+    else{ // not present
+      ret_obj->aseq = NULL; 
+    }
+
+    // Fifteenth field: ntseq, if present
+    if(presence_flags & NTSEQ_PRESENT){
+      ret_obj->ntseq = mem_ptr;
+      string_length = strlen(ret_obj->ntseq);
+      mem_ptr+= string_length + 1;
+    }
+    else{ // not present
+      ret_obj->ntseq = NULL; 
+    }
+
+    // Sixteenth field: ppline, if present
+    if(presence_flags & PPLINE_PRESENT){
+      ret_obj->ppline = mem_ptr;
+      string_length = strlen(ret_obj->ppline);
+      mem_ptr+= string_length + 1;
+    }
+    else{ // not present
+      ret_obj->ppline = NULL; 
+    }
   }
 
   // Seventeenth field: hmmname
@@ -960,7 +1584,8 @@ p7_alidisplay_Serialize_old(P7_ALIDISPLAY *ad)
  * Returns:   <eslOK> on success
  *
  * Throws:    <eslEMEM> on allocation failure, and <ad> is restored to
- *            its original (serialized) state.
+ *            its original (serialized) state. <eslEINVAL> if <ad> is
+ *            in an arena (see <p7_alidisplay_CreateInArena()>).
  */
 int
 p7_alidisplay_Deserialize_old(P7_ALIDISPLAY *ad)
@@ -970,6 +1595,8 @@ p7_alidisplay_Deserialize_old(P7_ALIDISPLAY *ad)
   int status;
 
   if (ad->mem == NULL) return eslOK; /* already deserialized, so no-op */
+  if (ad->in_arena)    ESL_EXCEPTION(eslEINVAL, "can't deserialize an alidisplay that's in an arena");
+  if ((status = p7_alidisplay_Expand(ad)) != eslOK) return status;
 
   pos = 0;
   if (ad->rfline) { ESL_ALLOC(ad->rfline, sizeof(char) * ad->N+1); memcpy(ad->rfline, ad->mem+pos, ad->N+1); pos += ad->N+1; }
@@ -1021,7 +1648,7 @@ p7_alidisplay_Deserialize_old(P7_ALIDISPLAY *ad)
 void
 p7_alidisplay_Destroy(P7_ALIDISPLAY *ad)
 {
-  if (ad == NULL) return;
+  if (ad == NULL || ad->in_arena) return; /* arena memory is freed in bulk, with the arena */
   if (ad->mem)
     {	/* serialized form */
       free(ad->mem);
@@ -1161,6 +1788,7 @@ p7_alidisplay_Print(FILE *fp, P7_ALIDISPLAY *ad, int min_aliwidth, int linewidth
 int
 p7_nontranslated_alidisplay_Print(FILE *fp, P7_ALIDISPLAY *ad, int min_aliwidth, int linewidth, int show_accessions)
 {
+  P7_ALIDISPLAY *ad2 = NULL;
   char *buf          = NULL;
   char *show_hmmname = NULL;
   char *show_seqname = NULL;
@@ -1172,6 +1800,14 @@ p7_nontranslated_alidisplay_Print(FILE *fp, P7_ALIDISPLAY *ad, int min_aliwidth,
   long  i1,i2;
   int   k1,k2;
 
+  if (ad->zdata)	/* compact: print a temporary expanded copy */
+    {
+      if ((ad2 = alidisplay_expanded_copy(ad)) == NULL) ESL_EXCEPTION(eslEMEM, "allocation failed expanding alidisplay");
+      status = p7_nontranslated_alidisplay_Print(fp, ad2, min_aliwidth, linewidth, show_accessions);
+      p7_alidisplay_Destroy(ad2);
+      return status;
+    }
+
   /* implement the --acc option for preferring accessions over names in output  */
   show_hmmname = (show_accessions && ad->hmmacc[0] != '\0') ? ad->hmmacc : ad->hmmname;
   show_seqname = (show_accessions && ad->sqacc[0]  != '\0') ? ad->sqacc  : ad->sqname;
@@ -1261,12 +1897,21 @@ p7_nontranslated_alidisplay_Print(FILE *fp, P7_ALIDISPLAY *ad, int min_aliwidth,
 int
 p7_alidisplay_Backconvert(const P7_ALIDISPLAY *ad, const ESL_ALPHABET *abc, ESL_SQ **ret_sq, P7_TRACE **ret_tr)
 {
+  P7_ALIDISPLAY *ad2 = NULL;	/* expanded copy of a compact <ad>   */
   ESL_SQ   *sq   = NULL;	/* RETURN: faux subsequence          */
   P7_TRACE *tr   = NULL;	/* RETURN: faux trace                */
   int       subL = 0;		/* subsequence length in the <ad>    */
   int       a, i, k;        	/* coords for <ad>, <sq->dsq>, model */
   char      s;   	        /* current state type: MDI           */
   int       status;
+
+  if (ad->zdata)	/* compact: backconvert a temporary expanded copy */
+    {
+      if ((ad2 = alidisplay_expanded_copy(ad)) == NULL) { status = eslEMEM; goto ERROR; }
+      status = p7_alidisplay_Backconvert(ad2, abc, ret_sq, ret_tr);
+      p7_alidisplay_Destroy(ad2);
+      return status;
+    }
   
   /* Make a first pass over <ad> just to calculate subseq length */
   for (a = 0; a < ad->N; a++)
@@ -1432,6 +2077,9 @@ p7_alidisplay_Sample(ESL_RANDOMNESS *rng, int N, P7_ALIDISPLAY **ret_ad)
 
   ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
   ad->rfline  = ad->mmline = ad->csline = ad->model   = ad->mline  = ad->aseq = ad->ntseq = ad->ppline = NULL;
+  ad->in_arena = FALSE;
+  ad->zdata   = NULL;
+  ad->zsize   = ad->zflags = 0;
   ad->hmmname = ad->hmmacc = ad->hmmdesc = NULL;
   ad->sqname  = ad->sqacc  = ad->sqdesc  = NULL;
   ad->mem     = NULL;
@@ -1557,6 +2205,17 @@ p7_alidisplay_Sample(ESL_RANDOMNESS *rng, int N, P7_ALIDISPLAY **ret_ad)
 int
 p7_alidisplay_Dump(FILE *fp, const P7_ALIDISPLAY *ad)
 {
+  P7_ALIDISPLAY *ad2 = NULL;
+
+  if (ad->zdata)
+    {
+      if ((ad2 = alidisplay_expanded_copy(ad)) == NULL) ESL_EXCEPTION(eslEMEM, "allocation failed expanding alidisplay");
+      p7_alidisplay_Dump(fp, ad2);
+      fprintf(fp, "compact size = %d bytes\n", (int) p7_alidisplay_Sizeof(ad));
+      p7_alidisplay_Destroy(ad2);
+      return eslOK;
+    }
+
   fprintf(fp, "P7_ALIDISPLAY dump\n");
   fprintf(fp, "------------------\n");
 
@@ -1601,10 +2260,35 @@ p7_alidisplay_Dump(FILE *fp, const P7_ALIDISPLAY *ad)
  *            a serialized and deserialized version of the same
  *            alidisplay will compare identical.
  */
+static int alidisplay_compare(const P7_ALIDISPLAY *ad1, const P7_ALIDISPLAY *ad2, int do_memcmp);
+
 int
 p7_alidisplay_Compare(const P7_ALIDISPLAY *ad1, const P7_ALIDISPLAY *ad2)
 {
-  if (ad1->mem && ad2->mem)	/* both objects serialized */
+  P7_ALIDISPLAY *x1 = NULL;
+  P7_ALIDISPLAY *x2 = NULL;
+  int            status;
+
+  if (! ad1->zdata && ! ad2->zdata) return alidisplay_compare(ad1, ad2, TRUE);
+
+  /* Compact: compare the contents of expanded copies. Their <mem> is
+   * laid out afresh, so it can't be compared byte for byte with the
+   * original. 
+   */
+  if (ad1->zdata && (x1 = alidisplay_expanded_copy(ad1)) == NULL) { status = eslFAIL; goto DONE; }
+  if (ad2->zdata && (x2 = alidisplay_expanded_copy(ad2)) == NULL) { status = eslFAIL; goto DONE; }
+  status = alidisplay_compare(x1 ? x1 : ad1, x2 ? x2 : ad2, FALSE);
+
+ DONE:
+  p7_alidisplay_Destroy(x1);
+  p7_alidisplay_Destroy(x2);
+  return status;
+}
+
+static int
+alidisplay_compare(const P7_ALIDISPLAY *ad1, const P7_ALIDISPLAY *ad2, int do_memcmp)
+{
+  if (do_memcmp && ad1->mem && ad2->mem)	/* both objects serialized */
     {
       if (ad1->memsize != ad2->memsize)                  return eslFAIL;
       if (memcmp(ad1->mem, ad2->mem, ad1->memsize) != 0) return eslFAIL;
@@ -1820,6 +2504,9 @@ alidisplay_SampleFake_ntseq(ESL_RANDOMNESS *rng, int N, P7_ALIDISPLAY **ret_ad)
 
   ESL_ALLOC(ad, sizeof(P7_ALIDISPLAY));
   ad->rfline  = ad->mmline = ad->csline = ad->model   = ad->mline  = ad->aseq = ad->ntseq = ad->ppline = NULL;
+  ad->in_arena = FALSE;
+  ad->zdata   = NULL;
+  ad->zsize   = ad->zflags = 0;
   ad->hmmname = ad->hmmacc = ad->hmmdesc = NULL;
   ad->sqname  = ad->sqacc  = ad->sqdesc  = NULL;
   ad->mem     = NULL;
@@ -2037,6 +2724,119 @@ utest_deserialize_error_conditions(ESL_RANDOMNESS *rng)
 }
 
 
+/* utest_Compress()
+ * 
+ * Compact an alidisplay and check that it's smaller, and that it
+ * still compares, clones, serializes, prints, and expands back to the
+ * same alignment.
+ */
+static void
+utest_Compress(ESL_RANDOMNESS *rng, int ntrials, int N)
+{
+  char           msg[]  = "utest_Compress failed";
+  P7_ALIDISPLAY *ad     = NULL;
+  P7_ALIDISPLAY *ad0    = NULL;
+  P7_ALIDISPLAY *ad2    = NULL;
+  P7_ALIDISPLAY *ad3    = NULL;
+  uint8_t       *buf    = NULL;
+  uint32_t       n      = 0;
+  uint32_t       nalloc = 0;
+  FILE          *fp     = NULL;
+  size_t         size0;
+  int            i;
+
+  if ((fp = fopen("/dev/null", "w")) == NULL) esl_fatal(msg);
+  for (i = 0; i < ntrials; i++)
+    {
+      if (p7_alidisplay_Sample(rng, N, &ad)      != eslOK) esl_fatal(msg);
+      if (p7_alidisplay_Serialize_old(ad)        != eslOK) esl_fatal(msg);
+      if ((ad0 = p7_alidisplay_Clone(ad))        == NULL)  esl_fatal(msg);
+      size0 = p7_alidisplay_Sizeof(ad);
+
+      if (p7_alidisplay_Compress(ad)             != eslOK) esl_fatal(msg);
+      if (ad->zdata == NULL || ad->aseq != NULL)           esl_fatal(msg);
+      if (p7_alidisplay_Sizeof(ad)               >= size0) esl_fatal(msg);
+      if (p7_alidisplay_Compress(ad)             != eslOK) esl_fatal(msg); /* no-op on a compact one */
+      if (p7_alidisplay_Compare(ad, ad0)         != eslOK) esl_fatal(msg);
+      if (p7_nontranslated_alidisplay_Print(fp, ad, 40, 80, FALSE) != eslOK) esl_fatal(msg);
+
+      if ((ad2 = p7_alidisplay_Clone(ad))        == NULL)  esl_fatal(msg);
+      if (ad2->zdata == NULL)                              esl_fatal(msg);
+      if (p7_alidisplay_Compare(ad2, ad0)        != eslOK) esl_fatal(msg);
+
+      n = 0;
+      if (p7_alidisplay_Serialize(ad, &buf, &n, &nalloc) != eslOK) esl_fatal(msg);
+      if ((ad3 = p7_alidisplay_Create_empty())   == NULL)  esl_fatal(msg);
+      n = 0;
+      if (p7_alidisplay_Deserialize(buf, &n, ad3) != eslOK) esl_fatal(msg);
+      if (ad3->zdata != NULL)                              esl_fatal(msg);
+      if (p7_alidisplay_Compare(ad3, ad0)        != eslOK) esl_fatal(msg);
+
+      if (p7_alidisplay_Expand(ad)               != eslOK) esl_fatal(msg);
+      if (ad->zdata != NULL || ad->aseq == NULL)           esl_fatal(msg);
+      if (p7_alidisplay_Compare(ad, ad0)         != eslOK) esl_fatal(msg);
+
+      p7_alidisplay_Destroy(ad);
+      p7_alidisplay_Destroy(ad0);
+      p7_alidisplay_Destroy(ad2);
+      p7_alidisplay_Destroy(ad3);
+    }
+  fclose(fp);
+  free(buf);
+}
+
+/* utest_SerializeAs()
+ *
+ * The compact serialized form deserializes to a compact alidisplay of
+ * the same alignment, whether or not the original was compact, and is
+ * smaller than the full form. The form without display lines keeps
+ * the coordinates and names.
+ */
+static void
+utest_SerializeAs(ESL_RANDOMNESS *rng, int ntrials, int N)
+{
+  char           msg[]  = "utest_SerializeAs failed";
+  P7_ALIDISPLAY *ad     = NULL;
+  P7_ALIDISPLAY *ad2    = NULL;
+  uint8_t       *buf    = NULL;
+  uint32_t       n, nfull;
+  uint32_t       nalloc = 0;
+  int            i, compressed;
+
+  for (i = 0; i < ntrials; i++)
+    for (compressed = 0; compressed <= 1; compressed++)
+      {
+	if (p7_alidisplay_Sample(rng, N, &ad)        != eslOK) esl_fatal(msg);
+	if (compressed && p7_alidisplay_Compress(ad) != eslOK) esl_fatal(msg);
+	if ((ad2 = p7_alidisplay_Create_empty())     == NULL)  esl_fatal(msg);
+
+	nfull = 0;
+	if (p7_alidisplay_SerializeAs(ad, p7_ALI_FULL,    &buf, &nfull, &nalloc) != eslOK) esl_fatal(msg);
+	n = 0;
+	if (p7_alidisplay_SerializeAs(ad, p7_ALI_COMPACT, &buf, &n,     &nalloc) != eslOK) esl_fatal(msg);
+	if (n >= nfull)                                       esl_fatal(msg);
+	n = 0;
+	if (p7_alidisplay_Deserialize(buf, &n, ad2)  != eslOK) esl_fatal(msg);
+	if (ad2->zdata == NULL)                                esl_fatal(msg);
+	if (p7_alidisplay_Compare(ad, ad2)           != eslOK) esl_fatal(msg);
+	if (p7_alidisplay_Expand(ad2)                != eslOK) esl_fatal(msg);
+	if (p7_alidisplay_Compare(ad, ad2)           != eslOK) esl_fatal(msg);
+
+	n = 0;
+	if (p7_alidisplay_SerializeAs(ad, p7_ALI_NONE, &buf, &n, &nalloc) != eslOK) esl_fatal(msg);
+	n = 0;
+	if (p7_alidisplay_Deserialize(buf, &n, ad2)  != eslOK) esl_fatal(msg);
+	if (ad2->N != 0 || ad2->aseq == NULL || ad2->aseq[0] != '\0') esl_fatal(msg);
+	if (ad2->hmmfrom != ad->hmmfrom || ad2->hmmto != ad->hmmto)   esl_fatal(msg);
+	if (ad2->sqfrom  != ad->sqfrom  || ad2->sqto  != ad->sqto)    esl_fatal(msg);
+	if (strcmp(ad2->hmmname, ad->hmmname) != 0 || strcmp(ad2->sqname, ad->sqname) != 0) esl_fatal(msg);
+
+	p7_alidisplay_Destroy(ad);
+	p7_alidisplay_Destroy(ad2);
+      }
+  free(buf);
+}
+
 static void
 utest_Backconvert(int be_verbose, ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int ntrials, int N)
 {
@@ -2105,6 +2905,8 @@ main(int argc, char **argv)
   //utest_Serialize_old  (            rng,      N, L);
   utest_Serialize(rng, 100);
   utest_Backconvert(be_verbose, rng, abc, N, L);
+  utest_Compress(rng, N, L);
+  utest_SerializeAs(rng, N, L);
   utest_serialize_error_conditions(rng);
   utest_deserialize_error_conditions(rng);
 
@@ -0,0 +1,414 @@
+/* P7_ARENA: bulk allocation for the many small objects in a hit list.
+ *
+ * A hit list accumulates lots of small allocations that all live and
+ * die together: target names, accessions, descriptions, and one
+ * alignment display per domain. Allocating each of them with
+ * malloc() and freeing each again in p7_tophits_Destroy() shows up in
+ * profiles of searches that produce many hits. A P7_ARENA instead
+ * carves them sequentially out of a chain of large blocks, and frees
+ * them only in bulk.
+ *
+ * Contents:
+ *    1. The P7_ARENA object.
+ *    2. Unit tests.
+ *    3. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "hmmer.h"
+
+/* Block headers are followed in the same allocation by their memory;
+ * round the header up so the memory is aligned for any object.
+ */
+#define p7ARENA_HDRSIZE  ((sizeof(struct p7_arenablock_s) + 15) & ~((size_t) 15))
+#define p7ARENA_ALIGN(n) (((n) + 7) & ~((size_t) 7))
+
+static void arena_free_blocks(struct p7_arenablock_s *blk, struct p7_arenablock_s *stop);
+
+
+/*****************************************************************
+ *= 1. The P7_ARENA object
+ *****************************************************************/
+
+/* Function:  p7_arena_Create()
+ * Synopsis:  Create a new, empty <P7_ARENA>.
+ *
+ * Purpose:   Create a new arena that allocates memory in blocks of
+ *            <blocksize> bytes; if <blocksize> is 0, use a default
+ *            (64KB). No memory is allocated for blocks until the
+ *            first <p7_arena_Alloc()>.
+ *
+ *            A single allocation bigger than <blocksize> gets a
+ *            block of its own, so <blocksize> only affects
+ *            efficiency: bigger blocks mean fewer malloc() calls but
+ *            more memory held by small arenas.
+ *
+ * Returns:   a pointer to the new arena.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_ARENA *
+p7_arena_Create(size_t blocksize)
+{
+  P7_ARENA *a = NULL;
+  int       status;
+
+  ESL_ALLOC(a, sizeof(P7_ARENA));
+  a->blk       = NULL;
+  a->blocksize = (blocksize > 0 ? blocksize : 65536);
+  a->nblocks   = 0;
+  a->nbytes    = 0;
+  a->is_marked = FALSE;
+  a->mark_blk  = NULL;
+  a->mark_n    = 0;
+  return a;
+
+ ERROR:
+  return NULL;
+}
+
+
+/* Function:  p7_arena_Alloc()
+ * Synopsis:  Allocate <n> bytes from an arena.
+ *
+ * Purpose:   Allocate <n> bytes from arena <a>, aligned for any
+ *            object type, and return a pointer to them. If the
+ *            current block doesn't have room, a new block is started
+ *            (and the rest of the current one goes unused).
+ *
+ *            The memory belongs to the arena. Never <free()> it;
+ *            it's freed in bulk by <p7_arena_Reuse()>,
+ *            <p7_arena_Rewind()> or <p7_arena_Destroy()>.
+ *
+ * Returns:   a pointer to the memory.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+void *
+p7_arena_Alloc(P7_ARENA *a, size_t n)
+{
+  struct p7_arenablock_s *blk = NULL;
+  size_t                  nalloc;
+  void                   *p;
+  int                     status;
+
+  n = p7ARENA_ALIGN(n);
+  if (a->blk == NULL || a->blk->nalloc - a->blk->n < n)
+    {
+      nalloc = ESL_MAX(a->blocksize, n);
+      ESL_ALLOC(blk, p7ARENA_HDRSIZE + nalloc);
+      blk->mem    = (char *) blk + p7ARENA_HDRSIZE;
+      blk->n      = 0;
+      blk->nalloc = nalloc;
+      blk->next   = a->blk;
+      a->blk      = blk;
+      a->nblocks++;
+    }
+
+  p          = a->blk->mem + a->blk->n;
+  a->blk->n += n;
+  a->nbytes += n;
+  return p;
+
+ ERROR:
+  return NULL;
+}
+
+
+/* Function:  p7_arena_Strdup()
+ * Synopsis:  Duplicate a string into an arena.
+ *
+ * Purpose:   Like <esl_strdup()>, but the copy is allocated from arena
+ *            <a>. Duplicate the first <n> characters of string <s>
+ *            (or all of it, if <n> is -1), \0-terminated, and return
+ *            the copy in <*ret_s>. If <s> is <NULL>, <*ret_s> is
+ *            <NULL>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <*ret_s> is <NULL>.
+ */
+int
+p7_arena_Strdup(P7_ARENA *a, const char *s, int64_t n, char **ret_s)
+{
+  char *new = NULL;
+
+  if (s == NULL) { *ret_s = NULL; return eslOK; }
+  if (n < 0) n = strlen(s);
+  if ((new = p7_arena_Alloc(a, n+1)) == NULL) { *ret_s = NULL; return eslEMEM; }
+  memcpy(new, s, n);
+  new[n] = '\0';
+  *ret_s = new;
+  return eslOK;
+}
+
+
+/* Function:  p7_arena_SetMark()
+ * Synopsis:  Remember the current end of an arena.
+ *
+ * Purpose:   Remember the current end of arena <a>, so that a
+ *            subsequent <p7_arena_Rewind()> can free everything
+ *            allocated after this point. Only one mark is kept; a new
+ *            mark replaces the old one.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+p7_arena_SetMark(P7_ARENA *a)
+{
+  a->is_marked = TRUE;
+  a->mark_blk  = a->blk;
+  a->mark_n    = (a->blk ? a->blk->n : 0);
+  return eslOK;
+}
+
+
+/* Function:  p7_arena_Rewind()
+ * Synopsis:  Free everything allocated since the last mark.
+ *
+ * Purpose:   Free all memory that arena <a> has allocated since the
+ *            last <p7_arena_SetMark()>. Objects allocated before the
+ *            mark are untouched. The mark is cleared. If there is no
+ *            mark (none was set, or <p7_arena_Reuse()> or
+ *            <p7_arena_Splice()> cleared it), do nothing.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+p7_arena_Rewind(P7_ARENA *a)
+{
+  if (! a->is_marked) return eslOK;
+
+  while (a->blk != a->mark_blk)
+    {
+      struct p7_arenablock_s *blk = a->blk;
+      a->blk     = blk->next;
+      a->nbytes -= blk->n;
+      a->nblocks--;
+      free(blk);
+    }
+  if (a->blk) { a->nbytes -= a->blk->n - a->mark_n; a->blk->n = a->mark_n; }
+
+  a->is_marked = FALSE;
+  a->mark_blk  = NULL;
+  a->mark_n    = 0;
+  return eslOK;
+}
+
+
+/* Function:  p7_arena_Splice()
+ * Synopsis:  Move all of one arena's memory into another.
+ *
+ * Purpose:   Transfer all the memory allocated in arena <src> to arena
+ *            <dst>, leaving <src> empty (but still valid). Objects
+ *            allocated from <src> stay where they are; they now
+ *            belong to <dst>, and are freed with it. This is what
+ *            lets <p7_tophits_Merge()> move hits from one list to
+ *            another without copying them.
+ *
+ *            Any marks in either arena are cleared.
+ *
+ * Returns:   <eslOK>.
+ */
+int
+p7_arena_Splice(P7_ARENA *dst, P7_ARENA *src)
+{
+  struct p7_arenablock_s *tail;
+
+  if (src->blk != NULL)
+    {
+      if (dst->blk == NULL)
+	dst->blk = src->blk;
+      else
+	{ /* insert <src>'s chain behind <dst>'s current block, which stays current */
+	  for (tail = src->blk; tail->next != NULL; tail = tail->next) ;
+	  tail->next      = dst->blk->next;
+	  dst->blk->next  = src->blk;
+	}
+      dst->nblocks += src->nblocks;
+      dst->nbytes  += src->nbytes;
+    }
+
+  src->blk      = NULL;
+  src->nblocks  = 0;
+  src->nbytes   = 0;
+  src->is_marked = dst->is_marked = FALSE;
+  src->mark_blk  = dst->mark_blk  = NULL;
+  src->mark_n    = dst->mark_n    = 0;
+  return eslOK;
+}
+
+
+/* Function:  p7_arena_Reuse()
+ * Synopsis:  Free everything in an arena, for reuse.
+ *
+ * Purpose:   Free all the memory allocated in arena <a>, keeping one
+ *            block of it so the next round of allocations can start
+ *            without a malloc().
+ *
+ * Returns:   <eslOK>.
+ */
+int
+p7_arena_Reuse(P7_ARENA *a)
+{
+  struct p7_arenablock_s *blk;
+
+  if (a == NULL) return eslOK;
+  if (a->blk != NULL)
+    {
+      /* keep the oldest block: it was made for the first allocation, so it's usually blocksize */
+      for (blk = a->blk; blk->next != NULL; blk = blk->next) ;
+      arena_free_blocks(a->blk, blk);
+      blk->n     = 0;
+      a->blk     = blk;
+      a->nblocks = 1;
+    }
+  a->nbytes    = 0;
+  a->is_marked = FALSE;
+  a->mark_blk  = NULL;
+  a->mark_n    = 0;
+  return eslOK;
+}
+
+
+/* Function:  p7_arena_Destroy()
+ * Synopsis:  Free an arena, and everything allocated in it.
+ */
+void
+p7_arena_Destroy(P7_ARENA *a)
+{
+  if (a == NULL) return;
+  arena_free_blocks(a->blk, NULL);
+  free(a);
+}
+
+
+/* arena_free_blocks()
+ * Free the chain of blocks starting at <blk>, up to but not
+ * including <stop> (or to the end of the chain, if <stop> is NULL).
+ */
+static void
+arena_free_blocks(struct p7_arenablock_s *blk, struct p7_arenablock_s *stop)
+{
+  struct p7_arenablock_s *next;
+
+  for (; blk != NULL && blk != stop; blk = next)
+    {
+      next = blk->next;
+      free(blk);
+    }
+}
+/*-------------------- end, P7_ARENA object ---------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests.
+ *****************************************************************/
+#ifdef p7ARENA_TESTDRIVE
+#include "esl_random.h"
+
+/* utest_strings()
+ * Fill an arena with random-length strings in small blocks, so many
+ * blocks (and some oversized ones) are made; check that they're all
+ * intact, through rewinds, splicing into a second arena, and reuse.
+ */
+static void
+utest_strings(ESL_RANDOMNESS *rng, int N)
+{
+  char      msg[] = "arena strings unit test failed";
+  P7_ARENA *a1    = p7_arena_Create(256);
+  P7_ARENA *a2    = p7_arena_Create(256);
+  char    **s1    = malloc(sizeof(char *) * N);
+  char    **s2    = malloc(sizeof(char *) * N);
+  char     *buf   = malloc(sizeof(char) * 1001);
+  char     *p;
+  int       i, n;
+
+  if (a1 == NULL || a2 == NULL || s1 == NULL || s2 == NULL || buf == NULL) esl_fatal(msg);
+  for (i = 0; i < 1000; i++) buf[i] = 'a' + i % 26;
+  buf[1000] = '\0';
+
+  /* each string i is buf+(i%26), length i%500 (some bigger than blocksize); NULL duplicates to NULL */
+  if (p7_arena_Strdup(a1, NULL, -1, &p) != eslOK || p != NULL) esl_fatal(msg);
+  for (i = 0; i < N; i++)
+    {
+      if (p7_arena_Strdup(a1, buf+(i%26), i%500, &(s1[i])) != eslOK) esl_fatal(msg);
+      if (((uintptr_t) s1[i]) % 8 != 0) esl_fatal(msg);
+
+      /* allocate some garbage after a mark, then rewind it away */
+      if (esl_rnd_Roll(rng, 4) == 0) {
+	p7_arena_SetMark(a1);
+	for (n = esl_rnd_Roll(rng, 5); n >= 0; n--)
+	  if ((p = p7_arena_Alloc(a1, esl_rnd_Roll(rng, 600))) == NULL) esl_fatal(msg);
+	p7_arena_Rewind(a1);
+      }
+    }
+  for (i = 0; i < N; i++)
+    if (strlen(s1[i]) != i%500 || strncmp(s1[i], buf+(i%26), i%500) != 0) esl_fatal(msg);
+
+  for (i = 0; i < N; i++)
+    if (p7_arena_Strdup(a2, buf, esl_rnd_Roll(rng, 1000), &(s2[i])) != eslOK) esl_fatal(msg);
+
+  /* splicing a1 into a2 keeps a1's strings valid */
+  n = a1->nblocks + a2->nblocks;
+  p7_arena_Splice(a2, a1);
+  if (a2->nblocks != n || a1->nblocks != 0 || a1->blk != NULL) esl_fatal(msg);
+  p7_arena_Destroy(a1);
+  for (i = 0; i < N; i++)
+    if (strlen(s1[i]) != i%500 || strncmp(s1[i], buf+(i%26), i%500) != 0) esl_fatal(msg);
+
+  /* still usable after reuse */
+  p7_arena_Reuse(a2);
+  if (a2->nblocks != 1 || a2->nbytes != 0) esl_fatal(msg);
+  if (p7_arena_Strdup(a2, buf, -1, &p) != eslOK || strcmp(p, buf) != 0) esl_fatal(msg);
+
+  p7_arena_Destroy(a2);
+  free(s1);
+  free(s2);
+  free(buf);
+}
+#endif /*p7ARENA_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+
+/*****************************************************************
+ * 3. Test driver.
+ *****************************************************************/
+#ifdef p7ARENA_TESTDRIVE
+/*
+  gcc -o p7_arena_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7ARENA_TESTDRIVE p7_arena.c -lhmmer -leasel -lm
+  ./p7_arena_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,   "2000", NULL, NULL,  NULL,  NULL, NULL, "number of strings to allocate",                    0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_ARENA";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  int             N   = esl_opt_GetInteger(go, "-N");
+
+  utest_strings(rng, N);
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7ARENA_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
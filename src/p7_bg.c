@@ -21,6 +21,8 @@
 
 #include "hmmer.h"
 
+static float bg_filter_forward(const ESL_HMM *hmm, const ESL_DSQ *dsq, int L);
+
 
 /*****************************************************************
  * 1. The P7_BG object: allocation, initialization, destruction.
@@ -466,21 +468,67 @@ p7_bg_SetFilter(P7_BG *bg, int M, const float *compo)
  *            The filter null model has no length distribution of its
  *            own; the same geometric length distribution (controlled
  *            by <bg->p1>) that the null1 model uses is imposed.
+ *
+ *            This runs on every target that passes the MSV filter, so
+ *            rather than <esl_hmm_Forward()> with an <L> row matrix
+ *            allocated for each call, it uses <bg_filter_forward()>,
+ *            a two-state Forward in registers that only rescales when
+ *            the scaled probabilities drift far from 1. The score
+ *            agrees with <esl_hmm_Forward()>'s to within float
+ *            roundoff.
  */
 int
 p7_bg_FilterScore(P7_BG *bg, const ESL_DSQ *dsq, int L, float *ret_sc)
 {
-  ESL_HMX *hmx = esl_hmx_Create(L, bg->fhmm->M); /* optimization target: this can be a 2-row matrix, and it can be stored in <bg>. */
-  float nullsc;		                  	 /* (or it could be passed in as an arg, but for sure it shouldn't be alloc'ed here */
-  
-  esl_hmm_Forward(dsq, L, bg->fhmm, hmx, &nullsc);
+  float nullsc = bg_filter_forward(bg->fhmm, dsq, L);
 
   /* impose the length distribution */
   *ret_sc = nullsc + (float) L * logf(bg->p1) + logf(1.-bg->p1);
-  esl_hmx_Destroy(hmx);
   return eslOK;
 }
 
+/* bg_filter_forward()
+ * The Forward score of <dsq> (1..L) under the two-state filter HMM
+ * <hmm>, in nats relative to the background frequencies: the same
+ * recurrence as <esl_hmm_Forward()> on the emission odds <hmm->eo>,
+ * but keeping only the current row, and rescaling (and collecting
+ * the log of the scale factor) every few dozen residues when the
+ * probabilities leave [1e-20, 1e20], instead of at every residue.
+ * The recurrence is serial in i, so there is nothing to vectorize;
+ * the win is no allocation and one logf() per rescale instead of one
+ * per residue.
+ */
+static float
+bg_filter_forward(const ESL_HMM *hmm, const ESL_DSQ *dsq, int L)
+{
+  float t00 = hmm->t[0][0], t01 = hmm->t[0][1];
+  float t10 = hmm->t[1][0], t11 = hmm->t[1][1];
+  float f0, f1, g0, max;
+  float logsc = 0.0f;
+  int   i;
+
+  if (L == 0) return logf(hmm->pi[hmm->M]);
+
+  f0 = hmm->eo[dsq[1]][0] * hmm->pi[0];
+  f1 = hmm->eo[dsq[1]][1] * hmm->pi[1];
+  for (i = 2; i <= L; i++)
+    {
+      g0 = (f0 * t00 + f1 * t10) * hmm->eo[dsq[i]][0];
+      f1 = (f0 * t01 + f1 * t11) * hmm->eo[dsq[i]][1];
+      f0 = g0;
+
+      max = ESL_MAX(f0, f1);
+      if (max < 1e-20f || max > 1e20f)
+	{
+	  if (max == 0.0f) return -eslINFINITY;
+	  f0    /= max;
+	  f1    /= max;
+	  logsc += logf(max);
+	}
+    }
+  return logsc + logf(f0 * hmm->t[0][2] + f1 * hmm->t[1][2]);
+}
+
 
 
 
@@ -555,6 +603,7 @@ main(int argc, char **argv)
 #ifdef p7BG_TESTDRIVE
 #include "esl_dirichlet.h"
 #include "esl_random.h"
+#include "esl_randomseq.h"
 
 static void
 utest_ReadWrite(ESL_RANDOMNESS *rng)
@@ -587,6 +636,53 @@ utest_ReadWrite(ESL_RANDOMNESS *rng)
   free(fq);
   remove(tmpfile);
 }
+
+/* p7_bg_FilterScore() must agree with the full esl_hmm_Forward() it
+ * replaced, for random model compositions and random sequences long
+ * enough to need rescaling many times.
+ */
+static void
+utest_FilterScore(ESL_RANDOMNESS *rng)
+{
+  char          msg[] = "bg FilterScore unit test failed";
+  ESL_ALPHABET *abc   = NULL;
+  P7_BG        *bg    = NULL;
+  ESL_HMX      *hmx   = NULL;
+  ESL_DSQ      *dsq   = NULL;
+  float        *compo = NULL;
+  int           maxL  = 5000;
+  int           trial, L;
+  float         sc1, sc2;
+
+  if ((abc   = esl_alphabet_Create(eslAMINO))             == NULL)  esl_fatal(msg);
+  if ((bg    = p7_bg_Create(abc))                         == NULL)  esl_fatal(msg);
+  if ((hmx   = esl_hmx_Create(maxL, 2))                   == NULL)  esl_fatal(msg);
+  if ((dsq   = malloc(sizeof(ESL_DSQ) * (maxL+2)))        == NULL)  esl_fatal(msg);
+  if ((compo = malloc(sizeof(float) * abc->K))            == NULL)  esl_fatal(msg);
+
+  for (trial = 0; trial < 20; trial++)
+    {
+      do {
+	if (esl_dirichlet_FSampleUniform(rng, abc->K, compo) != eslOK) esl_fatal(msg);
+      } while (esl_vec_FMin(compo, abc->K) < 0.001);
+      p7_bg_SetFilter(bg, 1 + esl_rnd_Roll(rng, 500), compo);
+
+      L = 1 + esl_rnd_Roll(rng, maxL);
+      p7_bg_SetLength(bg, L);
+      if (esl_rsq_xfIID(rng, (trial % 2 ? compo : bg->f), abc->K, L, dsq) != eslOK) esl_fatal(msg);
+
+      if (p7_bg_FilterScore(bg, dsq, L, &sc1)          != eslOK) esl_fatal(msg);
+      if (esl_hmm_Forward(dsq, L, bg->fhmm, hmx, &sc2) != eslOK) esl_fatal(msg);
+      sc2 += (float) L * logf(bg->p1) + logf(1.-bg->p1);
+      if (esl_FCompare(sc1, sc2, 1e-4, 1e-4) != eslOK) esl_fatal("%s: L=%d, %f vs %f", msg, L, sc1, sc2);
+    }
+
+  free(compo);
+  free(dsq);
+  esl_hmx_Destroy(hmx);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+}
 #endif /*p7BG_TESTDRIVE*/
 
 
@@ -625,6 +721,7 @@ main(int argc, char **argv)
   if (be_verbose) printf("p7_bg unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(rng));
 
   utest_ReadWrite(rng);
+  utest_FilterScore(rng);
 
   esl_randomness_Destroy(rng);
   esl_getopts_Destroy(go);
@@ -0,0 +1,774 @@
+/* P7_BINOUT: compact binary result files (--binout).
+ *
+ * Bulk runs that parse --domtblout text for billions of rows pay for
+ * the text formatting twice, once writing and once parsing. A binary
+ * result file stores each query's reported hits with the same
+ * serializers hmmpgmd uses (p7_hit_Serialize(), which includes the
+ * hit's domains and alignment displays), plus an index that gives
+ * random access to any query or hit. hmmbinconvert turns a binary
+ * result file back into the usual --tblout/--domtblout text.
+ *
+ * File layout. All integers are unsigned and in network (big-endian)
+ * byte order; doubles are stored as their 64-bit pattern, like the
+ * serializers do. Strings are stored as a uint32 length including
+ * the trailing NUL, then the bytes; a NULL string has length 0.
+ *
+ *   header:  8 bytes    magic "HMMRBIN1"
+ *            uint32     format version (p7_BINOUT_VERSION)
+ *            uint32     pipeline mode (p7_SEARCH_SEQS | p7_SCAN_MODELS)
+ *            string     program name
+ *            string     query file name
+ *            string     target file name
+ *
+ *   query:   uint32     p7_BINOUT_QUERYTAG
+ *   (each)   string     query name
+ *            string     query accession
+ *            uint32     long_targets flag
+ *            uint32     inc_by_E flag
+ *            double     Z
+ *            double     domZ
+ *            uint64     nhits, the number of reported hits stored
+ *            ...        nhits serialized hits, in rank order
+ *            uint64     nhits+1 file offsets: start of each hit, then
+ *                       the end of the last one
+ *
+ *   index:   uint32     p7_BINOUT_INDEXTAG
+ *            uint64     nquery
+ *            3 x uint64 for each query: offset of the query record,
+ *                       its nhits, offset of its hit offset table
+ *
+ *   trailer: uint64     offset of the index
+ *            8 bytes    magic "HMMRBIN1"
+ *
+ * A writer only keeps the index in memory (24 bytes per query), so
+ * writing doesn't require a seekable stream; reading does.
+ *
+ * Contents:
+ *    1. The P7_BINOUT object: writing.
+ *    2. Reading.
+ *    3. Internal functions.
+ *    4. Unit tests.
+ *    5. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "hmmer.h"
+
+static int binout_write   (P7_BINOUT *bo, const void *p, size_t n);
+static int binout_write32 (P7_BINOUT *bo, uint32_t x);
+static int binout_write64 (P7_BINOUT *bo, uint64_t x);
+static int binout_writeD  (P7_BINOUT *bo, double x);
+static int binout_writestr(P7_BINOUT *bo, const char *s);
+static int binout_read32  (FILE *fp, uint32_t *ret_x);
+static int binout_read64  (FILE *fp, uint64_t *ret_x);
+static int binout_readD   (FILE *fp, double *ret_x);
+static int binout_readstr (FILE *fp, char **ret_s);
+static int binout_readhit (P7_BINOUT *bo, uint64_t hitoff, uint64_t hitend, P7_HIT *hit);
+
+
+/*****************************************************************
+ *= 1. The P7_BINOUT object: writing
+ *****************************************************************/
+
+/* Function:  p7_binout_Create()
+ * Synopsis:  Create a binary result file writer.
+ *
+ * Purpose:   Create a writer for binary search results on open
+ *            stream <fp>, and write the file header: the name of
+ *            the program <progname>, the pipeline mode <mode>, and
+ *            the query and target file names <qfile> and <tfile>
+ *            (any of the names may be <NULL>). Then write each
+ *            query's results with <p7_binout_WriteQuery()>, and
+ *            finish the file with <p7_binout_WriteIndex()>.
+ *
+ *            <fp> is written sequentially, so it may be a pipe. It
+ *            remains the caller's to close.
+ *
+ * Returns:   <eslOK> on success, and <*ret_bo> points to the new
+ *            writer.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEWRITE> on a
+ *            write error. <*ret_bo> is <NULL>.
+ */
+int
+p7_binout_Create(FILE *fp, const char *progname, enum p7_pipemodes_e mode, const char *qfile, const char *tfile, P7_BINOUT **ret_bo)
+{
+  P7_BINOUT *bo = NULL;
+  int        status;
+
+  ESL_ALLOC(bo, sizeof(P7_BINOUT));
+  memset(bo, 0, sizeof(P7_BINOUT));
+  bo->fp        = fp;
+  bo->is_writer = TRUE;
+  bo->mode      = mode;
+
+  if ((status = binout_write  (bo, p7_BINOUT_MAGIC, 8))     != eslOK) goto ERROR;
+  if ((status = binout_write32(bo, p7_BINOUT_VERSION))      != eslOK) goto ERROR;
+  if ((status = binout_write32(bo, (uint32_t) mode))        != eslOK) goto ERROR;
+  if ((status = binout_writestr(bo, progname))              != eslOK) goto ERROR;
+  if ((status = binout_writestr(bo, qfile))                 != eslOK) goto ERROR;
+  if ((status = binout_writestr(bo, tfile))                 != eslOK) goto ERROR;
+
+  *ret_bo = bo;
+  return eslOK;
+
+ ERROR:
+  p7_binout_Close(bo);
+  *ret_bo = NULL;
+  return status;
+}
+
+
+/* Function:  p7_binout_WriteQuery()
+ * Synopsis:  Write one query's results to a binary result file.
+ *
+ * Purpose:   Write the reported hits in sorted, thresholded hit list
+ *            <th> for query <qname> (with accession <qacc>, or
+ *            <NULL>) to binary result file <bo>, along with what
+ *            the tabular writers need from pipeline <pli> (Z, domZ,
+ *            and a couple of flags). Call this where
+ *            <p7_tophits_TabularTargets()> would be called.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEWRITE> on a
+ *            write error.
+ */
+int
+p7_binout_WriteQuery(P7_BINOUT *bo, char *qname, char *qacc, P7_TOPHITS *th, P7_PIPELINE *pli)
+{
+  uint64_t *hoff   = NULL;	/* file offset of each stored hit, +1 for the end */
+  uint32_t  n      = 0;
+  uint64_t  nhits  = 0;
+  uint64_t  h;
+  void     *p;
+  int       status;
+
+  if (bo->nquery == bo->nqalloc)
+    {
+      bo->nqalloc = (bo->nqalloc == 0 ? 64 : bo->nqalloc * 2);
+      ESL_RALLOC(bo->qoff,  p, sizeof(uint64_t) * bo->nqalloc);
+      ESL_RALLOC(bo->nhits, p, sizeof(uint64_t) * bo->nqalloc);
+      ESL_RALLOC(bo->hoff,  p, sizeof(uint64_t) * bo->nqalloc);
+    }
+
+  for (h = 0; h < th->N; h++)
+    if (th->hit[h]->flags & p7_IS_REPORTED) nhits++;
+  ESL_ALLOC(hoff, sizeof(uint64_t) * (nhits+1));
+
+  bo->qoff[bo->nquery]  = bo->offset;
+  bo->nhits[bo->nquery] = nhits;
+  if ((status = binout_write32 (bo, p7_BINOUT_QUERYTAG))  != eslOK) goto ERROR;
+  if ((status = binout_writestr(bo, qname))               != eslOK) goto ERROR;
+  if ((status = binout_writestr(bo, qacc))                != eslOK) goto ERROR;
+  if ((status = binout_write32 (bo, pli->long_targets))   != eslOK) goto ERROR;
+  if ((status = binout_write32 (bo, pli->inc_by_E))       != eslOK) goto ERROR;
+  if ((status = binout_writeD  (bo, pli->Z))              != eslOK) goto ERROR;
+  if ((status = binout_writeD  (bo, pli->domZ))           != eslOK) goto ERROR;
+  if ((status = binout_write64 (bo, nhits))               != eslOK) goto ERROR;
+
+  /* serialize one hit at a time into the reusable buffer */
+  for (nhits = 0, h = 0; h < th->N; h++)
+    {
+      if (! (th->hit[h]->flags & p7_IS_REPORTED)) continue;
+      hoff[nhits++] = bo->offset;
+
+      n = 0;
+      if ((status = p7_hit_Serialize(th->hit[h], &(bo->buf), &n, &(bo->nalloc))) != eslOK) goto ERROR;
+      if ((status = binout_write(bo, bo->buf, n))                                 != eslOK) goto ERROR;
+    }
+  hoff[nhits] = bo->offset;
+
+  bo->hoff[bo->nquery] = bo->offset;
+  for (h = 0; h <= nhits; h++)
+    if ((status = binout_write64(bo, hoff[h])) != eslOK) goto ERROR;
+
+  bo->nquery++;
+  free(hoff);
+  return eslOK;
+
+ ERROR:
+  if (hoff) free(hoff);
+  return status;
+}
+
+
+/* Function:  p7_binout_WriteIndex()
+ * Synopsis:  Finish a binary result file.
+ *
+ * Purpose:   Write the query index and trailer to binary result file
+ *            <bo>, and flush its stream. The file isn't readable
+ *            until this is done. Call it once, after the last
+ *            query.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on a write error.
+ */
+int
+p7_binout_WriteIndex(P7_BINOUT *bo)
+{
+  uint64_t idxoff = bo->offset;
+  int64_t  q;
+  int      status;
+
+  if ((status = binout_write32(bo, p7_BINOUT_INDEXTAG))    != eslOK) return status;
+  if ((status = binout_write64(bo, (uint64_t) bo->nquery)) != eslOK) return status;
+  for (q = 0; q < bo->nquery; q++)
+    {
+      if ((status = binout_write64(bo, bo->qoff[q]))  != eslOK) return status;
+      if ((status = binout_write64(bo, bo->nhits[q])) != eslOK) return status;
+      if ((status = binout_write64(bo, bo->hoff[q]))  != eslOK) return status;
+    }
+  if ((status = binout_write64(bo, idxoff))              != eslOK) return status;
+  if ((status = binout_write  (bo, p7_BINOUT_MAGIC, 8))  != eslOK) return status;
+
+  if (fflush(bo->fp) != 0) ESL_EXCEPTION_SYS(eslEWRITE, "binary result file flush failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_binout_Close()
+ * Synopsis:  Free a binary result file reader or writer.
+ *
+ * Purpose:   Free binary result file object <bo>. A reader's stream
+ *            is closed, since <p7_binout_Open()> opened it; a
+ *            writer's stream belongs to the caller.
+ */
+void
+p7_binout_Close(P7_BINOUT *bo)
+{
+  if (bo == NULL) return;
+
+  if (! bo->is_writer && bo->fp) fclose(bo->fp);
+  if (bo->progname) free(bo->progname);
+  if (bo->qfile)    free(bo->qfile);
+  if (bo->tfile)    free(bo->tfile);
+  if (bo->qname)    free(bo->qname);
+  if (bo->qacc)     free(bo->qacc);
+  if (bo->qoff)     free(bo->qoff);
+  if (bo->nhits)    free(bo->nhits);
+  if (bo->hoff)     free(bo->hoff);
+  if (bo->buf)      free(bo->buf);
+  free(bo);
+}
+/*------------------ end, writing binary results -----------------*/
+
+
+
+/*****************************************************************
+ *= 2. Reading
+ *****************************************************************/
+
+/* Function:  p7_binout_Open()
+ * Synopsis:  Open a binary result file for reading.
+ *
+ * Purpose:   Open binary result file <filename>, check its header
+ *            and trailer, and read its query index. Query results
+ *            are then read by number with <p7_binout_ReadQuery()>,
+ *            or single hits with <p7_binout_ReadHit()>.
+ *
+ *            The file must be seekable. The header fields are
+ *            available in <bo->progname>, <bo->mode>, <bo->qfile>
+ *            and <bo->tfile>, and the number of queries in
+ *            <bo->nquery>.
+ *
+ * Returns:   <eslOK> on success, and <*ret_bo> points to the open
+ *            reader.
+ *
+ *            <eslENOTFOUND> if <filename> can't be opened;
+ *            <eslEFORMAT> if it isn't a complete binary result file
+ *            of a version we can read. <errbuf>, if non-<NULL>,
+ *            holds an informative message, and <*ret_bo> is
+ *            <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_binout_Open(char *filename, P7_BINOUT **ret_bo, char *errbuf)
+{
+  P7_BINOUT *bo = NULL;
+  char       magic[8];
+  uint64_t   idxoff;
+  uint64_t   nquery;
+  uint32_t   x;
+  int64_t    q;
+  int        status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+  ESL_ALLOC(bo, sizeof(P7_BINOUT));
+  memset(bo, 0, sizeof(P7_BINOUT));
+  bo->is_writer = FALSE;
+  bo->curr      = -1;
+
+  if ((bo->fp = fopen(filename, "rb")) == NULL) ESL_XFAIL(eslENOTFOUND, errbuf, "couldn't open binary result file %s", filename);
+
+  /* header */
+  if (fread(magic, 1, 8, bo->fp) != 8 || memcmp(magic, p7_BINOUT_MAGIC, 8) != 0)
+    ESL_XFAIL(eslEFORMAT, errbuf, "%s isn't a binary result file", filename);
+  if (binout_read32(bo->fp, &x) != eslOK || x != p7_BINOUT_VERSION)
+    ESL_XFAIL(eslEFORMAT, errbuf, "%s is a binary result file of an unknown version", filename);
+  if (binout_read32(bo->fp, &x) != eslOK || (x != p7_SEARCH_SEQS && x != p7_SCAN_MODELS))
+    ESL_XFAIL(eslEFORMAT, errbuf, "bad pipeline mode in header of %s", filename);
+  bo->mode = (enum p7_pipemodes_e) x;
+  if ((status = binout_readstr(bo->fp, &(bo->progname))) == eslEMEM) goto ERROR;
+  if (status == eslOK) status = binout_readstr(bo->fp, &(bo->qfile));
+  if (status == eslOK) status = binout_readstr(bo->fp, &(bo->tfile));
+  if (status == eslEMEM) goto ERROR;
+  if (status != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "truncated header in %s", filename);
+
+  /* trailer: index offset and closing magic */
+  if (fseeko(bo->fp, -16, SEEK_END) != 0 ||
+      binout_read64(bo->fp, &idxoff) != eslOK ||
+      fread(magic, 1, 8, bo->fp) != 8 || memcmp(magic, p7_BINOUT_MAGIC, 8) != 0)
+    ESL_XFAIL(eslEFORMAT, errbuf, "%s is truncated or still being written: no index", filename);
+
+  /* index */
+  if (fseeko(bo->fp, (off_t) idxoff, SEEK_SET) != 0 ||
+      binout_read32(bo->fp, &x)      != eslOK || x != p7_BINOUT_INDEXTAG ||
+      binout_read64(bo->fp, &nquery) != eslOK)
+    ESL_XFAIL(eslEFORMAT, errbuf, "bad index in %s", filename);
+
+  bo->nquery  = (int64_t) nquery;
+  bo->nqalloc = ESL_MAX(1, bo->nquery);
+  ESL_ALLOC(bo->qoff,  sizeof(uint64_t) * bo->nqalloc);
+  ESL_ALLOC(bo->nhits, sizeof(uint64_t) * bo->nqalloc);
+  ESL_ALLOC(bo->hoff,  sizeof(uint64_t) * bo->nqalloc);
+  for (q = 0; q < bo->nquery; q++)
+    {
+      if (binout_read64(bo->fp, &(bo->qoff[q]))  != eslOK ||
+	  binout_read64(bo->fp, &(bo->nhits[q])) != eslOK ||
+	  binout_read64(bo->fp, &(bo->hoff[q]))  != eslOK)
+	ESL_XFAIL(eslEFORMAT, errbuf, "truncated index in %s", filename);
+    }
+
+  *ret_bo = bo;
+  return eslOK;
+
+ ERROR:
+  p7_binout_Close(bo);
+  *ret_bo = NULL;
+  return status;
+}
+
+
+/* Function:  p7_binout_ReadQuery()
+ * Synopsis:  Read one query's results from a binary result file.
+ *
+ * Purpose:   Read the results for query number <q> (0..nquery-1)
+ *            from binary result file <bo>, and return them as a new
+ *            hit list in <*ret_th>, sorted and thresholded as they
+ *            were written. The query's name and accession are left
+ *            in <bo->qname> and <bo->qacc>, and <bo->pli> is set up
+ *            with the fields that the tabular writers use, so for
+ *            example
+ *            <p7_tophits_TabularDomains(ofp, bo->qname, bo->qacc, th, &(bo->pli), TRUE)>
+ *            reproduces --domtblout rows.
+ *
+ *            <bo->pli> is not a working pipeline: only its mode, Z,
+ *            domZ, long_targets and inc_by_E fields are set, and
+ *            everything else is zero.
+ *
+ * Returns:   <eslOK> on success. Caller frees <*ret_th> with
+ *            <p7_tophits_Destroy()>.
+ *
+ *            <eslEFORMAT> if the query's record is bad; error
+ *            message in <bo->errbuf>.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEINVAL> if <q>
+ *            is out of range.
+ */
+int
+p7_binout_ReadQuery(P7_BINOUT *bo, int64_t q, P7_TOPHITS **ret_th)
+{
+  P7_TOPHITS *th     = NULL;
+  uint64_t   *hoff   = NULL;
+  uint64_t    nhits;
+  uint64_t    h;
+  uint32_t    x;
+  int         status;
+
+  if (q < 0 || q >= bo->nquery) ESL_XEXCEPTION(eslEINVAL, "no such query %" PRId64, q);
+
+  if (bo->qname) { free(bo->qname); bo->qname = NULL; }
+  if (bo->qacc)  { free(bo->qacc);  bo->qacc  = NULL; }
+  memset(&(bo->pli), 0, sizeof(P7_PIPELINE));
+  bo->pli.mode = bo->mode;
+  bo->curr     = -1;
+
+  if (fseeko(bo->fp, (off_t) bo->qoff[q], SEEK_SET) != 0)                   ESL_XFAIL(eslEFORMAT, bo->errbuf, "failed to seek to query %" PRId64, q);
+  if (binout_read32(bo->fp, &x) != eslOK || x != p7_BINOUT_QUERYTAG)        ESL_XFAIL(eslEFORMAT, bo->errbuf, "bad record for query %" PRId64, q);
+  if ((status = binout_readstr(bo->fp, &(bo->qname))) == eslEMEM)           goto ERROR;
+  if (status == eslOK) status = binout_readstr(bo->fp, &(bo->qacc));
+  if (status == eslEMEM)                                                    goto ERROR;
+  if (status != eslOK || bo->qname == NULL)                                 ESL_XFAIL(eslEFORMAT, bo->errbuf, "bad name for query %" PRId64, q);
+  if (binout_read32(bo->fp, &x) != eslOK)                                   ESL_XFAIL(eslEFORMAT, bo->errbuf, "truncated record for query %" PRId64, q);
+  bo->pli.long_targets = x;
+  if (binout_read32(bo->fp, &x) != eslOK)                                   ESL_XFAIL(eslEFORMAT, bo->errbuf, "truncated record for query %" PRId64, q);
+  bo->pli.inc_by_E = x;
+  if (binout_readD (bo->fp, &(bo->pli.Z))    != eslOK ||
+      binout_readD (bo->fp, &(bo->pli.domZ)) != eslOK ||
+      binout_read64(bo->fp, &nhits)          != eslOK || nhits != bo->nhits[q])
+    ESL_XFAIL(eslEFORMAT, bo->errbuf, "truncated record for query %" PRId64, q);
+
+  /* hit offset table */
+  ESL_ALLOC(hoff, sizeof(uint64_t) * (nhits+1));
+  if (fseeko(bo->fp, (off_t) bo->hoff[q], SEEK_SET) != 0)                   ESL_XFAIL(eslEFORMAT, bo->errbuf, "failed to seek to hit table of query %" PRId64, q);
+  for (h = 0; h <= nhits; h++)
+    if (binout_read64(bo->fp, &(hoff[h])) != eslOK)                         ESL_XFAIL(eslEFORMAT, bo->errbuf, "truncated hit table for query %" PRId64, q);
+
+  if ((th = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
+  while (nhits > th->Nalloc)
+    if ((status = p7_tophits_Grow(th)) != eslOK) goto ERROR;
+
+  for (h = 0; h < nhits; h++)
+    {
+      th->unsrt[h].name = th->unsrt[h].acc = th->unsrt[h].desc = NULL;
+      th->unsrt[h].dcl  = NULL;
+      th->unsrt[h].ndom = 0;
+      th->unsrt[h].in_arena = FALSE;
+      th->N = h+1;		/* so Destroy cleans up a partial list */
+      if ((status = binout_readhit(bo, hoff[h], hoff[h+1], &(th->unsrt[h]))) != eslOK) goto ERROR;
+
+      th->hit[h] = &(th->unsrt[h]);
+      if (th->unsrt[h].flags & p7_IS_REPORTED) th->nreported++;
+      if (th->unsrt[h].flags & p7_IS_INCLUDED) th->nincluded++;
+    }
+  th->N                    = nhits;
+  th->is_sorted_by_sortkey = TRUE;
+  th->is_sorted_by_seqidx  = FALSE;
+
+  bo->curr = q;
+  free(hoff);
+  *ret_th = th;
+  return eslOK;
+
+ ERROR:
+  if (hoff) free(hoff);
+  p7_tophits_Destroy(th);
+  *ret_th = NULL;
+  return status;
+}
+
+
+/* Function:  p7_binout_ReadHit()
+ * Synopsis:  Read a single hit from a binary result file.
+ *
+ * Purpose:   Read hit number <h> (in rank order, 0..nhits-1) of
+ *            query number <q> in binary result file <bo>, without
+ *            reading the rest of the query's hits, and return it as
+ *            a new hit in <*ret_hit>.
+ *
+ * Returns:   <eslOK> on success. Caller frees <*ret_hit> with
+ *            <p7_hit_Destroy()>.
+ *
+ *            <eslEFORMAT> if the hit's record is bad; error message
+ *            in <bo->errbuf>.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEINVAL> if <q> or
+ *            <h> is out of range.
+ */
+int
+p7_binout_ReadHit(P7_BINOUT *bo, int64_t q, uint64_t h, P7_HIT **ret_hit)
+{
+  P7_HIT   *hit = NULL;
+  uint64_t  hitoff, hitend;
+  int       status;
+
+  if (q < 0 || q >= bo->nquery) ESL_XEXCEPTION(eslEINVAL, "no such query %" PRId64, q);
+  if (h >= bo->nhits[q])        ESL_XEXCEPTION(eslEINVAL, "no such hit %" PRIu64 " for query %" PRId64, h, q);
+
+  if (fseeko(bo->fp, (off_t) (bo->hoff[q] + h * sizeof(uint64_t)), SEEK_SET) != 0 ||
+      binout_read64(bo->fp, &hitoff) != eslOK ||
+      binout_read64(bo->fp, &hitend) != eslOK)
+    ESL_XFAIL(eslEFORMAT, bo->errbuf, "bad hit table for query %" PRId64, q);
+
+  if ((hit = p7_hit_Create_empty()) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = binout_readhit(bo, hitoff, hitend, hit)) != eslOK) goto ERROR;
+
+  *ret_hit = hit;
+  return eslOK;
+
+ ERROR:
+  if (hit) p7_hit_Destroy(hit);
+  *ret_hit = NULL;
+  return status;
+}
+/*------------------ end, reading binary results -----------------*/
+
+
+
+/*****************************************************************
+ * 3. Internal functions
+ *****************************************************************/
+
+static int
+binout_write(P7_BINOUT *bo, const void *p, size_t n)
+{
+  if (n > 0 && fwrite(p, 1, n, bo->fp) != n) ESL_EXCEPTION_SYS(eslEWRITE, "binary result file write failed");
+  bo->offset += n;
+  return eslOK;
+}
+
+static int
+binout_write32(P7_BINOUT *bo, uint32_t x)
+{
+  uint32_t network_32bit = esl_hton32(x);
+  return binout_write(bo, &network_32bit, sizeof(uint32_t));
+}
+
+static int
+binout_write64(P7_BINOUT *bo, uint64_t x)
+{
+  uint64_t network_64bit = esl_hton64(x);
+  return binout_write(bo, &network_64bit, sizeof(uint64_t));
+}
+
+static int
+binout_writeD(P7_BINOUT *bo, double x)
+{
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(uint64_t));
+  return binout_write64(bo, bits);
+}
+
+static int
+binout_writestr(P7_BINOUT *bo, const char *s)
+{
+  uint32_t n = (s ? strlen(s) + 1 : 0);
+  int      status;
+
+  if ((status = binout_write32(bo, n)) != eslOK) return status;
+  return binout_write(bo, s, n);
+}
+
+/* the readers return eslEOF on a short read, for the caller to report as eslEFORMAT */
+static int
+binout_read32(FILE *fp, uint32_t *ret_x)
+{
+  uint32_t network_32bit;
+  if (fread(&network_32bit, sizeof(uint32_t), 1, fp) != 1) return eslEOF;
+  *ret_x = esl_ntoh32(network_32bit);
+  return eslOK;
+}
+
+static int
+binout_read64(FILE *fp, uint64_t *ret_x)
+{
+  uint64_t network_64bit;
+  if (fread(&network_64bit, sizeof(uint64_t), 1, fp) != 1) return eslEOF;
+  *ret_x = esl_ntoh64(network_64bit);
+  return eslOK;
+}
+
+static int
+binout_readD(FILE *fp, double *ret_x)
+{
+  uint64_t bits;
+  if (binout_read64(fp, &bits) != eslOK) return eslEOF;
+  memcpy(ret_x, &bits, sizeof(double));
+  return eslOK;
+}
+
+static int
+binout_readstr(FILE *fp, char **ret_s)
+{
+  char     *s = NULL;
+  uint32_t  n;
+  int       status;
+
+  *ret_s = NULL;
+  if (binout_read32(fp, &n) != eslOK) return eslEOF;
+  if (n == 0) return eslOK;
+
+  ESL_ALLOC(s, n);
+  if (fread(s, 1, n, fp) != n || s[n-1] != '\0') { free(s); return eslEOF; }
+  *ret_s = s;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* binout_readhit()
+ *
+ * Read the serialized hit that occupies file offsets <hitoff>..<hitend>-1
+ * in <bo> into <hit>, whose string and domain pointers are NULL or
+ * owned by it.
+ */
+static int
+binout_readhit(P7_BINOUT *bo, uint64_t hitoff, uint64_t hitend, P7_HIT *hit)
+{
+  uint32_t n = 0;
+  void    *p;
+  int      status;
+
+  if (hitend <= hitoff || hitend - hitoff > UINT32_MAX) ESL_XFAIL(eslEFORMAT, bo->errbuf, "bad hit offsets");
+  if (hitend - hitoff > bo->nalloc)
+    {
+      ESL_RALLOC(bo->buf, p, hitend - hitoff);
+      bo->nalloc = hitend - hitoff;
+    }
+
+  if (fseeko(bo->fp, (off_t) hitoff, SEEK_SET) != 0 ||
+      fread(bo->buf, 1, hitend - hitoff, bo->fp) != hitend - hitoff)
+    ESL_XFAIL(eslEFORMAT, bo->errbuf, "truncated hit");
+
+  if ((status = p7_hit_Deserialize(bo->buf, &n, hit)) == eslEMEM) goto ERROR;
+  if (status != eslOK || n != hitend - hitoff) ESL_XFAIL(eslEFORMAT, bo->errbuf, "bad serialized hit");
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests
+ *****************************************************************/
+#ifdef p7BINOUT_TESTDRIVE
+
+/* utest_roundtrip()
+ *
+ * Write <nquery> queries of random hits to a binary result file, with
+ * a random subset of the hits reported; read them back by query and
+ * by single hit, and check we get the reported hits back in order.
+ */
+static void
+utest_roundtrip(ESL_RAND64 *rng, int nquery, int nhits)
+{
+  char           msg[]    = "p7_binout roundtrip unit test failed";
+  char           tmpname[32] = "esltmpXXXXXX";
+  FILE          *fp       = NULL;
+  P7_BINOUT     *bo       = NULL;
+  P7_TOPHITS   **th       = NULL;
+  P7_TOPHITS    *th2      = NULL;
+  P7_HIT        *hit      = NULL;
+  P7_PIPELINE    pli;
+  char           qname[32];
+  int64_t        q;
+  uint64_t       h, r;
+  int            status;
+
+  memset(&pli, 0, sizeof(P7_PIPELINE));
+  pli.mode = p7_SEARCH_SEQS;
+  pli.Z    = 1000.;
+  pli.domZ = 10.;
+
+  ESL_ALLOC(th, sizeof(P7_TOPHITS *) * nquery);
+  for (q = 0; q < nquery; q++)
+    {
+      if ((th[q] = p7_tophits_Create()) == NULL) esl_fatal(msg);
+      for (h = 0; h < nhits; h++)
+	{
+	  if (p7_hit_TestSample(rng, &hit) != eslOK) esl_fatal(msg);
+	  while (th[q]->N >= th[q]->Nalloc) p7_tophits_Grow(th[q]);
+	  th[q]->unsrt[th[q]->N] = *hit; /* shallow: th[q] takes over hit's internals */
+	  free(hit);
+	  th[q]->unsrt[th[q]->N].flags = (esl_rand64_Roll(rng, 2) ? p7_IS_REPORTED : 0);
+	  th[q]->N++;
+	}
+      for (h = 0; h < th[q]->N; h++) th[q]->hit[h] = &(th[q]->unsrt[h]);
+    }
+
+  if (esl_tmpfile_named(tmpname, &fp)                                            != eslOK) esl_fatal(msg);
+  if (p7_binout_Create(fp, "utest", p7_SEARCH_SEQS, "qfile", NULL, &bo)          != eslOK) esl_fatal(msg);
+  for (q = 0; q < nquery; q++)
+    {
+      snprintf(qname, 32, "query%d", (int) q);
+      pli.long_targets = q % 2;
+      if (p7_binout_WriteQuery(bo, qname, (q % 2 ? NULL : "ACC"), th[q], &pli) != eslOK) esl_fatal(msg);
+    }
+  if (p7_binout_WriteIndex(bo) != eslOK) esl_fatal(msg);
+  p7_binout_Close(bo);
+  fclose(fp);
+
+  if (p7_binout_Open(tmpname, &bo, NULL) != eslOK)   esl_fatal(msg);
+  if (bo->nquery != nquery)                          esl_fatal(msg);
+  if (strcmp(bo->progname, "utest") != 0)            esl_fatal(msg);
+  if (strcmp(bo->qfile,    "qfile") != 0)            esl_fatal(msg);
+  if (bo->tfile != NULL || bo->mode != p7_SEARCH_SEQS) esl_fatal(msg);
+
+  for (q = nquery-1; q >= 0; q--)   /* backwards, to exercise random access */
+    {
+      snprintf(qname, 32, "query%d", (int) q);
+      if (p7_binout_ReadQuery(bo, q, &th2) != eslOK)         esl_fatal(msg);
+      if (strcmp(bo->qname, qname) != 0)                     esl_fatal(msg);
+      if ((q % 2) != (bo->qacc == NULL))                     esl_fatal(msg);
+      if (bo->pli.Z != pli.Z || bo->pli.domZ != pli.domZ)    esl_fatal(msg);
+      if (bo->pli.long_targets != q % 2)                     esl_fatal(msg);
+      if (th2->N != th2->nreported)                          esl_fatal(msg);
+
+      for (r = 0, h = 0; h < th[q]->N; h++)
+	{
+	  if (! (th[q]->hit[h]->flags & p7_IS_REPORTED)) continue;
+	  if (r >= th2->N)                                               esl_fatal(msg);
+	  if (p7_hit_Compare(th[q]->hit[h], th2->hit[r], 1e-5, 1e-5) != eslOK) esl_fatal(msg);
+
+	  if (p7_binout_ReadHit(bo, q, r, &hit) != eslOK)                esl_fatal(msg);
+	  if (p7_hit_Compare(th[q]->hit[h], hit, 1e-5, 1e-5) != eslOK)   esl_fatal(msg);
+	  p7_hit_Destroy(hit);
+	  r++;
+	}
+      if (r != th2->N) esl_fatal(msg);
+      if (p7_binout_ReadHit(bo, q, r, &hit) != eslEINVAL) esl_fatal(msg);
+      p7_tophits_Destroy(th2);
+    }
+
+  p7_binout_Close(bo);
+  remove(tmpname);
+  for (q = 0; q < nquery; q++) p7_tophits_Destroy(th[q]);
+  free(th);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*p7BINOUT_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7BINOUT_TESTDRIVE
+/*
+  gcc -o p7_binout_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7BINOUT_TESTDRIVE p7_binout.c -lhmmer -leasel -lm
+  ./p7_binout_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,      "5", NULL, NULL,  NULL,  NULL, NULL, "number of queries to write",                       0 },
+  { "-M",        eslARG_INT,     "20", NULL, NULL,  NULL,  NULL, NULL, "number of hits per query",                         0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_BINOUT";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RAND64  *rng = esl_rand64_Create(esl_opt_GetInteger(go, "-s"));
+
+  utest_roundtrip(rng, esl_opt_GetInteger(go, "-N"), esl_opt_GetInteger(go, "-M"));
+
+  esl_rand64_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7BINOUT_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
@@ -4,11 +4,15 @@
  *    1. P7_BUILDER: allocation, initialization, destruction
  *    2. Standardized model construction API.
  *    3. Internal functions.
+ *    4. Cache of calibrated single sequence query models.
  */   
 #include <p7_config.h>
 
+#include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -117,6 +121,8 @@ p7_builder_Create(const ESL_GETOPTS *go, const ESL_ALPHABET *abc)
   bld->EfL        = (go != NULL) ?  esl_opt_GetInteger(go, "--EfL")        : 100;
   bld->EfN        = (go != NULL) ?  esl_opt_GetInteger(go, "--EfN")        : 200;
   bld->Eft        = (go != NULL) ?  esl_opt_GetReal   (go, "--Eft")        : 0.04;
+  bld->Ecpu       = 0;	/* hmmbuild-only option; set by caller */
+  bld->Mcpu       = 0;	/* hmmbuild-only option; set by caller */
 
   /* Normally we reinitialize the RNG to original seed before calibrating each model.
    * This eliminates run-to-run variation.
@@ -146,6 +152,7 @@ p7_builder_Create(const ESL_GETOPTS *go, const ESL_ALPHABET *abc)
 
   bld->popen   = -1;
   bld->pextend = -1;
+  bld->qcache  = NULL;
 
   return bld;
   
@@ -339,6 +346,47 @@ p7_builder_SetScoreSystem(P7_BUILDER *bld, const char *mxfile, const char *env,
 
 
 
+/* Function:  p7_builder_SetQueryCache()
+ * Synopsis:  Cache calibrated single sequence query models on disk.
+ *
+ * Purpose:   Make <p7_SingleBuilder()> keep the calibrated models it
+ *            builds in directory <dir>, and reuse them when it's asked
+ *            for the same model again, skipping the calibration
+ *            simulations that dominate its time. Each model is a
+ *            binary HMM file, named for a 64-bit hash of everything
+ *            that determines it: the query residues, the score system
+ *            (its conditional probabilities and gap probabilities), the
+ *            background frequencies, the calibration parameters and
+ *            RNG seed, and the window length settings. A model read
+ *            from the cache is exactly the one that would have been
+ *            built.
+ *
+ *            The cache is only used when calibration is reproducible
+ *            (<bld->do_reseeding>, a nonzero seed). The directory must
+ *            already exist. Several processes can share it: files are
+ *            written under a temporary name and renamed into place.
+ *
+ *            <dir> of <NULL> turns the cache off.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_builder_SetQueryCache(P7_BUILDER *bld, const char *dir)
+{
+  int status;
+
+  if (bld->qcache) free(bld->qcache);
+  bld->qcache = NULL;
+  if (dir && (status = esl_strdup(dir, -1, &(bld->qcache))) != eslOK) goto ERROR;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
 /* Function:  p7_builder_Destroy()
  * Synopsis:  Free a <P7_BUILDER>
  *
@@ -353,6 +401,7 @@ p7_builder_Destroy(P7_BUILDER *bld)
   if (bld->r       != NULL) esl_randomness_Destroy(bld->r);
   if (bld->Q       != NULL) esl_dmatrix_Destroy(bld->Q);
   if (bld->S       != NULL) esl_scorematrix_Destroy(bld->S);
+  if (bld->qcache  != NULL) free(bld->qcache);
 
   free(bld);
   return;
@@ -374,6 +423,10 @@ static int    parameterize         (P7_BUILDER *bld, P7_HMM *hmm);
 static int    annotate             (P7_BUILDER *bld, const ESL_MSA *msa, P7_HMM *hmm);
 static int    calibrate            (P7_BUILDER *bld, P7_HMM *hmm, P7_BG *bg, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om);
 static int    make_post_msa        (P7_BUILDER *bld, const ESL_MSA *premsa, const P7_HMM *hmm, P7_TRACE **tr, ESL_MSA **opt_postmsa);
+static void   qcache_key           (const P7_BUILDER *bld, const ESL_SQ *sq, const P7_BG *bg, char *key);
+static int    qcache_read          (const P7_BUILDER *bld, const char *key, const ESL_SQ *sq, P7_HMM **ret_hmm);
+static void   qcache_write         (const P7_BUILDER *bld, const char *key, P7_HMM *hmm);
+static int    qcache_profiles      (const P7_BUILDER *bld, P7_HMM *hmm, P7_BG *bg, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om);
 
 /* Function:  p7_Builder()
  * Synopsis:  Build a new HMM from an MSA.
@@ -480,6 +533,11 @@ p7_Builder(P7_BUILDER *bld, ESL_MSA *msa, P7_BG *bg,
  *            configuration must have been previously initialized by
  *            <p7_builder_SetScoreSystem()>.
  *            
+ *            If <bld> has a query model cache
+ *            (<p7_builder_SetQueryCache()>), a cached copy of the
+ *            model is used if there is one, and a newly built model
+ *            is added to the cache.
+ *            
  * Args:      bld       - build configuration
  *            sq        - query sequence
  *            bg        - null model (needed to parameterize insert emission probs)
@@ -498,22 +556,38 @@ p7_SingleBuilder(P7_BUILDER *bld, ESL_SQ *sq, P7_BG *bg, P7_HMM **opt_hmm,
 {
   P7_HMM   *hmm = NULL;
   P7_TRACE *tr  = NULL;
+  int       use_cache = (bld->qcache != NULL && bld->do_reseeding);
+  char      key[17];
   int       k;
   int       status;
   
   bld->errbuf[0] = '\0';
   if (! bld->Q) ESL_XEXCEPTION(eslEINVAL, "score system not initialized");
+  if (opt_gm != NULL) *opt_gm = NULL;
+  if (opt_om != NULL) *opt_om = NULL;
 
-  if ((status = p7_Seqmodel(bld->abc, sq->dsq, sq->n, sq->name, bld->Q, bg->f, bld->popen, bld->pextend, &hmm)) != eslOK) goto ERROR;
-  if ((status = p7_hmm_SetComposition(hmm))                                                                     != eslOK) goto ERROR;
-  if ((status = p7_hmm_SetConsensus(hmm, sq))                                                                   != eslOK) goto ERROR; 
-  if ((status = calibrate(bld, hmm, bg, opt_gm, opt_om))                                                        != eslOK) goto ERROR;
+  if (use_cache) 
+    {
+      qcache_key(bld, sq, bg, key);
+      if (qcache_read(bld, key, sq, &hmm) == eslOK &&
+	  (status = qcache_profiles(bld, hmm, bg, opt_gm, opt_om)) != eslOK) goto ERROR;
+    }
 
-  if ( bld->abc->type == eslDNA ||  bld->abc->type == eslRNA ) {
-    if (bld->w_len > 0)           hmm->max_length = bld->w_len;
-    else if (bld->w_beta == 0.0)  hmm->max_length = hmm->M *4;
-    else if ( (status =  p7_Builder_MaxLength(hmm, bld->w_beta)) != eslOK) goto ERROR;
-  }
+  if (hmm == NULL)
+    {
+      if ((status = p7_Seqmodel(bld->abc, sq->dsq, sq->n, sq->name, bld->Q, bg->f, bld->popen, bld->pextend, &hmm)) != eslOK) goto ERROR;
+      if ((status = p7_hmm_SetComposition(hmm))                                                                     != eslOK) goto ERROR;
+      if ((status = p7_hmm_SetConsensus(hmm, sq))                                                                   != eslOK) goto ERROR; 
+      if ((status = calibrate(bld, hmm, bg, opt_gm, opt_om))                                                        != eslOK) goto ERROR;
+
+      if ( bld->abc->type == eslDNA ||  bld->abc->type == eslRNA ) {
+	if (bld->w_len > 0)           hmm->max_length = bld->w_len;
+	else if (bld->w_beta == 0.0)  hmm->max_length = hmm->M *4;
+	else if ( (status =  p7_Builder_MaxLength(hmm, bld->w_beta)) != eslOK) goto ERROR;
+      }
+
+      if (use_cache) qcache_write(bld, key, hmm);
+    }
 
 
   /* build a faux trace: relative to core model (B->M_1..M_L->E) */
@@ -528,7 +602,7 @@ p7_SingleBuilder(P7_BUILDER *bld, ESL_SQ *sq, P7_BG *bg, P7_HMM **opt_hmm,
       tr->L = sq->n;
     }
 
-  /* note that <opt_gm> and <opt_om> were already set by calibrate() call above. */
+  /* note that <opt_gm> and <opt_om> were already set by calibrate() or qcache_profiles() above. */
   if (opt_hmm   != NULL) *opt_hmm = hmm; else p7_hmm_Destroy(hmm);
   if (opt_tr    != NULL) *opt_tr  = tr;
   return eslOK;
@@ -1026,7 +1100,8 @@ calibrate(P7_BUILDER *bld, P7_HMM *hmm, P7_BG *bg, P7_PROFILE **opt_gm, P7_OPROF
  * 
  * Optionally, we can return the alignment we actually built the model
  * from (including RF annotation on assigned consensus columns, and any
- * trace doctoring to enforce Plan7 consistency). 
+ * trace doctoring to enforce Plan7 consistency). The traces are the
+ * faux traces the model was built from, so no alignment DP is done.
  */
 static int
 make_post_msa(P7_BUILDER *bld, const ESL_MSA *premsa, const P7_HMM *hmm, P7_TRACE **tr, ESL_MSA **opt_postmsa)
@@ -1049,3 +1124,157 @@ make_post_msa(P7_BUILDER *bld, const ESL_MSA *premsa, const P7_HMM *hmm, P7_TRAC
 }
 /*---------------- end, internal functions ----------------------*/
 
+
+
+
+/*****************************************************************
+ * 4. Cache of calibrated single sequence query models.
+ *****************************************************************/
+
+/* 64-bit FNV-1a, accumulated into <*h> */
+static void
+qcache_hash(uint64_t *h, const void *p, size_t n)
+{
+  const unsigned char *b = (const unsigned char *) p;
+  size_t               i;
+
+  for (i = 0; i < n; i++) { *h ^= b[i]; *h *= 1099511628211ULL; }
+}
+
+/* qcache_key()
+ * 
+ * Set <key> (hex, 16 chars + NUL) to the hash of everything
+ * p7_SingleBuilder() builds a model of <sq> from.
+ */
+static void
+qcache_key(const P7_BUILDER *bld, const ESL_SQ *sq, const P7_BG *bg, char *key)
+{
+  uint64_t h    = 14695981039346656037ULL;
+  uint32_t seed = esl_randomness_GetSeed(bld->r);
+  int      a;
+
+  qcache_hash(&h, HMMER_VERSION, strlen(HMMER_VERSION));
+  qcache_hash(&h, &(bld->abc->type), sizeof(int));
+  qcache_hash(&h, &(sq->n),          sizeof(int64_t));
+  qcache_hash(&h, sq->dsq+1,         sizeof(ESL_DSQ) * sq->n);
+  for (a = 0; a < bld->Q->n; a++)
+    qcache_hash(&h, bld->Q->mx[a],   sizeof(double) * bld->Q->m);
+  qcache_hash(&h, bg->f,             sizeof(float) * bld->abc->K);
+  qcache_hash(&h, &(bld->popen),     sizeof(double));
+  qcache_hash(&h, &(bld->pextend),   sizeof(double));
+  qcache_hash(&h, &(bld->EmL),       sizeof(int));
+  qcache_hash(&h, &(bld->EmN),       sizeof(int));
+  qcache_hash(&h, &(bld->EvL),       sizeof(int));
+  qcache_hash(&h, &(bld->EvN),       sizeof(int));
+  qcache_hash(&h, &(bld->EfL),       sizeof(int));
+  qcache_hash(&h, &(bld->EfN),       sizeof(int));
+  qcache_hash(&h, &(bld->Eft),       sizeof(double));
+  qcache_hash(&h, &(bld->Ecpu),      sizeof(int));   /* a split calibration draws different samples */
+  qcache_hash(&h, &seed,             sizeof(uint32_t));
+  qcache_hash(&h, &(bld->w_len),     sizeof(int));
+  qcache_hash(&h, &(bld->w_beta),    sizeof(double));
+
+  snprintf(key, 17, "%016llx", (unsigned long long) h);
+}
+
+/* qcache_read()
+ * 
+ * Look for the model of <sq> under <key> in the cache. Anything short
+ * of a readable, calibrated model whose consensus is <sq>'s residues
+ * is a miss.
+ * 
+ * Returns <eslOK> and the model (renamed for <sq>) in <*ret_hmm> on
+ * a hit; <eslENOTFOUND> and <NULL> on a miss.
+ */
+static int
+qcache_read(const P7_BUILDER *bld, const char *key, const ESL_SQ *sq, P7_HMM **ret_hmm)
+{
+  ESL_ALPHABET *abc  = (ESL_ALPHABET *) bld->abc;
+  P7_HMMFILE   *hfp  = NULL;
+  P7_HMM       *hmm  = NULL;
+  char         *path = NULL;
+  char          errbuf[eslERRBUFSIZE];
+  int           k;
+
+  *ret_hmm = NULL;
+  if (esl_sprintf(&path, "%s/%s.hmm", bld->qcache, key)         != eslOK) goto MISS;
+  if (p7_hmmfile_OpenNoDB(path, NULL, &hfp, errbuf)            != eslOK) goto MISS;
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)                         != eslOK) goto MISS;
+  if (hmm->M != sq->n || ! (hmm->flags & p7H_CONS) || ! (hmm->flags & p7H_STATS)) goto MISS;
+  for (k = 1; k <= hmm->M; k++)
+    if (toupper(hmm->consensus[k]) != toupper(bld->abc->sym[sq->dsq[k]])) goto MISS;
+  if (p7_hmm_SetName(hmm, sq->name) != eslOK) goto MISS;
+  p7_hmm_SetCtime(hmm);
+
+  p7_hmmfile_Close(hfp);
+  free(path);
+  *ret_hmm = hmm;
+  return eslOK;
+
+ MISS:
+  if (hfp)  p7_hmmfile_Close(hfp);
+  if (hmm)  p7_hmm_Destroy(hmm);
+  if (path) free(path);
+  return eslENOTFOUND;
+}
+
+/* qcache_write()
+ * 
+ * Add <hmm> to the cache under <key>. The cache is only a shortcut,
+ * so failing to write it isn't an error.
+ */
+static void
+qcache_write(const P7_BUILDER *bld, const char *key, P7_HMM *hmm)
+{
+  FILE *fp   = NULL;
+  char *path = NULL;
+  char *tmp  = NULL;
+  int   ok   = FALSE;
+
+  if (esl_sprintf(&path, "%s/%s.hmm",        bld->qcache, key) != eslOK) goto DONE;
+  if (esl_sprintf(&tmp,  "%s/%s.hmm.XXXXXX", bld->qcache, key) != eslOK) goto DONE;
+  if (esl_tmpfile_named(tmp, &fp)                               != eslOK) goto DONE;
+  ok = (p7_hmmfile_WriteBinary(fp, -1, hmm) == eslOK);
+  if (fclose(fp) != 0) ok = FALSE;
+  if (ok) ok = (rename(tmp, path) == 0);
+  if (! ok) remove(tmp);
+
+ DONE:
+  if (path) free(path);
+  if (tmp)  free(tmp);
+}
+
+/* qcache_profiles()
+ * 
+ * For a calibrated <hmm> read from the cache, make the <opt_gm>
+ * and <opt_om> that calibrate() would have: a local profile
+ * configured for length <bld->EvL>, carrying the model's E-value
+ * parameters.
+ */
+static int
+qcache_profiles(const P7_BUILDER *bld, P7_HMM *hmm, P7_BG *bg, P7_PROFILE **opt_gm, P7_OPROFILE **opt_om)
+{
+  P7_PROFILE  *gm = NULL;
+  P7_OPROFILE *om = NULL;
+  int          status;
+
+  if (opt_gm == NULL && opt_om == NULL) return eslOK;
+
+  if ((gm     = p7_profile_Create(hmm->M, hmm->abc))               == NULL)  { status = eslEMEM; goto ERROR; }
+  if ((status = p7_ProfileConfig(hmm, bg, gm, bld->EvL, p7_LOCAL)) != eslOK) goto ERROR;
+  if (opt_om)
+    {
+      if ((om     = p7_oprofile_Create(hmm->M, hmm->abc)) == NULL)  { status = eslEMEM; goto ERROR; }
+      if ((status = p7_oprofile_Convert(gm, om))         != eslOK) goto ERROR;
+    }
+
+  if (opt_gm) *opt_gm = gm; else p7_profile_Destroy(gm);
+  if (opt_om) *opt_om = om;
+  return eslOK;
+
+ ERROR:
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  return status;
+}
+/*------------------- end, query model cache -------------------*/
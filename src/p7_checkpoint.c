@@ -0,0 +1,847 @@
+/* P7_CHECKPOINT: restartable searches (hmmsearch --checkpoint).
+ *
+ * A search that runs for days on a machine that can be taken away
+ * at any time saves its state every so often, so that running the
+ * same command again resumes it instead of starting over. To take a
+ * checkpoint, the search stops handing out targets and lets the
+ * ones under way finish; then everything before a single target
+ * record offset is done, and everything after it is not.
+ *
+ * A checkpoint holds the number of queries finished, with the sizes
+ * of the output files after their output; and for the query under
+ * way, the number of targets done, the record offset of the last of
+ * them, the pipeline counters summed over the workers, and all the
+ * workers' hits, stored with the same serializer hmmpgmd and
+ * --binout use. On resuming, the output files are cut back to those
+ * sizes, the finished queries are skipped, and the query under way
+ * picks up after its last target with its hits and counters
+ * restored.
+ *
+ * File layout. All integers are unsigned and in network (big-endian)
+ * byte order. Strings are stored as a uint32 length including the
+ * trailing NUL, then the bytes; a NULL string has length 0.
+ *
+ *   header:  8 bytes    magic "HMMRCKP1"
+ *            uint32     format version (p7_CHECKPOINT_VERSION)
+ *            string     query file name
+ *            string     target file name
+ *            uint64     nquery, the number of queries finished
+ *            uint32     nout, the number of output file slots
+ *            uint64     nout output file sizes, after those queries
+ *            uint32     1 if a query is under way; else 0, and no
+ *                       query section follows
+ *
+ *   query:   string     query name
+ *            uint64     number of targets done
+ *            uint64     record offset of the last one (as int64)
+ *            uint64     p7_CHECKPOINT_NCOUNTS pipeline counters
+ *            uint64     nhits
+ *            ...        nhits of: uint32 length, serialized hit
+ *
+ *   trailer: 8 bytes    magic "HMMRCKP1"
+ *
+ * A new checkpoint is written to <filename>.tmp, flushed to disk,
+ * and renamed over the old one, so there's always one complete
+ * checkpoint file; the output files are flushed to disk before it.
+ *
+ * Contents:
+ *    1. The P7_CHECKPOINT object.
+ *    2. Saving and restoring a search.
+ *    3. Internal functions.
+ *    4. Unit tests.
+ *    5. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "easel.h"
+#include "hmmer.h"
+
+static int  ckpt_write   (FILE *fp, const void *p, size_t n);
+static int  ckpt_write32 (FILE *fp, uint32_t x);
+static int  ckpt_write64 (FILE *fp, uint64_t x);
+static int  ckpt_writestr(FILE *fp, const char *s);
+static int  ckpt_read32  (FILE *fp, uint32_t *ret_x);
+static int  ckpt_read64  (FILE *fp, uint64_t *ret_x);
+static int  ckpt_readstr (FILE *fp, char **ret_s);
+static int  ckpt_sync    (FILE *fp);
+static void ckpt_counts  (const P7_PIPELINE *pli, uint64_t *c);
+static void ckpt_restore (P7_PIPELINE *pli, const uint64_t *c);
+
+
+/*****************************************************************
+ *= 1. The P7_CHECKPOINT object
+ *****************************************************************/
+
+/* Function:  p7_checkpoint_Create()
+ * Synopsis:  Create the checkpointing of a search.
+ *
+ * Purpose:   Create an object to checkpoint a search of query file
+ *            <qfile> against target file <tfile> in file <filename>,
+ *            about every <interval> seconds. The first checkpoint
+ *            comes <interval> seconds from now.
+ *
+ *            To resume a search from an existing <filename>, call
+ *            <p7_checkpoint_Read()> next.
+ *
+ * Returns:   <eslOK> on success, and <*ret_ck> points to the new
+ *            object.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <*ret_ck> is <NULL>.
+ */
+int
+p7_checkpoint_Create(const char *filename, double interval, const char *qfile, const char *tfile, P7_CHECKPOINT **ret_ck)
+{
+  P7_CHECKPOINT *ck = NULL;
+  int            status;
+
+  ESL_ALLOC(ck, sizeof(P7_CHECKPOINT));
+  memset(ck, 0, sizeof(P7_CHECKPOINT));
+  ck->interval  = interval;
+  ck->t_last    = p7_progress_Now();
+  ck->last_roff = -1;
+
+  if ((status = esl_strdup(filename, -1, &(ck->filename))) != eslOK) goto ERROR;
+  if ((status = esl_strdup(qfile,    -1, &(ck->qfile)))    != eslOK) goto ERROR;
+  if ((status = esl_strdup(tfile,    -1, &(ck->tfile)))    != eslOK) goto ERROR;
+
+  *ret_ck = ck;
+  return eslOK;
+
+ ERROR:
+  p7_checkpoint_Destroy(ck);
+  *ret_ck = NULL;
+  return status;
+}
+
+
+/* Function:  p7_checkpoint_Read()
+ * Synopsis:  Load a saved checkpoint, to resume a search.
+ *
+ * Purpose:   Read the checkpoint file of <ck>, if there is one, and
+ *            set <ck>'s state from it: <ck->nquery> queries are
+ *            finished, and if <ck->qname> is non-<NULL>, that query
+ *            was under way; its saved hits and counters are kept for
+ *            <p7_checkpoint_StartQuery()>. <ck->resumed> is set.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if there's no checkpoint file; the search
+ *            starts from the beginning, and <ck> is unchanged.
+ *
+ *            <eslEFORMAT> if the file isn't a complete checkpoint of
+ *            a version we can read, or it's a checkpoint of a search
+ *            of different files. <errbuf>, if non-<NULL>, holds an
+ *            informative message; <ck> isn't usable.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_checkpoint_Read(P7_CHECKPOINT *ck, char *errbuf)
+{
+  FILE       *fp    = NULL;
+  char       *qfile = NULL;
+  char       *tfile = NULL;
+  P7_TOPHITS *th    = NULL;
+  char        magic[8];
+  uint64_t    nhits, h, x64;
+  uint32_t    x, len, n;
+  void       *p;
+  int         i;
+  int         status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if ((fp = fopen(ck->filename, "rb")) == NULL) return eslENOTFOUND;
+
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, p7_CHECKPOINT_MAGIC, 8) != 0) ESL_XFAIL(eslEFORMAT, errbuf, "%s isn't a checkpoint file", ck->filename);
+  if (ckpt_read32(fp, &x) != eslOK || x != p7_CHECKPOINT_VERSION)                  ESL_XFAIL(eslEFORMAT, errbuf, "%s is a checkpoint of a version we can't read", ck->filename);
+  if ((status = ckpt_readstr(fp, &qfile)) == eslEMEM) goto ERROR;
+  if (status == eslOK) status = ckpt_readstr(fp, &tfile);
+  if (status == eslEMEM) goto ERROR;
+  if (status != eslOK)                                                             ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+  if (esl_strcmp(qfile, ck->qfile) != 0 || esl_strcmp(tfile, ck->tfile) != 0)      ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is for a search of %s against %s", ck->filename, qfile ? qfile : "-", tfile ? tfile : "-");
+
+  if (ckpt_read64(fp, &x64) != eslOK || ckpt_read32(fp, &x) != eslOK || x > p7_CHECKPOINT_MAXOUT) ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+  ck->nquery = (int64_t) x64;
+  ck->nout   = x;
+  for (i = 0; i < ck->nout; i++)
+    if (ckpt_read64(fp, &(ck->outsize[i])) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+
+  if (ckpt_read32(fp, &x) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+  if (x)
+    {
+      if ((status = ckpt_readstr(fp, &(ck->qname))) == eslEMEM) goto ERROR;
+      if (status != eslOK || ck->qname == NULL)                 ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+      if (ckpt_read64(fp, &(ck->ntargets)) != eslOK || ckpt_read64(fp, &x64) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+      ck->last_roff = (int64_t) x64;
+      for (i = 0; i < p7_CHECKPOINT_NCOUNTS; i++)
+	if (ckpt_read64(fp, &(ck->counts[i])) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+      if (ckpt_read64(fp, &nhits) != eslOK)             ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+
+      if ((th = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
+      while (nhits > th->Nalloc)
+	if ((status = p7_tophits_Grow(th)) != eslOK) goto ERROR;
+      for (h = 0; h < nhits; h++)
+	{
+	  if (ckpt_read32(fp, &len) != eslOK || len == 0) ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+	  if (len > ck->nalloc)
+	    {
+	      ESL_RALLOC(ck->buf, p, len);
+	      ck->nalloc = len;
+	    }
+	  if (fread(ck->buf, 1, len, fp) != len)           ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+
+	  th->unsrt[h].name = th->unsrt[h].acc = th->unsrt[h].desc = NULL;
+	  th->unsrt[h].dcl  = NULL;
+	  th->unsrt[h].ndom = 0;
+	  th->unsrt[h].in_arena = FALSE;
+	  th->N = h+1;		/* so Destroy cleans up a partial list */
+	  n = 0;
+	  if ((status = p7_hit_Deserialize(ck->buf, &n, &(th->unsrt[h]))) == eslEMEM) goto ERROR;
+	  if (status != eslOK || n != len)                 ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s has a bad hit", ck->filename);
+	  th->hit[h] = &(th->unsrt[h]);
+	}
+      th->N                    = nhits;
+      th->is_sorted_by_sortkey = FALSE;
+      th->is_sorted_by_seqidx  = FALSE;
+      ck->th         = th;
+      ck->have_saved = TRUE;
+      th             = NULL;
+    }
+
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, p7_CHECKPOINT_MAGIC, 8) != 0) ESL_XFAIL(eslEFORMAT, errbuf, "checkpoint file %s is truncated", ck->filename);
+
+  ck->resumed = TRUE;
+  fclose(fp);
+  free(qfile);
+  free(tfile);
+  return eslOK;
+
+ ERROR:
+  if (fp)    fclose(fp);
+  if (qfile) free(qfile);
+  if (tfile) free(tfile);
+  p7_tophits_Destroy(th);
+  return status;
+}
+
+
+/* Function:  p7_checkpoint_Remove()
+ * Synopsis:  Remove the checkpoint file of a finished search.
+ *
+ * Purpose:   Remove the checkpoint file of <ck>, once the search is
+ *            complete and its output files are closed, so the same
+ *            command run again starts a new search. It's not an
+ *            error if there isn't one.
+ */
+void
+p7_checkpoint_Remove(P7_CHECKPOINT *ck)
+{
+  if (ck) remove(ck->filename);
+}
+
+
+/* Function:  p7_checkpoint_Destroy()
+ * Synopsis:  Free a P7_CHECKPOINT.
+ *
+ * Purpose:   Free <ck>. The output files it keeps track of are the
+ *            caller's to close.
+ */
+void
+p7_checkpoint_Destroy(P7_CHECKPOINT *ck)
+{
+  if (ck == NULL) return;
+
+  if (ck->filename) free(ck->filename);
+  if (ck->qfile)    free(ck->qfile);
+  if (ck->tfile)    free(ck->tfile);
+  if (ck->qname)    free(ck->qname);
+  if (ck->buf)      free(ck->buf);
+  p7_tophits_Destroy(ck->th);
+  free(ck);
+}
+/*------------------ end, P7_CHECKPOINT object ------------------*/
+
+
+
+/*****************************************************************
+ *= 2. Saving and restoring a search
+ *****************************************************************/
+
+/* Function:  p7_checkpoint_OpenOutput()
+ * Synopsis:  Open an output file of a checkpointed search.
+ *
+ * Purpose:   Open output file <fname> for writing, as output file
+ *            number <which> (0..p7_CHECKPOINT_MAXOUT-1) of the
+ *            search, and return the open stream in <*ret_fp>. The
+ *            caller numbers its output files however it likes, but
+ *            the same way every time. The stream remains the
+ *            caller's to close.
+ *
+ *            If <ck> was resumed from a checkpoint file, the file is
+ *            opened for appending, cut back to what it held at the
+ *            checkpoint; a file that isn't a regular one (a device
+ *            such as <"/dev/null">) is just opened. Otherwise, and if
+ *            <ck> is <NULL>, it's opened as a new file.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if the file can't be opened;
+ *            <eslEFORMAT> if, resuming, it's shorter than it was at
+ *            the checkpoint. <*ret_fp> is <NULL>.
+ *
+ * Throws:    <eslEINVAL> if <which> is out of range.
+ */
+int
+p7_checkpoint_OpenOutput(P7_CHECKPOINT *ck, int which, const char *fname, FILE **ret_fp)
+{
+  FILE        *fp = NULL;
+  struct stat  st;
+  int          status;
+
+  if (ck && (which < 0 || which >= p7_CHECKPOINT_MAXOUT)) ESL_XEXCEPTION(eslEINVAL, "no such output file slot %d", which);
+
+  if (ck && ck->resumed && which < ck->nout)
+    {
+      if ((fp = fopen(fname, "r+")) == NULL) { status = eslENOTFOUND; goto ERROR; }
+      if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode))
+	{
+	  if ((uint64_t) st.st_size < ck->outsize[which])                 { status = eslEFORMAT; goto ERROR; }
+	  if (ftruncate(fileno(fp), (off_t) ck->outsize[which]) != 0)      { status = eslENOTFOUND; goto ERROR; }
+	}
+      if (fseeko(fp, 0, SEEK_END) != 0)                                    { status = eslENOTFOUND; goto ERROR; }
+    }
+  else if ((fp = fopen(fname, "w")) == NULL) { status = eslENOTFOUND; goto ERROR; }
+
+  if (ck)
+    {
+      ck->outfp[which] = fp;
+      ck->nout         = ESL_MAX(ck->nout, which+1);
+    }
+  *ret_fp = fp;
+  return eslOK;
+
+ ERROR:
+  if (fp) fclose(fp);
+  *ret_fp = NULL;
+  return status;
+}
+
+
+/* Function:  p7_checkpoint_StartQuery()
+ * Synopsis:  Start searching a query, or resume it.
+ *
+ * Purpose:   Start checkpointing the search of the query named
+ *            <qname>, with the pipeline <pli> and hit list <th> of
+ *            the first worker, both new.
+ *
+ *            If <ck> was resumed from a checkpoint taken during this
+ *            query, the saved counters are added to <pli> and the
+ *            saved hits moved to <th>, and <*ret_roff> is the record
+ *            offset of the last target that was done: the caller
+ *            positions the target file there and skips that one
+ *            target. Else <*ret_roff> is -1, and the search of the
+ *            targets starts at the beginning.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEINCOMPAT> if the checkpoint was taken during a
+ *            different query; the query file isn't the one it was.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_checkpoint_StartQuery(P7_CHECKPOINT *ck, const char *qname, P7_PIPELINE *pli, P7_TOPHITS *th, int64_t *ret_roff)
+{
+  int status;
+
+  *ret_roff = -1;
+  if (ck->have_saved)
+    {
+      if (strcmp(ck->qname, qname) != 0) return eslEINCOMPAT;
+
+      ckpt_restore(pli, ck->counts);
+      if ((status = p7_tophits_Merge(th, ck->th)) != eslOK) return status;
+      p7_tophits_Destroy(ck->th);
+      ck->th         = NULL;
+      ck->have_saved = FALSE;
+      *ret_roff      = ck->last_roff;
+      return eslOK;
+    }
+
+  if (ck->qname) free(ck->qname);
+  ck->qname     = NULL;
+  ck->ntargets  = 0;
+  ck->last_roff = -1;
+  return esl_strdup(qname, -1, &(ck->qname));
+}
+
+
+/* Function:  p7_checkpoint_Due()
+ * Synopsis:  Is it time for a checkpoint?
+ *
+ * Purpose:   Return TRUE if it's time to take a checkpoint, and set
+ *            <ck->stop>: the caller's target loop stops reading
+ *            targets, and once the ones under way are done, the
+ *            caller writes the checkpoint with
+ *            <p7_checkpoint_Write()> and goes on. Return FALSE if
+ *            not, or if <ck> is <NULL>.
+ */
+int
+p7_checkpoint_Due(P7_CHECKPOINT *ck)
+{
+  if (ck == NULL)                                    return FALSE;
+  if (ck->stop)                                      return TRUE;
+  if (p7_progress_Now() - ck->t_last < ck->interval) return FALSE;
+  ck->stop = TRUE;
+  return TRUE;
+}
+
+
+/* Function:  p7_checkpoint_Advance()
+ * Synopsis:  Count targets handed out to the search.
+ *
+ * Purpose:   Record that <ntargets> more targets of the current query
+ *            have been handed out to the workers, the last of them at
+ *            record offset <last_roff>. Does nothing if <ck> is
+ *            <NULL>.
+ */
+void
+p7_checkpoint_Advance(P7_CHECKPOINT *ck, uint64_t ntargets, int64_t last_roff)
+{
+  if (ck == NULL || ntargets == 0) return;
+  ck->ntargets  += ntargets;
+  ck->last_roff  = last_roff;
+}
+
+
+/* Function:  p7_checkpoint_Write()
+ * Synopsis:  Save a checkpoint.
+ *
+ * Purpose:   Save the state of the search in the checkpoint file of
+ *            <ck>: the finished queries recorded by
+ *            <p7_checkpoint_EndQuery()>, and if a query is under way,
+ *            the targets handed out so far, and the counters and hits
+ *            of its <n> workers' pipelines <pli[0..n-1]> and hit
+ *            lists <th[0..n-1]>. Every target handed out must be done.
+ *
+ *            Flushes the output files to disk first, and clears
+ *            <ck->stop>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEWRITE> on a
+ *            write error, and the previous checkpoint file is left
+ *            as it was.
+ */
+int
+p7_checkpoint_Write(P7_CHECKPOINT *ck, P7_PIPELINE **pli, P7_TOPHITS **th, int n)
+{
+  char     *tmpfile = NULL;
+  FILE     *fp      = NULL;
+  uint64_t  counts[p7_CHECKPOINT_NCOUNTS];
+  uint64_t  nhits   = 0;
+  uint64_t  h;
+  uint32_t  len;
+  int       i, c;
+  int       status;
+
+  /* the output files must be on disk before a checkpoint that vouches for them */
+  for (i = 0; i < ck->nout; i++)
+    if (ck->outfp[i] && ((status = ckpt_sync(ck->outfp[i])) != eslOK)) goto ERROR;
+
+  if ((status = esl_sprintf(&tmpfile, "%s.tmp", ck->filename)) != eslOK) goto ERROR;
+  if ((fp = fopen(tmpfile, "wb")) == NULL) ESL_XEXCEPTION_SYS(eslEWRITE, "failed to open checkpoint file %s", tmpfile);
+
+  if ((status = ckpt_write   (fp, p7_CHECKPOINT_MAGIC, 8))      != eslOK) goto ERROR;
+  if ((status = ckpt_write32 (fp, p7_CHECKPOINT_VERSION))       != eslOK) goto ERROR;
+  if ((status = ckpt_writestr(fp, ck->qfile))                   != eslOK) goto ERROR;
+  if ((status = ckpt_writestr(fp, ck->tfile))                   != eslOK) goto ERROR;
+  if ((status = ckpt_write64 (fp, (uint64_t) ck->nquery))       != eslOK) goto ERROR;
+  if ((status = ckpt_write32 (fp, (uint32_t) ck->nout))         != eslOK) goto ERROR;
+  for (i = 0; i < ck->nout; i++)
+    if ((status = ckpt_write64(fp, ck->outsize[i]))             != eslOK) goto ERROR;
+  if ((status = ckpt_write32 (fp, ck->qname ? 1 : 0))           != eslOK) goto ERROR;
+
+  if (ck->qname)
+    {
+      for (c = 0; c < p7_CHECKPOINT_NCOUNTS; c++) counts[c] = 0;
+      for (i = 0; i < n; i++)
+	{
+	  ckpt_counts(pli[i], counts);
+	  nhits += th[i]->N;
+	}
+
+      if ((status = ckpt_writestr(fp, ck->qname))                 != eslOK) goto ERROR;
+      if ((status = ckpt_write64 (fp, ck->ntargets))              != eslOK) goto ERROR;
+      if ((status = ckpt_write64 (fp, (uint64_t) ck->last_roff))  != eslOK) goto ERROR;
+      for (c = 0; c < p7_CHECKPOINT_NCOUNTS; c++)
+	if ((status = ckpt_write64(fp, counts[c]))                != eslOK) goto ERROR;
+      if ((status = ckpt_write64 (fp, nhits))                     != eslOK) goto ERROR;
+
+      for (i = 0; i < n; i++)
+	for (h = 0; h < th[i]->N; h++)
+	  {
+	    len = 0;
+	    if ((status = p7_hit_Serialize(th[i]->hit[h], &(ck->buf), &len, &(ck->nalloc))) != eslOK) goto ERROR;
+	    if ((status = ckpt_write32(fp, len))                                            != eslOK) goto ERROR;
+	    if ((status = ckpt_write  (fp, ck->buf, len))                                   != eslOK) goto ERROR;
+	  }
+    }
+  if ((status = ckpt_write(fp, p7_CHECKPOINT_MAGIC, 8)) != eslOK) goto ERROR;
+
+  if ((status = ckpt_sync(fp)) != eslOK) goto ERROR;
+  if (fclose(fp) != 0) { fp = NULL; ESL_XEXCEPTION_SYS(eslEWRITE, "checkpoint file write failed"); }
+  fp = NULL;
+  if (rename(tmpfile, ck->filename) != 0) ESL_XEXCEPTION_SYS(eslEWRITE, "failed to rename %s to %s", tmpfile, ck->filename);
+
+  ck->stop   = FALSE;
+  ck->t_last = p7_progress_Now();
+  free(tmpfile);
+  return eslOK;
+
+ ERROR:
+  if (fp)      { fclose(fp); remove(tmpfile); }
+  if (tmpfile) free(tmpfile);
+  return status;
+}
+
+
+/* Function:  p7_checkpoint_EndQuery()
+ * Synopsis:  Record a finished query.
+ *
+ * Purpose:   Record that query number <nquery> (1..) is finished and
+ *            all of its output written, along with the current sizes
+ *            of the output files. Call it after the output header,
+ *            too, with <nquery> 0. The next checkpoint written
+ *            includes this.
+ */
+void
+p7_checkpoint_EndQuery(P7_CHECKPOINT *ck, int64_t nquery)
+{
+  off_t offset;
+  int   i;
+
+  if (ck == NULL) return;
+  for (i = 0; i < ck->nout; i++)
+    if (ck->outfp[i] && (offset = ftello(ck->outfp[i])) >= 0)
+      ck->outsize[i] = (uint64_t) offset;
+
+  ck->nquery = nquery;
+  if (ck->qname) free(ck->qname);
+  ck->qname     = NULL;
+  ck->ntargets  = 0;
+  ck->last_roff = -1;
+}
+/*---------------- end, saving and restoring a search -----------*/
+
+
+
+/*****************************************************************
+ * 3. Internal functions
+ *****************************************************************/
+
+static int
+ckpt_write(FILE *fp, const void *p, size_t n)
+{
+  if (n > 0 && fwrite(p, 1, n, fp) != n) ESL_EXCEPTION_SYS(eslEWRITE, "checkpoint file write failed");
+  return eslOK;
+}
+
+static int
+ckpt_write32(FILE *fp, uint32_t x)
+{
+  uint32_t network_32bit = esl_hton32(x);
+  return ckpt_write(fp, &network_32bit, sizeof(uint32_t));
+}
+
+static int
+ckpt_write64(FILE *fp, uint64_t x)
+{
+  uint64_t network_64bit = esl_hton64(x);
+  return ckpt_write(fp, &network_64bit, sizeof(uint64_t));
+}
+
+static int
+ckpt_writestr(FILE *fp, const char *s)
+{
+  uint32_t n = (s ? strlen(s) + 1 : 0);
+  int      status;
+
+  if ((status = ckpt_write32(fp, n)) != eslOK) return status;
+  return ckpt_write(fp, s, n);
+}
+
+/* the readers return eslEOF on a short read, for the caller to report as eslEFORMAT */
+static int
+ckpt_read32(FILE *fp, uint32_t *ret_x)
+{
+  uint32_t network_32bit;
+  if (fread(&network_32bit, sizeof(uint32_t), 1, fp) != 1) return eslEOF;
+  *ret_x = esl_ntoh32(network_32bit);
+  return eslOK;
+}
+
+static int
+ckpt_read64(FILE *fp, uint64_t *ret_x)
+{
+  uint64_t network_64bit;
+  if (fread(&network_64bit, sizeof(uint64_t), 1, fp) != 1) return eslEOF;
+  *ret_x = esl_ntoh64(network_64bit);
+  return eslOK;
+}
+
+static int
+ckpt_readstr(FILE *fp, char **ret_s)
+{
+  char     *s = NULL;
+  uint32_t  n;
+  int       status;
+
+  *ret_s = NULL;
+  if (ckpt_read32(fp, &n) != eslOK) return eslEOF;
+  if (n == 0) return eslOK;
+
+  ESL_ALLOC(s, n);
+  if (fread(s, 1, n, fp) != n || s[n-1] != '\0') { free(s); return eslEOF; }
+  *ret_s = s;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* ckpt_sync()
+ *
+ * Flush stream <fp>, and if it's a regular file, get it to the disk;
+ * a checkpoint has to survive losing the machine, not just the
+ * process.
+ */
+static int
+ckpt_sync(FILE *fp)
+{
+  struct stat st;
+
+  if (fflush(fp) != 0) ESL_EXCEPTION_SYS(eslEWRITE, "failed to flush output to disk");
+  if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && fsync(fileno(fp)) != 0)
+    ESL_EXCEPTION_SYS(eslEWRITE, "failed to flush output to disk");
+  return eslOK;
+}
+
+/* ckpt_counts(), ckpt_restore()
+ *
+ * Add the counters of <pli> that <p7_pipeline_Merge()> sums over
+ * workers into <c[0..p7_CHECKPOINT_NCOUNTS-1]>; and add them back
+ * into a pipeline. The peak memory and --adapt state aren't saved;
+ * a resumed search starts those over.
+ */
+static void
+ckpt_counts(const P7_PIPELINE *pli, uint64_t *c)
+{
+  c[0]  += pli->nseqs;          c[1]  += pli->nres;
+  c[2]  += pli->n_past_msv;     c[3]  += pli->n_past_bias;
+  c[4]  += pli->n_past_vit;     c[5]  += pli->n_past_fwd;
+  c[6]  += pli->n_output;       c[7]  += pli->pos_past_msv;
+  c[8]  += pli->pos_past_bias;  c[9]  += pli->pos_past_vit;
+  c[10] += pli->pos_past_fwd;   c[11] += pli->pos_output;
+  c[12] += pli->n_fm_occ;       c[13] += pli->n_past_fm;
+  c[14] += pli->n_past_words;   c[15] += pli->ns_msv;
+  c[16] += pli->ns_bias;        c[17] += pli->ns_vit;
+  c[18] += pli->ns_fwd;         c[19] += pli->ns_dom;
+  c[20] += pli->n_topk_skipped;
+}
+
+static void
+ckpt_restore(P7_PIPELINE *pli, const uint64_t *c)
+{
+  pli->nseqs          += c[0];  pli->nres           += c[1];
+  pli->n_past_msv     += c[2];  pli->n_past_bias    += c[3];
+  pli->n_past_vit     += c[4];  pli->n_past_fwd     += c[5];
+  pli->n_output       += c[6];  pli->pos_past_msv   += c[7];
+  pli->pos_past_bias  += c[8];  pli->pos_past_vit   += c[9];
+  pli->pos_past_fwd   += c[10]; pli->pos_output     += c[11];
+  pli->n_fm_occ       += c[12]; pli->n_past_fm      += c[13];
+  pli->n_past_words   += c[14]; pli->ns_msv         += c[15];
+  pli->ns_bias        += c[16]; pli->ns_vit         += c[17];
+  pli->ns_fwd         += c[18]; pli->ns_dom         += c[19];
+  pli->n_topk_skipped += c[20];
+
+  /* as p7_pli_NewSeq() does */
+  if (pli->Z_setby == p7_ZSETBY_NTARGETS && pli->mode == p7_SEARCH_SEQS) pli->Z = (double) pli->nseqs;
+}
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests
+ *****************************************************************/
+#ifdef p7CHECKPOINT_TESTDRIVE
+
+/* utest_resume()
+ *
+ * Checkpoint a query under way with <nw> workers' worth of random
+ * hits and counters, and an output file; resume from the file, and
+ * check that the output file is cut back, and that the hits and
+ * summed counters come back for the query, and only for it.
+ */
+static void
+utest_resume(ESL_RAND64 *rng, int nw, int nhits)
+{
+  char           msg[]       = "p7_checkpoint resume unit test failed";
+  char           ckname[32]  = "esltmpXXXXXX";
+  char           outname[32] = "esltmpXXXXXX";
+  FILE          *fp          = NULL;
+  FILE          *ofp         = NULL;
+  P7_CHECKPOINT *ck          = NULL;
+  P7_PIPELINE  **pli         = NULL;
+  P7_TOPHITS   **th          = NULL;
+  P7_PIPELINE    pli2;
+  P7_TOPHITS    *th2         = NULL;
+  P7_HIT        *hit         = NULL;
+  uint64_t       nseqs       = 0;
+  int64_t        roff;
+  uint64_t       h, r;
+  int            i;
+  int            status;
+
+  /* the checkpoint file's name, reserved, but no file yet */
+  if (esl_tmpfile_named(ckname,  &fp)  != eslOK) esl_fatal(msg);
+  fclose(fp);
+  remove(ckname);
+  if (esl_tmpfile_named(outname, &fp)  != eslOK) esl_fatal(msg);
+  fclose(fp);
+
+  ESL_ALLOC(pli, sizeof(P7_PIPELINE *) * nw);
+  ESL_ALLOC(th,  sizeof(P7_TOPHITS *)  * nw);
+  for (i = 0; i < nw; i++)
+    {
+      ESL_ALLOC(pli[i], sizeof(P7_PIPELINE));
+      memset(pli[i], 0, sizeof(P7_PIPELINE));
+      pli[i]->mode       = p7_SEARCH_SEQS;
+      pli[i]->nseqs      = esl_rand64_Roll(rng, 1000);
+      pli[i]->n_past_msv = pli[i]->nseqs / 2;
+      nseqs += pli[i]->nseqs;
+
+      if ((th[i] = p7_tophits_Create()) == NULL) esl_fatal(msg);
+      for (h = 0; h < nhits; h++)
+	{
+	  if (p7_hit_TestSample(rng, &hit) != eslOK) esl_fatal(msg);
+	  while (th[i]->N >= th[i]->Nalloc) p7_tophits_Grow(th[i]);
+	  th[i]->unsrt[th[i]->N] = *hit; /* shallow: th[i] takes over hit's internals */
+	  free(hit);
+	  th[i]->N++;
+	}
+      for (h = 0; h < th[i]->N; h++) th[i]->hit[h] = &(th[i]->unsrt[h]);
+    }
+
+  /* a first search: one finished query, then a checkpoint in the second one */
+  if (p7_checkpoint_Create(ckname, 600., "qfile", "tfile", &ck)   != eslOK) esl_fatal(msg);
+  if (p7_checkpoint_Read(ck, NULL)                                 != eslENOTFOUND) esl_fatal(msg);
+  if (p7_checkpoint_OpenOutput(ck, 1, outname, &ofp)               != eslOK) esl_fatal(msg);
+  if (p7_checkpoint_Due(ck))                                                 esl_fatal(msg);
+  fprintf(ofp, "query1\n");
+  p7_checkpoint_EndQuery(ck, 1);
+  if (p7_checkpoint_StartQuery(ck, "query2", NULL, NULL, &roff)    != eslOK) esl_fatal(msg);
+  if (roff != -1)                                                            esl_fatal(msg);
+  p7_checkpoint_Advance(ck, 10, 1234);
+  if (p7_checkpoint_Write(ck, pli, th, nw)                         != eslOK) esl_fatal(msg);
+  fprintf(ofp, "partial output that the resumed search should cut off\n");
+  fclose(ofp);
+  p7_checkpoint_Destroy(ck);
+
+  /* a different search can't use it */
+  if (p7_checkpoint_Create(ckname, 600., "qfile", "other", &ck)   != eslOK) esl_fatal(msg);
+  if (p7_checkpoint_Read(ck, NULL)                                 != eslEFORMAT) esl_fatal(msg);
+  p7_checkpoint_Destroy(ck);
+
+  /* resume */
+  if (p7_checkpoint_Create(ckname, 600., "qfile", "tfile", &ck)   != eslOK) esl_fatal(msg);
+  if (p7_checkpoint_Read(ck, NULL)                                 != eslOK) esl_fatal(msg);
+  if (ck->nquery != 1 || ! ck->resumed)                                      esl_fatal(msg);
+  if (ck->qname == NULL || strcmp(ck->qname, "query2") != 0)                 esl_fatal(msg);
+  if (ck->ntargets != 10)                                                    esl_fatal(msg);
+  if (p7_checkpoint_OpenOutput(ck, 1, outname, &ofp)               != eslOK) esl_fatal(msg);
+  if (ftello(ofp) != (off_t) strlen("query1\n"))                                     esl_fatal(msg);
+  fclose(ofp);
+
+  memset(&pli2, 0, sizeof(P7_PIPELINE));
+  pli2.mode    = p7_SEARCH_SEQS;
+  pli2.Z_setby = p7_ZSETBY_NTARGETS;
+  if ((th2 = p7_tophits_Create()) == NULL)                                   esl_fatal(msg);
+  if (p7_checkpoint_StartQuery(ck, "query1", &pli2, th2, &roff)    != eslEINCOMPAT) esl_fatal(msg);
+  if (p7_checkpoint_StartQuery(ck, "query2", &pli2, th2, &roff)    != eslOK) esl_fatal(msg);
+  if (roff != 1234)                                                          esl_fatal(msg);
+  if (pli2.nseqs != nseqs || pli2.Z != (double) nseqs)                       esl_fatal(msg);
+  if (th2->N != (uint64_t) nw * nhits)                                       esl_fatal(msg);
+
+  /* every hit comes back; sort both sides the same way to compare them */
+  for (i = 1; i < nw; i++) p7_tophits_Merge(th[0], th[i]);
+  p7_tophits_SortBySortkey(th[0]);
+  p7_tophits_SortBySortkey(th2);
+  for (r = 0; r < th2->N; r++)
+    if (p7_hit_Compare(th[0]->hit[r], th2->hit[r], 1e-5, 1e-5) != eslOK) esl_fatal(msg);
+
+  /* once restored, the next query starts from scratch */
+  if (p7_checkpoint_StartQuery(ck, "query3", &pli2, th2, &roff)    != eslOK) esl_fatal(msg);
+  if (roff != -1 || ck->ntargets != 0)                                       esl_fatal(msg);
+
+  p7_checkpoint_Remove(ck);
+  if ((fp = fopen(ckname, "rb")) != NULL)                                    esl_fatal(msg);
+  p7_checkpoint_Destroy(ck);
+  remove(outname);
+  p7_tophits_Destroy(th2);
+  for (i = 0; i < nw; i++) { free(pli[i]); p7_tophits_Destroy(th[i]); }
+  free(pli);
+  free(th);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*p7CHECKPOINT_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7CHECKPOINT_TESTDRIVE
+/*
+  gcc -o p7_checkpoint_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7CHECKPOINT_TESTDRIVE p7_checkpoint.c -lhmmer -leasel -lm
+  ./p7_checkpoint_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,      "3", NULL, NULL,  NULL,  NULL, NULL, "number of workers",                                0 },
+  { "-M",        eslARG_INT,     "20", NULL, NULL,  NULL,  NULL, NULL, "number of hits per worker",                        0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_CHECKPOINT";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RAND64  *rng = esl_rand64_Create(esl_opt_GetInteger(go, "-s"));
+
+  utest_resume(rng, esl_opt_GetInteger(go, "-N"), esl_opt_GetInteger(go, "-M"));
+
+  esl_rand64_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7CHECKPOINT_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
@@ -0,0 +1,306 @@
+/* Pinning search threads to cpus (--cpubind, --readercpu).
+ *
+ * Left alone, the worker threads of hmmsearch, hmmscan, phmmer and
+ * nhmmer go wherever the scheduler puts them, migrate between cores
+ * (and their caches) as the load on a shared node shifts, and compete
+ * with the master thread that reads targets and writes output. With
+ * --cpubind, each worker pins itself when it starts:
+ *
+ *    --cpubind cores      worker k on the k'th cpu we're allowed to use
+ *    --cpubind sockets    worker k on NUMA node k mod (# of nodes),
+ *                         free to move among that node's cpus
+ *    --cpubind 0-7,16-23  worker k on the k'th cpu of the list
+ *
+ * wrapping around when there are more workers than cpus (or nodes).
+ * With --readercpu <n>, the master thread, and the reader, readahead
+ * and output threads it starts, are pinned to cpu <n>, and the workers
+ * are kept off it.
+ *
+ * A worker's DP matrices grow on the worker itself, so once it is
+ * pinned, the kernel's first-touch policy puts their pages on its own
+ * NUMA node.
+ *
+ * Pinning needs sched_setaffinity() (Linux). Elsewhere,
+ * p7_cpubind_Create() says so, and the drivers carry on unpinned.
+ *
+ * Contents:
+ *    1. The P7_CPUBIND object.
+ *    2. Internal functions.
+ */
+#define _GNU_SOURCE             /* sched_setaffinity() and the CPU_* macros, where available */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
+#include "easel.h"
+#include "hmmer.h"
+
+#define CPUBIND_MAXNODES 64
+
+struct p7_cpubind_s {
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t *set;               /* [0..nset-1]: worker k runs on set[k % nset] */
+  int        nset;
+#endif
+  int        reader;            /* cpu of the master and reader threads, or -1 */
+};
+
+#ifdef HAVE_SCHED_SETAFFINITY
+static int parse_cpulist(const char *s, int *list, int *ret_n);
+static int read_node(int node, cpu_set_t *cpus);
+#endif
+
+
+/*****************************************************************
+ * 1. The P7_CPUBIND object.
+ *****************************************************************/
+
+/* Function:  p7_cpubind_Create()
+ * Synopsis:  Work out which cpus worker and reader threads run on.
+ *
+ * Purpose:   Create a thread binding from <spec>, the argument of
+ *            --cpubind: "cores", "sockets", or a list of cpus such as
+ *            "0-7,16-23"; or NULL to leave the workers free. If
+ *            <reader> is $\geq 0$, cpu <reader> is reserved for the
+ *            master thread (see <p7_cpubind_Reader()>) and left out
+ *            of the workers' cpus. Only cpus this process is allowed
+ *            to run on are used.
+ *
+ *            Return the new binding in <*ret_cb>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEINVAL> if <spec> can't be parsed, names a cpu we
+ *            can't run on, or leaves no cpu for the workers; <eslFAIL>
+ *            if the cpus we can run on can't be read; and
+ *            <eslEUNIMPLEMENTED> if threads can't be pinned on this
+ *            platform. In all these cases <errbuf> says why, and
+ *            <*ret_cb> is NULL.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_cpubind_Create(const char *spec, int reader, P7_CPUBIND **ret_cb, char *errbuf)
+{
+  P7_CPUBIND *cb = NULL;
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t   allowed;
+  cpu_set_t   node[CPUBIND_MAXNODES];
+  cpu_set_t   cpus;
+  int        *list = NULL;
+  int         n    = 0;
+  int         c, i;
+#endif
+  int         status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+#ifdef HAVE_SCHED_SETAFFINITY
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) ESL_XFAIL(eslFAIL, errbuf, "can't read the cpus this process may run on");
+
+  if (reader >= 0)
+    {
+      if (reader >= CPU_SETSIZE || ! CPU_ISSET(reader, &allowed)) ESL_XFAIL(eslEINVAL, errbuf, "cpu %d isn't one this process may run on", reader);
+      CPU_CLR(reader, &allowed);
+    }
+  if (CPU_COUNT(&allowed) == 0) ESL_XFAIL(eslEINVAL, errbuf, "no cpus are left for the worker threads");
+
+  /* the workers' cpu sets, in the order workers take them */
+  if (spec == NULL)
+    {
+      node[0] = allowed;
+      n       = 1;
+    }
+  else if (strcmp(spec, "cores") == 0)
+    {
+      ESL_ALLOC(list, sizeof(int) * CPU_COUNT(&allowed));
+      for (c = 0; c < CPU_SETSIZE; c++)
+	if (CPU_ISSET(c, &allowed)) list[n++] = c;
+    }
+  else if (strcmp(spec, "sockets") == 0)
+    {
+      /* nodes with memory only, or none of our cpus, are skipped */
+      for (i = 0; n < CPUBIND_MAXNODES && read_node(i, &cpus) == eslOK; i++)
+	{
+	  CPU_AND(&node[n], &cpus, &allowed);
+	  if (CPU_COUNT(&node[n]) > 0) n++;
+	}
+      if (n == 0) { node[0] = allowed; n = 1; } /* no NUMA topology to read: one node */
+    }
+  else
+    {
+      ESL_ALLOC(list, sizeof(int) * CPU_SETSIZE);
+      if (parse_cpulist(spec, list, &n) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "--cpubind takes cores, sockets, or a list of cpus such as 0-7,16-23; not %s", spec);
+      for (i = 0; i < n; i++)
+	if (! CPU_ISSET(list[i], &allowed)) ESL_XFAIL(eslEINVAL, errbuf, "cpu %d isn't one this process may run on%s", list[i], (list[i] == reader ? ", after --readercpu" : ""));
+    }
+
+  ESL_ALLOC(cb, sizeof(P7_CPUBIND));
+  cb->set    = NULL;
+  cb->nset   = n;
+  cb->reader = reader;
+  ESL_ALLOC(cb->set, sizeof(cpu_set_t) * n);
+  for (i = 0; i < n; i++)
+    {
+      if (list) { CPU_ZERO(&cb->set[i]); CPU_SET(list[i], &cb->set[i]); }
+      else      cb->set[i] = node[i];
+    }
+
+  free(list);
+  *ret_cb = cb;
+  return eslOK;
+
+ ERROR:
+  free(list);
+  p7_cpubind_Destroy(cb);
+  *ret_cb = NULL;
+  return status;
+#else
+  ESL_XFAIL(eslEUNIMPLEMENTED, errbuf, "threads can't be pinned to cpus on this platform; --cpubind and --readercpu are ignored");
+
+ ERROR:
+  p7_cpubind_Destroy(cb);
+  *ret_cb = NULL;
+  return status;
+#endif
+}
+
+
+/* Function:  p7_cpubind_Reader()
+ * Synopsis:  Pin the calling thread to the reader cpu.
+ *
+ * Purpose:   Called by the master thread before it starts its worker,
+ *            reader and output threads, which inherit its binding;
+ *            workers then rebind themselves with <p7_cpubind_Worker()>.
+ *            Does nothing if <cb> is NULL or reserves no reader cpu.
+ */
+void
+p7_cpubind_Reader(const P7_CPUBIND *cb)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  cpu_set_t cpus;
+
+  if (cb == NULL || cb->reader < 0) return;
+  CPU_ZERO(&cpus);
+  CPU_SET(cb->reader, &cpus);
+  sched_setaffinity(0, sizeof(cpu_set_t), &cpus);
+#endif
+}
+
+
+/* Function:  p7_cpubind_Worker()
+ * Synopsis:  Pin the calling thread as worker <k>.
+ *
+ * Purpose:   Called by worker thread <k> when it starts, before it
+ *            touches its DP matrices. Does nothing if <cb> is NULL.
+ */
+void
+p7_cpubind_Worker(const P7_CPUBIND *cb, int k)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+  if (cb == NULL || cb->nset == 0) return;
+  sched_setaffinity(0, sizeof(cpu_set_t), &cb->set[k % cb->nset]);
+#endif
+}
+
+
+/* Function:  p7_cpubind_Destroy()
+ * Synopsis:  Free a P7_CPUBIND.
+ */
+void
+p7_cpubind_Destroy(P7_CPUBIND *cb)
+{
+  if (cb == NULL) return;
+#ifdef HAVE_SCHED_SETAFFINITY
+  free(cb->set);
+#endif
+  free(cb);
+}
+
+
+/*****************************************************************
+ * 2. Internal functions.
+ *****************************************************************/
+#ifdef HAVE_SCHED_SETAFFINITY
+
+/* parse_cpulist()
+ * Parse a list of cpus and ranges of cpus, such as "0-7,16-23", into
+ * <list> (allocated for CPU_SETSIZE), in order, and their number
+ * into <*ret_n>. Returns eslOK, or eslESYNTAX if <s> isn't such a
+ * list, or a cpu is out of range or repeated. Trailing whitespace
+ * (the newline of a sysfs file) is allowed.
+ */
+static int
+parse_cpulist(const char *s, int *list, int *ret_n)
+{
+  cpu_set_t  seen;
+  char      *p = (char *) s;
+  long       lo, hi;
+  int        n = 0;
+
+  CPU_ZERO(&seen);
+  *ret_n = 0;
+  while (isdigit((unsigned char) *p))
+    {
+      lo = hi = strtol(p, &p, 10);
+      if (*p == '-')
+	{
+	  if (! isdigit((unsigned char) p[1])) return eslESYNTAX;
+	  hi = strtol(p+1, &p, 10);
+	}
+      if (hi < lo || hi >= CPU_SETSIZE) return eslESYNTAX;
+      for ( ; lo <= hi; lo++)
+	{
+	  if (CPU_ISSET(lo, &seen)) return eslESYNTAX;
+	  CPU_SET(lo, &seen);
+	  list[n++] = (int) lo;
+	}
+      if (*p != ',') break;
+      if (! isdigit((unsigned char) *(++p))) return eslESYNTAX;
+    }
+  while (isspace((unsigned char) *p)) p++;
+  if (*p != '\0' || n == 0) return eslESYNTAX;
+
+  *ret_n = n;
+  return eslOK;
+}
+
+/* read_node()
+ * Read the cpus of NUMA node <node> into <cpus>. Returns eslOK, or
+ * eslENOTFOUND if there is no such node. A node with no cpus (memory
+ * only) comes back empty.
+ */
+static int
+read_node(int node, cpu_set_t *cpus)
+{
+  char  path[64];
+  char  buf[4096];
+  int  *list = NULL;
+  int   n    = 0;
+  int   i;
+  FILE *fp;
+  int   status;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  if ((fp = fopen(path, "r")) == NULL) return eslENOTFOUND;
+  if (fgets(buf, sizeof(buf), fp) == NULL) buf[0] = '\0';
+  fclose(fp);
+
+  CPU_ZERO(cpus);
+  ESL_ALLOC(list, sizeof(int) * CPU_SETSIZE);
+  if (parse_cpulist(buf, list, &n) == eslOK)
+    for (i = 0; i < n; i++) CPU_SET(list[i], cpus);
+  free(list);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+#endif /*HAVE_SCHED_SETAFFINITY*/
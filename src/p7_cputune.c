@@ -0,0 +1,357 @@
+/* Choosing the number of worker threads by measurement (--cpu auto).
+ *
+ * More worker threads aren't always faster. Filtering a large
+ * database can be bound by memory bandwidth rather than arithmetic,
+ * and past the point the memory system can feed, added threads only
+ * queue for it; hyperthreads share a core's vector units, which can
+ * slow Forward down. Where those points are depends on the host, so
+ * with --cpu auto they're measured: the first query is searched
+ * against the first blocks of the database, held in memory, with 1,
+ * 2, 4, ... worker threads, each pinned as the search's workers would
+ * be, until throughput stops improving; and the search proper uses
+ * the fewest threads within CPUTUNE_TOL of the best throughput seen.
+ *
+ * Each trial times the pipeline's stages too (pli->do_timing), so
+ * the report shows how each stage's share of the threads' time moves
+ * as threads are added; a stage that grows is the one they queue on.
+ *
+ * The trial searches are thrown away, and the search proper starts
+ * from the beginning of the database. --cpu auto costs a few seconds
+ * up front, for searches long enough to care.
+ *
+ * Contents:
+ *    1. The P7_CPUTUNE object.
+ *    2. Internal functions.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+
+#define CPUTUNE_MAXTRIALS 32
+#define CPUTUNE_TOL       0.03    /* fewer threads are as good, within this fraction of the best throughput */
+#define CPUTUNE_DROP      0.90    /* stop adding threads once throughput falls below this fraction of the best */
+
+enum cputune_stage_e { CPUTUNE_MSV = 0, CPUTUNE_BIAS = 1, CPUTUNE_VIT = 2, CPUTUNE_FWD = 3, CPUTUNE_DOM = 4 };
+#define CPUTUNE_NSTAGES 5
+
+struct p7_cputune_s {
+  int      ntrials;
+  int      nthreads[CPUTUNE_MAXTRIALS];  /* thread count of each trial, in the order run     */
+  double   secs[CPUTUNE_MAXTRIALS];      /* its elapsed time                                */
+  double   frac[CPUTUNE_MAXTRIALS][CPUTUNE_NSTAGES]; /* share of its threads' time in each stage */
+  uint64_t nres;                         /* residues in the sample                          */
+  int      nblocks;                      /* blocks in the sample                            */
+  int      best;                         /* the chosen number of worker threads             */
+};
+
+#ifdef HMMER_THREADS
+typedef struct {
+  const ESL_GETOPTS  *go;
+  const P7_OPROFILE  *om;
+  ESL_SQ_BLOCK      **blocks;
+  int                 nblocks;
+  const P7_CPUBIND   *cb;
+
+  int                 next;                  /* index of the next unclaimed block      */
+  uint64_t            ns[CPUTUNE_NSTAGES];   /* stage times, summed over the threads   */
+  int                 status;                /* eslOK, or the first failure            */
+  pthread_mutex_t     mutex;
+} CPUTUNE_WORK;
+
+typedef struct {
+  CPUTUNE_WORK *work;
+  int           k;                           /* which worker this is, for p7_cpubind_Worker() */
+} CPUTUNE_ARG;
+
+static int   cputune_trial(CPUTUNE_WORK *work, int nthreads, P7_CPUTUNE *tune);
+static void *cputune_thread(void *arg);
+#endif
+
+
+/*****************************************************************
+ * 1. The P7_CPUTUNE object.
+ *****************************************************************/
+
+/* Function:  p7_cputune_Measure()
+ * Synopsis:  Find the number of worker threads that searches fastest.
+ *
+ * Purpose:   Search query profile <om> against the <nblocks> target
+ *            blocks in <blocks>, with a pipeline configured by <go>
+ *            for each thread, once for each of an increasing number
+ *            of threads up to <maxcpus> (and no more than there are
+ *            blocks to share out); worker threads are pinned by <cb>,
+ *            if it's non-NULL. Doubling stops once throughput falls
+ *            below CPUTUNE_DROP of the best, and one more trial is run
+ *            halfway between the best count and the next one tried.
+ *            The choice is the fewest threads whose throughput was
+ *            within CPUTUNE_TOL of the best.
+ *
+ *            The blocks are only read, and hits are discarded. Return
+ *            the trials and the choice in <*ret_tune>; the choice is
+ *            <p7_cputune_NThreads()>.
+ *
+ *            The caller decides how big a sample is enough; trials
+ *            much shorter than a tenth of a second are noisy.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEINVAL> if a pipeline can't be configured for <om>
+ *            (with <go>'s model-specific thresholds, say, that <om>
+ *            doesn't have); then <*ret_tune> is NULL.
+ *
+ * Throws:    <eslEMEM> on allocation failure, <eslESYS> if a thread
+ *            can't be started; then <*ret_tune> is NULL.
+ */
+int
+p7_cputune_Measure(const ESL_GETOPTS *go, const P7_OPROFILE *om, ESL_SQ_BLOCK **blocks, int nblocks, int maxcpus, const P7_CPUBIND *cb, P7_CPUTUNE **ret_tune)
+{
+  P7_CPUTUNE   *tune = NULL;
+#ifdef HMMER_THREADS
+  CPUTUNE_WORK  work;
+  double        rate, bestrate = 0.;
+  int           tbest        = 1;
+  int           tnext;
+  int           t, b, i;
+#endif
+  int           status;
+
+  ESL_ALLOC(tune, sizeof(P7_CPUTUNE));
+  tune->ntrials = 0;
+  tune->nres    = 0;
+  tune->nblocks = nblocks;
+  tune->best    = 1;
+#ifdef HMMER_THREADS
+  for (b = 0; b < nblocks; b++)
+    for (i = 0; i < blocks[b]->count; i++) tune->nres += blocks[b]->list[i].n;
+
+  maxcpus = ESL_MAX(1, ESL_MIN(maxcpus, nblocks));
+
+  work.go      = go;
+  work.om      = om;
+  work.blocks  = blocks;
+  work.nblocks = nblocks;
+  work.cb      = cb;
+  if (pthread_mutex_init(&work.mutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init failed");
+
+  /* 1, 2, 4 ... threads, 'til they stop helping */
+  for (t = 1; ; t = ESL_MIN(2*t, maxcpus))
+    {
+      if ((status = cputune_trial(&work, t, tune)) != eslOK) break;
+      rate = (double) tune->nres / ESL_MAX(1e-9, tune->secs[tune->ntrials-1]);
+      if (rate > bestrate) { bestrate = rate; tbest = t; }
+      if (t == maxcpus || rate < CPUTUNE_DROP * bestrate) break;
+    }
+
+  /* then halfway between the best and the next count above it that was tried */
+  if (status == eslOK)
+    {
+      for (tnext = 0, i = 0; i < tune->ntrials; i++)
+	if (tune->nthreads[i] > tbest && (tnext == 0 || tune->nthreads[i] < tnext)) tnext = tune->nthreads[i];
+      if (tnext - tbest > 1 && (status = cputune_trial(&work, (tbest + tnext) / 2, tune)) == eslOK)
+	{
+	  rate = (double) tune->nres / ESL_MAX(1e-9, tune->secs[tune->ntrials-1]);
+	  if (rate > bestrate) { bestrate = rate; tbest = (tbest + tnext) / 2; }
+	}
+    }
+  pthread_mutex_destroy(&work.mutex);
+  if (status != eslOK) goto ERROR;
+
+  /* the fewest threads about as fast as the fastest */
+  tune->best = tbest;
+  for (i = 0; i < tune->ntrials; i++)
+    if (tune->nthreads[i] < tune->best && (double) tune->nres / ESL_MAX(1e-9, tune->secs[i]) >= (1. - CPUTUNE_TOL) * bestrate)
+      tune->best = tune->nthreads[i];
+#endif
+
+  *ret_tune = tune;
+  return eslOK;
+
+ ERROR:
+  p7_cputune_Destroy(tune);
+  *ret_tune = NULL;
+  return status;
+}
+
+
+/* Function:  p7_cputune_NThreads()
+ * Synopsis:  The number of worker threads chosen.
+ */
+int
+p7_cputune_NThreads(const P7_CPUTUNE *tune)
+{
+  return tune->best;
+}
+
+
+/* Function:  p7_cputune_Write()
+ * Synopsis:  Report the trials of a P7_CPUTUNE in an output header.
+ *
+ * Purpose:   Write the choice and a table of the trials in <tune> to
+ *            <ofp>, as comment lines for the header of a search's
+ *            output: for each trial, in the order they were run, the
+ *            number of threads, millions of residues searched per
+ *            second, in all and per thread, and the percentage of the
+ *            threads' time spent in each pipeline stage.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on write error.
+ */
+int
+p7_cputune_Write(FILE *ofp, const P7_CPUTUNE *tune)
+{
+  double rate;
+  int    i;
+
+  if (fprintf(ofp, "# number of worker threads:        %d (--cpu auto, from %d blocks, %.1f Mres)\n", tune->best, tune->nblocks, (double) tune->nres * 1e-6) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (tune->ntrials == 0) return eslOK;
+
+  if (fprintf(ofp, "#   threads  Mres/sec  per thread   msv%%  bias%%   vit%%   fwd%%   dom%%\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  for (i = 0; i < tune->ntrials; i++)
+    {
+      rate = (double) tune->nres / ESL_MAX(1e-9, tune->secs[i]) * 1e-6;
+      if (fprintf(ofp, "#   %7d  %8.2f  %10.2f  %5.1f  %5.1f  %5.1f  %5.1f  %5.1f\n",
+		  tune->nthreads[i], rate, rate / tune->nthreads[i],
+		  100. * tune->frac[i][CPUTUNE_MSV], 100. * tune->frac[i][CPUTUNE_BIAS], 100. * tune->frac[i][CPUTUNE_VIT],
+		  100. * tune->frac[i][CPUTUNE_FWD], 100. * tune->frac[i][CPUTUNE_DOM]) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_cputune_Destroy()
+ * Synopsis:  Free a P7_CPUTUNE.
+ */
+void
+p7_cputune_Destroy(P7_CPUTUNE *tune)
+{
+  free(tune);
+}
+
+
+/*****************************************************************
+ * 2. Internal functions.
+ *****************************************************************/
+#ifdef HMMER_THREADS
+
+/* cputune_trial()
+ * Search all of <work>'s blocks with <nthreads> threads, and record
+ * the trial in <tune>. Returns eslOK, or the first failure of a
+ * thread; eslESYS if a thread can't be started.
+ */
+static int
+cputune_trial(CPUTUNE_WORK *work, int nthreads, P7_CPUTUNE *tune)
+{
+  pthread_t   *tid   = NULL;
+  CPUTUNE_ARG *arg   = NULL;
+  int          nstarted = 0;
+  double       t0, busy;
+  int          n     = tune->ntrials;
+  int          i, s;
+  int          status;
+
+  if (n == CPUTUNE_MAXTRIALS) return eslOK;
+  ESL_ALLOC(tid, sizeof(pthread_t)   * nthreads);
+  ESL_ALLOC(arg, sizeof(CPUTUNE_ARG) * nthreads);
+
+  work->next   = 0;
+  work->status = eslOK;
+  for (s = 0; s < CPUTUNE_NSTAGES; s++) work->ns[s] = 0;
+
+  t0 = p7_progress_Now();
+  for (i = 0; i < nthreads; i++, nstarted++)
+    {
+      arg[i].work = work;
+      arg[i].k    = i;
+      if (pthread_create(&tid[i], NULL, cputune_thread, &arg[i]) != 0) break;
+    }
+  for (i = 0; i < nstarted; i++) pthread_join(tid[i], NULL);
+  if (nstarted < nthreads) ESL_XEXCEPTION(eslESYS, "failed to start a calibration thread");
+  if ((status = work->status) != eslOK) goto ERROR;
+
+  tune->nthreads[n] = nthreads;
+  tune->secs[n]     = p7_progress_Now() - t0;
+  busy              = ESL_MAX(1e-9, tune->secs[n] * nthreads * 1e9);
+  for (s = 0; s < CPUTUNE_NSTAGES; s++) tune->frac[n][s] = (double) work->ns[s] / busy;
+  tune->ntrials++;
+
+  free(tid);
+  free(arg);
+  return eslOK;
+
+ ERROR:
+  free(tid);
+  free(arg);
+  return status;
+}
+
+/* cputune_thread()
+ * One worker of a trial: with a pipeline, hit list, and profile of
+ * its own, as a search's worker has, search blocks 'til there are no
+ * more, then add its stage times to the trial's.
+ */
+static void *
+cputune_thread(void *p)
+{
+  CPUTUNE_ARG  *arg  = (CPUTUNE_ARG *) p;
+  CPUTUNE_WORK *work = arg->work;
+  P7_BG        *bg   = NULL;
+  P7_OPROFILE  *om   = NULL;
+  P7_PIPELINE  *pli  = NULL;
+  P7_TOPHITS   *th   = NULL;
+  int           b;
+  int           status = eslOK;
+
+  impl_Init();
+  p7_cpubind_Worker(work->cb, arg->k);
+
+  bg  = p7_bg_Create(work->om->abc);
+  om  = p7_oprofile_Clone(work->om);
+  pli = p7_pipeline_Create(work->go, work->om->M, 100, FALSE, p7_SEARCH_SEQS);
+  th  = p7_tophits_Create();
+  if (bg == NULL || om == NULL || pli == NULL || th == NULL) { status = eslEMEM; goto DONE; }
+  pli->do_timing = TRUE;
+  if ((status = p7_pli_NewModel(pli, om, bg)) != eslOK) goto DONE;
+
+  while (1)
+    {
+      pthread_mutex_lock(&work->mutex);
+      b = (work->status == eslOK ? work->next++ : work->nblocks);
+      pthread_mutex_unlock(&work->mutex);
+      if (b >= work->nblocks) break;
+
+      if ((status = p7_Pipeline_Block(pli, om, bg, work->blocks[b], th)) != eslOK) break;
+      p7_tophits_Reuse(th);
+    }
+
+ DONE:
+  pthread_mutex_lock(&work->mutex);
+  if (status != eslOK && work->status == eslOK) work->status = status;
+  if (pli) {
+    work->ns[CPUTUNE_MSV]  += pli->ns_msv;
+    work->ns[CPUTUNE_BIAS] += pli->ns_bias;
+    work->ns[CPUTUNE_VIT]  += pli->ns_vit;
+    work->ns[CPUTUNE_FWD]  += pli->ns_fwd;
+    work->ns[CPUTUNE_DOM]  += pli->ns_dom;
+  }
+  pthread_mutex_unlock(&work->mutex);
+
+  p7_tophits_Destroy(th);
+  p7_pipeline_Destroy(pli);
+  p7_oprofile_Destroy(om);
+  p7_bg_Destroy(bg);
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
@@ -154,6 +154,18 @@ ERROR:
 #define SER_BASE_SIZE (4 * sizeof(int)) + (6 * sizeof(int64_t)) + (5 * sizeof(float)) + (sizeof(double))
 
 extern int p7_domain_Serialize(const P7_DOMAIN *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc){
+  return p7_domain_SerializeAs(obj, p7_ALI_FULL, buf, n, nalloc);
+}
+
+/* Function:  p7_domain_SerializeAs
+ * Synopsis:  Serializes a P7_DOMAIN, choosing the form of its alignment display
+ *
+ * Purpose:   As <p7_domain_Serialize()>, but the enclosed P7_ALIDISPLAY is
+ *            written in form <form> (see <p7_alidisplay_SerializeAs()>).
+ *            With <p7_ALI_NONE>, the scores_per_pos array is left out too.
+ *            <p7_domain_Deserialize()> reads any of the forms.
+ */
+extern int p7_domain_SerializeAs(const P7_DOMAIN *obj, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc){
 
   int status; // error variable used by ESL_ALLOC
   uint32_t ser_size; // size of the structure when serialized
@@ -166,7 +178,7 @@ extern int p7_domain_Serialize(const P7_DOMAIN *obj, uint8_t **buf, uint32_t *n,
     return(eslEINVAL);
   }
 
-  if(obj->scores_per_pos != NULL){
+  if(obj->scores_per_pos != NULL && form != p7_ALI_NONE){
     ser_size = SER_BASE_SIZE + (obj->ad->N * sizeof(float)); 
   }
   else{
@@ -267,7 +279,7 @@ extern int p7_domain_Serialize(const P7_DOMAIN *obj, uint8_t **buf, uint32_t *n,
   ptr += sizeof(int32_t);
 
   //Handle the scores_per_pos_array
-  if(obj->scores_per_pos == NULL){ // No scores_per_pos, so just record its size as 0
+  if(obj->scores_per_pos == NULL || form == p7_ALI_NONE){ // No scores_per_pos, so just record its size as 0
     network_32bit = esl_hton32(0);
     memcpy(ptr, &network_32bit, sizeof(int32_t));
     ptr += sizeof(int32_t);
@@ -293,7 +305,7 @@ extern int p7_domain_Serialize(const P7_DOMAIN *obj, uint8_t **buf, uint32_t *n,
 
   *n = ptr - *buf; // update offset into buffer so that alidisplay_Serialize starts in the right place
   // Finally, the P7_ALIDISPLAY object
-  int ser_return = p7_alidisplay_Serialize(obj->ad, buf, n, nalloc);
+  int ser_return = p7_alidisplay_SerializeAs(obj->ad, form, buf, n, nalloc);
 
   return ser_return; // if we get this far and the Serialize went well, return eslOK.  Otherwise, return the error code from 
   // the serialize 
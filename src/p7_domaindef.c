@@ -35,6 +35,7 @@
 #include <p7_config.h>
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "easel.h"
@@ -44,10 +45,32 @@
 
 #include "hmmer.h"
 
+/* States in a trace of one domain, unihit, over <L> residues of a
+ * model of length <M>: at most L emitting states, M D states, and
+ * S,N,B,E,C,T. Traces in <ddef->tr> are sized to this before they're
+ * collected, instead of doubling their way up from the initial
+ * allocation.
+ */
+#define p7_DOMAINDEF_TRACELEN(L, M)  ((L) + (M) + 6)
+
 static int is_multidomain_region  (P7_DOMAINDEF *ddef, int i, int j);
 static int region_trace_ensemble  (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc);
 static int rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *ox1, P7_OMX *ox2,
 				   int i, int j, int null2_is_done, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+static int next_region            (P7_DOMAINDEF *ddef, int L, int *ret_i, int *ret_j);
+#if defined (eslENABLE_SSE)
+static P7_OMXCHK **envelope_chk   (P7_DOMAINDEF *ddef, int M, int L);
+static int envelope_chk_layout    (P7_DOMAINDEF *ddef, P7_OMXCHK **pock, int M, int L);
+#endif
+static int envelope_decode        (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2, int do_ali, float *ret_envsc, float *ret_oasc);
+static int envelope_align         (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, int Ld, P7_OMX *ox1, P7_OMX *ox2, float *ret_oasc);
+static int envelope_forward       (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, float *ret_sc);
+static int envelope_null2         (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, int Ld, P7_OMX *ox2, float *null2);
+static int region_domains         (P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *fwd, P7_OMX *bck,
+				   int i, int j, int is_multi, int saveL, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+#ifdef HMMER_THREADS
+static int domaindef_threaded     (P7_DOMAINDEF *ddef, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *fwd, P7_OMX *bck, P7_BG *bg, int saveL);
+#endif
 
 
 /*****************************************************************
@@ -80,7 +103,13 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->n2sc = NULL;
   ddef->sp   = NULL;
   ddef->tr   = NULL;
+  ddef->gtr  = NULL;
+  ddef->wdef = NULL;
+  ddef->wox  = NULL;
+  ddef->nwdef = 0;
   ddef->dcl  = NULL;
+  ddef->ock  = NULL;
+  ddef->ock16 = NULL;
 
   /* level 2 alloc: posterior prob arrays */
   ESL_ALLOC(ddef->mocc, sizeof(float) * (Lalloc+1));
@@ -108,6 +137,7 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->rt2           = 0.10;
   ddef->rt3           = 0.20;
   ddef->nsamples      = 200;
+  ddef->nbatch        = 0;
   ddef->min_overlap   = 0.8;
   ddef->of_smaller    = TRUE;
   ddef->max_diagdiff  = 4;
@@ -122,6 +152,17 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   /* keep a copy of ptr to the RNG */
   ddef->r            = r;  
   ddef->do_reseeding = TRUE;
+  ddef->nthreads     = 0;
+  ddef->ramlimit     = 0;
+  ddef->do_bf16      = FALSE;
+  ddef->defer_ali    = FALSE;
+  ddef->arena        = NULL;
+  ddef->ock          = NULL;
+  ddef->ock16        = NULL;
+  ddef->nchk         = 0;
+  ddef->post_ox      = NULL;
+  ddef->post_dsq     = NULL;
+  ddef->post_Ld      = 0;
   return ddef;
   
  ERROR:
@@ -203,6 +244,7 @@ p7_domaindef_Reuse(P7_DOMAINDEF *ddef)
     }
   ddef->ndom = 0;
   ddef->L    = 0;
+  ddef->post_ox = NULL;
 
   ddef->nexpected  = 0.0;
   ddef->nregions   = 0;
@@ -301,54 +343,150 @@ p7_domaindef_Destroy(P7_DOMAINDEF *ddef)
   p7_spensemble_Destroy(ddef->sp);
   p7_trace_Destroy(ddef->tr);
   p7_trace_Destroy(ddef->gtr);
+  for (d = 0; d < ddef->nwdef; d++)
+    {
+      p7_domaindef_Destroy(ddef->wdef[d]);
+      if (ddef->wox[2*d])   p7_omx_Destroy(ddef->wox[2*d]);
+      if (ddef->wox[2*d+1]) p7_omx_Destroy(ddef->wox[2*d+1]);
+    }
+  free(ddef->wdef);
+  free(ddef->wox);
+#if defined (eslENABLE_SSE)
+  p7_omxchk_Destroy(ddef->ock);
+  p7_omxchk_Destroy(ddef->ock16);
+#endif
   free(ddef);
   return;
 }
 
+
+/* Function:  p7_domaindef_Sizeof()
+ * Synopsis:  Returns the allocated size of a <P7_DOMAINDEF>, in bytes.
+ *
+ * Purpose:   Returns the number of bytes <ddef> currently holds: its
+ *            posterior and null2 arrays, its domain list and the
+ *            alignment displays in it (unless they're in a hit list's
+ *            arena), its trace and sampling workspace, its
+ *            checkpointed matrices, if it has created any, and the
+ *            scratch space and matrices it keeps for threaded region
+ *            workers. Domain lists that have been handed over to hits
+ *            aren't counted.
+ */
+size_t
+p7_domaindef_Sizeof(const P7_DOMAINDEF *ddef)
+{
+  const P7_TRACE *trv[2] = { ddef->tr, ddef->gtr };
+  size_t          n      = sizeof(P7_DOMAINDEF);
+  int             d, t;
+
+  n += sizeof(float) * (ddef->Lalloc+1) * 4;	/* mocc, btot, etot, n2sc */
+  if (ddef->dcl)
+    {
+      n += sizeof(P7_DOMAIN) * ddef->nalloc;
+      for (d = 0; d < ddef->ndom; d++)
+	if (ddef->dcl[d].ad && ! ddef->dcl[d].ad->in_arena) n += p7_alidisplay_Sizeof(ddef->dcl[d].ad);
+    }
+  for (t = 0; t < 2; t++)
+    if (trv[t])
+      {
+	n += sizeof(P7_TRACE) + (sizeof(char) + 2 * sizeof(int) + (trv[t]->pp ? sizeof(float) : 0)) * trv[t]->nalloc;
+	n += sizeof(int) * 6 * trv[t]->ndomalloc;
+      }
+  if (ddef->sp)
+    {
+      n += sizeof(P7_SPENSEMBLE) + sizeof(struct p7_spcoord_s) * (ddef->sp->nalloc + ddef->sp->nsigc_alloc);
+      n += sizeof(int) * (3 * ddef->sp->nalloc + ddef->sp->epc_alloc);	/* workspace (2n), assignment, epc */
+    }
+#if defined (eslENABLE_SSE)
+  if (ddef->ock)   n += p7_omxchk_Sizeof(ddef->ock);
+  if (ddef->ock16) n += p7_omxchk_Sizeof(ddef->ock16);
+#endif
+  n += (sizeof(P7_DOMAINDEF *) + 2 * sizeof(P7_OMX *)) * ddef->nwdef;
+  for (d = 0; d < ddef->nwdef; d++)
+    {
+      n += p7_domaindef_Sizeof(ddef->wdef[d]);
+      for (t = 2*d; t < 2*d+2; t++)
+	if (ddef->wox[t]) n += p7_omx_Sizeof(ddef->wox[t]);
+    }
+  return n;
+}
+
 /*****************************************************************
  * 2. Routines inferring domain structure of a target sequence
  *****************************************************************/
 
-#if 0
 /* Function:  p7_domaindef_ByViterbi()
- * Synopsis:  Define domains in a sequence by maximum likelihood.
- * Incept:    SRE, Fri Jan 25 15:10:21 2008 [Janelia]
+ * Synopsis:  Define a single domain by the Viterbi path, fast.
  *
- * Purpose:   Use a Viterbi (maximum likelihood) parse to determine
- *            the domain structure of sequence <sq> aligned to 
- *            model <gm>. Caller provides a filled Viterbi matrix
- *            in <gx1>, and a second matrix of at least the same
- *            size for scratch space in <gx2>.
- *            
- *            Upon return, <ddef> contains definitions of all the
- *            domains, bounds defined by Viterbi parse, individually
- *            scored by null2-corrected Forward, and aligned by
- *            optimal posterior accuracy.
- *            
- * Returns:   <eslOK> on success.
+ * Purpose:   The fast alternative to
+ *            <p7_domaindef_ByPosteriorHeuristics()>, for a target
+ *            <sq> that (probably) has one domain. Given model <om>,
+ *            configured for <sq> as for Forward, find the Viterbi
+ *            alignment of the whole target in full matrix <fwd>. If
+ *            it has exactly one domain, take that domain's sequence
+ *            range as its envelope, and score and align it, with
+ *            null2, as <p7_domaindef_ByPosteriorHeuristics()> does
+ *            an envelope, using <fwd> and <bck> as workspace. That
+ *            replaces a Backward pass over the whole target,
+ *            posterior decoding and region identification with one
+ *            Viterbi pass; the envelope is the Viterbi domain, so
+ *            it's often a few residues narrower than the posterior
+ *            one, and its score a little lower.
+ *
+ *            Only the SSE implementation has the vectorized Viterbi
+ *            traceback this needs; elsewhere, this always declines.
+ *            It also declines if the full matrix would be bigger
+ *            than <ddef->ramlimit> (when that's set).
+ *
+ * Returns:   <eslOK> on success, and <ddef> holds the one domain.
+ *
+ *            <eslENORESULT> if the Viterbi path has no domain or
+ *            several, or Viterbi can't be used; <ddef> is then as it
+ *            was, and the caller goes on with
+ *            <p7_domaindef_ByPosteriorHeuristics()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
  */
 int
-p7_domaindef_ByViterbi(P7_PROFILE *gm, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_GMX *gx1, P7_GMX *gx2, P7_DOMAINDEF *ddef) 
+p7_domaindef_ByViterbi(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *fwd, P7_OMX *bck, P7_DOMAINDEF *ddef, P7_BG *bg)
 {
-  int            d;
-  int            saveL     = gm->L;    /* need to be able to restore original <gm> config */
-  int            save_mode = gm->mode;
-
-  p7_domaindef_GrowTo(ddef, sq->n);
-  p7_GTrace  (sq->dsq, sq->n, gm, gx1, ddef->gtr);
-  p7_trace_Index(ddef->gtr);
-  
-  p7_ReconfigUnihit(gm, 0);	  /* process each domain in unihit L=0 mode */
-
-  for (d = 0; d < ddef->gtr->ndom; d++)
-    rescore_isolated_domain(ddef, gm, sq, ntsq, gx1, gx2, ddef->gtr->sqfrom[d], ddef->gtr->sqto[d], FALSE, NULL, FALSE, NULL, NULL, NULL);
+#if defined (eslENABLE_SSE)
+  int saveL     = om->L;
+  int save_mode = om->mode;
+  int i, j;
+  int status;
 
-  /* Restore original model configuration, including length */
-  if (p7_IsMulti(save_mode))  p7_ReconfigMultihit(gm, saveL); 
-  else                        p7_ReconfigUnihit(  gm, saveL); 
+  if (ddef->ramlimit > 0 && (int64_t) p7_omx_SizeofFull(om->M, sq->n) > ddef->ramlimit) return eslENORESULT;
+
+  if ((status = p7_omx_GrowTo(fwd, om->M, sq->n, sq->n)) != eslOK) return status;
+  if (p7_ViterbiFull(sq->dsq, sq->n, om, fwd, NULL)      != eslOK) return eslENORESULT;  /* eslERANGE: shouldn't happen */
+  if ((status = p7_VTrace(sq->dsq, sq->n, om, fwd, ddef->gtr)) != eslOK) goto ERROR;
+  if ((status = p7_trace_Index(ddef->gtr))               != eslOK) goto ERROR;
+  if (ddef->gtr->ndom != 1) { p7_trace_Reuse(ddef->gtr); return eslENORESULT; }
+  i = ddef->gtr->sqfrom[0];
+  j = ddef->gtr->sqto[0];
+  p7_trace_Reuse(ddef->gtr);
+
+  if ((status = p7_domaindef_GrowTo(ddef, sq->n)) != eslOK) return status;
+  esl_vec_FSet(ddef->n2sc, sq->n+1, 0.0);
+  ddef->post_ox   = NULL;
+  ddef->nexpected = 1.0;
+  ddef->nregions++;
+  ddef->nenvelopes++;
+
+  p7_oprofile_ReconfigUnihit(om, saveL);	/* the domain is rescored in unihit mode, as an envelope always is */
+  rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i, j, FALSE, bg, FALSE, NULL, NULL, NULL);
+  if (p7_IsMulti(save_mode)) p7_oprofile_ReconfigMultihit(om, saveL);
+  else                       p7_oprofile_ReconfigUnihit  (om, saveL);
   return eslOK;
-}
+
+ ERROR:
+  p7_trace_Reuse(ddef->gtr);
+  return status;
+#else
+  return eslENORESULT;
 #endif
+}
 
 
 /* Function:  p7_domaindef_ByPosteriorHeuristics()
@@ -373,12 +511,21 @@ p7_domaindef_ByViterbi(P7_PROFILE *gm, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_
  *            Upon return, <ddef> contains the definitions of all the
  *            domains: their bounds, their null-corrected Forward
  *            scores, and their optimal posterior accuracy alignments.
+ *
+ *            If <ddef->nthreads> is >1, <ddef->do_reseeding> is TRUE,
+ *            and this isn't a <long_target>, the regions of a long
+ *            target with several regions are processed by up to
+ *            <ddef->nthreads> threads (in a threaded build). Results
+ *            are identical to the serial path.
  *            
  * Returns:   <eslOK> on success.           
  *            
  *            <eslERANGE> on numeric overflow in posterior
  *            decoding. This should not be possible for multihit
  *            models.
+ *
+ * Throws:    <eslEMEM> on allocation failure, or <eslESYS> on a
+ *            threading failure, in the threaded path.
  */
 int
 p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om,
@@ -387,11 +534,6 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
 				   P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr)
 {
   int i, j;
-  int triggered;
-  int d;
-  int i2,j2;
-  int last_j2;
-  int nc;
   int saveL     = om->L;	/* Save the length config of <om>; will restore upon return */
   int save_mode = om->mode;	/* Likewise for the mode. */
   int status;
@@ -400,96 +542,132 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
   if ((status = p7_DomainDecoding(om, oxf, oxb, ddef)) != eslOK) return status;  /* ddef->{btot,etot,mocc} now made.                    */
 
   esl_vec_FSet(ddef->n2sc, sq->n+1, 0.0);          /* ddef->n2sc null2 scores are initialized                        */
+  ddef->post_ox   = NULL;                          /* no envelope decoded yet                                        */
   ddef->nexpected = ddef->btot[sq->n];             /* posterior expectation for # of domains (same as etot[sq->n])   */
 
   p7_oprofile_ReconfigUnihit(om, saveL);	   /* process each domain in unihit mode, regardless of om->mode     */
-  i     = -1;
-  triggered = FALSE;
 
-  for (j = 1; j <= sq->n; j++)
-  {
-
-    if (! triggered)
-    {			/* xref J2/101 for what the logic below is: */
-      if       (ddef->mocc[j] - (ddef->btot[j] - ddef->btot[j-1]) <  ddef->rt2) i = j;
-      else if  (i == -1)                                                        i = j;
-      if       (ddef->mocc[j]                                     >= ddef->rt1) triggered = TRUE;
-    }
-    else if (ddef->mocc[j] - (ddef->etot[j] - ddef->etot[j-1])  <  ddef->rt2)
+#ifdef HMMER_THREADS
+  /* A long target with several regions can have them farmed out to
+   * helper threads. The RNG is reset to its seed for each region, so
+   * the results are the same as the serial path below.
+   */
+  if (ddef->nthreads > 1 && ddef->do_reseeding && ! long_target)
     {
-        /* We have a region i..j to evaluate. */
-        p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
-        p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
-        ddef->nregions++;
-        if (is_multidomain_region(ddef, i, j))
-        {
-            /* This region appears to contain more than one domain, so we have to
-             * resolve it by cluster analysis of posterior trace samples, to define
-             * one or more domain envelopes.
-             */
-            ddef->nclustered++;
-
-            /* Resolve the region into domains by stochastic trace
-             * clustering; assign position-specific null2 model by
-             * stochastic trace clustering; there is redundancy
-             * here; we will consolidate later if null2 strategy
-             * works
-             */
-            p7_oprofile_ReconfigMultihit(om, saveL);
-            p7_Forward(sq->dsq+i-1, j-i+1, om, fwd, NULL);
-
-            region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, bck, &nc);
-            p7_oprofile_ReconfigUnihit(om, saveL);
-            /* ddef->n2sc is now set on i..j by the traceback-dependent method */
-
-            last_j2 = 0;
-            for (d = 0; d < nc; d++) {
-                  p7_spensemble_GetClusterCoords(ddef->sp, d, &i2, &j2, NULL, NULL, NULL);
-                  if (i2 <= last_j2) ddef->noverlaps++;
-
-                  /* Note that k..m coords on model are available, but
-                     * we're currently ignoring them.  This leads to a
-                     * rare clustering bug that we eventually need to fix
-                     * properly [xref J3/32]: two different regions in one
-                     * profile HMM might have hit same seq domain, and
-                     * when we now go to calculate an OA trace, nothing
-                     * constrains us to find the two different alignments
-                     * to the HMM; in fact, because OA is optimal, we'll
-                     * find one and the *same* alignment, leading to an
-                     * apparent duplicate alignment in the output.
-                     *
-                     * Registered as #h74, Dec 2009, after EBI finds and
-                     * reports it.  #h74 is worked around in p7_tophits.c
-                     * by hiding all but one envelope with an identical
-                     * alignment, in the rare event that this
-                     * happens. [xref J5/130].
-                  */
-                  ddef->nenvelopes++;
-
-                  /*the !long_target argument will cause the function to recompute null2
-                   * scores if this is part of a long_target (nhmmer) pipeline */
-                  if (rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i2, j2, TRUE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr) == eslOK)
-                       last_j2 = j2;
-            }
-            p7_spensemble_Reuse(ddef->sp);
-            p7_trace_Reuse(ddef->tr);
-        }
-        else
-        {
-            /* The region looks simple, single domain; convert the region to an envelope. */
-            ddef->nenvelopes++;
-            rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i, j, FALSE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
-        }
-        i     = -1;
-        triggered = FALSE;
+      status = domaindef_threaded(ddef, sq, ntsq, om, fwd, bck, bg, saveL);
+      if (status != eslEOD) goto DONE;          /* eslEOD: not worth threading; fall through to serial */
     }
-  }
+#endif
 
+  status = eslOK;
+  i = j  = 0;
+  while (next_region(ddef, sq->n, &i, &j))
+    {
+      /* We have a region i..j to evaluate. */
+      ddef->nregions++;
+      region_domains(ddef, om, sq, ntsq, fwd, bck, i, j, is_multidomain_region(ddef, i, j), saveL, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
+    }
 
+#ifdef HMMER_THREADS
+ DONE:
+#endif
   /* Restore model to uni/multihit mode, and to its original length model */
   if (p7_IsMulti(save_mode)) p7_oprofile_ReconfigMultihit(om, saveL); 
   else                       p7_oprofile_ReconfigUnihit  (om, saveL); 
-  return eslOK;
+  return status;
+}
+
+
+/* Function:  p7_domaindef_Align()
+ * Synopsis:  Align domains that were scored without alignments.
+ *
+ * Purpose:   After <p7_domaindef_ByPosteriorHeuristics()> with
+ *            <ddef->defer_ali> TRUE, the domains in <ddef> have
+ *            coordinates and scores but no alignments: <ad> is
+ *            NULL, and <iali..jali> are the envelope. Computing the
+ *            optimal accuracy alignments is only worth it for
+ *            targets that will be reported, which the caller only
+ *            knows once all domains are scored. So the caller
+ *            decides, and for a target it keeps, calls this to
+ *            compute the OA alignment of each such domain, with the
+ *            same <sq>, <ntsq> and <om> (in the same configuration)
+ *            it gave <p7_domaindef_ByPosteriorHeuristics()>. <fwd>
+ *            and <bck> are DP matrices for it to use (and reallocate
+ *            as needed).
+ *
+ *            Each envelope is decoded again, so an aligned domain
+ *            costs one more Forward/Backward than with
+ *            <defer_ali> FALSE; a target that isn't kept saves its
+ *            OA alignments and alignment displays altogether.
+ *            The exception is the last envelope that
+ *            <p7_domaindef_ByPosteriorHeuristics()> decoded: if its
+ *            posteriors are still in <bck>, as they are when the
+ *            caller goes straight from one call to the other with
+ *            the same matrices, that domain is aligned from them.
+ *            For the usual one-domain target, that's no extra
+ *            Forward/Backward at all.
+ *            Scores are unchanged, and the alignments are the same
+ *            as the ones <defer_ali> FALSE would have made.
+ *            
+ *            Domains that already have an alignment are left
+ *            alone, so this is a no-op when <defer_ali> is FALSE.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslERANGE> on numeric overflow in posterior decoding,
+ *            which can't happen for an envelope that
+ *            <p7_domaindef_ByPosteriorHeuristics()> kept.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_domaindef_Align(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *fwd, P7_OMX *bck, P7_DOMAINDEF *ddef)
+{
+  P7_DOMAIN *dom;
+  int        saveL     = om->L;
+  int        save_mode = om->mode;
+  float      envsc;
+  int        dfirst    = -1;
+  int        d, n, z;
+  int        status    = eslOK;
+
+  for (d = 0; d < ddef->ndom; d++)
+    if (ddef->dcl[d].ad == NULL) break;
+  if (d == ddef->ndom) return eslOK;
+
+  /* The domain whose posteriors we still have goes first, before another decoding overwrites them */
+  if (ddef->post_ox == bck)
+    for (d = 0; d < ddef->ndom; d++)
+      if (ddef->dcl[d].ad == NULL && ddef->post_dsq == sq->dsq + ddef->dcl[d].ienv-1 && ddef->post_Ld == ddef->dcl[d].jenv-ddef->dcl[d].ienv+1)
+	{ dfirst = d; break; }
+
+  p7_oprofile_ReconfigUnihit(om, saveL);	/* domains were aligned in unihit mode */
+  for (n = (dfirst >= 0 ? -1 : 0); n < ddef->ndom; n++)
+    {
+      d   = (n < 0 ? dfirst : n);
+      dom = &(ddef->dcl[d]);
+      if (dom->ad != NULL || (n >= 0 && d == dfirst)) continue;
+
+      if (ddef->post_ox == bck && ddef->post_dsq == sq->dsq + dom->ienv-1 && ddef->post_Ld == dom->jenv-dom->ienv+1)
+	status = envelope_align(ddef, om, ddef->post_Ld, fwd, bck, &(dom->oasc));
+      else
+	status = envelope_decode(ddef, om, sq->dsq + dom->ienv-1, dom->jenv-dom->ienv+1, fwd, bck, TRUE, &envsc, &(dom->oasc));
+      ddef->post_ox = NULL;	/* <fwd> now holds OA scores; and any other envelope decoded since has its own */
+      if (status != eslOK) { p7_trace_Reuse(ddef->tr); break; }
+
+      for (z = 0; z < ddef->tr->N; z++)
+	if (ddef->tr->i[z] > 0) ddef->tr->i[z] += dom->ienv-1;
+
+      dom->ad = p7_alidisplay_CreateInArena(ddef->arena, ddef->tr, 0, om, sq, ntsq);
+      p7_trace_Reuse(ddef->tr);
+      if (dom->ad == NULL) { status = eslEMEM; break; }
+      dom->iali = dom->ad->sqfrom;
+      dom->jali = dom->ad->sqto;
+    }
+
+  if (p7_IsMulti(save_mode)) p7_oprofile_ReconfigMultihit(om, saveL); 
+  else                       p7_oprofile_ReconfigUnihit  (om, saveL); 
+  return status;
 }
 
 
@@ -499,6 +677,132 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
  *****************************************************************/
 
 
+/* next_region()
+ *
+ * Find the next region in the posterior arrays of <ddef>, starting
+ * after position <*ret_j> (pass 0 to start at the beginning of a
+ * sequence of length <L>). A region is triggered by a residue with
+ * mocc[j] >= <ddef->rt1>, and extended on both sides until the
+ * mocc - {b,e}occ falls below <ddef->rt2> (xref J2/101).
+ *
+ * Return TRUE and the region's bounds in <*ret_i>..<*ret_j> if one is
+ * found; FALSE if there's no more regions in the sequence.
+ */
+static int
+next_region(P7_DOMAINDEF *ddef, int L, int *ret_i, int *ret_j)
+{
+  int i         = -1;
+  int triggered = FALSE;
+  int j;
+
+  for (j = *ret_j+1; j <= L; j++)
+    {
+      if (! triggered)
+	{			/* xref J2/101 for what the logic below is: */
+	  if       (ddef->mocc[j] - (ddef->btot[j] - ddef->btot[j-1]) <  ddef->rt2) i = j;
+	  else if  (i == -1)                                                        i = j;
+	  if       (ddef->mocc[j]                                     >= ddef->rt1) triggered = TRUE;
+	}
+      else if (ddef->mocc[j] - (ddef->etot[j] - ddef->etot[j-1])  <  ddef->rt2)
+	{
+	  *ret_i = i;
+	  *ret_j = j;
+	  return TRUE;
+	}
+    }
+  *ret_j = L;
+  return FALSE;
+}
+
+
+/* region_domains()
+ *
+ * Define, score, and align the domains in one region <i>..<j> of
+ * <sq>, appending them to <ddef->dcl>. If <is_multi> is TRUE, the
+ * region is resolved into envelopes by stochastic trace clustering
+ * first; otherwise the region is taken as a single envelope. <om> is
+ * in unihit mode, with length model <saveL>, and is left that way on
+ * return. <fwd> and <bck> are reallocated as needed.
+ *
+ * Updates the <nclustered>, <noverlaps>, and <nenvelopes> counters in
+ * <ddef>; the caller counts <nregions>.
+ */
+static int
+region_domains(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *fwd, P7_OMX *bck,
+	       int i, int j, int is_multi, int saveL, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr)
+{
+  int d;
+  int i2,j2;
+  int last_j2;
+  int nc;
+
+  p7_PROBE3(region__start, i, j, is_multi);
+  if (is_multi)
+    {
+      /* This region appears to contain more than one domain, so we have to
+       * resolve it by cluster analysis of posterior trace samples, to define
+       * one or more domain envelopes.
+       */
+      ddef->nclustered++;
+      ddef->post_ox = NULL;	/* <fwd>, <bck> are about to be overwritten */
+
+      /* Resolve the region into domains by stochastic trace
+       * clustering; assign position-specific null2 model by
+       * stochastic trace clustering; there is redundancy
+       * here; we will consolidate later if null2 strategy
+       * works
+       */
+      p7_oprofile_ReconfigMultihit(om, saveL);
+      p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);	/* stochastic traceback needs the full Forward matrix */
+      p7_omx_GrowTo(bck, om->M, 0,     0);	/* ...and one row of work space */
+      p7_Forward(sq->dsq+i-1, j-i+1, om, fwd, NULL);
+
+      region_trace_ensemble(ddef, om, sq->dsq, i, j, fwd, bck, &nc);
+      p7_oprofile_ReconfigUnihit(om, saveL);
+      /* ddef->n2sc is now set on i..j by the traceback-dependent method */
+
+      last_j2 = 0;
+      for (d = 0; d < nc; d++) {
+	p7_spensemble_GetClusterCoords(ddef->sp, d, &i2, &j2, NULL, NULL, NULL);
+	if (i2 <= last_j2) ddef->noverlaps++;
+
+	/* Note that k..m coords on model are available, but
+	 * we're currently ignoring them.  This leads to a
+	 * rare clustering bug that we eventually need to fix
+	 * properly [xref J3/32]: two different regions in one
+	 * profile HMM might have hit same seq domain, and
+	 * when we now go to calculate an OA trace, nothing
+	 * constrains us to find the two different alignments
+	 * to the HMM; in fact, because OA is optimal, we'll
+	 * find one and the *same* alignment, leading to an
+	 * apparent duplicate alignment in the output.
+	 *
+	 * Registered as #h74, Dec 2009, after EBI finds and
+	 * reports it.  #h74 is worked around in p7_tophits.c
+	 * by hiding all but one envelope with an identical
+	 * alignment, in the rare event that this
+	 * happens. [xref J5/130].
+	 */
+	ddef->nenvelopes++;
+
+	/*the !long_target argument will cause the function to recompute null2
+	 * scores if this is part of a long_target (nhmmer) pipeline */
+	if (rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i2, j2, TRUE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr) == eslOK)
+	  last_j2 = j2;
+      }
+      p7_spensemble_Reuse(ddef->sp);
+      p7_trace_Reuse(ddef->tr);
+    }
+  else
+    {
+      /* The region looks simple, single domain; convert the region to an envelope. */
+      ddef->nenvelopes++;
+      rescore_isolated_domain(ddef, om, sq, ntsq, fwd, bck, i, j, FALSE, bg, long_target, bg_tmp, scores_arr, fwd_emissions_arr);
+    }
+  return eslOK;
+}
+
+
 /* is_multidomain_region()
  * SRE, Fri Feb  8 11:35:04 2008 [Janelia]
  *
@@ -592,17 +896,33 @@ is_multidomain_region(P7_DOMAINDEF *ddef, int i, int j)
  * <ddef->tr> is used as working memory for sampled traces.
  *    
  * <wrk> has had its zero row clobbered as working space for a null2 calculation.
+ *
+ * Normally <ddef->nsamples> traces are sampled. If <ddef->nbatch> is
+ * set, traces are sampled in batches of that many, and the ensemble
+ * is clustered after each batch; sampling stops early once two
+ * successive clusterings give the same number of domains with
+ * endpoints within <ddef->max_diagdiff> of each other. Regions with
+ * a clear domain structure then need only a few batches, while
+ * ambiguous regions with a diffuse posterior still get up to
+ * <ddef->nsamples> traces.
+ *
+ * Returns <eslOK> on success. Throws <eslEMEM> on allocation failure.
  */
 static int
 region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, 
 		      const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc)
 {
+  struct p7_spcoord_s *prv = NULL;	/* significant clusters from the last batch, w/ nbatch */
+  int    nprv       = -1;
+  int    nprv_alloc = 0;
+  int    is_stable  = FALSE;
   int    Lr  = jreg-ireg+1;
   int    t, d, d2;
   int    nov, n;
   int    nc;
   int    pos;
   float  null2[p7_MAXCODE];
+  int    status;
 
   esl_vec_FSet(ddef->n2sc+ireg, Lr, 0.0); /* zero the null2 scores in region */
 
@@ -612,8 +932,11 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
   if (ddef->do_reseeding) 
     esl_randomness_Init(ddef->r, esl_randomness_GetSeed(ddef->r));
 
-  /* Collect an ensemble of sampled traces; calculate null2 odds ratios from these */
-  for (t = 0; t < ddef->nsamples; t++)
+  /* Collect an ensemble of sampled traces; calculate null2 odds ratios from these.
+   * Size <ddef->tr> for one domain up front; a trace with more grows it.
+   */
+  if ((status = p7_trace_GrowTo(ddef->tr, p7_DOMAINDEF_TRACELEN(Lr, om->M))) != eslOK) goto ERROR;
+  for (t = 0; t < ddef->nsamples && ! is_stable; t++)
     {
       p7_StochasticTrace(ddef->r, dsq+ireg-1, Lr, om, fwd, ddef->tr);
       p7_trace_Index(ddef->tr);
@@ -635,14 +958,40 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
       for (; pos <= Lr; pos++)  ddef->n2sc[ireg+pos-1] += 1.0;
 
       p7_trace_Reuse(ddef->tr);        
+
+      /* With batched sampling, see if the clustering has stopped changing. */
+      if (ddef->nbatch > 0 && (t+1) % ddef->nbatch == 0 && t+1 < ddef->nsamples)
+	{
+	  if ((status = p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc)) != eslOK) goto ERROR;
+
+	  if (nc == nprv)
+	    {
+	      for (d = 0; d < nc; d++)
+		if (abs(ddef->sp->sigc[d].i - prv[d].i) > ddef->max_diagdiff ||
+		    abs(ddef->sp->sigc[d].j - prv[d].j) > ddef->max_diagdiff) break;
+	      if (d == nc) is_stable = TRUE;
+	    }
+
+	  if (nc > nprv_alloc) {
+	    void *p;
+	    ESL_RALLOC(prv, p, sizeof(struct p7_spcoord_s) * nc);
+	    nprv_alloc = nc;
+	  }
+	  if (nc > 0) memcpy(prv, ddef->sp->sigc, sizeof(struct p7_spcoord_s) * nc);
+	  nprv = nc;
+	}
     }
+  /* <t> is now the number of traces sampled. */
 
   /* Convert the accumulated n2sc[] ratios in this region to log odds null2 scores on each residue. */
   for (pos = ireg; pos <= jreg; pos++)
-    ddef->n2sc[pos] = logf(ddef->n2sc[pos] / (float) ddef->nsamples);
+    ddef->n2sc[pos] = logf(ddef->n2sc[pos] / (float) t);
 
-  /* Cluster the ensemble of traces to break region into envelopes. */
-  p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc);
+  /* Cluster the ensemble of traces to break region into envelopes. 
+   * (If sampling stopped early, the last batch's clustering already did it.)
+   */
+  if (! is_stable &&
+      (status = p7_spensemble_Cluster(ddef->sp, ddef->min_overlap, ddef->of_smaller, ddef->max_diagdiff, ddef->min_posterior, ddef->min_endpointp, &nc)) != eslOK) goto ERROR;
 
   /* A little hacky now. Remove "dominated" domains relative to seq coords. */
   for (d = 0; d < nc; d++) 
@@ -674,7 +1023,13 @@ region_trace_ensemble(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *
     }
   ddef->sp->nc = d;
   *ret_nc = d;
+  if (prv) free(prv);
   return eslOK;
+
+ ERROR:
+  if (prv) free(prv);
+  *ret_nc = 0;
+  return status;
 }
 
 
@@ -783,6 +1138,11 @@ reparameterize_model (P7_BG *bg, P7_OPROFILE *om, const ESL_SQ *sq, int start, i
  * is not done, and the domcorrection, used to determine null2, is not
  * computed).
  * 
+ * If <ddef->defer_ali> is TRUE (and this isn't a <long_target>), the
+ * domain is scored but not aligned: no OA traceback, <ad> is NULL,
+ * and <iali..jali> are the envelope's coords, until the caller
+ * decides the target is worth it and calls <p7_domaindef_Align()>.
+ * 
  * Returns <eslOK> if a domain was successfully identified, scored,
  * and aligned in the envelope; if so, the per-domain information is
  * registered in <ddef>, in <ddef->dcl>.
@@ -825,6 +1185,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   int            status;
   int            max_env_extra = 20;
   int            orig_L;
+  int            do_ali        = (! ddef->defer_ali || long_target); /* long targets need the alignment to trim the envelope */
 
 
   if (long_target) {
@@ -840,20 +1201,15 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     reparameterize_model (bg, om, sq, i, j-i+1, fwd_emissions_arr, bg_tmp->f, scores_arr);
   }
 
-  p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &envsc);
-  p7_Backward(sq->dsq + i-1, Ld, om, ox1, ox2, NULL);
-
-  status = p7_Decoding(om, ox1, ox2, ox2);      /* <ox2> is now overwritten with post probabilities     */
+  /* Find an optimal accuracy alignment; <tr>'s seq coords are offset by i-1, rel to orig dsq */
+  status = envelope_decode(ddef, om, sq->dsq + i-1, Ld, ox1, ox2, do_ali, &envsc, &oasc);
   if (status == eslERANGE) { /* rare: numeric overflow; domain is assumed to be repetitive garbage [J3/119-121] */
     if (long_target && scores_arr) 
       reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
     status = eslFAIL;
     goto ERROR;
   }
-
-  /* Find an optimal accuracy alignment */
-  p7_OptimalAccuracy(om, ox2, ox1, &oasc);      /* <ox1> is now overwritten with OA scores              */
-  p7_OATrace        (om, ox2, ox1, ddef->tr);   /* <tr>'s seq coords are offset by i-1, rel to orig dsq */
+  else if (status != eslOK) goto ERROR;
 
   /* hack the trace's sq coords to be correct w.r.t. original dsq */
   for (z = 0; z < ddef->tr->N; z++)
@@ -865,7 +1221,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     ddef->nalloc *= 2;
   }
   dom = &(ddef->dcl[ddef->ndom]);
-  dom->ad             = p7_alidisplay_Create(ddef->tr, 0, om, sq, ntsq);
+  dom->ad             = (do_ali ? p7_alidisplay_CreateInArena(ddef->arena, ddef->tr, 0, om, sq, ntsq) : NULL);
   dom->scores_per_pos = NULL;
 
 
@@ -895,20 +1251,15 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
         reparameterize_model (bg, om, sq, i, Ld, fwd_emissions_arr, bg_tmp->f, scores_arr);
       }
 
-      p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &envsc);
-      p7_Backward(sq->dsq + i-1, Ld, om, ox1, ox2, NULL);
-
-      status = p7_Decoding(om, ox1, ox2, ox2);      /* <ox2> is now overwritten with post probabilities     */
+      /* Find an optimal accuracy alignment; <tr>'s seq coords are offset by i-1, rel to orig dsq */
+      p7_trace_Reuse(ddef->tr);
+      status = envelope_decode(ddef, om, sq->dsq + i-1, Ld, ox1, ox2, TRUE, &envsc, &oasc);
       if (status == eslERANGE) { /* rare: numeric overflow; domain is assumed to be repetitive garbage [J3/119-121] */
           reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
           status = eslFAIL;
           goto ERROR;
       }
-
-      /* Find an optimal accuracy alignment */
-      p7_OptimalAccuracy(om, ox2, ox1, &oasc);      /* <ox1> is now overwritten with OA scores              */
-      p7_trace_Reuse(ddef->tr);
-      p7_OATrace        (om, ox2, ox1, ddef->tr);   /* <tr>'s seq coords are offset by i-1, rel to orig dsq */
+      else if (status != eslOK) goto ERROR;
 
       /* re-hack the trace's sq coords to be correct w.r.t. original dsq */
        for (z = 0; z < ddef->tr->N; z++)
@@ -916,7 +1267,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
 
        /* store the results in it, first destroying the old alidisplay object */
        p7_alidisplay_Destroy(dom->ad);
-       dom->ad            = p7_alidisplay_Create(ddef->tr, 0, om, sq, NULL);
+       dom->ad            = p7_alidisplay_CreateInArena(ddef->arena, ddef->tr, 0, om, sq, NULL);
     }
 
     /* Estimate bias correction, by computing what the score would've been without
@@ -926,7 +1277,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     if (scores_arr!=NULL) { //revert bg and om back to original,
                             //and while I'm at it, capture what the default parameterized score would have been, for "null2"
       reparameterize_model (bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr);
-      p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &domcorrection);
+      envelope_forward(ddef, om, sq->dsq + i-1, Ld, ox1, &domcorrection);
     }
 
     p7_oprofile_ReconfigRestLength(om, orig_L);
@@ -946,7 +1297,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
      * do it now, by the expectation (posterior decoding) method.
      */
       if (!null2_is_done) {
-        p7_Null2_ByExpectation(om, ox2, null2);
+        envelope_null2(ddef, om, Ld, ox2, null2);
         for (pos = i; pos <= j; pos++)
           ddef->n2sc[pos]  = logf(null2[sq->dsq[pos]]);
       }
@@ -958,8 +1309,8 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   }
 
 
-  dom->iali          = dom->ad->sqfrom;
-  dom->jali          = dom->ad->sqto;
+  dom->iali          = (do_ali ? dom->ad->sqfrom : i); /* with <defer_ali>, envelope coords until p7_domaindef_Align() */
+  dom->jali          = (do_ali ? dom->ad->sqto   : j);
   dom->ienv          = i;
   dom->jenv          = j;
   dom->envsc         = envsc;         /* in units of NATS */
@@ -980,7 +1331,436 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   p7_trace_Reuse(ddef->tr);
   return status;
 }
-  
+
+
+
+/* envelope_chk()
+ *
+ * Which matrices envelope rescoring of an <M> by <L> problem uses.
+ * Returns NULL for the usual full matrices. Otherwise returns the
+ * address of the matrix set to use, which may not have been created
+ * yet: <ddef->ock>, checkpointed, if <ddef->ramlimit> is set and the
+ * two full matrices would be larger than that; or <ddef->ock16>,
+ * which keeps Forward and Backward in bfloat16, if <ddef->do_bf16> is
+ * set and those (about half the size) fit. Only the SSE
+ * implementation has these.
+ */
+#if defined (eslENABLE_SSE)
+static P7_OMXCHK **
+envelope_chk(P7_DOMAINDEF *ddef, int M, int L)
+{
+  int64_t full = (int64_t) p7_omx_SizeofFull(M, L);
+
+  if (ddef->ramlimit > 0 && 2 * full > ddef->ramlimit)
+    return ((ddef->do_bf16 && full <= ddef->ramlimit) ? &(ddef->ock16) : &(ddef->ock));
+  if (ddef->do_bf16) return &(ddef->ock16);
+  return NULL;
+}
+
+
+/* envelope_chk_layout()
+ *
+ * Create the matrix set <*pock> that <envelope_chk()> chose, or lay
+ * it out anew, for an <M> by <L> problem.
+ */
+static int
+envelope_chk_layout(P7_DOMAINDEF *ddef, P7_OMXCHK **pock, int M, int L)
+{
+  if (*pock != NULL) return p7_omxchk_GrowTo(*pock, M, L);
+
+  *pock = (pock == &(ddef->ock16) ? p7_omxchk_CreateBF16(M, L) : p7_omxchk_Create(M, L));
+  return (*pock == NULL ? eslEMEM : eslOK);
+}
+#endif
+
+
+/* envelope_decode()
+ *
+ * Forward, Backward, posterior decoding, and optimal accuracy
+ * alignment of the envelope <dsq+1..dsq+Ld> (an offset into the target
+ * sequence). The OA trace is left in <ddef->tr>, which must be
+ * empty, with coords relative to the envelope; the envelope's
+ * Forward score and the OA score are returned in <*ret_envsc> and
+ * <*ret_oasc>. If <do_ali> is FALSE, stop after posterior decoding:
+ * no trace, and <*ret_oasc> is 0.
+ *
+ * Normally this uses full matrices <ox1> and <ox2>, reallocated as
+ * needed. If <envelope_chk()> says so, it uses the checkpointed
+ * matrices in <ddef->ock> instead, with identical results, or the
+ * bfloat16 ones in <ddef->ock16>, with the same scores and
+ * posteriors rounded to bfloat16 precision. Afterwards,
+ * <envelope_null2()> can use the posterior decoding either way.
+ *
+ * Returns <eslOK> on success; <eslERANGE> on numeric overflow in
+ * posterior decoding. Throws <eslEMEM> on allocation failure.
+ */
+static int
+envelope_decode(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2, int do_ali, float *ret_envsc, float *ret_oasc)
+{
+  int status;
+
+  ddef->post_ox = NULL;		/* whatever was decoded before is about to be overwritten */
+
+#if defined (eslENABLE_SSE)
+  P7_OMXCHK **pock = envelope_chk(ddef, om->M, Ld);
+
+  if (pock != NULL)
+    {
+      if ((status = envelope_chk_layout(ddef, pock, om->M, Ld)) != eslOK) return status;
+      if (pock == &(ddef->ock)) ddef->nchk++;
+
+      p7_ForwardCheckpointed (dsq, Ld, om, *pock, ret_envsc);
+      p7_BackwardCheckpointed(dsq, Ld, om, *pock, NULL);
+      if (p7_DecodingCheckpointed(om, *pock) == eslERANGE) return eslERANGE;
+      if (! do_ali) { *ret_oasc = 0.0; return eslOK; }
+      p7_OptimalAccuracyCheckpointed(dsq, om, *pock, ret_oasc);
+      if ((status = p7_trace_GrowTo(ddef->tr, p7_DOMAINDEF_TRACELEN(Ld, om->M))) != eslOK) return status;
+      return p7_OATraceCheckpointed (dsq, om, *pock, ddef->tr);
+    }
+#endif
+
+  if ((status = p7_omx_GrowTo(ox1, om->M, Ld, Ld)) != eslOK) return status;
+  if ((status = p7_omx_GrowTo(ox2, om->M, Ld, Ld)) != eslOK) return status;
+
+  p7_Forward (dsq, Ld, om,      ox1, ret_envsc);
+  p7_Backward(dsq, Ld, om, ox1, ox2, NULL);
+  if (p7_Decoding(om, ox1, ox2, ox2) == eslERANGE) return eslERANGE;  /* <ox2> is now overwritten with post probabilities */
+  if (! do_ali) 
+    { /* p7_domaindef_Align() may be able to use these posteriors, if nothing overwrites them first */
+      ddef->post_ox  = ox2;
+      ddef->post_dsq = dsq;
+      ddef->post_Ld  = Ld;
+      *ret_oasc      = 0.0; 
+      return eslOK; 
+    }
+  return envelope_align(ddef, om, Ld, ox1, ox2, ret_oasc);
+}
+
+
+/* envelope_align()
+ *
+ * The optimal accuracy alignment of an envelope of length <Ld>, in
+ * <ddef->tr>, and its OA score in <*ret_oasc>, from the posterior
+ * decoding of it in full matrix <ox2>; <ox1> is overwritten with OA
+ * scores. Null2 by
+ * expectation reuses row 0 of <ox2>, which OA doesn't look at, so
+ * <envelope_null2()> may have been called in between.
+ */
+static int
+envelope_align(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, int Ld, P7_OMX *ox1, P7_OMX *ox2, float *ret_oasc)
+{
+  int status;
+
+  p7_OptimalAccuracy(om, ox2, ox1, ret_oasc);                         /* <ox1> is now overwritten with OA scores         */
+  if ((status = p7_trace_GrowTo(ddef->tr, p7_DOMAINDEF_TRACELEN(Ld, om->M))) != eslOK) return status;
+  return p7_OATrace (om, ox2, ox1, ddef->tr);
+}
+
+
+/* envelope_forward()
+ *
+ * Forward score of the envelope <dsq+1..dsq+Ld>, in <*ret_sc>, using
+ * <ox1>, <ddef->ock> or <ddef->ock16> by the same rule as
+ * <envelope_decode()>.
+ */
+static int
+envelope_forward(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, float *ret_sc)
+{
+  int status;
+
+  ddef->post_ox = NULL;
+
+#if defined (eslENABLE_SSE)
+  P7_OMXCHK **pock = envelope_chk(ddef, om->M, Ld);
+
+  if (pock != NULL)
+    {
+      if ((status = envelope_chk_layout(ddef, pock, om->M, Ld)) != eslOK) return status;
+      return p7_ForwardCheckpointed(dsq, Ld, om, *pock, ret_sc);
+    }
+#endif
+
+  if ((status = p7_omx_GrowTo(ox1, om->M, Ld, Ld)) != eslOK) return status;
+  return p7_Forward(dsq, Ld, om, ox1, ret_sc);
+}
+
+
+/* envelope_null2()
+ *
+ * Null2 odds ratios by expectation, from the posterior decoding that
+ * <envelope_decode()> just did on an envelope of length <Ld>, which
+ * is in <ox2>, <ddef->ock> or <ddef->ock16>.
+ */
+static int
+envelope_null2(P7_DOMAINDEF *ddef, const P7_OPROFILE *om, int Ld, P7_OMX *ox2, float *null2)
+{
+#if defined (eslENABLE_SSE)
+  P7_OMXCHK **pock = envelope_chk(ddef, om->M, Ld);
+
+  if (pock != NULL)
+    return p7_Null2_ByExpectationCheckpointed(om, *pock, null2);
+#endif
+  return p7_Null2_ByExpectation(om, ox2, null2);
+}
+
+#ifdef HMMER_THREADS
+/* domaindef_threaded()
+ *
+ * Regions in one target are independent of each other: each reads
+ * the shared posterior arrays, writes only its own stretch of
+ * n2sc[i..j], and (with reseeding) starts its stochastic tracebacks
+ * from the same RNG state. So on a long target with many regions, we
+ * hand the regions out to <ddef->nthreads> workers, each with private
+ * domaindef scratch space, RNG, profile clone, and DP matrices, and
+ * then gather the domains back into <ddef> in region order. The
+ * result is the same as the serial loop's. The workers' scratch space
+ * (traces, sampling ensemble, posterior arrays) and matrices are kept
+ * in <ddef> for the next target, instead of being allocated and grown
+ * again for each one.
+ *
+ * The caller's thread is worker 0, using <om>, <fwd>, and <bck>
+ * directly. <om> is in unihit mode with length model <saveL>. Only
+ * used by the protein pipeline: the <long_target> path modifies
+ * <om> and <bg> in place.
+ *
+ * Returns <eslOK> on success; <ddef> holds the domains, null2 scores,
+ * and counters as if the regions were processed serially.
+ * <eslEOD> if the target isn't worth threading (fewer than two
+ * regions, or too few residues in them); <ddef> is unchanged, and
+ * caller does it serially.
+ *
+ * Throws <eslEMEM> on allocation failure, <eslESYS> if the pool
+ * mutex can't be created.
+ */
+#define DOMDEF_THREAD_MINRES 2000   /* only thread if regions total at least this many residues */
+
+typedef struct {
+  int i, j;        /* region bounds in the target                  */
+  int is_multi;    /* TRUE to resolve by stochastic clustering     */
+  int w;           /* worker that processed the region             */
+  int d0, nd;      /* its domains are that worker's dcl[d0..d0+nd-1] */
+} DOMDEF_REGION;
+
+typedef struct {
+  const ESL_SQ   *sq;
+  const ESL_SQ   *ntsq;
+  P7_BG          *bg;
+  int             saveL;
+  DOMDEF_REGION  *reg;
+  int             nreg;
+  int             next;      /* next region to hand out; protected by <mutex> */
+  pthread_mutex_t mutex;
+} DOMDEF_POOL;
+
+typedef struct {
+  DOMDEF_POOL    *pool;
+  int             w;
+  P7_DOMAINDEF   *ddef;      /* private scratch space and results */
+  ESL_RANDOMNESS *r;
+  P7_OPROFILE    *om;
+  P7_OMX         *fwd;
+  P7_OMX         *bck;
+  pthread_t       thread;
+} DOMDEF_WORKER;
+
+/* domdef_workers()
+ * Make sure <ddef> keeps scratch space for at least <nw> region
+ * workers, and Forward/Backward matrices for workers 1..nw-1, sized
+ * for a model of length <M> to start with. Returns <eslOK>; throws
+ * <eslEMEM> on allocation failure, leaving whatever was made in <ddef>
+ * for p7_domaindef_Destroy().
+ */
+static int
+domdef_workers(P7_DOMAINDEF *ddef, int M, int nw)
+{
+  void *p;
+  int   w;
+  int   status;
+
+  if (nw <= ddef->nwdef) return eslOK;
+
+  ESL_RALLOC(ddef->wdef, p, sizeof(P7_DOMAINDEF *) * nw);
+  ESL_RALLOC(ddef->wox,  p, sizeof(P7_OMX *)       * 2 * nw);
+  for (w = ddef->nwdef; w < nw; w++)
+    {
+      ddef->wox[2*w] = ddef->wox[2*w+1] = NULL;
+      if ((ddef->wdef[w] = p7_domaindef_Create(NULL)) == NULL) { status = eslEMEM; goto ERROR; }
+      ddef->nwdef = w+1;
+      if (w == 0) continue;
+      if ((ddef->wox[2*w]   = p7_omx_Create(M, 0, 0)) == NULL) { status = eslEMEM; goto ERROR; }
+      if ((ddef->wox[2*w+1] = p7_omx_Create(M, 0, 0)) == NULL) { status = eslEMEM; goto ERROR; }
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+static void *
+domdef_worker(void *arg)
+{
+  DOMDEF_WORKER *wk   = (DOMDEF_WORKER *) arg;
+  DOMDEF_POOL   *pool = wk->pool;
+  DOMDEF_REGION *rg;
+  int            r;
+
+  for (;;)
+    {
+      pthread_mutex_lock(&pool->mutex);
+      r = pool->next++;
+      pthread_mutex_unlock(&pool->mutex);
+      if (r >= pool->nreg) break;
+
+      rg = &(pool->reg[r]);
+
+      rg->w  = wk->w;
+      rg->d0 = wk->ddef->ndom;
+      region_domains(wk->ddef, wk->om, pool->sq, pool->ntsq, wk->fwd, wk->bck, rg->i, rg->j, rg->is_multi, pool->saveL, pool->bg, FALSE, NULL, NULL, NULL);
+      rg->nd = wk->ddef->ndom - rg->d0;
+    }
+  return NULL;
+}
+
+static int
+domaindef_threaded(P7_DOMAINDEF *ddef, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPROFILE *om, P7_OMX *fwd, P7_OMX *bck, P7_BG *bg, int saveL)
+{
+  DOMDEF_POOL    pool;
+  DOMDEF_WORKER *wk         = NULL;
+  DOMDEF_REGION *rg;
+  P7_DOMAINDEF  *wd;
+  int            ralloc     = 16;
+  int            have_mutex = FALSE;
+  int            nres       = 0;
+  int            nw         = 0;    /* number of workers set up         */
+  int            nthr       = 1;    /* number of workers running; 0 is us */
+  int            ndom       = 0;
+  int            i, j, r, w;
+  int            status;
+
+  pool.sq    = sq;
+  pool.ntsq  = ntsq;
+  pool.bg    = bg;
+  pool.saveL = saveL;
+  pool.reg   = NULL;
+  pool.nreg  = 0;
+  pool.next  = 0;
+
+  ESL_ALLOC(pool.reg, sizeof(DOMDEF_REGION) * ralloc);
+  i = j = 0;
+  while (next_region(ddef, sq->n, &i, &j))
+    {
+      if (pool.nreg == ralloc) {
+	ESL_REALLOC(pool.reg, sizeof(DOMDEF_REGION) * ralloc * 2);
+	ralloc *= 2;
+      }
+      rg = &(pool.reg[pool.nreg++]);
+      rg->i        = i;
+      rg->j        = j;
+      rg->is_multi = is_multidomain_region(ddef, i, j);
+      rg->w        = 0;
+      rg->d0       = rg->nd = 0;
+      nres        += j-i+1;
+    }
+  if (pool.nreg < 2 || nres < DOMDEF_THREAD_MINRES) { status = eslEOD; goto ERROR; }
+
+  if (pthread_mutex_init(&pool.mutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+  have_mutex = TRUE;
+
+  nw = ESL_MIN(ddef->nthreads, pool.nreg);
+  if ((status = domdef_workers(ddef, om->M, nw)) != eslOK) goto ERROR;
+  ESL_ALLOC(wk, sizeof(DOMDEF_WORKER) * nw);
+  for (w = 0; w < nw; w++) { wk[w].ddef = NULL; wk[w].r = NULL; wk[w].om = NULL; wk[w].fwd = wk[w].bck = NULL; }
+
+  for (w = 0; w < nw; w++)
+    {
+      wk[w].pool = &pool;
+      wk[w].w    = w;
+      /* same RNG type and seed as <ddef->r>, which region_trace_ensemble() resets for each region */
+      if (ddef->r->type == eslRND_FAST) wk[w].r = esl_randomness_CreateFast(esl_randomness_GetSeed(ddef->r));
+      else                              wk[w].r = esl_randomness_Create    (esl_randomness_GetSeed(ddef->r));
+      if (wk[w].r == NULL) { status = eslEMEM; goto ERROR; }
+
+      wk[w].ddef = ddef->wdef[w];
+      if ((status = p7_domaindef_GrowTo(wk[w].ddef, sq->n)) != eslOK) goto ERROR;
+      wd                = wk[w].ddef;
+      wd->r             = wk[w].r;
+      wd->do_reseeding  = ddef->do_reseeding;
+      wd->rt1           = ddef->rt1;
+      wd->rt2           = ddef->rt2;
+      wd->rt3           = ddef->rt3;
+      wd->nsamples      = ddef->nsamples;
+      wd->nbatch        = ddef->nbatch;
+      wd->min_overlap   = ddef->min_overlap;
+      wd->of_smaller    = ddef->of_smaller;
+      wd->max_diagdiff  = ddef->max_diagdiff;
+      wd->min_posterior = ddef->min_posterior;
+      wd->min_endpointp = ddef->min_endpointp;
+      wd->ramlimit      = ddef->ramlimit;
+      wd->do_bf16       = ddef->do_bf16;
+      wd->defer_ali     = ddef->defer_ali;
+
+      if (w == 0) { wk[w].om = om; wk[w].fwd = fwd; wk[w].bck = bck; continue; }
+      if ((wk[w].om  = p7_oprofile_Clone(om))         == NULL) { status = eslEMEM; goto ERROR; }
+      wk[w].fwd = ddef->wox[2*w];
+      wk[w].bck = ddef->wox[2*w+1];
+    }
+
+  /* If a thread can't be started, the workers we do have take up its share. */
+  for (nthr = 1; nthr < nw; nthr++)
+    if (pthread_create(&(wk[nthr].thread), NULL, domdef_worker, &(wk[nthr])) != 0) break;
+  domdef_worker(&(wk[0]));
+  for (w = 1; w < nthr; w++)
+    pthread_join(wk[w].thread, NULL);
+
+  /* Gather results in region order. Make room first, so nothing can fail
+   * after the alidisplays start changing hands.
+   */
+  for (r = 0; r < pool.nreg; r++) ndom += pool.reg[r].nd;
+  if (ddef->ndom + ndom > ddef->nalloc)
+    {
+      ESL_REALLOC(ddef->dcl, sizeof(P7_DOMAIN) * (ddef->ndom + ndom));
+      ddef->nalloc = ddef->ndom + ndom;
+    }
+
+  for (r = 0; r < pool.nreg; r++)
+    {
+      rg = &(pool.reg[r]);
+      wd = wk[rg->w].ddef;
+      memcpy(ddef->n2sc + rg->i, wd->n2sc + rg->i, sizeof(float)     * (rg->j - rg->i + 1));
+      memcpy(ddef->dcl  + ddef->ndom, wd->dcl + rg->d0, sizeof(P7_DOMAIN) * rg->nd);
+      ddef->ndom += rg->nd;
+    }
+  ddef->nregions += pool.nreg;
+  for (w = 0; w < nw; w++)
+    {
+      ddef->nclustered += wk[w].ddef->nclustered;
+      ddef->noverlaps  += wk[w].ddef->noverlaps;
+      ddef->nenvelopes += wk[w].ddef->nenvelopes;
+      ddef->nchk       += wk[w].ddef->nchk;
+      wk[w].ddef->ndom  = 0;	/* its alidisplays now belong to <ddef> */
+    }
+  status = eslOK;
+  /* deliberate flowthrough */
+
+ ERROR:
+  for (w = 0; w < nw && wk != NULL; w++)
+    {
+      if (wk[w].ddef)
+	{ /* back to the pool; its counters were summed into <ddef> */
+	  p7_domaindef_Reuse(wk[w].ddef);
+	  wk[w].ddef->nchk = 0;
+	  wk[w].ddef->r    = NULL;
+	}
+      if (wk[w].r) esl_randomness_Destroy(wk[w].r);
+      if (w == 0) continue;
+      if (wk[w].om)  p7_oprofile_Destroy(wk[w].om);
+    }
+  if (have_mutex) pthread_mutex_destroy(&pool.mutex);
+  free(wk);
+  free(pool.reg);
+  return status;
+}
+#endif /*HMMER_THREADS*/  
     
 /*****************************************************************
  * Example driver.
@@ -65,6 +65,7 @@ extern P7_HIT *p7_hit_Create_empty(){
   the_hit->subseq_start = 0;
   the_hit->dcl = NULL;
   the_hit->offset = 0;
+  the_hit->in_arena = FALSE;
 
   return the_hit;
 ERROR:
@@ -168,6 +169,7 @@ extern int p7_hit_Copy(const P7_HIT *src, P7_HIT *dst){
   dst->acc = acc;
   dst->desc = desc;
   dst->dcl = dcl;
+  dst->in_arena = FALSE;
   return eslOK;
     
 ERROR:
@@ -217,6 +219,18 @@ ERROR:
 #define DESC_PRESENT (1 << 1)
 
 extern int p7_hit_Serialize(const P7_HIT *obj, uint8_t **buf, uint32_t *n, uint32_t *nalloc){
+  return p7_hit_SerializeAs(obj, p7_ALI_FULL, buf, n, nalloc);
+}
+
+/* Function:  p7_hit_SerializeAs
+ * Synopsis:  Serializes a P7_HIT, choosing the form of its alignment displays
+ *
+ * Purpose:   As <p7_hit_Serialize()>, but the alignment displays of the
+ *            hit's domains are written in form <form> (see
+ *            <p7_alidisplay_SerializeAs()>). <p7_hit_Deserialize()> reads
+ *            any of the forms.
+ */
+extern int p7_hit_SerializeAs(const P7_HIT *obj, enum p7_aliform_e form, uint8_t **buf, uint32_t *n, uint32_t *nalloc){
 
   int status; // error variable used by ESL_ALLOC
   int name_size, acc_size, desc_size;
@@ -407,7 +421,7 @@ extern int p7_hit_Serialize(const P7_HIT *obj, uint8_t **buf, uint32_t *n, uint3
   *n = ptr - *buf;  // update n to point to end of serialized region
 
   for(i = 0; i < obj->ndom; i++){
-    status = p7_domain_Serialize(&(obj->dcl[i]), buf, n, nalloc);
+    status = p7_domain_SerializeAs(&(obj->dcl[i]), form, buf, n, nalloc);
     if(status != eslOK){
       return status;
     }
@@ -573,6 +587,7 @@ extern int p7_hit_Deserialize(const uint8_t *buf, uint32_t *n, P7_HIT *ret_obj){
   ptr += 1;
 
   //Field 23: name string
+  ret_obj->in_arena = FALSE; // strings are allocated individually here
   string_length = strlen((char *) ptr) +1;
   
   if(ret_obj->name != NULL){
@@ -640,6 +655,134 @@ ERROR:
   return eslEMEM;
 }
 
+/* scan_u32(), scan_u64()
+ * Read a 32- or 64-bit field in network order at <ptr>.
+ */
+static uint32_t
+scan_u32(const uint8_t *ptr)
+{
+  uint32_t network_32bit;
+  memcpy(&network_32bit, ptr, sizeof(uint32_t));
+  return esl_ntoh32(network_32bit);
+}
+
+static uint64_t
+scan_u64(const uint8_t *ptr)
+{
+  uint64_t network_64bit;
+  memcpy(&network_64bit, ptr, sizeof(uint64_t));
+  return esl_ntoh64(network_64bit);
+}
+
+/* Function:  p7_hit_Scan
+ * Synopsis:  Index a serialized P7_HIT without deserializing it
+ *
+ * Purpose:   Look at the serialized P7_HIT that starts at offset <*n>
+ *            of <buf>, whose valid bytes are <buf[0..len-1]>, and fill
+ *            in <ref> with where it is, how long it is with all its
+ *            domains and alignment displays, and the fields that
+ *            ranking (<p7_hitref_Compare()>) and thresholding it take.
+ *            Only the objects' size fields are followed; nothing is
+ *            copied, and <ref->ser> and <ref->name> point into <buf>,
+ *            which must outlive <ref>. <ref->hit> is set to NULL.
+ *
+ *            Advances <*n> past the hit, as <p7_hit_Deserialize()> does.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> if the hit doesn't fit in <len> bytes or
+ *            its sizes are inconsistent; <*n> and <ref> are then
+ *            unchanged.
+ *
+ * Throws:    <eslEINVAL> if <buf>, <n> or <ref> is NULL.
+ */
+extern int p7_hit_Scan(const uint8_t *buf, uint32_t *n, uint32_t len, P7_HITREF *ref){
+
+  const uint8_t *ptr;
+  uint64_t pos, end;
+  uint64_t host_64bit;
+  uint32_t host_32bit;
+  uint32_t obj_size;
+  int      ndom, d;
+  int      nflagged = 0;
+
+  if (buf == NULL || n == NULL || ref == NULL) return eslEINVAL;
+
+  pos = *n;
+  if (pos > len || len - pos < SER_BASE_SIZE + 1) return eslEFORMAT;
+  ptr      = buf + pos;
+  obj_size = scan_u32(ptr);
+  if (obj_size < SER_BASE_SIZE + 1 || obj_size > len - pos) return eslEFORMAT;
+  if (ptr[obj_size-1] != '\0')                              return eslEFORMAT;  // strings must end inside the hit
+
+  // fields at their offsets in the order p7_hit_SerializeAs() writes them
+  host_64bit = scan_u64(ptr + 8);   ref->sortkey = *((double *) &host_64bit);
+  host_32bit = scan_u32(ptr + 16);  ref->score   = *((float *)  &host_32bit);
+  host_64bit = scan_u64(ptr + 28);  ref->lnP     = *((double *) &host_64bit);
+  ndom           = (int) scan_u32(ptr + 72);
+  ref->flags     = scan_u32(ptr + 76);
+  ref->nreported = (int) scan_u32(ptr + 80);
+  ref->nincluded = (int) scan_u32(ptr + 84);
+  ref->name      = (const char *) ptr + SER_BASE_SIZE;
+  ref->iali      = 0;
+  ref->jali      = 0;
+  if (ndom < 0) return eslEFORMAT;
+
+  // each domain is followed by its alignment display; both start with their size
+  end = pos + obj_size;
+  for (d = 0; d < ndom; d++)
+    {
+      if (len - end < 4) return eslEFORMAT;
+      obj_size = scan_u32(buf + end);   // P7_DOMAIN: 92 bytes of fixed fields, then scores_per_pos
+      if (obj_size < 92 || obj_size > len - end) return eslEFORMAT;
+      if (d == 0) {
+        ref->iali = (int64_t) scan_u64(buf + end + 20);
+        ref->jali = (int64_t) scan_u64(buf + end + 28);
+      }
+      if (scan_u32(buf + end + 80) || scan_u32(buf + end + 84)) nflagged++;
+      end += obj_size;
+
+      if (len - end < 4) return eslEFORMAT;
+      obj_size = scan_u32(buf + end);
+      if (obj_size < 4 || obj_size > len - end) return eslEFORMAT;
+      end += obj_size;
+    }
+  if (end - pos > UINT32_MAX) return eslEFORMAT;
+
+  ref->hit         = NULL;
+  ref->ser         = ptr;
+  ref->ser_len     = (uint32_t) (end - pos);
+  ref->ndom        = ndom;
+  ref->ndomflagged = nflagged;
+  *n               = (uint32_t) end;
+  return eslOK;
+}
+
+/* Function:  p7_hitref_Compare
+ * Synopsis:  Rank two scanned hits
+ *
+ * Purpose:   Compare the hits indexed by <r1> and <r2> as
+ *            <p7_tophits_SortBySortkey()> does their P7_HITs: by
+ *            decreasing sort key, then name, then strand (top first)
+ *            and start of the first domain's alignment.
+ *
+ * Returns:   <0 if <r1> ranks first, >0 if <r2> does, 0 if tied.
+ */
+extern int p7_hitref_Compare(const P7_HITREF *r1, const P7_HITREF *r2){
+  int c, dir1, dir2;
+
+  if      (r1->sortkey < r2->sortkey) return  1;
+  else if (r1->sortkey > r2->sortkey) return -1;
+  if ((c = strcmp(r1->name, r2->name)) != 0) return c;
+
+  dir1 = (r1->iali < r1->jali ? 1 : -1);
+  dir2 = (r2->iali < r2->jali ? 1 : -1);
+  if (dir1 != dir2)            return dir2;
+  if (r1->iali > r2->iali)     return  1;
+  if (r1->iali < r2->iali)     return -1;
+  return 0;
+}
+
 /*****************************************************************
  * 2. Debugging Functions
  *****************************************************************/      
@@ -1107,6 +1250,46 @@ static void utest_Serialize(int ntrials){
     esl_fatal(msg);
 
 }
+
+/* utest_Scan()
+ * p7_hit_Scan() finds each of a run of serialized hits where
+ * p7_hit_Deserialize() does, reads the same key fields, and refuses
+ * a truncated hit.
+ */
+static void utest_Scan(int ntrials){
+  ESL_RAND64 *rng    = esl_rand64_Create(0);
+  P7_HIT     *hit    = NULL;
+  P7_HITREF   ref;
+  uint8_t    *buf    = NULL;
+  uint32_t    n      = 0;
+  uint32_t    nalloc = 0;
+  uint32_t    start;
+  char        msg[]  = "utest_Scan failed";
+  int         i, d, nflagged;
+
+  for(i = 0; i < ntrials; i++){
+    if(p7_hit_TestSample(rng, &hit) != eslOK) esl_fatal(msg);
+    start = n;
+    if(p7_hit_SerializeAs(hit, (i % 2) ? p7_ALI_COMPACT : p7_ALI_FULL, &buf, &n, &nalloc) != eslOK) esl_fatal(msg);
+
+    if(p7_hit_Scan(buf, &start, n-1, &ref) != eslEFORMAT) esl_fatal(msg);   // one byte short
+    if(p7_hit_Scan(buf, &start, n,   &ref) != eslOK)      esl_fatal(msg);
+    if(start != n || ref.ser_len != n - (ref.ser - buf))  esl_fatal(msg);
+    if(ref.hit != NULL || strcmp(ref.name, hit->name) != 0) esl_fatal(msg);
+    if(ref.sortkey != hit->sortkey || ref.score != hit->score || ref.lnP != hit->lnP) esl_fatal(msg);
+    if(ref.flags != hit->flags || ref.ndom != hit->ndom)  esl_fatal(msg);
+    if(ref.nreported != hit->nreported || ref.nincluded != hit->nincluded) esl_fatal(msg);
+    if(hit->ndom > 0 && (ref.iali != hit->dcl[0].iali || ref.jali != hit->dcl[0].jali)) esl_fatal(msg);
+    for(nflagged = 0, d = 0; d < hit->ndom; d++)
+      if(hit->dcl[d].is_reported || hit->dcl[d].is_included) nflagged++;
+    if(ref.ndomflagged != nflagged) esl_fatal(msg);
+
+    p7_hit_Destroy(hit);
+    hit = NULL;
+  }
+  free(buf);
+  esl_rand64_Destroy(rng);
+}
 #endif
 
 /*****************************************************************
@@ -1121,6 +1304,7 @@ main(int argc, char **argv)
   utest_Serialize_error_conditions();
   utest_Deserialize_error_conditions();
   utest_Serialize(100);
+  utest_Scan(100);
   return eslOK; // If we get here, test passed
 }
 
@@ -15,6 +15,10 @@
 #include "hmmer.h"
 #include "p7_hmmcache.h"
 
+static int hmmcache_open(char *hmmfile, int lazy, uint32_t maxrest, uint32_t shard, uint32_t nshards, P7_HMMCACHE **ret_cache, char *errbuf);
+static int hmmcache_index(const P7_HMMCACHE *cache, const P7_OPROFILE *om);
+static int stamp_sorter(const void *vp1, const void *vp2);
+
 /*****************************************************************
  * 1. P7_HMMCACHE: a daemon's cached profile database
  *****************************************************************/ 
@@ -50,47 +54,194 @@
 int
 p7_hmmcache_Open(char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf)
 {
-  P7_HMMCACHE *cache    = NULL;
-  P7_HMMFILE  *hfp      = NULL;        /* open HMM database file    */
-  P7_OPROFILE *om       = NULL;        /* target profile            */
-  int          status;
-  
-  ESL_ALLOC(cache, sizeof(P7_HMMCACHE));
-  cache->name      = NULL;
-  cache->abc       = NULL;
-  cache->list      = NULL;
-  cache->lalloc    = 4096;	/* allocation chunk size for <list> of ptrs  */
-  cache->n         = 0;
+  return hmmcache_open(hmmfile, FALSE, 0, 0, 1, ret_cache, errbuf);
+}
 
-  if ( ( status = esl_strdup(hmmfile, -1, &cache->name) != eslOK)) goto ERROR; 
-  ESL_ALLOC(cache->list, sizeof(P7_OPROFILE *) * cache->lalloc);
 
-  if ( (status = p7_hmmfile_Open(hmmfile, NULL, &hfp, errbuf)) != eslOK) goto ERROR;  // eslENOTFOUND | eslEFORMAT 
+/* Function:  p7_hmmcache_OpenLazy()
+ * Synopsis:  Cache the MSV parts of a profile database.
+ *
+ * Purpose:   As <p7_hmmcache_Open()>, but hold only the MSV filter
+ *            part of each profile. In a scan, most profiles fail the
+ *            MSV filter for most queries, so most never need the
+ *            rest: the Viterbi filter and Forward/Backward score
+ *            vectors, and the annotation. A pipeline that is given
+ *            the cache in <pli->hcache> calls
+ *            <p7_hmmcache_GetRest()> to read the rest of a profile
+ *            when it passes the MSV filter. Between searches,
+ *            <p7_hmmcache_Trim()> frees the rest of all but the
+ *            <maxrest> most recently needed profiles again.
+ *
+ *            The score vectors of a profile read from a mapped
+ *            <.h3p> file stay in the mapping, where the page cache
+ *            already keeps only recently used ones; what the cache
+ *            then saves is each profile's vectors that
+ *            <p7_oprofile_Create()> allocates, as well as the AVX-512
+ *            copies.
+ *
+ *            Only the SSE implementation can free the rest of a
+ *            profile; elsewhere, this is <p7_hmmcache_Open()>.
+ *
+ * Args:      hmmfile   - (base) name of profile file to open
+ *            maxrest   - keep up to this many complete profiles past a Trim()
+ *            ret_cache - RETURN: cached profile database
+ *            errbuf    - optRETURN: error message for a failure
+ *
+ * Returns:   as <p7_hmmcache_Open()>.
+ *
+ * Throws:    <eslEMEM> : memory allocation error.
+ */
+int
+p7_hmmcache_OpenLazy(char *hmmfile, uint32_t maxrest, P7_HMMCACHE **ret_cache, char *errbuf)
+{
+#if defined (eslENABLE_SSE)
+  return hmmcache_open(hmmfile, TRUE,  maxrest, 0, 1, ret_cache, errbuf);
+#else
+  return hmmcache_open(hmmfile, FALSE, 0,       0, 1, ret_cache, errbuf);
+#endif
+}
 
-  while ((status = p7_oprofile_ReadMSV(hfp, &(cache->abc), &om)) == eslOK) /* eslEFORMAT | eslEINCOMPAT */
+
+/* Function:  p7_hmmcache_OpenShard()
+ * Synopsis:  Cache one shard of a profile database.
+ *
+ * Purpose:   As <p7_hmmcache_Open()>, but keep only shard <shard> of
+ *            <nshards> shards: the profiles of <hmmfile> numbered
+ *            <shard>, <shard>+<nshards>, <shard>+2*<nshards>, ... from
+ *            0, dealt out round robin as the sequence database shards
+ *            of hmmpgmd_shard are. The other profiles are read past
+ *            without reading their score vectors. Shard <shard> holds
+ *            <(N + nshards - 1 - shard) / nshards> of the file's <N>
+ *            profiles, and <p7_hmmcache_SetNumericNames()> names them
+ *            by their place in the whole file.
+ *
+ * Args:      hmmfile   - (base) name of profile file to open
+ *            shard     - shard to keep, 0..nshards-1
+ *            nshards   - number of shards the file is dealt into
+ *            ret_cache - RETURN: cached profile database shard
+ *            errbuf    - optRETURN: error message for a failure
+ *
+ * Returns:   as <p7_hmmcache_Open()>.
+ *
+ * Throws:    <eslEMEM> : memory allocation error.
+ *            <eslEINVAL>: <shard> isn't less than <nshards>.
+ */
+int
+p7_hmmcache_OpenShard(char *hmmfile, uint32_t shard, uint32_t nshards, P7_HMMCACHE **ret_cache, char *errbuf)
+{
+  if (shard >= nshards) ESL_EXCEPTION(eslEINVAL, "shard %u of %u", shard, nshards);
+  return hmmcache_open(hmmfile, FALSE, 0, shard, nshards, ret_cache, errbuf);
+}
+
+
+/* Function:  p7_hmmcache_GetRest()
+ * Synopsis:  Make a profile in a lazy cache complete.
+ *
+ * Purpose:   Make sure that <om>, one of the profiles in lazy cache
+ *            <cache>, has the rest of its profile read, and mark it
+ *            as needed by the current search. Thread-safe: threads
+ *            of concurrent searches may call this on the same <om>.
+ *
+ *            On a cache that isn't lazy, do nothing.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEFORMAT> if the rest of <om> couldn't be read, and
+ *            <eslENOTFOUND> if <om> isn't in <cache>; <errbuf>, if
+ *            non-<NULL>, has an error message.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslESYS> if the
+ *            mutex fails.
+ */
+int
+p7_hmmcache_GetRest(P7_HMMCACHE *cache, P7_OPROFILE *om, char *errbuf)
+{
+  char *name;
+  int   i;
+  int   status = eslOK;
+
+  if (! cache->lazy) return eslOK;
+  if ((i = hmmcache_index(cache, om)) < 0) ESL_FAIL(eslENOTFOUND, errbuf, "profile %s is not in cache %s", om->name, cache->name);
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_lock(&cache->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+#endif
+  if (cache->used[i] == 0)
     {
-      if (( status = p7_oprofile_ReadRest(hfp, om)) != eslOK)
-        { strncpy(errbuf, hfp->rr_errbuf, eslERRBUFSIZE); goto ERROR; }
+      /* the .h3p record is checked against the profile's name in the file */
+      name = om->name;
+      if (cache->fname) om->name = cache->fname[i];
+      status   = p7_oprofile_ReadRest(cache->hfp, om);
+      om->name = name;
+      if (status != eslOK) 
+	{
+	  p7_oprofile_FreeRest(om);
+	  if (errbuf) strncpy(errbuf, cache->hfp->rr_errbuf, eslERRBUFSIZE);
+	}
+    }
+  if (status == eslOK) cache->used[i] = cache->stamp;
+#ifdef HMMER_THREADS
+  if (pthread_mutex_unlock(&cache->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex unlock failed");
+#endif
+  return status;
+}
 
-      if (cache->n >= cache->lalloc) {
-	ESL_REALLOC(cache->list, sizeof(char *) * cache->lalloc * 2);
-	cache->lalloc *= 2;
-      }
-      
-      cache->list[cache->n++] = om;
-      om = NULL;
+
+/* Function:  p7_hmmcache_Trim()
+ * Synopsis:  Free the rest of profiles a lazy cache didn't need lately.
+ *
+ * Purpose:   If more than <cache->maxrest> profiles in lazy cache
+ *            <cache> are complete, free the rest of the least
+ *            recently needed ones, down to <maxrest>; then start a
+ *            new stamp, so profiles needed from now on count as more
+ *            recent than any before. On a cache that isn't lazy, do
+ *            nothing.
+ *
+ *            The caller must make sure no search is using <cache>:
+ *            call this between searches.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; then nothing is freed.
+ */
+int
+p7_hmmcache_Trim(P7_HMMCACHE *cache)
+{
+  uint32_t *stamps = NULL;	/* stamps of the complete profiles, newest first */
+  uint32_t  nrest  = 0;
+  uint32_t  cut;		/* free the profiles last needed before this stamp, */
+  uint32_t  nkeep  = 0;		/*   and all but <nkeep> of those needed at it      */
+  uint32_t  i;
+  int       status;
+
+  if (! cache->lazy) return eslOK;
+
+  ESL_ALLOC(stamps, sizeof(uint32_t) * ESL_MAX(1, cache->n));
+  for (i = 0; i < cache->n; i++)
+    if (cache->used[i]) stamps[nrest++] = cache->used[i];
+
+  if (nrest > cache->maxrest)
+    {
+      qsort(stamps, nrest, sizeof(uint32_t), stamp_sorter);
+      cut = stamps[cache->maxrest];
+      for (i = 0; i < cache->maxrest; i++)
+	if (stamps[i] == cut) nkeep++;
+
+      for (i = 0; i < cache->n; i++)
+	{
+	  if (cache->used[i] == 0 || cache->used[i] > cut) continue;
+	  if (cache->used[i] == cut && nkeep > 0)  { nkeep--; continue; }
+	  p7_oprofile_FreeRest(cache->list[i]);
+	  cache->used[i] = 0;
+	}
     }
-  if (status != eslEOF)  { strncpy(errbuf, hfp->errbuf, eslERRBUFSIZE); goto ERROR; }
 
-  //printf("\nfinal:: %d  memory %" PRId64 "\n", inx, total_mem);
-  p7_hmmfile_Close(hfp);
-  *ret_cache = cache;
+  cache->stamp++;
+  free(stamps);
   return eslOK;
 
  ERROR:
-  if (cache) p7_hmmcache_Close(cache);
-  if (om)    p7_oprofile_Destroy(om);
-  if (hfp)   p7_hmmfile_Close(hfp);
+  if (stamps) free(stamps);
   return status;
 }
 
@@ -107,6 +258,12 @@ p7_hmmcache_Sizeof(P7_HMMCACHE *cache)
   n += sizeof(char) * (strlen(cache->name) + 1);
   n += esl_alphabet_Sizeof(cache->abc);
   n += sizeof(P7_OPROFILE *) * cache->lalloc;     /* cache->list */
+  if (cache->used) n += sizeof(uint32_t) * cache->n;
+  if (cache->fname)
+    {
+      n += sizeof(char *) * cache->n;
+      for (i = 0; i < cache->n; i++) n += strlen(cache->fname[i]) + 1;
+    }
 
   for (i = 0; i < cache->n; i++)
     n += p7_oprofile_Sizeof(cache->list[i]);
@@ -124,6 +281,9 @@ p7_hmmcache_Sizeof(P7_HMMCACHE *cache)
  *            The code is nine digits long, left padded with
  *            0's.
  *
+ *            A lazy cache keeps the profiles' names in the file,
+ *            which <p7_hmmcache_GetRest()> still needs.
+ *
  * Returns:   <eslOK> on success.
  *
  * Throws:    <eslEMEM> on allocation failure.
@@ -133,16 +293,25 @@ p7_hmmcache_SetNumericNames(P7_HMMCACHE *cache)
 {
   int          namelen = 9;	/* 9 digit numeric code: 000000001, 000000002... */
   P7_OPROFILE *om;
-  int          i;
+  uint32_t     i;
   int          status;
 
+  if (cache->lazy && cache->fname == NULL)
+    {
+      ESL_ALLOC(cache->fname, sizeof(char *) * ESL_MAX(1, cache->n));
+      for (i = 0; i < cache->n; i++) { cache->fname[i] = cache->list[i]->name; cache->list[i]->name = NULL; }
+    }
+
   for (i = 0; i < cache->n; i++)
     {
       om = cache->list[i];
       if (om->name) free(om->name);
-      if (( status = esl_sprintf(&(om->name), "%0*d", namelen, i+1)) != eslOK) return status;
+      if (( status = esl_sprintf(&(om->name), "%0*d", namelen, i * cache->nshards + cache->shard + 1)) != eslOK) return status;
     }
   return eslOK;
+
+ ERROR:
+  return status;
 }
 
 
@@ -152,10 +321,19 @@ p7_hmmcache_SetNumericNames(P7_HMMCACHE *cache)
 void
 p7_hmmcache_Close(P7_HMMCACHE *cache)
 {
-  int i;
+  uint32_t i;
 
   if (! cache) return;
   if (cache->name) free(cache->name);
+  if (cache->used) free(cache->used);
+  if (cache->fname)
+    {
+      for (i = 0; i < cache->n; i++) free(cache->fname[i]);
+      free(cache->fname);
+    }
+#ifdef HMMER_THREADS
+  if (cache->lazy) pthread_mutex_destroy(&cache->mutex);
+#endif
   if (cache->abc)  esl_alphabet_Destroy(cache->abc);
   if (cache->list) 
     {
@@ -163,9 +341,129 @@ p7_hmmcache_Close(P7_HMMCACHE *cache)
 	p7_oprofile_Destroy(cache->list[i]);
       free(cache->list);
     }
+  if (cache->hfp)  p7_hmmfile_Close(cache->hfp);   /* after the profiles that may point into it */
   free(cache);
 }
 
+
+/* hmmcache_open()
+ * Read <hmmfile> into a new cache: complete profiles, or if <lazy>
+ * only their MSV parts; of every <nshards> profiles, only the one
+ * numbered <shard>. See p7_hmmcache_Open(), _OpenLazy(), _OpenShard().
+ */
+static int
+hmmcache_open(char *hmmfile, int lazy, uint32_t maxrest, uint32_t shard, uint32_t nshards, P7_HMMCACHE **ret_cache, char *errbuf)
+{
+  P7_HMMCACHE *cache    = NULL;
+  P7_HMMFILE  *hfp      = NULL;        /* open HMM database file    */
+  P7_OPROFILE *om       = NULL;        /* target profile            */
+  uint32_t     nread    = 0;           /* profiles read from <hfp>  */
+  uint32_t     i;
+  int          status;
+  
+  ESL_ALLOC(cache, sizeof(P7_HMMCACHE));
+  cache->name      = NULL;
+  cache->abc       = NULL;
+  cache->list      = NULL;
+  cache->lalloc    = 4096;	/* allocation chunk size for <list> of ptrs  */
+  cache->n         = 0;
+  cache->hfp       = NULL;
+  cache->lazy      = FALSE;	/* set at the end: Close() destroys the mutex of a lazy cache */
+  cache->maxrest   = maxrest;
+  cache->used      = NULL;
+  cache->stamp     = 1;
+  cache->fname     = NULL;
+  cache->shard     = shard;
+  cache->nshards   = nshards;
+
+  if ( ( status = esl_strdup(hmmfile, -1, &cache->name) != eslOK)) goto ERROR; 
+  ESL_ALLOC(cache->list, sizeof(P7_OPROFILE *) * cache->lalloc);
+
+  if ( (status = p7_hmmfile_Open(hmmfile, NULL, &hfp, errbuf)) != eslOK) goto ERROR;  // eslENOTFOUND | eslEFORMAT 
+
+  while ((status = p7_oprofile_ReadMSV(hfp, &(cache->abc), &om)) == eslOK) /* eslEFORMAT | eslEINCOMPAT */
+    {
+      /* another shard's profile; the next one's rest is found by its own offset */
+      if (nread++ % nshards != shard) { p7_oprofile_Destroy(om); om = NULL; continue; }
+
+#if defined (eslENABLE_SSE)
+      if (lazy) p7_oprofile_FreeRest(om);
+      else
+#endif
+      if (( status = p7_oprofile_ReadRest(hfp, om)) != eslOK)
+        { strncpy(errbuf, hfp->rr_errbuf, eslERRBUFSIZE); goto ERROR; }
+
+      if (cache->n >= cache->lalloc) {
+	ESL_REALLOC(cache->list, sizeof(char *) * cache->lalloc * 2);
+	cache->lalloc *= 2;
+      }
+      
+      cache->list[cache->n++] = om;
+      om = NULL;
+    }
+  if (status != eslEOF)  { strncpy(errbuf, hfp->errbuf, eslERRBUFSIZE); goto ERROR; }
+
+  if (lazy)
+    {
+      ESL_ALLOC(cache->used, sizeof(uint32_t) * ESL_MAX(1, cache->n));
+      for (i = 0; i < cache->n; i++) cache->used[i] = 0;
+#ifdef HMMER_THREADS
+      if (pthread_mutex_init(&cache->mutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "mutex init failed");
+#endif
+      cache->lazy = TRUE;
+    }
+
+  //printf("\nfinal:: %d  memory %" PRId64 "\n", inx, total_mem);
+  /* Keep <hfp> open: cached profiles' score vectors may live in its mapped .h3f/.h3p,
+   * and a lazy cache reads the rest of them from it
+   */
+  cache->hfp = hfp;
+  *ret_cache = cache;
+  return eslOK;
+
+ ERROR:
+  if (cache) p7_hmmcache_Close(cache);
+  if (om)    p7_oprofile_Destroy(om);
+  if (hfp)   p7_hmmfile_Close(hfp);
+  return status;
+}
+
+
+/* hmmcache_index()
+ * Return the index of <om> in <cache->list>, or -1. The profiles are
+ * in file order, so their .h3f offsets <roff> increase.
+ */
+static int
+hmmcache_index(const P7_HMMCACHE *cache, const P7_OPROFILE *om)
+{
+  int lo = 0;
+  int hi = (int) cache->n - 1;
+  int mid;
+
+  while (lo <= hi)
+    {
+      mid = (lo + hi) / 2;
+      if      (cache->list[mid]->roff < om->roff) lo = mid + 1;
+      else if (cache->list[mid]->roff > om->roff) hi = mid - 1;
+      else return (cache->list[mid] == om ? mid : -1);
+    }
+  return -1;
+}
+
+/* stamp_sorter()
+ * qsort() comparison of two uint32_t stamps: newest (largest) first.
+ */
+static int
+stamp_sorter(const void *vp1, const void *vp2)
+{
+  uint32_t s1 = *((const uint32_t *) vp1);
+  uint32_t s2 = *((const uint32_t *) vp2);
+
+  if      (s1 > s2) return -1;
+  else if (s1 < s2) return  1;
+  else              return  0;
+}
+
 /*****************************************************************
  * 2. Benchmark driver
  *****************************************************************/
@@ -183,6 +481,7 @@ p7_hmmcache_Close(P7_HMMCACHE *cache)
 static ESL_OPTIONS options[] = {
   /* name           type      default  env  range toggles reqs incomp  help                                  docgroup*/
   { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",      0 },
+  { "--lazy",    eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "cache only the MSV parts of the profiles",  0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options] <HMM file>";
@@ -201,7 +500,8 @@ main(int argc, char **argv)
 
   esl_stopwatch_Start(w);
 
-  status = p7_hmmcache_Open(hmmfile, &hcache, errbuf);
+  if (esl_opt_GetBoolean(go, "--lazy")) status = p7_hmmcache_OpenLazy(hmmfile, 0, &hcache, errbuf);
+  else                                  status = p7_hmmcache_Open    (hmmfile,    &hcache, errbuf);
   if      (status == eslENOTFOUND) p7_Fail("Failed to read %s\n  %s\n",           hmmfile, errbuf);
   else if (status == eslEFORMAT)   p7_Fail("Failed to parse %s\n  %s\n",          hmmfile, errbuf);
   else if (status == eslEINCOMPAT) p7_Fail("Mixed profile types in %s\n  %s\n",   hmmfile, errbuf);
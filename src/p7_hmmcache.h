@@ -3,19 +3,45 @@
 #ifndef P7_HMMCACHE_INCLUDED
 #define P7_HMMCACHE_INCLUDED
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
 #include "esl_alphabet.h"
 #include "hmmer.h"
 
-typedef struct {
+typedef struct p7_hmmcache_s {
   char               *name;        /* name of the hmm database              */
   ESL_ALPHABET       *abc;         /* alphabet for database                 */
 
   P7_OPROFILE       **list;        /* list of profiles [0 .. n-1]           */
   uint32_t            lalloc;	   /* allocated length of <list>            */
   uint32_t            n;           /* number of entries in <list>           */
+
+  P7_HMMFILE         *hfp;         /* open pressed db; <list> may point into its mmap()'ed auxfiles */
+
+  /* A lazy cache (p7_hmmcache_OpenLazy()) holds only the MSV part of each profile
+   * until p7_hmmcache_GetRest() reads the rest; p7_hmmcache_Trim() frees it again.
+   */
+  int                 lazy;        /* TRUE if <list> is read lazily                            */
+  uint32_t            maxrest;     /* keep up to this many complete profiles past a Trim()     */
+  uint32_t           *used;        /* [0..n-1]: stamp of last search needing list[i]; 0=MSV only */
+  uint32_t            stamp;       /* current stamp, 1..; Trim() advances it                   */
+  char              **fname;       /* [0..n-1]: names in <hfp>, if SetNumericNames() renamed them; or NULL */
+
+  /* A shard (p7_hmmcache_OpenShard()) holds profiles <shard>, <shard>+<nshards>, ... of the file */
+  uint32_t            shard;       /* first profile held; 0 for a whole database               */
+  uint32_t            nshards;     /* one profile in this many is held; 1 for a whole database */
+#ifdef HMMER_THREADS
+  pthread_mutex_t     mutex;       /* serializes GetRest()                                     */
+#endif
 } P7_HMMCACHE;
 
 extern int    p7_hmmcache_Open (char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf);
+extern int    p7_hmmcache_OpenLazy(char *hmmfile, uint32_t maxrest, P7_HMMCACHE **ret_cache, char *errbuf);
+extern int    p7_hmmcache_OpenShard(char *hmmfile, uint32_t shard, uint32_t nshards, P7_HMMCACHE **ret_cache, char *errbuf);
+extern int    p7_hmmcache_GetRest        (P7_HMMCACHE *cache, P7_OPROFILE *om, char *errbuf);
+extern int    p7_hmmcache_Trim           (P7_HMMCACHE *cache);
 extern size_t p7_hmmcache_Sizeof         (P7_HMMCACHE *cache);
 extern int    p7_hmmcache_SetNumericNames(P7_HMMCACHE *cache);
 extern void   p7_hmmcache_Close          (P7_HMMCACHE *cache);
@@ -20,6 +20,11 @@
 #ifdef HMMER_THREADS
 #include <pthread.h>
 #endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -66,6 +71,7 @@ static float h2ascii2prob(char *s, float null);
  *****************************************************************/
 
 static int open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_only, char *errbuf);
+static void map_auxfile(FILE *fp, char **ret_map, off_t *ret_size);
 
 
 /* Function:  p7_hmmfile_Open()
@@ -88,11 +94,15 @@ static int open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, in
  *            
  *            As another special case, if <filename> ends in a <.gz>
  *            suffix, the file is assumed to be compressed by GNU
- *            <gzip>, and it is opened for reading from a pipe with
- *            <gunzip -dc>. This feature is only available on
- *            POSIX-compliant systems that have a <popen()> call, and
- *            <HAVE_POPEN> is defined by the configure script at
- *            compile time. 
+ *            <gzip> (or <bgzip>, whose output is also gzip), and it
+ *            is opened for reading from a pipe with <pigz -dc> if
+ *            <pigz> is in the PATH, else <gzip -dc>; <pigz> inflates
+ *            on one thread but reads, writes and checksums on others,
+ *            so it keeps up with a threaded search better. A
+ *            <.zst> suffix likewise means a pipe from <zstd -dc>.
+ *            This feature is only available on POSIX-compliant
+ *            systems that have a <popen()> call, and <HAVE_POPEN> is
+ *            defined by the configure script at compile time.
  *            
  * Args:      filename - HMM file to open; or "-" for <stdin>
  *            env      - list of paths to look for <hmmfile> in, in 
@@ -179,6 +189,10 @@ p7_hmmfile_OpenBuffer(const char *buffer, int size, P7_HMMFILE **ret_hfp)
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->ffp_map      = NULL;
+  hfp->pfp_map      = NULL;
+  hfp->ffp_mapsize  = 0;
+  hfp->pfp_mapsize  = 0;
   hfp->ssi          = NULL;
   hfp->errbuf[0]    = '\0';
   hfp->rr_errbuf[0] = '\0';
@@ -228,7 +242,7 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
   P7_HMMFILE *hfp      = NULL;
   char       *envfile  = NULL;  /* full path to filename after using environment  */
   char       *dbfile   = NULL;  /* constructed name of an index or binary db file */
-  char       *cmd      = NULL;  /* constructed gzip -dc pipe command              */
+  char       *cmd      = NULL;  /* constructed decompression pipe command         */
   int         status;
   int         n        = strlen(filename);
   union { char c[4]; uint32_t n; } magic;
@@ -249,6 +263,10 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->ffp_map      = NULL;
+  hfp->pfp_map      = NULL;
+  hfp->ffp_mapsize  = 0;
+  hfp->pfp_mapsize  = 0;
   hfp->ssi          = NULL;
   hfp->errbuf[0]    = '\0';
   hfp->rr_errbuf[0] = '\0';
@@ -269,12 +287,22 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
   else if (n > 3 && strcmp(filename+n-3, ".gz") == 0) /* a <*.gz> filename means read via gunzip pipe */
   {
     if (! esl_FileExists(filename))                                     ESL_XFAIL(eslENOTFOUND, errbuf, ".gz file %s not found or not readable", filename);
-    if ((status = esl_sprintf(&cmd, "gzip -dc %s", filename)) != eslOK) ESL_XFAIL(status,       errbuf, "when setting up .gz pipe: esl_sprintf() failed");
+    if ((status = esl_sprintf(&cmd, "if command -v pigz >/dev/null 2>&1; then pigz -dc %s; else gzip -dc %s; fi", filename, filename)) != eslOK)
+                                                                        ESL_XFAIL(status,       errbuf, "when setting up .gz pipe: esl_sprintf() failed");
     if ((hfp->f = popen(cmd, "r")) == NULL)                             ESL_XFAIL(eslENOTFOUND, errbuf, "gzip -dc %s failed; gzip not installed or not in PATH?", filename);
     if ((status = esl_strdup(filename, n, &(hfp->fname))) != eslOK)     ESL_XFAIL(status,       errbuf, "esl_strdup() failed, shouldn't happen");
     hfp->do_gzip  = TRUE;
     free(cmd); cmd = NULL;
   }
+  else if (n > 4 && strcmp(filename+n-4, ".zst") == 0) /* and a <*.zst> one, via zstd */
+  {
+    if (! esl_FileExists(filename))                                     ESL_XFAIL(eslENOTFOUND, errbuf, ".zst file %s not found or not readable", filename);
+    if ((status = esl_sprintf(&cmd, "zstd -dcq %s", filename)) != eslOK) ESL_XFAIL(status,      errbuf, "when setting up .zst pipe: esl_sprintf() failed");
+    if ((hfp->f = popen(cmd, "r")) == NULL)                             ESL_XFAIL(eslENOTFOUND, errbuf, "zstd -dc %s failed; zstd not installed or not in PATH?", filename);
+    if ((status = esl_strdup(filename, n, &(hfp->fname))) != eslOK)     ESL_XFAIL(status,       errbuf, "esl_strdup() failed, shouldn't happen");
+    hfp->do_gzip  = TRUE;
+    free(cmd); cmd = NULL;
+  }
 #endif /*HAVE_POPEN: gzip mode */
   
   
@@ -355,6 +383,15 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
     dbfile[n-1] = 'p';  /* the remainder of the optimized profiles */
     if ((hfp->pfp = fopen(dbfile, "rb")) == NULL) ESL_XFAIL(eslENOTFOUND, errbuf, "Opened %s, a pressed HMM file; but no .h3p file found", hfp->fname);
 
+    /* Map the binary profile files, so optimized profiles can point
+     * their score vectors straight into the page cache, shared by
+     * every process reading the same database. Failure isn't fatal;
+     * we fall back to reading them with stdio. (So does a caller that
+     * asks for it with p7_hmmfile_Unmap().)
+     */
+    map_auxfile(hfp->ffp, &(hfp->ffp_map), &(hfp->ffp_mapsize));
+    map_auxfile(hfp->pfp, &(hfp->pfp_map), &(hfp->pfp_mapsize));
+
     dbfile[n-1] = 'i';  /* the SSI index for the .h3m file */
     status = esl_ssi_Open(dbfile, &(hfp->ssi));
     if      (status == eslENOTFOUND) ESL_XFAIL(eslENOTFOUND, errbuf, "Opened %s, a pressed HMM file; but no .h3i file found", hfp->fname);
@@ -421,6 +458,32 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
   else                              return eslEFORMAT;
 }
 
+/* map_auxfile()
+ * 
+ * Map the whole of open binary stream <fp>, for
+ * <p7_oprofile_ReadMSV()> and <p7_oprofile_ReadRest()> to point
+ * optimized profile score vectors into. The mapping is private, so
+ * nothing a caller does to a profile can reach the file. If the
+ * system doesn't support mmap(), or the mapping fails, <*ret_map> is
+ * <NULL> and the readers use stdio instead.
+ */
+static void
+map_auxfile(FILE *fp, char **ret_map, off_t *ret_size)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  struct stat st;
+  void       *p;
+
+  if (fstat(fileno(fp), &st) == 0 && st.st_size > 0)
+    {
+      p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+      if (p != MAP_FAILED) { *ret_map = (char *) p; *ret_size = st.st_size; return; }
+    }
+#endif
+  *ret_map  = NULL;
+  *ret_size = 0;
+}
+
 /* Function:  p7_hmmfile_Close()
  *
  * Purpose:   Closes an open HMM file <hfp>.
@@ -436,6 +499,10 @@ p7_hmmfile_Close(P7_HMMFILE *hfp)
   if (hfp->do_gzip && hfp->f != NULL)    pclose(hfp->f);
 #endif
   if (!hfp->do_gzip && !hfp->do_stdin && hfp->f != NULL) fclose(hfp->f);
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (hfp->ffp_map != NULL) munmap(hfp->ffp_map, hfp->ffp_mapsize);
+  if (hfp->pfp_map != NULL) munmap(hfp->pfp_map, hfp->pfp_mapsize);
+#endif
   if (hfp->ffp   != NULL) fclose(hfp->ffp);
   if (hfp->pfp   != NULL) fclose(hfp->pfp);
   if (hfp->fname != NULL) free(hfp->fname);
@@ -447,6 +514,35 @@ p7_hmmfile_Close(P7_HMMFILE *hfp)
   free(hfp);
 }
 
+/* Function:  p7_hmmfile_Unmap()
+ * Synopsis:  Read a pressed database's profiles with stdio, not mmap().
+ *
+ * Purpose:   Drop the mappings of the <.h3f> and <.h3p> files of
+ *            pressed database <hfp>, so that <p7_oprofile_ReadMSV()>
+ *            and <p7_oprofile_ReadRest()> read each optimized profile
+ *            into memory of its own, as they do where there's no
+ *            mmap(). Drivers call this for <--nommap>, for
+ *            filesystems where mapping is slow or unreliable.
+ *
+ *            Must be called right after <hfp> is opened, before any
+ *            profile is read from it: profiles read from a mapping
+ *            point into it.
+ *
+ * Returns:   (void)
+ */
+void
+p7_hmmfile_Unmap(P7_HMMFILE *hfp)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (hfp->ffp_map != NULL) munmap(hfp->ffp_map, hfp->ffp_mapsize);
+  if (hfp->pfp_map != NULL) munmap(hfp->pfp_map, hfp->pfp_mapsize);
+#endif
+  hfp->ffp_map     = NULL;
+  hfp->pfp_map     = NULL;
+  hfp->ffp_mapsize = 0;
+  hfp->pfp_mapsize = 0;
+}
+
 #ifdef HMMER_THREADS
 /* Function:  p7_hmmfile_CreateLock()
  *
@@ -484,6 +580,7 @@ p7_hmmfile_CreateLock(P7_HMMFILE *hfp)
  * 2. Writing HMMER3 HMM files.
  *****************************************************************/
 static int multiline(FILE *fp, const char *pfx, char *s);
+static float ascii_negexp(const char *tok);
 static int multilineString(char *str, int size, const char *pfx, char *s, int *offset);
 static int printprob(FILE *fp, int fieldwidth, float p);
 static int probToString(char *str, int size, int fieldwidth, float p, int offset);
@@ -1073,6 +1170,18 @@ p7_hmmfile_WriteBinary(FILE *fp, int format, P7_HMM *hmm)
  * 3. API for reading profile HMM files in various formats.
  *****************************************************************/
 
+/* p7_hmmfile_ReadAt() reads forward over gaps up to this size rather
+ * than seeking; sorted fetches from Pfam-sized files mostly skip less.
+ */
+#define p7_HMMFILE_READAHEAD (1024 * 1024)
+
+typedef struct {
+  off_t offset;
+  int   idx;
+} KEY_OFFSET;
+
+static int cmp_key_offset(const void *vp1, const void *vp2);
+
 /* Function:  p7_hmmfile_Read()
  *
  * Purpose:   Read the next HMM from open save file <hfp>, and
@@ -1195,6 +1304,123 @@ p7_hmmfile_Position(P7_HMMFILE *hfp, const off_t offset)
   hfp->newly_opened = FALSE;  /* because we're poised on the magic number, and must read it */
   return eslOK;
 }
+
+/* Function:  p7_hmmfile_SortKeys()
+ * Synopsis:  Look up many HMMs in SSI, and order them by file offset.
+ *
+ * Purpose:   Look up each of the <nkeys> names or accessions <keys>
+ *            in the SSI index of <hfp>, putting the offset of HMM
+ *            <keys[i]> in <offset[i]>, and the key indices
+ *            <0..nkeys-1> in <order[]> sorted by those offsets (keys
+ *            of the same HMM in the order they were given). Reading
+ *            the HMMs in that <order> with <p7_hmmfile_ReadAt()>
+ *            goes through the file once, front to back, instead of
+ *            seeking back and forth; that matters on disks and
+ *            network storage.
+ *
+ *            Caller provides <offset> and <order>, allocated for
+ *            <nkeys> at least.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENOTFOUND> if a key isn't in the index; and
+ *            <eslEFORMAT> if the SSI file can't be read. In either
+ *            case <hfp->errbuf> says which key.
+ *
+ * Throws:    <eslEMEM> on allocation failure, or <eslEINVAL> if <hfp>
+ *            doesn't have an SSI index.
+ */
+int
+p7_hmmfile_SortKeys(P7_HMMFILE *hfp, char **keys, int nkeys, off_t *offset, int *order)
+{
+  KEY_OFFSET *ko = NULL;
+  uint16_t    fh;
+  int         i;
+  int         status;
+
+  if (hfp->ssi == NULL) ESL_EXCEPTION(eslEINVAL, "Need an open SSI index to call p7_hmmfile_SortKeys()");
+  ESL_ALLOC(ko, sizeof(KEY_OFFSET) * ESL_MAX(1, nkeys));
+
+  for (i = 0; i < nkeys; i++)
+    {
+      status = esl_ssi_FindName(hfp->ssi, keys[i], &fh, &offset[i], NULL, NULL);
+      if      (status == eslENOTFOUND) ESL_XFAIL(eslENOTFOUND, hfp->errbuf, "HMM %s not found in SSI index for file %s", keys[i], hfp->fname);
+      else if (status == eslEFORMAT)   ESL_XFAIL(eslEFORMAT,   hfp->errbuf, "Failed to parse SSI index for %s", hfp->fname);
+      else if (status != eslOK)        goto ERROR;
+      ko[i].offset = offset[i];
+      ko[i].idx    = i;
+    }
+  qsort(ko, nkeys, sizeof(KEY_OFFSET), cmp_key_offset);
+  for (i = 0; i < nkeys; i++) order[i] = ko[i].idx;
+
+  free(ko);
+  return eslOK;
+
+ ERROR:
+  free(ko);
+  return status;
+}
+
+
+/* Function:  p7_hmmfile_ReadAt()
+ * Synopsis:  Read the HMM that starts at a given file offset.
+ *
+ * Purpose:   Read the HMM that starts at <offset> in <hfp>, as
+ *            <p7_hmmfile_Position()> then <p7_hmmfile_Read()> would,
+ *            with the same arguments and returns as
+ *            <p7_hmmfile_Read()>. If <offset> is a short way ahead of
+ *            where <hfp> is now (up to <p7_HMMFILE_READAHEAD> bytes,
+ *            as when going through offsets sorted by
+ *            <p7_hmmfile_SortKeys()>), the HMMs in between are read
+ *            past in large sequential reads instead of seeking.
+ *
+ * Returns:   As <p7_hmmfile_Read()>; <eslEOF> if the file ends before
+ *            <offset>.
+ *
+ * Throws:    As <p7_hmmfile_Read()>; and <eslESYS> if <hfp> can't be
+ *            positioned, or <eslEINVAL> if it's a stream (stdin, or a
+ *            decompression pipe) or was opened on a memory buffer.
+ */
+int
+p7_hmmfile_ReadAt(P7_HMMFILE *hfp, off_t offset, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
+{
+  char   buf[65536];
+  off_t  pos;
+  size_t n;
+
+  if (opt_hmm) *opt_hmm = NULL;
+  if (hfp->f == NULL || hfp->do_stdin || hfp->do_gzip) ESL_EXCEPTION(eslEINVAL, "Can't position an HMM stream or buffer");
+  if ((pos = ftello(hfp->f)) < 0)                      ESL_EXCEPTION(eslESYS,   "ftello failed");
+
+  if (offset < pos || offset - pos > p7_HMMFILE_READAHEAD)
+    {
+      if (fseeko(hfp->f, offset, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseek failed");
+    }
+  else
+    {
+      /* reads of at least a buffer's worth go straight from the file to <buf> */
+      for ( ; pos < offset; pos += n)
+	if ((n = fread(buf, 1, (size_t) ESL_MIN((off_t) sizeof(buf), offset - pos), hfp->f)) == 0) return eslEOF;
+    }
+
+  hfp->newly_opened = FALSE;  /* because we're poised on the magic number, and must read it */
+  return p7_hmmfile_Read(hfp, ret_abc, opt_hmm);
+}
+
+/* cmp_key_offset()
+ * qsort() comparison for p7_hmmfile_SortKeys(): by offset, then by
+ * key index, so keys of the same HMM stay in the order given.
+ */
+static int
+cmp_key_offset(const void *vp1, const void *vp2)
+{
+  const KEY_OFFSET *a = (const KEY_OFFSET *) vp1;
+  const KEY_OFFSET *b = (const KEY_OFFSET *) vp2;
+
+  if      (a->offset < b->offset) return -1;
+  else if (a->offset > b->offset) return  1;
+  else return (a->idx - b->idx);
+}
 /*------------------- end, input API ----------------------------*/
 
 
@@ -1483,7 +1709,7 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
   if (strcmp(tok1, "COMPO") == 0) {
     for (x = 0; x < abc->K; x++)  {
       if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))     != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few fields on COMPO line");
-      hmm->compo[x] = (*tok1 == '*' ? 0.0 : expf(-1.0 * atof(tok1)));
+      hmm->compo[x] = ascii_negexp(tok1);
     }
     hmm->flags |= p7H_COMPO;
     if ((status = esl_fileparser_NextLine(hfp->efp))                          != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data after COMPO line");  
@@ -1492,15 +1718,15 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
 
   /* First two lines are node 0: insert emissions, then transitions from node 0 (begin) */
 
-  hmm->ins[0][0] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+  hmm->ins[0][0] = ascii_negexp(tok1);
   for (x = 1; x < abc->K; x++) {
     if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))       != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few fields on insert line, node 0: expected %d, got %d\n", abc->K, x);
-    hmm->ins[0][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+    hmm->ins[0][x] = ascii_negexp(tok1);
   }
   if ((status = esl_fileparser_NextLine(hfp->efp))                            != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data in main model: no node 0 transition line");
   for (x = 0; x < p7H_NTRANSITIONS; x++) {
     if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))       != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few fields on begin (0) transition line");
-    hmm->t[0][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+    hmm->t[0][x] = ascii_negexp(tok1);
   }
 
   /* The main model section. */
@@ -1513,7 +1739,7 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
       
       for (x = 0; x < abc->K; x++) {
 	if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))   != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few probability fields on match line, node %d: expected %d, got %d\n", k, abc->K, x);
-	hmm->mat[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+	hmm->mat[k][x] = ascii_negexp(tok1);
       }
       
       if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))     != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Missing MAP field on match line for node %d: should at least be -", k);
@@ -1539,12 +1765,12 @@ read_asc30hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
       if ((status = esl_fileparser_NextLine(hfp->efp))                        != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data in main model: no insert emission line, node %d", k);
       for (x = 0; x < abc->K; x++) {
 	if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))   != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few probability fields on insert line, node %d: expected %d, got %d\n", k, abc->K, x);
-	hmm->ins[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+	hmm->ins[k][x] = ascii_negexp(tok1);
       }
       if ((status = esl_fileparser_NextLine(hfp->efp))                        != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Premature end of data in main model: no transition line, node %d", k);
       for (x = 0; x < p7H_NTRANSITIONS; x++) {
 	if ((status = esl_fileparser_GetTokenOnLine(hfp->efp, &tok1, NULL))   != eslOK)  ESL_XFAIL(status,     hfp->errbuf, "Too few probability fields on transition line, node %d: expected %d, got %d\n", k, abc->K, x);
-	hmm->t[k][x] = (*tok1 == '*' ? 0.0 : expf(-1.0 *atof(tok1)));
+	hmm->t[k][x] = ascii_negexp(tok1);
       }
     }
 
@@ -1978,6 +2204,39 @@ read_asc20hmm(P7_HMMFILE *hfp, ESL_ALPHABET **ret_abc, P7_HMM **opt_hmm)
  * 5. Other private functions involved in i/o
  *****************************************************************/
 
+/* ascii_negexp()
+ * 
+ * Convert a field of an ASCII save file that holds a -log
+ * probability, like "2.30259", to the probability; "*" means 0.
+ * These are the bulk of a model, and atof() is the largest cost of
+ * reading one, so the usual fixed-point fields are converted here:
+ * up to 15 digits are exact as an integer-valued double, and a single
+ * division by an exact power of ten is correctly rounded, so the
+ * value is the one atof() returns. Anything else (signs, exponents,
+ * longer fields) is left to atof().
+ */
+static float
+ascii_negexp(const char *tok)
+{
+  static const double pow10[] = { 1e0, 1e1, 1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+				  1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+  const char *s      = tok;
+  double      m      = 0.;
+  int         ndigit = 0;
+  int         nfrac  = 0;
+  int         indot  = FALSE;
+
+  if (*tok == '*') return 0.0;
+  for (; *s != '\0'; s++)
+    {
+      if      (*s >= '0' && *s <= '9') { m = m * 10. + (*s - '0'); ndigit++; if (indot) nfrac++; }
+      else if (*s == '.' && ! indot)   indot = TRUE;
+      else break;
+    }
+  if (*s != '\0' || ndigit == 0 || ndigit > 15) return expf(-1.0 * atof(tok));
+  return expf(-1.0 * (m / pow10[nfrac]));
+}
+
 
 /* multiline()
  * 
@@ -2304,6 +2563,7 @@ main(int argc, char **argv)
  * 7. Unit tests.
  *****************************************************************/
 #ifdef p7HMMFILE_TESTDRIVE
+#include "esl_random.h"
 
 /* utest_io_30: tests read/write for 3.0 save files.
  *              Caller provides a named tmpfile that we can
@@ -2402,6 +2662,79 @@ utest_io_3a(char *tmpfile, P7_HMM *hmm)
   return eslOK;
 }
 
+/* utest_negexp: the hand conversion of -log probabilities in ASCII
+ * files must agree exactly with atof()'s.
+ */
+static void
+utest_negexp(ESL_RANDOMNESS *r)
+{
+  char  *msg     = "ascii_negexp() unit test failed";
+  char  *odd[]   = { "0", "0.", "1e-3", "2.5E2", "-0.5", "12345678901234567.5", "0.000000000000000123456789" };
+  char   buf[64];
+  float  p;
+  int    i;
+
+  if (ascii_negexp("*") != 0.0f) esl_fatal(msg);
+  for (i = 0; i < 100000; i++)
+    {
+      /* as printprob() writes them, plus some wider ones */
+      p = esl_random(r);
+      if      (i % 3 == 0) snprintf(buf, 64, "%.5f",  -logf(p));
+      else if (i % 3 == 1) snprintf(buf, 64, "%.10f", -logf(p) * 1000.);
+      else                 snprintf(buf, 64, "%.5f",  (float) esl_rnd_Roll(r, 100000) / 100000.);
+      if (ascii_negexp(buf) != expf(-1.0 * atof(buf))) esl_fatal(msg);
+    }
+  for (i = 0; i < sizeof(odd) / sizeof(char *); i++)
+    if (ascii_negexp(odd[i]) != expf(-1.0 * atof(odd[i]))) esl_fatal(msg);
+}
+
+
+/* utest_readat: p7_hmmfile_ReadAt() finds HMMs by offset, whether it
+ *               has to skip forward over others or seek back, in
+ *               ASCII and binary files.
+ */
+static void
+utest_readat(char *tmpfile, P7_HMM *hmm)
+{
+  char          msg[]    = "p7_hmmfile_ReadAt() unit test failed";
+  int           order[]  = { 1, 3, 4, 2, 0, 0 };
+  int           nhmm     = 5;
+  FILE         *fp       = NULL;
+  P7_HMMFILE   *hfp      = NULL;
+  P7_HMM       *new      = NULL;
+  ESL_ALPHABET *newabc   = NULL;
+  off_t         offset[5];
+  char          name[16];
+  int           do_binary, i;
+
+  for (do_binary = FALSE; do_binary <= TRUE; do_binary++)
+    {
+      if ((fp = fopen(tmpfile, "w")) == NULL) esl_fatal(msg);
+      for (i = 0; i < nhmm; i++)
+	{
+	  snprintf(name, sizeof(name), "hmm%d", i);
+	  if (p7_hmm_SetName(hmm, name)            != eslOK) esl_fatal(msg);
+	  if ((offset[i] = ftello(fp))             <  0)     esl_fatal(msg);
+	  if (do_binary) { if (p7_hmmfile_WriteBinary(fp, -1, hmm) != eslOK) esl_fatal(msg); }
+	  else           { if (p7_hmmfile_WriteASCII (fp, -1, hmm) != eslOK) esl_fatal(msg); }
+	}
+      fclose(fp);
+
+      if (p7_hmmfile_Open(tmpfile, NULL, &hfp, NULL) != eslOK) esl_fatal(msg);
+      for (i = 0; i < sizeof(order) / sizeof(int); i++)
+	{
+	  snprintf(name, sizeof(name), "hmm%d", order[i]);
+	  if (p7_hmmfile_ReadAt(hfp, offset[order[i]], &newabc, &new) != eslOK) esl_fatal(msg);
+	  if (strcmp(new->name, name)                                 != 0)     esl_fatal(msg);
+	  if (p7_hmm_SetName(new, hmm->name)                          != eslOK) esl_fatal(msg);
+	  if (p7_hmm_Compare(hmm, new, 0.0001)                        != eslOK) esl_fatal(msg);
+	  p7_hmm_Destroy(new);
+	}
+      p7_hmmfile_Close(hfp);
+    }
+  esl_alphabet_Destroy(newabc);
+}
+
 #endif /*p7HMMFILE_TESTDRIVE*/
 /*-------------------- end, unit tests --------------------------*/
 
@@ -2440,10 +2773,13 @@ main(int argc, char **argv)
   if ((esl_tmpfile_named(tmpfile, &fp))        != eslOK) esl_fatal("failed to create tmp file");
   fclose(fp);
 
+  utest_negexp(r);
+
   /* Protein HMMs */
   p7_hmm_Sample(r, M, aa_abc, &hmm);
   utest_io_current(tmpfile, hmm);
   utest_io_3a     (tmpfile, hmm);
+  utest_readat    (tmpfile, hmm);
   p7_hmm_Destroy(hmm);
 
   /* Nucleic acid HMMs */
@@ -75,3 +75,51 @@ ERROR:
 }
 
 
+/* Function:  p7_hmmwindow_Covered()
+ *
+ * Synopsis:  Check if a window on the list already covers a range
+ *
+ * Purpose:   Return TRUE if some window on <list> with complementarity
+ *            <complementarity> contains all of positions
+ *            <pos..pos+length-1>; otherwise FALSE.
+ *
+ * Returns:   TRUE or FALSE
+ */
+int
+p7_hmmwindow_Covered (const P7_HMM_WINDOWLIST *list, int complementarity, int64_t pos, int64_t length) {
+  int i;
+  P7_HMM_WINDOW *window;
+
+  for (i=0; i<list->count; i++) {
+    window = list->windows + i;
+    if ( window->complementarity == complementarity &&
+         window->n <= pos &&
+         window->n + window->length >= pos + length )
+      return TRUE;
+  }
+  return FALSE;
+}
+
+
+/* Function:  p7_hmmwindow_Prune()
+ *
+ * Synopsis:  Drop the windows that end before some position
+ *
+ * Purpose:   Remove (in place, keeping their order) the windows on
+ *            <list> that end before position <pos>.
+ *
+ * Returns:   eslOK
+ */
+int
+p7_hmmwindow_Prune (P7_HMM_WINDOWLIST *list, int64_t pos) {
+  int i;
+  int new_cnt = 0;
+
+  for (i=0; i<list->count; i++) {
+    if (list->windows[i].n + list->windows[i].length - 1 >= pos)
+      list->windows[new_cnt++] = list->windows[i];
+  }
+  list->count = new_cnt;
+
+  return eslOK;
+}
@@ -0,0 +1,336 @@
+/* Big buffers backed by hugepages.
+ *
+ * The full DP matrices of domain definition, the residues of a
+ * sequence cache and the arrays of an FM index are big enough (up to
+ * many GB) that, in 4 KB pages, their random-access stages spend much
+ * of their time on TLB misses. With hugepages switched on, buffers of
+ * at least 2 MB are mmap()'ed instead of malloc()'ed. Drivers switch
+ * them on with --hugepages, through p7_hugemem_SetMode():
+ *
+ *    thp   transparent hugepages: 2 MB-aligned anonymous memory,
+ *          madvise()'d MADV_HUGEPAGE, so the kernel backs it with
+ *          hugepages even when its THP setting is "madvise".
+ *    2M    explicit 2 MB hugepages (MAP_HUGETLB), from the pool the
+ *    1G    administrator reserved (1 GB pages only for buffers of at
+ *          least 1 GB); falling back to transparent ones when the
+ *          pool is empty.
+ *
+ * By default, or with "off", everything is malloc()'ed as before. Any
+ * failure quietly falls back to the next option, and finally to
+ * malloc(); hugepages are only an optimization.
+ *
+ * Memory from p7_hugemem_Alloc() is freed with p7_hugemem_Free(),
+ * which tells the two kinds apart by a registry of the mappings, and
+ * so also frees plain malloc()'ed pointers: a structure can hand its
+ * buffer back with p7_hugemem_Free() whichever way the buffer came.
+ * A mapping starts on a page boundary, so alignment for SIMD loads
+ * is kept; callers align within their buffers as they do now.
+ *
+ * Contents:
+ *    1. Big buffers.
+ *    2. Internal functions.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+#include "hmmer.h"
+
+#define HUGEMEM_2M  ((size_t) 2 * 1024 * 1024)
+#define HUGEMEM_1G  ((size_t) 1024 * 1024 * 1024)
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+
+typedef struct {
+  void   *mem;
+  size_t  len;                  /* mapped length, a multiple of the page size used */
+} HUGEMAP;
+
+static HUGEMAP *hugemaps  = NULL;   /* the live mappings [0..nhugemaps-1] */
+static int      nhugemaps = 0;
+static int      nalloc    = 0;
+static int      hugemode  = p7_HUGEMEM_OFF;   /* see p7_hugemem_SetMode() */
+
+#ifdef HMMER_THREADS
+static pthread_mutex_t hugemem_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define HUGEMEM_LOCK()    pthread_mutex_lock(&hugemem_mutex)
+#define HUGEMEM_UNLOCK()  pthread_mutex_unlock(&hugemem_mutex)
+#else
+#define HUGEMEM_LOCK()
+#define HUGEMEM_UNLOCK()
+#endif
+
+static void *map_explicit(size_t n, size_t pagesize, size_t *ret_len);
+static void *map_transparent(size_t n, size_t *ret_len);
+static int   find_map(void *p);
+#endif
+
+
+/*****************************************************************
+ *= 1. Big buffers
+ *****************************************************************/
+
+/* Function:  p7_hugemem_SetMode()
+ * Synopsis:  Choose the kind of hugepages big buffers get.
+ *
+ * Purpose:   Set the hugepage mode from string <s>, the argument of
+ *            a driver's <--hugepages> option: "off", "thp", "2M" or
+ *            "1G" (see above). This is process-wide; call it before
+ *            any threads start, and before the big buffers it should
+ *            apply to are allocated. Where there's no anonymous
+ *            mmap(), any valid <s> is accepted and everything stays
+ *            malloc()'ed.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if <s> isn't one of the above; the mode is
+ *            unchanged.
+ */
+int
+p7_hugemem_SetMode(const char *s)
+{
+  int mode;
+
+  if      (strcmp(s, "off") == 0)                         mode = p7_HUGEMEM_OFF;
+  else if (strcmp(s, "thp") == 0)                         mode = p7_HUGEMEM_THP;
+  else if (strcmp(s, "2M")  == 0 || strcmp(s, "2m") == 0) mode = p7_HUGEMEM_2M;
+  else if (strcmp(s, "1G")  == 0 || strcmp(s, "1g") == 0) mode = p7_HUGEMEM_1G;
+  else return eslEINVAL;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  hugemode = mode;
+#endif
+  return eslOK;
+}
+
+
+/* Function:  p7_hugemem_Mode()
+ * Synopsis:  Which kind of hugepages big buffers get.
+ *
+ * Purpose:   Return <p7_HUGEMEM_OFF>, <p7_HUGEMEM_THP>,
+ *            <p7_HUGEMEM_2M> or <p7_HUGEMEM_1G>, as set by
+ *            <p7_hugemem_SetMode()>; <p7_HUGEMEM_OFF> by default.
+ *            Always <p7_HUGEMEM_OFF> where there's no anonymous
+ *            mmap().
+ */
+int
+p7_hugemem_Mode(void)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  return hugemode;
+#else
+  return p7_HUGEMEM_OFF;
+#endif
+}
+
+
+/* Function:  p7_hugemem_Alloc()
+ * Synopsis:  Allocate a big buffer, in hugepages if they're on.
+ *
+ * Purpose:   Allocate <n> bytes: mmap()'ed in hugepages if
+ *            <p7_hugemem_Mode()> says so and <n> is at least
+ *            <p7_HUGEMEM_MIN>; else, or if that fails, with malloc().
+ *            The memory isn't initialized. Caller frees it with
+ *            <p7_hugemem_Free()>.
+ *
+ * Returns:   ptr to the buffer, or <NULL> if no memory can be had
+ *            either way.
+ */
+void *
+p7_hugemem_Alloc(size_t n)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  int      mode = p7_hugemem_Mode();
+  void    *mem  = NULL;
+  size_t   len  = 0;
+  HUGEMAP *p;
+
+  if (mode == p7_HUGEMEM_OFF || n < p7_HUGEMEM_MIN) return malloc(n);
+
+  if (mode == p7_HUGEMEM_1G && n >= HUGEMEM_1G)          mem = map_explicit(n, HUGEMEM_1G, &len);
+  if (mem == NULL && (mode == p7_HUGEMEM_1G || mode == p7_HUGEMEM_2M)) mem = map_explicit(n, HUGEMEM_2M, &len);
+  if (mem == NULL)                                      mem = map_transparent(n, &len);
+  if (mem == NULL)                                      return malloc(n);
+
+  HUGEMEM_LOCK();
+  if (nhugemaps == nalloc) {
+    if ((p = realloc(hugemaps, sizeof(HUGEMAP) * (nalloc + 16))) == NULL) {
+      HUGEMEM_UNLOCK();
+      munmap(mem, len);
+      return malloc(n);
+    }
+    hugemaps = p;
+    nalloc  += 16;
+  }
+  hugemaps[nhugemaps].mem = mem;
+  hugemaps[nhugemaps].len = len;
+  nhugemaps++;
+  HUGEMEM_UNLOCK();
+  return mem;
+#else
+  return malloc(n);
+#endif
+}
+
+
+/* Function:  p7_hugemem_Grow()
+ * Synopsis:  Make a big buffer at least <n> bytes, without keeping its contents.
+ *
+ * Purpose:   For DP matrices, which are refilled after they grow:
+ *            return a buffer of at least <n> bytes in place of <p>,
+ *            which may be <NULL>. A mapping whose slack past its last
+ *            use already holds <n> is returned as it is; otherwise
+ *            <p> is freed and a new buffer allocated, so unlike
+ *            realloc() the old contents are lost.
+ *
+ * Returns:   ptr to the buffer, or <NULL> on allocation failure, in
+ *            which case <p> has been freed.
+ */
+void *
+p7_hugemem_Grow(void *p, size_t n)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  int    i;
+  size_t len = 0;
+
+  if (p != NULL) {
+    HUGEMEM_LOCK();
+    if ((i = find_map(p)) >= 0) len = hugemaps[i].len;
+    HUGEMEM_UNLOCK();
+    if (len >= n) return p;
+  }
+#endif
+  p7_hugemem_Free(p);
+  return p7_hugemem_Alloc(n);
+}
+
+
+/* Function:  p7_hugemem_Free()
+ * Synopsis:  Free a buffer from <p7_hugemem_Alloc()>, or <malloc()>.
+ *
+ * Purpose:   Unmap <p> if it is a hugepage mapping;
+ *            else <free()> it. <NULL> is ignored.
+ */
+void
+p7_hugemem_Free(void *p)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  size_t len = 0;
+  int    i;
+
+  if (p == NULL) return;
+  HUGEMEM_LOCK();
+  if ((i = find_map(p)) >= 0) {
+    len         = hugemaps[i].len;
+    hugemaps[i] = hugemaps[--nhugemaps];
+  }
+  HUGEMEM_UNLOCK();
+  if (len) { munmap(p, len); return; }
+#endif
+  free(p);
+}
+
+
+/* Function:  p7_hugemem_Advise()
+ * Synopsis:  Ask for transparent hugepages for memory allocated elsewhere.
+ *
+ * Purpose:   For a big buffer that must come from somewhere else (say,
+ *            <posix_memalign()>, for a particular alignment): if
+ *            hugepages are on, madvise() the whole pages of
+ *            <mem>..<mem+n-1> MADV_HUGEPAGE. Best called before the
+ *            memory is first touched. Does nothing otherwise, or
+ *            where <MADV_HUGEPAGE> isn't available.
+ */
+void
+p7_hugemem_Advise(void *mem, size_t n)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS) && defined(MADV_HUGEPAGE)
+  uintptr_t start = ((uintptr_t) mem + 4095) & ~((uintptr_t) 4095);
+  uintptr_t end   = ((uintptr_t) mem + n)    & ~((uintptr_t) 4095);
+
+  if (mem == NULL || n < p7_HUGEMEM_MIN || p7_hugemem_Mode() == p7_HUGEMEM_OFF) return;
+  if (end > start) madvise((void *) start, end - start, MADV_HUGEPAGE);
+#endif
+}
+/*------------------- end, big buffers --------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions
+ *****************************************************************/
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+
+/* map_explicit()
+ * Map <n> bytes, rounded up to <pagesize>, from the reserved pool of
+ * hugepages of that size; or return NULL.
+ */
+static void *
+map_explicit(size_t n, size_t pagesize, size_t *ret_len)
+{
+#ifdef MAP_HUGETLB
+  size_t  len   = (n + pagesize - 1) / pagesize * pagesize;
+  int     flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+  void   *mem;
+
+#if defined(MAP_HUGE_2MB) && defined(MAP_HUGE_1GB)
+  flags |= (pagesize == HUGEMEM_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+#else
+  if (pagesize != HUGEMEM_2M) return NULL;  /* the default hugepage size is all we can ask for */
+#endif
+  if ((mem = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0)) == MAP_FAILED) return NULL;
+  *ret_len = len;
+  return mem;
+#else
+  return NULL;
+#endif
+}
+
+/* map_transparent()
+ * Map <n> bytes, rounded up to 2 MB, at a 2 MB boundary so that every
+ * bit of it can be a hugepage: map 2 MB extra, and unmap the ends.
+ */
+static void *
+map_transparent(size_t n, size_t *ret_len)
+{
+  size_t    len = (n + HUGEMEM_2M - 1) / HUGEMEM_2M * HUGEMEM_2M;
+  char     *raw;
+  char     *mem;
+  uintptr_t lead;
+
+  if ((raw = mmap(NULL, len + HUGEMEM_2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) return NULL;
+  lead = (HUGEMEM_2M - ((uintptr_t) raw % HUGEMEM_2M)) % HUGEMEM_2M;
+  mem  = raw + lead;
+  if (lead)              munmap(raw, lead);
+  if (HUGEMEM_2M - lead) munmap(mem + len, HUGEMEM_2M - lead);
+#ifdef MADV_HUGEPAGE
+  madvise(mem, len, MADV_HUGEPAGE);
+#endif
+  *ret_len = len;
+  return mem;
+}
+
+/* find_map()
+ * Return the index of mapping <p> in the registry, or -1; caller
+ * holds the lock.
+ */
+static int
+find_map(void *p)
+{
+  int i;
+
+  for (i = 0; i < nhugemaps; i++)
+    if (hugemaps[i].mem == p) return i;
+  return -1;
+}
+#endif
+/*------------------ end, internal functions --------------------*/
@@ -0,0 +1,482 @@
+/* P7_MXPOOL: a shared pool of reusable DP matrices.
+ *
+ * A pipeline grows its DP matrices to fit the largest comparison it
+ * has seen, and frees them when it's destroyed. In a long-running
+ * program that creates a pipeline for each search, like the hmmpgmd
+ * worker, every search starts cold and reallocates everything. A
+ * P7_MXPOOL holds the matrices of finished pipelines idle, so the
+ * next ones can start warm.
+ *
+ * An idle matrix is handed out on a best-fit basis: the smallest one
+ * that's already big enough, or failing that the biggest one (which
+ * has the least growing to do). Two limits keep a pool from
+ * becoming a leak: the total size of idle matrices is capped by a
+ * high-water mark, and a matrix bigger than a trim size -- one that
+ * grew for some unusually long target -- is freed when it comes back
+ * rather than kept.
+ *
+ * Contents:
+ *    1. The P7_MXPOOL object.
+ *    2. Unit tests.
+ *    3. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+#include "hmmer.h"
+
+#ifdef HMMER_THREADS
+#define MXPOOL_LOCK(p)    pthread_mutex_lock(&((p)->mutex))
+#define MXPOOL_UNLOCK(p)  pthread_mutex_unlock(&((p)->mutex))
+#else
+#define MXPOOL_LOCK(p)
+#define MXPOOL_UNLOCK(p)
+#endif
+
+static int mxpool_keep(P7_MXPOOL *pool, size_t size);
+
+
+/*****************************************************************
+ *= 1. The P7_MXPOOL object
+ *****************************************************************/
+
+/* Function:  p7_mxpool_Create()
+ * Synopsis:  Create a new, empty <P7_MXPOOL>.
+ *
+ * Purpose:   Create a new pool of idle DP matrices, that holds at most
+ *            <maxbytes> of them in total, and never keeps one bigger
+ *            than <maxmx> bytes. A limit of 0 means no limit.
+ *
+ * Returns:   ptr to the new pool. Caller frees it with
+ *            <p7_mxpool_Destroy()>, after all the pipelines using it
+ *            have been destroyed.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_MXPOOL *
+p7_mxpool_Create(size_t maxbytes, size_t maxmx)
+{
+  P7_MXPOOL *pool = NULL;
+  int        status;
+
+  ESL_ALLOC(pool, sizeof(P7_MXPOOL));
+  pool->ox       = NULL;
+  pool->oxsize   = NULL;
+  pool->gx       = NULL;
+  pool->gxsize   = NULL;
+  pool->nox      = pool->ngx     = 0;
+  pool->oxalloc  = pool->gxalloc = 8;
+  pool->nbytes   = 0;
+  pool->maxbytes = maxbytes;
+  pool->maxmx    = maxmx;
+  pool->nget     = 0;
+  pool->nhit     = 0;
+  pool->ntrim    = 0;
+
+  ESL_ALLOC(pool->ox,     sizeof(P7_OMX *) * pool->oxalloc);
+  ESL_ALLOC(pool->oxsize, sizeof(size_t)   * pool->oxalloc);
+  ESL_ALLOC(pool->gx,     sizeof(P7_GMX *) * pool->gxalloc);
+  ESL_ALLOC(pool->gxsize, sizeof(size_t)   * pool->gxalloc);
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_init(&(pool->mutex), NULL) != 0) goto ERROR;
+#endif
+  return pool;
+
+ ERROR:
+  if (pool) {
+    if (pool->ox)     free(pool->ox);
+    if (pool->oxsize) free(pool->oxsize);
+    if (pool->gx)     free(pool->gx);
+    if (pool->gxsize) free(pool->gxsize);
+    free(pool);
+  }
+  return NULL;
+}
+
+
+/* Function:  p7_mxpool_GetOMX()
+ * Synopsis:  Borrow an optimized DP matrix from a pool.
+ *
+ * Purpose:   Get an optimized DP matrix from <pool> that's big enough
+ *            for an <M> by <L> comparison with <XL> rows of special
+ *            states, as <p7_omx_Create(M, L, XL)> would make it. An
+ *            idle matrix is reused if there is one, grown if
+ *            necessary; otherwise a new one is created.
+ *
+ * Returns:   ptr to the matrix. Caller gives it back with
+ *            <p7_mxpool_PutOMX()> (or may free it with
+ *            <p7_omx_Destroy()>).
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_OMX *
+p7_mxpool_GetOMX(P7_MXPOOL *pool, int M, int L, int XL)
+{
+  P7_OMX *ox   = NULL;
+  int     best = -1;
+  int     i;
+
+  MXPOOL_LOCK(pool);
+  pool->nget++;
+  for (i = 0; i < pool->nox; i++)
+    if (pool->ox[i]->allocQ4*4 >= M && pool->ox[i]->validR > L && pool->ox[i]->allocXR >= XL+1)
+      if (best == -1 || pool->oxsize[i] < pool->oxsize[best]) best = i;
+  if (best == -1)
+    for (i = 0; i < pool->nox; i++)
+      if (best == -1 || pool->oxsize[i] > pool->oxsize[best]) best = i;
+  if (best != -1)
+    {
+      ox                 = pool->ox[best];
+      pool->nbytes      -= pool->oxsize[best];
+      pool->nox--;
+      pool->ox[best]     = pool->ox[pool->nox];
+      pool->oxsize[best] = pool->oxsize[pool->nox];
+      pool->nhit++;
+    }
+  MXPOOL_UNLOCK(pool);
+
+  if (ox == NULL) return p7_omx_Create(M, L, XL);
+  if (p7_omx_GrowTo(ox, M, L, XL) != eslOK) { p7_omx_Destroy(ox); return NULL; }
+  p7_omx_Reuse(ox);
+  return ox;
+}
+
+
+/* Function:  p7_mxpool_PutOMX()
+ * Synopsis:  Give an optimized DP matrix back to a pool.
+ *
+ * Purpose:   Return optimized DP matrix <ox> to <pool>, where it's
+ *            kept idle for reuse -- unless it's bigger than the
+ *            pool's trim size, or keeping it would take the pool
+ *            over its high-water mark, in which case it's freed.
+ *            Either way, the caller must not use <ox> again. <ox>
+ *            may be <NULL>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <ox> is freed.
+ */
+int
+p7_mxpool_PutOMX(P7_MXPOOL *pool, P7_OMX *ox)
+{
+  size_t size;
+  void  *p;
+  int    status;
+
+  if (ox == NULL) return eslOK;
+  size = p7_omx_Sizeof(ox);
+
+  MXPOOL_LOCK(pool);
+  if (! mxpool_keep(pool, size)) { MXPOOL_UNLOCK(pool); p7_omx_Destroy(ox); return eslOK; }
+  if (pool->nox == pool->oxalloc)
+    {
+      ESL_RALLOC(pool->ox,     p, sizeof(P7_OMX *) * pool->oxalloc * 2);
+      ESL_RALLOC(pool->oxsize, p, sizeof(size_t)   * pool->oxalloc * 2);
+      pool->oxalloc *= 2;
+    }
+  pool->ox[pool->nox]     = ox;
+  pool->oxsize[pool->nox] = size;
+  pool->nox++;
+  pool->nbytes += size;
+  MXPOOL_UNLOCK(pool);
+  return eslOK;
+
+ ERROR:
+  MXPOOL_UNLOCK(pool);
+  p7_omx_Destroy(ox);
+  return status;
+}
+
+
+/* Function:  p7_mxpool_GetGMX()
+ * Synopsis:  Borrow a generic DP matrix from a pool.
+ *
+ * Purpose:   Get a generic DP matrix from <pool> that's big enough
+ *            for an <M> by <L> comparison, as <p7_gmx_Create(M, L)>
+ *            would make it; reusing an idle one if possible, as in
+ *            <p7_mxpool_GetOMX()>.
+ *
+ * Returns:   ptr to the matrix. Caller gives it back with
+ *            <p7_mxpool_PutGMX()>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_GMX *
+p7_mxpool_GetGMX(P7_MXPOOL *pool, int M, int L)
+{
+  P7_GMX *gx   = NULL;
+  int     best = -1;
+  int     i;
+
+  MXPOOL_LOCK(pool);
+  pool->nget++;
+  for (i = 0; i < pool->ngx; i++)
+    if (pool->gx[i]->allocW > M && pool->gx[i]->validR > L)
+      if (best == -1 || pool->gxsize[i] < pool->gxsize[best]) best = i;
+  if (best == -1)
+    for (i = 0; i < pool->ngx; i++)
+      if (best == -1 || pool->gxsize[i] > pool->gxsize[best]) best = i;
+  if (best != -1)
+    {
+      gx                 = pool->gx[best];
+      pool->nbytes      -= pool->gxsize[best];
+      pool->ngx--;
+      pool->gx[best]     = pool->gx[pool->ngx];
+      pool->gxsize[best] = pool->gxsize[pool->ngx];
+      pool->nhit++;
+    }
+  MXPOOL_UNLOCK(pool);
+
+  if (gx == NULL) return p7_gmx_Create(M, L);
+  if (p7_gmx_GrowTo(gx, M, L) != eslOK) { p7_gmx_Destroy(gx); return NULL; }
+  p7_gmx_Reuse(gx);
+  return gx;
+}
+
+
+/* Function:  p7_mxpool_PutGMX()
+ * Synopsis:  Give a generic DP matrix back to a pool.
+ *
+ * Purpose:   Return generic DP matrix <gx> to <pool>, as
+ *            <p7_mxpool_PutOMX()> does for optimized ones.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <gx> is freed.
+ */
+int
+p7_mxpool_PutGMX(P7_MXPOOL *pool, P7_GMX *gx)
+{
+  size_t size;
+  void  *p;
+  int    status;
+
+  if (gx == NULL) return eslOK;
+  size = p7_gmx_Sizeof(gx);
+
+  MXPOOL_LOCK(pool);
+  if (! mxpool_keep(pool, size)) { MXPOOL_UNLOCK(pool); p7_gmx_Destroy(gx); return eslOK; }
+  if (pool->ngx == pool->gxalloc)
+    {
+      ESL_RALLOC(pool->gx,     p, sizeof(P7_GMX *) * pool->gxalloc * 2);
+      ESL_RALLOC(pool->gxsize, p, sizeof(size_t)   * pool->gxalloc * 2);
+      pool->gxalloc *= 2;
+    }
+  pool->gx[pool->ngx]     = gx;
+  pool->gxsize[pool->ngx] = size;
+  pool->ngx++;
+  pool->nbytes += size;
+  MXPOOL_UNLOCK(pool);
+  return eslOK;
+
+ ERROR:
+  MXPOOL_UNLOCK(pool);
+  p7_gmx_Destroy(gx);
+  return status;
+}
+
+
+/* Function:  p7_mxpool_Sizeof()
+ * Synopsis:  Returns the allocated size of a pool, in bytes.
+ *
+ * Purpose:   Returns the number of bytes allocated for <pool>,
+ *            including the idle matrices it holds (but not the ones
+ *            it has handed out).
+ */
+size_t
+p7_mxpool_Sizeof(const P7_MXPOOL *pool)
+{
+  size_t n = sizeof(P7_MXPOOL);
+
+  n += (sizeof(P7_OMX *) + sizeof(size_t)) * pool->oxalloc;
+  n += (sizeof(P7_GMX *) + sizeof(size_t)) * pool->gxalloc;
+  n += pool->nbytes;
+  return n;
+}
+
+
+/* Function:  p7_mxpool_Destroy()
+ * Synopsis:  Free a pool, and the idle matrices in it.
+ */
+void
+p7_mxpool_Destroy(P7_MXPOOL *pool)
+{
+  int i;
+
+  if (pool == NULL) return;
+  for (i = 0; i < pool->nox; i++) p7_omx_Destroy(pool->ox[i]);
+  for (i = 0; i < pool->ngx; i++) p7_gmx_Destroy(pool->gx[i]);
+  free(pool->ox);
+  free(pool->oxsize);
+  free(pool->gx);
+  free(pool->gxsize);
+#ifdef HMMER_THREADS
+  pthread_mutex_destroy(&(pool->mutex));
+#endif
+  free(pool);
+}
+
+
+/* mxpool_keep()
+ * Decide whether a returned matrix of <size> bytes is kept idle in
+ * <pool>; if not, count it as trimmed. Caller holds the lock.
+ */
+static int
+mxpool_keep(P7_MXPOOL *pool, size_t size)
+{
+  if ((pool->maxmx    && size > pool->maxmx) ||
+      (pool->maxbytes && pool->nbytes + size > pool->maxbytes))
+    {
+      pool->ntrim++;
+      return FALSE;
+    }
+  return TRUE;
+}
+/*------------------- end, P7_MXPOOL object ---------------------*/
+
+
+
+/*****************************************************************
+ * 2. Unit tests.
+ *****************************************************************/
+#ifdef p7MXPOOL_TESTDRIVE
+#include "esl_random.h"
+
+/* utest_reuse()
+ * A matrix given back is the one handed out next, already big
+ * enough; a small matrix is preferred to a big one for a small
+ * request.
+ */
+static void
+utest_reuse(void)
+{
+  char       msg[] = "mxpool reuse unit test failed";
+  P7_MXPOOL *pool  = p7_mxpool_Create(0, 0);
+  P7_OMX    *ox1, *ox2, *ox3;
+  P7_GMX    *gx1, *gx2;
+
+  if (pool == NULL) esl_fatal(msg);
+
+  if ((ox1 = p7_mxpool_GetOMX(pool, 100, 50,  50))  == NULL) esl_fatal(msg);
+  if ((ox2 = p7_mxpool_GetOMX(pool, 100, 500, 500)) == NULL) esl_fatal(msg);
+  if (pool->nhit != 0 || pool->nget != 2)                     esl_fatal(msg);
+  if (p7_mxpool_PutOMX(pool, ox2) != eslOK)                   esl_fatal(msg);
+  if (p7_mxpool_PutOMX(pool, ox1) != eslOK)                   esl_fatal(msg);
+  if (pool->nox != 2 || pool->nbytes != p7_omx_Sizeof(ox1) + p7_omx_Sizeof(ox2)) esl_fatal(msg);
+
+  if ((ox3 = p7_mxpool_GetOMX(pool, 80, 40, 40)) != ox1)      esl_fatal(msg);   /* best fit   */
+  if ((ox3 = p7_mxpool_GetOMX(pool, 80, 40, 40)) != ox2)      esl_fatal(msg);   /* only one   */
+  if (pool->nhit != 2 || pool->nbytes != 0 || pool->nox != 0) esl_fatal(msg);
+  if (p7_mxpool_PutOMX(pool, ox1) != eslOK)                   esl_fatal(msg);
+
+  /* nothing fits: the biggest idle one is grown */
+  if ((ox3 = p7_mxpool_GetOMX(pool, 200, 1000, 1000)) != ox1) esl_fatal(msg);
+  if (ox3->allocQ4*4 < 200 || ox3->validR <= 1000 || ox3->allocXR < 1001) esl_fatal(msg);
+  p7_mxpool_PutOMX(pool, ox2);
+  p7_mxpool_PutOMX(pool, ox3);
+  p7_mxpool_PutOMX(pool, NULL);
+  if (pool->nox != 2) esl_fatal(msg);
+
+  if ((gx1 = p7_mxpool_GetGMX(pool, 100, 200)) == NULL)       esl_fatal(msg);
+  p7_mxpool_PutGMX(pool, gx1);
+  if ((gx2 = p7_mxpool_GetGMX(pool, 50, 100)) != gx1)         esl_fatal(msg);
+  if (gx2->M != 0 || gx2->L != 0)                             esl_fatal(msg);
+  p7_mxpool_PutGMX(pool, gx2);
+  if (pool->ngx != 1 || pool->ntrim != 0)                     esl_fatal(msg);
+
+  p7_mxpool_Destroy(pool);
+}
+
+/* utest_limits()
+ * Hand out and take back random-sized matrices, with a high-water
+ * mark and trim size set; the pool must never hold more than
+ * allowed, and every matrix it hands out must be big enough.
+ */
+static void
+utest_limits(ESL_RANDOMNESS *rng, int N)
+{
+  char       msg[]  = "mxpool limits unit test failed";
+  P7_OMX    *ox[4]  = { NULL, NULL, NULL, NULL };
+  P7_MXPOOL *pool;
+  size_t     small, nbytes;
+  int        i, j, M, L;
+
+  if ((ox[0] = p7_omx_Create(100, 100, 100)) == NULL) esl_fatal(msg);
+  small = p7_omx_Sizeof(ox[0]);
+  p7_omx_Destroy(ox[0]);
+  ox[0] = NULL;
+  if ((pool = p7_mxpool_Create(8*small, 4*small)) == NULL) esl_fatal(msg);
+  for (i = 0; i < N; i++)
+    {
+      j = esl_rnd_Roll(rng, 4);
+      if (ox[j] != NULL) { p7_mxpool_PutOMX(pool, ox[j]); ox[j] = NULL; }
+      else
+	{
+	  M = 1 + esl_rnd_Roll(rng, 200);
+	  L = esl_rnd_Roll(rng, 5) == 0 ? esl_rnd_Roll(rng, 2000) : esl_rnd_Roll(rng, 200);
+	  if ((ox[j] = p7_mxpool_GetOMX(pool, M, L, L)) == NULL) esl_fatal(msg);
+	  if (ox[j]->allocQ4*4 < M || ox[j]->validR <= L || ox[j]->allocXR < L+1) esl_fatal(msg);
+	}
+
+      for (nbytes = 0, j = 0; j < pool->nox; j++)
+	{
+	  if (pool->oxsize[j] != p7_omx_Sizeof(pool->ox[j])) esl_fatal(msg);
+	  if (pool->oxsize[j] > pool->maxmx)                 esl_fatal(msg);
+	  nbytes += pool->oxsize[j];
+	}
+      if (nbytes != pool->nbytes || nbytes > pool->maxbytes) esl_fatal(msg);
+    }
+  if (pool->ntrim == 0) esl_fatal(msg);   /* some L=2000 matrices were too big to keep */
+
+  for (j = 0; j < 4; j++) p7_mxpool_PutOMX(pool, ox[j]);
+  p7_mxpool_Destroy(pool);
+}
+#endif /*p7MXPOOL_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+
+/*****************************************************************
+ * 3. Test driver.
+ *****************************************************************/
+#ifdef p7MXPOOL_TESTDRIVE
+/*
+  gcc -o p7_mxpool_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7MXPOOL_TESTDRIVE p7_mxpool.c -lhmmer -leasel -lm
+  ./p7_mxpool_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,   "1000", NULL, NULL,  NULL,  NULL, NULL, "number of matrices to get or put",                 0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_MXPOOL";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  int             N   = esl_opt_GetInteger(go, "-N");
+
+  utest_reuse();
+  utest_limits(rng, N);
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7MXPOOL_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
@@ -60,20 +60,18 @@ void
 p7_null3_score(const ESL_ALPHABET *abc, const ESL_DSQ *dsq, P7_TRACE *tr, int start, int stop, P7_BG *bg, float *ret_sc)
 {
   float score = 0.;
-  int status;
   int i;
-  float *freq;
+  float freq[p7_MAXABET];	/* no allocation: this runs once per hit */
   int dir;
   int tr_pos;
 
-  ESL_ALLOC(freq, sizeof(float) * abc->K);
-  esl_vec_FSet(freq, abc->K, 0.0);
-
   /* contract check */
   if(abc == NULL) esl_exception(eslEINVAL, FALSE, __FILE__, __LINE__, "p7_null3_score() alphabet is NULL.%s\n", "");
   if(dsq == NULL) esl_exception(eslEINVAL, FALSE, __FILE__, __LINE__, "p7_null3_score() dsq alphabet is NULL.%s\n", "");
   if(abc->type != eslRNA && abc->type != eslDNA) esl_exception(eslEINVAL, FALSE, __FILE__, __LINE__, "p7_null3_score() expects alphabet of RNA or DNA.%s\n", "");
 
+  esl_vec_FSet(freq, abc->K, 0.0);
+
   dir = start < stop ? 1 : -1;
 
   if (tr != NULL) {
@@ -115,13 +113,6 @@ p7_null3_score(const ESL_ALPHABET *abc, const ESL_DSQ *dsq, P7_TRACE *tr, int st
   /* Return the correction to the bit score. */
   score = p7_FLogsum(0., score);
   *ret_sc = score;
-
-  return;
-
- ERROR:
-  esl_exception(eslEINVAL, FALSE, __FILE__, __LINE__, "p7_null3_score() memory allocation error.%s\n", "");
-  return; /* never reached */
-
 }
 
 
@@ -3,14 +3,20 @@
  * Contents:
  *   1. P7_PIPELINE: allocation, initialization, destruction
  *   2. Pipeline API
- *   3. Example 1: search mode (in a sequence db)
- *   4. Example 2: scan mode (in an HMM db)
+ *   3. Unit tests
+ *   4. Test driver
+ *   5. Example 1: search mode (in a sequence db)
+ *   6. Example 2: scan mode (in an HMM db)
  */
 #include <p7_config.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h> 
+#include <time.h>
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
 
 #include "easel.h"
 #include "esl_exponential.h"
@@ -19,9 +25,32 @@
 #include "esl_vectorops.h"
 
 #include "hmmer.h"
+#include "p7_hmmcache.h"
 
 #include "esl_sqio.h" //!!!!DEBUG
 
+/* In top-K mode, a target is only dropped after the Forward filter if
+ * its uncorrected Forward score is more than this many bits below the
+ * current Kth best (see p7_pipeline_SetTopK()); with --max, if it's
+ * more than this many bits short of being reportable.
+ */
+#define p7_TOPK_SLACK 2.0
+
+/* The bounded MSV and Viterbi filters (p7_MSVFilter_bounded()) only
+ * stop early this many nats clear of a threshold, so rounding in
+ * the threshold's inverse P-value can't flip a decision.
+ */
+#define p7_BOUND_SLACK 0.01
+
+/* Adaptive filter thresholds (see p7_pipeline_SetAdaptive()): every
+ * p7_ADAPT_WINDOW targets, a filter that passed more than
+ * p7_ADAPT_EXCESS times its expected fraction of them is tightened by
+ * half, down to 1/p7_ADAPT_MAXTIGHTEN of its original threshold.
+ */
+#define p7_ADAPT_WINDOW     1000
+#define p7_ADAPT_EXCESS     10.0
+#define p7_ADAPT_MAXTIGHTEN 16.0
+
 /* Struct used to pass a collection of useful temporary objects around
  * within the LongTarget functions
  *  */
@@ -33,6 +62,76 @@ typedef struct {
   float            *fwd_emissions_arr;
 } P7_PIPELINE_LONGTARGET_OBJS;
 
+/* pli_clock()
+ * Monotonic clock in ns for the optional per-stage timers; 0 (and no
+ * system call) when <pli> isn't timing.
+ */
+static inline uint64_t
+pli_clock(const P7_PIPELINE *pli)
+{
+  struct timespec ts;
+
+  if (! pli->do_timing) return 0;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/* pli_lenparam()
+ * The multihit N,C,J length parameters for target length <L>,
+ * recalculated only when <L> changes: in a scan, once per query,
+ * not once per model.
+ */
+static inline const P7_LENPARAM *
+pli_lenparam(P7_PIPELINE *pli, int L)
+{
+  if (pli->lenp.L != L) p7_LengthParams(&pli->lenp, L, 1.0f);
+  return &pli->lenp;
+}
+
+/* pli_nullone()
+ * The null1 score of a length <L> target under <bg>, recalculated
+ * only when <L> or bg->p1 changes: in a scan, once per query, not
+ * once per model. (The bias filter score can't be kept the same
+ * way; its filter HMM takes each model's composition.)
+ */
+static inline float
+pli_nullone(P7_PIPELINE *pli, const P7_BG *bg, const ESL_DSQ *dsq, int L)
+{
+  if (pli->null_L != L || pli->null_p1 != bg->p1)
+    {
+      p7_bg_NullOne(bg, dsq, L, &pli->null_sc);
+      pli->null_L  = L;
+      pli->null_p1 = bg->p1;
+    }
+  return pli->null_sc;
+}
+
+/* pli_filters_open()
+ * TRUE if the MSV, bias and Viterbi filters can't reject anything
+ * (--max, or F1 = F2 = 1 without the bias filter). Then they aren't
+ * run at all: every target goes straight to Forward.
+ */
+static inline int
+pli_filters_open(const P7_PIPELINE *pli)
+{
+  return (pli->F1 >= 1.0 && pli->F2 >= 1.0 && ! pli->do_biasfilter);
+}
+
+static int pipeline_trim_omx(P7_MXPOOL *pool, P7_OMX **ox);
+static int    pipeline_shrink_omx(P7_PIPELINE *pli, P7_OMX **ox);
+static size_t pli_memtotal(const P7_PIPELINE *pli);
+static void   pli_account_dp(P7_PIPELINE *pli);
+static void   pli_budget_ramlimit(P7_PIPELINE *pli);
+static size_t pli_hitsize(const P7_HIT *hit);
+static int  pli_longtarget_objs_Create(const P7_OPROFILE *om, const P7_BG *bg, P7_PIPELINE_LONGTARGET_OBJS **ret_pli_tmp);
+static void pli_longtarget_objs_Destroy(P7_PIPELINE_LONGTARGET_OBJS *pli_tmp);
+static int pipeline_main(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist, const float *opt_usc, const float *opt_nullsc);
+static int pipeline_filters(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const float *opt_usc, const float *opt_nullsc,
+			    float *ret_nullsc, float *ret_filtersc, int *ret_pass);
+static int pipeline_seqscore(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, P7_TOPHITS *hitlist, float fwdsc, float nullsc, float filtersc);
+static int pipeline_postfilter(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist,
+			       float nullsc, float filtersc);
+
 
 /*****************************************************************
  * 1. The P7_PIPELINE object: allocation, initialization, destruction.
@@ -86,6 +185,14 @@ typedef struct {
  *            | --nonull2    |  turn OFF biased comp score correction      |   FALSE   |
  *            | --seed       |  RNG seed (0=use arbitrary seed)            |      42   |
  *            | --acc        |  prefer accessions over names in output     |   FALSE   |
+ *            | --timing     |  time each stage (see p7_pli_Statistics())  |   FALSE   |
+ *            | --memstats   |  report memory high-water marks             |   FALSE   |
+ *            | --membudget  |  memory budget in MB, per pipeline          |    NULL   |
+ *            | --dd_threads |  domain definition threads (not nhmmer)     |       0   |
+ *            | --dd_ramlimit|  MB cap on envelope DP matrices (0: no cap) |       0   |
+ *            | --dd_nbatch  |  sample traces in batches of n (0: fixed)   |       0   |
+ *            | --dd_deferali|  align only reported targets (not nhmmer)   |   FALSE   |
+ *            | --dd_bf16    |  bfloat16 envelope Fwd/Bck matrices         |   FALSE   |
  *
  *            As a special case, if <go> is <NULL>, defaults are set as above.
  *            This shortcut is used in simplifying test programs and the like.
@@ -97,6 +204,27 @@ typedef struct {
  */
 P7_PIPELINE *
 p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targets, enum p7_pipemodes_e mode)
+{
+  return p7_pipeline_CreateInPool(NULL, go, M_hint, L_hint, long_targets, mode);
+}
+
+
+/* Function:  p7_pipeline_CreateInPool()
+ * Synopsis:  Create a new pipeline, borrowing its matrices from a pool.
+ *
+ * Purpose:   Same as <p7_pipeline_Create()>, except that the pipeline's
+ *            DP matrices are borrowed from <pool> (if it isn't
+ *            <NULL>), and <p7_pipeline_Destroy()> gives them back to
+ *            it. <p7_pipeline_Reuse()> also gives back any matrix that
+ *            has grown past the pool's trim size, in exchange for a
+ *            smaller one, so one unusually long target doesn't leave
+ *            the pipeline holding a huge matrix.
+ *
+ *            The pool must outlive the pipeline. A pool may be shared
+ *            by pipelines in different threads.
+ */
+P7_PIPELINE *
+p7_pipeline_CreateInPool(P7_MXPOOL *pool, const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targets, enum p7_pipemodes_e mode)
 {
   P7_PIPELINE *pli  = NULL;
   int          seed = (go ? esl_opt_GetInteger(go, "--seed") : 42);
@@ -106,11 +234,35 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
 
   pli->do_alignment_score_calc = 0;
   pli->long_targets = long_targets;
-
-  if ((pli->fwd = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
-  if ((pli->bck = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
-  if ((pli->oxf = p7_omx_Create(M_hint, 0,      L_hint)) == NULL) goto ERROR;
-  if ((pli->oxb = p7_omx_Create(M_hint, 0,      L_hint)) == NULL) goto ERROR;     
+  pli->window_maxlen = 0;
+  pli->fwd_windows.windows = NULL;
+  pli->fwd_windows.count   = 0;
+  pli->fwd_seqidx   = -1;
+  pli->lenp.L       = -1;
+  pli->null_L       = -1;
+  pli->msv_score    = -eslINFINITY;
+  pli->topk         = 0;
+  pli->ntopk        = 0;
+  pli->topk_heap    = NULL;
+  pli->n_topk_skipped = 0;
+  pli->n_max_skipped  = 0;
+
+  pli->mxpool = pool;
+  pli->fwd    = pli->bck = pli->oxf = pli->oxb = NULL;
+  if (pool)
+    {
+      if ((pli->fwd = p7_mxpool_GetOMX(pool, M_hint, L_hint, L_hint)) == NULL) goto ERROR;
+      if ((pli->bck = p7_mxpool_GetOMX(pool, M_hint, L_hint, L_hint)) == NULL) goto ERROR;
+      if ((pli->oxf = p7_mxpool_GetOMX(pool, M_hint, 0,      L_hint)) == NULL) goto ERROR;
+      if ((pli->oxb = p7_mxpool_GetOMX(pool, M_hint, 0,      L_hint)) == NULL) goto ERROR;
+    }
+  else
+    {
+      if ((pli->fwd = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
+      if ((pli->bck = p7_omx_Create(M_hint, L_hint, L_hint)) == NULL) goto ERROR;
+      if ((pli->oxf = p7_omx_Create(M_hint, 0,      L_hint)) == NULL) goto ERROR;
+      if ((pli->oxb = p7_omx_Create(M_hint, 0,      L_hint)) == NULL) goto ERROR;
+    }
 
   /* Normally, we reinitialize the RNG to the original seed every time we're
    * about to collect a stochastic trace ensemble. This eliminates run-to-run
@@ -121,6 +273,43 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
   pli->do_reseeding       = (seed == 0) ? FALSE : TRUE;
   pli->ddef               = p7_domaindef_Create(pli->r);
   pli->ddef->do_reseeding = pli->do_reseeding;
+  if (long_targets && p7_hmmwindow_init(&(pli->fwd_windows)) != eslOK) goto ERROR;
+
+  /* Domain definition on a long sequence with many regions can be spread
+   * over <--dd_threads> helper threads. (Not for nhmmer/nhmmscan, whose
+   * windows are already small.)
+   */
+  pli->ddef->nthreads     = ((go && ! long_targets) ? esl_opt_GetInteger(go, "--dd_threads") : 0);
+
+  /* Posterior decoding and OA alignment of a long envelope need two
+   * full O(ML) matrices. With <--dd_ramlimit> set (in MB),
+   * envelopes that would need more than that use O(M sqrt L)
+   * checkpointed matrices instead, at the cost of recomputation.
+   */
+  pli->ddef->ramlimit     = (go ? ESL_MBYTES((int64_t) esl_opt_GetInteger(go, "--dd_ramlimit")) : 0);
+
+  /* With <--dd_bf16>, envelope rescoring keeps its Forward
+   * and Backward matrices in bfloat16 (half the memory, no
+   * recomputation), unless even those exceed <--dd_ramlimit>. Scores are
+   * unchanged; posterior probabilities are good to about 2^-8.
+   */
+  pli->ddef->do_bf16      = ((go && esl_opt_GetBoolean(go, "--dd_bf16")) ? TRUE : FALSE);
+
+  /* Stochastic trace clustering of a multidomain region normally
+   * samples a fixed number of traces. With <--dd_nbatch> set,
+   * traces are sampled in batches of that many, and sampling stops
+   * as soon as two successive clusterings agree.
+   */
+  pli->ddef->nbatch       = (go ? esl_opt_GetInteger(go, "--dd_nbatch") : 0);
+
+  /* Domains are normally aligned as they're scored. With
+   * <--dd_deferali>, OA alignment waits until the target's
+   * score is known, and is only done for targets that make it into
+   * the hit list; it costs an extra envelope Forward/Backward for
+   * those, so it pays off when most targets past the filters aren't
+   * reported (strict -E/-T, or the --cut_* thresholds).
+   */
+  pli->ddef->defer_ali    = ((go && ! long_targets && esl_opt_GetBoolean(go, "--dd_deferali")) ? TRUE : FALSE);
 
   /* Configure reporting thresholds */
   pli->by_E            = TRUE;
@@ -229,6 +418,16 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
     }
   if (go && esl_opt_GetBoolean(go, "--nonull2")) pli->do_null2      = FALSE;
   if (go && esl_opt_GetBoolean(go, "--nobias"))  pli->do_biasfilter = FALSE;
+
+  pli->do_adapt    = FALSE;
+  pli->n_adapt     = 0;
+  pli->do_vitdom   = FALSE;
+  pli->n_vitdom    = 0;
+  pli->do_seqonly  = FALSE;
+  pli->adapt_bias  = FALSE;
+  pli->F1_orig     = pli->F1;
+  pli->F2_orig     = pli->F2;
+  pli->adapt_nseqs = pli->adapt_nbias = pli->adapt_nvit = 0;
   
 
   /* Accounting as we collect results */
@@ -244,10 +443,36 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
   pli->pos_past_bias   = 0;
   pli->pos_past_vit    = 0;
   pli->pos_past_fwd    = 0;
+  pli->n_fm_occ        = 0;
+  pli->n_past_fm       = 0;
+  pli->n_past_words    = 0;
+  pli->do_timing       = ((go && esl_opt_GetBoolean(go, "--timing")) ? TRUE : FALSE);
+  pli->ns_msv          = 0;
+  pli->ns_bias         = 0;
+  pli->ns_vit          = 0;
+  pli->ns_fwd          = 0;
+  pli->ns_dom          = 0;
+
+  /* Memory accounting is always done, and reported with
+   * <--memstats>. <--membudget> (in MB) sets a budget on it; see
+   * p7_pipeline_SetMemBudget().
+   */
+  pli->do_memstats     = ((go && esl_opt_GetBoolean(go, "--memstats")) ? TRUE : FALSE);
+  memset(pli->mem_cur,  0, sizeof(size_t) * p7_NMEMSYS);
+  memset(pli->mem_peak, 0, sizeof(size_t) * p7_NMEMSYS);
+  pli->mem_peaktot     = 0;
+  pli->mem_sumpeaks    = 0;
+  pli->mem_budget      = 0;
+  pli->mem_ramlimit    = pli->ddef->ramlimit;
+  if (go && esl_opt_IsOn(go, "--membudget")) p7_pipeline_SetMemBudget(pli, ESL_MBYTES((int64_t) esl_opt_GetInteger(go, "--membudget")));
+  pli_account_dp(pli);
+
   pli->mode            = mode;
   pli->show_accessions = (go && esl_opt_GetBoolean(go, "--acc")   ? TRUE  : FALSE);
   pli->show_alignments = (go && esl_opt_GetBoolean(go, "--noali") ? FALSE : TRUE);
   pli->hfp             = NULL;
+  pli->hcache          = NULL;
+  pli->words           = NULL;
   pli->errbuf[0]       = '\0';
 
   return pli;
@@ -271,6 +496,21 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
 int
 p7_pipeline_Reuse(P7_PIPELINE *pli)
 {
+  int status;
+
+  if (pli->mxpool && pli->mxpool->maxmx)
+    {
+      if ((status = pipeline_trim_omx(pli->mxpool, &(pli->oxf))) != eslOK) return status;
+      if ((status = pipeline_trim_omx(pli->mxpool, &(pli->oxb))) != eslOK) return status;
+      if ((status = pipeline_trim_omx(pli->mxpool, &(pli->fwd))) != eslOK) return status;
+      if ((status = pipeline_trim_omx(pli->mxpool, &(pli->bck))) != eslOK) return status;
+    }
+  if (pli->mem_budget > 0 && pli_memtotal(pli) > (size_t) pli->mem_budget)
+    {
+      if ((status = pipeline_shrink_omx(pli, &(pli->fwd))) != eslOK) return status;
+      if ((status = pipeline_shrink_omx(pli, &(pli->bck))) != eslOK) return status;
+      pli_account_dp(pli);
+    }
   p7_omx_Reuse(pli->oxf);
   p7_omx_Reuse(pli->oxb);
   p7_omx_Reuse(pli->fwd);
@@ -280,6 +520,84 @@ p7_pipeline_Reuse(P7_PIPELINE *pli)
 }
 
 
+/* Function:  p7_pipeline_ReuseQuery()
+ * Synopsis:  Reuse a pipeline for the next query.
+ *
+ * Purpose:   Reuse <pli>, which has finished a search, for another
+ *            query with the same options: as <p7_pipeline_Reuse()>,
+ *            and also reset what the search accumulated, as
+ *            <p7_pipeline_Create()> left it. The accounting and
+ *            timing counts are zeroed, the top-K heap is emptied,
+ *            adaptive filter thresholds go back to their original
+ *            values, and a Z or domZ that was set by the number of
+ *            targets goes back to 0. Memory peaks start again from
+ *            what the pipeline holds now.
+ *
+ *            Thresholds and other settings from the options are
+ *            kept, along with the matrices and domain definition
+ *            workspace, so a server answering many small queries
+ *            needn't create a pipeline for each one.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, as <p7_pipeline_Reuse()>.
+ */
+int
+p7_pipeline_ReuseQuery(P7_PIPELINE *pli)
+{
+  int m;
+  int status;
+
+  if ((status = p7_pipeline_Reuse(pli)) != eslOK) return status;
+
+  pli->fwd_seqidx     = -1;
+  pli->msv_score      = -eslINFINITY;
+  pli->ntopk          = 0;
+  pli->n_topk_skipped = 0;
+  pli->n_max_skipped  = 0;
+
+  if (pli->Z_setby    == p7_ZSETBY_NTARGETS) pli->Z    = 0.0;
+  if (pli->domZ_setby == p7_ZSETBY_NTARGETS) pli->domZ = 0.0;
+
+  if (pli->adapt_bias) pli->do_biasfilter = FALSE;  /* adaptation turned it on */
+  pli->F1          = pli->F1_orig;
+  pli->F2          = pli->F2_orig;
+  pli->n_adapt     = 0;
+  pli->adapt_bias  = FALSE;
+  pli->adapt_nseqs = pli->adapt_nbias = pli->adapt_nvit = 0;
+  pli->n_vitdom    = 0;
+
+  pli->nmodels       = 0;
+  pli->nseqs         = 0;
+  pli->nres          = 0;
+  pli->nnodes        = 0;
+  pli->n_past_msv    = 0;
+  pli->n_past_bias   = 0;
+  pli->n_past_vit    = 0;
+  pli->n_past_fwd    = 0;
+  pli->n_output      = 0;
+  pli->pos_past_msv  = 0;
+  pli->pos_past_bias = 0;
+  pli->pos_past_vit  = 0;
+  pli->pos_past_fwd  = 0;
+  pli->pos_output    = 0;
+  pli->n_fm_occ      = 0;
+  pli->n_past_fm     = 0;
+  pli->n_past_words  = 0;
+  pli->ns_msv        = 0;
+  pli->ns_bias       = 0;
+  pli->ns_vit        = 0;
+  pli->ns_fwd        = 0;
+  pli->ns_dom        = 0;
+
+  for (m = 0; m < p7_NMEMSYS; m++) pli->mem_peak[m] = pli->mem_cur[m];
+  pli->mem_peaktot  = pli_memtotal(pli);
+  pli->mem_sumpeaks = pli->mem_peaktot;
+  pli->ddef->nchk   = 0;
+  return eslOK;
+}
+
+
 
 /* Function:  p7_pipeline_Destroy()
  * Synopsis:  Free a <P7_PIPELINE> object.
@@ -291,14 +609,130 @@ p7_pipeline_Destroy(P7_PIPELINE *pli)
 {
   if (pli == NULL) return;
   
-  p7_omx_Destroy(pli->oxf);
-  p7_omx_Destroy(pli->oxb);
-  p7_omx_Destroy(pli->fwd);
-  p7_omx_Destroy(pli->bck);
+  if (pli->mxpool)
+    {
+      p7_mxpool_PutOMX(pli->mxpool, pli->oxf);
+      p7_mxpool_PutOMX(pli->mxpool, pli->oxb);
+      p7_mxpool_PutOMX(pli->mxpool, pli->fwd);
+      p7_mxpool_PutOMX(pli->mxpool, pli->bck);
+    }
+  else
+    {
+      p7_omx_Destroy(pli->oxf);
+      p7_omx_Destroy(pli->oxb);
+      p7_omx_Destroy(pli->fwd);
+      p7_omx_Destroy(pli->bck);
+    }
+  if (pli->fwd_windows.windows) free(pli->fwd_windows.windows);
+  if (pli->topk_heap)           free(pli->topk_heap);
   esl_randomness_Destroy(pli->r);
   p7_domaindef_Destroy(pli->ddef);
   free(pli);
 }
+
+
+/* pipeline_trim_omx()
+ * If matrix <*ox> has grown bigger than <pool>'s trim size, give it
+ * back (the pool frees it) and take a smaller one in its place, for
+ * the same model width.
+ */
+static int
+pipeline_trim_omx(P7_MXPOOL *pool, P7_OMX **ox)
+{
+  int M;
+
+  if (p7_omx_Sizeof(*ox) <= pool->maxmx) return eslOK;
+  M = (*ox)->allocQ4 * 4;
+  p7_mxpool_PutOMX(pool, *ox);
+  if ((*ox = p7_mxpool_GetOMX(pool, M, 0, 0)) == NULL) return eslEMEM;
+  return eslOK;
+}
+
+/* pipeline_shrink_omx()
+ * Over the memory budget: swap full matrix <*ox> for a minimal one of
+ * the same model width, back in the pool if it came from one.
+ */
+static int
+pipeline_shrink_omx(P7_PIPELINE *pli, P7_OMX **ox)
+{
+  int M = (*ox)->allocQ4 * 4;
+
+  if ((*ox)->allocR <= 1) return eslOK;
+  if (pli->mxpool)
+    {
+      p7_mxpool_PutOMX(pli->mxpool, *ox);
+      if ((*ox = p7_mxpool_GetOMX(pli->mxpool, M, 0, 0)) == NULL) return eslEMEM;
+    }
+  else
+    {
+      p7_omx_Destroy(*ox);
+      if ((*ox = p7_omx_Create(M, 0, 0)) == NULL) return eslEMEM;
+    }
+  return eslOK;
+}
+
+/* pli_memtotal()
+ * Current total of the memory <pli> accounts for.
+ */
+static size_t
+pli_memtotal(const P7_PIPELINE *pli)
+{
+  size_t n = 0;
+  int    m;
+
+  for (m = 0; m < p7_NMEMSYS; m++) n += pli->mem_cur[m];
+  return n;
+}
+
+/* pli_account_dp()
+ * Account for the DP matrices and the domain definition workspace,
+ * which have (maybe) just grown.
+ */
+static void
+pli_account_dp(P7_PIPELINE *pli)
+{
+  p7_pli_MemAccount(pli, p7_MEM_OMX, p7_omx_Sizeof(pli->oxf) + p7_omx_Sizeof(pli->oxb) + p7_omx_Sizeof(pli->fwd) + p7_omx_Sizeof(pli->bck));
+  p7_pli_MemAccount(pli, p7_MEM_DOMAINDEF, p7_domaindef_Sizeof(pli->ddef));
+}
+
+/* pli_budget_ramlimit()
+ * About to define domains: with a memory budget, envelopes whose
+ * full matrices won't fit in what's left of it are checkpointed
+ * instead. The envelope matrices <fwd> and <bck> themselves don't
+ * count against what's left, since they're what'd be regrown.
+ */
+static void
+pli_budget_ramlimit(P7_PIPELINE *pli)
+{
+  int64_t used, left;
+
+  if (pli->mem_budget <= 0) return;
+  used = (int64_t) pli_memtotal(pli) - (int64_t) (p7_omx_Sizeof(pli->fwd) + p7_omx_Sizeof(pli->bck));
+  left = ESL_MAX(1, pli->mem_budget - ESL_MAX(0, used));
+  pli->ddef->ramlimit = (pli->mem_ramlimit > 0 ? ESL_MIN(left, pli->mem_ramlimit) : left);
+}
+
+/* pli_hitsize()
+ * Approximate memory held by a new hit: the hit, its strings, its
+ * domain list and their alignment displays.
+ */
+static size_t
+pli_hitsize(const P7_HIT *hit)
+{
+  size_t n = sizeof(P7_HIT) + sizeof(P7_HIT *);
+  int    d;
+
+  if (hit->name) n += strlen(hit->name) + 1;
+  if (hit->acc)  n += strlen(hit->acc)  + 1;
+  if (hit->desc) n += strlen(hit->desc) + 1;
+  if (hit->dcl)
+    {
+      n += sizeof(P7_DOMAIN) * hit->ndom;
+      for (d = 0; d < hit->ndom; d++)
+	if (hit->dcl[d].ad) n += p7_alidisplay_Sizeof(hit->dcl[d].ad);
+    }
+  return n;
+}
 /*---------------- end, P7_PIPELINE object ----------------------*/
 
 
@@ -317,10 +751,19 @@ p7_pipeline_Destroy(P7_PIPELINE *pli)
  *            by more than <pct_overlap> percent, ensuring that windows
  *            stay within the bounds of 1..<L>.
  *
+ *            If <max_len> is >0, a merge that would make a window
+ *            longer than <max_len> isn't done (unless one window
+ *            already contains the other): the window ends there, and
+ *            the next one starts a new window that overlaps it. So on
+ *            a run of many close diagonals (e.g. in repeat-rich DNA),
+ *            the windows are split in the gaps between diagonals,
+ *            rather than merged into one huge window; each diagonal
+ *            still gets its entire extension.
+ *
  * Returns:   <eslOK>
  */
 int
-p7_pli_ExtendAndMergeWindows (P7_OPROFILE *om, const P7_SCOREDATA *data, P7_HMM_WINDOWLIST *windowlist, float pct_overlap) {
+p7_pli_ExtendAndMergeWindows (P7_OPROFILE *om, const P7_SCOREDATA *data, P7_HMM_WINDOWLIST *windowlist, float pct_overlap, int max_len) {
 
   int i;
   P7_HMM_WINDOW        *prev_window = NULL;
@@ -374,15 +817,18 @@ p7_pli_ExtendAndMergeWindows (P7_OPROFILE *om, const P7_SCOREDATA *data, P7_HMM_
     window_end   = ESL_MIN(prev_window->n+prev_window->length-1, curr_window->n+curr_window->length-1);
     window_len   = window_end - window_start + 1;
 
+    //length of the window if they're merged
+    window_start = ESL_MIN(prev_window->n, curr_window->n);
+    window_end   = ESL_MAX(prev_window->n+prev_window->length-1, curr_window->n+curr_window->length-1);
+
     if (  prev_window->complementarity == curr_window->complementarity &&
           prev_window->id == curr_window->id &&
-          (float)(window_len)/ESL_MIN(prev_window->length, curr_window->length) > pct_overlap // &&
+          (float)(window_len)/ESL_MIN(prev_window->length, curr_window->length) > pct_overlap &&
+          ( max_len <= 0 || window_end - window_start + 1 <= ESL_MAX(max_len, ESL_MAX(prev_window->length, curr_window->length)) )
           //curr_window->n + curr_window->length >=  prev_window->n + prev_window->length
           )
     {
       //merge windows
-      window_start        = ESL_MIN(prev_window->n, curr_window->n);
-      window_end          = ESL_MAX(prev_window->n+prev_window->length-1, curr_window->n+curr_window->length-1);
       prev_window->fm_n  -= (prev_window->n - window_start);
       prev_window->n      = window_start;
       prev_window->length = window_end - window_start + 1;
@@ -496,6 +942,7 @@ p7_pli_NewModel(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg)
   pli->nmodels++;
   pli->nnodes += om->M;
   if (pli->Z_setby == p7_ZSETBY_NTARGETS && pli->mode == p7_SCAN_MODELS) pli->Z = pli->nmodels;
+  p7_pli_MemAccount(pli, p7_MEM_OPROFILE, p7_oprofile_Sizeof((P7_OPROFILE *) om));
 
   if (pli->do_biasfilter) p7_bg_SetFilter(bg, om->M, om->compo);
 
@@ -503,6 +950,9 @@ p7_pli_NewModel(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg)
     status = p7_pli_NewModelThresholds(pli, om);
 
   pli->W = om->max_length;
+  pli->window_maxlen     = p7_WINDOW_MAXLEN_FACTOR * om->max_length;
+  pli->fwd_windows.count = 0;  // windows searched with another model don't count
+  pli->fwd_seqidx        = -1;
 
   return status;
 }
@@ -617,6 +1067,8 @@ p7_pli_NewSeq(P7_PIPELINE *pli, const ESL_SQ *sq)
 int
 p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
 {
+  int m;
+
   /* if we are searching a sequence database, we need to keep track of the
    * number of sequences and residues processed.
    */
@@ -642,6 +1094,35 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   p1->pos_past_vit  += p2->pos_past_vit;
   p1->pos_past_fwd  += p2->pos_past_fwd;
   p1->pos_output    += p2->pos_output;
+  p1->n_fm_occ      += p2->n_fm_occ;
+  p1->n_past_fm     += p2->n_past_fm;
+  p1->n_past_words  += p2->n_past_words;
+
+  p1->ns_msv  += p2->ns_msv;
+  p1->ns_bias += p2->ns_bias;
+  p1->ns_vit  += p2->ns_vit;
+  p1->ns_fwd  += p2->ns_fwd;
+  p1->ns_dom  += p2->ns_dom;
+
+  p1->n_topk_skipped += p2->n_topk_skipped;
+  p1->n_max_skipped  += p2->n_max_skipped;
+  p1->n_vitdom       += p2->n_vitdom;
+  p1->do_vitdom      |= p2->do_vitdom;
+  p1->do_seqonly     |= p2->do_seqonly;
+
+  /* Memory: the peaks of the biggest thread, and the sum over threads (bounding what they held at once) */
+  for (m = 0; m < p7_NMEMSYS; m++) p1->mem_peak[m] = ESL_MAX(p1->mem_peak[m], p2->mem_peak[m]);
+  p1->mem_peaktot   = ESL_MAX(p1->mem_peaktot, p2->mem_peaktot);
+  p1->mem_sumpeaks += p2->mem_sumpeaks;
+  p1->ddef->nchk   += p2->ddef->nchk;
+
+  if (p2->n_adapt > 0)
+    { /* threads adapt independently; report the tightest thresholds any of them reached */
+      p1->n_adapt    += p2->n_adapt;
+      p1->adapt_bias |= p2->adapt_bias;
+      p1->F1          = ESL_MIN(p1->F1, p2->F1);
+      p1->F2          = ESL_MIN(p1->F2, p2->F2);
+    }
 
   if (p1->Z_setby == p7_ZSETBY_NTARGETS)
     {
@@ -655,6 +1136,243 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
   return eslOK;
 }
 
+/* Function:  p7_pipeline_SetTopK()
+ * Synopsis:  Only report the best <topk> targets.
+ *
+ * Purpose:   Put pipeline <pli> in top-K mode, for a search where only
+ *            the <topk> best targets will be reported (hmmsearch
+ *            --topk, for example). The pipeline keeps a min-heap of
+ *            the sort keys of the best <topk> hits it has found so
+ *            far. Once it has <topk> of them, a target that passes
+ *            the Forward filter but whose Forward score shows it
+ *            can't beat the worst of them skips the Backward parser
+ *            and domain definition, the most expensive part of the
+ *            pipeline, and never becomes a hit.
+ *
+ *            The bound is the Forward score with no null2 correction.
+ *            The null2 correction only lowers a score, but the
+ *            per-domain reconstruction score (which replaces the
+ *            Forward score when it's better) isn't strictly bounded
+ *            by it, so targets within <p7_TOPK_SLACK> bits of the
+ *            cutoff still get the full treatment.
+ *
+ *            Each pipeline keeps its own heap. A thread's Kth best is
+ *            never better than the whole search's, so threads don't
+ *            need to share it. <p7_tophits_Threshold()> then reports
+ *            only the top <topk> of the merged hits. E-values are
+ *            unaffected, because Z still counts every target
+ *            searched.
+ *
+ *            <topk> of 0 turns top-K mode off.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_pipeline_SetTopK(P7_PIPELINE *pli, int topk)
+{
+  int status;
+
+  if (pli->topk_heap) { free(pli->topk_heap); pli->topk_heap = NULL; }
+  pli->topk  = topk;
+  pli->ntopk = 0;
+  if (topk > 0) ESL_ALLOC(pli->topk_heap, sizeof(double) * topk);
+  return eslOK;
+
+ ERROR:
+  pli->topk = 0;
+  return status;
+}
+
+/* Function:  p7_pipeline_SetAdaptive()
+ * Synopsis:  Tighten filter thresholds when too many targets pass.
+ *
+ * Purpose:   If <do_adapt> is TRUE, put search pipeline <pli> in
+ *            adaptive mode (hmmsearch --adapt, for example). The F1
+ *            (MSV and bias) and F2 (Viterbi) thresholds are P-values,
+ *            so on nonhomologous targets each filter should pass about
+ *            that fraction of them. Some queries, low complexity or
+ *            highly repetitive models, pass far more, and the
+ *            pipeline spends its time in Forward and Backward.
+ *
+ *            In adaptive mode, every <p7_ADAPT_WINDOW> targets, the
+ *            pass rates of the window are compared to F1 and F2. If
+ *            more than <p7_ADAPT_EXCESS> times F1 passed the bias
+ *            filter, the bias filter is turned on if it was off
+ *            (--nobias), or else F1 is halved. Likewise F2 is halved
+ *            if too many passed the Viterbi filter. Neither is taken
+ *            below 1/<p7_ADAPT_MAXTIGHTEN> of its original value.
+ *
+ *            This trades sensitivity for speed, and true homologs
+ *            inflate pass rates too: a database rich in the query's
+ *            family gets tighter filters. So it's off by default, and
+ *            <p7_pli_Statistics()> reports any adjustments. Each
+ *            thread's pipeline adapts on its own targets, so with
+ *            more than one thread, results can depend on which
+ *            targets each thread happened to get.
+ *
+ *            It has no effect in scan mode, with --max, or on
+ *            nhmmer's long-target pipeline.
+ */
+void
+p7_pipeline_SetAdaptive(P7_PIPELINE *pli, int do_adapt)
+{
+  pli->do_adapt    = (do_adapt && pli->mode == p7_SEARCH_SEQS && ! pli->long_targets && ! pli->do_max);
+  pli->F1_orig     = pli->F1;
+  pli->F2_orig     = pli->F2;
+  pli->adapt_nseqs = pli->nseqs;
+  pli->adapt_nbias = pli->n_past_bias;
+  pli->adapt_nvit  = pli->n_past_vit;
+}
+
+/* Function:  p7_pipeline_SetViterbiDomains()
+ * Synopsis:  Define single-domain targets by their Viterbi path.
+ *
+ * Purpose:   If <do_vitdom> is TRUE, a target that passes the Forward
+ *            filter gets <p7_domaindef_ByViterbi()> first (hmmsearch
+ *            --vitdom, for example): a Viterbi alignment of the whole
+ *            target, and if that has one domain, its range is the
+ *            domain's envelope, with no Backward pass over the
+ *            target, no posterior decoding and no stochastic trace
+ *            clustering. Targets whose Viterbi path has several
+ *            domains (or none) go through the usual posterior
+ *            heuristics. Per-sequence scores, and so which targets
+ *            are reported, don't change; domain boundaries and
+ *            scores may, a little, so it's off by default, for
+ *            high-throughput annotation. <p7_pli_Statistics()>
+ *            reports how many targets it took.
+ *
+ *            It has no effect on nhmmer's long-target pipeline, or
+ *            outside the SSE implementation.
+ */
+void
+p7_pipeline_SetViterbiDomains(P7_PIPELINE *pli, int do_vitdom)
+{
+  pli->do_vitdom = (do_vitdom && ! pli->long_targets);
+}
+
+/* Function:  p7_pipeline_SetSeqScoreOnly()
+ * Synopsis:  Score targets by Forward alone, with no domains.
+ *
+ * Purpose:   If <do_seqonly> is TRUE, a target that passes the Forward
+ *            filter is scored by its Forward score and goes into the
+ *            hit list with no domains (hmmsearch --seqscore_only):
+ *            there's no Backward pass, and no domain definition, which
+ *            is most of what the pipeline spends on the targets that
+ *            get that far. For presence/absence calls that only need
+ *            per-target scores and E-values.
+ *
+ *            The null2 correction needs posterior decoding, so in its
+ *            place (unless --nonull2) the score is corrected with the
+ *            bias filter's composition model, the same way; per-target
+ *            scores are close to the full pipeline's, but not the
+ *            same. Hits' best-domain columns and domain tables are
+ *            left empty.
+ *
+ *            It has no effect on nhmmer's long-target pipeline.
+ */
+void
+p7_pipeline_SetSeqScoreOnly(P7_PIPELINE *pli, int do_seqonly)
+{
+  pli->do_seqonly = (do_seqonly && ! pli->long_targets);
+}
+
+/* Function:  p7_pipeline_SetMemBudget()
+ * Synopsis:  Keep a pipeline's memory under a hard budget.
+ *
+ * Purpose:   Give pipeline <pli> a budget of <nbytes> for the memory
+ *            it accounts for (see <p7_pli_MemAccount()>). Rather than
+ *            grow its full DP matrices past the budget, domain
+ *            definition then rescores envelopes with checkpointed
+ *            $O(M \sqrt{L})$ matrices (as with <--dd_ramlimit>,
+ *            which still applies if it's lower), and a pipeline that
+ *            finds itself over budget after a target gives back its
+ *            grown envelope matrices. Results are unchanged; long
+ *            envelopes cost recomputation.
+ *
+ *            The budget can't shrink what isn't the pipeline's to
+ *            shrink: the profile, the targets, and hits already found
+ *            are counted, but a search whose hits alone exceed the
+ *            budget still grows. It's also per pipeline, so per
+ *            thread.
+ *
+ *            <nbytes> of 0 turns the budget off.
+ */
+void
+p7_pipeline_SetMemBudget(P7_PIPELINE *pli, int64_t nbytes)
+{
+  pli->mem_budget = ESL_MAX(0, nbytes);
+  if (pli->mem_budget == 0) pli->ddef->ramlimit = pli->mem_ramlimit;
+}
+
+/* pli_adapt()
+ * A window of targets has gone by in adaptive mode: tighten the
+ * filters that passed too many of them (see p7_pipeline_SetAdaptive()),
+ * and start a new window. <L> is the length of the target about to be
+ * filtered: turning the bias filter on resets its filter HMM to the
+ * default length, so the target's length has to be set again.
+ */
+static void
+pli_adapt(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg, int L)
+{
+  double n = (double) (pli->nseqs - pli->adapt_nseqs);
+
+  if ((double) (pli->n_past_bias - pli->adapt_nbias) > p7_ADAPT_EXCESS * pli->F1 * n)
+    {
+      if (! pli->do_biasfilter)
+	{
+	  pli->do_biasfilter = pli->adapt_bias = TRUE;
+	  p7_bg_SetFilter(bg, om->M, om->compo);
+	  p7_bg_SetLength(bg, L);
+	  pli->n_adapt++;
+	}
+      else if (pli->F1 > pli->F1_orig / p7_ADAPT_MAXTIGHTEN)
+	{
+	  pli->F1 *= 0.5;
+	  pli->n_adapt++;
+	}
+    }
+
+  if ((double) (pli->n_past_vit - pli->adapt_nvit) > p7_ADAPT_EXCESS * pli->F2 * n && pli->F2 > pli->F2_orig / p7_ADAPT_MAXTIGHTEN)
+    {
+      pli->F2 *= 0.5;
+      pli->n_adapt++;
+    }
+
+  pli->adapt_nseqs = pli->nseqs;
+  pli->adapt_nbias = pli->n_past_bias;
+  pli->adapt_nvit  = pli->n_past_vit;
+}
+
+/* topk_push()
+ * A hit with sort key <key> was found: keep it in <pli>'s heap of
+ * the best <topk> sort keys so far, if it belongs there.
+ */
+static void
+topk_push(P7_PIPELINE *pli, double key)
+{
+  double *h = pli->topk_heap;
+  int     i, c;
+
+  if (pli->ntopk < pli->topk)
+    {
+      for (i = pli->ntopk++; i > 0 && h[(i-1)/2] > key; i = (i-1)/2)
+	h[i] = h[(i-1)/2];
+      h[i] = key;
+    }
+  else if (key > h[0])
+    {
+      for (i = 0; (c = 2*i+1) < pli->ntopk; i = c)
+	{
+	  if (c+1 < pli->ntopk && h[c+1] < h[c]) c++;
+	  if (h[c] >= key) break;
+	  h[i] = h[c];
+	}
+      h[i] = key;
+    }
+}
+
 /* Function:  p7_Pipeline()
  * Synopsis:  HMMER3's accelerated seq/profile comparison pipeline.
  *
@@ -696,41 +1414,116 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
 int
 p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist)
 {
-  P7_HIT          *hit     = NULL;     /* ptr to the current hit output data      */
-  float            usc, vfsc, fwdsc;   /* filter scores                           */
+  return pipeline_main(pli, om, bg, sq, ntsq, hitlist, NULL, NULL);
+}
+
+/* pipeline_main()
+ * The body of p7_Pipeline(). The block pipelines may already have
+ * calculated the MSV filter score <*opt_usc> and/or the null model
+ * score <*opt_nullsc> for this comparison; if so, they aren't
+ * calculated again. Results are identical either way.
+ */
+static int
+pipeline_main(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist, const float *opt_usc, const float *opt_nullsc)
+{
+  float nullsc, filtersc;
+  int   pass;
+  int   status;
+
+  if ((status = pipeline_filters(pli, om, bg, sq, opt_usc, opt_nullsc, &nullsc, &filtersc, &pass)) != eslOK) return status;
+  if (! pass) return eslOK;
+  return pipeline_postfilter(pli, om, bg, sq, ntsq, hitlist, nullsc, filtersc);
+}
+
+/* pipeline_filters()
+ * The first stage of the pipeline: the word seed prefilter, MSV,
+ * bias and Viterbi filters, which all stream through the target with
+ * the one-row matrix <pli->oxf>. Sets <*ret_pass> TRUE if the target
+ * goes on to pipeline_postfilter(), and then also returns the null
+ * model score in <*ret_nullsc> and the bias filter null score in
+ * <*ret_filtersc>, which that stage needs.
+ */
+static int
+pipeline_filters(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const float *opt_usc, const float *opt_nullsc,
+		 float *ret_nullsc, float *ret_filtersc, int *ret_pass)
+{
+  float            usc, vfsc;          /* filter scores                           */
   float            filtersc;           /* HMM null filter score                   */
   float            nullsc;             /* null model score                        */
-  float            seqbias;  
   float            seq_score;          /* the corrected per-seq bit score */
-  float            sum_score;           /* the corrected reconstruction score for the seq */
-  float            pre_score, pre2_score; /* uncorrected bit scores for seq */
+#if defined (eslENABLE_SSE)
+  float            lo, hi;             /* bounded filters' reject, accept scores  */
+#endif
+  int              usc_lb = FALSE;     /* TRUE if <usc> is only a lower bound     */
   double           P;                /* P-value of a hit */
-  double           lnP;              /* log P-value of a hit */
-  int              Ld;               /* # of residues in envelopes */
-  int              d;
+  uint64_t         t0, t1;           /* stage timer marks (if pli->do_timing) */
   int              status;
   
+  *ret_pass      = FALSE;
+  pli->msv_score = -eslINFINITY;
   if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
   if (sq->n > 100000) ESL_EXCEPTION(eslETYPE, "Target sequence length > 100K, over comparison pipeline limit.\n(Did you mean to use nhmmer/nhmmscan?)");
+  if (pli->do_adapt && pli->nseqs - pli->adapt_nseqs >= p7_ADAPT_WINDOW) pli_adapt(pli, om, bg, sq->n);
+
+  /* Optional word seed prefilter (phmmer --wordk): no query word neighbour, no MSV */
+  if (pli->words)
+    {
+      if (! p7_wordseeds_Hit(pli->words, sq->dsq, sq->n)) return eslOK;
+      pli->n_past_words++;
+    }
 
+  t0 = pli_clock(pli);
   p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);    /* expand the one-row omx if needed */
 
-  /* Base null model score (we could calculate this in NewSeq(), for a scan pipeline) */
-  p7_bg_NullOne  (bg, sq->dsq, sq->n, &nullsc);
+  /* Base null model score: once per query in a scan (pli_nullone()) */
+  if (opt_nullsc) nullsc = *opt_nullsc;
+  else            nullsc = pli_nullone(pli, bg, sq->dsq, sq->n);
 
-  /* First level filter: the MSV filter, multihit with <om> */
-  p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+  /* First level filter: the MSV filter, multihit with <om>. The
+   * bounded filter stops once the score is certain to fail F1, or to
+   * pass min(F1,F2): then <usc> is only a bound on it, but one that
+   * gives the same decisions here and, without the bias filter, at
+   * the Viterbi stage too.
+   */
+  p7_PROBE2(msv__start, sq->n, om->M);
+  if      (opt_usc)                usc = *opt_usc;
+  else if (pli_filters_open(pli))  usc = -eslINFINITY;  /* P = 1: passes F1, and Viterbi is skipped */
+  else
+    {
+#if defined (eslENABLE_SSE)
+      P  = ESL_MIN(pli->F1, pli->F2);
+      lo = (pli->F1 < 1.0) ? nullsc + eslCONST_LOG2 * esl_gumbel_invsurv(pli->F1, om->evparam[p7_MMU], om->evparam[p7_MLAMBDA]) - p7_BOUND_SLACK : -eslINFINITY;
+      hi = (P       < 1.0) ? nullsc + eslCONST_LOG2 * esl_gumbel_invsurv(P,       om->evparam[p7_MMU], om->evparam[p7_MLAMBDA]) + p7_BOUND_SLACK :  eslINFINITY;
+      p7_MSVFilter_bounded(sq->dsq, sq->n, om, pli->oxf, lo, hi, &usc);
+      usc_lb = (usc >= hi);
+#else
+      p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+#endif
+    }
   seq_score = (usc - nullsc) / eslCONST_LOG2;
+  pli->msv_score = seq_score;
   P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+  t1 = pli_clock(pli); pli->ns_msv += t1 - t0; t0 = t1;
+  p7_PROBE3(msv__done, sq->n, om->M, (P <= pli->F1));
   if (P > pli->F1) return eslOK;
   pli->n_past_msv++;
 
   /* biased composition HMM filtering */
   if (pli->do_biasfilter)
     {
+      p7_PROBE2(bias__start, sq->n, om->M);
       p7_bg_FilterScore(bg, sq->dsq, sq->n, &filtersc);
       seq_score = (usc - filtersc) / eslCONST_LOG2;
       P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+      if (usc_lb && P > ESL_MIN(pli->F1, pli->F2))  /* the bound doesn't settle this filter or the Viterbi skip; finish the MSV score */
+	{
+	  p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+	  pli->msv_score = (usc - nullsc) / eslCONST_LOG2;
+	  seq_score      = (usc - filtersc) / eslCONST_LOG2;
+	  P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+	}
+      t1 = pli_clock(pli); pli->ns_bias += t1 - t0; t0 = t1;
+      p7_PROBE3(bias__done, sq->n, om->M, (P <= pli->F1));
       if (P > pli->F1) return eslOK;
     }
   else filtersc = nullsc;
@@ -739,55 +1532,206 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   /* In scan mode, if it passes the MSV filter, read the rest of the profile */
   if (pli->mode == p7_SCAN_MODELS)
     {
-      if (pli->hfp) p7_oprofile_ReadRest(pli->hfp, om);
-      p7_oprofile_ReconfigRestLength(om, sq->n);
+      if      (pli->hcache) { if ((status = p7_hmmcache_GetRest(pli->hcache, om, pli->errbuf)) != eslOK) return status; }
+      else if (pli->hfp)    p7_oprofile_ReadRest(pli->hfp, om);
+      p7_oprofile_SetRestLength(om, pli_lenparam(pli, sq->n));
       if ((status = p7_pli_NewModelThresholds(pli, om)) != eslOK) return status; /* pli->errbuf has err msg set */
     }
 
   /* Second level filter: ViterbiFilter(), multihit with <om> */
   if (P > pli->F2)
     {
+      p7_PROBE2(vit__start, sq->n, om->M);
+#if defined (eslENABLE_SSE)
+      lo = filtersc + eslCONST_LOG2 * esl_gumbel_invsurv(pli->F2, om->evparam[p7_VMU], om->evparam[p7_VLAMBDA]);
+      p7_ViterbiFilter_bounded(sq->dsq, sq->n, om, pli->oxf, lo - p7_BOUND_SLACK, lo + p7_BOUND_SLACK, &vfsc);
+#else
       p7_ViterbiFilter(sq->dsq, sq->n, om, pli->oxf, &vfsc);  
+#endif
       seq_score = (vfsc-filtersc) / eslCONST_LOG2;
       P  = esl_gumbel_surv(seq_score,  om->evparam[p7_VMU],  om->evparam[p7_VLAMBDA]);
+      t1 = pli_clock(pli); pli->ns_vit += t1 - t0; t0 = t1;
+      p7_PROBE3(vit__done, sq->n, om->M, (P <= pli->F2));
       if (P > pli->F2) return eslOK;
     }
   pli->n_past_vit++;
 
+  *ret_nullsc   = nullsc;
+  *ret_filtersc = filtersc;
+  *ret_pass     = TRUE;
+  return eslOK;
+}
 
-  /* Parse it with Forward and obtain its real Forward score. */
-  p7_ForwardParser(sq->dsq, sq->n, om, pli->oxf, &fwdsc);
-  seq_score = (fwdsc-filtersc) / eslCONST_LOG2;
-  P = esl_exp_surv(seq_score,  om->evparam[p7_FTAU],  om->evparam[p7_FLAMBDA]);
-  if (P > pli->F3) return eslOK;
-  pli->n_past_fwd++;
-
-  /* ok, it's for real. Now a Backwards parser pass, and hand it to domain definition workflow */
-  p7_omx_GrowTo(pli->oxb, om->M, 0, sq->n);
-  p7_BackwardParser(sq->dsq, sq->n, om, pli->oxf, pli->oxb, NULL);
-
-  status = p7_domaindef_ByPosteriorHeuristics(sq, ntsq, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, FALSE, NULL, NULL, NULL);
-  if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen  */
-  if (pli->ddef->nregions   == 0) return eslOK; /* score passed threshold but there's no discrete domains here       */
-  if (pli->ddef->nenvelopes == 0) return eslOK; /* rarer: region was found, stochastic clustered, no envelopes found */
-  if (pli->ddef->ndom       == 0) return eslOK; /* even rarer: envelope found, no domain identified {iss131}         */
-
+/* pipeline_seqscore()
+ * The rest of pipeline_postfilter() in score-only mode (see
+ * p7_pipeline_SetSeqScoreOnly()): hit <sq>, with Forward score <fwdsc>,
+ * if it is reportable on that alone. The bias filter's composition
+ * model stands in for null2, weighted by omega the same way.
+ */
+static int
+pipeline_seqscore(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, P7_TOPHITS *hitlist,
+		  float fwdsc, float nullsc, float filtersc)
+{
+  P7_HIT  *hit = NULL;
+  float    seqbias;
+  float    pre_score, seq_score;
+  double   lnP;
+  int      status;
 
-  /* Calculate the null2-corrected per-seq score */
   if (pli->do_null2)
     {
-      seqbias = esl_vec_FSum(pli->ddef->n2sc, sq->n+1);
-      seqbias = p7_FLogsum(0.0, log(bg->omega) + seqbias);
+      if (! pli->do_biasfilter) p7_bg_FilterScore(bg, sq->dsq, sq->n, &filtersc);
+      seqbias = p7_FLogsum(0.0, log(bg->omega) + (filtersc - nullsc));
     }
   else seqbias = 0.0;
-  pre_score =  (fwdsc - nullsc) / eslCONST_LOG2; 
-  seq_score =  (fwdsc - (nullsc + seqbias)) / eslCONST_LOG2;
+  pre_score = (fwdsc - nullsc) / eslCONST_LOG2;
+  seq_score = (fwdsc - (nullsc + seqbias)) / eslCONST_LOG2;
 
-  
-  /* Calculate the "reconstruction score": estimated
-   * per-sequence score as sum of individual domains,
-   * discounting domains that aren't significant after they're
-   * null-corrected.
+  lnP = esl_exp_logsurv(seq_score, om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
+  if (! p7_pli_TargetReportable(pli, seq_score, lnP)) return eslOK;
+
+  p7_tophits_CreateNextHit(hitlist, &hit);
+  if (pli->mode == p7_SEARCH_SEQS) {
+    if ((status = p7_tophits_SetHitStrings(hitlist, hit, sq->name, (sq->acc[0] != '\0' ? sq->acc : NULL), (sq->desc[0] != '\0' ? sq->desc : NULL))) != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+  } else {
+    if ((status = p7_tophits_SetHitStrings(hitlist, hit, om->name, om->acc, om->desc)) != eslOK) esl_fatal("allocation failure");
+  }
+  hit->ndom        = 0;
+  hit->dcl         = NULL;
+  hit->best_domain = 0;
+
+  hit->pre_score   = pre_score; /* BITS */
+  hit->pre_lnP     = esl_exp_logsurv(pre_score, om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
+  hit->score       = seq_score; /* BITS */
+  hit->lnP         = lnP;
+  hit->sortkey     = pli->inc_by_E ? -lnP : seq_score;
+  if (pli->topk > 0) topk_push(pli, hit->sortkey);
+  hit->sum_score   = seq_score;
+  hit->sum_lnP     = lnP;
+  p7_pli_MemAccount(pli, p7_MEM_TOPHITS, pli->mem_cur[p7_MEM_TOPHITS] + pli_hitsize(hit));
+
+  /* model-specific bit score cutoffs are applied now; see pipeline_postfilter() */
+  if (pli->use_bit_cutoffs && p7_pli_TargetReportable(pli, hit->score, hit->lnP))
+    {
+      hit->flags |= p7_IS_REPORTED;
+      if (p7_pli_TargetIncludable(pli, hit->score, hit->lnP))
+	hit->flags |= p7_IS_INCLUDED;
+    }
+  return eslOK;
+}
+
+/* pipeline_postfilter()
+ * The second stage: Forward, Backward, domain definition and the hit
+ * list, for a target that passed pipeline_filters() with null scores
+ * <nullsc> and <filtersc>. <bg> and <om> must still be configured for
+ * its length.
+ */
+static int
+pipeline_postfilter(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist,
+		    float nullsc, float filtersc)
+{
+  P7_HIT          *hit     = NULL;     /* ptr to the current hit output data      */
+  float            fwdsc;              /* Forward score                           */
+  float            seqbias;  
+  float            seq_score;          /* the corrected per-seq bit score */
+  float            sum_score;           /* the corrected reconstruction score for the seq */
+  float            pre_score, pre2_score; /* uncorrected bit scores for seq */
+  double           P;                /* P-value of a hit */
+  double           lnP;              /* log P-value of a hit */
+  int              Ld;               /* # of residues in envelopes */
+  int              d;
+  uint64_t         t0, t1;           /* stage timer marks (if pli->do_timing) */
+  int              status;
+
+  t0 = pli_clock(pli);
+  p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);
+
+  /* Parse it with Forward and obtain its real Forward score. */
+  p7_PROBE2(fwd__start, sq->n, om->M);
+  p7_ForwardParser(sq->dsq, sq->n, om, pli->oxf, &fwdsc);
+  seq_score = (fwdsc-filtersc) / eslCONST_LOG2;
+  P = esl_exp_surv(seq_score,  om->evparam[p7_FTAU],  om->evparam[p7_FLAMBDA]);
+  t1 = pli_clock(pli); pli->ns_fwd += t1 - t0; t0 = t1;
+  p7_PROBE3(fwd__done, sq->n, om->M, (P <= pli->F3));
+  if (P > pli->F3) return eslOK;
+  pli->n_past_fwd++;
+
+  /* With --max, almost every target gets this far, and most are
+   * nowhere near the reporting threshold. Skip Backward and domain
+   * definition for one that couldn't be reported even with
+   * p7_TOPK_SLACK bits more than its uncorrected Forward score: it
+   * would never go into the hit list. (When Z is the number of
+   * targets, the Z here is the count so far, no more than the final
+   * one, so this can only err toward keeping a target.)
+   */
+  if (pli->do_max)
+    {
+      float bound = (fwdsc - nullsc) / eslCONST_LOG2 + p7_TOPK_SLACK;
+      if (! p7_pli_TargetReportable(pli, bound, esl_exp_logsurv(bound, om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA])))
+	{ pli->n_max_skipped++; return eslOK; }
+    }
+
+  /* Top-K mode: skip Backward and domain definition for a target that
+   * can't make the top K (see p7_pipeline_SetTopK()). Sort keys are
+   * bit scores, or -lnP when inclusion is by E-value.
+   */
+  if (pli->topk > 0 && pli->ntopk == pli->topk)
+    {
+      float  bound = (fwdsc - nullsc) / eslCONST_LOG2 + p7_TOPK_SLACK;
+      double key   = pli->inc_by_E ? -esl_exp_logsurv(bound, om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]) : bound;
+      if (key < pli->topk_heap[0]) { pli->n_topk_skipped++; return eslOK; }
+    }
+
+  if (pli->do_seqonly) return pipeline_seqscore(pli, om, bg, sq, hitlist, fwdsc, nullsc, filtersc);
+
+  /* Alignment displays go straight into the hit list's arena; if this
+   * target turns out not to be reportable, we rewind the arena below.
+   */
+  if (hitlist->arena) p7_arena_SetMark(hitlist->arena);
+  pli_budget_ramlimit(pli);
+  pli->ddef->arena = hitlist->arena;
+
+  /* With --vitdom, a target whose Viterbi path has one domain is done here */
+  p7_PROBE2(dom__start, sq->n, om->M);
+  status = eslENORESULT;
+  if (pli->do_vitdom)
+    {
+      status = p7_domaindef_ByViterbi(sq, ntsq, om, pli->fwd, pli->bck, pli->ddef, bg);
+      if (status == eslOK) pli->n_vitdom++;
+    }
+
+  /* ok, it's for real. Now a Backwards parser pass, and hand it to domain definition workflow */
+  if (status == eslENORESULT)
+    {
+      p7_omx_GrowTo(pli->oxb, om->M, 0, sq->n);
+      p7_BackwardParser(sq->dsq, sq->n, om, pli->oxf, pli->oxb, NULL);
+      status = p7_domaindef_ByPosteriorHeuristics(sq, ntsq, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, FALSE, NULL, NULL, NULL);
+    }
+  pli->ddef->arena = NULL;
+  pli->ns_dom += pli_clock(pli) - t0;
+  p7_PROBE3(dom__done, sq->n, om->M, pli->ddef->ndom);
+  pli_account_dp(pli);
+  if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen  */
+  if (pli->ddef->nregions   == 0) return eslOK; /* score passed threshold but there's no discrete domains here       */
+  if (pli->ddef->nenvelopes == 0) return eslOK; /* rarer: region was found, stochastic clustered, no envelopes found */
+  if (pli->ddef->ndom       == 0) return eslOK; /* even rarer: envelope found, no domain identified {iss131}         */
+
+
+  /* Calculate the null2-corrected per-seq score */
+  if (pli->do_null2)
+    {
+      seqbias = esl_vec_FSum(pli->ddef->n2sc, sq->n+1);
+      seqbias = p7_FLogsum(0.0, log(bg->omega) + seqbias);
+    }
+  else seqbias = 0.0;
+  pre_score =  (fwdsc - nullsc) / eslCONST_LOG2; 
+  seq_score =  (fwdsc - (nullsc + seqbias)) / eslCONST_LOG2;
+
+  
+  /* Calculate the "reconstruction score": estimated
+   * per-sequence score as sum of individual domains,
+   * discounting domains that aren't significant after they're
+   * null-corrected.
    */
   sum_score = 0.0f;
   seqbias   = 0.0f;
@@ -837,15 +1781,22 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   lnP =  esl_exp_logsurv (seq_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
   if (p7_pli_TargetReportable(pli, seq_score, lnP))
     {
+      /* With deferred alignment, now's when the domains get aligned */
+      if (pli->ddef->defer_ali)
+	{
+	  t0 = pli_clock(pli);
+	  pli->ddef->arena = hitlist->arena;
+	  status = p7_domaindef_Align(sq, ntsq, om, pli->fwd, pli->bck, pli->ddef);
+	  pli->ddef->arena = NULL;
+	  pli->ns_dom += pli_clock(pli) - t0;
+	  if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain alignment failure");
+	}
+
       p7_tophits_CreateNextHit(hitlist, &hit);
       if (pli->mode == p7_SEARCH_SEQS) {
-        if (                       (status  = esl_strdup(sq->name, -1, &(hit->name)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (sq->acc[0]  != '\0' && (status  = esl_strdup(sq->acc,  -1, &(hit->acc)))   != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
-        if (sq->desc[0] != '\0' && (status  = esl_strdup(sq->desc, -1, &(hit->desc)))  != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
+        if ((status = p7_tophits_SetHitStrings(hitlist, hit, sq->name, (sq->acc[0] != '\0' ? sq->acc : NULL), (sq->desc[0] != '\0' ? sq->desc : NULL))) != eslOK) ESL_EXCEPTION(eslEMEM, "allocation failure");
       } else {
-        if ((status  = esl_strdup(om->name, -1, &(hit->name)))  != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->acc,  -1, &(hit->acc)))   != eslOK) esl_fatal("allocation failure");
-        if ((status  = esl_strdup(om->desc, -1, &(hit->desc)))  != eslOK) esl_fatal("allocation failure");
+        if ((status = p7_tophits_SetHitStrings(hitlist, hit, om->name, om->acc, om->desc)) != eslOK) esl_fatal("allocation failure");
       } 
       hit->ndom       = pli->ddef->ndom;
       hit->nexpected  = pli->ddef->nexpected;
@@ -860,6 +1811,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
       hit->score      = seq_score; /* BITS */
       hit->lnP        = lnP;
       hit->sortkey    = pli->inc_by_E ? -lnP : seq_score; /* per-seq output sorts on bit score if inclusion is by score  */
+      if (pli->topk > 0) topk_push(pli, hit->sortkey);
 
       hit->sum_score  = sum_score; /* BITS */
       hit->sum_lnP    = esl_exp_logsurv (hit->sum_score,  om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
@@ -885,6 +1837,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
 
         if (hit->dcl[d].bitscore > hit->dcl[hit->best_domain].bitscore) hit->best_domain = d;
       }
+      p7_pli_MemAccount(pli, p7_MEM_TOPHITS, pli->mem_cur[p7_MEM_TOPHITS] + pli_hitsize(hit));
 
       /* If we're using model-specific bit score thresholds (GA | TC |
        * NC) and we're in an hmmscan pipeline (mode = p7_SCAN_MODELS),
@@ -931,12 +1884,264 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
       }
 	  
     }
+  else if (hitlist->arena)
+    {
+      /* Not reported: drop its arena alignment displays from the
+       * domaindef (p7_domaindef_Reuse() would no-op on them anyway),
+       * and give their space back.
+       */
+      for (d = 0; d < pli->ddef->ndom; d++)
+	if (pli->ddef->dcl[d].ad != NULL && pli->ddef->dcl[d].ad->in_arena) pli->ddef->dcl[d].ad = NULL;
+      p7_arena_Rewind(hitlist->arena);
+    }
 
   return eslOK;
 }
 
 
 
+/* Function:  p7_Pipeline_Block()
+ * Synopsis:  Run the search pipeline on a block of target sequences.
+ *
+ * Purpose:   Compare profile <om> against each target sequence in
+ *            <block>, in order, exactly as if the caller did
+ *            <p7_pli_NewSeq()>, <p7_bg_SetLength()>,
+ *            <p7_oprofile_ReconfigLength()>, <p7_Pipeline()> and
+ *            <p7_pipeline_Reuse()> for each one. That's what
+ *            hmmsearch's worker threads do for each block they get;
+ *            this lets the pipeline see the whole block at once.
+ *
+ *            When the model is short (<om->M> $\leq$
+ *            <p7_SSVMULTI_MAXM>) and the host supports the
+ *            inter-sequence SSV filter, the SSV part of the MSV
+ *            filter is calculated for the whole block first, with
+ *            one target sequence per vector lane
+ *            (<p7_SSVFilter_multi()>). Striped filters waste most of
+ *            their vector width on short models. With a GPU
+ *            (<p7_impl_HaveGPU()>), blocks of at least
+ *            <p7_GPU_MINBATCH> targets get the same batch SSV step
+ *            for any model length, on the GPU. Scores and hits are
+ *            the same as with the one-at-a-time loop.
+ *
+ *            The rest of the pipeline runs in two stages. First the
+ *            filters (MSV, bias, Viterbi), which stream through each
+ *            target with a one-row matrix, run over the whole block;
+ *            then Forward, Backward and domain definition, with
+ *            their much larger matrices, run on the survivors, in
+ *            block order. Each stage then keeps its own working set
+ *            in cache over many targets, instead of the domain
+ *            matrices evicting the filter profile at every target
+ *            that survives. The reported hits and the pipeline's
+ *            counts are the same as with one target at a time. (When
+ *            Z is the number of targets, hits are kept on a lower
+ *            bound E-value that has already counted the whole block,
+ *            so fewer of those that won't be reported get kept.)
+ *
+ *            The caller still owns the sequences in <block>; this
+ *            doesn't <esl_sq_Reuse()> them.
+ *
+ * Returns:   <eslOK> on success. Otherwise, the first nonzero status
+ *            returned by <p7_Pipeline()>. As in the one-at-a-time
+ *            loop, the remaining targets in the block are still
+ *            processed.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and any exception
+ *            thrown by <p7_Pipeline()>.
+ */
+int
+p7_Pipeline_Block(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ_BLOCK *block, P7_TOPHITS *hitlist)
+{
+  const ESL_DSQ **dsq = NULL;
+  int            *L   = NULL;
+  int            *idx = NULL;   /* idx[i]: index of block->list[i] in the SSV batch, or -1 */
+  uint8_t        *xE  = NULL;
+  int            *surv = NULL;  /* surv[0..nsurv-1]: indices of the targets that passed the filters */
+  float          *snull = NULL; /*   ... and their null model scores */
+  float          *sfilt = NULL; /*   ... and bias filter null scores */
+  float           usc;
+  int             nseq  = 0;
+  int             nsurv = 0;
+  int             pass;
+  int             i, s;
+  int             pstatus;
+  uint64_t        t0;
+  size_t          nbytes = sizeof(ESL_SQ_BLOCK);
+  int             status = eslOK;
+
+  for (i = 0; i < block->count; i++)
+    nbytes += sizeof(ESL_SQ) + block->list[i].salloc + block->list[i].nalloc + block->list[i].aalloc + block->list[i].dalloc + block->list[i].srcalloc;
+  p7_pli_MemAccount(pli, p7_MEM_SEQS, nbytes);
+
+#if defined (eslENABLE_SSE)
+  if (! pli_filters_open(pli) &&
+      ((om->M <= p7_SSVMULTI_MAXM && impl_HaveAVX2() && block->count > 1) ||
+       (block->count >= p7_GPU_MINBATCH && p7_impl_HaveGPU())))
+    {
+      t0 = pli_clock(pli);
+      ESL_ALLOC(dsq, sizeof(ESL_DSQ *) * block->count);
+      ESL_ALLOC(L,   sizeof(int)       * block->count);
+      ESL_ALLOC(idx, sizeof(int)       * block->count);
+      ESL_ALLOC(xE,  sizeof(uint8_t)   * block->count);
+
+      /* Targets that p7_Pipeline() skips or rejects stay out of the batch */
+      for (i = 0; i < block->count; i++)
+	if (block->list[i].n > 0 && block->list[i].n <= 100000)
+	  {
+	    dsq[nseq] = block->list[i].dsq;
+	    L[nseq]   = block->list[i].n;
+	    idx[i]    = nseq++;
+	  }
+	else idx[i] = -1;
+
+      if ((status = p7_SSVFilter_multi(dsq, L, nseq, om, xE)) != eslOK) goto ERROR;
+      pli->ns_msv += pli_clock(pli) - t0;
+    }
+#endif
+
+  if (block->count > 0)
+    {
+      ESL_ALLOC(surv,  sizeof(int)   * block->count);
+      ESL_ALLOC(snull, sizeof(float) * block->count);
+      ESL_ALLOC(sfilt, sizeof(float) * block->count);
+    }
+
+  /* Stage 1: the filters, over the whole block */
+  for (i = 0; i < block->count; i++)
+    {
+      const ESL_SQ *sq = block->list + i;
+
+      p7_pli_NewSeq(pli, sq);
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+
+#if defined (eslENABLE_SSE)
+      /* Finish the batched SSV score; if the J state might have been used, p7_Pipeline() runs the full MSV filter */
+      if (idx && idx[i] >= 0 && p7_SSVFilter_Score(xE[idx[i]], om, &usc) != eslENORESULT)
+	pstatus = pipeline_filters(pli, om, bg, sq, &usc, NULL, &(snull[nsurv]), &(sfilt[nsurv]), &pass);
+      else
+#endif
+	pstatus = pipeline_filters(pli, om, bg, sq, NULL, NULL, &(snull[nsurv]), &(sfilt[nsurv]), &pass);
+      if (pstatus != eslOK && status == eslOK) status = pstatus;
+
+      if (pass) surv[nsurv++] = i;
+      else      p7_pipeline_Reuse(pli);
+    }
+
+  /* Stage 2: Forward, Backward and domain definition, on the survivors */
+  for (s = 0; s < nsurv; s++)
+    {
+      const ESL_SQ *sq = block->list + surv[s];
+
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+      pstatus = pipeline_postfilter(pli, om, bg, sq, NULL, hitlist, snull[s], sfilt[s]);
+      if (pstatus != eslOK && status == eslOK) status = pstatus;
+
+      p7_pipeline_Reuse(pli);
+    }
+
+ ERROR:
+  if (dsq)   free(dsq);
+  if (L)     free(L);
+  if (idx)   free(idx);
+  if (xE)    free(xE);
+  if (surv)  free(surv);
+  if (snull) free(snull);
+  if (sfilt) free(sfilt);
+  return status;
+}
+
+
+/* Function:  p7_Pipeline_ScanBlock()
+ * Synopsis:  Run the scan pipeline on a block of profiles.
+ *
+ * Purpose:   Compare query sequence <sq> against each profile in
+ *            <block>, in order, as if the caller did
+ *            <p7_pli_NewModel()>, <p7_bg_SetLength()>,
+ *            <p7_oprofile_ReconfigLength()>, <p7_Pipeline()> and
+ *            <p7_pipeline_Reuse()> for each one. That's what
+ *            hmmscan's worker threads do with each block they get
+ *            from <p7_oprofile_ReadBlockMSV()>.
+ *
+ *            Seeing the whole block lets the MSV stage run as one
+ *            tight pass over the profiles with the query held in
+ *            cache. The null model score, which only depends on the
+ *            query, is calculated once per block instead of once per
+ *            profile, and only the MSV part of each
+ *            profile is configured for the query length, from
+ *            length parameters calculated once per query
+ *            (<p7_LengthParams()>). Only the
+ *            MSV survivors (typically ~2%) go on to the rest of the
+ *            pipeline, which does the rest of the configuration.
+ *            Scores and hits are the same as with the
+ *            one-at-a-time loop.
+ *
+ *            <pli> must be a <p7_SCAN_MODELS> pipeline. The caller
+ *            still owns the profiles in <block>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslEINVAL> if a profile lacks the GA/TC/NC cutoffs
+ *            we've been asked to use, with a message in
+ *            <pli->errbuf>; we stop at that profile. Otherwise, the
+ *            first other nonzero status returned by <p7_Pipeline()>
+ *            (the remaining profiles are still processed).
+ *
+ * Throws:    Any exception thrown by <p7_Pipeline()>.
+ */
+int
+p7_Pipeline_ScanBlock(P7_PIPELINE *pli, P7_OM_BLOCK *block, P7_BG *bg, const ESL_SQ *sq, P7_TOPHITS *hitlist)
+{
+  P7_OPROFILE *om;
+  float        nullsc;
+  float        usc;
+  float        seq_score;
+  double       P;
+  int          i;
+  int          pstatus;
+  uint64_t     t0;
+  int          status = eslOK;
+
+  p7_bg_SetLength(bg, sq->n);
+  if (sq->n > 0 && sq->n <= 100000)    /* otherwise p7_Pipeline() skips or rejects it, below */
+    nullsc = pli_nullone(pli, bg, sq->dsq, sq->n);
+
+  for (i = 0; i < block->count; i++)
+    {
+      om = block->list[i];
+      p7_pli_NewModel(pli, om, bg);
+      p7_bg_SetLength(bg, sq->n);  /* after NewModel(), which resets the filter HMM to its default length */
+
+      if (sq->n == 0 || sq->n > 100000)
+	{
+	  p7_oprofile_ReconfigLength(om, sq->n);
+	  pstatus = p7_Pipeline(pli, om, bg, sq, NULL, hitlist);
+	}
+      else if (pli_filters_open(pli))
+	pstatus = pipeline_main(pli, om, bg, sq, NULL, hitlist, NULL, &nullsc);
+      else
+	{
+	  /* First level filter, before any per-model work beyond the MSV length config */
+	  t0 = pli_clock(pli);
+	  p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);
+	  p7_oprofile_SetMSVLength(om, pli_lenparam(pli, sq->n));
+	  p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+	  seq_score = (usc - nullsc) / eslCONST_LOG2;
+	  P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
+	  pli->ns_msv += pli_clock(pli) - t0;
+	  if (P > pli->F1) continue;
+
+	  pstatus = pipeline_main(pli, om, bg, sq, NULL, hitlist, &usc, &nullsc);
+	}
+      if (pstatus == eslEINVAL) return pstatus;
+      if (pstatus != eslOK && status == eslOK) status = pstatus;
+
+      p7_pipeline_Reuse(pli);
+    }
+  return status;
+}
+
+
 /* Function:  p7_pli_computeAliScores()
  * Synopsis:  Compute per-position scores for the alignment for a domain
  *
@@ -1076,6 +2281,7 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
   float            seq_score;          /* the corrected per-seq bit score */
   double           P;               /* P-value of a hit */
   int              d;
+  uint64_t         t0;              /* stage timer mark (if pli->do_timing) */
   int              status;
 //  int              nres;
   ESL_DSQ          *dsq_holder;
@@ -1102,7 +2308,9 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
   p7_oprofile_ReconfigRestLength(om, window_len);
 
   /* Parse with Forward and obtain its real Forward score. */
+  t0 = pli_clock(pli);
   p7_ForwardParser(subseq, window_len, om, pli->oxf, &fwdsc);
+  pli->ns_fwd += pli_clock(pli) - t0;
   filtersc =  nullsc + (bias_filtersc * ( F3_L>window_len ? 1.0 : (float)F3_L/window_len) );
   seq_score = (fwdsc - filtersc) / eslCONST_LOG2;
   P = esl_exp_surv(seq_score,  om->evparam[p7_FTAU],  om->evparam[p7_FLAMBDA]);
@@ -1124,12 +2332,16 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
 
   /* Now a Backwards parser pass, and hand it to domain definition workflow
    * In this case "domains" will end up being translated as independent "hits" */
+  t0 = pli_clock(pli);
   p7_omx_GrowTo(pli->oxb, om->M, 0, window_len);
   p7_BackwardParser(subseq, window_len, om, pli->oxf, pli->oxb, NULL);
 
   //if we're asked to not do null correction, pass a NULL instead of a temp scores variable - domaindef knows what to do
+  pli_budget_ramlimit(pli);
   status = p7_domaindef_ByPosteriorHeuristics(pli_tmp->tmpseq, NULL, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, TRUE,
                                               pli_tmp->bg, (pli->do_null2?pli_tmp->scores:NULL), pli_tmp->fwd_emissions_arr);
+  pli->ns_dom += pli_clock(pli) - t0;
+  pli_account_dp(pli);
 
   pli_tmp->tmpseq->dsq = dsq_holder;
   if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen */
@@ -1243,6 +2455,7 @@ p7_pli_postViterbi_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_T
         if ((status  = esl_strdup(om->acc,  -1, &(hit->acc)))   != eslOK) esl_fatal("allocation failure");
         if ((status  = esl_strdup(om->desc, -1, &(hit->desc)))  != eslOK) esl_fatal("allocation failure");
       }
+      p7_pli_MemAccount(pli, p7_MEM_TOPHITS, pli->mem_cur[p7_MEM_TOPHITS] + pli_hitsize(hit));
 
 
       /* If using model-specific thresholds, filter now.  See notes in front
@@ -1277,6 +2490,59 @@ ERROR:
 }
 
 
+/* pli_fwdwindow_NewBlock()
+ * A block of sequence <seqidx> (ReadWindow()'s window <sq>) is about
+ * to go through the long target pipeline: drop the windows Forward
+ * saw that end before it starts. The ones left (from the overlap
+ * with the preceding block) are what pli_fwdwindow_Seen() checks
+ * against.
+ */
+static void
+pli_fwdwindow_NewBlock(P7_PIPELINE *pli, int64_t seqidx, const ESL_SQ *sq)
+{
+  if (pli->fwd_windows.windows == NULL) return;
+
+  if (pli->fwd_seqidx != seqidx) {
+    pli->fwd_windows.count = 0;
+    pli->fwd_seqidx        = seqidx;
+  } else {
+    p7_hmmwindow_Prune(&(pli->fwd_windows), ESL_MIN(sq->start, sq->end));
+  }
+}
+
+/* pli_fwdwindow_Seen()
+ * Returns TRUE if the window of length <length> that starts at
+ * position <n> of the sequence handed to the pipeline (which starts
+ * at <seq_start> of sequence <seqidx>, on strand <complementarity>)
+ * is inside a window that's already been passed to Forward: e.g. it
+ * was found again in the overlap of two consecutive blocks, or in
+ * two overlapping windows from p7_pli_ExtendAndMergeWindows(). If
+ * not, record the window (in sequence coordinates) and return FALSE.
+ */
+static int
+pli_fwdwindow_Seen(P7_PIPELINE *pli, int64_t seqidx, int complementarity, int64_t seq_start, int64_t n, int length)
+{
+  P7_HMM_WINDOW *window;
+  int64_t        lo;
+
+  if (pli->fwd_windows.windows == NULL) return FALSE;
+
+  if (pli->fwd_seqidx != seqidx) {
+    pli->fwd_windows.count = 0;
+    pli->fwd_seqidx        = seqidx;
+  }
+
+  // same conversion as the hit coordinates in p7_pli_postViterbi_LongTarget()
+  lo = (complementarity == p7_NOCOMPLEMENT ? seq_start + n - 1 : seq_start - n - length + 2);
+
+  if (p7_hmmwindow_Covered(&(pli->fwd_windows), complementarity, lo, length)) return TRUE;
+
+  window = p7_hmmwindow_new(&(pli->fwd_windows), 0, 0, 0, 0, length, 0.0, complementarity, 0);
+  if (window != NULL) window->n = lo;  // (if it can't be recorded, it just won't be skipped later)
+  return FALSE;
+}
+
+
 /* Function:  p7_pli_postSSV_LongTarget()
  * Synopsis:  the part of the LongTarget P7 search Pipeline downstream
  *            of the SSV filter
@@ -1339,6 +2605,7 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
   float            bias_filtersc;      /* HMM null filter score                   */
   float            seq_score;          /* the corrected per-seq bit score */
   double           P;                  /* P-value of a hit */
+  uint64_t         t0;                 /* stage timer mark (if pli->do_timing) */
   int i;
   int overlap;
   uint64_t new_n;
@@ -1354,8 +2621,10 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
 
   //initial bias filter, based on the input window_len
   if (pli->do_biasfilter) {
+      t0 = pli_clock(pli);
       p7_bg_SetLength(bg, window_len);
       p7_bg_FilterScore(bg, subseq, window_len, &bias_filtersc);
+      pli->ns_bias += pli_clock(pli) - t0;
       bias_filtersc -= nullsc; // doing this because I'll be modifying the bias part of filtersc based on length, then adding nullsc back in.
       filtersc =  nullsc + (bias_filtersc * (float)(( F1_L>window_len ? 1.0 : (float)F1_L/window_len)));
       seq_score = (usc - filtersc) / eslCONST_LOG2;
@@ -1369,25 +2638,31 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
   //establish a possibly shorter target window parameterization
   loc_window_len = ESL_MIN(window_len,om->max_length);
 
-  //compute the new nullsc based on possibly shorter window
-  p7_bg_SetLength(bg, loc_window_len);
-  p7_bg_NullOne  (bg, subseq, loc_window_len, &nullsc);
+  //compute the new nullsc based on possibly shorter window; the
+  //passed one already is the window_len one
+  if (loc_window_len != window_len) {
+    p7_bg_SetLength(bg, loc_window_len);
+    p7_bg_NullOne  (bg, subseq, loc_window_len, &nullsc);
+  }
 
   // bias_filtersc has already been reduced by nullsc based on window_len
   // We compute a --B2-scaled bias, then tack on the nullsc based on the new,
   // possibly shorter length model
   filtersc =  nullsc + (bias_filtersc * ( F2_L>window_len ? 1.0 : (float)F2_L/window_len) );
 
-  //Then configure the model length based on the possibly shorter window length
-  p7_oprofile_ReconfigRestLength(om, loc_window_len);
+  //Then configure the model length based on the possibly shorter window length,
+  //unless the last window already left it there
+  if (om->L != loc_window_len) p7_oprofile_ReconfigRestLength(om, loc_window_len);
 
   /* Second level filter: ViterbiFilter(), multihit with <om> */
   p7_omx_GrowTo(pli->oxf, om->M, 0, window_len);
 
   //use window_len instead of loc_window_len, because length parameterization is done, just need to loop over subseq
+  t0 = pli_clock(pli);
   p7_ViterbiFilter_longtarget(subseq, window_len, om, pli->oxf, filtersc, pli->F2, vit_windowlist);
+  pli->ns_vit += pli_clock(pli) - t0;
 
-  p7_pli_ExtendAndMergeWindows (om, data, vit_windowlist, 0.5);
+  p7_pli_ExtendAndMergeWindows (om, data, vit_windowlist, 0.5, pli->window_maxlen);
 
   // if a window is still too long (>80Kb), need to split it up to
   // ensure numeric stability in Fwd.
@@ -1416,6 +2691,12 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
     if (i>0)
       pli->pos_past_vit -= ESL_MAX(0,  vit_windowlist->windows[i-1].n + vit_windowlist->windows[i-1].length - vit_windowlist->windows[i].n );
 
+    //skip a window Forward has already seen all of
+    if (pli_fwdwindow_Seen(pli, seqidx, complementarity, seq_start, window_start+vit_windowlist->windows[i].n-1, vit_windowlist->windows[i].length)) {
+      overlap = 0;
+      continue;
+    }
+
     p7_pli_postViterbi_LongTarget(pli, om, bg, hitlist, data, seqidx,
         window_start+vit_windowlist->windows[i].n-1, vit_windowlist->windows[i].length,
         subseq + vit_windowlist->windows[i].n - 1,
@@ -1440,118 +2721,100 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
 
 
 
-/* Function:  p7_Pipeline_LongTarget()
- * Synopsis:  Accelerated seq/profile comparison pipeline for long target sequences.
- *
- * Purpose:   Run HMMER's accelerated pipeline to compare profile <om>
- *            against sequence <sq>. If a significant hit is found,
- *            information about it is added to the <hitlist>. This is
- *            a variant of p7_Pipeline that runs one of two
- *            alternative SSV filters
- *              (1) the scanning SSV filter (p7_SSVFilter_longtarget) that scans
- *              a long sequence and finds high-scoring regions (windows), or
- *              (2) the FM-index-based SSV filter that finds modest-scoring
- *              diagonals using the FM-index, and extends them to maximum-
- *              scoring diagonals subjected to the SSV filter thresholds
- *
- *            Windows passing the appropriate SSV filter are then passed
- *            to the remainder of the pipeline. The pipeline accumulates
- *            bean counting information about how many comparisons and
- *            residues flow through the pipeline while it's active.
- *
- * Returns:   <eslOK> on success. If a significant hit is obtained,
- *            its information is added to the growing <hitlist>.
- *
- *            <eslEINVAL> if (in a scan pipeline) we're supposed to
- *            set GA/TC/NC bit score thresholds but the model doesn't
- *            have any.
- *
- *            <eslERANGE> on numerical overflow errors in the
- *            optimized vector implementations; particularly in
- *            posterior decoding. We don't believe this is possible for
- *            multihit local models, but we're set up to catch it
- *            anyway. We may emit a warning to the user, but cleanly
- *            skip the problematic sequence and continue.
- *
- * Args:      pli             - the main pipeline object
- *            om              - optimized profile (query)
- *            data            - for computing diagonals, and picking window edges based
- *                              on maximum prefix/suffix extensions
- *            bg              - background model
- *            hitlist         - pointer to hit storage bin (already allocated)
- *
- *            :: the next three values are assigned if a standard sequence database is being used. If FM database is used, they are ignored
- *            seqidx          - the id # of the sequence from which the current window was extracted
- *            sq              - digital sequence of the window
- *            complementarity - is <sq> from the top strand (p7_NOCOMPLEMENT), or bottom strand (P7_COMPLEMENT)
- *
- *            :: the next three are assigned if an FM database is being used. If standard sequence is used, they are set to NULL.
- *            fmf             - the FM_DATA for forward-strand search
- *            fmb             - the FM_DATA for reverse-strand (complement) search
- *            fm_cfg          - general FM configuration
- *
- * Throws:    <eslEMEM> on allocation failure.
+/* pli_longtarget_objs_Create(), pli_longtarget_objs_Destroy()
+ * The temporary objects that one strand's pass of the long target
+ * pipeline passes around to its windows.
  */
-int
-p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
-                        P7_BG *bg, P7_TOPHITS *hitlist,
-                        int64_t seqidx, const ESL_SQ *sq, int complementarity,
-                        const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg
-                        )
+static int
+pli_longtarget_objs_Create(const P7_OPROFILE *om, const P7_BG *bg, P7_PIPELINE_LONGTARGET_OBJS **ret_pli_tmp)
 {
-  int              i;
-  int              status;
-  float            nullsc;   /* null model score                        */
-  float            usc;      /* msv score  */
-  float            P;
-  float            bias_filtersc;
-
-  ESL_DSQ          *subseq;
-  uint64_t         seq_start;
-
-
-  P7_HMM_WINDOWLIST msv_windowlist;
-  P7_HMM_WINDOWLIST vit_windowlist;
-  P7_HMM_WINDOW    *window;
-  FM_SEQDATA        seq_data;
-
-  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp;
-
-  if ((sq && (sq->n == 0)) || (fmf && (fmf->N == 0))) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
-
+  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp = NULL;
+  int status;
 
   ESL_ALLOC(pli_tmp, sizeof(P7_PIPELINE_LONGTARGET_OBJS));
   pli_tmp->tmpseq = NULL;
+  pli_tmp->scores = NULL;
+  pli_tmp->fwd_emissions_arr = NULL;
   pli_tmp->bg = p7_bg_Clone(bg);
   pli_tmp->om = p7_oprofile_Create(om->M, om->abc);
   ESL_ALLOC(pli_tmp->scores, sizeof(float) * om->abc->Kp * 4); //allocation of space to store scores that will be used in p7_oprofile_Update(Fwd|Vit|MSV)EmissionScores
   ESL_ALLOC(pli_tmp->fwd_emissions_arr, sizeof(float) *  om->abc->Kp * (om->M+1));
 
-  msv_windowlist.windows = NULL;
-  vit_windowlist.windows = NULL;
-  p7_hmmwindow_init(&msv_windowlist);
-
-  p7_omx_GrowTo(pli->oxf, om->M, 0, om->max_length);    /* expand the one-row omx if needed */
-
-  /* Set false target length. This is a conservative estimate of the length of window that'll
-   * soon be passed on to later phases of the pipeline;  used to recover some bits of the score
-   * that we would miss if we left length parameters set to the full target length */
-  p7_oprofile_ReconfigMSVLength(om, om->max_length);
+  *ret_pli_tmp = pli_tmp;
+  return eslOK;
 
+ ERROR:
+  pli_longtarget_objs_Destroy(pli_tmp);
+  *ret_pli_tmp = NULL;
+  return status;
+}
 
-  /* First level filter: the SSV filter, with <om>.
-   * This variant of SSV will scan a long sequence and find
-   * short high-scoring regions.
-   */
-  if (fmf) // using an FM-index
-    p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, pli->strands, pli->r, &msv_windowlist );
-  else // compare directly to sequence
-    p7_SSVFilter_longtarget(sq->dsq, sq->n, om, pli->oxf, data, bg, pli->F1, &msv_windowlist);
+static void
+pli_longtarget_objs_Destroy(P7_PIPELINE_LONGTARGET_OBJS *pli_tmp)
+{
+  if (pli_tmp != NULL) {
+    if (pli_tmp->tmpseq != NULL) esl_sq_Destroy(pli_tmp->tmpseq);
+    if (pli_tmp->bg != NULL)     p7_bg_Destroy(pli_tmp->bg);
+    if (pli_tmp->om != NULL)     p7_oprofile_Destroy(pli_tmp->om);
+    if (pli_tmp->scores != NULL)        free (pli_tmp->scores);
+    if (pli_tmp->fwd_emissions_arr != NULL) free (pli_tmp->fwd_emissions_arr);
+    free(pli_tmp);
+  }
+}
+
+/* pli_revcomp_window()
+ * Put the residues <n..n+len-1> of the reverse complement of DNA
+ * sequence <sq> in <rcsq->dsq[1..len]>, without reverse complementing
+ * the rest of <sq>.
+ */
+static int
+pli_revcomp_window(const ESL_SQ *sq, int64_t n, int len, ESL_SQ *rcsq)
+{
+  const ESL_DSQ *compl = sq->abc->complement;
+  int64_t        i;
+  int            status;
+
+  if ((status = esl_sq_GrowTo(rcsq, len)) != eslOK) return status;
+
+  rcsq->dsq[0] = eslDSQ_SENTINEL;
+  for (i = 1; i <= len; i++)
+    rcsq->dsq[i] = compl[sq->dsq[sq->n + 2 - n - i]];  // residue n+i-1 of the revcomp is the complement of residue sq->n+1-(n+i-1)
+  rcsq->dsq[len+1] = eslDSQ_SENTINEL;
+  rcsq->n = rcsq->L = len;
+  return eslOK;
+}
+
+/* pli_longtarget_windows()
+ * The part of p7_Pipeline_LongTarget() after the SSV filter: extend and
+ * merge the windows in <msv_windowlist>, and pass each of them on to the
+ * rest of the pipeline. If <rc_windows> is TRUE, the windows are on the
+ * reverse complement of <sq> (p7_Pipeline_LongTargetDual()), and each
+ * is reverse complemented on its own before it's searched.
+ */
+static int
+pli_longtarget_windows(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data, P7_BG *bg, P7_TOPHITS *hitlist,
+                       int64_t seqidx, const ESL_SQ *sq, int complementarity, int rc_windows,
+                       const FM_DATA *fmf, FM_CFG *fm_cfg, P7_HMM_WINDOWLIST *msv_windowlist,
+                       P7_PIPELINE_LONGTARGET_OBJS *pli_tmp)
+{
+  int              i;
+  int              status;
+  float            nullsc;   /* null model score                        */
+  float            usc;      /* msv score  */
+  float            P;
 
+  ESL_DSQ          *subseq;
+  uint64_t         seq_start;
+
+  P7_HMM_WINDOWLIST vit_windowlist;
+  P7_HMM_WINDOW    *window;
+  FM_SEQDATA        seq_data;
+
+  vit_windowlist.windows = NULL;
 
   /* convert hits to windows, merging neighboring windows
    */
-  if ( msv_windowlist.count > 0 ) {
+  if ( msv_windowlist->count > 0 ) {
 
     /* In scan mode, if it passes the MSV filter, read the rest of the profile */
     if (!fmf && pli->hfp)
@@ -1564,19 +2827,19 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
 
     p7_oprofile_GetFwdEmissionArray(om, bg, pli_tmp->fwd_emissions_arr);
 
-    if (data->prefix_lengths == NULL)  // otherwise, already filled in
-      p7_hmm_ScoreDataComputeRest(om, data);
+    if (data->prefix_lengths == NULL)  // otherwise, already filled in; a <data> shared by threads must be
+      p7_hmm_ScoreDataComputeRest(om, data);   // ... filled in before they start, as nhmmer does
 
-    p7_pli_ExtendAndMergeWindows (om, data, &msv_windowlist, 0);
+    p7_pli_ExtendAndMergeWindows (om, data, msv_windowlist, 0, pli->window_maxlen);
 
     /*  If using FM, it's possible for a seed we just created to span more than one segment
      *  in the target. Check for this, and resolve it, by trimming an over-extended
      *  segment, and tacking it on as a new window (to be dealt with in a later pass)
      */
     if (fmf) {
-      for (i=0; i<msv_windowlist.count; i++) {
+      for (i=0; i<msv_windowlist->count; i++) {
         int again = TRUE;
-        window = msv_windowlist.windows + i;
+        window = msv_windowlist->windows + i;
 
         while (again) {
           uint32_t seg_id;
@@ -1595,8 +2858,8 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
             use_length = window->length - overext + 1;
 
             if (use_length >= 8 && window->length >= 8) { // if both halves are kinda long, split the first half off as a new window
-              p7_hmmwindow_new(&msv_windowlist, seg_id + (is_compl?-1:1), window->n, window->fm_n, window->k+use_length-1, use_length, window->score, window->complementarity, fm_cfg->meta->seq_data[seg_id].length);
-              window = msv_windowlist.windows + i; // it may have moved due a a realloc
+              p7_hmmwindow_new(msv_windowlist, seg_id + (is_compl?-1:1), window->n, window->fm_n, window->k+use_length-1, use_length, window->score, window->complementarity, fm_cfg->meta->seq_data[seg_id].length);
+              window = msv_windowlist->windows + i; // it may have moved due a a realloc
               window->k      +=  use_length;
               window->length  =  overext;
               again         = TRUE;
@@ -1615,24 +2878,27 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
   /* Pass each remaining window on to the remaining pipeline */
     p7_hmmwindow_init(&vit_windowlist);
     pli_tmp->tmpseq = esl_sq_CreateDigital(om->abc);
-    if (!fmf )
+    if (!fmf && !rc_windows)
       free (pli_tmp->tmpseq->dsq);  //this ESL_SQ object is just a container that'll point to a series of other DSQs, so free the one we just created inside the larger SQ object
 
 
-    for (i=0; i<msv_windowlist.count; i++){
-      window =  msv_windowlist.windows + i ;
+    for (i=0; i<msv_windowlist->count; i++){
+      window =  msv_windowlist->windows + i ;
 
       if (fmf) {
         fm_convertRange2DSQ( fmf, fm_cfg->meta, window->fm_n, window->length, window->complementarity, pli_tmp->tmpseq, TRUE );
         subseq = pli_tmp->tmpseq->dsq;
+      } else if (rc_windows) {
+        if ((status = pli_revcomp_window(sq, window->n, window->length, pli_tmp->tmpseq)) != eslOK) goto ERROR;
+        subseq = pli_tmp->tmpseq->dsq;
       } else {
         subseq = sq->dsq + window->n - 1;
       }
 
+      /* The bias filter score is left to p7_pli_postSSV_LongTarget(), for the windows that pass MSV */
       p7_bg_SetLength(bg, window->length);
       p7_bg_NullOne  (bg, subseq, window->length, &nullsc);
 
-      p7_bg_FilterScore(bg, subseq, window->length, &bias_filtersc);
       // Compute standard MSV to ensure that bias doesn't overcome SSV score when MSV
       // would have survived it
       p7_oprofile_ReconfigMSVLength(om, window->length);
@@ -1652,7 +2918,7 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
       status = p7_pli_postSSV_LongTarget(pli, om, bg, hitlist, data,
             (fmf != NULL ? seq_data.target_id     : seqidx),
             window->n, window->length, subseq,
-            (fmf != NULL ? seq_start       : sq->start),
+            (fmf != NULL ? seq_start       : (rc_windows ? sq->end : sq->start)), // sq->end is where the revcomp starts
             (fmf != NULL ? seq_data.name   : sq->name),
             (fmf != NULL ? seq_data.source : sq->source),
             (fmf != NULL ? seq_data.acc    : sq->acc),
@@ -1668,41 +2934,242 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
 
     }
 
-    if (fmf)  free (pli_tmp->tmpseq->dsq);
+    if (fmf || rc_windows)  free (pli_tmp->tmpseq->dsq);
 
     pli_tmp->tmpseq->dsq = NULL;  //it's a pointer to a dsq object belonging to another sequence
 
     esl_sq_Destroy(pli_tmp->tmpseq);
+    pli_tmp->tmpseq = NULL;
     free (vit_windowlist.windows);
   }
 
-  if (msv_windowlist.windows != NULL) free (msv_windowlist.windows);
 
-  if (pli_tmp != NULL) {
-    if (pli_tmp->bg != NULL)     p7_bg_Destroy(pli_tmp->bg);
-    if (pli_tmp->om != NULL)     p7_oprofile_Destroy(pli_tmp->om);
-    if (pli_tmp->scores != NULL)        free (pli_tmp->scores);
-    if (pli_tmp->fwd_emissions_arr != NULL) free (pli_tmp->fwd_emissions_arr);
-    free(pli_tmp);
+  return eslOK;
+
+ERROR:
+  if (vit_windowlist.windows != NULL) free (vit_windowlist.windows);
+  if (pli_tmp->tmpseq != NULL) {
+    if (!fmf && !rc_windows) pli_tmp->tmpseq->dsq = NULL;  // points into <sq>
+    esl_sq_Destroy(pli_tmp->tmpseq);
+    pli_tmp->tmpseq = NULL;
   }
+  return status;
+}
+
 
+/* Function:  p7_Pipeline_LongTarget()
+ * Synopsis:  Accelerated seq/profile comparison pipeline for long target sequences.
+ *
+ * Purpose:   Run HMMER's accelerated pipeline to compare profile <om>
+ *            against sequence <sq>. If a significant hit is found,
+ *            information about it is added to the <hitlist>. This is
+ *            a variant of p7_Pipeline that runs one of two
+ *            alternative SSV filters
+ *              (1) the scanning SSV filter (p7_SSVFilter_longtarget) that scans
+ *              a long sequence and finds high-scoring regions (windows), or
+ *              (2) the FM-index-based SSV filter that finds modest-scoring
+ *              diagonals using the FM-index, and extends them to maximum-
+ *              scoring diagonals subjected to the SSV filter thresholds
+ *
+ *            Windows passing the appropriate SSV filter are then passed
+ *            to the remainder of the pipeline. The pipeline accumulates
+ *            bean counting information about how many comparisons and
+ *            residues flow through the pipeline while it's active.
+ *
+ * Returns:   <eslOK> on success. If a significant hit is obtained,
+ *            its information is added to the growing <hitlist>.
+ *
+ *            <eslEINVAL> if (in a scan pipeline) we're supposed to
+ *            set GA/TC/NC bit score thresholds but the model doesn't
+ *            have any.
+ *
+ *            <eslERANGE> on numerical overflow errors in the
+ *            optimized vector implementations; particularly in
+ *            posterior decoding. We don't believe this is possible for
+ *            multihit local models, but we're set up to catch it
+ *            anyway. We may emit a warning to the user, but cleanly
+ *            skip the problematic sequence and continue.
+ *
+ * Args:      pli             - the main pipeline object
+ *            om              - optimized profile (query)
+ *            data            - for computing diagonals, and picking window edges based
+ *                              on maximum prefix/suffix extensions
+ *            bg              - background model
+ *            hitlist         - pointer to hit storage bin (already allocated)
+ *
+ *            :: the next three values are assigned if a standard sequence database is being used. If FM database is used, they are ignored
+ *            seqidx          - the id # of the sequence from which the current window was extracted
+ *            sq              - digital sequence of the window
+ *            complementarity - is <sq> from the top strand (p7_NOCOMPLEMENT), or bottom strand (P7_COMPLEMENT)
+ *
+ *            :: the next three are assigned if an FM database is being used. If standard sequence is used, they are set to NULL.
+ *            fmf             - the FM_DATA for forward-strand search
+ *            fmb             - the FM_DATA for reverse-strand (complement) search
+ *            fm_cfg          - general FM configuration
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
+                        P7_BG *bg, P7_TOPHITS *hitlist,
+                        int64_t seqidx, const ESL_SQ *sq, int complementarity,
+                        const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg
+                        )
+{
+  int              status;
+  uint64_t         t0;       /* stage timer mark (if pli->do_timing) */
+
+  P7_HMM_WINDOWLIST msv_windowlist;
+  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp = NULL;
+
+  if ((sq && (sq->n == 0)) || (fmf && (fmf->N == 0))) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
+  if (!fmf) pli_fwdwindow_NewBlock(pli, seqidx, sq);
+  if (fmf)  p7_pli_MemAccount(pli, p7_MEM_FMDATA, fm_FM_Sizeof(fmf, fm_cfg->meta, TRUE) + (fmb ? fm_FM_Sizeof(fmb, fm_cfg->meta, FALSE) : 0));
+
+  msv_windowlist.windows = NULL;
+  if ((status = pli_longtarget_objs_Create(om, bg, &pli_tmp)) != eslOK) goto ERROR;
+  p7_hmmwindow_init(&msv_windowlist);
+
+  p7_omx_GrowTo(pli->oxf, om->M, 0, om->max_length);    /* expand the one-row omx if needed */
+
+  /* Set false target length. This is a conservative estimate of the length of window that'll
+   * soon be passed on to later phases of the pipeline;  used to recover some bits of the score
+   * that we would miss if we left length parameters set to the full target length */
+  p7_oprofile_ReconfigMSVLength(om, om->max_length);
+
+
+  /* First level filter: the SSV filter, with <om>.
+   * This variant of SSV will scan a long sequence and find
+   * short high-scoring regions.
+   */
+  t0 = pli_clock(pli);
+  if (fmf) // using an FM-index
+    p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, pli->strands, pli->r, &msv_windowlist, &(pli->n_fm_occ) );
+  else // compare directly to sequence
+    p7_SSVFilter_longtarget(sq->dsq, sq->n, om, pli->oxf, data, bg, pli->F1, &msv_windowlist);
+  pli->ns_msv += pli_clock(pli) - t0;
+
+  status = pli_longtarget_windows(pli, om, data, bg, hitlist, seqidx, sq, complementarity, FALSE, fmf, fm_cfg, &msv_windowlist, pli_tmp);
+  if (status != eslOK) goto ERROR;
+
+  free (msv_windowlist.windows);
+  pli_longtarget_objs_Destroy(pli_tmp);
   return eslOK;
 
 ERROR:
   if (msv_windowlist.windows != NULL) free (msv_windowlist.windows);
-  if (vit_windowlist.windows != NULL) free (vit_windowlist.windows);
+  pli_longtarget_objs_Destroy(pli_tmp);
+  return status;
+}
 
-  if (pli_tmp != NULL) {
-    if (pli_tmp->tmpseq != NULL) esl_sq_Destroy(pli_tmp->tmpseq);
-    if (pli_tmp->bg != NULL)     p7_bg_Destroy(pli_tmp->bg);
-    if (pli_tmp->om != NULL)     p7_oprofile_Destroy(pli_tmp->om);
-    if (pli_tmp->scores != NULL)        free (pli_tmp->scores);
-    if (pli_tmp->fwd_emissions_arr != NULL) free (pli_tmp->fwd_emissions_arr);
-    free(pli_tmp);
-  }
 
+/* Function:  p7_Pipeline_LongTargetDual()
+ * Synopsis:  Long target pipeline on both strands of a DNA sequence in one pass.
+ *
+ * Purpose:   Same as running <p7_Pipeline_LongTarget()> on the top strand
+ *            of DNA sequence <sq> (as <p7_NOCOMPLEMENT>), then
+ *            <p7_pipeline_Reuse()>, then <p7_Pipeline_LongTarget()> on
+ *            its reverse complement (as <p7_COMPLEMENT>), with the same
+ *            hits in <hitlist> and the same bean counts; but <sq> is
+ *            neither copied nor reverse complemented.
+ *
+ *            The SSV filter scans both strands in one pass
+ *            (<p7_SSVFilter_longtarget_dual()>), and only the windows
+ *            that pass it on the bottom strand are reverse complemented,
+ *            to go through the rest of the pipeline.
+ *
+ *            Without the SSE implementation, falls back to making the
+ *            reverse complement and running the two strands separately.
+ *
+ * Args:      pli             - the main pipeline object
+ *            om              - optimized profile (query)
+ *            data            - for computing diagonals, and picking window edges based
+ *                              on maximum prefix/suffix extensions
+ *            bg              - background model
+ *            hitlist         - pointer to hit storage bin (already allocated)
+ *            seqidx          - the id # of the sequence from which the current window was extracted
+ *            sq              - digital sequence of the window (top strand); its alphabet
+ *                              must have a complement
+ *
+ * Returns:   <eslOK> on success. If a significant hit is obtained,
+ *            its information is added to the growing <hitlist>.
+ *
+ *            <eslERANGE> on numerical overflow errors, as
+ *            <p7_Pipeline_LongTarget()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslEINVAL> if <sq>'s alphabet has no complement.
+ */
+int
+p7_Pipeline_LongTargetDual(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
+                           P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx, const ESL_SQ *sq)
+{
+  int              status;
+#if defined (eslENABLE_SSE)
+  uint64_t         t0;       /* stage timer mark (if pli->do_timing) */
+
+  P7_HMM_WINDOWLIST msv_windowlist;
+  P7_HMM_WINDOWLIST rc_windowlist;
+  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp    = NULL;
+  P7_PIPELINE_LONGTARGET_OBJS *rc_pli_tmp = NULL;
+
+  if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
+  if (sq->abc->complement == NULL) ESL_EXCEPTION(eslEINVAL, "sequence alphabet has no complement");
+  pli_fwdwindow_NewBlock(pli, seqidx, sq);
+
+  msv_windowlist.windows = NULL;
+  rc_windowlist.windows  = NULL;
+  if ((status = pli_longtarget_objs_Create(om, bg, &pli_tmp))    != eslOK) goto ERROR;
+  if ((status = pli_longtarget_objs_Create(om, bg, &rc_pli_tmp)) != eslOK) goto ERROR;
+  p7_hmmwindow_init(&msv_windowlist);
+  p7_hmmwindow_init(&rc_windowlist);
+
+  p7_omx_GrowTo(pli->oxf, om->M, 0, om->max_length);    /* expand the one-row omx if needed */
+  p7_oprofile_ReconfigMSVLength(om, om->max_length);
+
+  t0 = pli_clock(pli);
+  p7_SSVFilter_longtarget_dual(sq->dsq, sq->n, om, pli->oxf, data, bg, pli->F1, &msv_windowlist, &rc_windowlist);
+  pli->ns_msv += pli_clock(pli) - t0;
+
+  status = pli_longtarget_windows(pli, om, data, bg, hitlist, seqidx, sq, p7_NOCOMPLEMENT, FALSE, NULL, NULL, &msv_windowlist, pli_tmp);
+  if (status != eslOK) goto ERROR;
+  if ((status = p7_pipeline_Reuse(pli)) != eslOK) goto ERROR; // as between the two strands' searches
+  status = pli_longtarget_windows(pli, om, data, bg, hitlist, seqidx, sq, p7_COMPLEMENT,   TRUE,  NULL, NULL, &rc_windowlist,  rc_pli_tmp);
+  if (status != eslOK) goto ERROR;
+
+  free (msv_windowlist.windows);
+  free (rc_windowlist.windows);
+  pli_longtarget_objs_Destroy(pli_tmp);
+  pli_longtarget_objs_Destroy(rc_pli_tmp);
+  return eslOK;
+
+ERROR:
+  if (msv_windowlist.windows != NULL) free (msv_windowlist.windows);
+  if (rc_windowlist.windows  != NULL) free (rc_windowlist.windows);
+  pli_longtarget_objs_Destroy(pli_tmp);
+  pli_longtarget_objs_Destroy(rc_pli_tmp);
   return status;
 
+#else
+  ESL_SQ *sq_revcmp = NULL;
+
+  if (sq->abc->complement == NULL) ESL_EXCEPTION(eslEINVAL, "sequence alphabet has no complement");
+
+  if ((status = p7_Pipeline_LongTarget(pli, om, data, bg, hitlist, seqidx, sq, p7_NOCOMPLEMENT, NULL, NULL, NULL)) != eslOK) goto ERROR;
+  if ((status = p7_pipeline_Reuse(pli)) != eslOK) goto ERROR;
+
+  if ((sq_revcmp = esl_sq_CreateDigital(sq->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = esl_sq_Copy(sq, sq_revcmp))           != eslOK) goto ERROR;
+  if ((status = esl_sq_ReverseComplement(sq_revcmp)) != eslOK) goto ERROR;
+  if ((status = p7_Pipeline_LongTarget(pli, om, data, bg, hitlist, seqidx, sq_revcmp, p7_COMPLEMENT, NULL, NULL, NULL)) != eslOK) goto ERROR;
+
+  esl_sq_Destroy(sq_revcmp);
+  return eslOK;
+
+ERROR:
+  if (sq_revcmp) esl_sq_Destroy(sq_revcmp);
+  return status;
+#endif
 }
 
 
@@ -1716,6 +3183,23 @@ ERROR:
  *            stopwatch that was timing the pipeline, then the report
  *            includes timing information.
  *
+ *            If the pipeline was created with the <--timing> option
+ *            on, it also collected per-stage times (MSV, bias,
+ *            Viterbi, Forward, and Backward plus domain definition),
+ *            summed over threads
+ *            and MPI workers by <p7_pipeline_Merge()>, and the report
+ *            includes those too.
+ *
+ *            With the <--memstats> option on, or a memory budget (see
+ *            <p7_pipeline_SetMemBudget()>), it reports the high-water
+ *            marks of the memory it accounted for
+ *            (<p7_pli_MemAccount()>), per subsystem for the biggest
+ *            thread and in total, and the process's peak RSS.
+ *
+ *            For an nhmmer search of an FM-index, the report includes
+ *            the number of FM-index occurrence counts done by the seed
+ *            search.
+ *
  * Returns:   <eslOK> on success.
  */
 int
@@ -1760,8 +3244,21 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
           (int)pli->n_output,
           (double)pli->pos_output / (pli->nres*pli->nmodels) );
 
+      if (pli->n_fm_occ > 0)
+        fprintf(ofp, "FM-index occurrence counts:  %15" PRIu64 "\n", pli->n_fm_occ);
+
   } else { // typical case output
 
+      if (pli->words)
+        fprintf(ofp, "Passed word seed prefilter:  %15" PRId64 "  (%.6g)\n",
+            pli->n_past_words,
+            (double) pli->n_past_words / ntargets);
+
+      if (pli->n_fm_occ > 0)
+        fprintf(ofp, "Passed FM seed prefilter:    %15" PRId64 "  (%.6g)\n",
+            pli->n_past_fm,
+            (double) pli->n_past_fm / ntargets);
+
       fprintf(ofp, "Passed MSV filter:           %15" PRId64 "  (%.6g); expected %.1f (%.6g)\n",
           pli->n_past_msv,
           (double) pli->n_past_msv / ntargets,
@@ -1786,8 +3283,53 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
           pli->F3 * ntargets,
           pli->F3);
 
+      if (pli->n_topk_skipped > 0)
+        fprintf(ofp, "Skipped, can't make top-K:   %15" PRIu64 "\n", pli->n_topk_skipped);
+
+      if (pli->n_max_skipped > 0)
+        fprintf(ofp, "Skipped, can't be reported:  %15" PRIu64 "\n", pli->n_max_skipped);
+
+      if (pli->do_vitdom)
+        fprintf(ofp, "Domains by Viterbi path:     %15" PRIu64 "  (%.6g of Fwd passes)\n",
+            pli->n_vitdom,
+            (pli->n_past_fwd ? (double) pli->n_vitdom / pli->n_past_fwd : 0.0));
+
+      if (pli->do_seqonly)
+        fprintf(ofp, "Scored by Forward only:      %15" PRIu64 "  (no domain definition)\n", pli->n_past_fwd);
+
+      if (pli->n_adapt > 0)
+        fprintf(ofp, "Adaptive filter adjustments: %15d  (F1 %.3g -> %.3g; F2 %.3g -> %.3g%s)\n",
+            pli->n_adapt, pli->F1_orig, pli->F1, pli->F2_orig, pli->F2,
+            pli->adapt_bias ? "; bias filter turned on" : "");
+
       fprintf(ofp, "Initial search space (Z):    %15.0f  %s\n", pli->Z,    pli->Z_setby    == p7_ZSETBY_OPTION ? "[as set by --Z on cmdline]"    : "[actual number of targets]");
       fprintf(ofp, "Domain search space  (domZ): %15.0f  %s\n", pli->domZ, pli->domZ_setby == p7_ZSETBY_OPTION ? "[as set by --domZ on cmdline]" : "[number of targets reported over threshold]");
+      if (pli->n_fm_occ > 0)
+        fprintf(ofp, "FM-index occurrence counts:  %15" PRIu64 "\n", pli->n_fm_occ);
+  }
+
+  if (pli->do_timing) {
+    fprintf(ofp, "Stage times (sec, summed over threads):\n");
+    fprintf(ofp, "  MSV filter:                %15.3f\n", (double) pli->ns_msv  * 1e-9);
+    fprintf(ofp, "  bias filter:               %15.3f\n", (double) pli->ns_bias * 1e-9);
+    fprintf(ofp, "  Vit filter:                %15.3f\n", (double) pli->ns_vit  * 1e-9);
+    fprintf(ofp, "  Fwd filter:                %15.3f\n", (double) pli->ns_fwd  * 1e-9);
+    fprintf(ofp, "  Bck + domain definition:   %15.3f\n", (double) pli->ns_dom  * 1e-9);
+  }
+
+  if (pli->do_memstats || pli->mem_budget > 0) {
+    static const char *memsys[p7_NMEMSYS] = { "DP matrices", "domain definition", "hit lists", "profiles", "sequence blocks", "FM-index" };
+    int m;
+
+    fprintf(ofp, "Memory high-water marks (MB, biggest thread):\n");
+    for (m = 0; m < p7_NMEMSYS; m++)
+      if (pli->mem_peak[m] > 0) fprintf(ofp, "  %-25s %15.1f\n", memsys[m], (double) pli->mem_peak[m] / 1048576.);
+    fprintf(ofp, "  %-25s %15.1f\n", "total, per thread",   (double) pli->mem_peaktot  / 1048576.);
+    fprintf(ofp, "  %-25s %15.1f\n", "total, all threads",  (double) ESL_MAX(pli->mem_sumpeaks, pli->mem_peaktot) / 1048576.);
+    if (p7_pli_ProcessPeak() > 0)
+      fprintf(ofp, "  %-25s %15.1f\n", "process (max RSS)", (double) p7_pli_ProcessPeak() / 1048576.);
+    if (pli->mem_budget > 0)
+      fprintf(ofp, "  %-25s %15.1f  (%" PRIu64 " envelopes checkpointed)\n", "budget", (double) pli->mem_budget / 1048576., pli->ddef->nchk);
   }
 
   if (w != NULL) {
@@ -1798,11 +3340,691 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
 
   return eslOK;
 }
+
+/* Function:  p7_pli_MemAccount()
+ * Synopsis:  Record the current memory size of one of the pipeline's subsystems.
+ *
+ * Purpose:   Record that subsystem <which> of pipeline <pli> now holds
+ *            <nbytes>, and update its high-water mark and that of the
+ *            total. The pipeline accounts for its own DP matrices
+ *            (<p7_MEM_OMX>), domain definition workspace
+ *            (<p7_MEM_DOMAINDEF>), the hits it has added to its hit
+ *            list (<p7_MEM_TOPHITS>), the current profile
+ *            (<p7_MEM_OPROFILE>), the current block of targets
+ *            (<p7_MEM_SEQS>, in <p7_Pipeline_Block()>) and FM-index
+ *            (<p7_MEM_FMDATA>); a caller can account for others'
+ *            memory in the same subsystems, for instance sequence
+ *            blocks it holds but doesn't pass to the pipeline.
+ *
+ *            A pipeline belongs to one thread, so these are per-thread
+ *            figures; <p7_pipeline_Merge()> combines them.
+ */
+void
+p7_pli_MemAccount(P7_PIPELINE *pli, enum p7_memsys_e which, size_t nbytes)
+{
+  size_t tot;
+
+  pli->mem_cur[which] = nbytes;
+  if (nbytes > pli->mem_peak[which]) pli->mem_peak[which] = nbytes;
+  if ((tot = pli_memtotal(pli)) > pli->mem_peaktot)
+    {
+      pli->mem_sumpeaks += tot - pli->mem_peaktot;
+      pli->mem_peaktot   = tot;
+    }
+}
+
+/* Function:  p7_pli_ProcessPeak()
+ * Synopsis:  Peak resident memory of this process, in bytes.
+ *
+ * Purpose:   Returns the process's maximum resident set size so far,
+ *            from <getrusage()>, or 0 if that isn't available. Unlike
+ *            a pipeline's own accounting, it includes everything: the
+ *            program's other data, and malloc's overheads.
+ */
+size_t
+p7_pli_ProcessPeak(void)
+{
+#if defined(HAVE_SYS_RESOURCE_H)
+  struct rusage ru;
+
+  if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+  return (size_t) ru.ru_maxrss;            /* bytes on macOS */
+#else
+  return (size_t) ru.ru_maxrss * 1024;     /* kilobytes elsewhere */
+#endif
+#else
+  return 0;
+#endif
+}
+
+/* Function:  p7_pli_TabularTimings()
+ * Synopsis:  Write per-stage timings as a tabular comment line.
+ *
+ * Purpose:   If <pli> collected per-stage timings, write them to
+ *            <ofp> as one '#' comment line in the tabular output
+ *            formats, following a query's rows:
+ *            
+ *            # stage times (ns): msv <n> bias <n> vit <n> fwd <n> dom <n>
+ *
+ *            Does nothing if <pli> isn't timing.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> on a write error.
+ */
+int
+p7_pli_TabularTimings(FILE *ofp, P7_PIPELINE *pli)
+{
+  if (! pli->do_timing) return eslOK;
+  if (fprintf(ofp, "# stage times (ns): msv %" PRIu64 " bias %" PRIu64 " vit %" PRIu64 " fwd %" PRIu64 " dom %" PRIu64 "\n",
+              pli->ns_msv, pli->ns_bias, pli->ns_vit, pli->ns_fwd, pli->ns_dom) < 0)
+    ESL_EXCEPTION_SYS(eslEWRITE, "tabular timing write failed");
+  return eslOK;
+}
 /*------------------- end, pipeline API -------------------------*/
 
 
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7PIPELINE_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_scanblock()
+ *
+ * Sample <nmodels> calibrated profiles of length <M>, and a query made
+ * of sequences emitted by every third of them, separated by i.i.d.
+ * background; scan the query against them with
+ * p7_Pipeline_ScanBlock(), and with the one-at-a-time loop that
+ * hmmscan runs without threads. Both count the same targets past
+ * each filter, and give the same hits with the same scores. The bias
+ * filter is on, so setting the target length before
+ * p7_pli_NewModel() resets it to the default shows up as a difference.
+ */
+static void
+utest_scanblock(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int nmodels)
+{
+  char          msg[]  = "p7_pipeline ScanBlock unit test failed";
+  P7_HMM       *hmm    = NULL;
+  P7_PROFILE   *gm     = NULL;
+  P7_OM_BLOCK  *block  = NULL;
+  ESL_SQ       *sq     = NULL;
+  ESL_SQ       *tmp    = NULL;
+  P7_PIPELINE  *pli1   = NULL;
+  P7_PIPELINE  *pli2   = NULL;
+  P7_TOPHITS   *th1    = NULL;
+  P7_TOPHITS   *th2    = NULL;
+  char          name[32];
+  int           L, n;
+  int           i;
+
+  if ((block = p7_oprofile_CreateBlock(nmodels)) == NULL) esl_fatal(msg);
+  if ((sq    = esl_sq_CreateDigital(abc))        == NULL) esl_fatal(msg);
+  if ((tmp   = esl_sq_CreateDigital(abc))        == NULL) esl_fatal(msg);
+  if (esl_sq_SetName(sq, "query")                != eslOK) esl_fatal(msg);
+  for (n = 0, i = 0; i < nmodels; i++)
+    {
+      snprintf(name, 32, "model%d", i);
+      if (p7_hmm_Sample(rng, M, abc, &hmm)                   != eslOK) esl_fatal(msg);
+      if (p7_hmm_SetName(hmm, name)                          != eslOK) esl_fatal(msg);
+      if (p7_hmm_SetComposition(hmm)                         != eslOK) esl_fatal(msg);
+      if (p7_Calibrate(hmm, NULL, &rng, &bg, NULL, NULL)     != eslOK) esl_fatal(msg);
+      if ((gm = p7_profile_Create(hmm->M, abc))              == NULL)  esl_fatal(msg);
+      if ((block->list[i] = p7_oprofile_Create(hmm->M, abc)) == NULL)  esl_fatal(msg);
+      if (p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL)       != eslOK) esl_fatal(msg);
+      if (p7_oprofile_Convert(gm, block->list[i])            != eslOK) esl_fatal(msg);
+      block->count++;
+
+      /* every third model emits a domain of the query; each is followed by background */
+      if (i % 3 == 0)
+	{
+	  if (p7_CoreEmit(rng, hmm, tmp, NULL)                 != eslOK) esl_fatal(msg);
+	  if (esl_sq_GrowTo(sq, n + tmp->n)                    != eslOK) esl_fatal(msg);
+	  memcpy(sq->dsq + n + 1, tmp->dsq + 1, tmp->n);
+	  n += tmp->n;
+	  esl_sq_Reuse(tmp);
+	}
+      L = 1 + esl_rnd_Roll(rng, M);
+      if (esl_sq_GrowTo(tmp, L)                                != eslOK) esl_fatal(msg);
+      if (esl_rsq_xfIID(rng, bg->f, abc->K, L, tmp->dsq)       != eslOK) esl_fatal(msg);
+      if (esl_sq_GrowTo(sq, n + L)                             != eslOK) esl_fatal(msg);
+      memcpy(sq->dsq + n + 1, tmp->dsq + 1, L);
+      n += L;
+      esl_sq_Reuse(tmp);
+
+      p7_profile_Destroy(gm);
+      p7_hmm_Destroy(hmm);
+    }
+  sq->dsq[0]   = eslDSQ_SENTINEL;
+  sq->dsq[n+1] = eslDSQ_SENTINEL;
+  sq->n        = n;
+
+  if ((pli1 = p7_pipeline_Create(NULL, 100, 100, FALSE, p7_SCAN_MODELS)) == NULL) esl_fatal(msg);
+  if ((pli2 = p7_pipeline_Create(NULL, 100, 100, FALSE, p7_SCAN_MODELS)) == NULL) esl_fatal(msg);
+  if ((th1  = p7_tophits_Create())                                       == NULL) esl_fatal(msg);
+  if ((th2  = p7_tophits_Create())                                       == NULL) esl_fatal(msg);
+  if (p7_pli_NewSeq(pli1, sq) != eslOK || p7_pli_NewSeq(pli2, sq) != eslOK)       esl_fatal(msg);
+
+  if (p7_Pipeline_ScanBlock(pli1, block, bg, sq, th1) != eslOK) esl_fatal(msg);
+  for (i = 0; i < block->count; i++)
+    {
+      p7_pli_NewModel(pli2, block->list[i], bg);
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(block->list[i], sq->n);
+      if (p7_Pipeline(pli2, block->list[i], bg, sq, NULL, th2) != eslOK) esl_fatal(msg);
+      p7_pipeline_Reuse(pli2);
+    }
+
+  if (pli1->nmodels     != nmodels         || pli2->nmodels     != nmodels)   esl_fatal(msg);
+  if (pli1->n_past_msv  != pli2->n_past_msv  || pli1->n_past_msv  == 0)     esl_fatal(msg);
+  if (pli1->n_past_bias != pli2->n_past_bias)                                esl_fatal(msg);
+  if (pli1->n_past_vit  != pli2->n_past_vit)                                 esl_fatal(msg);
+  if (pli1->n_past_fwd  != pli2->n_past_fwd)                                 esl_fatal(msg);
+  if (th1->N != th2->N || th1->N == 0)                                       esl_fatal(msg);
+  p7_tophits_SortBySortkey(th1);
+  p7_tophits_SortBySortkey(th2);
+  for (i = 0; i < th1->N; i++)
+    {
+      if (strcmp(th1->hit[i]->name, th2->hit[i]->name) != 0) esl_fatal(msg);
+      if (th1->hit[i]->score     != th2->hit[i]->score)      esl_fatal(msg);
+      if (th1->hit[i]->pre_score != th2->hit[i]->pre_score)  esl_fatal(msg);
+      if (th1->hit[i]->ndom      != th2->hit[i]->ndom)       esl_fatal(msg);
+    }
+
+  for (i = 0; i < block->count; i++) p7_oprofile_Destroy(block->list[i]);
+  p7_oprofile_DestroyBlock(block);
+  p7_tophits_Destroy(th1);
+  p7_tophits_Destroy(th2);
+  p7_pipeline_Destroy(pli1);
+  p7_pipeline_Destroy(pli2);
+  esl_sq_Destroy(tmp);
+  esl_sq_Destroy(sq);
+}
+
+/* sample_target()
+ * Sample target sequence number <i> of a search test into <sq>,
+ * using <tmp> for scratch: a core emission of <hmm> flanked by
+ * i.i.d. background (every third target), i.i.d. background, or
+ * i.i.d. residues of the model's own composition, which the bias
+ * filter is there to catch. Background pieces are 1..<L> long.
+ */
+static void
+sample_target(ESL_RANDOMNESS *rng, const P7_HMM *hmm, const P7_BG *bg, int i, int L, ESL_SQ *tmp, ESL_SQ *sq)
+{
+  char         msg[] = "p7_pipeline unit test target sampling failed";
+  const float *f     = (i % 3 == 2) ? hmm->compo : bg->f;
+  int          npiece = (i % 3 == 0) ? 3 : 1;
+  int          n      = 0;
+  int          len;
+  int          p;
+
+  esl_sq_Reuse(sq);
+  for (p = 0; p < npiece; p++)
+    {
+      if (p == 1)
+	{
+	  if (p7_CoreEmit(rng, hmm, tmp, NULL)                 != eslOK) esl_fatal(msg);
+	}
+      else
+	{
+	  len = 1 + esl_rnd_Roll(rng, L);
+	  if (esl_sq_GrowTo(tmp, len)                          != eslOK) esl_fatal(msg);
+	  if (esl_rsq_xfIID(rng, f, hmm->abc->K, len, tmp->dsq) != eslOK) esl_fatal(msg);
+	  tmp->n = len;
+	}
+      if (esl_sq_GrowTo(sq, n + tmp->n)                        != eslOK) esl_fatal(msg);
+      memcpy(sq->dsq + n + 1, tmp->dsq + 1, tmp->n);
+      n += tmp->n;
+      esl_sq_Reuse(tmp);
+    }
+  sq->dsq[0]   = eslDSQ_SENTINEL;
+  sq->dsq[n+1] = eslDSQ_SENTINEL;
+  sq->n        = n;
+  if (esl_sq_FormatName(sq, "target%d", i) != eslOK) esl_fatal(msg);
+}
+
+/* sample_search()
+ * Sample a calibrated model of length <M>, configured for targets of
+ * length about <L>, for the search tests.
+ */
+static void
+sample_search(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, P7_HMM **ret_hmm, P7_PROFILE **ret_gm, P7_OPROFILE **ret_om)
+{
+  char         msg[] = "p7_pipeline unit test model sampling failed";
+  P7_HMM      *hmm   = NULL;
+  P7_PROFILE  *gm    = NULL;
+  P7_OPROFILE *om    = NULL;
+
+  if (p7_hmm_Sample(rng, M, abc, &hmm)               != eslOK) esl_fatal(msg);
+  if (p7_hmm_SetName(hmm, "query")                   != eslOK) esl_fatal(msg);
+  if (p7_hmm_SetComposition(hmm)                     != eslOK) esl_fatal(msg);
+  if (p7_Calibrate(hmm, NULL, &rng, &bg, NULL, NULL) != eslOK) esl_fatal(msg);
+  if ((gm = p7_profile_Create(hmm->M, abc))          == NULL)  esl_fatal(msg);
+  if ((om = p7_oprofile_Create(hmm->M, abc))         == NULL)  esl_fatal(msg);
+  if (p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL)     != eslOK) esl_fatal(msg);
+  if (p7_oprofile_Convert(gm, om)                    != eslOK) esl_fatal(msg);
+  *ret_hmm = hmm;
+  *ret_gm  = gm;
+  *ret_om  = om;
+}
+
+/* utest_bounded()
+ *
+ * Search a sampled model against <N> sampled targets with filter
+ * thresholds <F1>, <F2>, with the bias filter on or off, and check
+ * each target's filter decisions against ones made from the full,
+ * unbounded MSV and Viterbi filter scores. With the bias filter on and
+ * <F2> > <F1>, an MSV score the bounded filter stopped at its accept
+ * bound has to be finished before the bias filter can use it; a
+ * target that is passed or failed on the bound shows up here.
+ */
+static void
+utest_bounded(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N, double F1, double F2, int do_biasfilter)
+{
+  char         msg[] = "p7_pipeline bounded filter unit test failed";
+  P7_HMM      *hmm   = NULL;
+  P7_PROFILE  *gm    = NULL;
+  P7_OPROFILE *om    = NULL;
+  P7_PIPELINE *pli   = NULL;
+  P7_TOPHITS  *th    = NULL;
+  P7_OMX      *ox    = NULL;
+  ESL_SQ      *sq    = esl_sq_CreateDigital(abc);
+  ESL_SQ      *tmp   = esl_sq_CreateDigital(abc);
+  float        nullsc, filtersc, usc, vfsc;
+  double       P;
+  int          pass_msv, pass_bias, pass_vit;
+  uint64_t     nmsv, nbias, nvit;
+  int          i;
+
+  sample_search(rng, abc, bg, M, L, &hmm, &gm, &om);
+  if ((pli = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((th  = p7_tophits_Create())                                   == NULL) esl_fatal(msg);
+  if ((ox  = p7_omx_Create(M, 0, L))                                == NULL) esl_fatal(msg);
+  pli->F1            = F1;
+  pli->F2            = F2;
+  pli->do_biasfilter = do_biasfilter;
+  if (p7_pli_NewModel(pli, om, bg) != eslOK) esl_fatal(msg);
+
+  for (i = 0; i < N; i++)
+    {
+      sample_target(rng, hmm, bg, i, L, tmp, sq);
+      if (p7_pli_NewSeq(pli, sq) != eslOK) esl_fatal(msg);
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+
+      /* the decisions the unbounded filters make */
+      p7_omx_GrowTo(ox, om->M, 0, sq->n);
+      p7_bg_NullOne(bg, sq->dsq, sq->n, &nullsc);
+      p7_MSVFilter(sq->dsq, sq->n, om, ox, &usc);
+      P = esl_gumbel_surv((usc - nullsc) / eslCONST_LOG2, om->evparam[p7_MMU], om->evparam[p7_MLAMBDA]);
+      pass_msv = pass_bias = pass_vit = (P <= F1);
+      filtersc = nullsc;
+      if (pass_msv && do_biasfilter)
+	{
+	  p7_bg_FilterScore(bg, sq->dsq, sq->n, &filtersc);
+	  P = esl_gumbel_surv((usc - filtersc) / eslCONST_LOG2, om->evparam[p7_MMU], om->evparam[p7_MLAMBDA]);
+	  pass_bias = pass_vit = (P <= F1);
+	}
+      if (pass_bias && P > F2)
+	{
+	  p7_ViterbiFilter(sq->dsq, sq->n, om, ox, &vfsc);
+	  P = esl_gumbel_surv((vfsc - filtersc) / eslCONST_LOG2, om->evparam[p7_VMU], om->evparam[p7_VLAMBDA]);
+	  pass_vit = (P <= F2);
+	}
+
+      nmsv  = pli->n_past_msv;
+      nbias = pli->n_past_bias;
+      nvit  = pli->n_past_vit;
+      if (p7_Pipeline(pli, om, bg, sq, NULL, th) != eslOK) esl_fatal(msg);
+      if (pli->n_past_msv  - nmsv  != (uint64_t) pass_msv)  esl_fatal("%s: MSV decision differs on %s",    msg, sq->name);
+      if (pli->n_past_bias - nbias != (uint64_t) pass_bias) esl_fatal("%s: bias decision differs on %s",   msg, sq->name);
+      if (pli->n_past_vit  - nvit  != (uint64_t) pass_vit)  esl_fatal("%s: Viterbi decision differs on %s", msg, sq->name);
+      p7_pipeline_Reuse(pli);
+    }
+  if (pli->n_past_msv == 0 || pli->n_past_msv == (uint64_t) N) esl_fatal("%s: MSV filter didn't discriminate", msg);
+
+  p7_omx_Destroy(ox);
+  p7_tophits_Destroy(th);
+  p7_pipeline_Destroy(pli);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  esl_sq_Destroy(tmp);
+  esl_sq_Destroy(sq);
+}
+
+/* compare_reported()
+ * The reported hits in sorted, thresholded hit lists <th1> and <th2>
+ * are the same targets, with the same scores and domains.
+ */
+static void
+compare_reported(P7_TOPHITS *th1, P7_TOPHITS *th2, char *msg)
+{
+  uint64_t h1, h2;
+
+  if (th1->nreported != th2->nreported || th1->nreported == 0) esl_fatal("%s: %d vs. %d hits reported", msg, (int) th1->nreported, (int) th2->nreported);
+  if (th1->nincluded != th2->nincluded)                        esl_fatal("%s: %d vs. %d hits included", msg, (int) th1->nincluded, (int) th2->nincluded);
+  for (h1 = 0, h2 = 0; h1 < th1->N && h2 < th2->N; h1++, h2++)
+    {
+      while (h1 < th1->N && ! (th1->hit[h1]->flags & p7_IS_REPORTED)) h1++;
+      while (h2 < th2->N && ! (th2->hit[h2]->flags & p7_IS_REPORTED)) h2++;
+      if (h1 == th1->N || h2 == th2->N) break;
+      if (strcmp(th1->hit[h1]->name, th2->hit[h2]->name) != 0) esl_fatal("%s: %s vs. %s", msg, th1->hit[h1]->name, th2->hit[h2]->name);
+      if (th1->hit[h1]->score     != th2->hit[h2]->score)      esl_fatal("%s: scores differ on %s", msg, th1->hit[h1]->name);
+      if (th1->hit[h1]->pre_score != th2->hit[h2]->pre_score)  esl_fatal("%s: scores differ on %s", msg, th1->hit[h1]->name);
+      if (th1->hit[h1]->lnP       != th2->hit[h2]->lnP)        esl_fatal("%s: E-values differ on %s", msg, th1->hit[h1]->name);
+      if (th1->hit[h1]->ndom      != th2->hit[h2]->ndom)       esl_fatal("%s: domains differ on %s", msg, th1->hit[h1]->name);
+      if (th1->hit[h1]->flags     != th2->hit[h2]->flags)      esl_fatal("%s: flags differ on %s", msg, th1->hit[h1]->name);
+    }
+}
+
+/* utest_maxskip()
+ *
+ * Search a sampled model against <N> sampled targets as with --max,
+ * once skipping Backward and domain definition for targets that can't
+ * be reported even with p7_TOPK_SLACK bits more than their
+ * uncorrected Forward score, and once without the skip. The reported
+ * hits are the same, and the skip has something to skip.
+ */
+static void
+utest_maxskip(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char         msg[] = "p7_pipeline --max skip unit test failed";
+  P7_HMM      *hmm   = NULL;
+  P7_PROFILE  *gm    = NULL;
+  P7_OPROFILE *om    = NULL;
+  P7_PIPELINE *pli1  = NULL;
+  P7_PIPELINE *pli2  = NULL;
+  P7_TOPHITS  *th1   = NULL;
+  P7_TOPHITS  *th2   = NULL;
+  ESL_SQ      *sq    = esl_sq_CreateDigital(abc);
+  ESL_SQ      *tmp   = esl_sq_CreateDigital(abc);
+  int          i;
+
+  sample_search(rng, abc, bg, M, L, &hmm, &gm, &om);
+  if ((pli1 = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((pli2 = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((th1  = p7_tophits_Create())                                   == NULL) esl_fatal(msg);
+  if ((th2  = p7_tophits_Create())                                   == NULL) esl_fatal(msg);
+
+  /* as hmmsearch --max sets them; pli2 just doesn't skip */
+  pli1->do_max        = pli2->do_max        = TRUE;
+  pli1->do_biasfilter = pli2->do_biasfilter = FALSE;
+  pli1->F1 = pli1->F2 = pli1->F3 = pli2->F1 = pli2->F2 = pli2->F3 = 1.0;
+  pli2->do_max        = FALSE;
+  if (p7_pli_NewModel(pli1, om, bg) != eslOK || p7_pli_NewModel(pli2, om, bg) != eslOK) esl_fatal(msg);
+
+  for (i = 0; i < N; i++)
+    {
+      sample_target(rng, hmm, bg, i, L, tmp, sq);
+      if (p7_pli_NewSeq(pli1, sq) != eslOK || p7_pli_NewSeq(pli2, sq) != eslOK) esl_fatal(msg);
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+      if (p7_Pipeline(pli1, om, bg, sq, NULL, th1) != eslOK) esl_fatal(msg);
+      if (p7_Pipeline(pli2, om, bg, sq, NULL, th2) != eslOK) esl_fatal(msg);
+      p7_pipeline_Reuse(pli1);
+      p7_pipeline_Reuse(pli2);
+    }
+  if (pli1->n_past_fwd != pli2->n_past_fwd)                  esl_fatal(msg);
+  if (pli1->n_max_skipped == 0 || pli2->n_max_skipped != 0)  esl_fatal("%s: nothing skipped", msg);
+
+  p7_tophits_SortBySortkey(th1);
+  p7_tophits_SortBySortkey(th2);
+  p7_tophits_Threshold(th1, pli1);
+  p7_tophits_Threshold(th2, pli2);
+  compare_reported(th1, th2, msg);
+
+  p7_tophits_Destroy(th1);
+  p7_tophits_Destroy(th2);
+  p7_pipeline_Destroy(pli1);
+  p7_pipeline_Destroy(pli2);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  esl_sq_Destroy(tmp);
+  esl_sq_Destroy(sq);
+}
+
+/* utest_seqscore()
+ *
+ * Search a sampled model against <N> sampled targets in score-only
+ * mode, with every target let through to Forward, and check each
+ * target's hit, or lack of one, against the per-target score
+ * calculated directly: the Forward score over the null model score,
+ * corrected (if <do_null2>) by the bias filter's composition model;
+ * and, without null2, against a full pipeline's hit, whose score
+ * can only be higher (when the sum of its domains scores better). The
+ * bias filter on or off decides whether the pipeline already has the
+ * composition model's score.
+ */
+static void
+utest_seqscore(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N, int do_null2, int do_biasfilter)
+{
+  char         msg[] = "p7_pipeline score-only unit test failed";
+  P7_HMM      *hmm   = NULL;
+  P7_PROFILE  *gm    = NULL;
+  P7_OPROFILE *om    = NULL;
+  P7_PIPELINE *pli1  = NULL;
+  P7_PIPELINE *pli2  = NULL;
+  P7_TOPHITS  *th1   = NULL;
+  P7_TOPHITS  *th2   = NULL;
+  P7_OMX      *ox    = NULL;
+  P7_HIT      *hit   = NULL;
+  ESL_SQ      *sq    = esl_sq_CreateDigital(abc);
+  ESL_SQ      *tmp   = esl_sq_CreateDigital(abc);
+  float        nullsc, filtersc, fwdsc, seqbias;
+  float        pre_score, seq_score;
+  double       lnP;
+  uint64_t     n1, n2;
+  int          nhits = 0;
+  int          i;
+
+  sample_search(rng, abc, bg, M, L, &hmm, &gm, &om);
+  if ((pli1 = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((pli2 = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((th1  = p7_tophits_Create())                                   == NULL) esl_fatal(msg);
+  if ((th2  = p7_tophits_Create())                                   == NULL) esl_fatal(msg);
+  if ((ox   = p7_omx_Create(M, 0, L))                                == NULL) esl_fatal(msg);
+  pli1->F1 = pli1->F2 = pli1->F3 = pli2->F1 = pli2->F2 = pli2->F3 = 1.0;
+  pli1->do_null2      = pli2->do_null2      = do_null2;
+  pli1->do_biasfilter = pli2->do_biasfilter = do_biasfilter;
+  p7_pipeline_SetSeqScoreOnly(pli1, TRUE);
+  if (p7_pli_NewModel(pli1, om, bg) != eslOK || p7_pli_NewModel(pli2, om, bg) != eslOK) esl_fatal(msg);
+
+  for (i = 0; i < N; i++)
+    {
+      sample_target(rng, hmm, bg, i, L, tmp, sq);
+      if (p7_pli_NewSeq(pli1, sq) != eslOK || p7_pli_NewSeq(pli2, sq) != eslOK) esl_fatal(msg);
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+
+      /* the per-target score, calculated directly */
+      p7_omx_GrowTo(ox, om->M, 0, sq->n);
+      p7_bg_NullOne(bg, sq->dsq, sq->n, &nullsc);
+      p7_ForwardParser(sq->dsq, sq->n, om, ox, &fwdsc);
+      if (do_null2)
+	{
+	  p7_bg_FilterScore(bg, sq->dsq, sq->n, &filtersc);
+	  seqbias = p7_FLogsum(0.0, log(bg->omega) + (filtersc - nullsc));
+	}
+      else seqbias = 0.0;
+      pre_score = (fwdsc - nullsc) / eslCONST_LOG2;
+      seq_score = (fwdsc - (nullsc + seqbias)) / eslCONST_LOG2;
+      lnP       = esl_exp_logsurv(seq_score, om->evparam[p7_FTAU], om->evparam[p7_FLAMBDA]);
+
+      n1 = th1->N;
+      n2 = th2->N;
+      if (p7_Pipeline(pli1, om, bg, sq, NULL, th1) != eslOK) esl_fatal(msg);
+      if (p7_Pipeline(pli2, om, bg, sq, NULL, th2) != eslOK) esl_fatal(msg);
+      p7_pipeline_Reuse(pli1);
+      p7_pipeline_Reuse(pli2);
+
+      if (th1->N - n1 != (uint64_t) p7_pli_TargetReportable(pli1, seq_score, lnP)) esl_fatal("%s: hit or miss differs on %s", msg, sq->name);
+      if (th1->N == n1) continue;
+      hit = th1->unsrt + n1;
+      nhits++;
+      if (strcmp(hit->name, sq->name) != 0 || hit->ndom != 0) esl_fatal(msg);
+      if (hit->pre_score != pre_score)                         esl_fatal("%s: pre_score differs on %s", msg, sq->name);
+      if (hit->score     != seq_score)                         esl_fatal("%s: score differs on %s",     msg, sq->name);
+      if (hit->lnP       != lnP)                               esl_fatal("%s: E-value differs on %s",   msg, sq->name);
+
+      if (! do_null2 && th2->N > n2 && th2->unsrt[n2].score < hit->score) esl_fatal("%s: full pipeline scores %s lower", msg, sq->name);
+    }
+  if (nhits == 0 || nhits == N) esl_fatal("%s: hits didn't discriminate", msg);
+  if (pli1->n_past_fwd != pli2->n_past_fwd) esl_fatal(msg);
+
+  p7_omx_Destroy(ox);
+  p7_tophits_Destroy(th1);
+  p7_tophits_Destroy(th2);
+  p7_pipeline_Destroy(pli1);
+  p7_pipeline_Destroy(pli2);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  esl_sq_Destroy(tmp);
+  esl_sq_Destroy(sq);
+}
+
+/* utest_block()
+ *
+ * Search a sampled model of length <M> against <nblocks> blocks of <B>
+ * sampled targets with p7_Pipeline_Block(), which runs the filters
+ * over each block before the domain stage runs on the survivors, and
+ * with the one-at-a-time p7_Pipeline() loop. Both count the same
+ * targets past each filter and report the same hits. A short enough
+ * model also gets the block's batched SSV filter, where the host has
+ * one.
+ */
+static void
+utest_block(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int B, int nblocks)
+{
+  char          msg[] = "p7_pipeline Block unit test failed";
+  P7_HMM       *hmm   = NULL;
+  P7_PROFILE   *gm    = NULL;
+  P7_OPROFILE  *om    = NULL;
+  P7_PIPELINE  *pli1  = NULL;
+  P7_PIPELINE  *pli2  = NULL;
+  P7_TOPHITS   *th1   = NULL;
+  P7_TOPHITS   *th2   = NULL;
+  ESL_SQ_BLOCK *block = esl_sq_CreateDigitalBlock(B, abc);
+  ESL_SQ       *tmp   = esl_sq_CreateDigital(abc);
+  ESL_SQ       *sq    = NULL;
+  int           b, i;
+
+  sample_search(rng, abc, bg, M, L, &hmm, &gm, &om);
+  if ((pli1 = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((pli2 = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((th1  = p7_tophits_Create())                                   == NULL) esl_fatal(msg);
+  if ((th2  = p7_tophits_Create())                                   == NULL) esl_fatal(msg);
+  if (p7_pli_NewModel(pli1, om, bg) != eslOK || p7_pli_NewModel(pli2, om, bg) != eslOK) esl_fatal(msg);
+
+  for (b = 0; b < nblocks; b++)
+    {
+      for (i = 0; i < B; i++)
+	sample_target(rng, hmm, bg, b*B + i, L, tmp, block->list + i);
+      block->count = B;
+
+      if (p7_Pipeline_Block(pli1, om, bg, block, th1) != eslOK) esl_fatal(msg);
+      for (i = 0; i < block->count; i++)
+	{
+	  sq = block->list + i;
+	  if (p7_pli_NewSeq(pli2, sq) != eslOK) esl_fatal(msg);
+	  p7_bg_SetLength(bg, sq->n);
+	  p7_oprofile_ReconfigLength(om, sq->n);
+	  if (p7_Pipeline(pli2, om, bg, sq, NULL, th2) != eslOK) esl_fatal(msg);
+	  p7_pipeline_Reuse(pli2);
+	}
+    }
+
+  if (pli1->nseqs       != pli2->nseqs || pli1->nres != pli2->nres)  esl_fatal(msg);
+  if (pli1->n_past_msv  != pli2->n_past_msv  || pli1->n_past_msv == 0) esl_fatal("%s: MSV counts differ", msg);
+  if (pli1->n_past_bias != pli2->n_past_bias)                          esl_fatal("%s: bias counts differ", msg);
+  if (pli1->n_past_vit  != pli2->n_past_vit)                           esl_fatal("%s: Viterbi counts differ", msg);
+  if (pli1->n_past_fwd  != pli2->n_past_fwd)                           esl_fatal("%s: Forward counts differ", msg);
+
+  p7_tophits_SortBySortkey(th1);
+  p7_tophits_SortBySortkey(th2);
+  p7_tophits_Threshold(th1, pli1);
+  p7_tophits_Threshold(th2, pli2);
+  compare_reported(th1, th2, msg);
+
+  p7_tophits_Destroy(th1);
+  p7_tophits_Destroy(th2);
+  p7_pipeline_Destroy(pli1);
+  p7_pipeline_Destroy(pli2);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  esl_sq_DestroyBlock(block);
+  esl_sq_Destroy(tmp);
+}
+#endif /*p7PIPELINE_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7PIPELINE_TESTDRIVE
+/*
+  gcc -o p7_pipeline_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7PIPELINE_TESTDRIVE p7_pipeline.c -lhmmer -leasel -lm
+  ./p7_pipeline_utest
+*/
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-M",        eslARG_INT,     "50", NULL, NULL,  NULL,  NULL, NULL, "length of the sampled profiles",                   0 },
+  { "-N",        eslARG_INT,     "12", NULL, NULL,  NULL,  NULL, NULL, "number of profiles in the scanned block",          0 },
+  { "-L",        eslARG_INT,    "400", NULL, NULL,  NULL,  NULL, NULL, "maximum length of target background pieces",      0 },
+  { "-T",        eslARG_INT,    "300", NULL, NULL,  NULL,  NULL, NULL, "number of targets in the search tests",            0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the acceleration pipeline";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg  = p7_bg_Create(abc);
+
+  int             M   = esl_opt_GetInteger(go, "-M");
+  int             L   = esl_opt_GetInteger(go, "-L");
+  int             T   = esl_opt_GetInteger(go, "-T");
+
+  impl_Init();
+  utest_scanblock(rng, abc, bg, M, esl_opt_GetInteger(go, "-N"));
+  utest_bounded  (rng, abc, bg, M, L, T, 0.02, 1e-3, TRUE);   /* default F2 < F1 */
+  utest_bounded  (rng, abc, bg, M, L, T, 0.02, 0.1,  TRUE);   /* F2 > F1: bias filter needs the finished MSV score */
+  utest_bounded  (rng, abc, bg, M, L, T, 0.02, 0.02, TRUE);
+  utest_bounded  (rng, abc, bg, M, L, T, 0.02, 0.1,  FALSE);
+  utest_maxskip  (rng, abc, bg, M, L, T);
+  utest_seqscore (rng, abc, bg, M, L, T, TRUE,  TRUE);
+  utest_seqscore (rng, abc, bg, M, L, T, TRUE,  FALSE);
+  utest_seqscore (rng, abc, bg, M, L, T, FALSE, TRUE);
+  utest_block    (rng, abc, bg, M,  L, 100, T / 100);
+  utest_block    (rng, abc, bg, 20, L, 100, T / 100);  /* short model: batched SSV */
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7PIPELINE_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
+
 /*****************************************************************
- * 3. Example 1: "search mode" in a sequence db
+ * 5. Example 1: "search mode" in a sequence db
  *****************************************************************/
 
 #ifdef p7PIPELINE_EXAMPLE
@@ -1835,8 +4057,16 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,  "1e-3", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             0 },
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
+  { "--dd_threads", eslARG_INT,    "0",   NULL, "n>=0",    NULL,  NULL, NULL,                           "define domains of a multidomain target in <n> threads",        0 },
+  { "--dd_ramlimit", eslARG_INT,   "0",   NULL, "n>=0",    NULL,  NULL, NULL,                           "cap full envelope DP matrices at <n> MB (0: no cap)",          0 },
+  { "--dd_nbatch",  eslARG_INT,    "0",   NULL, "n>=0",    NULL,  NULL, NULL,                           "sample domain traces in batches of <n>, stopping early",       0 },
+  { "--dd_deferali", eslARG_NONE,  FALSE, NULL, NULL,      NULL,  NULL, NULL,                           "align domains only of targets that are reported",              0 },
+  { "--dd_bf16",    eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL,                           "keep envelope DP matrices in bfloat16 (half the memory)",      0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
+  { "--timing",     eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  NULL,                          "report time spent in each stage of the pipeline",              0 },
+  { "--memstats",   eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  NULL,                          "report memory high-water marks of the pipeline",               0 },
+  { "--membudget",  eslARG_INT,    NULL,  NULL, "n>0",     NULL,  NULL,  NULL,                          "keep each pipeline under <n> MB of DP memory",                 0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
@@ -1942,7 +4172,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 4. Example 2: "scan mode" in an HMM db
+ * 6. Example 2: "scan mode" in an HMM db
  *****************************************************************/
 #ifdef p7PIPELINE_EXAMPLE2
 /* gcc -o pipeline_example2 -g -Wall -I../easel -L../easel -I. -L. -Dp7PIPELINE_EXAMPLE2 p7_pipeline.c -lhmmer -leasel -lm
@@ -1974,8 +4204,16 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,  "1e-3", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             0 },
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
+  { "--dd_threads", eslARG_INT,    "0",   NULL, "n>=0",    NULL,  NULL, NULL,                           "define domains of a multidomain target in <n> threads",        0 },
+  { "--dd_ramlimit", eslARG_INT,   "0",   NULL, "n>=0",    NULL,  NULL, NULL,                           "cap full envelope DP matrices at <n> MB (0: no cap)",          0 },
+  { "--dd_nbatch",  eslARG_INT,    "0",   NULL, "n>=0",    NULL,  NULL, NULL,                           "sample domain traces in batches of <n>, stopping early",       0 },
+  { "--dd_deferali", eslARG_NONE,  FALSE, NULL, NULL,      NULL,  NULL, NULL,                           "align domains only of targets that are reported",              0 },
+  { "--dd_bf16",    eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL, NULL,                           "keep envelope DP matrices in bfloat16 (half the memory)",      0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
+  { "--timing",     eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  NULL,                          "report time spent in each stage of the pipeline",              0 },
+  { "--memstats",   eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  NULL,                          "report memory high-water marks of the pipeline",               0 },
+  { "--membudget",  eslARG_INT,    NULL,  NULL, "n>0",     NULL,  NULL,  NULL,                          "keep each pipeline under <n> MB of DP memory",                 0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
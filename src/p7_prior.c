@@ -6,6 +6,7 @@
 
 #include "easel.h"
 #include "esl_alphabet.h"
+#include "esl_stats.h"
 #include "esl_vectorops.h"
 
 #include "hmmer.h"
@@ -359,3 +360,99 @@ p7_ParameterEstimation(P7_HMM *hmm, const P7_PRIOR *pri)
 }
 
 
+/* Function:  p7_MatchParameterEstimation()
+ * Synopsis:  Mean posterior match emissions for rescaled counts.
+ *
+ * Purpose:   Given a counts-based <hmm> and a prior <pri>, calculate
+ *            the mean posterior match emission probabilities that
+ *            <p7_ParameterEstimation()> would give if the counts of
+ *            each node <k> were first multiplied by <scale[k]>, and
+ *            store them in <mat[1..M][0..K-1]>. The <hmm> itself
+ *            isn't touched, and nothing else is estimated.
+ *
+ *            This is the inner loop of entropy weighting
+ *            (<p7_EntropyWeight()>), where only match emissions enter
+ *            the relative entropy target, and it's evaluated for
+ *            many scalings of the same counts. The terms of the
+ *            mixture posterior that depend only on the prior, the
+ *            log mixture coefficients and the log gamma functions of
+ *            each component's $\alpha$, are calculated once per call
+ *            rather than once per node; a single-component prior
+ *            needs no log gamma functions at all.
+ *
+ *            If <pri> is <NULL>, the emissions are the normalized
+ *            counts, as in <p7_ParameterEstimation()>.
+ *
+ * Args:      hmm   - model containing counts; unchanged
+ *            pri   - mixture Dirichlet prior, or <NULL>
+ *            scale - scale[1..M]: count multiplier for each node
+ *            mat   - RETURN: mat[1..M] emission vectors; may be
+ *                    another model's <mat>, but not <hmm->mat>
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_MatchParameterEstimation(const P7_HMM *hmm, const P7_PRIOR *pri, const double *scale, float **mat)
+{
+  ESL_MIXDCHLET *d = (pri ? pri->em : NULL);
+  int            K = hmm->abc->K;
+  double         c[p7_MAXABET];
+  double         p[p7_MAXABET];
+  double         base[p7_MAXDCHLET];  /* log q_j + log Gamma(|alpha_j|) - sum_x log Gamma(alpha_jx) */
+  double         A[p7_MAXDCHLET];     /* |alpha_j| */
+  double         lp[p7_MAXDCHLET];    /* log posterior of component j, then posterior */
+  double         N, lg;
+  int            j, k, x;
+
+  if (d == NULL || d->Q > p7_MAXDCHLET)
+    {
+      for (k = 1; k <= hmm->M; k++)
+	{
+	  for (x = 0; x < K; x++) c[x] = scale[k] * hmm->mat[k][x];
+	  if (d) esl_mixdchlet_MPParameters(d, c, p);
+	  else { esl_vec_DCopy(c, K, p); esl_vec_DNorm(p, K); }
+	  esl_vec_D2F(p, K, mat[k]);
+	}
+      return eslOK;
+    }
+
+  for (j = 0; j < d->Q; j++)
+    {
+      A[j]    = esl_vec_DSum(d->alpha[j], K);
+      base[j] = -eslINFINITY;
+      if (d->Q == 1 || d->q[j] <= 0.) continue;
+
+      esl_stats_LogGamma(A[j], &lg);
+      base[j] = log(d->q[j]) + lg;
+      for (x = 0; x < K; x++) { esl_stats_LogGamma(d->alpha[j][x], &lg); base[j] -= lg; }
+    }
+
+  for (k = 1; k <= hmm->M; k++)
+    {
+      for (N = 0., x = 0; x < K; x++) { c[x] = scale[k] * hmm->mat[k][x]; N += c[x]; }
+
+      if (d->Q == 1) lp[0] = 1.0;
+      else
+	{
+	  for (j = 0; j < d->Q; j++)
+	    {
+	      if (base[j] == -eslINFINITY) { lp[j] = -eslINFINITY; continue; }
+	      esl_stats_LogGamma(A[j] + N, &lg);
+	      lp[j] = base[j] - lg;
+	      for (x = 0; x < K; x++) { esl_stats_LogGamma(d->alpha[j][x] + c[x], &lg); lp[j] += lg; }
+	    }
+	  esl_vec_DLogNorm(lp, d->Q);
+	}
+
+      esl_vec_DSet(p, K, 0.);
+      for (j = 0; j < d->Q; j++)
+	if (lp[j] > 0.)
+	  for (x = 0; x < K; x++)
+	    p[x] += lp[j] * (c[x] + d->alpha[j][x]) / (N + A[j]);
+      esl_vec_DNorm(p, K);
+      esl_vec_D2F(p, K, mat[k]);
+    }
+  return eslOK;
+}
+
+
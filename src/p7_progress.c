@@ -0,0 +1,406 @@
+/* P7_PROGRESS: progress and throughput reports during a long search.
+ *
+ * A search's statistics only come out at the end of each query, from
+ * p7_pli_Statistics(). A long batch job that is starved for input,
+ * or has unbalanced threads, looks the same as a healthy one until
+ * then. With a P7_PROGRESS, a search driver writes one line of
+ * telemetry every <interval> seconds (to stderr, or a file) while it
+ * runs:
+ *
+ *   # progress t=120.0 query=1 name=globins4 targets=5430122 residues=1.9e+09
+ *     targets_s=45210 residues_s_core=1.98e+05 msv=0.0212 bias=0.0187
+ *     vit=0.0031 fwd=0.00011 util=0.97 util_min=0.91 util_max=0.99
+ *     starved=0.021 reader_wait=0.45 done=0.452 eta=145
+ *
+ * (all on one line), where:
+ *   t             seconds since the run started;
+ *   query, name   the current query;
+ *   targets       comparisons done, all queries so far (sequences for
+ *                 a search, models for a scan);
+ *   residues      residues (search) or model nodes (scan) compared;
+ *   targets_s     comparisons per second, over the last interval;
+ *   residues_s_core ... residues or nodes per second per worker;
+ *   msv..fwd      fraction of the current query's comparisons past
+ *                 each filter;
+ *   util          mean fraction of the last interval the workers spent
+ *                 in the pipeline, and its lowest and highest;
+ *   starved       mean fraction of it they spent waiting on the work
+ *                 queue for targets: the reader (or the disk) is too slow;
+ *   reader_wait   fraction of it the reader spent waiting for an empty
+ *                 block: the workers are the bottleneck, as they should be;
+ *   done, eta     fraction of the work done, and estimated seconds to
+ *                 go; "-" when the driver can't tell.
+ *
+ * Workers report after each block of targets, with
+ * p7_progress_Worker(), copying their pipeline's counts under a
+ * mutex; nothing is read from a pipeline while it's working. What
+ * "done" measures is up to the driver: bytes of a file read, or the
+ * workers' residues against a known total (p7_progress_SetTotal()).
+ *
+ * With HMMER_THREADS, a thread of its own writes the reports; without
+ * them, the next p7_progress_Worker() call after an interval is up
+ * does. Every function takes a <NULL> <prog>, and does nothing.
+ *
+ * Contents:
+ *    1. The P7_PROGRESS object.
+ *    2. Internal functions.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#define PROGRESS_LOCK(p)    pthread_mutex_lock(&((p)->mutex))
+#define PROGRESS_UNLOCK(p)  pthread_mutex_unlock(&((p)->mutex))
+#else
+#define PROGRESS_LOCK(p)
+#define PROGRESS_UNLOCK(p)
+#endif
+
+#include "easel.h"
+#include "hmmer.h"
+
+static void progress_report(P7_PROGRESS *prog, double now, int final);
+#ifdef HMMER_THREADS
+static void *progress_thread(void *arg);
+#endif
+
+
+/*****************************************************************
+ *= 1. The P7_PROGRESS object
+ *****************************************************************/
+
+/* Function:  p7_progress_Create()
+ * Synopsis:  Start reporting a search's progress.
+ *
+ * Purpose:   Report progress to open stream <fp> every <interval>
+ *            seconds, for a search with <nworkers> workers (1, for a
+ *            serial one) comparing <mode> <p7_SEARCH_SEQS> or
+ *            <p7_SCAN_MODELS>. If <close_fp> is TRUE, <fp> is closed
+ *            when the object is destroyed.
+ *
+ * Returns:   the new object, or <NULL> on allocation failure; a
+ *            search just goes on without reports.
+ */
+P7_PROGRESS *
+p7_progress_Create(FILE *fp, int close_fp, double interval, int nworkers, enum p7_pipemodes_e mode)
+{
+  P7_PROGRESS *prog = NULL;
+  int          status;
+
+  ESL_ALLOC(prog, sizeof(P7_PROGRESS));
+  memset(prog, 0, sizeof(P7_PROGRESS));
+  prog->fp        = fp;
+  prog->close_fp  = close_fp;
+  prog->interval  = interval;
+  prog->mode      = mode;
+  prog->nslots    = ESL_MAX(1, nworkers);
+  ESL_ALLOC(prog->slot, sizeof(P7_PROGRESS_SLOT) * prog->nslots);
+  memset(prog->slot, 0, sizeof(P7_PROGRESS_SLOT) * prog->nslots);
+  prog->t_start   = p7_progress_Now();
+  prog->t_last    = prog->t_start;
+  prog->t_total   = prog->t_start;
+  prog->qname[0]  = '\0';
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_init(&prog->mutex, NULL) != 0) { status = eslESYS; goto ERROR; }
+  if (pthread_cond_init (&prog->cond,  NULL) != 0) { pthread_mutex_destroy(&prog->mutex); status = eslESYS; goto ERROR; }
+  if (pthread_create(&prog->thread, NULL, progress_thread, prog) != 0)
+    {
+      pthread_cond_destroy(&prog->cond);
+      pthread_mutex_destroy(&prog->mutex);
+      status = eslESYS;
+      goto ERROR;
+    }
+#endif
+  return prog;
+
+ ERROR:
+  if (prog) { free(prog->slot); free(prog); }
+  return NULL;
+}
+
+
+/* Function:  p7_progress_NewQuery()
+ * Synopsis:  Start reporting on the next query.
+ *
+ * Purpose:   Query number <nquery> (1..), named <qname>, is about to be
+ *            searched. The workers' counts for the last query are
+ *            added to the run's totals, and their slots cleared for
+ *            the new pipelines.
+ */
+void
+p7_progress_NewQuery(P7_PROGRESS *prog, int nquery, const char *qname)
+{
+  int i;
+
+  if (prog == NULL) return;
+  PROGRESS_LOCK(prog);
+  for (i = 0; i < prog->nslots; i++)
+    {
+      prog->run_targets += prog->slot[i].ntargets;
+      prog->run_pos     += prog->slot[i].npos;
+      prog->slot[i].ntargets = prog->slot[i].npos = 0;
+      prog->slot[i].n_past_msv = prog->slot[i].n_past_bias = prog->slot[i].n_past_vit = prog->slot[i].n_past_fwd = 0;
+    }
+  prog->nquery = nquery;
+  snprintf(prog->qname, sizeof(prog->qname), "%s", (qname ? qname : "-"));
+  PROGRESS_UNLOCK(prog);
+}
+
+
+/* Function:  p7_progress_SetTotal()
+ * Synopsis:  Say how much work there is, for the done and eta fields.
+ *
+ * Purpose:   From now, <total> units of work are to be done, and none
+ *            is done yet. If <by_residues> is TRUE, the units are
+ *            residues (or nodes) and the workers' counts from here on
+ *            measure what's done; otherwise the driver reports it
+ *            with <p7_progress_SetDone()>. A <total> of 0 means it's
+ *            unknown. The estimated time to go assumes the rest goes
+ *            at the rate since this call.
+ */
+void
+p7_progress_SetTotal(P7_PROGRESS *prog, double total, int by_residues)
+{
+  int i;
+
+  if (prog == NULL) return;
+  PROGRESS_LOCK(prog);
+  prog->total       = total;
+  prog->done        = 0.;
+  prog->by_residues = by_residues;
+  prog->pos0        = prog->run_pos;
+  for (i = 0; i < prog->nslots; i++) prog->pos0 += prog->slot[i].npos;
+  prog->t_total     = p7_progress_Now();
+  PROGRESS_UNLOCK(prog);
+}
+
+
+/* Function:  p7_progress_SetDone()
+ * Synopsis:  Report how much of the work is done.
+ */
+void
+p7_progress_SetDone(P7_PROGRESS *prog, double done)
+{
+  if (prog == NULL) return;
+  PROGRESS_LOCK(prog);
+  prog->done = done;
+  PROGRESS_UNLOCK(prog);
+}
+
+
+/* Function:  p7_progress_Worker()
+ * Synopsis:  A worker reports its counts, after a block of targets.
+ *
+ * Purpose:   Worker <idx> (0..nworkers-1) has spent another <busy>
+ *            seconds comparing, and <wait> seconds waiting for
+ *            targets, since its last report. Its pipeline <pli> has
+ *            the counts for the current query so far.
+ */
+void
+p7_progress_Worker(P7_PROGRESS *prog, int idx, const P7_PIPELINE *pli, double busy, double wait)
+{
+  P7_PROGRESS_SLOT *s;
+
+  if (prog == NULL || idx < 0 || idx >= prog->nslots) return;
+  PROGRESS_LOCK(prog);
+  s = &prog->slot[idx];
+  s->ntargets    = (prog->mode == p7_SCAN_MODELS) ? pli->nmodels : pli->nseqs;
+  s->npos        = (prog->mode == p7_SCAN_MODELS) ? pli->nnodes  : pli->nres;
+  s->n_past_msv  = pli->n_past_msv;
+  s->n_past_bias = pli->n_past_bias;
+  s->n_past_vit  = pli->n_past_vit;
+  s->n_past_fwd  = pli->n_past_fwd;
+  s->busy       += busy;
+  s->wait       += wait;
+  PROGRESS_UNLOCK(prog);
+
+#ifndef HMMER_THREADS
+  {
+    double now = p7_progress_Now();
+    if (now - prog->t_last >= prog->interval) progress_report(prog, now, FALSE);
+  }
+#endif
+}
+
+
+/* Function:  p7_progress_ReaderWait()
+ * Synopsis:  The reader reports time spent waiting for an empty block.
+ */
+void
+p7_progress_ReaderWait(P7_PROGRESS *prog, double wait)
+{
+  if (prog == NULL) return;
+  PROGRESS_LOCK(prog);
+  prog->reader_wait += wait;
+  PROGRESS_UNLOCK(prog);
+}
+
+
+/* Function:  p7_progress_Now()
+ * Synopsis:  Monotonic clock, in seconds, for timing busy and wait spells.
+ */
+double
+p7_progress_Now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+
+/* Function:  p7_progress_Destroy()
+ * Synopsis:  Stop reporting; write a last report, and free the object.
+ *
+ * Purpose:   Stop the reporter, write a final report (marked
+ *            <final=1>) for the whole run, close the stream if the
+ *            object owns it, and free <prog>.
+ */
+void
+p7_progress_Destroy(P7_PROGRESS *prog)
+{
+  if (prog == NULL) return;
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&prog->mutex);
+  prog->stop = TRUE;
+  pthread_cond_signal(&prog->cond);
+  pthread_mutex_unlock(&prog->mutex);
+  pthread_join(prog->thread, NULL);
+#endif
+
+  progress_report(prog, p7_progress_Now(), TRUE);
+
+#ifdef HMMER_THREADS
+  pthread_cond_destroy(&prog->cond);
+  pthread_mutex_destroy(&prog->mutex);
+#endif
+  if (prog->close_fp) fclose(prog->fp);
+  free(prog->slot);
+  free(prog);
+}
+/*------------------- end, P7_PROGRESS --------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions
+ *****************************************************************/
+
+/* progress_report()
+ *
+ * Write one report, at time <now>, and start the next interval. Rates
+ * and utilization are over the interval just ended; a worker's busy
+ * time only counts once its block is done, so a worker on a long
+ * block can show 0 for one interval and be clamped to 1 in the next.
+ */
+static void
+progress_report(P7_PROGRESS *prog, double now, int final)
+{
+  uint64_t targets = prog->run_targets;
+  uint64_t pos     = prog->run_pos;
+  uint64_t qtargets= 0, msv = 0, bias = 0, vit = 0, fwd = 0;
+  double   dt, u, umin = 1., umax = 0., usum = 0., wsum = 0.;
+  double   done, eta;
+  int      i;
+
+  PROGRESS_LOCK(prog);
+  dt = now - prog->t_last;
+  for (i = 0; i < prog->nslots; i++)
+    {
+      P7_PROGRESS_SLOT *s = &prog->slot[i];
+
+      qtargets += s->ntargets;
+      pos      += s->npos;
+      msv      += s->n_past_msv;
+      bias     += s->n_past_bias;
+      vit      += s->n_past_vit;
+      fwd      += s->n_past_fwd;
+
+      u     = (dt > 0.) ? ESL_MIN(1., (s->busy - s->rbusy) / dt) : 0.;
+      usum += u;
+      umin  = ESL_MIN(umin, u);
+      umax  = ESL_MAX(umax, u);
+      wsum += (dt > 0.) ? ESL_MIN(1., (s->wait - s->rwait) / dt) : 0.;
+      s->rbusy = s->busy;
+      s->rwait = s->wait;
+    }
+  targets += qtargets;
+
+  done = prog->by_residues ? (double) (pos - prog->pos0) : prog->done;
+  eta  = (prog->total > 0. && done > 0.) ? (now - prog->t_total) * ESL_MAX(0., prog->total - done) / done : -1.;
+
+  if (final)
+    fprintf(prog->fp, "# progress t=%.1f final=1 queries=%d targets=%" PRIu64 " residues=%.4g targets_s=%.6g residues_s_core=%.4g\n",
+	    now - prog->t_start, prog->nquery, targets, (double) pos,
+	    (now > prog->t_start) ? (double) targets / (now - prog->t_start) : 0.,
+	    (now > prog->t_start) ? (double) pos / (now - prog->t_start) / prog->nslots : 0.);
+  else
+    {
+      fprintf(prog->fp, "# progress t=%.1f query=%d name=%s targets=%" PRIu64 " residues=%.4g targets_s=%.6g residues_s_core=%.4g"
+	      " msv=%.4g bias=%.4g vit=%.4g fwd=%.4g util=%.2f util_min=%.2f util_max=%.2f starved=%.3f reader_wait=%.3f",
+	      now - prog->t_start, prog->nquery, prog->qname, targets, (double) pos,
+	      (dt > 0.) ? (double) (targets - prog->last_targets) / dt : 0.,
+	      (dt > 0.) ? (double) (pos - prog->last_pos) / dt / prog->nslots : 0.,
+	      qtargets ? (double) msv  / qtargets : 0.,
+	      qtargets ? (double) bias / qtargets : 0.,
+	      qtargets ? (double) vit  / qtargets : 0.,
+	      qtargets ? (double) fwd  / qtargets : 0.,
+	      usum / prog->nslots, umin, umax, wsum / prog->nslots,
+	      (dt > 0.) ? ESL_MIN(1., (prog->reader_wait - prog->r_reader_wait) / dt) : 0.);
+      if (eta >= 0.) fprintf(prog->fp, " done=%.3f eta=%.0f\n", ESL_MIN(1., done / prog->total), eta);
+      else           fprintf(prog->fp, " done=- eta=-\n");
+    }
+  fflush(prog->fp);
+
+  prog->t_last        = now;
+  prog->last_targets  = targets;
+  prog->last_pos      = pos;
+  prog->r_reader_wait = prog->reader_wait;
+  PROGRESS_UNLOCK(prog);
+}
+
+#ifdef HMMER_THREADS
+/* progress_thread()
+ *
+ * Write a report every <interval> seconds until told to stop. The
+ * wait is on the realtime clock (what pthread_cond_timedwait() takes)
+ * but intervals are measured on the monotonic one.
+ */
+static void *
+progress_thread(void *arg)
+{
+  P7_PROGRESS     *prog = (P7_PROGRESS *) arg;
+  struct timespec  until;
+  double           now;
+  double           left;
+
+  pthread_mutex_lock(&prog->mutex);
+  while (! prog->stop)
+    {
+      now = p7_progress_Now();
+      if (now - prog->t_last >= prog->interval)
+	{
+	  pthread_mutex_unlock(&prog->mutex);
+	  progress_report(prog, now, FALSE);
+	  pthread_mutex_lock(&prog->mutex);
+	  continue;
+	}
+      left = prog->interval - (now - prog->t_last);
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_sec  += (time_t) left;
+      until.tv_nsec += (long) ((left - (double) (time_t) left) * 1e9);
+      if (until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+      pthread_cond_timedwait(&prog->cond, &prog->mutex, &until);
+    }
+  pthread_mutex_unlock(&prog->mutex);
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+/*------------------ end, internal functions --------------------*/
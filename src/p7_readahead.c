@@ -0,0 +1,199 @@
+/* P7_READAHEAD: reading a target sequence file ahead of its parser.
+ *
+ * The threaded search drivers read and parse target sequences on one
+ * thread, with blocking reads. On a network filesystem (NFS, Lustre)
+ * each read can wait on a round trip, and the workers wait with it.
+ * A P7_READAHEAD runs a thread of its own that keeps the next
+ * <window> bytes of the file, past the parser's position, in the page
+ * cache: it asks the kernel to start reading the whole window
+ * (posix_fadvise() POSIX_FADV_WILLNEED, which lets the filesystem
+ * keep several large reads in flight), and then reads through it in
+ * chunks itself, for filesystems that ignore the advice. The parser
+ * then finds its data already in memory.
+ *
+ * The parser reports its position with p7_readahead_Advance(); moving
+ * back (a rewind, for the next query) restarts the readahead there.
+ * Only a plain file can be read ahead: not stdin, and not a .gz file,
+ * whose parse offsets aren't file offsets.
+ *
+ * Without HMMER_THREADS, p7_readahead_Open() always returns NULL, and
+ * callers read without it.
+ *
+ * Contents:
+ *    1. The P7_READAHEAD object.
+ *    2. Internal functions.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+#include "hmmer.h"
+
+#define p7_READAHEAD_CHUNK (4 * 1024 * 1024) /* bytes read per pread() */
+
+#ifdef HMMER_THREADS
+static void *readahead_thread(void *arg);
+#endif
+
+
+/*****************************************************************
+ *= 1. The P7_READAHEAD object
+ *****************************************************************/
+
+/* Function:  p7_readahead_Open()
+ * Synopsis:  Start reading a file ahead of its parser.
+ *
+ * Purpose:   Open sequence file <filename> a second time, and start a
+ *            thread keeping up to <window> bytes of it ahead of the
+ *            parser's position (initially 0) in the page cache.
+ *
+ * Returns:   the new object, or <NULL> if <filename> can't be read
+ *            ahead (stdin, a .gz file, not a regular file, no
+ *            threads) or anything fails. Readahead is only an
+ *            optimization, so callers just go on without it.
+ */
+P7_READAHEAD *
+p7_readahead_Open(const char *filename, size_t window)
+{
+#ifdef HMMER_THREADS
+  P7_READAHEAD *ra  = NULL;
+  struct stat   st;
+  size_t        n   = strlen(filename);
+  int           fd  = -1;
+
+  if (window == 0 || strcmp(filename, "-") == 0)             return NULL;
+  if (n > 3 && strcmp(filename + n - 3, ".gz") == 0)          return NULL;
+  if ((fd = open(filename, O_RDONLY)) < 0)                    return NULL;
+  if (fstat(fd, &st) != 0 || ! S_ISREG(st.st_mode))         { close(fd); return NULL; }
+
+  if ((ra = malloc(sizeof(P7_READAHEAD))) == NULL)          { close(fd); return NULL; }
+  ra->fd      = fd;
+  ra->fsize   = st.st_size;
+  ra->window  = window;
+  ra->parsed  = 0;
+  ra->fetched = 0;
+  ra->stop    = FALSE;
+  if ((ra->buf = malloc(p7_READAHEAD_CHUNK)) == NULL)       { close(fd); free(ra); return NULL; }
+
+  if (pthread_mutex_init(&ra->mutex, NULL) != 0)            { close(fd); free(ra->buf); free(ra); return NULL; }
+  if (pthread_cond_init (&ra->cond,  NULL) != 0)            { pthread_mutex_destroy(&ra->mutex); close(fd); free(ra->buf); free(ra); return NULL; }
+  if (pthread_create(&ra->thread, NULL, readahead_thread, ra) != 0)
+    {
+      pthread_cond_destroy(&ra->cond);
+      pthread_mutex_destroy(&ra->mutex);
+      close(fd);
+      free(ra->buf);
+      free(ra);
+      return NULL;
+    }
+  return ra;
+#else
+  return NULL;
+#endif
+}
+
+
+/* Function:  p7_readahead_Advance()
+ * Synopsis:  Tell the readahead where the parser is.
+ *
+ * Purpose:   The parser of <ra>'s file has reached byte offset <pos>.
+ *            Read ahead from there; if <pos> is behind the last
+ *            position reported, the file was rewound, and readahead
+ *            starts over at <pos>. A negative <pos> (an offset the
+ *            parser didn't record) and a <NULL> <ra> are ignored.
+ */
+void
+p7_readahead_Advance(P7_READAHEAD *ra, off_t pos)
+{
+#ifdef HMMER_THREADS
+  if (ra == NULL || pos < 0) return;
+  pthread_mutex_lock(&ra->mutex);
+  if (pos < ra->parsed) ra->fetched = pos;
+  ra->parsed = pos;
+  pthread_cond_signal(&ra->cond);
+  pthread_mutex_unlock(&ra->mutex);
+#endif
+}
+
+
+/* Function:  p7_readahead_Close()
+ * Synopsis:  Stop reading ahead, and free the object.
+ */
+void
+p7_readahead_Close(P7_READAHEAD *ra)
+{
+#ifdef HMMER_THREADS
+  if (ra == NULL) return;
+  pthread_mutex_lock(&ra->mutex);
+  ra->stop = TRUE;
+  pthread_cond_signal(&ra->cond);
+  pthread_mutex_unlock(&ra->mutex);
+  pthread_join(ra->thread, NULL);
+
+  pthread_cond_destroy(&ra->cond);
+  pthread_mutex_destroy(&ra->mutex);
+  close(ra->fd);
+  free(ra->buf);
+  free(ra);
+#endif
+}
+/*-------------------- end, P7_READAHEAD ------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions
+ *****************************************************************/
+#ifdef HMMER_THREADS
+
+/* readahead_thread()
+ *
+ * Keep [parsed, parsed+window) read: advise the kernel of all of
+ * what's missing, then pread() it a chunk at a time, dropping the
+ * mutex while reading. A chunk that straddles a rewind is simply
+ * read again from the new position.
+ */
+static void *
+readahead_thread(void *arg)
+{
+  P7_READAHEAD *ra = (P7_READAHEAD *) arg;
+  off_t         off, end;
+  size_t        n;
+
+  pthread_mutex_lock(&ra->mutex);
+  while (! ra->stop)
+    {
+      end = ESL_MIN(ra->fsize, ra->parsed + (off_t) ra->window);
+      off = ESL_MAX(ra->fetched, ra->parsed);   /* the parser may have overtaken us */
+      if (off >= end)
+	{
+	  pthread_cond_wait(&ra->cond, &ra->mutex);
+	  continue;
+	}
+
+      n   = (size_t) ESL_MIN((off_t) p7_READAHEAD_CHUNK, end - off);
+      pthread_mutex_unlock(&ra->mutex);
+
+#ifdef POSIX_FADV_WILLNEED
+      posix_fadvise(ra->fd, off, end - off, POSIX_FADV_WILLNEED);
+#endif
+      if (pread(ra->fd, ra->buf, n, off) <= 0) n = 0;
+
+      pthread_mutex_lock(&ra->mutex);
+      if (n == 0)                 break;              /* read error or EOF: give up quietly */
+      if (ra->fetched == off)     ra->fetched = off + n;
+    }
+  pthread_mutex_unlock(&ra->mutex);
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+/*------------------ end, internal functions --------------------*/
@@ -162,7 +162,11 @@ p7_hmm_ScoreDataDestroy(P7_SCOREDATA *data )
  *
  *            Once a hit passes the MSV filter, and the prefix/suffix
  *            values of P7_SCOREDATA are required, p7_hmm_ScoreDataComputeRest()
- *            must be called.
+ *            must be called. The pipeline does that lazily, the first
+ *            time it needs them; so a <P7_SCOREDATA> that several
+ *            threads share must have had p7_hmm_ScoreDataComputeRest()
+ *            called on it first. After that, nothing writes to it, and
+ *            the threads need no copies of their own.
  *
  * Args:      om         - P7_OPROFILE containing scores used to produce SCOREDATA contents
  *            do_opt_ext - boolean, TRUE if optimal-extension scores are required (for FM-MSV)
@@ -254,8 +258,8 @@ p7_hmm_ScoreDataClone(P7_SCOREDATA *src, int Kp) {
      memcpy(new->suffix_lengths, src->suffix_lengths, (src->M+1) * sizeof(float));
   }
   if (src->fwd_scores != NULL) {
-     ESL_ALLOC(new->fwd_scores, (src->M+1) * sizeof(float));
-     memcpy(new->fwd_scores, src->fwd_scores, (src->M+1) * sizeof(float));
+     ESL_ALLOC(new->fwd_scores, (src->M+1) * Kp * sizeof(float));
+     memcpy(new->fwd_scores, src->fwd_scores, (src->M+1) * Kp * sizeof(float));
   }
 
 
@@ -306,9 +310,10 @@ ERROR:
  * Args:      om         - P7_OPROFILE containing emission/transition probabilities used to for calculations
  *            data       - P7_SCOREDATA into which the computed values are placed
  *
- * Returns:   eslEMEM on failure, else eslOK
+ * Returns:   eslOK on success.
  *
- * Throws:    <NULL> on allocation failure.
+ * Throws:    <eslEMEM> on allocation failure; <data> is left for the
+ *            caller to free with p7_hmm_ScoreDataDestroy().
  */
 int
 p7_hmm_ScoreDataComputeRest(P7_OPROFILE *om, P7_SCOREDATA *data )
@@ -324,6 +329,7 @@ p7_hmm_ScoreDataComputeRest(P7_OPROFILE *om, P7_SCOREDATA *data )
 
   //2D array, holding all the transition scores/costs
   ESL_ALLOC(data->fwd_transitions, sizeof(float*) * p7O_NTRANS);
+  for (k=0; k<p7O_NTRANS; k++) data->fwd_transitions[k] = NULL;
 
   for (k=0; k<p7O_NTRANS; k++) {
     ESL_ALLOC(data->fwd_transitions[k], sizeof(float) * (om->M+1));
@@ -381,7 +387,6 @@ p7_hmm_ScoreDataComputeRest(P7_OPROFILE *om, P7_SCOREDATA *data )
   return eslOK;
 
   ERROR:
-   p7_hmm_ScoreDataDestroy(data);
    return eslEMEM;
 }
 
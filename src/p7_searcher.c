@@ -0,0 +1,789 @@
+/* P7_SEARCHER: an in-process search context.
+ *
+ * A program that links libhmmer can load a target sequence database
+ * and/or a profile database into a P7_SEARCHER once, then search
+ * them with any number of query profiles or sequences, from any
+ * number of its own threads at once, and get each result back as a
+ * P7_TOPHITS (and optionally its P7_PIPELINE, for statistics)
+ * instead of output. Nothing is global: everything a search needs is
+ * in the searcher or in the call, so separate searchers don't
+ * interact at all.
+ *
+ * The searcher owns a pool of worker threads. A search is queued as
+ * a job; the workers take targets from it in chunks of
+ * p7_SEARCHER_CHUNK, each with its own pipeline, hit list and length
+ * configured clone of the profile, and merge what they found into
+ * the job's results when there are no targets left. The caller
+ * waits for that, then sorts and thresholds the hits as hmmsearch
+ * and hmmscan do. A searcher with no workers runs each search in
+ * the calling thread.
+ *
+ * Contents:
+ *   1. P7_SEARCHER: creating, loading, searching.
+ *   2. Internal functions: jobs and workers.
+ *   3. Unit tests.
+ *   4. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+#include "p7_hmmcache.h"
+#include "p7_searcher.h"
+
+/* One search, queued for the workers. Everything in it but <ntargets>,
+ * <mode>, <go>, <om> and <sq> is guarded by the searcher's mutex.
+ */
+struct p7_searcher_job_s {
+  enum p7_pipemodes_e  mode;      /* p7_SEARCH_SEQS or p7_SCAN_MODELS                    */
+  const ESL_GETOPTS   *go;        /* pipeline options, or NULL for defaults               */
+  const P7_OPROFILE   *om;        /* query profile (p7_SEARCH_SEQS)                       */
+  const ESL_SQ        *sq;        /* query sequence (p7_SCAN_MODELS)                      */
+  uint64_t             ntargets;  /* targets 0..ntargets-1 are to be searched             */
+  uint64_t             next;      /* next target to hand out                              */
+  int                  nactive;   /* workers with a part of this job                      */
+  int                  done;      /* TRUE when every part is merged into <pli>, <th>      */
+  int                  status;    /* eslOK, or the first error a worker had               */
+  char                 errbuf[eslERRBUFSIZE];
+  P7_PIPELINE         *pli;       /* merged pipeline statistics                           */
+  P7_TOPHITS          *th;        /* merged hits                                          */
+  P7_SEARCHER_JOB     *link;      /* next job in the queue                                */
+};
+
+static int   searcher_run (P7_SEARCHER *srch, P7_SEARCHER_JOB *job);
+static void  searcher_work(P7_SEARCHER *srch, P7_SEARCHER_JOB *job);
+static int   searcher_take(P7_SEARCHER *srch, P7_SEARCHER_JOB *job, uint64_t *ret_a, uint64_t *ret_b);
+static void  searcher_lock  (P7_SEARCHER *srch);
+static void  searcher_unlock(P7_SEARCHER *srch);
+#ifdef HMMER_THREADS
+static void *searcher_thread(void *arg);
+#endif
+
+
+/*****************************************************************
+ * 1. P7_SEARCHER: creating, loading, searching.
+ *****************************************************************/
+
+/* Function:  p7_searcher_Create()
+ * Synopsis:  Create a search context.
+ *
+ * Purpose:   Create a searcher for sequences and profiles in alphabet
+ *            <abctype> (<eslAMINO>, <eslDNA>...), with <ncpus> worker
+ *            threads, and return it in <*ret_srch>. With <ncpus> = 0,
+ *            or without POSIX threads support, each search runs in the
+ *            thread that calls it. If fewer threads can be started
+ *            than asked for, the searcher works with those it has.
+ *
+ *            It has no targets yet; give it some with
+ *            <p7_searcher_SetTargets()> and/or
+ *            <p7_searcher_SetProfiles()>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if <abctype> isn't a valid alphabet type,
+ *            with a message in <errbuf> if it's non-<NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslESYS> if the
+ *            searcher's mutex or condition variables can't be
+ *            created. <*ret_srch> is <NULL> on any error.
+ */
+int
+p7_searcher_Create(int abctype, int ncpus, P7_SEARCHER **ret_srch, char *errbuf)
+{
+  P7_SEARCHER *srch = NULL;
+  int          status;
+
+  if (errbuf) errbuf[0] = '\0';
+  ESL_ALLOC(srch, sizeof(P7_SEARCHER));
+  srch->abc      = NULL;
+  srch->seqdb    = NULL;
+  srch->hmmdb    = NULL;
+  srch->nworkers = 0;
+
+#ifdef HMMER_THREADS
+  srch->thread   = NULL;
+  srch->head     = NULL;
+  srch->tail     = NULL;
+  srch->shutdown = FALSE;
+  if (pthread_mutex_init(&srch->mutex,   NULL) != 0)   { free(srch); ESL_EXCEPTION(eslESYS, "mutex init failed"); }
+  if (pthread_cond_init (&srch->work_cv, NULL) != 0)   { pthread_mutex_destroy(&srch->mutex); free(srch); ESL_EXCEPTION(eslESYS, "cond init failed"); }
+  if (pthread_cond_init (&srch->done_cv, NULL) != 0)   { pthread_cond_destroy(&srch->work_cv); pthread_mutex_destroy(&srch->mutex); free(srch); ESL_EXCEPTION(eslESYS, "cond init failed"); }
+#endif
+
+  if ((srch->abc = esl_alphabet_Create(abctype)) == NULL) ESL_XFAIL(eslEINVAL, errbuf, "bad alphabet type %d", abctype);
+
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      ESL_ALLOC(srch->thread, sizeof(pthread_t) * ncpus);
+      for ( ; srch->nworkers < ncpus; srch->nworkers++)
+	if (pthread_create(&(srch->thread[srch->nworkers]), NULL, searcher_thread, srch) != 0) break;
+    }
+#endif
+
+  *ret_srch = srch;
+  return eslOK;
+
+ ERROR:
+  p7_searcher_Destroy(srch);
+  *ret_srch = NULL;
+  return status;
+}
+
+
+/* Function:  p7_searcher_SetTargets()
+ * Synopsis:  Load the target sequence database of a searcher.
+ *
+ * Purpose:   Make the sequences of <seqfile> the targets that
+ *            <p7_searcher_Search()> searches. If <seqfile> has a current
+ *            pressed database (hmmseqpress) it's opened in place;
+ *            otherwise the whole file is read into memory. Any
+ *            database the searcher had before is closed.
+ *
+ *            Not to be called while any search with <srch> is running.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if <seqfile> can't be opened;
+ *            <eslEFORMAT> if it, or its pressed database, is empty,
+ *            misformatted or corrupt; <eslEINCOMPAT> if its sequences
+ *            aren't in the searcher's alphabet. On any of these,
+ *            <errbuf> (if non-<NULL>) has a message, and the searcher
+ *            keeps the database it had.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_searcher_SetTargets(P7_SEARCHER *srch, const char *seqfile, char *errbuf)
+{
+  P7_SEQDB   *db   = NULL;
+  ESL_SQFILE *sqfp = NULL;
+  int         status;
+
+  if (errbuf) errbuf[0] = '\0';
+  status = p7_seqdb_Open(seqfile, &db, errbuf);
+  if (status == eslENOTFOUND)
+    {
+      status = esl_sqfile_OpenDigital(srch->abc, seqfile, eslSQFILE_UNKNOWN, NULL, &sqfp);
+      if      (status == eslENOTFOUND) ESL_XFAIL(status,    errbuf, "failed to open sequence file %s for reading", seqfile);
+      else if (status == eslEFORMAT)   ESL_XFAIL(status,    errbuf, "sequence file %s is empty or misformatted", seqfile);
+      else if (status != eslOK)        ESL_XFAIL(status,    errbuf, "unexpected error %d opening sequence file %s", status, seqfile);
+      if ((status = p7_seqdb_Load(sqfp, &db, errbuf)) != eslOK) goto ERROR;
+      esl_sqfile_Close(sqfp);
+      sqfp = NULL;
+    }
+  else if (status != eslOK) goto ERROR;
+
+  if (p7_seqdb_SetDigital(db, srch->abc) != eslOK) ESL_XFAIL(eslEINCOMPAT, errbuf, "sequences in %s aren't in the searcher's alphabet", seqfile);
+
+  if (srch->seqdb) p7_seqdb_Close(srch->seqdb);
+  srch->seqdb = db;
+  return eslOK;
+
+ ERROR:
+  if (sqfp) esl_sqfile_Close(sqfp);
+  if (db)   p7_seqdb_Close(db);
+  return status;
+}
+
+
+/* Function:  p7_searcher_SetProfiles()
+ * Synopsis:  Load the target profile database of a searcher.
+ *
+ * Purpose:   Cache the profiles of the pressed profile database
+ *            <hmmfile> (see <p7_hmmcache_Open()>) as the targets that
+ *            <p7_searcher_Scan()> searches. Any profile database the
+ *            searcher had before is closed.
+ *
+ *            Not to be called while any search with <srch> is running.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if <hmmfile> can't be opened;
+ *            <eslEFORMAT> if it isn't a pressed HMMER database;
+ *            <eslEINCOMPAT> if its profiles aren't all in the
+ *            searcher's alphabet. On any of these, <errbuf> (if
+ *            non-<NULL>) has a message, and the searcher keeps the
+ *            profiles it had.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_searcher_SetProfiles(P7_SEARCHER *srch, char *hmmfile, char *errbuf)
+{
+  P7_HMMCACHE *hc = NULL;
+  char         ebuf[eslERRBUFSIZE];
+  int          status;
+
+  if (errbuf) errbuf[0] = '\0';
+  ebuf[0] = '\0';
+  if ((status = p7_hmmcache_Open(hmmfile, &hc, ebuf)) != eslOK)
+    {
+      if (errbuf) strcpy(errbuf, ebuf);
+      goto ERROR;
+    }
+  if (hc->n > 0 && hc->abc->type != srch->abc->type) ESL_XFAIL(eslEINCOMPAT, errbuf, "profiles in %s aren't in the searcher's alphabet", hmmfile);
+
+  if (srch->hmmdb) p7_hmmcache_Close(srch->hmmdb);
+  srch->hmmdb = hc;
+  return eslOK;
+
+ ERROR:
+  if (hc) p7_hmmcache_Close(hc);
+  return status;
+}
+
+
+/* Function:  p7_searcher_Search()
+ * Synopsis:  Search the target sequences with a profile.
+ *
+ * Purpose:   Search every target sequence of <srch> with query profile
+ *            <hmm>, as hmmsearch does, with the pipeline configured by
+ *            <go> (hmmsearch's options), or by default if <go> is
+ *            <NULL>. Return the sorted, thresholded hits in <*ret_th>;
+ *            and, if <opt_pli> is non-<NULL>, the pipeline with the
+ *            search's statistics in <*opt_pli>, for
+ *            <p7_pli_Statistics()> or output with the hits. The caller
+ *            frees them.
+ *
+ *            Any number of threads can search one searcher at once.
+ *            Searches of one searcher are run in the order they're
+ *            called, each by all of its workers.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if the searcher has no target sequences, or
+ *            the pipeline can't use <hmm> (such as a missing score
+ *            cutoff that <go> asks for); <eslEINCOMPAT> if <hmm> isn't
+ *            in the searcher's alphabet. On these, <errbuf> (if
+ *            non-<NULL>) has a message, and <*ret_th> (and
+ *            <*opt_pli>) are <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_searcher_Search(P7_SEARCHER *srch, const P7_HMM *hmm, const ESL_GETOPTS *go, P7_TOPHITS **ret_th, P7_PIPELINE **opt_pli, char *errbuf)
+{
+  P7_SEARCHER_JOB job;
+  P7_BG          *bg = NULL;
+  P7_PROFILE     *gm = NULL;
+  P7_OPROFILE    *om = NULL;
+  int             status;
+
+  job.pli = NULL;
+  job.th  = NULL;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (srch->seqdb == NULL)                  ESL_XFAIL(eslEINVAL,    errbuf, "searcher has no target sequences; see p7_searcher_SetTargets()");
+  if (hmm->abc->type != srch->abc->type)    ESL_XFAIL(eslEINCOMPAT, errbuf, "query model %s isn't in the searcher's alphabet", hmm->name);
+
+  if ((bg = p7_bg_Create(srch->abc))               == NULL) { status = eslEMEM; goto ERROR; }
+  if ((gm = p7_profile_Create (hmm->M, srch->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((om = p7_oprofile_Create(hmm->M, srch->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  p7_ProfileConfig(hmm, bg, gm, 100, p7_LOCAL); /* 100 is a dummy length for now; and MSVFilter requires local mode */
+  p7_oprofile_Convert(gm, om);                  /* <om> is now p7_LOCAL, multihit */
+
+  job.mode     = p7_SEARCH_SEQS;
+  job.go       = go;
+  job.om       = om;
+  job.sq       = NULL;
+  job.ntargets = srch->seqdb->nseq;
+  if ((job.th  = p7_tophits_Create())                                           == NULL) { status = eslEMEM; goto ERROR; }
+  if ((job.pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS))     == NULL) { status = eslEMEM; goto ERROR; }
+  if (p7_pli_NewModel(job.pli, om, bg) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "%s", job.pli->errbuf);
+
+  if ((status = searcher_run(srch, &job)) != eslOK)
+    {
+      if (errbuf) strcpy(errbuf, job.errbuf);
+      goto ERROR;
+    }
+
+  p7_tophits_SortBySortkey(job.th);
+  p7_tophits_Threshold(job.th, job.pli);
+
+  *ret_th = job.th;
+  if (opt_pli) *opt_pli = job.pli; else p7_pipeline_Destroy(job.pli);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  return eslOK;
+
+ ERROR:
+  if (job.th)  p7_tophits_Destroy(job.th);
+  if (job.pli) p7_pipeline_Destroy(job.pli);
+  if (om)      p7_oprofile_Destroy(om);
+  if (gm)      p7_profile_Destroy(gm);
+  if (bg)      p7_bg_Destroy(bg);
+  *ret_th = NULL;
+  if (opt_pli) *opt_pli = NULL;
+  return status;
+}
+
+
+/* Function:  p7_searcher_Scan()
+ * Synopsis:  Search the target profiles with a sequence.
+ *
+ * Purpose:   Search every target profile of <srch> with digital query
+ *            sequence <sq>, as hmmscan does, with the pipeline
+ *            configured by <go> (hmmscan's options), or by default if
+ *            <go> is <NULL>. Results, and the rules for calling it,
+ *            are as for <p7_searcher_Search()>.
+ *
+ *            The cached profiles are shared by every search; each
+ *            worker configures its own clone of one for the length of
+ *            <sq>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINVAL> if the searcher has no target profiles, or
+ *            the pipeline can't use one of them; <eslEINCOMPAT> if
+ *            <sq> isn't a digital sequence in the searcher's alphabet.
+ *            On these, <errbuf> (if non-<NULL>) has a message, and
+ *            <*ret_th> (and <*opt_pli>) are <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_searcher_Scan(P7_SEARCHER *srch, const ESL_SQ *sq, const ESL_GETOPTS *go, P7_TOPHITS **ret_th, P7_PIPELINE **opt_pli, char *errbuf)
+{
+  P7_SEARCHER_JOB job;
+  int             status;
+
+  job.pli = NULL;
+  job.th  = NULL;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (srch->hmmdb == NULL)                                ESL_XFAIL(eslEINVAL,    errbuf, "searcher has no target profiles; see p7_searcher_SetProfiles()");
+  if (sq->dsq == NULL || sq->abc->type != srch->abc->type) ESL_XFAIL(eslEINCOMPAT, errbuf, "query sequence %s isn't a digital sequence in the searcher's alphabet", sq->name);
+
+  job.mode     = p7_SCAN_MODELS;
+  job.go       = go;
+  job.om       = NULL;
+  job.sq       = sq;
+  job.ntargets = srch->hmmdb->n;
+  if ((job.th  = p7_tophits_Create())                                      == NULL) { status = eslEMEM; goto ERROR; }
+  if ((job.pli = p7_pipeline_Create(go, 100, 100, FALSE, p7_SCAN_MODELS))  == NULL) { status = eslEMEM; goto ERROR; } /* M_hint = 100, L_hint = 100 are just dummies for now */
+  p7_pli_NewSeq(job.pli, sq);
+
+  if ((status = searcher_run(srch, &job)) != eslOK)
+    {
+      if (errbuf) strcpy(errbuf, job.errbuf);
+      goto ERROR;
+    }
+
+  p7_tophits_SortBySortkey(job.th);
+  p7_tophits_Threshold(job.th, job.pli);
+
+  *ret_th = job.th;
+  if (opt_pli) *opt_pli = job.pli; else p7_pipeline_Destroy(job.pli);
+  return eslOK;
+
+ ERROR:
+  if (job.th)  p7_tophits_Destroy(job.th);
+  if (job.pli) p7_pipeline_Destroy(job.pli);
+  *ret_th = NULL;
+  if (opt_pli) *opt_pli = NULL;
+  return status;
+}
+
+
+/* Function:  p7_searcher_Destroy()
+ * Synopsis:  Stop a searcher's workers and free it.
+ *
+ * Purpose:   Stop and join the worker threads of <srch>, close its
+ *            databases, and free it. Not to be called while any
+ *            search with <srch> is running.
+ */
+void
+p7_searcher_Destroy(P7_SEARCHER *srch)
+{
+#ifdef HMMER_THREADS
+  int w;
+#endif
+
+  if (! srch) return;
+
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&srch->mutex);
+  srch->shutdown = TRUE;
+  pthread_cond_broadcast(&srch->work_cv);
+  pthread_mutex_unlock(&srch->mutex);
+  for (w = 0; w < srch->nworkers; w++)
+    pthread_join(srch->thread[w], NULL);
+  free(srch->thread);
+  pthread_cond_destroy(&srch->done_cv);
+  pthread_cond_destroy(&srch->work_cv);
+  pthread_mutex_destroy(&srch->mutex);
+#endif
+
+  if (srch->seqdb) p7_seqdb_Close(srch->seqdb);
+  if (srch->hmmdb) p7_hmmcache_Close(srch->hmmdb);
+  if (srch->abc)   esl_alphabet_Destroy(srch->abc);
+  free(srch);
+}
+/*--------------------- end, P7_SEARCHER ------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions: jobs and workers.
+ *****************************************************************/
+
+/* searcher_run()
+ *
+ * Run <job> to the end: queue it for the workers and wait for them,
+ * or, with no workers, do all of it here. Return the job's status;
+ * on an error, <job->errbuf> has a message.
+ */
+static int
+searcher_run(P7_SEARCHER *srch, P7_SEARCHER_JOB *job)
+{
+  job->next      = 0;
+  job->nactive   = 0;
+  job->done      = FALSE;
+  job->status    = eslOK;
+  job->errbuf[0] = '\0';
+  job->link      = NULL;
+  if (job->ntargets == 0) return eslOK;
+
+#ifdef HMMER_THREADS
+  if (srch->nworkers > 0)
+    {
+      pthread_mutex_lock(&srch->mutex);
+      if (srch->tail) srch->tail->link = job; else srch->head = job;
+      srch->tail = job;
+      pthread_cond_broadcast(&srch->work_cv);
+      while (! job->done) pthread_cond_wait(&srch->done_cv, &srch->mutex);
+      pthread_mutex_unlock(&srch->mutex);
+      return job->status;
+    }
+#endif
+
+  job->nactive = 1;
+  searcher_work(srch, job);
+  return job->status;
+}
+
+
+/* searcher_work()
+ *
+ * One worker's part of <job>, which it has already joined
+ * (<job->nactive> counts it): search chunks of targets until there
+ * are none left, with a pipeline, hit list and profile clone of its
+ * own; then merge them into the job's, leave it, and if it was the
+ * last to leave, mark the job done. An error stops the whole job.
+ */
+static void
+searcher_work(P7_SEARCHER *srch, P7_SEARCHER_JOB *job)
+{
+  P7_BG       *bg  = NULL;
+  P7_PIPELINE *pli = NULL;
+  P7_TOPHITS  *th  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_SQ       view;		/* a target of p7_SEARCH_SEQS, in <srch->seqdb> */
+  char         errbuf[eslERRBUFSIZE];
+  uint64_t     a, b, i;
+  int          status = eslOK;
+
+  errbuf[0] = '\0';
+  memset(&view, 0, sizeof(ESL_SQ));
+
+  if ((bg  = p7_bg_Create(srch->abc))                                                      == NULL) ESL_XFAIL(eslEMEM, errbuf, "allocation failure");
+  if ((th  = p7_tophits_Create())                                                          == NULL) ESL_XFAIL(eslEMEM, errbuf, "allocation failure");
+  if ((pli = p7_pipeline_Create(job->go, (job->om ? job->om->M : 100), 100, FALSE, job->mode)) == NULL) ESL_XFAIL(eslEMEM, errbuf, "allocation failure");
+
+  if (job->mode == p7_SEARCH_SEQS)
+    {
+      if ((om = p7_oprofile_Clone(job->om))   == NULL) ESL_XFAIL(eslEMEM, errbuf, "allocation failure");
+      if (p7_pli_NewModel(pli, om, bg)       != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "%s", pli->errbuf);
+    }
+  else p7_pli_NewSeq(pli, job->sq);
+
+  while (searcher_take(srch, job, &a, &b))
+    for (i = a; i < b; i++)
+      {
+	if (job->mode == p7_SEARCH_SEQS)
+	  {
+	    p7_seqdb_Get(srch->seqdb, i, &view);
+	    p7_pli_NewSeq(pli, &view);
+	    p7_bg_SetLength(bg, view.n);
+	    p7_oprofile_ReconfigLength(om, view.n);
+	    status = p7_Pipeline(pli, om, bg, &view, NULL, th);
+	  }
+	else
+	  {
+	    if ((om = p7_oprofile_Clone(srch->hmmdb->list[i])) == NULL) ESL_XFAIL(eslEMEM, errbuf, "allocation failure");
+	    p7_pli_NewModel(pli, om, bg);
+	    p7_bg_SetLength(bg, job->sq->n);
+	    p7_oprofile_ReconfigLength(om, job->sq->n);
+	    status = p7_Pipeline(pli, om, bg, job->sq, NULL, th);
+	    p7_oprofile_Destroy(om);
+	    om = NULL;
+	  }
+	if      (status == eslEINVAL) ESL_XFAIL(status, errbuf, "%s", pli->errbuf);
+	else if (status != eslOK)     ESL_XFAIL(status, errbuf, "pipeline failed with error %d", status);
+	p7_pipeline_Reuse(pli);
+      }
+
+ ERROR:
+  searcher_lock(srch);
+  if (status == eslOK && job->status == eslOK)
+    {
+      p7_pipeline_Merge(job->pli, pli);
+      if ((status = p7_tophits_Merge(job->th, th)) != eslOK) snprintf(errbuf, eslERRBUFSIZE, "allocation failure");
+    }
+  if (status != eslOK && job->status == eslOK)
+    {
+      job->status = status;
+      strcpy(job->errbuf, errbuf);
+      job->next   = job->ntargets;	/* hand out nothing more */
+#ifdef HMMER_THREADS
+      if (srch->head == job) { srch->head = job->link; if (! srch->head) srch->tail = NULL; }
+#endif
+    }
+  if (--job->nactive == 0 && job->next >= job->ntargets)
+    {
+      job->done = TRUE;
+#ifdef HMMER_THREADS
+      pthread_cond_broadcast(&srch->done_cv);
+#endif
+    }
+  searcher_unlock(srch);
+
+  if (om)  p7_oprofile_Destroy(om);
+  if (pli) p7_pipeline_Destroy(pli);
+  if (th)  p7_tophits_Destroy(th);
+  if (bg)  p7_bg_Destroy(bg);
+}
+
+
+/* searcher_take()
+ *
+ * Hand out the next chunk of targets of <job>, <*ret_a>..<*ret_b>-1,
+ * and return TRUE; or return FALSE if there are none left. The job
+ * leaves the queue with its last chunk, so no more workers join it.
+ */
+static int
+searcher_take(P7_SEARCHER *srch, P7_SEARCHER_JOB *job, uint64_t *ret_a, uint64_t *ret_b)
+{
+  int found = FALSE;
+
+  searcher_lock(srch);
+  if (job->next < job->ntargets)
+    {
+      *ret_a    = job->next;
+      *ret_b    = ESL_MIN(job->next + p7_SEARCHER_CHUNK, job->ntargets);
+      job->next = *ret_b;
+      found     = TRUE;
+#ifdef HMMER_THREADS
+      if (job->next == job->ntargets && srch->head == job) { srch->head = job->link; if (! srch->head) srch->tail = NULL; }
+#endif
+    }
+  searcher_unlock(srch);
+  return found;
+}
+
+
+/* searcher_lock(), searcher_unlock()
+ *
+ * Guard the job queue and the jobs on it; a searcher without workers
+ * has nothing to guard.
+ */
+static void
+searcher_lock(P7_SEARCHER *srch)
+{
+#ifdef HMMER_THREADS
+  if (srch->nworkers > 0) pthread_mutex_lock(&srch->mutex);
+#endif
+}
+
+static void
+searcher_unlock(P7_SEARCHER *srch)
+{
+#ifdef HMMER_THREADS
+  if (srch->nworkers > 0) pthread_mutex_unlock(&srch->mutex);
+#endif
+}
+
+
+#ifdef HMMER_THREADS
+/* searcher_thread()
+ *
+ * A worker: join the job at the head of the queue, do its part of it,
+ * and wait for the next, until the searcher is destroyed.
+ */
+static void *
+searcher_thread(void *arg)
+{
+  P7_SEARCHER     *srch = (P7_SEARCHER *) arg;
+  P7_SEARCHER_JOB *job;
+
+  impl_Init();                  /* processor specific initialization */
+
+  pthread_mutex_lock(&srch->mutex);
+  for (;;)
+    {
+      while (! srch->shutdown && srch->head == NULL)
+	pthread_cond_wait(&srch->work_cv, &srch->mutex);
+      if (srch->shutdown) break;
+
+      job = srch->head;
+      job->nactive++;
+      pthread_mutex_unlock(&srch->mutex);
+      searcher_work(srch, job);
+      pthread_mutex_lock(&srch->mutex);
+    }
+  pthread_mutex_unlock(&srch->mutex);
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7SEARCHER_TESTDRIVE
+#include <unistd.h>
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_search()
+ *
+ * Write a FASTA file of <nseq> sequences, every third one emitted by a
+ * random profile and the rest i.i.d. background, and search it with
+ * that profile in a searcher with no workers and in one with
+ * <ncpus> of them: both give the same hits, in the same order, and
+ * count every target. Two searches of the same searcher, one after
+ * the other, give the same result too.
+ */
+static void
+utest_search(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int nseq, int ncpus)
+{
+  char         msg[]       = "p7_searcher search unit test failed";
+  char         tmpname[32] = "esltmpXXXXXX";
+  FILE        *fp          = NULL;
+  P7_HMM      *hmm         = NULL;
+  ESL_SQ      *sq          = NULL;
+  P7_SEARCHER *s1          = NULL;
+  P7_SEARCHER *s2          = NULL;
+  P7_TOPHITS  *th1         = NULL;
+  P7_TOPHITS  *th2         = NULL;
+  P7_TOPHITS  *th3         = NULL;
+  P7_PIPELINE *pli1        = NULL;
+  P7_PIPELINE *pli2        = NULL;
+  char         name[32];
+  char         errbuf[eslERRBUFSIZE];
+  int          L;
+  int          i;
+
+  if (p7_hmm_Sample(rng, M, abc, &hmm)         != eslOK) esl_fatal(msg);
+  if ((sq = esl_sq_CreateDigital(abc))         == NULL)  esl_fatal(msg);
+  if (esl_tmpfile_named(tmpname, &fp)          != eslOK) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (i % 3 == 0)
+	{
+	  if (p7_CoreEmit(rng, hmm, sq, NULL)                 != eslOK) esl_fatal(msg);
+	}
+      else
+	{
+	  L = 1 + esl_rnd_Roll(rng, 2*M);
+	  if (esl_sq_GrowTo(sq, L)                            != eslOK) esl_fatal(msg);
+	  if (esl_rsq_xfIID(rng, bg->f, abc->K, L, sq->dsq)   != eslOK) esl_fatal(msg);
+	  sq->n = L;
+	}
+      snprintf(name, 32, "seq%d", i);
+      if (esl_sq_SetName(sq, name)                         != eslOK) esl_fatal(msg);
+      if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE)   != eslOK) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  fclose(fp);
+
+  if (p7_searcher_Create(abc->type, 0,     &s1, errbuf)  != eslOK) esl_fatal(msg);
+  if (p7_searcher_Create(abc->type, ncpus, &s2, errbuf)  != eslOK) esl_fatal(msg);
+  if (p7_searcher_Search(s1, hmm, NULL, &th1, NULL, errbuf) != eslEINVAL || th1 != NULL) esl_fatal(msg);
+  if (p7_searcher_SetTargets(s1, tmpname, errbuf)         != eslOK) esl_fatal(msg);
+  if (p7_searcher_SetTargets(s2, tmpname, errbuf)         != eslOK) esl_fatal(msg);
+
+  if (p7_searcher_Search(s1, hmm, NULL, &th1, &pli1, errbuf) != eslOK) esl_fatal(msg);
+  if (p7_searcher_Search(s2, hmm, NULL, &th2, &pli2, errbuf) != eslOK) esl_fatal(msg);
+  if (p7_searcher_Search(s2, hmm, NULL, &th3, NULL,  errbuf) != eslOK) esl_fatal(msg);
+
+  if (pli1->nseqs != nseq || pli2->nseqs != nseq)          esl_fatal(msg);
+  if (pli1->Z != nseq || pli2->Z != nseq)                  esl_fatal(msg);
+  if (pli1->n_past_msv != pli2->n_past_msv)                esl_fatal(msg);
+  if (th1->N == 0 || th1->N != th2->N || th1->N != th3->N) esl_fatal(msg);
+  for (i = 0; i < th1->N; i++)
+    {
+      if (strcmp(th1->hit[i]->name, th2->hit[i]->name) != 0) esl_fatal(msg);
+      if (strcmp(th1->hit[i]->name, th3->hit[i]->name) != 0) esl_fatal(msg);
+      if (th1->hit[i]->score != th2->hit[i]->score)          esl_fatal(msg);
+      if (th1->hit[i]->ndom  != th2->hit[i]->ndom)           esl_fatal(msg);
+    }
+
+  p7_tophits_Destroy(th1);
+  p7_tophits_Destroy(th2);
+  p7_tophits_Destroy(th3);
+  p7_pipeline_Destroy(pli1);
+  p7_pipeline_Destroy(pli2);
+  p7_searcher_Destroy(s1);
+  p7_searcher_Destroy(s2);
+  remove(tmpname);
+  esl_sq_Destroy(sq);
+  p7_hmm_Destroy(hmm);
+}
+#endif /*p7SEARCHER_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7SEARCHER_TESTDRIVE
+/*
+  gcc -o p7_searcher_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7SEARCHER_TESTDRIVE p7_searcher.c -lhmmer -leasel -lm
+  ./p7_searcher_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-M",        eslARG_INT,     "50", NULL, NULL,  NULL,  NULL, NULL, "length of the sampled query profile",              0 },
+  { "-N",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "number of target sequences",                       0 },
+  { "--cpu",     eslARG_INT,      "2", NULL, NULL,  NULL,  NULL, NULL, "number of worker threads",                         0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_SEARCHER";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg  = p7_bg_Create(abc);
+
+  impl_Init();
+  utest_search(rng, abc, bg, esl_opt_GetInteger(go, "-M"), esl_opt_GetInteger(go, "-N"), esl_opt_GetInteger(go, "--cpu"));
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7SEARCHER_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
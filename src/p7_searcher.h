@@ -0,0 +1,47 @@
+/* An in-process search context: targets and profiles loaded once,
+ * searched by any number of callers with no global state.
+ */
+#ifndef P7_SEARCHER_INCLUDED
+#define P7_SEARCHER_INCLUDED
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+#include "p7_hmmcache.h"
+
+#define p7_SEARCHER_CHUNK 32	/* targets a worker takes from a job at a time */
+
+typedef struct p7_searcher_job_s P7_SEARCHER_JOB;
+
+typedef struct p7_searcher_s {
+  ESL_ALPHABET       *abc;         /* alphabet of targets and profiles                 */
+  P7_SEQDB           *seqdb;       /* target sequences, or NULL; p7_searcher_SetTargets()  */
+  P7_HMMCACHE        *hmmdb;       /* target profiles, or NULL;  p7_searcher_SetProfiles() */
+  int                 nworkers;    /* # of worker threads; 0 = searches run in the caller */
+
+#ifdef HMMER_THREADS
+  pthread_t          *thread;      /* [0..nworkers-1] worker threads                   */
+  pthread_mutex_t     mutex;       /* guards the job queue, and every job on it        */
+  pthread_cond_t      work_cv;     /* signalled when a job is queued, or on shutdown   */
+  pthread_cond_t      done_cv;     /* broadcast when a job is finished                 */
+  P7_SEARCHER_JOB    *head;        /* queue of jobs with targets left to hand out      */
+  P7_SEARCHER_JOB    *tail;
+  int                 shutdown;    /* TRUE tells the workers to exit                   */
+#endif
+} P7_SEARCHER;
+
+extern int  p7_searcher_Create     (int abctype, int ncpus, P7_SEARCHER **ret_srch, char *errbuf);
+extern int  p7_searcher_SetTargets (P7_SEARCHER *srch, const char *seqfile, char *errbuf);
+extern int  p7_searcher_SetProfiles(P7_SEARCHER *srch, char *hmmfile, char *errbuf);
+extern int  p7_searcher_Search     (P7_SEARCHER *srch, const P7_HMM *hmm, const ESL_GETOPTS *go, P7_TOPHITS **ret_th, P7_PIPELINE **opt_pli, char *errbuf);
+extern int  p7_searcher_Scan       (P7_SEARCHER *srch, const ESL_SQ *sq,   const ESL_GETOPTS *go, P7_TOPHITS **ret_th, P7_PIPELINE **opt_pli, char *errbuf);
+extern void p7_searcher_Destroy    (P7_SEARCHER *srch);
+
+#endif /*P7_SEARCHER_INCLUDED*/
+
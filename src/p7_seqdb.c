@@ -0,0 +1,1473 @@
+/* P7_SEQDB: pressed target sequence databases.
+ *
+ * Every hmmsearch, phmmer or jackhmmer run parses and digitizes its
+ * whole target sequence file again; for repeated searches of the same
+ * large database, that can be most of the time spent outside the
+ * filters. hmmseqpress runs p7_seqdb_Press() once, to save the
+ * digitized targets as <seqfile>.h3q; the search programs then find
+ * it with p7_seqdb_Open(), map it, and hand the pipeline sequences
+ * whose residues, names and descriptions point straight into the
+ * mapping, with nothing parsed, copied or allocated per target.
+ *
+ * File layout. Integers are in native byte order, so a pressed file
+ * is only valid on machines of the same architecture, like an hmmpgmd
+ * snapshot; the magic number catches a byte-swapped one. Sections
+ * start on p7_SEQDB_ALIGN boundaries, so they can be used in place.
+ *
+ *   header:   uint32     p7_SEQDB_MAGIC
+ *             uint32     alphabet type (eslAMINO, eslDNA...)
+ *             uint64     nseq, number of sequences
+ *             uint64     nres, total number of residues
+ *             uint64     maxL, length of the longest sequence
+ *             uint64     offset and size of the residue section
+ *             uint64     offset of the index
+ *             uint64     offset and size of the metadata section
+ *
+ *   residues: the digital sequences end to end, each preceded by a
+ *             sentinel, and one more sentinel at the end; so a
+ *             sequence's residues dsq[1..L] are bracketed by sentinels
+ *             as an ESL_SQ's are, each one sharing its trailing
+ *             sentinel with the next one's leading sentinel.
+ *
+ *   index:    nseq+1 P7_SEQDB_ENTRYs, one per sequence in file order:
+ *             the offset of its leading sentinel in the residue
+ *             section (the last entry's is the final sentinel, so
+ *             L = roff[i+1] - roff[i] - 1) and of its names in the
+ *             metadata section.
+ *
+ *   metadata: for each sequence, its name, accession and description,
+ *             each NUL-terminated (the empty string if there's none).
+ *
+ *   trailer:  uint32     p7_SEQDB_MAGIC
+ *
+ * Metadata are kept apart from residues so that a scan only pages in
+ * the residues, and the names of the few targets that become hits.
+ *
+ * Contents:
+ *    1. Pressing a sequence file; or writing one sequence at a time.
+ *    2. Opening and reading a pressed database; or loading one into memory,
+ *       whole or a listed subset.
+ *    3. Internal functions.
+ *    4. Unit tests.
+ *    5. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_fileparser.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+
+#define p7_SEQDB_ALIGN 4096	/* sections start on page boundaries */
+
+static int  seqdb_is_current(const char *seqfile, const char *dbfile);
+static int  seqdb_pad(FILE *fp, uint64_t *offset);
+static int  seqdb_append(FILE *fp, FILE *src, uint64_t n);
+static int  seqdb_get(char **p, char *end, void *dst, size_t n);
+static void seqdb_view(const P7_SEQDB *db, uint64_t i, ESL_SQ *sq);
+static int  seqdb_load(ESL_SQFILE *sqfp, const off_t *roff, off_t start, uint64_t nkey, P7_SEQDB **ret_db, char *errbuf);
+static int  seqdb_loadnext(ESL_SQFILE *sqfp, const off_t *roff, uint64_t nkey, uint64_t *k, ESL_SQ *sq, int info_only);
+static int  seqdb_cmp_off(const void *a, const void *b);
+
+
+/*****************************************************************
+ * 1. Pressing a sequence file; or writing one sequence at a time.
+ *****************************************************************/
+
+/* Function:  p7_seqdb_Press()
+ * Synopsis:  Save the digitized sequences of a file as a pressed database.
+ *
+ * Purpose:   Read the sequences of digital sequence file <sqfp> from
+ *            its current position to the end, and write them as the
+ *            pressed sequence database <dbfile>, normally
+ *            <seqfile>.h3q (<p7_SEQDB_SUFFIX>), through a
+ *            <P7_SEQDB_WRITER>. 
+ *
+ *            Optionally return the number of sequences and residues
+ *            pressed in <opt_nseq> and <opt_nres>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEFORMAT> on a parse error in <sqfp>; <eslEWRITE> if
+ *            a file can't be written, or a name is too long to index.
+ *            In either case, <errbuf> (if non-<NULL>) has a message,
+ *            and no <dbfile> is left behind.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqdb_Press(ESL_SQFILE *sqfp, const char *dbfile, uint64_t *opt_nseq, uint64_t *opt_nres, char *errbuf)
+{
+  ESL_SQ          *sq = NULL;
+  P7_SEQDB_WRITER *w  = NULL;
+  int              status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if ((sq = esl_sq_CreateDigital(sqfp->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = p7_seqdb_CreateWriter(dbfile, sqfp->abc->type, &w, errbuf)) != eslOK) goto ERROR;
+
+  while ((status = esl_sqio_Read(sqfp, sq)) == eslOK)
+    {
+      if ((status = p7_seqdb_Write(w, sq)) != eslOK) { if (errbuf) strcpy(errbuf, w->errbuf); goto ERROR; }
+      esl_sq_Reuse(sq);
+    }
+  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, "parse failed (sequence file %s):\n%s", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+  else if (status != eslEOF)     ESL_XFAIL(status,     errbuf, "unexpected error %d reading sequence file %s", status, sqfp->filename);
+
+  status = p7_seqdb_CloseWriter(w, opt_nseq, opt_nres, errbuf);
+  w = NULL;
+  if (status != eslOK) goto ERROR;
+
+  esl_sq_Destroy(sq);
+  return eslOK;
+
+ ERROR:
+  if (w)  p7_seqdb_DestroyWriter(w);
+  if (sq) esl_sq_Destroy(sq);
+  if (opt_nseq) *opt_nseq = 0;
+  if (opt_nres) *opt_nres = 0;
+  return status;
+}
+
+
+/* Function:  p7_seqdb_CreateWriter()
+ * Synopsis:  Start writing a pressed database one sequence at a time.
+ *
+ * Purpose:   Open a new pressed sequence database <dbfile> in alphabet
+ *            <abctype> (<eslAMINO>, <eslDNA>...), for a caller that
+ *            makes its sequences rather than reading them from a file,
+ *            such as <hmmemit --press>. Sequences are added with
+ *            <p7_seqdb_Write()>, and the file is finished with
+ *            <p7_seqdb_CloseWriter()>, or abandoned with
+ *            <p7_seqdb_DestroyWriter()>.
+ *
+ *            The file is written to <dbfile>.tmp and renamed when it's
+ *            closed, so searches never see a partial one. The index
+ *            and metadata are spooled to temporary files while the
+ *            residues are written, so memory use doesn't grow with
+ *            the database.
+ *
+ * Returns:   <eslOK> on success, and <*ret_w> is the new writer.
+ *            <eslEWRITE> if a file can't be opened, with a message in
+ *            <errbuf> if it's non-<NULL>; <*ret_w> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqdb_CreateWriter(const char *dbfile, int abctype, P7_SEQDB_WRITER **ret_w, char *errbuf)
+{
+  P7_SEQDB_WRITER *w        = NULL;
+  ESL_DSQ          sentinel = eslDSQ_SENTINEL;
+  uint64_t         offset   = 0;
+  int              status;
+
+  if (errbuf) errbuf[0] = '\0';
+  ESL_ALLOC(w, sizeof(P7_SEQDB_WRITER));
+  w->dbfile    = NULL;
+  w->tmpname   = NULL;
+  w->fp        = NULL;
+  w->efp       = NULL;
+  w->mfp       = NULL;
+  w->abctype   = abctype;
+  w->nseq      = 0;
+  w->nres      = 0;
+  w->maxL      = 0;
+  w->res_off   = 0;
+  w->res_size  = 0;
+  w->meta_size = 0;
+  w->errbuf[0] = '\0';
+
+  if ((status = esl_strdup(dbfile, -1, &(w->dbfile)))      != eslOK) goto ERROR;
+  if ((status = esl_sprintf(&(w->tmpname), "%s.tmp", dbfile)) != eslOK) goto ERROR;
+  if ((w->fp  = fopen(w->tmpname, "wb")) == NULL) ESL_XFAIL(eslEWRITE, errbuf, "failed to open %s for writing", w->tmpname);
+  if ((w->efp = tmpfile())               == NULL) ESL_XFAIL(eslEWRITE, errbuf, "failed to open a temporary file");
+  if ((w->mfp = tmpfile())               == NULL) ESL_XFAIL(eslEWRITE, errbuf, "failed to open a temporary file");
+
+  /* The header is written at the end, once its fields are known; zeros for now */
+  if (fputc('\0', w->fp) == EOF) ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+  offset = 1;
+  if (seqdb_pad(w->fp, &offset) != eslOK) ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+
+  /* Residues follow, as they're written */
+  w->res_off = offset;
+  if (fwrite(&sentinel, sizeof(ESL_DSQ), 1, w->fp) != 1) ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+  w->res_size = 1;
+
+  *ret_w = w;
+  return eslOK;
+
+ ERROR:
+  p7_seqdb_DestroyWriter(w);
+  *ret_w = NULL;
+  return status;
+}
+
+
+/* Function:  p7_seqdb_Write()
+ * Synopsis:  Add one digital sequence to a pressed database.
+ *
+ * Purpose:   Append digital sequence <sq> (its name, accession,
+ *            description and residues) to the database being written
+ *            by <w>. 
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEWRITE> if a write fails, or the names are too long
+ *            to index; <w->errbuf> has a message. The caller should
+ *            then abandon <w> with <p7_seqdb_DestroyWriter()>.
+ */
+int
+p7_seqdb_Write(P7_SEQDB_WRITER *w, const ESL_SQ *sq)
+{
+  P7_SEQDB_ENTRY ent;
+  ESL_DSQ        sentinel = eslDSQ_SENTINEL;
+  size_t         nlen     = strlen(sq->name);
+  size_t         alen     = strlen(sq->acc);
+  size_t         dlen     = strlen(sq->desc);
+  int            status;
+
+  if (nlen + alen + 2 > UINT32_MAX) ESL_XFAIL(eslEWRITE, w->errbuf, "names of sequence %s are too long to press", sq->name);
+
+  ent.roff = w->res_size - 1;
+  ent.moff = w->meta_size;
+  ent.aoff = nlen + 1;
+  ent.doff = nlen + alen + 2;
+  if (fwrite(&ent, sizeof(P7_SEQDB_ENTRY), 1, w->efp) != 1)                        ESL_XFAIL(eslEWRITE, w->errbuf, "write of temporary index failed");
+  if (fwrite(sq->name, 1, nlen+1, w->mfp) != nlen+1 ||
+      fwrite(sq->acc,  1, alen+1, w->mfp) != alen+1 ||
+      fwrite(sq->desc, 1, dlen+1, w->mfp) != dlen+1)                               ESL_XFAIL(eslEWRITE, w->errbuf, "write of temporary metadata failed");
+  if (sq->n && fwrite(sq->dsq+1, sizeof(ESL_DSQ), sq->n, w->fp) != (size_t) sq->n) ESL_XFAIL(eslEWRITE, w->errbuf, "write of %s failed", w->tmpname);
+  if (fwrite(&sentinel, sizeof(ESL_DSQ), 1, w->fp) != 1)                           ESL_XFAIL(eslEWRITE, w->errbuf, "write of %s failed", w->tmpname);
+
+  w->meta_size += nlen + alen + dlen + 3;
+  w->res_size  += sq->n + 1;
+  w->nres      += sq->n;
+  w->maxL       = ESL_MAX(w->maxL, (uint64_t) sq->n);
+  w->nseq++;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_seqdb_CloseWriter()
+ * Synopsis:  Finish a pressed database.
+ *
+ * Purpose:   Write the index, metadata and header of the database
+ *            being written by <w>, rename it to its final name, and
+ *            free <w>. Optionally return the number of sequences and
+ *            residues in it in <opt_nseq> and <opt_nres>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEWRITE> if a write fails, with a message in <errbuf>
+ *            if it's non-<NULL>; no database is left behind. 
+ *            Either way, <w> is free'd.
+ */
+int
+p7_seqdb_CloseWriter(P7_SEQDB_WRITER *w, uint64_t *opt_nseq, uint64_t *opt_nres, char *errbuf)
+{
+  uint32_t       magic    = p7_SEQDB_MAGIC;
+  uint64_t       ent_off  = 0;
+  uint64_t       meta_off = 0;
+  uint64_t       offset   = 0;
+  P7_SEQDB_ENTRY ent;
+  int            status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+  /* The last index entry closes both sections */
+  ent.roff = w->res_size - 1;
+  ent.moff = w->meta_size;
+  ent.aoff = ent.doff = 0;
+  if (fwrite(&ent, sizeof(P7_SEQDB_ENTRY), 1, w->efp) != 1) ESL_XFAIL(eslEWRITE, errbuf, "write of temporary index failed");
+
+  /* Index and metadata, copied in after the residues */
+  offset = w->res_off + w->res_size;
+  if (seqdb_pad(w->fp, &offset) != eslOK)                                          ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+  ent_off = offset;
+  if (seqdb_append(w->fp, w->efp, sizeof(P7_SEQDB_ENTRY) * (w->nseq+1)) != eslOK)  ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+  offset += sizeof(P7_SEQDB_ENTRY) * (w->nseq+1);
+  if (seqdb_pad(w->fp, &offset) != eslOK)                                          ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+  meta_off = offset;
+  if (seqdb_append(w->fp, w->mfp, w->meta_size) != eslOK)                          ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+  if (fwrite(&magic, sizeof(uint32_t), 1, w->fp) != 1)                             ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+
+  /* and now the header */
+  if (fseeko(w->fp, 0, SEEK_SET) != 0)                                             ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+  if (fwrite(&magic,         sizeof(uint32_t), 1, w->fp) != 1 ||
+      fwrite(&(w->abctype),  sizeof(uint32_t), 1, w->fp) != 1 ||
+      fwrite(&(w->nseq),     sizeof(uint64_t), 1, w->fp) != 1 ||
+      fwrite(&(w->nres),     sizeof(uint64_t), 1, w->fp) != 1 ||
+      fwrite(&(w->maxL),     sizeof(uint64_t), 1, w->fp) != 1 ||
+      fwrite(&(w->res_off),  sizeof(uint64_t), 1, w->fp) != 1 ||
+      fwrite(&(w->res_size), sizeof(uint64_t), 1, w->fp) != 1 ||
+      fwrite(&ent_off,       sizeof(uint64_t), 1, w->fp) != 1 ||
+      fwrite(&meta_off,      sizeof(uint64_t), 1, w->fp) != 1 ||
+      fwrite(&(w->meta_size),sizeof(uint64_t), 1, w->fp) != 1)                     ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname);
+
+  status = fclose(w->fp);
+  w->fp  = NULL;
+  if (status != 0) { remove(w->tmpname); ESL_XFAIL(eslEWRITE, errbuf, "write of %s failed", w->tmpname); }
+  if (rename(w->tmpname, w->dbfile) != 0) { remove(w->tmpname); ESL_XFAIL(eslEWRITE, errbuf, "failed to rename %s to %s", w->tmpname, w->dbfile); }
+
+  if (opt_nseq) *opt_nseq = w->nseq;
+  if (opt_nres) *opt_nres = w->nres;
+  p7_seqdb_DestroyWriter(w);
+  return eslOK;
+
+ ERROR:
+  p7_seqdb_DestroyWriter(w);
+  if (opt_nseq) *opt_nseq = 0;
+  if (opt_nres) *opt_nres = 0;
+  return status;
+}
+
+
+/* Function:  p7_seqdb_DestroyWriter()
+ * Synopsis:  Abandon a pressed database being written.
+ *
+ * Purpose:   Free <w>. If its database hasn't been finished by
+ *            <p7_seqdb_CloseWriter()>, the partial file is removed.
+ */
+void
+p7_seqdb_DestroyWriter(P7_SEQDB_WRITER *w)
+{
+  if (w)
+    {
+      if (w->fp)      { fclose(w->fp); remove(w->tmpname); }
+      if (w->efp)     fclose(w->efp);
+      if (w->mfp)     fclose(w->mfp);
+      if (w->tmpname) free(w->tmpname);
+      if (w->dbfile)  free(w->dbfile);
+      free(w);
+    }
+}
+/*------------------ end, pressing ------------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Opening and reading a pressed database.
+ *****************************************************************/
+
+/* Function:  p7_seqdb_Open()
+ * Synopsis:  Open the pressed database of a sequence file, if there is one.
+ *
+ * Purpose:   Open <seqfile>.h3q, the pressed form of sequence file
+ *            <seqfile>, and return it in <*ret_db>. A pressed file
+ *            older than <seqfile> is out of date and isn't used; one
+ *            is used without <seqfile>, though, so the text file
+ *            needn't be kept.
+ *
+ *            Where mmap() is available the file is mapped read-only
+ *            and shared, so concurrent searches on one host share its
+ *            pages; otherwise it's read into memory. Opening only
+ *            checks the header and the index, which is linear in the
+ *            number of sequences, not residues.
+ *
+ *            Before sequences can be read, the caller sets the
+ *            digital alphabet with <p7_seqdb_SetDigital()>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if there's no current pressed file for
+ *            <seqfile>; <eslEFORMAT> if there is but it's truncated,
+ *            corrupt or from another architecture, with a message in
+ *            <errbuf> if it's non-<NULL>. <*ret_db> is <NULL> on
+ *            either error.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqdb_Open(const char *seqfile, P7_SEQDB **ret_db, char *errbuf)
+{
+  P7_SEQDB    *db   = NULL;
+  FILE        *fp   = NULL;
+  char        *base = NULL;
+  char        *end;
+  char        *p;
+  struct stat  st;
+  uint32_t     magic;
+  uint32_t     abctype;
+  uint64_t     res_off, res_size, ent_off, meta_off, meta_size;
+  uint64_t     i;
+  int          status;
+
+  if (errbuf) errbuf[0] = '\0';
+
+  ESL_ALLOC(db, sizeof(P7_SEQDB));
+  memset(db, 0, sizeof(P7_SEQDB));
+  if ((status = esl_sprintf(&db->dbfile, "%s%s", seqfile, p7_SEQDB_SUFFIX)) != eslOK) goto ERROR;
+
+  if (! seqdb_is_current(seqfile, db->dbfile))                 { status = eslENOTFOUND; goto ERROR; }
+  if ((fp = fopen(db->dbfile, "rb")) == NULL)                  { status = eslENOTFOUND; goto ERROR; }
+  if (fstat(fileno(fp), &st) != 0 || st.st_size == 0)          ESL_XFAIL(eslEFORMAT, errbuf, "%s is empty", db->dbfile);
+  db->size = st.st_size;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  base = mmap(NULL, db->size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+  if (base == MAP_FAILED) base = NULL;
+  else db->mapped = TRUE;
+#endif
+  if (base == NULL)
+    {
+      ESL_ALLOC(base, db->size);
+      if (fread(base, sizeof(char), db->size, fp) != db->size) { free(base); ESL_XFAIL(eslEFORMAT, errbuf, "failed to read %s", db->dbfile); }
+    }
+  db->mem = base;
+  fclose(fp); fp = NULL;
+
+  p   = base;
+  end = base + db->size;
+  if (seqdb_get(&p, end, &magic,     sizeof(uint32_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "%s is truncated", db->dbfile);
+  if (magic != p7_SEQDB_MAGIC)                                   ESL_XFAIL(eslEFORMAT, errbuf, "bad magic; %s isn't a pressed sequence database for this machine", db->dbfile);
+  if (seqdb_get(&p, end, &abctype,   sizeof(uint32_t)) != eslOK ||
+      seqdb_get(&p, end, &db->nseq,  sizeof(uint64_t)) != eslOK ||
+      seqdb_get(&p, end, &db->nres,  sizeof(uint64_t)) != eslOK ||
+      seqdb_get(&p, end, &db->maxL,  sizeof(uint64_t)) != eslOK ||
+      seqdb_get(&p, end, &res_off,   sizeof(uint64_t)) != eslOK ||
+      seqdb_get(&p, end, &res_size,  sizeof(uint64_t)) != eslOK ||
+      seqdb_get(&p, end, &ent_off,   sizeof(uint64_t)) != eslOK ||
+      seqdb_get(&p, end, &meta_off,  sizeof(uint64_t)) != eslOK ||
+      seqdb_get(&p, end, &meta_size, sizeof(uint64_t)) != eslOK) ESL_XFAIL(eslEFORMAT, errbuf, "%s is truncated", db->dbfile);
+  db->abctype = abctype;
+
+  /* Sections in order and inside the file, with the trailer after them */
+  if (res_off > db->size || res_size > db->size - res_off || res_size != db->nres + db->nseq + 1)               ESL_XFAIL(eslEFORMAT, errbuf, "bad residue section in %s", db->dbfile);
+  if (ent_off < res_off + res_size || ent_off % sizeof(uint64_t) ||
+      db->nseq + 1 > (db->size - ESL_MIN(ent_off, db->size)) / sizeof(P7_SEQDB_ENTRY))                          ESL_XFAIL(eslEFORMAT, errbuf, "bad index in %s", db->dbfile);
+  if (meta_off < ent_off + sizeof(P7_SEQDB_ENTRY) * (db->nseq+1) || meta_off > db->size ||
+      meta_size + sizeof(uint32_t) > db->size - meta_off)                                                       ESL_XFAIL(eslEFORMAT, errbuf, "bad metadata section in %s", db->dbfile);
+  p = base + meta_off + meta_size;
+  if (seqdb_get(&p, end, &magic, sizeof(uint32_t)) != eslOK || magic != p7_SEQDB_MAGIC)                          ESL_XFAIL(eslEFORMAT, errbuf, "bad trailer; %s is corrupted?", db->dbfile);
+  if (meta_size > 0 && base[meta_off + meta_size - 1] != '\0')                                                   ESL_XFAIL(eslEFORMAT, errbuf, "bad metadata section in %s", db->dbfile);
+
+  db->res  = (const ESL_DSQ *)        (base + res_off);
+  db->ent  = (const P7_SEQDB_ENTRY *) (base + ent_off);
+  db->meta = base + meta_off;
+
+  /* Each sequence's residues and names must lie inside their sections */
+  if (db->ent[0].roff != 0 || db->ent[db->nseq].roff != res_size - 1 || db->ent[db->nseq].moff != meta_size)     ESL_XFAIL(eslEFORMAT, errbuf, "bad index in %s", db->dbfile);
+  for (i = 0; i < db->nseq; i++)
+    if (db->ent[i+1].roff <= db->ent[i].roff ||
+	db->ent[i+1].moff <= db->ent[i].moff ||
+	db->ent[i].aoff   >= db->ent[i+1].moff - db->ent[i].moff ||
+	db->ent[i].doff   >= db->ent[i+1].moff - db->ent[i].moff)   ESL_XFAIL(eslEFORMAT, errbuf, "bad index entry for sequence %" PRIu64 " in %s", i, db->dbfile);
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(MADV_SEQUENTIAL)
+  /* residues are scanned front to back; madvise() wants a page-aligned start, which the section has */
+  if (db->mapped) madvise(base + res_off, res_size, MADV_SEQUENTIAL);
+#endif
+
+  *ret_db = db;
+  return eslOK;
+
+ ERROR:
+  if (fp) fclose(fp);
+  p7_seqdb_Close(db);
+  *ret_db = NULL;
+  return status;
+}
+
+
+/* Function:  p7_seqdb_Load()
+ * Synopsis:  Make an in-memory pressed database from a sequence file.
+ *
+ * Purpose:   Read all the sequences of digital sequence file <sqfp>
+ *            into memory, laid out as a pressed database would be,
+ *            and return it in <*ret_db>: an alternative to pressing
+ *            with <hmmseqpress> for a program that reads the same
+ *            targets many times in one run (as jackhmmer does, once
+ *            per round) and has the memory to hold them. The result
+ *            is read and closed like one from <p7_seqdb_Open()>; its
+ *            <dbfile> is the name of <sqfp>'s file.
+ *
+ *            <sqfp> is read twice, first with <esl_sqio_ReadInfo()>
+ *            to size the one allocation, so it must be rewindable.
+ *            It's left positioned at its end.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEFORMAT> on a parse error in <sqfp>, or if it
+ *            changed between the reads; <eslEINVAL> if it isn't
+ *            rewindable. <errbuf> (if non-<NULL>) has a message, and
+ *            <*ret_db> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqdb_Load(ESL_SQFILE *sqfp, P7_SEQDB **ret_db, char *errbuf)
+{
+  return seqdb_load(sqfp, NULL, 0, 0, ret_db, errbuf);
+}
+
+
+/* Function:  p7_seqdb_LoadRange()
+ * Synopsis:  Make an in-memory database of a run of a file's sequences.
+ *
+ * Purpose:   As <p7_seqdb_Load()>, but only for the <nseq> sequences
+ *            of <sqfp> starting with the one whose record begins at
+ *            byte offset <roff> (as an <ESL_SQ>'s <roff> gives it), so
+ *            that each of several processes can hold its own part of
+ *            one large database. A <roff> that isn't the start of a
+ *            record is a parse error; so is a file that ends before
+ *            <nseq> sequences are read.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEFORMAT> on a parse error in <sqfp>, or if it
+ *            changed between the reads; <eslEINVAL> if it isn't
+ *            rewindable, or <nseq> is 0. <errbuf> (if non-<NULL>)
+ *            has a message, and <*ret_db> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqdb_LoadRange(ESL_SQFILE *sqfp, off_t roff, uint64_t nseq, P7_SEQDB **ret_db, char *errbuf)
+{
+  if (nseq == 0) {
+    if (errbuf) snprintf(errbuf, eslERRBUFSIZE, "no sequences to load from %s", sqfp->filename);
+    *ret_db = NULL;
+    return eslEINVAL;
+  }
+  return seqdb_load(sqfp, NULL, roff, nseq, ret_db, errbuf);
+}
+
+
+/* Function:  p7_seqdb_LoadList()
+ * Synopsis:  Make an in-memory database of listed sequences of a file.
+ *
+ * Purpose:   As <p7_seqdb_Load()>, but only for the sequences of
+ *            <sqfp> named in <listfile>: one name or accession per
+ *            line, with anything after it on the line ignored, and
+ *            <#> starting a comment. They're found with <sqfp>'s SSI
+ *            index, which the caller has opened with
+ *            <esl_sqfile_OpenSSI()>, so a few thousand targets can be
+ *            taken from a large database without reading the rest of
+ *            it. They're read in file order, not list order, and a
+ *            sequence listed more than once is loaded once. 
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if <listfile> can't be opened, or a key
+ *            isn't in the index (or <sqfp> has none);
+ *            <eslEFORMAT> on a parse error in <sqfp>; <eslEINVAL> if
+ *            it isn't rewindable. <errbuf> (if non-<NULL>) has a
+ *            message, and <*ret_db> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_seqdb_LoadList(ESL_SQFILE *sqfp, const char *listfile, P7_SEQDB **ret_db, char *errbuf)
+{
+  ESL_FILEPARSER *efp    = NULL;
+  ESL_SQ         *sq     = NULL;
+  off_t          *roff   = NULL;
+  uint64_t        nkey   = 0;
+  uint64_t        nalloc = 0;
+  uint64_t        i, j;
+  char           *key;
+  int             keylen;
+  void           *p;
+  int             status;
+
+  if (errbuf) errbuf[0] = '\0';
+  *ret_db = NULL;
+  if (! esl_sqfile_IsRewindable(sqfp)) ESL_XFAIL(eslEINVAL, errbuf, "sequence file %s isn't rewindable", sqfp->filename);
+  if (esl_fileparser_Open(listfile, NULL, &efp) != eslOK) ESL_XFAIL(eslENOTFOUND, errbuf, "failed to open target list %s", listfile);
+  esl_fileparser_SetCommentChar(efp, '#');
+  if ((sq = esl_sq_CreateDigital(sqfp->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  /* Each key's record offset, from the index */
+  while (esl_fileparser_NextLine(efp) == eslOK)
+    {
+      if (esl_fileparser_GetTokenOnLine(efp, &key, &keylen) != eslOK) continue;
+      if (esl_sqfile_PositionByKey(sqfp, key) != eslOK)
+	ESL_XFAIL(eslENOTFOUND, errbuf, "no sequence %s in the SSI index of %s", key, sqfp->filename);
+      if ((status = esl_sqio_ReadInfo(sqfp, sq)) != eslOK)
+	ESL_XFAIL(eslEFORMAT, errbuf, "parse failed (sequence file %s):\n%s", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+
+      if (nkey == nalloc) {
+	nalloc = (nalloc ? nalloc * 2 : 256);
+	ESL_RALLOC(roff, p, sizeof(off_t) * nalloc);
+      }
+      roff[nkey++] = sq->roff;
+      esl_sq_Reuse(sq);
+    }
+
+  /* In file order, once each */
+  if (nkey > 1) qsort(roff, nkey, sizeof(off_t), seqdb_cmp_off);
+  for (i = j = 0; i < nkey; i++)
+    if (j == 0 || roff[i] != roff[j-1]) roff[j++] = roff[i];
+  nkey = j;
+
+  status = seqdb_load(sqfp, roff, 0, nkey, ret_db, errbuf);
+
+  esl_fileparser_Close(efp);
+  esl_sq_Destroy(sq);
+  free(roff);
+  return status;
+
+ ERROR:
+  if (efp) esl_fileparser_Close(efp);
+  esl_sq_Destroy(sq);
+  free(roff);
+  return status;
+}
+
+
+/* seqdb_load()
+ * Load the <nkey> sequences of <sqfp> at record offsets <roff[]>, in
+ * that order; or if <roff> is NULL, the <nkey> in a row from the
+ * record at offset <start> (all of them to the end, if <nkey> is 0).
+ * Does the work of p7_seqdb_Load(), p7_seqdb_LoadList() and
+ * p7_seqdb_LoadRange().
+ */
+static int
+seqdb_load(ESL_SQFILE *sqfp, const off_t *roff, off_t start, uint64_t nkey, P7_SEQDB **ret_db, char *errbuf)
+{
+  P7_SEQDB       *db   = NULL;
+  ESL_SQ         *sq   = NULL;
+  P7_SEQDB_ENTRY *ent;
+  ESL_DSQ        *res;
+  char           *meta;
+  uint64_t        nseq = 0, res_size = 1, meta_size = 0;
+  uint64_t        ent_off;
+  uint64_t        r = 0, m = 0;
+  uint64_t        i, k;
+  size_t          nlen, alen, dlen;
+  int             status;
+
+  if (errbuf) errbuf[0] = '\0';
+  if (! esl_sqfile_IsRewindable(sqfp)) ESL_XFAIL(eslEINVAL, errbuf, "sequence file %s isn't rewindable", sqfp->filename);
+
+  ESL_ALLOC(db, sizeof(P7_SEQDB));
+  memset(db, 0, sizeof(P7_SEQDB));
+  if ((status = esl_strdup(sqfp->filename, -1, &db->dbfile)) != eslOK) goto ERROR;
+  if ((sq = esl_sq_CreateDigital(sqfp->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+
+  /* Sizes first */
+  if (esl_sqfile_Position(sqfp, start) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "failed to position sequence file %s", sqfp->filename);
+  k = 0;
+  while ((status = seqdb_loadnext(sqfp, roff, nkey, &k, sq, TRUE)) == eslOK)
+    {
+      nlen = strlen(sq->name);
+      alen = strlen(sq->acc);
+      dlen = strlen(sq->desc);
+      if (nlen + alen + 2 > UINT32_MAX) ESL_XFAIL(eslEFORMAT, errbuf, "names of sequence %s are too long", sq->name);
+      meta_size += nlen + alen + dlen + 3;
+      res_size  += sq->L + 1;
+      nseq++;
+      esl_sq_Reuse(sq);
+    }
+  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, "parse failed (sequence file %s):\n%s", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+  else if (status != eslEOF)     ESL_XFAIL(status,     errbuf, "unexpected error %d reading sequence file %s", status, sqfp->filename);
+
+  /* One allocation: residues, then the index (aligned for its uint64s), then metadata */
+  ent_off  = (res_size + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+  db->size = ent_off + sizeof(P7_SEQDB_ENTRY) * (nseq+1) + meta_size;
+  ESL_ALLOC(db->mem, db->size);
+  res  = (ESL_DSQ *)        db->mem;
+  ent  = (P7_SEQDB_ENTRY *) (db->mem + ent_off);
+  meta = db->mem + ent_off + sizeof(P7_SEQDB_ENTRY) * (nseq+1);
+
+  /* Then the sequences */
+  if (esl_sqfile_Position(sqfp, start) != eslOK) ESL_XFAIL(eslEINVAL, errbuf, "failed to position sequence file %s", sqfp->filename);
+  res[r++] = eslDSQ_SENTINEL;
+  k = 0;
+  for (i = 0; (status = seqdb_loadnext(sqfp, roff, nkey, &k, sq, FALSE)) == eslOK; i++)
+    {
+      nlen = strlen(sq->name);
+      alen = strlen(sq->acc);
+      dlen = strlen(sq->desc);
+      if (i == nseq || r + sq->n + 1 > res_size || m + nlen + alen + dlen + 3 > meta_size)
+	ESL_XFAIL(eslEFORMAT, errbuf, "sequence file %s changed while it was being read", sqfp->filename);
+
+      ent[i].roff = r - 1;
+      ent[i].moff = m;
+      ent[i].aoff = nlen + 1;
+      ent[i].doff = nlen + alen + 2;
+      memcpy(meta + m,              sq->name, nlen+1);
+      memcpy(meta + m + nlen+1,      sq->acc,  alen+1);
+      memcpy(meta + m + nlen+alen+2, sq->desc, dlen+1);
+      if (sq->n) memcpy(res + r, sq->dsq+1, sq->n);
+      r += sq->n;
+      res[r++] = eslDSQ_SENTINEL;
+      m += nlen + alen + dlen + 3;
+
+      db->nres += sq->n;
+      db->maxL  = ESL_MAX(db->maxL, (uint64_t) sq->n);
+      esl_sq_Reuse(sq);
+    }
+  if      (status == eslEFORMAT) ESL_XFAIL(eslEFORMAT, errbuf, "parse failed (sequence file %s):\n%s", sqfp->filename, esl_sqfile_GetErrorBuf(sqfp));
+  else if (status != eslEOF)     ESL_XFAIL(status,     errbuf, "unexpected error %d reading sequence file %s", status, sqfp->filename);
+  if (i != nseq || r != res_size || m != meta_size) ESL_XFAIL(eslEFORMAT, errbuf, "sequence file %s changed while it was being read", sqfp->filename);
+
+  ent[nseq].roff = r - 1;
+  ent[nseq].moff = m;
+  ent[nseq].aoff = ent[nseq].doff = 0;
+
+  db->abctype = sqfp->abc->type;
+  db->nseq    = nseq;
+  db->res     = res;
+  db->ent     = ent;
+  db->meta    = meta;
+  db->mapped  = FALSE;
+
+  esl_sq_Destroy(sq);
+  *ret_db = db;
+  return eslOK;
+
+ ERROR:
+  esl_sq_Destroy(sq);
+  p7_seqdb_Close(db);
+  *ret_db = NULL;
+  return status;
+}
+
+
+/* Function:  p7_seqdb_SetDigital()
+ * Synopsis:  Set the alphabet of the sequences read from a pressed database.
+ *
+ * Purpose:   Set the digital alphabet of the sequences that
+ *            <p7_seqdb_Read()> and <p7_seqdb_ReadBlock()> return from
+ *            <db> to <abc>. The caller keeps <abc>; it has to be of
+ *            the type the database was pressed in.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEINCOMPAT> if <abc> isn't the database's alphabet.
+ */
+int
+p7_seqdb_SetDigital(P7_SEQDB *db, const ESL_ALPHABET *abc)
+{
+  if (abc->type != db->abctype) return eslEINCOMPAT;
+  db->abc = abc;
+  return eslOK;
+}
+
+
+/* Function:  p7_seqdb_Position()
+ * Synopsis:  Reposition a pressed database to a given sequence.
+ *
+ * Purpose:   Make sequence <i> (0..nseq-1) of <db> the next one read;
+ *            <p7_seqdb_Position(db, 0)> rewinds it, and <i> = nseq
+ *            positions it at the end.
+ *
+ * Returns:   <eslOK> on success; <eslEINVAL> if <i> is out of range.
+ */
+int
+p7_seqdb_Position(P7_SEQDB *db, uint64_t i)
+{
+  if (i > db->nseq) return eslEINVAL;
+  db->next = i;
+  return eslOK;
+}
+
+
+/* Function:  p7_seqdb_Read()
+ * Synopsis:  Get the next sequence from a pressed database, in place.
+ *
+ * Purpose:   Make <sq> a view of the next sequence of <db>: its
+ *            <dsq>, <name>, <acc> and <desc> point into the database,
+ *            which stays the owner; <n>, <L>, <start>, <end> and
+ *            <idx> (its index in the database, from 0) are set.
+ *            <acc> and <desc> are the empty string if the sequence has
+ *            none, as for a sequence read from a file.
+ *
+ *            <sq> must be a plain <ESL_SQ> structure that doesn't own
+ *            anything, zeroed before first use (such as one of a block
+ *            from <p7_seqdb_CreateBlock()>); it can only be used
+ *            read-only, as <p7_Pipeline()> does. Never pass it to
+ *            <esl_sq_Reuse()>, <esl_sq_Destroy()> or other Easel
+ *            routines that modify or free a sequence.
+ *
+ * Returns:   <eslOK> on success; <eslEOF> if there are no more
+ *            sequences.
+ */
+int
+p7_seqdb_Read(P7_SEQDB *db, ESL_SQ *sq)
+{
+  if (db->next >= db->nseq) return eslEOF;
+  seqdb_view(db, db->next++, sq);
+  return eslOK;
+}
+
+
+/* Function:  p7_seqdb_Get()
+ * Synopsis:  Get sequence <i> of a pressed database, in place.
+ *
+ * Purpose:   Make <sq> a view of sequence <i> (0..nseq-1) of <db>, as
+ *            <p7_seqdb_Read()> does for the next one, with the same
+ *            rules for <sq>. It doesn't use or move <db>'s position,
+ *            so any number of threads can read one database this way
+ *            at once.
+ *
+ * Returns:   <eslOK> on success; <eslEINVAL> if <i> is out of range.
+ */
+int
+p7_seqdb_Get(const P7_SEQDB *db, uint64_t i, ESL_SQ *sq)
+{
+  if (i >= db->nseq) return eslEINVAL;
+  seqdb_view(db, i, sq);
+  return eslOK;
+}
+
+
+/* Function:  p7_seqdb_ReadBlock()
+ * Synopsis:  Get the next block of sequences from a pressed database, in place.
+ *
+ * Purpose:   Fill <block>, made by <p7_seqdb_CreateBlock()>, with views
+ *            of up to <block->listSize> next sequences of <db>, as
+ *            <p7_seqdb_Read()> does for one; and set its <count> and
+ *            <first_seqidx>. Like <esl_sqio_ReadBlock()>, the block
+ *            that comes back empty is the end of the database, and
+ *            if <max_residues> is positive, the block stops once its
+ *            sequences have that many residues between them (it
+ *            always gets at least one).
+ *
+ * Returns:   <eslOK> if any sequences were read; <eslEOF>, with
+ *            <block->count> 0, if there are no more.
+ */
+int
+p7_seqdb_ReadBlock(P7_SEQDB *db, ESL_SQ_BLOCK *block, int max_residues)
+{
+  int64_t nres = 0;
+
+  block->count        = 0;
+  block->first_seqidx = db->next;
+  while (block->count < block->listSize && db->next < db->nseq && (max_residues <= 0 || nres < max_residues))
+    {
+      seqdb_view(db, db->next++, block->list + block->count);
+      nres += block->list[block->count++].n;
+    }
+  return (block->count > 0) ? eslOK : eslEOF;
+}
+
+
+/* Function:  p7_seqdb_CreateBlock()
+ * Synopsis:  Create a block for views of pressed sequences.
+ *
+ * Purpose:   Create a block of <count> empty sequence structures for
+ *            <p7_seqdb_ReadBlock()>. Unlike a block from
+ *            <esl_sq_CreateDigitalBlock()>, its sequences own no
+ *            memory; free it with <p7_seqdb_DestroyBlock()>, not
+ *            <esl_sq_DestroyBlock()>.
+ *
+ * Returns:   the new block, or <NULL> on allocation failure.
+ */
+ESL_SQ_BLOCK *
+p7_seqdb_CreateBlock(int count)
+{
+  ESL_SQ_BLOCK *block = NULL;
+  int           status;
+
+  ESL_ALLOC(block, sizeof(ESL_SQ_BLOCK));
+  block->count        = 0;
+  block->listSize     = count;
+  block->complete     = TRUE;
+  block->first_seqidx = -1;
+  block->list         = NULL;
+  ESL_ALLOC(block->list, sizeof(ESL_SQ) * count);
+  memset(block->list, 0, sizeof(ESL_SQ) * count);
+  return block;
+
+ ERROR:
+  p7_seqdb_DestroyBlock(block);
+  return NULL;
+}
+
+
+/* Function:  p7_seqdb_DestroyBlock()
+ * Synopsis:  Free a block from p7_seqdb_CreateBlock().
+ */
+void
+p7_seqdb_DestroyBlock(ESL_SQ_BLOCK *block)
+{
+  if (block)
+    {
+      free(block->list);
+      free(block);
+    }
+}
+
+
+/* Function:  p7_seqdb_Close()
+ * Synopsis:  Close a pressed database.
+ *
+ * Purpose:   Unmap or free <db>. Any sequence views of it are invalid
+ *            after this.
+ */
+void
+p7_seqdb_Close(P7_SEQDB *db)
+{
+  if (db)
+    {
+      if (db->mem)
+	{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+	  if (db->mapped) munmap(db->mem, db->size);
+	  else            free(db->mem);
+#else
+	  free(db->mem);
+#endif
+	}
+      free(db->dbfile);
+      free(db);
+    }
+}
+/*------------- end, opening, loading and reading ----------------*/
+
+
+
+/*****************************************************************
+ * 3. Internal functions.
+ *****************************************************************/
+
+/* seqdb_is_current()
+ *
+ * Return TRUE if <dbfile> exists and is no older than <seqfile>.
+ */
+static int
+seqdb_is_current(const char *seqfile, const char *dbfile)
+{
+  struct stat seq_st;
+  struct stat db_st;
+
+  if (stat(dbfile,  &db_st)  != 0) return FALSE;
+  if (stat(seqfile, &seq_st) != 0) return TRUE;  /* pressed file alone is fine */
+  return (db_st.st_mtime >= seq_st.st_mtime) ? TRUE : FALSE;
+}
+
+/* seqdb_pad()
+ *
+ * Write zeros to <fp> from file offset <*offset> up to the next
+ * <p7_SEQDB_ALIGN> boundary, and update <*offset>.
+ */
+static int
+seqdb_pad(FILE *fp, uint64_t *offset)
+{
+  for ( ; *offset % p7_SEQDB_ALIGN; (*offset)++)
+    if (fputc('\0', fp) == EOF) return eslEWRITE;
+  return eslOK;
+}
+
+/* seqdb_append()
+ *
+ * Copy the <n> bytes spooled to temporary file <src> to the end of <fp>.
+ */
+static int
+seqdb_append(FILE *fp, FILE *src, uint64_t n)
+{
+  char   buf[65536];
+  size_t k;
+
+  if (fflush(src) != 0 || fseeko(src, 0, SEEK_SET) != 0) return eslEWRITE;
+  while (n > 0)
+    {
+      k = ESL_MIN(n, sizeof(buf));
+      if (fread (buf, 1, k, src) != k) return eslEWRITE;
+      if (fwrite(buf, 1, k, fp)  != k) return eslEWRITE;
+      n -= k;
+    }
+  return eslOK;
+}
+
+/* seqdb_get()
+ *
+ * Copy the next <n> bytes at <*p> to <dst>, and advance <*p>; fail
+ * with <eslEFORMAT> if that runs past <end>.
+ */
+static int
+seqdb_get(char **p, char *end, void *dst, size_t n)
+{
+  if (n > (size_t) (end - *p)) return eslEFORMAT;
+  memcpy(dst, *p, n);
+  *p += n;
+  return eslOK;
+}
+
+/* seqdb_view()
+ *
+ * Make <sq> a view of sequence <i> of <db>. Only the fields that the
+ * pipeline reads are set; <sq> doesn't own any of them.
+ */
+/* seqdb_loadnext()
+ * Read the next sequence for seqdb_load() into <sq>; only its
+ * lengths and names, if <info_only>. With record offsets <roff>,
+ * that's the one at <roff[*k]>; else the next in the file. <*k> is
+ * bumped, and it's <eslEOF> after the <nkey>'th (if <nkey> > 0). (A
+ * record that's gone, or a file that ends short, is <eslEFORMAT>.)
+ */
+static int
+seqdb_loadnext(ESL_SQFILE *sqfp, const off_t *roff, uint64_t nkey, uint64_t *k, ESL_SQ *sq, int info_only)
+{
+  int status;
+
+  if ((roff || nkey) && *k == nkey) return eslEOF;
+  if (roff && esl_sqfile_Position(sqfp, roff[*k]) != eslOK) return eslEFORMAT;
+  status = (info_only ? esl_sqio_ReadInfo(sqfp, sq) : esl_sqio_Read(sqfp, sq));
+  if ((roff || nkey) && status == eslEOF) status = eslEFORMAT;
+  if (status == eslOK) (*k)++;
+  return status;
+}
+
+/* seqdb_cmp_off()
+ * qsort()'s pawn for record offsets.
+ */
+static int
+seqdb_cmp_off(const void *a, const void *b)
+{
+  off_t oa = *(const off_t *) a;
+  off_t ob = *(const off_t *) b;
+  return (oa > ob) - (oa < ob);
+}
+
+static void
+seqdb_view(const P7_SEQDB *db, uint64_t i, ESL_SQ *sq)
+{
+  const P7_SEQDB_ENTRY *e    = db->ent + i;
+  const char           *meta = db->meta + e->moff;
+
+  sq->name   = (char *) meta;
+  sq->acc    = (char *) meta + e->aoff;
+  sq->desc   = (char *) meta + e->doff;
+  sq->source = (char *) meta + e->aoff - 1; /* the name's NUL: "" */
+  sq->dsq    = (ESL_DSQ *) db->res + e->roff;
+  sq->n      = e[1].roff - e->roff - 1;
+  sq->L      = sq->n;
+  sq->start  = 1;
+  sq->end    = sq->n;
+  sq->C      = 0;
+  sq->W      = sq->n;
+  sq->idx    = i;
+  sq->abc    = db->abc;
+}
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests
+ *****************************************************************/
+#ifdef p7SEQDB_TESTDRIVE
+#include <unistd.h>
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_ssi.h"
+
+/* utest_roundtrip()
+ *
+ * Write <nseq> random sequences, some of them empty and some with an
+ * accession or description, to a FASTA file; press it; and check that
+ * reading the pressed database, one at a time and in blocks, gives
+ * back the same sequences.
+ */
+static void
+utest_roundtrip(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int nseq)
+{
+  char          msg[]       = "p7_seqdb roundtrip unit test failed";
+  char          tmpname[32] = "esltmpXXXXXX";
+  char         *dbfile      = NULL;
+  FILE         *fp          = NULL;
+  ESL_SQ      **sq          = NULL;
+  ESL_SQFILE   *sqfp        = NULL;
+  P7_SEQDB     *db          = NULL;
+  ESL_SQ_BLOCK *block       = NULL;
+  ESL_SQ        view;
+  char          name[32];
+  uint64_t      nseq2, nres, nres2;
+  int           L;
+  int           i, j;
+  int           status;
+
+  ESL_ALLOC(sq, sizeof(ESL_SQ *) * nseq);
+  if (esl_tmpfile_named(tmpname, &fp) != eslOK) esl_fatal(msg);
+  for (nres = 0, i = 0; i < nseq; i++)
+    {
+      L = (i % 7 == 3) ? 0 : 1 + esl_rnd_Roll(rng, 300);
+      snprintf(name, 32, "seq%d", i);
+      if ((sq[i] = esl_sq_CreateDigital(abc)) == NULL)              esl_fatal(msg);
+      if (esl_sq_GrowTo(sq[i], L)                  != eslOK)         esl_fatal(msg);
+      if (esl_rsq_xfIID(rng, bg->f, abc->K, L, sq[i]->dsq) != eslOK)  esl_fatal(msg);
+      sq[i]->n = L;
+      if (esl_sq_SetName(sq[i], name)              != eslOK)         esl_fatal(msg);
+      if (i % 2 && esl_sq_SetAccession(sq[i], "ACC1") != eslOK)      esl_fatal(msg);
+      if (i % 3 && esl_sq_SetDesc(sq[i], "a test sequence") != eslOK) esl_fatal(msg);
+      if (esl_sqio_Write(fp, sq[i], eslSQFILE_FASTA, FALSE) != eslOK) esl_fatal(msg);
+      nres += L;
+    }
+  fclose(fp);
+
+  if (esl_sprintf(&dbfile, "%s%s", tmpname, p7_SEQDB_SUFFIX)                 != eslOK) esl_fatal(msg);
+  if (esl_sqfile_OpenDigital(abc, tmpname, eslSQFILE_FASTA, NULL, &sqfp)     != eslOK) esl_fatal(msg);
+  if (p7_seqdb_Press(sqfp, dbfile, &nseq2, &nres2, NULL)                     != eslOK) esl_fatal(msg);
+  if (nseq2 != nseq || nres2 != nres)                                                  esl_fatal(msg);
+  esl_sqfile_Close(sqfp);
+
+  if (p7_seqdb_Open(tmpname, &db, NULL)        != eslOK) esl_fatal(msg);
+  if (db->nseq != nseq || db->nres != nres)              esl_fatal(msg);
+  if (p7_seqdb_SetDigital(db, abc)             != eslOK) esl_fatal(msg);
+
+  /* one at a time */
+  memset(&view, 0, sizeof(ESL_SQ));
+  if (p7_seqdb_Position(db, 0) != eslOK) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      if (p7_seqdb_Read(db, &view) != eslOK)                                 esl_fatal(msg);
+      if (view.n != sq[i]->n || view.idx != i)                               esl_fatal(msg);
+      if (strcmp(view.name, sq[i]->name) != 0)                               esl_fatal(msg);
+      if (strcmp(view.acc,  sq[i]->acc)  != 0)                               esl_fatal(msg);
+      if (strcmp(view.desc, sq[i]->desc) != 0)                               esl_fatal(msg);
+      if (view.dsq[0] != eslDSQ_SENTINEL || view.dsq[view.n+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+      if (memcmp(view.dsq+1, sq[i]->dsq+1, view.n) != 0)                     esl_fatal(msg);
+    }
+  if (p7_seqdb_Read(db, &view) != eslEOF) esl_fatal(msg);
+
+  /* in blocks, from the middle */
+  if ((block = p7_seqdb_CreateBlock(7)) == NULL) esl_fatal(msg);
+  if (p7_seqdb_Position(db, nseq/2)   != eslOK) esl_fatal(msg);
+  for (i = nseq/2; (status = p7_seqdb_ReadBlock(db, block, -1)) == eslOK; i += block->count)
+    {
+      if (block->first_seqidx != i) esl_fatal(msg);
+      for (j = 0; j < block->count; j++)
+	{
+	  if (block->list[j].n != sq[i+j]->n)                          esl_fatal(msg);
+	  if (strcmp(block->list[j].name, sq[i+j]->name) != 0)         esl_fatal(msg);
+	  if (memcmp(block->list[j].dsq+1, sq[i+j]->dsq+1, sq[i+j]->n)) esl_fatal(msg);
+	}
+    }
+  if (status != eslEOF || i != nseq || block->count != 0) esl_fatal(msg);
+
+  p7_seqdb_DestroyBlock(block);
+  p7_seqdb_Close(db);
+  remove(dbfile);
+  remove(tmpname);
+  free(dbfile);
+  for (i = 0; i < nseq; i++) esl_sq_Destroy(sq[i]);
+  free(sq);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+
+/* utest_load()
+ *
+ * Loading a sequence file into memory gives the same database as
+ * pressing it and opening the pressed file.
+ */
+static void
+utest_load(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int nseq)
+{
+  char        msg[]       = "p7_seqdb load unit test failed";
+  char        tmpname[32] = "esltmpXXXXXX";
+  char       *dbfile      = NULL;
+  FILE       *fp          = NULL;
+  ESL_SQ     *sq          = NULL;
+  ESL_SQFILE *sqfp        = NULL;
+  P7_SEQDB   *db1         = NULL;	/* pressed and opened */
+  P7_SEQDB   *db2         = NULL;	/* loaded             */
+  ESL_SQ      v1, v2;
+  char        name[32];
+  int         L;
+  int         i;
+
+  if (esl_tmpfile_named(tmpname, &fp)  != eslOK) esl_fatal(msg);
+  if ((sq = esl_sq_CreateDigital(abc)) == NULL)  esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      L = (i % 5 == 2) ? 0 : 1 + esl_rnd_Roll(rng, 200);
+      snprintf(name, 32, "seq%d", i);
+      if (esl_sq_GrowTo(sq, L)                             != eslOK) esl_fatal(msg);
+      if (esl_rsq_xfIID(rng, bg->f, abc->K, L, sq->dsq)    != eslOK) esl_fatal(msg);
+      sq->n = L;
+      if (esl_sq_SetName(sq, name)                         != eslOK) esl_fatal(msg);
+      if (i % 3 && esl_sq_SetDesc(sq, "a test sequence")   != eslOK) esl_fatal(msg);
+      if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE)   != eslOK) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  fclose(fp);
+
+  if (esl_sprintf(&dbfile, "%s%s", tmpname, p7_SEQDB_SUFFIX)             != eslOK) esl_fatal(msg);
+  if (esl_sqfile_OpenDigital(abc, tmpname, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if (p7_seqdb_Press(sqfp, dbfile, NULL, NULL, NULL)                     != eslOK) esl_fatal(msg);
+  if (p7_seqdb_Load(sqfp, &db2, NULL)                                    != eslOK) esl_fatal(msg);
+  esl_sqfile_Close(sqfp);
+  if (p7_seqdb_Open(tmpname, &db1, NULL)                                 != eslOK) esl_fatal(msg);
+
+  if (db1->nseq != db2->nseq || db1->nres != db2->nres || db1->maxL != db2->maxL) esl_fatal(msg);
+  if (p7_seqdb_SetDigital(db1, abc) != eslOK || p7_seqdb_SetDigital(db2, abc) != eslOK) esl_fatal(msg);
+
+  memset(&v1, 0, sizeof(ESL_SQ));
+  memset(&v2, 0, sizeof(ESL_SQ));
+  for (i = 0; i < nseq; i++)
+    {
+      if (p7_seqdb_Read(db1, &v1) != eslOK || p7_seqdb_Read(db2, &v2) != eslOK) esl_fatal(msg);
+      if (v1.n != v2.n || v1.idx != v2.idx)                                  esl_fatal(msg);
+      if (strcmp(v1.name, v2.name) != 0 || strcmp(v1.acc, v2.acc) != 0)      esl_fatal(msg);
+      if (strcmp(v1.desc, v2.desc) != 0)                                     esl_fatal(msg);
+      if (v2.dsq[0] != eslDSQ_SENTINEL || v2.dsq[v2.n+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+      if (memcmp(v1.dsq+1, v2.dsq+1, v1.n) != 0)                             esl_fatal(msg);
+    }
+  if (p7_seqdb_Read(db2, &v2) != eslEOF) esl_fatal(msg);
+
+  p7_seqdb_Close(db1);
+  p7_seqdb_Close(db2);
+  remove(dbfile);
+  remove(tmpname);
+  free(dbfile);
+  esl_sq_Destroy(sq);
+}
+
+/* utest_loadlist()
+ *
+ * Index a FASTA file of <nseq> random sequences with SSI, and load a
+ * subset of them from a list that's out of order and names one
+ * sequence twice: the subset comes back once each, in file order.
+ */
+static void
+utest_loadlist(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int nseq)
+{
+  char        msg[]        = "p7_seqdb loadlist unit test failed";
+  char        tmpname[32]  = "esltmpXXXXXX";
+  char        listname[32] = "esltmpXXXXXX";
+  char       *ssifile      = NULL;
+  FILE       *fp           = NULL;
+  ESL_NEWSSI *ns           = NULL;
+  ESL_SQ     *sq           = NULL;
+  ESL_SQFILE *sqfp         = NULL;
+  P7_SEQDB   *db           = NULL;
+  ESL_SQ      v;
+  char        name[32];
+  uint16_t    fh;
+  off_t       roff;
+  int         L;
+  int         i, n;
+
+  if (esl_tmpfile_named(tmpname, &fp)  != eslOK) esl_fatal(msg);
+  if (esl_sprintf(&ssifile, "%s.ssi", tmpname)           != eslOK) esl_fatal(msg);
+  if (esl_newssi_Open(ssifile, TRUE, &ns)                != eslOK) esl_fatal(msg);
+  if (esl_newssi_AddFile(ns, tmpname, eslSQFILE_FASTA, &fh) != eslOK) esl_fatal(msg);
+  if ((sq = esl_sq_CreateDigital(abc)) == NULL)          esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      L = 1 + esl_rnd_Roll(rng, 200);
+      snprintf(name, 32, "seq%d", i);
+      if (esl_sq_GrowTo(sq, L)                           != eslOK) esl_fatal(msg);
+      if (esl_rsq_xfIID(rng, bg->f, abc->K, L, sq->dsq)  != eslOK) esl_fatal(msg);
+      sq->n = L;
+      if (esl_sq_SetName(sq, name)                       != eslOK) esl_fatal(msg);
+      if ((roff = ftello(fp)) < 0)                                 esl_fatal(msg);
+      if (esl_newssi_AddKey(ns, name, fh, roff, 0, 0)    != eslOK) esl_fatal(msg);
+      if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE) != eslOK) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  fclose(fp);
+  if (esl_newssi_Write(ns) != eslOK) esl_fatal(msg);
+  esl_newssi_Close(ns);
+
+  /* every third sequence, last first, and seq0 twice */
+  if (esl_tmpfile_named(listname, &fp) != eslOK) esl_fatal(msg);
+  fprintf(fp, "# test list\nseq0\n");
+  for (i = nseq-1, n = 0; i >= 0; i--)
+    if (i % 3 == 0) { fprintf(fp, "seq%d  extra words\n", i); n++; }
+  fclose(fp);
+
+  if (esl_sqfile_OpenDigital(abc, tmpname, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if (esl_sqfile_OpenSSI(sqfp, NULL)                                     != eslOK) esl_fatal(msg);
+  if (p7_seqdb_LoadList(sqfp, listname, &db, NULL)                       != eslOK) esl_fatal(msg);
+  if (p7_seqdb_SetDigital(db, abc)                                       != eslOK) esl_fatal(msg);
+  if (db->nseq != (uint64_t) n)                                                    esl_fatal(msg);
+
+  memset(&v, 0, sizeof(ESL_SQ));
+  for (i = 0; i < n; i++)
+    {
+      snprintf(name, 32, "seq%d", 3*i);
+      if (p7_seqdb_Read(db, &v) != eslOK)                                  esl_fatal(msg);
+      if (strcmp(v.name, name) != 0)                                       esl_fatal(msg);
+      if (v.dsq[0] != eslDSQ_SENTINEL || v.dsq[v.n+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+    }
+  if (p7_seqdb_Read(db, &v) != eslEOF) esl_fatal(msg);
+  p7_seqdb_Close(db);
+
+  /* a name that isn't there */
+  if ((fp = fopen(listname, "w")) == NULL) esl_fatal(msg);
+  fprintf(fp, "seq0\nnosuchseq\n");
+  fclose(fp);
+  if (p7_seqdb_LoadList(sqfp, listname, &db, NULL) != eslENOTFOUND || db != NULL) esl_fatal(msg);
+
+  esl_sqfile_Close(sqfp);
+  remove(tmpname);
+  remove(listname);
+  remove(ssifile);
+  free(ssifile);
+  esl_sq_Destroy(sq);
+}
+
+/* utest_loadrange()
+ *
+ * Split a FASTA file of <nseq> random sequences into three runs by
+ * their record offsets, as jackhmmer's MPI master does: the runs,
+ * loaded one by one, are the whole file in order; a run that goes off
+ * the end of the file is refused.
+ */
+static void
+utest_loadrange(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int nseq)
+{
+  char        msg[]       = "p7_seqdb loadrange unit test failed";
+  char        tmpname[32] = "esltmpXXXXXX";
+  FILE       *fp          = NULL;
+  ESL_SQ     *sq          = NULL;
+  ESL_SQFILE *sqfp        = NULL;
+  P7_SEQDB   *db          = NULL;
+  off_t      *roff        = NULL;
+  ESL_SQ      v;
+  char        name[32];
+  int         lo, hi;
+  int         L;
+  int         i, p;
+
+  if (esl_tmpfile_named(tmpname, &fp)  != eslOK) esl_fatal(msg);
+  if ((sq = esl_sq_CreateDigital(abc)) == NULL)  esl_fatal(msg);
+  if ((roff = malloc(sizeof(off_t) * nseq)) == NULL) esl_fatal(msg);
+  for (i = 0; i < nseq; i++)
+    {
+      L = 1 + esl_rnd_Roll(rng, 200);
+      snprintf(name, 32, "seq%d", i);
+      if (esl_sq_GrowTo(sq, L)                           != eslOK) esl_fatal(msg);
+      if (esl_rsq_xfIID(rng, bg->f, abc->K, L, sq->dsq)  != eslOK) esl_fatal(msg);
+      sq->n = L;
+      if (esl_sq_SetName(sq, name)                       != eslOK) esl_fatal(msg);
+      if ((roff[i] = ftello(fp)) < 0)                              esl_fatal(msg);
+      if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE) != eslOK) esl_fatal(msg);
+      esl_sq_Reuse(sq);
+    }
+  fclose(fp);
+
+  if (esl_sqfile_OpenDigital(abc, tmpname, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  memset(&v, 0, sizeof(ESL_SQ));
+  for (p = 0; p < 3; p++)
+    {
+      lo = nseq * p / 3;
+      hi = nseq * (p+1) / 3;
+      if (lo == hi) continue;
+      if (p7_seqdb_LoadRange(sqfp, roff[lo], hi - lo, &db, NULL) != eslOK) esl_fatal(msg);
+      if (p7_seqdb_SetDigital(db, abc)                          != eslOK) esl_fatal(msg);
+      if (db->nseq != (uint64_t) (hi - lo))                               esl_fatal(msg);
+      for (i = lo; i < hi; i++)
+	{
+	  snprintf(name, 32, "seq%d", i);
+	  if (p7_seqdb_Read(db, &v) != eslOK)                                  esl_fatal(msg);
+	  if (strcmp(v.name, name) != 0)                                       esl_fatal(msg);
+	  if (v.dsq[0] != eslDSQ_SENTINEL || v.dsq[v.n+1] != eslDSQ_SENTINEL) esl_fatal(msg);
+	}
+      if (p7_seqdb_Read(db, &v) != eslEOF) esl_fatal(msg);
+      p7_seqdb_Close(db);
+    }
+
+  if (p7_seqdb_LoadRange(sqfp, roff[nseq-1], 2, &db, NULL) != eslEFORMAT || db != NULL) esl_fatal(msg);
+
+  esl_sqfile_Close(sqfp);
+  remove(tmpname);
+  free(roff);
+  esl_sq_Destroy(sq);
+}
+
+/* utest_corrupt()
+ *
+ * A pressed file that's been truncated is refused with <eslEFORMAT>;
+ * one older than its sequence file isn't used.
+ */
+static void
+utest_corrupt(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg)
+{
+  char        msg[]       = "p7_seqdb corrupt file unit test failed";
+  char        tmpname[32] = "esltmpXXXXXX";
+  char       *dbfile      = NULL;
+  FILE       *fp          = NULL;
+  ESL_SQ     *sq          = NULL;
+  ESL_SQFILE *sqfp        = NULL;
+  P7_SEQDB   *db          = NULL;
+  struct stat st;
+  char        errbuf[eslERRBUFSIZE];
+
+  if (esl_tmpfile_named(tmpname, &fp)                       != eslOK) esl_fatal(msg);
+  if ((sq = esl_sq_CreateDigital(abc))                      == NULL)  esl_fatal(msg);
+  if (esl_sq_GrowTo(sq, 100)                                != eslOK) esl_fatal(msg);
+  if (esl_rsq_xfIID(rng, bg->f, abc->K, 100, sq->dsq)       != eslOK) esl_fatal(msg);
+  sq->n = 100;
+  if (esl_sq_SetName(sq, "seq1")                            != eslOK) esl_fatal(msg);
+  if (esl_sqio_Write(fp, sq, eslSQFILE_FASTA, FALSE)        != eslOK) esl_fatal(msg);
+  fclose(fp);
+
+  if (esl_sprintf(&dbfile, "%s%s", tmpname, p7_SEQDB_SUFFIX)             != eslOK) esl_fatal(msg);
+  if (esl_sqfile_OpenDigital(abc, tmpname, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) esl_fatal(msg);
+  if (p7_seqdb_Press(sqfp, dbfile, NULL, NULL, NULL)                     != eslOK) esl_fatal(msg);
+  esl_sqfile_Close(sqfp);
+
+  if (stat(dbfile, &st) != 0 || truncate(dbfile, st.st_size - 2) != 0)  esl_fatal(msg);
+  if (p7_seqdb_Open(tmpname, &db, errbuf) != eslEFORMAT || db != NULL)   esl_fatal(msg);
+
+  remove(tmpname);              /* without the sequence file, a pressed file is still current */
+  if (p7_seqdb_Open(tmpname, &db, errbuf) != eslEFORMAT)                 esl_fatal(msg);
+  remove(dbfile);
+  if (p7_seqdb_Open(tmpname, &db, errbuf) != eslENOTFOUND || db != NULL) esl_fatal(msg);
+
+  free(dbfile);
+  esl_sq_Destroy(sq);
+}
+#endif /*p7SEQDB_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7SEQDB_TESTDRIVE
+/*
+  gcc -o p7_seqdb_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7SEQDB_TESTDRIVE p7_seqdb.c -lhmmer -leasel -lm
+  ./p7_seqdb_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,     "50", NULL, NULL,  NULL,  NULL, NULL, "number of sequences to press",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_SEQDB";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg  = p7_bg_Create(abc);
+
+  utest_roundtrip(rng, abc, bg, esl_opt_GetInteger(go, "-N"));
+  utest_load     (rng, abc, bg, esl_opt_GetInteger(go, "-N"));
+  utest_loadlist (rng, abc, bg, esl_opt_GetInteger(go, "-N"));
+  utest_loadrange(rng, abc, bg, esl_opt_GetInteger(go, "-N"));
+  utest_corrupt  (rng, abc, bg);
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7SEQDB_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
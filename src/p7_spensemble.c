@@ -216,6 +216,134 @@ link_spsamples(const void *v1, const void *v2, const void *prm, int *ret_link)
   return eslOK;
 }
 
+/* spsample_cmp()
+ * Orders seg pairs <a>,<b> in <sp> by i, then j, k, m; ties fall
+ * back to the index itself, so the order is total.
+ */
+static int
+spsample_cmp(const struct p7_spcoord_s *sp, int a, int b)
+{
+  if (sp[a].i != sp[b].i) return (sp[a].i < sp[b].i ? -1 : 1);
+  if (sp[a].j != sp[b].j) return (sp[a].j < sp[b].j ? -1 : 1);
+  if (sp[a].k != sp[b].k) return (sp[a].k < sp[b].k ? -1 : 1);
+  if (sp[a].m != sp[b].m) return (sp[a].m < sp[b].m ? -1 : 1);
+  return (a < b ? -1 : (a > b ? 1 : 0));
+}
+
+/* sift_spsamples()
+ * Sifts <order[root]> down the heap <order[0..n-1]>.
+ */
+static void
+sift_spsamples(const struct p7_spcoord_s *sp, int *order, int root, int n)
+{
+  int child, tmp;
+
+  while ((child = 2*root+1) < n)
+    {
+      if (child+1 < n && spsample_cmp(sp, order[child], order[child+1]) < 0) child++;
+      if (spsample_cmp(sp, order[root], order[child]) >= 0) break;
+      tmp = order[root]; order[root] = order[child]; order[child] = tmp;
+      root = child;
+    }
+}
+
+/* sort_spsamples()
+ * Heapsorts the indices <order[0..n-1]> of seg pairs in <sp> by
+ * spsample_cmp(). In place, so it needs no memory beyond <order>.
+ */
+static void
+sort_spsamples(const struct p7_spcoord_s *sp, int *order, int n)
+{
+  int h, tmp;
+
+  for (h = n/2-1; h >= 0; h--) sift_spsamples(sp, order, h, n);
+  for (h = n-1;   h >  0; h--)
+    {
+      tmp = order[0]; order[0] = order[h]; order[h] = tmp;
+      sift_spsamples(sp, order, 0, h);
+    }
+}
+
+/* find_spcluster()
+ * Returns the root of seg pair <h> in the union-find forest <parent>,
+ * halving the path on the way.
+ */
+static int
+find_spcluster(int *parent, int h)
+{
+  while (parent[h] != h) { parent[h] = parent[parent[h]]; h = parent[h]; }
+  return h;
+}
+
+/* cluster_spsamples()
+ * 
+ * Single-linkage clustering of the seg pairs in <sp> by
+ * link_spsamples(), without testing all n^2 pairs. A link needs the
+ * two seq segments to overlap (when <min_overlap> > 0), so seg pairs
+ * are swept in order of i, each tested only against the earlier ones
+ * whose j still reaches it; a pair already in the same cluster isn't
+ * tested at all. A run of identical seg pairs, which sampling
+ * produces in quantity, goes through the sweep as its first member
+ * alone, if that links to itself.
+ *
+ * Leaves the same clusters that <esl_cluster_SingleLinkage()> would,
+ * numbered 0..nc-1 in order of their first seg pair in <sp->sp>, in
+ * <sp->assignment> and <sp->nc>. Uses <sp->workspace>: the first n
+ * for the union-find forest, the second n for the sweep order, whose
+ * front also holds the active seg pairs.
+ */
+static int
+cluster_spsamples(P7_SPENSEMBLE *sp, struct p7_linkparam_s *param)
+{
+  struct p7_spcoord_s *s      = sp->sp;
+  int                 *parent = sp->workspace;
+  int                 *order  = sp->workspace + sp->n;
+  int                  nact   = 0;	/* active seg pairs are <order[0..nact-1]> */
+  int                  p, q, a, x, h, r;
+  int                  do_link;
+  int                  status;
+
+  for (h = 0; h < sp->n; h++) { parent[h] = h; order[h] = h; }
+  sort_spsamples(s, order, sp->n);
+
+  for (p = 0; p < sp->n; p = q)
+    {
+      h = order[p];
+
+      /* <order[p..q-1]> is the run of seg pairs identical to <h> */
+      for (q = p+1; q < sp->n; q++)
+	if (s[order[q]].i != s[h].i || s[order[q]].j != s[h].j || s[order[q]].k != s[h].k || s[order[q]].m != s[h].m) break;
+      if (q-p > 1) {
+	if ((status = link_spsamples(&s[h], &s[h], param, &do_link)) != eslOK) return status;
+	if (do_link) { for (x = p+1; x < q; x++) parent[order[x]] = h; }
+	else q = p+1;		/* members go through the sweep one at a time */
+      }
+
+      /* Retire active seg pairs that end before <h> starts; test the rest */
+      for (x = 0, a = 0; a < nact; a++)
+	{
+	  if (s[order[a]].j < s[h].i) continue;
+	  order[x++] = order[a];
+
+	  r = find_spcluster(parent, order[a]);
+	  if (r == find_spcluster(parent, h)) continue;
+	  if ((status = link_spsamples(&s[order[a]], &s[h], param, &do_link)) != eslOK) return status;
+	  if (do_link) parent[r] = find_spcluster(parent, h);
+	}
+      nact = x;
+      order[nact++] = h;	/* nact <= p: the unswept part of <order> is untouched */
+    }
+
+  for (h = 0; h < sp->n; h++) sp->assignment[h] = -1;
+  for (sp->nc = 0, h = 0; h < sp->n; h++)
+    {
+      r = find_spcluster(parent, h);
+      if (sp->assignment[r] == -1) sp->assignment[r] = sp->nc++;
+      sp->assignment[h] = sp->assignment[r];
+    }
+  return eslOK;
+}
+
 /* cluster_orderer()
  * is the routine that gets passed to qsort() to sort
  * the significant clusters by order of occurrence on
@@ -265,6 +393,11 @@ cluster_orderer(const void *v1, const void *v2)
  *            <min_overlap = 0.8>, <of_smaller = TRUE>, <max_diagdiff
  *            = 4>, <min_posterior = 0.25>, <min_endpointp = 0.02>.
  *            
+ *            <Cluster()> may be called more than once on an ensemble
+ *            that is still growing, for instance to see whether the
+ *            clustering has stabilized; each call replaces the
+ *            significant clusters defined by the last one.
+ *            
  * Args:      sp            - segment pair ensemble to cluster
  *            min_overlap   - linkage requires fractional overlap >= this, in both seq and hmm segments
  *            of_smaller    - overlap fraction denominators uses either the smaller (if TRUE) or larger (if FALSE) segment
@@ -294,14 +427,19 @@ p7_spensemble_Cluster(P7_SPENSEMBLE *sp,
   int imax, jmax, kmax, mmax;
   int best_i, best_j, best_k, best_m;
 
-  /* set up a single linkage clustering problem for Easel's general routine */
+  /* set up the single linkage clustering problem */
   param.min_overlap   = min_overlap;
   param.of_smaller    = of_smaller;
   param.max_diagdiff  = max_diagdiff;
   param.min_posterior = min_posterior;
   param.min_endpointp = min_endpointp;
-  if ((status = esl_cluster_SingleLinkage(sp->sp, sp->n, sizeof(struct p7_spcoord_s), link_spsamples, (void *) &param,
-					  sp->workspace, sp->assignment, &(sp->nc))) != eslOK) goto ERROR;
+  sp->nsigc           = 0;
+  if (min_overlap > 0.) {
+    if ((status = cluster_spsamples(sp, &param)) != eslOK) goto ERROR;
+  } else {			/* overlap isn't needed to link, so there's no sweep: test all pairs */
+    if ((status = esl_cluster_SingleLinkage(sp->sp, sp->n, sizeof(struct p7_spcoord_s), link_spsamples, (void *) &param,
+					    sp->workspace, sp->assignment, &(sp->nc))) != eslOK) goto ERROR;
+  }
 
   ESL_ALLOC(ninc, sizeof(int) * sp->nc);
 
@@ -456,6 +594,176 @@ p7_spensemble_Destroy(P7_SPENSEMBLE *sp)
 
 
 
+/*****************************************************************
+ * Unit tests.
+ *****************************************************************/
+#ifdef p7SPENSEMBLE_TESTDRIVE
+#include "esl_random.h"
+
+/* sample_ensemble()
+ * Fill <sp> with the seg pairs of <nsamples> made-up sampled traces
+ * of a target of length <L> against a model of length <M>: each
+ * trace has each of <ndom> domains with probability 0.7, with its
+ * endpoints moved by up to <jitter> (none, if 0, so most seg pairs
+ * come in runs of identical ones), and now and then a random seg
+ * pair.
+ */
+static void
+sample_ensemble(ESL_RANDOMNESS *rng, P7_SPENSEMBLE *sp, int nsamples, int ndom, int L, int M, int jitter)
+{
+  char msg[] = "spensemble sampling failed";
+  int  di[8], dj[8], dk[8], dm[8];
+  int  i, j, k, m;
+  int  t, d, len;
+
+  for (d = 0; d < ndom; d++)
+    {
+      len   = 10 + esl_rnd_Roll(rng, 50);
+      di[d] = 1 + esl_rnd_Roll(rng, L - len);
+      dj[d] = di[d] + len - 1;
+      dk[d] = 1 + esl_rnd_Roll(rng, M - len/2);
+      dm[d] = ESL_MIN(M, dk[d] + len - 1 + esl_rnd_Roll(rng, 5) - 2);
+    }
+
+  p7_spensemble_Reuse(sp);
+  for (t = 0; t < nsamples; t++)
+    {
+      for (d = 0; d < ndom; d++)
+	{
+	  if (esl_random(rng) > 0.7) continue;
+	  i = ESL_MAX(1, di[d] + esl_rnd_Roll(rng, 2*jitter+1) - jitter);
+	  j = ESL_MIN(L, ESL_MAX(i, dj[d] + esl_rnd_Roll(rng, 2*jitter+1) - jitter));
+	  k = ESL_MAX(1, dk[d] + esl_rnd_Roll(rng, 2*jitter+1) - jitter);
+	  m = ESL_MIN(M, ESL_MAX(k, dm[d] + esl_rnd_Roll(rng, 2*jitter+1) - jitter));
+	  if (p7_spensemble_Add(sp, t, i, j, k, m) != eslOK) esl_fatal(msg);
+	}
+      if (esl_random(rng) < 0.1)
+	{
+	  i = 1 + esl_rnd_Roll(rng, L);
+	  j = i + esl_rnd_Roll(rng, L - i + 1);
+	  k = 1 + esl_rnd_Roll(rng, M);
+	  m = k + esl_rnd_Roll(rng, M - k + 1);
+	  if (p7_spensemble_Add(sp, t, i, j, k, m) != eslOK) esl_fatal(msg);
+	}
+    }
+}
+
+/* utest_cluster()
+ *
+ * On <ntrials> sampled ensembles, the clusters p7_spensemble_Cluster()
+ * finds by sorting and sweeping are the ones that Easel's all-pairs
+ * esl_cluster_SingleLinkage() finds with the same linkage rule. The
+ * two can number clusters differently, so the test is that the two
+ * assignments are the same partition.
+ */
+static void
+utest_cluster(ESL_RANDOMNESS *rng, int ntrials, int nsamples, int L, int M, float min_overlap, int of_smaller, int max_diagdiff)
+{
+  char                  msg[] = "spensemble clustering unit test failed";
+  P7_SPENSEMBLE        *sp    = p7_spensemble_Create(1024, 64, 32);
+  struct p7_linkparam_s param;
+  int                  *work  = NULL;
+  int                  *asg   = NULL;	/* assignments by esl_cluster_SingleLinkage() */
+  int                  *map   = NULL;	/* map[c]: sweep's cluster for Easel's cluster c, or -1 */
+  int                  *used  = NULL;	/* used[c]: TRUE if sweep's cluster c has been mapped to */
+  int                   nalloc = 0;
+  int                   nc, nsig;
+  int                   t, h;
+
+  if (sp == NULL) esl_fatal(msg);
+  param.min_overlap   = min_overlap;
+  param.of_smaller    = of_smaller;
+  param.max_diagdiff  = max_diagdiff;
+  param.min_posterior = 0.25;
+  param.min_endpointp = 0.02;
+
+  for (t = 0; t < ntrials; t++)
+    {
+      sample_ensemble(rng, sp, nsamples, 1 + esl_rnd_Roll(rng, 6), L, M, esl_rnd_Roll(rng, 3) * 5);
+      if (sp->n > nalloc)
+	{
+	  nalloc = sp->n;
+	  free(work); free(asg); free(map); free(used);
+	  if ((work = malloc(sizeof(int) * nalloc * 2)) == NULL) esl_fatal(msg);
+	  if ((asg  = malloc(sizeof(int) * nalloc))     == NULL) esl_fatal(msg);
+	  if ((map  = malloc(sizeof(int) * nalloc))     == NULL) esl_fatal(msg);
+	  if ((used = malloc(sizeof(int) * nalloc))     == NULL) esl_fatal(msg);
+	}
+
+      if (esl_cluster_SingleLinkage(sp->sp, sp->n, sizeof(struct p7_spcoord_s), link_spsamples, (void *) &param,
+				    work, asg, &nc)                                                         != eslOK) esl_fatal(msg);
+      if (p7_spensemble_Cluster(sp, min_overlap, of_smaller, max_diagdiff, 0.25, 0.02, &nsig) != eslOK) esl_fatal(msg);
+
+      if (sp->nc != nc) esl_fatal("%s: %d clusters, not %d", msg, sp->nc, nc);
+      for (h = 0; h < nc; h++) { map[h] = -1; used[h] = FALSE; }
+      for (h = 0; h < sp->n; h++)
+	{
+	  if (map[asg[h]] == -1)
+	    {
+	      if (used[sp->assignment[h]]) esl_fatal("%s: seg pair %d is in the wrong cluster", msg, h);
+	      map[asg[h]]              = sp->assignment[h];
+	      used[sp->assignment[h]]  = TRUE;
+	    }
+	  else if (map[asg[h]] != sp->assignment[h]) esl_fatal("%s: seg pair %d is in the wrong cluster", msg, h);
+	}
+    }
+
+  free(work);
+  free(asg);
+  free(map);
+  free(used);
+  p7_spensemble_Destroy(sp);
+}
+#endif /*p7SPENSEMBLE_TESTDRIVE*/
+/*------------------- end, unit tests ---------------------------*/
+
+
+
+/*****************************************************************
+ * Test driver.
+ *****************************************************************/
+#ifdef p7SPENSEMBLE_TESTDRIVE
+/*
+  gcc -o p7_spensemble_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7SPENSEMBLE_TESTDRIVE p7_spensemble.c -lhmmer -leasel -lm
+  ./p7_spensemble_utest
+*/
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "number of sampled traces per ensemble",            0 },
+  { "-T",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of ensembles per test",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for sampled domain clustering";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  int             N   = esl_opt_GetInteger(go, "-N");
+  int             T   = esl_opt_GetInteger(go, "-T");
+
+  utest_cluster(rng, T, N, 400,  150, 0.8, TRUE,  4);   /* domain definition's defaults */
+  utest_cluster(rng, T, N, 400,  150, 0.8, FALSE, 4);
+  utest_cluster(rng, T, N, 400,  150, 0.3, TRUE,  0);
+  utest_cluster(rng, T, N, 200,   60, 0.5, FALSE, 10);  /* crowded: domains overlap */
+
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7SPENSEMBLE_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
+
 /*****************************************************************
  * Benchmark and example.
  *****************************************************************/
@@ -0,0 +1,596 @@
+/* P7_TABSTREAM: streaming tabular output, written while a search runs.
+ *
+ * Normally --tblout and --domtblout are written only at the end of
+ * a query's search, from the sorted and thresholded hit list. When
+ * the search space sizes Z and domZ are fixed in advance, a hit's
+ * E-values and report flags are already final when the pipeline
+ * finds it, so its rows can be written right away. Downstream
+ * consumers can then start on the results of a long search while it
+ * runs. Streamed rows come in the order hits are found, not sorted.
+ *
+ * Workers give the stream copies of their newly found reported hits
+ * with p7_tabstream_AddHits(). In a threaded build, a writer thread
+ * formats and writes them, so workers only pay for the copy.
+ *
+ * Contents:
+ *    1. The P7_TABSTREAM object.
+ *    2. Internal functions.
+ *    3. Unit tests.
+ *    4. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
+#include "easel.h"
+#include "hmmer.h"
+
+static int tabstream_write(P7_TABSTREAM *ts, P7_HIT **hits, int n);
+#ifdef HMMER_THREADS
+static void *tabstream_writer(void *arg);
+#endif
+
+
+/*****************************************************************
+ *= 1. The P7_TABSTREAM object
+ *****************************************************************/
+
+/* Function:  p7_tabstream_Create()
+ * Synopsis:  Create a stream for tabular output as hits are found.
+ *
+ * Purpose:   Create a stream that writes per-sequence hit rows to
+ *            <tblfp> and per-domain rows to <domtblfp>; either may
+ *            be <NULL>. If <use_thread> is TRUE (and this is a
+ *            threaded build), start a writer thread to do the
+ *            output; otherwise hits are written by the caller of
+ *            <p7_tabstream_AddHits()>, and if several threads add
+ *            hits, writes are serialized anyway.
+ *
+ *            Call <p7_tabstream_NewQuery()> before adding hits.
+ *
+ * Returns:   a pointer to the new stream.
+ *
+ * Throws:    <NULL> on allocation failure, or if the writer thread
+ *            can't be started.
+ */
+P7_TABSTREAM *
+p7_tabstream_Create(FILE *tblfp, FILE *domtblfp, int use_thread)
+{
+  P7_TABSTREAM *ts = NULL;
+  int           status;
+
+  ESL_ALLOC(ts, sizeof(P7_TABSTREAM));
+  ts->tblfp    = tblfp;
+  ts->domtblfp = domtblfp;
+  ts->qname    = NULL;
+  ts->qacc     = NULL;
+  ts->pli      = NULL;
+  ts->q        = NULL;
+  ts->nq       = 0;
+  ts->nqalloc  = 0;
+  ts->nwritten = 0;
+  ts->status   = eslOK;
+
+  ESL_ALLOC(ts->q, sizeof(P7_HIT *) * 64);
+  ts->nqalloc = 64;
+
+#ifdef HMMER_THREADS
+  ts->use_thread = FALSE;
+  ts->busy       = FALSE;
+  ts->stop       = FALSE;
+  if (pthread_mutex_init(&ts->mutex, NULL) != 0) goto ERROR;
+  if (pthread_cond_init (&ts->cond,  NULL) != 0) { pthread_mutex_destroy(&ts->mutex); goto ERROR; }
+  if (use_thread)
+    {
+      if (pthread_create(&ts->thread, NULL, tabstream_writer, ts) != 0) { p7_tabstream_Destroy(ts); return NULL; }
+      ts->use_thread = TRUE;
+    }
+#endif
+  return ts;
+
+ ERROR:
+  if (ts) {
+    if (ts->q) free(ts->q);
+    free(ts);
+  }
+  return NULL;
+}
+
+
+/* Function:  p7_tabstream_NewQuery()
+ * Synopsis:  Start streaming the hits of a new query.
+ *
+ * Purpose:   Prepare stream <ts> for the hits of query <qname>
+ *            (accession <qacc>, or <NULL>) searched with pipeline
+ *            <pli>, and if <show_header> is TRUE, write the table
+ *            headers.
+ *
+ *            <pli> must have fixed <Z> and <domZ> (see
+ *            <p7_tophits_ThresholdHit()>); its search space sizes
+ *            and mode are used for the output, so it must stay valid
+ *            until <p7_tabstream_EndQuery()>. Any worker's pipeline
+ *            will do, since they all share the same settings.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <pli> doesn't have fixed <Z> and <domZ>.
+ *            <eslEMEM> on allocation failure. <eslEWRITE> on a write
+ *            failure.
+ */
+int
+p7_tabstream_NewQuery(P7_TABSTREAM *ts, char *qname, char *qacc, P7_PIPELINE *pli, int show_header)
+{
+  int status;
+
+  if (pli->Z_setby != p7_ZSETBY_OPTION || pli->domZ_setby != p7_ZSETBY_OPTION)
+    ESL_EXCEPTION(eslEINVAL, "streaming tabular output requires fixed Z and domZ");
+
+  if (ts->qname) free(ts->qname);
+  if (ts->qacc)  free(ts->qacc);
+  ts->qname = ts->qacc = NULL;
+  if ((status = esl_strdup(qname, -1, &(ts->qname))) != eslOK) return status;
+  if ((status = esl_strdup(qacc,  -1, &(ts->qacc)))  != eslOK) return status;
+  ts->pli      = pli;
+  ts->nwritten = 0;
+
+  /* the writer is idle between queries, so we can write directly */
+  if (show_header && (status = p7_tophits_TabularHeaders(ts->tblfp, ts->domtblfp, ts->qname, ts->qacc, pli)) != eslOK) return status;
+  return eslOK;
+}
+
+
+/* Function:  p7_tabstream_AddHits()
+ * Synopsis:  Stream the newly found hits of a hit list.
+ *
+ * Purpose:   Apply thresholds to hits <from..th->N-1> of <th>'s
+ *            storage (the ones the pipeline has added since
+ *            <th->N> was <from>), using the worker's pipeline <pli>;
+ *            see <p7_tophits_ThresholdHit()>. Copies of the reported
+ *            ones are passed to the stream for output.
+ *
+ *            The hits in <th> are left flagged as reported/included,
+ *            as <p7_tophits_Threshold()> on the final list would
+ *            flag them.
+ *
+ *            Safe to call from several worker threads at once.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure. <eslEINVAL> if <pli>
+ *            can't threshold single hits. <eslEWRITE> on a write
+ *            failure (including an earlier one in the writer
+ *            thread).
+ */
+int
+p7_tabstream_AddHits(P7_TABSTREAM *ts, P7_TOPHITS *th, uint64_t from, P7_PIPELINE *pli)
+{
+  P7_HIT  **cp = NULL;		/* copies of this batch's reported hits */
+  uint64_t  i;
+  int       ncp = 0;
+  int       status;
+
+  if (from >= th->N) return eslOK;
+
+  ESL_ALLOC(cp, sizeof(P7_HIT *) * (th->N - from));
+  for (i = from; i < th->N; i++)
+    {
+      if ((status = p7_tophits_ThresholdHit(&(th->unsrt[i]), pli)) != eslOK) goto ERROR;
+      if (! (th->unsrt[i].flags & p7_IS_REPORTED)) continue;
+
+      if ((cp[ncp] = p7_hit_Create_empty()) == NULL)                  { status = eslEMEM; goto ERROR; }
+      if ((status  = p7_hit_Copy(&(th->unsrt[i]), cp[ncp])) != eslOK) { free(cp[ncp]);     goto ERROR; }
+      ncp++;
+    }
+  if (ncp == 0) { free(cp); return eslOK; }
+
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&ts->mutex);
+  if (ts->status == eslOK && ts->use_thread)
+    {
+      if (ts->nq + ncp > ts->nqalloc)
+	{
+	  void *p;
+	  int   nalloc = ESL_MAX(ts->nqalloc * 2, ts->nq + ncp);
+	  if ((p = realloc(ts->q, sizeof(P7_HIT *) * nalloc)) == NULL) { pthread_mutex_unlock(&ts->mutex); status = eslEMEM; goto ERROR; }
+	  ts->q       = p;
+	  ts->nqalloc = nalloc;
+	}
+      memcpy(ts->q + ts->nq, cp, sizeof(P7_HIT *) * ncp);
+      ts->nq += ncp;
+      ncp     = 0;		/* the stream owns them now */
+      pthread_cond_broadcast(&ts->cond);
+    }
+  else if (ts->status == eslOK)
+    ts->status = tabstream_write(ts, cp, ncp);
+  status = ts->status;
+  pthread_mutex_unlock(&ts->mutex);
+#else
+  if (ts->status == eslOK) ts->status = tabstream_write(ts, cp, ncp);
+  status = ts->status;
+#endif
+
+  for (i = 0; i < ncp; i++) p7_hit_Destroy(cp[i]);
+  free(cp);
+  return status;
+
+ ERROR:
+  if (cp) {
+    for (i = 0; i < ncp; i++) p7_hit_Destroy(cp[i]);
+    free(cp);
+  }
+  return status;
+}
+
+
+/* Function:  p7_tabstream_EndQuery()
+ * Synopsis:  Finish streaming a query's hits.
+ *
+ * Purpose:   Wait until all the hits passed to stream <ts> for the
+ *            current query have been written, and flush the output
+ *            streams. Call this before the query's pipeline is
+ *            destroyed or modified by <p7_pipeline_Merge()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> if any write for this query failed.
+ */
+int
+p7_tabstream_EndQuery(P7_TABSTREAM *ts)
+{
+  int status;
+
+#ifdef HMMER_THREADS
+  pthread_mutex_lock(&ts->mutex);
+  while (ts->use_thread && (ts->nq > 0 || ts->busy) && ts->status == eslOK)
+    pthread_cond_wait(&ts->cond, &ts->mutex);
+  status = ts->status;
+  pthread_mutex_unlock(&ts->mutex);
+#else
+  status = ts->status;
+#endif
+
+  if (ts->tblfp    && fflush(ts->tblfp)    != 0) status = eslEWRITE;
+  if (ts->domtblfp && fflush(ts->domtblfp) != 0) status = eslEWRITE;
+  ts->pli = NULL;
+  if (status == eslEWRITE) ESL_EXCEPTION_SYS(eslEWRITE, "streaming tabular output: write failed");
+  return status;
+}
+
+
+/* Function:  p7_tabstream_Destroy()
+ * Synopsis:  Stop and free a <P7_TABSTREAM>.
+ *
+ * Purpose:   Stop the writer thread, if any, discarding any hits not
+ *            yet written (call <p7_tabstream_EndQuery()> first to
+ *            write them), and free the stream. Doesn't close the
+ *            output files, which belong to the caller.
+ */
+void
+p7_tabstream_Destroy(P7_TABSTREAM *ts)
+{
+  int i;
+
+  if (ts == NULL) return;
+
+#ifdef HMMER_THREADS
+  if (ts->use_thread)
+    {
+      pthread_mutex_lock(&ts->mutex);
+      ts->stop = TRUE;
+      pthread_cond_broadcast(&ts->cond);
+      pthread_mutex_unlock(&ts->mutex);
+      pthread_join(ts->thread, NULL);
+    }
+  pthread_cond_destroy(&ts->cond);
+  pthread_mutex_destroy(&ts->mutex);
+#endif
+
+  for (i = 0; i < ts->nq; i++) p7_hit_Destroy(ts->q[i]);
+  if (ts->q)     free(ts->q);
+  if (ts->qname) free(ts->qname);
+  if (ts->qacc)  free(ts->qacc);
+  free(ts);
+}
+/*-------------- end, P7_TABSTREAM object -----------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions
+ *****************************************************************/
+
+/* tabstream_write()
+ * Write the rows for hits <hits[0..n-1]>, which have their report
+ * flags set, for the stream's current query. Returns <eslOK>, or
+ * <eslEWRITE> on a write failure.
+ */
+static int
+tabstream_write(P7_TABSTREAM *ts, P7_HIT **hits, int n)
+{
+  int i;
+  int status;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((status = p7_tophits_TabularHit(ts->tblfp, ts->domtblfp, ts->qname, ts->qacc, hits[i], ts->pli)) != eslOK) return status;
+      ts->nwritten++;
+    }
+  return eslOK;
+}
+
+
+#ifdef HMMER_THREADS
+/* tabstream_writer()
+ * The writer thread. Waits for hits, takes the whole waiting batch
+ * so workers can keep adding while it writes, writes and frees
+ * them, and repeats until told to stop.
+ */
+static void *
+tabstream_writer(void *arg)
+{
+  P7_TABSTREAM *ts     = (P7_TABSTREAM *) arg;
+  P7_HIT      **batch  = NULL;
+  int           nbatch = 0;
+  int           nalloc = 0;
+  void         *p;
+  int           i;
+  int           status;
+
+  pthread_mutex_lock(&ts->mutex);
+  while (1)
+    {
+      while (ts->nq == 0 && ! ts->stop) pthread_cond_wait(&ts->cond, &ts->mutex);
+      if (ts->nq == 0 && ts->stop) break;
+
+      /* swap queues: take the waiting hits, leave an empty array */
+      if (nalloc < ts->nqalloc)
+	{
+	  if ((p = realloc(batch, sizeof(P7_HIT *) * ts->nqalloc)) == NULL)
+	    {
+	      for (i = 0; i < ts->nq; i++) p7_hit_Destroy(ts->q[i]);
+	      ts->nq     = 0;
+	      ts->status = eslEMEM;
+	      pthread_cond_broadcast(&ts->cond);
+	      continue;
+	    }
+	  batch  = p;
+	  nalloc = ts->nqalloc;
+	}
+      memcpy(batch, ts->q, sizeof(P7_HIT *) * ts->nq);
+      nbatch   = ts->nq;
+      ts->nq   = 0;
+      ts->busy = TRUE;
+      status   = ts->status;
+      pthread_mutex_unlock(&ts->mutex);
+
+      if (status == eslOK) status = tabstream_write(ts, batch, nbatch);
+      for (i = 0; i < nbatch; i++) p7_hit_Destroy(batch[i]);
+
+      pthread_mutex_lock(&ts->mutex);
+      if (status != eslOK && ts->status == eslOK) ts->status = status;
+      ts->busy = FALSE;
+      pthread_cond_broadcast(&ts->cond);
+    }
+  pthread_mutex_unlock(&ts->mutex);
+
+  if (batch) free(batch);
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7TABSTREAM_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+static int
+compare_rows(const void *a, const void *b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* read_rows()
+ * Read the non-comment lines of tabular output file <fp> from its
+ * start, sorted, so tables written in different orders compare
+ * equal.
+ */
+static void
+read_rows(FILE *fp, char ***ret_rows, int *ret_n)
+{
+  char  **rows   = NULL;
+  char   *buf    = NULL;
+  int     n      = 0;
+  int     nalloc = 0;
+  int     nbuf   = 0;
+
+  rewind(fp);
+  while (esl_fgets(&buf, &nbuf, fp) == eslOK)
+    {
+      if (*buf == '#') continue;
+      if (n == nalloc) {
+	nalloc = (nalloc ? nalloc * 2 : 64);
+	if ((rows = realloc(rows, sizeof(char *) * nalloc)) == NULL) esl_fatal("read_rows: allocation failed");
+      }
+      if (esl_strdup(buf, -1, &(rows[n])) != eslOK) esl_fatal("read_rows: allocation failed");
+      n++;
+    }
+  if (n > 0) qsort(rows, n, sizeof(char *), compare_rows);
+  if (buf) free(buf);
+  *ret_rows = rows;
+  *ret_n    = n;
+}
+
+static void
+compare_tables(FILE *fp1, FILE *fp2, char *msg)
+{
+  char **rows1 = NULL;
+  char **rows2 = NULL;
+  int    n1, n2;
+  int    i;
+
+  read_rows(fp1, &rows1, &n1);
+  read_rows(fp2, &rows2, &n2);
+  if (n1 != n2 || n1 == 0) esl_fatal(msg);
+  for (i = 0; i < n1; i++)
+    if (strcmp(rows1[i], rows2[i]) != 0) esl_fatal(msg);
+
+  for (i = 0; i < n1; i++) { free(rows1[i]); free(rows2[i]); }
+  free(rows1);
+  free(rows2);
+}
+
+/* utest_stream()
+ *
+ * Search a sampled model against <nseq> targets, emitted from the
+ * model or random, with fixed Z and domZ, streaming each target's
+ * new hits as the pipeline finds them (through a writer thread if
+ * <use_thread> is TRUE). The streamed per-sequence and per-domain
+ * rows must be the same, up to order, as the ones
+ * <p7_tophits_TabularTargets()> and <p7_tophits_TabularDomains()>
+ * write from the sorted, thresholded hit list.
+ */
+static void
+utest_stream(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, int M, int nseq, int use_thread)
+{
+  char          msg[]   = "p7_tabstream stream unit test failed";
+  P7_HMM       *hmm     = NULL;
+  P7_PROFILE   *gm      = NULL;
+  P7_OPROFILE  *om      = NULL;
+  P7_PIPELINE  *pli     = NULL;
+  P7_TOPHITS   *th      = NULL;
+  P7_TABSTREAM *ts      = NULL;
+  ESL_SQ       *sq      = esl_sq_CreateDigital(abc);
+  FILE         *tblfp1  = tmpfile();
+  FILE         *tblfp2  = tmpfile();
+  FILE         *domfp1  = tmpfile();
+  FILE         *domfp2  = tmpfile();
+  uint64_t      from;
+  int           L;
+  int           i;
+
+  if (sq == NULL || tblfp1 == NULL || tblfp2 == NULL || domfp1 == NULL || domfp2 == NULL) esl_fatal(msg);
+  if (p7_hmm_Sample(rng, M, abc, &hmm)               != eslOK) esl_fatal(msg);
+  if (p7_hmm_SetName(hmm, "query")                   != eslOK) esl_fatal(msg);
+  if (p7_hmm_SetAccession(hmm, "PF00001.1")          != eslOK) esl_fatal(msg);
+  if (p7_hmm_SetComposition(hmm)                     != eslOK) esl_fatal(msg);
+  if (p7_Calibrate(hmm, NULL, &rng, &bg, NULL, NULL) != eslOK) esl_fatal(msg);
+  if ((gm = p7_profile_Create(hmm->M, abc))          == NULL)  esl_fatal(msg);
+  if ((om = p7_oprofile_Create(hmm->M, abc))         == NULL)  esl_fatal(msg);
+  if (p7_ProfileConfig(hmm, bg, gm, 400, p7_LOCAL)   != eslOK) esl_fatal(msg);
+  if (p7_oprofile_Convert(gm, om)                    != eslOK) esl_fatal(msg);
+
+  if ((pli = p7_pipeline_Create(NULL, hmm->M, 400, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  if ((th  = p7_tophits_Create())                                          == NULL) esl_fatal(msg);
+  pli->Z          = pli->domZ       = (double) nseq;
+  pli->Z_setby    = pli->domZ_setby = p7_ZSETBY_OPTION;
+
+  if ((ts = p7_tabstream_Create(tblfp1, domfp1, use_thread))                == NULL)  esl_fatal(msg);
+  if (p7_tabstream_NewQuery(ts, hmm->name, hmm->acc, pli, TRUE)            != eslOK) esl_fatal(msg);
+  if (p7_pli_NewModel(pli, om, bg)                                         != eslOK) esl_fatal(msg);
+
+  /* every other target is emitted from the model; the rest are i.i.d. */
+  for (i = 0; i < nseq; i++)
+    {
+      if (i % 2 == 0)
+	{
+	  if (p7_ProfileEmit(rng, hmm, gm, bg, sq, NULL)         != eslOK) esl_fatal(msg);
+	}
+      else
+	{
+	  L = 1 + esl_rnd_Roll(rng, 2 * M);
+	  if (esl_sq_GrowTo(sq, L)                               != eslOK) esl_fatal(msg);
+	  if (esl_rsq_xfIID(rng, bg->f, abc->K, L, sq->dsq)      != eslOK) esl_fatal(msg);
+	  sq->n = L;
+	}
+      if (esl_sq_FormatName(sq, "seq%d", i)                    != eslOK) esl_fatal(msg);
+      if (i % 3 == 0 && esl_sq_FormatAccession(sq, "SQ%d", i)  != eslOK) esl_fatal(msg);
+
+      if (p7_pli_NewSeq(pli, sq)                               != eslOK) esl_fatal(msg);
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+
+      from = th->N;
+      if (p7_Pipeline(pli, om, bg, sq, NULL, th)               != eslOK) esl_fatal(msg);
+      if (p7_tabstream_AddHits(ts, th, from, pli)              != eslOK) esl_fatal(msg);
+      p7_pipeline_Reuse(pli);
+      esl_sq_Reuse(sq);
+    }
+  if (p7_tabstream_EndQuery(ts) != eslOK) esl_fatal(msg);
+
+  p7_tophits_SortBySortkey(th);
+  p7_tophits_Threshold(th, pli);
+  if (th->nreported == 0) esl_fatal(msg);
+  if (p7_tophits_TabularTargets(tblfp2, hmm->name, hmm->acc, th, pli, TRUE) != eslOK) esl_fatal(msg);
+  if (p7_tophits_TabularDomains(domfp2, hmm->name, hmm->acc, th, pli, TRUE) != eslOK) esl_fatal(msg);
+
+  compare_tables(tblfp1, tblfp2, msg);
+  compare_tables(domfp1, domfp2, msg);
+
+  fclose(tblfp1);
+  fclose(tblfp2);
+  fclose(domfp1);
+  fclose(domfp2);
+  p7_tabstream_Destroy(ts);
+  p7_tophits_Destroy(th);
+  p7_pipeline_Destroy(pli);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  esl_sq_Destroy(sq);
+}
+#endif /*p7TABSTREAM_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7TABSTREAM_TESTDRIVE
+/*
+  gcc -o p7_tabstream_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7TABSTREAM_TESTDRIVE p7_tabstream.c -lhmmer -leasel -lm
+  ./p7_tabstream_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-M",        eslARG_INT,     "50", NULL, NULL,  NULL,  NULL, NULL, "length of the sampled profile",                    0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of target sequences",                       0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_TABSTREAM";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg  = p7_bg_Create(abc);
+  int             M   = esl_opt_GetInteger(go, "-M");
+  int             N   = esl_opt_GetInteger(go, "-N");
+
+  utest_stream(rng, abc, bg, M, N, FALSE);
+  utest_stream(rng, abc, bg, M, N, TRUE);
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7TABSTREAM_TESTDRIVE*/
@@ -13,9 +13,89 @@
 #include <string.h>
 #include <limits.h>
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
 #include "easel.h"
 #include "hmmer.h"
 
+/* p7_tophits_AlignmentThreaded(): one thread's share of the
+ * backconversions of alignment displays to sequences and traces.
+ */
+typedef struct {
+  P7_ALIDISPLAY     **ad;
+  const ESL_ALPHABET *abc;
+  ESL_SQ            **sq;
+  P7_TRACE          **tr;
+  int                 end;	/* displays are converted up to ad[end-1]           */
+  int                *next;	/* shared: the next display to convert              */
+  int                 status;
+#ifdef HMMER_THREADS
+  pthread_mutex_t    *lock;	/* protects <*next>; NULL with one worker           */
+  pthread_t           thread;
+#endif
+} BC_WORKER;
+
+#define p7_TOPHITS_BCCHUNK 64	/* displays a worker takes at a time */
+
+static void *backconvert_worker(void *arg);
+
+/* p7_tophits_DomainsThreaded(): one thread's chunk of reported
+ * targets in a round, formatted into its own temporary file.
+ */
+typedef struct {
+  P7_TOPHITS   *th;
+  P7_PIPELINE  *pli;
+  int           textw;
+  int          *hidx;		/* indices in th->hit[] of the reported targets     */
+  int           start, end;	/* this chunk is hidx[start..end-1]                 */
+  FILE         *fp;		/* temporary file the chunk is formatted into       */
+  long          len;		/* bytes written to <fp> this round                 */
+  int           status;
+#ifdef HMMER_THREADS
+  pthread_t     thread;
+#endif
+} DOM_WORKER;
+
+#define p7_TOPHITS_DOMCHUNK 256	/* reported targets a thread formats per round */
+
+static int   domains_hit(FILE *ofp, P7_HIT *hit, P7_PIPELINE *pli, int textw);
+static int   domains_threaded(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw, int ncpu);
+static void *domains_worker(void *arg);
+
+/* A k-way merge of a spilled hit list's runs, read back from their
+ * temporary files one hit at a time; see p7_tophits_SetSpill().
+ */
+typedef struct {
+  P7_HITSPILL  *sp;
+  P7_HIT      **head;		/* head[r]: run r's next hit, or NULL when it's used up   */
+  P7_HIT     ***runs;		/* runs[r] = &head[r], for run_heap_siftdown()            */
+  uint64_t     *pos;		/* all 0, for run_heap_siftdown()                         */
+  uint64_t     *left;		/* hits still to be read from each run                    */
+  int          *heap;		/* run indices, best head on top                          */
+  int           nh;		/* number of runs in the heap                             */
+  int           last;		/* run of the hit returned last, or -1                    */
+  uint8_t      *buf;		/* read buffer for a serialized hit                       */
+  uint32_t      balloc;
+  uint64_t      nrep;		/* spill_threshold_hit(): targets reported so far         */
+} SPILL_MERGE;
+
+static int      sort_by_sortkey(P7_TOPHITS *h);
+static void     free_hits(P7_TOPHITS *h);
+static uint64_t spill_hitsize(const P7_HIT *hit);
+static int      spill_write_run(P7_TOPHITS *h);
+static int      spill_compact(P7_HITSPILL *sp, P7_PIPELINE *pli);
+static int      spill_adopt(P7_TOPHITS *h1, P7_TOPHITS *h2);
+static void     spill_clear(P7_HITSPILL *sp);
+static void     spill_destroy(P7_HITSPILL *sp);
+static int      spill_merge_open(P7_HITSPILL *sp, SPILL_MERGE **ret_m);
+static int      spill_merge_next(SPILL_MERGE *m, P7_HIT **ret_hit);
+static void     spill_merge_close(SPILL_MERGE *m);
+static void     spill_threshold_hit(SPILL_MERGE *m, P7_HIT *hit, P7_PIPELINE *pli);
+static int      spill_threshold(P7_TOPHITS *th, P7_PIPELINE *pli);
+static int      workaround_bug_h74_hit(P7_HIT *hit);
+
 /*****************************************************************
  *= 1. The P7_TOPHITS object
  *****************************************************************/
@@ -26,6 +106,11 @@
  * Purpose:   Allocates a new <P7_TOPHITS> hit list and return a pointer
  *            to it.
  *
+ *            The list has its own <P7_ARENA>, which
+ *            <p7_tophits_SetHitStrings()> and the search pipeline use
+ *            for the names and alignment displays of its hits, so
+ *            they can be freed in bulk.
+ *
  * Throws:    <NULL> on allocation failure.
  */
 P7_TOPHITS *
@@ -38,11 +123,15 @@ p7_tophits_Create(void)
   ESL_ALLOC(h, sizeof(P7_TOPHITS));
   h->hit    = NULL;
   h->unsrt  = NULL;
+  h->arena  = NULL;
+  h->spill  = NULL;
+  h->borrow_strings = FALSE;
 
   ESL_ALLOC(h->hit,   sizeof(P7_HIT *) * default_nalloc);
   ESL_ALLOC(h->unsrt, sizeof(P7_HIT)   * default_nalloc);
   h->Nalloc    = default_nalloc;
   h->N         = 0;
+  if ((h->arena = p7_arena_Create(0)) == NULL) goto ERROR;
   h->nreported = 0;
   h->nincluded = 0;
   h->is_sorted_by_sortkey = TRUE; /* but only because there's 0 hits */
@@ -84,6 +173,9 @@ p7_tophits_Clone(const P7_TOPHITS *h)
   
   h2->hit = NULL;
   h2->unsrt = NULL;
+  h2->arena = NULL;   // cloned hits are individually allocated by p7_hit_Copy()
+  h2->spill = NULL;   // and spilled ones aren't cloned
+  h2->borrow_strings = FALSE;
   
   ESL_ALLOC(h2->hit,   sizeof(P7_HIT *) * h2->N);
   ESL_ALLOC(h2->unsrt, sizeof(P7_HIT)   * h2->N);
@@ -207,6 +299,7 @@ p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit)
   hit->best_domain  = -1;
   hit->dcl          = NULL;
   hit->offset       = 0;
+  hit->in_arena     = FALSE;
 
   *ret_hit = hit;
   return eslOK;
@@ -217,6 +310,72 @@ p7_tophits_CreateNextHit(P7_TOPHITS *h, P7_HIT **ret_hit)
 }
 
 
+/* Function:  p7_tophits_SetHitStrings()
+ * Synopsis:  Set a new hit's name, accession, and description.
+ *
+ * Purpose:   Set the name, accession, and description of new hit
+ *            <hit> in list <h> (from <p7_tophits_CreateNextHit()>) to
+ *            copies of <name>, <acc>, and <desc>. <acc> and <desc>
+ *            may be <NULL>, in which case the hit's are too.
+ *
+ *            If <h> has an arena, the copies are made in it and freed
+ *            in bulk with the list; otherwise they're ordinary
+ *            allocations. If <h> borrows strings
+ *            (<p7_tophits_BorrowStrings()>), no copies are made: the
+ *            hit points at <name>, <acc>, and <desc> themselves.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error.
+ */
+int
+p7_tophits_SetHitStrings(P7_TOPHITS *h, P7_HIT *hit, const char *name, const char *acc, const char *desc)
+{
+  int status;
+
+  if (h->borrow_strings)
+    {
+      hit->in_arena = TRUE;
+      hit->name     = (char *) name;
+      hit->acc      = (char *) acc;
+      hit->desc     = (char *) desc;
+    }
+  else if (h->arena)
+    {
+      hit->in_arena = TRUE;
+      if ((status = p7_arena_Strdup(h->arena, name, -1, &(hit->name))) != eslOK) return status;
+      if ((status = p7_arena_Strdup(h->arena, acc,  -1, &(hit->acc)))  != eslOK) return status;
+      if ((status = p7_arena_Strdup(h->arena, desc, -1, &(hit->desc))) != eslOK) return status;
+    }
+  else
+    {
+      hit->in_arena = FALSE;
+      if ((status = esl_strdup(name, -1, &(hit->name))) != eslOK) return status;
+      if ((status = esl_strdup(acc,  -1, &(hit->acc)))  != eslOK) return status;
+      if ((status = esl_strdup(desc, -1, &(hit->desc))) != eslOK) return status;
+    }
+  return eslOK;
+}
+
+
+/* Function:  p7_tophits_BorrowStrings()
+ * Synopsis:  Have a hit list point at its targets' names, not copy them.
+ *
+ * Purpose:   From now on, <p7_tophits_SetHitStrings()> sets the name,
+ *            accession, and description of a new hit in <h> to the
+ *            caller's strings, instead of copies. For a caller whose
+ *            targets' strings stay put for as long as the list's hits
+ *            do, like the sequence cache of the hmmpgmd daemon, this
+ *            saves three copies per hit. Hits merged into another list
+ *            keep pointing at the same strings; a clone has its own.
+ */
+void
+p7_tophits_BorrowStrings(P7_TOPHITS *h)
+{
+  h->borrow_strings = TRUE;
+}
+
+
 
 /* Function:  p7_tophits_Add()
  * Synopsis:  Add a hit to the top hits list.
@@ -296,6 +455,7 @@ p7_tophits_Add(P7_TOPHITS *h,
   h->unsrt[h->N].nincluded  = 0;
   h->unsrt[h->N].best_domain= 0;
   h->unsrt[h->N].dcl        = NULL;
+  h->unsrt[h->N].in_arena   = FALSE;
   h->N++;
 
   if (h->N >= 2) {
@@ -305,6 +465,17 @@ p7_tophits_Add(P7_TOPHITS *h,
   return eslOK;
 }
 
+static int merge_hit_arrays(P7_HIT ***runs, const uint64_t *nrun, int nruns, P7_HIT **out, int (*sorter)(const void *, const void *));
+static int merge_many(P7_TOPHITS *h1, P7_TOPHITS **hl, int nlist, int by_seqidx);
+
+/* P7_HITKEY: a hit's sortkey and its index in <unsrt>, the
+ * compact record that p7_tophits_SortBySortkey() sorts.
+ */
+typedef struct {
+  double   sortkey;
+  uint64_t idx;
+} P7_HITKEY;
+
 /* hit_sorter(): qsort's pawn, below */
 static int
 hit_sorter_by_sortkey(const void *vh1, const void *vh2)
@@ -380,6 +551,65 @@ hit_sorter_by_modelname_aliposition(const void *vh1, const void *vh2)
 }
 
 
+/* hit_heap_siftdown(): restore a heap of hit pointers below <i>;
+ * the worst-ranked hit by <hit_sorter_by_sortkey()> is on top.
+ * Used in partial top-K selection, p7_tophits_SortTopK().
+ */
+static void
+hit_heap_siftdown(P7_HIT **a, uint64_t n, uint64_t i)
+{
+  P7_HIT  *tmp;
+  uint64_t c;
+
+  while ((c = 2*i+1) < n)
+    {
+      if (c+1 < n && hit_sorter_by_sortkey(&a[c+1], &a[c]) > 0) c++;
+      if (hit_sorter_by_sortkey(&a[c], &a[i]) <= 0) break;
+      tmp = a[i]; a[i] = a[c]; a[c] = tmp;
+      i   = c;
+    }
+}
+
+/* run_heap_siftdown(): restore a heap of run indices below <i>, in
+ * a k-way merge; the run whose next hit <runs[r][pos[r]]> ranks best
+ * by <sorter> is on top, with ties going to the lower-numbered run.
+ * Used in merge_hit_arrays().
+ */
+static void
+run_heap_siftdown(int *heap, int n, int i, P7_HIT ***runs, const uint64_t *pos, int (*sorter)(const void *, const void *))
+{
+  int tmp, c, cmp;
+
+  while ((c = 2*i+1) < n)
+    {
+      if (c+1 < n) {
+        cmp = (*sorter)(&runs[heap[c+1]][pos[heap[c+1]]], &runs[heap[c]][pos[heap[c]]]);
+        if (cmp < 0 || (cmp == 0 && heap[c+1] < heap[c])) c++;
+      }
+      cmp = (*sorter)(&runs[heap[c]][pos[heap[c]]], &runs[heap[i]][pos[heap[i]]]);
+      if (cmp > 0 || (cmp == 0 && heap[c] > heap[i])) break;
+      tmp = heap[i]; heap[i] = heap[c]; heap[c] = tmp;
+      i   = c;
+    }
+}
+
+
+/* sortkey_sorter(): qsort's pawn for the compact keys in
+ * p7_tophits_SortBySortkey(); big sortkeys first, and equal ones
+ * left for hit_sorter_by_sortkey() to break.
+ */
+static int
+sortkey_sorter(const void *vk1, const void *vk2)
+{
+  const P7_HITKEY *k1 = (const P7_HITKEY *) vk1;
+  const P7_HITKEY *k2 = (const P7_HITKEY *) vk2;
+
+  if      (k1->sortkey < k2->sortkey) return  1;
+  else if (k1->sortkey > k2->sortkey) return -1;
+  else                                return  0;
+}
+
+
 /* Function:  p7_tophits_SortBySortkey()
  * Synopsis:  Sorts a hit list.
  *
@@ -387,16 +617,66 @@ hit_sorter_by_modelname_aliposition(const void *vh1, const void *vh2)
  *            <h->hit[i]> points to the i'th ranked 
  *            <P7_HIT> for all <h->N> hits.
  *
+ *            The sort is done on a compact array of <(sortkey,
+ *            index)> pairs, copied in one pass over <h->unsrt>, so
+ *            that qsort() streams through 16 bytes a hit instead of
+ *            chasing a pointer to a whole <P7_HIT> at each
+ *            comparison. Only runs of tied sortkeys go back to the
+ *            hits themselves, to be put in name and position order as
+ *            before.
+ *
+ *            If <h> has spilled hits to disk (see
+ *            <p7_tophits_SetSpill()>), the ones in memory are sorted
+ *            and spilled too, leaving <h->N> 0: the whole list is
+ *            then a set of sorted runs, merged as it's read back.
+ *
  * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> if spilled hits can't be written.
  */
 int
 p7_tophits_SortBySortkey(P7_TOPHITS *h)
 {
-  int i;
+  if (h->spill && h->spill->nruns > 0) return spill_write_run(h);
+  return sort_by_sortkey(h);
+}
+
+/* sort_by_sortkey()
+ * <p7_tophits_SortBySortkey()> of the hits in memory.
+ */
+static int
+sort_by_sortkey(P7_TOPHITS *h)
+{
+  P7_HITKEY *key = NULL;
+  uint64_t   i, j;
+  int        status;
 
   if (h->is_sorted_by_sortkey)  return eslOK;
+  if (h->N > 1)
+    {
+      ESL_ALLOC(key, sizeof(P7_HITKEY) * h->N);
+      for (i = 0; i < h->N; i++) { key[i].sortkey = h->unsrt[i].sortkey; key[i].idx = i; }
+      qsort(key, h->N, sizeof(P7_HITKEY), sortkey_sorter);
+      for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + key[i].idx;
+
+      for (i = 0; i < h->N; i = j)
+	{
+	  for (j = i+1; j < h->N && key[j].sortkey == key[i].sortkey; j++) ;
+	  if (j - i > 1) qsort(h->hit + i, j - i, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+	}
+      free(key);
+    }
+  else
+    for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
+
+  h->is_sorted_by_seqidx  = FALSE;
+  h->is_sorted_by_sortkey = TRUE;
+  return eslOK;
+
+ ERROR:
+  /* no room for the keys: sort the hit pointers directly, as we used to */
   for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
-  if (h->N > 1)  qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+  qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_sortkey);
   h->is_sorted_by_seqidx  = FALSE;
   h->is_sorted_by_sortkey = TRUE;
   return eslOK;
@@ -429,7 +709,11 @@ p7_tophits_SortBySeqidxAndAlipos(P7_TOPHITS *h)
 
   if (h->is_sorted_by_seqidx)  return eslOK;
   for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
-  if (h->N > 1)  qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_seqidx_aliposition);
+
+  /* hits usually come in target order already: check, it's cheaper than sorting */
+  for (i = 1; i < h->N; i++)
+    if (hit_sorter_by_seqidx_aliposition(&h->hit[i-1], &h->hit[i]) > 0) break;
+  if (i < h->N)  qsort(h->hit, h->N, sizeof(P7_HIT *), hit_sorter_by_seqidx_aliposition);
   h->is_sorted_by_sortkey = FALSE;
   h->is_sorted_by_seqidx  = TRUE;
   return eslOK;
@@ -482,11 +766,12 @@ p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2)
   uint64_t Nalloc = h1->N + h2->N;
   int      status;
 
+  if ((status = spill_adopt(h1, h2)) != eslOK) return status;
   if(h2->N <= 0) return eslOK;
   
   /* Make sure the two lists are sorted */
-  if ((status = p7_tophits_SortBySortkey(h1)) != eslOK) goto ERROR;
-  if ((status = p7_tophits_SortBySortkey(h2)) != eslOK) goto ERROR;
+  if ((status = sort_by_sortkey(h1)) != eslOK) goto ERROR;
+  if ((status = sort_by_sortkey(h2)) != eslOK) goto ERROR;
 
   /* Attempt our allocations, so we fail early if we fail. 
    * Reallocating h1->unsrt screws up h1->hit, so fix it.
@@ -516,6 +801,13 @@ p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2)
       h2->unsrt[i].dcl  = NULL;
   }
 
+  /* ... and of the arena memory that some of those hits live in. */
+  if (h2->arena)
+  {
+      if (h1->arena) p7_arena_Splice(h1->arena, h2->arena);
+      else         { h1->arena = h2->arena; h2->arena = NULL; }
+  }
+
   /* Construct the new grown h1 */
   free(h1->hit);
   h1->hit    = new_hit;
@@ -529,6 +821,279 @@ p7_tophits_Merge(P7_TOPHITS *h1, P7_TOPHITS *h2)
   return status;
 }
 
+/* Function:  p7_tophits_MergeHitArrays()
+ * Synopsis:  K-way merge of sorted arrays of hit pointers.
+ *
+ * Purpose:   Given <nruns> arrays of hit pointers <runs[0..nruns-1]>,
+ *            of lengths <nrun[0..nruns-1]>, each already in
+ *            <p7_tophits_SortBySortkey()> order, merge them into
+ *            <out>, which the caller has allocated for the total
+ *            number of hits. Uses a heap over the runs, so the cost
+ *            is $O(N \log k)$ for $N$ hits total in $k$ runs. Equal
+ *            hits keep the order of the runs they came from.
+ *
+ *            Only pointers are moved; the hits themselves stay
+ *            where they are.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <out> is then
+ *            undefined, but <runs> are unchanged.
+ */
+int
+p7_tophits_MergeHitArrays(P7_HIT ***runs, const uint64_t *nrun, int nruns, P7_HIT **out)
+{
+  return merge_hit_arrays(runs, nrun, nruns, out, hit_sorter_by_sortkey);
+}
+
+/* merge_hit_arrays()
+ * 
+ * The k-way merge of <p7_tophits_MergeHitArrays()>, with runs in
+ * the order of <sorter>.
+ */
+static int
+merge_hit_arrays(P7_HIT ***runs, const uint64_t *nrun, int nruns, P7_HIT **out, int (*sorter)(const void *, const void *))
+{
+  int      *heap = NULL;   /* run indices, best next hit on top */
+  uint64_t *pos  = NULL;   /* next unmerged hit in each run     */
+  uint64_t  k    = 0;
+  int       nh   = 0;
+  int       r, i;
+  int       status;
+
+  ESL_ALLOC(heap, sizeof(int)      * (nruns+1));  /* +1: nruns may be 0 */
+  ESL_ALLOC(pos,  sizeof(uint64_t) * (nruns+1));
+
+  for (r = 0; r < nruns; r++)
+    {
+      pos[r] = 0;
+      if (nrun[r] > 0) heap[nh++] = r;
+    }
+  for (i = nh/2-1; i >= 0; i--) run_heap_siftdown(heap, nh, i, runs, pos, sorter);
+
+  while (nh > 0)
+    {
+      r        = heap[0];
+      out[k++] = runs[r][pos[r]++];
+      if (pos[r] == nrun[r]) heap[0] = heap[--nh];
+      if (nh > 1) run_heap_siftdown(heap, nh, 0, runs, pos, sorter);
+    }
+
+  free(heap);
+  free(pos);
+  return eslOK;
+
+ ERROR:
+  if (heap) free(heap);
+  if (pos)  free(pos);
+  return status;
+}
+
+
+/* Function:  p7_tophits_MergeMany()
+ * Synopsis:  Merge many top hits lists into one.
+ *
+ * Purpose:   Merge the <nlist> lists <hl[0..nlist-1]> into <h1>,
+ *            as if by calling <p7_tophits_Merge()> on each of them
+ *            in turn, but with one reallocation of <h1> and a
+ *            single k-way merge of the sorted lists instead of
+ *            <nlist> pairwise ones. Lists that aren't already
+ *            sorted are sorted first: to get that work done in
+ *            parallel, worker threads should call
+ *            <p7_tophits_SortBySortkey()> on their own lists before
+ *            finishing.
+ *
+ *            Spilled runs of the <hl[]> are handed over to <h1>
+ *            (see <p7_tophits_SetSpill()>).
+ *
+ *            Upon return, <h1> contains the sorted, merged list.
+ *            Each <hl[]> is effectively destroyed; caller should
+ *            not access them further, and may as well free them
+ *            immediately.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <h1> and
+ *            all the <hl[]> remain valid.
+ */
+int
+p7_tophits_MergeMany(P7_TOPHITS *h1, P7_TOPHITS **hl, int nlist)
+{
+  return merge_many(h1, hl, nlist, FALSE);
+}
+
+/* Function:  p7_tophits_MergeManyBySeqidxAndAlipos()
+ * Synopsis:  Merge many nhmmer hit lists in target order.
+ *
+ * Purpose:   As <p7_tophits_MergeMany()>, but the lists are put in
+ *            <p7_tophits_SortBySeqidxAndAlipos()> order, and merged
+ *            in that order, ready for <p7_tophits_RemoveDuplicates()>.
+ *            That saves sorting all of nhmmer's hits at once after a
+ *            pairwise merge by sortkey: each thread sorts its own
+ *            list, which it finds in target order already, apart from
+ *            the reverse strand's hits, and the merge is
+ *            $O(N \log k)$. Ties keep the order of the lists.
+ *
+ *            Upon return, <h1> contains the merged list, flagged
+ *            sorted by seqidx; the <hl[]> are effectively destroyed.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure, and <h1> and
+ *            all the <hl[]> remain valid.
+ */
+int
+p7_tophits_MergeManyBySeqidxAndAlipos(P7_TOPHITS *h1, P7_TOPHITS **hl, int nlist)
+{
+  return merge_many(h1, hl, nlist, TRUE);
+}
+
+/* merge_many()
+ * 
+ * <p7_tophits_MergeMany()>, and with <by_seqidx> TRUE,
+ * <p7_tophits_MergeManyBySeqidxAndAlipos()>.
+ */
+static int
+merge_many(P7_TOPHITS *h1, P7_TOPHITS **hl, int nlist, int by_seqidx)
+{
+  int      (*sort_list)(P7_TOPHITS *)               = (by_seqidx ? p7_tophits_SortBySeqidxAndAlipos  : sort_by_sortkey);
+  int      (*sorter)(const void *, const void *)    = (by_seqidx ? hit_sorter_by_seqidx_aliposition : hit_sorter_by_sortkey);
+  void      *p;
+  P7_HIT   **new_hit = NULL;
+  P7_HIT   **tmp     = NULL;  /* hl[]'s sorted hit pointers, relocated into h1 */
+  P7_HIT  ***runs    = NULL;
+  uint64_t  *nrun    = NULL;
+  P7_HIT    *ori1    = h1->unsrt;
+  P7_HIT    *base;
+  uint64_t   Nalloc  = h1->N;
+  uint64_t   Nother;
+  uint64_t   i, off;
+  int        l;
+  int        status;
+
+  for (l = 0; l < nlist; l++)
+    if ((status = spill_adopt(h1, hl[l])) != eslOK) return status;
+  if ((status = (*sort_list)(h1)) != eslOK) goto ERROR;
+
+  for (l = 0; l < nlist; l++) Nalloc += hl[l]->N;
+  Nother = Nalloc - h1->N;
+  if (Nother == 0) return eslOK;
+
+  for (l = 0; l < nlist; l++)
+    if ((status = (*sort_list)(hl[l])) != eslOK) goto ERROR;
+
+  /* Do all allocations up front, so we fail early if we fail. */
+  ESL_ALLOC(new_hit, sizeof(P7_HIT *)  * Nalloc);
+  ESL_ALLOC(tmp,     sizeof(P7_HIT *)  * Nother);
+  ESL_ALLOC(runs,    sizeof(P7_HIT **) * (nlist+1));
+  ESL_ALLOC(nrun,    sizeof(uint64_t)  * (nlist+1));
+  ESL_RALLOC(h1->unsrt, p, sizeof(P7_HIT) * Nalloc);
+  for (i = 0; i < h1->N; i++)
+    h1->hit[i] = h1->unsrt + (h1->hit[i] - ori1);
+
+  /* Append each list's unsorted data to h1, and set up its sorted
+   * run of pointers to where its hits now are.
+   */
+  runs[0] = h1->hit;
+  nrun[0] = h1->N;
+  base    = h1->unsrt + h1->N;
+  for (off = 0, l = 0; l < nlist; l++)
+    {
+      memcpy(base, hl[l]->unsrt, sizeof(P7_HIT) * hl[l]->N);
+      for (i = 0; i < hl[l]->N; i++)
+        tmp[off+i] = base + (hl[l]->hit[i] - hl[l]->unsrt);
+      runs[l+1] = tmp + off;
+      nrun[l+1] = hl[l]->N;
+      base     += hl[l]->N;
+      off      += hl[l]->N;
+    }
+
+  if ((status = merge_hit_arrays(runs, nrun, nlist+1, new_hit, sorter)) != eslOK) goto ERROR;
+
+  /* The lists now turn over management of their name, acc, desc,
+   * domain memory, and arenas to h1.
+   */
+  for (l = 0; l < nlist; l++)
+    {
+      for (i = 0; i < hl[l]->N; i++)
+        {
+          hl[l]->unsrt[i].name = NULL;
+          hl[l]->unsrt[i].acc  = NULL;
+          hl[l]->unsrt[i].desc = NULL;
+          hl[l]->unsrt[i].dcl  = NULL;
+        }
+      if (hl[l]->arena)
+        {
+          if (h1->arena) p7_arena_Splice(h1->arena, hl[l]->arena);
+          else         { h1->arena = hl[l]->arena; hl[l]->arena = NULL; }
+        }
+    }
+
+  free(h1->hit);
+  h1->hit    = new_hit;
+  h1->Nalloc = Nalloc;
+  h1->N      = Nalloc;
+  /* is_sorted_by_sortkey (or _by_seqidx) is TRUE, from sorting h1 above */
+  free(tmp);
+  free(runs);
+  free(nrun);
+  return eslOK;
+
+ ERROR:
+  if (new_hit) free(new_hit);
+  if (tmp)     free(tmp);
+  if (runs)    free(runs);
+  if (nrun)    free(nrun);
+  return status;
+}
+
+
+/* Function:  p7_tophits_SortTopK()
+ * Synopsis:  Partially sort a hit list, ranking only the top <K>.
+ *
+ * Purpose:   Arrange <h->hit[]> so that its first <K> entries point
+ *            to the <K> best hits, in <p7_tophits_SortBySortkey()>
+ *            order; the remaining <h->N-K> entries point to the other
+ *            hits, in no particular order. Takes $O(N \log K)$
+ *            time instead of a full sort's $O(N \log N)$, for when
+ *            only the top of the list matters to the caller.
+ *
+ *            If <K> $\geq$ <h->N>, this is the same as
+ *            <p7_tophits_SortBySortkey()>. Otherwise <h> is left
+ *            flagged as unsorted, so a later full sort still does
+ *            its work.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_tophits_SortTopK(P7_TOPHITS *h, uint64_t K)
+{
+  P7_HIT  *tmp;
+  uint64_t i;
+
+  if (K >= h->N)               return p7_tophits_SortBySortkey(h);
+  if (h->is_sorted_by_sortkey) return eslOK;
+  for (i = 0; i < h->N; i++) h->hit[i] = h->unsrt + i;
+  if (K == 0) return eslOK;
+
+  /* hit[0..K-1] is a heap with the worst of the best K on top;
+   * anything better than that displaces it.
+   */
+  for (i = K/2; i > 0; i--) hit_heap_siftdown(h->hit, K, i-1);
+  for (i = K; i < h->N; i++)
+    if (hit_sorter_by_sortkey(&h->hit[i], &h->hit[0]) < 0)
+      {
+        tmp = h->hit[0]; h->hit[0] = h->hit[i]; h->hit[i] = tmp;
+        hit_heap_siftdown(h->hit, K, 0);
+      }
+  if (K > 1) qsort(h->hit, K, sizeof(P7_HIT *), hit_sorter_by_sortkey);
+
+  h->is_sorted_by_seqidx  = FALSE;
+  h->is_sorted_by_sortkey = FALSE;
+  return eslOK;
+}
+
+
 /* Function:  p7_tophits_GetMaxPositionLength()
  * Synopsis:  Returns maximum position length in hit list (targets).
  *
@@ -586,7 +1151,7 @@ int
 p7_tophits_GetMaxNameLength(P7_TOPHITS *h)
 {
   int i, max, n;
-  for (max = 0, i = 0; i < h->N; i++)
+  for (max = (h->spill ? h->spill->maxnamelen : 0), i = 0; i < h->N; i++)
     if (h->unsrt[i].name != NULL) {
       n   = strlen(h->unsrt[i].name);
       max = ESL_MAX(n, max);
@@ -605,7 +1170,7 @@ int
 p7_tophits_GetMaxAccessionLength(P7_TOPHITS *h)
 {
   int i, max, n;
-  for (max = 0, i = 0; i < h->N; i++)
+  for (max = (h->spill ? h->spill->maxacclen : 0), i = 0; i < h->N; i++)
     if (h->unsrt[i].acc != NULL) {
       n   = strlen(h->unsrt[i].acc);
       max = ESL_MAX(n, max);
@@ -627,7 +1192,7 @@ int
 p7_tophits_GetMaxShownLength(P7_TOPHITS *h)
 {
   int i, max, n;
-  for (max = 0, i = 0; i < h->N; i++)
+  for (max = (h->spill ? h->spill->maxshownlen : 0), i = 0; i < h->N; i++)
   {
     if (h->unsrt[i].acc != NULL && h->unsrt[i].acc[0] != '\0')
     {
@@ -650,33 +1215,51 @@ p7_tophits_GetMaxShownLength(P7_TOPHITS *h)
  * Purpose:   Reuse the tophits list <h>; save as 
  *            many malloc/free cycles as possible,
  *            as opposed to <Destroy()>'ing it and
- *            <Create>'ing a new one.
+ *            <Create>'ing a new one. Hit strings and
+ *            alignment displays in the list's arena
+ *            are freed in bulk. Spilled hits are
+ *            dropped, but the memory budget stays.
  */
 int
 p7_tophits_Reuse(P7_TOPHITS *h)
+{
+  if (h == NULL) return eslOK;
+  free_hits(h);
+  spill_clear(h->spill);
+  return eslOK;
+}
+
+/* free_hits()
+ * Free the hits <h> has in memory, leaving it empty, as
+ * <p7_tophits_Reuse()> does.
+ */
+static void
+free_hits(P7_TOPHITS *h)
 {
   int i, j;
 
-  if (h == NULL) return eslOK;
   if (h->unsrt != NULL) 
   {
     for (i = 0; i < h->N; i++)
     {
-      if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
-      if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
-      if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
+      if (! h->unsrt[i].in_arena)
+      {
+        if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
+        if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
+        if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
+      }
       if (h->unsrt[i].dcl  != NULL) {
         for (j = 0; j < h->unsrt[i].ndom; j++)
-          if (h->unsrt[i].dcl[j].ad != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad);
+          if (h->unsrt[i].dcl[j].ad != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad); /* no-op for arena displays */
         free(h->unsrt[i].dcl);
       }
     }
   }
+  p7_arena_Reuse(h->arena);
   h->N         = 0;
   h->is_sorted_by_seqidx = FALSE;
   h->is_sorted_by_sortkey = TRUE;  /* because there are 0 hits */
   h->hit[0]    = h->unsrt;
-  return eslOK;
 }
 
 /* Function:  p7_tophits_Destroy()
@@ -692,9 +1275,12 @@ p7_tophits_Destroy(P7_TOPHITS *h)
   {
     for (i = 0; i < h->N; i++)
     {
-      if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
-      if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
-      if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
+      if (! h->unsrt[i].in_arena)
+      {
+        if (h->unsrt[i].name != NULL) free(h->unsrt[i].name);
+        if (h->unsrt[i].acc  != NULL) free(h->unsrt[i].acc);
+        if (h->unsrt[i].desc != NULL) free(h->unsrt[i].desc);
+      }
       if (h->unsrt[i].dcl  != NULL) {
         for (j = 0; j < h->unsrt[i].ndom; j++) {
           if (h->unsrt[i].dcl[j].ad             != NULL) p7_alidisplay_Destroy(h->unsrt[i].dcl[j].ad);
@@ -705,73 +1291,709 @@ p7_tophits_Destroy(P7_TOPHITS *h)
     }
     free(h->unsrt);
   }
+  p7_arena_Destroy(h->arena);
+  spill_destroy(h->spill);
   free(h);
   return;
 }
-/*---------------- end, P7_TOPHITS object -----------------------*/
 
 
+/* Function:  p7_tophits_Serialize()
+ * Synopsis:  Serialize a hit list into a contiguous byte buffer.
+ *
+ * Purpose:   Append hit list <th> to the buffer <*buf> at offset <*n>,
+ *            as a 24-byte header (the number of hits, <nreported> and
+ *            <nincluded>, as 64-bit integers) followed by each hit in
+ *            <th->unsrt> order as written by <p7_hit_Serialize()>.
+ *            Like the <p7_hit_Serialize()> format it is built on, every
+ *            field is in network byte order, so the buffer can be sent
+ *            between machines as raw bytes; <p7_tophits_Deserialize()>
+ *            reads it.
+ *
+ *            The buffer conventions are those of <p7_hit_Serialize()>:
+ *            <*buf> of <*nalloc> bytes is reallocated if it's too
+ *            small, and if <*buf> is <NULL> (with <*n> and <*nalloc>
+ *            0) it is allocated.
+ *
+ * Returns:   <eslOK> on success. <*n> is the offset just past the
+ *            serialized list; <*buf> and <*nalloc> may have changed.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <eslEINVAL> on bad
+ *            arguments, as <p7_hit_Serialize()>.
+ */
+int
+p7_tophits_Serialize(const P7_TOPHITS *th, uint8_t **buf, uint32_t *n, uint32_t *nalloc)
+{
+  uint64_t network_64bit;
+  uint64_t i;
+  int      status;
 
+  if (th == NULL || buf == NULL || n == NULL || nalloc == NULL || (*buf == NULL && (*n != 0 || *nalloc != 0))) return eslEINVAL;
 
+  if (*buf == NULL || *n + 3 * sizeof(uint64_t) > *nalloc)
+    {
+      ESL_REALLOC(*buf, *n + 3 * sizeof(uint64_t));
+      *nalloc = *n + 3 * sizeof(uint64_t);
+    }
 
+  network_64bit = esl_hton64(th->N);         memcpy(*buf + *n, &network_64bit, sizeof(uint64_t)); *n += sizeof(uint64_t);
+  network_64bit = esl_hton64(th->nreported); memcpy(*buf + *n, &network_64bit, sizeof(uint64_t)); *n += sizeof(uint64_t);
+  network_64bit = esl_hton64(th->nincluded); memcpy(*buf + *n, &network_64bit, sizeof(uint64_t)); *n += sizeof(uint64_t);
 
-/*****************************************************************
- * 2. Standard (human-readable) output of pipeline results
- *****************************************************************/
+  for (i = 0; i < th->N; i++)
+    if ((status = p7_hit_Serialize(th->unsrt + i, buf, n, nalloc)) != eslOK) return status;
+  return eslOK;
 
-/* workaround_bug_h74(): 
- * Different envelopes, identical alignment
- * 
- * Bug #h74, though extremely rare, arises from a limitation in H3's
- * implementation of Forward/Backward, as follows:
- * 
- *  1. A multidomain region is analyzed by stochastic clustering
- *  2. Overlapping envelopes are found (w.r.t sequence coords), though
- *     trace clusters are distinct if HMM endpoints are also considered.
- *  3. We have no facility for limiting Forward/Backward to a specified
- *     range of profile coordinates, so each envelope is passed to
- *     rescore_isolated_domain() and analyzed independently.
- *  4. Optimal accuracy alignment may identify exactly the same alignment
- *     in the overlap region shared by the two envelopes.
- *     
- * The disturbing result is two different envelopes that have
- * identical alignments and alignment endpoints.
- * 
- * The correct fix is to define envelopes not only by sequence
- * endpoints but also by profile endpoints, passing them to
- * rescore_isolated_domain(), and limiting F/B calculations to this
- * pieces of the DP lattice. This requires a fair amount of work,
- * adding to the optimized API.
- * 
- * The workaround is to detect when there are duplicate alignments,
- * and only display one. We show the one with the best bit score.
- * 
- * If we ever implement envelope-limited versions of F/B, revisit this
- * fix.
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_tophits_Deserialize()
+ * Synopsis:  Read a hit list back from a <p7_tophits_Serialize()> buffer.
  *
- * SRE, Tue Dec 22 16:27:04 2009
- * xref J5/130; notebook/2009/1222-hmmer-bug-h74
- */
-static int
-workaround_bug_h74(P7_TOPHITS *th)
+ * Purpose:   Read the hit list serialized in <buf> at offset <*n>, of
+ *            a buffer <len> bytes long, appending its hits to <th> and
+ *            adding its <nreported> and <nincluded> counts to <th>'s.
+ *            <th> is usually empty, from <p7_tophits_Create()>.
+ *
+ * Returns:   <eslOK> on success, and <*n> is the offset just past the
+ *            serialized list. <eslEFORMAT> if the buffer is truncated
+ *            or inconsistent.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tophits_Deserialize(const uint8_t *buf, uint32_t len, uint32_t *n, P7_TOPHITS *th)
+{
+  P7_HIT  *hit = NULL;
+  uint64_t network_64bit;
+  uint64_t nhits, nreported, nincluded;
+  uint64_t i;
+  int      status;
+
+  if (*n + 3 * sizeof(uint64_t) > len) return eslEFORMAT;
+  memcpy(&network_64bit, buf + *n, sizeof(uint64_t)); nhits     = esl_ntoh64(network_64bit); *n += sizeof(uint64_t);
+  memcpy(&network_64bit, buf + *n, sizeof(uint64_t)); nreported = esl_ntoh64(network_64bit); *n += sizeof(uint64_t);
+  memcpy(&network_64bit, buf + *n, sizeof(uint64_t)); nincluded = esl_ntoh64(network_64bit); *n += sizeof(uint64_t);
+
+  for (i = 0; i < nhits; i++)
+    {
+      if (*n + sizeof(uint32_t) > len) return eslEFORMAT;
+      if ((status = p7_tophits_CreateNextHit(th, &hit)) != eslOK) return status;
+      if ((status = p7_hit_Deserialize(buf, n, hit))    != eslOK) return (status == eslEMEM ? eslEMEM : eslEFORMAT);
+      if (*n > len) return eslEFORMAT;
+    }
+  th->nreported += nreported;
+  th->nincluded += nincluded;
+  return eslOK;
+}
+
+/* Function:  p7_tophits_SetSpill()
+ * Synopsis:  Give a hit list a memory budget, past which it spills to disk.
+ *
+ * Purpose:   Let hit list <h> hold about <maxbytes> of hits in
+ *            memory: names, domain lists and alignment displays
+ *            included. Past that, <p7_tophits_Spill()> writes them
+ *            out, sorted, as a run in a temporary file. A very
+ *            permissive search (<-E 1000>, <--max>) against a big
+ *            database can find more hits than fit in memory at once.
+ *
+ *            A spilled list's runs are merged back with the hits
+ *            still in memory by <p7_tophits_SortBySortkey()> and
+ *            <p7_tophits_Threshold()>, and read back one hit at a
+ *            time, in order, by the standard and tabular output
+ *            functions and <p7_tophits_Alignment()>; their output is
+ *            the same as if the hits had stayed in memory. Merging
+ *            two lists moves the runs too. Other uses of <h->hit[]>,
+ *            such as <p7_tophits_TabularXfam()>, only see the hits
+ *            in memory: <h->N> of them, out of a total of
+ *            <p7_tophits_Count()>.
+ *
+ *            Calling it again changes the budget.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_tophits_SetSpill(P7_TOPHITS *h, uint64_t maxbytes)
+{
+  int status;
+
+  if (h->spill == NULL)
+    {
+      ESL_ALLOC(h->spill, sizeof(P7_HITSPILL));
+      h->spill->fp          = NULL;
+      h->spill->nrun        = NULL;
+      h->spill->nruns       = 0;
+      h->spill->nalloc      = 0;
+      h->spill->nspilled    = 0;
+      h->spill->maxnamelen  = 0;
+      h->spill->maxacclen   = 0;
+      h->spill->maxshownlen = 0;
+      h->spill->buf         = NULL;
+      h->spill->balloc      = 0;
+    }
+  h->spill->maxbytes = maxbytes;
+  h->spill->nbytes   = 0;
+  h->spill->nsized   = 0;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_tophits_Spill()
+ * Synopsis:  Spill a hit list's hits to disk, if they're over budget.
+ *
+ * Purpose:   If hit list <h> has a memory budget (see
+ *            <p7_tophits_SetSpill()>) and the hits it holds in memory
+ *            are now bigger than that, sort them and write them to a
+ *            new run in a temporary file, freeing their memory. The
+ *            search loop calls this after each target. Only hits
+ *            added since the last call are sized, so it's cheap.
+ *            Without a budget, it does nothing.
+ *
+ *            No caller may keep pointers to <h>'s hits across this.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> if a temporary file can't be opened or
+ *            written (disk full, for example); <eslEMEM> on
+ *            allocation failure.
+ */
+int
+p7_tophits_Spill(P7_TOPHITS *h)
+{
+  P7_HITSPILL *sp = h->spill;
+
+  if (sp == NULL) return eslOK;
+  for ( ; sp->nsized < h->N; sp->nsized++)
+    sp->nbytes += spill_hitsize(&(h->unsrt[sp->nsized]));
+  if (sp->nbytes <= sp->maxbytes) return eslOK;
+  return spill_write_run(h);
+}
+
+
+/* Function:  p7_tophits_Count()
+ * Synopsis:  Number of hits in a list, in memory and spilled.
+ */
+uint64_t
+p7_tophits_Count(const P7_TOPHITS *h)
+{
+  return h->N + (h->spill ? h->spill->nspilled : 0);
+}
+
+
+/* spill_hitsize()
+ * Approximate memory held by <hit>: the hit, its strings, its
+ * domain list and their alignment displays.
+ */
+static uint64_t
+spill_hitsize(const P7_HIT *hit)
+{
+  uint64_t n = sizeof(P7_HIT) + sizeof(P7_HIT *);
+  int      d;
+
+  if (hit->name) n += strlen(hit->name) + 1;
+  if (hit->acc)  n += strlen(hit->acc)  + 1;
+  if (hit->desc) n += strlen(hit->desc) + 1;
+  if (hit->dcl)
+    {
+      n += sizeof(P7_DOMAIN) * hit->ndom;
+      for (d = 0; d < hit->ndom; d++)
+	if (hit->dcl[d].ad) n += p7_alidisplay_Sizeof(hit->dcl[d].ad);
+    }
+  return n;
+}
+
+/* spill_grow()
+ * Make room in <sp> for at least <nruns> runs.
+ */
+static int
+spill_grow(P7_HITSPILL *sp, int nruns)
+{
+  void *p;
+  int   nalloc;
+  int   status;
+
+  if (nruns <= sp->nalloc) return eslOK;
+  nalloc = ESL_MAX(nruns, ESL_MAX(8, 2 * sp->nalloc));
+  ESL_RALLOC(sp->fp,   p, sizeof(FILE *)   * nalloc);
+  ESL_RALLOC(sp->nrun, p, sizeof(uint64_t) * nalloc);
+  sp->nalloc = nalloc;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* spill_write_hit()
+ * Append <hit> to the run being written to <fp>, as its serialized
+ * length (32 bits, network order) and p7_hit_Serialize() bytes, and
+ * note its name lengths for output column widths.
+ */
+static int
+spill_write_hit(P7_HITSPILL *sp, FILE *fp, const P7_HIT *hit)
+{
+  uint32_t n = 0;
+  uint32_t network_32bit;
+  int      len;
+  int      status;
+
+  if ((status = p7_hit_Serialize(hit, &(sp->buf), &n, &(sp->balloc))) != eslOK) return status;
+  network_32bit = esl_hton32(n);
+  if (fwrite(&network_32bit, sizeof(uint32_t), 1, fp) != 1 || fwrite(sp->buf, 1, n, fp) != n)
+    ESL_EXCEPTION_SYS(eslEWRITE, "failed to write spilled hits");
+
+  if (hit->name) { len = strlen(hit->name); sp->maxnamelen = ESL_MAX(sp->maxnamelen, len); }
+  if (hit->acc)  { len = strlen(hit->acc);  sp->maxacclen  = ESL_MAX(sp->maxacclen,  len); }
+  if      (hit->acc && hit->acc[0] != '\0') { len = strlen(hit->acc);  sp->maxshownlen = ESL_MAX(sp->maxshownlen, len); }
+  else if (hit->name)                       { len = strlen(hit->name); sp->maxshownlen = ESL_MAX(sp->maxshownlen, len); }
+  return eslOK;
+}
+
+/* spill_write_run()
+ * Sort the hits <h> has in memory, write them to a new run, and
+ * free them. If that makes too many runs, merge them into one.
+ */
+static int
+spill_write_run(P7_TOPHITS *h)
+{
+  P7_HITSPILL *sp = h->spill;
+  FILE        *fp = NULL;
+  uint64_t     i;
+  int          status;
+
+  if (h->N == 0) return eslOK;
+  if ((status = spill_grow(sp, sp->nruns+1)) != eslOK) return status;
+  sort_by_sortkey(h);
+
+  if ((fp = tmpfile()) == NULL) ESL_XEXCEPTION_SYS(eslEWRITE, "failed to open a temporary file for spilled hits");
+  for (i = 0; i < h->N; i++)
+    if ((status = spill_write_hit(sp, fp, h->hit[i])) != eslOK) goto ERROR;
+  if (fflush(fp) != 0) ESL_XEXCEPTION_SYS(eslEWRITE, "failed to write spilled hits");
+
+  sp->fp[sp->nruns]   = fp;
+  sp->nrun[sp->nruns] = h->N;
+  sp->nruns++;
+  sp->nspilled += h->N;
+  free_hits(h);
+  sp->nbytes = 0;
+  sp->nsized = 0;
+
+  if (sp->nruns > p7_HITSPILL_MAXRUNS) return spill_compact(sp, NULL);
+  return eslOK;
+
+ ERROR:
+  if (fp) fclose(fp);
+  return status;
+}
+
+/* spill_compact()
+ * Merge all the runs of <sp> into one. With a <pli>, thresholding
+ * each hit on the way (see spill_threshold_hit()), so the flags of
+ * the thresholded list are on disk.
+ */
+static int
+spill_compact(P7_HITSPILL *sp, P7_PIPELINE *pli)
+{
+  SPILL_MERGE *m     = NULL;
+  FILE        *fp    = NULL;
+  P7_HIT      *hit;
+  uint64_t     nhits = 0;
+  int          r;
+  int          status;
+
+  if ((status = spill_merge_open(sp, &m)) != eslOK) goto ERROR;
+  if ((fp = tmpfile()) == NULL) ESL_XEXCEPTION_SYS(eslEWRITE, "failed to open a temporary file for spilled hits");
+  while ((status = spill_merge_next(m, &hit)) == eslOK)
+    {
+      if (pli) spill_threshold_hit(m, hit, pli);
+      if ((status = spill_write_hit(sp, fp, hit)) != eslOK) goto ERROR;
+      nhits++;
+    }
+  if (status != eslEOF) goto ERROR;
+  if (fflush(fp) != 0) ESL_XEXCEPTION_SYS(eslEWRITE, "failed to write spilled hits");
+  spill_merge_close(m);
+
+  for (r = 0; r < sp->nruns; r++) fclose(sp->fp[r]);
+  sp->fp[0]   = fp;
+  sp->nrun[0] = nhits;
+  sp->nruns   = 1;
+  return eslOK;
+
+ ERROR:
+  spill_merge_close(m);
+  if (fp) fclose(fp);
+  return status;
+}
+
+/* spill_adopt()
+ * Move <h2>'s spilled runs to <h1>, as part of merging the lists.
+ */
+static int
+spill_adopt(P7_TOPHITS *h1, P7_TOPHITS *h2)
+{
+  P7_HITSPILL *s1;
+  P7_HITSPILL *s2 = h2->spill;
+  int          r;
+  int          status;
+
+  if (s2 == NULL || s2->nruns == 0) return eslOK;
+  if (h1->spill == NULL && (status = p7_tophits_SetSpill(h1, s2->maxbytes)) != eslOK) return status;
+  s1 = h1->spill;
+  if ((status = spill_grow(s1, s1->nruns + s2->nruns)) != eslOK) return status;
+
+  for (r = 0; r < s2->nruns; r++)
+    {
+      s1->fp[s1->nruns]   = s2->fp[r];
+      s1->nrun[s1->nruns] = s2->nrun[r];
+      s1->nruns++;
+    }
+  s1->nspilled   += s2->nspilled;
+  s1->maxnamelen  = ESL_MAX(s1->maxnamelen,  s2->maxnamelen);
+  s1->maxacclen   = ESL_MAX(s1->maxacclen,   s2->maxacclen);
+  s1->maxshownlen = ESL_MAX(s1->maxshownlen, s2->maxshownlen);
+  s2->nruns    = 0;
+  s2->nspilled = 0;
+
+  if (s1->nruns > p7_HITSPILL_MAXRUNS) return spill_compact(s1, NULL);
+  return eslOK;
+}
+
+/* spill_clear()
+ * Close and forget the runs of <sp>, keeping its budget.
+ */
+static void
+spill_clear(P7_HITSPILL *sp)
+{
+  int r;
+
+  if (sp == NULL) return;
+  for (r = 0; r < sp->nruns; r++) fclose(sp->fp[r]);
+  sp->nruns       = 0;
+  sp->nspilled    = 0;
+  sp->nbytes      = 0;
+  sp->nsized      = 0;
+  sp->maxnamelen  = 0;
+  sp->maxacclen   = 0;
+  sp->maxshownlen = 0;
+}
+
+/* spill_destroy()
+ * Free <sp>, closing (and so removing) its temporary files.
+ */
+static void
+spill_destroy(P7_HITSPILL *sp)
+{
+  if (sp == NULL) return;
+  spill_clear(sp);
+  if (sp->fp)   free(sp->fp);
+  if (sp->nrun) free(sp->nrun);
+  if (sp->buf)  free(sp->buf);
+  free(sp);
+}
+
+/* spill_read()
+ * Read the next hit of run <r> into <m->head[r]>, or set it to NULL
+ * if the run is used up.
+ */
+static int
+spill_read(SPILL_MERGE *m, int r)
+{
+  FILE     *fp  = m->sp->fp[r];
+  P7_HIT   *hit = NULL;
+  uint32_t  network_32bit;
+  uint32_t  len;
+  uint32_t  n   = 0;
+  void     *p;
+  int       status;
+
+  m->head[r] = NULL;
+  if (m->left[r] == 0) return eslOK;
+
+  if (fread(&network_32bit, sizeof(uint32_t), 1, fp) != 1) ESL_XEXCEPTION(eslECORRUPT, "spilled hits are truncated");
+  len = esl_ntoh32(network_32bit);
+  if (len > m->balloc)
+    {
+      ESL_RALLOC(m->buf, p, len);
+      m->balloc = len;
+    }
+  if (fread(m->buf, 1, len, fp) != len) ESL_XEXCEPTION(eslECORRUPT, "spilled hits are truncated");
+
+  if ((hit = p7_hit_Create_empty()) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = p7_hit_Deserialize(m->buf, &n, hit)) == eslEMEM) goto ERROR;
+  if (status != eslOK || n != len) ESL_XEXCEPTION(eslECORRUPT, "a spilled hit is corrupt");
+
+  m->left[r]--;
+  m->head[r] = hit;
+  return eslOK;
+
+ ERROR:
+  p7_hit_Destroy(hit);
+  return status;
+}
+
+/* spill_merge_open()
+ * Start reading back the runs of <sp>, merged in sortkey order.
+ */
+static int
+spill_merge_open(P7_HITSPILL *sp, SPILL_MERGE **ret_m)
+{
+  SPILL_MERGE *m = NULL;
+  int          r, i;
+  int          status;
+
+  ESL_ALLOC(m, sizeof(SPILL_MERGE));
+  m->sp     = sp;
+  m->head   = NULL;
+  m->runs   = NULL;
+  m->pos    = NULL;
+  m->left   = NULL;
+  m->heap   = NULL;
+  m->nh     = 0;
+  m->last   = -1;
+  m->buf    = NULL;
+  m->balloc = 0;
+  m->nrep   = 0;
+  ESL_ALLOC(m->head, sizeof(P7_HIT *)  * (sp->nruns+1));  /* +1: nruns may be 0 */
+  for (r = 0; r < sp->nruns; r++) m->head[r] = NULL;
+  ESL_ALLOC(m->runs, sizeof(P7_HIT **) * (sp->nruns+1));
+  ESL_ALLOC(m->pos,  sizeof(uint64_t)  * (sp->nruns+1));
+  ESL_ALLOC(m->left, sizeof(uint64_t)  * (sp->nruns+1));
+  ESL_ALLOC(m->heap, sizeof(int)       * (sp->nruns+1));
+
+  for (r = 0; r < sp->nruns; r++)
+    {
+      m->runs[r] = &(m->head[r]);  /* so run_heap_siftdown() sees each run's head as runs[r][0] */
+      m->pos[r]  = 0;
+      m->left[r] = sp->nrun[r];
+      if (fseeko(sp->fp[r], 0, SEEK_SET) != 0) ESL_XEXCEPTION_SYS(eslESYS, "failed to rewind spilled hits");
+      if ((status = spill_read(m, r)) != eslOK) goto ERROR;
+      if (m->head[r]) m->heap[m->nh++] = r;
+    }
+  for (i = m->nh/2-1; i >= 0; i--) run_heap_siftdown(m->heap, m->nh, i, m->runs, m->pos, hit_sorter_by_sortkey);
+
+  *ret_m = m;
+  return eslOK;
+
+ ERROR:
+  spill_merge_close(m);
+  *ret_m = NULL;
+  return status;
+}
+
+/* spill_merge_next()
+ * Return the next hit of merge <m> in <*ret_hit>, or <eslEOF> when
+ * there are no more. The hit belongs to <m>, and is freed by the
+ * next call; a caller that keeps it must take over its contents.
+ */
+static int
+spill_merge_next(SPILL_MERGE *m, P7_HIT **ret_hit)
+{
+  int r = m->last;
+  int status;
+
+  *ret_hit = NULL;
+  if (r >= 0)
+    {
+      p7_hit_Destroy(m->head[r]);
+      m->last = -1;
+      if ((status = spill_read(m, r)) != eslOK) { m->heap[0] = m->heap[--m->nh]; return status; }
+      if (m->head[r] == NULL) m->heap[0] = m->heap[--m->nh];
+      if (m->nh > 1) run_heap_siftdown(m->heap, m->nh, 0, m->runs, m->pos, hit_sorter_by_sortkey);
+    }
+  if (m->nh == 0) return eslEOF;
+
+  m->last  = m->heap[0];
+  *ret_hit = m->head[m->last];
+  return eslOK;
+}
+
+/* spill_merge_close()
+ * Free merge <m>, with any hits it still holds.
+ */
+static void
+spill_merge_close(SPILL_MERGE *m)
+{
+  int r;
+
+  if (m == NULL) return;
+  if (m->head)
+    for (r = 0; r < m->sp->nruns; r++) p7_hit_Destroy(m->head[r]);
+  if (m->head) free(m->head);
+  if (m->runs) free(m->runs);
+  if (m->pos)  free(m->pos);
+  if (m->left) free(m->left);
+  if (m->heap) free(m->heap);
+  if (m->buf)  free(m->buf);
+  free(m);
+}
+
+/* spill_threshold_hit()
+ * Flag one hit of merge <m>, in its turn, as p7_tophits_Threshold()
+ * flags a list in memory. <m->nrep> counts the targets over the
+ * reporting threshold, for top-K mode and for domZ.
+ */
+static void
+spill_threshold_hit(SPILL_MERGE *m, P7_HIT *hit, P7_PIPELINE *pli)
+{
+  int d;
+
+  if ( ! pli->use_bit_cutoffs &&
+       !(hit->flags & p7_IS_DUPLICATE) &&
+       p7_pli_TargetReportable(pli, hit->score, hit->lnP))
+    {
+      hit->flags |= p7_IS_REPORTED;
+      if (p7_pli_TargetIncludable(pli, hit->score, hit->lnP))
+	hit->flags |= p7_IS_INCLUDED;
+
+      if (pli->long_targets) {
+	hit->dcl[0].is_reported = hit->flags & p7_IS_REPORTED;
+	hit->dcl[0].is_included = hit->flags & p7_IS_INCLUDED;
+      }
+    }
+
+  if (hit->flags & p7_IS_REPORTED)
+    {
+      if (pli->topk > 0 && m->nrep >= pli->topk)
+	{
+	  hit->flags &= ~(p7_IS_REPORTED | p7_IS_INCLUDED);
+	  for (d = 0; d < hit->ndom; d++)
+	    hit->dcl[d].is_reported = hit->dcl[d].is_included = FALSE;
+	}
+      m->nrep++;
+    }
+
+  if (! pli->use_bit_cutoffs && !pli->long_targets && (hit->flags & p7_IS_REPORTED))
+    {
+      for (d = 0; d < hit->ndom; d++)
+	{
+	  if (p7_pli_DomainReportable(pli, hit->dcl[d].bitscore, hit->dcl[d].lnP))
+	    hit->dcl[d].is_reported = TRUE;
+	  if ((hit->flags & p7_IS_INCLUDED) &&
+	      p7_pli_DomainIncludable(pli, hit->dcl[d].bitscore, hit->dcl[d].lnP))
+	    hit->dcl[d].is_included = TRUE;
+	}
+    }
+
+  hit->nreported = 0;
+  hit->nincluded = 0;
+  for (d = 0; d < hit->ndom; d++)
+    {
+      if (hit->dcl[d].is_reported) hit->nreported++;
+      if (hit->dcl[d].is_included) hit->nincluded++;
+    }
+  workaround_bug_h74_hit(hit);
+}
+
+/* spill_threshold()
+ * p7_tophits_Threshold() for a spilled list <th>. One pass over the
+ * merged hits counts the reported and included targets, which sets
+ * domZ; a second flags the domains too, merging the runs into one
+ * thresholded run that the output functions read back as it is.
+ */
+static int
+spill_threshold(P7_TOPHITS *th, P7_PIPELINE *pli)
+{
+  SPILL_MERGE *m = NULL;
+  P7_HIT      *hit;
+  uint64_t     nrep;
+  int          status;
+
+  if ((status = spill_write_run(th))                != eslOK) return status;
+  if ((status = spill_merge_open(th->spill, &m))     != eslOK) return status;
+
+  th->nreported = 0;
+  th->nincluded = 0;
+  while ((status = spill_merge_next(m, &hit)) == eslOK)
+    {
+      spill_threshold_hit(m, hit, pli);
+      if (hit->flags & p7_IS_REPORTED) th->nreported++;
+      if (hit->flags & p7_IS_INCLUDED) th->nincluded++;
+    }
+  nrep = m->nrep;
+  spill_merge_close(m);
+  if (status != eslEOF) return status;
+
+  if (pli->domZ_setby == p7_ZSETBY_NTARGETS) pli->domZ = (double) nrep;
+  return spill_compact(th->spill, pli);
+}
+/*---------------- end, P7_TOPHITS object -----------------------*/
+
+
+
+
+
+
+/*****************************************************************
+ * 2. Standard (human-readable) output of pipeline results
+ *****************************************************************/
+
+/* workaround_bug_h74(): 
+ * Different envelopes, identical alignment
+ * 
+ * Bug #h74, though extremely rare, arises from a limitation in H3's
+ * implementation of Forward/Backward, as follows:
+ * 
+ *  1. A multidomain region is analyzed by stochastic clustering
+ *  2. Overlapping envelopes are found (w.r.t sequence coords), though
+ *     trace clusters are distinct if HMM endpoints are also considered.
+ *  3. We have no facility for limiting Forward/Backward to a specified
+ *     range of profile coordinates, so each envelope is passed to
+ *     rescore_isolated_domain() and analyzed independently.
+ *  4. Optimal accuracy alignment may identify exactly the same alignment
+ *     in the overlap region shared by the two envelopes.
+ *     
+ * The disturbing result is two different envelopes that have
+ * identical alignments and alignment endpoints.
+ * 
+ * The correct fix is to define envelopes not only by sequence
+ * endpoints but also by profile endpoints, passing them to
+ * rescore_isolated_domain(), and limiting F/B calculations to this
+ * pieces of the DP lattice. This requires a fair amount of work,
+ * adding to the optimized API.
+ * 
+ * The workaround is to detect when there are duplicate alignments,
+ * and only display one. We show the one with the best bit score.
+ * 
+ * If we ever implement envelope-limited versions of F/B, revisit this
+ * fix.
+ *
+ * SRE, Tue Dec 22 16:27:04 2009
+ * xref J5/130; notebook/2009/1222-hmmer-bug-h74
+ */
+static int
+workaround_bug_h74_hit(P7_HIT *hit)
 {
-  int h;
   int d1, d2;
   int dremoved;
 
+  if (hit->noverlaps)
+  {
+      for (d1 = 0; d1 < hit->ndom; d1++)
+        for (d2 = d1+1; d2 < hit->ndom; d2++)
+          if (hit->dcl[d1].iali == hit->dcl[d2].iali &&
+              hit->dcl[d1].jali == hit->dcl[d2].jali)
+          {
+              dremoved = (hit->dcl[d1].bitscore >= hit->dcl[d2].bitscore) ? d2 : d1;
+              if (hit->dcl[dremoved].is_reported) { hit->dcl[dremoved].is_reported = FALSE; hit->nreported--; }
+              if (hit->dcl[dremoved].is_included) { hit->dcl[dremoved].is_included = FALSE; hit->nincluded--; }
+          }
+  }
+  return eslOK;
+}
+
+static int
+workaround_bug_h74(P7_TOPHITS *th)
+{
+  int h;
+
   for (h = 0; h < th->N; h++)  
-    if (th->hit[h]->noverlaps)
-    {
-        for (d1 = 0; d1 < th->hit[h]->ndom; d1++)
-          for (d2 = d1+1; d2 < th->hit[h]->ndom; d2++)
-            if (th->hit[h]->dcl[d1].iali == th->hit[h]->dcl[d2].iali &&
-                th->hit[h]->dcl[d1].jali == th->hit[h]->dcl[d2].jali)
-            {
-                dremoved = (th->hit[h]->dcl[d1].bitscore >= th->hit[h]->dcl[d2].bitscore) ? d2 : d1;
-                if (th->hit[h]->dcl[dremoved].is_reported) { th->hit[h]->dcl[dremoved].is_reported = FALSE; th->hit[h]->nreported--; }
-                if (th->hit[h]->dcl[dremoved].is_included) { th->hit[h]->dcl[dremoved].is_included = FALSE; th->hit[h]->nincluded--; }
-            }
-    }
+    workaround_bug_h74_hit(th->hit[h]);
   return eslOK;
 }
 
@@ -921,80 +2143,108 @@ p7_tophits_RemoveDuplicates(P7_TOPHITS *th, int using_bit_cutoffs)
  *            applied in the pipeline. In this case all we're
  *            responsible for here is counting them (setting
  *            nreported, nincluded counters).
+ *
+ *            In top-K mode (<pli->topk>; see <p7_pipeline_SetTopK()>),
+ *            only the first <topk> reportable targets are reported,
+ *            so <th> must already be sorted by sort key. <domZ> is
+ *            still the number of targets found over the reporting
+ *            threshold, top K or not.
+ *
+ *            A list that has spilled hits to disk (see
+ *            <p7_tophits_SetSpill()>) is thresholded as it's merged
+ *            back, in two passes over the runs, and left as a single
+ *            run of flagged hits for the output functions.
  *            
  * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> or <eslECORRUPT> if spilled hits can't be
+ *            written or read back; <eslEMEM> on allocation failure.
  */
 int
 p7_tophits_Threshold(P7_TOPHITS *th, P7_PIPELINE *pli)
 {
-  int h, d;    /* counters over sequence hits, domains in sequences */
+  P7_HIT *hit;
+  int     h, d;    /* counters over sequence hits, domains in sequences */
+  int     nrep;
+
+  if (th->spill && th->spill->nruns > 0) return spill_threshold(th, pli);
   
-  /* Flag reported, included targets (if we're using general thresholds) */
-  if (! pli->use_bit_cutoffs) 
+  /* Flag reported, included targets (if we're using general thresholds),
+   * counting them as we go: each pass over the hits touches every
+   * P7_HIT, so for big lists there are as few passes as we can manage.
+   */
+  th->nreported = 0;
+  th->nincluded = 0;
+  for (h = 0; h < th->N; h++)
   {
-    for (h = 0; h < th->N; h++)
-    {
-
-      if ( !(th->hit[h]->flags & p7_IS_DUPLICATE) &&
-          p7_pli_TargetReportable(pli, th->hit[h]->score, th->hit[h]->lnP))
+      hit = th->hit[h];
+      if ( ! pli->use_bit_cutoffs &&
+           !(hit->flags & p7_IS_DUPLICATE) &&
+          p7_pli_TargetReportable(pli, hit->score, hit->lnP))
       {
-          th->hit[h]->flags |= p7_IS_REPORTED;
-          if (p7_pli_TargetIncludable(pli, th->hit[h]->score, th->hit[h]->lnP))
-              th->hit[h]->flags |= p7_IS_INCLUDED;
+          hit->flags |= p7_IS_REPORTED;
+          if (p7_pli_TargetIncludable(pli, hit->score, hit->lnP))
+              hit->flags |= p7_IS_INCLUDED;
 
           if (pli->long_targets) { // no domains in dna search, so:
-            th->hit[h]->dcl[0].is_reported = th->hit[h]->flags & p7_IS_REPORTED;
-            th->hit[h]->dcl[0].is_included = th->hit[h]->flags & p7_IS_INCLUDED;
+            hit->dcl[0].is_reported = hit->flags & p7_IS_REPORTED;
+            hit->dcl[0].is_included = hit->flags & p7_IS_INCLUDED;
           }
       }
-    }
+      if (hit->flags & p7_IS_REPORTED)  th->nreported++;
+      if (hit->flags & p7_IS_INCLUDED)  th->nincluded++;
   }
 
-  /* Count reported, included targets */
-  th->nreported = 0;
-  th->nincluded = 0;
-  for (h = 0; h < th->N; h++)
-  {
-      if (th->hit[h]->flags & p7_IS_REPORTED)  th->nreported++;
-      if (th->hit[h]->flags & p7_IS_INCLUDED)  th->nincluded++;
-  }
-  
   /* Now we can determined domZ, the effective search space in which additional domains are found */
   if (pli->domZ_setby == p7_ZSETBY_NTARGETS) pli->domZ = (double) th->nreported;
 
+  /* Top-K mode: unflag everything after the Kth reported target, and recount */
+  if (pli->topk > 0 && th->nreported > pli->topk)
+  {
+    th->nincluded = 0;
+    for (nrep = 0, h = 0; h < th->N; h++)
+    {
+      hit = th->hit[h];
+      if ((hit->flags & p7_IS_REPORTED) && nrep++ >= pli->topk)
+      {
+        hit->flags &= ~(p7_IS_REPORTED | p7_IS_INCLUDED);
+        for (d = 0; d < hit->ndom; d++)
+          hit->dcl[d].is_reported = hit->dcl[d].is_included = FALSE;
+      }
+      if (hit->flags & p7_IS_INCLUDED) th->nincluded++;
+    }
+    th->nreported = pli->topk;
+  }
+
 
-  /* Second pass is over domains, flagging reportable/includable ones. 
+  /* Second pass is over domains, flagging reportable/includable ones,
+   * and counting them. 
    * Depends on knowing the domZ we just set.
    * Note how this enforces a hierarchical logic of 
    * (sequence|domain) must be reported to be included, and
    * domain can only be (reported|included) if whole sequence is too.
    */
-  if (! pli->use_bit_cutoffs && !pli->long_targets)
+  for (h = 0; h < th->N; h++)
   {
-    for (h = 0; h < th->N; h++)
+    hit = th->hit[h];
+    if (! pli->use_bit_cutoffs && !pli->long_targets && (hit->flags & p7_IS_REPORTED))
     {
-      if (th->hit[h]->flags & p7_IS_REPORTED)
+      for (d = 0; d < hit->ndom; d++)
       {
-        for (d = 0; d < th->hit[h]->ndom; d++)
-        {
-          if (p7_pli_DomainReportable(pli, th->hit[h]->dcl[d].bitscore, th->hit[h]->dcl[d].lnP))
-            th->hit[h]->dcl[d].is_reported = TRUE;
-          if ((th->hit[h]->flags & p7_IS_INCLUDED) &&
-              p7_pli_DomainIncludable(pli, th->hit[h]->dcl[d].bitscore, th->hit[h]->dcl[d].lnP))
-            th->hit[h]->dcl[d].is_included = TRUE;
-        }
+        if (p7_pli_DomainReportable(pli, hit->dcl[d].bitscore, hit->dcl[d].lnP))
+          hit->dcl[d].is_reported = TRUE;
+        if ((hit->flags & p7_IS_INCLUDED) &&
+            p7_pli_DomainIncludable(pli, hit->dcl[d].bitscore, hit->dcl[d].lnP))
+          hit->dcl[d].is_included = TRUE;
       }
     }
-  }
 
-  /* Count the reported, included domains */
-  for (h = 0; h < th->N; h++) {
-    th->hit[h]->nreported = 0;
-    th->hit[h]->nincluded = 0;
-    for (d = 0; d < th->hit[h]->ndom; d++)
+    hit->nreported = 0;
+    hit->nincluded = 0;
+    for (d = 0; d < hit->ndom; d++)
     {
-        if (th->hit[h]->dcl[d].is_reported) th->hit[h]->nreported++;
-        if (th->hit[h]->dcl[d].is_included) th->hit[h]->nincluded++;
+        if (hit->dcl[d].is_reported) hit->nreported++;
+        if (hit->dcl[d].is_included) hit->nincluded++;
     }
   }
 
@@ -1007,6 +2257,77 @@ p7_tophits_Threshold(P7_TOPHITS *th, P7_PIPELINE *pli)
 
 
 
+/* Function:  p7_tophits_ThresholdHit()
+ * Synopsis:  Apply score and E-value thresholds to one hit, as it's found.
+ *
+ * Purpose:   Do for the single hit <hit> what <p7_tophits_Threshold()>
+ *            does for a whole list: flag the target and its domains
+ *            as reported and/or included, and count its reported and
+ *            included domains. This lets a caller output a hit as
+ *            soon as the pipeline finds it (see <P7_TABSTREAM>),
+ *            rather than after the whole search.
+ *
+ *            That's only possible when the search space sizes <Z> and
+ *            <domZ> are fixed in advance (<-Z>, <--domZ>), so
+ *            E-values don't depend on the rest of the search; and
+ *            not for long-target (nhmmer) hits, where duplicates
+ *            from overlapping windows are only removed at the end.
+ *            A later <p7_tophits_Threshold()> on the final list
+ *            comes to the same conclusions for <hit>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <pli> doesn't have fixed <Z> and <domZ>, or
+ *            is a long-target pipeline.
+ */
+int
+p7_tophits_ThresholdHit(P7_HIT *hit, P7_PIPELINE *pli)
+{
+  int d;
+
+  if (pli->Z_setby != p7_ZSETBY_OPTION || pli->domZ_setby != p7_ZSETBY_OPTION)
+    ESL_EXCEPTION(eslEINVAL, "thresholding a single hit requires fixed Z and domZ");
+  if (pli->long_targets)
+    ESL_EXCEPTION(eslEINVAL, "can't threshold a single long-target hit before duplicate removal");
+
+  /* with model-specific thresholds, the pipeline already set the flags */
+  if (! pli->use_bit_cutoffs)
+  {
+      if ( !(hit->flags & p7_IS_DUPLICATE) &&
+          p7_pli_TargetReportable(pli, hit->score, hit->lnP))
+      {
+          hit->flags |= p7_IS_REPORTED;
+          if (p7_pli_TargetIncludable(pli, hit->score, hit->lnP))
+              hit->flags |= p7_IS_INCLUDED;
+      }
+
+      if (hit->flags & p7_IS_REPORTED)
+      {
+          for (d = 0; d < hit->ndom; d++)
+          {
+              if (p7_pli_DomainReportable(pli, hit->dcl[d].bitscore, hit->dcl[d].lnP))
+                hit->dcl[d].is_reported = TRUE;
+              if ((hit->flags & p7_IS_INCLUDED) &&
+                  p7_pli_DomainIncludable(pli, hit->dcl[d].bitscore, hit->dcl[d].lnP))
+                hit->dcl[d].is_included = TRUE;
+          }
+      }
+  }
+
+  hit->nreported = 0;
+  hit->nincluded = 0;
+  for (d = 0; d < hit->ndom; d++)
+  {
+      if (hit->dcl[d].is_reported) hit->nreported++;
+      if (hit->dcl[d].is_included) hit->nincluded++;
+  }
+
+  workaround_bug_h74_hit(hit);
+  return eslOK;
+}
+
+
+
 /* Function:  p7_tophits_CompareRanking()
  * Synopsis:  Compare current top hits to previous top hits ranking.
  *
@@ -1101,6 +2422,95 @@ p7_tophits_CompareRanking(P7_TOPHITS *th, ESL_KEYHASH *kh, int *opt_nnew)
 }
 
 
+/* targets_row()
+ * One reported target's line of p7_tophits_Targets(), with the
+ * inclusion threshold line before the first that's not included.
+ */
+static int
+targets_row(FILE *ofp, P7_HIT *hit, P7_PIPELINE *pli, int textw, int namew, int posw, int descw, int *have_printed_incthresh)
+{
+  char   newness;
+  int    d;
+  char  *showname;
+
+  d    = hit->best_domain;
+
+  if (! (hit->flags & p7_IS_INCLUDED) && ! *have_printed_incthresh) 
+    {
+      if (fprintf(ofp, "  ------ inclusion threshold ------\n") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+      *have_printed_incthresh = TRUE;
+    }
+
+  if (pli->show_accessions)
+    {   /* the --acc option: report accessions rather than names if possible */
+      if (hit->acc != NULL && hit->acc[0] != '\0') showname = hit->acc;
+      else                                         showname = hit->name;
+    }
+  else
+    showname = hit->name;
+
+  if      (hit->flags & p7_IS_NEW)     newness = '+';
+  else if (hit->flags & p7_IS_DROPPED) newness = '-';
+  else                                 newness = ' ';
+
+  if (pli->long_targets) 
+    {
+      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %-*s %*" PRId64 " %*" PRId64 "",
+		  newness,
+		  exp(hit->lnP), // * pli->Z,
+		  hit->score,
+		  eslCONST_LOG2R * hit->dcl[d].dombias, // an nhmmer hit is really a domain, so this is the hit's bias correction
+		  namew, showname,
+		  posw, hit->dcl[d].iali,
+		  posw, hit->dcl[d].jali) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  else if (hit->ndom == 0)   /* scored without domains (p7_pipeline_SetSeqScoreOnly()) */
+    {
+      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %9s %6s %5s  %5s %2s  %-*s ",
+		  newness,
+		  exp(hit->lnP) * pli->Z,
+		  hit->score,
+		  hit->pre_score - hit->score, /* bias correction */
+		  "-", "-", "-", "-", "-",
+		  namew, showname) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  else
+    {
+      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %9.2g %6.1f %5.1f  %5.1f %2d  %-*s ",
+		  newness,
+		  exp(hit->lnP) * pli->Z,
+		  hit->score,
+		  hit->pre_score - hit->score, /* bias correction */
+		  exp(hit->dcl[d].lnP) * pli->Z,
+		  hit->dcl[d].bitscore,
+		  eslCONST_LOG2R * hit->dcl[d].dombias, /* convert NATS to BITS at last moment */
+		  hit->nexpected,
+		  hit->nreported,
+		  namew, showname) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+
+  if (textw > 0) 
+    {
+      if (fprintf(ofp, " %-.*s\n", descw, hit->desc == NULL ? "" : hit->desc) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  else 
+    {
+      if (fprintf(ofp, " %s\n",           hit->desc == NULL ? "" : hit->desc) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
+    }
+  /* do NOT use *s with unlimited (INT_MAX) line length. Some systems
+   * have an fprintf() bug here (we found one on an Opteron/SUSE Linux
+   * system (#h66)
+   */
+  return eslOK;
+}
+
+
 /* Function:  p7_tophits_Targets()
  * Synopsis:  Format and write a top target hits list to an output stream.
  *
@@ -1119,13 +2529,13 @@ p7_tophits_CompareRanking(P7_TOPHITS *th, ESL_KEYHASH *kh, int *opt_nnew)
 int
 p7_tophits_Targets(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
 {
-  char   newness;
+  SPILL_MERGE *m = NULL;
+  P7_HIT *hit;
   int    h;
-  int    d;
   int    namew;
-  int    posw;
+  int    posw = 0;
   int    descw;
-  char  *showname;
+  int    status;
 
   int    have_printed_incthresh = FALSE;
 
@@ -1170,74 +2580,20 @@ p7_tophits_Targets(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
         ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
   }
 
-  for (h = 0; h < th->N; h++)
+  if (th->spill && th->spill->nruns > 0)
     {
-      if (th->hit[h]->flags & p7_IS_REPORTED)
-	{
-	  d    = th->hit[h]->best_domain;
-
-	  if (! (th->hit[h]->flags & p7_IS_INCLUDED) && ! have_printed_incthresh) 
-	    {
-	      if (fprintf(ofp, "  ------ inclusion threshold ------\n") < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	      have_printed_incthresh = TRUE;
-	    }
-
-	  if (pli->show_accessions)
-	    {   /* the --acc option: report accessions rather than names if possible */
-	      if (th->hit[h]->acc != NULL && th->hit[h]->acc[0] != '\0') showname = th->hit[h]->acc;
-	      else                                                       showname = th->hit[h]->name;
-	    }
-	  else
-	    showname = th->hit[h]->name;
-
-	  if      (th->hit[h]->flags & p7_IS_NEW)     newness = '+';
-	  else if (th->hit[h]->flags & p7_IS_DROPPED) newness = '-';
-	  else                                        newness = ' ';
-
-	  if (pli->long_targets) 
-	    {
-	      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %-*s %*" PRId64 " %*" PRId64 "",
-			  newness,
-			  exp(th->hit[h]->lnP), // * pli->Z,
-			  th->hit[h]->score,
-			  eslCONST_LOG2R * th->hit[h]->dcl[d].dombias, // an nhmmer hit is really a domain, so this is the hit's bias correction
-			  namew, showname,
-			  posw, th->hit[h]->dcl[d].iali,
-			  posw, th->hit[h]->dcl[d].jali) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	    }
-	  else
-	    {
-	      if (fprintf(ofp, "%c %9.2g %6.1f %5.1f  %9.2g %6.1f %5.1f  %5.1f %2d  %-*s ",
-			  newness,
-			  exp(th->hit[h]->lnP) * pli->Z,
-			  th->hit[h]->score,
-			  th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-			  exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-			  th->hit[h]->dcl[d].bitscore,
-			  eslCONST_LOG2R * th->hit[h]->dcl[d].dombias, /* convert NATS to BITS at last moment */
-			  th->hit[h]->nexpected,
-			  th->hit[h]->nreported,
-			  namew, showname) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	    }
-
-	  if (textw > 0) 
-	    {
-	      if (fprintf(ofp, " %-.*s\n", descw, th->hit[h]->desc == NULL ? "" : th->hit[h]->desc) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	    }
-	  else 
-	    {
-	      if (fprintf(ofp, " %s\n",           th->hit[h]->desc == NULL ? "" : th->hit[h]->desc) < 0)
-		ESL_EXCEPTION_SYS(eslEWRITE, "per-sequence hit list: write failed");
-	    }
-	  /* do NOT use *s with unlimited (INT_MAX) line length. Some systems
-	   * have an fprintf() bug here (we found one on an Opteron/SUSE Linux
-	   * system (#h66)
-	   */
-	}
+      if ((status = spill_merge_open(th->spill, &m)) != eslOK) return status;
+      while ((status = spill_merge_next(m, &hit)) == eslOK)
+	if (hit->flags & p7_IS_REPORTED)
+	  if ((status = targets_row(ofp, hit, pli, textw, namew, posw, descw, &have_printed_incthresh)) != eslOK) break;
+      spill_merge_close(m);
+      if (status != eslEOF) return status;
+    }
+  else
+    {
+      for (h = 0; h < th->N; h++)
+	if (th->hit[h]->flags & p7_IS_REPORTED)
+	  if ((status = targets_row(ofp, th->hit[h], pli, textw, namew, posw, descw, &have_printed_incthresh)) != eslOK) return status;
     }
 
   if (th->nreported == 0)
@@ -1266,10 +2622,35 @@ p7_tophits_Targets(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
 int
 p7_tophits_Domains(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
 {
-  int   h, d;
-  int   nd;
-  int   namew, descw;
-  char *showname;
+  return p7_tophits_DomainsThreaded(ofp, th, pli, textw, 0);
+}
+
+/* Function:  p7_tophits_DomainsThreaded()
+ * Synopsis:  <p7_tophits_Domains()>, formatted on threads.
+ *
+ * Purpose:   As <p7_tophits_Domains()>, with the per-target blocks
+ *            (domain tables and alignments) formatted by up to <ncpu>
+ *            threads, into temporary files that are copied to <ofp>
+ *            in rank order. The output is identical to the serial
+ *            version's. With <ncpu> 0 or 1, too few reported targets
+ *            to share out, or no temporary files, it's done serially;
+ *            as it is for a list spilled to disk, which is read back
+ *            one hit at a time.
+ *
+ *            Printing the alignments for tens of thousands of hits
+ *            otherwise leaves the search threads idle for minutes.
+ *
+ * Returns:   <eslOK> on success.
+ * 
+ * Throws:    <eslEWRITE> if a write to <ofp> fails; <eslEMEM> on
+ *            allocation failure.
+ */
+int
+p7_tophits_DomainsThreaded(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw, int ncpu)
+{
+  SPILL_MERGE *m = NULL;
+  P7_HIT      *hit;
+  int   h;
   int   status;
 
   if (pli->long_targets) 
@@ -1286,192 +2667,384 @@ p7_tophits_Domains(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw)
         ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
     }
 
-  for (h = 0; h < th->N; h++)
-    if (th->hit[h]->flags & p7_IS_REPORTED)
-      {
-	if (pli->show_accessions && th->hit[h]->acc != NULL && th->hit[h]->acc[0] != '\0')
-	  {
-	    showname = th->hit[h]->acc;
-	    namew    = strlen(th->hit[h]->acc);
-	  }
-	else
-	  {
-	    showname = th->hit[h]->name;
-	    namew = strlen(th->hit[h]->name);
-	  }
+  if (pli->do_seqonly)
+    {
+      if (fprintf(ofp, "\n   [Not done: targets were scored without domain definition]\n") < 0)
+        ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      return eslOK;
+    }
+
+  if (th->spill && th->spill->nruns > 0)
+    {
+      if ((status = spill_merge_open(th->spill, &m)) != eslOK) return status;
+      while ((status = spill_merge_next(m, &hit)) == eslOK)
+	if (hit->flags & p7_IS_REPORTED)
+	  if ((status = domains_hit(ofp, hit, pli, textw)) != eslOK) break;
+      spill_merge_close(m);
+      if (status != eslEOF) return status;
+      status = eslOK;
+    }
+  else
+    status = (ncpu > 1 ? domains_threaded(ofp, th, pli, textw, ncpu) : eslEUNIMPLEMENTED);
+
+  if (status == eslEUNIMPLEMENTED)
+    {
+      for (h = 0; h < th->N; h++)
+	if (th->hit[h]->flags & p7_IS_REPORTED)
+	  if ((status = domains_hit(ofp, th->hit[h], pli, textw)) != eslOK) return status;
+    }
+  else if (status != eslOK) return status;
+
+  if (th->nreported == 0)
+    {
+      if (fprintf(ofp, "\n   [No targets detected that satisfy reporting thresholds]\n") < 0) 
+        ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+  return eslOK;
+}
+
+
+/* domains_hit()
+ * The per-target block of <p7_tophits_Domains()>: the domain table
+ * for reported target <hit>, and its alignments if <pli> shows them.
+ */
+static int
+domains_hit(FILE *ofp, P7_HIT *hit, P7_PIPELINE *pli, int textw)
+{
+  int   d;
+  int   nd;
+  int   namew, descw;
+  char *showname;
+  int   status;
+
+  if (pli->show_accessions && hit->acc != NULL && hit->acc[0] != '\0')
+    {
+      showname = hit->acc;
+      namew    = strlen(hit->acc);
+    }
+  else
+    {
+      showname = hit->name;
+      namew = strlen(hit->name);
+    }
+
+  if (textw > 0)
+    {
+      descw = ESL_MAX(32, textw - namew - 5);
+      if (fprintf(ofp, ">> %s  %-.*s\n", showname, descw, (hit->desc == NULL ? "" : hit->desc)) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+  else
+    {
+      if (fprintf(ofp, ">> %s  %s\n",    showname,        (hit->desc == NULL ? "" : hit->desc)) < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+
+  if (hit->nreported == 0)
+    {
+      if (fprintf(ofp,"   [No individual domains that satisfy reporting thresholds (although complete target did)]\n\n") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      return eslOK;
+    }
+
+
+  if (pli->long_targets)
+    {
+      /* The dna hit table is 119 char wide:
+	     score  bias    Evalue hmmfrom  hmm to     alifrom    ali to      envfrom    env to       hqfrom     hq to   sq len      acc
+	     ------ ----- --------- ------- -------    --------- ---------    --------- ---------    --------- --------- ---------    ----
+	 !     82.7 104.4   4.9e-22     782     998 .. 241981174 241980968 .. 241981174 241980966 .. 241981174 241980968 234234233   0.78
+       */
+      if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "score",  "bias",  "  Evalue", "hmmfrom",  "hmm to", "  ", " alifrom ",  " ali to ", "  ",  " envfrom ",  " env to ",  (pli->mode == p7_SEARCH_SEQS ? "  sq len " : " mod len "), "  ",  "acc")  < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "------", "-----", "---------", "-------", "-------", "  ", "---------", "---------", "  ", "---------", "---------",  "---------", "  ", "----") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+  else
+    {
+      /* The domain table is 101 char wide:
+	  #     score  bias  c-Evalue  i-Evalue hmmfrom   hmmto    alifrom  ali to    envfrom  env to     acc
+	 ---   ------ ----- --------- --------- ------- -------    ------- -------    ------- -------    ----
+	   1 ?  123.4  23.1   9.7e-11    6.8e-9       3    1230 ..       1     492 []       2     490 .] 0.90
+	 123 ! 1234.5 123.4 123456789 123456789 1234567 1234567 .. 1234567 1234567 [] 1234567 1234568 .] 0.12
+      */
+      if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",    "#",  "score",  "bias",  "c-Evalue",  "i-Evalue", "hmmfrom",  "hmm to", "  ", "alifrom",  "ali to", "  ", "envfrom",  "env to", "  ",  "acc")  < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",  "---", "------", "-----", "---------", "---------", "-------", "-------", "  ", "-------", "-------", "  ", "-------", "-------", "  ", "----")  < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
 
-	if (textw > 0)
-	  {
-	    descw = ESL_MAX(32, textw - namew - 5);
-	    if (fprintf(ofp, ">> %s  %-.*s\n", showname, descw, (th->hit[h]->desc == NULL ? "" : th->hit[h]->desc)) < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-	else
-	  {
-	    if (fprintf(ofp, ">> %s  %s\n",    showname,        (th->hit[h]->desc == NULL ? "" : th->hit[h]->desc)) < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
 
-	if (th->hit[h]->nreported == 0)
-	  {
-	    if (fprintf(ofp,"   [No individual domains that satisfy reporting thresholds (although complete target did)]\n\n") < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	    continue;
-	  }
+  /* Domain hit table for each reported domain in this reported sequence. */
+  nd = 0;
+  for (d = 0; d < hit->ndom; d++)
+    {
+      if (hit->dcl[d].is_reported)
+	{
+	  nd++;
+	  if (pli->long_targets)
+	    {
+	      if (fprintf(ofp, " %c %6.1f %5.1f %9.2g %9d %9d %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 "    %4.2f\n",
+			  //nd,
+			  hit->dcl[d].is_included ? '!' : '?',
+			  hit->dcl[d].bitscore,
+			  hit->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+			  exp(hit->dcl[d].lnP),
+			  hit->dcl[d].ad->hmmfrom,
+			  hit->dcl[d].ad->hmmto,
+			  (hit->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
+			  (hit->dcl[d].ad->hmmto   == hit->dcl[d].ad->M) ? ']' : '.',
+			  hit->dcl[d].ad->sqfrom,
+			  hit->dcl[d].ad->sqto,
+			  (hit->dcl[d].ad->sqfrom == 1) ? '[' : '.',
+			  (hit->dcl[d].ad->sqto   == hit->dcl[d].ad->L) ? ']' : '.',
+			  hit->dcl[d].ienv,
+			  hit->dcl[d].jenv,
+			  (hit->dcl[d].ienv == 1) ? '[' : '.',
+			  (hit->dcl[d].jenv == hit->dcl[d].ad->L) ? ']' : '.',
+			  hit->dcl[d].ad->L,
+			  (hit->dcl[d].oasc / (1.0 + fabs((float) (hit->dcl[d].jenv - hit->dcl[d].ienv))))) < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	    }
+	  else
+	    {
+	      if (fprintf(ofp, " %3d %c %6.1f %5.1f %9.2g %9.2g %7d %7d %c%c",
+			  nd,
+			  hit->dcl[d].is_included ? '!' : '?',
+			  hit->dcl[d].bitscore,
+			  hit->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+			  exp(hit->dcl[d].lnP) * pli->domZ,
+			  exp(hit->dcl[d].lnP) * pli->Z,
+			  hit->dcl[d].ad->hmmfrom,
+			  hit->dcl[d].ad->hmmto,
+			  (hit->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
+			  (hit->dcl[d].ad->hmmto   == hit->dcl[d].ad->M ) ? ']' : '.') < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+
+	      if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
+			  hit->dcl[d].ad->sqfrom,
+			  hit->dcl[d].ad->sqto,
+			  (hit->dcl[d].ad->sqfrom == 1) ? '[' : '.',
+			  (hit->dcl[d].ad->sqto   == hit->dcl[d].ad->L) ? ']' : '.') < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+
+	      if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
+			  hit->dcl[d].ienv,
+			  hit->dcl[d].jenv,
+			  (hit->dcl[d].ienv == 1) ? '[' : '.',
+			  (hit->dcl[d].jenv == hit->dcl[d].ad->L) ? ']' : '.') < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");                                               
+
+	      if (fprintf(ofp, " %4.2f\n",
+			  (hit->dcl[d].oasc / (1.0 + fabs((float) (hit->dcl[d].jenv - hit->dcl[d].ienv))))) < 0)
+		ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	    }
 
+	}
+    } // end of domain table in this reported sequence.
 
-	if (pli->long_targets)
-	  {
-	    /* The dna hit table is 119 char wide:
-                   score  bias    Evalue hmmfrom  hmm to     alifrom    ali to      envfrom    env to       hqfrom     hq to   sq len      acc
-                   ------ ----- --------- ------- -------    --------- ---------    --------- ---------    --------- --------- ---------    ----
-               !     82.7 104.4   4.9e-22     782     998 .. 241981174 241980968 .. 241981174 241980966 .. 241981174 241980968 234234233   0.78
-             */
-	    if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "score",  "bias",  "  Evalue", "hmmfrom",  "hmm to", "  ", " alifrom ",  " ali to ", "  ",  " envfrom ",  " env to ",  (pli->mode == p7_SEARCH_SEQS ? "  sq len " : " mod len "), "  ",  "acc")  < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	    if (fprintf(ofp, "   %6s %5s %9s %9s %9s %2s %9s %9s %2s %9s %9s    %9s %2s %4s\n",  "------", "-----", "---------", "-------", "-------", "  ", "---------", "---------", "  ", "---------", "---------",  "---------", "  ", "----") < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-	else
-	  {
-	    /* The domain table is 101 char wide:
-                #     score  bias  c-Evalue  i-Evalue hmmfrom   hmmto    alifrom  ali to    envfrom  env to     acc
-               ---   ------ ----- --------- --------- ------- -------    ------- -------    ------- -------    ----
-                 1 ?  123.4  23.1   9.7e-11    6.8e-9       3    1230 ..       1     492 []       2     490 .] 0.90
-               123 ! 1234.5 123.4 123456789 123456789 1234567 1234567 .. 1234567 1234567 [] 1234567 1234568 .] 0.12
-	    */
-	    if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",    "#",  "score",  "bias",  "c-Evalue",  "i-Evalue", "hmmfrom",  "hmm to", "  ", "alifrom",  "ali to", "  ", "envfrom",  "env to", "  ",  "acc")  < 0)
-              ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	    if (fprintf(ofp, " %3s   %6s %5s %9s %9s %7s %7s %2s %7s %7s %2s %7s %7s %2s %4s\n",  "---", "------", "-----", "---------", "---------", "-------", "-------", "  ", "-------", "-------", "  ", "-------", "-------", "  ", "----")  < 0)
-	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-	  }
-		
-	  
-	/* Domain hit table for each reported domain in this reported sequence. */
-	nd = 0;
-	for (d = 0; d < th->hit[h]->ndom; d++)
+  /* Alignment data for each reported domain in this reported sequence. */
+  if (pli->show_alignments)
+    {
+      if (pli->long_targets)
+	{
+	  if (fprintf(ofp, "\n  Alignment:\n") < 0)
+	    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	}
+      else
+	{
+	  if (fprintf(ofp, "\n  Alignments for each domain:\n") < 0)
+	    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	  nd = 0;
+	}
+
+      for (d = 0; d < hit->ndom; d++)
+	if (hit->dcl[d].is_reported)
 	  {
-	    if (th->hit[h]->dcl[d].is_reported)
+	    nd++;
+	    if (!pli->long_targets)
 	      {
-		nd++;
-		if (pli->long_targets)
-		  {
-		    if (fprintf(ofp, " %c %6.1f %5.1f %9.2g %9d %9d %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 " %9" PRId64 " %c%c %9" PRId64 "    %4.2f\n",
-				//nd,
-				th->hit[h]->dcl[d].is_included ? '!' : '?',
-				th->hit[h]->dcl[d].bitscore,
-				th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-				exp(th->hit[h]->dcl[d].lnP),
-				th->hit[h]->dcl[d].ad->hmmfrom,
-				th->hit[h]->dcl[d].ad->hmmto,
-				(th->hit[h]->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->hmmto   == th->hit[h]->dcl[d].ad->M) ? ']' : '.',
-				th->hit[h]->dcl[d].ad->sqfrom,
-				th->hit[h]->dcl[d].ad->sqto,
-				(th->hit[h]->dcl[d].ad->sqfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->sqto   == th->hit[h]->dcl[d].ad->L) ? ']' : '.',
-				th->hit[h]->dcl[d].ienv,
-				th->hit[h]->dcl[d].jenv,
-				(th->hit[h]->dcl[d].ienv == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].jenv == th->hit[h]->dcl[d].ad->L) ? ']' : '.',
-				th->hit[h]->dcl[d].ad->L,
-				(th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv))))) < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		  }
-		else
-		  {
-		    if (fprintf(ofp, " %3d %c %6.1f %5.1f %9.2g %9.2g %7d %7d %c%c",
-				nd,
-				th->hit[h]->dcl[d].is_included ? '!' : '?',
-				th->hit[h]->dcl[d].bitscore,
-				th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-				exp(th->hit[h]->dcl[d].lnP) * pli->domZ,
-				exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-				th->hit[h]->dcl[d].ad->hmmfrom,
-				th->hit[h]->dcl[d].ad->hmmto,
-				(th->hit[h]->dcl[d].ad->hmmfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->hmmto   == th->hit[h]->dcl[d].ad->M ) ? ']' : '.') < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-			
-		    if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
-				th->hit[h]->dcl[d].ad->sqfrom,
-				th->hit[h]->dcl[d].ad->sqto,
-				(th->hit[h]->dcl[d].ad->sqfrom == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].ad->sqto   == th->hit[h]->dcl[d].ad->L) ? ']' : '.') < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-						
-		    if (fprintf(ofp, " %7" PRId64 " %7" PRId64 " %c%c",
-				th->hit[h]->dcl[d].ienv,
-				th->hit[h]->dcl[d].jenv,
-				(th->hit[h]->dcl[d].ienv == 1) ? '[' : '.',
-				(th->hit[h]->dcl[d].jenv == th->hit[h]->dcl[d].ad->L) ? ']' : '.') < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");						   
-		    
-		    if (fprintf(ofp, " %4.2f\n",
-				(th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv))))) < 0)
-		      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		  }
-            
+		if (fprintf(ofp, "  == domain %d", nd ) < 0)
+		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
 	      }
-	  } // end of domain table in this reported sequence.
-
-	/* Alignment data for each reported domain in this reported sequence. */
-	if (pli->show_alignments)
-	  {
-	    if (pli->long_targets)
+	    if (fprintf(ofp, "  score: %.1f bits", hit->dcl[d].bitscore) < 0)
+	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	    if (!pli->long_targets)
 	      {
-		if (fprintf(ofp, "\n  Alignment:\n") < 0)
+		if (fprintf(ofp, ";  conditional E-value: %.2g\n",  exp(hit->dcl[d].lnP) * pli->domZ) < 0)
 		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
 	      }
 	    else
 	      {
-		if (fprintf(ofp, "\n  Alignments for each domain:\n") < 0)
+		if (fprintf(ofp, "\n") < 0)
 		  ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		nd = 0;
 	      }
 
-	    for (d = 0; d < th->hit[h]->ndom; d++)
-	      if (th->hit[h]->dcl[d].is_reported)
-		{
-		  nd++;
-		  if (!pli->long_targets)
-		    {
-		      if (fprintf(ofp, "  == domain %d", nd ) < 0)
-			ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		    }
-		  if (fprintf(ofp, "  score: %.1f bits", th->hit[h]->dcl[d].bitscore) < 0)
-		    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		  if (!pli->long_targets)
-		    {
-		      if (fprintf(ofp, ";  conditional E-value: %.2g\n",  exp(th->hit[h]->dcl[d].lnP) * pli->domZ) < 0)
-			ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		    }
-		  else
-		    {
-		      if (fprintf(ofp, "\n") < 0)
-			ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		    }
-
-		  if ((status = p7_alidisplay_Print(ofp, th->hit[h]->dcl[d].ad, 40, textw, pli)) != eslOK) return status;
-		  
-		  if (fprintf(ofp, "\n") < 0)
-		    ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
-		}
-	  }
-	else // alignment reporting is off:
-	  { 
+	    if ((status = p7_alidisplay_Print(ofp, hit->dcl[d].ad, 40, textw, pli)) != eslOK) return status;
+
 	    if (fprintf(ofp, "\n") < 0)
 	      ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
 	  }
+    }
+  else // alignment reporting is off:
+    { 
+      if (fprintf(ofp, "\n") < 0)
+	ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+    }
+  return eslOK;
+}
 
-      } // end, loop over all reported hits
+/* domains_worker()
+ * One thread's share of a round in <domains_threaded()>: format
+ * reported targets <hidx[start..end-1]> into its own temporary file,
+ * noting how many bytes it wrote.
+ */
+static void *
+domains_worker(void *arg)
+{
+  DOM_WORKER *wk = (DOM_WORKER *) arg;
+  int         i;
 
-  if (th->nreported == 0)
+  rewind(wk->fp);
+  for (i = wk->start; i < wk->end; i++)
+    if ((wk->status = domains_hit(wk->fp, wk->th->hit[wk->hidx[i]], wk->pli, wk->textw)) != eslOK) return NULL;
+  if (fflush(wk->fp) != 0 || (wk->len = ftell(wk->fp)) < 0) wk->status = eslEWRITE;
+  return NULL;
+}
+
+/* domains_threaded()
+ * <p7_tophits_Domains()> on <ncpu> threads. Reported targets are taken
+ * in rounds of <p7_TOPHITS_DOMCHUNK> per thread; each thread formats
+ * its chunk into a temporary file of its own, and the caller copies
+ * the chunks to <ofp> in rank order, so the output is the same as the
+ * serial version's. The caller formats the first chunk of each round
+ * itself.
+ *
+ * Returns <eslEUNIMPLEMENTED> without writing anything when threading
+ * wouldn't help (or isn't compiled in, or temporary files can't be
+ * opened), and the caller should do it serially; <eslOK> on success.
+ * Throws <eslEMEM> on allocation failure, <eslEWRITE> on write failure.
+ */
+static int
+domains_threaded(FILE *ofp, P7_TOPHITS *th, P7_PIPELINE *pli, int textw, int ncpu)
+{
+#ifdef HMMER_THREADS
+  DOM_WORKER *wk     = NULL;
+  int        *hidx   = NULL;
+  int        *active = NULL;	/* TRUE for workers running in their own thread this round */
+  char        buf[BUFSIZ];
+  int         nrep   = 0;
+  int         nw;
+  int         h, w, r;
+  long        left;
+  size_t      n;
+  int         status;
+
+  for (h = 0; h < th->N; h++)
+    if (th->hit[h]->flags & p7_IS_REPORTED) nrep++;
+  nw = ESL_MIN(ncpu, nrep / p7_TOPHITS_DOMCHUNK);
+  if (nw < 2) return eslEUNIMPLEMENTED;
+
+  ESL_ALLOC(hidx,   sizeof(int)        * nrep);
+  ESL_ALLOC(active, sizeof(int)        * nw);
+  ESL_ALLOC(wk,     sizeof(DOM_WORKER) * nw);
+  for (nrep = 0, h = 0; h < th->N; h++)
+    if (th->hit[h]->flags & p7_IS_REPORTED) hidx[nrep++] = h;
+  for (w = 0; w < nw; w++) wk[w].fp = NULL;
+  for (w = 0; w < nw; w++)
     {
-      if (fprintf(ofp, "\n   [No targets detected that satisfy reporting thresholds]\n") < 0) 
-        ESL_EXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+      wk[w].th     = th;
+      wk[w].pli    = pli;
+      wk[w].textw  = textw;
+      wk[w].hidx   = hidx;
+      if ((wk[w].fp = tmpfile()) == NULL) { status = eslEUNIMPLEMENTED; goto ERROR; }
+    }
+
+  for (r = 0; r < nrep; r += nw * p7_TOPHITS_DOMCHUNK)
+    {
+      for (w = 0; w < nw; w++)
+	{
+	  wk[w].start  = ESL_MIN(r + w * p7_TOPHITS_DOMCHUNK, nrep);
+	  wk[w].end    = ESL_MIN(wk[w].start + p7_TOPHITS_DOMCHUNK, nrep);
+	  wk[w].len    = 0;
+	  wk[w].status = eslOK;
+	  active[w]    = FALSE;
+	}
+
+      /* a thread that can't be started has its chunk done here instead */
+      for (w = 1; w < nw; w++)
+	if (wk[w].start < wk[w].end && pthread_create(&(wk[w].thread), NULL, domains_worker, &(wk[w])) == 0) active[w] = TRUE;
+      for (w = 0; w < nw; w++)
+	if (! active[w] && wk[w].start < wk[w].end) domains_worker(&(wk[w]));
+      for (w = 1; w < nw; w++)
+	if (active[w]) pthread_join(wk[w].thread, NULL);
+
+      for (w = 0; w < nw; w++)
+	{
+	  if (wk[w].status != eslOK) { status = wk[w].status; goto ERROR; }
+	  rewind(wk[w].fp);
+	  for (left = wk[w].len; left > 0; left -= n)
+	    {
+	      n = fread(buf, 1, ESL_MIN((long) sizeof(buf), left), wk[w].fp);
+	      if (n == 0)                         ESL_XEXCEPTION(eslEWRITE, "domain hit list: temporary file read failed");
+	      if (fwrite(buf, 1, n, ofp) != n)    ESL_XEXCEPTION_SYS(eslEWRITE, "domain hit list: write failed");
+	    }
+	}
     }
+
+  for (w = 0; w < nw; w++) fclose(wk[w].fp);
+  free(wk);
+  free(active);
+  free(hidx);
+  return eslOK;
+
+ ERROR:
+  if (wk) { for (w = 0; w < nw; w++) if (wk[w].fp) fclose(wk[w].fp); free(wk); }
+  if (active) free(active);
+  if (hidx)   free(hidx);
+  return status;
+#else
+  return eslEUNIMPLEMENTED;
+#endif /*HMMER_THREADS*/
+}
+
+
+/* spill_included()
+ * Read the included targets of spilled hit list <sp> back into a new
+ * hit list <*ret_inc>, in order, for p7_tophits_AlignmentThreaded().
+ */
+static int
+spill_included(P7_HITSPILL *sp, P7_TOPHITS **ret_inc)
+{
+  P7_TOPHITS  *inc = NULL;
+  SPILL_MERGE *m   = NULL;
+  P7_HIT      *hit;
+  P7_HIT      *slot;
+  int          status;
+
+  if ((inc = p7_tophits_Create()) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((status = spill_merge_open(sp, &m)) != eslOK) goto ERROR;
+  while ((status = spill_merge_next(m, &hit)) == eslOK)
+    if (hit->flags & p7_IS_INCLUDED)
+      {
+	if ((status = p7_tophits_CreateNextHit(inc, &slot)) != eslOK) goto ERROR;
+	*slot = *hit;		/* <inc> takes over the hit's strings and domains */
+	hit->name = hit->acc = hit->desc = NULL;
+	hit->dcl  = NULL;
+	hit->ndom = 0;
+      }
+  if (status != eslEOF) goto ERROR;
+  spill_merge_close(m);
+  sort_by_sortkey(inc);
+
+  *ret_inc = inc;
   return eslOK;
+
+ ERROR:
+  spill_merge_close(m);
+  p7_tophits_Destroy(inc);
+  *ret_inc = NULL;
+  return status;
 }
 
 
@@ -1510,13 +3083,64 @@ p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
                      ESL_SQ **inc_sqarr, P7_TRACE **inc_trarr, int inc_n,
                      int optflags, ESL_MSA **ret_msa)
 {
-  ESL_SQ   **sqarr = NULL;
-  P7_TRACE **trarr = NULL;
-  ESL_MSA   *msa   = NULL;
-  int        ndom  = 0;
-  int        M     = 0;
-  int        h, d, y;
-  int        status;
+  return p7_tophits_AlignmentThreaded(th, abc, inc_sqarr, inc_trarr, inc_n, optflags, 0, ret_msa);
+}
+
+/* Function:  p7_tophits_AlignmentThreaded()
+ * Synopsis:  Create a multiple alignment of all the included domains, on threads.
+ *
+ * Purpose:   As <p7_tophits_Alignment()>, with the included domains'
+ *            alignment displays converted back to sequences and traces
+ *            by <ncpu> threads (the caller's included), taking
+ *            <p7_TOPHITS_BCCHUNK> of them at a time; <ncpu> 0 or 1
+ *            converts them all in the calling thread. For a list of
+ *            tens of thousands of hits, that conversion is most of the
+ *            work outside of <p7_tracealign_Seqs()>. The alignment is
+ *            the same however many threads there are.
+ *
+ *            For a list spilled to disk (see <p7_tophits_SetSpill()>),
+ *            only the included targets are read back into memory.
+ *
+ * Returns:   <eslOK> on success, and <*ret_msa> points to a new MSA that
+ *            the caller is responsible for freeing.
+ *
+ *            Returns <eslFAIL> if there are no included domains,
+ *            in which case <*ret_msa> is <NULL>.
+ *
+ * Throws:    <eslEMEM> on allocation failure; 
+ *            <eslECORRUPT> on unexpected internal data corruption.
+ */
+int
+p7_tophits_AlignmentThreaded(const P7_TOPHITS *th, const ESL_ALPHABET *abc, 
+			     ESL_SQ **inc_sqarr, P7_TRACE **inc_trarr, int inc_n,
+			     int optflags, int ncpu, ESL_MSA **ret_msa)
+{
+  ESL_SQ        **sqarr = NULL;
+  P7_TRACE      **trarr = NULL;
+  P7_ALIDISPLAY **ads   = NULL;
+  BC_WORKER      *wk    = NULL;
+  ESL_MSA        *msa   = NULL;
+  int             ndom  = 0;
+  int             M     = 0;
+  int             next  = 0;
+  int             nw    = 1;
+  int             h, d, y, w;
+  int             status;
+#ifdef HMMER_THREADS
+  pthread_mutex_t lock;
+  int             have_lock = FALSE;
+  int             nthr;
+#endif
+
+  if (th->spill && th->spill->nruns > 0)
+    {
+      P7_TOPHITS *inc = NULL;
+
+      if ((status = spill_included(th->spill, &inc)) != eslOK) return status;
+      status = p7_tophits_AlignmentThreaded(inc, abc, inc_sqarr, inc_trarr, inc_n, optflags, ncpu, ret_msa);
+      p7_tophits_Destroy(inc);
+      return status;
+    }
 
   /* How many domains will be included in the new alignment?  We also
    * set M here; we don't have hmm, but every ali has a copy.
@@ -1549,18 +3173,53 @@ p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
   for (y = 0; y < inc_n;        y++) { sqarr[y] = inc_sqarr[y];  trarr[y] = inc_trarr[y]; }
   for (;      y < (ndom+inc_n); y++) { sqarr[y] = NULL;          trarr[y] = NULL; }
 
-  /* Make faux sequences, traces from hit list */
-  y = inc_n;
+  /* Make faux sequences, traces from hit list, in hit order */
+  if (ndom > 0) ESL_ALLOC(ads, sizeof(P7_ALIDISPLAY *) * ndom);
+  y = 0;
   for (h = 0; h < th->N; h++)
     if (th->hit[h]->flags & p7_IS_INCLUDED)
     {
         for (d = 0; d < th->hit[h]->ndom; d++)
           if (th->hit[h]->dcl[d].is_included)
-          {
-              if ((status = p7_alidisplay_Backconvert(th->hit[h]->dcl[d].ad, abc, &(sqarr[y]), &(trarr[y]))) != eslOK) goto ERROR;
-              y++;
-          }
+            ads[y++] = th->hit[h]->dcl[d].ad;
+    }
+
+#ifdef HMMER_THREADS
+  nw = ESL_MAX(1, ESL_MIN(ncpu, (ndom + p7_TOPHITS_BCCHUNK - 1) / p7_TOPHITS_BCCHUNK));
+  if (nw > 1)
+    {
+      if (pthread_mutex_init(&lock, NULL) == 0) have_lock = TRUE;
+      else                                      nw = 1;
+    }
+#endif
+  ESL_ALLOC(wk, sizeof(BC_WORKER) * nw);
+  for (w = 0; w < nw; w++)
+    {
+      wk[w].ad     = ads;
+      wk[w].abc    = abc;
+      wk[w].sq     = sqarr + inc_n;
+      wk[w].tr     = trarr + inc_n;
+      wk[w].end    = ndom;
+      wk[w].next   = &next;
+      wk[w].status = eslOK;
+#ifdef HMMER_THREADS
+      wk[w].lock   = (have_lock ? &lock : NULL);
+#endif
     }
+
+  /* If a thread can't be started, the others just take its share. */
+#ifdef HMMER_THREADS
+  for (nthr = 1; nthr < nw; nthr++)
+    if (pthread_create(&(wk[nthr].thread), NULL, backconvert_worker, &(wk[nthr])) != 0) break;
+#endif
+  backconvert_worker(&(wk[0]));
+#ifdef HMMER_THREADS
+  for (w = 1; w < nthr; w++)
+    pthread_join(wk[w].thread, NULL);
+  if (have_lock) { pthread_mutex_destroy(&lock); have_lock = FALSE; }
+#endif
+  for (w = 0; w < nw; w++)
+    if (wk[w].status != eslOK) { status = wk[w].status; goto ERROR; }
   
   /* Make the multiple alignment */
   if ((status = p7_tracealign_Seqs(sqarr, trarr, inc_n+ndom, M, optflags, NULL, &msa)) != eslOK) goto ERROR;
@@ -1570,16 +3229,54 @@ p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
   for (y = inc_n; y < ndom+inc_n; y++) p7_trace_Destroy(trarr[y]);
   free(sqarr);
   free(trarr);
+  free(ads);
+  free(wk);
   *ret_msa = msa;
   return eslOK;
   
  ERROR:
+#ifdef HMMER_THREADS
+  if (have_lock) pthread_mutex_destroy(&lock);
+#endif
   if (sqarr != NULL) { for (y = inc_n; y < ndom+inc_n; y++) if (sqarr[y] != NULL) esl_sq_Destroy(sqarr[y]);   free(sqarr); }
   if (trarr != NULL) { for (y = inc_n; y < ndom+inc_n; y++) if (trarr[y] != NULL) p7_trace_Destroy(trarr[y]); free(trarr); }
   if (msa   != NULL) esl_msa_Destroy(msa);
+  if (ads)  free(ads);
+  if (wk)   free(wk);
   *ret_msa = NULL;
   return status;
 }
+
+/* backconvert_worker()
+ * Body of <p7_tophits_AlignmentThreaded()>, for one thread: take the
+ * next chunk of displays (under the lock, if there's more than one
+ * worker) until none are left, and convert each to a sequence and a
+ * trace. Each display has its own slots in <sq>, <tr>, so the result
+ * doesn't depend on who took what. Stops at the first failure.
+ */
+static void *
+backconvert_worker(void *arg)
+{
+  BC_WORKER *wk = (BC_WORKER *) arg;
+  int        i, end;
+
+  while (wk->status == eslOK)
+    {
+#ifdef HMMER_THREADS
+      if (wk->lock) pthread_mutex_lock(wk->lock);
+#endif
+      i       = *wk->next;
+      *wk->next = ESL_MIN(i + p7_TOPHITS_BCCHUNK, wk->end);
+#ifdef HMMER_THREADS
+      if (wk->lock) pthread_mutex_unlock(wk->lock);
+#endif
+      if (i >= wk->end) break;
+
+      for (end = ESL_MIN(i + p7_TOPHITS_BCCHUNK, wk->end); i < end; i++)
+	if ((wk->status = p7_alidisplay_Backconvert(wk->ad[i], wk->abc, &(wk->sq[i]), &(wk->tr[i]))) != eslOK) break;
+    }
+  return NULL;
+}
 /*---------------- end, standard output format ------------------*/
 
 
@@ -1590,6 +3287,176 @@ p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
  * 3. Tabular (parsable) output of pipeline results.
  *****************************************************************/
 
+/* tabular_targets_header(), tabular_targets_row():
+ * the header lines, and one reported hit's row, of a per-sequence
+ * hit table with the given column widths. Shared by
+ * p7_tophits_TabularTargets() and p7_tophits_TabularHit().
+ */
+static int
+tabular_targets_header(FILE *ofp, P7_PIPELINE *pli, int tnamew, int taccw, int qnamew, int qaccw, int posw)
+{
+  if (pli->long_targets) 
+  {
+    if (fprintf(ofp, "#%-*s %-*s %-*s %-*s %s %s %*s %*s %*s %*s %*s %6s %9s %6s %5s  %s\n",
+      tnamew-1, " target name",        taccw, "accession",  qnamew, "query name",           qaccw, "accession", "hmmfrom", "hmm to", posw, "alifrom", posw, "ali to", posw, "envfrom", posw, "env to", posw, ( pli->mode == p7_SCAN_MODELS ? "modlen" : "sq len" ), "strand", "  E-value", " score", " bias", "description of target") < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+    if (fprintf(ofp, "#%*s %*s %*s %*s %s %s %*s %*s %*s %*s %*s %6s %9s %6s %5s %s\n",
+      tnamew-1, "-------------------", taccw, "----------", qnamew, "--------------------", qaccw, "----------", "-------", "-------", posw, "-------", posw, "-------",  posw, "-------", posw, "-------", posw, "-------", "------", "---------", "------", "-----", "---------------------") < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-per-sequence hit list: write failed");
+  }
+  else
+  {
+    if (fprintf(ofp, "#%*s %22s %22s %33s\n", tnamew+qnamew+taccw+qaccw+2, "", "--- full sequence ----", "--- best 1 domain ----", "--- domain number estimation ----") < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+    if (fprintf(ofp, "#%-*s %-*s %-*s %-*s %9s %6s %5s %9s %6s %5s %5s %3s %3s %3s %3s %3s %3s %3s %s\n",
+      tnamew-1, " target name",        taccw, "accession",  qnamew, "query name",           qaccw, "accession",  "  E-value", " score", " bias", "  E-value", " score", " bias", "exp", "reg", "clu", " ov", "env", "dom", "rep", "inc", "description of target") < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+    if (fprintf(ofp, "#%*s %*s %*s %*s %9s %6s %5s %9s %6s %5s %5s %3s %3s %3s %3s %3s %3s %3s %s\n",
+      tnamew-1, "-------------------", taccw, "----------", qnamew, "--------------------", qaccw, "----------", "---------", "------", "-----", "---------", "------", "-----", "---", "---", "---", "---", "---", "---", "---", "---", "---------------------") < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+  }
+  return eslOK;
+}
+
+static int
+tabular_targets_row(FILE *ofp, char *qname, char *qacc, P7_HIT *hit, P7_PIPELINE *pli, int tnamew, int taccw, int qnamew, int qaccw, int posw)
+{
+  int d = hit->best_domain;
+
+  if (pli->long_targets) 
+  {
+    if (fprintf(ofp, "%-*s %-*s %-*s %-*s %7d %7d %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %6s %9.2g %6.1f %5.1f  %s\n",
+      tnamew, hit->name,
+      taccw,  hit->acc ? hit->acc : "-",
+      qnamew, qname,
+      qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
+      hit->dcl[d].ad->hmmfrom,
+      hit->dcl[d].ad->hmmto,
+      posw, hit->dcl[d].iali,
+      posw, hit->dcl[d].jali,
+      posw, hit->dcl[d].ienv,
+      posw, hit->dcl[d].jenv,
+      posw, hit->dcl[0].ad->L,
+      (hit->dcl[d].iali < hit->dcl[d].jali ? "   +  "  :  "   -  "),
+      exp(hit->lnP),
+      hit->score,
+      hit->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+      hit->desc == NULL ? "-" :  hit->desc ) < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+  }
+  else if (hit->ndom == 0)   /* scored without domains (p7_pipeline_SetSeqScoreOnly()) */
+  {
+    if (fprintf(ofp, "%-*s %-*s %-*s %-*s %9.2g %6.1f %5.1f %9s %6s %5s %5s %3s %3s %3s %3s %3d %3d %3d %s\n",
+      tnamew, hit->name,
+      taccw,  hit->acc ? hit->acc : "-",
+      qnamew, qname,
+      qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
+      exp(hit->lnP) * pli->Z,
+      hit->score,
+      hit->pre_score - hit->score, /* bias correction */
+      "-", "-", "-", "-", "-", "-", "-", "-",
+      hit->ndom,
+      hit->nreported,
+      hit->nincluded,
+      (hit->desc == NULL ? "-" : hit->desc)) < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+  }
+  else
+  {
+    if (fprintf(ofp, "%-*s %-*s %-*s %-*s %9.2g %6.1f %5.1f %9.2g %6.1f %5.1f %5.1f %3d %3d %3d %3d %3d %3d %3d %s\n",
+      tnamew, hit->name,
+      taccw,  hit->acc ? hit->acc : "-",
+      qnamew, qname,
+      qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
+      exp(hit->lnP) * pli->Z,
+      hit->score,
+      hit->pre_score - hit->score, /* bias correction */
+      exp(hit->dcl[d].lnP) * pli->Z,
+      hit->dcl[d].bitscore,
+      hit->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
+      hit->nexpected,
+      hit->nregions,
+      hit->nclustered,
+      hit->noverlaps,
+      hit->nenvelopes,
+      hit->ndom,
+      hit->nreported,
+      hit->nincluded,
+      (hit->desc == NULL ? "-" : hit->desc)) < 0)
+      ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
+  }
+  return eslOK;
+}
+
+/* tabular_domains_header(), tabular_domains_rows():
+ * the same for a per-domain hit table: header lines, and the rows
+ * for one reported hit's reported domains. Shared by
+ * p7_tophits_TabularDomains() and p7_tophits_TabularHit().
+ */
+static int
+tabular_domains_header(FILE *ofp, int tnamew, int taccw, int qnamew, int qaccw)
+{
+  if (fprintf(ofp, "#%*s %22s %40s %11s %11s %11s\n", tnamew+qnamew-1+15+taccw+qaccw, "",                                   "--- full sequence ---",        "-------------- this domain -------------",                "hmm coord",      "ali coord",     "env coord") < 0)
+    ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+  if (fprintf(ofp, "#%-*s %-*s %5s %-*s %-*s %5s %9s %6s %5s %3s %3s %9s %9s %6s %5s %5s %5s %5s %5s %5s %5s %4s %s\n",
+    tnamew-1, " target name",        taccw, "accession",  "tlen",  qnamew, "query name",           qaccw, "accession",  "qlen",  "E-value",   "score",  "bias",  "#",   "of",  "c-Evalue",  "i-Evalue",  "score",  "bias",  "from",  "to",    "from",  "to",   "from",   "to",    "acc",  "description of target") < 0)
+    ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+  if (fprintf(ofp, "#%*s %*s %5s %*s %*s %5s %9s %6s %5s %3s %3s %9s %9s %6s %5s %5s %5s %5s %5s %5s %5s %4s %s\n", 
+    tnamew-1, "-------------------", taccw, "----------", "-----", qnamew, "--------------------", qaccw, "----------", "-----", "---------", "------", "-----", "---", "---", "---------", "---------", "------", "-----", "-----", "-----", "-----", "-----", "-----", "-----", "----", "---------------------") < 0)
+    ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+  return eslOK;
+}
+
+static int
+tabular_domains_rows(FILE *ofp, char *qname, char *qacc, P7_HIT *hit, P7_PIPELINE *pli, int tnamew, int taccw, int qnamew, int qaccw)
+{
+  int tlen, qlen;
+  int d,nd;
+
+  nd = 0;
+  for (d = 0; d < hit->ndom; d++)
+    if (hit->dcl[d].is_reported)
+    {
+      nd++;
+
+      /* in hmmsearch, targets are seqs and queries are HMMs;
+       * in hmmscan, the reverse.  but in the ALIDISPLAY
+       * structure, lengths L and M are for seq and HMMs, not
+       * for query and target, so sort it out.
+       */
+      if (pli->mode == p7_SEARCH_SEQS) { qlen = hit->dcl[d].ad->M; tlen = hit->dcl[d].ad->L;  }
+      else                             { qlen = hit->dcl[d].ad->L; tlen = hit->dcl[d].ad->M;  }
+
+      if (fprintf(ofp, "%-*s %-*s %5d %-*s %-*s %5d %9.2g %6.1f %5.1f %3d %3d %9.2g %9.2g %6.1f %5.1f %5d %5d %5" PRId64 " %5" PRId64 " %5" PRId64 " %5" PRId64 " %4.2f %s\n",
+        tnamew, hit->name,
+        taccw,  hit->acc ? hit->acc : "-",
+        tlen,
+        qnamew, qname,
+        qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
+        qlen,
+        exp(hit->lnP) * pli->Z,
+        hit->score,
+        hit->pre_score - hit->score, /* bias correction */
+        nd,
+        hit->nreported,
+        exp(hit->dcl[d].lnP) * pli->domZ,
+        exp(hit->dcl[d].lnP) * pli->Z,
+        hit->dcl[d].bitscore,
+        hit->dcl[d].dombias * eslCONST_LOG2R, /* NATS to BITS at last moment */
+        hit->dcl[d].ad->hmmfrom,
+        hit->dcl[d].ad->hmmto,
+        hit->dcl[d].ad->sqfrom,
+        hit->dcl[d].ad->sqto,
+        hit->dcl[d].ienv,
+        hit->dcl[d].jenv,
+        (hit->dcl[d].oasc / (1.0 + fabs((float) (hit->dcl[d].jenv - hit->dcl[d].ienv)))),
+        (hit->desc ?  hit->desc : "-")) < 0)
+        ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+    }
+  return eslOK;
+}
+
+
 /* Function:  p7_tophits_TabularTargets()
  * Synopsis:  Output parsable table of per-sequence hits.
  *
@@ -1601,6 +3468,9 @@ p7_tophits_Alignment(const P7_TOPHITS *th, const ESL_ALPHABET *abc,
  *            Designed to be concatenated for multiple queries and
  *            multiple top hits list.
  *
+ *            If <pli> collected per-stage timings, they follow the
+ *            hits as a '#' comment line; see <p7_pli_TabularTimings()>.
+ *
  * Returns:   <eslOK> on success.
  * 
  * Throws:    <eslEWRITE> if a write to <ofp> fails; for example, if
@@ -1614,83 +3484,31 @@ p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
   int qaccw  = ((qacc != NULL) ? ESL_MAX(10, strlen(qacc)) : 10);
   int taccw  = ESL_MAX(10, p7_tophits_GetMaxAccessionLength(th));
   int posw   = (pli->long_targets ? ESL_MAX(7, p7_tophits_GetMaxPositionLength(th)) : 0);
-  int h,d;
+  SPILL_MERGE *m = NULL;
+  P7_HIT *hit;
+  int h;
+  int status;
 
   if (show_header)
-  {
-      if (pli->long_targets) 
-      {
-        if (fprintf(ofp, "#%-*s %-*s %-*s %-*s %s %s %*s %*s %*s %*s %*s %6s %9s %6s %5s  %s\n",
-          tnamew-1, " target name",        taccw, "accession",  qnamew, "query name",           qaccw, "accession", "hmmfrom", "hmm to", posw, "alifrom", posw, "ali to", posw, "envfrom", posw, "env to", posw, ( pli->mode == p7_SCAN_MODELS ? "modlen" : "sq len" ), "strand", "  E-value", " score", " bias", "description of target") < 0)
-          ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-        if (fprintf(ofp, "#%*s %*s %*s %*s %s %s %*s %*s %*s %*s %*s %6s %9s %6s %5s %s\n",
-          tnamew-1, "-------------------", taccw, "----------", qnamew, "--------------------", qaccw, "----------", "-------", "-------", posw, "-------", posw, "-------",  posw, "-------", posw, "-------", posw, "-------", "------", "---------", "------", "-----", "---------------------") < 0)
-          ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-per-sequence hit list: write failed");
-      }
-      else
-      {
-        if (fprintf(ofp, "#%*s %22s %22s %33s\n", tnamew+qnamew+taccw+qaccw+2, "", "--- full sequence ----", "--- best 1 domain ----", "--- domain number estimation ----") < 0)
-          ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-        if (fprintf(ofp, "#%-*s %-*s %-*s %-*s %9s %6s %5s %9s %6s %5s %5s %3s %3s %3s %3s %3s %3s %3s %s\n",
-          tnamew-1, " target name",        taccw, "accession",  qnamew, "query name",           qaccw, "accession",  "  E-value", " score", " bias", "  E-value", " score", " bias", "exp", "reg", "clu", " ov", "env", "dom", "rep", "inc", "description of target") < 0)
-          ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-        if (fprintf(ofp, "#%*s %*s %*s %*s %9s %6s %5s %9s %6s %5s %5s %3s %3s %3s %3s %3s %3s %3s %s\n",
-          tnamew-1, "-------------------", taccw, "----------", qnamew, "--------------------", qaccw, "----------", "---------", "------", "-----", "---------", "------", "-----", "---", "---", "---", "---", "---", "---", "---", "---", "---------------------") < 0)
-          ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-      }
-  }
+    if ((status = tabular_targets_header(ofp, pli, tnamew, taccw, qnamew, qaccw, posw)) != eslOK) return status;
 
-  for (h = 0; h < th->N; h++)
-    if (th->hit[h]->flags & p7_IS_REPORTED)    
+  if (th->spill && th->spill->nruns > 0)
     {
-        d    = th->hit[h]->best_domain;
-        if (pli->long_targets) 
-        {
-            if (fprintf(ofp, "%-*s %-*s %-*s %-*s %7d %7d %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %*" PRId64 " %6s %9.2g %6.1f %5.1f  %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                th->hit[h]->dcl[d].ad->hmmfrom,
-                th->hit[h]->dcl[d].ad->hmmto,
-                posw, th->hit[h]->dcl[d].iali,
-                posw, th->hit[h]->dcl[d].jali,
-                posw, th->hit[h]->dcl[d].ienv,
-                posw, th->hit[h]->dcl[d].jenv,
-                posw, th->hit[h]->dcl[0].ad->L,
-                (th->hit[h]->dcl[d].iali < th->hit[h]->dcl[d].jali ? "   +  "  :  "   -  "),
-                exp(th->hit[h]->lnP),
-                th->hit[h]->score,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-                th->hit[h]->desc == NULL ? "-" :  th->hit[h]->desc ) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-        }
-        else
-        {
-                if (fprintf(ofp, "%-*s %-*s %-*s %-*s %9.2g %6.1f %5.1f %9.2g %6.1f %5.1f %5.1f %3d %3d %3d %3d %3d %3d %3d %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                exp(th->hit[h]->lnP) * pli->Z,
-                th->hit[h]->score,
-                th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-                exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-                th->hit[h]->dcl[d].bitscore,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* convert NATS to BITS at last moment */
-                th->hit[h]->nexpected,
-                th->hit[h]->nregions,
-                th->hit[h]->nclustered,
-                th->hit[h]->noverlaps,
-                th->hit[h]->nenvelopes,
-                th->hit[h]->ndom,
-                th->hit[h]->nreported,
-                th->hit[h]->nincluded,
-                (th->hit[h]->desc == NULL ? "-" : th->hit[h]->desc)) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-sequence hit list: write failed");
-        }
+      if ((status = spill_merge_open(th->spill, &m)) != eslOK) return status;
+      while ((status = spill_merge_next(m, &hit)) == eslOK)
+	if (hit->flags & p7_IS_REPORTED)
+	  if ((status = tabular_targets_row(ofp, qname, qacc, hit, pli, tnamew, taccw, qnamew, qaccw, posw)) != eslOK) break;
+      spill_merge_close(m);
+      if (status != eslEOF) return status;
     }
-  return eslOK;
+  else
+    {
+      for (h = 0; h < th->N; h++)
+	if (th->hit[h]->flags & p7_IS_REPORTED)
+	  if ((status = tabular_targets_row(ofp, qname, qacc, th->hit[h], pli, tnamew, taccw, qnamew, qaccw, posw)) != eslOK) return status;
+    }
+
+  return p7_pli_TabularTimings(ofp, pli);
 }
 
 
@@ -1705,6 +3523,9 @@ p7_tophits_TabularTargets(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
  *            Designed to be concatenated for multiple queries and
  *            multiple top hits list.
  *
+ *            If <pli> collected per-stage timings, they follow the
+ *            hits as a '#' comment line; see <p7_pli_TabularTimings()>.
+ *
  * Returns:   <eslOK> on success.
  * 
  * Throws:    <eslEWRITE> if a write to <ofp> fails; for example, if
@@ -1718,68 +3539,90 @@ p7_tophits_TabularDomains(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7
   int tnamew = ESL_MAX(20, p7_tophits_GetMaxNameLength(th));
   int qaccw  = (qacc ? ESL_MAX(10, strlen(qacc)) : 10);
   int taccw  = ESL_MAX(10, p7_tophits_GetMaxAccessionLength(th));
-  int tlen, qlen;
-  int h,d,nd;
+  SPILL_MERGE *m = NULL;
+  P7_HIT *hit;
+  int h;
+  int status;
 
   if (show_header)
+    if ((status = tabular_domains_header(ofp, tnamew, taccw, qnamew, qaccw)) != eslOK) return status;
+
+  if (th->spill && th->spill->nruns > 0)
     {
-         if (fprintf(ofp, "#%*s %22s %40s %11s %11s %11s\n", tnamew+qnamew-1+15+taccw+qaccw, "",                                   "--- full sequence ---",        "-------------- this domain -------------",                "hmm coord",      "ali coord",     "env coord") < 0)
-            ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
-         if (fprintf(ofp, "#%-*s %-*s %5s %-*s %-*s %5s %9s %6s %5s %3s %3s %9s %9s %6s %5s %5s %5s %5s %5s %5s %5s %4s %s\n",
-            tnamew-1, " target name",        taccw, "accession",  "tlen",  qnamew, "query name",           qaccw, "accession",  "qlen",  "E-value",   "score",  "bias",  "#",   "of",  "c-Evalue",  "i-Evalue",  "score",  "bias",  "from",  "to",    "from",  "to",   "from",   "to",    "acc",  "description of target") < 0)
-            ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
-         if (fprintf(ofp, "#%*s %*s %5s %*s %*s %5s %9s %6s %5s %3s %3s %9s %9s %6s %5s %5s %5s %5s %5s %5s %5s %4s %s\n", 
-           tnamew-1, "-------------------", taccw, "----------", "-----", qnamew, "--------------------", qaccw, "----------", "-----", "---------", "------", "-----", "---", "---", "---------", "---------", "------", "-----", "-----", "-----", "-----", "-----", "-----", "-----", "----", "---------------------") < 0)
-           ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+      if ((status = spill_merge_open(th->spill, &m)) != eslOK) return status;
+      while ((status = spill_merge_next(m, &hit)) == eslOK)
+	if (hit->flags & p7_IS_REPORTED)
+	  if ((status = tabular_domains_rows(ofp, qname, qacc, hit, pli, tnamew, taccw, qnamew, qaccw)) != eslOK) break;
+      spill_merge_close(m);
+      if (status != eslEOF) return status;
     }
-
-  for (h = 0; h < th->N; h++)
-    if (th->hit[h]->flags & p7_IS_REPORTED)
+  else
     {
-        nd = 0;
-        for (d = 0; d < th->hit[h]->ndom; d++)
-          if (th->hit[h]->dcl[d].is_reported)
-          {
-              nd++;
-
-              /* in hmmsearch, targets are seqs and queries are HMMs;
-               * in hmmscan, the reverse.  but in the ALIDISPLAY
-               * structure, lengths L and M are for seq and HMMs, not
-               * for query and target, so sort it out.
-               */
-              if (pli->mode == p7_SEARCH_SEQS) { qlen = th->hit[h]->dcl[d].ad->M; tlen = th->hit[h]->dcl[d].ad->L;  }
-              else                             { qlen = th->hit[h]->dcl[d].ad->L; tlen = th->hit[h]->dcl[d].ad->M;  }
-
-
-
-              if (fprintf(ofp, "%-*s %-*s %5d %-*s %-*s %5d %9.2g %6.1f %5.1f %3d %3d %9.2g %9.2g %6.1f %5.1f %5d %5d %5" PRId64 " %5" PRId64 " %5" PRId64 " %5" PRId64 " %4.2f %s\n",
-                tnamew, th->hit[h]->name,
-                taccw,  th->hit[h]->acc ? th->hit[h]->acc : "-",
-                tlen,
-                qnamew, qname,
-                qaccw,  ( (qacc != NULL && qacc[0] != '\0') ? qacc : "-"),
-                qlen,
-                exp(th->hit[h]->lnP) * pli->Z,
-                th->hit[h]->score,
-                th->hit[h]->pre_score - th->hit[h]->score, /* bias correction */
-                nd,
-                th->hit[h]->nreported,
-                exp(th->hit[h]->dcl[d].lnP) * pli->domZ,
-                exp(th->hit[h]->dcl[d].lnP) * pli->Z,
-                th->hit[h]->dcl[d].bitscore,
-                th->hit[h]->dcl[d].dombias * eslCONST_LOG2R, /* NATS to BITS at last moment */
-                th->hit[h]->dcl[d].ad->hmmfrom,
-                th->hit[h]->dcl[d].ad->hmmto,
-                th->hit[h]->dcl[d].ad->sqfrom,
-                th->hit[h]->dcl[d].ad->sqto,
-                th->hit[h]->dcl[d].ienv,
-                th->hit[h]->dcl[d].jenv,
-                (th->hit[h]->dcl[d].oasc / (1.0 + fabs((float) (th->hit[h]->dcl[d].jenv - th->hit[h]->dcl[d].ienv)))),
-                (th->hit[h]->desc ?  th->hit[h]->desc : "-")) < 0)
-                  ESL_EXCEPTION_SYS(eslEWRITE, "tabular per-domain hit list: write failed");
+      for (h = 0; h < th->N; h++)
+	if (th->hit[h]->flags & p7_IS_REPORTED)
+	  if ((status = tabular_domains_rows(ofp, qname, qacc, th->hit[h], pli, tnamew, taccw, qnamew, qaccw)) != eslOK) return status;
+    }
 
-          }
-      }
+  return p7_pli_TabularTimings(ofp, pli);
+}
+
+
+/* Function:  p7_tophits_TabularHeaders()
+ * Synopsis:  Output the headers of streamed hit tables.
+ *
+ * Purpose:   Output the header lines of a per-sequence hit table to
+ *            <tblfp> and of a per-domain table to <domtblfp>, for
+ *            query <qname>/<qacc>, with the minimum target column
+ *            widths that <p7_tophits_TabularHit()> uses. Either
+ *            stream may be <NULL>, to skip that table.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> if a write fails.
+ */
+int
+p7_tophits_TabularHeaders(FILE *tblfp, FILE *domtblfp, char *qname, char *qacc, P7_PIPELINE *pli)
+{
+  int qnamew = ESL_MAX(20, strlen(qname));
+  int qaccw  = (qacc ? ESL_MAX(10, strlen(qacc)) : 10);
+  int status;
+
+  if (tblfp    && (status = tabular_targets_header(tblfp, pli, 20, 10, qnamew, qaccw, (pli->long_targets ? 7 : 0))) != eslOK) return status;
+  if (domtblfp && (status = tabular_domains_header(domtblfp,    20, 10, qnamew, qaccw))                               != eslOK) return status;
+  return eslOK;
+}
+
+
+/* Function:  p7_tophits_TabularHit()
+ * Synopsis:  Output one hit's rows of the parseable hit tables.
+ *
+ * Purpose:   Output the <p7_tophits_TabularTargets()> row for hit
+ *            <hit> to <tblfp>, and its <p7_tophits_TabularDomains()>
+ *            rows to <domtblfp>, if it's flagged as reported. Either
+ *            stream may be <NULL>.
+ *
+ *            This is for writing the tables as hits are found
+ *            rather than from a final sorted list (see
+ *            <P7_TABSTREAM>), so the caller is responsible for
+ *            having set the hit's report flags already (see
+ *            <p7_tophits_ThresholdHit()>). Columns use minimum
+ *            widths; a longer name or accession just widens its own
+ *            row.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEWRITE> if a write fails.
+ */
+int
+p7_tophits_TabularHit(FILE *tblfp, FILE *domtblfp, char *qname, char *qacc, P7_HIT *hit, P7_PIPELINE *pli)
+{
+  int qnamew = ESL_MAX(20, strlen(qname));
+  int qaccw  = (qacc ? ESL_MAX(10, strlen(qacc)) : 10);
+  int status;
+
+  if (! (hit->flags & p7_IS_REPORTED)) return eslOK;
+  if (tblfp    && (status = tabular_targets_row(tblfp, qname, qacc, hit, pli, 20, 10, qnamew, qaccw, (pli->long_targets ? 7 : 0))) != eslOK) return status;
+  if (domtblfp && (status = tabular_domains_rows(domtblfp, qname, qacc, hit, pli, 20, 10, qnamew, qaccw))                            != eslOK) return status;
   return eslOK;
 }
 
@@ -1945,6 +3788,7 @@ p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PI
       }
       free (domHitlist->unsrt);
       free (domHitlist->hit);
+      p7_arena_Destroy(domHitlist->arena);
       free (domHitlist);
   }
   return eslOK;
@@ -1954,6 +3798,7 @@ p7_tophits_TabularXfam(FILE *ofp, char *qname, char *qacc, P7_TOPHITS *th, P7_PI
   {
       free (domHitlist->unsrt);
       free (domHitlist->hit);
+      p7_arena_Destroy(domHitlist->arena);
       free (domHitlist);
   }
   return status;
@@ -2101,6 +3946,7 @@ static ESL_OPTIONS options[] = {
   { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
   { "-M",        eslARG_INT,     "10", NULL, NULL,  NULL,  NULL, NULL, "number of top hits lists to simulate and merge",   0 },
   { "-N",        eslARG_INT,  "10000", NULL, NULL,  NULL,  NULL, NULL, "number of top hits to simulate",                   0 },
+  { "-p",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "merge pairwise with Merge(), not MergeMany()",     0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
 };
 static char usage[]  = "[-options]";
@@ -2143,9 +3989,11 @@ main(int argc, char **argv)
       p7_tophits_SortBySortkey(h[j]);
   }
   /* then merge them into one big list in h[0] */
+  if (! esl_opt_GetBoolean(go, "-p"))
+    p7_tophits_MergeMany(h[0], h+1, M-1);
   for (j = 1; j < M; j++)
   {
-      p7_tophits_Merge(h[0], h[j]);
+      if (esl_opt_GetBoolean(go, "-p")) p7_tophits_Merge(h[0], h[j]);
       p7_tophits_Destroy(h[j]);
   }
 
@@ -2205,8 +4053,14 @@ main(int argc, char **argv)
   char            name[]   = "not_unique_name";
   char            acc[]    = "not_unique_acc";
   char            desc[]   = "Test description for the purposes of making the test driver allocate space";
+  P7_TOPHITS     *hl[4];
+  P7_TOPHITS     *hp[4];
+  P7_HIT         *hit;
+  int             nl       = 4;
+  int             K        = 10;
+  double          topkey[10];
   double          key;
-  int             i;
+  int             i,j;
 
   h1 = p7_tophits_Create();
   h2 = p7_tophits_Create();
@@ -2238,6 +4092,192 @@ main(int argc, char **argv)
   
   if (p7_tophits_GetMaxNameLength(h3) != strlen(name)) esl_fatal("GetMaxNameLength() failed");
 
+  /* k-way merge of several lists, some of them empty or unsorted */
+  for (j = 0; j < nl; j++)
+    {
+      hl[j] = p7_tophits_Create();
+      for (i = 0; i < (j == 1 ? 0 : N); i++)
+        {
+          key = esl_random(r);
+          p7_tophits_Add(hl[j], name, acc, desc, key, (float) key, key, (float) key, key, i, i, N, i, i, N, 1, 1, NULL);
+        }
+      if (j % 2) p7_tophits_SortBySortkey(hl[j]);
+    }
+  if (p7_tophits_MergeMany(h3, hl, nl) != eslOK) esl_fatal("MergeMany() failed");
+  if (h3->N != 3*N+2 + (nl-1)*N)                 esl_fatal("after k-way merge, wrong number of hits");
+  if (! h3->is_sorted_by_sortkey)                esl_fatal("after k-way merge, list not flagged sorted");
+  if (strcmp(h3->hit[0]->name,      "first") != 0) esl_fatal("after k-way merge, sort failed (top is %s = %f)",  h3->hit[0]->name,      h3->hit[0]->sortkey);
+  if (strcmp(h3->hit[h3->N-1]->name, "last") != 0) esl_fatal("after k-way merge, sort failed (last is %s = %f)", h3->hit[h3->N-1]->name, h3->hit[h3->N-1]->sortkey);
+  for (i = 1; i < h3->N; i++)
+    if (h3->hit[i]->sortkey > h3->hit[i-1]->sortkey) esl_fatal("after k-way merge, hits %d and %d out of order", i-1, i);
+
+  /* k-way merge of nhmmer-style lists into target/position order */
+  for (j = 0; j < nl; j++)
+    {
+      hp[j] = p7_tophits_Create();
+      for (i = 0; i < (j == 2 ? 0 : N); i++)
+        {
+          p7_tophits_CreateNextHit(hp[j], &hit);
+          hit->seqidx       = esl_rnd_Roll(r, 5);
+          hit->ndom         = 1;
+          hit->dcl          = calloc(1, sizeof(P7_DOMAIN));
+          hit->dcl[0].iali  = 1 + esl_rnd_Roll(r, 1000);
+          hit->dcl[0].jali  = 1 + esl_rnd_Roll(r, 1000);
+        }
+      if (j % 2) p7_tophits_SortBySeqidxAndAlipos(hp[j]);
+    }
+  if (p7_tophits_MergeManyBySeqidxAndAlipos(hp[0], hp+1, nl-1) != eslOK) esl_fatal("MergeManyBySeqidxAndAlipos() failed");
+  if (hp[0]->N != (nl-1)*N)            esl_fatal("after positional merge, wrong number of hits");
+  if (! hp[0]->is_sorted_by_seqidx)    esl_fatal("after positional merge, list not flagged sorted");
+  for (i = 1; i < hp[0]->N; i++)
+    if (hit_sorter_by_seqidx_aliposition(&hp[0]->hit[i-1], &hp[0]->hit[i]) > 0) esl_fatal("after positional merge, hits %d and %d out of order", i-1, i);
+
+  /* runs of tied sortkeys come out in hit_sorter_by_sortkey() order */
+  for (i = 0; i < hp[0]->N; i++)
+    {
+      hp[0]->unsrt[i].sortkey = (double) esl_rnd_Roll(r, 4);
+      esl_strdup(esl_rnd_Roll(r, 2) ? "a" : "b", -1, &(hp[0]->unsrt[i].name));
+    }
+  hp[0]->is_sorted_by_sortkey = FALSE;
+  p7_tophits_SortBySortkey(hp[0]);
+  for (i = 1; i < hp[0]->N; i++)
+    if (hit_sorter_by_sortkey(&hp[0]->hit[i-1], &hp[0]->hit[i]) > 0) esl_fatal("sort with ties, hits %d and %d out of order", i-1, i);
+
+  /* partial top-K selection agrees with the full sort */
+  for (i = 0; i < h3->N; i++) h3->hit[i] = h3->unsrt + i;
+  h3->is_sorted_by_sortkey = FALSE;
+  p7_tophits_SortTopK(h3, K);
+  if (h3->N > K && h3->is_sorted_by_sortkey) esl_fatal("SortTopK() flagged a partial sort as full");
+  for (i = 0; i < K && i < h3->N; i++) topkey[i] = h3->hit[i]->sortkey;
+  p7_tophits_SortBySortkey(h3);
+  for (i = 0; i < K && i < h3->N; i++)
+    if (topkey[i] != h3->hit[i]->sortkey) esl_fatal("SortTopK() and SortBySortkey() disagree at rank %d", i);
+
+  /* a serialized list reads back the same */
+  {
+    P7_TOPHITS *h4     = p7_tophits_Create();
+    uint8_t    *buf    = NULL;
+    uint32_t    n      = 0;
+    uint32_t    nalloc = 0;
+
+    h3->nreported = 3;
+    h3->nincluded = 2;
+    for (i = 0; i < h3->N; i++) h3->unsrt[i].ndom = 0; /* test hits have no domain list */
+    if (p7_tophits_Serialize(h3, &buf, &n, &nalloc) != eslOK) esl_fatal("Serialize() failed");
+    nalloc = n;
+    n      = 0;
+    if (p7_tophits_Deserialize(buf, nalloc, &n, h4) != eslOK) esl_fatal("Deserialize() failed");
+    if (n != nalloc)                                          esl_fatal("Deserialize() read the wrong length");
+    if (h4->N != h3->N || h4->nreported != 3 || h4->nincluded != 2) esl_fatal("Deserialize() got the wrong counts");
+    for (i = 0; i < h3->N; i++)
+      if (strcmp(h4->unsrt[i].name, h3->unsrt[i].name) != 0 || h4->unsrt[i].sortkey != h3->unsrt[i].sortkey)
+	esl_fatal("Deserialize() changed hit %d", i);
+    n = 0;
+    if (p7_tophits_Deserialize(buf, nalloc - 1, &n, h4) != eslEFORMAT) esl_fatal("Deserialize() missed a truncated buffer");
+    free(buf);
+    p7_tophits_Destroy(h4);
+  }
+
+  /* threaded domain output is byte for byte the serial output */
+  {
+    P7_TOPHITS  *h5  = p7_tophits_Create();
+    P7_PIPELINE *pli = calloc(1, sizeof(P7_PIPELINE)); /* Domains() only looks at output options */
+    FILE        *fp1 = tmpfile();
+    FILE        *fp2 = tmpfile();
+    long         n1, n2;
+    int          c1, c2;
+
+    if (pli == NULL || fp1 == NULL || fp2 == NULL) esl_fatal("domain output test setup failed");
+    for (i = 0; i < 3 * p7_TOPHITS_DOMCHUNK + 17; i++)
+      {
+	p7_tophits_CreateNextHit(h5, &hit);
+	esl_sprintf(&(hit->name), "hit%d", i);
+	hit->flags = (esl_rnd_Roll(r, 8) ? p7_IS_REPORTED : 0);
+	if (hit->flags) h5->nreported++;
+      }
+    if (p7_tophits_Domains        (fp1, h5, pli, 80)    != eslOK) esl_fatal("Domains() failed");
+    if (p7_tophits_DomainsThreaded(fp2, h5, pli, 80, 4) != eslOK) esl_fatal("DomainsThreaded() failed");
+    if ((n1 = ftell(fp1)) != (n2 = ftell(fp2)))                    esl_fatal("DomainsThreaded() wrote %ld bytes, not %ld", n2, n1);
+    rewind(fp1);
+    rewind(fp2);
+    while ((c1 = fgetc(fp1)) != EOF)
+      if ((c2 = fgetc(fp2)) != c1) esl_fatal("DomainsThreaded() output differs");
+    fclose(fp1);
+    fclose(fp2);
+    free(pli);
+    p7_tophits_Destroy(h5);
+  }
+
+  /* a list spilled to disk thresholds and outputs the same as one in memory */
+  {
+    ESL_RAND64  *r64 = esl_rand64_Create(esl_opt_GetInteger(go, "-s"));
+    P7_TOPHITS  *hm  = p7_tophits_Create();
+    P7_TOPHITS  *hs  = p7_tophits_Create();
+    P7_HIT      *smp = NULL;
+    P7_PIPELINE *pli = calloc(1, sizeof(P7_PIPELINE));
+    FILE        *fp[2];
+    P7_TOPHITS  *th[2];
+    long         n1, n2;
+    int          c1, c2;
+    int          d, k;
+
+    if (r64 == NULL || pli == NULL || (fp[0] = tmpfile()) == NULL || (fp[1] = tmpfile()) == NULL) esl_fatal("spill test setup failed");
+    pli->by_E   = pli->inc_by_E    = TRUE;  pli->E    = 10.0; pli->incE    = 0.01; pli->Z    = 1000.; pli->Z_setby    = p7_ZSETBY_OPTION;
+    pli->dom_by_E = pli->incdom_by_E = TRUE; pli->domE = 10.0; pli->incdomE = 0.01;                  pli->domZ_setby = p7_ZSETBY_NTARGETS;
+    pli->mode   = p7_SEARCH_SEQS;
+    if (p7_tophits_SetSpill(hs, 4096) != eslOK) esl_fatal("SetSpill() failed");
+
+    for (i = 0; i < 5 * p7_HITSPILL_MAXRUNS; i++)
+      {
+	if (p7_hit_TestSample(r64, &smp) != eslOK) esl_fatal("spill test: hit sampling failed");
+	smp->flags       = 0;
+	smp->lnP         = -30.0 * esl_random(r);
+	smp->sortkey     = -smp->lnP;
+	smp->score       = (float) smp->sortkey;
+	for (d = 0; d < smp->ndom; d++)
+	  {
+	    smp->dcl[d].lnP         = -30.0 * esl_random(r);
+	    smp->dcl[d].is_reported = smp->dcl[d].is_included = FALSE;
+	  }
+	for (k = 0; k < 2; k++)
+	  {
+	    p7_tophits_CreateNextHit(k ? hs : hm, &hit);
+	    if (p7_hit_Copy(smp, hit) != eslOK) esl_fatal("spill test: hit copy failed");
+	  }
+	if (p7_tophits_Spill(hs) != eslOK) esl_fatal("Spill() failed");
+      }
+    if (hs->spill->nruns == 0)                                esl_fatal("spill test: nothing was spilled");
+    if (p7_tophits_Count(hs) != (uint64_t) hm->N)             esl_fatal("spill test: Count() is wrong");
+
+    th[0] = hm;
+    th[1] = hs;
+    for (k = 0; k < 2; k++)
+      {
+	if (p7_tophits_SortBySortkey(th[k])                       != eslOK) esl_fatal("spill test: sort failed");
+	if (p7_tophits_Threshold(th[k], pli)                      != eslOK) esl_fatal("spill test: Threshold() failed");
+	if (p7_tophits_Targets(fp[k], th[k], pli, 120)            != eslOK) esl_fatal("spill test: Targets() failed");
+	if (p7_tophits_Domains(fp[k], th[k], pli, 120)            != eslOK) esl_fatal("spill test: Domains() failed");
+	if (p7_tophits_TabularTargets(fp[k], "q", NULL, th[k], pli, TRUE) != eslOK) esl_fatal("spill test: TabularTargets() failed");
+	if (p7_tophits_TabularDomains(fp[k], "q", NULL, th[k], pli, TRUE) != eslOK) esl_fatal("spill test: TabularDomains() failed");
+      }
+    if (hs->nreported != hm->nreported || hs->nincluded != hm->nincluded) esl_fatal("spill test: Threshold() counts differ");
+    if ((n1 = ftell(fp[0])) != (n2 = ftell(fp[1])))                       esl_fatal("spill test: wrote %ld bytes, not %ld", n2, n1);
+    rewind(fp[0]);
+    rewind(fp[1]);
+    while ((c1 = fgetc(fp[0])) != EOF)
+      if ((c2 = fgetc(fp[1])) != c1) esl_fatal("spill test: output differs");
+
+    fclose(fp[0]);
+    fclose(fp[1]);
+    free(pli);
+    p7_hit_Destroy(smp);
+    p7_tophits_Destroy(hm);
+    p7_tophits_Destroy(hs);
+    esl_rand64_Destroy(r64);
+  }
+
+  for (j = 0; j < nl; j++) p7_tophits_Destroy(hl[j]);
+  for (j = 0; j < nl; j++) p7_tophits_Destroy(hp[j]);
   p7_tophits_Destroy(h1);
   p7_tophits_Destroy(h2);
   p7_tophits_Destroy(h3);
@@ -1275,6 +1275,27 @@ p7_trace_Index(P7_TRACE *tr)
  */
 int
 p7_trace_FauxFromMSA(ESL_MSA *msa, int *matassign, int optflags, P7_TRACE **tr)
+{
+  return p7_trace_FauxFromMSARange(msa, matassign, optflags, 0, msa->nseq, tr);
+}
+
+
+/* Function:  p7_trace_FauxFromMSARange()
+ * Synopsis:  Create faux tracebacks for a range of seqs in an MSA.
+ *
+ * Purpose:   Same as <p7_trace_FauxFromMSA()>, but only for sequences
+ *            <idx0..idx1-1> of the <msa>: set <tr[idx0..idx1-1]>, and
+ *            leave the rest of <tr> alone. Different threads can fill
+ *            disjoint ranges of the same <tr> array; model
+ *            construction in <build.c> does this for big alignments.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation error; <tr[idx0..idx1-1]> are
+ *            then NULL.
+ */
+int
+p7_trace_FauxFromMSARange(ESL_MSA *msa, int *matassign, int optflags, int idx0, int idx1, P7_TRACE **tr)
 {		      
   int  idx;			/* counter over seqs in MSA */
   int  k;                       /* position in HMM                 */
@@ -1283,9 +1304,9 @@ p7_trace_FauxFromMSA(ESL_MSA *msa, int *matassign, int optflags, P7_TRACE **tr)
   int  showpos;			/* coord to actually record: apos or rpos */
   int  status = eslOK;
  
-  for (idx = 0; idx < msa->nseq; idx++) tr[idx] = NULL;
+  for (idx = idx0; idx < idx1; idx++) tr[idx] = NULL;
  
-  for (idx = 0; idx < msa->nseq; idx++)
+  for (idx = idx0; idx < idx1; idx++)
     {
       if ((tr[idx] = p7_trace_Create())                      == NULL) goto ERROR; 
       if ((status  = p7_trace_Append(tr[idx], p7T_B, 0, 0)) != eslOK) goto ERROR;
@@ -1337,7 +1358,7 @@ p7_trace_FauxFromMSA(ESL_MSA *msa, int *matassign, int optflags, P7_TRACE **tr)
 
 
  ERROR:
-  for (idx = 0; idx < msa->nseq; idx++) { p7_trace_Destroy(tr[idx]); tr[idx] = NULL; }
+  for (idx = idx0; idx < idx1; idx++) { p7_trace_Destroy(tr[idx]); tr[idx] = NULL; }
   return status; 
 }
 
@@ -0,0 +1,308 @@
+/* P7_WORDSEEDS: a k-mer word seed prefilter for single sequence queries.
+ *
+ * phmmer's profile is built from one query sequence and a score
+ * matrix. Most targets in a large database have no short word that
+ * scores well against any word of the query, and those targets
+ * almost never pass the MSV filter anyway. Like BLAST's word
+ * seeding, we precompute the query "neighbourhood": every k-mer <w>
+ * that scores at least <T> against some k-mer of the query under the
+ * score matrix. A target with no neighbourhood word anywhere in it
+ * is dropped before MSV. Testing a target is one table lookup per
+ * residue, with a rolling word code.
+ *
+ * This is a lossy filter. A homolog whose alignment to the query
+ * contains no k-mer scoring T or better is lost, however good the
+ * rest of its alignment is. The prefilter is therefore off unless
+ * the caller asks for it.
+ *
+ * The neighbourhood is a table of K^k flags, so k is limited to
+ * p7_WORDSEEDS_MAXK (160000 flags for amino acids at k=4). Query
+ * words containing a noncanonical residue contribute nothing, and
+ * target words containing one never hit.
+ *
+ * Contents:
+ *    1. The P7_WORDSEEDS object.
+ *    2. Internal functions.
+ *    3. Unit tests.
+ *    4. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "easel.h"
+#include "esl_scorematrix.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+
+static void wordseeds_extend(P7_WORDSEEDS *ws, const ESL_SCOREMATRIX *S, const ESL_DSQ *q, const int *bound,
+			     int j, int code, int sc);
+
+
+/*****************************************************************
+ *= 1. The P7_WORDSEEDS object
+ *****************************************************************/
+
+/* Function:  p7_wordseeds_Create()
+ * Synopsis:  Build the word neighbourhood of a query sequence.
+ *
+ * Purpose:   Create a word seed table for digital query sequence
+ *            <qsq>, with word length <k> and neighbourhood score
+ *            threshold <T> under score matrix <S>: a k-mer is a seed
+ *            if it scores $\geq T$ against the k-mer at some position
+ *            of <qsq>. <k> must be in the range
+ *            1..p7_WORDSEEDS_MAXK.
+ *
+ *            The neighbourhood of each query word is enumerated
+ *            depth first, pruned wherever the best possible score of
+ *            the rest of the word can't reach <T>, so the cost
+ *            follows the size of the neighbourhood, not $K^k$ per
+ *            query position.
+ *
+ * Returns:   a pointer to the new table.
+ *
+ * Throws:    <NULL> on allocation failure, or if <k> is out of range.
+ */
+P7_WORDSEEDS *
+p7_wordseeds_Create(const ESL_SQ *qsq, const ESL_SCOREMATRIX *S, int k, int T)
+{
+  P7_WORDSEEDS *ws = NULL;
+  int           bound[p7_WORDSEEDS_MAXK+1];
+  int           rowmax;
+  int           i, j, b;
+  int           status;
+
+  if (k < 1 || k > p7_WORDSEEDS_MAXK) ESL_XEXCEPTION(eslEINVAL, "word length %d out of range", k);
+
+  ESL_ALLOC(ws, sizeof(P7_WORDSEEDS));
+  ws->seed    = NULL;
+  ws->k       = k;
+  ws->T       = T;
+  ws->K       = S->K;
+  ws->nmarked = 0;
+  for (ws->nwords = 1, j = 0; j < k; j++) ws->nwords *= S->K;
+  ESL_ALLOC(ws->seed, sizeof(uint8_t) * ws->nwords);
+  memset(ws->seed, 0, sizeof(uint8_t) * ws->nwords);
+
+  for (i = 1; i + k - 1 <= qsq->n; i++)
+    {
+      for (j = 0; j < k; j++) if (qsq->dsq[i+j] >= ws->K) break;
+      if (j < k) continue;	/* noncanonical residue in this query word */
+
+      /* bound[j] = best possible score of word positions j..k-1 */
+      bound[k] = 0;
+      for (j = k-1; j >= 0; j--)
+	{
+	  for (rowmax = S->s[qsq->dsq[i+j]][0], b = 1; b < S->K; b++)
+	    rowmax = ESL_MAX(rowmax, S->s[qsq->dsq[i+j]][b]);
+	  bound[j] = bound[j+1] + rowmax;
+	}
+      if (bound[0] >= T) wordseeds_extend(ws, S, qsq->dsq+i, bound, 0, 0, 0);
+    }
+  return ws;
+
+ ERROR:
+  p7_wordseeds_Destroy(ws);
+  return NULL;
+}
+
+
+/* Function:  p7_wordseeds_Hit()
+ * Synopsis:  Test whether a target contains a seed word.
+ *
+ * Purpose:   Return <TRUE> if digital target sequence <dsq> of length
+ *            <L> contains at least one seed word of <ws>, and <FALSE>
+ *            if it doesn't (including when <L> is shorter than the
+ *            word length).
+ */
+int
+p7_wordseeds_Hit(const P7_WORDSEEDS *ws, const ESL_DSQ *dsq, int L)
+{
+  int code = 0;
+  int run  = 0;			/* # of canonical residues ending at i, up to k */
+  int i;
+
+  if (ws->nmarked == 0) return FALSE;
+  for (i = 1; i <= L; i++)
+    {
+      if (dsq[i] >= ws->K) { run = 0; code = 0; continue; }
+      code = (code * ws->K + dsq[i]) % ws->nwords;
+      if (run < ws->k) run++;
+      if (run == ws->k && ws->seed[code]) return TRUE;
+    }
+  return FALSE;
+}
+
+
+/* Function:  p7_wordseeds_Destroy()
+ * Synopsis:  Free a word seed table.
+ */
+void
+p7_wordseeds_Destroy(P7_WORDSEEDS *ws)
+{
+  if (ws)
+    {
+      if (ws->seed) free(ws->seed);
+      free(ws);
+    }
+}
+/*------------------ end, P7_WORDSEEDS --------------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions
+ *****************************************************************/
+
+/* wordseeds_extend()
+ *
+ * Mark every completion of the first <j> word positions (packed in
+ * <code>, scoring <sc> so far against query word <q>) that can reach
+ * the threshold; <bound[j]> is the best the rest can add.
+ */
+static void
+wordseeds_extend(P7_WORDSEEDS *ws, const ESL_SCOREMATRIX *S, const ESL_DSQ *q, const int *bound,
+		 int j, int code, int sc)
+{
+  int b;
+
+  if (j == ws->k)
+    {
+      if (! ws->seed[code]) { ws->seed[code] = TRUE; ws->nmarked++; }
+      return;
+    }
+  for (b = 0; b < ws->K; b++)
+    if (sc + S->s[q[j]][b] + bound[j+1] >= ws->T)
+      wordseeds_extend(ws, S, q, bound, j+1, code * ws->K + b, sc + S->s[q[j]][b]);
+}
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7WORDSEEDS_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_brute()
+ *
+ * For random queries and targets, p7_wordseeds_Hit() agrees with a
+ * brute force comparison of every query word to every target word;
+ * and a target that contains a query word scoring T or better
+ * against itself always hits.
+ */
+static void
+utest_brute(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, P7_BG *bg, ESL_SCOREMATRIX *S, int k, int T, int ntrials)
+{
+  char          msg[] = "p7_wordseeds brute unit test failed";
+  ESL_SQ       *qsq   = esl_sq_CreateDigital(abc);
+  ESL_DSQ      *dsq   = NULL;
+  P7_WORDSEEDS *ws    = NULL;
+  int           qL    = 30;
+  int           L     = 50;
+  int           i, j, n, sc;
+  int           expect;
+  int           t;
+  int           status;
+
+  ESL_ALLOC(dsq, sizeof(ESL_DSQ) * (L+2));
+  if (esl_sq_GrowTo(qsq, qL) != eslOK) esl_fatal(msg);
+  for (t = 0; t < ntrials; t++)
+    {
+      if (esl_rsq_xfIID(rng, bg->f, abc->K, qL, qsq->dsq) != eslOK) esl_fatal(msg);
+      qsq->n = qL;
+      if (t % 4 == 1) qsq->dsq[1 + esl_rnd_Roll(rng, qL)] = esl_abc_XGetUnknown(abc);
+      if ((ws = p7_wordseeds_Create(qsq, S, k, T)) == NULL) esl_fatal(msg);
+
+      if (esl_rsq_xfIID(rng, bg->f, abc->K, L, dsq) != eslOK) esl_fatal(msg);
+      if (t % 3 == 2) dsq[1 + esl_rnd_Roll(rng, L)] = esl_abc_XGetUnknown(abc);
+
+      for (expect = FALSE, i = 1; ! expect && i + k - 1 <= qL; i++)
+	for (j = 1; ! expect && j + k - 1 <= L; j++)
+	  {
+	    for (sc = 0, n = 0; n < k; n++)
+	      {
+		if (qsq->dsq[i+n] >= abc->K || dsq[j+n] >= abc->K) break;
+		sc += S->s[qsq->dsq[i+n]][dsq[j+n]];
+	      }
+	    if (n == k && sc >= T) expect = TRUE;
+	  }
+      if (p7_wordseeds_Hit(ws, dsq, L) != expect) esl_fatal(msg);
+
+      /* a canonical query word that scores >= T against itself is a seed */
+      for (i = 1; i + k - 1 <= qL; i++)
+	{
+	  for (sc = 0, n = 0; n < k; n++)
+	    {
+	      if (qsq->dsq[i+n] >= abc->K) break;
+	      sc += S->s[qsq->dsq[i+n]][qsq->dsq[i+n]];
+	    }
+	  if (n == k && sc >= T && ! p7_wordseeds_Hit(ws, qsq->dsq+i-1, k)) esl_fatal(msg);
+	}
+      if (p7_wordseeds_Hit(ws, dsq, k-1)) esl_fatal(msg);
+
+      p7_wordseeds_Destroy(ws);
+      esl_sq_Reuse(qsq);
+    }
+
+  free(dsq);
+  esl_sq_Destroy(qsq);
+  return;
+
+ ERROR:
+  esl_fatal(msg);
+}
+#endif /*p7WORDSEEDS_TESTDRIVE*/
+/*--------------------- end, unit tests -------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver.
+ *****************************************************************/
+#ifdef p7WORDSEEDS_TESTDRIVE
+/*
+  gcc -o p7_wordseeds_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7WORDSEEDS_TESTDRIVE p7_wordseeds.c -lhmmer -leasel -lm
+  ./p7_wordseeds_utest
+*/
+#include "esl_getopts.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-N",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "number of random trials per test",                 0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for P7_WORDSEEDS";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS     *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS  *rng = esl_randomness_Create(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET    *abc = esl_alphabet_Create(eslAMINO);
+  P7_BG           *bg  = p7_bg_Create(abc);
+  ESL_SCOREMATRIX *S   = esl_scorematrix_Create(abc);
+  int              N   = esl_opt_GetInteger(go, "-N");
+
+  if (esl_scorematrix_Set("BLOSUM62", S) != eslOK) esl_fatal("failed to set BLOSUM62 scores");
+
+  utest_brute(rng, abc, bg, S, 1,  4, N);
+  utest_brute(rng, abc, bg, S, 2,  9, N);
+  utest_brute(rng, abc, bg, S, 3, 11, N);
+  utest_brute(rng, abc, bg, S, 3, 15, N);
+
+  esl_scorematrix_Destroy(S);
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7WORDSEEDS_TESTDRIVE*/
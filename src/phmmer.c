@@ -30,28 +30,48 @@
 
 #include "hmmer.h"
 
-typedef struct {
+typedef struct worker_s {
 #ifdef HMMER_THREADS
   ESL_WORK_QUEUE   *queue;
+  P7_CPUBIND       *cpubind;     /* --cpubind, --readercpu; or NULL         */
 #endif
   P7_BG            *bg;
   P7_PIPELINE      *pli;
   P7_TOPHITS       *th;
   P7_OPROFILE      *om;
+  int               sqviews;     /* TRUE if targets are p7_seqdb views, not to be esl_sq_Reuse()'d */
+  struct worker_s  *qnext;       /* same worker, next query of a batch (--qbatch); NULL if none */
 } WORKER_INFO;
 
+/* one query of a batch (--qbatch), held from its setup until its results are output */
+typedef struct {
+  ESL_SQ           *qsq;
+  P7_OPROFILE      *om;
+  P7_WORDSEEDS     *ws;          /* word seed prefilter (--wordk), or NULL */
+  int               nquery;      /* which query of <seqfile> this is, 1..; for the tabular output headers */
+} QUERY_INFO;
+
+/* one thread building the query models of a batch: queries w, w+nw, w+2nw... */
+typedef struct {
+  P7_BUILDER       *bld;
+  P7_BG            *bg;
+  QUERY_INFO       *batch;
+  int               nb;
+  int               w;
+  int               nw;
+} BUILD_INFO;
+
 #define REPOPTS     "-E,-T,--cut_ga,--cut_nc,--cut_tc"
 #define DOMREPOPTS  "--domE,--domT,--cut_ga,--cut_nc,--cut_tc"
 #define INCOPTS     "--incE,--incT,--cut_ga,--cut_nc,--cut_tc"
 #define INCDOMOPTS  "--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 #define THRESHOPTS  "-E,-T,--domE,--domT,--incE,--incT,--incdomE,--incdomT,--cut_ga,--cut_nc,--cut_tc"
 
-#if defined (HMMER_THREADS) && defined (HMMER_MPI)
-#define CPUOPTS     "--mpi"
-#define MPIOPTS     "--cpu"
+/* --qbatch only applies to the serial/threaded master, not to MPI */
+#ifdef HMMER_MPI
+#define QBATCHOPTS  "--mpi"
 #else
-#define CPUOPTS     NULL
-#define MPIOPTS     NULL
+#define QBATCHOPTS  NULL
 #endif
 
 static ESL_OPTIONS options[] = {
@@ -77,6 +97,7 @@ static ESL_OPTIONS options[] = {
   { "-T",           eslARG_REAL,        FALSE, NULL,  NULL,     NULL,  NULL,  REPOPTS,           "report sequences >= this score threshold in output",           4 },
   { "--domE",       eslARG_REAL,       "10.0", NULL, "x>0",     NULL,  NULL,  DOMREPOPTS,        "report domains <= this E-value threshold in output",           4 },
   { "--domT",       eslARG_REAL,        FALSE, NULL,  NULL,     NULL,  NULL,  DOMREPOPTS,        "report domains >= this score cutoff in output",                4 },
+  { "--topk",       eslARG_INT,         FALSE, NULL,  "n>0",    NULL,  NULL,  NULL,              "report only the <n> best sequences; skip work on the rest",    4 },
 /* Control of inclusion thresholds */
   { "--incE",       eslARG_REAL,       "0.01", NULL, "x>0",     NULL,  NULL,  INCOPTS,           "consider sequences <= this E-value threshold as significant",  5 },
   { "--incT",       eslARG_REAL,        FALSE, NULL,  NULL,     NULL,  NULL,  INCOPTS,           "consider sequences >= this score threshold as significant",    5 },
@@ -92,6 +113,16 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,       "1e-3", NULL, NULL,      NULL,  NULL, "--max",            "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,       "1e-5", NULL, NULL,      NULL,  NULL, "--max",            "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL, "--max",            "turn off composition bias filter",                             7 },
+  { "--adapt",      eslARG_NONE,       FALSE,  NULL, NULL,      NULL,  NULL, "--max",            "tighten filters if far too many targets pass them",            7 },
+  { "--vitdom",     eslARG_NONE,       FALSE,  NULL, NULL,      NULL,  NULL, NULL,               "define one-domain targets by their Viterbi path (faster)",     7 },
+  { "--seqscore_only", eslARG_NONE,     FALSE,  NULL, NULL,      NULL,  NULL, "-A,--domtblout,--vitdom", "per-sequence scores only: no Backward, no domains (faster)", 7 },
+  { "--dd_threads", eslARG_INT,         "0",   NULL, "n>=0",    NULL,  NULL, NULL,               "define domains of a multidomain target in <n> threads",        7 },
+  { "--dd_ramlimit", eslARG_INT,        "0",   NULL, "n>=0",    NULL,  NULL, NULL,               "cap full envelope DP matrices at <n> MB (0: no cap)",          7 },
+  { "--dd_nbatch",  eslARG_INT,         "0",   NULL, "n>=0",    NULL,  NULL, NULL,               "sample domain traces in batches of <n>, stopping early",       7 },
+  { "--dd_deferali", eslARG_NONE,       FALSE, NULL, NULL,      NULL,  NULL, NULL,               "align domains only of targets that are reported",              7 },
+  { "--dd_bf16",    eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL, NULL,               "keep envelope DP matrices in bfloat16 (half the memory)",      7 },
+  { "--wordk",      eslARG_INT,        FALSE,  NULL, "1<=n<=4", NULL,  NULL, "--max",            "prefilter: skip targets w/o a query word neighbour of length <n>", 7 },
+  { "--wordT",      eslARG_INT,         "11",  NULL, NULL,      NULL,"--wordk", NULL,            "score threshold for --wordk neighbourhood words",              7 },
 /* Control of E-value calibration */
   { "--EmL",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,              "length of sequences for MSV Gumbel mu fit",                   11 },   
   { "--EmN",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,              "number of sequences for MSV Gumbel mu fit",                   11 },   
@@ -105,14 +136,25 @@ static ESL_OPTIONS options[] = {
   { "-Z",           eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,         "42",  NULL, "n>=0",    NULL,  NULL,  NULL,              "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
+  { "--timing",     eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL,  NULL,              "report time spent in each stage of the pipeline",             12 },
+  { "--memstats",   eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL,  NULL,              "report memory high-water marks of the pipeline",              12 },
+  { "--membudget",  eslARG_INT,         NULL,  NULL, "n>0",     NULL,  NULL,  NULL,              "keep each pipeline under <n> MB of DP memory",                12 },
+  { "--hugepages",  eslARG_STRING,      NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "put big buffers in hugepages: <s> = off|thp|2M|1G",           12 },
   { "--qformat",    eslARG_STRING,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "assert query <seqfile> is in format <s>: no autodetection",   12 },
   { "--tformat",    eslARG_STRING,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "assert target <seqdb> is in format <s>>: no autodetection",   12 },
+  { "--tlist",      eslARG_INFILE,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "only search the targets named in file <f>, found by SSI index", 12 },
+  { "--qbatch",     eslARG_INT,          "1", NULL, "n>0",     NULL,  NULL,  QBATCHOPTS,        "search <n> queries per pass through <seqdb>",                 12 },
+  { "--qcache",     eslARG_STRING,      NULL, NULL, NULL,      NULL,  NULL,  NULL,              "keep calibrated query models in directory <d>, and reuse them", 12 },
 #ifdef HMMER_THREADS
-  { "--cpu",        eslARG_INT,  p7_NCPU,"HMMER_NCPU", "n>=0",NULL,  NULL,  CPUOPTS,            "number of parallel CPU workers to use for multithreads",      12 },
+  { "--cpu",        eslARG_INT,  p7_NCPU,"HMMER_NCPU", "n>=0",NULL,  NULL,  NULL,               "number of parallel CPU workers to use for multithreads",      12 },
+  { "--cpubind",    eslARG_STRING, NULL, NULL, NULL,    NULL,  NULL,  NULL,            "pin workers to cpus: 'cores', 'sockets', or a list <s> (0-7,16)", 12 },
+  { "--readercpu",  eslARG_INT,    NULL, NULL, "n>=0",  NULL,  NULL,  NULL,            "reserve cpu <n> for the reader and output threads",           12 },
+  { "--nblocks",    eslARG_INT,          "2", NULL, "n>0",     NULL,  NULL,  NULL,              "number of target blocks queued per worker thread",            12 },
+  { "--readahead",  eslARG_INT,          "0", NULL, "n>=0",    NULL,  NULL,  NULL,              "keep <n> MB of <seqdb> read ahead of the parser (0: off)",    12 },
 #endif
 #ifdef HMMER_MPI
   { "--stall",      eslARG_NONE,   FALSE, NULL, NULL,      NULL,"--mpi", NULL,              "arrest after start: for debugging MPI under gdb",             12 },  
-  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  MPIOPTS,           "run as an MPI parallel program",                              12 },
+  { "--mpi",        eslARG_NONE,   FALSE, NULL, NULL,      NULL,  NULL,  NULL,              "run as an MPI parallel program",                              12 },
 #endif
 
   /* Restrict search to subset of database - hidden because these flags are
@@ -147,13 +189,17 @@ struct cfg_s {
 };
 
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
+static P7_BUILDER *create_builder(ESL_GETOPTS *go, ESL_ALPHABET *abc, P7_BG *bg);
 static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  serial_loop_seqdb(WORKER_INFO *info, P7_SEQDB *sqdb);
 
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_READAHEAD *ra, int n_targetseqs, int max_residues);
+static int  thread_loop_seqdb(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_SEQDB *sqdb, int max_residues);
 static void pipeline_thread(void *arg);
+static void build_thread(void *arg);
 #endif 
 
 #ifdef HMMER_MPI
@@ -214,6 +260,9 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_qfil
   if (strcmp(*ret_qfile, "-") == 0 && strcmp(*ret_dbfile, "-") == 0) 
     { if (puts("Either <seqfile> or <seqdb> may be '-' (to read from stdin), but not both.") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");  goto FAILURE; }
 
+  if (esl_opt_IsOn(go, "--hugepages") && p7_hugemem_SetMode(esl_opt_GetString(go, "--hugepages")) != eslOK)
+    { if (printf("--hugepages takes off, thp, 2M or 1G, not %s\n", esl_opt_GetString(go, "--hugepages")) < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed"); goto FAILURE; }
+
   *ret_go = go;
   return eslOK;
   
@@ -255,6 +304,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "-T")          && fprintf(ofp, "# sequence reporting threshold:    score >= %g\n",    esl_opt_GetReal(go, "-T"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domE")      && fprintf(ofp, "# domain reporting threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--domE"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domT")      && fprintf(ofp, "# domain reporting threshold:      score >= %g\n",    esl_opt_GetReal(go, "--domT"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--topk")      && fprintf(ofp, "# report only the top:             %d sequences\n",   esl_opt_GetInteger(go, "--topk"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incE")      && fprintf(ofp, "# sequence inclusion threshold:    E-value <= %g\n",  esl_opt_GetReal(go, "--incE"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incT")      && fprintf(ofp, "# sequence inclusion threshold:    score >= %g\n",    esl_opt_GetReal(go, "--incT"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--incdomE")   && fprintf(ofp, "# domain inclusion threshold:      E-value <= %g\n",  esl_opt_GetReal(go, "--incdomE"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -267,6 +317,14 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--F2")        && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--adapt")     && fprintf(ofp, "# adaptive filter thresholds:      on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--vitdom")    && fprintf(ofp, "# Viterbi-path domain definition:  on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seqscore_only") && fprintf(ofp, "# per-sequence scores only:        on\n")                                               < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_threads") && fprintf(ofp, "# domain definition threads:       %d\n", esl_opt_GetInteger(go, "--dd_threads"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_ramlimit") && fprintf(ofp, "# domain definition RAM limit:     %d MB\n", esl_opt_GetInteger(go, "--dd_ramlimit"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_nbatch")  && fprintf(ofp, "# domain trace sample batch size:  %d\n", esl_opt_GetInteger(go, "--dd_nbatch"))           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_deferali") && fprintf(ofp, "# deferred domain alignment:       on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--dd_bf16")    && fprintf(ofp, "# bfloat16 envelope matrices:      on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") && fprintf(ofp, "# Restrict db to start at seq key: %s\n",            esl_opt_GetString(go, "--restrictdb_stkey"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_n")     && fprintf(ofp, "# Restrict db to # target seqs:    %d\n",            esl_opt_GetInteger(go, "--restrictdb_n")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--ssifile")          && fprintf(ofp, "# Override ssi file to:            %s\n",            esl_opt_GetString(go, "--ssifile"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -281,14 +339,25 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--Eft")       && fprintf(ofp, "# tail mass for Fwd exp tau fit:   %f\n",             esl_opt_GetReal   (go, "--Eft"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--qcache")    && fprintf(ofp, "# query model cache:               %s\n",             esl_opt_GetString(go, "--qcache"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
     if (esl_opt_GetInteger(go, "--seed") == 0 && fprintf(ofp, "# random number seed:              one-time arbitrary\n")                             < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
     else if (                                    fprintf(ofp, "# random number seed set to:       %d\n",      esl_opt_GetInteger(go, "--seed"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   }
+  if (esl_opt_IsUsed(go, "--timing")     && fprintf(ofp, "# pipeline stage timing:           on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--memstats")   && fprintf(ofp, "# pipeline memory statistics:      on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--membudget")  && fprintf(ofp, "# pipeline memory budget:          %d MB\n", esl_opt_GetInteger(go, "--membudget"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--hugepages")  && fprintf(ofp, "# hugepages for big buffers:       %s\n", esl_opt_GetString(go, "--hugepages"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--qformat")   && fprintf(ofp, "# query <seqfile> format asserted: %s\n",            esl_opt_GetString(go, "--qformat"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--tformat")   && fprintf(ofp, "# target <seqdb> format asserted:  %s\n",            esl_opt_GetString(go, "--tformat"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--tlist")     && fprintf(ofp, "# targets restricted to list:      %s\n",            esl_opt_GetString(go, "--tlist"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--qbatch")    && fprintf(ofp, "# queries per pass over <seqdb>:   %d\n",           esl_opt_GetInteger(go, "--qbatch"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #ifdef HMMER_THREADS
   if (esl_opt_IsUsed(go, "--cpu")       && fprintf(ofp, "# number of worker threads:        %d\n",            esl_opt_GetInteger(go, "--cpu"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
+  if (esl_opt_IsUsed(go, "--nblocks")   && fprintf(ofp, "# target blocks queued per thread: %d\n",            esl_opt_GetInteger(go, "--nblocks"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--readahead") && fprintf(ofp, "# target readahead (MB):           %d\n",            esl_opt_GetInteger(go, "--readahead")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--cpubind")    && fprintf(ofp, "# worker threads pinned to:        %s\n",             esl_opt_GetString(go, "--cpubind"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--readercpu")  && fprintf(ofp, "# reader threads pinned to cpu:    %d\n",             esl_opt_GetInteger(go, "--readercpu")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 #endif
 #ifdef HMMER_MPI
   if (esl_opt_IsUsed(go, "--mpi")       && fprintf(ofp, "# MPI:                             on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -335,6 +404,9 @@ main(int argc, char **argv)
   if ( cfg.n_targetseq != -1 && cfg.n_targetseq < 1 )
     p7_Fail("--restrictdb_n must be >= 1\n");
 
+  if (esl_opt_IsOn(go, "--tlist") && (cfg.firstseq_key != NULL || cfg.n_targetseq != -1))
+    p7_Fail("--tlist can't be combined with --restrictdb_stkey or --restrictdb_n\n");
+
   /* Figure out who we are, and send control there: 
    * we might be an MPI master, an MPI worker, or a serial program.
    */
@@ -347,6 +419,7 @@ main(int argc, char **argv)
 
   if (esl_opt_GetBoolean(go, "--mpi")) 
     {
+      if (esl_opt_IsOn(go, "--tlist")) p7_Fail("--tlist doesn't work with --mpi\n");
       cfg.do_mpi     = TRUE;
       MPI_Init(&argc, &argv);
       MPI_Comm_rank(MPI_COMM_WORLD, &(cfg.my_rank));
@@ -368,6 +441,41 @@ main(int argc, char **argv)
   return status;
 }
 
+/* create_builder()
+ * 
+ * Create a builder for the single sequence query models, with only
+ * the options phmmer needs.
+ */
+static P7_BUILDER *
+create_builder(ESL_GETOPTS *go, ESL_ALPHABET *abc, P7_BG *bg)
+{
+  P7_BUILDER *bld = p7_builder_Create(NULL, abc);
+  int         seed;
+  int         status;
+
+  if (bld == NULL) p7_Fail("Failed to create query model builder");
+  if ((seed = esl_opt_GetInteger(go, "--seed")) > 0)
+    {				/* a little wasteful - we're blowing a couple of usec by reinitializing */
+      esl_randomness_Init(bld->r, seed);
+      bld->do_reseeding = TRUE;
+    }
+  bld->EmL = esl_opt_GetInteger(go, "--EmL");
+  bld->EmN = esl_opt_GetInteger(go, "--EmN");
+  bld->EvL = esl_opt_GetInteger(go, "--EvL");
+  bld->EvN = esl_opt_GetInteger(go, "--EvN");
+  bld->EfL = esl_opt_GetInteger(go, "--EfL");
+  bld->EfN = esl_opt_GetInteger(go, "--EfN");
+  bld->Eft = esl_opt_GetReal   (go, "--Eft");
+
+  /* Default is stored in the --mx option, so it's always IsOn(). Check --mxfile first; then go to the --mx option and the default. */
+  if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
+  else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
+  if (status != eslOK) p7_Fail("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+
+  if (esl_opt_IsOn(go, "--qcache") && p7_builder_SetQueryCache(bld, esl_opt_GetString(go, "--qcache")) != eslOK) p7_Fail("Failed to set query model cache");
+  return bld;
+}
+
 /* serial_master()
  * For each query sequence in <seqfile> search the database for hits.
  * 
@@ -387,14 +495,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              qformat  = eslSQFILE_UNKNOWN;  /* format of qfile                                  */
   ESL_SQFILE      *qfp      = NULL;		  /* open qfile                                       */
   ESL_SQ          *qsq      = NULL;               /* query sequence                                   */
+  P7_OPROFILE     *om       = NULL;               /* optimized query profile                          */
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                 */
   ESL_SQFILE      *dbfp     = NULL;               /* open dbfile                                      */
+  P7_SEQDB        *sqdb     = NULL;               /* its pressed form (hmmseqpress), if there is one  */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                                */
   P7_BG           *bg       = NULL;		  /* null model (copies made of this into threads)    */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                   */
+  BUILD_INFO      *binfo    = NULL;               /* [0..nbld-1] query model builders, if threaded    */
+  int              nbld     = 0;
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                       */
   int              nquery   = 0;
-  int              seed;
+  int              npass    = 0;                  /* # of passes through the target database          */
   int              textw;
   int              status   = eslOK;
   int              qstatus  = eslOK;
@@ -402,12 +514,21 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              i;
   int              ncpus    = 0;
   int              infocnt  = 0;
-  WORKER_INFO     *info     = NULL;
+  WORKER_INFO     *infoset  = NULL;     /* [0..qbatch*infocnt-1]: row <q> holds the workers of query <q> in a batch */
+  WORKER_INFO     *info     = NULL;     /* current row of <infoset>    */
+  QUERY_INFO      *batch    = NULL;     /* [0..qbatch-1]: the queries of a batch */
+  int              qbatch   = esl_opt_GetInteger(go, "--qbatch");
+  int              nb, q;
+  int              batchM;              /* nodes of a batch's models: each target block goes through all */
+  P7_TOPHITS     **thl      = NULL;     /* the other workers' hit lists, for p7_tophits_MergeMany() */
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
   ESL_WORK_QUEUE  *queue    = NULL;
+  P7_CPUBIND      *cpubind  = NULL;
+  P7_READAHEAD    *ra       = NULL;     /* readahead of <dbfp> (--readahead), or NULL */
 #endif
+  char             errbuf[eslERRBUFSIZE];
 
   /* Initializations */
   abc     = esl_alphabet_Create(eslAMINO);
@@ -428,24 +549,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   /* Initialize a default builder configuration,
    * then set only the options we need for single sequence search
    */
-  bld = p7_builder_Create(NULL, abc);
-  if ((seed = esl_opt_GetInteger(go, "--seed")) > 0)
-    {				/* a little wasteful - we're blowing a couple of usec by reinitializing */
-      esl_randomness_Init(bld->r, seed);
-      bld->do_reseeding = TRUE;
-    }
-  bld->EmL = esl_opt_GetInteger(go, "--EmL");
-  bld->EmN = esl_opt_GetInteger(go, "--EmN");
-  bld->EvL = esl_opt_GetInteger(go, "--EvL");
-  bld->EvN = esl_opt_GetInteger(go, "--EvN");
-  bld->EfL = esl_opt_GetInteger(go, "--EfL");
-  bld->EfN = esl_opt_GetInteger(go, "--EfN");
-  bld->Eft = esl_opt_GetReal   (go, "--Eft");
-
-  /* Default is stored in the --mx option, so it's always IsOn(). Check --mxfile first; then go to the --mx option and the default. */
-  if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
-  else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
-  if (status != eslOK) p7_Fail("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  bld = create_builder(go, abc, bg);
 
   /* Open results output files */
   if (esl_opt_IsOn(go, "-o"))          { if ((ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  p7_Fail("Failed to open output file %s for writing\n",                 esl_opt_GetString(go, "-o")); } 
@@ -454,21 +558,49 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  p7_Fail("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
 
-  /* Open the target sequence database for sequential access. */
-  status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
-  if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
-  else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
-  else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
-  else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
+  /* Open the target sequence database for sequential access: a
+   * current pressed copy (<seqdb>.h3q, from hmmseqpress) is mapped
+   * instead of parsing it, unless a format was asserted or the search
+   * is restricted to a range or list of it.
+   */
+  if (dbformat == eslSQFILE_UNKNOWN && strcmp(cfg->dbfile, "-") != 0 && cfg->firstseq_key == NULL && cfg->n_targetseq < 0 && ! esl_opt_IsOn(go, "--tlist"))
+    {
+      status = p7_seqdb_Open(cfg->dbfile, &sqdb, errbuf);
+      if      (status == eslEFORMAT) p7_Fail("Pressed sequence file for %s is unusable; rerun hmmseqpress -f, or delete it:\n%s\n", cfg->dbfile, errbuf);
+      else if (status == eslEMEM)    p7_Fail("Failed to open pressed sequence file %s%s\n", cfg->dbfile, p7_SEQDB_SUFFIX);
+      if (sqdb && p7_seqdb_SetDigital(sqdb, abc) != eslOK) p7_Fail("Pressed sequence file %s isn't protein\n", sqdb->dbfile);
+    }
 
+  if (sqdb == NULL)
+    {
+      status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
+      if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
+      else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
+      else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
+      else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
+    }
 
-  if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n")) {
+  if (dbfp && (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n") || esl_opt_IsOn(go, "--tlist"))) {
     if (esl_opt_IsUsed(go, "--ssifile"))
-      esl_sqfile_OpenSSI(dbfp, esl_opt_GetString(go, "--ssifile"));
+      status = esl_sqfile_OpenSSI(dbfp, esl_opt_GetString(go, "--ssifile"));
     else
-      esl_sqfile_OpenSSI(dbfp, NULL);
+      status = esl_sqfile_OpenSSI(dbfp, NULL);
+    if (status != eslOK && esl_opt_IsOn(go, "--tlist")) p7_Fail("--tlist needs an SSI index of %s; make one with esl-sfetch --index\n", cfg->dbfile);
   }
 
+  /* With --tlist, fetch the listed targets once, by their SSI offsets
+   * in file order, and search that in-memory database as a pressed
+   * one, for every query.
+   */
+  if (dbfp && esl_opt_IsOn(go, "--tlist"))
+    {
+      status = p7_seqdb_LoadList(dbfp, esl_opt_GetString(go, "--tlist"), &sqdb, errbuf);
+      if (status != eslOK) p7_Fail("Failed to read the targets listed in %s:\n%s\n", esl_opt_GetString(go, "--tlist"), errbuf);
+      if (p7_seqdb_SetDigital(sqdb, abc) != eslOK) p7_Fail("Targets listed in %s aren't protein\n", esl_opt_GetString(go, "--tlist"));
+      esl_sqfile_Close(dbfp);
+      dbfp = NULL;
+    }
+
 
   /* Open the query sequence file  */
   status = esl_sqfile_OpenDigital(abc, cfg->qfile, qformat, NULL, &qfp);
@@ -476,39 +608,80 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   p7_Fail("Sequence file %s is empty or misformatted\n",        cfg->qfile);
   else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        p7_Fail ("Unexpected error %d opening sequence file %s\n", status, cfg->qfile);
-  qsq  = esl_sq_CreateDigital(abc);
 
 #ifdef HMMER_THREADS
   /* initialize thread data */
   ncpus = ESL_MIN( esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (esl_opt_IsOn(go, "--cpubind") || esl_opt_IsOn(go, "--readercpu"))
+    {
+      status = p7_cpubind_Create(esl_opt_GetString(go, "--cpubind"), (esl_opt_IsOn(go, "--readercpu") ? esl_opt_GetInteger(go, "--readercpu") : -1), &cpubind, errbuf);
+      if      (status == eslEUNIMPLEMENTED) fprintf(stderr, "Warning: %s\n", errbuf);
+      else if (status != eslOK)             p7_Fail("%s\n", errbuf);
+      p7_cpubind_Reader(cpubind);   /* before any thread starts: they inherit it */
+    }
   if (ncpus > 0)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
-      queue = esl_workqueue_Create(ncpus * 2);
+      queue = esl_workqueue_Create(ncpus * esl_opt_GetInteger(go, "--nblocks"));
+      if (dbfp) ra = p7_readahead_Open(cfg->dbfile, (size_t) esl_opt_GetInteger(go, "--readahead") * 1024 * 1024);
     }
 #endif
 
   infocnt = (ncpus <= 0) ? 1 : ncpus;    
-  ESL_ALLOC(info, (ptrdiff_t) sizeof(*info) * infocnt); 
+  ESL_ALLOC(infoset, (ptrdiff_t) sizeof(*infoset) * infocnt * qbatch);
+
+  /* With threads and batches, the query models of a batch are built
+   * in parallel, one builder per thread. When calibrations reseed
+   * their RNG (the default), the models don't depend on which thread
+   * built them.
+   */
+  nbld = (ncpus > 0 ? ESL_MIN(ncpus, qbatch) : 0);
+  if (nbld > 1)
+    {
+      ESL_ALLOC(binfo, sizeof(BUILD_INFO) * nbld);
+      for (i = 0; i < nbld; i++)
+	{
+	  binfo[i].bld   = (i == 0 ? bld : create_builder(go, abc, bg));
+	  binfo[i].bg    = p7_bg_Clone(bg);
+	  binfo[i].batch = NULL;
+	  binfo[i].nb    = 0;
+	  binfo[i].w     = i;
+	  binfo[i].nw    = nbld;
+	}
+    }
+  ESL_ALLOC(batch,   (ptrdiff_t) sizeof(*batch)   * qbatch);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
+  info = infoset;
+
+  for (q = 0; q < qbatch; q++)
+    {
+      batch[q].qsq = esl_sq_CreateDigital(abc);
+      batch[q].om  = NULL;
+      batch[q].ws  = NULL;
+    }
 
   /* Show header output */
   output_header(ofp, go, cfg->qfile, cfg->dbfile);
 
-  for (i = 0; i < infocnt; ++i)
+  for (i = 0; i < infocnt * qbatch; ++i)
     {
-      info[i].pli   = NULL;
-      info[i].th    = NULL;
-      info[i].om    = NULL;
-      info[i].bg    = p7_bg_Clone(bg);
+      infoset[i].pli     = NULL;
+      infoset[i].th      = NULL;
+      infoset[i].om      = NULL;
+      infoset[i].qnext   = NULL;
+      infoset[i].bg      = p7_bg_Clone(bg);
+      infoset[i].sqviews = (sqdb != NULL);
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      infoset[i].queue   = queue;
+      infoset[i].cpubind = cpubind;
 #endif
     }
 
 #ifdef HMMER_THREADS
-  for (i = 0; i < ncpus * 2; ++i)
+  for (i = 0; i < ncpus * esl_opt_GetInteger(go, "--nblocks"); ++i)
     {
-      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
+      if (sqdb) block = p7_seqdb_CreateBlock(BLOCK_SIZE); /* views into <sqdb>; no sequence memory of their own */
+      else      block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
       if (block == NULL) 
 	{
 	  p7_Fail("Failed to allocate sequence block");
@@ -522,18 +695,27 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     }
 #endif
 
-  /* Outer loop over sequence queries */
-  while ((qstatus = esl_sqio_Read(qfp, qsq)) == eslOK)
+  /* Outer loop over sequence queries, in batches of up to <qbatch>
+   * (--qbatch). The target database is read once per batch; each
+   * block of it is searched with all the batch's queries before the
+   * next block is read.
+   */
+  while (qstatus == eslOK)
     {
-      P7_OPROFILE     *om       = NULL;           /* optimized query profile                  */
-
-      nquery++;
-      if (qsq->n == 0) continue; /* skip zero length seqs as if they aren't even present */
+      for (nb = 0; nb < qbatch && (qstatus = esl_sqio_Read(qfp, batch[nb].qsq)) == eslOK; )
+	{
+	  nquery++;
+	  if (batch[nb].qsq->n == 0) { esl_sq_Reuse(batch[nb].qsq); continue; } /* skip zero length seqs as if they aren't even present */
+	  batch[nb++].nquery = nquery;
+	}
+      if (nb == 0) break;
 
       esl_stopwatch_Start(w);
+      npass++;
 
       /* seqfile may need to be rewound (multiquery mode) */
-      if (nquery > 1)
+      if (sqdb) p7_seqdb_Position(sqdb, 0);
+      else if (npass > 1)
       {
         if (! esl_sqfile_IsRewindable(dbfp)) p7_Fail("Target sequence file %s isn't rewindable; can't search it with multiple queries", cfg->dbfile);
 
@@ -548,32 +730,64 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       }
 
 
-      if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->acc[0]  != '\0' && fprintf(ofp, "Accession:   %s\n", qsq->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      if (qsq->desc[0] != '\0' && fprintf(ofp, "Description: %s\n", qsq->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
-
-
-      /* Build the model */
-      p7_SingleBuilder(bld, qsq, info[0].bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
+#ifdef HMMER_THREADS
+      if (nbld > 1 && nb > 1)
+	{ /* Build the batch's models in parallel */
+	  ESL_THREADS *bthreadObj = esl_threads_Create(&build_thread);
+	  for (i = 0; i < nbld; i++)
+	    {
+	      binfo[i].batch = batch;
+	      binfo[i].nb    = nb;
+	      esl_threads_AddThread(bthreadObj, &binfo[i]);
+	    }
+	  esl_threads_WaitForStart(bthreadObj);
+	  esl_threads_WaitForFinish(bthreadObj);
+	  esl_threads_Destroy(bthreadObj);
+	}
+#endif
 
-      for (i = 0; i < infocnt; ++i)
-      {
-        /* Create processing pipeline and hit list */
-        info[i].th  = p7_tophits_Create();
-        info[i].om  = p7_oprofile_Clone(om);
-        info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-        p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+      for (q = 0; q < nb; q++)
+	{
+	  /* Build the model, unless it was built in parallel above */
+	  if (batch[q].om == NULL)
+	    p7_SingleBuilder(bld, batch[q].qsq, infoset[0].bg, NULL, NULL, NULL, &(batch[q].om)); /* bypass HMM - only need model */
+	  om = batch[q].om;
+	  if (esl_opt_IsOn(go, "--wordk") &&
+	      (batch[q].ws = p7_wordseeds_Create(batch[q].qsq, bld->S, esl_opt_GetInteger(go, "--wordk"), esl_opt_GetInteger(go, "--wordT"))) == NULL)
+	    p7_Fail("Failed to build word seed table for query %s", batch[q].qsq->name);
+
+	  /* Create processing pipelines and hit lists; worker <i> goes through the batch's queries along its qnext chain */
+	  info = infoset + q * infocnt;
+	  for (i = 0; i < infocnt; ++i)
+	    {
+	      info[i].th  = p7_tophits_Create();
+	      info[i].om  = p7_oprofile_Clone(om);
+	      info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	      if (esl_opt_IsOn(go, "--topk") && p7_pipeline_SetTopK(info[i].pli, esl_opt_GetInteger(go, "--topk")) != eslOK) p7_Fail("Failed to allocate --topk heap");
+	      if (esl_opt_GetBoolean(go, "--adapt")) p7_pipeline_SetAdaptive(info[i].pli, TRUE);
+	      if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(info[i].pli, TRUE);
+	      if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(info[i].pli, TRUE);
+	      info[i].pli->words = batch[q].ws;
+	      info[i].qnext = (q+1 < nb ? info + infocnt + i : NULL);
+	      p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+	    }
+	}
+      for (batchM = 0, q = 0; q < nb; q++) batchM += batch[q].om->M;
+      info = infoset;
 
 #ifdef HMMER_THREADS
-        if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+      if (ncpus > 0)
+	for (i = 0; i < infocnt; ++i) esl_threads_AddThread(threadObj, &info[i]);
 #endif
-      }
 
 #ifdef HMMER_THREADS
-      if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp, cfg->n_targetseq);
-      else           sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+      if      (sqdb && ncpus > 0) sstatus = thread_loop_seqdb(threadObj, queue, sqdb, p7_BLOCK_RESIDUES(batchM));
+      else if (sqdb)              sstatus = serial_loop_seqdb(info, sqdb);
+      else if (ncpus > 0)         sstatus = thread_loop(threadObj, queue, dbfp, ra, cfg->n_targetseq, p7_BLOCK_RESIDUES(batchM));
+      else                        sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
 #else
-      sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
+      if (sqdb) sstatus = serial_loop_seqdb(info, sqdb);
+      else      sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
 #endif
       switch(sstatus)
       {
@@ -590,58 +804,74 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       }
 
 
-      /* merge the results of the search results */
-      for (i = 1; i < infocnt; ++i)
+      /* Output the results of each query of the batch, in order */
+      for (q = 0; q < nb; q++)
       {
-        p7_tophits_Merge(info[0].th, info[i].th);
-        p7_pipeline_Merge(info[0].pli, info[i].pli);
-
-        p7_pipeline_Destroy(info[i].pli);
-        p7_tophits_Destroy(info[i].th);
-        p7_oprofile_Destroy(info[i].om);
-      }
+        info = infoset + q * infocnt;
+        qsq  = batch[q].qsq;
+        om   = batch[q].om;
+
+        if (fprintf(ofp, "Query:       %s  [L=%ld]\n", qsq->name, (long) qsq->n) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        if (qsq->acc[0]  != '\0' && fprintf(ofp, "Accession:   %s\n", qsq->acc)  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        if (qsq->desc[0] != '\0' && fprintf(ofp, "Description: %s\n", qsq->desc) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");  
+
+        /* merge the results of the search results */
+        for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+        p7_tophits_MergeMany(info[0].th, thl, infocnt-1);
+        for (i = 1; i < infocnt; ++i)
+        {
+          p7_pipeline_Merge(info[0].pli, info[i].pli);
+
+          p7_pipeline_Destroy(info[i].pli);
+          p7_tophits_Destroy(info[i].th);
+          p7_oprofile_Destroy(info[i].om);
+        }
 
-      /* Print the results.  */
-      p7_tophits_SortBySortkey(info->th);
-      p7_tophits_Threshold(info->th, info->pli);
-      p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      p7_tophits_Domains(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        /* Print the results.  */
+        p7_tophits_SortBySortkey(info->th);
+        p7_tophits_Threshold(info->th, info->pli);
+        p7_tophits_Targets(ofp, info->th, info->pli, textw); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        p7_tophits_DomainsThreaded(ofp, info->th, info->pli, textw, ncpus); if (fprintf(ofp, "\n\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   
-      if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, (nquery == 1));
-      if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsq->name, qsq->acc, info->th, info->pli);
-
-      esl_stopwatch_Stop(w);
-      p7_pli_Statistics(ofp, info->pli, w);
-      if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-      fflush(ofp);
-
-      /* Output the results in an MSA (-A option) */
-      if (afp) {
-	ESL_MSA *msa = NULL;
-
-	if ( p7_tophits_Alignment(info->th, abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK) 
-	  {
-	    esl_msa_SetName     (msa, om->name, -1);   // don't use qsq->name; it's optional in a ESL_SQ, and SingleBuilder took care of naming model.
-	    if (qsq->acc[0]  != '\0') esl_msa_SetAccession(msa, qsq->acc,  -1);
-	    if (qsq->desc[0] != '\0') esl_msa_SetDesc     (msa, qsq->desc, -1);
-	    esl_msa_FormatAuthor(msa, "phmmer (HMMER %s)", HMMER_VERSION);
-
-	    if (textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
-	    else           esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
-
-	    if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
-	  }
-	else if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        if (tblfp)     p7_tophits_TabularTargets(tblfp,    qsq->name, qsq->acc, info->th, info->pli, (batch[q].nquery == 1));
+        if (domtblfp)  p7_tophits_TabularDomains(domtblfp, qsq->name, qsq->acc, info->th, info->pli, (batch[q].nquery == 1));
+        if (pfamtblfp) p7_tophits_TabularXfam(pfamtblfp, qsq->name, qsq->acc, info->th, info->pli);
+
+        esl_stopwatch_Stop(w);	/* with a batch, the elapsed time runs from the start of the batch */
+        p7_pli_Statistics(ofp, info->pli, w);
+        if (fprintf(ofp, "//\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+        fflush(ofp);
+
+        /* Output the results in an MSA (-A option) */
+        if (afp) {
+  	ESL_MSA *msa = NULL;
+
+  	if ( p7_tophits_Alignment(info->th, abc, NULL, NULL, 0, p7_ALL_CONSENSUS_COLS, &msa) == eslOK) 
+  	  {
+  	    esl_msa_SetName     (msa, om->name, -1);   // don't use qsq->name; it's optional in a ESL_SQ, and SingleBuilder took care of naming model.
+  	    if (qsq->acc[0]  != '\0') esl_msa_SetAccession(msa, qsq->acc,  -1);
+  	    if (qsq->desc[0] != '\0') esl_msa_SetDesc     (msa, qsq->desc, -1);
+  	    esl_msa_FormatAuthor(msa, "phmmer (HMMER %s)", HMMER_VERSION);
+
+  	    if (textw > 0) esl_msafile_Write(afp, msa, eslMSAFILE_STOCKHOLM);
+  	    else           esl_msafile_Write(afp, msa, eslMSAFILE_PFAM);
+
+  	    if (fprintf(ofp, "# Alignment of %d hits satisfying inclusion thresholds saved to: %s\n", msa->nseq, esl_opt_GetString(go, "-A")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  	  }
+  	else if (fprintf(ofp, "# No hits satisfy inclusion thresholds; no alignment saved\n") < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 	  
-	esl_msa_Destroy(msa);
-      }
+  	esl_msa_Destroy(msa);
+        }
 
-      p7_tophits_Destroy(info->th);
-      p7_pipeline_Destroy(info->pli);
-      p7_oprofile_Destroy(info->om);
-      p7_oprofile_Destroy(om);
-      esl_sq_Reuse(qsq);
+        p7_tophits_Destroy(info->th);
+        p7_pipeline_Destroy(info->pli);
+        p7_oprofile_Destroy(info->om);
+        p7_oprofile_Destroy(om);
+        p7_wordseeds_Destroy(batch[q].ws);
+        batch[q].om = NULL;
+        batch[q].ws = NULL;
+        esl_sq_Reuse(qsq);
+      } /* end loop over the queries of a batch */
     } /* end outer loop over query sequences */
   if      (qstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n",
 					    qfp->filename, esl_sqfile_GetErrorBuf(qfp));
@@ -658,25 +888,45 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
   /* Cleanup - prepare for successful exit
    */
-  for (i = 0; i < infocnt; ++i)
-    p7_bg_Destroy(info[i].bg);
+  for (i = 0; i < infocnt * qbatch; ++i)
+    p7_bg_Destroy(infoset[i].bg);
+  for (q = 0; q < qbatch; q++)
+    esl_sq_Destroy(batch[q].qsq);
 
 #ifdef HMMER_THREADS
   if (ncpus > 0)
     {
       esl_workqueue_Reset(queue);
       while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
-	esl_sq_DestroyBlock(block);
+	{
+	  if (sqdb) p7_seqdb_DestroyBlock(block);
+	  else      esl_sq_DestroyBlock(block);
+	}
       esl_workqueue_Destroy(queue);
       esl_threads_Destroy(threadObj);
     }
+  p7_cpubind_Destroy(cpubind);
 #endif
 
-  free(info);
-  esl_sqfile_Close(dbfp);
+  if (binfo) 
+    {
+      for (i = 0; i < nbld; i++)
+	{
+	  if (i > 0) p7_builder_Destroy(binfo[i].bld);
+	  p7_bg_Destroy(binfo[i].bg);
+	}
+      free(binfo);
+    }
+#ifdef HMMER_THREADS
+  p7_readahead_Close(ra);
+#endif
+  free(infoset);
+  free(batch);
+  free(thl);
+  if (dbfp) esl_sqfile_Close(dbfp);
+  p7_seqdb_Close(sqdb);
   esl_sqfile_Close(qfp);
   esl_stopwatch_Destroy(w);
-  esl_sq_Destroy(qsq);
   p7_bg_Destroy(bg);
   p7_builder_Destroy(bld);
   esl_alphabet_Destroy(abc);
@@ -938,6 +1188,7 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) mpi_failure("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (esl_opt_IsOn(go, "--qcache") && p7_builder_SetQueryCache(bld, esl_opt_GetString(go, "--qcache")) != eslOK) mpi_failure("Failed to set query model cache");
 
   /* Open results output files */
   if (esl_opt_IsOn(go, "-o")          && (ofp      = fopen(esl_opt_GetString(go, "-o"),          "w")) == NULL)  
@@ -1022,6 +1273,10 @@ mpi_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Create processing pipeline and hit list */
       th  = p7_tophits_Create(); 
       pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+      if (esl_opt_IsOn(go, "--topk") && p7_pipeline_SetTopK(pli, esl_opt_GetInteger(go, "--topk")) != eslOK) mpi_failure("Failed to allocate --topk heap");
+      if (esl_opt_GetBoolean(go, "--adapt")) p7_pipeline_SetAdaptive(pli, TRUE);
+      if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(pli, TRUE);
+      if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(pli, TRUE);
       p7_pli_NewModel(pli, om, bg);
 
       /* Main loop: */
@@ -1233,6 +1488,18 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              status   = eslOK;
   int              qstatus  = eslOK;
   int              sstatus  = eslOK;
+  int              i;
+  int              ncpus    = 0;
+
+  int              infocnt  = 0;
+  WORKER_INFO     *info     = NULL;
+  P7_TOPHITS     **thl      = NULL;               /* the other threads' hit lists, for p7_tophits_MergeMany() */
+#ifdef HMMER_THREADS
+  ESL_SQ_BLOCK    *sqblock  = NULL;
+  ESL_THREADS     *threadObj= NULL;
+  ESL_WORK_QUEUE  *queue    = NULL;
+  void            *newBlock;
+#endif
 
   char            *mpi_buf  = NULL;               /* buffer used to pack/unpack structures            */
   int              mpi_size = 0;                  /* size of the allocated buffer                     */
@@ -1274,6 +1541,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(go, "--mxfile"), NULL, esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg);
   else                              status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(go, "--mx"),           esl_opt_GetReal(go, "--popen"), esl_opt_GetReal(go, "--pextend"), bg); 
   if (status != eslOK) mpi_failure("Failed to set single query seq score system:\n%s\n", bld->errbuf);
+  if (esl_opt_IsOn(go, "--qcache") && p7_builder_SetQueryCache(bld, esl_opt_GetString(go, "--qcache")) != eslOK) mpi_failure("Failed to set query model cache");
 
   /* Open the target sequence database for sequential access. */
   status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
@@ -1291,13 +1559,40 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status != eslOK)        mpi_failure ("Unexpected error %d opening sequence file %s\n", status, cfg->qfile);
   qsq  = esl_sq_CreateDigital(abc);
 
+  /* With --cpu, this rank searches its blocks with a pool of threads,
+   * the same way the threaded version does, rather than alone.
+   */
+#ifdef HMMER_THREADS
+  if (esl_opt_IsUsed(go, "--cpu")) ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+  if (ncpus > 0)
+    {
+      threadObj = esl_threads_Create(&pipeline_thread);
+      queue     = esl_workqueue_Create(ncpus * 2);
+      for (i = 0; i < ncpus * 2; ++i)
+	{
+	  if ((sqblock = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc)) == NULL) mpi_failure("Failed to allocate sequence block");
+	  if (esl_workqueue_Init(queue, sqblock) != eslOK)                   mpi_failure("Failed to add block to work queue");
+	}
+    }
+#endif
 
+  infocnt = (ncpus == 0) ? 1 : ncpus;
+  ESL_ALLOC(info, sizeof(WORKER_INFO)  * infocnt);
+  ESL_ALLOC(thl,  sizeof(P7_TOPHITS *) * infocnt);
+  for (i = 0; i < infocnt; ++i)
+    {
+      info[i].bg      = p7_bg_Create(abc);
+      info[i].sqviews = FALSE;
+      info[i].qnext   = NULL;
+#ifdef HMMER_THREADS
+      info[i].queue   = queue;
+      info[i].cpubind = NULL;
+#endif
+    }
 
   /* Outer loop over sequence queries */
   while ((qstatus = esl_sqio_Read(qfp, qsq)) == eslOK)
     {
-      P7_PIPELINE     *pli      = NULL;		  /* processing pipeline                      */
-      P7_TOPHITS      *th       = NULL;        	  /* top-scoring sequence hits                */
       P7_OPROFILE     *om       = NULL;           /* optimized query profile                  */
 
       SEQ_BLOCK        block;
@@ -1312,10 +1607,32 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Build the model */
       p7_SingleBuilder(bld, qsq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
 
-      /* Create processing pipeline and hit list */
-      th  = p7_tophits_Create(); 
-      pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
-      p7_pli_NewModel(pli, om, bg);
+      /* Create processing pipelines and hit lists; each thread
+       * needs its own profile, since it's reconfigured for every target length
+       */
+      for (i = 0; i < infocnt; ++i)
+	{
+	  info[i].th  = p7_tophits_Create(); 
+	  info[i].om  = p7_oprofile_Clone(om);
+	  info[i].pli = p7_pipeline_Create(go, om->M, 100, FALSE, p7_SEARCH_SEQS); /* L_hint = 100 is just a dummy for now */
+	  if (esl_opt_IsOn(go, "--topk") && p7_pipeline_SetTopK(info[i].pli, esl_opt_GetInteger(go, "--topk")) != eslOK) mpi_failure("Failed to allocate --topk heap");
+	  if (esl_opt_GetBoolean(go, "--adapt")) p7_pipeline_SetAdaptive(info[i].pli, TRUE);
+	  if (esl_opt_GetBoolean(go, "--vitdom")) p7_pipeline_SetViterbiDomains(info[i].pli, TRUE);
+	  if (esl_opt_GetBoolean(go, "--seqscore_only")) p7_pipeline_SetSeqScoreOnly(info[i].pli, TRUE);
+	  p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+#ifdef HMMER_THREADS
+	  if (ncpus > 0) esl_threads_AddThread(threadObj, &info[i]);
+#endif
+	}
+
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{
+	  esl_workqueue_Reset(queue);
+	  esl_threads_WaitForStart(threadObj);
+	  if (esl_workqueue_ReaderUpdate(queue, NULL, &newBlock) != eslOK) mpi_failure("Work queue reader failed");
+	}
+#endif
 
       /* receive a sequence block from the master */
       MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
@@ -1327,18 +1644,33 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  status = esl_sqfile_Position(dbfp, block.offset);
 	  if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
 
+#ifdef HMMER_THREADS
+	  if (ncpus > 0)
+	    { /* hand the block's sequences to the threads, up to BLOCK_SIZE at a time */
+	      while (count > 0)
+		{
+		  sqblock = (ESL_SQ_BLOCK *) newBlock;
+		  if ((sstatus = esl_sqio_ReadBlock(dbfp, sqblock, p7_BLOCK_RESIDUES(info->om->M), (int) count, /*max_init_window=*/FALSE, FALSE)) != eslOK) break;
+		  length = sqblock->list[sqblock->count-1].eoff - block.offset + 1;
+		  count -= sqblock->count;
+
+		  if (esl_workqueue_ReaderUpdate(queue, sqblock, &newBlock) != eslOK) mpi_failure("Work queue reader failed");
+		}
+	    }
+	  else
+#endif
 	  while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
 	    {
 	      length = dbsq->eoff - block.offset + 1;
 
-	      p7_pli_NewSeq(pli, dbsq);
-	      p7_bg_SetLength(bg, dbsq->n);
-	      p7_oprofile_ReconfigLength(om, dbsq->n);
+	      p7_pli_NewSeq(info->pli, dbsq);
+	      p7_bg_SetLength(info->bg, dbsq->n);
+	      p7_oprofile_ReconfigLength(info->om, dbsq->n);
       
-	      p7_Pipeline(pli, om, bg, dbsq, NULL, th);
+	      p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
 
 	      esl_sq_Reuse(dbsq);
-	      p7_pipeline_Reuse(pli);
+	      p7_pipeline_Reuse(info->pli);
 
 	      --count;
 	    }
@@ -1355,14 +1687,37 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  MPI_Recv(&block, 3, MPI_LONG_LONG_INT, 0, HMMER_BLOCK_TAG, MPI_COMM_WORLD, &mpistatus);
 	}
 
+#ifdef HMMER_THREADS
+      if (ncpus > 0)
+	{ /* an empty block for each thread tells it we're done */
+	  for (i = 0; i <= ncpus; ++i)
+	    {
+	      sqblock = (ESL_SQ_BLOCK *) newBlock;
+	      sqblock->count = 0;
+	      if (esl_workqueue_ReaderUpdate(queue, sqblock, (i < ncpus ? &newBlock : NULL)) != eslOK) mpi_failure("Work queue reader failed");
+	    }
+	  esl_threads_WaitForFinish(threadObj);
+	  esl_workqueue_Complete(queue);
+	}
+#endif
+
       esl_stopwatch_Stop(w);
 
+      /* merge the threads' results */
+      for (i = 1; i < infocnt; ++i) thl[i-1] = info[i].th;
+      p7_tophits_MergeMany(info[0].th, thl, infocnt-1);
+      for (i = 1; i < infocnt; ++i) p7_pipeline_Merge(info[0].pli, info[i].pli);
+
       /* Send the top hits back to the master. */
-      p7_tophits_MPISend(th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
-      p7_pipeline_MPISend(pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_tophits_MPISend(info[0].th, 0, HMMER_TOPHITS_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
+      p7_pipeline_MPISend(info[0].pli, 0, HMMER_PIPELINE_TAG, MPI_COMM_WORLD,  &mpi_buf, &mpi_size);
 
-      p7_tophits_Destroy(th);
-      p7_pipeline_Destroy(pli);
+      for (i = 0; i < infocnt; ++i)
+	{
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
+	  p7_oprofile_Destroy(info[i].om);
+	}
       p7_oprofile_Destroy(om);
       esl_sq_Reuse(qsq);
     } /* end outer loop over query sequences */
@@ -1374,6 +1729,21 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   status = 0;
   MPI_Send(&status, 1, MPI_INT, 0, HMMER_TERMINATING_TAG, MPI_COMM_WORLD);
 
+#ifdef HMMER_THREADS
+  if (ncpus > 0)
+    {
+      esl_workqueue_Reset(queue);
+      while (esl_workqueue_Remove(queue, (void **) &sqblock) == eslOK)
+	esl_sq_DestroyBlock(sqblock);
+      esl_workqueue_Destroy(queue);
+      esl_threads_Destroy(threadObj);
+    }
+#endif
+  for (i = 0; i < infocnt; ++i)
+    p7_bg_Destroy(info[i].bg);
+  free(info);
+  free(thl);
+
   if (mpi_buf != NULL) free(mpi_buf);
 
   p7_bg_Destroy(bg);
@@ -1386,15 +1756,24 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   p7_builder_Destroy(bld);
   esl_alphabet_Destroy(abc);
   return eslOK;
+
+ ERROR:
+  mpi_failure("Allocation failed");
+  return eslEMEM;
 }
 #endif /*HMMER_MPI*/
 
 
+/* serial_loop()
+ * Search each target in <dbfp> with the query of <info>, and with
+ * the rest of the batch's queries along its <qnext> chain.
+ */
 static int
 serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
 {
   int      sstatus   = eslOK;
   ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
+  WORKER_INFO *wi;
   int seq_cnt = 0;
 
   dbsq = esl_sq_CreateDigital(info->om->abc);
@@ -1402,15 +1781,19 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
   /* Main loop: */
   while ((n_targetseqs==-1 || seq_cnt<n_targetseqs) && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
     {
-      p7_pli_NewSeq(info->pli, dbsq);
-      p7_bg_SetLength(info->bg, dbsq->n);
-      p7_oprofile_ReconfigLength(info->om, dbsq->n);
-      
-      p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
+      for (wi = info; wi; wi = wi->qnext)
+	{
+	  p7_pli_NewSeq(wi->pli, dbsq);
+	  p7_bg_SetLength(wi->bg, dbsq->n);
+	  p7_oprofile_ReconfigLength(wi->om, dbsq->n);
+
+	  p7_Pipeline(wi->pli, wi->om, wi->bg, dbsq, NULL, wi->th);
+
+	  p7_pipeline_Reuse(wi->pli);
+	}
 
       seq_cnt++;
       esl_sq_Reuse(dbsq);
-      p7_pipeline_Reuse(info->pli);
     }
 
   if (n_targetseqs!=-1 && seq_cnt==n_targetseqs)
@@ -1421,9 +1804,36 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
   return sstatus;
 }
 
+/* serial_loop_seqdb()
+ * As serial_loop(), with the targets coming from pressed sequence
+ * database <sqdb> as views: nothing to parse, copy or reuse.
+ */
+static int
+serial_loop_seqdb(WORKER_INFO *info, P7_SEQDB *sqdb)
+{
+  ESL_SQ       dbsq;           /* view of one target sequence    */
+  WORKER_INFO *wi;
+
+  memset(&dbsq, 0, sizeof(ESL_SQ));
+
+  /* Main loop: */
+  while (p7_seqdb_Read(sqdb, &dbsq) == eslOK)
+    for (wi = info; wi; wi = wi->qnext)
+      {
+	p7_pli_NewSeq(wi->pli, &dbsq);
+	p7_bg_SetLength(wi->bg, dbsq.n);
+	p7_oprofile_ReconfigLength(wi->om, dbsq.n);
+
+	p7_Pipeline(wi->pli, wi->om, wi->bg, &dbsq, NULL, wi->th);
+
+	p7_pipeline_Reuse(wi->pli);
+      }
+  return eslEOF;
+}
+
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs)
+thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, P7_READAHEAD *ra, int n_targetseqs, int max_residues)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
@@ -1447,8 +1857,9 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
         block->count = 0;
         sstatus = eslEOF;
       } else {
-        sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
+        sstatus = esl_sqio_ReadBlock(dbfp, block, max_residues, n_targetseqs, /*max_init_window=*/FALSE, FALSE);
         n_targetseqs -= block->count;
+        if (block->count > 0) p7_readahead_Advance(ra, ESL_MAX(block->list[block->count-1].roff, block->list[block->count-1].eoff));
       }
 
       if (sstatus == eslEOF)
@@ -1459,6 +1870,7 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
 	  
       if (sstatus == eslOK)
       {
+        p7_PROBE1(block__handoff, block->count);
         status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
         if (status != eslOK) p7_Fail("Work queue reader failed");
       }
@@ -1477,6 +1889,86 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
   return sstatus;
 }
 
+/* thread_loop_seqdb()
+ * As thread_loop(), with target sequences coming from pressed
+ * database <sqdb>. The queue's blocks are p7_seqdb views, so filling
+ * one only sets pointers; the workers don't esl_sq_Reuse() them.
+ * Blocks stop at <max_residues>, as esl_sqio_ReadBlock()'s do.
+ */
+static int
+thread_loop_seqdb(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_SEQDB *sqdb, int max_residues)
+{
+  int  status  = eslOK;
+  int  sstatus = eslOK;
+  int  eofCount = 0;
+  ESL_SQ_BLOCK *block;
+  void         *newBlock;
+
+  esl_workqueue_Reset(queue);
+  esl_threads_WaitForStart(obj);
+
+  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
+  if (status != eslOK) p7_Fail("Work queue reader failed");
+
+  /* Main loop: */
+  while (sstatus == eslOK)
+    {
+      block = (ESL_SQ_BLOCK *) newBlock;
+
+      sstatus = p7_seqdb_ReadBlock(sqdb, block, max_residues);
+
+      if (sstatus == eslEOF)
+      {
+        if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
+        ++eofCount;
+      }
+
+      if (sstatus == eslOK)
+      {
+        status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
+        if (status != eslOK) p7_Fail("Work queue reader failed");
+      }
+    }
+
+  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
+  if (status != eslOK) p7_Fail("Work queue reader failed");
+
+  if (sstatus == eslEOF)
+    {
+      /* wait for all the threads to complete */
+      esl_threads_WaitForFinish(obj);
+      esl_workqueue_Complete(queue);  
+    }
+
+  return sstatus;
+}
+
+/* build_thread()
+ * 
+ * Build this thread's share of the query models of a batch.
+ */
+static void
+build_thread(void *arg)
+{
+  int          workeridx;
+  BUILD_INFO  *bi;
+  ESL_THREADS *obj;
+  int          q;
+
+  impl_Init();
+
+  obj = (ESL_THREADS *) arg;
+  esl_threads_Started(obj, &workeridx);
+
+  bi = (BUILD_INFO *) esl_threads_GetData(obj, workeridx);
+  for (q = bi->w; q < bi->nb; q += bi->nw)
+    if (p7_SingleBuilder(bi->bld, bi->batch[q].qsq, bi->bg, NULL, NULL, NULL, &(bi->batch[q].om)) != eslOK)
+      bi->batch[q].om = NULL;  /* the master builds it again, serially */
+
+  esl_threads_Finished(obj, workeridx);
+  return;
+}
+
 static void 
 pipeline_thread(void *arg)
 {
@@ -1484,6 +1976,7 @@ pipeline_thread(void *arg)
   int status;
   int workeridx;
   WORKER_INFO   *info;
+  WORKER_INFO   *wi;
   ESL_THREADS   *obj;
   ESL_SQ_BLOCK  *block = NULL;
   void          *newBlock;
@@ -1494,6 +1987,7 @@ pipeline_thread(void *arg)
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+  p7_cpubind_Worker(info->cpubind, workeridx);  /* before its DP matrices grow, so they're on its own NUMA node */
 
   status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
   if (status != eslOK) p7_Fail("Work queue worker failed");
@@ -1502,20 +1996,23 @@ pipeline_thread(void *arg)
   block = (ESL_SQ_BLOCK *) newBlock;
   while (block->count > 0)
     {
-      /* Main loop: */
-      for (i = 0; i < block->count; ++i)
-	{
-	  ESL_SQ *dbsq = block->list + i;
+      /* Main loop: the whole block with each query of the batch (--qbatch) in turn, while it's in cache */
+      for (wi = info; wi; wi = wi->qnext)
+	for (i = 0; i < block->count; ++i)
+	  {
+	    ESL_SQ *dbsq = block->list + i;
 
-	  p7_pli_NewSeq(info->pli, dbsq);
-	  p7_bg_SetLength(info->bg, dbsq->n);
-	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
-	  
-	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-	  
-	  esl_sq_Reuse(dbsq);
-	  p7_pipeline_Reuse(info->pli);
-	}
+	    p7_pli_NewSeq(wi->pli, dbsq);
+	    p7_bg_SetLength(wi->bg, dbsq->n);
+	    p7_oprofile_ReconfigLength(wi->om, dbsq->n);
+
+	    p7_Pipeline(wi->pli, wi->om, wi->bg, dbsq, NULL, wi->th);
+
+	    p7_pipeline_Reuse(wi->pli);
+	  }
+
+      if (! info->sqviews)
+	for (i = 0; i < block->count; ++i) esl_sq_Reuse(block->list + i);
 
       status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
       if (status != eslOK) p7_Fail("Work queue worker failed");
@@ -1526,6 +2023,9 @@ pipeline_thread(void *arg)
   status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
   if (status != eslOK) p7_Fail("Work queue worker failed");
 
+  /* sort our own hits while other threads may still be working, ready for the k-way merge */
+  for (wi = info; wi; wi = wi->qnext)
+    p7_tophits_SortBySortkey(wi->th);
   esl_threads_Finished(obj, workeridx);
   return;
 }
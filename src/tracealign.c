@@ -9,11 +9,38 @@
  */
 #include <p7_config.h>
 
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
+
 #include "easel.h"
 #include "esl_vectorops.h"
 
 #include "hmmer.h"
 
+/* p7_tracealign_computeTracesThreaded() frees a thread's DP matrices
+ * after a sequence that grew them past this many bytes.
+ */
+#define p7_TRACEALIGN_MXKEEP (64 * 1024 * 1024)
+
+/* One thread's share of p7_tracealign_computeTracesThreaded(). */
+typedef struct {
+  ESL_SQ          **sq;
+  P7_TRACE        **tr;
+  int               end;	/* sequences are aligned up to sq[end-1]                   */
+  int              *next;	/* shared: the next sequence to align                      */
+  int               w;		/* worker number; 0 is the calling thread                  */
+  P7_PROFILE       *gm;		/* this worker's own configured profiles: they're          */
+  P7_OPROFILE      *om;		/*   reconfigured for the length of each sequence          */
+  P7_OMX           *oxf, *oxb;	/* optimized Forward, Backward matrices                    */
+  P7_GMX           *gxf, *gxb;	/* generic ones, only for the p7_Decoding() overflow failover */
+  int               status;
+#ifdef HMMER_THREADS
+  pthread_mutex_t  *lock;	/* protects <*next>; NULL with one worker                  */
+  pthread_t         thread;
+#endif
+} TA_WORKER;
+
 static int     map_new_msa(P7_TRACE **tr, int nseq, int M, int optflags, int **ret_inscount, int **ret_matuse, int **ret_matmap, int *ret_alen);
 static ESL_DSQ get_dsq_z(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int idx, int z);
 static int     make_digital_msa(ESL_SQ **sq, const ESL_MSA *premsa, P7_TRACE **tr, int nseq, const int *matuse, const int *matmap, int M, int alen, int optflags, ESL_MSA **ret_msa);
@@ -23,6 +50,7 @@ static int     annotate_mm(ESL_MSA *msa, P7_HMM *hmm, const int *matuse, const i
 static int     annotate_posterior_probability(ESL_MSA *msa, P7_TRACE **tr, const int *matmap, int M, int optflags);
 static int     rejustify_insertions_digital  (                         ESL_MSA *msa, const int *inserts, const int *matmap, const int *matuse, int M);
 static int     rejustify_insertions_text     (const ESL_ALPHABET *abc, ESL_MSA *msa, const int *inserts, const int *matmap, const int *matuse, int M);
+static void   *tracealign_worker(void *arg);
 
 
 /*****************************************************************
@@ -64,6 +92,11 @@ static int     rejustify_insertions_text     (const ESL_ALPHABET *abc, ESL_MSA *
  *            
  *            The <optflags> can be combined by logical OR; for
  *            example, <p7_DIGITIZE | p7_ALL_CONSENSUS_COLS>.
+ *
+ *            No dynamic programming is done here: the traces come
+ *            from the caller, from <p7_tracealign_computeTraces()>
+ *            (which uses the vectorized Forward, Backward, decoding
+ *            and OA routines) or from faux traces of an MSA.
  *            
  * Args:      sq       - array of digital sequences, 0..nseq-1
  *            tr       - array of tracebacks, 0..nseq-1
@@ -235,135 +268,129 @@ p7_tracealign_MSA(const ESL_MSA *premsa, P7_TRACE **tr, int M, int optflags, ESL
 int
 p7_tracealign_computeTraces(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRACE  **tr)
 {
+  return p7_tracealign_computeTracesThreaded(hmm, sq, offset, N, tr, 0);
+}
+
 
-  P7_OMX       *oxf     = NULL; /* optimized Forward matrix        */
-  P7_OMX       *oxb     = NULL; /* optimized Backward matrix       */
-  P7_GMX       *gxf     = NULL; /* generic Forward mx for failover */
-  P7_GMX       *gxb     = NULL; /* generic Backward mx for failover*/
+/* Function: p7_tracealign_computeTracesThreaded()
+ *
+ * Synopsis: Compute traces for a collection of sequences, in parallel.
+ *
+ * Purpose:  As <p7_tracealign_computeTraces()>, with up to <ncpu>
+ *           threads (the caller's included) taking the sequences in
+ *           turn; <ncpu> 0 aligns them all in the calling thread.
+ *           Each thread has its own copy of the configured profile
+ *           and its own DP matrices, so the traces are the same
+ *           however many threads there are.
+ *
+ *           A thread's matrices grow to fit the longest sequence it
+ *           has aligned; once they're over <p7_TRACEALIGN_MXKEEP>
+ *           bytes they're freed after that sequence, so a few very
+ *           long sequences don't leave every thread holding big
+ *           matrices for the rest of the run.
+ *
+ * Return:   eslOK if no errors.
+ *
+ * Throws:   <eslEMEM> on allocation failure.
+ */
+int
+p7_tracealign_computeTracesThreaded(P7_HMM *hmm, ESL_SQ  **sq, int offset, int N, P7_TRACE  **tr, int ncpu)
+{
+  TA_WORKER    *wk      = NULL;
   P7_PROFILE   *gm      = NULL;
   P7_OPROFILE  *om      = NULL;
   P7_BG        *bg      = NULL;
-  int tfrom, tto;
+  int           next    = offset;
+  int           nw      = 0;
+  int           nthr;
+  int           w;
+  int           status;
+#ifdef HMMER_THREADS
+  pthread_mutex_t lock;
+  int           have_lock = FALSE;
+#endif
 
-  int           idx;
-  float         fwdsc;    /* Forward score                   */
-  float         oasc;   /* optimal accuracy score          */
-  int status;
+  if (N == 0) return eslOK;
 
-  bg = p7_bg_Create(hmm->abc);
-  gm = p7_profile_Create (hmm->M, hmm->abc);
-  om = p7_oprofile_Create(hmm->M, hmm->abc);
+  if ((bg = p7_bg_Create(hmm->abc))              == NULL) { status = eslEMEM; goto ERROR; }
+  if ((gm = p7_profile_Create (hmm->M, hmm->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if ((om = p7_oprofile_Create(hmm->M, hmm->abc)) == NULL) { status = eslEMEM; goto ERROR; }
 
   p7_ProfileConfig(hmm, bg, gm, sq[offset]->n, p7_UNILOCAL);
   p7_oprofile_Convert(gm, om);
 
+#ifdef HMMER_THREADS
+  nw = ESL_MAX(1, ESL_MIN(ncpu, N));
+  if (nw > 1)
+    {
+      if (pthread_mutex_init(&lock, NULL) == 0) have_lock = TRUE;
+      else                                      nw = 1;
+    }
+#else
+  nw = 1;
+#endif
 
-  oxf = p7_omx_Create(hmm->M, sq[offset]->n, sq[offset]->n);
-  oxb = p7_omx_Create(hmm->M, sq[offset]->n, sq[offset]->n);
-
-  /* Collect an OA trace for each sequence that needs to be aligned
-   */
-  for (idx = offset; idx < offset+ N; idx++)
-  {
-    /* special case: a sequence of length 0. HMMER model can't generate 0 length seq. Set tr->N == 0 as a flag. (bug #h100 fix) */
-    if (sq[idx]->n == 0) { tr[idx]->N = 0; continue; }
-
-    p7_omx_GrowTo(oxf, hmm->M, sq[idx]->n, sq[idx]->n);
-    p7_omx_GrowTo(oxb, hmm->M, sq[idx]->n, sq[idx]->n);
-
-    p7_oprofile_ReconfigLength(om, sq[idx]->n);
-
-    p7_Forward (sq[idx]->dsq, sq[idx]->n, om,      oxf, &fwdsc);
-    p7_Backward(sq[idx]->dsq, sq[idx]->n, om, oxf, oxb, NULL);
-
-    status = p7_Decoding(om, oxf, oxb, oxb);      /* <oxb> is now overwritten with post probabilities     */
-
-    if (status == eslOK)
-      {
-        p7_OptimalAccuracy(om, oxb, oxf, &oasc);      /* <oxf> is now overwritten with OA scores              */
-        p7_OATrace        (om, oxb, oxf, tr[idx]);    /* tr[idx] is now an OA traceback for seq #idx          */
-      }
-    else if (status == eslERANGE)
-      {
-        /* Work around the numeric overflow problem in Decoding()
-         * xref J3/119-121 for commentary;
-         * also the note in impl_sse/decoding.c::p7_Decoding().
-         *
-         * In short: p7_Decoding() can overflow in cases where the
-         * model is in unilocal mode (expects to see a single
-         * "domain") but the target contains more than one domain.
-         * In searches, I believe this only happens on repetitive
-         * garbage, because the domain postprocessor is very good
-         * about identifying single domains before doing posterior
-         * decoding. But in hmmalign, we're in unilocal mode
-         * to begin with, and the user can definitely give us a
-         * multidomain protein.
-         *
-         * We need to make this far more robust; but that's probably
-         * an issue to deal with when we really spend some time
-         * looking hard at hmmalign performance. For now (Nov 2009;
-         * in beta tests leading up to 3.0 release) I'm more
-         * concerned with stabilizing the search programs.
-         *
-         * The workaround is to detect the overflow and fail over to
-         * slow generic routines.
-         */
-        if (gxf == NULL) gxf = p7_gmx_Create(hmm->M, sq[idx]->n);
-        else             p7_gmx_GrowTo(gxf,  hmm->M, sq[idx]->n);
-
-        if (gxb == NULL) gxb = p7_gmx_Create(hmm->M, sq[idx]->n);
-        else             p7_gmx_GrowTo(gxb,  hmm->M, sq[idx]->n);
-
-        p7_ReconfigLength(gm, sq[idx]->n);
-
-        p7_GForward (sq[idx]->dsq, sq[idx]->n, gm, gxf, &fwdsc);
-        p7_GBackward(sq[idx]->dsq, sq[idx]->n, gm, gxb, NULL);
-        p7_GDecoding(gm, gxf, gxb, gxb);
-        p7_GOptimalAccuracy(gm, gxb, gxf, &oasc);
-        p7_GOATrace        (gm, gxb, gxf, tr[idx]);
-        p7_gmx_Reuse(gxf);
-        p7_gmx_Reuse(gxb);
-      }
-
-
-    /* the above steps aren't storing the tfrom/tto values in the trace,
-     * which are required for downstream processing in this case, so
-     * hack them here. Note - this treats the whole thing as one domain,
-     * even if there are really multiple domains.
-     */
-    // skip the parts of the trace that precede the first match state
-    tfrom = 2;
-    while (tr[idx]->st[tfrom] != p7T_M)   tfrom++;
-
-    tto = tfrom + 1;
-    //run until the model is exited
-    while (tr[idx]->st[tto] != p7T_E)     tto++;
-
-    tr[idx]->tfrom[0]  = tfrom;
-    tr[idx]->tto[0]    = tto - 1;
-
-
-    p7_omx_Reuse(oxf);
-    p7_omx_Reuse(oxb);
-  }
-
-#if 0
-  for (idx = 0; idx < nseq; idx++)
-    p7_trace_Dump(stdout, tr[idx], gm, sq[idx]->dsq);
+  ESL_ALLOC(wk, sizeof(TA_WORKER) * nw);
+  for (w = 0; w < nw; w++) { wk[w].gm = NULL; wk[w].om = NULL; }
+  for (w = 0; w < nw; w++)
+    {
+      wk[w].sq     = sq;
+      wk[w].tr     = tr;
+      wk[w].end    = offset + N;
+      wk[w].next   = &next;
+      wk[w].w      = w;
+      wk[w].gm     = (w == 0 ? gm : p7_profile_Clone(gm));
+      wk[w].om     = (w == 0 ? om : p7_oprofile_Clone(om));
+      wk[w].oxf    = NULL;
+      wk[w].oxb    = NULL;
+      wk[w].gxf    = NULL;
+      wk[w].gxb    = NULL;
+      wk[w].status = eslOK;
+#ifdef HMMER_THREADS
+      wk[w].lock   = (have_lock ? &lock : NULL);
 #endif
+      if (wk[w].gm == NULL || wk[w].om == NULL) { status = eslEMEM; goto ERROR; }
+    }
 
+  /* If a thread can't be started, the others just take its share of the sequences. */
+  nthr = 1;
+#ifdef HMMER_THREADS
+  for (nthr = 1; nthr < nw; nthr++)
+    if (pthread_create(&(wk[nthr].thread), NULL, tracealign_worker, &(wk[nthr])) != 0) break;
+#endif
+  tracealign_worker(&(wk[0]));
+#ifdef HMMER_THREADS
+  for (w = 1; w < nthr; w++)
+    pthread_join(wk[w].thread, NULL);
+  if (have_lock) pthread_mutex_destroy(&lock);
+#endif
 
+  status = eslOK;
+  for (w = 0; w < nw; w++)
+    {
+      if (wk[w].status != eslOK) status = wk[w].status;
+      if (w > 0) { p7_profile_Destroy(wk[w].gm); p7_oprofile_Destroy(wk[w].om); }
+    }
 
-  p7_omx_Destroy(oxf);
-  p7_omx_Destroy(oxb);
-  p7_gmx_Destroy(gxf);
-  p7_gmx_Destroy(gxb);
+  free(wk);
   p7_bg_Destroy(bg);
   p7_profile_Destroy(gm);
   p7_oprofile_Destroy(om);
+  return status;
 
-
-  return eslOK;
+ ERROR:
+  if (wk)
+    {
+      for (w = 1; w < nw; w++) { p7_profile_Destroy(wk[w].gm); p7_oprofile_Destroy(wk[w].om); }
+      free(wk);
+    }
+#ifdef HMMER_THREADS
+  if (have_lock) pthread_mutex_destroy(&lock);
+#endif
+  p7_bg_Destroy(bg);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+  return status;
 }
 
 
@@ -468,6 +495,150 @@ ERROR:
  * 2. Internal functions used by the API
  *****************************************************************/
 
+/* tracealign_worker()
+ *
+ * Body of <p7_tracealign_computeTracesThreaded()>, for one thread:
+ * take the next sequence (under the lock, if there's more than one
+ * worker) until none are left, and collect its OA trace. The trace
+ * steps are those of the original serial p7_tracealign_computeTraces().
+ */
+static void *
+tracealign_worker(void *arg)
+{
+  TA_WORKER    *wk  = (TA_WORKER *) arg;
+  ESL_SQ      **sq  = wk->sq;
+  P7_TRACE    **tr  = wk->tr;
+  P7_PROFILE   *gm  = wk->gm;
+  P7_OPROFILE  *om  = wk->om;
+  int           M   = om->M;
+  int           tfrom, tto;
+  int           idx;
+  float         fwdsc;    /* Forward score                   */
+  float         oasc;     /* optimal accuracy score          */
+  int           status;
+
+  if (wk->w > 0) impl_Init();	/* a new thread's SIMD state, as the pipeline threads set it */
+
+  while (1)
+  {
+#ifdef HMMER_THREADS
+    if (wk->lock) pthread_mutex_lock(wk->lock);
+#endif
+    idx = (*wk->next)++;
+#ifdef HMMER_THREADS
+    if (wk->lock) pthread_mutex_unlock(wk->lock);
+#endif
+    if (idx >= wk->end) break;
+
+    /* special case: a sequence of length 0. HMMER model can't generate 0 length seq. Set tr->N == 0 as a flag. (bug #h100 fix) */
+    if (sq[idx]->n == 0) { tr[idx]->N = 0; continue; }
+
+    if (wk->oxf == NULL) wk->oxf = p7_omx_Create(M, sq[idx]->n, sq[idx]->n);
+    else                 p7_omx_GrowTo(wk->oxf, M, sq[idx]->n, sq[idx]->n);
+    if (wk->oxb == NULL) wk->oxb = p7_omx_Create(M, sq[idx]->n, sq[idx]->n);
+    else                 p7_omx_GrowTo(wk->oxb, M, sq[idx]->n, sq[idx]->n);
+    if (wk->oxf == NULL || wk->oxb == NULL) { wk->status = eslEMEM; break; }
+
+    p7_oprofile_ReconfigLength(om, sq[idx]->n);
+
+    p7_Forward (sq[idx]->dsq, sq[idx]->n, om,          wk->oxf, &fwdsc);
+    p7_Backward(sq[idx]->dsq, sq[idx]->n, om, wk->oxf, wk->oxb, NULL);
+
+    status = p7_Decoding(om, wk->oxf, wk->oxb, wk->oxb);      /* <oxb> is now overwritten with post probabilities     */
+
+    if (status == eslOK)
+      {
+        p7_OptimalAccuracy(om, wk->oxb, wk->oxf, &oasc);      /* <oxf> is now overwritten with OA scores              */
+        p7_OATrace        (om, wk->oxb, wk->oxf, tr[idx]);    /* tr[idx] is now an OA traceback for seq #idx          */
+      }
+    else if (status == eslERANGE)
+      {
+        /* Work around the numeric overflow problem in Decoding()
+         * xref J3/119-121 for commentary;
+         * also the note in impl_sse/decoding.c::p7_Decoding().
+         *
+         * In short: p7_Decoding() can overflow in cases where the
+         * model is in unilocal mode (expects to see a single
+         * "domain") but the target contains more than one domain.
+         * In searches, I believe this only happens on repetitive
+         * garbage, because the domain postprocessor is very good
+         * about identifying single domains before doing posterior
+         * decoding. But in hmmalign, we're in unilocal mode
+         * to begin with, and the user can definitely give us a
+         * multidomain protein.
+         *
+         * We need to make this far more robust; but that's probably
+         * an issue to deal with when we really spend some time
+         * looking hard at hmmalign performance. For now (Nov 2009;
+         * in beta tests leading up to 3.0 release) I'm more
+         * concerned with stabilizing the search programs.
+         *
+         * The workaround is to detect the overflow and fail over to
+         * slow generic routines.
+         */
+        if (wk->gxf == NULL) wk->gxf = p7_gmx_Create(M, sq[idx]->n);
+        else                 p7_gmx_GrowTo(wk->gxf,  M, sq[idx]->n);
+
+        if (wk->gxb == NULL) wk->gxb = p7_gmx_Create(M, sq[idx]->n);
+        else                 p7_gmx_GrowTo(wk->gxb,  M, sq[idx]->n);
+        if (wk->gxf == NULL || wk->gxb == NULL) { wk->status = eslEMEM; break; }
+
+        p7_ReconfigLength(gm, sq[idx]->n);
+
+        p7_GForward (sq[idx]->dsq, sq[idx]->n, gm, wk->gxf, &fwdsc);
+        p7_GBackward(sq[idx]->dsq, sq[idx]->n, gm, wk->gxb, NULL);
+        p7_GDecoding(gm, wk->gxf, wk->gxb, wk->gxb);
+        p7_GOptimalAccuracy(gm, wk->gxb, wk->gxf, &oasc);
+        p7_GOATrace        (gm, wk->gxb, wk->gxf, tr[idx]);
+        p7_gmx_Reuse(wk->gxf);
+        p7_gmx_Reuse(wk->gxb);
+      }
+
+
+    /* the above steps aren't storing the tfrom/tto values in the trace,
+     * which are required for downstream processing in this case, so
+     * hack them here. Note - this treats the whole thing as one domain,
+     * even if there are really multiple domains.
+     */
+    // skip the parts of the trace that precede the first match state
+    tfrom = 2;
+    while (tr[idx]->st[tfrom] != p7T_M)   tfrom++;
+
+    tto = tfrom + 1;
+    //run until the model is exited
+    while (tr[idx]->st[tto] != p7T_E)     tto++;
+
+    tr[idx]->tfrom[0]  = tfrom;
+    tr[idx]->tto[0]    = tto - 1;
+
+    /* Don't keep matrices sized for an unusually long sequence */
+    if (p7_omx_Sizeof(wk->oxf) + p7_omx_Sizeof(wk->oxb) > p7_TRACEALIGN_MXKEEP)
+      {
+        p7_omx_Destroy(wk->oxf); wk->oxf = NULL;
+        p7_omx_Destroy(wk->oxb); wk->oxb = NULL;
+      }
+    else
+      {
+        p7_omx_Reuse(wk->oxf);
+        p7_omx_Reuse(wk->oxb);
+      }
+    if (wk->gxf && p7_gmx_Sizeof(wk->gxf) + p7_gmx_Sizeof(wk->gxb) > p7_TRACEALIGN_MXKEEP)
+      {
+        p7_gmx_Destroy(wk->gxf); wk->gxf = NULL;
+        p7_gmx_Destroy(wk->gxb); wk->gxb = NULL;
+      }
+  }
+
+  p7_omx_Destroy(wk->oxf);
+  p7_omx_Destroy(wk->oxb);
+  p7_gmx_Destroy(wk->gxf);
+  p7_gmx_Destroy(wk->gxb);
+  wk->oxf = wk->oxb = NULL;
+  wk->gxf = wk->gxb = NULL;
+  return NULL;
+}
+
+
 /* map_new_msa()
  *
  * Construct <inscount[0..M]>, <matuse[1..M]>, and <matmap[1..M]>
@@ -0,0 +1,294 @@
+#! /usr/bin/perl
+
+# End-to-end throughput benchmark, with stored baselines.
+#
+# Usage:    ./throughput.pl [options] <top_builddir> <top_srcdir> <workdir>
+# Example:  ./throughput.pl --cpus 1,2,4,8 --save base.tbl ../build ..  tp-work
+#           ./throughput.pl --cpus 1,2,4,8 --baseline base.tbl ../build .. tp-work2
+#
+# Unlike speed-master.pl, this needs no local databases. It makes its
+# own fixed datasets in <workdir> from files in the source tree, with
+# fixed seeds, so two runs on different machines (or of different
+# builds) time the same work:
+#
+#   pfam      the six Pfam models of testsuite/ that component-benchmark.pl
+#             uses, plus their seed alignments (for hmmbuild)
+#   uniprot   a protein sample: iid sequences, with homologs of the
+#             pfam models emitted into it
+#   genome    a DNA slice: iid sequence, with homologs of a DNA model
+#             emitted into it, as one sequence
+#   fmdb      the genome slice as an FM-index database (makehmmerdb)
+#
+# Real data can be used instead with --pfam <hmmfile> (and --pfamsto
+# <msafile> for hmmbuild), --uniprot <seqfile>, --genome <seqfile>;
+# a baseline is only comparable to runs on the same datasets.
+#
+# Each program is timed (wall clock) at each --cpu count:
+#   hmmsearch   pfam     vs uniprot
+#   hmmscan     uniprot  (first --nscan seqs) vs pressed pfam
+#   phmmer      uniprot  (first --nphmmer seqs) vs uniprot
+#   jackhmmer   uniprot  (first seq, -N 3) vs uniprot
+#   nhmmer      DNA model vs genome, and vs fmdb
+#   hmmbuild    pfam seed alignments
+#
+# and reported as throughput in Mcells/s: query nodes (or residues,
+# for sequence queries) times target residues, per second; for
+# hmmbuild, in alignment columns per second. Scaling efficiency is
+# t(1) / (n * t(n)), relative to the smallest --cpu count.
+#
+# --save <f> writes the results table to <f>; --baseline <f> reads
+# one back and adds the ratio of each throughput to the baseline's.
+#
+# Requires the Easel miniapps (esl-shuffle, esl-seqstat, esl-sfetch)
+# in <top_builddir>/easel/miniapps.
+
+use Getopt::Long;
+use Time::HiRes qw(time);
+
+$cpulist  = "1,2,4";
+$nseq     = 100000;
+$seqlen   = 350;
+$nhomolog = 20;
+$genlen   = 10000000;
+$nscan    = 100;
+$nphmmer  = 5;
+$seed     = 42;
+
+&GetOptions("cpus=s"     => \$cpulist,
+            "nseq=i"     => \$nseq,
+            "L=i"        => \$seqlen,
+            "genlen=i"   => \$genlen,
+            "nscan=i"    => \$nscan,
+            "nphmmer=i"  => \$nphmmer,
+            "pfam=s"     => \$pfam_hmm,
+            "pfamsto=s"  => \$pfam_sto,
+            "uniprot=s"  => \$uniprot,
+            "genome=s"   => \$genome,
+            "save=s"     => \$savefile,
+            "baseline=s" => \$basefile) || die "bad options";
+
+if ($#ARGV != 2) { die "Usage: ./throughput.pl [options] <top_builddir> <top_srcdir> <workdir>\n"; }
+$top_builddir = shift;
+$top_srcdir   = shift;
+$workdir      = shift;
+
+@cpus   = split(/,/, $cpulist);
+@models = ("XYPPX", "RRM_1", "Caudal_act", "LuxC", "Patched", "SMC_N");
+$dnamodel = "$top_srcdir/testsuite/2OG-FeII_Oxy_3-nt.hmm";
+
+$src        = "$top_builddir/src";
+$miniapps   = "$top_builddir/easel/miniapps";
+foreach $prog ("hmmsearch", "hmmscan", "phmmer", "jackhmmer", "nhmmer", "hmmbuild", "hmmpress", "hmmemit", "makehmmerdb") {
+    if (! -x "$src/$prog") { die "FAIL: didn't find $prog in $src\n"; }
+}
+foreach $prog ("esl-shuffle", "esl-seqstat", "esl-sfetch") {
+    if (! -x "$miniapps/$prog") { die "FAIL: didn't find $prog in $miniapps\n"; }
+}
+
+if (-e $workdir) { die "$workdir exists"; }
+system("mkdir $workdir") == 0 || die "failed to create $workdir";
+
+&make_datasets();
+
+$Mpfam     = &total_nodes("$workdir/pfam.hmm");
+$Mdna      = &total_nodes($dnamodel);
+$Lprot     = &total_residues("$workdir/uniprot.fa");
+$Lgenome   = &total_residues("$workdir/genome.fa");
+$Lscan     = &total_residues("$workdir/scan.fa");
+$Lphmmer   = &total_residues("$workdir/phmmer.fa");
+$Ljack     = &total_residues("$workdir/jack.fa");
+$ncols     = &total_columns("$workdir/pfam.sto");
+
+# name, command (with %CPU%), cells (or columns) per run
+@jobs = (
+    [ "hmmsearch",  "$src/hmmsearch --cpu %CPU% -o /dev/null $workdir/pfam.hmm $workdir/uniprot.fa",                  $Mpfam   * $Lprot   ],
+    [ "hmmscan",    "$src/hmmscan   --cpu %CPU% -o /dev/null $workdir/pfam.hmm $workdir/scan.fa",                     $Mpfam   * $Lscan   ],
+    [ "phmmer",     "$src/phmmer    --cpu %CPU% -o /dev/null $workdir/phmmer.fa $workdir/uniprot.fa",                 $Lphmmer * $Lprot   ],
+    [ "jackhmmer",  "$src/jackhmmer --cpu %CPU% -N 3 -o /dev/null $workdir/jack.fa $workdir/uniprot.fa",              3 * $Ljack * $Lprot ],
+    [ "nhmmer",     "$src/nhmmer    --cpu %CPU% -o /dev/null $dnamodel $workdir/genome.fa",                           $Mdna    * $Lgenome ],
+    [ "nhmmer-fm",  "$src/nhmmer    --cpu %CPU% -o /dev/null --tformat hmmerdb $dnamodel $workdir/genome.fmdb",       $Mdna    * $Lgenome ],
+    [ "hmmbuild",   "$src/hmmbuild  --cpu %CPU% -o /dev/null $workdir/build.hmm $workdir/pfam.sto",                   $ncols   ],
+    );
+
+%baseline = ();
+if ($basefile) { &read_baseline($basefile); }
+
+printf("# %-10s %5s %10s %14s %9s %9s\n", "program", "cpus", "seconds", "throughput", "scaling", "vs base");
+printf("# %-10s %5s %10s %14s %9s %9s\n", "-" x 10, "-----", "-" x 10, "-" x 14, "-" x 9, "-" x 9);
+@table = ();
+foreach $job (@jobs)
+{
+    ($name, $cmd, $work) = @$job;
+    $unit = ($name eq "hmmbuild") ? "cols/s" : "Mc/s";
+
+    # Warmup: an untimed run, to get the targets into the filesystem cache.
+    $c = $cmd; $c =~ s/%CPU%/$cpus[0]/;
+    system("$c > /dev/null 2>&1") == 0 || die "FAIL: $c\n";
+
+    $t1 = 0;
+    foreach $n (@cpus)
+    {
+        $c = $cmd; $c =~ s/%CPU%/$n/;
+        $t0 = time();
+        system("$c > /dev/null 2>&1") == 0 || die "FAIL: $c\n";
+        $secs = time() - $t0;
+
+        $tput    = ($name eq "hmmbuild") ? $work / $secs : $work / $secs / 1e6;
+        $t1      = $secs * $cpus[0] if ($n == $cpus[0]);
+        $scaling = $t1 / ($n * $secs);
+        $key     = "$name $n";
+        $vsbase  = defined($baseline{$key}) ? sprintf("%9.2f", $tput / $baseline{$key}) : sprintf("%9s", "-");
+
+        printf("  %-10s %5d %10.2f %9.1f %-4s %9.2f %s\n", $name, $n, $secs, $tput, $unit, $scaling, $vsbase);
+        push @table, sprintf("%-10s %5d %10.3f %12.3f %-6s %6.3f", $name, $n, $secs, $tput, $unit, $scaling);
+    }
+}
+
+if ($savefile)
+{
+    open(SAVE, ">$savefile") || die "failed to open $savefile";
+    print SAVE "# throughput.pl baseline: nseq $nseq L $seqlen genlen $genlen nscan $nscan nphmmer $nphmmer seed $seed\n";
+    print SAVE "# program   cpus    seconds   throughput unit   scaling\n";
+    foreach $line (@table) { print SAVE "$line\n"; }
+    close SAVE;
+}
+
+system("rm -rf $workdir");
+exit 0;
+
+
+# make_datasets()
+# Fixed-seed synthetic datasets in $workdir, unless real ones were given.
+sub make_datasets
+{
+    if ($pfam_hmm) { system("cp $pfam_hmm $workdir/pfam.hmm") == 0 || die "failed to copy $pfam_hmm"; }
+    else {
+        system("cat " . join(" ", map { "$top_srcdir/testsuite/$_.hmm" } @models) . " > $workdir/pfam.hmm") == 0 || die "failed to make pfam.hmm";
+    }
+    if    ($pfam_sto) { system("cp $pfam_sto $workdir/pfam.sto") == 0 || die "failed to copy $pfam_sto"; }
+    elsif (! $pfam_hmm) {
+        system("cat " . join(" ", map { "$top_srcdir/testsuite/$_.sto" } @models) . " > $workdir/pfam.sto") == 0 || die "failed to make pfam.sto";
+    }
+    else { die "--pfam needs --pfamsto, for the hmmbuild benchmark\n"; }
+    system("$src/hmmpress $workdir/pfam.hmm > /dev/null") == 0 || die "hmmpress failed";
+
+    if ($uniprot) { system("cp $uniprot $workdir/uniprot.fa") == 0 || die "failed to copy $uniprot"; }
+    else {
+        system("$miniapps/esl-shuffle -G --amino -N $nseq -L $seqlen --seed $seed -o $workdir/uniprot.fa") == 0 || die "esl-shuffle failed";
+        system("$src/hmmemit -N $nhomolog --seed $seed $workdir/pfam.hmm >> $workdir/uniprot.fa") == 0 || die "hmmemit failed";
+    }
+
+    if ($genome) { system("cp $genome $workdir/genome.fa") == 0 || die "failed to copy $genome"; }
+    else {
+        # one chromosome-like sequence: iid DNA, with homologs of the DNA model spliced in
+        system("$miniapps/esl-shuffle -G --dna -N 1 -L $genlen --seed $seed -o $workdir/genome.raw") == 0 || die "esl-shuffle failed";
+        system("$src/hmmemit -N $nhomolog --seed $seed $dnamodel > $workdir/genome.emit") == 0 || die "hmmemit failed";
+        &splice_genome("$workdir/genome.raw", "$workdir/genome.emit", "$workdir/genome.fa");
+    }
+    system("$src/makehmmerdb $workdir/genome.fa $workdir/genome.fmdb > /dev/null") == 0 || die "makehmmerdb failed";
+
+    # query subsets: the first seqs of the sample, and the last (a homolog) for jackhmmer
+    &first_seqs("$workdir/uniprot.fa", $nscan,   "$workdir/scan.fa");
+    &first_seqs("$workdir/uniprot.fa", $nphmmer, "$workdir/phmmer.fa");
+    system("$miniapps/esl-sfetch --index $workdir/uniprot.fa > /dev/null") == 0 || die "esl-sfetch --index failed";
+    $last = `grep '^>' $workdir/uniprot.fa | tail -1`;
+    ($lastname) = ($last =~ /^>(\S+)/);
+    system("$miniapps/esl-sfetch -o $workdir/jack.fa $workdir/uniprot.fa $lastname > /dev/null") == 0 || die "esl-sfetch failed";
+}
+
+# splice_genome(<rawfile>, <emitfile>, <outfile>)
+# Insert the emitted sequences into the single raw sequence, evenly spaced.
+sub splice_genome
+{
+    my ($rawfile, $emitfile, $outfile) = @_;
+    my ($seq, @ins, $cur, $i, $step, $out, $pos);
+
+    open(RAW, $rawfile) || die; while (<RAW>) { next if /^>/; chomp; $seq .= $_; } close RAW;
+    open(EMIT, $emitfile) || die;
+    $cur = undef;
+    while (<EMIT>) {
+        chomp;
+        if (/^>/) { push @ins, $cur if defined($cur); $cur = ""; }
+        else      { $cur .= $_; }
+    }
+    push @ins, $cur if defined($cur);
+    close EMIT;
+
+    $step = int(length($seq) / (scalar(@ins) + 1));
+    $out  = "";
+    $pos  = 0;
+    for ($i = 0; $i <= $#ins; $i++) {
+        $out .= substr($seq, $pos, $step) . $ins[$i];
+        $pos += $step;
+    }
+    $out .= substr($seq, $pos);
+
+    open(OUT, ">$outfile") || die;
+    print OUT ">genome\n";
+    for ($pos = 0; $pos < length($out); $pos += 60) { print OUT substr($out, $pos, 60), "\n"; }
+    close OUT;
+}
+
+sub first_seqs
+{
+    my ($seqfile, $n, $outfile) = @_;
+    my $count = 0;
+    open(IN, $seqfile) || die;
+    open(OUT, ">$outfile") || die;
+    while (<IN>) {
+        if (/^>/) { $count++; last if ($count > $n); }
+        print OUT;
+    }
+    close IN;
+    close OUT;
+}
+
+sub total_residues
+{
+    my ($seqfile) = @_;
+    my $output = `$miniapps/esl-seqstat $seqfile`;
+    if ($? != 0) { die "esl-seqstat failed on $seqfile"; }
+    if ($output =~ /^Total \# residues:\s+(\d+)/m) { return $1; }
+    die "failed to parse esl-seqstat output for $seqfile";
+}
+
+sub total_nodes
+{
+    my ($hmmfile) = @_;
+    my $M = 0;
+    open(HMM, $hmmfile) || die "failed to open $hmmfile";
+    while (<HMM>) { if (/^LENG\s+(\d+)/) { $M += $1; } }
+    close HMM;
+    return $M;
+}
+
+# total_columns(<stofile>): alignment columns, summed over the MSAs
+sub total_columns
+{
+    my ($stofile) = @_;
+    my ($ncols, $name, %seen, $s);
+    $ncols = 0;
+    open(STO, $stofile) || die "failed to open $stofile";
+    while (<STO>) {
+        if (/^\/\//)                  { %seen = (); next; }
+        if (/^#/ || /^\s*$/)          { next; }
+        if (/^(\S+)\s+(\S+)\s*$/) {
+            ($name, $s) = ($1, $2);
+            $seen{$name} .= $s;
+            if (scalar(keys %seen) == 1) { $ncols += length($s); }
+        }
+    }
+    close STO;
+    return $ncols;
+}
+
+sub read_baseline
+{
+    my ($file) = @_;
+    open(BASE, $file) || die "failed to open baseline $file";
+    while (<BASE>) {
+        next if /^#/;
+        if (/^(\S+)\s+(\d+)\s+\S+\s+(\S+)/) { $baseline{"$1 $2"} = $3; }
+    }
+    close BASE;
+}